@@ -0,0 +1,224 @@
+/** @file benchmark.hpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <thread>
+
+
+/**
+ * Minimal micro-benchmark harness (same model and same JSON output format as Google Benchmark so
+ * that the results can be processed by the same tools).
+ *
+ * A benchmark is a function taking a State. The body of the loop `while (state.run())` is timed
+ * and the number of iterations is increased until the loop lasts at least minTime() seconds.
+ * The setup code placed before the loop is not timed.
+ *
+ * @code
+ * bench::add("grid/set", [](bench::State & state)
+ *     {
+ *     Grid_basic<2, int> G;
+ *     int64 i = 0;
+ *     while (state.run()) { G.set({ i & 1023, i >> 10 }, 1); i++; }
+ *     state.setItemsProcessed(state.iterations());
+ *     });
+ * return bench::runAll(argc, argv);
+ * @endcode
+ **/
+namespace bench
+	{
+
+
+	/** Prevent the compiler from optimizing away the computation of v. **/
+	template<typename T> inline void doNotOptimize(const T & v)
+		{
+#if defined(_MSC_VER)
+		static const volatile void * sink; sink = &v;
+#else
+		asm volatile("" : : "r"(&v) : "memory");
+#endif
+		}
+
+
+	/** State of a running benchmark. **/
+	class State
+		{
+
+		public:
+
+			State(size_t maxIter) : _maxiter(maxIter), _iter(0), _items(0), _bytes(0) {}
+
+			/** Return true while the loop must run. The clock starts at the first call. **/
+			inline bool run()
+				{
+				if (_iter == 0) { _start = std::chrono::steady_clock::now(); }
+				if (_iter < _maxiter) { _iter++; return true; }
+				_stop = std::chrono::steady_clock::now();
+				return false;
+				}
+
+			/** Number of iterations of the loop. **/
+			size_t iterations() const { return _maxiter; }
+
+			/** Set the number of items processed by the whole loop (reported as items_per_second). **/
+			void setItemsProcessed(size_t n) { _items = n; }
+
+			/** Set the number of bytes processed by the whole loop (reported as bytes_per_second). **/
+			void setBytesProcessed(size_t n) { _bytes = n; }
+
+			/** Duration of the loop in seconds. **/
+			double seconds() const { return std::chrono::duration<double>(_stop - _start).count(); }
+
+			size_t items() const { return _items; }
+			size_t bytes() const { return _bytes; }
+
+		private:
+
+			size_t _maxiter, _iter, _items, _bytes;
+			std::chrono::steady_clock::time_point _start, _stop;
+		};
+
+
+	namespace internals_bench
+		{
+
+		struct Entry
+			{
+			std::string name;
+			std::function<void(State &)> fun;
+			};
+
+		inline std::vector<Entry> & registry() { static std::vector<Entry> R; return R; }
+
+		inline double & minTime() { static double t = 0.5; return t; }
+
+		inline std::string jsonEscape(const std::string & s)
+			{
+			std::string r;
+			for (char c : s) { if ((c == '"') || (c == '\\')) r += '\\'; r += c; }
+			return r;
+			}
+		}
+
+
+	/** Register a benchmark. **/
+	inline void add(const std::string & name, std::function<void(State &)> fun) { internals_bench::registry().push_back({ name, fun }); }
+
+
+	/** Minimum duration of the timed loop of each benchmark, in seconds. **/
+	inline double minTime() { return internals_bench::minTime(); }
+
+
+	/**
+	 * Run the registered benchmarks. Command line options:
+	 *
+	 * --filter=str     only run the benchmarks whose name contains str.
+	 * --min_time=t     minimum duration of the timed loop (default 0.5 second).
+	 * --out=file       write the JSON report in file instead of the standard output.
+	 *
+	 * A summary is printed on stderr as the benchmarks run.
+	 *
+	 * @return 0 (to be returned by main).
+	 **/
+	inline int runAll(int argc, char ** argv)
+		{
+		std::string filter, out;
+		for (int i = 1; i < argc; i++)
+			{
+			const std::string a(argv[i]);
+			if (a.compare(0, 9, "--filter=") == 0) { filter = a.substr(9); }
+			else if (a.compare(0, 11, "--min_time=") == 0) { internals_bench::minTime() = std::stod(a.substr(11)); }
+			else if (a.compare(0, 6, "--out=") == 0) { out = a.substr(6); }
+			else { std::fprintf(stderr, "usage: %s [--filter=str] [--min_time=seconds] [--out=file.json]\n", argv[0]); return 1; }
+			}
+		std::ostringstream js;
+		js << "{\n  \"context\": {\n";
+		js << "    \"date\": \"" << __DATE__ << " " << __TIME__ << "\",\n";
+		js << "    \"num_cpus\": " << std::thread::hardware_concurrency() << ",\n";
+#if defined(NDEBUG)
+		js << "    \"library_build_type\": \"release\"\n";
+#else
+		js << "    \"library_build_type\": \"debug\"\n";
+#endif
+		js << "  },\n  \"benchmarks\": [";
+		bool first = true;
+		for (auto & e : internals_bench::registry())
+			{
+			if ((filter.size() > 0) && (e.name.find(filter) == std::string::npos)) continue;
+			size_t n = 1;
+			State st(n);
+			while (1)
+				{ // increase the number of iterations until the loop lasts long enough
+				st = State(n);
+				e.fun(st);
+				const double t = st.seconds();
+				if ((t >= internals_bench::minTime()) || (n >= ((size_t)1 << 40))) break;
+				const double f = (t <= 0.0) ? 100.0 : (1.4 * internals_bench::minTime() / t);
+				n = (size_t)(n * ((f > 100.0) ? 100.0 : ((f < 2.0) ? 2.0 : f)));
+				}
+			const double ns = st.seconds() * 1.0e9 / st.iterations();
+			std::fprintf(stderr, "%-50s %14.1f ns %12zu iterations", e.name.c_str(), ns, st.iterations());
+			js << (first ? "\n" : ",\n") << "    {\n";
+			js << "      \"name\": \"" << internals_bench::jsonEscape(e.name) << "\",\n";
+			js << "      \"iterations\": " << st.iterations() << ",\n";
+			js << "      \"real_time\": " << ns << ",\n";
+			js << "      \"time_unit\": \"ns\"";
+			if (st.items() > 0)
+				{
+				const double r = st.items() / st.seconds();
+				std::fprintf(stderr, "  %12.4g items/s", r);
+				js << ",\n      \"items_per_second\": " << r;
+				}
+			if (st.bytes() > 0)
+				{
+				const double r = st.bytes() / st.seconds();
+				std::fprintf(stderr, "  %12.4g bytes/s", r);
+				js << ",\n      \"bytes_per_second\": " << r;
+				}
+			js << "\n    }";
+			std::fprintf(stderr, "\n");
+			first = false;
+			}
+		js << "\n  ]\n}\n";
+		if (out.size() > 0)
+			{
+			std::ofstream f(out);
+			f << js.str();
+			if (!f) { std::fprintf(stderr, "error writing %s\n", out.c_str()); return 1; }
+			}
+		else
+			{
+			std::fwrite(js.str().data(), 1, js.str().size(), stdout);
+			}
+		return 0;
+		}
+
+
+	}
+
+
+/* end of file */
+
@@ -0,0 +1,330 @@
+/***************************************************************************************************
+* Micro-benchmarks for mtools.
+*
+* Build the (non default) target bench_mtools and run it with --out=file.json to save the results.
+* Compare two runs to detect performance regressions. See benchmark.hpp for the options.
+****************************************************************************************************/
+
+#include "mtools/containers/grid_basic.hpp"
+#include "mtools/containers/treefigure.hpp"
+#include "mtools/random/gen_mt2002_32.hpp"
+#include "mtools/random/gen_mt2004_64.hpp"
+#include "mtools/random/gen_xorgen4096_64.hpp"
+#include "mtools/random/gen_fastRNG.hpp"
+#include "mtools/random/gen_buffered.hpp"
+#include "mtools/random/classiclaws.hpp"
+#include "mtools/random/peelinglaw.hpp"
+#include "mtools/graphics/image.hpp"
+#include "mtools/maths/circlePacking.hpp"
+
+#include "benchmark.hpp"
+
+using namespace mtools;
+
+
+/* sequential positions in a 1024 x 1024 square */
+inline iVec2 seqPos(size_t i) { return iVec2((int64)(i & 1023) - 512, (int64)((i >> 10) & 1023) - 512); }
+
+
+/* random positions in a 1024 x 1024 square (precomputed) */
+const std::vector<iVec2> & randomPos()
+	{
+	static std::vector<iVec2> tab;
+	if (tab.size() == 0)
+		{
+		MT2004_64 gen(1);
+		tab.resize(1 << 16);
+		for (auto & p : tab) { p = iVec2(Unif_int(-512, 511, gen), Unif_int(-512, 511, gen)); }
+		}
+	return tab;
+	}
+
+
+/* triangulated n x n square (triangular lattice) and its boundary, for the circle packing */
+void triangulatedSquare(int n, std::vector<std::vector<int> > & gr, std::vector<int> & boundary)
+	{
+	gr.assign(n * n, std::vector<int>());
+	boundary.assign(n * n, 0);
+	const int dx[6] = { 1, 1, 0, -1, -1, 0 };
+	const int dy[6] = { 0, 1, 1, 0, -1, -1 };	// counterclockwise
+	for (int j = 0; j < n; j++) for (int i = 0; i < n; i++)
+		{
+		const int v = i + n * j;
+		if ((i == 0) || (j == 0) || (i == n - 1) || (j == n - 1)) boundary[v] = 1;
+		for (int k = 0; k < 6; k++)
+			{
+			const int a = i + dx[k], b = j + dy[k];
+			if ((a >= 0) && (b >= 0) && (a < n) && (b < n)) gr[v].push_back(a + n * b);
+			}
+		}
+	}
+
+
+/* register the benchmarks of a random generator */
+template<typename GEN> void addGenerator(const std::string & name)
+	{
+	bench::add("random/" + name + "/operator()", [](bench::State & state)
+		{
+		GEN gen(1);
+		while (state.run()) { auto v = gen(); bench::doNotOptimize(v); }
+		state.setItemsProcessed(state.iterations());
+		});
+	bench::add("random/" + name + "/Unif", [](bench::State & state)
+		{
+		GEN gen(1);
+		while (state.run()) { double v = Unif(gen); bench::doNotOptimize(v); }
+		state.setItemsProcessed(state.iterations());
+		});
+	}
+
+
+void addGrids()
+	{
+	bench::add("grid_basic/set/sequential", [](bench::State & state)
+		{
+		Grid_basic<2, int64> G;
+		size_t i = 0;
+		while (state.run()) { G.set(seqPos(i), (int64)i); i++; }
+		state.setItemsProcessed(state.iterations());
+		});
+	bench::add("grid_basic/set/random", [](bench::State & state)
+		{
+		Grid_basic<2, int64> G;
+		const auto & P = randomPos();
+		size_t i = 0;
+		while (state.run()) { G.set(P[i & 65535], (int64)i); i++; }
+		state.setItemsProcessed(state.iterations());
+		});
+	bench::add("grid_basic/get/sequential", [](bench::State & state)
+		{
+		Grid_basic<2, int64> G;
+		for (size_t i = 0; i < (1 << 20); i++) G.set(seqPos(i), (int64)i);
+		const Grid_basic<2, int64> & CG = G;
+		size_t i = 0;
+		while (state.run()) { bench::doNotOptimize(CG.get(seqPos(i))); i++; }
+		state.setItemsProcessed(state.iterations());
+		});
+	bench::add("grid_basic/get/random", [](bench::State & state)
+		{
+		Grid_basic<2, int64> G;
+		for (size_t i = 0; i < (1 << 20); i++) G.set(seqPos(i), (int64)i);
+		const Grid_basic<2, int64> & CG = G;
+		const auto & P = randomPos();
+		size_t i = 0;
+		while (state.run()) { bench::doNotOptimize(CG.get(P[i & 65535])); i++; }
+		state.setItemsProcessed(state.iterations());
+		});
+	bench::add("grid_basic/peek/random", [](bench::State & state)
+		{
+		Grid_basic<2, int64> G;
+		for (size_t i = 0; i < (1 << 19); i++) G.set(seqPos(i), (int64)i); // half of the square
+		const auto & P = randomPos();
+		size_t i = 0;
+		while (state.run()) { bench::doNotOptimize(G.peek(P[i & 65535])); i++; }
+		state.setItemsProcessed(state.iterations());
+		});
+	bench::add("grid_basic/peek/sequential_cursor", [](bench::State & state)
+		{
+		Grid_basic<2, int64> G;
+		for (size_t i = 0; i < (1 << 20); i++) G.set(seqPos(i), (int64)i);
+		Grid_basic<2, int64>::Cursor C;
+		size_t i = 0;
+		while (state.run()) { bench::doNotOptimize(G.peek(seqPos(i), C)); i++; }
+		state.setItemsProcessed(state.iterations());
+		});
+	bench::add("grid_factor/findFullBox", [](bench::State & state)
+		{
+		Grid_factor<2, int64, 1> G(0, 0, false);
+		MT2004_64 gen(2);
+		for (int k = 0; k < 20000; k++) G.set(iVec2(Unif_int(-300, 300, gen), Unif_int(-300, 300, gen)), 1);
+		const auto & P = randomPos();
+		iBox2 B;
+		size_t i = 0;
+		while (state.run()) { bench::doNotOptimize(G.findFullBox(P[i & 65535], B)); i++; }
+		state.setItemsProcessed(state.iterations());
+		});
+	}
+
+
+void addRandom()
+	{
+	addGenerator<MT2002_32>("MT2002_32");
+	addGenerator<MT2004_64>("MT2004_64");
+	addGenerator<XorGen4096_64>("XorGen4096_64");
+	addGenerator<FastRNG>("FastRNG");
+	bench::add("random/BufferedGen<MT2004_64>/operator()", [](bench::State & state)
+		{
+		MT2004_64 base(1);
+		BufferedGen<MT2004_64> gen(base);
+		while (state.run()) { auto v = gen(); bench::doNotOptimize(v); }
+		state.setItemsProcessed(state.iterations());
+		});
+
+	bench::add("laws/Unif_int", [](bench::State & state)
+		{
+		MT2004_64 gen(3);
+		while (state.run()) { int64 v = Unif_int(0, 999, gen); bench::doNotOptimize(v); }
+		state.setItemsProcessed(state.iterations());
+		});
+	bench::add("laws/NormalLaw", [](bench::State & state)
+		{
+		MT2004_64 gen(3); NormalLaw law;
+		while (state.run()) { double v = law(gen); bench::doNotOptimize(v); }
+		state.setItemsProcessed(state.iterations());
+		});
+	bench::add("laws/NormalLaw/ziggurat_fill", [](bench::State & state)
+		{
+		MT2004_64 gen(3); NormalLaw law(0.0, 1.0, true);
+		std::vector<double> buf(1024);
+		while (state.run()) { law.fill(gen, buf.data(), buf.size()); bench::doNotOptimize(buf[0]); }
+		state.setItemsProcessed(state.iterations() * buf.size());
+		});
+	bench::add("laws/ExponentialLaw", [](bench::State & state)
+		{
+		MT2004_64 gen(3); ExponentialLaw law(2.0);
+		while (state.run()) { double v = law(gen); bench::doNotOptimize(v); }
+		state.setItemsProcessed(state.iterations());
+		});
+	bench::add("laws/GeometricLaw", [](bench::State & state)
+		{
+		MT2004_64 gen(3); GeometricLaw law(0.3);
+		while (state.run()) { int64 v = law(gen); bench::doNotOptimize(v); }
+		state.setItemsProcessed(state.iterations());
+		});
+	bench::add("laws/BinomialLaw", [](bench::State & state)
+		{
+		MT2004_64 gen(3); BinomialLaw law(1000, 0.3);
+		while (state.run()) { int v = law(gen); bench::doNotOptimize(v); }
+		state.setItemsProcessed(state.iterations());
+		});
+	bench::add("laws/UIHPTLaw", [](bench::State & state)
+		{
+		MT2004_64 gen(3);
+		while (state.run()) { int64 v = UIHPTLaw(gen); bench::doNotOptimize(v); }
+		state.setItemsProcessed(state.iterations());
+		});
+	bench::add("laws/UIPTLaw", [](bench::State & state)
+		{
+		MT2004_64 gen(3);
+		while (state.run()) { int64 v = UIPTLaw(100, gen); bench::doNotOptimize(v); }
+		state.setItemsProcessed(state.iterations());
+		});
+	bench::add("laws/freeBoltzmanTriangulationLaw", [](bench::State & state)
+		{
+		MT2004_64 gen(3);
+		while (state.run()) { int64 v = freeBoltzmanTriangulationLaw(100, gen); bench::doNotOptimize(v); }
+		state.setItemsProcessed(state.iterations());
+		});
+	}
+
+
+void addImages()
+	{
+	bench::add("image/blend/512x512", [](bench::State & state)
+		{
+		Image dst(1024, 1024, RGBc::c_White);
+		Image src(512, 512, RGBc::c_Red.getMultOpacity(0.5f));
+		while (state.run()) { dst.blend(src, 100, 100, 0.7f); }
+		state.setItemsProcessed(state.iterations() * 512 * 512);
+		});
+	bench::add("image/blit/512x512", [](bench::State & state)
+		{
+		Image dst(1024, 1024, RGBc::c_White);
+		Image src(512, 512, RGBc::c_Red);
+		while (state.run()) { dst.blit(src, 100, 100); }
+		state.setItemsProcessed(state.iterations() * 512 * 512);
+		});
+	for (int quality : { 0, 5, 10 })
+		{
+		bench::add("image/get_rescale/1024->317/quality_" + std::to_string(quality), [quality](bench::State & state)
+			{
+			Image src(1024, 1024);
+			MT2004_64 gen(4);
+			for (int64 j = 0; j < 1024; j++) for (int64 i = 0; i < 1024; i++) { src(i, j) = RGBc((uint32)gen() | 0xFF000000); }
+			while (state.run()) { Image im = src.get_rescale(quality, 317, 317); bench::doNotOptimize(im); }
+			state.setItemsProcessed(state.iterations() * 317 * 317);
+			});
+		}
+	bench::add("image/draw_line/aa_blend", [](bench::State & state)
+		{
+		Image im(1024, 1024, RGBc::c_White);
+		size_t i = 0;
+		while (state.run()) { im.draw_line(iVec2(0, (int64)(i & 1023)), iVec2(1023, 1023 - (int64)(i & 1023)), RGBc::c_Blue.getMultOpacity(0.5f), true, true, true); i++; }
+		state.setItemsProcessed(state.iterations());
+		});
+	bench::add("image/draw_filled_circle/r100", [](bench::State & state)
+		{
+		Image im(1024, 1024, RGBc::c_White);
+		while (state.run()) { im.draw_filled_circle(iVec2(512, 512), 100, RGBc::c_Black, RGBc::c_Green.getMultOpacity(0.5f), true, true); }
+		state.setItemsProcessed(state.iterations());
+		});
+	bench::add("image/draw_box/200x200", [](bench::State & state)
+		{
+		Image im(1024, 1024, RGBc::c_White);
+		while (state.run()) { im.draw_box(100, 100, 200, 200, RGBc::c_Red.getMultOpacity(0.5f), true); }
+		state.setItemsProcessed(state.iterations() * 200 * 200);
+		});
+	}
+
+
+void addTreeFigure()
+	{
+	bench::add("treefigure/iterate_intersect", [](bench::State & state)
+		{
+		typedef TreeFigure<int, 10> Tree;
+		Tree T;
+		MT2004_64 gen(5);
+		for (int k = 0; k < 200000; k++)
+			{
+			const double x = Unif(0, 1000, gen), y = Unif(0, 1000, gen), r = Unif(0, 2, gen);
+			T.insert(Tree::BBox(x - r, x + r, y - r, y + r), k);
+			}
+		size_t i = 0, nb = 0;
+		while (state.run())
+			{
+			const double x = (double)((i * 37) % 950), y = (double)((i * 91) % 950);
+			nb += T.iterate_intersect(Tree::BBox(x, x + 50, y, y + 50), [](const Tree::BoundedObject & bo) { bench::doNotOptimize(bo); });
+			i++;
+			}
+		bench::doNotOptimize(nb);
+		state.setItemsProcessed(nb);
+		});
+	}
+
+
+void addCirclePacking()
+	{
+	for (int n : { 30, 100 })
+		{
+		bench::add("circlepacking/computeRadii/" + std::to_string(n) + "x" + std::to_string(n), [n](bench::State & state)
+			{
+			std::vector<std::vector<int> > gr;
+			std::vector<int> boundary;
+			triangulatedSquare(n, gr, boundary);
+			CirclePackingLabel<double> P;
+			P.setTriangulation(gr, boundary);
+			int64 it = 0;
+			while (state.run())
+				{
+				P.setRadii();
+				it += P.computeRadii(1.0e-9);
+				}
+			bench::doNotOptimize(it);
+			});
+		}
+	}
+
+
+int main(int argc, char ** argv)
+	{
+	addGrids();
+	addRandom();
+	addImages();
+	addTreeFigure();
+	addCirclePacking();
+	return bench::runAll(argc, argv);
+	}
+
+
+/* end of file */
+
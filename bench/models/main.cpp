@@ -0,0 +1,466 @@
+/***************************************************************************************************
+* Headless model benchmarks.
+*
+* Fixed-seed and fixed-size versions of the simulations of the examples directory (without
+* graphics) used to measure how changes in the library affect the throughput of real simulations.
+*
+* usage: bench_models [--filter=str] [--scale=k] [--seed=s] [--out=file.json]
+*
+* --filter=str     only run the models whose name contains str.
+* --scale=k        multiply the size of each simulation by k (default 1).
+* --seed=s         seed of the random generators (default 1).
+* --out=file       write the JSON report in file instead of the standard output.
+*
+* For each model, the report contains the number of steps and sites, the steps per second, the time
+* needed to reach 1/4, 1/2 and all the sites and the peak resident set size of the process. The peak
+* RSS is a maximum over the whole process: use --filter to run a single model per process when
+* comparing memory usage.
+****************************************************************************************************/
+
+#include "mtools/containers/grid_basic.hpp"
+#include "mtools/containers/randomurn.hpp"
+#include "mtools/random/gen_mt2004_64.hpp"
+#include "mtools/random/classiclaws.hpp"
+#include "mtools/random/SRW.hpp"
+using namespace mtools;
+
+#include "../../examples/CMPonZ2/CMPMerger.hpp"
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cmath>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+
+/* peak resident set size of the process in bytes */
+size_t peakRSS()
+	{
+#if defined(_WIN32)
+	PROCESS_MEMORY_COUNTERS info;
+	GetProcessMemoryInfo(GetCurrentProcess(), &info, sizeof(info));
+	return (size_t)info.PeakWorkingSetSize;
+#else
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+#if defined(__APPLE__)
+	return (size_t)ru.ru_maxrss;			// bytes on OSX
+#else
+	return (size_t)ru.ru_maxrss * 1024;		// kilobytes on Linux
+#endif
+#endif
+	}
+
+
+/* measures of a model run */
+class Report
+	{
+
+	public:
+
+		Report(const std::string & name, int64 targetSites) : _name(name), _target(targetSites), _steps(0), _sites(0), _next(1), _start(std::chrono::steady_clock::now()) {}
+
+		/* record the progress of the simulation: records the time when sites reaches 1/4, 1/2 and all of
+		 * the target (no record if the target is 0) */
+		inline void progress(int64 steps, int64 sites)
+			{
+			_steps = steps;
+			_sites = sites;
+			while ((_target > 0) && (_next <= 4) && (sites * 4 >= _target * _next))
+				{
+				_checkpoints.push_back(std::make_pair(sites, _elapsed()));
+				_next *= 2;
+				}
+			}
+
+		/* stop the clock and return the json description */
+		std::string finish()
+			{
+			const double t = _elapsed();
+			const size_t rss = peakRSS();
+			std::fprintf(stderr, "%-16s %12lld steps %10lld sites %9.3f s %14.4g steps/s %10.1f MB peak RSS\n", _name.c_str(), (long long)_steps, (long long)_sites, t, _steps / t, rss / 1048576.0);
+			std::ostringstream js;
+			js << "    {\n";
+			js << "      \"name\": \"" << _name << "\",\n";
+			js << "      \"steps\": " << _steps << ",\n";
+			js << "      \"sites\": " << _sites << ",\n";
+			js << "      \"seconds\": " << t << ",\n";
+			js << "      \"steps_per_second\": " << (_steps / t) << ",\n";
+			js << "      \"peak_rss\": " << rss << ",\n";
+			js << "      \"time_to_sites\": [";
+			for (size_t i = 0; i < _checkpoints.size(); i++) { js << ((i == 0) ? "" : ", ") << "{ \"sites\": " << _checkpoints[i].first << ", \"seconds\": " << _checkpoints[i].second << " }"; }
+			js << "]\n    }";
+			return js.str();
+			}
+
+	private:
+
+		double _elapsed() const { return std::chrono::duration<double>(std::chrono::steady_clock::now() - _start).count(); }
+
+		std::string _name;
+		int64 _target, _steps, _sites, _next;
+		std::chrono::steady_clock::time_point _start;
+		std::vector<std::pair<int64, double> > _checkpoints;
+	};
+
+
+/***************************************************************************************************
+* internal DLA on Z^2 (examples/iDLA_2D), sequential version. A step is a walker added to the cluster.
+****************************************************************************************************/
+std::string benchIDLA(int64 nbwalkers, uint64 seed)
+	{
+	Grid_factor<2, char, 2, 5> Grid;
+	Grid.reset(0, 1, false);
+	Grid.set(0, 0, 1);
+	MT2004_64 gen(seed);
+	Report rep("iDLA_2D", nbwalkers);
+	for (int64 n = 1; n <= nbwalkers; n++)
+		{
+		iVec2 pos(0, 0);
+		int k = 101;
+		while (Grid(pos) == 1)
+			{
+			if (k > 100)
+				{
+				iBox2 fullR;
+				Grid.findFullBox(pos, fullR);
+				if (fullR.min[0] == fullR.max[0]) { SRW_Z2_1step(pos, gen); k = 0; }
+				else
+					{
+					fullR.min[0]--; fullR.max[0]++; fullR.min[1]--; fullR.max[1]++;
+					SRW_Z2_MoveInRect(pos, fullR, 16, gen);
+					}
+				}
+			else { SRW_Z2_1step(pos, gen); k++; }
+			}
+		Grid.set(pos, 1);
+		rep.progress(n, n + 1);
+		}
+	return rep.finish();
+	}
+
+
+/***************************************************************************************************
+* Eden model (examples/Eden). A step is a site picked in the boundary.
+****************************************************************************************************/
+std::string benchEden(int64 nbsites, uint64 seed)
+	{
+	Grid_factor<2, char, 2> Grid(5, 5, false);
+	RandomUrn<iVec2> Urn;
+	MT2004_64 gen(seed);
+	Grid.set({ 0,0 }, 4); Urn.insert({ 0,0 });
+	Report rep("Eden", nbsites);
+	int64 N = 0, steps = 0;
+	while (N < nbsites)
+		{
+		steps++;
+		iVec2 & rpos = Urn(Unif(gen));
+		if (Unif(gen) * 4 >= (4 - Grid(rpos)))
+			{
+			iVec2 pos = rpos;
+			Urn.remove(rpos);
+			Grid.set(pos, 5);
+			iVec2 upPos(pos.X(), pos.Y() + 1); char up = Grid(upPos); if (up == 0) { Urn.insert(upPos); } if (up != 5) { Grid.set(upPos, up + 1); }
+			iVec2 downPos(pos.X(), pos.Y() - 1); char down = Grid(downPos); if (down == 0) { Urn.insert(downPos); } if (down != 5) { Grid.set(downPos, down + 1); }
+			iVec2 leftPos(pos.X() + 1, pos.Y()); char left = Grid(leftPos); if (left == 0) { Urn.insert(leftPos); } if (left != 5) { Grid.set(leftPos, left + 1); }
+			iVec2 rightPos(pos.X() - 1, pos.Y()); char right = Grid(rightPos); if (right == 0) { Urn.insert(rightPos); } if (right != 5) { Grid.set(rightPos, right + 1); }
+			N++;
+			rep.progress(steps, N);
+			}
+		}
+	rep.progress(steps, N);
+	return rep.finish();
+	}
+
+
+/***************************************************************************************************
+* Tree Eden model (examples/TreeEden). A step is a site picked in the boundary.
+****************************************************************************************************/
+struct TreeEdenSite
+	{
+	TreeEdenSite() : N(0), direction(0) {}
+	int64 N;
+	char direction;
+	};
+
+std::string benchTreeEden(int64 nbsites, uint64 seed)
+	{
+	Grid_basic<2, TreeEdenSite> Grid;
+	RandomUrn<iVec2> Urn;
+	MT2004_64 gen(seed);
+	Grid(0, 0).direction = 1; Urn.insert({ 0,0 });
+	Report rep("TreeEden", nbsites);
+	int64 N = 0, steps = 0;
+	while ((N < nbsites) && (Urn.size() > 0))
+		{
+		steps++;
+		iVec2 & rpos = Urn(Unif(gen));
+		iVec2 pos = rpos;
+		Urn.remove(rpos);
+		auto & S = Grid(pos);
+		if (S.direction == 1)
+			{
+			N++;
+			S.N = N;
+			iVec2 upPos(pos.X(), pos.Y() + 1); auto & up = Grid(upPos); if (up.N > 0) { S.direction = 1; } else { if ((up.direction)++ == 0) Urn.insert(upPos); }
+			iVec2 downPos(pos.X(), pos.Y() - 1); auto & down = Grid(downPos); if (down.N > 0) { S.direction = 2; } else { if ((down.direction)++ == 0) Urn.insert(downPos); }
+			iVec2 leftPos(pos.X() - 1, pos.Y()); auto & left = Grid(leftPos); if (left.N > 0) { S.direction = 3; } else { if ((left.direction)++ == 0) Urn.insert(leftPos); }
+			iVec2 rightPos(pos.X() + 1, pos.Y()); auto & right = Grid(rightPos); if (right.N > 0) { S.direction = 4; } else { if ((right.direction)++ == 0) Urn.insert(rightPos); }
+			rep.progress(steps, N);
+			}
+		}
+	rep.progress(steps, N);
+	return rep.finish();
+	}
+
+
+/***************************************************************************************************
+* Linearly edge reinforced random walk (examples/LERRW_2D). A step is a step of the walk, the sites
+* are the distinct sites visited.
+****************************************************************************************************/
+struct LERRWSite
+	{
+	LERRWSite() : up(1.0), right(1.0), V(0) {}
+	double up, right;
+	int64 V;
+	};
+
+std::string benchLERRW(int64 steps, uint64 seed)
+	{
+	const double delta = 2.0;
+	Grid_basic<2, LERRWSite> G;
+	MT2004_64 gen(seed);
+	iVec2 pos(0, 0);
+	int64 range = 0;
+	Report rep("LERRW_2D", 0);
+	for (int64 n = 1; n <= steps; n++)
+		{
+		LERRWSite & S = G[pos];
+		if (S.V == 0) { range++; }
+		S.V++;
+		double & right = S.right;
+		double & up = S.up;
+		double & left = G(pos.X() - 1, pos.Y()).right;
+		double & down = G(pos.X(), pos.Y() - 1).up;
+		const double e = Unif(gen)*(left + right + up + down);
+		if (e < left) { left += delta; pos.X()--; }
+		else if (e < (left + right)) { right += delta; pos.X()++; }
+		else if (e < (left + right + up)) { up += delta; pos.Y()++; }
+		else { down += delta; pos.Y()--; }
+		if ((n & 1023) == 0) rep.progress(n, range);
+		}
+	rep.progress(steps, range);
+	return rep.finish();
+	}
+
+
+/***************************************************************************************************
+* Once reinforced random walk (examples/OERRW_2D). A step is a step of the walk (the long runs
+* inside the trace count as a single step), the sites are the distinct sites visited.
+****************************************************************************************************/
+std::string benchOERRW(int64 nbsites, uint64 seed)
+	{
+	const double delta = 5.0;
+	const char maskup = 1, maskright = 2, maskdown = 4, maskleft = 8;
+	const char maskfull = (maskup | maskdown | maskleft | maskright);
+	Grid_factor<2, char, 1, 5> G;
+	G.reset(maskfull, maskfull, false);
+	MT2004_64 gen(seed);
+	iVec2 pos(0, 0);
+	int64 N = 0, steps = 0, lastb = 0;
+	Report rep("OERRW_2D", nbsites);
+	char v = G(pos);
+	while (N < nbsites)
+		{
+		steps++;
+		if (v == maskfull)
+			{ // inside the trace: simple random walk
+			if (lastb < 100) { SRW_Z2_1step(pos, gen); lastb++; }
+			else
+				{
+				int64 d;
+				do
+					{
+					iBox2 fullR;
+					G.findFullBoxCentered(pos, fullR);
+					fullR.min[0]--; fullR.max[0]++; fullR.min[1]--; fullR.max[1]++;
+					d = SRW_Z2_MoveInRect(pos, fullR, 8, gen);
+					}
+				while (d > 0);
+				}
+			v = G(pos);
+			continue;
+			}
+		lastb = 0;
+		const double up = ((v & maskup) ? delta : 1.0);
+		const double right = ((v & maskright) ? delta : 1.0);
+		const double down = ((v & maskdown) ? delta : 1.0);
+		const double left = ((v & maskleft) ? delta : 1.0);
+		const double a = Unif(gen)*(up + right + down + left);
+		char mask, back; iVec2 np = pos;
+		if (a < up) { mask = maskup; back = maskdown; np.Y()++; }
+		else if (a < up + right) { mask = maskright; back = maskleft; np.X()++; }
+		else if (a < up + right + down) { mask = maskdown; back = maskup; np.Y()--; }
+		else { mask = maskleft; back = maskright; np.X()--; }
+		if ((v & mask) == 0)
+			{
+			G.set(pos, v | mask);
+			pos = np; v = G(pos);
+			if (v == 0) { N++; rep.progress(steps, N); }
+			v |= back; G.set(pos, v);
+			}
+		else { pos = np; v = G(pos); }
+		}
+	rep.progress(steps, N);
+	return rep.finish();
+	}
+
+
+/***************************************************************************************************
+* CMP of a percolation on a box of Z^2 (examples/CMPonZ2). The whole CMP is computed at once: the
+* number of steps and sites is the number of sites of the box.
+****************************************************************************************************/
+struct CMPSite : public CMPHook<CMPSite, 1>
+	{
+	inline int nbneighbour()
+		{
+		if ((X == 0) || (X == LX - 1)) { return (((Y == 0) || (Y == LY - 1)) ? 2 : 3); }
+		return 4;
+		}
+
+	inline CMPSite * neighbour(int index)
+		{
+		if (X == 0) { if (index == 0) return (this + 1); if (Y == 0) return (this + LX); if (index == 1) return (this - LX); return (this + LX); }
+		if (X == LX - 1) { if (index == 0) return (this - 1); if (Y == 0) return (this + LX); if (index == 1) return (this - LX); return (this + LX); }
+		if (Y == 0) { if (index == 0) return (this + LX); if (index == 1) return (this - 1); return (this + 1); }
+		if (Y == LY - 1) { if (index == 0) return (this - LX); if (index == 1) return (this - 1); return (this + 1); }
+		switch (index)
+			{
+			case 0: return (this - 1);
+			case 1: return (this + 1);
+			case 2: return (this - LX);
+			}
+		return (this + LX);
+		}
+
+	inline double radius() const { return rad; }
+
+	double rad;
+	int X, Y, LX, LY;
+	};
+
+std::string benchCMP(int L, uint64 seed)
+	{
+	const double a = 0.12;
+	MT2004_64 gen(seed);
+	std::vector<CMPSite> box((size_t)L * L);
+	for (int j = 0; j < L; j++) for (int i = 0; i < L; i++)
+		{
+		CMPSite & S = box[i + (size_t)j * L];
+		S.X = i; S.Y = j; S.LX = L; S.LY = L; S.rad = ((Unif(gen) < a) ? 1.0 : 0.0);
+		}
+	Report rep("CMPonZ2", (int64)L * L);
+		{
+		CMPMerger<CMPSite> cmpMerger(box.data());
+		if (cmpMerger.nbClusters() > 0) rep.progress((int64)L * L, (int64)L * L);
+		}
+	return rep.finish();
+	}
+
+
+/***************************************************************************************************
+* Infinite noodle (examples/infiniteNoodle): construction of the arcs and of the clusters. The number
+* of steps and sites is the number of sites.
+****************************************************************************************************/
+std::string benchNoodle(int L, uint64 seed)
+	{
+	MT2004_64 gen(seed);
+	Report rep("infiniteNoodle", L);
+	std::vector<int> upArc(L), downArc(L), clusterId(L, -1), stack;
+	for (std::vector<int> * tab : { &upArc, &downArc })
+		{
+		stack.clear();
+		for (int i = 0; i < L; i++)
+			{
+			if (Unif_1(gen)) { (*tab)[i] = L; stack.push_back(i); }
+			else if (stack.size() == 0) { (*tab)[i] = -1; }
+			else { const int j = stack.back(); (*tab)[i] = j; (*tab)[j] = i; stack.pop_back(); }
+			}
+		}
+	int64 nbclusters = 0, done = 0;
+	for (int i = 0; i < L; i++)
+		{
+		if (clusterId[i] != -1) continue;
+		// follow the cluster in both directions
+		for (int dir = 0; dir < 2; dir++)
+			{
+			int pos = i;
+			bool useup = (dir == 0);
+			while (1)
+				{
+				if (clusterId[pos] == -1) { clusterId[pos] = (int)nbclusters; done++; }
+				pos = (useup ? upArc[pos] : downArc[pos]);
+				useup = !useup;
+				if ((pos == -1) || (pos == L) || (pos == i)) break;
+				}
+			if (pos == i) break; // complete cluster
+			}
+		nbclusters++;
+		rep.progress(done, done);
+		}
+	return rep.finish();
+	}
+
+
+int main(int argc, char ** argv)
+	{
+	std::string filter, out;
+	int64 scale = 1;
+	uint64 seed = 1;
+	for (int i = 1; i < argc; i++)
+		{
+		const std::string a(argv[i]);
+		if (a.compare(0, 9, "--filter=") == 0) { filter = a.substr(9); }
+		else if (a.compare(0, 8, "--scale=") == 0) { scale = std::stoll(a.substr(8)); if (scale < 1) scale = 1; }
+		else if (a.compare(0, 7, "--seed=") == 0) { seed = std::stoull(a.substr(7)); }
+		else if (a.compare(0, 6, "--out=") == 0) { out = a.substr(6); }
+		else { std::fprintf(stderr, "usage: %s [--filter=str] [--scale=k] [--seed=s] [--out=file.json]\n", argv[0]); return 1; }
+		}
+	auto sel = [&](const char * name) { return ((filter.size() == 0) || (std::string(name).find(filter) != std::string::npos)); };
+	std::vector<std::string> res;
+	if (sel("iDLA_2D")) res.push_back(benchIDLA(20000 * scale, seed));
+	if (sel("Eden")) res.push_back(benchEden(5000000 * scale, seed));
+	if (sel("TreeEden")) res.push_back(benchTreeEden(2000000 * scale, seed));
+	if (sel("LERRW_2D")) res.push_back(benchLERRW(50000000 * scale, seed));
+	if (sel("OERRW_2D")) res.push_back(benchOERRW(200000 * scale, seed));
+	if (sel("CMPonZ2")) res.push_back(benchCMP((int)(1000 * std::sqrt((double)scale)), seed));
+	if (sel("infiniteNoodle")) res.push_back(benchNoodle((int)(10000000 * scale), seed));
+	std::ostringstream js;
+	js << "{\n  \"context\": {\n    \"date\": \"" << __DATE__ << " " << __TIME__ << "\",\n    \"seed\": " << seed << ",\n    \"scale\": " << scale << "\n  },\n  \"models\": [\n";
+	for (size_t i = 0; i < res.size(); i++) { js << res[i] << ((i + 1 < res.size()) ? ",\n" : "\n"); }
+	js << "  ]\n}\n";
+	if (out.size() > 0)
+		{
+		std::ofstream f(out);
+		f << js.str();
+		if (!f) { std::fprintf(stderr, "error writing %s\n", out.c_str()); return 1; }
+		}
+	else
+		{
+		std::fwrite(js.str().data(), 1, js.str().size(), stdout);
+		}
+	return 0;
+	}
+
+
+/* end of file */
+
@@ -0,0 +1,69 @@
+# Try to find the LZ4 compression library
+# This search module defines
+#
+#  LZ4_FOUND and LZ4_alt_FOUND if the library is found
+#  LZ4_INCLUDE_DIRS - the lz4 include directory
+#  LZ4_LIBRARIES    - the required libraries
+#
+
+
+if (LZ4_alt_FOUND) 
+	return()
+endif()
+
+
+if (VCPKG_TOOLCHAIN)
+	# use vcpkg to find lz4
+	find_library(LZ4_LIBRARY_RELEASE lz4)
+	find_library(LZ4_LIBRARY_DEBUG lz4d)
+	find_path(LZ4_INCLUDE_DIRS "lz4frame.h")
+	
+	if (LZ4_LIBRARY_RELEASE AND LZ4_INCLUDE_DIRS)
+		if (NOT LZ4_LIBRARY_DEBUG)
+			set(LZ4_LIBRARY_DEBUG ${LZ4_LIBRARY_RELEASE})
+		endif()
+		select_library_configurations(LZ4) # create LZ4_LIBRARIES from LZ4_LIBRARY_DEBUG and LZ4_LIBRARY_RELEASE
+		message(STATUS "Found LZ4 (via vcpkg): release [${LZ4_LIBRARY_RELEASE}]  debug [${LZ4_LIBRARY_DEBUG}]")
+		set(LZ4_FOUND 1)
+	endif()
+endif()
+
+
+if (NOT LZ4_FOUND)
+	#try to find lz4 the usual way
+	
+	find_package(PkgConfig QUIET)
+
+	if (PKG_CONFIG_FOUND)
+		pkg_search_module(LZ4 liblz4 QUIET)
+		if (LZ4_FOUND)
+			find_library(LZ4_LIBRARY lz4 HINTS ${LZ4_LIBRARY_DIRS})
+			set(LZ4_LIBRARIES ${LZ4_LIBRARY})
+			message(STATUS "Found LZ4 (pkg-config): [${LZ4_LIBRARIES}]")
+			set(LZ4_FOUND 1)
+		endif()
+	endif()
+
+	if (NOT LZ4_FOUND)
+		find_library(LZ4_LIBRARY lz4)
+		find_path(LZ4_INCLUDE_DIRS "lz4frame.h")
+		if (LZ4_LIBRARY AND LZ4_INCLUDE_DIRS)
+			set(LZ4_LIBRARIES ${LZ4_LIBRARY})
+			message(STATUS "Found LZ4 (direct search): [${LZ4_LIBRARIES}]")
+			set(LZ4_FOUND 1)
+		endif()
+	endif()
+endif()
+
+
+if (LZ4_FOUND)
+	set(LZ4_alt_FOUND 1)
+else()
+	if (LZ4_alt_FIND_REQUIRED)
+		message(SEND_ERROR "LZ4 NOT found")
+	else()
+		message(STATUS "LZ4 NOT found.")
+	endif()
+endif()
+
+mark_as_advanced(LZ4_LIBRARIES LZ4_INCLUDE_DIRS LZ4_LIBRARY)
@@ -0,0 +1,69 @@
+# Try to find the Zstandard compression library
+# This search module defines
+#
+#  ZSTD_FOUND and ZSTD_alt_FOUND if the library is found
+#  ZSTD_INCLUDE_DIRS - the zstd include directory
+#  ZSTD_LIBRARIES    - the required libraries
+#
+
+
+if (ZSTD_alt_FOUND) 
+	return()
+endif()
+
+
+if (VCPKG_TOOLCHAIN)
+	# use vcpkg to find zstd
+	find_library(ZSTD_LIBRARY_RELEASE zstd)
+	find_library(ZSTD_LIBRARY_DEBUG zstdd)
+	find_path(ZSTD_INCLUDE_DIRS "zstd.h")
+	
+	if (ZSTD_LIBRARY_RELEASE AND ZSTD_INCLUDE_DIRS)
+		if (NOT ZSTD_LIBRARY_DEBUG)
+			set(ZSTD_LIBRARY_DEBUG ${ZSTD_LIBRARY_RELEASE})
+		endif()
+		select_library_configurations(ZSTD) # create ZSTD_LIBRARIES from ZSTD_LIBRARY_DEBUG and ZSTD_LIBRARY_RELEASE
+		message(STATUS "Found ZSTD (via vcpkg): release [${ZSTD_LIBRARY_RELEASE}]  debug [${ZSTD_LIBRARY_DEBUG}]")
+		set(ZSTD_FOUND 1)
+	endif()
+endif()
+
+
+if (NOT ZSTD_FOUND)
+	#try to find zstd the usual way
+	
+	find_package(PkgConfig QUIET)
+
+	if (PKG_CONFIG_FOUND)
+		pkg_search_module(ZSTD libzstd QUIET)
+		if (ZSTD_FOUND)
+			find_library(ZSTD_LIBRARY zstd HINTS ${ZSTD_LIBRARY_DIRS})
+			set(ZSTD_LIBRARIES ${ZSTD_LIBRARY})
+			message(STATUS "Found ZSTD (pkg-config): [${ZSTD_LIBRARIES}]")
+			set(ZSTD_FOUND 1)
+		endif()
+	endif()
+
+	if (NOT ZSTD_FOUND)
+		find_library(ZSTD_LIBRARY zstd)
+		find_path(ZSTD_INCLUDE_DIRS "zstd.h")
+		if (ZSTD_LIBRARY AND ZSTD_INCLUDE_DIRS)
+			set(ZSTD_LIBRARIES ${ZSTD_LIBRARY})
+			message(STATUS "Found ZSTD (direct search): [${ZSTD_LIBRARIES}]")
+			set(ZSTD_FOUND 1)
+		endif()
+	endif()
+endif()
+
+
+if (ZSTD_FOUND)
+	set(ZSTD_alt_FOUND 1)
+else()
+	if (ZSTD_alt_FIND_REQUIRED)
+		message(SEND_ERROR "Zstandard NOT found")
+	else()
+		message(STATUS "Zstandard NOT found.")
+	endif()
+endif()
+
+mark_as_advanced(ZSTD_LIBRARIES ZSTD_INCLUDE_DIRS ZSTD_LIBRARY)
@@ -41,11 +41,10 @@ struct LERRWPlot
         }
 
 
-    /* detail : image associated with a site */
-    static const Image * getImage(mtools::iVec2 p, mtools::iVec2 size)
+    /* detail : configuration of the image associated with a site */
+    static EdgeSiteImage siteImage(mtools::iVec2 p)
         {
         const siteInfo * S = G.peek(p);
-        if ((S == nullptr) || (S->V == 0)) return nullptr;
         EdgeSiteImage ES;
         //if (pos == p) { ES.bkColor(RGBc::c_Black.getOpacity(0.5)); }      // uncomment to display the current position
         ES.site(true, RGBc::jetPaletteLog(S->V, 0, maxV, logscale));
@@ -58,7 +57,25 @@ struct LERRWPlot
         if (down > 1.0) { ES.down(ES.EDGE, RGBc::jetPaletteLog(down / maxE, logscale)); }
         if (left > 1.0) { ES.left(ES.EDGE, RGBc::jetPaletteLog(left / maxE, logscale)); ES.textleft(mtools::toString((int64)((left - 1) / delta))); }
         if (right > 1.0) { ES.right(ES.EDGE, RGBc::jetPaletteLog(right / maxE, logscale)); }
-        ES.makeImage(image, size);
+        return ES;
+        }
+
+
+    /* detail : key of the image associated with a site (sites with the same configuration share their sprite) */
+    static uint64 getImageKey(mtools::iVec2 p)
+        {
+        const siteInfo * S = G.peek(p);
+        if ((S == nullptr) || (S->V == 0)) return 0;
+        return siteImage(p).key();
+        }
+
+
+    /* detail : image associated with a site */
+    static const Image * getImage(mtools::iVec2 p, mtools::iVec2 size)
+        {
+        const siteInfo * S = G.peek(p);
+        if ((S == nullptr) || (S->V == 0)) return nullptr;
+        siteImage(p).makeImage(image, size);
         return(&image);
         }
 
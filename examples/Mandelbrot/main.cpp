@@ -8,29 +8,6 @@ using namespace mtools;
 
 volatile int inIt = 256; // initial number of iterations 
 
-/* Mandelbrot
-simple RGBc return type
--> multiple call for the same pixel are blended together
-*/
-RGBc mandelbrot(const fVec2 & pos, const fBox2 & R, int32 nbiter)
-    {
-    int nbi = inIt + nbiter * (inIt/10);
-    const double cx = pos.X();
-    const double cy = pos.Y();
-    double X = 0.0;
-    double Y = 0.0;
-    for (int i = 0; i < nbi; i++)
-        {
-        const double sX = X;
-        const double sY = Y;
-        X = sX*sX - sY*sY + cx;
-        Y = 2 * sX*sY + cy;
-        if ((X*X + Y*Y) > 4) { return RGBc::jetPalette(i, 1, nbi); }
-        }
-    return RGBc::c_Black;
-    }
-
-
 /* Douady's rabbit
 here, the return type is 'std::pair<RGBc,bool>' 
 -> setting the bool to true forces the returned color to overwrite previous color at the same pixel. 
@@ -61,10 +38,16 @@ int main(int argc, char *argv[])
     cout << "**************************************\n";
     cout << "Drawing Mandelbrot + Douady's rabbit.\n";
     cout << "**************************************\n";
-    inIt = arg('n', 256).info("initial number of iterations");
+    inIt = arg('n', 256).info("initial number of iterations for the rabbit");
+    const int maxit = arg("maxit", 5000).info("maximum number of iterations for the Mandelbrot set");
+    const std::string cre = arg("re", std::string("0")).info("real part of the center (any number of digits)");
+    const std::string cim = arg("im", std::string("0")).info("imaginary part of the center (any number of digits)");
+    MandelbrotEngine E(maxit);  // double iteration / perturbation around the center for deep zooms
+    E.setCenter(cre, cim);      // the plane shows c - center (the rabbit stays in absolute coordinates)
+    cout << "escape time kernel: " << MandelbrotEngine::kernelName() << "\n";
     Plotter2D Plotter;  // create the plotter
     int nb = nbHardwareThreads(); // total number of thread we can use
-    auto M = makePlot2DPlane(mandelbrot, nb/2, "Mandelbrot Set"); // the mandelbrot set
+    auto M = makePlot2DPlane(E, nb/2, "Mandelbrot Set"); // the mandelbrot set
     auto D = makePlot2DPlane(rabbit, nb-1 - nb/2, "Douady's rabbit"); // the mandelbrot set
     Plotter[M][D];
     Plotter.sensibility(1);
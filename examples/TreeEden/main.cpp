@@ -80,11 +80,10 @@ public:
         if ((v == nullptr) || ((*v).N == 0)) return RGBc::c_Transparent; else return RGBc::jetPalette((*v).N, 1, N);
         }
 
-    /* detail : image associated with a site */
-    const Image * getImage(mtools::iVec2 pos, mtools::iVec2 size)
+    /* detail : configuration of the image associated with a site */
+    EdgeSiteImage siteImage(mtools::iVec2 pos)
         {
         auto v = Grid.peek(pos);
-        if ((v == nullptr) || ((*v).N == 0)) return nullptr;
         EdgeSiteImage ES;
         ES.site(true, RGBc::jetPalette((*v).N, 1, N));
         ES.text(mtools::toString(v->N)).textColor(RGBc::c_White);
@@ -96,7 +95,23 @@ public:
         auto down = Grid.peek(pos.X(), pos.Y() - 1); if ((down != nullptr) && (down->N >0) && (down->direction == 1)) { ES.down(ES.EDGE); }
         auto left = Grid.peek(pos.X() - 1, pos.Y()); if ((left != nullptr) && (left->N >0) && (left->direction == 4)) { ES.left(ES.EDGE); }
         auto right = Grid.peek(pos.X() + 1, pos.Y()); if ((right != nullptr) && (right->N >0) && (right->direction == 3)) { ES.right(ES.EDGE); }
-        ES.makeImage(image, size);
+        return ES;
+        }
+
+    /* detail : key of the image associated with a site (sites with the same configuration share their sprite) */
+    uint64 getImageKey(mtools::iVec2 pos)
+        {
+        auto v = Grid.peek(pos);
+        if ((v == nullptr) || ((*v).N == 0)) return 0;
+        return siteImage(pos).key();
+        }
+
+    /* detail : image associated with a site */
+    const Image * getImage(mtools::iVec2 pos, mtools::iVec2 size)
+        {
+        auto v = Grid.peek(pos);
+        if ((v == nullptr) || ((*v).N == 0)) return nullptr;
+        siteImage(pos).makeImage(image, size);
         return(&image);
         }
 
@@ -6,39 +6,41 @@
 #include "mtools/mtools.hpp"  
 using namespace mtools;
 
-MT2004_64  gen;	// the random number generator
-
 Grid_factor<2, char, 2,5> Grid;   // the grid
 
 volatile int64 N; //number of walkers sent
 
 
-/* send a given number of walkers */
-void makeCluster(int nb)
+/* walk from the origin until exiting the cluster */
+iVec2 walker(AggregationView<decltype(Grid)> & view, MT2004_64 & g)
     {
-    for (int i = 0;i < nb;i++) 
+    iVec2 pos(0, 0);
+    int k = 101;
+    while(view.get(pos) == 1) 
         {
-        iVec2 pos(0, 0);
-        int k = 101;
-        while(Grid.get(pos) == 1) 
-            {
-            if (k > 100) {
-                iBox2 fullR;
-                Grid.findFullBox(pos, fullR);
-                if (fullR.min[0] == fullR.max[0]) { SRW_Z2_1step(pos, gen); k = 0; }
-                else 
-                    {
-                    fullR.min[0]--; fullR.max[0]++; fullR.min[1]--; fullR.max[1]++;
-                    SRW_Z2_MoveInRect(pos, fullR, 16, gen);
-                    }
-                }
-            else  { 
-                SRW_Z2_1step(pos, gen); k++; 
+        if (k > 100) {
+            iBox2 fullR;
+            view.findFullBox(pos, fullR);
+            if (fullR.min[0] == fullR.max[0]) { SRW_Z2_1step(pos, g); k = 0; }
+            else 
+                {
+                fullR.min[0]--; fullR.max[0]++; fullR.min[1]--; fullR.max[1]++;
+                SRW_Z2_MoveInRect(pos, fullR, 16, g);
                 }
             }
-        Grid.set(pos, 1);
-        N++;
+        else  { 
+            SRW_Z2_1step(pos, g); k++; 
+            }
         }
+    return pos;
+    }
+
+
+/* send a given number of walkers */
+void makeCluster(ParallelAggregation<decltype(Grid)> & PA, int nb)
+    {
+    PA.run(nb, walker);
+    N = PA.nbWalkers();
     }
 
 
@@ -67,8 +69,10 @@ int main(int argc, char *argv[])
     cout << "internal DLA on Z2\n";
     cout << "******************************\n";
     int autoredraw = arg('a', 600).info("autoredraw rate");
+    int nbthreads = arg('t', 0).info("number of threads (0 = all)");
     Grid.reset(0, 1, false);
     Grid.set(0, 0, 1); // initial cluster. 
+    ParallelAggregation<decltype(Grid)> PA(Grid, 1, randomID(), nbthreads);
     Plotter2D P;
     auto Cl = makePlot2DLattice(colorCluster, "iDLA cluster"); P[Cl]; Cl.opacity(0.5);
     auto Ci = makePlot2DLattice(colorCircle, "Circle"); P[Ci]; Ci.opacity(0.5);
@@ -78,7 +82,7 @@ int main(int argc, char *argv[])
     watch("# of particles", N);
     while (P.shown())
         {
-        makeCluster(1000);
+        makeCluster(PA, 1000);
         }
     return 0;
 	}
@@ -26,6 +26,7 @@
 #include "../misc/stringfct.hpp"
 
 #include <string>
+#include <algorithm>
 
 
 /****************************************************************************************************
@@ -294,7 +295,7 @@ public:
         std::string s;
         s += "*****************************************************\n";
         s += "TreeGraph object statistics\n\n";
-        s += "- Memory allocated         : " + mtools::toString(((sizeof(TreeNode)*tab_size)+(sizeof(size_t)*(tab_size+5)))/(1024*1024)) + "Mb\n";
+        s += "- Memory allocated         : " + mtools::toString(((sizeof(TreeNode)*tab_size)+(sizeof(uint32)*(tab_size+5)))/(1024*1024)) + "Mb\n";
         s += "- Number of cleanup done   : " + mtools::toString(NbCleanUp()) + "\n";
         s += "- Number of step performed : " + mtools::toString(NbSteps()) + "\n"; 
         s += "- Depth of the memory root : " + mtools::toString(MemoryRootDepth()) + "\n";
@@ -402,7 +403,7 @@ private:
     /*******************
      * the variables   *
      ******************/
-    size_t * repart;    // array for the repartition of the depth
+    uint32 * repart;    // distance of each node to the actual position (used when cutting the tree)
     TreeNode * tab;     // the array of nodes itself
     size_t tab_size;    // size of the array tab
     size_t median;      // size of the median (approx. number of site we keep when we cut the tree)
@@ -428,14 +429,15 @@ private:
     *****************/
     void init(uint32 SizeMB,double ratiokept)
     {
-        tab_size = (((size_t)SizeMB)*1024*1024)/(sizeof(TreeNode)+sizeof(size_t));
+        tab_size = (((size_t)SizeMB)*1024*1024)/(sizeof(TreeNode)+sizeof(uint32));
         if (tab_size < 267000) {MTOOLS_ERROR("TreeGraph::TreeGraph(), SizeMB too small. Must be enough to create at least 267000 nodes !");}
+        if (((uint64)tab_size) > (uint64)4000000000) {tab_size = (size_t)4000000000;} // distances are stored on 32 bits
         median = (size_t)(((double)tab_size)*ratiokept);
         if (median < 133000) {median = 133000;}
         if ((median + 133000) > tab_size) {median = tab_size - 133000;}
         try {
             tab = new TreeNode[tab_size];
-            repart = new size_t[tab_size+5];
+            repart = new uint32[tab_size+5];
             }
         catch(...) {MTOOLS_ERROR("TreeGraph::TreeGraph(), Out of memory !");}
         if ((tab == NULL)||(repart == NULL)) {MTOOLS_ERROR("TreeGraph::TreeGraph(), Out of memory !");}
@@ -574,85 +576,48 @@ private:
      * the set of site with flag1 set verify condition 1) and 2) of the *
      * CondenseTree() function.                                         *
      * return the root of the subtree with flag1 set.                   *
+     *                                                                  *
+     * The nodes in [SITE_FIRST_POS,tab_free[ are exactly the nodes of  *
+     * the tree and a node is always stored after its father (sons are *
+     * appended at the end and CondenseTree() keeps the order) so the   *
+     * distances are computed by linear scans of the array instead of a *
+     * walk of the tree.                                                *
      *******************************************************************/
     size_t CutTree(size_t limit)
     {
-        // CLEAR THE REPART TAB
-        for(size_t i=0;i<(tab_size+5);i++) {repart[i] = 0;}
         // CLEAR FLAG1 AND DIRFLAG IN THE ARRAY
-        for(size_t i=0;i<tab_size;i++) {tab[i].unsetflag1(); tab[i].unsetdirflag();} 
+        for(size_t i=SITE_FIRST_POS;i<tab_free;i++) {tab[i].unsetflag1(); tab[i].unsetdirflag();} 
         // MAKE DIRECTION PATH AND GET DISTANCE OF THE ACTUAL POSITION TO THE ROOT
         size_t d = 0;  size_t p = tab_pos;
         while(p >= SITE_FIRST_POS) {tab[p].setdirflag(); p = tab[p].father(); d++;} d--;
-        // FILL THE REPART TAB
-        p = SITE_FIRST_POS;             // start at the root
-        while(p!=SITE_NOT_CREATED)      // iterate until we have visited all the site
-            {
-            repart[d]++;                // add the distance for the node
-            Next(d,p,SITE_FIRST_POS);   // get the next node and its distance
-            }
-        // FIND THE MEDIAN
-        size_t cumul = 0; size_t i = 0; while(cumul < limit) {cumul += repart[i]; i++;}
+        // COMPUTE THE DISTANCE OF EVERY NODE TO THE ACTUAL POSITION
+        repart[SITE_FIRST_POS] = (uint32)d;
+        for(p = SITE_FIRST_POS + 1; p < tab_free; p++) {repart[p] = (tab[p].dirflag() ? (repart[tab[p].father()] - 1) : (repart[tab[p].father()] + 1));}
+        // FIND THE MEDIAN: i-1 is the distance of the limit-th closest node
+        const size_t nbnodes = tab_free - SITE_FIRST_POS;
+        if ((limit == 0)||(limit > nbnodes)) { MTOOLS_ERROR("TreeGraph::CutTree(), invalid median!");}
+        std::nth_element(repart + SITE_FIRST_POS, repart + SITE_FIRST_POS + (limit - 1), repart + tab_free);
+        size_t i = ((size_t)repart[SITE_FIRST_POS + limit - 1]) + 1;
         if (i < 3) { MTOOLS_ERROR("TreeGraph::CutTree(), cannot keep any site, median too small!");}
         // FIND THE NEW ROOT AT DISTANCE <= i-2
         size_t nroot = tab_pos; d = 0;
         for(size_t j=0;j<(i-2);j++) {if (tab[nroot].father() >= SITE_FIRST_POS) {d++; nroot = tab[nroot].father();}}
         // SAVE THE DEPTH OF THE NEW MEMORY ROOT
         memrootdepth = depth - d;
-        // ITERATE ON THE SUBTREE STARTING AT nroot AND FLAG THE NODE WE KEEP
-        p = nroot;      // start at this new root
-        while(p!=SITE_NOT_CREATED)      // iterate
+        // FLAG THE NODES OF THE SUBTREE ROOTED AT nroot WHICH ARE AT DISTANCE < i (their fathers are flagged before them)
+        tab[nroot].setflag1(); repart[nroot] = (uint32)d;
+        for(p = nroot + 1; p < tab_free; p++)
             {
-            if (d < i) {tab[p].setflag1();}       // keep the nodes at distance < i
-            else {tab[p].setson(SITE_DESTROYED);} // otherwise, remove the children so we do not visit them
-            Next(d,p,SITE_FIRST_POS);             // get the next node and its distance
+            const size_t f = tab[p].father();
+            if (!tab[f].flag1()) continue;    // father not kept, or not in the subtree
+            repart[p] = (tab[p].dirflag() ? (repart[f] - 1) : (repart[f] + 1));
+            if (repart[p] < i) {tab[p].setflag1();}
             }
         // RETURN THE NEW ROOT
         return nroot;
     }
 
 
-    /****************************************************
-    * move to the next node and update the position     *
-    * p and the depth value (relative to the direction  *
-    * path if any).                                     *
-    * return SITE_NOT_CREATED when we are finished      *
-    *****************************************************/
-    inline void Next(size_t & depth,size_t & p,size_t root)
-        {
-            if (tab[p].son() >= SITE_FIRST_POS) {goson(depth,p); return;} // if there is a son, we go there
-            if (p==root) {p = SITE_NOT_CREATED; return;}                  // if at the root we are done
-            while(tab[p].lastbrother())                                   // find the first ancestor with a brother which is not the root
-                {
-                gofather(depth,p);
-                if (p==root) {p = SITE_NOT_CREATED; return;}
-                }
-            gobrother(depth,p);
-        }
-
-
-    /***********************************************
-     * go to the first son and update the depth    *
-     * relatively to the direction path if any     *
-     * do not check that the son exist !           *
-     **********************************************/
-    inline void goson(size_t & depth,size_t & p)        {p = tab[p].son(); if (tab[p].dirflag()) {depth--;} else {depth++;}}
-
-    /***********************************************
-     * go to the next brother and update the depth *
-     * relatively to the direction path if any     *
-     * do not check that the brother exist !       *
-     **********************************************/
-    inline void gobrother(size_t & depth,size_t & p)    {if (tab[p].dirflag()) {depth += 2;} else {if (tab[p+1].dirflag()) {depth -= 2;}} p++;}
-
-    /***********************************************
-     * go to the father and update the depth       *
-     * relatively to the direction path if any     *
-     * do not check that the father exist !        *
-     **********************************************/
-    inline void gofather(size_t & depth,size_t & p)     {if (tab[p].dirflag()) {depth++;} else {depth--;} p = tab[p].father();}
-
-
     /***********************************************
     * The TreeBox class used for creating a string *
     * representing the tree                        *
@@ -26,12 +26,25 @@
 #include "../misc/misc.hpp"
 
 #include <string>
+#include <vector>
 #include <math.h>
 #include <limits.h>
+#include <string.h>
+#include <atomic>
+#include <thread>
+#include <functional>
 
 
 namespace mtools
 {
+
+    namespace internals_bitgraph
+    {
+        /* log2 of the number of objects of size sz in a chunk of about 1MB (at most 2^16 objects) */
+        constexpr int chunkBits(size_t sz, int b) { return (((sz << (b + 1)) > (((size_t)1) << 20)) || (b >= 16)) ? b : chunkBits(sz, b + 1); }
+    }
+
+
     /**
      * Class representing square of Z^2 centered at zero (ie of the form [-X,X-1]^2) where each site
      * is represented by exactle 1 bit i.e. each site is either set or unset. Factorize full/empty
@@ -59,6 +72,24 @@ namespace mtools
      * }
      * @endcode.
      *
+     * Besides the per-site methods, the graph can be accessed by words of 64 horizontal sites
+     * (getRow64(), setRow64(), unsetRow64()). The word-level methods neighbourCount64(),
+     * neighbourMask64(), countSet() and floodFill() process 64 sites at once with shifts and
+     * popcount and are much faster than loops over the sites.
+     *
+     * The subsquares are allocated on demand, by chunks, up to the maximum number given to the
+     * constructor (which can be raised with reserve()). The main square can be enlarged with grow():
+     * the existing subsquares are re-embedded in the new grid without being copied. With
+     * autoGrow(true), setting a site outside of the square grows it and running out of subsquares
+     * doubles the maximum instead of stopping the program.
+     *
+     * cleanup() releases the full and empty subsquares without moving the others, the freed
+     * subsquares being reused by later allocations. A single writer thread may call set(), unset(),
+     * setRow64(), unsetRow64(), cleanup(), grow(), reserve() and clear() while any number of other
+     * threads read the graph with concurrentGet(): the memory of the released subsquares and of the
+     * old grids is only reused once no reader can access it anymore. The other read methods
+     * (get(), getRow64()...) must not be used concurrently with the writer.
+     *
      * @tparam  N   Each subsquare is of size 8N x 8N.
     **/
     template<int32 N> class BitGraphZ2
@@ -67,10 +98,10 @@ namespace mtools
 
 
         /**
-         * Constructor. The memory used is about 16L^2 + V(8N^2 + 16)
+         * Constructor. The memory used is at most about 16L^2 + V(8N^2 + 16)
          *
          * @param   L   the main square is of size 2L x 2L.
-         * @param   V   Number of subsquare to allocate
+         * @param   V   Maximum number of subsquare to allocate
         **/
         BitGraphZ2(int32 L, int32 V) 
             {
@@ -96,7 +127,13 @@ namespace mtools
         /**
          * Destructor.
         **/
-        ~BitGraphZ2() {delete [] MStab; delete [] Grid;}
+        ~BitGraphZ2()
+            {
+            for (int32 i = 0; i < _nbchunks; i++) { delete [] _chunks[i]; }
+            delete [] _chunks;
+            delete [] Grid;
+            delete _view.load();
+            }
 
 
         /**
@@ -107,8 +144,11 @@ namespace mtools
             minx = LLONG_MAX; maxx = LLONG_MIN;
             miny = LLONG_MAX; maxy = LLONG_MIN;
             totset=0; 
+            for(size_t i=0;i<((size_t)(4*LL*LL));i++) {_storeGrid(i,-1);}
+            _synchronize(); // no reader can access the subsquares anymore
             v=0; 
-            for(size_t i=0;i<((size_t)(4*LL*LL));i++) {Grid[i]=-1;}
+            _nbused=0;
+            _free.clear();
             }
 
 
@@ -128,12 +168,39 @@ namespace mtools
             int32 p = Grid[Gpos];
             if (p == -1) {return false;}
             if (p == -2) {return true;}
-            unsigned char a = MStab[Grid[Gpos]].get((rx%(8*N)),(ry%(8*N)));
+            unsigned char a = _sq(p).get((rx%(8*N)),(ry%(8*N)));
             if (a!= 0) {return true;}
             return false;
             }
 
 
+        /**
+         * Same as get() but can be called while another thread modifies the graph (see the class
+         * description). A site modified during the call may be reported in its old or new state.
+         *
+         * @param   x   The x coordinate.
+         * @param   y   The y coordinate.
+         *
+         * @return  return true if the point is set and false otherwise.
+        **/
+        inline bool concurrentGet(int64 x,int64 y) const
+            {
+            std::atomic<int64> * guard = _rdEnter();
+            const _View * W = _view.load();
+            bool res = false;
+            int64 rx = (8*W->L*N) + x; int64 ry = (8*W->L*N) + y;
+            if ((rx >= 0) && (rx < 16*(W->L*N)) && (ry >= 0) && (ry < 16*(W->L*N)))
+                {
+                size_t Gpos = (size_t)((rx/(8*N)) + ((2*W->L)*(ry/(8*N))));
+                int32 p = reinterpret_cast<std::atomic<int32>&>(W->grid[Gpos]).load(std::memory_order_acquire);
+                if (p == -2) { res = true; }
+                else if (p >= 0) { res = (W->chunks[p >> _CHUNK_BITS][p & _CHUNK_MASK].get((rx%(8*N)),(ry%(8*N))) != 0); }
+                }
+            guard->fetch_sub(1);
+            return res;
+            }
+
+
         /**
          * Set the point at a given coordinate. Does nothing is outside of the whole square.
          *
@@ -146,14 +213,15 @@ namespace mtools
             if (y > maxy) {maxy = y;}
             if (x < minx) {minx = x;}
             if (y < miny) {miny = y;}
+            if ((_autogrow) && ((x < minV()) || (x > maxV()) || (y < minV()) || (y > maxV()))) { _growToContain(x, y); }
             int64 rx = (8*LL*N) + x; int64 ry = (8*LL*N) + y;
             if ((rx < 0) || (rx >= 16 * (LL*N))) { return; }
             if ((ry < 0)||(ry >= 16*(LL*N))) { return; }
             size_t Gpos = (size_t)((rx/(8*N)) + ((2*LL)*(ry/(8*N))));
             int32 p = Grid[Gpos];
             if (p == -2) {return;}
-            if (p == -1) {if (v == VV) {cleanup(); if (v == VV) {MTOOLS_ERROR("BitGraphZ2::Set(), out of memory !"); }} Grid[Gpos] = v; MStab[v].reset0(Gpos); v++;}
-            MStab[Grid[Gpos]].set((rx%(8*N)),(ry%(8*N)),totset);
+            if (p == -1) {p = _newSquare(Gpos, false, "BitGraphZ2::Set()");}
+            _sq(p).set((rx%(8*N)),(ry%(8*N)),totset);
             }
 
 
@@ -174,8 +242,8 @@ namespace mtools
             size_t Gpos = (size_t)((rx/(8*N)) + ((2*LL)*(ry/(8*N))));
             int32 p = Grid[Gpos];
             if (p == -1) {return;}
-            if (p == -2) {if (v == VV) {cleanup(); if (v == VV) {MTOOLS_ERROR("BitGraphZ2::Unset(), out of memory !"); }} Grid[Gpos] = v; MStab[v].reset1(Gpos); v++;}
-            MStab[Grid[Gpos]].unset((rx%(8*N)),(ry%(8*N)),totset);
+            if (p == -2) {p = _newSquare(Gpos, true, "BitGraphZ2::Unset()");}
+            _sq(p).unset((rx%(8*N)),(ry%(8*N)),totset);
             }
 
 
@@ -245,15 +313,15 @@ namespace mtools
             s += "- lattice represented : [ " + toString(minV()) + " , " + toString(maxV()) + " ]^2\n";
             s += "- Main grid size      : [ " + toString(-LL) + " , " + toString(LL-1) + " ]^2 (" + toString((4*sizeof(int32)*LL*LL)/(1024*1024)) + "Mb)\n";
             s += "- Size of a subsquare : " + toString(N*8) + " x " + toString(N*8) + " (" + toString(sizeof(_MSQ)) + "b each)\n";
-            s += "- Number of subsquare : " + toString(VV) + " (" + toString(((int64)VV)*sizeof(_MSQ) /(1024*1024)) + "Mb)\n\n";
+            s += "- Number of subsquare : " + toString(VV) + " max, " + toString(((int64)_nbchunks) << _CHUNK_BITS) + " allocated (" + toString((((int64)_nbchunks) << _CHUNK_BITS)*sizeof(_MSQ) /(1024*1024)) + "Mb)\n\n";
             s += "Number of point set : " + toString(nbSet()) + "\n";
             s += "Surrounding square : ";
             if (minX() != LLONG_MAX) {
             s += "[ " + toString(minX()) + " , " + toString(maxX()) + " ] x [ " + toString(minY()) + " , " + toString(maxY()) + " ]\n";
             } else {s += "No point set yet !\n";}
-            s += "Memory used before cleanup\t" + toString(v) + "/" + toString(VV) + " (" + toString((int)(100*(((double)v)/((double)VV))))+ "%)\n";
+            s += "Memory used before cleanup\t" + toString(_nbused) + "/" + toString(VV) + " (" + toString((int)(100*(((double)_nbused)/((double)VV))))+ "%)\n";
             cleanup();
-            s += "Memory used after cleanup\t" + toString(v) + "/" + toString(VV) + " (" + toString((int)(100*(((double)v)/((double)VV))))+ "%)\n";
+            s += "Memory used after cleanup\t" + toString(_nbused) + "/" + toString(VV) + " (" + toString((int)(100*(((double)_nbused)/((double)VV))))+ "%)\n";
             s += "*****************************************************\n";
             return s;            
         }
@@ -310,15 +378,286 @@ namespace mtools
 
 
 
+        /**
+         * Return the states of 64 consecutive sites of a row: bit i of the result is set if site
+         * (x + i, y) is set. Sites outside of the whole square are unset.
+         *
+         * @param   x   The x coordinate of the first site.
+         * @param   y   The y coordinate of the row.
+         *
+         * @return  The 64 sites (x, y), (x+1, y), ..., (x+63, y) as a bit mask.
+        **/
+        inline uint64 getRow64(int64 x, int64 y) const
+            {
+            const int64 S = 8 * N;
+            int64 ry = (8*LL*N) + y;
+            if ((ry < 0) || (ry >= 16 * (LL*N))) { return 0; }
+            int64 rx = (8*LL*N) + x;
+            uint64 res = 0;
+            int done = 0;
+            if (rx < 0) { if (rx <= -64) return 0; done = (int)(-rx); rx = 0; }
+            while ((done < 64) && (rx < 16 * (LL*N)))
+                {
+                const int64 ox = rx % S;
+                const int len = (int)(((64 - done) < (S - ox)) ? (64 - done) : (S - ox));
+                const int32 p = Grid[(size_t)((rx / S) + ((2 * LL)*(ry / S)))];
+                if (p != -1) { res |= ((p == -2) ? _lowMask(len) : _sq(p).getBits(ox, ry % S, len)) << done; }
+                done += len; rx += len;
+                }
+            return res;
+            }
+
+
+        /**
+         * Set all the sites (x + i, y) for which bit i of mask is set. Sites outside of the whole
+         * square are ignored.
+         *
+         * @param   x       The x coordinate of the first site.
+         * @param   y       The y coordinate of the row.
+         * @param   mask    The sites to set.
+        **/
+        inline void setRow64(int64 x, int64 y, uint64 mask)
+            {
+            _modRow64(x, y, mask, true);
+            }
+
+
+        /**
+         * Unset all the sites (x + i, y) for which bit i of mask is set. Sites outside of the whole
+         * square are ignored.
+         *
+         * @param   x       The x coordinate of the first site.
+         * @param   y       The y coordinate of the row.
+         * @param   mask    The sites to unset.
+        **/
+        inline void unsetRow64(int64 x, int64 y, uint64 mask)
+            {
+            _modRow64(x, y, mask, false);
+            }
+
+
+        /**
+         * Count the number of set neighbours (for the 4-neighbours graph) of the 64 sites (x + i, y)
+         * for i = 0..63. The counts (between 0 and 4) are returned bit-sliced: the count for site
+         * (x + i, y) is bit i of b0 + 2*b1 + 4*b2.
+         *
+         * @param   x           The x coordinate of the first site.
+         * @param   y           The y coordinate of the row.
+         * @param [out] b0      bit 0 of the counts.
+         * @param [out] b1      bit 1 of the counts.
+         * @param [out] b2      bit 2 of the counts.
+        **/
+        inline void neighbourCount64(int64 x, int64 y, uint64 & b0, uint64 & b1, uint64 & b2) const
+            {
+            const uint64 l = getRow64(x - 1, y), r = getRow64(x + 1, y);
+            const uint64 u = getRow64(x, y + 1), d = getRow64(x, y - 1);
+            const uint64 s0 = l ^ r, c0 = l & r;    // l + r = 2*c0 + s0
+            const uint64 s1 = u ^ d, c1 = u & d;    // u + d = 2*c1 + s1
+            const uint64 k = s0 & s1;               // s0 + s1 = 2*k + b0
+            b0 = s0 ^ s1;
+            b1 = c0 ^ c1 ^ k;
+            b2 = (c0 & c1) | (k & (c0 ^ c1));
+            }
+
+
+        /**
+         * Return the mask of the sites (x + i, y) for i = 0..63 which have at least k set neighbours
+         * (for the 4-neighbours graph).
+         *
+         * @param   x   The x coordinate of the first site.
+         * @param   y   The y coordinate of the row.
+         * @param   k   The minimum number of neighbours.
+         *
+         * @return  bit i is set if site (x + i, y) has at least k set neighbours.
+        **/
+        inline uint64 neighbourMask64(int64 x, int64 y, int k) const
+            {
+            if (k <= 0) return ~((uint64)0);
+            if (k > 4) return 0;
+            uint64 b0, b1, b2;
+            neighbourCount64(x, y, b0, b1, b2);
+            switch (k)
+                {
+                case 1: return (b0 | b1 | b2);
+                case 2: return (b1 | b2);
+                case 3: return (b2 | (b1 & b0));
+                }
+            return b2;
+            }
+
+
+        /**
+         * Count the number of set sites in the rectangle [xmin, xmax] x [ymin, ymax].
+         *
+         * @return  The number of set sites in the rectangle.
+        **/
+        uint64 countSet(int64 xmin, int64 xmax, int64 ymin, int64 ymax) const
+            {
+            if (xmin < minV()) xmin = minV();
+            if (xmax > maxV()) xmax = maxV();
+            if (ymin < minV()) ymin = minV();
+            if (ymax > maxV()) ymax = maxV();
+            if ((xmin > xmax) || (ymin > ymax)) return 0;
+            uint64 tot = 0;
+            for (int64 y = ymin; y <= ymax; y++)
+                {
+                for (int64 x = xmin; x <= xmax; x += 64)
+                    {
+                    const int64 l = xmax - x + 1;
+                    tot += _popcount64(getRow64(x, y) & ((l >= 64) ? ~((uint64)0) : _lowMask((int)l)));
+                    }
+                }
+            return tot;
+            }
+
+
+        /**
+         * Flood fill: mark in cluster all the set sites of this graph which are connected to (x, y)
+         * by a path of set sites (for the 4-neighbours graph) and which are not already set in
+         * cluster. The fill is bit-parallel: it processes rows by words of 64 sites and only visits
+         * each word a few times.
+         *
+         * Sites already set in cluster act as walls. Hence, the clusters of a graph can be labelled
+         * by calling floodFill() repeatedly with the same cluster object for all the sites of the
+         * graph which are not yet set in cluster.
+         *
+         * @param   x               The x coordinate of the starting site.
+         * @param   y               The y coordinate of the starting site.
+         * @param [in,out]  cluster The object where the cluster is marked. Must be distinct from
+         *                          this object and cover at least the same square.
+         *
+         * @return  The number of sites added to cluster (0 if (x,y) is not set or already in
+         *          cluster).
+        **/
+        uint64 floodFill(int64 x, int64 y, BitGraphZ2<N> & cluster) const
+            {
+            MTOOLS_INSURE(&cluster != this);
+            MTOOLS_INSURE((cluster.minV() <= minV()) && (cluster.maxV() >= maxV()));
+            if ((!get(x, y)) || (cluster.get(x, y))) return 0;
+            const int64 x0 = minV();
+            const int64 nbw = (maxV() - x0) / 64 + 1; // number of words in a row
+            std::vector<_FillItem> stack;
+            stack.push_back(_FillItem((x - x0) / 64, y, ((uint64)1) << ((x - x0) % 64)));
+            uint64 tot = 0;
+            while (!stack.empty())
+                {
+                const _FillItem it = stack.back();
+                stack.pop_back();
+                const int64 xw = x0 + 64 * it.wx;
+                const uint64 fr = getRow64(xw, it.y) & (~cluster.getRow64(xw, it.y)); // sites that can still be reached
+                const uint64 sd = it.seed & fr;
+                if (sd == 0) continue;
+                const uint64 f = _fillWord(sd, fr);
+                cluster.setRow64(xw, it.y, f);
+                tot += _popcount64(f);
+                if (it.y < maxV()) { stack.push_back(_FillItem(it.wx, it.y + 1, f)); }
+                if (it.y > minV()) { stack.push_back(_FillItem(it.wx, it.y - 1, f)); }
+                if (((f >> 63) != 0) && (it.wx + 1 < nbw)) { stack.push_back(_FillItem(it.wx + 1, it.y, 1)); }
+                if (((f & 1) != 0) && (it.wx > 0)) { stack.push_back(_FillItem(it.wx - 1, it.y, ((uint64)1) << 63)); }
+                }
+            return tot;
+            }
+
+
         /**
          * return the number of MB allocated for the object
          *
          * @return  size of memory used in MB.
         **/
-        inline uint64 memory() const {return((((uint64)VV)*sizeof(_MSQ) + 4*sizeof(int32)*LL*LL)/(1024*1024));}
+        inline uint64 memory() const {return(((((uint64)_nbchunks) << _CHUNK_BITS)*sizeof(_MSQ) + 4*sizeof(int32)*LL*LL)/(1024*1024));}
+
+
+        /**
+         * Release the subsquares which are completely full or empty. The other subsquares are not
+         * moved and the released ones are reused by later allocations. Can be called while other
+         * threads use concurrentGet().
+        **/
+        void cleanup()
+            {
+            std::vector<int32> limbo;
+            for (int32 j = 0; j < v; j++)
+                {
+                const _MSQ & S = _sq(j);
+                const size_t Gpos = S.getpos();
+                if (Grid[Gpos] != j) continue; // not in use
+                const size_t nb = S.nbdone();
+                if ((nb == 0) || (nb >= ((size_t)(64*N*N)))) { _storeGrid(Gpos, ((nb == 0) ? -1 : -2)); limbo.push_back(j); }
+                }
+            if (limbo.size() == 0) return;
+            _synchronize(); // readers may still access the released subsquares until now
+            _free.insert(_free.end(), limbo.begin(), limbo.end());
+            _nbused -= (int32)limbo.size();
+            }
+
+
+        /**
+         * Enlarge the main square to [-8*N*newL, 8*N*newL - 1]^2. Only the main grid is reallocated,
+         * the subsquares stay in place. Does nothing if newL is not larger than the current L. Can be
+         * called while other threads use concurrentGet().
+         *
+         * @param   newL    The new value of L (at most 1000000).
+        **/
+        void grow(int32 newL)
+            {
+            if (newL <= LL) return;
+            if (newL > 1000000) { MTOOLS_ERROR("BitGraphZ2::grow(), parameter L incorrect !"); }
+            const int64 nL = (int64)newL;
+            const int64 d = nL - LL;
+            int32 * G = new int32[(size_t)(4*nL*nL)];
+            for (size_t i = 0; i < ((size_t)(4*nL*nL)); i++) { G[i] = -1; }
+            for (int64 j = 0; j < 2*LL; j++)
+                {
+                for (int64 i = 0; i < 2*LL; i++)
+                    {
+                    const int32 p = Grid[(size_t)(i + (2*LL)*j)];
+                    const size_t Gpos = (size_t)((i + d) + (2*nL)*(j + d));
+                    G[Gpos] = p;
+                    if (p >= 0) { _sq(p).setpos(Gpos); }
+                    }
+                }
+            int32 * oldGrid = Grid;
+            Grid = G; LL = nL;
+            _publish();
+            delete [] oldGrid;
+            }
+
+
+        /**
+         * Raise the maximum number of subsquares. The subsquares are allocated only when needed.
+         *
+         * @param   V   The new maximum number of subsquares (does nothing if it is not larger).
+        **/
+        void reserve(int32 V)
+            {
+            if (V > VV) { VV = V; }
+            }
+
+
+        /**
+         * Set whether the object grows automatically: when enabled, setting a site outside of the
+         * main square enlarges it (doubling L as many times as needed) and running out of
+         * subsquares doubles their maximum number instead of stopping the program. Disabled by
+         * default.
+        **/
+        void autoGrow(bool enable) { _autogrow = enable; }
+
+
+        /**
+         * Query if the object grows automatically.
+        **/
+        bool autoGrow() const { return _autogrow; }
+
+
+        /**
+         * Number of subsquares currently in use (i.e. neither full nor empty since the last cleanup).
+        **/
+        inline int32 nbSubsquares() const { return _nbused; }
+
 
     private:
 
+        class _MSQ;
+
         /* Initialization of the object, called by the ctors */
         void init(int32 L,int32 V)
             {
@@ -326,34 +665,224 @@ namespace mtools
             if ((V<2)||(V>2000000000))     {MTOOLS_ERROR("BitGraphZ2::Init(), constructor parameter L or V is incorrect !"); }
             if ((L<2)||(L>1000000))        {MTOOLS_ERROR("BitGraphZ2::Init(), parameter L incorrect !");}
             VV = V; LL = (int64)L;
+            _autogrow = false;
+            _rdEpoch = 0;
+            for (size_t i = 0; i < _RD_STRIPES; i++) { _rdReaders[0][i].nb = 0; _rdReaders[1][i].nb = 0; }
             Grid  = new int32[(size_t)(4*LL*LL)];
-            MStab = new _MSQ[(size_t)(VV)];
+            _nbchunks = 0; _chunkcap = 16;
+            _chunks = new _MSQ*[(size_t)_chunkcap];
+            _view = new _View(Grid, LL, _chunks);
             clear();
             }
 
-        /* Private cleanup function */
-       void cleanup()
+
+        /* subsquare with a given index */
+        inline _MSQ & _sq(int32 p) const { return _chunks[p >> _CHUNK_BITS][p & _CHUNK_MASK]; }
+
+
+        /* store an entry of the main grid (the subsquare must be initialized before it is published) */
+        inline void _storeGrid(size_t Gpos, int32 p) { reinterpret_cast<std::atomic<int32>&>(Grid[Gpos]).store(p, std::memory_order_release); }
+
+
+        /* allocate a subsquare for the grid entry Gpos (full or empty) and return its index */
+        int32 _newSquare(size_t Gpos, bool full, const char * fname)
             {
-            int32 i=0; 
-            int32 j=0;
-            while(j < v)
+            if ((_free.size() == 0) && (v == VV))
                 {
-                size_t nb = MStab[j].nbdone();
-                if (i==j) 
+                cleanup();
+                if ((_free.size() == 0) && (v == VV))
                     {
-                    if (nb == 0) {Grid[MStab[i].getpos()] = -1;}
-                    else {if (nb < ((size_t)(64*N*N))) {i++;} else {Grid[MStab[i].getpos()] = -2;}}
+                    if ((!_autogrow) || (VV > 1000000000)) { MTOOLS_ERROR(std::string(fname) + ", out of memory !"); }
+                    reserve(2*VV);
                     }
-                else
+                }
+            int32 p;
+            if (_free.size() > 0) { p = _free.back(); _free.pop_back(); }
+            else
+                {
+                if ((v >> _CHUNK_BITS) == _nbchunks) { _addChunk(); }
+                p = v++;
+                }
+            if (full) _sq(p).reset1(Gpos); else _sq(p).reset0(Gpos);
+            _storeGrid(Gpos, p);
+            _nbused++;
+            return p;
+            }
+
+
+        /* allocate a new chunk of subsquares */
+        void _addChunk()
+            {
+            if (_nbchunks == _chunkcap)
+                { // the table of chunks is full: replace it
+                _MSQ ** T = new _MSQ*[(size_t)(2*_chunkcap)];
+                for (int32 i = 0; i < _nbchunks; i++) { T[i] = _chunks[i]; }
+                _MSQ ** oldT = _chunks;
+                _chunks = T; _chunkcap *= 2;
+                _publish();
+                delete [] oldT;
+                }
+            _chunks[_nbchunks] = new _MSQ[(size_t)(_CHUNK_MASK + 1)];
+            _nbchunks++;
+            }
+
+
+        /* grow the main square (doubling L) until it contains (x,y), if possible */
+        void _growToContain(int64 x, int64 y)
+            {
+            int64 L = LL;
+            while ((L <= 1000000) && ((x < -8*L*N) || (x >= 8*L*N) || (y < -8*L*N) || (y >= 8*L*N))) { L *= 2; }
+            if (L > 1000000) { if ((x < -8000000*((int64)N)) || (x >= 8000000*((int64)N)) || (y < -8000000*((int64)N)) || (y >= 8000000*((int64)N))) return; L = 1000000; }
+            grow((int32)L);
+            }
+
+
+        /* make the current grid and table of chunks visible to the readers and free the previous view */
+        void _publish()
+            {
+            _View * old = _view.load();
+            _view = new _View(Grid, LL, _chunks);
+            _synchronize();
+            delete old;
+            }
+
+
+        /* enter a read side critical section: register the thread in the counter of the current
+         * epoch and return it. The counter must be decremented on exit. */
+        inline std::atomic<int64> * _rdEnter() const
+            {
+            static thread_local const size_t stripe = std::hash<std::thread::id>()(std::this_thread::get_id()) % _RD_STRIPES;
+            while (1)
+                {
+                const uint64 e = _rdEpoch.load();
+                std::atomic<int64> * c = &(_rdReaders[e & 1][stripe].nb);
+                c->fetch_add(1);
+                if (_rdEpoch.load() == e) return c;
+                c->fetch_sub(1); // the epoch changed in the meantime
+                }
+            }
+
+
+        /* wait until all the threads which entered a critical section before the call have left it */
+        void _synchronize()
+            {
+            const uint64 e = _rdEpoch.fetch_add(1);
+            while (1)
+                {
+                int64 n = 0;
+                for (size_t i = 0; i < _RD_STRIPES; i++) { n += _rdReaders[e & 1][i].nb.load(); }
+                if (n == 0) return;
+                std::this_thread::yield();
+                }
+            }
+
+        /* set or unset the sites of a row given by a mask */
+        inline void _modRow64(int64 x, int64 y, uint64 mask, bool setbits)
+            {
+            if (mask == 0) return;
+            const int64 xa = x + _lowestBit(mask), xb = x + _highestBit(mask);
+            if (xb > maxx) {maxx = xb;}
+            if (y > maxy) {maxy = y;}
+            if (xa < minx) {minx = xa;}
+            if (y < miny) {miny = y;}
+            if ((_autogrow) && (setbits)) { _growToContain(xa, y); _growToContain(xb, y); }
+            const int64 S = 8 * N;
+            int64 ry = (8*LL*N) + y;
+            if ((ry < 0) || (ry >= 16 * (LL*N))) { return; }
+            int64 rx = (8*LL*N) + x;
+            int done = 0;
+            if (rx < 0) { if (rx <= -64) return; done = (int)(-rx); rx = 0; }
+            while ((done < 64) && (rx < 16 * (LL*N)))
+                {
+                const int64 ox = rx % S;
+                const int len = (int)(((64 - done) < (S - ox)) ? (64 - done) : (S - ox));
+                const uint64 m = (mask >> done) & _lowMask(len);
+                if (m != 0)
                     {
-                    if (nb == 0) {Grid[MStab[j].getpos()] = -1;}
-                    else {if (nb < ((size_t)(64*N*N))) {Grid[MStab[j].getpos()] = i; MStab[i] = MStab[j];  i++;} else {Grid[MStab[j].getpos()] = -2;}}
+                    const size_t Gpos = (size_t)((rx / S) + ((2 * LL)*(ry / S)));
+                    const int32 p = Grid[Gpos];
+                    if (p != (setbits ? -2 : -1))
+                        {
+                        const int32 q = ((p < 0) ? _newSquare(Gpos, (p == -2), "BitGraphZ2::setRow64()") : p);
+                        _sq(q).modBits(ox, ry % S, len, m, setbits, totset);
+                        }
                     }
-                j++;
+                done += len; rx += len;
                 }
-            v = i;
             }
 
+
+        /* word of a flood fill waiting to be processed */
+        struct _FillItem
+            {
+            _FillItem(int64 wx_, int64 y_, uint64 seed_) : wx(wx_), y(y_), seed(seed_) {}
+            int64  wx;      // index of the word in the row
+            int64  y;       // row
+            uint64 seed;    // sites reached from the neighbouring words
+            };
+
+
+        /* all the bits of g in a run of consecutive bits containing a bit of seed (Kogge-Stone fill in both directions) */
+        static inline uint64 _fillWord(uint64 seed, uint64 g)
+            {
+            uint64 gen = seed & g, pro = g;
+            gen |= pro & (gen << 1);  pro &= (pro << 1);
+            gen |= pro & (gen << 2);  pro &= (pro << 2);
+            gen |= pro & (gen << 4);  pro &= (pro << 4);
+            gen |= pro & (gen << 8);  pro &= (pro << 8);
+            gen |= pro & (gen << 16); pro &= (pro << 16);
+            gen |= pro & (gen << 32);
+            pro = g;
+            gen |= pro & (gen >> 1);  pro &= (pro >> 1);
+            gen |= pro & (gen >> 2);  pro &= (pro >> 2);
+            gen |= pro & (gen >> 4);  pro &= (pro >> 4);
+            gen |= pro & (gen >> 8);  pro &= (pro >> 8);
+            gen |= pro & (gen >> 16); pro &= (pro >> 16);
+            gen |= pro & (gen >> 32);
+            return gen;
+            }
+
+
+        /* mask with the len lowest bits set (0 <= len <= 64) */
+        static inline uint64 _lowMask(int len) { return ((len >= 64) ? ~((uint64)0) : ((((uint64)1) << len) - 1)); }
+
+
+        /* number of bits set */
+        static inline int _popcount64(uint64 w)
+            {
+            #if defined(__GNUC__) || defined(__clang__)
+            return __builtin_popcountll(w);
+            #else
+            w = w - ((w >> 1) & 0x5555555555555555ULL);
+            w = (w & 0x3333333333333333ULL) + ((w >> 2) & 0x3333333333333333ULL);
+            w = (w + (w >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+            return (int)((w * 0x0101010101010101ULL) >> 56);
+            #endif
+            }
+
+
+        /* index of the lowest bit set (w != 0) */
+        static inline int _lowestBit(uint64 w)
+            {
+            #if defined(__GNUC__) || defined(__clang__)
+            return __builtin_ctzll(w);
+            #else
+            int i = 0; while ((w & 1) == 0) { w >>= 1; i++; } return i;
+            #endif
+            }
+
+
+        /* index of the highest bit set (w != 0) */
+        static inline int _highestBit(uint64 w)
+            {
+            #if defined(__GNUC__) || defined(__clang__)
+            return 63 - __builtin_clzll(w);
+            #else
+            int i = 63; while ((w >> 63) == 0) { w <<= 1; i--; } return i;
+            #endif
+            }
+
+
        /* no copy */
        BitGraphZ2(const BitGraphZ2 &);
        BitGraphZ2 & operator=(const BitGraphZ2 &);
@@ -372,6 +901,35 @@ namespace mtools
                 inline void             set(int64 x,int64 y,uint64 & t)     {unsigned char a = tab[(size_t)((N*y) + (x/8))]; unsigned char b = (a | (1 << (x%8))); if (b!=a) {tab[(size_t)((N*y) + (x/8))] = b; nb++; t++;}}
                 inline void             unset(int64 x,int64 y,uint64 & t)   {unsigned char a = tab[(size_t)((N*y) + (x/8))]; unsigned char mask =  255 - (1 << (x%8)); unsigned char b = (a & mask); if (b!=a) {tab[(size_t)((N*y) + (x/8))] = b; nb--; t--;}}
                 inline size_t           getpos() const                      {return pos;}
+                inline void             setpos(size_t p)                    {pos = p;}
+
+                /* return len <= 64 consecutive bits of row y starting at x (x + len <= 8N) */
+                inline uint64 getBits(int64 x, int64 y, int len) const
+                    {
+                    const unsigned char * row = tab + (size_t)((N*y) + (x/8));
+                    const int s = (int)(x % 8);
+                    const int nbytes = (s + len + 7) / 8;
+                    uint64 w = 0;
+                    for (int k = 0; (k < nbytes) && (k < 8); k++) { w |= ((uint64)row[k]) << (8*k); }
+                    w >>= s;
+                    if (nbytes > 8) { w |= ((uint64)row[8]) << (64 - s); }
+                    return (w & _lowMask(len));
+                    }
+
+                /* set or unset the bits of m in row y starting at x (x + len <= 8N) */
+                inline void modBits(int64 x, int64 y, int len, uint64 m, bool setbits, uint64 & t)
+                    {
+                    for (int64 b = x / 8; b*8 < x + len; b++)
+                        {
+                        const unsigned char bm = (unsigned char)(((b*8 >= x) ? (m >> (b*8 - x)) : (m << (x - b*8))) & 0xFF);
+                        if (bm == 0) continue;
+                        unsigned char & a = tab[(size_t)((N*y) + b)];
+                        const unsigned char c = (setbits ? (unsigned char)(a | bm) : (unsigned char)(a & (~bm)));
+                        const int d = _popcount64((uint64)(a ^ c));
+                        if (setbits) { nb += d; t += d; } else { nb -= d; t -= d; }
+                        a = c;
+                        }
+                    }
                 inline size_t           nbdone() const                      {return nb;}
             private:
                 size_t  pos;
@@ -380,14 +938,44 @@ namespace mtools
             };
 
 
+        static const int    _CHUNK_BITS = internals_bitgraph::chunkBits((size_t)(8*N*N + 16), 0);   // log2 of the number of subsquares in a chunk
+        static const int32  _CHUNK_MASK = (((int32)1) << _CHUNK_BITS) - 1;
+
+        /* what the concurrent readers see: the grid and the table of chunks */
+        struct _View
+            {
+            _View(int32 * g, int64 l, _MSQ ** c) : grid(g), L(l), chunks(c) {}
+            int32 * grid;
+            int64   L;
+            _MSQ ** chunks;
+            };
+
+        /* per-stripe counter of the threads inside a read side critical section (padded to avoid false sharing) */
+        struct _rdCounter
+            {
+            std::atomic<int64> nb;
+            char pad[64 - sizeof(std::atomic<int64>)];
+            };
+
+        static const size_t _RD_STRIPES = 16;   // number of stripes for the read side counters
+
         int64 minx,maxx,miny,maxy;
         uint64  totset;                 
-        int32   v;                      
+        int32   v;                      // number of subsquares used so far (in use or free)
+        int32   _nbused;                // number of subsquares in use
+        std::vector<int32> _free;       // released subsquares
 
         int32 * Grid;                   
-        int32   VV;             
+        int32   VV;                     // maximum number of subsquares
         int64   LL;                     
-        _MSQ *  MStab;                  
+        _MSQ ** _chunks;                // table of the chunks of subsquares
+        int32   _nbchunks;              // number of chunks allocated
+        int32   _chunkcap;              // size of the table of chunks
+        bool    _autogrow;              // grow automatically
+
+        std::atomic<_View *> _view;                         // view of the readers
+        mutable std::atomic<uint64> _rdEpoch;               // current epoch
+        mutable _rdCounter _rdReaders[2][_RD_STRIPES];      // readers in a critical section, indexed by the parity of the epoch
     };
 
 }
@@ -0,0 +1,163 @@
+/** @file collectivemerge.hpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include "../misc/internal/mtools_export.hpp"
+#include "../misc/error.hpp"
+#include "../io/serialization.hpp"
+#include "grid_distributed.hpp"
+
+#include <string>
+#include <vector>
+
+
+namespace mtools
+{
+
+
+    /**
+     * Collective merge of a mergeable object over all the ranks of a group (threads or MPI
+     * processes, see GridComm). Typical use: each rank of a simulation campaign fills its own
+     * IntegerEmpiricalDistribution (or RealEmpiricalDistribution...) and the results are combined
+     * without writing one file per rank.
+     *
+     * The object type OBJ must be default constructible, serializable (serialize() / deserialize()
+     * methods) and provide a method merge(const OBJ &). The objects are sent in binary archives and
+     * merged along a binomial tree: log2(size) rounds, each rank merging at most one object per round.
+     * The order of the merges only depends on the number of ranks so the result is reproducible.
+     *
+     * Collective: every rank of the group must call it.
+     *
+     * @param [in,out]  obj     The object of this rank. On return, the object of the root contains
+     *                          the merge of the objects of all the ranks. The objects of the other
+     *                          ranks contain partial merges.
+     * @param [in,out]  comm    The communicator of this rank.
+     * @param           root    The rank receiving the result.
+     *
+     * @code
+     * IntegerEmpiricalDistribution ED;
+     * ... // fill with the results of this rank
+     * MPIGridComm comm;
+     * reduceMerge(ED, comm);
+     * if (comm.rank() == 0) ED.save("campaign.txt");
+     * @endcode
+     **/
+    template<typename OBJ> void reduceMerge(OBJ & obj, GridComm & comm, int root = 0)
+        {
+        const int n = comm.size();
+        MTOOLS_INSURE((root >= 0) && (root < n));
+        const int me = (comm.rank() - root + n) % n; // rank relative to the root
+        std::vector< std::vector<char> > send((size_t)n), recv;
+        bool done = false; // true once the object was sent to its parent
+        for (int s = 1; s < n; s *= 2)
+            {
+            for (auto & b : send) b.clear();
+            if ((!done) && (me % (2 * s) == s))
+                { // send the object to the parent
+                OStringArchive ar(true);
+                ar & obj;
+                const std::string & str = ar.get();
+                send[(size_t)((me - s + root) % n)].assign(str.begin(), str.end());
+                done = true;
+                }
+            comm.alltoall(send, recv);
+            if ((!done) && (me % (2 * s) == 0) && (me + s < n))
+                { // merge the object of the child
+                const std::vector<char> & buf = recv[(size_t)((me + s + root) % n)];
+                MTOOLS_INSURE(buf.size() > 0);
+                OBJ other;
+                IStringArchive ar(buf.data(), buf.size());
+                ar & other;
+                obj.merge(other);
+                }
+            }
+        }
+
+
+    /**
+     * Collective merge of a mergeable object over all the ranks of a group. Same as reduceMerge()
+     * but every rank receives the result: the merged object is broadcasted from rank 0 along a
+     * binomial tree, serialized only once.
+     *
+     * @param [in,out]  obj     The object of this rank, replaced by the merge of the objects of all
+     *                          the ranks.
+     * @param [in,out]  comm    The communicator of this rank.
+     **/
+    template<typename OBJ> void allreduceMerge(OBJ & obj, GridComm & comm)
+        {
+        reduceMerge(obj, comm, 0);
+        const int n = comm.size();
+        const int me = comm.rank();
+        int top = 1; while (top < n) top *= 2;
+        std::vector< std::vector<char> > send((size_t)n), recv;
+        std::vector<char> data; // serialized result (once received)
+        if (me == 0)
+            {
+            OStringArchive ar(true);
+            ar & obj;
+            const std::string & str = ar.get();
+            data.assign(str.begin(), str.end());
+            }
+        for (int s = top / 2; s >= 1; s /= 2)
+            {
+            for (auto & b : send) b.clear();
+            if ((me % (2 * s) == 0) && (me + s < n)) { send[(size_t)(me + s)] = data; }
+            comm.alltoall(send, recv);
+            if (me % (2 * s) == s)
+                {
+                data.swap(recv[(size_t)(me - s)]);
+                MTOOLS_INSURE(data.size() > 0);
+                IStringArchive ar(data.data(), data.size());
+                ar & obj;
+                }
+            }
+        }
+
+
+#if (MTOOLS_USE_MPI)
+
+    /**
+     * reduceMerge() over an MPI communicator (MPI must be initialized by the caller).
+     **/
+    template<typename OBJ> void reduceMerge(OBJ & obj, MPI_Comm mpicomm, int root = 0)
+        {
+        MPIGridComm comm(mpicomm);
+        reduceMerge(obj, comm, root);
+        }
+
+
+    /**
+     * allreduceMerge() over an MPI communicator (MPI must be initialized by the caller).
+     **/
+    template<typename OBJ> void allreduceMerge(OBJ & obj, MPI_Comm mpicomm)
+        {
+        MPIGridComm comm(mpicomm);
+        allreduceMerge(obj, comm);
+        }
+
+#endif
+
+
+}
+
+
+/* end of file */
+
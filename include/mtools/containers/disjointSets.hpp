@@ -0,0 +1,334 @@
+/** @file disjointSets.hpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+
+#include "../misc/internal/mtools_export.hpp"
+#include "../misc/misc.hpp"
+#include "../misc/stringfct.hpp"
+#include "../misc/error.hpp"
+
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <typeinfo>
+
+
+namespace mtools
+{
+
+
+    /**
+     * Union-find structure over the elements {0,...,size()-1} (e.g. the sites of a percolation
+     * model), with path halving and union by size.
+     *
+     * The structure is a single flat array: entry i contains the parent of i, or -(size of the
+     * set) when i is the root of its set. Any sequence of m operations on n elements takes
+     * O(m alpha(n)) time and 4 bytes per element with the default index type.
+     *
+     * @code{.cpp}
+     * DisjointSets<> DS(L*L);                                     // one set per site
+     * for (each open edge (x,y)) DS.unite(x, y);                  // merge the clusters
+     * if (DS.same(x, y)) ...                                      // are x and y connected ?
+     * size_t s = DS.setSize(x);                                   // size of the cluster of x
+     * @endcode
+     *
+     * @tparam  INDEX   signed integer type used for the indices (int32 by default: at most 2^31-1
+     *                  elements; use int64 for more).
+     **/
+    template<typename INDEX = int32> class DisjointSets
+    {
+
+        static_assert(std::is_integral<INDEX>::value && std::is_signed<INDEX>::value, "DisjointSets: INDEX must be a signed integer type");
+
+    public:
+
+
+        /**
+         * Constructor. n singletons {0},...,{n-1}.
+         **/
+        DisjointSets(size_t n = 0) : _nbsets(0) { reset(n); }
+
+
+        /**
+         * Reset to n singletons {0},...,{n-1}.
+         **/
+        void reset(size_t n)
+            {
+            _parent.assign(n, (INDEX)(-1));
+            _nbsets = n;
+            }
+
+
+        /**
+         * Add a new element (in its own set) and return its index.
+         **/
+        INDEX add()
+            {
+            _parent.push_back((INDEX)(-1));
+            _nbsets++;
+            return (INDEX)(_parent.size() - 1);
+            }
+
+
+        /**
+         * Number of elements.
+         **/
+        size_t size() const { return _parent.size(); }
+
+
+        /**
+         * Number of disjoint sets.
+         **/
+        size_t nbSets() const { return _nbsets; }
+
+
+        /**
+         * Return the representative of the set containing x (path halving).
+         **/
+        inline INDEX find(INDEX x)
+            {
+            MTOOLS_ASSERT((x >= 0) && ((size_t)x < _parent.size()));
+            INDEX p;
+            while ((p = _parent[x]) >= 0)
+                {
+                const INDEX g = _parent[p];
+                if (g < 0) return p;
+                _parent[x] = g;
+                x = g;
+                }
+            return x;
+            }
+
+
+        /**
+         * Merge the sets containing a and b (union by size).
+         *
+         * @return  The representative of the merged set.
+         **/
+        inline INDEX unite(INDEX a, INDEX b)
+            {
+            a = find(a); b = find(b);
+            if (a == b) return a;
+            if (_parent[a] > _parent[b]) { const INDEX t = a; a = b; b = t; } // a is the largest set
+            _parent[a] += _parent[b];
+            _parent[b] = a;
+            _nbsets--;
+            return a;
+            }
+
+
+        /**
+         * Query whether a and b belong to the same set.
+         **/
+        inline bool same(INDEX a, INDEX b) { return (find(a) == find(b)); }
+
+
+        /**
+         * Number of elements in the set containing x.
+         **/
+        inline size_t setSize(INDEX x) { return (size_t)(-_parent[find(x)]); }
+
+
+        /**
+         * Query whether x is the representative of its set.
+         **/
+        inline bool isRoot(INDEX x) const { return (_parent[x] < 0); }
+
+
+        /**
+         * Memory used by the structure (in bytes).
+         **/
+        size_t memoryUsed() const { return sizeof(*this) + _parent.capacity() * sizeof(INDEX); }
+
+
+        /**
+         * Print information about the structure into a string.
+         **/
+        std::string toString() const
+            {
+            return std::string("DisjointSets<") + typeid(INDEX).name() + "> elements: " + mtools::toString(size()) + " sets: " + mtools::toString(nbSets()) + " (" + toStringMemSize(memoryUsed()) + ")";
+            }
+
+
+    private:
+
+        std::vector<INDEX> _parent;     // parent of each element or -size for the roots
+        size_t _nbsets;                 // number of sets
+
+    };
+
+
+
+    /**
+     * Lock-free union-find structure over the elements {0,...,size()-1}. find(), unite() and
+     * same() can be called concurrently from any number of threads without lock (randomized
+     * linking and path splitting with compare-and-swap, after Jayanti and Tarjan 2016), so the
+     * clusters of a huge lattice can be computed by several threads, each handling a part of the
+     * edges.
+     *
+     * The roots are linked according to a fixed pseudo-random priority of their index (instead of
+     * the size of the sets which cannot be maintained without lock): the trees have logarithmic
+     * depth in expectation. reset(), nbSets() and flatten() must not be called concurrently with
+     * the other methods.
+     *
+     * @tparam  INDEX   unsigned integer type used for the indices (uint32 by default).
+     **/
+    template<typename INDEX = uint32> class ConcurrentDisjointSets
+    {
+
+        static_assert(std::is_integral<INDEX>::value && std::is_unsigned<INDEX>::value, "ConcurrentDisjointSets: INDEX must be an unsigned integer type");
+
+    public:
+
+
+        /**
+         * Constructor. n singletons {0},...,{n-1}.
+         **/
+        ConcurrentDisjointSets(size_t n = 0) : _n(0) { reset(n); }
+
+
+        /**
+         * Reset to n singletons {0},...,{n-1}. Not thread-safe.
+         **/
+        void reset(size_t n)
+            {
+            _parent.reset((n > 0) ? new std::atomic<INDEX>[n] : nullptr);
+            _n = n;
+            for (size_t i = 0; i < n; i++) { _parent[i].store((INDEX)i, std::memory_order_relaxed); }
+            }
+
+
+        /**
+         * Number of elements.
+         **/
+        size_t size() const { return _n; }
+
+
+        /**
+         * Return the representative of the set containing x (path splitting). Thread-safe. The
+         * representative may change afterwards if another thread merges the set.
+         **/
+        inline INDEX find(INDEX x)
+            {
+            MTOOLS_ASSERT((size_t)x < _n);
+            while (1)
+                {
+                INDEX p = _parent[x].load(std::memory_order_acquire);
+                if (p == x) return x;
+                const INDEX g = _parent[p].load(std::memory_order_acquire);
+                if (p != g) _parent[x].compare_exchange_weak(p, g, std::memory_order_release, std::memory_order_relaxed);
+                x = p;
+                }
+            }
+
+
+        /**
+         * Merge the sets containing a and b. Thread-safe.
+         *
+         * @return  true if the sets were distinct (i.e. this call merged them).
+         **/
+        inline bool unite(INDEX a, INDEX b)
+            {
+            while (1)
+                {
+                a = find(a); b = find(b);
+                if (a == b) return false;
+                if (_prio(a) < _prio(b)) { const INDEX t = a; a = b; b = t; } // link b below a
+                INDEX e = b;
+                if (_parent[b].compare_exchange_strong(e, a, std::memory_order_acq_rel, std::memory_order_relaxed)) return true;
+                }
+            }
+
+
+        /**
+         * Query whether a and b belong to the same set. Thread-safe (the answer is exact at some
+         * point during the call).
+         **/
+        inline bool same(INDEX a, INDEX b)
+            {
+            while (1)
+                {
+                a = find(a); b = find(b);
+                if (a == b) return true;
+                if (_parent[a].load(std::memory_order_acquire) == a) return false; // a was still a root after b was found
+                }
+            }
+
+
+        /**
+         * Number of disjoint sets. Not thread-safe.
+         **/
+        size_t nbSets() const
+            {
+            size_t nb = 0;
+            for (size_t i = 0; i < _n; i++) { if (_parent[i].load(std::memory_order_relaxed) == (INDEX)i) nb++; }
+            return nb;
+            }
+
+
+        /**
+         * Make every element point directly to its representative and copy the representatives in
+         * a vector (so that they can be read without any further cost). Not thread-safe.
+         *
+         * @param [in,out]  roots   The representative of each element.
+         **/
+        void flatten(std::vector<INDEX> & roots)
+            {
+            roots.resize(_n);
+            for (size_t i = 0; i < _n; i++) { const INDEX r = find((INDEX)i); _parent[i].store(r, std::memory_order_relaxed); roots[i] = r; }
+            }
+
+
+        /**
+         * Memory used by the structure (in bytes).
+         **/
+        size_t memoryUsed() const { return sizeof(*this) + _n * sizeof(std::atomic<INDEX>); }
+
+
+        /**
+         * Print information about the structure into a string.
+         **/
+        std::string toString() const
+            {
+            return std::string("ConcurrentDisjointSets<") + typeid(INDEX).name() + "> elements: " + mtools::toString(size()) + " (" + toStringMemSize(memoryUsed()) + ")";
+            }
+
+
+    private:
+
+        /* linking priority: a bijection of the index (no ties) */
+        static inline uint64 _prio(INDEX x) { return ((uint64)x) * 11400714819323198485ULL; }
+
+        std::unique_ptr<std::atomic<INDEX>[]> _parent;  // parent of each element (itself for the roots)
+        size_t _n;                                      // number of elements
+
+        ConcurrentDisjointSets(const ConcurrentDisjointSets &) = delete;
+        ConcurrentDisjointSets & operator=(const ConcurrentDisjointSets &) = delete;
+    };
+
+
+}
+
+
+/* end of file */
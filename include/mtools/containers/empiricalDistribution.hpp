@@ -21,14 +21,24 @@
 #pragma once
 
 #include "../misc/internal/mtools_export.hpp"
+#include "../misc/misc.hpp"
 #include "../misc/error.hpp"
 #include "../misc/stringfct.hpp"
 #include "../io/serialization.hpp"
 #include "../io/fileio.hpp"
 #include "../io/logfile.hpp"
+#include "../misc/internal/threadworker.hpp"
 
 #include <string>
 #include <vector>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <fstream>
+#include <memory>
 
 
 
@@ -36,6 +46,46 @@ namespace mtools
 {
 
 
+class ConcurrentIntegerEmpiricalDistribution;
+
+
+/**
+ * Report filled by the parallel loading methods of the empirical distribution classes (e.g.
+ * IntegerEmpiricalDistribution::load_and_append_bunch_parallel()).
+ **/
+struct EmpiricalDistributionLoadReport
+	{
+	size_t						nbFiles;		///< number of files found
+	size_t						nbLoaded;		///< number of files merged
+	std::vector<std::string>	badFiles;		///< files skipped because they are corrupt or incompatible
+	uint64						nbBytes;		///< total size (on disk) of the files merged
+	double						seconds;		///< time taken
+
+	EmpiricalDistributionLoadReport() : nbFiles(0), nbLoaded(0), badFiles(), nbBytes(0), seconds(0.0) {}
+
+	/** Number of files merged per second. */
+	double filesPerSecond() const { return (seconds > 0.0) ? (nbLoaded / seconds) : 0.0; }
+
+	/** Number of megabytes (on disk) merged per second. */
+	double MBPerSecond() const { return (seconds > 0.0) ? (nbBytes / (1048576.0 * seconds)) : 0.0; }
+
+	/** Print the report into a string. */
+	std::string toString() const
+		{
+		std::string s = mtools::toString(nbLoaded) + " / " + mtools::toString(nbFiles) + " files loaded in " + mtools::toString(seconds) + "s ("
+			+ mtools::toString(filesPerSecond()) + " files/s, " + mtools::toString(MBPerSecond()) + " MB/s)\n";
+		for (auto & f : badFiles) { s += " - skipped [" + f + "]\n"; }
+		return s;
+		}
+	};
+
+
+namespace internals_empiricaldistribution
+	{
+	template<typename ED> size_t parallelLoadBunch(ED & target, const std::string & filename, const std::string & path, int nbThreads, EmpiricalDistributionLoadReport * report);
+	}
+
+
 /** 
  * Class representing the empirical distribution of an integer valued random variable. 
  * 
@@ -46,6 +96,9 @@ namespace mtools
  * realizations in [3L, 7L[ and ]-7L, -3L] are groupe by 4.
  * realizations in [7L, 15L[ and ]-15L, -7L] are groupe by 8.
  * 
+ * The distributions computed by the ranks of a multi-process (or multi-thread) run can be merged
+ * directly in memory with reduceMerge() / allreduceMerge() (see collectivemerge.hpp).
+ * 
  **/
 class IntegerEmpiricalDistribution
 	{
@@ -63,7 +116,7 @@ class IntegerEmpiricalDistribution
 		 * 						object saves every value on [0, L[, then every 2 values on [L, 3L[, every 4
 		 * 						values on [3L, 7L[, every 8 values on [7L, 15L[  ...
 		 **/
-		IntegerEmpiricalDistribution(uint64 logspacing = DEFAULT_LOGSPACING) : EXP(logspacing),  _tab_plus(), _tab_minus(), _cdf_plus(), _cdf_minus(), _nb_plus(0), _nb_minus(0), _nb_plus_infinity(0), _nb_minus_infinity(0), _minval(std::numeric_limits<int64>::max()), _maxval(std::numeric_limits<int64>::min())
+		IntegerEmpiricalDistribution(uint64 logspacing = DEFAULT_LOGSPACING) : EXP(logspacing),  _tab_plus(), _tab_minus(), _fen_plus(), _fen_minus(), _fen_ok(false), _nb_plus(0), _nb_minus(0), _nb_plus_infinity(0), _nb_minus_infinity(0), _minval(std::numeric_limits<int64>::max()), _maxval(std::numeric_limits<int64>::min()), _sum_low(0), _sum_high(0), _sum2_low(0.0), _sum2_high(0.0)
 			{
 			MTOOLS_INSURE(logspacing >= 2);
 			MTOOLS_INSURE(logspacing <= 62);
@@ -94,14 +147,19 @@ class IntegerEmpiricalDistribution
 			{
 			_tab_plus.clear();
 			_tab_minus.clear();
-			_cdf_plus.clear();
-			_cdf_minus.clear();
+			_fen_plus.clear();
+			_fen_minus.clear();
+			_fen_ok = false;
 			_nb_plus = 0;
 			_nb_minus = 0;
 			_nb_plus_infinity = 0;
 			_nb_minus_infinity = 0;
 			_minval = std::numeric_limits<int64>::max();
 			_maxval = std::numeric_limits<int64>::min();
+			_sum_low = 0;
+			_sum_high = 0;
+			_sum2_low = 0.0;
+			_sum2_high = 0.0;
 			}
 
 
@@ -135,18 +193,7 @@ class IntegerEmpiricalDistribution
 		 **/
 		void deserialize(IBaseArchive & ar)
 			{
-			reset();
-			ar & EXP;
-			MTOOLS_INSURE(EXP >= 2);
-			MTOOLS_INSURE(EXP <= 62);
-			ar & _tab_plus;
-			ar & _tab_minus;
-			ar & _nb_plus;
-			ar & _nb_minus;
-			ar & _nb_plus_infinity;
-			ar & _nb_minus_infinity;
-			ar & _minval;
-			ar & _maxval;
+			MTOOLS_INSURE(_tryDeserialize(ar));
 			}
 
 
@@ -257,6 +304,27 @@ class IntegerEmpiricalDistribution
 			}
 
 
+		/**
+		 * Parallel version of load_and_append_bunch(). The files are decompressed and deserialized by a
+		 * pool of threads, each one merging them into its own partial distribution, and the partial
+		 * distributions are then merged by a tree reduction.
+		 * 
+		 * Corrupt files (and files whose spacing differs from the one of this object, or of the first
+		 * file loaded if this object is empty) are skipped instead of aborting the program.
+		 *
+		 * @param	filename 	name of the file (without path!)
+		 * @param	path	 	path of the file.
+		 * @param	nbThreads	number of threads (0 = number of hardware threads).
+		 * @param	report   	if not nullptr, filled with the list of the files skipped and the throughput.
+		 *
+		 * @return	number of files added to the object.
+		 **/
+		size_t load_and_append_bunch_parallel(const std::string & filename, const std::string & path = ".", int nbThreads = 0, EmpiricalDistributionLoadReport * report = nullptr)
+			{
+			return internals_empiricaldistribution::parallelLoadBunch(*this, filename, path, nbThreads, report);
+			}
+
+
 		/**
 		* Add the point of another empirical distribution to this object. Same as operator+=(ED);
 		*
@@ -279,6 +347,11 @@ class IntegerEmpiricalDistribution
 			_nb_minus_infinity += ED._nb_minus_infinity;
 			if (ED._minval < _minval) { _minval = ED._minval; }
 			if (ED._maxval > _maxval) { _maxval = ED._maxval; }
+			_sum_low += ED._sum_low;
+			_sum_high += ED._sum_high;
+			_sum2_low += ED._sum2_low;
+			_sum2_high += ED._sum2_high;
+			_fen_ok = false;
 			}
 
 
@@ -440,12 +513,18 @@ class IntegerEmpiricalDistribution
 				if (index >= _tab_plus.size()) { _tab_plus.resize(index + 1, 0); }
 				_tab_plus[index]++;
 				_nb_plus++;
+				const int64 lo = (int64)_bucketLow_u((uint64)val, hb);
+				_addSums(lo, lo + (int64)((1ull << hb) - 1), 1);
+				if (_fen_ok) _fenAdd(_fen_plus, index);
 				return;
 				}
 			uint64 index = _posInArray_u((uint64)(-val), hb);
 			if (index >= _tab_minus.size()) { _tab_minus.resize(index + 1, 0); }
 			_tab_minus[index]++;
 			_nb_minus++;
+			const int64 hi = -((int64)_bucketLow_u((uint64)(-val), hb));
+			_addSums(hi - (int64)((1ull << hb) - 1), hi, 1);
+			if (_fen_ok) _fenAdd(_fen_minus, index);
 			return;
 			}
 
@@ -484,42 +563,24 @@ class IntegerEmpiricalDistribution
 
 
 		/**
-		 * (re)-calculates the empirical CDF. 
+		 * (Re)-builds the structure used for the CDF queries.
 		 *
-		 * 	!!! This method should be called after new insertions and prior to calling  any
-		 *  query method below !!!. 
+		 * The CDF is stored in two Fenwick trees (for the negative and non-negative buckets) which are
+		 * built lazily by the first query and then updated by insert() in O(log n). Calling this method
+		 * is therefore not needed anymore: it only forces the build.
 		 **/
 		void recomputeCDF() const
 			{
-			uint64 acc = 0;
-			if (_tab_minus.size() > 1)
-				{ 
-				if (_cdf_minus.size() < _tab_minus.size()) { _cdf_minus.resize(_tab_minus.size()); }
-				for (size_t i = _tab_minus.size() - 1; i > 0; i--)
-					{
-					acc += _tab_minus[i]; 
-					_cdf_minus[i] = acc;
-					}
-				}
-			else { _cdf_minus.clear(); }
-			if (_tab_plus.size() > 0)
-				{
-				if (_cdf_plus.size() < _tab_plus.size()) { _cdf_plus.resize(_tab_plus.size()); }
-				for (size_t i = 0; i < _tab_plus.size(); i++)
-					{
-					acc += _tab_plus[i];
-					_cdf_plus[i] = acc;
-					}
-				}
-			else { _cdf_plus.clear(); }
-			MTOOLS_ASSERT(acc = _nb_plus + _nb_minus);
+			_fenBuild(_fen_minus, _tab_minus);
+			_fenBuild(_fen_plus, _tab_plus);
+			_fen_ok = true;
 			}
 
 
 		/**
 		 * Compute the CDF: P(X <= j).
 		 *
-		 * Make sure recomputeCDF() has been called after the last modification of the object. 
+		 * O(log n) where n is the number of buckets.
 		 *
 		 * @param	j	position to query
 		 * @param	rounding	The rounding mode (may be one of ROUND_BELOW, ROUND_MIDDLE, ROUND_ABOVE).
@@ -554,7 +615,7 @@ class IntegerEmpiricalDistribution
 		/**
 		* Compute the tail distribution: P(X > j).
 		*
-		* Make sure recomputeCDF() has been called after the last modification of the object.
+		* O(log n) where n is the number of buckets.
 		*
 		* @param	j	position to query
 		* @param	rounding	The rounding mode (may be one of ROUND_BELOW, ROUND_MIDDLE, ROUND_ABOVE).
@@ -586,7 +647,52 @@ class IntegerEmpiricalDistribution
 
 
 		/**
-		 * Compute the expectation of the random variable. (slow).
+		 * Compute a quantile: the smallest x such that P(X <= x) >= p. O(log n) where n is the number
+		 * of buckets.
+		 *
+		 * @param	p			The probability, in [0,1].
+		 * @param	rounding	The rounding mode (may be one of ROUND_BELOW, ROUND_MIDDLE, ROUND_ABOVE)
+		 * 						i.e. which value of the bucket containing the quantile is returned.
+		 *
+		 * @return	The quantile. std::numeric_limits<int64>::min() / max() if it is -infty / +infty
+		 * 			(and 0 if the distribution is empty).
+		 **/
+		int64 quantile(double p, int rounding = ROUND_MIDDLE) const
+			{
+			const uint64 N = nbInsertion();
+			if (N == 0) return 0;
+			_fenEnsure();
+			uint64 r = (uint64)ceil(p*N); // rank of the quantile (starting from 1)
+			if (r < 1) r = 1; else if (r > N) r = N;
+			if (r <= _nb_minus_infinity) return std::numeric_limits<int64>::min();
+			r -= _nb_minus_infinity;
+			int64 i;
+			if (r <= _nb_minus)
+				{ // there are r negative values <= the quantile: look for the largest m with #{index >= m} >= r
+				i = -((int64)_fenSearch(_fen_minus, _nb_minus - r));
+				}
+			else
+				{
+				r -= _nb_minus;
+				if (r > _nb_plus) return std::numeric_limits<int64>::max();
+				i = (int64)_fenSearch(_fen_plus, r - 1); // smallest index with prefix sum >= r
+				}
+			int64 min;
+			uint64 ls;
+			_rangeIndex(i, min, ls);
+			switch (rounding)
+				{
+				case ROUND_BELOW: { return min; }
+				case ROUND_ABOVE: { return min + (int64)((1ull << ls) - 1); }
+				case ROUND_MIDDLE: { return min + (int64)(((1ull << ls) - 1) / 2); }
+				}
+			MTOOLS_ERROR("incorrect rounding mode");
+			return 0;
+			}
+
+
+		/**
+		 * Compute the expectation of the random variable. O(1): the sums are maintained by insert().
 		 * 
 		 * The infinite values are discarded (ie we compute the expectation conditionally on the r.v.
 		 * being finite).  
@@ -599,63 +705,18 @@ class IntegerEmpiricalDistribution
 			{
 			if (rounding == ROUND_MIDDLE) return (expectation(ROUND_ABOVE) + expectation(ROUND_BELOW)) / 2;
 			if (_nb_plus + _nb_minus == 0) return 0.0;
-			const int64 L = (int64)spacing();
-			int64 sum = 0;
-			int64 pos = 1;
-			int64 step = 1;
-			int64 off = 1;
 			switch (rounding)
 				{
-				case ROUND_BELOW:
-					{
-					for (size_t i = 1; i < _tab_plus.size(); i++)
-						{
-						sum += ((int64)_tab_plus[i] * pos);
-						pos += step;
-						off++;
-						if (off == L) { off = 0;  step <<= 1; }
-						}
-					pos = -1;
-					step = 1;
-					off = 1;
-					for (size_t i = 1; i < _tab_minus.size(); i++)
-						{
-						sum += ((int64)_tab_minus[i] * (pos - step +1));
-						pos -= step;
-						off++;
-						if (off == L) { off = 0;  step <<= 1; }
-						}
-					break;
-					}
-				case ROUND_ABOVE:
-					{
-					for (size_t i = 1; i < _tab_plus.size(); i++)
-						{
-						sum += ((int64)_tab_plus[i] * (pos + step - 1));
-						pos += step;
-						off++;
-						if (off == L) { off = 0;  step <<= 1; }
-						}
-					pos = -1;
-					step = 1;
-					off = 1;
-					for (size_t i = 1; i < _tab_minus.size(); i++)
-						{
-						sum += ((int64)_tab_minus[i] * pos);
-						pos -= step;
-						off++;
-						if (off == L) { off = 0;  step <<= 1; }
-						}
-					break;
-					}
-				default: { MTOOLS_ERROR("incorrect rounding mode"); return 0.0; }
+				case ROUND_BELOW: { return (double)_sum_low / (_nb_plus + _nb_minus); }
+				case ROUND_ABOVE: { return (double)_sum_high / (_nb_plus + _nb_minus); }
 				}
-			return (double)sum / (_nb_plus + _nb_minus);
+			MTOOLS_ERROR("incorrect rounding mode");
+			return 0.0;
 			}
 
 
 		/**
-		 * Compute the variance of the random variable. (slow).
+		 * Compute the variance of the random variable. O(1).
 		 * 
 		 * The infinite values are discarded (ie we compute the variance conditionally on the r.v.
 		 * being finite).
@@ -671,7 +732,8 @@ class IntegerEmpiricalDistribution
 
 
 		/**
-		 * Compute the k'th moment of the random variable. (slow).
+		 * Compute the k'th moment of the random variable. O(1) for k = 1 and k = 2 (the sums are
+		 * maintained by insert()), slow otherwise.
 		 * 
 		 * The infinite values are discarded (ie we compute the moment conditionnally on the r.v. being
 		 * finite).
@@ -685,6 +747,12 @@ class IntegerEmpiricalDistribution
 			{
 			if (rounding == ROUND_MIDDLE) return (moment(k,ROUND_ABOVE) + moment(k,ROUND_BELOW)) / 2;
 			if (_nb_plus + _nb_minus == 0) return 0.0;
+			if (k == 1.0) return expectation(rounding);
+			if (k == 2.0)
+				{
+				if (rounding == ROUND_BELOW) return _sum2_low / (_nb_plus + _nb_minus);
+				if (rounding == ROUND_ABOVE) return _sum2_high / (_nb_plus + _nb_minus);
+				}
 			if (k < 0) { if (rounding == ROUND_BELOW) rounding = ROUND_ABOVE; else if (rounding == ROUND_ABOVE) rounding = ROUND_BELOW; }
 			const int64 L = (int64)spacing();
 			double sum = 0;
@@ -768,7 +836,7 @@ class IntegerEmpiricalDistribution
 		 **/
 		uint64 memoryFootprint() const
 			{
-			return sizeof(IntegerEmpiricalDistribution) + sizeof(uint64)*(_tab_plus.capacity() + _tab_minus.capacity() + _cdf_plus.capacity() + _cdf_minus.capacity());
+			return sizeof(IntegerEmpiricalDistribution) + sizeof(uint64)*(_tab_plus.capacity() + _tab_minus.capacity() + _fen_plus.capacity() + _fen_minus.capacity());
 			}
 
 
@@ -781,18 +849,125 @@ class IntegerEmpiricalDistribution
 
 	private:
 
+		friend class ConcurrentIntegerEmpiricalDistribution;
+		template<typename ED> friend size_t internals_empiricaldistribution::parallelLoadBunch(ED &, const std::string &, const std::string &, int, EmpiricalDistributionLoadReport *);
+
+
+		/* deserialize the object, return false (and reset the object) if the data is not valid */
+		bool _tryDeserialize(IBaseArchive & ar)
+			{
+			reset();
+			ar & EXP;
+			if ((EXP < 2) || (EXP > 62)) { reset(); EXP = DEFAULT_LOGSPACING; return false; }
+			ar & _tab_plus;
+			ar & _tab_minus;
+			ar & _nb_plus;
+			ar & _nb_minus;
+			ar & _nb_plus_infinity;
+			ar & _nb_minus_infinity;
+			ar & _minval;
+			ar & _maxval;
+			uint64 np = 0, nm = 0;
+			for (auto n : _tab_plus) { np += n; }
+			for (auto n : _tab_minus) { nm += n; }
+			if ((np != _nb_plus) || (nm != _nb_minus) || ((np + nm > 0) && (_minval > _maxval))) { reset(); return false; }
+			_recomputeSums();
+			return true;
+			}
+
+
+		/* true if the points of ED can be merged into this object */
+		bool _sameParameters(const IntegerEmpiricalDistribution & ED) const { return (ED.EXP == EXP); }
+
 
-		/* return _cdf_plus/minus[i] extended for all value of i */
+		/* return the number of finite values in the buckets <= i (extended for all value of i) */
 		MTOOLS_FORCEINLINE uint64 _cdf(int64 i) const
 			{
+			_fenEnsure();
 			if (i >= 0)
 				{
-				if (i >= (int64)_cdf_plus.size()) return (_nb_minus + _nb_plus);
-				return _cdf_plus[i];
+				if (i >= (int64)_tab_plus.size()) return (_nb_minus + _nb_plus);
+				return _nb_minus + _fenPrefix(_fen_plus, (uint64)i);
 				}
 			i = -i;
-			if (i >= (int64)_cdf_minus.size()) return 0;
-			return _cdf_minus[i];
+			if (i >= (int64)_tab_minus.size()) return 0;
+			return _nb_minus - _fenPrefix(_fen_minus, (uint64)(i - 1));
+			}
+
+
+		/* build the Fenwick trees if needed */
+		MTOOLS_FORCEINLINE void _fenEnsure() const { if (!_fen_ok) recomputeCDF(); }
+
+
+		/* build a Fenwick tree (1-based, its size n is a power of 2) from an array of counts */
+		static void _fenBuild(std::vector<uint64> & fen, const std::vector<uint64> & tab)
+			{
+			size_t n = 1;
+			while (n < tab.size()) n <<= 1;
+			fen.assign(n + 1, 0);
+			for (size_t i = 0; i < tab.size(); i++) { fen[i + 1] = tab[i]; }
+			for (size_t i = 1; i <= n; i++) { const size_t j = i + (i & (~i + 1)); if (j <= n) fen[j] += fen[i]; }
+			}
+
+
+		/* add one to the count at a given index of a Fenwick tree. The tree doubles in size as needed: the
+		 * existing nodes do not change and the new root is the sum of the old tree. */
+		static MTOOLS_FORCEINLINE void _fenAdd(std::vector<uint64> & fen, uint64 index)
+			{
+			size_t n = fen.size() - 1;
+			while (index >= n) { fen.resize(2 * n + 1, 0); fen[2 * n] = fen[n]; n *= 2; }
+			for (size_t i = (size_t)index + 1; i <= n; i += (i & (~i + 1))) { fen[i]++; }
+			}
+
+
+		/* sum of the counts at indexes 0..index (which must be in the tree) */
+		static MTOOLS_FORCEINLINE uint64 _fenPrefix(const std::vector<uint64> & fen, uint64 index)
+			{
+			uint64 s = 0;
+			for (size_t i = (size_t)index + 1; i > 0; i -= (i & (~i + 1))) { s += fen[i]; }
+			return s;
+			}
+
+
+		/* return the number of leading indexes whose cumulated count is <= target */
+		static uint64 _fenSearch(const std::vector<uint64> & fen, uint64 target)
+			{
+			const size_t n = fen.size() - 1;
+			size_t pos = 0;
+			for (size_t step = n; step > 0; step >>= 1)
+				{
+				if ((pos + step <= n) && (fen[pos + step] <= target)) { pos += step; target -= fen[pos]; }
+				}
+			return pos;
+			}
+
+
+		/* add nb values to the sums used for the moments. lo and hi are the bounds of their bucket */
+		MTOOLS_FORCEINLINE void _addSums(int64 lo, int64 hi, uint64 nb)
+			{
+			_sum_low += lo*(int64)nb;
+			_sum_high += hi*(int64)nb;
+			_sum2_low += ((double)lo)*((double)lo)*nb;
+			_sum2_high += ((double)hi)*((double)hi)*nb;
+			}
+
+
+		/* recompute the sums used for the moments from the buckets */
+		void _recomputeSums()
+			{
+			_sum_low = 0; _sum_high = 0; _sum2_low = 0.0; _sum2_high = 0.0;
+			int64 min;
+			uint64 ls;
+			for (size_t i = 1; i < _tab_plus.size(); i++) { if (_tab_plus[i] > 0) { _rangeIndex((int64)i, min, ls); _addSums(min, min + (int64)((1ull << ls) - 1), _tab_plus[i]); } }
+			for (size_t i = 1; i < _tab_minus.size(); i++) { if (_tab_minus[i] > 0) { _rangeIndex(-((int64)i), min, ls); _addSums(min, min + (int64)((1ull << ls) - 1), _tab_minus[i]); } }
+			}
+
+
+		/* lower bound of the bucket containing val >= 0 (hb as returned by _posInArray_u()) */
+		MTOOLS_FORCEINLINE uint64 _bucketLow_u(const uint64 val, const uint64 hb) const
+			{
+			const uint64 base = ((1ull << hb) - 1) << EXP;
+			return val - ((val - base) & ((1ull << hb) - 1));
 			}
 
 
@@ -892,8 +1067,9 @@ class IntegerEmpiricalDistribution
 		std::vector<uint64> _tab_plus;	// array for non-negative values. 
 		std::vector<uint64> _tab_minus; // array for (strictly) negative values. 
 
-		mutable std::vector<uint64> _cdf_plus;	// array for the cdf (positive or null values)
-		mutable std::vector<uint64> _cdf_minus;	// array for the cdf (negative values)
+		mutable std::vector<uint64> _fen_plus;	// Fenwick tree of _tab_plus (for the cdf)
+		mutable std::vector<uint64> _fen_minus;	// Fenwick tree of _tab_minus
+		mutable bool _fen_ok;					// true if the Fenwick trees are built (they are then updated by insert())
 
 		uint64 _nb_plus;				// number of entries that are positive or zero. 
 		uint64 _nb_minus;				// number of entries that are strictly negative. 
@@ -904,9 +1080,930 @@ class IntegerEmpiricalDistribution
 		int64 _minval;					// minimum value recorded;
 		int64 _maxval;					// maximum value recorded; 
 
+		int64 _sum_low;					// sum of the finite values, each rounded to the lower bound of its bucket
+		int64 _sum_high;				// sum of the finite values, each rounded to the upper bound of its bucket
+		double _sum2_low;				// sum of the squares of the values rounded to the lower bound of their bucket
+		double _sum2_high;				// sum of the squares of the values rounded to the upper bound of their bucket
+
 	};
 
 
+/**
+ * Class representing the empirical distribution of a real valued random variable, in bounded
+ * memory.
+ *
+ * - The moments are computed exactly (up to rounding) with Welford's online algorithm.
+ * - The quantiles and the CDF are estimated with a t-digest (merging variant):
+ *   the values are summarized by centroids (mean, weight) whose weights are small near the tails and
+ *   larger near the median, so the relative error on extreme quantiles stays small. The number of
+ *   centroids is of order compression() (plus an insertion buffer of BUFFER_FACTOR * compression()
+ *   values) whatever the number of insertions.
+ *
+ * Objects are mergeable: several shards (e.g. one per thread, run or node) can be filled
+ * independently and then combined with merge(), possibly after being saved into / reloaded from
+ * files. The infinite values are counted separately and NaN are discarded (but counted).
+ *
+ * @code
+ * RealEmpiricalDistribution ED;
+ * for (int i = 0; i < 1000000; i++) ED.insert(Unif(gen));
+ * cout << ED.expectation() << " " << ED.quantile(0.99) << " " << ED.cdf(0.5) << "\n";
+ * @endcode
+ **/
+class RealEmpiricalDistribution
+	{
+
+	public:
+
+
+		static const int DEFAULT_COMPRESSION = 200;		// default compression parameter of the t-digest.
+		static const int BUFFER_FACTOR = 5;				// size of the insertion buffer (relatively to the compression).
+
+
+		/**
+		 * Constructor. Create an empty distribution.
+		 *
+		 * @param	compression	The compression parameter of the t-digest (at least 20). The memory used is
+		 * 						proportional to it and the error on the quantiles is roughly inversely
+		 * 						proportional to it.
+		 **/
+		RealEmpiricalDistribution(int compression = DEFAULT_COMPRESSION) : _compression((double)compression), _means(), _weights(), _buffer(), _nb(0), _mean(0.0), _m2(0.0), _minval(std::numeric_limits<double>::infinity()), _maxval(-std::numeric_limits<double>::infinity()), _nb_plus_infinity(0), _nb_minus_infinity(0), _nb_nan(0)
+			{
+			MTOOLS_INSURE(compression >= 20);
+			}
+
+
+		/**
+		 * Default copy constructor
+		 **/
+		RealEmpiricalDistribution(const RealEmpiricalDistribution &) = default;
+
+
+		/**
+		 * Default move constructor
+		 **/
+		RealEmpiricalDistribution(RealEmpiricalDistribution &&) = default;
+
+
+		/**
+		 * Default assignement operator
+		 **/
+		RealEmpiricalDistribution & operator=(const RealEmpiricalDistribution &) = default;
+
+
+		/** Resets this object to the empty emprical distribution. */
+		void reset()
+			{
+			_means.clear();
+			_weights.clear();
+			_buffer.clear();
+			_nb = 0;
+			_mean = 0.0;
+			_m2 = 0.0;
+			_minval = std::numeric_limits<double>::infinity();
+			_maxval = -std::numeric_limits<double>::infinity();
+			_nb_plus_infinity = 0;
+			_nb_minus_infinity = 0;
+			_nb_nan = 0;
+			}
+
+
+		/**
+		 * serialize this object into an archive.
+		 *
+		 * @param [in,out]	ar	The archive to use.
+		 **/
+		void serialize(OBaseArchive & ar) const
+			{
+			_flush();
+			ar << "RealEmpiricalDistribution";
+			ar & _compression;
+			ar.newline();
+			ar & _means;
+			ar.newline();
+			ar & _weights;
+			ar.newline();
+			ar & _nb;
+			ar & _mean;
+			ar & _m2;
+			ar & _minval;
+			ar & _maxval;
+			ar & _nb_plus_infinity;
+			ar & _nb_minus_infinity;
+			ar & _nb_nan;
+			}
+
+
+		/**
+		 * deserialize this object from an archive.
+		 *
+		 * @param [in,out]	ar	The archive to use.
+		 **/
+		void deserialize(IBaseArchive & ar)
+			{
+			MTOOLS_INSURE(_tryDeserialize(ar));
+			}
+
+
+		/**
+		 * Saves the object into a file.
+		 *
+		 * @param	filename	Name of the file,
+		 * @param	index   	optional index to append to the filename.
+		 **/
+		void save(std::string filename, uint32 index = 0) const
+			{
+			if (index != 0) filename += std::string("-") + mtools::toString(index);
+			OFileArchive ar(filename);
+			ar & (*this);
+			}
+
+
+		/**
+		 * Append the content of a file to the current emprical distribution.
+		 *
+		 * @param	filename	Filename of the file.
+		 * @param	index   	Optional index to append to the filename.
+		 **/
+		void load_and_append(std::string filename, uint32 index = 0)
+			{
+			if (index != 0) filename += std::string("-") + mtools::toString(index);
+			RealEmpiricalDistribution ED;
+			IFileArchive ar(filename);
+			ar & ED;
+			merge(ED);
+			}
+
+
+		/**
+		 * Append all the files with a given filename and all possible index into this object.
+		 *
+		 * @param	filename	name of the file (without path!)
+		 * @param	path		path of the file.
+		 *
+		 * @return	number of files added to the object.
+		 **/
+		size_t load_and_append_bunch(const std::string & filename, const std::string & path = ".")
+			{
+			std::vector<std::string> tabfile;
+			mtools::getFileList(path, filename + "-*", false, tabfile, false, true, false);
+			if (doFileExist(path + "/" + filename)) tabfile.push_back(filename);
+			for (size_t i = 0; i < tabfile.size(); i++)
+				{
+				load_and_append(path + "/" + tabfile[i], 0);
+				}
+			return tabfile.size();
+			}
+
+
+		/**
+		 * Parallel version of load_and_append_bunch(): the files are deserialized by a pool of threads and
+		 * merged by a tree reduction. Corrupt files are skipped. See
+		 * IntegerEmpiricalDistribution::load_and_append_bunch_parallel().
+		 **/
+		size_t load_and_append_bunch_parallel(const std::string & filename, const std::string & path = ".", int nbThreads = 0, EmpiricalDistributionLoadReport * report = nullptr)
+			{
+			return internals_empiricaldistribution::parallelLoadBunch(*this, filename, path, nbThreads, report);
+			}
+
+
+		/**
+		 * Add the points of another empirical distribution to this object. Same as operator+=(ED).
+		 * The compression parameters may differ (this object keeps its own).
+		 *
+		 * @param	ED	The emprirical distribution whose points should be added to this one.
+		 **/
+		void merge(const RealEmpiricalDistribution & ED)
+			{
+			if (ED.isEmpty()) return;
+			if (ED._nb > 0)
+				{ // Chan et al. formula for combining the moments
+				const double n1 = (double)_nb, n2 = (double)ED._nb, n = n1 + n2;
+				const double delta = ED._mean - _mean;
+				_mean += delta * (n2 / n);
+				_m2 += ED._m2 + delta * delta * (n1 * n2 / n);
+				_nb += ED._nb;
+				if (ED._minval < _minval) _minval = ED._minval;
+				if (ED._maxval > _maxval) _maxval = ED._maxval;
+				_flush();
+				for (size_t i = 0; i < ED._means.size(); i++) { _means.push_back(ED._means[i]); _weights.push_back(ED._weights[i]); }
+				for (double x : ED._buffer) { _means.push_back(x); _weights.push_back(1.0); }
+				_compress(_means, _weights);
+				}
+			_nb_plus_infinity += ED._nb_plus_infinity;
+			_nb_minus_infinity += ED._nb_minus_infinity;
+			_nb_nan += ED._nb_nan;
+			}
+
+
+		/**
+		 * Add the points of another empirical distribution to this object. Same as merge(ED);
+		 **/
+		void operator+=(const RealEmpiricalDistribution & ED) { merge(ED); }
+
+
+		/**
+		 * Insert a new realization in the distribution. Amortized O(log(compression)).
+		 *
+		 * @param	val	The value to insert (may be infinite, NaN are discarded).
+		 **/
+		MTOOLS_FORCEINLINE void insert(const double val)
+			{
+			if (!std::isfinite(val))
+				{
+				if (val != val) { _nb_nan++; return; }
+				if (val > 0) _nb_plus_infinity++; else _nb_minus_infinity++;
+				return;
+				}
+			_nb++;
+			const double delta = val - _mean;
+			_mean += delta / _nb;
+			_m2 += delta * (val - _mean);
+			if (val < _minval) _minval = val;
+			if (val > _maxval) _maxval = val;
+			_buffer.push_back(val);
+			if (_buffer.size() >= (size_t)(BUFFER_FACTOR * _compression)) _flush();
+			}
+
+
+		/**
+		 * Insert a new realization in the distribution. Same as insert(val).
+		 **/
+		MTOOLS_FORCEINLINE void operator[](const double val) { insert(val); }
+
+
+		/**
+		 * Query if this object is empty.
+		 **/
+		MTOOLS_FORCEINLINE bool isEmpty() const { return ((_nb == 0) && (_nb_plus_infinity == 0) && (_nb_minus_infinity == 0) && (_nb_nan == 0)); }
+
+
+		/**
+		 * The compression parameter of the t-digest.
+		 **/
+		MTOOLS_FORCEINLINE int compression() const { return (int)_compression; }
+
+
+		/**
+		 * Return the total number of insertions performed (excluding NaN).
+		 **/
+		MTOOLS_FORCEINLINE uint64 nbInsertion() const { return _nb + _nb_plus_infinity + _nb_minus_infinity; }
+
+
+		/**
+		 * Return the number of finite values inserted.
+		 **/
+		MTOOLS_FORCEINLINE uint64 nbFinite() const { return _nb; }
+
+
+		/**
+		 * Return the number of values inserted that are equal to +infty.
+		 **/
+		MTOOLS_FORCEINLINE uint64 nbPlusInfinity() const { return _nb_plus_infinity; }
+
+
+		/**
+		 * Return the number of values inserted that are equal to -infty.
+		 **/
+		MTOOLS_FORCEINLINE uint64 nbMinusInfinity() const { return _nb_minus_infinity; }
+
+
+		/**
+		 * Return the number of NaN values discarded.
+		 **/
+		MTOOLS_FORCEINLINE uint64 nbNaN() const { return _nb_nan; }
+
+
+		/**
+		 * Return the minimum finite value inserted (+infty if there are none).
+		 **/
+		MTOOLS_FORCEINLINE double minVal() const { return _minval; }
+
+
+		/**
+		 * Return the maximum finite value inserted (-infty if there are none).
+		 **/
+		MTOOLS_FORCEINLINE double maxVal() const { return _maxval; }
+
+
+		/**
+		 * Return the expectation of the finite values.
+		 **/
+		MTOOLS_FORCEINLINE double expectation() const { return _mean; }
+
+
+		/**
+		 * Return the (biased) empirical variance of the finite values.
+		 **/
+		MTOOLS_FORCEINLINE double variance() const { return (_nb == 0) ? 0.0 : (_m2 / _nb); }
+
+
+		/**
+		 * Return the unbiased estimator of the variance of the finite values.
+		 **/
+		MTOOLS_FORCEINLINE double unbiasedVariance() const { return (_nb < 2) ? 0.0 : (_m2 / (_nb - 1)); }
+
+
+		/**
+		 * Estimate the CDF P(X <= x) (infinite values included).
+		 **/
+		double cdf(double x) const
+			{
+			const uint64 N = nbInsertion();
+			if (N == 0) return 0.0;
+			if (x != x) return 0.0;
+			if (x == std::numeric_limits<double>::infinity()) return 1.0;
+			return ((double)_nb_minus_infinity + _nb * _cdfFinite(x)) / N;
+			}
+
+
+		/**
+		 * Estimate the tail distribution P(X > x).
+		 **/
+		double tail(double x) const { return (nbInsertion() == 0) ? 0.0 : 1.0 - cdf(x); }
+
+
+		/**
+		 * Estimate a quantile: the smallest x such that P(X <= x) >= p (infinite values included).
+		 *
+		 * @param	p	The probability in [0,1].
+		 *
+		 * @return	The quantile (possibly +/-infty) or NaN if the distribution is empty.
+		 **/
+		double quantile(double p) const
+			{
+			const uint64 N = nbInsertion();
+			if (N == 0) return std::numeric_limits<double>::quiet_NaN();
+			p = (p < 0.0) ? 0.0 : ((p > 1.0) ? 1.0 : p);
+			double r = p * N;
+			if ((_nb_minus_infinity > 0) && (r <= (double)_nb_minus_infinity)) return -std::numeric_limits<double>::infinity();
+			r -= _nb_minus_infinity;
+			if (r > (double)_nb) return std::numeric_limits<double>::infinity();
+			return _quantileFinite(r / _nb);
+			}
+
+
+		/**
+		 * Return the number of centroids of the t-digest.
+		 **/
+		size_t nbCentroids() const { _flush(); return _means.size(); }
+
+
+		/**
+		 * Print information about this object into an std::string.
+		 **/
+		std::string toString() const
+			{
+			std::string s("RealEmpiricalDistribution [compression="); s += mtools::toString(compression()) + "]";
+			if (isEmpty()) return s + " EMPTY !\n";
+			s += std::string("\n - memory usage : ") + toStringMemSize(memoryFootprint()) + "\n";
+			s += std::string(" - number of entries = ") + mtools::toString(nbInsertion()) + " (" + mtools::toString(nbCentroids()) + " centroids)\n";
+			s += std::string(" - range of values = [") + mtools::toString(minVal()) + " , " + mtools::toString(maxVal()) + "]\n";
+			s += std::string(" - E[X]   = ") + mtools::toString(expectation()) + "\n";
+			s += std::string(" - Var[X] = ") + mtools::toString(variance()) + "\n";
+			s += std::string(" - quantiles 1% / 50% / 99% = ") + mtools::toString(quantile(0.01)) + " / " + mtools::toString(quantile(0.5)) + " / " + mtools::toString(quantile(0.99)) + "\n";
+			if (nbMinusInfinity() > 0) s += std::string(" - number of values = -infty : ") + mtools::toString(nbMinusInfinity()) + "\n";
+			if (nbPlusInfinity() > 0) s += std::string(" - number of values = +infty : ") + mtools::toString(nbPlusInfinity()) + "\n";
+			if (nbNaN() > 0) s += std::string(" - number of NaN discarded : ") + mtools::toString(nbNaN()) + "\n";
+			return s;
+			}
+
+
+		/**
+		 * Return the number of bytes used by this object.
+		 **/
+		uint64 memoryFootprint() const
+			{
+			return sizeof(RealEmpiricalDistribution) + sizeof(double)*(_means.capacity() + _weights.capacity() + _buffer.capacity());
+			}
+
+
+	private:
+
+		template<typename ED> friend size_t internals_empiricaldistribution::parallelLoadBunch(ED &, const std::string &, const std::string &, int, EmpiricalDistributionLoadReport *);
+
+
+		/* deserialize the object, return false (and reset the object) if the data is not valid */
+		bool _tryDeserialize(IBaseArchive & ar)
+			{
+			reset();
+			ar & _compression;
+			if (!(_compression >= 20)) { _compression = DEFAULT_COMPRESSION; return false; }
+			ar & _means;
+			ar & _weights;
+			ar & _nb;
+			ar & _mean;
+			ar & _m2;
+			ar & _minval;
+			ar & _maxval;
+			ar & _nb_plus_infinity;
+			ar & _nb_minus_infinity;
+			ar & _nb_nan;
+			double W = 0.0;
+			for (double w : _weights) { W += w; }
+			if ((_means.size() != _weights.size()) || (std::abs(W - (double)_nb) > 0.5 + 1.0e-9*_nb) || (!(_m2 >= 0.0)) || ((_nb > 0) && (!(_minval <= _maxval)))) { const double c = _compression; reset(); _compression = c; return false; }
+			return true;
+			}
+
+
+		/* true if the points of ED can be merged into this object */
+		bool _sameParameters(const RealEmpiricalDistribution & ED) const { return true; }
+
+
+		/* merge the insertion buffer into the centroids */
+		void _flush() const
+			{
+			if (_buffer.size() == 0) return;
+			for (double x : _buffer) { _means.push_back(x); _weights.push_back(1.0); }
+			_buffer.clear();
+			_compress(_means, _weights);
+			}
+
+
+		/* maximal cumulated weight (as a fraction of the total) of a centroid starting at q. Each centroid may span
+		 * one unit of both scale functions of the t-digest:
+		 * - k1(q) = compression/(2 PI) * asin(2q - 1) bounds the size of the centroids in the bulk
+		 * - k2(q) = norm * log(q/(1-q)) makes them shrink geometrically toward the tails so the extreme quantiles
+		 *   are accurate (norm depends on the total weight so that the number of centroids stays of order
+		 *   compression()). */
+		MTOOLS_FORCEINLINE double _qlimit(double q, double norm) const
+			{
+			q = (q < 0.0) ? 0.0 : ((q > 1.0) ? 1.0 : q);
+			const double k1 = _compression / (2 * PI) * asin(2 * q - 1) + 1.0;
+			const double q1 = (k1 >= _compression / 4) ? 1.0 : (sin(k1 * (2 * PI) / _compression) + 1) / 2;
+			const double q2 = 1 / (1 + exp(-(log(q / (1 - q)) + 1.0 / norm)));
+			return std::min<double>(q1, q2);
+			}
+
+
+		/* sort the centroids and merge them greedily such that each centroid spans at most one unit of the scale function */
+		void _compress(std::vector<double> & means, std::vector<double> & weights) const
+			{
+			const size_t n = means.size();
+			if (n == 0) return;
+			std::vector<size_t> perm(n);
+			for (size_t i = 0; i < n; i++) perm[i] = i;
+			std::sort(perm.begin(), perm.end(), [&](size_t a, size_t b) { return means[a] < means[b]; });
+			double W = 0;
+			for (size_t i = 0; i < n; i++) W += weights[i];
+			const double norm = _compression / (4 * log(std::max<double>(W / _compression, 1.0)) + 24);
+			std::vector<double> nm, nw;
+			nm.reserve((size_t)(2 * _compression) + 8);
+			nw.reserve((size_t)(2 * _compression) + 8);
+			double cm = means[perm[0]], cw = weights[perm[0]];
+			double wsofar = 0;
+			double qlimit = _qlimit(0.0, norm) * W;
+			for (size_t i = 1; i < n; i++)
+				{
+				const double m = means[perm[i]], w = weights[perm[i]];
+				if (wsofar + cw + w <= qlimit)
+					{ // merge into the current centroid
+					cw += w;
+					cm += (m - cm) * w / cw;
+					}
+				else
+					{
+					nm.push_back(cm); nw.push_back(cw);
+					wsofar += cw;
+					qlimit = _qlimit(wsofar / W, norm) * W;
+					cm = m; cw = w;
+					}
+				}
+			nm.push_back(cm); nw.push_back(cw);
+			means.swap(nm);
+			weights.swap(nw);
+			}
+
+
+		/* estimate of P(X <= x) for the finite values */
+		double _cdfFinite(double x) const
+			{
+			_flush();
+			if ((_nb == 0) || (x < _minval)) return 0.0;
+			if (x >= _maxval) return 1.0;
+			const size_t n = _means.size();
+			if (n == 1) return (x - _minval) / (_maxval - _minval);
+			double left = _minval, cumw = 0; // position and cumulated weight of the previous anchor point
+			for (size_t i = 0; i < n; i++)
+				{ // anchors are the centers of the centroids, each holding half of its weight on each side
+				const double right = _means[i], rw = cumw + ((i == 0) ? 0.0 : _weights[i - 1] / 2) + _weights[i] / 2;
+				if (x < right) return (right > left) ? (cumw + (rw - cumw) * (x - left) / (right - left)) / _nb : cumw / _nb;
+				left = right; cumw = rw;
+				}
+			return (cumw + (_nb - cumw) * (x - left) / (_maxval - left)) / _nb;
+			}
+
+
+		/* estimate of the quantile of order q in [0,1] of the finite values */
+		double _quantileFinite(double q) const
+			{
+			_flush();
+			const size_t n = _means.size();
+			if (n == 1) return _minval + q * (_maxval - _minval);
+			const double target = q * _nb;
+			double left = _minval, cumw = 0;
+			for (size_t i = 0; i < n; i++)
+				{
+				const double right = _means[i], rw = cumw + ((i == 0) ? 0.0 : _weights[i - 1] / 2) + _weights[i] / 2;
+				if (target <= rw) return (rw > cumw) ? (left + (right - left) * (target - cumw) / (rw - cumw)) : right;
+				left = right; cumw = rw;
+				}
+			return (_nb > cumw) ? (left + (_maxval - left) * (target - cumw) / (_nb - cumw)) : _maxval;
+			}
+
+
+		double _compression;					// compression parameter of the t-digest
+		mutable std::vector<double> _means;		// means of the centroids (sorted)
+		mutable std::vector<double> _weights;	// weights of the centroids
+		mutable std::vector<double> _buffer;	// values inserted but not yet merged into the centroids
+
+		uint64 _nb;								// number of finite values
+		double _mean;							// mean of the finite values (Welford)
+		double _m2;								// sum of the squared deviations from the mean (Welford)
+		double _minval;							// minimum finite value
+		double _maxval;							// maximum finite value
+
+		uint64 _nb_plus_infinity;				// number of entries that are +infinity
+		uint64 _nb_minus_infinity;				// number of entries that are -infinity
+		uint64 _nb_nan;							// number of NaN discarded
+	};
+
+
+
+/**
+ * Concurrent version of IntegerEmpiricalDistribution. Any number of threads may insert values
+ * simultaneously without lock while another thread takes snapshots of the distribution.
+ *
+ * The counters are split into shards: each thread writes into its own shard (threads are given
+ * consecutive indices, modulo the number of shards) with relaxed atomic increments so there is no
+ * contention when there are at least as many shards as threads. The buckets are the same
+ * log-spaced buckets as IntegerEmpiricalDistribution. They are allocated lazily by chunks so only
+ * the ranges of values actually inserted use memory in each shard.
+ *
+ * snapshot() sums the shards into an IntegerEmpiricalDistribution (with its CDF already computed).
+ * It may run while the writers are active: the numbers of positive/negative values are recomputed
+ * from the buckets so the CDF and the moments of the snapshot are always consistent with each
+ * other (a value being inserted during the snapshot may or may not be counted).
+ *
+ * @code
+ * ConcurrentIntegerEmpiricalDistribution ED;
+ * // in each simulation thread
+ * ED.insert(exitTime);
+ * // in the monitoring thread
+ * auto S = ED.snapshot();
+ * cout << S.expectation() << " " << S.cdf(100) << "\n";
+ * @endcode
+ **/
+class ConcurrentIntegerEmpiricalDistribution
+	{
+
+	public:
+
+		static const uint64 MAX_LOGSPACING = 24;		// maximum logarithm of the spacing (the directory of chunks is not allocated lazily).
+		static const size_t DEFAULT_NB_SHARDS = 64;		// default number of shards.
+
+
+		/**
+		 * Constructor. Create an empty distribution.
+		 *
+		 * @param	logspacing	logarithm of the spacing parameter (between 2 and MAX_LOGSPACING), see
+		 * 						IntegerEmpiricalDistribution.
+		 * @param	nbShards  	number of shards (should be at least the number of writing threads).
+		 **/
+		ConcurrentIntegerEmpiricalDistribution(uint64 logspacing = IntegerEmpiricalDistribution::DEFAULT_LOGSPACING, size_t nbShards = DEFAULT_NB_SHARDS) : EXP(logspacing), CH(std::min<uint64>(logspacing, 10)), _layout(logspacing), _shards(), _nbchunks(0)
+			{
+			MTOOLS_INSURE(logspacing >= 2);
+			MTOOLS_INSURE(logspacing <= MAX_LOGSPACING);
+			MTOOLS_INSURE(nbShards > 0);
+			for (size_t i = 0; i < nbShards; i++) { _shards.push_back(new _Shard()); }
+			reset();
+			}
+
+
+		/**
+		 * Destructor.
+		 **/
+		~ConcurrentIntegerEmpiricalDistribution()
+			{
+			_release();
+			for (auto S : _shards) { delete S; }
+			}
+
+
+		/**
+		 * Resets this object to the empty emprical distribution. Not threadsafe: no other thread may
+		 * access the object during the call.
+		 **/
+		void reset()
+			{
+			_release();
+			for (auto S : _shards)
+				{
+				for (size_t k = 0; k < 2; k++) for (size_t o = 0; o < 64; o++) { S->dir[k][o] = nullptr; }
+				S->nb_plus_infinity = 0;
+				S->nb_minus_infinity = 0;
+				S->minval = std::numeric_limits<int64>::max();
+				S->maxval = std::numeric_limits<int64>::min();
+				}
+			_nbchunks = 0;
+			}
+
+
+		/**
+		 * Return the logarithm in base 2 of the spacing.
+		 **/
+		MTOOLS_FORCEINLINE uint64 logspacing() const { return EXP; }
+
+
+		/**
+		 * Return the number of shards.
+		 **/
+		MTOOLS_FORCEINLINE size_t nbShards() const { return _shards.size(); }
+
+
+		/**
+		 * Insert a new realization in the distribution. Threadsafe.
+		 *
+		 * @param	val	The value to insert.
+		 **/
+		MTOOLS_FORCEINLINE void insert(const int64 val)
+			{
+			_Shard & S = _shard();
+			_atomicMin(S.minval, val); // before the counter (release) so a snapshot which sees the value also sees the range
+			_atomicMax(S.maxval, val);
+			uint64 hb;
+			if (val >= 0) { _counter(S, 0, _layout._posInArray_u((uint64)val, hb)).fetch_add(1, std::memory_order_release); return; }
+			_counter(S, 1, _layout._posInArray_u((uint64)(-val), hb)).fetch_add(1, std::memory_order_release);
+			}
+
+
+		/**
+		 * Insert a new realization in the distribution. Same as insert(val).
+		 **/
+		MTOOLS_FORCEINLINE void operator[](const int64 val) { insert(val); }
+
+
+		/**
+		 * Inserts a plus or minus infinity value. Threadsafe.
+		 **/
+		MTOOLS_FORCEINLINE void insert_infinity(bool positiveinfinity) { if (positiveinfinity) insert_plus_infinity(); else insert_minus_infinity(); }
+
+
+		/**
+		 * Inserts a +infty value. Threadsafe.
+		 **/
+		MTOOLS_FORCEINLINE void insert_plus_infinity() { _shard().nb_plus_infinity.fetch_add(1, std::memory_order_relaxed); }
+
+
+		/**
+		 * Inserts a -infty value. Threadsafe.
+		 **/
+		MTOOLS_FORCEINLINE void insert_minus_infinity() { _shard().nb_minus_infinity.fetch_add(1, std::memory_order_relaxed); }
+
+
+		/**
+		 * Return a snapshot of the distribution, with its CDF computed. May be called while other
+		 * threads are inserting values.
+		 **/
+		IntegerEmpiricalDistribution snapshot() const
+			{
+			IntegerEmpiricalDistribution ED(EXP);
+			snapshot(ED);
+			return ED;
+			}
+
+
+		/**
+		 * Put a snapshot of the distribution in ED (whose previous content is discarded) and compute
+		 * its CDF. May be called while other threads are inserting values.
+		 **/
+		void snapshot(IntegerEmpiricalDistribution & ED) const
+			{
+			ED.reset();
+			ED.EXP = EXP;
+			const uint64 L = (1ull << EXP);
+			const uint64 C = (1ull << CH);
+			for (auto S : _shards)
+				{
+				for (size_t k = 0; k < 2; k++)
+					{
+					std::vector<uint64> & tab = ((k == 0) ? ED._tab_plus : ED._tab_minus);
+					for (uint64 o = 0; o < 64; o++)
+						{
+						_ChunkPtr * d = S->dir[k][o].load(std::memory_order_acquire);
+						if (d == nullptr) continue;
+						for (uint64 j = 0; j < (L >> CH); j++)
+							{
+							_Counter * c = d[j].load(std::memory_order_acquire);
+							if (c == nullptr) continue;
+							const uint64 base = (o << EXP) + (j << CH);
+							for (uint64 i = 0; i < C; i++)
+								{
+								const uint64 n = c[i].load(std::memory_order_acquire);
+								if (n == 0) continue;
+								if (base + i >= tab.size()) { tab.resize((size_t)(base + i + 1), 0); }
+								tab[(size_t)(base + i)] += n;
+								}
+							}
+						}
+					}
+				ED._nb_plus_infinity += S->nb_plus_infinity.load(std::memory_order_relaxed);
+				ED._nb_minus_infinity += S->nb_minus_infinity.load(std::memory_order_relaxed);
+				}
+			for (auto n : ED._tab_plus) { ED._nb_plus += n; }
+			for (auto n : ED._tab_minus) { ED._nb_minus += n; }
+			if (ED._nb_plus + ED._nb_minus > 0)
+				{
+				for (auto S : _shards)
+					{
+					ED._minval = std::min<int64>(ED._minval, S->minval.load(std::memory_order_relaxed));
+					ED._maxval = std::max<int64>(ED._maxval, S->maxval.load(std::memory_order_relaxed));
+					}
+				}
+			ED._recomputeSums();
+			ED.recomputeCDF();
+			}
+
+
+		/**
+		 * Return the number of bytes used by this object.
+		 **/
+		uint64 memoryFootprint() const
+			{
+			uint64 m = sizeof(ConcurrentIntegerEmpiricalDistribution) + _shards.size()*sizeof(_Shard);
+			for (auto S : _shards) for (size_t k = 0; k < 2; k++) for (size_t o = 0; o < 64; o++) { if (S->dir[k][o].load(std::memory_order_relaxed) != nullptr) m += sizeof(_ChunkPtr) << (EXP - CH); }
+			return m + _nbchunks.load(std::memory_order_relaxed)*(sizeof(_Counter) << CH);
+			}
+
+
+	private:
+
+		typedef std::atomic<uint64>		_Counter;		// a bucket
+		typedef std::atomic<_Counter*>	_ChunkPtr;		// pointer to a chunk of 2^CH buckets
+		typedef std::atomic<_ChunkPtr*>	_DirPtr;		// pointer to the directory of chunks of an octave (2^EXP buckets)
+
+		/* counters of a shard: dir[0] for non-negative values and dir[1] for negative ones */
+		struct _Shard
+			{
+			_DirPtr					dir[2][64];
+			std::atomic<uint64>		nb_plus_infinity;
+			std::atomic<uint64>		nb_minus_infinity;
+			std::atomic<int64>		minval;
+			std::atomic<int64>		maxval;
+			char					pad[64];	// the shards are allocated separately, keep them on different cache lines
+			};
+
+
+		/* the shard of the calling thread */
+		MTOOLS_FORCEINLINE _Shard & _shard() const
+			{
+			static std::atomic<size_t> next(0);
+			static thread_local const size_t index = next++;
+			return *(_shards[index % _shards.size()]);
+			}
+
+
+		/* return the bucket at position index, allocate it if needed */
+		MTOOLS_FORCEINLINE _Counter & _counter(_Shard & S, size_t k, uint64 index)
+			{
+			const uint64 r = index & ((1ull << EXP) - 1);
+			_DirPtr & dp = S.dir[k][index >> EXP];
+			_ChunkPtr * d = dp.load(std::memory_order_acquire);
+			if (d == nullptr) { d = _install(dp, new _ChunkPtr[(size_t)(1ull << (EXP - CH))]()); }
+			_ChunkPtr & cp = d[r >> CH];
+			_Counter * c = cp.load(std::memory_order_acquire);
+			if (c == nullptr)
+				{
+				_Counter * nc = new _Counter[(size_t)(1ull << CH)]();
+				c = _install(cp, nc);
+				if (c == nc) _nbchunks++;
+				}
+			return c[r & ((1ull << CH) - 1)];
+			}
+
+
+		/* publish a newly allocated array, or use the one published by another thread in the meantime */
+		template<typename U> static U * _install(std::atomic<U*> & slot, U * p)
+			{
+			U * expected = nullptr;
+			if (slot.compare_exchange_strong(expected, p, std::memory_order_acq_rel)) return p;
+			delete[] p;
+			return expected;
+			}
+
+
+		static MTOOLS_FORCEINLINE void _atomicMin(std::atomic<int64> & a, int64 v)
+			{
+			int64 c = a.load(std::memory_order_relaxed);
+			while ((v < c) && (!a.compare_exchange_weak(c, v, std::memory_order_relaxed))) {}
+			}
+
+
+		static MTOOLS_FORCEINLINE void _atomicMax(std::atomic<int64> & a, int64 v)
+			{
+			int64 c = a.load(std::memory_order_relaxed);
+			while ((v > c) && (!a.compare_exchange_weak(c, v, std::memory_order_relaxed))) {}
+			}
+
+
+		/* release all the chunks and directories */
+		void _release()
+			{
+			for (auto S : _shards) for (size_t k = 0; k < 2; k++) for (size_t o = 0; o < 64; o++)
+				{
+				_ChunkPtr * d = S->dir[k][o].load(std::memory_order_relaxed);
+				if (d == nullptr) continue;
+				for (uint64 j = 0; j < (1ull << (EXP - CH)); j++) { delete[] d[j].load(std::memory_order_relaxed); }
+				delete[] d;
+				S->dir[k][o] = nullptr;
+				}
+			}
+
+
+		ConcurrentIntegerEmpiricalDistribution(const ConcurrentIntegerEmpiricalDistribution &) = delete;				// no copy
+		ConcurrentIntegerEmpiricalDistribution & operator=(const ConcurrentIntegerEmpiricalDistribution &) = delete;	//
+
+		uint64 EXP;									// L = 2^EXP, same buckets as IntegerEmpiricalDistribution
+		uint64 CH;									// a chunk contains 2^CH buckets
+		const IntegerEmpiricalDistribution _layout;	// empty distribution, only used to compute the position of the buckets
+		std::vector<_Shard*> _shards;				// the shards
+		std::atomic<uint64> _nbchunks;				// number of chunks allocated
+	};
+
+
+
+namespace internals_empiricaldistribution
+	{
+
+	/* implementation of load_and_append_bunch_parallel() */
+	template<typename ED> size_t parallelLoadBunch(ED & target, const std::string & filename, const std::string & path, int nbThreads, EmpiricalDistributionLoadReport * report)
+		{
+		const auto t0 = std::chrono::steady_clock::now();
+		std::vector<std::string> tabfile;
+		mtools::getFileList(path, filename + "-*", false, tabfile, false, true, false);
+		if (doFileExist(path + "/" + filename)) tabfile.push_back(filename);
+		if (nbThreads <= 0) nbThreads = (int)nbHardwareThreads();
+		if ((size_t)nbThreads > tabfile.size()) nbThreads = (int)std::max<size_t>(1, tabfile.size());
+		ED proto(target);
+		proto.reset(); // empty object with the same parameters
+		std::vector<ED> partial((size_t)nbThreads, proto);
+		std::unique_ptr<ED> ref;	// parameters of the first file loaded (when target is empty)
+		std::mutex mut;
+		std::vector<std::string> bad;
+		std::atomic<size_t> next(0), nbloaded(0);
+		std::atomic<uint64> nbbytes(0);
+		auto work = [&](size_t t)
+			{
+			size_t k;
+			while ((k = next++) < tabfile.size())
+				{
+				const std::string fn = path + "/" + tabfile[k];
+				ED E(proto);
+				bool ok = false;
+				try
+					{
+					IFileArchive ar(fn);
+					ok = E._tryDeserialize(ar);
+					}
+				catch (...) { ok = false; }
+				if (ok)
+					{
+					std::lock_guard<std::mutex> lock(mut);
+					const ED * R = (!target.isEmpty()) ? (&target) : ref.get();
+					if (R == nullptr) { ref.reset(new ED(E)); } else { ok = R->_sameParameters(E); }
+					}
+				if (!ok) { std::lock_guard<std::mutex> lock(mut); bad.push_back(fn); continue; }
+				std::ifstream f(fn, std::ios::binary | std::ios::ate);
+				if (f) nbbytes += (uint64)f.tellg();
+				partial[t].merge(E);
+				nbloaded++;
+				}
+			};
+		std::vector<std::thread> threads;
+		for (size_t t = 1; t < partial.size(); t++) { threads.push_back(std::thread(work, t)); }
+		work(0);
+		for (auto & th : threads) { th.join(); }
+		for (size_t step = 1; step < partial.size(); step *= 2)
+			{ // tree reduction
+			threads.clear();
+			for (size_t i = 0; i + step < partial.size(); i += 2 * step) { threads.push_back(std::thread([&partial, i, step]() { partial[i].merge(partial[i + step]); })); }
+			for (auto & th : threads) { th.join(); }
+			}
+		target.merge(partial[0]);
+		if (report != nullptr)
+			{
+			report->nbFiles = tabfile.size();
+			report->nbLoaded = nbloaded;
+			report->badFiles = bad;
+			report->nbBytes = nbbytes;
+			report->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+			}
+		return nbloaded;
+		}
+
+	}
+
+
+
 
 }
 
@@ -27,58 +27,489 @@
 #include "../io/serialization.hpp"
 
 #include <string>
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <typeinfo>
 
 namespace mtools
 {
 
-// TODO
-template<class T> class ExTab
+
+    /**
+     * Constant memory summary of a very long sequence of numbers (typically a time series with
+     * 10^12 steps which cannot be stored).
+     *
+     * The sequence is cut into at most L consecutive cells. For each cell, the table keeps the
+     * minimum, the maximum and an estimate of the median of the values inside the cell. As long
+     * as there are less than L values, each cell contains a single value. When the table is full,
+     * cells are merged by groups of three (min of the mins, max of the maxs and median of the
+     * medians) so the length of the cells grows geometrically (1, 3, 9, 27...) while the memory
+     * stays bounded.
+     *
+     * The median of the cell currently being filled is computed with the remedian algorithm (one
+     * buffer of 2 values per level): Add() is O(1) amortized and the median estimate of a cell is
+     * the median of medians of its 3^k values (exact for the min and max).
+     *
+     * - minV(), maxV(), medV() query the cell containing a given entry.
+     * - range() returns the min/max over a range of entries (at the resolution of the cells).
+     * - append() concatenates another table (e.g. computed by another thread on the next part of
+     *   the series).
+     * - the table can be saved/loaded (Save(), Load()) or serialized with an archive.
+     *
+     * Plot2DExTab (in plot2Dextab.hpp) displays the table.
+     *
+     * @code{.cpp}
+     * ExTab<int64> tab(3000);        // at most 3000 cells
+     * int64 x = 0;
+     * for (uint64 i = 0; i < 1000000000000; i++) { x += (Unif(gen) < 0.5) ? 1 : -1; tab.Add(x); }
+     * double m = tab.maxV();         // max over the whole walk
+     * int64 y = tab.medV(0.5);       // median estimate around the middle of the walk
+     * @endcode
+     *
+     * @tparam  T   Type of the values. Must be comparable and convertible to/from double.
+     **/
+    template<class T> class ExTab
     {
-     
-public:
-
-    ExTab(size_t L);
-    ExTab(const std::string & filename);
-	ExTab(mtools::IBaseArchive & A);
-    ~ExTab();
-
-	void Save(const std::string & filename) const;
-	void Reset();
-    void serialize(mtools::OBaseArchive & ar);
-    void deserialize(mtools::IBaseArchive & ar);
-    inline void Add(const T & val);
-
-    inline T medV(uint64 pos) const;
-    inline T medV(double pos) const;
-    inline T maxV(uint64 pos) const;
-    inline T maxV(double pos) const;
-    inline T minV(uint64 pos) const;
-    inline T minV(double pos) const;
-    inline int64 NbEntries() const;
-
-    double maxV() const;
-	double minV() const;
-    std::string toString() const;
-    void append(const ExTab<T> & tab);
-    void append(const T * tab,size_t len);
-    void operator+=(const ExTab<T> & tab);
-    void operator-=(const ExTab<T> & tab);
-    void operator*=(const ExTab & tab);
-    void operator/=(const ExTab & tab);
-    void operator+=(double x);
-    void operator-=(double x);
-    void operator*=(double x);
-    void operator/=(double x);
- 
-
-
-private:
-
-	// no copy allowed
-	ExTab(const ExTab &);
-	ExTab & operator=(const ExTab &);
-
-};
+
+    public:
+
+
+        /**
+         * Constructor.
+         *
+         * @param   L   maximum number of cells (rounded up to a multiple of 3, at least 3).
+         **/
+        ExTab(size_t L = 3000) : _L(_roundL(L)) { Reset(); }
+
+
+        /**
+         * Constructor. Load the table from a file (created with Save()). Throws if error.
+         *
+         * @param   filename    name of the file.
+         **/
+        ExTab(const std::string & filename) : _L(3) { Load(filename); }
+
+
+        /**
+         * Constructor. Deserialize the table from an archive.
+         **/
+        ExTab(mtools::IBaseArchive & A) : _L(3) { deserialize(A); }
+
+
+        /**
+         * Destructor.
+         **/
+        ~ExTab() {}
+
+
+        /**
+         * Save the table into a file (binary archive). Throws if error. Use .z or .gz to save in
+         * compressed format.
+         *
+         * @param   filename    name of the file.
+         **/
+        void Save(const std::string & filename) const
+            {
+            OBinaryFileArchive ar(filename);
+            ar & (*this);
+            }
+
+
+        /**
+         * Load the table from a file. The current content is discarded. Throws if error.
+         *
+         * @param   filename    name of the file.
+         **/
+        void Load(const std::string & filename)
+            {
+            IFileArchive ar(filename);
+            ar & (*this);
+            }
+
+
+        /**
+         * Remove all the entries (the maximum number of cells is kept).
+         **/
+        void Reset()
+            {
+            _n = 0; _pcount = 0; _level = 0;
+            _gmin = _gmax = _pmin = _pmax = T();
+            _start.clear(); _min.clear(); _max.clear(); _med.clear();
+            _buf.clear(); _bufn.clear();
+            _reserve();
+            }
+
+
+        /**
+         * Serialize the table.
+         **/
+        void serialize(mtools::OBaseArchive & ar) const
+            {
+            uint64 L = _L;
+            ar & L & _level & _n & _pcount;
+            ar & _gmin & _gmax & _pmin & _pmax;
+            ar & _start & _min & _max & _med;
+            ar & _buf & _bufn;
+            }
+
+
+        /**
+         * Deserialize the table.
+         **/
+        void deserialize(mtools::IBaseArchive & ar)
+            {
+            uint64 L;
+            ar & L & _level & _n & _pcount;
+            ar & _gmin & _gmax & _pmin & _pmax;
+            ar & _start & _min & _max & _med;
+            ar & _buf & _bufn;
+            _L = (size_t)L;
+            MTOOLS_INSURE((_L >= 3) && (_L % 3 == 0) && (_level >= 0));
+            MTOOLS_INSURE((_start.size() < _L) && (_min.size() == _start.size()) && (_max.size() == _start.size()) && (_med.size() == _start.size()));
+            MTOOLS_INSURE((_buf.size() == 2 * (size_t)_level) && (_bufn.size() == (size_t)_level) && (_pcount <= _n));
+            _reserve();
+            }
+
+
+        /**
+         * Add a value at the end of the sequence. O(1) amortized.
+         *
+         * @param   val The value.
+         **/
+        inline void Add(const T & val)
+            {
+            if (_n == 0) { _gmin = _gmax = val; } else { if (val < _gmin) _gmin = val; if (_gmax < val) _gmax = val; }
+            if (_pcount == 0) { _pmin = _pmax = val; } else { if (val < _pmin) _pmin = val; if (_pmax < val) _pmax = val; }
+            _n++; _pcount++;
+            T m = val;
+            for (int j = 0; j < _level; j++)
+                { // remedian: level j holds up to 2 medians of 3^j values
+                if (_bufn[j] < 2) { _buf[2 * j + _bufn[j]] = m; _bufn[j]++; return; }
+                m = _med3(_buf[2 * j], _buf[2 * j + 1], m);
+                _bufn[j] = 0;
+                }
+            const uint64 start = _n - _pcount;
+            _pcount = 0;
+            _pushCell(start, _pmin, _pmax, m);
+            }
+
+
+        /**
+         * Estimate of the median of the values in the cell containing a given entry.
+         *
+         * @param   pos index of the entry (must be smaller than NbEntries()).
+         **/
+        inline T medV(uint64 pos) const
+            {
+            const size_t i = _cell(pos);
+            return (i == _start.size()) ? _partialMed() : _med[i];
+            }
+
+
+        /**
+         * Estimate of the median of the values in the cell at a given relative position.
+         *
+         * @param   pos relative position in [0,1] (0 = first entry, 1 = last entry).
+         **/
+        inline T medV(double pos) const { return medV(_relpos(pos)); }
+
+
+        /**
+         * Maximum of the values in the cell containing a given entry.
+         *
+         * @param   pos index of the entry (must be smaller than NbEntries()).
+         **/
+        inline T maxV(uint64 pos) const
+            {
+            const size_t i = _cell(pos);
+            return (i == _start.size()) ? _pmax : _max[i];
+            }
+
+
+        /**
+         * Maximum of the values in the cell at a given relative position in [0,1].
+         **/
+        inline T maxV(double pos) const { return maxV(_relpos(pos)); }
+
+
+        /**
+         * Minimum of the values in the cell containing a given entry.
+         *
+         * @param   pos index of the entry (must be smaller than NbEntries()).
+         **/
+        inline T minV(uint64 pos) const
+            {
+            const size_t i = _cell(pos);
+            return (i == _start.size()) ? _pmin : _min[i];
+            }
+
+
+        /**
+         * Minimum of the values in the cell at a given relative position in [0,1].
+         **/
+        inline T minV(double pos) const { return minV(_relpos(pos)); }
+
+
+        /**
+         * Number of values added so far.
+         **/
+        inline int64 NbEntries() const { return (int64)_n; }
+
+
+        /**
+         * Number of cells currently used (including the cell being filled).
+         **/
+        inline size_t NbCells() const { return _start.size() + ((_pcount > 0) ? 1 : 0); }
+
+
+        /**
+         * Maximum number of cells.
+         **/
+        inline size_t MaxCells() const { return _L; }
+
+
+        /**
+         * Maximum of all the values added (exact). NaN if the table is empty.
+         **/
+        double maxV() const { return (_n == 0) ? std::numeric_limits<double>::quiet_NaN() : (double)_gmax; }
+
+
+        /**
+         * Minimum of all the values added (exact). NaN if the table is empty.
+         **/
+        double minV() const { return (_n == 0) ? std::numeric_limits<double>::quiet_NaN() : (double)_gmin; }
+
+
+        /**
+         * Minimum and maximum of the values in the range [a,b) of entries, at the resolution of the
+         * cells: the values of all the cells intersecting the range are taken into account. The cost
+         * is proportional to the number of cells intersecting the range.
+         *
+         * @param   a               first entry.
+         * @param   b               entry after the last one.
+         * @param [in,out]  mn      set to the minimum.
+         * @param [in,out]  mx      set to the maximum.
+         *
+         * @return  false if the range contains no entry (mn and mx are not modified).
+         **/
+        bool range(uint64 a, uint64 b, T & mn, T & mx) const
+            {
+            if (b > _n) b = _n;
+            if (a >= b) return false;
+            size_t i = _cell(a);
+            const size_t j = _cell(b - 1);
+            bool first = true;
+            for (; i <= j; i++)
+                {
+                const T & m1 = (i == _start.size()) ? _pmin : _min[i];
+                const T & m2 = (i == _start.size()) ? _pmax : _max[i];
+                if (first) { mn = m1; mx = m2; first = false; }
+                else { if (m1 < mn) mn = m1; if (mx < m2) mx = m2; }
+                }
+            return true;
+            }
+
+
+        /**
+         * Return a string describing the table.
+         **/
+        std::string toString() const
+            {
+            std::string s("ExTab<");
+            s += typeid(T).name() + std::string(">\n");
+            s += " - entries   : " + mtools::toString(_n) + "\n";
+            s += " - cells     : " + mtools::toString(NbCells()) + " / " + mtools::toString(_L) + " (level " + mtools::toString(_level) + ")\n";
+            if (_n > 0) { s += " - range     : [" + mtools::toString(minV()) + ", " + mtools::toString(maxV()) + "]\n"; }
+            return s;
+            }
+
+
+        /**
+         * Append the entries of another table after those of this table (the tables may have been
+         * filled by different threads). The cell being filled in this table and the one of tab
+         * become complete cells. The cells are then merged as usual so the medians are only
+         * estimates, the min/max stay exact.
+         *
+         * @param   tab The table to append (must be distinct from this).
+         **/
+        void append(const ExTab<T> & tab)
+            {
+            MTOOLS_INSURE(&tab != this);
+            if (tab._n == 0) return;
+            _flush();
+            if (_n == 0) { _gmin = tab._gmin; _gmax = tab._gmax; }
+            else { if (tab._gmin < _gmin) _gmin = tab._gmin; if (_gmax < tab._gmax) _gmax = tab._gmax; }
+            if (tab._level > _level) { _level = tab._level; _buf.resize(2 * (size_t)_level); _bufn.resize((size_t)_level, 0); }
+            const uint64 base = _n;
+            for (size_t i = 0; i < tab._start.size(); i++) { _pushCell(base + tab._start[i], tab._min[i], tab._max[i], tab._med[i]); }
+            if (tab._pcount > 0) { _pushCell(base + tab._n - tab._pcount, tab._pmin, tab._pmax, tab._partialMed()); }
+            _n += tab._n;
+            }
+
+
+        /**
+         * Add the values of a C-array at the end of the sequence.
+         *
+         * @param   tab pointer to the values.
+         * @param   len number of values.
+         **/
+        void append(const T * tab, size_t len)
+            {
+            for (size_t i = 0; i < len; i++) Add(tab[i]);
+            }
+
+
+        /**
+         * Add a constant to all the values.
+         **/
+        void operator+=(double x) { _transform([&](const T & v) -> T { return (T)(v + x); }, false); }
+
+
+        /**
+         * Subtract a constant to all the values.
+         **/
+        void operator-=(double x) { _transform([&](const T & v) -> T { return (T)(v - x); }, false); }
+
+
+        /**
+         * Multiply all the values by a constant (the min and max are exchanged if x < 0).
+         **/
+        void operator*=(double x) { _transform([&](const T & v) -> T { return (T)(v * x); }, (x < 0)); }
+
+
+        /**
+         * Divide all the values by a constant (the min and max are exchanged if x < 0).
+         **/
+        void operator/=(double x) { _transform([&](const T & v) -> T { return (T)(v / x); }, (x < 0)); }
+
+
+    private:
+
+        // no copy allowed
+        ExTab(const ExTab &);
+        ExTab & operator=(const ExTab &);
+
+
+        /* round L to a multiple of 3 */
+        static size_t _roundL(size_t L) { if (L < 3) L = 3; return ((L + 2) / 3) * 3; }
+
+
+        /* the tables never reallocate while values are added (so a plot may read them) */
+        void _reserve()
+            {
+            _start.reserve(_L); _min.reserve(_L); _max.reserve(_L); _med.reserve(_L);
+            }
+
+
+        /* median of 3 values */
+        static inline T _med3(const T & a, const T & b, const T & c)
+            {
+            if (a < b) { if (b < c) return b; return (a < c) ? c : a; }
+            if (a < c) return a;
+            return (b < c) ? c : b;
+            }
+
+
+        /* estimate of the median of the cell being filled: from the highest non-empty remedian buffer */
+        T _partialMed() const
+            {
+            for (int j = _level - 1; j >= 0; j--)
+                {
+                if (_bufn[j] == 1) return _buf[2 * j];
+                if (_bufn[j] == 2) return (T)(((double)_buf[2 * j] + (double)_buf[2 * j + 1]) / 2);
+                }
+            return (T)(((double)_pmin + (double)_pmax) / 2);
+            }
+
+
+        /* index of the cell containing entry pos (_start.size() for the cell being filled) */
+        inline size_t _cell(uint64 pos) const
+            {
+            MTOOLS_ASSERT(pos < _n);
+            if (pos >= _n - _pcount) return _start.size();
+            return (size_t)(std::upper_bound(_start.begin(), _start.end(), pos) - _start.begin()) - 1;
+            }
+
+
+        /* entry at a relative position in [0,1] */
+        inline uint64 _relpos(double pos) const
+            {
+            MTOOLS_ASSERT(_n > 0);
+            if (!(pos > 0)) return 0;
+            const double p = pos * (double)(_n - 1);
+            return (p >= (double)(_n - 1)) ? (_n - 1) : (uint64)p;
+            }
+
+
+        /* add a complete cell, merge the cells by groups of three when the table is full */
+        inline void _pushCell(uint64 start, const T & mn, const T & mx, const T & md)
+            {
+            _start.push_back(start); _min.push_back(mn); _max.push_back(mx); _med.push_back(md);
+            if (_start.size() >= _L) _compact();
+            }
+
+
+        /* merge the cells by groups of three. Called when the cell being filled is empty */
+        void _compact()
+            {
+            MTOOLS_ASSERT(_pcount == 0);
+            const size_t nb = _start.size() / 3;
+            size_t k = 0;
+            for (size_t i = 0; i < nb; i++, k += 3)
+                {
+                _start[i] = _start[k];
+                _min[i] = std::min<T>(std::min<T>(_min[k], _min[k + 1]), _min[k + 2]);
+                _max[i] = std::max<T>(std::max<T>(_max[k], _max[k + 1]), _max[k + 2]);
+                _med[i] = _med3(_med[k], _med[k + 1], _med[k + 2]);
+                }
+            size_t r = nb;
+            for (; k < _start.size(); k++, r++) { _start[r] = _start[k]; _min[r] = _min[k]; _max[r] = _max[k]; _med[r] = _med[k]; }
+            _start.resize(r); _min.resize(r); _max.resize(r); _med.resize(r);
+            _level++;
+            _buf.resize(2 * (size_t)_level);
+            _bufn.resize((size_t)_level, 0);
+            }
+
+
+        /* close the cell being filled (even if it is not complete) */
+        void _flush()
+            {
+            if (_pcount == 0) return;
+            const T md = _partialMed();
+            const uint64 start = _n - _pcount;
+            _pcount = 0;
+            for (auto & c : _bufn) c = 0;
+            _pushCell(start, _pmin, _pmax, md);
+            }
+
+
+        /* apply an increasing (or decreasing if swap is set) map to all the values */
+        template<typename FUN> void _transform(FUN f, bool swap)
+            {
+            for (auto & v : _min) v = f(v);
+            for (auto & v : _max) v = f(v);
+            for (auto & v : _med) v = f(v);
+            for (auto & v : _buf) v = f(v);
+            _pmin = f(_pmin); _pmax = f(_pmax); _gmin = f(_gmin); _gmax = f(_gmax);
+            if (swap) { _min.swap(_max); std::swap(_pmin, _pmax); std::swap(_gmin, _gmax); }
+            }
+
+
+        size_t              _L;         // maximum number of cells (multiple of 3)
+        int32               _level;     // complete cells added by Add() contain 3^_level values
+        uint64              _n;         // number of entries
+        uint64              _pcount;    // number of entries in the cell being filled
+        T                   _gmin, _gmax;   // global min/max
+        T                   _pmin, _pmax;   // min/max of the cell being filled
+        std::vector<uint64> _start;     // index of the first entry of each complete cell
+        std::vector<T>      _min;       // min of each complete cell
+        std::vector<T>      _max;       // max of each complete cell
+        std::vector<T>      _med;       // median estimate of each complete cell
+        std::vector<T>      _buf;       // remedian buffers of the cell being filled (2 values per level)
+        std::vector<uint8>  _bufn;      // number of values in each buffer
+
+    };
 
 
 }
@@ -86,17 +517,3 @@ private:
 
 /* end of file */
 
-
-
-
-
-
-
-
-
-
-
-
-
-
-
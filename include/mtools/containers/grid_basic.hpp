@@ -26,17 +26,28 @@
 #include "../maths/box.hpp"
 #include "../misc/metaprog.hpp"
 #include "../io/serialization.hpp"
+#include "../misc/internal/threadworker.hpp"
+#include "../misc/profiler.hpp"
 #include "internal/internals_grid.hpp"
 
 #include <string>
 #include <atomic>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <thread>
+#include <type_traits>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 
 
 namespace mtools
 {
 
     /* forward declaration of the Grid_basic class*/
-    template< size_t D, typename T, size_t NB_SPECIAL, size_t R> class Grid_factor;
+    template< size_t D, typename T, size_t NB_SPECIAL, size_t R, typename LAYOUT> class Grid_factor;
 
 
     /**
@@ -58,9 +69,10 @@ namespace mtools
      * previously accessed element.
      * 
      * - No objet of type T is ever deleted, copied or moved around during the whole life of the
-     * grid. Thus, pointers/references to elements are never invalidated. Destructors of all the
-     * objects created are called when the grid is destoyed or reset (unless the caller specifically
-     * requests not to call the dtors).
+     * grid (unless sparse leafs are enabled, see sparseLeafs(), or snapshots are taken, see
+     * snapshot()). Thus, pointers/references to elements are never invalidated. Destructors of all
+     * the objects created are called when the grid is destoyed or reset (unless the caller
+     * specifically requests not to call the dtors).
      * 
      * - The type T need only be constructible with `T()` or `T(const Pos &)`. If both ctor exist,
      * the positional constructor is used. Furthermore, if T has a copy constructor, then the whole
@@ -90,17 +102,25 @@ namespace mtools
      *              | 3         | 20
      *              | 4         | 6
      *              | >= 5      | 1.
+     * @tparam  LAYOUT  Memory layout of the cells inside an elementary box. Either
+     *                  GridLayout_rowMajor (default) or GridLayout_tiled<B> which stores the cells by
+     *                  contiguous tiles of size B^D and improves cache locality for local access
+     *                  patterns when R is large. The layout does not change the file format.
      *
      * @sa  Grid_factor
      **/
-    template<size_t D, typename T, size_t R = internals_grid::defaultR<D>::val > class Grid_basic
+    template<size_t D, typename T, size_t R = internals_grid::defaultR<D>::val, typename LAYOUT = GridLayout_rowMajor > class Grid_basic
     {
 
-        template<size_t D2, typename T2, size_t NB_SPECIAL2, size_t R2> friend class Grid_factor;
+        template<size_t D2, typename T2, size_t NB_SPECIAL2, size_t R2, typename LAYOUT2> friend class Grid_factor;
 
         typedef internals_grid::_box<D, T, R> *     _pbox;
         typedef internals_grid::_node<D, T, R> *    _pnode;
-        typedef internals_grid::_leaf<D, T, R> *    _pleaf;
+        typedef internals_grid::_leaf<D, T, R, LAYOUT> *    _pleaf;
+        typedef internals_grid::_sparseLeaf<D, T, R, LAYOUT>    _sparseLeaf;
+        typedef internals_grid::_sparseLeaf<D, T, R, LAYOUT> *  _psparse;
+
+        struct _SnapData;
 
 
     public:
@@ -111,6 +131,31 @@ namespace mtools
         typedef iVec<D> Pos;
 
 
+        /**
+         * Position in the tree owned by the caller (see the get(), set() and peek() overloads taking a
+         * cursor). Without a cursor, each access starts from a position shared by all the callers of
+         * the grid, so threads walking different regions keep moving each other away from their own
+         * region and write the same cache line. Each thread should own its cursor and use it for all
+         * its accesses.
+         *
+         * A default constructed cursor is empty and can be used with any grid. Afterwards, a cursor must
+         * only be used with the grid it was first used with. It remains valid when the grid is reset,
+         * loaded or assigned (the grid detects it and starts over) but not when the grid is destroyed.
+         **/
+        struct Cursor
+            {
+            Cursor() : _p(nullptr), _gen(0) {}
+
+            /** Empty the cursor. **/
+            void reset() { _p = nullptr; }
+
+            private:
+                friend class Grid_basic;
+                void *  _p;     // current box
+                uint64  _gen;   // generation of the tree when _p was set
+            };
+
+
         /**
          * Constructor. An empty grid (no objet of type T is created).
          *
@@ -118,7 +163,7 @@ namespace mtools
          *                      is released. Setting this to false can speed up memory relase for basic
          *                      type that do not have 'important' destructors.
          **/
-        Grid_basic(bool callDtors = true) : _pcurrent((_pbox)nullptr), _pcurrentpeek((_pbox)nullptr), _rangemin(std::numeric_limits<int64>::max()), _rangemax(std::numeric_limits<int64>::min()), _callDtors(callDtors) 
+        Grid_basic(bool callDtors = true) : _pcurrent((_pbox)nullptr), _pcurrentpeek((_pbox)nullptr), _rangemin(std::numeric_limits<int64>::max()), _rangemax(std::numeric_limits<int64>::min()), _callDtors(callDtors), _sparse(false)
             { 
             _createBaseNode(); 
             }
@@ -129,7 +174,7 @@ namespace mtools
          *
          * @param   filename    Filename of the file.
          **/
-        Grid_basic(const std::string & filename) : _pcurrent((_pbox)nullptr), _pcurrentpeek((_pbox)nullptr), _rangemin(std::numeric_limits<int64>::max()), _rangemax(std::numeric_limits<int64>::min()), _callDtors(true) {load(filename);}
+        Grid_basic(const std::string & filename) : _pcurrent((_pbox)nullptr), _pcurrentpeek((_pbox)nullptr), _rangemin(std::numeric_limits<int64>::max()), _rangemax(std::numeric_limits<int64>::min()), _callDtors(true), _sparse(false) {load(filename);}
         
         
         /**
@@ -137,16 +182,21 @@ namespace mtools
         *
         * @param   str    Filename of the file.
         **/
-        Grid_basic(const char * str) : _pcurrent((_pbox)nullptr), _pcurrentpeek((_pbox)nullptr), _rangemin(std::numeric_limits<int64>::max()), _rangemax(std::numeric_limits<int64>::min()), _callDtors(true) { load(std::string(str)); } // needed together with the std::string ctor to prevent implicit conversion to bool and call of the wrong ctor.
+        Grid_basic(const char * str) : _pcurrent((_pbox)nullptr), _pcurrentpeek((_pbox)nullptr), _rangemin(std::numeric_limits<int64>::max()), _rangemax(std::numeric_limits<int64>::min()), _callDtors(true), _sparse(false) { load(std::string(str)); } // needed together with the std::string ctor to prevent implicit conversion to bool and call of the wrong ctor.
 
 
 		/**
 		 * Move constructor.
 		 **/
-		Grid_basic(Grid_basic && G) : _pcurrent((_pbox)G._pcurrent), _pcurrentpeek((_pbox)G._pcurrentpeek), _rangemin(G._rangemin), _rangemax(G._rangemax), _callDtors(G._callDtors), _poolLeaf(std::move(G._poolLeaf)), _poolNode(std::move(G._poolNode))
+		Grid_basic(Grid_basic && G) : _pcurrent((_pbox)G._pcurrent), _pcurrentpeek((_pbox)G._pcurrentpeek), _rangemin(G._rangemin), _rangemax(G._rangemax), _callDtors(G._callDtors), _sparse(G._sparse), _poolLeaf(std::move(G._poolLeaf)), _poolNode(std::move(G._poolNode)), _poolSparse0(std::move(G._poolSparse0)), _poolSparse1(std::move(G._poolSparse1)), _poolSparse2(std::move(G._poolSparse2))
 			{
+			_deltaFull = G._deltaFull;
+			_cowgen = G._cowgen;
+			_snap = std::move(G._snap);
+			_snaplink = std::move(G._snaplink);
 			G._pcurrentpeek = nullptr;
 			G._pcurrent = nullptr;
+			G._generation++;
 			G._rangemin.clear(std::numeric_limits<int64>::max());
 			G._rangemax.clear(std::numeric_limits<int64>::min());
 			G._callDtors = false;
@@ -156,7 +206,7 @@ namespace mtools
         /**
          * Destructor. Destroys the grid. The destructors of all the T objects in the grid are invoqued.
          * In order to prevent calling the dtors of T objects, invoque `callDtors(false)` prior to
-         * destructing the grid.
+         * destructing the grid. When T is trivially destructible, the objects are not visited.
          **/
         ~Grid_basic() { _destroyTree(); }
 
@@ -167,7 +217,7 @@ namespace mtools
          *
          * @param   G   The const Grid_basic<D,T,R> & to process.
          **/
-        Grid_basic(const Grid_basic<D, T, R> & G) : _pcurrent((_pbox)nullptr), _pcurrentpeek((_pbox)nullptr), _rangemin(std::numeric_limits<int64>::max()), _rangemax(std::numeric_limits<int64>::min()), _callDtors(true)
+        Grid_basic(const Grid_basic<D, T, R, LAYOUT> & G) : _pcurrent((_pbox)nullptr), _pcurrentpeek((_pbox)nullptr), _rangemin(std::numeric_limits<int64>::max()), _rangemax(std::numeric_limits<int64>::min()), _callDtors(true), _sparse(false)
             {
             static_assert(std::is_copy_constructible<T>::value, "The object T must be copy-constructible T(const T&) in order to use the copy constructor of the grid.");
             this->operator=(G);
@@ -181,7 +231,7 @@ namespace mtools
          *
          * @param   G   The source Grid_factor object to copy.
          **/
-        template<size_t NB_SPECIAL> Grid_basic(const Grid_factor<D, T, NB_SPECIAL, R> & G) : _pcurrent((_pbox)nullptr), _pcurrentpeek((_pbox)nullptr), _rangemin(std::numeric_limits<int64>::max()), _rangemax(std::numeric_limits<int64>::min()), _callDtors(true)
+        template<size_t NB_SPECIAL> Grid_basic(const Grid_factor<D, T, NB_SPECIAL, R, LAYOUT> & G) : _pcurrent((_pbox)nullptr), _pcurrentpeek((_pbox)nullptr), _rangemin(std::numeric_limits<int64>::max()), _rangemax(std::numeric_limits<int64>::min()), _callDtors(true), _sparse(false)
             {
             static_assert(std::is_copy_constructible<T>::value, "The object T must be copy-constructible T(const T&) in order to use the copy constructor of the grid.");
             this->operator=(G);
@@ -199,7 +249,7 @@ namespace mtools
          *
          * @return  the object for chaining.
          **/
-        Grid_basic<D, T, R> & operator=(const Grid_basic<D, T, R> & G)
+        Grid_basic<D, T, R, LAYOUT> & operator=(const Grid_basic<D, T, R, LAYOUT> & G)
             {
             static_assert(std::is_copy_constructible<T>::value,"The object T must be copy constructible T(const T&) in order to use assignement operator= on the grid.");
             if ((&G) == this) { return(*this); }
@@ -209,6 +259,7 @@ namespace mtools
             _pcurrent = _copy(G._getRoot(),nullptr);
             _pcurrentpeek = (_pbox)_pcurrent;
             _callDtors = G._callDtors;
+            _sparse = G._sparse;
             return(*this);
             }
 
@@ -224,14 +275,22 @@ namespace mtools
          *
          * @return  The object for chaining.
          **/
-        template<size_t NB_SPECIAL> Grid_basic<D, T, R> & operator=(const Grid_factor<D, T, NB_SPECIAL, R> & G);
+        template<size_t NB_SPECIAL> Grid_basic<D, T, R, LAYOUT> & operator=(const Grid_factor<D, T, NB_SPECIAL, R, LAYOUT> & G);
 
 
         /**
          * Resets the grid to its initial state. Call the destructor of all the T objects if the flag
          * callDtors is set. When the method returns, there are no living T object inside the grid.
+         * 
+         * If T is trivially destructible (or if callDtors is not set), the nodes and leaves are not
+         * visited: the blocks of the memory pools are released at once so the cost does not depend on
+         * the size of the grid. By default, the blocks are kept for the next simulation (no page
+         * fault when the grid is filled again, e.g. between the samples of a Monte Carlo loop).
+         *
+         * @param   releaseMemory   true to give the memory back to the operating system instead of
+         *                          keeping it for reuse.
          **/
-        void reset() { _destroyTree(); _createBaseNode(); }
+        void reset(bool releaseMemory = false) { _destroyTree(releaseMemory); _createBaseNode(); }
 
 
         /**
@@ -245,20 +304,7 @@ namespace mtools
          **/
         void serialize(OBaseArchive & ar) const
             {
-            ar << "\nBegining of Grid_basic<" << D << " , [" << std::string(typeid(T).name()) << "] , " << R << ">\n";
-            ar << "Version";    ar & ((uint64)1); ar.newline();
-            ar << "Template D"; ar & ((uint64)D); ar.newline();
-            ar << "Template R"; ar & ((uint64)R); ar.newline();
-            ar << "object T";   ar & std::string(typeid(T).name()); ar.newline();
-            ar << "sizeof(T)";  ar & ((uint64)sizeof(T)); ar.newline();
-            ar << "call dtors"; ar & _callDtors; ar.newline();
-            ar << "_rangemin";  ar & _rangemin; ar.newline();
-            ar << "_rangemax";  ar & _rangemax; ar.newline();
-            ar << "_minSpec";   ar & ((int64)0); ar.newline();
-            ar << "_maxSpec";   ar & ((int64)-1); ar.newline();
-            ar << "Grid tree\n";
-            _serializeTree(ar, _getRoot());
-            ar << "\nEnd of Grid_basic<" << D << " , [" << std::string(typeid(T).name()) << "] , " << R << ">\n";
+            _serializeWith(ar, _callDtors, _rangemin, _rangemax, [&](OBaseArchive & a) { _serializeTree(a, _getRoot()); });
             }
 
 
@@ -372,242 +418,1211 @@ namespace mtools
 
 
         /**
-         * Return the range of elements accessed. The method returns an empty box if no element 
-         * was ever accessed.
+         * Appends an incremental checkpoint to a delta file. Only the leafs (elementary sub-boxes)
+         * modified since the last checkpoint are written. A checkpoint is either a call to
+         * saveDelta(), clearDirty() or loadWithDeltas(). A typical use is:
+         * 
+         * - save(base) followed by clearDirty() to create the base file.
+         * - saveDelta(delta) regularly afterward (the delta file only grows).
+         * - loadWithDeltas(base, delta) to recover the grid at the last checkpoint.
+         * 
+         * A leaf is marked as modified when it is created or accessed through a non-const method
+         * (set(), get(), operator[], operator()...). After a reset(), a load() or an assignment, the
+         * whole grid is written in the next delta.
+         * 
+         * The delta file is compressed if it ends by the extension ".gz", ".gzip" or ".z". If the
+         * method fails, the delta file may contain an incomplete record and should not be used anymore.
          *
-         * @param [in,out]  rangeBox    Box to put the range into.
+         * @param   filename    The delta file (created if it does not exist).
+         *
+         * @return  true on success, false on failure.
+         *
+         * @sa  clearDirty, applyDelta, loadWithDeltas
          **/
-        inline void getPosRange(iBox<D> & rangeBox) const 
-            { 
-            rangeBox.min = _rangemin; 
-            rangeBox.max = _rangemax;
+        bool saveDelta(const std::string & filename)
+            {
+            try
+                {
+                    {
+                    OFileArchive ar(filename, true);
+                    ar << "\nDelta of Grid_basic<" << D << " , [" << std::string(typeid(T).name()) << "] , " << R << ">\n";
+                    ar & ((uint64)1); ar & ((uint64)D); ar & ((uint64)R); ar & ((uint64)sizeof(T)); ar.newline();
+                    if (_deltaFull)
+                        {
+                        ar & ((char)'F'); ar.newline();
+                        serialize(ar);
+                        }
+                    else
+                        {
+                        ar & ((char)'D'); ar & _rangemin; ar & _rangemax; ar.newline();
+                        _serializeDirty(ar, _getRoot());
+                        ar & ((char)'E');
+                        }
+                    }
+                clearDirty();
+                }
+            catch (...)
+                {
+                MTOOLS_DEBUG("Error saving delta of Grid_basic object");
+                return false;
+                } // error
+            return true; // ok
             }
 
 
         /**
-         * Check if we should call the destructors of T objects when they are not needed anymore.
+         * Replays all the records of a delta file created by saveDelta() on top of the current grid.
+         * The modified leafs remain marked as dirty.
          *
-         * @return  true if we call the dtors and false otherwise.
+         * @param   filename    The delta file.
+         *
+         * @return  true on success, false on failure [in this case, the grid may be partially updated].
+         *
+         * @sa  saveDelta, loadWithDeltas
          **/
-        bool callDtors() const { return _callDtors; }
-
-
-        /**
-        * Set whether we should, from now on, call the destructor of object when they are not needed
-        * anymore.
-        *
-        * @param   callDtor    true to call the destructors.
-        **/
-        void callDtors(bool callDtor) { _callDtors = callDtor; }
-
-
-        /**
-        * Return the memory currently allocated by the grid (in bytes).
-        **/
-        size_t memoryAllocated() const { return sizeof(*this) + _poolLeaf.footprint() + _poolNode.footprint(); }
-
-
-        /**
-        * Return the memory currently used by the grid (in bytes).
-        **/
-        size_t memoryUsed() const { return sizeof(*this) + _poolLeaf.used() + _poolNode.used(); } 
-
-
-        /**
-        * Returns a string with some information concerning the object.
-        *
-        * @param   debug   Set this flag to true to enable the debug mode where the whole tree structure
-        *                  of the lattice is written into the string [should not be used for large grids].
-        *
-        * @return  an info string.
-        **/
-        std::string toString(bool debug = false) const
+        bool applyDelta(const std::string & filename)
             {
-            std::string s;
-            s += std::string("Grid_basic<") + mtools::toString(D) + " , " + typeid(T).name() + " , " + mtools::toString(R) + ">\n";
-            s += std::string(" - Memory : ") + mtools::toStringMemSize(memoryUsed()) + " / " + mtools::toStringMemSize(memoryAllocated()) + "\n";
-            s += std::string(" - Range min = ") + _rangemin.toString(false) + "\n";
-            s += std::string(" - Range max = ") + _rangemax.toString(false) + "\n";
-            if (debug) { s += "\n" + _printTree(_getRoot(), ""); }
-            return s;
+            try
+                {
+                IFileArchive ar(filename);
+                while (!ar.atEnd())
+                    {
+                    uint64 ver;         ar & ver;      if (ver != 1) { MTOOLS_THROW("wrong version"); }
+                    uint64 d;           ar & d;        if (d != D) { MTOOLS_THROW("wrong dimension"); }
+                    uint64 r;           ar & r;        if (r != R) { MTOOLS_THROW("wrong R parameter"); }
+                    uint64 sizeofT;     ar & sizeofT;  if (sizeofT != sizeof(T)) { MTOOLS_THROW("wrong sizeof(T)"); }
+                    char c; ar & c;
+                    if (c == 'F') { deserialize(ar); continue; }
+                    if (c != 'D') { MTOOLS_THROW(std::string("Unknown tag [") + std::string(1, c) + "]"); }
+                    Pos rmin, rmax;
+                    ar & rmin; ar & rmax;
+                    while (1)
+                        {
+                        ar & c;
+                        if (c == 'E') break;
+                        if (c != 'L') { MTOOLS_THROW(std::string("Unknown tag [") + std::string(1, c) + "]"); }
+                        Pos center; ar & center;
+                        _getw(center);
+                        _pleaf L = _currentDenseLeaf(); // all the sites are overwritten
+
+                        MTOOLS_ASSERT(L->center == center);
+                        for (size_t i = 0; i < metaprog::power<(2 * R + 1), D>::value; ++i) { ar & (L->getRowMajor(i)); }
+                        }
+                    for (size_t i = 0; i < D; i++)
+                        {
+                        if (rmin[i] < _rangemin[i]) { _rangemin[i] = rmin[i]; }
+                        if (rmax[i] > _rangemax[i]) { _rangemax[i] = rmax[i]; }
+                        }
+                    }
+                }
+            catch (...)
+                {
+                MTOOLS_DEBUG("Error applying delta to Grid_basic object");
+                return false;
+                } // error
+            return true; // ok
             }
 
 
         /**
-         * Sets the value at a given site. This method require T to be assignable via T.operator=. If the
-         * value at the site does not exist prior to the call of the method, it is first created then the
-         * assignement is performed.
+         * Loads a base file and replays a delta file on top of it. This recovers the state of the
+         * grid saved by the last call to saveDelta(). The grid is then marked as clean so that
+         * saveDelta() can be used again to continue the same delta file.
          *
-         * @param   pos The position of the site to access.
-         * @param   val The value to set.
+         * @param   baseFile    The base file (created with save()).
+         * @param   deltaFile   The delta file (created with saveDelta()).
+         *
+         * @return  true on success, false on failure.
+         *
+         * @sa  saveDelta, applyDelta
          **/
-        inline void set(const Pos & pos, const T & val) { _get(pos) = val; }
-
-
-        /**
-        * Set a value at a given position. Dimension 1 specialization.
-        **/
-        inline void set(int64 x, const T & val) { static_assert(D == 1, "template parameter D must be 1"); _get(Pos(x)) = val; return; }
+        bool loadWithDeltas(const std::string & baseFile, const std::string & deltaFile)
+            {
+            if (!load(baseFile)) { return false; }
+            if (!applyDelta(deltaFile)) { return false; }
+            clearDirty();
+            return true;
+            }
 
 
         /**
-        * Set a value at a given position. Dimension 2 specialization.
-        **/
-        inline void set(int64 x, int64 y, const T & val) { static_assert(D == 2, "template parameter D must be 2"); _get(Pos(x,y)) = val; return; }
+         * Mark every leaf as unmodified. The next call to saveDelta() will only write the leafs
+         * modified after this call.
+         **/
+        void clearDirty()
+            {
+            _clearDirty(_getRoot());
+            _deltaFull = false;
+            }
 
 
         /**
-        * Set a value at a given position. Dimension 3 specialization.
-        **/
-        inline void set(int64 x, int64 y, int64 z, const T & val) { static_assert(D == 3, "template parameter D must be 3"); _get(Pos(x,y,z)) = val; return; }
+         * Return the number of leafs (elementary sub-boxes) modified since the last checkpoint.
+         **/
+        size_t nbDirtyLeafs() const { return _countDirty(_getRoot()); }
 
 
         /**
-         * Get a value at a given position. If the T object at that site does not exist, it is created.
+         * Enable or disable the journal of the modifications of the grid.
          *
-         * @param   pos The position.
+         * When enabled, the write accessors (set(), get(), operator(), operator[],
+         * getMany(), neighbourhood(), importBox(), applyDelta()...) record the leafs they modify so that a consumer running in
+         * another thread (typically a drawer, cf. LatticeDrawer::redrawSites()) can update only what
+         * changed since its last call to takeChanges(). Consecutive writes in the same leaf only cost
+         * a comparison. Modifications made through the pointers returned by leafs() are not recorded.
+         * Resetting, loading or assigning the grid counts as a modification of every site.
          *
-         * @return  A reference to the value.
+         * @param   enable      true to enable the journal, false to disable it.
+         * @param   capacity    maximum number of leafs recorded between two calls to takeChanges().
+         *                      Beyond that, the journal only remembers that everything changed.
          **/
-        inline T & get(const Pos & pos) { return _get(pos); }
+        void journal(bool enable, size_t capacity = 65536) { _changes.enable(enable, capacity); }
+
+
+        /** Return true if the journal of the modifications is enabled. */
+        bool journal() const { return _changes.enabled(); }
 
 
         /**
-         * Get a value at a given position. If the T object at that site does not exist, it is created.
-         * (const version)
+         * Retrieve the modifications recorded by the journal since the last call (see journal()).
          *
-         * @param   pos The position.
+         * @param [out] boxes   The boxes of the leafs modified (each one is reported once).
          *
-         * @return  A const reference to the value.
+         * @return  false if everything must be considered modified: the journal is disabled, it
+         *          overflowed, the grid was reset... or this is the first call since it was enabled.
          **/
-        inline const T & get(const Pos & pos) const { return _get(pos); }
-
-
-        /**
-        * Get a value at a given position. If the T object at that site does not exist, it is created. Dimension 1 specialization.
-        **/
-        inline T & get(int64 x) { static_assert(D == 1, "template parameter D must be 1"); return _get(Pos(x)); }
-
-        /**
-        * Get a value at a given position. If the T object at that site does not exist, it is created. Dimension 1 specialization. (const version)
-        **/
-        inline const T & get(int64 x) const { static_assert(D == 1, "template parameter D must be 1"); return _get(Pos(x)); }
+        bool takeChanges(std::vector<iBox<D> > & boxes) { return _changes.take(boxes); }
 
 
         /**
-        * Get a value at a given position. If the T object at that site does not exist, it is created. Dimension 2 specialization.
-        **/
-        inline T & get(int64 x, int64 y) { static_assert(D == 2, "template parameter D must be 2"); return _get(Pos(x, y)); }
+         * A leaf of the grid: an elementary sub-box [center-R, center+R]^D together with the
+         * (2R+1)^D objects it contains, stored contiguously in memory following LAYOUT (i.e. in
+         * row-major order, first coordinate varying fastest, with the default GridLayout_rowMajor).
+         **/
+        struct LeafSpan
+            {
+            static const size_t SIZE = metaprog::power<(2 * R + 1), D>::value; ///< number of objects in a leaf
 
+            iBox<D> box;    ///< the sites of the leaf
+            T *     data;   ///< the SIZE objects of the leaf
 
-        /**
-        * Get a value at a given position. If the T object at that site does not exist, it is created. Dimension 2 specialization. (const version)
-        **/
-        inline const T & get(int64 x, int64 y) const { static_assert(D == 2, "template parameter D must be 2"); return _get(Pos(x, y)); }
+            /** Reference to the object at a position inside box. */
+            inline T & operator()(const Pos & pos) const
+                {
+                Pos c; for (size_t i = 0; i < D; i++) { c[i] = box.min[i] + (int64)R; }
+                return data[LAYOUT::template offset<D, R>(pos, c)];
+                }
+            };
 
 
         /**
-        * Get a value at a given position. If the T object at that site does not exist, it is created. Dimension 3 specialization.
-        **/
-        inline T & get(int64 x, int64 y, int64 z) { static_assert(D == 3, "template parameter D must be 3"); return _get(Pos(x, y, z)); }
+         * Return the list of all the leafs of the grid. The objects of a leaf are all created together
+         * so a leaf may contain sites which were never accessed (they hold default constructed
+         * objects). This is the fastest way to visit all the objects of the grid: the pointers remain
+         * valid until the grid is reset, loaded or assigned (or until the next snapshot(), after which
+         * they must not be used for writing).
+         **/
+        std::vector<LeafSpan> leafs()
+            {
+            std::vector<LeafSpan> vec;
+            if (_snapAlive()) { _cowAll(_getRoot()); } // the leafs may be written through the spans
+            _collectLeafs(_getRoot(), vec);
+            return vec;
+            }
 
 
         /**
-        * Get a value at a given position. If the T object at that site does not exist, it is created. Dimension 3 specialization. (const version)
-        **/
-        inline const T & get(int64 x, int64 y, int64 z) const { static_assert(D == 3, "template parameter D must be 3"); return _get(Pos(x, y, z)); }
+         * Call fun(const LeafSpan & leaf) for each leaf of the grid. See leafs().
+         **/
+        template<typename FUN> void for_each_leaf(FUN fun)
+            {
+            const std::vector<LeafSpan> vec = leafs();
+            for (const LeafSpan & L : vec) { fun(L); }
+            }
 
 
         /**
-         * Get a value at a given position. If the T object at that site does not exist, it is created.
-         *
-         * @param   pos The position.
+         * Call fun(const LeafSpan & leaf, size_t thread) for each leaf of the grid, the leafs being
+         * distributed among several threads. The index of the calling thread (in [0, nbThreads-1]) is
+         * passed to fun so reductions (mass, perimeter, moments...) can be accumulated in per-thread
+         * variables without locking. The grid must not be modified during the call (but the objects
+         * of the leafs may be).
          *
-         * @return  A reference to the value.
+         * @param   fun         The function called for each leaf.
+         * @param   nbThreads   Number of threads (0 = number of hardware threads).
          **/
-        inline T & operator[](const Pos & pos) { return _get(pos); }
+        template<typename FUN> void parallel_for_each_leaf(FUN fun, size_t nbThreads = 0)
+            {
+            if (nbThreads == 0) { nbThreads = (size_t)nbHardwareThreads(); }
+            const std::vector<LeafSpan> vec = leafs();
+            std::atomic<size_t> next(0);
+            auto work = [&](size_t t) { size_t k; while ((k = next++) < vec.size()) { fun(vec[k], t); } };
+            std::vector<std::thread> threads;
+            for (size_t t = 1; t < nbThreads; t++) { threads.push_back(std::thread(work, t)); }
+            work(0);
+            for (auto & th : threads) { th.join(); }
+            }
 
 
         /**
-         * Get a value at a given position. If the T object at that site does not exist, it is created.
-         * (const version)
+         * Export the content of a box of the grid chunk by chunk, without densifying the grid.
          *
-         * @param   pos The position.
+         * The box B is cut in disjoint chunks whose union is B and sink(const iBox<D> & chunk, const T * data)
+         * is called for each of them (in no particular order):
          *
-         * @return  A const reference to the value.
+         * - for the part of B covered by a leaf, the chunk is the leaf box clipped to B (so the chunks
+         *   are aligned on the (2R+1)^D leaf grid) and data points to its objects in row-major order
+         *   (first coordinate varying fastest). Sites of a sparse leaf which were never created are
+         *   given as default constructed objects.
+         * - for a part of B which contains no leaf, the chunk may be larger than a leaf and data is
+         *   nullptr: it should be written as a fill value. No memory is touched for these regions.
+         *
+         * data is only valid during the call. This is meant to write chunked formats such as HDF5 with
+         * chunks of size (2R+1)^D: the sink simply writes each chunk as a hyperslab (and skips the
+         * empty ones when the dataset has a fill value).
+         *
+         * @param   B       The box to export.
+         * @param   sink    The function called for each chunk.
          **/
-        inline const T & operator[](const Pos & pos) const { return _get(pos); }
+        template<typename SINK, typename = typename std::enable_if<!std::is_pointer<SINK>::value>::type> void exportBox(const iBox<D> & B, SINK sink) const
+            {
+            if (B.isEmpty()) return;
+            _pbox root = _getRoot();
+            if (root == nullptr) { sink(B, (const T *)nullptr); return; }
+            const int64 hw = (int64)(root->isLeaf() ? R : (3 * root->rad + 1));
+            iBox<D> rem = B; // parts of B outside of the tree are empty
+            for (size_t i = 0; i < D; i++)
+                {
+                if (rem.min[i] < root->center[i] - hw)
+                    {
+                    iBox<D> C = rem; C.max[i] = std::min<int64>(rem.max[i], root->center[i] - hw - 1);
+                    sink((const iBox<D> &)C, (const T *)nullptr);
+                    rem.min[i] = C.max[i] + 1;
+                    }
+                if (rem.max[i] > root->center[i] + hw)
+                    {
+                    iBox<D> C = rem; C.min[i] = std::max<int64>(rem.min[i], root->center[i] + hw + 1);
+                    sink((const iBox<D> &)C, (const T *)nullptr);
+                    rem.max[i] = C.min[i] - 1;
+                    }
+                if (rem.isEmpty()) return;
+                }
+            std::vector<T> buf;
+            _exportBox(root, root->center, hw, rem, sink, buf);
+            }
 
 
         /**
-        * Get a value at a given position. If the T object at that site does not exist, it is created.
-        * Same as the get() method.
-        *
-        * @param   pos The position.
-        *
-        * @return  A reference to the value.
-        **/
-        inline T & operator()(const Pos & pos) { return _get(pos); }
+         * Export the content of a box of the grid into a dense array.
+         *
+         * @param           B       The box to export.
+         * @param [out]     out     Array with one entry per site of B, receiving its objects
+         *                          in row-major order (first coordinate varying fastest).
+         * @param           fill    Value written for the sites of B which belong to no leaf.
+         **/
+        void exportBox(const iBox<D> & B, T * out, const T & fill = T()) const
+            {
+            exportBox(B, [&](const iBox<D> & C, const T * data)
+                {
+                size_t k = 0;
+                _forEachRow(C, [&](const Pos & start, size_t len)
+                    {
+                    T * dst = out + _denseIndex(B, start);
+                    if (data == nullptr) { std::fill(dst, dst + len, fill); } else { std::copy(data + k, data + k + len, dst); k += len; }
+                    });
+                });
+            }
 
 
         /**
-         * Get a value at a given position. If the T object at that site does not exist, it is created
-         * Same as the get() method. (const version).
+         * Import the content of a box of the grid chunk by chunk. This is the converse of exportBox().
          *
-         * @param   pos The position.
+         * The box B is cut along the leaf grid and, for each chunk (a leaf box clipped to B),
+         * source(const iBox<D> & chunk, T * data) is called to fill data with the objects of the chunk in
+         * row-major order (first coordinate varying fastest). If source returns true, the objects are
+         * moved into the leaf (which is created if needed). If it returns false, the chunk is considered
+         * empty and the grid is left untouched there (no leaf is created).
          *
-         * @return  A reference to the value.
+         * The leafs written are dense (a sparse leaf intersecting B is converted) and marked as dirty.
+         *
+         * @param   B       The box to import.
+         * @param   source  The function called for each chunk.
          **/
-        inline const T & operator()(const Pos & pos) const { return _get(pos); }
-
+        template<typename SOURCE, typename = typename std::enable_if<!std::is_pointer<SOURCE>::value>::type> void importBox(const iBox<D> & B, SOURCE source)
+            {
+            if (B.isEmpty()) return;
+            const int64 L = (int64)(2 * R + 1);
+            auto leafIndex = [&](int64 x) -> int64 { x += (int64)R; return ((x >= 0) ? (x / L) : (-((-x - 1) / L) - 1)); };
+            iBox<D> K; // range of the leaf indices
+            for (size_t i = 0; i < D; i++) { K.min[i] = leafIndex(B.min[i]); K.max[i] = leafIndex(B.max[i]); }
+            std::vector<T> buf;
+            Pos k = K.min;
+            while (1)
+                {
+                Pos center; iBox<D> C;
+                for (size_t i = 0; i < D; i++)
+                    {
+                    center[i] = k[i] * L;
+                    C.min[i] = std::max<int64>(center[i] - (int64)R, B.min[i]);
+                    C.max[i] = std::min<int64>(center[i] + (int64)R, B.max[i]);
+                    }
+                buf.resize(_boxSize(C));
+                if (source((const iBox<D> &)C, buf.data()))
+                    {
+                    _pleaf F = _writableLeaf(center);
+                    size_t j = 0;
+                    _forEachRow(C, [&](Pos pos, size_t len) { for (size_t n = 0; n < len; n++) { F->get(pos) = std::move(buf[j++]); pos[0]++; } });
+                    }
+                size_t i = 0;
+                while ((i < D) && (k[i] == K.max[i])) { k[i] = K.min[i]; i++; }
+                if (i == D) return;
+                k[i]++;
+                }
+            }
 
-        /**
-        * get a value at a given position. Dimension 1 specialization.
-        * This creates the object if it does not exist yet.
-        **/
-        inline T & operator()(int64 x) { static_assert(D == 1, "template parameter D must be 1"); return _get(Pos(x)); }
 
         /**
-         * get a value at a given position. Dimension 1 specialization. (const version)
-         * This creates the object if it does not exist yet.
+         * Import the content of a box of the grid from a dense array.
+         *
+         * @param   B   The box to import.
+         * @param   in  Array with one entry per site of B, containing its objects in
+         *              row-major order (first coordinate varying fastest).
          **/
-        inline const T & operator()(int64 x) const { static_assert(D == 1, "template parameter D must be 1"); return _get(Pos(x)); }
+        void importBox(const iBox<D> & B, const T * in)
+            {
+            importBox(B, [&](const iBox<D> & C, T * data)
+                {
+                _forEachRow(C, [&](const Pos & start, size_t len) { const T * src = in + _denseIndex(B, start); data = std::copy(src, src + len, data); });
+                return true;
+                });
+            }
 
 
         /**
-        * get a value at a given position. Dimension 2 specialization.
-        * This creates the object if it does not exist yet.
-        **/
-        inline T & operator()(int64 x, int64 y) { static_assert(D == 2, "template parameter D must be 2"); return _get(Pos(x, y)); }
+         * A frozen, read-only view of a grid obtained from Grid_basic::snapshot().
+         *
+         * The view is not affected by the subsequent modifications of the grid so it can be read by
+         * another thread while the grid keeps being modified. Copying a Snapshot is cheap and gives
+         * another handle on the same view. A handle caches the last leaf accessed so it must only be
+         * used by one thread at a time: give a copy to each reader thread.
+         **/
+        class Snapshot
+            {
 
+            public:
 
-        /**
-         * get a value at a given position. Dimension 2 specialization. (const version)
-         * This creates the object if it does not exist yet.
-         **/
-        inline const T & operator()(int64 x, int64 y) const { static_assert(D == 2, "template parameter D must be 2"); return _get(Pos(x, y)); }
+            /** Empty snapshot (not valid). */
+            Snapshot() : _d(nullptr), _hres(nullptr) {}
 
+            /** Copy constructor: another handle on the same view. */
+            Snapshot(const Snapshot & S) : _d(S._d), _hres(nullptr) {}
 
-        /**
-        * get a value at a given position. Dimension 3 specialization.
-        * This creates the object if it does not exist yet.
-        **/
-        inline T & operator()(int64 x, int64 y, int64 z) { static_assert(D == 3, "template parameter D must be 3"); return _get(Pos(x, y, z)); }
+            /** Assignment operator: another handle on the same view. */
+            Snapshot & operator=(const Snapshot & S) { _d = S._d; _hres = nullptr; return(*this); }
 
+            /**
+             * Query whether the snapshot can be read. Return false if the snapshot is empty or if the
+             * grid was reset, loaded, assigned or destroyed since the snapshot was taken.
+             **/
+            bool valid() const { return ((_d != nullptr) && (_d->link->treegen.load() == _d->treegen)); }
 
-        /**
-         * get a value at a given position. Dimension 3 specialization. (const version)
-         * This creates the object if it does not exist yet.
-         **/
-        inline const T & operator()(int64 x, int64 y, int64 z) const { static_assert(D == 3, "template parameter D must be 3"); return _get(Pos(x, y, z)); }
+            /** Release the handle. The memory kept for the view is freed by the grid once all the handles are released. */
+            void reset() { _d.reset(); _hres = nullptr; }
 
+            /**
+             * Return the range of the elements accessed at the time of the snapshot.
+             *
+             * @param [in,out]  rangeBox    Box to put the range into.
+             **/
+            void getPosRange(iBox<D> & rangeBox) const { MTOOLS_ASSERT(valid()); rangeBox.min = _d->rangemin; rangeBox.max = _d->rangemax; }
 
-        /**
-        * Return a pointer to the object at a given position. If the value at the site was not yet
-        * created, returns nullptr. This method does not create sites and is suited when drawing the
-        * lattice using, for instance, the LatticeDrawer class.
-        *
-        * This method is threadsafe : it is safe to call peek() while accessing the object via a get()
+            /**
+             * Return a pointer to the object at position pos at the time of the snapshot, or nullptr if it
+             * did not exist then. Suited for drawing the lattice with the LatticeDrawer class.
+             *
+             * @param   pos The position to peek.
+             **/
+            const T * peek(const Pos & pos) const
+                {
+                MTOOLS_ASSERT(valid());
+                _pleaf L = _hres;
+                if ((L != nullptr) && (L->isInBox(pos))) return(&(L->get(pos)));
+                _pnode q = _d->root;
+                if (!q->isInBox(pos)) return nullptr;
+                while (1)
+                    {
+                    _pbox & b = q->getSubBox(pos);
+                    const _pbox c = b;
+                    if (c == nullptr) return nullptr;
+                    if (q->rad == R)
+                        {
+                        L = _d->resolve(&b, (_pleaf)c);
+                        if (L == nullptr) return nullptr;
+                        _hres = L;
+                        return(&(L->get(pos)));
+                        }
+                    q = (_pnode)c;
+                    }
+                }
+
+            /**
+             * Call fun(const LeafSpan & leaf) for each leaf of the grid at the time of the snapshot (see
+             * Grid_basic::leafs()). The objects must not be modified.
+             **/
+            template<typename FUN> void for_each_leaf(FUN fun) const
+                {
+                MTOOLS_ASSERT(valid());
+                _forEachLeaf(_d->root, fun);
+                }
+
+            /**
+             * Serializes the grid, as it was at the time of the snapshot, into an OBaseArchive. The
+             * format is the same as Grid_basic::serialize() so the archive can be loaded into any grid
+             * with the same template parameters.
+             **/
+            void serialize(OBaseArchive & ar) const
+                {
+                MTOOLS_INSURE(valid());
+                _serializeWith(ar, _d->callDtors, _d->rangemin, _d->rangemax, [&](OBaseArchive & a) { _serializeTree(a, _d->root); });
+                }
+
+            /**
+             * Saves the grid, as it was at the time of the snapshot, into a file. The file can be opened
+             * with Grid_basic::load().
+             *
+             * @param   filename    The filename to save.
+             *
+             * @return  true on success, false on failure.
+             **/
+            bool save(const std::string & filename) const
+                {
+                try
+                    {
+                    OFileArchive ar(filename);
+                    serialize(ar);
+                    }
+                catch (...)
+                    {
+                    MTOOLS_DEBUG("Error saving Grid_basic snapshot");
+                    return false;
+                    }
+                return true;
+                }
+
+            private:
+
+            friend class Grid_basic;
+
+            Snapshot(const std::shared_ptr<_SnapData> & d) : _d(d), _hres(nullptr) {}
+
+            template<typename FUN> void _forEachLeaf(_pnode q, FUN & fun) const
+                {
+                for (size_t i = 0; i < metaprog::power<3, D>::value; ++i)
+                    {
+                    _pbox & b = q->tab[i];
+                    const _pbox c = b;
+                    if (c == nullptr) continue;
+                    if (q->rad != R) { _forEachLeaf((_pnode)c, fun); continue; }
+                    const _pleaf L = _d->resolve(&b, (_pleaf)c);
+                    if (L == nullptr) continue;
+                    LeafSpan S;
+                    for (size_t j = 0; j < D; j++) { S.box.min[j] = L->center[j] - (int64)R; S.box.max[j] = L->center[j] + (int64)R; }
+                    S.data = L->data;
+                    fun((const LeafSpan &)S);
+                    }
+                }
+
+            void _serializeTree(OBaseArchive & ar, _pnode q) const
+                {
+                ar & ((char)'N');
+                ar & q->center;
+                ar & q->rad;
+                for (size_t i = 0; i < metaprog::power<3, D>::value; ++i)
+                    {
+                    _pbox & b = q->tab[i];
+                    const _pbox c = b;
+                    if (c == nullptr) { ar & ((char)'V'); continue; }
+                    if (q->rad != R) { _serializeTree(ar, (_pnode)c); continue; }
+                    const _pleaf L = _d->resolve(&b, (_pleaf)c);
+                    if (L == nullptr) { ar & ((char)'V'); continue; }
+                    ar & ((char)'L');
+                    ar & L->center;
+                    ar & L->rad;
+                    for (size_t k = 0; k < metaprog::power<(2 * R + 1), D>::value; ++k) { ar & (L->getRowMajor(k)); } // always saved in row-major order
+                    }
+                }
+
+            std::shared_ptr<_SnapData> _d;  // the view
+            mutable _pleaf _hres;           // last leaf resolved
+            };
+
+
+        /**
+         * Take a snapshot of the grid: a frozen, read-only view of its current state which other
+         * threads can read (draw, save, compute statistics...) while the grid keeps being modified.
+         * The call is O(1): nothing is copied.
+         *
+         * After the call, the leafs of the grid are copy-on-write: the first time a leaf is written
+         * (via get(), set(), operator[], getMany(), neighbourhood(), applyDelta() or leafs()), it is
+         * copied and the copy replaces it in the tree while the snapshot keeps the old version. The
+         * old versions are freed once all the snapshots which see them are released. Leafs created
+         * after the snapshot are not seen by it. The cost is thus one copy of each leaf modified while
+         * a snapshot is alive and nothing at all once the snapshots are released.
+         *
+         * Restrictions:
+         * - T must be copy constructible and the grid must not contain sparse leafs (see sparseLeafs()).
+         * - Pointers and references to objects of the grid (including the LeafSpans returned by leafs())
+         *   obtained before the snapshot must not be used for writing afterwards: they point to the
+         *   version seen by the snapshot. Other threads should read the snapshot instead of calling
+         *   peek() on the grid with a hint or a cursor (the leafs they point to may be freed).
+         * - Resetting, loading, assigning or destroying the grid invalidates its snapshots (see
+         *   Snapshot::valid()) so it must not happen while a snapshot is being read.
+         * - While a snapshot is alive, leafs() copies every leaf not modified since the last snapshot
+         *   so the snapshots should be released as soon as they are not needed anymore.
+         *
+         * @code{.cpp}
+         * Grid_basic<2, int> G;
+         * ...
+         * auto S = G.snapshot();                                   // in the simulation thread
+         * std::thread th([S]() { S.save("frame.grid.gz"); });     // save it in the background
+         * ...                                                      // while G keeps being modified
+         * @endcode
+         *
+         * @return  The snapshot.
+         **/
+        Snapshot snapshot()
+            {
+            static_assert(std::is_copy_constructible<T>::value, "The object T must be copy constructible T(const T&) in order to take snapshots of the grid.");
+            MTOOLS_INSURE((!_sparse) && (_poolSparse0.size() == 0) && (_poolSparse1.size() == 0) && (_poolSparse2.size() == 0)); // dense leafs only
+            if (_snaplink == nullptr) { _snaplink = std::make_shared<_SnapLink>(); }
+            _freeGarbage();
+            std::shared_ptr<_SnapData> S = std::make_shared<_SnapData>();
+            S->link = _snaplink;
+            S->treegen = _snaplink->treegen.load();
+            S->gen = _cowgen;
+            S->root = (_pnode)_getRoot();
+            S->rangemin = _rangemin;
+            S->rangemax = _rangemax;
+            S->callDtors = _callDtors;
+            if (_snapAlive())
+                { // the previous snapshots need the versions replaced from now on
+                std::lock_guard<std::mutex> lock(_snap->mut);
+                _snap->next = S;
+                }
+            _snap = S;
+            _cowgen++;
+            return Snapshot(S);
+            }
+
+
+        /**
+         * Return the range of elements accessed. The method returns an empty box if no element 
+         * was ever accessed.
+         *
+         * @param [in,out]  rangeBox    Box to put the range into.
+         **/
+        inline void getPosRange(iBox<D> & rangeBox) const 
+            { 
+            rangeBox.min = _rangemin; 
+            rangeBox.max = _rangemax;
+            }
+
+
+        /**
+         * Check if we should call the destructors of T objects when they are not needed anymore.
+         *
+         * @return  true if we call the dtors and false otherwise.
+         **/
+        bool callDtors() const { return _callDtors; }
+
+
+        /**
+        * Set whether we should, from now on, call the destructor of object when they are not needed
+        * anymore.
+        *
+        * @param   callDtor    true to call the destructors.
+        **/
+        void callDtors(bool callDtor) { _callDtors = callDtor; }
+
+
+        /**
+         * Enable or disable sparse leafs for the elementary boxes created from now on (disabled by
+         * default). Existing leafs are not modified.
+         * 
+         * When enabled, a new elementary box does not create its (2R+1)^D objects at once. It starts as
+         * a small sparse block in which only the objects of the sites actually accessed are created.
+         * The block grows (by a factor 8, up to 3 times) when it is full and, once sparseLeafCapacity()
+         * sites have been accessed, it is replaced by a regular dense leaf. This divides the memory used
+         * by a large factor when the sites visited are scattered (for instance, the trace of a random
+         * walk far from its origin). Sparse leafs are transparent to
+         * get(), set(), peek() and to the other methods (serialization still writes every site of a
+         * leaf so files are unchanged) except that:
+         * 
+         * - When a sparse leaf grows or becomes dense, its objects are moved with the move (or copy)
+         *   constructor of T. Pointers and references to them are then invalidated. This happens during
+         *   a call which creates a new site (get(), set(), operator[]...).
+         * - The sites of a sparse leaf which were never accessed do not exist: peek() returns nullptr.
+         * - leafs() and applyDelta() turn the sparse leafs they visit into dense ones.
+         * 
+         * The method does nothing when the leafs are small ((2R+1)^D < 512, see sparseLeafCapacity()).
+         *
+         * @param   enable  true to create sparse leafs, false to create dense leafs.
+         **/
+        void sparseLeafs(bool enable)
+            {
+            static_assert(std::is_move_constructible<T>::value, "The object T must be move or copy constructible in order to use sparse leafs.");
+            MTOOLS_INSURE((!enable) || (!_snapAlive())); // snapshots require dense leafs
+            _sparse = (enable && (_sparseLeaf::NB_TIERS > 0));
+            }
+
+
+        /**
+         * Query whether new elementary boxes are created as sparse leafs. See sparseLeafs(bool).
+         **/
+        bool sparseLeafs() const { return _sparse; }
+
+
+        /**
+         * Maximum number of sites of a sparse leaf before it is replaced by a dense leaf (0 if sparse
+         * leafs are not available for these template parameters).
+         **/
+        static size_t sparseLeafCapacity() { return ((_sparseLeaf::NB_TIERS == 0) ? 0 : (((size_t)64) << (3 * (_sparseLeaf::NB_TIERS - 1)))); }
+
+
+        /**
+         * Use a memory mapped file as backing store for the leaves of the grid (which contain all the
+         * T objects). The operating system may then page cold leaves out to the file and reload them
+         * transparently when they are accessed again by get(), set() or peek(). This permits to
+         * simulate on grids much larger than the physical memory.
+         * 
+         * The grid is reset (the dtors of T objects are called depending on the callDtors flag).
+         *
+         * @param   filename    Name of the backing file. It is deleted when the grid is destroyed or
+         *                      when the method is called again. Set an empty string to go back to
+         *                      regular memory allocation.
+         * @param   maxResident Maximum number of bytes of leaves kept in physical memory (0 = no limit,
+         *                      the OS alone decides which pages to evict). When the limit is reached,
+         *                      the oldest leaves are written back to the file and dropped from memory.
+         **/
+        void setLeafBackingFile(const std::string & filename, size_t maxResident = 0)
+            {
+            _destroyTree();
+            _poolLeaf.setBackingFile(filename, maxResident);
+            _createBaseNode();
+            }
+
+
+        /**
+         * Back the memory pools of the grid with huge pages (see CstSizeMemoryPool::setHugePages()).
+         * This reduces the TLB misses when accessing leaves scattered over a very large grid. The
+         * address space is reserved up front and the memory is committed as the grid grows.
+         * 
+         * The grid is reset (the dtors of T objects are called depending on the callDtors flag) and
+         * the memory of the pools is returned to the operating system.
+         *
+         * @param   pageSize    Size of the huge pages (e.g. MEM_MB(2) or MEM_GB(1)). Set 0 to go back
+         *                      to regular memory allocation.
+         * @param   reserve     Size of the address space reserved at once by each pool.
+         **/
+        void setHugePageAllocation(size_t pageSize = MEM_MB(2), size_t reserve = MEM_GB(((size_t)64)))
+            {
+            _destroyTree();
+            _poolLeaf.setHugePages(pageSize, reserve);
+            _poolNode.setHugePages(pageSize, reserve);
+            _poolSparse0.setHugePages(pageSize, reserve);
+            _poolSparse1.setHugePages(pageSize, reserve);
+            _poolSparse2.setHugePages(pageSize, reserve);
+            _createBaseNode();
+            }
+
+
+        /**
+         * Enable or disable the thread caching mode of the memory pools of the grid (see
+         * CstSizeMemoryPool::setThreadCaching()). In this mode, nodes and leaves may be allocated and
+         * released simultaneously by several threads without a global lock, which is useful for code
+         * that coordinates the modifications of the tree itself. The grid is not modified.
+         *
+         * @param   batchSize   Number of chunks exchanged at once between a thread and the shared
+         *                      depot (0 to disable the mode).
+         **/
+        void setThreadCachingAllocation(size_t batchSize = 64)
+            {
+            _poolLeaf.setThreadCaching(batchSize);
+            _poolNode.setThreadCaching(batchSize);
+            _poolSparse0.setThreadCaching(batchSize);
+            _poolSparse1.setThreadCaching(batchSize);
+            _poolSparse2.setThreadCaching(batchSize);
+            }
+
+
+        /**
+        * Return the memory currently allocated by the grid (in bytes).
+        **/
+        size_t memoryAllocated() const { return sizeof(*this) + _poolLeaf.footprint() + _poolNode.footprint() + _poolSparse0.footprint() + _poolSparse1.footprint() + _poolSparse2.footprint(); }
+
+
+        /**
+        * Return the memory currently used by the grid (in bytes).
+        **/
+        size_t memoryUsed() const { return sizeof(*this) + _poolLeaf.used() + _poolNode.used() + _poolSparse0.used() + _poolSparse1.used() + _poolSparse2.used(); } 
+
+
+        /**
+         * Return telemetry about the tree of the grid (see GridStats). Without the tree walk, the
+         * method is cheap and may be polled from another thread (e.g. a watch window) while the grid
+         * is being modified. The tree walk must not run concurrently with writers.
+         *
+         * @param   walkTree    true to also compute the depth histogram of the leaves.
+         **/
+        GridStats stats(bool walkTree = false) const
+            {
+            GridStats st;
+            st.nbNodes = _poolNode.size();
+            st.nbLeaves = _poolLeaf.size();
+            st.nbSparseLeaves = _poolSparse0.size() + _poolSparse1.size() + _poolSparse2.size();
+            st.bytesNodes = _poolNode.used();
+            st.bytesLeaves = _poolLeaf.used();
+            st.bytesSparseLeaves = _poolSparse0.used() + _poolSparse1.used() + _poolSparse2.used();
+            st.memoryUsed = memoryUsed();
+            st.memoryAllocated = memoryAllocated();
+#if (MTOOLS_USE_PROFILING)
+            st.getCalls = _statGets.load(std::memory_order_relaxed);
+            st.getHits = _statHits.load(std::memory_order_relaxed);
+#endif
+            if (walkTree) { _statsWalk(_getRoot(), 0, st); }
+            return st;
+            }
+
+
+        /**
+         * Reset the get() cache hit counters reported by stats().
+         **/
+        void resetStats()
+            {
+#if (MTOOLS_USE_PROFILING)
+            _statGets = 0;
+            _statHits = 0;
+#endif
+            }
+
+
+        /**
+        * Returns a string with some information concerning the object.
+        *
+        * @param   debug   Set this flag to true to enable the debug mode where the whole tree structure
+        *                  of the lattice is written into the string [should not be used for large grids].
+        *
+        * @return  an info string.
+        **/
+        std::string toString(bool debug = false) const
+            {
+            std::string s;
+            s += std::string("Grid_basic<") + mtools::toString(D) + " , " + typeid(T).name() + " , " + mtools::toString(R) + ">\n";
+            s += std::string(" - Memory : ") + mtools::toStringMemSize(memoryUsed()) + " / " + mtools::toStringMemSize(memoryAllocated()) + "\n";
+            s += std::string(" - Range min = ") + _rangemin.toString(false) + "\n";
+            s += std::string(" - Range max = ") + _rangemax.toString(false) + "\n";
+            if (debug) { s += "\n" + _printTree(_getRoot(), ""); }
+            return s;
+            }
+
+
+        /**
+         * Sets the value at a given site. This method require T to be assignable via T.operator=. If the
+         * value at the site does not exist prior to the call of the method, it is first created then the
+         * assignement is performed.
+         *
+         * @param   pos The position of the site to access.
+         * @param   val The value to set.
+         **/
+        inline void set(const Pos & pos, const T & val) { _getw(pos) = val; }
+
+
+        /**
+         * Sets the value at a given site, starting the search from the cursor C (which is updated).
+         * Same as set(pos, val) otherwise. Creating sites is not thread-safe: there must be a single
+         * writer.
+         *
+         * @param   pos         The position of the site to access.
+         * @param   val         The value to set.
+         * @param [in,out]  C   The cursor of the calling thread.
+         **/
+        inline void set(const Pos & pos, const T & val, Cursor & C) { _getw(pos, C) = val; }
+
+
+        /**
+        * Set a value at a given position. Dimension 1 specialization.
+        **/
+        inline void set(int64 x, const T & val) { static_assert(D == 1, "template parameter D must be 1"); _getw(Pos(x)) = val; return; }
+
+
+        /**
+        * Set a value at a given position. Dimension 2 specialization.
+        **/
+        inline void set(int64 x, int64 y, const T & val) { static_assert(D == 2, "template parameter D must be 2"); _getw(Pos(x,y)) = val; return; }
+
+
+        /**
+        * Set a value at a given position. Dimension 3 specialization.
+        **/
+        inline void set(int64 x, int64 y, int64 z, const T & val) { static_assert(D == 3, "template parameter D must be 3"); _getw(Pos(x,y,z)) = val; return; }
+
+
+        /**
+         * Get a value at a given position. If the T object at that site does not exist, it is created.
+         *
+         * @param   pos The position.
+         *
+         * @return  A reference to the value.
+         **/
+        inline T & get(const Pos & pos) { return _getw(pos); }
+
+
+        /**
+         * Get a value at a given position. If the T object at that site does not exist, it is created.
+         * (const version)
+         *
+         * @param   pos The position.
+         *
+         * @return  A const reference to the value.
+         **/
+        inline const T & get(const Pos & pos) const { return _get(pos); }
+
+
+        /**
+         * Get a value at a given position, starting the search from the cursor C (which is updated).
+         * If the T object at that site does not exist, it is created. Creating sites is not
+         * thread-safe: threads which only read the grid concurrently with a writer must use
+         * peek(pos, C) instead.
+         *
+         * @param   pos         The position.
+         * @param [in,out]  C   The cursor of the calling thread.
+         *
+         * @return  A reference to the value.
+         **/
+        inline T & get(const Pos & pos, Cursor & C) { return _getw(pos, C); }
+
+
+        /**
+         * Get a value at a given position, starting the search from the cursor C (which is updated).
+         * (const version, the site is not marked as modified for saveDelta()).
+         *
+         * @param   pos         The position.
+         * @param [in,out]  C   The cursor of the calling thread.
+         *
+         * @return  A const reference to the value.
+         **/
+        inline const T & get(const Pos & pos, Cursor & C) const
+            {
+            _pbox c = _cursorBox(C, _pcurrent);
+            const T & r = _getFrom(pos, c);
+            C._p = c;
+            return r;
+            }
+
+
+        /**
+        * Get a value at a given position. If the T object at that site does not exist, it is created. Dimension 1 specialization.
+        **/
+        inline T & get(int64 x) { static_assert(D == 1, "template parameter D must be 1"); return _getw(Pos(x)); }
+
+        /**
+        * Get a value at a given position. If the T object at that site does not exist, it is created. Dimension 1 specialization. (const version)
+        **/
+        inline const T & get(int64 x) const { static_assert(D == 1, "template parameter D must be 1"); return _get(Pos(x)); }
+
+
+        /**
+        * Get a value at a given position. If the T object at that site does not exist, it is created. Dimension 2 specialization.
+        **/
+        inline T & get(int64 x, int64 y) { static_assert(D == 2, "template parameter D must be 2"); return _getw(Pos(x, y)); }
+
+
+        /**
+        * Get a value at a given position. If the T object at that site does not exist, it is created. Dimension 2 specialization. (const version)
+        **/
+        inline const T & get(int64 x, int64 y) const { static_assert(D == 2, "template parameter D must be 2"); return _get(Pos(x, y)); }
+
+
+        /**
+        * Get a value at a given position. If the T object at that site does not exist, it is created. Dimension 3 specialization.
+        **/
+        inline T & get(int64 x, int64 y, int64 z) { static_assert(D == 3, "template parameter D must be 3"); return _getw(Pos(x, y, z)); }
+
+
+        /**
+        * Get a value at a given position. If the T object at that site does not exist, it is created. Dimension 3 specialization. (const version)
+        **/
+        inline const T & get(int64 x, int64 y, int64 z) const { static_assert(D == 3, "template parameter D must be 3"); return _get(Pos(x, y, z)); }
+
+
+        /**
+         * Get the values at several positions at once. Objects which do not exist are created.
+         *
+         * The positions are first sorted according to the Morton (Z-order) index of the leaf
+         * containing them. Then, each leaf is reached only once from the tree and every position
+         * inside it is resolved directly. This is much faster than calling get() repeatedly when the
+         * positions are scattered (for instance, when moving many particles at once).
+         *
+         * The pointers returned stay valid as long as the objects are not moved, which is the case for
+         * dense leafs when no snapshot is alive. Otherwise, they must not be kept across calls which may
+         * create or write sites: a sparse leaf moves its objects when it grows (see sparseLeafs()) and,
+         * while a snapshot is alive, the first write to a leaf replaces it by a copy (see snapshot()).
+         *
+         * @param           pos     array of nb positions.
+         * @param           nb      number of positions.
+         * @param [in,out]  res     array of size nb where the pointer to the object at position pos[i] is
+         *                          put in res[i].
+         **/
+        void getMany(const Pos * pos, size_t nb, T ** res)
+            {
+            _sortByLeaf(pos, nb);
+            size_t k = 0;
+            bool sparse = false;
+            while (k < nb)
+                {
+                size_t j = _sortbuf[k].second;
+                res[j] = &(_getw(pos[j]));   // after a call to _getw(), _pcurrent points to the leaf containing pos[j]
+                if (((_pbox)_pcurrent)->isSparse()) { sparse = true; ++k; continue; } // sites of a sparse leaf are created one by one
+                _pleaf L = (_pleaf)((_pbox)_pcurrent);
+                for (++k; k < nb; ++k)
+                    {
+                    j = _sortbuf[k].second;
+                    if (!L->isInBox(pos[j])) break;
+                    _updaterange(pos[j]);
+                    res[j] = &(L->get(pos[j]));
+                    }
+                }
+            if (sparse)
+                { // creating a site may have moved the objects of its sparse leaf: resolve again (every site exists now)
+                for (k = 0; k < nb; ++k) { const size_t j = _sortbuf[k].second; res[j] = &(_getw(pos[j])); }
+                }
+            }
+
+
+        /**
+         * Set the values at several positions at once. This method require T to be assignable via
+         * T.operator=. Positions are processed leaf by leaf as in getMany(). If the same position
+         * appears several times in the array, the value set is the last one (in the order of the array).
+         *
+         * @param   pos     array of nb positions.
+         * @param   val     array of nb values: val[i] is the value to set at position pos[i].
+         * @param   nb      number of positions.
+         **/
+        void setMany(const Pos * pos, const T * val, size_t nb)
+            {
+            _sortByLeaf(pos, nb);
+            size_t k = 0;
+            while (k < nb)
+                {
+                size_t j = _sortbuf[k].second;
+                _getw(pos[j]) = val[j];
+                if (((_pbox)_pcurrent)->isSparse()) { ++k; continue; } // sites of a sparse leaf are created one by one
+                _pleaf L = (_pleaf)((_pbox)_pcurrent);
+                for (++k; k < nb; ++k)
+                    {
+                    j = _sortbuf[k].second;
+                    if (!L->isInBox(pos[j])) break;
+                    _updaterange(pos[j]);
+                    L->get(pos[j]) = val[j];
+                    }
+                }
+            }
+
+
+        /**
+         * A site together with its 2D nearest neighbours (see neighbourhood() and
+         * for_each_neighbourhood()).
+         **/
+        struct Neighbourhood
+            {
+            T * center;         ///< the site itself
+            T * nei[2 * D];     ///< nei[2i] is the site pos - e_i and nei[2i+1] is the site pos + e_i
+
+            /** Reference to the neighbour in direction dir (in [0, 2D-1]). */
+            inline T & operator[](size_t dir) const { return *(nei[dir]); }
+            };
+
+
+        /**
+         * Return pointers to the object at position pos and to its 2D nearest neighbours. The objects
+         * which do not exist are created, as with get().
+         *
+         * The leaf containing pos is reached once from the tree and, when pos is not on the boundary
+         * of the leaf, the neighbours are obtained directly from their offset inside it. Only the
+         * neighbours which belong to another leaf are looked up separately. If the leaf containing pos
+         * is sparse (see sparseLeafs()), it is replaced by a dense one.
+         *
+         * @param   pos The position of the center.
+         *
+         * @return  The pointers to the center and its neighbours.
+         **/
+        Neighbourhood neighbourhood(const Pos & pos)
+            {
+            Neighbourhood N;
+            N.center = &(_getw(pos));   // after a call to _getw(), _pcurrent points to the leaf containing pos
+            if (((_pbox)_pcurrent)->isSparse()) { N.center = &(_currentDenseLeaf()->get(pos)); } // the neighbours may fill the sparse leaf, which would move the center
+            _pleaf L = (_pleaf)((_pbox)_pcurrent);
+            for (size_t i = 0; i < D; i++)
+                {
+                Pos q = pos;
+                for (size_t k = 0; k < 2; k++)
+                    {
+                    q[i] = pos[i] + ((k == 0) ? -1 : 1);
+                    const int64 u = q[i] - L->center[i];
+                    if ((u > (int64)R) || (u < -((int64)R))) { N.nei[2 * i + k] = &(_getw(q)); continue; } // in another leaf
+                    _updaterange(q);
+                    N.nei[2 * i + k] = &(L->get(q));
+                    }
+                }
+            return N;
+            }
+
+
+        /**
+         * Call fun(const Pos & pos, const Neighbourhood & N) for every site pos of a leaf, N being the
+         * neighbourhood of pos (as returned by neighbourhood()). The sites are visited in row-major
+         * order and the neighbours inside the leaf are found from their offset without
+         * any lookup (only the sites on the boundary of the leaf need to look at the adjacent leafs).
+         * This is the fastest way to apply a stencil to the whole grid: call it for each leaf returned
+         * by leafs().
+         *
+         * Contrarily to neighbourhood(), no object is created: the neighbours which lie in another
+         * leaf and do not exist are set to nullptr in N.
+         *
+         * @param   leaf    The leaf to visit (obtained from leafs() or for_each_leaf()).
+         * @param   fun     The function to call for each site.
+         **/
+        template<typename FUN> void for_each_neighbourhood(const LeafSpan & leaf, FUN fun)
+            {
+            const size_t N = 2 * R + 1;
+            const bool rowmajor = std::is_same<LAYOUT, GridLayout_rowMajor>::value;
+            size_t stride[D];
+            stride[0] = 1; for (size_t i = 1; i < D; i++) { stride[i] = stride[i - 1] * N; }
+            Cursor C;
+            Neighbourhood NB;
+            size_t x[D];
+            for (size_t i = 0; i < D; i++) { x[i] = 0; }
+            for (size_t r = 0; r < LeafSpan::SIZE; r++)
+                {
+                Pos pos;
+                for (size_t i = 0; i < D; i++) { pos[i] = leaf.box.min[i] + (int64)x[i]; }
+                const size_t off = (rowmajor ? r : LAYOUT::template offset<D, R>(x));
+                NB.center = leaf.data + off;
+                for (size_t i = 0; i < D; i++)
+                    {
+                    for (size_t k = 0; k < 2; k++)
+                        {
+                        T * & p = NB.nei[2 * i + k];
+                        if (((k == 0) && (x[i] == 0)) || ((k == 1) && (x[i] == N - 1)))
+                            { // in an adjacent leaf
+                            Pos q = pos; q[i] += ((k == 0) ? -1 : 1);
+                            p = const_cast<T*>(peek(q, C));
+                            }
+                        else if (rowmajor) { p = NB.center + ((k == 0) ? -((std::ptrdiff_t)stride[i]) : ((std::ptrdiff_t)stride[i])); }
+                        else
+                            {
+                            x[i] += ((k == 0) ? -1 : 1);
+                            p = leaf.data + LAYOUT::template offset<D, R>(x);
+                            x[i] -= ((k == 0) ? -1 : 1);
+                            }
+                        }
+                    }
+                fun((const Pos &)pos, (const Neighbourhood &)NB);
+                for (size_t i = 0; i < D; i++) { if (++x[i] < N) break; x[i] = 0; } // next site in row-major order
+                }
+            }
+
+
+        /**
+         * Get a value at a given position. If the T object at that site does not exist, it is created.
+         *
+         * @param   pos The position.
+         *
+         * @return  A reference to the value.
+         **/
+        inline T & operator[](const Pos & pos) { return _getw(pos); }
+
+
+        /**
+         * Get a value at a given position. If the T object at that site does not exist, it is created.
+         * (const version)
+         *
+         * @param   pos The position.
+         *
+         * @return  A const reference to the value.
+         **/
+        inline const T & operator[](const Pos & pos) const { return _get(pos); }
+
+
+        /**
+        * Get a value at a given position. If the T object at that site does not exist, it is created.
+        * Same as the get() method.
+        *
+        * @param   pos The position.
+        *
+        * @return  A reference to the value.
+        **/
+        inline T & operator()(const Pos & pos) { return _getw(pos); }
+
+
+        /**
+         * Get a value at a given position. If the T object at that site does not exist, it is created
+         * Same as the get() method. (const version).
+         *
+         * @param   pos The position.
+         *
+         * @return  A reference to the value.
+         **/
+        inline const T & operator()(const Pos & pos) const { return _get(pos); }
+
+
+        /**
+        * get a value at a given position. Dimension 1 specialization.
+        * This creates the object if it does not exist yet.
+        **/
+        inline T & operator()(int64 x) { static_assert(D == 1, "template parameter D must be 1"); return _getw(Pos(x)); }
+
+        /**
+         * get a value at a given position. Dimension 1 specialization. (const version)
+         * This creates the object if it does not exist yet.
+         **/
+        inline const T & operator()(int64 x) const { static_assert(D == 1, "template parameter D must be 1"); return _get(Pos(x)); }
+
+
+        /**
+        * get a value at a given position. Dimension 2 specialization.
+        * This creates the object if it does not exist yet.
+        **/
+        inline T & operator()(int64 x, int64 y) { static_assert(D == 2, "template parameter D must be 2"); return _getw(Pos(x, y)); }
+
+
+        /**
+         * get a value at a given position. Dimension 2 specialization. (const version)
+         * This creates the object if it does not exist yet.
+         **/
+        inline const T & operator()(int64 x, int64 y) const { static_assert(D == 2, "template parameter D must be 2"); return _get(Pos(x, y)); }
+
+
+        /**
+        * get a value at a given position. Dimension 3 specialization.
+        * This creates the object if it does not exist yet.
+        **/
+        inline T & operator()(int64 x, int64 y, int64 z) { static_assert(D == 3, "template parameter D must be 3"); return _getw(Pos(x, y, z)); }
+
+
+        /**
+         * get a value at a given position. Dimension 3 specialization. (const version)
+         * This creates the object if it does not exist yet.
+         **/
+        inline const T & operator()(int64 x, int64 y, int64 z) const { static_assert(D == 3, "template parameter D must be 3"); return _get(Pos(x, y, z)); }
+
+
+        /**
+        * Return a pointer to the object at a given position. If the value at the site was not yet
+        * created, returns nullptr. This method does not create sites and is suited when drawing the
+        * lattice using, for instance, the LatticeDrawer class.
+        *
+        * This method is threadsafe : it is safe to call peek() while accessing the object via a get()
         * or a set() or one of their operator [], operator() equivalents. It may even be called while
         * the grid is being modified by assign/load operations. However, peek() should not be called
         * while another peek() is in progress. To perform multiple simulatneous peek, use the peek
@@ -629,10 +1644,16 @@ namespace mtools
             if (c->isLeaf())
                 {
                 _pleaf p = (_pleaf)(c);
-                if (p->isInBox(pos)) return(&(p->get(pos)));
+                if ((p->isInBox(pos)) && (p->cowgen != _COW_RETIRED)) return(&(p->get(pos)));
                 c = p->father;
                 if (c == nullptr) return nullptr;
                 }
+            else if (c->isSparse())
+                {
+                _psparse p = (_psparse)(c);
+                if (p->isInBox(pos)) return _peekSparse(p, pos);
+                c = p->father;
+                }
             // no we go up...
             _pnode q = (_pnode)(c);
             while (!q->isInBox(pos))
@@ -646,6 +1667,7 @@ namespace mtools
                 _pbox b = q->getSubBox(pos);
                 if (b == nullptr) { _pcurrentpeek = q; return nullptr; }
                 if (b->isLeaf()) { _pcurrentpeek = b; return(&(((_pleaf)b)->get(pos))); }
+                if (b->isSparse()) { _pcurrentpeek = b; return _peekSparse((_psparse)b, pos); }
                 q = (_pnode)b;
                 }
             }
@@ -683,10 +1705,16 @@ namespace mtools
             if (c->isLeaf())
                 {
                 _pleaf p = (_pleaf)(c);
-                if (p->isInBox(pos)) return(&(p->get(pos)));
+                if ((p->isInBox(pos)) && (p->cowgen != _COW_RETIRED)) return(&(p->get(pos)));
                 c = p->father;
                 if (c == nullptr) return nullptr;
                 }
+            else if (c->isSparse())
+                {
+                _psparse p = (_psparse)(c);
+                if (p->isInBox(pos)) return _peekSparse(p, pos);
+                c = p->father;
+                }
             // no we go up...
             _pnode q = (_pnode)(c);
             while (!q->isInBox(pos))
@@ -700,11 +1728,33 @@ namespace mtools
                 _pbox b = q->getSubBox(pos);
                 if (b == nullptr) { hint = q; return nullptr; }
                 if (b->isLeaf()) { hint = b; return(&(((_pleaf)b)->get(pos))); }
+                if (b->isSparse()) { hint = b; return _peekSparse((_psparse)b, pos); }
                 q = (_pnode)b;
                 }
             }
 
 
+        /**
+         * Return a pointer to the object at a given position, starting the search from the cursor C
+         * (which is updated). Same as peek(pos, hint) but the cursor also survives the resets of the
+         * grid. Nothing shared is written, so any number of threads may peek simultaneously, each
+         * with its own cursor, while the grid is modified.
+         *
+         * @param   pos         The position to peek.
+         * @param [in,out]  C   The cursor of the calling thread.
+         *
+         * @return  nullptr if the value at that site was not yet created. A const pointer to it
+         *          otherwise.
+         **/
+        inline const T * peek(const Pos & pos, Cursor & C) const
+            {
+            void * hint = _cursorBox(C, _pcurrentpeek);
+            const T * r = peek(pos, hint);
+            C._p = hint;
+            return r;
+            }
+
+
         /**
          * peek at a value at a given position. Dimension 1 specialization.
          * 
@@ -773,6 +1823,12 @@ namespace mtools
                 MTOOLS_ASSERT(cp->father != nullptr); // a leaf must always have a father
                 cp = p->father;
                 }
+            else if (cp->isSparse())
+                {
+                _psparse p = (_psparse)(cp);
+                if (p->isInBox(pos)) { boxMin = pos; boxMax = pos; return p->find(p->index(pos)); } // singleton, empty or not
+                cp = p->father;
+                }
             // no, going up...
             _pnode q = (_pnode)(cp);
             while (!q->isInBox(pos))
@@ -818,6 +1874,12 @@ namespace mtools
                     _pcurrent = b;
                     return(&(((_pleaf)b)->get(pos))); // just a singleton
                     }
+                if (b->isSparse())
+                    {
+                    boxMin = pos; boxMax = pos;
+                    _pcurrent = b;
+                    return ((_psparse)b)->find(((_psparse)b)->index(pos));
+                    }
                 q = (_pnode)b;
                 }
             }
@@ -838,7 +1900,27 @@ namespace mtools
         **/
         inline const T * findFullBoxCentered(const Pos & pos, iBox<D> & bestRect) const
             {
-            static_assert(D == 2, "findFullBoxCentered() only implemented for dimension 2 yet...");
+            return _findFullBoxCentered(pos, bestRect, metaprog::dummy<D == 2>());
+            }
+
+
+
+        /***************************************************************
+        * Private section
+        ***************************************************************/
+
+
+    private:
+
+
+        static_assert(D > 0, "template parameter D (dimension) must be non-zero");
+        static_assert(R > 0, "template parameter R (radius) must be non-zero");
+        static_assert(std::is_constructible<T>::value || std::is_constructible<T, Pos>::value, "The object T must either be default constructible T() or constructible with T(const Pos &)");
+
+
+        /* Used by findFullBoxCentered (2D specialization). */
+        inline const T * _findFullBoxCentered(const Pos & pos, iBox<D> & bestRect, metaprog::dummy<true> dum) const
+            {
             const T* pv = findFullBox(pos, bestRect); // get the non optimized box.
             if ((pv != nullptr)||(bestRect.lx() == 0)) return pv;   // no box found, nothing more to do.
 
@@ -1209,18 +2291,68 @@ namespace mtools
             }
 
 
-
-        /***************************************************************
-        * Private section
-        ***************************************************************/
-
-
-    private:
-
-
-        static_assert(D > 0, "template parameter D (dimension) must be non-zero");
-        static_assert(R > 0, "template parameter R (radius) must be non-zero");
-        static_assert(std::is_constructible<T>::value || std::is_constructible<T, Pos>::value, "The object T must either be default constructible T() or constructible with T(const Pos &)");
+        /* Used by findFullBoxCentered (dimension D != 2). Extend the base box face by face with the
+         * adjacent boxes of the same size which are full (closest face to pos first) then go down one
+         * level toward pos. */
+        inline const T * _findFullBoxCentered(const Pos & pos, iBox<D> & bestRect, metaprog::dummy<false> dum) const
+            {
+            const T* pv = findFullBox(pos, bestRect); // get the non optimized box.
+            if ((pv != nullptr)||(bestRect.lx() == 0)) return pv;   // no box found, nothing more to do.
+            iBox<D> baseRect = bestRect;                // the base box is the best box.
+            int64 lbest = bestRect.boundaryDist(pos);   // current distance to the boundary
+            while (1)
+                {
+                const int64 lbase = baseRect.boundaryDist(pos); // distance from the boundary of the base box to pos
+                const int64 diambase = baseRect.lx() + 1;       // diameter of the base box
+                if (lbase + diambase <= lbest) { return pv; }   // we cannot improve the distance to the boundary at this level (nor below)
+                size_t faces[2 * D]; int64 fdist[2 * D];
+                for (size_t i = 0; i < D; i++)
+                    {
+                    faces[2 * i] = 2 * i; fdist[2 * i] = pos[i] - baseRect.min[i];
+                    faces[2 * i + 1] = 2 * i + 1; fdist[2 * i + 1] = baseRect.max[i] - pos[i];
+                    }
+                std::sort(faces, faces + 2 * D, [&](size_t a, size_t b) { return fdist[a] < fdist[b]; });
+                iBox<D> ext = baseRect;
+                for (size_t f = 0; f < 2 * D; f++)
+                    {
+                    const size_t ax = faces[f] / 2;
+                    iBox<D> slab = ext; // the layer of boxes of size diambase adjacent to that face
+                    if (faces[f] & 1) { slab.min[ax] = ext.max[ax] + 1; slab.max[ax] = ext.max[ax] + diambase; } else { slab.min[ax] = ext.min[ax] - diambase; slab.max[ax] = ext.min[ax] - 1; }
+                    if (_fullSlab(slab, diambase, pv)) { ext.min[ax] = std::min<int64>(ext.min[ax], slab.min[ax]); ext.max[ax] = std::max<int64>(ext.max[ax], slab.max[ax]); }
+                    }
+                const int64 lext = ext.boundaryDist(pos);
+                if (lext > lbest) { bestRect = ext; lbest = lext; }
+                if (diambase == (2 * R + 1)) return pv; // already at the bottom level, we stop
+                const int64 nrad = (diambase - 3) / 6;  // radius of a sub-box of baseRect
+                const int64 off = (2 * nrad + 1);
+                const Pos basecenter = baseRect.center();
+                Pos newcenter;
+                for (size_t i = 0; i < D; i++)
+                    {
+                    const int64 diff = pos[i] - basecenter[i];
+                    newcenter[i] = basecenter[i] + ((diff < -nrad) ? -off : ((diff > nrad) ? off : 0));
+                    }
+                if (newcenter == basecenter) { return pv; } // same center: going further down will not improve the solution so we stop
+                for (size_t i = 0; i < D; i++) { baseRect.min[i] = newcenter[i] - nrad; baseRect.max[i] = newcenter[i] + nrad; }
+                }
+            }
+
+
+        /* Used by findFullBoxCentered (dimension D != 2). Check that all the boxes of diameter diam
+         * (aligned with the grid structure) which tile the box slab are full with value pv. */
+        inline bool _fullSlab(const iBox<D> & slab, const int64 diam, const T * pv) const
+            {
+            Pos c;
+            for (size_t i = 0; i < D; i++) { c[i] = slab.min[i] + diam / 2; }
+            while (1)
+                {
+                iBox<D> RR;
+                if ((findFullBox(c, RR) != pv) || (RR.lx() + 1 < diam)) return false; // box too small or with another value
+                size_t i = 0;
+                while ((i < D) && ((c[i] += diam) > slab.max[i])) { c[i] = slab.min[i] + diam / 2; i++; }
+                if (i == D) return true;
+                }
+            }
 
 
         /* Used by findFullBoxCentered (2D specialization). Check if a given border adjacent box of same size is full. */
@@ -1278,13 +2410,31 @@ namespace mtools
             {
             MTOOLS_ASSERT(_pcurrent != (_pbox)nullptr);
             _pbox c = _pcurrent;
+            T & result = _getFrom(pos, c);
+            _pcurrent = c;
+            return result;
+            }
+
+
+        /* get sub method starting from the box cur (which may be a sparse leaf replaced since) and
+         * setting cur to the leaf containing pos */
+        inline T & _getFrom(const Pos & pos, _pbox & cur) const
+            {
+            _pbox c = cur;
             _updaterange(pos);
             if (c->isLeaf())
                 {
-                if (((_pleaf)c)->isInBox(pos)) { return(((_pleaf)c)->get(pos)); }
+                if ((((_pleaf)c)->isInBox(pos)) && (((_pleaf)c)->cowgen != _COW_RETIRED)) { _countGet(true); return(((_pleaf)c)->get(pos)); }
                 MTOOLS_ASSERT(c->father != nullptr); // a leaf must always have a father
                 c = c->father;
                 }
+            else if (c->isSparse())
+                {
+                if ((((_psparse)c)->forward() == nullptr) && (((_psparse)c)->isInBox(pos))) { _countGet(true); return _getSparse((_psparse)c, pos, cur); }
+                c = c->father;
+                }
+            _countGet(false);
+            MTOOLS_PROF_SCOPE("Grid_basic::tree walk");
             // going up...
             _pnode q = (_pnode)c;
             while (!q->isInBox(pos))
@@ -1300,23 +2450,138 @@ namespace mtools
                     {
                     if (q->rad == R)
                         {
+                        if (_sparse)
+                            {
+                            b = _allocateSparseLeaf(q, q->subBoxCenter(pos), 0);
+                            return _getSparse((_psparse)b, pos, cur);
+                            }
                         b = _allocateLeaf(q, q->subBoxCenter(pos));
-                        T & result = ((_pleaf)b)->get(pos);
-                        _pcurrent = b;
-                        return(result);
+                        cur = b;
+                        return(((_pleaf)b)->get(pos));
                         }
                     q = _allocateNode(q, q->subBoxCenter(pos), nullptr);
                     b = q;
                     }
                 else
                     {
-                    if (b->isLeaf()) { T & result = ((_pleaf)b)->get(pos); _pcurrent = b; return(result); }
+                    if (b->isLeaf()) { cur = b; return(((_pleaf)b)->get(pos)); }
+                    if (b->isSparse()) { return _getSparse((_psparse)b, pos, cur); }
                     q = (_pnode)b;
                     }
                 }
             }
 
 
+        /* get sub method for a sparse leaf: create the object if needed and replace the leaf by a dense
+         * one when it is full. Set cur to the leaf containing pos */
+        inline T & _getSparse(_psparse S, const Pos & pos, _pbox & cur) const
+            {
+            const size_t i = S->index(pos);
+            T * p = S->find(i);
+            if (p == nullptr)
+                {
+                if (S->full())
+                    {
+                    _pbox L = _promote(S, false);
+                    if (L->isSparse()) { return _getSparse((_psparse)L, pos, cur); }
+                    cur = L;
+                    return ((_pleaf)L)->get(pos);
+                    }
+                p = S->obj(S->nb);
+                _constructCell(p, pos, metaprog::dummy<std::is_constructible<T, Pos>::value>());
+                S->publish(i);
+                }
+            cur = S;
+            return *p;
+            }
+
+
+        /* peek sub method for a sparse leaf */
+        inline const T * _peekSparse(_psparse S, const Pos & pos) const
+            {
+            _pbox L;
+            while ((L = S->forward()) != nullptr)
+                { // S was replaced
+                if (!L->isSparse()) return(&(((_pleaf)L)->get(pos)));
+                S = (_psparse)L;
+                }
+            return S->find(S->index(pos));
+            }
+
+
+        /* Replace the sparse leaf S in the tree by a sparse leaf of the next tier or by a dense leaf (if dense
+         * is set or if S is in the last tier) and return it. The objects of S are moved. S is not released
+         * because a concurrent peek() may still use it: it forwards to the new leaf. */
+        _pbox _promote(_psparse S, bool dense) const
+            {
+            _pbox L;
+            if ((!dense) && (S->tier + 1 < _sparseLeaf::NB_TIERS))
+                {
+                _psparse N = _allocateSparseLeaf(S->father, S->center, S->tier + 1);
+                N->dirty = S->dirty;
+                for (size_t k = 0; k < S->nb; ++k)
+                    {
+                    _moveCell(N->obj(k), S->obj(k), metaprog::dummy<std::is_move_constructible<T>::value>());
+                    N->publish(S->keyTab()[k]);
+                    }
+                L = N;
+                }
+            else
+                {
+                _pleaf F = _poolLeaf.allocate();
+                _fillFromSparse(S, F, [](void * dst, T * src) { _moveCell(dst, src, metaprog::dummy<std::is_move_constructible<T>::value>()); });
+                F->dirty = S->dirty;
+                F->cowgen = _cowgen;
+                F->center = S->center;
+                F->rad = 1;
+                F->father = S->father;
+                L = F;
+                }
+            ((_pnode)(S->father))->getSubBox(S->center) = L;
+            S->forward(L);
+            if ((_pbox)_pcurrent == (_pbox)S) { _pcurrent = L; }
+            return L;
+            }
+
+
+        /* return the leaf pointed by _pcurrent, replacing it by a dense leaf if it is sparse */
+        inline _pleaf _currentDenseLeaf() const
+            {
+            _pbox c = _pcurrent;
+            if (c->isSparse()) { return (_pleaf)_promote((_psparse)c, true); }
+            return (_pleaf)c;
+            }
+
+
+        /* construct all the objects of the leaf L from those of the sparse leaf S: fun(dst, src) is called
+         * for the sites which exist in S, the other ones are default/position constructed */
+        template<typename LEAF, typename FUN> static void _fillFromSparse(_psparse S, LEAF * L, FUN fun)
+            {
+            Pos pos = S->center;
+            for (size_t i = 0; i < D; ++i) { pos[i] -= R; }
+            for (size_t x = 0; x < metaprog::power<(2 * R + 1), D>::value; ++x)
+                {
+                T * src = S->find(x);
+                if (src != nullptr) { fun(L->ptrRowMajor(x), src); } else { _constructCell(L->ptrRowMajor(x), pos, metaprog::dummy<std::is_constructible<T, Pos>::value>()); }
+                for (size_t i = 0; i < D; ++i)
+                    {
+                    if (pos[i] < (S->center[i] + (int64)R)) { pos[i]++;  break; }
+                    pos[i] -= (2 * R);
+                    }
+                }
+            }
+
+
+        /* construct a single object with T(pos) or T() */
+        static inline void _constructCell(void * p, const Pos & pos, metaprog::dummy<true> dum) { new(p) T(pos); }
+        static inline void _constructCell(void * p, const Pos & pos, metaprog::dummy<false> dum) { new(p) T(); }
+
+
+        /* move an object to a new location */
+        static inline void _moveCell(void * dst, T * src, metaprog::dummy<true> dum) { new(dst) T(std::move(*src)); }
+        static inline void _moveCell(void * dst, T * src, metaprog::dummy<false> dum) { MTOOLS_ERROR("Grid_basic: T must be move constructible to use sparse leafs."); }
+
+
         /* update _rangemin and _rangemax */
         inline void _updaterange(const Pos & pos) const
             {
@@ -1329,6 +2594,16 @@ namespace mtools
             }
 
 
+        /* fill _sortbuf with the indexes of the positions sorted by the Morton key of their leaf
+         * (ties are ordered by index). Used by getMany() and setMany() */
+        void _sortByLeaf(const Pos * pos, size_t nb)
+            {
+            _sortbuf.resize(nb);
+            for (size_t i = 0; i < nb; ++i) { _sortbuf[i] = std::pair<uint64, size_t>(internals_grid::_leafMortonKey<D, R>(pos[i]), i); }
+            std::sort(_sortbuf.begin(), _sortbuf.end());
+            }
+
+
         /* get the root of the tree */
         inline _pbox _getRoot() const
             {
@@ -1339,6 +2614,32 @@ namespace mtools
             }
 
 
+        /* update the get() cache hit counters (only when profiling is enabled) */
+        inline void _countGet(bool hit) const
+            {
+#if (MTOOLS_USE_PROFILING)
+            _statGets.fetch_add(1, std::memory_order_relaxed);
+            if (hit) _statHits.fetch_add(1, std::memory_order_relaxed);
+#else
+            (void)hit;
+#endif
+            }
+
+
+        /* fill the depth histogram of the subtree p at depth d */
+        void _statsWalk(_pbox p, size_t d, GridStats & st) const
+            {
+            if (p == nullptr) return;
+            if ((p->isLeaf()) || (p->isSparse()))
+                {
+                if (st.depthHistogram.size() <= d) st.depthHistogram.resize(d + 1, 0);
+                st.depthHistogram[d]++;
+                return;
+                }
+            for (size_t i = 0; i < metaprog::power<3, D>::value; ++i) { _statsWalk(((_pnode)p)->tab[i], d + 1, st); }
+            }
+
+
         /* print the tree, for debug purpose only */
         std::string _printTree(_pbox p, std::string tab) const
             {
@@ -1348,6 +2649,11 @@ namespace mtools
                 std::string r = tab + " Leaf: center = " + p->center.toString(false) + "\n";
                 return r;
                 }
+            if (p->isSparse())
+                {
+                std::string r = tab + " Sparse leaf: center = " + p->center.toString(false) + "  Objects = " + mtools::toString(((_psparse)p)->nb) + "\n";
+                return r;
+                }
             std::string r = tab + " Node: center = " + p->center.toString(false) + "  Radius = " + mtools::toString(p->rad) + "\n";
             tab += "    |";
             for (size_t i = 0; i < metaprog::power<3, D>::value; ++i) { r += _printTree(((_pnode)p)->tab[i], tab); }
@@ -1355,16 +2661,303 @@ namespace mtools
             }
 
 
+        /* access an element with the intent to modify it: mark the leaf as dirty and copy it first if
+         * it may be seen by a snapshot */
+        inline T & _getw(const Pos & pos)
+            {
+            _changes.record(pos);
+            T & r = _get(pos);
+            _pbox c = _pcurrent; // after a call to _get(), _pcurrent points to the leaf containing pos
+            if (c->isSparse()) { ((_psparse)c)->dirty = 1; return r; }
+            _pleaf L = (_pleaf)c;
+            if (L->cowgen != _cowgen) { L = _cowLeaf(L); L->dirty = 1; return L->get(pos); }
+            L->dirty = 1;
+            return r;
+            }
+
+
+        /* same as _getw() but using the cursor C instead of _pcurrent */
+        inline T & _getw(const Pos & pos, Cursor & C)
+            {
+            _changes.record(pos);
+            _pbox c = _cursorBox(C, _pcurrent);
+            T & r = _getFrom(pos, c);
+            C._p = c;
+            if (c->isSparse()) { ((_psparse)c)->dirty = 1; return r; }
+            _pleaf L = (_pleaf)c;
+            if (L->cowgen != _cowgen) { L = _cowLeaf(L); C._p = L; L->dirty = 1; return L->get(pos); }
+            L->dirty = 1;
+            return r;
+            }
+
+
+        /* true if a snapshot of the grid may still be read */
+        inline bool _snapAlive() const { return ((_snap != nullptr) && (_snap.use_count() > 1)); }
+
+
+        /* copy-on-write: return the leaf which replaces L in the tree and may be modified. L was created
+         * before the last snapshot: it is copied and kept for the snapshots if one of them can see it */
+        _pleaf _cowLeaf(_pleaf L)
+            {
+            _pbox & slot = ((_pnode)L->father)->getSubBox(L->center);
+            if ((_pbox)slot != (_pbox)L)
+                { // L was already replaced (found from a cursor)
+                L = (_pleaf)((_pbox)slot);
+                if (L->cowgen == _cowgen) return L;
+                }
+            if (!_snapAlive())
+                { // nobody can see L anymore
+                _snap.reset();
+                _freeGarbage();
+                L->cowgen = _cowgen;
+                return L;
+                }
+            _freeGarbage();
+            MTOOLS_PROF_COUNT("Grid_basic::leaf copied on write", 1);
+            _pleaf F = _poolLeaf.allocate();
+            for (size_t i = 0; i < metaprog::power<(2 * R + 1), D>::value; ++i) { new(F->data + i) T(L->data[i]); }
+            F->dirty = L->dirty;
+            F->cowgen = _cowgen;
+            F->center = L->center;
+            F->rad = 1;
+            F->father = L->father;
+                {
+                std::lock_guard<std::mutex> lock(_snap->mut);
+                _snap->preserved[&slot] = std::pair<uint64, _pleaf>(L->cowgen, L);
+                }
+            std::atomic_thread_fence(std::memory_order_release); // F and the old version are published before F is put in the tree
+            slot = F;
+            L->cowgen = _COW_RETIRED;
+            if ((_pbox)_pcurrent == (_pbox)L) { _pcurrent = F; }
+            if ((_pbox)_pcurrentpeek == (_pbox)L) { _pcurrentpeek = F; }
+            return F;
+            }
+
+
+        /* copy all the leafs of the subtree starting at p which were created before the last snapshot */
+        void _cowAll(_pbox p)
+            {
+            if (p == nullptr) return;
+            if (p->isLeaf()) { if (((_pleaf)p)->cowgen != _cowgen) { _cowLeaf((_pleaf)p); } return; }
+            for (size_t i = 0; i < metaprog::power<3, D>::value; ++i) { _cowAll(((_pnode)p)->tab[i]); }
+            }
+
+
+        /* free the old versions of the leafs released by the snapshots */
+        void _freeGarbage()
+            {
+            if ((_snaplink == nullptr) || (!_snaplink->hasGarbage.load(std::memory_order_acquire))) return;
+            std::vector<_pleaf> garbage;
+                {
+                std::lock_guard<std::mutex> lock(_snaplink->mut);
+                garbage.swap(_snaplink->garbage);
+                _snaplink->hasGarbage = false;
+                }
+            for (_pleaf L : garbage)
+                {
+                if (_callDtors) { _poolLeaf.destroy(L); }
+                _poolLeaf.deallocate(L);
+                }
+            }
+
+
+        /* return the box of a cursor, or def if the cursor is empty or was created before the last
+         * reset of the tree */
+        inline _pbox _cursorBox(Cursor & C, _pbox def) const
+            {
+            const uint64 g = _generation.load(std::memory_order_acquire);
+            if ((C._p == nullptr) || (C._gen != g)) { C._p = def; C._gen = g; }
+            return (_pbox)C._p;
+            }
+
+
+        /* serialize the dirty leafs of the subtree starting at p */
+        void _serializeDirty(OBaseArchive & ar, _pbox p) const
+            {
+            if (p == nullptr) return;
+            if (p->isSparse())
+                {
+                if (((_psparse)p)->dirty == 0) return;
+                ar & ((char)'L');
+                ar & p->center;
+                _serializeSparse(ar, (_psparse)p);
+                ar.newline();
+                return;
+                }
+            if (p->isLeaf())
+                {
+                if (((_pleaf)p)->dirty == 0) return;
+                ar & ((char)'L');
+                ar & p->center;
+                for (size_t i = 0; i < metaprog::power<(2 * R + 1), D>::value; ++i)  { ar & (((_pleaf)p)->getRowMajor(i)); }
+                ar.newline();
+                return;
+                }
+            for (size_t i = 0; i < metaprog::power<3, D>::value; ++i) { _serializeDirty(ar, ((_pnode)p)->tab[i]); }
+            }
+
+
+        /* clear the dirty flags of the subtree starting at p */
+        void _clearDirty(_pbox p)
+            {
+            if (p == nullptr) return;
+            if (p->isSparse()) { ((_psparse)p)->dirty = 0; return; }
+            if (p->isLeaf()) { ((_pleaf)p)->dirty = 0; return; }
+            for (size_t i = 0; i < metaprog::power<3, D>::value; ++i) { _clearDirty(((_pnode)p)->tab[i]); }
+            }
+
+
+        /* add the leafs of the subtree starting at p to vec */
+        void _collectLeafs(_pbox p, std::vector<LeafSpan> & vec) const
+            {
+            if (p == nullptr) return;
+            if (p->isSparse()) { p = _promote((_psparse)p, true); }
+            if (p->isLeaf())
+                {
+                LeafSpan L;
+                for (size_t i = 0; i < D; i++) { L.box.min[i] = p->center[i] - (int64)R; L.box.max[i] = p->center[i] + (int64)R; }
+                L.data = ((_pleaf)p)->data;
+                vec.push_back(L);
+                return;
+                }
+            for (size_t i = 0; i < metaprog::power<3, D>::value; ++i) { _collectLeafs(((_pnode)p)->tab[i], vec); }
+            }
+
+
+        /* export the part of the box B inside the box of half width hw centered at center, which
+         * corresponds to p (nullptr if empty). See exportBox() */
+        template<typename SINK> void _exportBox(_pbox p, const Pos & center, int64 hw, const iBox<D> & B, SINK & sink, std::vector<T> & buf) const
+            {
+            iBox<D> C;
+            for (size_t i = 0; i < D; i++)
+                {
+                C.min[i] = std::max<int64>(center[i] - hw, B.min[i]);
+                C.max[i] = std::min<int64>(center[i] + hw, B.max[i]);
+                if (C.min[i] > C.max[i]) return;
+                }
+            if (p == nullptr) { sink((const iBox<D> &)C, (const T *)nullptr); return; }
+            if (p->isLeaf())
+                {
+                _pleaf F = (_pleaf)p;
+                bool full = std::is_same<LAYOUT, GridLayout_rowMajor>::value;
+                for (size_t i = 0; i < D; i++) { if ((C.min[i] != center[i] - hw) || (C.max[i] != center[i] + hw)) { full = false; } }
+                if (full) { sink((const iBox<D> &)C, (const T *)F->data); return; } // no copy needed
+                buf.clear();
+                _forEachRow(C, [&](Pos pos, size_t len) { for (size_t n = 0; n < len; n++) { buf.push_back(F->get(pos)); pos[0]++; } });
+                sink((const iBox<D> &)C, (const T *)buf.data());
+                return;
+                }
+            if (p->isSparse())
+                {
+                _psparse S = (_psparse)p;
+                buf.clear();
+                _forEachRow(C, [&](Pos pos, size_t len) { for (size_t n = 0; n < len; n++) { const T * o = S->find(S->index(pos)); if (o != nullptr) buf.push_back(*o); else buf.push_back(T()); pos[0]++; } });
+                sink((const iBox<D> &)C, (const T *)buf.data());
+                return;
+                }
+            _pnode q = (_pnode)p;
+            for (size_t i = 0; i < metaprog::power<3, D>::value; ++i) { _exportBox(q->tab[i], q->subBoxCenterFromIndex(i), (int64)q->rad, B, sink, buf); }
+            }
+
+
+        /* call fun(start, len) for each row of the (non-empty) box C, in row-major order. A row is the
+         * set of len sites start, start + e_0, ..., start + (len-1)e_0 */
+        template<typename FUN> static void _forEachRow(const iBox<D> & C, FUN fun)
+            {
+            const size_t len = (size_t)(C.max[0] - C.min[0] + 1);
+            Pos pos = C.min;
+            while (1)
+                {
+                fun((const Pos &)pos, len);
+                size_t i = 1;
+                while ((i < D) && (pos[i] == C.max[i])) { pos[i] = C.min[i]; i++; }
+                if (i >= D) return;
+                pos[i]++;
+                }
+            }
+
+
+        /* index of the site pos in a dense row-major array covering the box B */
+        static inline size_t _denseIndex(const iBox<D> & B, const Pos & pos)
+            {
+            size_t off = 0, A = 1;
+            for (size_t i = 0; i < D; i++) { off += (size_t)(pos[i] - B.min[i]) * A; A *= (size_t)(B.max[i] - B.min[i] + 1); }
+            return off;
+            }
+
+
+        /* number of sites in the (non-empty) box C */
+        static inline size_t _boxSize(const iBox<D> & C)
+            {
+            size_t n = 1;
+            for (size_t i = 0; i < D; i++) { n *= (size_t)(C.max[i] - C.min[i] + 1); }
+            return n;
+            }
+
+
+        /* return the dense leaf containing pos, ready to be written (created if needed, copied if a
+         * snapshot may see it and marked as dirty) */
+        _pleaf _writableLeaf(const Pos & pos)
+            {
+            _changes.record(pos);
+            _get(pos); // _pcurrent now points to the leaf containing pos
+            _pleaf L = _currentDenseLeaf();
+            if (L->cowgen != _cowgen) { L = _cowLeaf(L); }
+            L->dirty = 1;
+            return L;
+            }
+
+
+        /* count the number of dirty leafs in the subtree starting at p */
+        size_t _countDirty(_pbox p) const
+            {
+            if (p == nullptr) return 0;
+            if (p->isSparse()) { return ((((_psparse)p)->dirty != 0) ? 1 : 0); }
+            if (p->isLeaf()) { return ((((_pleaf)p)->dirty != 0) ? 1 : 0); }
+            size_t nb = 0;
+            for (size_t i = 0; i < metaprog::power<3, D>::value; ++i) { nb += _countDirty(((_pnode)p)->tab[i]); }
+            return nb;
+            }
+
+
+        /* write the header of the grid file and call treefun(ar) to write the tree */
+        template<typename TREEFUN> static void _serializeWith(OBaseArchive & ar, bool callDtors, const Pos & rangemin, const Pos & rangemax, TREEFUN treefun)
+            {
+            ar << "\nBegining of Grid_basic<" << D << " , [" << std::string(typeid(T).name()) << "] , " << R << ">\n";
+            ar << "Version";    ar & ((uint64)1); ar.newline();
+            ar << "Template D"; ar & ((uint64)D); ar.newline();
+            ar << "Template R"; ar & ((uint64)R); ar.newline();
+            ar << "object T";   ar & std::string(typeid(T).name()); ar.newline();
+            ar << "sizeof(T)";  ar & ((uint64)sizeof(T)); ar.newline();
+            ar << "call dtors"; ar & callDtors; ar.newline();
+            ar << "_rangemin";  ar & rangemin; ar.newline();
+            ar << "_rangemax";  ar & rangemax; ar.newline();
+            ar << "_minSpec";   ar & ((int64)0); ar.newline();
+            ar << "_maxSpec";   ar & ((int64)-1); ar.newline();
+            ar << "Grid tree\n";
+            treefun(ar);
+            ar << "\nEnd of Grid_basic<" << D << " , [" << std::string(typeid(T).name()) << "] , " << R << ">\n";
+            }
+
+
         /* recursive method for serialization of the tree */
         template<typename ARCHIVE> void _serializeTree(ARCHIVE & ar, _pbox p) const
             {
             if (p == nullptr) { ar & ((char)'V'); return; } // void pointer
+            if (p->isSparse())
+                { // saved as a regular leaf
+                ar & ((char)'L');
+                ar & p->center;
+                ar & ((uint64)1);
+                _serializeSparse(ar, (_psparse)p);
+                return;
+                }
             if (p->isLeaf())
                 {
                 ar & ((char)'L');
                 ar & p->center;
                 ar & p->rad;
-                for (size_t i = 0; i < metaprog::power<(2 * R + 1), D>::value; ++i)  { ar & (((_pleaf)p)->data[i]); }
+                for (size_t i = 0; i < metaprog::power<(2 * R + 1), D>::value; ++i)  { ar & (((_pleaf)p)->getRowMajor(i)); } // always saved in row-major order
                 return;
                 }
             ar & ((char)'N');
@@ -1375,18 +2968,45 @@ namespace mtools
             }
 
 
+        /* serialize all the sites of a sparse leaf in row-major order, as for a dense leaf: the sites
+         * which do not exist are written as newly constructed objects */
+        template<typename ARCHIVE> void _serializeSparse(ARCHIVE & ar, _psparse S) const
+            {
+            typename std::aligned_storage<sizeof(T), alignof(T)>::type buf;
+            Pos pos = S->center;
+            for (size_t i = 0; i < D; ++i) { pos[i] -= R; }
+            for (size_t x = 0; x < metaprog::power<(2 * R + 1), D>::value; ++x)
+                {
+                T * p = S->find(x);
+                if (p != nullptr) { ar & (*p); }
+                else
+                    {
+                    T * t = reinterpret_cast<T*>(&buf);
+                    _constructCell(t, pos, metaprog::dummy<std::is_constructible<T, Pos>::value>());
+                    ar & (*t);
+                    t->~T();
+                    }
+                for (size_t i = 0; i < D; ++i)
+                    {
+                    if (pos[i] < (S->center[i] + (int64)R)) { pos[i]++;  break; }
+                    pos[i] -= (2 * R);
+                    }
+                }
+            }
+
+
         /* reconstruction of the object of a leaf from the constructor T(IBaseArchive &)*/
-        inline void _reconstructLeaf(IBaseArchive & ar, T * data, Pos center, metaprog::dummy<true> dum)
+        inline void _reconstructLeaf(IBaseArchive & ar, _pleaf L, Pos center, metaprog::dummy<true> dum)
             {
-            for (size_t i = 0; i < metaprog::power<(2 * R + 1), D>::value; ++i)  { new(data + i) T(ar); }
+            for (size_t i = 0; i < metaprog::power<(2 * R + 1), D>::value; ++i)  { new(L->ptrRowMajor(i)) T(ar); }
             }
 
 
         /* reconstruction of the object of a leaf when no constructor from archive */
-        inline void _reconstructLeaf(IBaseArchive & ar, T * data, Pos center, metaprog::dummy<false> dum)
+        inline void _reconstructLeaf(IBaseArchive & ar, _pleaf L, Pos center, metaprog::dummy<false> dum)
             {
-            _createDataLeaf(data, center, metaprog::dummy<std::is_constructible<T, Pos>::value>());          // first call the default or the positionnal ctor for every object
-            for (size_t i = 0; i < metaprog::power<(2 * R + 1), D>::value; ++i)  { ar &  (data[i]); }        // and then deserializes
+            _createDataLeaf(L, center, metaprog::dummy<std::is_constructible<T, Pos>::value>());          // first call the default or the positionnal ctor for every object
+            for (size_t i = 0; i < metaprog::power<(2 * R + 1), D>::value; ++i)  { ar &  (L->getRowMajor(i)); }  // and then deserializes
             }
 
 
@@ -1400,11 +3020,13 @@ namespace mtools
                 {
                 MTOOLS_ASSERT(father->rad == R);
                 _pleaf p = _poolLeaf.allocate();
+                p->dirty = 1;
+                p->cowgen = _cowgen;
                 ar & p->center;
                 ar & p->rad;
                 MTOOLS_ASSERT(p->rad == 1);
                 p->father = father;
-                _reconstructLeaf(ar, p->data, p->center, metaprog::dummy< std::is_constructible<T, IBaseArchive>::value>());
+                _reconstructLeaf(ar, p, p->center, metaprog::dummy< std::is_constructible<T, IBaseArchive>::value>());
                 return p;
                 }
             if (c == 'N')
@@ -1421,15 +3043,37 @@ namespace mtools
             }
 
 
-        /* Release all the allocated  memory and reset the tree */
-        void _destroyTree()
+        /* Release all the allocated  memory and reset the tree. The objects are not visited when T
+           is trivially destructible (or callDtors is not set): the blocks of the pools are released
+           at once and kept for reuse unless releaseMemory is set. */
+        void _destroyTree(bool releaseMemory = false)
             {
+            _changes.all();
+            _snap.reset();
+            if (_snaplink != nullptr)
+                { // invalidate the snapshots
+                std::lock_guard<std::mutex> lock(_snaplink->mut);
+                _snaplink->treegen++;
+                _snaplink->garbage.clear();
+                _snaplink->hasGarbage = false;
+                }
+            _deltaFull = true;
+            _generation++;
             _pcurrentpeek = nullptr;
             _pcurrent = nullptr;
             _rangemin.clear(std::numeric_limits<int64>::max());
             _rangemax.clear(std::numeric_limits<int64>::min());
-            _poolNode.deallocateAll();
-            if (_callDtors) { _poolLeaf.destroyAndDeallocateAll(); } else { _poolLeaf.deallocateAll(); }
+            _poolNode.deallocateAll(releaseMemory);
+            if ((_callDtors) && (!std::is_trivially_destructible<T>::value))
+                {
+                _poolLeaf.destroyAndDeallocateAll(releaseMemory);
+                _poolSparse0.destroyAndDeallocateAll(releaseMemory); _poolSparse1.destroyAndDeallocateAll(releaseMemory); _poolSparse2.destroyAndDeallocateAll(releaseMemory);
+                }
+            else
+                { // nothing to destroy: O(1)
+                _poolLeaf.deallocateAll(releaseMemory);
+                _poolSparse0.deallocateAll(releaseMemory); _poolSparse1.deallocateAll(releaseMemory); _poolSparse2.deallocateAll(releaseMemory);
+                }
             return;
             }
 
@@ -1440,9 +3084,18 @@ namespace mtools
         _pbox _copy(_pbox pg, _pbox pere)
             {
             if (pg == nullptr) { return nullptr; }
+            if (pg->isSparse())
+                {
+                _psparse S = (_psparse)pg;
+                _psparse p = _allocateSparseLeaf(pere, S->center, S->tier);
+                for (size_t k = 0; k < S->nb; ++k) { new(p->obj(k)) T(*(S->obj(k))); p->publish(S->keyTab()[k]); }
+                return p;
+                }
             if (pg->isLeaf())
                 {
                 _pleaf p = _poolLeaf.allocate();
+                p->dirty = 1;
+                p->cowgen = _cowgen;
                 p->center = pg->center;
                 p->rad = pg->rad;
                 p->father = pere;
@@ -1459,13 +3112,13 @@ namespace mtools
 
 
         /* create the data for an elementary sub box using the T(const Pos & v) version */
-        inline void _createDataLeaf(T * data, Pos pos, metaprog::dummy<true> dum) const
+        inline void _createDataLeaf(_pleaf L, Pos pos, metaprog::dummy<true> dum) const
             {
             Pos center = pos;
             for (size_t i = 0; i < D; ++i) { pos[i] -= R; }
             for (size_t x = 0; x < metaprog::power<(2 * R + 1), D>::value; ++x)
                 {
-                new(data + x) T(pos);
+                new(L->ptrRowMajor(x)) T(pos);
                 for (size_t i = 0; i < D; ++i)
                     {
                     if (pos[i] < (center[i] + (int64)R)) { pos[i]++;  break; }
@@ -1476,17 +3129,34 @@ namespace mtools
 
 
         /* create the data for an elementary sub box using the default T() version */
-        inline void _createDataLeaf(T * data, Pos pos, metaprog::dummy<false> dum) const { for (size_t i = 0; i < metaprog::power<(2 * R + 1), D>::value; ++i) { new(data + i) T(); } }
+        inline void _createDataLeaf(_pleaf L, Pos pos, metaprog::dummy<false> dum) const { for (size_t i = 0; i < metaprog::power<(2 * R + 1), D>::value; ++i) { new(L->data + i) T(); } }
 
 
         /* Allocate a leaf, call constructor from above with default initialization (ie either T() or T(Pos) */
         inline _pleaf _allocateLeaf(_pbox above, const Pos & centerpos) const
             {
+            MTOOLS_PROF_COUNT("Grid_basic::leaf allocated", 1);
             _pleaf p = _poolLeaf.allocate();
-            _createDataLeaf(p->data, centerpos, metaprog::dummy<std::is_constructible<T,Pos>::value>());
+            p->dirty = 1;
+            p->cowgen = _cowgen;
+            _createDataLeaf(p, centerpos, metaprog::dummy<std::is_constructible<T,Pos>::value>());
             p->center = centerpos;
             p->rad = 1;
             p->father = above;
+            std::atomic_thread_fence(std::memory_order_release); // the leaf is complete before a snapshot can see it
+            return p;
+            }
+
+
+        /* Allocate an empty sparse leaf of a given tier */
+        inline _psparse _allocateSparseLeaf(_pbox above, const Pos & centerpos, size_t tier) const
+            {
+            MTOOLS_PROF_COUNT("Grid_basic::sparse leaf allocated", 1);
+            _psparse p = ((tier == 0) ? _poolSparse0.allocate() : ((tier == 1) ? _poolSparse1.allocate() : _poolSparse2.allocate()));
+            p->init(tier);
+            p->center = centerpos;
+            p->rad = 0;
+            p->father = above;
             return p;
             }
 
@@ -1495,6 +3165,7 @@ namespace mtools
         inline void _createBaseNode()
             {
             MTOOLS_ASSERT(_pcurrent == (_pbox)nullptr);   // should only be called when the tree dos not exist.
+            _deltaFull = true;
             _pnode p = _poolNode.allocate();
             for (size_t i = 0; i < metaprog::power<3, D>::value; ++i) { p->tab[i] = nullptr; }
             p->center = Pos(0);
@@ -1531,14 +3202,85 @@ namespace mtools
             }
 
 
+        /* state shared by the grid and its snapshots */
+        struct _SnapLink
+            {
+            _SnapLink() : treegen(0), hasGarbage(false) {}
+
+            std::mutex mut;                 // protects garbage
+            std::atomic<uint64> treegen;    // incremented each time the tree is destroyed
+            std::atomic<bool> hasGarbage;   // true if garbage is not empty
+            std::vector<_pleaf> garbage;    // old versions of leafs released by the snapshots, freed by the grid
+            };
+
+
+        /* a snapshot: the root of the tree at the time of the snapshot together with the old versions of
+         * the leafs replaced during the following generation (i.e. until the next snapshot) */
+        struct _SnapData
+            {
+            ~_SnapData()
+                {
+                std::lock_guard<std::mutex> lock(link->mut);
+                if (link->treegen.load() != treegen) return; // the tree was destroyed with its leafs
+                for (auto & P : preserved) { link->garbage.push_back(P.second.second); }
+                if (link->garbage.size() > 0) { link->hasGarbage = true; }
+                }
+
+            /* return the version, at the time of the snapshot, of the leaf whose slot in the tree is slot
+             * and currently contains L, or nullptr if the leaf did not exist then */
+            _pleaf resolve(const void * slot, _pleaf L) const
+                {
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (L->cowgen <= gen) return L;
+                for (const _SnapData * S = this; S != nullptr; )
+                    { // the first old version found in this snapshot or a newer one is the one we want
+                    std::lock_guard<std::mutex> lock(S->mut);
+                    auto it = S->preserved.find(slot);
+                    if (it != S->preserved.end()) { return ((it->second.first <= gen) ? it->second.second : nullptr); }
+                    S = S->next.get();
+                    }
+                return nullptr;
+                }
+
+            std::shared_ptr<_SnapLink> link;    // shared with the grid
+            uint64 treegen;                     // link->treegen when the snapshot was taken
+            uint64 gen;                         // leafs with cowgen <= gen are seen by the snapshot
+            _pnode root;                        // root of the tree
+            Pos rangemin, rangemax;             // range of the grid
+            bool callDtors;                     // callDtors flag of the grid
+            mutable std::mutex mut;             // protects preserved and next
+            std::unordered_map<const void*, std::pair<uint64, _pleaf> > preserved;  // slot -> (cowgen, old version) of the leafs replaced
+            std::shared_ptr<_SnapData> next;    // the next snapshot (if it was taken while this one was alive)
+            };
+
+
+        static const uint64 _COW_RETIRED = ((uint64)-1);   // cowgen of a leaf replaced in the tree by its copy
+
         mutable std::atomic<_pbox> _pcurrent;        // pointer to the current box
         mutable std::atomic<_pbox> _pcurrentpeek;    // pointer to the current box for peek operations
+        std::atomic<uint64> _generation{ 0 };        // incremented each time the tree is destroyed (invalidates the cursors)
         mutable Pos   _rangemin;        // the minimal range
         mutable Pos   _rangemax;        // the maximal range
         bool _callDtors;                // should we call the destructors
+        bool _deltaFull;                // true if the next delta must contain the whole grid
+        internals_grid::_journal<D, R> _changes; // journal of the modified leafs
+        bool _sparse;                   // true if new leafs are created sparse
+        uint64 _cowgen{ 0 };            // current generation: incremented by snapshot(), leafs from an older generation are copied on write
+        std::shared_ptr<_SnapData> _snap;       // the last snapshot taken
+        std::shared_ptr<_SnapLink> _snaplink;   // state shared with the snapshots (created with the first snapshot)
+
+        std::vector<std::pair<uint64, size_t> > _sortbuf;   // buffer used by getMany() and setMany()
+
+#if (MTOOLS_USE_PROFILING)
+        mutable std::atomic<uint64> _statGets{ 0 };  // number of calls to _getFrom()
+        mutable std::atomic<uint64> _statHits{ 0 };  // number of calls resolved by the current box
+#endif
 
-        mutable SingleObjectAllocator<internals_grid::_leaf<D, T, R> >  _poolLeaf;       // the two memory pools
+        mutable SingleObjectAllocator<internals_grid::_leaf<D, T, R, LAYOUT> >  _poolLeaf;       // the two memory pools
         mutable SingleObjectAllocator<internals_grid::_node<D, T, R> >  _poolNode;       //
+        mutable SingleObjectAllocator<_sparseLeaf, _sparseLeaf::template bytes<0>::val >  _poolSparse0;   // pools for the
+        mutable SingleObjectAllocator<_sparseLeaf, _sparseLeaf::template bytes<1>::val >  _poolSparse1;   // three tiers of
+        mutable SingleObjectAllocator<_sparseLeaf, _sparseLeaf::template bytes<2>::val >  _poolSparse2;   // sparse leafs
 
     };
 
@@ -1554,7 +3296,7 @@ namespace mtools
 {
 
 
-    template<size_t D, typename T, size_t R> template<size_t NB_SPECIAL> Grid_basic<D, T, R> & Grid_basic<D, T, R>::operator=(const Grid_factor<D, T, NB_SPECIAL, R> & G)
+    template<size_t D, typename T, size_t R, typename LAYOUT> template<size_t NB_SPECIAL> Grid_basic<D, T, R, LAYOUT> & Grid_basic<D, T, R, LAYOUT>::operator=(const Grid_factor<D, T, NB_SPECIAL, R, LAYOUT> & G)
         {
         static_assert(std::is_copy_constructible<T>::value, "The object T must be copy constructible T(const T&) in order to use assignement operator= on the grid.");
         MTOOLS_INSURE(G._specialRange() <= 0); // there must not be any special objects. 
@@ -0,0 +1,596 @@
+/** @file grid_distributed.hpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+
+#include "../mtools_config.hpp"
+#include "../misc/internal/mtools_export.hpp"
+#include "../misc/misc.hpp"
+#include "../misc/error.hpp"
+#include "../maths/vec.hpp"
+#include "../maths/box.hpp"
+#include "grid_basic.hpp"
+
+#include <type_traits>
+#include <vector>
+#include <array>
+#include <functional>
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <condition_variable>
+#include <limits>
+
+#if (MTOOLS_USE_MPI)
+#include <mpi.h>
+#endif
+
+
+namespace mtools
+{
+
+
+    /**
+     * Communication layer used by Grid_distributed. Each participant (a 'rank') owns an object
+     * implementing this interface. All the methods are collective: every rank of the group must
+     * call them, in the same order.
+     *
+     * Two implementations are provided: ThreadGridComm (the ranks are threads of the same process)
+     * and MPIGridComm (the ranks are MPI processes, only available when mtools is built with
+     * USE_MPI).
+     **/
+    class GridComm
+    {
+
+    public:
+
+        /** Reduction operations for allreduce(). */
+        enum { OP_MIN = 0, OP_MAX = 1, OP_SUM = 2 };
+
+        virtual ~GridComm() {}
+
+        /** Index of this rank in [0, size()). */
+        virtual int rank() const = 0;
+
+        /** Number of ranks in the group. */
+        virtual int size() const = 0;
+
+        /**
+         * Personalized all-to-all exchange: send[r] is sent to rank r and, when the method returns,
+         * recv[r] contains the buffer sent by rank r to this rank. Both vectors have size() elements
+         * (recv is resized if needed). The send buffers may be emptied.
+         **/
+        virtual void alltoall(std::vector< std::vector<char> > & send, std::vector< std::vector<char> > & recv) = 0;
+
+        /** In place reduction of data[0..n-1] over all the ranks (op = OP_MIN, OP_MAX or OP_SUM). */
+        virtual void allreduce(int64 * data, size_t n, int op) = 0;
+
+        /** Wait until all the ranks reach the barrier. */
+        virtual void barrier() = 0;
+
+    };
+
+
+    /**
+     * GridComm between the threads of a single process. The threads share a Group object and each
+     * one constructs its own ThreadGridComm with its rank. Useful to run a distributed simulation
+     * on a single machine, and to test it without MPI.
+     *
+     * @code
+     * ThreadGridComm::Group group(4);
+     * std::vector<std::thread> th;
+     * for (int r = 0; r < 4; r++) th.emplace_back([&group, r]() { ThreadGridComm comm(group, r); simulate(comm); });
+     * for (auto & t : th) t.join();
+     * @endcode
+     **/
+    class ThreadGridComm : public GridComm
+    {
+
+    public:
+
+        /** State shared by the threads of a group. */
+        class Group
+        {
+        public:
+
+            /** Group of n threads. */
+            Group(int n) : _n(n), _count(0), _phase(0), _box((size_t)n, std::vector< std::vector<char> >((size_t)n)), _red((size_t)n)
+                {
+                MTOOLS_INSURE(n > 0);
+                }
+
+        private:
+
+            friend class ThreadGridComm;
+
+            void _barrier()
+                {
+                std::unique_lock<std::mutex> lock(_mut);
+                const uint64 ph = _phase;
+                if (++_count == _n) { _count = 0; _phase++; _cv.notify_all(); return; }
+                _cv.wait(lock, [&]() { return (_phase != ph); });
+                }
+
+            int                         _n;         // number of threads
+            int                         _count;     // number of threads waiting at the barrier
+            uint64                      _phase;     // number of barriers completed
+            std::mutex                  _mut;
+            std::condition_variable     _cv;
+            std::vector< std::vector< std::vector<char> > > _box;   // _box[dest][src]: buffer from src to dest
+            std::vector< std::vector<int64> >               _red;   // _red[r]: reduction input of rank r
+
+            Group(const Group &) = delete;
+            Group & operator=(const Group &) = delete;
+        };
+
+
+        /** Constructor. rank must be in [0, group size) and used by a single thread. */
+        ThreadGridComm(Group & group, int rank) : _g(group), _rank(rank)
+            {
+            MTOOLS_INSURE((rank >= 0) && (rank < group._n));
+            }
+
+        virtual int rank() const override { return _rank; }
+
+        virtual int size() const override { return _g._n; }
+
+        virtual void alltoall(std::vector< std::vector<char> > & send, std::vector< std::vector<char> > & recv) override
+            {
+            MTOOLS_INSURE(send.size() == (size_t)_g._n);
+            for (int r = 0; r < _g._n; r++) { _g._box[r][_rank] = std::move(send[r]); send[r].clear(); }
+            _g._barrier();
+            recv.resize(_g._n);
+            for (int r = 0; r < _g._n; r++) { recv[r] = std::move(_g._box[_rank][r]); _g._box[_rank][r].clear(); }
+            _g._barrier(); // no one writes the next round before everyone has read this one
+            }
+
+        virtual void allreduce(int64 * data, size_t n, int op) override
+            {
+            _g._red[_rank].assign(data, data + n);
+            _g._barrier();
+            for (int r = 0; r < _g._n; r++)
+                {
+                if (r == _rank) continue;
+                const std::vector<int64> & v = _g._red[r];
+                MTOOLS_INSURE(v.size() == n);
+                for (size_t i = 0; i < n; i++)
+                    {
+                    switch (op)
+                        {
+                        case OP_MIN: data[i] = std::min<int64>(data[i], v[i]); break;
+                        case OP_MAX: data[i] = std::max<int64>(data[i], v[i]); break;
+                        default: data[i] += v[i]; break;
+                        }
+                    }
+                }
+            _g._barrier();
+            }
+
+        virtual void barrier() override { _g._barrier(); }
+
+    private:
+
+        Group & _g;
+        int     _rank;
+
+    };
+
+
+#if (MTOOLS_USE_MPI)
+
+    /**
+     * GridComm over an MPI communicator (MPI must be initialized by the caller). The buffers
+     * exchanged by a rank in a single alltoall() call must be smaller than 2GB.
+     **/
+    class MPIGridComm : public GridComm
+    {
+
+    public:
+
+        /** Constructor. */
+        MPIGridComm(MPI_Comm comm = MPI_COMM_WORLD) : _comm(comm)
+            {
+            MPI_Comm_rank(_comm, &_rank);
+            MPI_Comm_size(_comm, &_size);
+            }
+
+        virtual int rank() const override { return _rank; }
+
+        virtual int size() const override { return _size; }
+
+        virtual void alltoall(std::vector< std::vector<char> > & send, std::vector< std::vector<char> > & recv) override
+            {
+            MTOOLS_INSURE(send.size() == (size_t)_size);
+            std::vector<int> scount(_size), sdispl(_size), rcount(_size), rdispl(_size);
+            size_t stot = 0;
+            for (int r = 0; r < _size; r++) { scount[r] = (int)send[r].size(); sdispl[r] = (int)stot; stot += send[r].size(); }
+            MTOOLS_INSURE(stot < (size_t)std::numeric_limits<int>::max());
+            MPI_Alltoall(scount.data(), 1, MPI_INT, rcount.data(), 1, MPI_INT, _comm);
+            size_t rtot = 0;
+            for (int r = 0; r < _size; r++) { rdispl[r] = (int)rtot; rtot += (size_t)rcount[r]; }
+            MTOOLS_INSURE(rtot < (size_t)std::numeric_limits<int>::max());
+            std::vector<char> sbuf(stot + 1), rbuf(rtot + 1);
+            for (int r = 0; r < _size; r++) { if (scount[r] > 0) std::memcpy(sbuf.data() + sdispl[r], send[r].data(), send[r].size()); send[r].clear(); }
+            MPI_Alltoallv(sbuf.data(), scount.data(), sdispl.data(), MPI_CHAR, rbuf.data(), rcount.data(), rdispl.data(), MPI_CHAR, _comm);
+            recv.resize(_size);
+            for (int r = 0; r < _size; r++) { recv[r].assign(rbuf.data() + rdispl[r], rbuf.data() + rdispl[r] + rcount[r]); }
+            }
+
+        virtual void allreduce(int64 * data, size_t n, int op) override
+            {
+            const MPI_Op mop = (op == OP_MIN) ? MPI_MIN : ((op == OP_MAX) ? MPI_MAX : MPI_SUM);
+            MPI_Allreduce(MPI_IN_PLACE, data, (int)n, MPI_INT64_T, mop, _comm);
+            }
+
+        virtual void barrier() override { MPI_Barrier(_comm); }
+
+    private:
+
+        MPI_Comm    _comm;
+        int         _rank;
+        int         _size;
+
+    };
+
+#endif
+
+
+    /**
+     * A D-dimensional grid distributed over several ranks (threads or MPI processes, see GridComm).
+     *
+     * Z^D is partitioned into blocks [k*B, (k+1)*B - 1]^D of side B and each block is owned by a
+     * single rank (by default, the owner is a hash of the block coordinates, so the load is spread
+     * evenly whatever the shape of the region explored). Each rank stores the sites it owns in a
+     * local Grid_basic and may only modify those sites.
+     *
+     * - Halo: the sites at distance at most H (for the infinity norm) of a block owned by another
+     * rank are copied to that rank by exchangeHalo(). After the exchange, peek() on a rank returns
+     * the value of any site it owns and of any site of its halo (the value at the time of the last
+     * exchange). Only the sites modified through set() or get() since the previous exchange are
+     * sent.
+     *
+     * - Migration: migrate() sends each object of a vector (a walker...) to the rank owning its
+     * position.
+     *
+     * - findFullBox(): collective version of Grid_basic::findFullBox(), the box returned is empty on
+     * every rank.
+     *
+     * The methods exchangeHalo(), migrate(), findFullBox() and sync() are collective: all the ranks
+     * must call them in the same order. The other methods are local.
+     *
+     * Choose B as a multiple of 2R+1 so that the leafs of the local grids do not overlap the blocks
+     * of other ranks (otherwise a leaf allocates sites which belong to other ranks).
+     *
+     * @tparam  D   Dimension of the grid Z^D.
+     * @tparam  T   Type of objects stored in the sites. Must be trivially copyable (it is sent to the
+     *              other ranks as raw bytes).
+     * @tparam  R   Radius of an elementary box of the local Grid_basic.
+     * @tparam  LAYOUT  Memory layout of the local Grid_basic.
+     **/
+    template<size_t D, typename T, size_t R = internals_grid::defaultR<D>::val, typename LAYOUT = GridLayout_rowMajor> class Grid_distributed
+    {
+
+        static_assert(std::is_trivially_copyable<T>::value, "Grid_distributed: T must be trivially copyable");
+
+    public:
+
+        /** Position in the grid. */
+        typedef iVec<D> Pos;
+
+        /** The local grid type. */
+        typedef Grid_basic<D, T, R, LAYOUT> LocalGrid;
+
+
+        /**
+         * Constructor.
+         *
+         * @param [in,out]  comm    The communicator (must outlive the object).
+         * @param   blockSide       Side B of the blocks.
+         * @param   halo            Width H of the halo (0 <= H <= B).
+         * @param   blockOwner      Optional function returning the rank owning the block with given
+         *                          block coordinates (the block k contains the sites [k*B,(k+1)*B-1]).
+         *                          It must return the same value on every rank. By default, a hash
+         *                          of the block coordinates.
+         **/
+        Grid_distributed(GridComm & comm, int64 blockSide, int64 halo = 1, std::function<int(const Pos &)> blockOwner = nullptr) :
+            _comm(comm), _rank(comm.rank()), _nbranks(comm.size()), _B(blockSide), _H(halo), _blockOwner(blockOwner), _G(false)
+            {
+            MTOOLS_INSURE(_B > 0);
+            MTOOLS_INSURE((_H >= 0) && (_H <= _B));
+            }
+
+
+        /** The communicator. */
+        GridComm & comm() const { return _comm; }
+
+
+        /** Rank of this participant. */
+        int rank() const { return _rank; }
+
+
+        /** Number of ranks. */
+        int nbRanks() const { return _nbranks; }
+
+
+        /** Side of the blocks. */
+        int64 blockSide() const { return _B; }
+
+
+        /** Width of the halo. */
+        int64 haloWidth() const { return _H; }
+
+
+        /**
+         * The local grid. It contains the sites owned by this rank and the halo copies. Modifying it
+         * directly bypasses the halo bookkeeping.
+         **/
+        LocalGrid & localGrid() { return _G; }
+        const LocalGrid & localGrid() const { return _G; }
+
+
+        /** Coordinates of the block containing pos. */
+        inline Pos block(const Pos & pos) const
+            {
+            Pos b;
+            for (size_t i = 0; i < D; i++) { b[i] = _floorDiv(pos[i]); }
+            return b;
+            }
+
+
+        /** Rank owning the block with coordinates b. */
+        inline int blockOwner(const Pos & b) const
+            {
+            if (_blockOwner) { const int r = _blockOwner(b); MTOOLS_ASSERT((r >= 0) && (r < _nbranks)); return r; }
+            uint64 h = 0x9E3779B97F4A7C15ULL;
+            for (size_t i = 0; i < D; i++)
+                {
+                h ^= (uint64)b[i] + 0x9E3779B97F4A7C15ULL + (h << 6) + (h >> 2);
+                h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ULL;
+                h = (h ^ (h >> 27)) * 0x94D049BB133111EBULL;
+                h ^= (h >> 31);
+                }
+            return (int)(h % (uint64)_nbranks);
+            }
+
+
+        /** Rank owning site pos. */
+        inline int owner(const Pos & pos) const { return blockOwner(block(pos)); }
+
+
+        /** Query whether site pos is owned by this rank. */
+        inline bool isLocal(const Pos & pos) const { return (owner(pos) == _rank); }
+
+
+        /**
+         * Set the value of a site owned by this rank.
+         **/
+        inline void set(const Pos & pos, const T & val)
+            {
+            MTOOLS_ASSERT(isLocal(pos));
+            _touch(pos);
+            _G.set(pos, val);
+            }
+
+
+        /**
+         * Reference to a site owned by this rank. The site is sent at the next halo exchange (if it is
+         * in the halo of another rank) whether it is modified or not.
+         **/
+        inline T & get(const Pos & pos)
+            {
+            MTOOLS_ASSERT(isLocal(pos));
+            _touch(pos);
+            return _G.get(pos);
+            }
+
+
+        /**
+         * Value of a site owned by this rank or in its halo (as of the last exchangeHalo()). Return
+         * nullptr if the site does not exist in the local grid. The value of a site which is neither
+         * owned nor in the halo is meaningless.
+         **/
+        inline const T * peek(const Pos & pos) const { return _G.peek(pos); }
+
+
+        /**
+         * Send the sites modified since the last call to the ranks having them in their halo, and
+         * receive the ones of the other ranks. Collective.
+         *
+         * @return  The number of sites received.
+         **/
+        size_t exchangeHalo()
+            {
+            std::vector< std::vector<char> > send((size_t)_nbranks), recv;
+            std::sort(_modified.begin(), _modified.end());
+            _modified.erase(std::unique(_modified.begin(), _modified.end()), _modified.end());
+            std::vector<int> dests;
+            for (const auto & c : _modified)
+                {
+                dests.clear();
+                Pos pos, bmin, bmax, b;
+                for (size_t i = 0; i < D; i++) { pos[i] = c[i]; }
+                for (size_t i = 0; i < D; i++) { bmin[i] = _floorDiv(pos[i] - _H); bmax[i] = _floorDiv(pos[i] + _H); }
+                b = bmin;
+                while (1)
+                    {
+                    const int r = blockOwner(b);
+                    if ((r != _rank) && (std::find(dests.begin(), dests.end(), r) == dests.end())) dests.push_back(r);
+                    size_t i = 0;
+                    while ((i < D) && (b[i] == bmax[i])) { b[i] = bmin[i]; i++; }
+                    if (i == D) break;
+                    b[i]++;
+                    }
+                const T * pv = _G.peek(pos);
+                MTOOLS_ASSERT(pv != nullptr);
+                for (int r : dests) { _append(send[r], pos, *pv); }
+                }
+            _modified.clear();
+            _comm.alltoall(send, recv);
+            size_t nb = 0;
+            for (int r = 0; r < _nbranks; r++)
+                {
+                const std::vector<char> & buf = recv[r];
+                MTOOLS_INSURE(buf.size() % _SITESIZE == 0);
+                for (size_t off = 0; off < buf.size(); off += _SITESIZE)
+                    {
+                    Pos pos;
+                    int64 c[D];
+                    std::memcpy(c, buf.data() + off, sizeof(c));
+                    for (size_t i = 0; i < D; i++) { pos[i] = c[i]; }
+                    std::memcpy(&_G.get(pos), buf.data() + off + sizeof(c), sizeof(T));
+                    nb++;
+                    }
+                }
+            return nb;
+            }
+
+
+        /**
+         * Send each object of a vector to the rank owning its position. The objects owned by another
+         * rank are removed from the vector and the objects received are appended to it. Collective.
+         *
+         * @param [in,out]  objs    The objects (W must be trivially copyable).
+         * @param   posOf           Function object returning the position (a Pos) of an object.
+         *
+         * @return  The number of objects received.
+         **/
+        template<typename W, typename POSFUN> size_t migrate(std::vector<W> & objs, POSFUN posOf)
+            {
+            static_assert(std::is_trivially_copyable<W>::value, "Grid_distributed::migrate: W must be trivially copyable");
+            std::vector< std::vector<char> > send((size_t)_nbranks), recv;
+            size_t k = 0;
+            for (size_t j = 0; j < objs.size(); j++)
+                {
+                const int r = owner(posOf((const W &)objs[j]));
+                if (r == _rank) { if (k != j) objs[k] = objs[j]; k++; continue; }
+                std::vector<char> & buf = send[r];
+                const size_t off = buf.size();
+                buf.resize(off + sizeof(W));
+                std::memcpy(buf.data() + off, &objs[j], sizeof(W));
+                }
+            objs.resize(k);
+            _comm.alltoall(send, recv);
+            size_t nb = 0;
+            for (int r = 0; r < _nbranks; r++)
+                {
+                const std::vector<char> & buf = recv[r];
+                MTOOLS_INSURE(buf.size() % sizeof(W) == 0);
+                const size_t n = buf.size() / sizeof(W);
+                const size_t old = objs.size();
+                objs.resize(old + n);
+                if (n > 0) std::memcpy(&objs[old], buf.data(), buf.size());
+                nb += n;
+                }
+            return nb;
+            }
+
+
+        /**
+         * Collective version of Grid_basic::findFullBox(): find a box containing pos such that no
+         * site of the box (except pos itself) exists in the local grid of any rank. Every rank must
+         * call the method with the same pos and obtains the same box.
+         *
+         * @param   pos             The position.
+         * @param [in,out]  outBox  The box (the singleton pos if the site exists on some rank).
+         *
+         * @return  true if the site pos exists in the local grid of some rank.
+         **/
+        bool findFullBox(const Pos & pos, iBox<D> & outBox)
+            {
+            const T * pv = _G.findFullBox(pos, outBox);
+            int64 lo[D + 1], hi[D + 1];
+            for (size_t i = 0; i < D; i++) { lo[i] = outBox.min[i]; hi[i] = outBox.max[i]; }
+            lo[D] = ((pv != nullptr) ? 1 : 0);
+            hi[D] = 0;
+            _comm.allreduce(lo, D + 1, GridComm::OP_MAX);
+            _comm.allreduce(hi, D, GridComm::OP_MIN);
+            for (size_t i = 0; i < D; i++) { outBox.min[i] = lo[i]; outBox.max[i] = hi[i]; }
+            return (lo[D] != 0);
+            }
+
+
+        /**
+         * Sum of v over all the ranks (e.g. to count the walkers left). Collective.
+         **/
+        int64 sum(int64 v)
+            {
+            _comm.allreduce(&v, 1, GridComm::OP_SUM);
+            return v;
+            }
+
+
+        /** Wait for all the ranks. Collective. */
+        void sync() { _comm.barrier(); }
+
+
+    private:
+
+        static const size_t _SITESIZE = D*sizeof(int64) + sizeof(T);   // size of a site in a halo buffer
+
+        /* floor(x / B) */
+        inline int64 _floorDiv(int64 x) const { return (x >= 0) ? (x / _B) : (-((-x - 1) / _B) - 1); }
+
+        /* record pos if it belongs to the halo of another block */
+        inline void _touch(const Pos & pos)
+            {
+            if (_H == 0) return;
+            for (size_t i = 0; i < D; i++)
+                {
+                const int64 off = pos[i] - _floorDiv(pos[i])*_B;
+                if ((off < _H) || (off >= _B - _H))
+                    {
+                    std::array<int64, D> c;
+                    for (size_t j = 0; j < D; j++) { c[j] = pos[j]; }
+                    _modified.push_back(c);
+                    return;
+                    }
+                }
+            }
+
+        /* append a site to a halo buffer */
+        static void _append(std::vector<char> & buf, const Pos & pos, const T & val)
+            {
+            const size_t off = buf.size();
+            buf.resize(off + _SITESIZE);
+            int64 c[D];
+            for (size_t i = 0; i < D; i++) { c[i] = pos[i]; }
+            std::memcpy(buf.data() + off, c, sizeof(c));
+            std::memcpy(buf.data() + off + sizeof(c), &val, sizeof(T));
+            }
+
+        GridComm &                          _comm;
+        int                                 _rank;
+        int                                 _nbranks;
+        int64                               _B;             // side of the blocks
+        int64                               _H;             // width of the halo
+        std::function<int(const Pos &)>     _blockOwner;    // owner of a block (or empty for the hash)
+        LocalGrid                           _G;             // sites owned and halo copies
+        std::vector< std::array<int64, D> > _modified;      // sites near a block boundary modified since the last exchange
+
+        Grid_distributed(const Grid_distributed &) = delete;
+        Grid_distributed & operator=(const Grid_distributed &) = delete;
+    };
+
+
+}
+
+
+/* end of file */
@@ -21,28 +21,36 @@
 #pragma once
 
 
+#include "../mtools_config.hpp"
 #include "../misc/internal/mtools_export.hpp"
 #include "../misc/misc.hpp"
 #include "../maths/vec.hpp"
 #include "../maths/box.hpp"
 #include "../misc/metaprog.hpp"
 #include "../io/serialization.hpp"
+#include "../misc/memory.hpp"
+#include "../misc/internal/threadworker.hpp"
 #include "internal/internals_grid.hpp"
 
 #include <type_traits>
 #include <string>
+#include <cstdio>
 #include <fstream>
 #include <list>
 #include <vector>
 #include <atomic>
 #include <mutex>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <algorithm>
 
 namespace mtools
 {
 
 
     /* forward declaration of the Grid_basic class*/
-    template< size_t D, typename T, size_t R> class Grid_basic;
+    template< size_t D, typename T, size_t R, typename LAYOUT> class Grid_basic;
 
 
     /**
@@ -106,19 +114,22 @@ namespace mtools
      *                      | 3         | 20
      *                      | 4         | 6
      *                      | >= 5      | 1.
+     * @tparam  LAYOUT      Memory layout of the cells inside an elementary box (GridLayout_rowMajor
+     *                      or GridLayout_tiled<B>). See Grid_basic. The layout does not change the
+     *                      file format but conversions between grids require the same layout.
      *
      * @sa  Grid_basic
      **/
-    template < size_t D, typename T, size_t NB_SPECIAL = 256 , size_t R = internals_grid::defaultR<D>::val > class Grid_factor
+    template < size_t D, typename T, size_t NB_SPECIAL = 256 , size_t R = internals_grid::defaultR<D>::val, typename LAYOUT = GridLayout_rowMajor > class Grid_factor
     {
 
-        template<size_t D2, typename T2, size_t NB_SPECIAL2, size_t R2> friend class Grid_factor;
-        template<size_t D2, typename T2, size_t R2> friend class Grid_basic;
+        template<size_t D2, typename T2, size_t NB_SPECIAL2, size_t R2, typename LAYOUT2> friend class Grid_factor;
+        template<size_t D2, typename T2, size_t R2, typename LAYOUT2> friend class Grid_basic;
 
 
         typedef internals_grid::_box<D, T, R> *     _pbox;
         typedef internals_grid::_node<D, T, R> *    _pnode;
-        typedef internals_grid::_leafFactor<D, T, NB_SPECIAL, R> *    _pleafFactor;
+        typedef internals_grid::_leafFactor<D, T, NB_SPECIAL, R, LAYOUT> *    _pleafFactor;
 
     public:
 
@@ -136,7 +147,7 @@ namespace mtools
          * @param   maxSpecial  The maximum value of the special objects.
          * @param   callDtors   true to call the destructors of the T objects when destroyed.
          **/
-        Grid_factor(int64 minSpecial = 0, int64 maxSpecial = -1, bool callDtors = true) : _psafeT(nullptr)
+        Grid_factor(int64 minSpecial = 0, int64 maxSpecial = -1, bool callDtors = true) : _psafeT(nullptr), _leafIndexTick(0), _bgActive(false), _bgStop(false), _bgEpoch(0), _bgNbFactorized(0)
             {
             reset(minSpecial, maxSpecial, callDtors);
             }
@@ -147,7 +158,7 @@ namespace mtools
          *
          * @param   filename    Filename of the file.
          **/
-        Grid_factor(const std::string & filename) : _psafeT(nullptr)
+        Grid_factor(const std::string & filename) : _psafeT(nullptr), _leafIndexTick(0), _bgActive(false), _bgStop(false), _bgEpoch(0), _bgNbFactorized(0)
             { 
             reset(0,-1,true);
             load(filename);
@@ -163,7 +174,7 @@ namespace mtools
          * Destructor. Destroys the grid. The destructors of all the T objects in the grid are invoqued
          * if the callDtor flag is set and are dropped into oblivion otherwise.
          **/
-        ~Grid_factor() { _reset(); if (_callDtors) { delete _psafeT; } }
+        ~Grid_factor() { stopBackgroundFactorization(); _reset(); if (_callDtors) { delete _psafeT; } }
 
 
         /**
@@ -177,7 +188,7 @@ namespace mtools
          * @tparam  NB_SPECIAL2 the template paramter for the max number of special object of the source.
          * @param   G   the source Grid_factor to copy.
          **/
-        template<size_t NB_SPECIAL2> Grid_factor(const Grid_factor<D, T, NB_SPECIAL2, R> & G) : _psafeT(nullptr)
+        template<size_t NB_SPECIAL2> Grid_factor(const Grid_factor<D, T, NB_SPECIAL2, R, LAYOUT> & G) : _psafeT(nullptr), _leafIndexTick(0), _bgActive(false), _bgStop(false), _bgEpoch(0), _bgNbFactorized(0)
             {
             MTOOLS_INSURE(((!G._existSpecial()) || (G._specialRange()<= NB_SPECIAL))); // make sure we can hold all the special element of the source.
             reset(0, -1, true);
@@ -194,7 +205,7 @@ namespace mtools
         * 
         * @param   G   the source Grid_factor to copy.
         **/
-        Grid_factor(const Grid_factor<D, T, NB_SPECIAL, R> & G) : _psafeT(nullptr)
+        Grid_factor(const Grid_factor<D, T, NB_SPECIAL, R, LAYOUT> & G) : _psafeT(nullptr), _leafIndexTick(0), _bgActive(false), _bgStop(false), _bgEpoch(0), _bgNbFactorized(0)
             {
             reset(0, -1, true);
             this->operator=(G);
@@ -207,7 +218,7 @@ namespace mtools
          *
          * @param   G   The basic_grid to process.
          **/
-        Grid_factor(const Grid_basic<D, T, R> & G) : _psafeT(nullptr)
+        Grid_factor(const Grid_basic<D, T, R, LAYOUT> & G) : _psafeT(nullptr), _leafIndexTick(0), _bgActive(false), _bgStop(false), _bgEpoch(0), _bgNbFactorized(0)
             {
             reset(0, -1, true);
             this->operator=(G);
@@ -232,7 +243,7 @@ namespace mtools
          *
          * @return  the object for chaining.
          **/
-        template<size_t NB_SPECIAL2> Grid_factor<D, T, NB_SPECIAL, R> & operator=(const Grid_factor<D, T, NB_SPECIAL2, R> & G)
+        template<size_t NB_SPECIAL2> Grid_factor<D, T, NB_SPECIAL, R, LAYOUT> & operator=(const Grid_factor<D, T, NB_SPECIAL2, R, LAYOUT> & G)
             {
             std::lock_guard<std::recursive_mutex> lock(_peekmut); // protect from safePeek()
             MTOOLS_INSURE(((!G._existSpecial()) || (G._specialRange() <= NB_SPECIAL))); // make sure we can hold all the special element of the source.
@@ -276,7 +287,7 @@ namespace mtools
          *
          * @return  the object for chaining.
          **/
-        Grid_factor<D, T, NB_SPECIAL, R> & operator=(const Grid_factor<D, T, NB_SPECIAL, R> & G)
+        Grid_factor<D, T, NB_SPECIAL, R, LAYOUT> & operator=(const Grid_factor<D, T, NB_SPECIAL, R, LAYOUT> & G)
             {
             return operator=<NB_SPECIAL>(G);
             }
@@ -293,7 +304,7 @@ namespace mtools
          *
          * @return  the object for chaining.
          **/
-        Grid_factor<D, T, NB_SPECIAL, R> & operator=(const Grid_basic<D, T, R> & G); // definition below to prevent circular inclusion
+        Grid_factor<D, T, NB_SPECIAL, R, LAYOUT> & operator=(const Grid_basic<D, T, R, LAYOUT> & G); // definition below to prevent circular inclusion
 
 
         /**
@@ -326,6 +337,43 @@ namespace mtools
             }
 
 
+        /**
+         * Saves the grid into a compressed file using several threads. The tree is split into
+         * independent subtrees which are serialized and compressed in parallel (see
+         * OParallelFileArchive). The file created is a regular compressed archive which can be opened
+         * with load() by Grid_basic and Grid_factor objects, and faster with loadParallel().
+         * 
+         * The grid must not be modified while this method is running.
+         *
+         * @param   filename    The filename.
+         * @param   nbThreads   Number of threads to use (0 = number of hardware threads).
+         *
+         * @return  true if it succeeds, false if it fails.
+         **/
+        bool saveParallel(const std::string & filename, size_t nbThreads = 0) const
+            {
+            try
+                {
+                if (nbThreads == 0) { nbThreads = (size_t)nbHardwareThreads(); }
+                std::vector<_serialChunk> chunks;
+                _splitTree(chunks, nbThreads);
+                OParallelFileArchive ar(filename, nbThreads);
+                ar.write(chunks.size() + 2, [&](size_t i, OBaseArchive & a)
+                    {
+                    if (i == 0) { _serializeHead(a); return; }
+                    if (i == chunks.size() + 1) { _serializeTail(a); return; }
+                    for (auto & it : chunks[i - 1]) { if (it.second) { _serializeTree(a, it.first); } else { _serializeNodeHead(a, it.first); } }
+                    });
+                }
+            catch (...)
+                {
+                MTOOLS_DEBUG("Error saving Grid_factor object");
+                return false;
+                } // error
+            return true; // ok
+            }
+
+
         /**
          * Loads the given file. The file may have been created by saving either a Grid_basic or a
          * Grid_factor object with same template parameter T, D, R.
@@ -358,6 +406,448 @@ namespace mtools
             }
 
 
+        /**
+         * Loads the given file, decompressing it using several threads (see IParallelFileArchive).
+         * Same as load() but faster for files created with saveParallel(). Any other file accepted by
+         * load() may also be used.
+         *
+         * @param   filename    The filename to load.
+         * @param   nbThreads   Number of threads to use (0 = number of hardware threads).
+         *
+         * @return  true if it succeeds, false if it fails.
+         **/
+        bool loadParallel(const std::string & filename, size_t nbThreads = 0)
+            {
+            try
+                {
+                IParallelFileArchive ar(filename, nbThreads);
+                ar & (*this); // use the deserialize method.
+                }
+            catch (...)
+                {
+                MTOOLS_DEBUG("Error loading Grid_factor object");
+                reset(0, -1, true);
+                return false;
+                } // error
+            return true; // ok
+            }
+
+
+        /**
+         * Saves the grid into a spatially indexed file which can be partially reloaded with loadBox().
+         *
+         * Each leaf (elementary sub-box) is serialized independently (binary archive, objects in
+         * row-major order) and each special sub-box is simply recorded with its value. The file ends
+         * with an index of all these blocks sorted by size and Morton (Z-order) key of their position,
+         * which gives the offset of each leaf in the file. The file is not compressed and it cannot be
+         * opened with load().
+         *
+         * The grid must not be modified while this method is running.
+         *
+         * @param   filename    The filename.
+         *
+         * @return  true if it succeeds, false if it fails (in particular if the grid extends too far
+         *          for the Morton keys: more than 2^(64/D - 1) leafs from the origin in a direction).
+         *
+         * @sa  loadBox
+         **/
+        bool saveIndexed(const std::string & filename) const
+            {
+            FILE * f = nullptr;
+            try
+                {
+                const std::vector<LeafSpan> blocks = leafs();
+                f = fopen(filename.c_str(), "wb");
+                if (f == nullptr) { MTOOLS_THROW("cannot create the file"); }
+                uint64 off = 0;
+                auto write = [&](const void * p, size_t len) { if ((len > 0) && (fwrite(p, 1, len, f) != len)) { MTOOLS_THROW("write error"); } off += len; };
+                internals_grid::_tileIndexFooter footer;
+                    {
+                    OStringArchive ar(true);
+                    _serializeHead(ar);
+                    footer.headoffset = off; footer.headsize = ar.get().size();
+                    write(ar.get().data(), ar.get().size());
+                    }
+                std::vector<internals_grid::_tileIndexEntry> index(blocks.size());
+                for (size_t k = 0; k < blocks.size(); k++)
+                    {
+                    const LeafSpan & L = blocks[k];
+                    internals_grid::_tileIndexEntry & E = index[k];
+                    Pos center;
+                    for (size_t i = 0; i < D; i++) { center[i] = (L.box.min[i] + L.box.max[i]) / 2; }
+                    E.rad = (uint64)((L.box.max[0] - L.box.min[0]) / 2);
+                    if (!internals_grid::_tileMortonKey<D>(center, (int64)E.rad, E.key)) { MTOOLS_THROW("grid too large for the index"); }
+                    if (L.special) { E.offset = (uint64)((int64)(*L.data)); E.size = 0; continue; }
+                    OStringArchive ar(true);
+                    Pos pos = L.box.min;
+                    for (size_t x = 0; x < LeafSpan::SIZE; ++x)
+                        {
+                        ar & L(pos);
+                        for (size_t i = 0; i < D; ++i) { if (pos[i] < L.box.max[i]) { pos[i]++;  break; } pos[i] -= (2 * R); } // row-major order
+                        }
+                    E.offset = off; E.size = ar.get().size();
+                    write(ar.get().data(), ar.get().size());
+                    }
+                std::sort(index.begin(), index.end());
+                const char pad[8] = { 0 };
+                write(pad, (size_t)((8 - (off % 8)) % 8)); // align the index
+                footer.indexoffset = off;
+                footer.nbentries = index.size();
+                footer.magic = internals_grid::_tileIndexFooter::MAGIC;
+                write(index.data(), index.size() * sizeof(internals_grid::_tileIndexEntry));
+                write(&footer, sizeof(footer));
+                const bool ok = (fclose(f) == 0);
+                f = nullptr;
+                if (!ok) { MTOOLS_THROW("error closing the file"); }
+                }
+            catch (...)
+                {
+                if (f != nullptr) { fclose(f); }
+                MTOOLS_DEBUG("Error saving Grid_factor object");
+                return false;
+                } // error
+            return true; // ok
+            }
+
+
+        /**
+         * Loads the part of a grid saved with saveIndexed() which intersects a box. Only the index and
+         * the leafs intersecting B are read: the file is memory mapped and the blocks are found with
+         * a binary search in the index for each interval of Morton keys covering B. The time needed
+         * thus depends on the size of B and not on the size of the file.
+         *
+         * The grid is first reset, then the special range, the special objects and the callDtor flag
+         * are those of the saved grid. The grid contains afterward exactly the leafs and special
+         * sub-boxes of the saved grid which intersect B (so possibly sites slightly outside of B).
+         * The other sites are absent, as if they were never accessed.
+         *
+         * @param   filename    The file (created with saveIndexed()).
+         * @param   B           The box to load.
+         *
+         * @return  true if it succeeds, false if it fails (the grid is then empty).
+         *
+         * @sa  saveIndexed
+         **/
+        bool loadBox(const std::string & filename, const iBox<D> & B)
+            {
+            try
+                {
+                std::lock_guard<std::recursive_mutex> lock(_peekmut); // protect from safePeek()
+                try
+                    {
+                    MappedFile F(filename);
+                    internals_grid::_tileIndexFooter footer;
+                    if ((!F.isOpen()) || (F.size() < sizeof(footer))) { MTOOLS_THROW("cannot open the file"); }
+                    memcpy(&footer, F.data() + F.size() - sizeof(footer), sizeof(footer));
+                    const uint64 indexsize = F.size() - sizeof(footer);
+                    if ((footer.magic != internals_grid::_tileIndexFooter::MAGIC) || (footer.indexoffset % 8 != 0) || (footer.indexoffset > indexsize)
+                        || (footer.nbentries > (indexsize - footer.indexoffset) / sizeof(internals_grid::_tileIndexEntry)) || (footer.headoffset > footer.indexoffset)
+                        || (footer.headsize > footer.indexoffset - footer.headoffset)) { MTOOLS_THROW("not an indexed grid file"); }
+                        {
+                        IStringArchive ar(F.data() + footer.headoffset, (size_t)footer.headsize);
+                        _deserializeHead(ar);
+                        }
+                    const Pos fmin = _rangemin, fmax = _rangemax; // range of the saved grid
+                    _rangemin.clear(std::numeric_limits<int64>::max());
+                    _rangemax.clear(std::numeric_limits<int64>::min());
+                    _createBaseNode();
+                    const internals_grid::_tileIndexEntry * index = (const internals_grid::_tileIndexEntry *)(F.data() + footer.indexoffset);
+                    const internals_grid::_tileIndexEntry * end = index + footer.nbentries;
+                    if (footer.nbentries == 0) return true;
+                    std::vector<std::pair<uint64, uint64> > ranges;
+                    for (int64 rad = (int64)R; (rad <= (int64)(end - 1)->rad) && (rad < (((int64)1) << 60)); rad = 3 * rad + 1)
+                        { // the blocks of each size
+                        internals_grid::_mortonRanges<D>(B, rad, ranges);
+                        const internals_grid::_tileIndexEntry * p = index;
+                        for (const auto & I : ranges)
+                            {
+                            internals_grid::_tileIndexEntry E; E.rad = (uint64)rad; E.key = I.first;
+                            p = std::lower_bound(p, end, E);
+                            for (; (p != end) && (p->rad == (uint64)rad) && (p->key <= I.second); ++p) { _loadIndexedBlock(F, *p, footer.indexoffset, fmin, fmax); }
+                            }
+                        }
+                    }
+                catch (...)
+                    {
+                    callDtors(false); // prevent calling the destructor of object when we release memory (since we do not know whch one may be in an invalid state)
+                    reset(0, -1, true); // put the object in a valid state
+                    throw;
+                    }
+                }
+            catch (...)
+                {
+                MTOOLS_DEBUG("Error loading Grid_factor object");
+                return false;
+                } // error
+            return true; // ok
+            }
+
+
+        /**
+         * Appends an incremental checkpoint to a delta file. Only the leafs (elementary sub-boxes)
+         * modified since the last checkpoint are written, together with the regions that were
+         * factorized into special values. A checkpoint is either a call to saveDelta(), clearDirty()
+         * or loadWithDeltas(). A typical use is:
+         * 
+         * - save(base) followed by clearDirty() to create the base file.
+         * - saveDelta(delta) regularly afterward (the delta file only grows).
+         * - loadWithDeltas(base, delta) to recover the grid at the last checkpoint.
+         * 
+         * A leaf is marked as modified when it is created or when one of its element is changed by
+         * set(), concurrentSet() or accessed via access(). After a reset(), a load(), an assignment or
+         * a change of the special range, the whole grid is written in the next delta.
+         * 
+         * The delta file is compressed if it ends by the extension ".gz", ".gzip" or ".z". If the
+         * method fails, the delta file may contain an incomplete record and should not be used anymore.
+         *
+         * @param   filename    The delta file (created if it does not exist).
+         *
+         * @return  true on success, false on failure.
+         *
+         * @sa  clearDirty, applyDelta, loadWithDeltas
+         **/
+        bool saveDelta(const std::string & filename)
+            {
+            try
+                {
+                    {
+                    OFileArchive ar(filename, true);
+                    ar << "\nDelta of Grid_factor<" << D << " , [" << std::string(typeid(T).name()) << "] , " << NB_SPECIAL << " , " << R << ">\n";
+                    ar & ((uint64)1); ar & ((uint64)D); ar & ((uint64)R); ar & ((uint64)sizeof(T)); ar.newline();
+                    if (_deltaFull)
+                        {
+                        ar & ((char)'F'); ar.newline();
+                        serialize(ar);
+                        }
+                    else
+                        {
+                        ar & ((char)'D'); ar & _rangemin; ar & _rangemax; ar.newline();
+                        for (auto & sp : _deltaSpecial)
+                            { // factorized leafs must be replayed first
+                            MTOOLS_ASSERT(_isSpecial(sp.second));
+                            MTOOLS_ASSERT(_tabSpecObj[sp.second - _minSpec] != nullptr);
+                            ar & ((char)'S'); ar & sp.first; ar & (*_tabSpecObj[sp.second - _minSpec]); ar.newline();
+                            }
+                        _serializeDirty(ar, _getRoot());
+                        ar & ((char)'E');
+                        }
+                    }
+                clearDirty();
+                }
+            catch (...)
+                {
+                MTOOLS_DEBUG("Error saving delta of Grid_factor object");
+                return false;
+                } // error
+            return true; // ok
+            }
+
+
+        /**
+         * Replays all the records of a delta file created by saveDelta() on top of the current grid.
+         * The modified leafs remain marked as dirty.
+         *
+         * @param   filename    The delta file.
+         *
+         * @return  true on success, false on failure [in this case, the grid may be partially updated].
+         *
+         * @sa  saveDelta, loadWithDeltas
+         **/
+        bool applyDelta(const std::string & filename)
+            {
+            try
+                {
+                IFileArchive ar(filename);
+                while (!ar.atEnd())
+                    {
+                    uint64 ver;         ar & ver;      if (ver != 1) { MTOOLS_THROW("wrong version"); }
+                    uint64 d;           ar & d;        if (d != D) { MTOOLS_THROW("wrong dimension"); }
+                    uint64 r;           ar & r;        if (r != R) { MTOOLS_THROW("wrong R parameter"); }
+                    uint64 sizeofT;     ar & sizeofT;  if (sizeofT != sizeof(T)) { MTOOLS_THROW("wrong sizeof(T)"); }
+                    char c; ar & c;
+                    if (c == 'F') { deserialize(ar); continue; }
+                    if (c != 'D') { MTOOLS_THROW(std::string("Unknown tag [") + std::string(1, c) + "]"); }
+                    Pos rmin, rmax;
+                    ar & rmin; ar & rmax;
+                    typename std::aligned_storage<sizeof(T), std::alignment_of<T>::value>::type buf;
+                    T * obj = (T*)(&buf);
+                    while (1)
+                        {
+                        ar & c;
+                        if (c == 'E') break;
+                        if ((c != 'L') && (c != 'S')) { MTOOLS_THROW(std::string("Unknown tag [") + std::string(1, c) + "]"); }
+                        Pos pos; ar & pos;
+                        const Pos center = pos;
+                        for (size_t i = 0; i < D; ++i) { pos[i] -= R; } // go to the first cell
+                        if (c == 'S') { _deserializeObjectT(ar, obj); }
+                        for (size_t x = 0; x < metaprog::power<(2 * R + 1), D>::value; ++x)
+                            {
+                            if (c == 'L') { _deserializeObjectT(ar, obj); }
+                            _set(pos, obj);
+                            if (c == 'L') { obj->~T(); }
+                            for (size_t i = 0; i < D; ++i) { if (pos[i] < (center[i] + (int64)R)) { pos[i]++;  break; } pos[i] -= (2 * R); } // move to the next cell.
+                            }
+                        if (c == 'S') { obj->~T(); }
+                        }
+                    for (size_t i = 0; i < D; i++)
+                        {
+                        if (rmin[i] < _rangemin[i]) { _rangemin[i] = rmin[i]; }
+                        if (rmax[i] > _rangemax[i]) { _rangemax[i] = rmax[i]; }
+                        }
+                    }
+                }
+            catch (...)
+                {
+                MTOOLS_DEBUG("Error applying delta to Grid_factor object");
+                return false;
+                } // error
+            return true; // ok
+            }
+
+
+        /**
+         * Loads a base file and replays a delta file on top of it. This recovers the state of the
+         * grid saved by the last call to saveDelta(). The grid is then marked as clean so that
+         * saveDelta() can be used again to continue the same delta file.
+         *
+         * @param   baseFile    The base file (created with save() or saveParallel()).
+         * @param   deltaFile   The delta file (created with saveDelta()).
+         *
+         * @return  true on success, false on failure.
+         *
+         * @sa  saveDelta, applyDelta
+         **/
+        bool loadWithDeltas(const std::string & baseFile, const std::string & deltaFile)
+            {
+            if (!load(baseFile)) { return false; }
+            if (!applyDelta(deltaFile)) { return false; }
+            clearDirty();
+            return true;
+            }
+
+
+        /**
+         * Mark every leaf as unmodified. The next call to saveDelta() will only write the changes
+         * made after this call.
+         **/
+        void clearDirty()
+            {
+            std::lock_guard<std::recursive_mutex> lock(_peekmut); // protect from safePeek()
+            _clearDirty(_getRoot());
+            _deltaSpecial.clear();
+            _deltaFull = false;
+            }
+
+
+        /**
+         * Return the number of leafs (elementary sub-boxes) modified since the last checkpoint.
+         **/
+        size_t nbDirtyLeafs() const { return _countDirty(_getRoot()); }
+
+
+        /**
+         * Enable or disable the journal of the modifications of the grid.
+         *
+         * When enabled, set(), access(), concurrentSet() and applyDelta() record the leafs they modify so that a consumer running in
+         * another thread (typically a drawer, cf. LatticeDrawer::redrawSites()) can update only what
+         * changed since its last call to takeChanges(). Consecutive writes in the same leaf only cost
+         * a comparison. Resetting, loading or assigning the grid counts as a modification of every site.
+         *
+         * @param   enable      true to enable the journal, false to disable it.
+         * @param   capacity    maximum number of leafs recorded between two calls to takeChanges().
+         *                      Beyond that, the journal only remembers that everything changed.
+         **/
+        void journal(bool enable, size_t capacity = 65536) { _changes.enable(enable, capacity); }
+
+
+        /** Return true if the journal of the modifications is enabled. */
+        bool journal() const { return _changes.enabled(); }
+
+
+        /**
+         * Retrieve the modifications recorded by the journal since the last call (see journal()).
+         *
+         * @param [out] boxes   The boxes of the leafs modified (each one is reported once).
+         *
+         * @return  false if everything must be considered modified: the journal is disabled, it
+         *          overflowed, the grid was reset... or this is the first call since it was enabled.
+         **/
+        bool takeChanges(std::vector<iBox<D> > & boxes) { return _changes.take(boxes); }
+
+
+        /**
+         * A block of the grid returned by leafs(). Either:
+         * - a leaf: the elementary sub-box box = [center-R, center+R]^D and its SIZE objects, stored
+         *   contiguously following LAYOUT (row-major, first coordinate fastest, by default).
+         * - a special sub-box (special = true): a box of any size on which all the sites have the same
+         *   special value. data then points to the unique object shared by the whole box.
+         **/
+        struct LeafSpan
+            {
+            static const size_t SIZE = metaprog::power<(2 * R + 1), D>::value; ///< number of objects in a leaf
+
+            iBox<D>     box;        ///< the sites of the block
+            const T *   data;       ///< the SIZE objects of the leaf, or the special object
+            bool        special;    ///< true if all the sites of box share the object data[0]
+
+            /** The object at a position inside box. */
+            inline const T & operator()(const Pos & pos) const
+                {
+                if (special) return *data;
+                Pos c; for (size_t i = 0; i < D; i++) { c[i] = box.min[i] + (int64)R; }
+                return data[LAYOUT::template offset<D, R>(pos, c)];
+                }
+            };
+
+
+        /**
+         * Return the list of all the blocks (leafs and special sub-boxes) of the grid. Together, they
+         * cover every site ever accessed and they do not overlap. A leaf may contain sites which were
+         * never accessed (they hold the default special object). This is the fastest way to visit the
+         * grid: a uniform region is visited once, whatever its size. The pointers remain valid until the
+         * grid is modified.
+         **/
+        std::vector<LeafSpan> leafs() const
+            {
+            std::vector<LeafSpan> vec;
+            _pbox root = _getRoot();
+            if (root != nullptr) { _collectLeafs(root, vec); }
+            return vec;
+            }
+
+
+        /**
+         * Call fun(const LeafSpan & leaf) for each block of the grid. See leafs().
+         **/
+        template<typename FUN> void for_each_leaf(FUN fun) const
+            {
+            const std::vector<LeafSpan> vec = leafs();
+            for (const LeafSpan & L : vec) { fun(L); }
+            }
+
+
+        /**
+         * Call fun(const LeafSpan & leaf, size_t thread) for each block of the grid, the blocks being
+         * distributed among several threads. The index of the calling thread (in [0, nbThreads-1]) is
+         * passed to fun so reductions can be accumulated in per-thread variables without locking. The
+         * grid must not be modified during the call.
+         *
+         * @param   fun         The function called for each block.
+         * @param   nbThreads   Number of threads (0 = number of hardware threads).
+         **/
+        template<typename FUN> void parallel_for_each_leaf(FUN fun, size_t nbThreads = 0) const
+            {
+            if (nbThreads == 0) { nbThreads = (size_t)nbHardwareThreads(); }
+            const std::vector<LeafSpan> vec = leafs();
+            std::atomic<size_t> next(0);
+            auto work = [&](size_t t) { size_t k; while ((k = next++) < vec.size()) { fun(vec[k], t); } };
+            std::vector<std::thread> threads;
+            for (size_t t = 1; t < nbThreads; t++) { threads.push_back(std::thread(work, t)); }
+            work(0);
+            for (auto & th : threads) { th.join(); }
+            }
+
+
         /**
         * Serializes the grid into an OBaseArchive. If T implement a serialize method recognized by
         * OBaseArchive, it is used for serialization otherwise OBaseArchive uses the default serialization
@@ -369,27 +859,9 @@ namespace mtools
         **/
         void serialize(OBaseArchive & ar) const
             {
-            ar << "\nBegining of Grid_factor<" << D << " , [" << std::string(typeid(T).name()) << "] , " << NB_SPECIAL << " , " << R << ">\n";
-            ar << "Version";    ar & ((uint64)1); ar.newline();
-            ar << "Template D"; ar & ((uint64)D); ar.newline();
-            ar << "Template R"; ar & ((uint64)R); ar.newline();
-            ar << "object T";   ar & std::string(typeid(T).name()); ar.newline();
-            ar << "sizeof(T)";  ar & ((uint64)sizeof(T)); ar.newline();
-            ar << "call dtors"; ar & (_callDtors); ar.newline();
-            ar << "_rangemin";  ar & _rangemin; ar.newline();
-            ar << "_rangemax";  ar & _rangemax; ar.newline();
-            ar << "_minSpec";   ar & _minSpec; ar.newline();
-            ar << "_maxSpec";   ar & _maxSpec; ar.newline();
-            ar << "List of special objects\n";
-            for (int64 i = 0; i < _specialRange(); i++)
-                {
-                ar << "Object (" << _minSpec + i << ")";
-                if (_tabSpecObj[i] == nullptr) { ar & false; } else { ar & true; ar & (*_tabSpecObj[i]); }
-                ar.newline();
-                }
-            ar << "Grid tree\n";
+            _serializeHead(ar);
             _serializeTree(ar, _getRoot());
-            ar << "\nEnd of Grid_factor<" << D << " , [" << std::string(typeid(T).name()) << "] , " << NB_SPECIAL << " , " << R << ">\n";
+            _serializeTail(ar);
             }
 
 
@@ -412,28 +884,7 @@ namespace mtools
             try
                 {
                 std::lock_guard<std::recursive_mutex> lock(_peekmut); // protect from safePeek()
-                _reset(-1, 0, true); // reset the object, do not create the root node
-                uint64 ver;         ar & ver;      if (ver != 1) { MTOOLS_THROW("wrong version");}
-                uint64 d;           ar & d;        if (d != D) { MTOOLS_THROW("wrong dimension");}
-                uint64 r;           ar & r;        if (r != R) { MTOOLS_THROW("wrong R parameter");}
-                std::string stype;  ar & stype;
-                uint64 sizeofT;     ar & sizeofT;  if (sizeofT != sizeof(T)) { MTOOLS_THROW("wrong sizeof(T)");}
-                ar & _callDtors;
-                ar & _rangemin;
-                ar & _rangemax;
-                ar & _minSpec;
-                ar & _maxSpec;
-                if (((int64)NB_SPECIAL) < _specialRange()) { MTOOLS_THROW("NB_SPECIAL too small to fit all special values");}
-                for (int64 i = 0; i < _specialRange(); i++)
-                    {
-                    bool b; ar & b;
-                    if (b)
-                        {
-                        _tabSpecObj[i] = _poolSpec.allocate();      // allocate the memory
-                        _deserializeObjectT(ar, _tabSpecObj[i]);    // deserialize the object
-                        MTOOLS_ASSERT((((int64)(*(_tabSpecObj[i]))) == (i + _minSpec)));
-                        }
-                    }
+                _deserializeHead(ar);
                 _pcurrent = _deserializeTree(ar, nullptr);
                 _pcurrentpeek = (_pbox)_pcurrent;
                 }
@@ -447,42 +898,104 @@ namespace mtools
 
 
         /**
-         * Change the range of special objects. This method first expand the whole tree structure to
-         * remove all factorization of the tree then set the new range for the special objects and
-         * subsequently re-factorizes the tree using the new paramters.
-         * 
-         * This method can be time and memory consumming
-         * 
-         * Set newMaxSpec \< newMinSpec to disable special object and expand the whole tree (or simply call the `removeSpecialObjects()` method).
+         * Change the range of special objects.
+         *
+         * The change is incremental: only the special sub-boxes whose value leaves the special range are
+         * expanded, the other ones are simply re-labeled. The count arrays of the leafs are rebased
+         * and only the leafs containing normal objects are scanned, and only if the new range contains
+         * values which were not special before (shrinking or shifting the range inside the old one
+         * never reads the objects). The leafs are processed in parallel. The tree is then re-factorized
+         * with the new range.
+         *
+         * Set newMaxSpec \< newMinSpec to disable special object and expand the whole tree (or simply
+         * call the `removeSpecialObjects()` method).
          *
          * @param   newMinSpec  the new minimum value for the special objects range.
          * @param   newMaxSpec  the new maximum value for the special object range.
+         * @param   nbThreads   number of threads used (0 = number of hardware threads).
          **/
-        void changeSpecialRange(int64 newMinSpec, int64 newMaxSpec)
+        void changeSpecialRange(int64 newMinSpec, int64 newMaxSpec, size_t nbThreads = 0)
             {
             std::lock_guard<std::recursive_mutex> lock(_peekmut); // protect from safePeek()
             MTOOLS_INSURE(((newMaxSpec < newMinSpec) || ((newMaxSpec - newMinSpec) < ((int64)NB_SPECIAL))));
-            _expandTree(); // we expand the whole tree, removing every dummy links
-            if (_callDtors) _poolSpec.destroyAndDeallocateAll(); else _poolSpec.deallocateAll(); // release the memory for all the special objects saved
-            memset(_tabSpecObj, 0, sizeof(_tabSpecObj)); // clear the list of pointer to special objects
-            memset(_tabSpecNB, 0, sizeof(_tabSpecNB));   // clear the count for special objects
-            _nbNormalObj = 0; // reset the number of normal objects
+            if (newMaxSpec < newMinSpec) { newMinSpec = 0; newMaxSpec = -1; }
+            const int64 oldMin = _minSpec, oldMax = (_existSpecial() ? _maxSpec : _minSpec - 1);
+            if (((newMaxSpec < newMinSpec) && (oldMax < oldMin)) || ((newMinSpec == oldMin) && (newMaxSpec == oldMax))) return; // nothing to do
+            const bool bg = _bgActive; const int bgInterval = _bgInterval;
+            if (bg) stopBackgroundFactorization();
+            for (auto & e : _leafIndexTab) { e.leaf = nullptr; }
+            // expand the special sub-boxes which are not special anymore and re-label the other ones
+            std::vector<_pleafFactor> leafs;
+            std::vector<std::pair<_pleafFactor, T*> > fills;
+            _rangeWalk((_pnode)_getRoot(), newMinSpec, newMaxSpec, leafs, fills);
+            // rebase / scan the leafs in parallel
+            const int64 enterMin = newMinSpec, enterMax = newMaxSpec; // values becoming special are those of [enterMin,enterMax] outside [oldMin,oldMax]
+            const size_t nbItems = leafs.size() + fills.size();
+            if (nbThreads == 0) { nbThreads = (size_t)nbHardwareThreads(); }
+            nbThreads = std::max<size_t>(1, std::min<size_t>(nbThreads, nbItems / 64));
+            std::vector<std::vector<uint64> > entered(nbThreads, std::vector<uint64>(NB_SPECIAL, 0));
+            std::atomic<size_t> next(0);
+            auto work = [&](size_t t)
+                {
+                const size_t CHUNK = 32;
+                size_t k;
+                while ((k = next.fetch_add(CHUNK)) < nbItems)
+                    {
+                    const size_t e = std::min<size_t>(k + CHUNK, nbItems);
+                    for (; k < e; k++)
+                        {
+                        if (k < leafs.size()) { _rebaseLeaf(leafs[k], oldMin, oldMax, enterMin, enterMax, entered[t].data()); continue; }
+                        const auto & F = fills[k - leafs.size()];
+                        for (size_t i = 0; i < metaprog::power<(2 * R + 1), D>::value; ++i) { new(F.first->data + i) T(*(F.second)); }
+                        memset(F.first->count, 0, sizeof(F.first->count)); // the value is not special anymore
+                        }
+                    }
+                };
+            std::vector<std::thread> threads;
+            for (size_t t = 1; t < nbThreads; t++) { threads.push_back(std::thread(work, t)); }
+            work(0);
+            for (auto & th : threads) { th.join(); }
+            // new tables of special objects
+            T* newObj[NB_SPECIAL];
+            uint64 newNB[NB_SPECIAL];
+            memset(newObj, 0, sizeof(newObj));
+            memset(newNB, 0, sizeof(newNB));
+            for (int64 v = oldMin; v <= oldMax; v++)
+                {
+                const size_t off = (size_t)(v - oldMin);
+                if ((v >= newMinSpec) && (v <= newMaxSpec)) { newObj[v - newMinSpec] = _tabSpecObj[off]; newNB[v - newMinSpec] = _tabSpecNB[off]; continue; }
+                _nbNormalObj += _tabSpecNB[off]; // these objects are now normal
+                if (_tabSpecObj[off] != nullptr)
+                    {
+                    if (_callDtors) { _tabSpecObj[off]->~T(); }
+                    _poolSpec.deallocate(_tabSpecObj[off]);
+                    }
+                }
+            for (size_t t = 0; t < nbThreads; t++)
+                {
+                for (size_t i = 0; i < NB_SPECIAL; i++) { newNB[i] += entered[t][i]; _nbNormalObj -= entered[t][i]; }
+                }
+            memcpy(_tabSpecObj, newObj, sizeof(_tabSpecObj));
+            memcpy(_tabSpecNB, newNB, sizeof(_tabSpecNB));
             _minSpec = newMinSpec; // set the new min value for the special objects
             _maxSpec = newMaxSpec; // set the new max value for the special objects
-            _recountTree(); // recount all the leafs with the new special object range
-            if (!_existSpecial()) return; // no need to simplify since there are no special objects
-            _simplifyTree(); // simplify the tree using the new special objects
+            _pcurrent = _getRoot();
+            _pcurrentpeek = _pcurrent;
+            _deltaFull = true; // the whole grid must be written in the next delta
+            _deltaSpecial.clear();
+            if (_existSpecial()) { _simplifyTree(); } // factorize the tree with the new special objects
+            if (bg) startBackgroundFactorization(bgInterval);
             }
 
 
         /**
          * Removes the special objects. This makes the grid compatible with Grid_basic object
          * 
-         *  Same as 'changeSpecialRange(0, -1)'.
+         *  Same as 'changeSpecialRange(0, -1, nbThreads)'.
          **/
-        void removeSpecialObjects()
+        void removeSpecialObjects(size_t nbThreads = 0)
             {
-            changeSpecialRange(0, -1);
+            changeSpecialRange(0, -1, nbThreads);
             }
 
 
@@ -707,7 +1220,14 @@ namespace mtools
          *
          * @return  A reference to the element at position pos.
          **/
-        inline T & access(const Pos & pos) { return _get(pos); }
+        inline T & access(const Pos & pos)
+            {
+            _changes.record(pos);
+            T & r = _get(pos);
+            _pbox c = _pcurrent;
+            if (c->isLeaf()) { ((_pleafFactor)c)->dirty = 1; _leafIndexInvalidate(c); } // after a call to _get(), _pcurrent points to the leaf containing pos (if any)
+            return r;
+            }
 
 
         /**
@@ -858,16 +1378,250 @@ namespace mtools
         inline const T * safePeek(int64 x, int64 y, int64 z) const { static_assert(D == 3, "template parameter D must be 3"); return safePeek(Pos(x, y, z)); }
 
 
+        /**
+         * Set the value at a given site. Concurrent version.
+         * 
+         * Several threads may call concurrentSet() and concurrentGet() simultaneously (as well as
+         * peek() with a hint and Grid_basic-like readers) without any global lock:
+         * 
+         * - The tree is traversed from a cursor `hint` which is owned by the calling thread (it
+         *   must be set to nullptr before the first call and then forwarded to each subsequent
+         *   call, exactly as with the hint version of peek()).
+         * 
+         * - Child pointers in the tree are read and published atomically. The memory pools are
+         *   not threadsafe so a small mutex protects the allocation of new nodes/leaves. This lock is
+         *   only taken when a new part of the tree is created (i.e. about once per leaf).
+         * 
+         * - Cell writes are atomic per cell. This requires T to be trivially copyable.
+         * 
+         * - No factorization takes place while in concurrent mode (the counters for special objects
+         *   are not maintained). Once all threads are done, endConcurrentAccess() MUST be called
+         *   to recount the cells and re-factorize the tree. 
+         * 
+         * No other method (besides peek() and the methods above) may be called while threads are
+         * using the concurrent methods.
+         *
+         * @param           pos     The position of the site to access.
+         * @param           val     The value to set.
+         * @param [in,out]  hint    The per-thread cursor. Must be set to nullptr for the first call
+         *                          and then forwarded on each subsequent call.
+         **/
+        inline void concurrentSet(const Pos & pos, const T & val, void* & hint)
+            {
+            static_assert(std::is_trivially_copyable<T>::value, "concurrentSet() requires T to be trivially copyable");
+            static_assert((sizeof(std::atomic<T>) == sizeof(T)) && (alignof(std::atomic<T>) == alignof(T)), "std::atomic<T> must have the same layout as T");
+            const int64 nv = (int64)val;
+            std::atomic<int64> * guard = (_bgActive ? _bgEnter() : nullptr);
+            while (1)
+                {
+                _pleafFactor L;
+                T * p = _concurrentAccess(pos, hint, true, nv, L);
+                if (p == nullptr) break; // the site is inside a factorized region with the same value
+                if ((nv < _atomicBound(_minVal).load(std::memory_order_relaxed)) || (nv > _atomicBound(_maxVal).load(std::memory_order_relaxed))) { std::lock_guard<std::mutex> lock(_allocmut); _updateValueRange(nv); }
+                reinterpret_cast<std::atomic<T>*>(p)->store(val, std::memory_order_release);
+                _atomicFlag(L->dirty).store(1, std::memory_order_relaxed);
+                if (guard == nullptr) break;
+                _atomicFlag(L->hot).store(1, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst); // pairs with the fence in _bgFactorizeLeaf()
+                char r;
+                while ((r = _atomicFlag(L->retired).load(std::memory_order_acquire)) == 1) { std::this_thread::yield(); }
+                if (r == 0) break;
+                // the leaf was factorized by the background thread before it could see our write: do it again.
+                }
+            if (guard != nullptr) guard->fetch_sub(1);
+            _changes.record(pos);
+            }
+
+
+        /**
+         * Get the value at a given position (the value is created if needed). Concurrent version. 
+         * 
+         * The value is returned by copy (the read is atomic). See concurrentSet() for details.
+         *
+         * @param           pos     The position.
+         * @param [in,out]  hint    The per-thread cursor. Must be set to nullptr for the first call
+         *                          and then forwarded on each subsequent call.
+         *
+         * @return  A copy of the value at that position.
+         **/
+        inline T concurrentGet(const Pos & pos, void* & hint) const
+            {
+            static_assert(std::is_trivially_copyable<T>::value, "concurrentGet() requires T to be trivially copyable");
+            static_assert((sizeof(std::atomic<T>) == sizeof(T)) && (alignof(std::atomic<T>) == alignof(T)), "std::atomic<T> must have the same layout as T");
+            std::atomic<int64> * guard = (_bgActive ? _bgEnter() : nullptr);
+            _pleafFactor L;
+            const T * p = _concurrentAccess(pos, hint, false, 0, L);
+            const T res = reinterpret_cast<const std::atomic<T>*>(p)->load(std::memory_order_acquire);
+            if (guard != nullptr) guard->fetch_sub(1);
+            return res;
+            }
+
+
+        /**
+         * Terminate a concurrent access phase. Must be called (by a single thread) once all threads
+         * are done using concurrentSet() and concurrentGet(). Stop the background factorization (if
+         * running), recompute the statistics about the objects in the grid and re-factorize the tree.
+         **/
+        void endConcurrentAccess()
+            {
+            stopBackgroundFactorization();
+            std::lock_guard<std::recursive_mutex> lock(_peekmut); // protect from safePeek()
+            memset(_tabSpecNB, 0, sizeof(_tabSpecNB));   // clear the count for special objects
+            _nbNormalObj = 0; // reset the number of normal objects
+            _recountTree();
+            if (_existSpecial()) _simplifyTree();
+            }
+
+
+        /**
+         * Start a background thread which factorizes the tree incrementally during a concurrent access
+         * phase. Without it, the leaves filled with a special value are only factorized by
+         * endConcurrentAccess(), all at once.
+         * 
+         * Every `intervalMs` milliseconds, the thread walks through the tree and replaces by a special
+         * node each cold leaf (i.e. not written by concurrentSet() since the previous pass) whose sites
+         * all have the same special value. The threads using concurrentSet() and concurrentGet() are
+         * never blocked (except for the brief moment when a leaf they just wrote is being checked).
+         * The memory of the factorized leaves is reclaimed with an epoch scheme: a leaf is released once
+         * no thread can still hold a pointer to it, at the end of each pass.
+         * 
+         * - Must be called before the threads start using the concurrent methods and their hints must be
+         *   (re)set to nullptr afterward. While the background thread runs, the hints only point to nodes
+         *   (which are never released in this phase).
+         * 
+         * - peek() may not be used while the background factorization is running (the pointer returned
+         *   could refer to a leaf released by the background thread). Use concurrentGet() instead.
+         * 
+         * - The counters of special objects are not maintained: endConcurrentAccess() must still be
+         *   called at the end of the phase, it also stops the background thread.
+         *
+         * @param   intervalMs  Delay in milliseconds between two passes over the tree.
+         **/
+        void startBackgroundFactorization(int intervalMs = 50)
+            {
+            static_assert(std::is_trivially_copyable<T>::value, "startBackgroundFactorization() requires T to be trivially copyable");
+            std::lock_guard<std::recursive_mutex> lock(_peekmut);
+            if ((_bgActive) || (!_existSpecial())) return; // already running or nothing to factorize
+            _bgResetLeafs(_pcurrent);
+            if (_pcurrent->isLeaf()) { _pcurrent = _pcurrent->father; }
+            _pcurrentpeek = _pcurrent;
+            for (size_t i = 0; i < _BG_STRIPES; i++) { _bgReaders[0][i].nb = 0; _bgReaders[1][i].nb = 0; }
+            _bgInterval = (intervalMs < 1) ? 1 : intervalMs;
+            _bgStop = false;
+            _bgActive = true;
+            _bgThread = std::thread(&Grid_factor::_bgLoop, this);
+            }
+
+
+        /**
+         * Stop the background factorization thread started by startBackgroundFactorization(). Does
+         * nothing if it is not running. Must not be called while other threads use the concurrent
+         * methods (endConcurrentAccess() calls it).
+         **/
+        void stopBackgroundFactorization()
+            {
+            if (!_bgActive) return;
+            _bgStop = true;
+            _bgThread.join();
+            _bgActive = false;
+            }
+
+
+        /**
+         * Number of leaves factorized by the background thread since the creation of the grid.
+         **/
+        uint64 nbBackgroundFactorized() const { return _bgNbFactorized; }
+
+
+
+        /**
+         * Use a memory mapped file as backing store for the leaves of the grid. The operating system
+         * may then page cold leaves out to the file and reload them transparently when they are
+         * accessed again. See Grid_basic::setLeafBackingFile() for details.
+         * 
+         * The grid is reset (keeping the current special range and callDtors flag).
+         *
+         * @param   filename    Name of the backing file (empty to go back to regular allocation).
+         * @param   maxResident Maximum number of bytes of leaves kept in physical memory (0 = no limit).
+         **/
+        void setLeafBackingFile(const std::string & filename, size_t maxResident = 0)
+            {
+            std::lock_guard<std::recursive_mutex> lock(_peekmut); // protect from safePeek()
+            _reset();
+            _poolLeaf.setBackingFile(filename, maxResident);
+            _createBaseNode();
+            }
+
+
+        /**
+         * Back the memory pools of the leaves and nodes of the grid with huge pages. See
+         * Grid_basic::setHugePageAllocation() for details.
+         * 
+         * The grid is reset (keeping the current special range and callDtors flag).
+         *
+         * @param   pageSize    Size of the huge pages (0 to go back to regular allocation).
+         * @param   reserve     Size of the address space reserved at once by each pool.
+         **/
+        void setHugePageAllocation(size_t pageSize = MEM_MB(2), size_t reserve = MEM_GB(((size_t)64)))
+            {
+            std::lock_guard<std::recursive_mutex> lock(_peekmut); // protect from safePeek()
+            _reset();
+            _poolLeaf.setHugePages(pageSize, reserve);
+            _poolNode.setHugePages(pageSize, reserve);
+            _createBaseNode();
+            }
+
+
         /**
         * Return the memory currently allocated by the grid (in bytes).
         **/
-        size_t memoryAllocated() const { return sizeof(*this) + _poolLeaf.footprint() + _poolNode.footprint() + _poolSpec.footprint() + ((_psafeT == nullptr) ? 0 : sizeof(T)); }
+        size_t memoryAllocated() const { return sizeof(*this) + _poolLeaf.footprint() + _poolNode.footprint() + _poolSpec.footprint() + ((_psafeT == nullptr) ? 0 : sizeof(T)) + _leafIndexMemory(); }
 
 
         /**
         * Return the memory currently used by the grid (in bytes).
         **/
-        size_t memoryUsed() const { return sizeof(*this) + _poolLeaf.used() + _poolNode.used() + _poolSpec.used() + ((_psafeT == nullptr) ? 0 : sizeof(T)); }
+        size_t memoryUsed() const { return sizeof(*this) + _poolLeaf.used() + _poolNode.used() + _poolSpec.used() + ((_psafeT == nullptr) ? 0 : sizeof(T)) + _leafIndexMemory(); }
+
+
+        /**
+         * Return telemetry about the tree of the grid (see GridStats). Without the tree walk, the
+         * method is cheap and may be polled from another thread (e.g. a watch window) while the grid
+         * is being modified. The tree walk must not run concurrently with writers.
+         *
+         * @param   walkTree    true to also compute the number of factorized subtrees and the depth
+         *                      histogram of the leaves.
+         **/
+        GridStats stats(bool walkTree = false) const
+            {
+            GridStats st;
+            st.nbNodes = _poolNode.size();
+            st.nbLeaves = _poolLeaf.size();
+            st.nbSpecialObjects = _poolSpec.size();
+            st.bytesNodes = _poolNode.used();
+            st.bytesLeaves = _poolLeaf.used();
+            st.bytesSpecialObjects = _poolSpec.used();
+            st.memoryUsed = memoryUsed();
+            st.memoryAllocated = memoryAllocated();
+#if (MTOOLS_USE_PROFILING)
+            st.getCalls = _statGets.load(std::memory_order_relaxed);
+            st.getHits = _statHits.load(std::memory_order_relaxed);
+#endif
+            if (walkTree) { _statsWalk(_getRoot(), 0, st); }
+            return st;
+            }
+
+
+        /**
+         * Reset the get() cache hit counters reported by stats().
+         **/
+        void resetStats()
+            {
+#if (MTOOLS_USE_PROFILING)
+            _statGets = 0;
+            _statHits = 0;
+#endif
+            }
         
 
         /**
@@ -903,6 +1657,42 @@ namespace mtools
             }
 
 
+        /**
+         * Enable or disable the leaf index used by findFullBox() and findFullBoxCentered() (dimension
+         * 2 only, ignored otherwise).
+         *
+         * Without the index, these methods return the singleton {pos} whenever pos belongs to a leaf
+         * (an elementary sub-grid containing distinct values). With the index, they return instead
+         * the largest square centered at pos, inside the leaf, on which all the values are equal to
+         * the value at pos. This is done in O(log R) time using summed-area tables of the leaf. The
+         * tables are built (in O(R^2) time) when a leaf is queried and kept for the nbcached leafs most
+         * recently queried. They are updated by set() (in O(R^2) time in the worst case but with a
+         * very small constant: only the quadrant above and to the right of the modified site is
+         * touched).
+         *
+         * Each table uses 8(2R+2)^2 bytes of memory.
+         *
+         * @warning The concurrent methods (concurrentSet()...) do not update the index: call
+         *          setLeafIndex() again after using them to discard the cached tables.
+         *
+         * @param   nbcached    Number of leaf tables kept in cache (0 to disable the index).
+         **/
+        void setLeafIndex(size_t nbcached = 8)
+            {
+            _leafIndexTab.clear();
+            _leafIndexTab.shrink_to_fit();
+            _leafIndexTab.resize((D == 2) ? nbcached : 0);
+            _leafIndexTick = 0;
+            }
+
+
+        /**
+         * Return the number of leaf tables kept in cache by the leaf index (0 if the index is
+         * disabled). See setLeafIndex().
+         **/
+        size_t leafIndex() const { return _leafIndexTab.size(); }
+
+
         /**
          * Find a box containing position pos such that all the points inside the (closed) box have the
          * same special value (or are all undefined). The coordinate of the box are put outBox and the
@@ -910,6 +1700,8 @@ namespace mtools
          * 
          * If no such box can be found (for instance if the value at pos is defined but not special)
          * then the function sets outBox to the single point pos. (and returns the value at pos).
+         * If the leaf index is enabled (see setLeafIndex()), the function sets instead outBox to the
+         * largest square centered at pos inside the leaf containing pos on which all values are equal.
          * 
          *  The box returned is always a square and correspond to the largest full box containing pos 
          *  in the quadtree-like grid structure.
@@ -927,77 +1719,66 @@ namespace mtools
          **/
         inline const T * findFullBox(const Pos & pos, iBox<D> & outBox) const
             {
-            Pos & boxMin = outBox.min;
-            Pos & boxMax = outBox.max;
             _pbox cp = _pcurrent;
             MTOOLS_ASSERT(cp != nullptr);
-            // check if we are at the right place
-            if (cp->isLeaf())
-                {
-                _pleafFactor p = (_pleafFactor)(cp);
-                MTOOLS_ASSERT(_isLeafFull(p) == (_maxSpec + 1)); // the leaf cannot be full
-                if (p->isInBox(pos)) { boxMin = pos; boxMax = pos; return(&(p->get(pos))); } // just a singleton, box = [pos,pos]^d
-                MTOOLS_ASSERT(cp->father != nullptr); // a leaf must always have a father
-                cp = p->father;
-                }
-            // no, going up...
-            _pnode q = (_pnode)(cp);
-            while (!q->isInBox(pos))
-                {
-                if (q->father == nullptr) 
-                    { // the point is outside of largest boundary box
-                    int64 r = 3*q->rad + 1; 
-                    for (size_t i = 0; i < D; ++i)
-                        {
-                        int64 u = pos[i]; if (u < 0) {u = -u;}
-                        while(u > r) { r = 3*r + 1; }
-                        }
-                    // r is the radius of the box containing pos
-                    r = (r - 1) / 3;
-                    for (size_t i = 0; i < D; i++) 
-                        { 
-                        const int64 a = pos[i]; 
-                        const int64 sb =  ((a < -r) ? (-(2*r + 1)) : ((a > r) ? (2*r + 1) : 0)); 
-                        boxMin[i] = sb - r; boxMax[i] = sb + r; // TODO, we could find bigger if we just want a rectangle and not a square...
-                        }
-                    _pcurrent = q; 
-                    return nullptr; 
-                    } 
-                q = (_pnode)q->father;
-                }
-            // and down..
-            while (1)
-                {
-                _pbox b = q->getSubBox(pos);
-                if (b == nullptr) 
-                    { // subbox does not exist yet
-                    const int64 rad = q->rad;
-                    boxMin = q->subBoxCenter(pos);
-                    boxMax = boxMin;
-                    boxMin -= rad;
-                    boxMax += rad;
-                    _pcurrent = q; 
-                    return nullptr; 
-                    }
-                T * obj = _getSpecialObject(b); // check if the link is a special dummy link
-                if (obj != nullptr) 
-                        { // good we have full box
-                        const int64 rad = q->rad;
-                        boxMin = q->subBoxCenter(pos);
-                        boxMax = boxMin;
-                        boxMin -= rad; 
-                        boxMax += rad;
-                        _pcurrent = q;
-                        return obj;
-                        }
-                if (b->isLeaf())
-                    {
-                    boxMin = pos; boxMax = pos;
-                    _pcurrent = b;
-                    return(&(((_pleafFactor)b)->get(pos))); // just a singleton
-                    }
-                q = (_pnode)b;
-                }
+            const T * pv = _findFullBox(pos, outBox, cp);
+            _pcurrent = cp;
+            if ((cp->isLeaf()) && (_leafIndexTab.size() != 0)) { _leafFullBoxIndex((_pleafFactor)cp, pos, outBox, metaprog::dummy<D == 2>()); } // square from the leaf index
+            return pv;
+            }
+
+
+        /**
+         * Find a box containing position pos such that all the points inside the (closed) box have the
+         * same special value (or are all undefined). Version with a hint.
+         * 
+         * Same as findFullBox() except that the tree is traversed from a cursor owned by the caller
+         * instead of the internal pointer used by get() and set(). The leaf index (see
+         * setLeafIndex()) is not used: the box returned is a singleton whenever pos belongs to a leaf.
+         * 
+         * Since the object is not modified at all, several threads may call this method (and
+         * peek() with a hint) simultaneously, each one with its own hint, as long as no other thread
+         * modifies the grid at the same time.
+         *
+         * @param           pos     The position to check.
+         * @param [in,out]  outBox  The box to put the solution.
+         * @param [in,out]  hint    The per-thread cursor. Must be set to nullptr for the first call
+         *                          and then forwarded on each subsequent call. Must be reset to
+         *                          nullptr after the grid is modified.
+         *
+         * @return  A pointer to the element at position pos or nullptr if it does not exist.
+         **/
+        inline const T * findFullBox(const Pos & pos, iBox<D> & outBox, void* & hint) const
+            {
+            _pbox cp = (_pbox)hint;
+            if (cp == nullptr) { cp = _pcurrent; }
+            MTOOLS_ASSERT(cp != nullptr);
+            const T * pv = _findFullBox(pos, outBox, cp);
+            hint = cp;
+            return pv;
+            }
+
+
+        /**
+         * Return a pointer to the object at a given position, or nullptr if it was not yet created.
+         * Version with a hint.
+         * 
+         * Same as peek() but the tree is traversed from a cursor owned by the caller. Several
+         * threads may call this method (and findFullBox() with a hint) simultaneously, each one with
+         * its own hint, as long as no other thread modifies the grid at the same time.
+         *
+         * @param           pos     The position to peek.
+         * @param [in,out]  hint    The per-thread cursor. Must be set to nullptr for the first call
+         *                          and then forwarded on each subsequent call. Must be reset to
+         *                          nullptr after the grid is modified.
+         *
+         * @return  nullptr if the value at that site was not yet created. A const pointer to it
+         *          otherwise.
+         **/
+        inline const T * peek(const Pos & pos, void* & hint) const
+            {
+            iBox<D> B;
+            return findFullBox(pos, B, hint);
             }
 
 
@@ -1016,6 +1797,9 @@ namespace mtools
         * to the boundary is at least that returned by findFullBox() yet the volume of the box may be   
         * smaller.
         * - The box returned need not be a square (as in findFullBox()).
+        * - In dimension other than 2 (e.g. for SRW_Z3_ExitBox()), the box is extended face by face
+        * with the adjacent boxes of the same size at each level of the tree instead of trying all the
+        * combinations of neighbours, so the result is not always optimal.
         *
         * @warning This method is NOT threadsafe and uses the same pointer as get() and set().
         *
@@ -1026,9 +1810,38 @@ namespace mtools
         **/
         inline const T * findFullBoxCentered(const Pos & pos, iBox<D> & bestRect) const
             {
-            static_assert(D == 2, "findFullBoxCentered() only implemented for dimension 2 yet...");
+            return _findFullBoxCentered(pos, bestRect, metaprog::dummy<D == 2>());
+            }
+
+
+
+
+
+
+        /***************************************************************
+        * Private section
+        ***************************************************************/
+
+    private:
+
+        /* Make sure template parameters are OK */
+        static_assert(NB_SPECIAL > 0, "the number of special objects must be > 0, use Grid_basic otherwise.");
+        static_assert(D > 0, "template parameter D (dimension) must be non-zero");
+        static_assert(R > 0, "template parameter R (radius) must be non-zero");
+        static_assert(std::is_constructible<T>::value || std::is_constructible<T, Pos>::value, "The object T must either be default constructible T() or constructible with T(const Pos &)");
+        static_assert(std::is_copy_constructible<T>::value, "The object T must be copy constructible T(const T&).");
+        static_assert(std::is_convertible<T, int64>::value, "The object T must be convertible to int64");
+        static_assert(metaprog::has_assignementOperator<T>::value, "The object T must be assignable via operator=()");
+
+
+
+
+        /* Used by findFullBoxCentered (2D specialization). */
+        inline const T * _findFullBoxCentered(const Pos & pos, iBox<D> & bestRect, metaprog::dummy<true> dum) const
+            {
             const T* pv = findFullBox(pos, bestRect); // get the non optimized box.
             if (bestRect.lx() == 0) return pv;   // no box found, nothing more to do.
+            if (_pcurrent->isLeaf()) return pv;  // box inside a leaf given by the leaf index, already centered.
 
             iBox2 baseRect = bestRect;                  // the base rectangle is the best rectangle.
             int64 lbest = bestRect.boundaryDist(pos);   // current distance to the boundary
@@ -1397,26 +2210,69 @@ namespace mtools
             }
 
 
+        /* Used by findFullBoxCentered (dimension D != 2). Extend the base box face by face with the
+         * adjacent boxes of the same size which are full (closest face to pos first) then go down one
+         * level toward pos. */
+        inline const T * _findFullBoxCentered(const Pos & pos, iBox<D> & bestRect, metaprog::dummy<false> dum) const
+            {
+            const T* pv = findFullBox(pos, bestRect); // get the non optimized box.
+            if (bestRect.lx() == 0) return pv;   // no box found, nothing more to do.
+            if (_pcurrent->isLeaf()) return pv;  // box inside a leaf given by the leaf index, already centered.
+            iBox<D> baseRect = bestRect;                // the base box is the best box.
+            int64 lbest = bestRect.boundaryDist(pos);   // current distance to the boundary
+            while (1)
+                {
+                const int64 lbase = baseRect.boundaryDist(pos); // distance from the boundary of the base box to pos
+                const int64 diambase = baseRect.lx() + 1;       // diameter of the base box
+                if (lbase + diambase <= lbest) { return pv; }   // we cannot improve the distance to the boundary at this level (nor below)
+                size_t faces[2 * D]; int64 fdist[2 * D];
+                for (size_t i = 0; i < D; i++)
+                    {
+                    faces[2 * i] = 2 * i; fdist[2 * i] = pos[i] - baseRect.min[i];
+                    faces[2 * i + 1] = 2 * i + 1; fdist[2 * i + 1] = baseRect.max[i] - pos[i];
+                    }
+                std::sort(faces, faces + 2 * D, [&](size_t a, size_t b) { return fdist[a] < fdist[b]; });
+                iBox<D> ext = baseRect;
+                for (size_t f = 0; f < 2 * D; f++)
+                    {
+                    const size_t ax = faces[f] / 2;
+                    iBox<D> slab = ext; // the layer of boxes of size diambase adjacent to that face
+                    if (faces[f] & 1) { slab.min[ax] = ext.max[ax] + 1; slab.max[ax] = ext.max[ax] + diambase; } else { slab.min[ax] = ext.min[ax] - diambase; slab.max[ax] = ext.min[ax] - 1; }
+                    if (_fullSlab(slab, diambase, pv)) { ext.min[ax] = std::min<int64>(ext.min[ax], slab.min[ax]); ext.max[ax] = std::max<int64>(ext.max[ax], slab.max[ax]); }
+                    }
+                const int64 lext = ext.boundaryDist(pos);
+                if (lext > lbest) { bestRect = ext; lbest = lext; }
+                if (diambase == (2 * R + 1)) return pv; // already at the bottom level, we stop
+                const int64 nrad = (diambase - 3) / 6;  // radius of a sub-box of baseRect
+                const int64 off = (2 * nrad + 1);
+                const Pos basecenter = baseRect.center();
+                Pos newcenter;
+                for (size_t i = 0; i < D; i++)
+                    {
+                    const int64 diff = pos[i] - basecenter[i];
+                    newcenter[i] = basecenter[i] + ((diff < -nrad) ? -off : ((diff > nrad) ? off : 0));
+                    }
+                if (newcenter == basecenter) { return pv; } // same center: going further down will not improve the solution so we stop
+                for (size_t i = 0; i < D; i++) { baseRect.min[i] = newcenter[i] - nrad; baseRect.max[i] = newcenter[i] + nrad; }
+                }
+            }
 
 
-
-
-        /***************************************************************
-        * Private section
-        ***************************************************************/
-
-    private:
-
-        /* Make sure template parameters are OK */
-        static_assert(NB_SPECIAL > 0, "the number of special objects must be > 0, use Grid_basic otherwise.");
-        static_assert(D > 0, "template parameter D (dimension) must be non-zero");
-        static_assert(R > 0, "template parameter R (radius) must be non-zero");
-        static_assert(std::is_constructible<T>::value || std::is_constructible<T, Pos>::value, "The object T must either be default constructible T() or constructible with T(const Pos &)");
-        static_assert(std::is_copy_constructible<T>::value, "The object T must be copy constructible T(const T&).");
-        static_assert(std::is_convertible<T, int64>::value, "The object T must be convertible to int64");
-        static_assert(metaprog::has_assignementOperator<T>::value, "The object T must be assignable via operator=()");
-
-
+        /* Used by findFullBoxCentered (dimension D != 2). Check that all the boxes of diameter diam
+         * (aligned with the grid structure) which tile the box slab are full with value pv. */
+        inline bool _fullSlab(const iBox<D> & slab, const int64 diam, const T * pv) const
+            {
+            Pos c;
+            for (size_t i = 0; i < D; i++) { c[i] = slab.min[i] + diam / 2; }
+            while (1)
+                {
+                iBox<D> RR;
+                if ((findFullBox(c, RR) != pv) || (RR.lx() + 1 < diam)) return false; // box too small or with another value
+                size_t i = 0;
+                while ((i < D) && ((c[i] += diam) > slab.max[i])) { c[i] = slab.min[i] + diam / 2; i++; }
+                if (i == D) return true;
+                }
+            }
 
 
         /* Used by findFullBoxCentered (2D specialization). Check if a given border adjacent box of same size is full. */
@@ -1468,6 +2324,34 @@ namespace mtools
             }
 
 
+        /* update the get() cache hit counters (only when profiling is enabled) */
+        inline void _countGet(bool hit) const
+            {
+#if (MTOOLS_USE_PROFILING)
+            _statGets.fetch_add(1, std::memory_order_relaxed);
+            if (hit) _statHits.fetch_add(1, std::memory_order_relaxed);
+#else
+            (void)hit;
+#endif
+            }
+
+
+        /* count the factorized subtrees and fill the depth histogram of the subtree p at depth d */
+        void _statsWalk(_pbox p, size_t d, GridStats & st) const
+            {
+            if (p == nullptr) return;
+            const bool special = (_getSpecialObject(p) != nullptr);
+            if (special) st.nbFactorized++;
+            if ((special) || (p->isLeaf()))
+                {
+                if (st.depthHistogram.size() <= d) st.depthHistogram.resize(d + 1, 0);
+                st.depthHistogram[d]++;
+                return;
+                }
+            for (size_t i = 0; i < metaprog::power<3, D>::value; ++i) { _statsWalk(((_pnode)p)->tab[i], d + 1, st); }
+            }
+
+
         /* print the tree, for debug purpose only */
         std::string _printTree(_pbox p, std::string tab) const
             {
@@ -1490,30 +2374,248 @@ namespace mtools
             }
 
 
-        /* update _rangemin and _rangemax */
+        /* update _rangemin and _rangemax. The stores are atomic since the concurrent methods read the
+         * bounds without lock (the method itself must be called under _allocmut in concurrent mode) */
         inline void _updatePosRange(const Pos & pos) const
             {
             for (size_t i = 0; i < D; i++) 
                 {
-                const int64 x = pos[i];
-                if (x < _rangemin[i]) { _rangemin[i] = x; }  
-                if (x > _rangemax[i]) { _rangemax[i] = x; }
+                const int64 x = pos[i];
+                if (x < _rangemin[i]) { _atomicBound(_rangemin[i]).store(x, std::memory_order_relaxed); }
+                if (x > _rangemax[i]) { _atomicBound(_rangemax[i]).store(x, std::memory_order_relaxed); }
+                }
+            }
+
+
+        /* update _minVal and _maxVal. Same remark as for _updatePosRange() */
+        inline void _updateValueRange(int64 v) const
+            {
+            if (v < _minVal) _atomicBound(_minVal).store(v, std::memory_order_relaxed);
+            if (v > _maxVal) _atomicBound(_maxVal).store(v, std::memory_order_relaxed);
+            }
+
+
+        /* atomic access to one of the bounds _rangemin, _rangemax, _minVal, _maxVal (used by the concurrent methods) */
+        inline static std::atomic<int64> & _atomicBound(int64 & x)
+            {
+            static_assert((sizeof(std::atomic<int64>) == sizeof(int64)) && (alignof(std::atomic<int64>) == alignof(int64)), "std::atomic<int64> must have the same layout as int64");
+            return reinterpret_cast<std::atomic<int64>&>(x);
+            }
+
+
+        /* atomic read of a pointer in the tree (used by the concurrent methods) */
+        inline static _pbox _loadLink(_pbox & link) { return reinterpret_cast<std::atomic<_pbox>&>(link).load(std::memory_order_acquire); }
+
+
+        /* atomic write of a pointer in the tree (used by the concurrent methods) */
+        inline static void _storeLink(_pbox & link, _pbox p) { reinterpret_cast<std::atomic<_pbox>&>(link).store(p, std::memory_order_release); }
+
+
+        /* Concurrent version of _get()/_set(): return a pointer to the element at pos, creating it if needed
+         * and never factorizing the tree. If the site belongs to a factorized region, the special object is 
+         * returned when expand = false. When expand = true, the region is expanded (unless its special value 
+         * is nv in which case nullptr is returned) so that the pointer returned is always a leaf cell. */
+        T * _concurrentAccess(const Pos & pos, void* & hint, bool expand, int64 nv, _pleafFactor & leaf) const
+            {
+            static_assert(sizeof(std::atomic<_pbox>) == sizeof(_pbox), "std::atomic<_pbox> must have the same size as _pbox");
+            _updatePosRangeConcurrent(pos);
+            _pbox c = (_pbox)hint;
+            if (c == nullptr) { c = _pcurrent; }
+            if (c->isLeaf())
+                {
+                if (((_pleafFactor)c)->isInBox(pos)) { leaf = (_pleafFactor)c; return(&(leaf->get(pos))); }
+                c = c->father;
+                }
+            // going up...
+            _pnode q = (_pnode)c;
+            while (!q->isInBox(pos))
+                {
+                _pbox f = _loadLink(q->father);
+                if (f == nullptr)
+                    { // create a new root
+                    std::lock_guard<std::mutex> lock(_allocmut);
+                    f = q->father;
+                    if (f == nullptr) { f = _allocateNode(q); _storeLink(q->father, f); }
+                    }
+                q = (_pnode)f;
+                }
+            // ...and down
+            while (1)
+                {
+                _pbox & link = q->getSubBox(pos);
+                _pbox b = _loadLink(link);
+                if ((b == nullptr) || (expand && (_getSpecialObject(b) != nullptr) && (_getSpecialValue(b) != nv)))
+                    { // we must create (or expand) the sub-box
+                    std::lock_guard<std::mutex> lock(_allocmut);
+                    b = link; // read again, the sub-box may have been created in the meantime
+                    if (b == nullptr)
+                        {
+                        if (q->rad == R) { b = _allocateLeaf(q, q->subBoxCenter(pos)); } else { b = _allocateNode(q, q->subBoxCenter(pos), nullptr); }
+                        _storeLink(link, b);
+                        }
+                    else
+                        {
+                        T * obj = _getSpecialObject(b);
+                        if ((expand) && (obj != nullptr) && (_getSpecialValue(b) != nv))
+                            {
+                            if (q->rad == R) { b = _allocateLeafCst(q, q->subBoxCenter(pos), obj, _getSpecialValue(b)); } else { b = _allocateNode(q, q->subBoxCenter(pos), b); }
+                            _storeLink(link, b);
+                            }
+                        }
+                    }
+                T * obj = _getSpecialObject(b);
+                if (obj != nullptr) { hint = q; return (expand ? nullptr : obj); }
+                if (b->isLeaf()) { hint = (_bgActive ? (_pbox)q : b); leaf = (_pleafFactor)b; return(&(leaf->get(pos))); } // never keep a leaf as cursor if it may be released
+                q = (_pnode)b;
+                }
+            }
+
+
+        /* update _rangemin and _rangemax, concurrent version: the bounds are read atomically and the lock 
+         * is only taken when the range increases (_updatePosRange() checks again under the lock) */
+        inline void _updatePosRangeConcurrent(const Pos & pos) const
+            {
+            for (size_t i = 0; i < D; i++)
+                {
+                const int64 x = pos[i];
+                if ((x < _atomicBound(_rangemin[i]).load(std::memory_order_relaxed)) || (x > _atomicBound(_rangemax[i]).load(std::memory_order_relaxed))) { std::lock_guard<std::mutex> lock(_allocmut); _updatePosRange(pos); return; }
+                }
+            }
+
+
+        /* atomic access to a flag of a leaf (used by the concurrent methods) */
+        inline static std::atomic<char> & _atomicFlag(char & c) { return reinterpret_cast<std::atomic<char>&>(c); }
+
+
+        /* enter a read side critical section of the background factorization: register the thread in
+         * the counter of the current epoch and return it. The counter must be decremented on exit. */
+        inline std::atomic<int64> * _bgEnter() const
+            {
+            static thread_local const size_t stripe = std::hash<std::thread::id>()(std::this_thread::get_id()) % _BG_STRIPES;
+            while (1)
+                {
+                const uint64 e = _bgEpoch.load();
+                std::atomic<int64> * c = &(_bgReaders[e & 1][stripe].nb);
+                c->fetch_add(1);
+                if (_bgEpoch.load() == e) return c;
+                c->fetch_sub(1); // the epoch changed in the meantime
+                }
+            }
+
+
+        /* wait until all the threads which entered a critical section before the call have left it */
+        void _bgSynchronize()
+            {
+            const uint64 e = _bgEpoch.fetch_add(1);
+            while (1)
+                {
+                int64 n = 0;
+                for (size_t i = 0; i < _BG_STRIPES; i++) { n += _bgReaders[e & 1][i].nb.load(); }
+                if (n == 0) return;
+                std::this_thread::yield();
+                }
+            }
+
+
+        /* main loop of the background factorization thread */
+        void _bgLoop()
+            {
+            std::vector<_pleafFactor> limbo;
+            while (!_bgStop)
+                {
+                _pbox root = _pcurrent;
+                _pbox f;
+                while ((f = _loadLink(root->father)) != nullptr) { root = f; }
+                _bgFactorizeTree((_pnode)root, limbo);
+                if (limbo.size() > 0)
+                    { // release the leaves factorized during this pass once no thread can access them anymore
+                    _bgSynchronize();
+                    std::lock_guard<std::mutex> lock(_allocmut);
+                    for (auto L : limbo) { _releaseLeaf(L); }
+                    limbo.clear();
+                    }
+                for (int t = 0; (t < _bgInterval) && (!_bgStop); t += 5) { std::this_thread::sleep_for(std::chrono::milliseconds(std::min<int>(5, _bgInterval - t))); }
+                }
+            }
+
+
+        /* one pass of the background thread over the sub-tree of N. The leaves replaced by special nodes are
+         * added to limbo */
+        void _bgFactorizeTree(_pnode N, std::vector<_pleafFactor> & limbo)
+            {
+            for (size_t i = 0; i < metaprog::power<3, D>::value; ++i)
+                {
+                _pbox b = _loadLink(N->tab[i]);
+                if ((b == nullptr) || (_getSpecialObject(b) != nullptr)) continue;
+                if (!b->isLeaf()) { _bgFactorizeTree((_pnode)b, limbo); continue; }
+                if (_bgFactorizeLeaf(N->tab[i], (_pleafFactor)b)) { limbo.push_back((_pleafFactor)b); _bgNbFactorized++; }
+                }
+            }
+
+
+        /* check if the sites of a leaf all have the same special value. If so, return true and put a copy 
+         * of the value in obj */
+        bool _bgUniform(_pleafFactor L, T & obj) const
+            {
+            obj = reinterpret_cast<std::atomic<T>*>(L->data)->load(std::memory_order_acquire);
+            const int64 v = (int64)obj;
+            if (!_isSpecial(v)) return false;
+            for (size_t i = 1; i < metaprog::power<(2 * R + 1), D>::value; ++i)
+                {
+                if ((int64)(reinterpret_cast<std::atomic<T>*>(L->data + i)->load(std::memory_order_relaxed)) != v) return false;
+                }
+            return true;
+            }
+
+
+        /* try to replace the leaf L (linked from link) by a special node. Return true if done.
+         * A writer stores its value, then checks L->retired. We set L->retired, then check the values
+         * again: with the fences, either we see the new value or the writer sees the flag and waits
+         * until we are done to write again at the new location (cf. concurrentSet()). */
+        bool _bgFactorizeLeaf(_pbox & link, _pleafFactor L)
+            {
+            if (_atomicFlag(L->hot).exchange(0, std::memory_order_relaxed) != 0) return false; // written recently
+            T obj;
+            if (!_bgUniform(L, obj)) return false;
+            _atomicFlag(L->retired).store(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            T obj2;
+            if ((!_bgUniform(L, obj2)) || ((int64)obj2 != (int64)obj))
+                {
+                _atomicFlag(L->retired).store(0, std::memory_order_release);
+                return false;
+                }
+                {
+                std::lock_guard<std::mutex> lock(_allocmut);
+                _storeLink(link, _setSpecial((int64)obj2, &obj2));
                 }
+            _atomicFlag(L->retired).store(2, std::memory_order_release);
+            return true;
             }
 
 
-        /* update _minVal and _maxVal */
-        inline void _updateValueRange(int64 v) const
+        /* reset the flags used by the background factorization in all the leaves of the tree */
+        void _bgResetLeafs(_pbox p)
+            {
+            if (p == nullptr) return;
+            while (p->father != nullptr) { p = p->father; }
+            _bgResetLeafsSub(p);
+            }
+
+        void _bgResetLeafsSub(_pbox p)
             {
-            if (v < _minVal) _minVal = v;
-            if (v > _maxVal) _maxVal = v;
+            if ((p == nullptr) || (_getSpecialObject(p) != nullptr)) return;
+            if (p->isLeaf()) { ((_pleafFactor)p)->hot = 0; ((_pleafFactor)p)->retired = 0; return; }
+            for (size_t i = 0; i < metaprog::power<3, D>::value; ++i) { _bgResetLeafsSub(((_pnode)p)->tab[i]); }
             }
 
 
+
         /* set the object at a given position.
         * keep the tree consistent and simplified */
         inline void _set(const Pos & pos, const T * val)
             {
+            _changes.record(pos);
             _pbox pc = _pcurrent;
             MTOOLS_ASSERT(pc != nullptr);
             _updatePosRange(pos);
@@ -1600,11 +2702,13 @@ namespace mtools
                 if (((_pleafFactor)pc)->isInBox(pos)) 
                         { 
                         MTOOLS_ASSERT(_isLeafFull((_pleafFactor)pc) == (_maxSpec + 1)); // the leaf cannot be full
+                        _countGet(true);
                         return(((_pleafFactor)pc)->get(pos)); 
                         }
                 MTOOLS_ASSERT(pc->father != nullptr); // a leaf must always have a father
                 pc = pc->father;
                 }
+            _countGet(false);
             // going up...
             _pnode q = (_pnode)pc;
             while (!q->isInBox(pos))
@@ -1679,6 +2783,7 @@ namespace mtools
         /* Reset the object */
         void _reset()
             {
+            _changes.all();
             _poolNode.deallocateAll();
             if (_callDtors)
                 {
@@ -1692,6 +2797,7 @@ namespace mtools
                 }
             _pcurrent = nullptr;
             _pcurrentpeek = nullptr;
+            for (auto & e : _leafIndexTab) { e.leaf = nullptr; }
             _rangemin.clear(std::numeric_limits<int64>::max());
             _rangemax.clear(std::numeric_limits<int64>::min());
             
@@ -1701,6 +2807,8 @@ namespace mtools
             memset(_tabSpecObj, 0, sizeof(_tabSpecObj));
             memset(_tabSpecNB, 0, sizeof(_tabSpecNB));
             _nbNormalObj = 0;
+            _deltaFull = true;
+            _deltaSpecial.clear();
             return;
             }
 
@@ -1712,6 +2820,251 @@ namespace mtools
         ***************************************************************/
 
 
+        /* serialize the beginning of the archive, up to the grid tree
+           used by serialize() and saveParallel() */
+        void _serializeHead(OBaseArchive & ar) const
+            {
+            ar << "\nBegining of Grid_factor<" << D << " , [" << std::string(typeid(T).name()) << "] , " << NB_SPECIAL << " , " << R << ">\n";
+            ar << "Version";    ar & ((uint64)1); ar.newline();
+            ar << "Template D"; ar & ((uint64)D); ar.newline();
+            ar << "Template R"; ar & ((uint64)R); ar.newline();
+            ar << "object T";   ar & std::string(typeid(T).name()); ar.newline();
+            ar << "sizeof(T)";  ar & ((uint64)sizeof(T)); ar.newline();
+            ar << "call dtors"; ar & (_callDtors); ar.newline();
+            ar << "_rangemin";  ar & _rangemin; ar.newline();
+            ar << "_rangemax";  ar & _rangemax; ar.newline();
+            ar << "_minSpec";   ar & _minSpec; ar.newline();
+            ar << "_maxSpec";   ar & _maxSpec; ar.newline();
+            ar << "List of special objects\n";
+            for (int64 i = 0; i < _specialRange(); i++)
+                {
+                ar << "Object (" << _minSpec + i << ")";
+                if (_tabSpecObj[i] == nullptr) { ar & false; } else { ar & true; ar & (*_tabSpecObj[i]); }
+                ar.newline();
+                }
+            ar << "Grid tree\n";
+            }
+
+
+        /* serialize the end of the archive, after the grid tree
+           used by serialize() and saveParallel() */
+        void _serializeTail(OBaseArchive & ar) const
+            {
+            ar << "\nEnd of Grid_factor<" << D << " , [" << std::string(typeid(T).name()) << "] , " << NB_SPECIAL << " , " << R << ">\n";
+            }
+
+
+        /* deserialize the beginning of the archive, up to the grid tree. The object is reset first
+           and the root node is not created. used by deserialize() and loadBox() */
+        void _deserializeHead(IBaseArchive & ar)
+            {
+            _reset(-1, 0, true); // reset the object, do not create the root node
+            uint64 ver;         ar & ver;      if (ver != 1) { MTOOLS_THROW("wrong version");}
+            uint64 d;           ar & d;        if (d != D) { MTOOLS_THROW("wrong dimension");}
+            uint64 r;           ar & r;        if (r != R) { MTOOLS_THROW("wrong R parameter");}
+            std::string stype;  ar & stype;
+            uint64 sizeofT;     ar & sizeofT;  if (sizeofT != sizeof(T)) { MTOOLS_THROW("wrong sizeof(T)");}
+            ar & _callDtors;
+            ar & _rangemin;
+            ar & _rangemax;
+            ar & _minSpec;
+            ar & _maxSpec;
+            if (((int64)NB_SPECIAL) < _specialRange()) { MTOOLS_THROW("NB_SPECIAL too small to fit all special values");}
+            for (int64 i = 0; i < _specialRange(); i++)
+                {
+                bool b; ar & b;
+                if (b)
+                    {
+                    _tabSpecObj[i] = _poolSpec.allocate();      // allocate the memory
+                    _deserializeObjectT(ar, _tabSpecObj[i]);    // deserialize the object
+                    MTOOLS_ASSERT((((int64)(*(_tabSpecObj[i]))) == (i + _minSpec)));
+                    }
+                }
+            }
+
+
+        /* load a block of an indexed file (cf. loadBox()): set the sites of a leaf or insert a special
+           sub-box of half-width rad (the tree must not contain any site of the block) */
+        void _loadIndexedBlock(const MappedFile & F, const internals_grid::_tileIndexEntry & E, uint64 indexoffset, const Pos & fmin, const Pos & fmax)
+            {
+            const Pos center = internals_grid::_tileCenter<D>(E.key, (int64)E.rad);
+            if (E.size == 0)
+                { // special sub-box
+                const int64 val = (int64)E.offset;
+                if ((!_isSpecial(val)) || (_tabSpecObj[val - _minSpec] == nullptr)) { MTOOLS_THROW("invalid special value in the index"); }
+                _pnode q = (_pnode)_getRoot();
+                while ((q->rad < E.rad) || (!q->isInBox(center)))
+                    { // going up...
+                    if (q->father == nullptr) { q->father = _allocateNode(q); }
+                    q = (_pnode)q->father;
+                    }
+                while (q->rad > E.rad)
+                    { // ...and down
+                    _pbox & b = q->getSubBox(center);
+                    if (b == nullptr) { b = _allocateNode(q, q->subBoxCenter(center), nullptr); }
+                    MTOOLS_ASSERT((_getSpecialObject(b) == nullptr) && (!b->isLeaf()));
+                    q = (_pnode)b;
+                    }
+                if (q->rad != E.rad) { MTOOLS_THROW("invalid block size in the index"); }
+                _pbox & b = q->getSubBox(center);
+                if (b != nullptr)
+                    { // only empty nodes created on the way to other blocks (e.g. the base node) may be there
+                    _releasePlaceholder(b);
+                    _pbox r = q; while (r->father != nullptr) { r = r->father; }
+                    _pcurrent = r; // _pcurrent may have been released
+                    _pcurrentpeek = r;
+                    }
+                b = _getSpecialNode(val);
+                _updateValueRange(val);
+                int64 pow = 1; for (size_t i = 0; i < D; i++) { pow *= (2 * (int64)E.rad + 1); }
+                _tabSpecNB[val - _minSpec] += pow;
+                Pos a, c;
+                for (size_t i = 0; i < D; i++)
+                    { // the sites accessed in the sub-box
+                    a[i] = std::max<int64>(center[i] - (int64)E.rad, fmin[i]);
+                    c[i] = std::min<int64>(center[i] + (int64)E.rad, fmax[i]);
+                    if (a[i] > c[i]) return;
+                    }
+                _updatePosRange(a);
+                _updatePosRange(c);
+                return;
+                }
+            if ((E.rad != R) || (E.offset > indexoffset) || (E.size > indexoffset - E.offset)) { MTOOLS_THROW("invalid leaf in the index"); }
+            IStringArchive ar(F.data() + E.offset, (size_t)E.size);
+            typename std::aligned_storage<sizeof(T), std::alignment_of<T>::value>::type buf;
+            T * obj = (T*)(&buf);
+            Pos pos = center;
+            for (size_t i = 0; i < D; ++i) { pos[i] -= R; } // go to the first cell
+            for (size_t x = 0; x < metaprog::power<(2 * R + 1), D>::value; ++x)
+                {
+                _deserializeObjectT(ar, obj);
+                _set(pos, obj);
+                obj->~T();
+                for (size_t i = 0; i < D; ++i) { if (pos[i] < (center[i] + (int64)R)) { pos[i]++;  break; } pos[i] -= (2 * R); } // move to the next cell.
+                }
+            }
+
+
+        /* release a subtree made only of empty nodes (used by _loadIndexedBlock()) */
+        void _releasePlaceholder(_pbox p)
+            {
+            if (p == nullptr) return;
+            if ((_getSpecialObject(p) != nullptr) || (p->isLeaf())) { MTOOLS_THROW("overlapping blocks in the index"); }
+            for (size_t i = 0; i < metaprog::power<3, D>::value; ++i) { _releasePlaceholder(((_pnode)p)->tab[i]); }
+            _releaseNode((_pnode)p);
+            }
+
+
+        /* serialize the dirty leafs of the subtree starting at p */
+        void _serializeDirty(OBaseArchive & ar, _pbox p) const
+            {
+            if ((p == nullptr) || (_getSpecialObject(p) != nullptr)) return;
+            if (p->isLeaf())
+                {
+                if (((_pleafFactor)p)->dirty == 0) return;
+                ar & ((char)'L');
+                ar & p->center;
+                for (size_t i = 0; i < metaprog::power<(2 * R + 1), D>::value; ++i) { ar & (((_pleafFactor)p)->getRowMajor(i)); }
+                ar.newline();
+                return;
+                }
+            for (size_t i = 0; i < metaprog::power<3, D>::value; ++i) { _serializeDirty(ar, ((_pnode)p)->tab[i]); }
+            }
+
+
+        /* clear the dirty flags of the subtree starting at p */
+        void _clearDirty(_pbox p)
+            {
+            if ((p == nullptr) || (_getSpecialObject(p) != nullptr)) return;
+            if (p->isLeaf()) { ((_pleafFactor)p)->dirty = 0; return; }
+            for (size_t i = 0; i < metaprog::power<3, D>::value; ++i) { _clearDirty(((_pnode)p)->tab[i]); }
+            }
+
+
+        /* add the blocks of the subtree starting at p (not special) to vec */
+        void _collectLeafs(_pbox p, std::vector<LeafSpan> & vec) const
+            {
+            LeafSpan L;
+            if (p->isLeaf())
+                {
+                for (size_t i = 0; i < D; i++) { L.box.min[i] = p->center[i] - (int64)R; L.box.max[i] = p->center[i] + (int64)R; }
+                L.data = ((_pleafFactor)p)->data; L.special = false;
+                vec.push_back(L);
+                return;
+                }
+            _pnode q = (_pnode)p;
+            for (size_t j = 0; j < metaprog::power<3, D>::value; ++j)
+                {
+                _pbox b = q->tab[j];
+                if (b == nullptr) continue;
+                T * obj = _getSpecialObject(b);
+                if (obj == nullptr) { _collectLeafs(b, vec); continue; }
+                const Pos c = q->subBoxCenterFromIndex(j);
+                for (size_t i = 0; i < D; i++) { L.box.min[i] = c[i] - (int64)q->rad; L.box.max[i] = c[i] + (int64)q->rad; }
+                L.data = obj; L.special = true;
+                vec.push_back(L);
+                }
+            }
+
+
+        /* count the number of dirty leafs in the subtree starting at p */
+        size_t _countDirty(_pbox p) const
+            {
+            if ((p == nullptr) || (_getSpecialObject(p) != nullptr)) return 0;
+            if (p->isLeaf()) { return ((((_pleafFactor)p)->dirty != 0) ? 1 : 0); }
+            size_t nb = 0;
+            for (size_t i = 0; i < metaprog::power<3, D>::value; ++i) { nb += _countDirty(((_pnode)p)->tab[i]); }
+            return nb;
+            }
+
+
+        /* serialize the header of a node (without its sub-boxes) */
+        void _serializeNodeHead(OBaseArchive & ar, _pbox p) const
+            {
+            ar & ((char)'N');
+            ar & p->center;
+            ar & p->rad;
+            ar.newline();
+            }
+
+
+        /* chunk of the tree used for parallel serialization: list of (box, true) for a whole subtree
+           and (box, false) for the header of a node only, in the same order as _serializeTree() */
+        typedef std::vector< std::pair<_pbox, bool> > _serialChunk;
+
+
+        /* split the tree into chunks such that serializing them in order is equivalent to _serializeTree(root).
+           Each chunk ends with a non-trivial subtree. Go down until there are enough chunks for nbThreads. */
+        void _splitTree(std::vector<_serialChunk> & chunks, size_t nbThreads) const
+            {
+            for (size_t depth = 1; ; depth++)
+                {
+                chunks.clear();
+                chunks.push_back(_serialChunk());
+                bool deeper = false;
+                _splitTree(chunks, _getRoot(), depth, deeper);
+                if (chunks.back().size() == 0) { chunks.pop_back(); }
+                if ((!deeper) || (chunks.size() >= 8 * nbThreads) || (depth >= 32)) { return; }
+                }
+            }
+
+
+        /* recursive part of _splitTree() */
+        void _splitTree(std::vector<_serialChunk> & chunks, _pbox p, size_t depth, bool & deeper) const
+            {
+            if ((p == nullptr) || (_getSpecialObject(p) != nullptr)) { chunks.back().push_back(std::pair<_pbox, bool>(p, true)); return; } // trivial subtree
+            if ((p->isLeaf()) || (depth == 0))
+                {
+                if (!p->isLeaf()) { deeper = true; }
+                chunks.back().push_back(std::pair<_pbox, bool>(p, true));
+                chunks.push_back(_serialChunk()); // start a new chunk
+                return;
+                }
+            chunks.back().push_back(std::pair<_pbox, bool>(p, false));
+            for (size_t i = 0; i < metaprog::power<3, D>::value; ++i) { _splitTree(chunks, ((_pnode)p)->tab[i], depth - 1, deeper); }
+            }
+
+
         /* recursive method for serialization of the tree 
            used by serialize() */
             void _serializeTree(OBaseArchive & ar, _pbox p) const
@@ -1729,14 +3082,11 @@ namespace mtools
                 ar & ((char)'L');
                 ar & p->center;
                 ar & p->rad;
-                for (size_t i = 0; i < metaprog::power<(2 * R + 1), D>::value; ++i) { ar & (((_pleafFactor)p)->data[i]); }
+                for (size_t i = 0; i < metaprog::power<(2 * R + 1), D>::value; ++i) { ar & (((_pleafFactor)p)->getRowMajor(i)); } // always saved in row-major order
                 ar.newline();
                 return;
                 }
-            ar & ((char)'N');
-            ar & p->center;
-            ar & p->rad;
-            ar.newline();
+            _serializeNodeHead(ar, p);
             for (size_t i = 0; i < metaprog::power<3, D>::value; ++i) { _serializeTree(ar, ((_pnode)p)->tab[i]); }
             return;
             }
@@ -1782,9 +3132,22 @@ namespace mtools
         _pbox _copyTreeFromGridBasic(_pbox father, _pbox p)
             {
             MTOOLS_ASSERT(p != nullptr);
+            if (p->isSparse())
+                { // we must copy a sparse leaf: the sites which do not exist are created
+                _pleafFactor F = _poolLeaf.allocate();
+                F->dirty = 1;
+                F->center = p->center;
+                F->rad = 1;
+                F->father = father;
+                memset(F->count, 0, sizeof(F->count)); // reset the number of each type of special object
+                Grid_basic<D, T, R, LAYOUT>::_fillFromSparse((typename Grid_basic<D, T, R, LAYOUT>::_psparse)p, F, [](void * dst, T * src) { new(dst) T(*src); });
+                _nbNormalObj += metaprog::power<(2 * R + 1), D>::value;
+                return F;
+                }
             if (p->isLeaf())
                 { // we must copy a leaf
                 _pleafFactor F = _poolLeaf.allocate();
+                F->dirty = 1;
                 F->center = p->center;
                 F->rad = p->rad;
                 F->father = father;
@@ -1809,7 +3172,7 @@ namespace mtools
 
         /* recursive method for copying a tree from G
         * used by operator=() */
-        template<size_t NB_SPECIAL2> _pbox _copyTree(_pbox father, _pbox p, const Grid_factor<D, T, NB_SPECIAL2, R> & G)
+        template<size_t NB_SPECIAL2> _pbox _copyTree(_pbox father, _pbox p, const Grid_factor<D, T, NB_SPECIAL2, R, LAYOUT> & G)
             {
             MTOOLS_ASSERT(p != nullptr);
             if (G._getSpecialObject(p) != nullptr)
@@ -1820,6 +3183,7 @@ namespace mtools
             if (p->isLeaf())
                 { // we must copy a leaf
                 _pleafFactor F = _poolLeaf.allocate();
+                F->dirty = 1;
                 F->center = p->center;
                 F->rad = p->rad;
                 F->father = father;
@@ -1846,6 +3210,76 @@ namespace mtools
             }
 
 
+        /* Walk the tree below N (with the current special range) for changeSpecialRange():
+         * - special sub-boxes whose value is in [newMin,newMax] are re-labeled with their new offset,
+         * - the other ones are expanded. The leafs created are only allocated and pushed in fills
+         *   (with the object to copy) so they can be filled in parallel,
+         * - the existing leafs are pushed in leafs. */
+        void _rangeWalk(_pnode N, int64 newMin, int64 newMax, std::vector<_pleafFactor> & leafs, std::vector<std::pair<_pleafFactor, T*> > & fills)
+            {
+            for (size_t i = 0; i < metaprog::power<3, D>::value; ++i)
+                {
+                const _pbox K = N->tab[i];
+                if (K == nullptr) continue;
+                T * pv = _getSpecialObject(K);
+                if (pv == nullptr)
+                    {
+                    if (K->isLeaf()) { leafs.push_back((_pleafFactor)K); } else { _rangeWalk((_pnode)K, newMin, newMax, leafs, fills); }
+                    continue;
+                    }
+                const int64 v = _getSpecialValue(K);
+                if ((v >= newMin) && (v <= newMax)) { N->tab[i] = _dummyNodes + (v - newMin); continue; } // still special: re-label
+                if (N->rad > R)
+                    { // expand into a node and recurse
+                    N->tab[i] = _allocateNode(N, N->subBoxCenterFromIndex(i), K);
+                    _rangeWalk((_pnode)(N->tab[i]), newMin, newMax, leafs, fills);
+                    continue;
+                    }
+                _pleafFactor pleaf = _poolLeaf.allocate(); // the objects are created later
+                pleaf->dirty = 1;
+                pleaf->hot = 1;
+                pleaf->retired = 0;
+                pleaf->center = N->subBoxCenterFromIndex(i);
+                pleaf->rad = 1;
+                pleaf->father = N;
+                N->tab[i] = pleaf;
+                fills.push_back(std::pair<_pleafFactor, T*>(pleaf, pv));
+                }
+            }
+
+
+        /* Rebase the count array of a leaf from the special range [oldMin,oldMax] to [newMin,newMax]
+         * (empty range when max < min). The objects are scanned only if the leaf contains normal
+         * objects and the new range contains values outside the old one. The number of objects
+         * becoming special is added to entered[]. */
+        void _rebaseLeaf(_pleafFactor L, int64 oldMin, int64 oldMax, int64 newMin, int64 newMax, uint64 * entered) const
+            {
+            const size_t SIZE = metaprog::power<(2 * R + 1), D>::value;
+            size_t cnt[NB_SPECIAL];
+            memset(cnt, 0, sizeof(cnt));
+            size_t nbspec = 0;
+            for (int64 v = oldMin; v <= oldMax; v++)
+                {
+                const size_t c = L->count[v - oldMin];
+                nbspec += c;
+                if ((c != 0) && (v >= newMin) && (v <= newMax)) { cnt[v - newMin] = c; }
+                }
+            const bool newValues = (newMin < oldMin) || (newMax > oldMax) || (oldMax < oldMin);
+            if ((newValues) && (nbspec < SIZE) && (newMax >= newMin))
+                { // some normal objects may become special
+                for (size_t x = 0; x < SIZE; ++x)
+                    {
+                    const int64 val = (int64)(L->data[x]);
+                    if ((val < newMin) || (val > newMax)) continue;
+                    if ((val >= oldMin) && (val <= oldMax)) continue; // already counted
+                    cnt[val - newMin]++;
+                    entered[val - newMin]++;
+                    }
+                }
+            memcpy(L->count, cnt, sizeof(cnt));
+            }
+
+
         /* expand the whole tree 
          * _pcurrent is set to the root of the tree
          */
@@ -2055,6 +3489,7 @@ namespace mtools
          * - Return the leaf or the first node above */
         inline _pbox _setLeafValue(const T * obj, const Pos & pos, _pleafFactor leaf)
             {
+            leaf->dirty = 1;
             T * oldobj = &(leaf->get(pos));     // the previous object
             int64 oldvalue = (int64)(*oldobj);  // the previous object value
             int64 value = (int64)(*obj);        // the new object value
@@ -2083,6 +3518,7 @@ namespace mtools
             // old and new do not have the same value
             _updateValueRange(value); // possibly a new extreme value
             (*oldobj) = (*obj); // save the new value
+            if (_leafIndexTab.size() != 0) { _leafIndexUpdate(leaf, pos, metaprog::dummy<D == 2>()); }
             if (_isSpecial(oldvalue)) 
                 { //old value was special, decrement the global count and the leaf count 
                 auto off = oldvalue - _minSpec; 
@@ -2121,6 +3557,148 @@ namespace mtools
 
 
 
+        /* Implementation of findFullBox(). The tree is traversed from cp which is updated to point to the
+         * last box visited (the leaf containing pos when the box returned is a singleton). */
+        inline const T * _findFullBox(const Pos & pos, iBox<D> & outBox, _pbox & cp) const
+            {
+            Pos & boxMin = outBox.min;
+            Pos & boxMax = outBox.max;
+            // check if we are at the right place
+            if (cp->isLeaf())
+                {
+                _pleafFactor p = (_pleafFactor)(cp);
+                MTOOLS_ASSERT(_isLeafFull(p) == (_maxSpec + 1)); // the leaf cannot be full
+                if (p->isInBox(pos)) { boxMin = pos; boxMax = pos; return(&(p->get(pos))); } // just a singleton, box = [pos,pos]^d
+                MTOOLS_ASSERT(cp->father != nullptr); // a leaf must always have a father
+                cp = p->father;
+                }
+            // no, going up...
+            _pnode q = (_pnode)(cp);
+            while (!q->isInBox(pos))
+                {
+                if (q->father == nullptr) 
+                    { // the point is outside of largest boundary box
+                    int64 r = 3*q->rad + 1; 
+                    for (size_t i = 0; i < D; ++i)
+                        {
+                        int64 u = pos[i]; if (u < 0) {u = -u;}
+                        while(u > r) { r = 3*r + 1; }
+                        }
+                    // r is the radius of the box containing pos
+                    r = (r - 1) / 3;
+                    for (size_t i = 0; i < D; i++) 
+                        { 
+                        const int64 a = pos[i]; 
+                        const int64 sb =  ((a < -r) ? (-(2*r + 1)) : ((a > r) ? (2*r + 1) : 0)); 
+                        boxMin[i] = sb - r; boxMax[i] = sb + r; // TODO, we could find bigger if we just want a rectangle and not a square...
+                        }
+                    cp = q; 
+                    return nullptr; 
+                    } 
+                q = (_pnode)q->father;
+                }
+            // and down..
+            while (1)
+                {
+                _pbox b = q->getSubBox(pos);
+                if (b == nullptr) 
+                    { // subbox does not exist yet
+                    const int64 rad = q->rad;
+                    boxMin = q->subBoxCenter(pos);
+                    boxMax = boxMin;
+                    boxMin -= rad;
+                    boxMax += rad;
+                    cp = q; 
+                    return nullptr; 
+                    }
+                T * obj = _getSpecialObject(b); // check if the link is a special dummy link
+                if (obj != nullptr) 
+                        { // good we have full box
+                        const int64 rad = q->rad;
+                        boxMin = q->subBoxCenter(pos);
+                        boxMax = boxMin;
+                        boxMin -= rad; 
+                        boxMax += rad;
+                        cp = q;
+                        return obj;
+                        }
+                if (b->isLeaf())
+                    {
+                    boxMin = pos; boxMax = pos;
+                    cp = b;
+                    return(&(((_pleafFactor)b)->get(pos))); // just a singleton
+                    }
+                q = (_pnode)b;
+                }
+            }
+
+
+
+        /***************************************************************
+        * Leaf index
+        ***************************************************************/
+
+
+        /* discard the index of a leaf (if any) */
+        inline void _leafIndexInvalidate(const void * L) const
+            {
+            for (auto & e : _leafIndexTab) { if (e.leaf == L) { e.leaf = nullptr; } }
+            }
+
+
+        /* update the index of a leaf (if any) after the value at pos changed */
+        void _leafIndexUpdate(_pleafFactor leaf, const Pos & pos, metaprog::dummy<true> dum) const
+            {
+            for (auto & e : _leafIndexTab)
+                {
+                if (e.leaf == leaf)
+                    {
+                    const Pos c = leaf->center;
+                    e.update((size_t)(pos[0] - c[0] + (int64)R), (size_t)(pos[1] - c[1] + (int64)R), [&](size_t a, size_t b) { return (int64)(leaf->get(Pos(c[0] - (int64)R + (int64)a, c[1] - (int64)R + (int64)b))); });
+                    return;
+                    }
+                }
+            }
+
+        /* other dimensions: no index */
+        void _leafIndexUpdate(_pleafFactor leaf, const Pos & pos, metaprog::dummy<false> dum) const {}
+
+
+        /* memory used by the leaf index */
+        size_t _leafIndexMemory() const
+            {
+            size_t m = 0;
+            for (auto & e : _leafIndexTab) { m += e.memoryUsed(); }
+            return m;
+            }
+
+
+        /* dimension 2: use the leaf index */
+        void _leafFullBoxIndex(_pleafFactor leaf, const Pos & pos, iBox<D> & outBox, metaprog::dummy<true> dum) const
+            {
+            internals_grid::_leafIndex2<R> * E = nullptr;
+            for (auto & e : _leafIndexTab)
+                {
+                if (e.leaf == leaf) { E = &e; break; }
+                if ((E == nullptr) || ((E->leaf != nullptr) && ((e.leaf == nullptr) || (e.tick < E->tick)))) { E = &e; } // free or least recently used entry
+                }
+            if (E->leaf != (const void *)leaf)
+                { // build the index
+                const Pos c = leaf->center;
+                E->build(leaf, [&](size_t a, size_t b) { return (int64)(leaf->get(Pos(c[0] - (int64)R + (int64)a, c[1] - (int64)R + (int64)b))); });
+                }
+            E->tick = ++_leafIndexTick;
+            const size_t a = (size_t)(pos[0] - leaf->center[0] + (int64)R);
+            const size_t b = (size_t)(pos[1] - leaf->center[1] + (int64)R);
+            const int64 r = (int64)E->largestSquare(a, b);
+            for (size_t i = 0; i < D; i++) { outBox.min[i] = pos[i] - r; outBox.max[i] = pos[i] + r; }
+            }
+
+        /* other dimensions: no index */
+        void _leafFullBoxIndex(_pleafFactor leaf, const Pos & pos, iBox<D> & outBox, metaprog::dummy<false> dum) const {}
+
+
+
         /***************************************************************
         * Memory allocation : creating Nodes and Leafs
         ***************************************************************/
@@ -2153,6 +3731,8 @@ namespace mtools
             MTOOLS_ASSERT(L != nullptr); // the node must not be nullptr
             MTOOLS_ASSERT(_getSpecialObject(L) == nullptr); // the node must not be special
             MTOOLS_ASSERT(L->isLeaf());
+            if (!_deltaFull) { _deltaSpecial.push_back(std::pair<Pos, int64>(L->center, (int64)(*(L->data)))); } // the leaf is released because it is full of a special value
+            _leafIndexInvalidate(L);
             if (_callDtors) { _poolLeaf.destroy(L); } 
              _poolLeaf.deallocate(L);
             }
@@ -2185,8 +3765,8 @@ namespace mtools
             for (size_t i = 0; i < D; ++i) { pos[i] -= R; } // go to the first cell
             for (size_t x = 0; x < metaprog::power<(2 * R + 1), D>::value; ++x)
                 {
-                new(L->data + x) T(pos); // create the object using the positional constructor
-                ar &  (L->data[x]); // deserialize
+                new(L->ptrRowMajor(x)) T(pos); // create the object using the positional constructor
+                ar &  (L->getRowMajor(x)); // deserialize
                 for (size_t i = 0; i < D; ++i) { if (pos[i] < (L->center[i] + (int64)R)) { pos[i]++;  break; } pos[i] -= (2 * R); } // move to the next cell.
                 }
             return;
@@ -2198,8 +3778,8 @@ namespace mtools
             {
             for (size_t x = 0; x < metaprog::power<(2 * R + 1), D>::value; ++x)
                 {
-                new(L->data + x) T();  // create the object using the default constructor
-                ar &  (L->data[x]); // deserialize
+                new(L->ptrRowMajor(x)) T();  // create the object using the default constructor
+                ar &  (L->getRowMajor(x)); // deserialize
                 }
             return;
             }
@@ -2215,7 +3795,7 @@ namespace mtools
         /* deserialize data, use IBaseArchive constructor */
         inline void _deserializeDataLeaf(IBaseArchive & ar, _pleafFactor L, metaprog::dummy<true> dum)
             {
-            for (size_t i = 0; i < metaprog::power<(2 * R + 1), D>::value; ++i) { new(L->data + i) T(ar); }
+            for (size_t i = 0; i < metaprog::power<(2 * R + 1), D>::value; ++i) { new(L->ptrRowMajor(i)) T(ar); }
             }
 
 
@@ -2224,6 +3804,7 @@ namespace mtools
             {
             MTOOLS_ASSERT(father->rad == R);
             _pleafFactor L = _poolLeaf.allocate();
+            L->dirty = 1;
             L->father = father;
             ar & L->center;
             ar & L->rad;
@@ -2254,8 +3835,9 @@ namespace mtools
             for (size_t i = 0; i < D; ++i) { pos[i] -= R; } // go to the first cell
             for (size_t x = 0; x < metaprog::power<(2 * R + 1), D>::value; ++x)
                 {
-                new(pleaf->data + x) T(pos); // create using the positionnal constructor
-                int64 val = (int64)(*(pleaf->data + x)); // convert to int64
+                T * pt = pleaf->ptrRowMajor(x);
+                new(pt) T(pos); // create using the positionnal constructor
+                int64 val = (int64)(*pt); // convert to int64
                 _updateValueRange(val); // possibly a new extremum value
                 if (_isSpecial(val)) // check if it is a special value
                     { // yes
@@ -2295,6 +3877,9 @@ namespace mtools
         _pleafFactor _allocateLeaf(_pbox above, const Pos & centerpos) const
             {
             _pleafFactor p = _poolLeaf.allocate(); // allocate the memory
+            p->dirty = 1;
+            p->hot = 1;
+            p->retired = 0;
             _createDataLeaf(p, centerpos, metaprog::dummy<std::is_constructible<T, Pos>::value>()); // create the data
             p->center = centerpos;
             p->rad = 1;
@@ -2308,6 +3893,9 @@ namespace mtools
         _pleafFactor _allocateLeafCst(_pbox above, const Pos & centerpos, const T * obj, int64 value) const
             {
             _pleafFactor pleaf = _poolLeaf.allocate(); // allocate the memory
+            pleaf->dirty = 1;
+            pleaf->hot = 1;
+            pleaf->retired = 0;
             memset(pleaf->count, 0, sizeof(pleaf->count)); // reset the number of each type of special object 
             for (size_t i = 0; i < metaprog::power<(2 * R + 1), D>::value; ++i) { new(pleaf->data + i) T(*obj); } // init all objects with copy ctor
             MTOOLS_ASSERT(value == (int64)(*obj)); // make sure obj and value match
@@ -2451,9 +4039,22 @@ namespace mtools
         * Internal state
         ***************************************************************/
 
+        /* per-stripe counter of the threads inside a read side critical section (padded to avoid false sharing) */
+        struct _bgCounter
+            {
+            std::atomic<int64> nb;
+            char pad[64 - sizeof(std::atomic<int64>)];
+            };
+
+        static const size_t _BG_STRIPES = 16;   // number of stripes for the read side counters
+
         mutable std::recursive_mutex  _peekmut; // mutex used for safePeek().
+        mutable std::mutex  _allocmut;          // mutex used for allocation by the concurrent methods.
         mutable T *   _psafeT;                  // place to store the safePeeked object
 
+        mutable std::vector<internals_grid::_leafIndex2<R> > _leafIndexTab;  // cache of leaf indexes (empty if disabled)
+        mutable uint64 _leafIndexTick;                                         // counter for the LRU policy of the leaf index cache
+
         mutable _pbox _pcurrentpeek;            // pointer to the current box used for peeking
         mutable _pbox _pcurrent;                // pointer to the current box
         mutable Pos   _rangemin;                // the minimal accessed range
@@ -2462,7 +4063,7 @@ namespace mtools
         mutable int64 _minVal;                  // current minimum value in the grid
         mutable int64 _maxVal;                  // current maximum value in the grid
 
-        mutable SingleObjectAllocator<internals_grid::_leafFactor<D, T, NB_SPECIAL, R> >  _poolLeaf; // pool for leaf objects
+        mutable SingleObjectAllocator<internals_grid::_leafFactor<D, T, NB_SPECIAL, R, LAYOUT> >  _poolLeaf; // pool for leaf objects
         mutable SingleObjectAllocator<internals_grid::_node<D, T, R> >  _poolNode;                   // pool for node objects
         mutable SingleObjectAllocator<T, sizeof(T), NB_SPECIAL + 1 >  _poolSpec;                     // pool for special objects
 
@@ -2475,6 +4076,23 @@ namespace mtools
         int64 _minSpec, _maxSpec;                                                                   // min and max value of special objects
         bool _callDtors;                                                                            // should we call the dtors of T objects. 
 
+        bool _deltaFull;                                                                            // true if the next delta must contain the whole grid
+        internals_grid::_journal<D, R> _changes;                                                    // journal of the modified leafs
+        mutable std::vector<std::pair<Pos, int64> > _deltaSpecial;                                  // centers and values of the leafs factorized since the last checkpoint
+
+        bool _bgActive;                                                                             // true while the background factorization thread is running
+        std::atomic<bool> _bgStop;                                                                  // set to stop the background thread
+        mutable std::atomic<uint64> _bgEpoch;                                                       // current epoch of the background factorization
+        mutable _bgCounter _bgReaders[2][_BG_STRIPES];                                              // threads in a critical section, indexed by the parity of the epoch
+        std::atomic<uint64> _bgNbFactorized;                                                        // number of leaves factorized by the background thread
+
+#if (MTOOLS_USE_PROFILING)
+        mutable std::atomic<uint64> _statGets{ 0 };                                                 // number of calls to _get()
+        mutable std::atomic<uint64> _statHits{ 0 };                                                 // number of calls resolved by the current box
+#endif
+        int _bgInterval;                                                                            // delay between two passes of the background thread (in ms)
+        std::thread _bgThread;                                                                      // the background thread
+
 
 
     };
@@ -2488,7 +4106,7 @@ namespace mtools
 {
 
     /* implementation of the assignement operator from grid_basic */
-    template<size_t D, typename T, size_t NB_SPECIAL, size_t R> Grid_factor<D, T, NB_SPECIAL, R> & Grid_factor<D, T, NB_SPECIAL, R>::operator=(const Grid_basic<D, T, R> & G)
+    template<size_t D, typename T, size_t NB_SPECIAL, size_t R, typename LAYOUT> Grid_factor<D, T, NB_SPECIAL, R, LAYOUT> & Grid_factor<D, T, NB_SPECIAL, R, LAYOUT>::operator=(const Grid_basic<D, T, R, LAYOUT> & G)
         {
         std::lock_guard<std::recursive_mutex> lock(_peekmut); // protect from safePeek()
         _reset(0,-1, G._callDtors); // reset the grid and set the special range and dtor flag
@@ -0,0 +1,589 @@
+/** @file grid_packed.hpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include "../misc/internal/mtools_export.hpp"
+#include "../misc/misc.hpp"
+#include "../misc/stringfct.hpp"
+#include "../misc/error.hpp"
+#include "../misc/metaprog.hpp"
+#include "../misc/memory.hpp"
+#include "../maths/vec.hpp"
+#include "../maths/box.hpp"
+#include "internal/internals_grid.hpp"
+
+#include <string>
+#include <type_traits>
+#include <typeinfo>
+
+
+namespace mtools
+{
+
+
+    /**
+     * Traits hook used by Grid_packed: number of bits needed to store a value of type T (1, 2 or 4).
+     * The values of T must convert to integers in [0, 2^value - 1] and back. Specialize it for your
+     * own (enum) types:
+     *
+     * @code
+     * enum Cell : char { EMPTY = 0, VISITED = 1, ACTIVE = 2 };
+     * namespace mtools { template<> struct GridPackedBits<Cell> { static const size_t value = 2; }; }
+     * @endcode
+     **/
+    template<typename T> struct GridPackedBits { static const size_t value = 0; };
+
+    template<> struct GridPackedBits<bool> { static const size_t value = 1; };
+
+
+    namespace internals_grid
+    {
+
+        /* Leaf of Grid_packed: the (2R+1)^D cells packed in 64 bits words (row-major order, BITS bits per
+         * cell, the unused fields of the last word are always 0) together with the number of cells of each
+         * value (so that a leaf becoming uniform is detected in O(1)). */
+        template<size_t D, typename T, size_t R, size_t BITS> struct _packedLeaf : public _box < D, T, R >
+        {
+            typedef iVec<D> Pos;
+
+            static const size_t SIZE = metaprog::power<(2 * R + 1), D>::value;  // number of cells
+            static const size_t PERWORD = 64 / BITS;                            // cells per word
+            static const size_t NBWORDS = (SIZE + PERWORD - 1) / PERWORD;       // number of words
+            static const size_t NBVAL = ((size_t)1) << BITS;                    // number of values
+
+            _packedLeaf() {}
+            ~_packedLeaf() {}
+
+            uint32  count[NBVAL];       // number of cells with each value
+            uint64  words[NBWORDS];     // the cells
+
+            /* mask of a field */
+            static inline uint64 field() { return (((uint64)1) << BITS) - 1; }
+
+            /* a word with all fields equal to v */
+            static inline uint64 pattern(uint64 v) { return v * (~((uint64)0) / field()); }
+
+            /* mask of the fields of the last word which are used */
+            static inline uint64 lastMask() { const size_t n = SIZE - (NBWORDS - 1)*PERWORD; return ((n == PERWORD) ? ~((uint64)0) : ((((uint64)1) << (n*BITS)) - 1)); }
+
+            /* number of bits set */
+            static inline uint32 popcount(uint64 w)
+                {
+                #if defined(__GNUC__) || defined(__clang__)
+                return (uint32)__builtin_popcountll(w);
+                #else
+                w = w - ((w >> 1) & 0x5555555555555555ULL);
+                w = (w & 0x3333333333333333ULL) + ((w >> 2) & 0x3333333333333333ULL);
+                w = (w + (w >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+                return (uint32)((w * 0x0101010101010101ULL) >> 56);
+                #endif
+                }
+
+            /* number of fields of w equal to v */
+            static inline uint32 countEqual(uint64 w, uint64 v)
+                {
+                uint64 x = w ^ pattern(v); // fields equal to v are now 0
+                if (BITS == 1) return 64 - popcount(x);
+                if (BITS >= 2) x |= (x >> 1);
+                if (BITS >= 4) x |= (x >> 2);
+                return popcount((~x) & pattern(1)); // low bit of each field set iff the field was 0
+                }
+
+            /* return true if the point belong to this box, false otherwise */
+            inline bool isInBox(const Pos & pos) const { for (size_t i = 0; i < D; ++i) { int64 u = (pos[i] - this->center[i]); if ((u >(int64)R) || (u < -((int64)R))) { return false; } } return true; }
+
+            /* row-major index of a point of the box */
+            inline size_t index(const Pos & pos) const { return GridLayout_rowMajor::template offset<D, R>(pos, this->center); }
+
+            /* value of the cell of index i */
+            inline uint64 get(size_t i) const { return (words[i / PERWORD] >> ((i % PERWORD)*BITS)) & field(); }
+
+            /* set the value of the cell of index i */
+            inline void set(size_t i, uint64 v) { uint64 & w = words[i / PERWORD]; const size_t s = (i % PERWORD)*BITS; w = (w & (~(field() << s))) | (v << s); }
+
+            /* set all the cells to v */
+            inline void fill(uint64 v)
+                {
+                const uint64 p = pattern(v);
+                for (size_t k = 0; k < NBWORDS; k++) { words[k] = p; }
+                words[NBWORDS - 1] &= lastMask();
+                for (size_t k = 0; k < NBVAL; k++) { count[k] = 0; }
+                count[v] = (uint32)SIZE;
+                }
+
+            /* recompute the counts from the words */
+            inline void recount()
+                {
+                for (size_t v = 0; v < NBVAL; v++)
+                    {
+                    uint32 c = 0;
+                    for (size_t k = 0; k < NBWORDS; k++) { c += countEqual(words[k], v); }
+                    count[v] = c;
+                    }
+                count[0] -= (uint32)(NBWORDS*PERWORD - SIZE); // unused fields of the last word
+                }
+
+            /* return true if the n cells of indexes [i, i+n[ all have value v */
+            inline bool rangeEqual(size_t i, size_t n, uint64 v) const
+                {
+                const uint64 p = pattern(v);
+                while (n > 0)
+                    {
+                    const size_t s = i % PERWORD;
+                    const size_t m = ((n < PERWORD - s) ? n : (PERWORD - s));
+                    const uint64 mask = ((m == PERWORD) ? ~((uint64)0) : (((((uint64)1) << (m*BITS)) - 1) << (s*BITS)));
+                    if (((words[i / PERWORD] ^ p) & mask) != 0) return false;
+                    i += m; n -= m;
+                    }
+                return true;
+                }
+
+        private:
+            _packedLeaf(const _packedLeaf &) = delete;                // no copy
+            _packedLeaf & operator=(const _packedLeaf &) = delete;    //
+        };
+
+    }
+
+
+    /**
+     * A D-dimensional grid whose cells contain small values (stored on 1, 2 or 4 bits). This is the
+     * packed counterpart of Grid_factor for binary or small enum states (aggregation models, site
+     * percolation...).
+     *
+     * - The number of bits is given by the traits hook GridPackedBits<T> (1 for bool, specialize it for
+     *   other types). The value of a site is converted to an integer in [0, 2^bits - 1] when stored and
+     *   converted back to T when read. Sites never set have value T(0).
+     *
+     * - The grid has the same tree structure as Grid_factor: leafs of (2R+1)^D cells and nodes with 3^D
+     *   sub-boxes. The cells of a leaf are packed in 64 bits words so a leaf uses 8 to 32 times less
+     *   memory than with one byte per site. Every value is 'special': a leaf (or a node) on which all the
+     *   sites have the same value is replaced by a tagged link and released. Sites with value 0 cost
+     *   nothing.
+     *
+     * - findFullBox() uses the same tree walk as Grid_factor. Inside a leaf, in dimension 2, the square
+     *   centered at the position is grown row by row with word-level comparisons instead of returning a
+     *   singleton.
+     *
+     * Since values are packed, get() returns by value and there is no access()/peek() returning
+     * references. The methods are not thread safe (get() moves an internal cursor).
+     *
+     * @code
+     * Grid_packed<2, bool> G;      // 1 bit per site
+     * G.set(0, 0, true);
+     * if (G(1, 0)) { ... }
+     * @endcode
+     *
+     * @tparam  D   Dimension of the grid.
+     * @tparam  T   Type of the values (GridPackedBits<T>::value must be 1, 2 or 4).
+     * @tparam  R   Radius of an elementary box (same default as Grid_factor).
+     **/
+    template < size_t D, typename T, size_t R = internals_grid::defaultR<D>::val > class Grid_packed
+    {
+
+    public:
+
+        static const size_t BITS = GridPackedBits<T>::value;   ///< number of bits per site
+
+        static_assert((BITS == 1) || (BITS == 2) || (BITS == 4), "GridPackedBits<T>::value must be 1, 2 or 4");
+        static_assert(D > 0, "template parameter D (dimension) must be non-zero");
+        static_assert(R > 0, "template parameter R (radius) must be non-zero");
+
+        /**
+        * Alias for a D-dimensional int64 vector representing a position in the grid.
+        **/
+        typedef iVec<D> Pos;
+
+
+        /**
+         * Constructor. Construct an empty grid (all sites have value 0).
+         **/
+        Grid_packed() : _pcurrent(nullptr), _nbLeafs(0) { _createBaseNode(); }
+
+
+        /**
+         * Destructor.
+         **/
+        ~Grid_packed() { _poolLeaf.deallocateAll(); _poolNode.deallocateAll(); }
+
+
+        /**
+         * Reset the grid: all sites have value 0.
+         **/
+        void reset()
+            {
+            _poolLeaf.deallocateAll();
+            _poolNode.deallocateAll();
+            _createBaseNode();
+            }
+
+
+        /**
+         * Set the value at a given position.
+         **/
+        inline void set(const Pos & pos, const T & val) { _set(pos, _toField(val)); }
+
+        /** Set the value at a given position (dimension 1). **/
+        inline void set(int64 x, const T & val) { static_assert(D == 1, "template parameter D must be 1"); _set(Pos(x), _toField(val)); }
+
+        /** Set the value at a given position (dimension 2). **/
+        inline void set(int64 x, int64 y, const T & val) { static_assert(D == 2, "template parameter D must be 2"); _set(Pos(x, y), _toField(val)); }
+
+        /** Set the value at a given position (dimension 3). **/
+        inline void set(int64 x, int64 y, int64 z, const T & val) { static_assert(D == 3, "template parameter D must be 3"); _set(Pos(x, y, z), _toField(val)); }
+
+
+        /**
+         * Get the value at a given position.
+         **/
+        inline T get(const Pos & pos) const { return _fromField(_get(pos)); }
+
+        /** Get the value at a given position (dimension 1). **/
+        inline T get(int64 x) const { static_assert(D == 1, "template parameter D must be 1"); return get(Pos(x)); }
+
+        /** Get the value at a given position (dimension 2). **/
+        inline T get(int64 x, int64 y) const { static_assert(D == 2, "template parameter D must be 2"); return get(Pos(x, y)); }
+
+        /** Get the value at a given position (dimension 3). **/
+        inline T get(int64 x, int64 y, int64 z) const { static_assert(D == 3, "template parameter D must be 3"); return get(Pos(x, y, z)); }
+
+        /** Same as get(). **/
+        inline T operator()(const Pos & pos) const { return get(pos); }
+
+        /** Same as get() (dimension 1). **/
+        inline T operator()(int64 x) const { static_assert(D == 1, "template parameter D must be 1"); return get(Pos(x)); }
+
+        /** Same as get() (dimension 2). **/
+        inline T operator()(int64 x, int64 y) const { static_assert(D == 2, "template parameter D must be 2"); return get(Pos(x, y)); }
+
+        /** Same as get() (dimension 3). **/
+        inline T operator()(int64 x, int64 y, int64 z) const { static_assert(D == 3, "template parameter D must be 3"); return get(Pos(x, y, z)); }
+
+
+        /**
+         * Find a box containing position pos on which all the sites have the same value (same
+         * semantics as Grid_factor::findFullBox()). The box is a uniform sub-box of the tree when
+         * there is one. Otherwise pos belongs to a leaf and the box is, in dimension 2, the largest
+         * square centered at pos inside the leaf (rows are compared a word at a time) and the
+         * singleton {pos} in other dimensions.
+         *
+         * @param           pos     The position to check.
+         * @param [in,out]  outBox  The box to put the solution.
+         *
+         * @return  The value at pos (common to the whole box).
+         **/
+        inline T findFullBox(const Pos & pos, iBox<D> & outBox) const { return _fromField(_findFullBox(pos, outBox)); }
+
+
+        /**
+         * The smallest box containing all the positions set so far.
+         **/
+        inline void getPosRange(iBox<D> & rangeBox) const { rangeBox.min = _rangemin; rangeBox.max = _rangemax; }
+
+
+        /**
+         * Memory allocated by the grid (memory pools included).
+         **/
+        size_t memoryAllocated() const { return sizeof(*this) + _poolLeaf.footprint() + _poolNode.footprint(); }
+
+
+        /**
+         * Memory used by the grid (nodes and leafs currently in use).
+         **/
+        size_t memoryUsed() const { return sizeof(*this) + _poolLeaf.used() + _poolNode.used(); }
+
+
+        /**
+         * Number of leafs currently allocated (the other boxes are uniform).
+         **/
+        size_t nbLeafs() const { return _nbLeafs; }
+
+
+        /**
+         * Print some information about the grid.
+         **/
+        std::string toString() const
+            {
+            std::string s;
+            s += std::string("Grid_packed<") + mtools::toString(D) + " , " + typeid(T).name() + " , " + mtools::toString(R) + "> (" + mtools::toString(BITS) + " bits per site)\n";
+            s += std::string(" - Memory : ") + mtools::toStringMemSize(memoryUsed()) + " / " + mtools::toStringMemSize(memoryAllocated()) + "\n";
+            s += std::string(" - Leafs : ") + mtools::toString(nbLeafs()) + " (" + mtools::toStringMemSize(sizeof(_leaf)) + " each)\n";
+            s += std::string(" - Min position set = ") + _rangemin.toString(false) + "\n";
+            s += std::string(" - Max position set = ") + _rangemax.toString(false) + "\n";
+            return s;
+            }
+
+
+    private:
+
+        typedef internals_grid::_box<D, T, R>                   _boxT;
+        typedef internals_grid::_node<D, T, R>                  _nodeT;
+        typedef internals_grid::_packedLeaf<D, T, R, BITS>      _leaf;
+        typedef _boxT *     _pbox;
+        typedef _nodeT *    _pnode;
+        typedef _leaf *     _pleaf;
+
+        static const size_t NBVAL = ((size_t)1) << BITS;
+        static const size_t NBSUB = metaprog::power<3, D>::value;
+
+        Grid_packed(const Grid_packed &) = delete;               // no copy
+        Grid_packed & operator=(const Grid_packed &) = delete;   //
+
+
+        /* conversion between T and the stored value */
+        static inline uint64 _toField(const T & val) { const uint64 v = (uint64)(int64)val; MTOOLS_ASSERT(v < NBVAL); return v & (NBVAL - 1); }
+        static inline T _fromField(uint64 v) { return (T)(v); }
+
+
+        /* a link to a uniform box of value v < NBVAL is the tagged pointer v (nullptr for 0) */
+        static inline bool _isUniform(_pbox p) { return (((uintptr_t)p) < NBVAL); }
+        static inline uint64 _uniformValue(_pbox p) { return (uint64)((uintptr_t)p); }
+        static inline _pbox _uniformLink(uint64 v) { return (_pbox)((uintptr_t)v); }
+
+
+        /* create the root */
+        void _createBaseNode()
+            {
+            _rangemin = Pos(0); _rangemax = Pos(0);
+            _nbLeafs = 0;
+            _pnode N = _poolNode.allocate();
+            for (size_t i = 0; i < NBSUB; ++i) { N->tab[i] = nullptr; }
+            N->center = Pos(0);
+            N->rad = R;
+            N->father = nullptr;
+            _pcurrent = N;
+            }
+
+
+        /* the root of the tree */
+        inline _pnode _root() const { _pbox p = _pcurrent; while (p->father != nullptr) { p = p->father; } return (_pnode)p; }
+
+
+        /* return the value at pos and move the cursor */
+        inline uint64 _get(const Pos & pos) const
+            {
+            _pbox cp = _pcurrent;
+            if (cp->isLeaf())
+                {
+                _pleaf L = (_pleaf)cp;
+                if (L->isInBox(pos)) return L->get(L->index(pos));
+                cp = L->father;
+                }
+            _pnode q = (_pnode)cp;
+            while (!q->isInBox(pos))
+                {
+                if (q->father == nullptr) { _pcurrent = q; return 0; } // outside the tree
+                q = (_pnode)q->father;
+                }
+            while (1)
+                {
+                _pbox b = q->getSubBox(pos);
+                if (_isUniform(b)) { _pcurrent = q; return _uniformValue(b); }
+                if (b->isLeaf()) { _pcurrent = b; _pleaf L = (_pleaf)b; return L->get(L->index(pos)); }
+                q = (_pnode)b;
+                }
+            }
+
+
+        /* set the value at pos */
+        inline void _set(const Pos & pos, uint64 v)
+            {
+            for (size_t i = 0; i < D; i++) { if (pos[i] < _rangemin[i]) _rangemin[i] = pos[i]; if (pos[i] > _rangemax[i]) _rangemax[i] = pos[i]; }
+            _pbox cp = _pcurrent;
+            if (cp->isLeaf())
+                {
+                _pleaf L = (_pleaf)cp;
+                if (L->isInBox(pos)) { _setInLeaf(L, pos, v); return; }
+                cp = L->father;
+                }
+            _pnode q = (_pnode)cp;
+            while (!q->isInBox(pos))
+                {
+                if (q->father == nullptr)
+                    { // expand the tree
+                    if (v == 0) { _pcurrent = q; return; } // nothing to do, outside sites have value 0
+                    _pnode N = _poolNode.allocate();
+                    for (size_t i = 0; i < NBSUB; ++i) { N->tab[i] = nullptr; }
+                    N->tab[(NBSUB - 1) / 2] = q;
+                    N->center = q->center;
+                    N->rad = 3 * q->rad + 1;
+                    N->father = nullptr;
+                    q->father = N;
+                    }
+                q = (_pnode)q->father;
+                }
+            while (1)
+                {
+                _pbox & b = q->getSubBox(pos);
+                if (_isUniform(b))
+                    {
+                    const uint64 u = _uniformValue(b);
+                    if (u == v) { _pcurrent = q; return; } // nothing to do
+                    if (q->rad == R)
+                        { // create a leaf filled with u
+                        _pleaf L = _poolLeaf.allocate();
+                        L->center = q->subBoxCenter(pos);
+                        L->rad = 1;
+                        L->father = q;
+                        L->fill(u);
+                        b = L;
+                        _nbLeafs++;
+                        }
+                    else
+                        { // create a node filled with u
+                        _pnode N = _poolNode.allocate();
+                        for (size_t i = 0; i < NBSUB; ++i) { N->tab[i] = b; }
+                        N->center = q->subBoxCenter(pos);
+                        N->rad = (q->rad - 1) / 3;
+                        N->father = q;
+                        b = N;
+                        }
+                    }
+                if (b->isLeaf()) { _setInLeaf((_pleaf)b, pos, v); return; }
+                q = (_pnode)b;
+                }
+            }
+
+
+        /* set the value in a leaf and factorize it if it becomes uniform */
+        inline void _setInLeaf(_pleaf L, const Pos & pos, uint64 v)
+            {
+            const size_t i = L->index(pos);
+            const uint64 old = L->get(i);
+            _pcurrent = L;
+            if (old == v) return;
+            L->set(i, v);
+            L->count[old]--;
+            if ((++(L->count[v])) < _leaf::SIZE) return;
+            // the leaf is uniform: replace it by a tagged link and go up while the nodes are uniform
+            _pnode q = (_pnode)L->father;
+            q->getSubBox(pos) = _uniformLink(v);
+            _poolLeaf.deallocate(L);
+            _nbLeafs--;
+            while (q->father != nullptr)
+                {
+                for (size_t k = 0; k < NBSUB; ++k) { if (q->tab[k] != _uniformLink(v)) { _pcurrent = q; return; } }
+                _pnode f = (_pnode)q->father;
+                f->getSubBox(pos) = _uniformLink(v);
+                _poolNode.deallocate(q);
+                q = f;
+                }
+            _pcurrent = q;
+            }
+
+
+        /* find a uniform box containing pos, return its value */
+        inline uint64 _findFullBox(const Pos & pos, iBox<D> & outBox) const
+            {
+            Pos & boxMin = outBox.min;
+            Pos & boxMax = outBox.max;
+            _pbox cp = _pcurrent;
+            if (cp->isLeaf())
+                {
+                _pleaf L = (_pleaf)cp;
+                if (L->isInBox(pos)) return _leafBox(L, pos, outBox);
+                cp = L->father;
+                }
+            _pnode q = (_pnode)cp;
+            while (!q->isInBox(pos))
+                {
+                if (q->father == nullptr)
+                    { // the point is outside of the tree: same box as Grid_factor
+                    int64 r = 3 * q->rad + 1;
+                    for (size_t i = 0; i < D; ++i)
+                        {
+                        int64 u = pos[i]; if (u < 0) { u = -u; }
+                        while (u > r) { r = 3 * r + 1; }
+                        }
+                    r = (r - 1) / 3;
+                    for (size_t i = 0; i < D; i++)
+                        {
+                        const int64 a = pos[i];
+                        const int64 sb = ((a < -r) ? (-(2 * r + 1)) : ((a > r) ? (2 * r + 1) : 0));
+                        boxMin[i] = sb - r; boxMax[i] = sb + r;
+                        }
+                    _pcurrent = q;
+                    return 0;
+                    }
+                q = (_pnode)q->father;
+                }
+            while (1)
+                {
+                _pbox b = q->getSubBox(pos);
+                if (_isUniform(b))
+                    {
+                    const int64 rad = q->rad;
+                    boxMin = q->subBoxCenter(pos);
+                    boxMax = boxMin;
+                    boxMin -= rad;
+                    boxMax += rad;
+                    _pcurrent = q;
+                    return _uniformValue(b);
+                    }
+                if (b->isLeaf()) { _pcurrent = b; return _leafBox((_pleaf)b, pos, outBox); }
+                q = (_pnode)b;
+                }
+            }
+
+
+        /* uniform box around pos inside a leaf */
+        inline uint64 _leafBox(_pleaf L, const Pos & pos, iBox<D> & outBox) const
+            {
+            const size_t i = L->index(pos);
+            const uint64 v = L->get(i);
+            outBox.min = pos; outBox.max = pos;
+            if (D == 2)
+                {
+                const int64 N = 2 * R + 1;
+                const int64 a = pos[0] - L->center[0] + (int64)R;
+                const int64 b = pos[1] - L->center[1] + (int64)R;
+                int64 r = 0;
+                while ((a - r - 1 >= 0) && (a + r + 1 < N) && (b - r - 1 >= 0) && (b + r + 1 < N))
+                    { // try to add the ring at distance r+1: two rows (word-level) and two columns
+                    const int64 s = r + 1;
+                    if (!L->rangeEqual((size_t)((a - s) + (b - s)*N), (size_t)(2 * s + 1), v)) break;
+                    if (!L->rangeEqual((size_t)((a - s) + (b + s)*N), (size_t)(2 * s + 1), v)) break;
+                    bool ok = true;
+                    for (int64 y = b - r; y <= b + r; y++) { if ((L->get((size_t)((a - s) + y*N)) != v) || (L->get((size_t)((a + s) + y*N)) != v)) { ok = false; break; } }
+                    if (!ok) break;
+                    r = s;
+                    }
+                outBox.min -= r;
+                outBox.max += r;
+                }
+            return v;
+            }
+
+
+        mutable _pbox   _pcurrent;      // cursor: last box visited
+        Pos             _rangemin;      // range of the positions set
+        Pos             _rangemax;      //
+        size_t          _nbLeafs;       // number of leafs allocated
+
+        mutable SingleObjectAllocator<_leaf>    _poolLeaf;  // pool for the leafs
+        mutable SingleObjectAllocator<_nodeT>   _poolNode;  // pool for the nodes
+    };
+
+
+}
+
+
+/* end of file */
@@ -24,17 +24,154 @@
 #include "../../misc/metaprog.hpp"
 #include "../../misc/memory.hpp"
 
+#include <string>
+#include <vector>
+#include <atomic>
+#include <type_traits>
+#include <mutex>
+#include <algorithm>
+
 namespace mtools
 {
 
+
+    /**
+     * Layout policy for the elementary sub-grids (leafs) of Grid_basic and Grid_factor: the cells of
+     * a leaf are stored in row-major order (first coordinate varies fastest). This is the default.
+     **/
+    struct GridLayout_rowMajor
+        {
+        /* offset of the cell at relative coordinates x[0..D-1] (each in [0, 2R]) inside the leaf */
+        template<size_t D, size_t R> static inline size_t offset(const size_t * x) { size_t off = 0, A = 1; for (size_t i = 0; i < D; ++i) { off += x[i] * A; A *= (2 * R + 1); } return off; }
+
+        /* offset of the cell at absolute position pos inside the leaf centered at center */
+        template<size_t D, size_t R> static inline size_t offset(const iVec<D> & pos, const iVec<D> & center) { size_t off = 0, A = 1; for (size_t i = 0; i < D; ++i) { off += (size_t)((pos[i] - center[i] + R)*A); A *= (2 * R + 1); } return off; }
+
+        /* offset of the cell whose row-major index is i */
+        template<size_t D, size_t R> static inline size_t storageIndex(size_t i) { return i; }
+        };
+
+
+    /**
+     * Layout policy for the elementary sub-grids (leafs) of Grid_basic and Grid_factor: the cells of
+     * a leaf are stored by tiles of B^D cells, each tile being contiguous in memory (row-major inside
+     * the tile and tiles in row-major order). Neighbouring cells in every direction are then close in
+     * memory which reduces cache misses for local access patterns (random walks, stencils...) when R is
+     * large. The tiles on the upper boundary of a leaf are truncated so no memory is wasted. B should
+     * be a power of 2 so that offsets are computed with shifts and masks.
+     *
+     * The layout only affects the in-memory representation: serialization always uses the row-major
+     * order so files are exchangeable between grids using different layouts.
+     *
+     * @tparam  B   length of the side of a tile.
+     **/
+    template<size_t B> struct GridLayout_tiled
+        {
+        static_assert(B > 0, "the tile size must be positive");
+
+        template<size_t D, size_t R> static inline size_t offset(const size_t * x)
+            {
+            const size_t N = 2 * R + 1;
+            size_t h[D];
+            size_t off = 0, hprod = 1, lowvol = metaprog::power<(int)N, (int)(D - 1)>::value;
+            for (size_t k = D; k > 0; k--)
+                { // dimension k-1 is split in slabs of thickness B, the lower dimensions are not split yet
+                const size_t t = x[k - 1] / B;
+                h[k - 1] = ((t*B + B <= N) ? B : (N - t*B));
+                off += t*B*lowvol*hprod;
+                hprod *= h[k - 1];
+                lowvol /= N;
+                }
+            size_t in = 0;
+            for (size_t k = D; k > 0; k--) { in = in*h[k - 1] + (x[k - 1] % B); } // row-major inside the tile
+            return off + in;
+            }
+
+        template<size_t D, size_t R> static inline size_t offset(const iVec<D> & pos, const iVec<D> & center)
+            {
+            size_t x[D];
+            for (size_t i = 0; i < D; ++i) { x[i] = (size_t)(pos[i] - center[i] + (int64)R); }
+            return offset<D, R>(x);
+            }
+
+        template<size_t D, size_t R> static inline size_t storageIndex(size_t i)
+            {
+            size_t x[D];
+            for (size_t k = 0; k < D; ++k) { x[k] = i % (2 * R + 1); i /= (2 * R + 1); }
+            return offset<D, R>(x);
+            }
+        };
+
+
+    /**
+     * Telemetry of the tree of a Grid_basic or Grid_factor, returned by their stats() method.
+     *
+     * The object counts and memory sizes are read from the memory pools and are cheap to obtain:
+     * they may be polled from a monitoring thread (the values are then only approximate while the
+     * grid is modified). The depth histogram and the number of factorized leaves require a walk of
+     * the whole tree and are only filled when requested.
+     *
+     * The hit rate of the current box cache of get() is only measured when mtools is configured with
+     * the cmake option USE_PROFILING (getCalls and getHits stay 0 otherwise).
+     **/
+    struct GridStats
+        {
+        size_t nbNodes = 0;                 // number of nodes
+        size_t nbLeaves = 0;                // number of (full) leaves
+        size_t nbSparseLeaves = 0;          // number of sparse leaves (Grid_basic in sparse mode)
+        size_t nbFactorized = 0;            // number of subtrees replaced by a special value (Grid_factor, tree walk only)
+        size_t nbSpecialObjects = 0;        // number of special objects stored (Grid_factor)
+
+        size_t bytesNodes = 0;              // memory used by the nodes
+        size_t bytesLeaves = 0;             // memory used by the leaves
+        size_t bytesSparseLeaves = 0;       // memory used by the sparse leaves
+        size_t bytesSpecialObjects = 0;     // memory used by the special objects
+        size_t memoryUsed = 0;              // total memory used by the grid (same as memoryUsed())
+        size_t memoryAllocated = 0;         // total memory allocated by the grid (same as memoryAllocated())
+
+        std::vector<size_t> depthHistogram; // depthHistogram[d] = number of leaves (of any kind) at depth d below the root (tree walk only)
+
+        uint64 getCalls = 0;                // number of accesses through the current box cache
+        uint64 getHits = 0;                 // number of these accesses resolved without walking the tree
+
+        /** Hit rate of the current box cache (0 if not measured). */
+        double hitRate() const { return ((getCalls == 0) ? 0.0 : ((double)getHits) / ((double)getCalls)); }
+
+        /** Maximal depth of a leaf (-1 if the histogram is empty). */
+        int maxDepth() const { return ((int)depthHistogram.size()) - 1; }
+
+        /** Human readable summary. */
+        std::string toString() const
+            {
+            std::string s;
+            s += std::string(" - Nodes          : ") + mtools::toString(nbNodes) + " (" + mtools::toStringMemSize(bytesNodes) + ")\n";
+            s += std::string(" - Leaves         : ") + mtools::toString(nbLeaves) + " (" + mtools::toStringMemSize(bytesLeaves) + ")\n";
+            if (nbSparseLeaves > 0) { s += std::string(" - Sparse leaves  : ") + mtools::toString(nbSparseLeaves) + " (" + mtools::toStringMemSize(bytesSparseLeaves) + ")\n"; }
+            if ((nbFactorized > 0) || (nbSpecialObjects > 0))
+                {
+                s += std::string(" - Factorized     : ") + mtools::toString(nbFactorized) + "\n";
+                s += std::string(" - Special objects: ") + mtools::toString(nbSpecialObjects) + " (" + mtools::toStringMemSize(bytesSpecialObjects) + ")\n";
+                }
+            s += std::string(" - Memory         : ") + mtools::toStringMemSize(memoryUsed) + " / " + mtools::toStringMemSize(memoryAllocated) + "\n";
+            if (getCalls > 0) { s += std::string(" - get() cache    : ") + mtools::toString(getHits) + " hits / " + mtools::toString(getCalls) + " calls (" + mtools::toString(100.0*hitRate()) + "%)\n"; }
+            for (size_t d = 0; d < depthHistogram.size(); d++)
+                {
+                if (depthHistogram[d] > 0) { s += std::string(" - depth ") + mtools::toString(d) + " : " + mtools::toString(depthHistogram[d]) + " leaves\n"; }
+                }
+            return s;
+            }
+        };
+
+
     namespace internals_grid
     {
 
         /* forward declaration */
         template<size_t D, typename T, size_t R> struct _box;
         template<size_t D, typename T, size_t R> struct _node;
-        template<size_t D, typename T, size_t R> struct _leaf;
-        template<size_t D, typename T, size_t NB_SPECIAL, size_t R > struct _leafFactor;
+        template<size_t D, typename T, size_t R, typename LAYOUT = GridLayout_rowMajor> struct _leaf;
+        template<size_t D, typename T, size_t NB_SPECIAL, size_t R, typename LAYOUT = GridLayout_rowMajor> struct _leafFactor;
+        template<size_t D, typename T, size_t R, typename LAYOUT = GridLayout_rowMajor> struct _sparseLeaf;
 
 
         /* Box object */
@@ -55,6 +192,9 @@ namespace mtools
             /* return true is this object is a leaf*/
             inline bool isLeaf() const { return (rad == 1); }
 
+            /* return true is this object is a sparse leaf (Grid_basic only) */
+            inline bool isSparse() const { return (rad == 0); }
+
         private:
             _box(const _box &) = delete;                // no copy
             _box & operator=(const _box &) = delete;    //
@@ -112,25 +252,33 @@ namespace mtools
 
 
         /* Leaf object */
-        template<size_t D, typename T, size_t R> struct _leaf : public _box < D, T, R >
+        template<size_t D, typename T, size_t R, typename LAYOUT> struct _leaf : public _box < D, T, R >
         {
 
             typedef iVec<D>             Pos;
             typedef _box<D, T, R> *     _pbox;
-            typedef _leaf<D, T, R> *    _pleaf;
+            typedef _leaf<D, T, R, LAYOUT> *    _pleaf;
             typedef _node<D, T, R> *    _pnode;
 
 
             _leaf() {}
             ~_leaf() {};
 
+            char dirty;                                            // non-zero if the leaf was modified since the last checkpoint
+            uint64 cowgen;                                         // snapshot generation when the leaf was created or copied (Grid_basic only)
             T  data[metaprog::power<(2*R+1),D>::value];           // the elements of an elementary box
 
             /* return true if the point belong to this box, false otherwise */
             inline bool isInBox(const Pos & pos) { for (size_t i = 0; i < D; ++i) { int64 u = (pos[i] - this->center[i]); if ((u >(int64)R) || (u < -((int64)R))) { return false; } } return true; }
 
             /* return a reference to the object pointed by pos (no safe check) */
-            inline T & get(const Pos & pos) { size_t off = 0, A = 1; for (size_t i = 0; i < D; ++i) { off += (size_t)((pos[i] - this->center[i] + R)*A); A *= (2 * R + 1); } return(data[off]); }
+            inline T & get(const Pos & pos) { return(data[LAYOUT::template offset<D, R>(pos, this->center)]); }
+
+            /* return a reference to the object whose row-major index in the leaf is i (used for serialization) */
+            inline T & getRowMajor(size_t i) { return(data[LAYOUT::template storageIndex<D, R>(i)]); }
+
+            /* return a pointer to the memory location of the object whose row-major index in the leaf is i */
+            inline T * ptrRowMajor(size_t i) { return(data + LAYOUT::template storageIndex<D, R>(i)); }
 
         private:
             _leaf(const _leaf &) = delete;                // no copy
@@ -140,12 +288,14 @@ namespace mtools
 
 
         /* Leaf Factor object  */
-        template<size_t D, typename T, size_t NB_SPECIAL, size_t R> struct _leafFactor : public _leaf< D, T, R>
+        template<size_t D, typename T, size_t NB_SPECIAL, size_t R, typename LAYOUT> struct _leafFactor : public _leaf< D, T, R, LAYOUT>
         {
             _leafFactor() {}
             ~_leafFactor() {};
 
             size_t count[NB_SPECIAL]; // number of special element of each type
+            char hot;                 // set by concurrentSet() and cleared by the background factorization thread
+            char retired;             // background factorization: 1 while the leaf is being checked, 2 once it is replaced by a special node
 
         private:
             _leafFactor(const _leafFactor &) = delete;                // no copy
@@ -154,10 +304,470 @@ namespace mtools
 
 
 
+        /* Sparse leaf object (rad = 0): an elementary box of Grid_basic in which only the objects of the
+         * sites accessed are created. The objects are stored in their order of creation and indexed by an
+         * open addressing hash table keyed by their row-major index in the box. Objects and hash entries
+         * never move so find() is lock free wrt insertions.
+         *
+         * A sparse leaf belongs to a tier which sets its capacity (64, 512 or 4096 objects). The storage
+         * follows the header in a chunk of size bytes<tier>::val. When it is full, the leaf is replaced in
+         * the tree by a sparse leaf of the next tier or, after the last tier, by a _leaf. fwd then points
+         * to the replacement. */
+        template<size_t D, typename T, size_t R, typename LAYOUT> struct _sparseLeaf : public _box < D, T, R >
+        {
+            typedef iVec<D>                     Pos;
+            typedef _box<D, T, R> *             _pbox;
+
+            static const size_t SIZE = metaprog::power<(2 * R + 1), D>::value;
+
+            /* capacity of a tier */
+            template<size_t TIER> struct capacity { static const size_t val = (((size_t)64) << (3 * TIER)); };
+
+            /* number of tiers used: those with a capacity at most 1/8 of the size of the box (0 if sparse leafs are useless) */
+            static const size_t NB_TIERS = ((capacity<2>::val * 8 <= SIZE) ? 3 : ((capacity<1>::val * 8 <= SIZE) ? 2 : ((capacity<0>::val * 8 <= SIZE) ? 1 : 0)));
+
+            /* size in bytes of the chunk of a sparse leaf of a given tier */
+            template<size_t TIER> struct bytes { static const size_t val = _sparseLeaf::_storageOffset(capacity<TIER>::val) + capacity<TIER>::val * sizeof(T); };
+
+            _sparseLeaf() {}
+            ~_sparseLeaf() { for (size_t k = 0; k < nb; k++) { obj(k)->~T(); } }
+
+            char    dirty;          // non-zero if the leaf was modified since the last checkpoint
+            uint32  tier;           // tier of the leaf
+            uint32  cap;            // capacity of the leaf
+            uint32  nb;             // number of objects created
+            _pbox   fwd;            // the leaf which replaced this one, nullptr while the sparse leaf is in the tree
+
+            /* initialize an empty sparse leaf of a given tier */
+            inline void init(size_t t)
+                {
+                dirty = 1; tier = (uint32)t; nb = 0; fwd = nullptr;
+                cap = (uint32)(((size_t)64) << (3 * t));
+                int32 * h = hashTab();
+                for (size_t i = 0; i < 2 * (size_t)cap; i++) { h[i] = -1; }
+                }
+
+            /* return true if the point belong to this box, false otherwise */
+            inline bool isInBox(const Pos & pos) const { for (size_t i = 0; i < D; ++i) { int64 u = (pos[i] - this->center[i]); if ((u >(int64)R) || (u < -((int64)R))) { return false; } } return true; }
+
+            /* row-major index of a point of the box */
+            inline size_t index(const Pos & pos) const { return GridLayout_rowMajor::template offset<D, R>(pos, this->center); }
+
+            /* the hash table (2*cap entries: slot of the object or -1), the keys (row-major index of the object in each slot) and the objects */
+            inline int32 * hashTab() { return reinterpret_cast<int32*>(reinterpret_cast<char*>(this) + sizeof(_sparseLeaf)); }
+            inline uint32 * keyTab() { return reinterpret_cast<uint32*>(hashTab() + 2 * (size_t)cap); }
+            inline T * obj(size_t k) { return reinterpret_cast<T*>(reinterpret_cast<char*>(this) + _storageOffset(cap)) + k; }
+
+            /* return a pointer to the object whose row-major index is i, nullptr if it does not exist */
+            inline T * find(size_t i)
+                {
+                const int32 * h = hashTab();
+                const uint32 * key = keyTab();
+                const size_t mask = 2 * (size_t)cap - 1;
+                size_t j = _hash(i) & mask;
+                while (1)
+                    {
+                    const int32 k = reinterpret_cast<const std::atomic<int32>*>(h + j)->load(std::memory_order_acquire);
+                    if (k < 0) return nullptr;
+                    if (key[k] == i) return obj((size_t)k);
+                    j = (j + 1) & mask;
+                    }
+                }
+
+            /* return true if no more object can be added */
+            inline bool full() const { return (nb == cap); }
+
+            /* register the object constructed in slot nb with row-major index i (not full, not already present) */
+            inline void publish(size_t i)
+                {
+                int32 * h = hashTab();
+                keyTab()[nb] = (uint32)i;
+                const size_t mask = 2 * (size_t)cap - 1;
+                size_t j = _hash(i) & mask;
+                while (h[j] >= 0) { j = (j + 1) & mask; }
+                reinterpret_cast<std::atomic<int32>*>(h + j)->store((int32)nb, std::memory_order_release);
+                nb++;
+                }
+
+            /* the leaf which replaced this one (nullptr if none) */
+            inline _pbox forward() const { return reinterpret_cast<const std::atomic<_pbox>*>(&fwd)->load(std::memory_order_acquire); }
+
+            /* set the leaf which replaces this one */
+            inline void forward(_pbox L) { reinterpret_cast<std::atomic<_pbox>*>(&fwd)->store(L, std::memory_order_release); }
+
+        private:
+
+            static inline size_t _hash(size_t i) { uint32 h = ((uint32)i) * 2654435761u; h ^= (h >> 16); return (size_t)h; }
+
+            static constexpr size_t _storageOffset(size_t c) { return ((sizeof(_sparseLeaf) + 12 * c + alignof(T) - 1) / alignof(T)) * alignof(T); }
+
+            _sparseLeaf(const _sparseLeaf &) = delete;                // no copy
+            _sparseLeaf & operator=(const _sparseLeaf &) = delete;    //
+        };
+
+
+
+        /* Index of a 2D leaf used by Grid_factor::findFullBox() to find the largest square centered at
+         * a given position on which all values are equal (see Grid_factor::setLeafIndex()).
+         * With L = 2R+1 and (a,b) in [0,L-1]^2 the relative coordinates inside the leaf, sh and sv are the
+         * summed-area tables of the number of pairs of neighbours (a,b),(a+1,b) [resp. (a,b),(a,b+1)]
+         * with distinct values: sh[i + j*(L+1)] = number of such pairs with a < i and b < j. */
+        template<size_t R> struct _leafIndex2
+        {
+            static const size_t L = 2 * R + 1;
+
+            _leafIndex2() : leaf(nullptr), tick(0) {}
+
+            const void *            leaf;   // the leaf indexed (nullptr if the entry is free)
+            uint64                  tick;   // time of last use
+            std::vector<uint32>     sh;     // summed-area table of horizontal differences
+            std::vector<uint32>     sv;     // summed-area table of vertical differences
+
+            /* construct the index for a leaf, cell(a,b) must return the value (as int64) at relative coordinates (a,b) */
+            template<typename CELL> void build(const void * pleaf, CELL cell)
+                {
+                leaf = pleaf;
+                sh.assign((L + 1)*(L + 1), 0);
+                sv.assign((L + 1)*(L + 1), 0);
+                std::vector<int64> val(L*L);
+                for (size_t b = 0; b < L; b++) { for (size_t a = 0; a < L; a++) { val[a + b*L] = cell(a, b); } }
+                for (size_t b = 0; b < L; b++)
+                    {
+                    for (size_t a = 0; a < L; a++)
+                        {
+                        const uint32 dh = (((a + 1 < L) && (val[a + b*L] != val[a + 1 + b*L])) ? 1 : 0);
+                        const uint32 dv = (((b + 1 < L) && (val[a + b*L] != val[a + (b + 1)*L])) ? 1 : 0);
+                        const size_t k = (a + 1) + (b + 1)*(L + 1);
+                        sh[k] = dh + sh[k - 1] + sh[k - (L + 1)] - sh[k - (L + 2)];
+                        sv[k] = dv + sv[k - 1] + sv[k - (L + 1)] - sv[k - (L + 2)];
+                        }
+                    }
+                }
+
+            /* update the index after the value at (a,b) changed, cell(a,b) must return the (new) value (as int64) at relative coordinates (a,b) */
+            template<typename CELL> void update(size_t a, size_t b, CELL cell)
+                {
+                const int64 v = cell(a, b);
+                // horizontal pairs (a-1,b),(a,b) and (a,b),(a+1,b): entries sh[i,j] with j > b and i > a-1 (resp. i > a)
+                const uint32 h1 = ((a > 0) ? ((cell(a - 1, b) != v) ? 1 : 0) - _sum(sh, a - 1, a, b, b + 1) : 0);
+                const uint32 h2 = ((a + 1 < L) ? ((cell(a + 1, b) != v) ? 1 : 0) - _sum(sh, a, a + 1, b, b + 1) : 0);
+                if ((h1 != 0) || (h2 != 0))
+                    {
+                    for (size_t j = b + 1; j <= L; j++)
+                        {
+                        uint32 * p = sh.data() + j*(L + 1);
+                        if (a > 0) { p[a] += h1; }
+                        const uint32 h = h1 + h2;
+                        for (size_t i = a + 1; i <= L; i++) { p[i] += h; }
+                        }
+                    }
+                // vertical pairs (a,b-1),(a,b) and (a,b),(a,b+1): entries sv[i,j] with i > a and j > b-1 (resp. j > b)
+                const uint32 v1 = ((b > 0) ? ((cell(a, b - 1) != v) ? 1 : 0) - _sum(sv, a, a + 1, b - 1, b) : 0);
+                const uint32 v2 = ((b + 1 < L) ? ((cell(a, b + 1) != v) ? 1 : 0) - _sum(sv, a, a + 1, b, b + 1) : 0);
+                if ((v1 != 0) || (v2 != 0))
+                    {
+                    if (b > 0)
+                        {
+                        uint32 * p = sv.data() + b*(L + 1);
+                        for (size_t i = a + 1; i <= L; i++) { p[i] += v1; }
+                        }
+                    const uint32 w = v1 + v2;
+                    for (size_t j = b + 1; j <= L; j++)
+                        {
+                        uint32 * p = sv.data() + j*(L + 1);
+                        for (size_t i = a + 1; i <= L; i++) { p[i] += w; }
+                        }
+                    }
+                }
+
+            /* return the sum of the entries of table s over [a0,a1[ x [b0,b1[ */
+            static inline uint32 _sum(const std::vector<uint32> & s, size_t a0, size_t a1, size_t b0, size_t b1)
+                {
+                return s[a1 + b1*(L + 1)] - s[a0 + b1*(L + 1)] - s[a1 + b0*(L + 1)] + s[a0 + b0*(L + 1)];
+                }
+
+            /* return true if all the values in [a0,a1] x [b0,b1] are equal */
+            inline bool isConstant(size_t a0, size_t a1, size_t b0, size_t b1) const
+                {
+                return ((_sum(sh, a0, a1, b0, b1 + 1) == 0) && (_sum(sv, a0, a1 + 1, b0, b1) == 0));
+                }
+
+            /* return the largest r such that the square [a-r, a+r] x [b-r, b+r] is inside the leaf and constant (binary search) */
+            inline size_t largestSquare(size_t a, size_t b) const
+                {
+                size_t lo = 0, hi = a;
+                if (b < hi) hi = b;
+                if (L - 1 - a < hi) hi = L - 1 - a;
+                if (L - 1 - b < hi) hi = L - 1 - b;
+                while (lo < hi)
+                    {
+                    const size_t m = (lo + hi + 1) / 2;
+                    if (isConstant(a - m, a + m, b - m, b + m)) lo = m; else hi = m - 1;
+                    }
+                return lo;
+                }
+
+            /* memory used by the index */
+            size_t memoryUsed() const { return sizeof(*this) + MEM_FOR_OBJ(uint32, (sh.capacity() + sv.capacity())); }
+        };
+
+
         /* the default value for the radius of an elementary sub-grid */
         template<size_t D> struct defaultR { static const size_t val = ((D == 1) ? 10000 : ((D == 2) ? 100 : ((D == 3) ? 20 : ((D == 4) ? 6 : ((D == 5) ? 3 : 1))))); };
 
 
+        /* return the Morton (Z-order) key of the leaf containing pos. Leaf centers are the multiples of
+         * (2R+1) so the leaf index of each coordinate is obtained by floor division. Only the lowest
+         * 64/D bits of each index are interleaved: keys of far away leaves may collide but this only
+         * affects the ordering, not the correctness of methods using it. */
+        template<size_t D, size_t R> inline uint64 _leafMortonKey(const iVec<D> & pos)
+            {
+            const size_t B = 64 / D;  // number of bits per coordinate
+            const int64 L = (int64)(2 * R + 1);
+            uint64 key = 0;
+            for (size_t i = 0; i < D; ++i)
+                {
+                const int64 x = pos[i] + (int64)R;
+                const int64 k = (x >= 0) ? (x / L) : (-((-x + L - 1) / L)); // floor division
+                const uint64 u = ((uint64)k) + (((uint64)1) << (B - 1));    // shift so that negative indices come first
+                for (size_t b = 0; b < B; ++b) { key |= ((u >> b) & 1) << (b*D + i); }
+                }
+            return key;
+            }
+
+
+        /* Entry of the index of a file written by Grid_factor::saveIndexed(). A block is a tile of the
+         * grid with half-width rad (rad = R for the leafs, 3*rad+1 for the level above...) whose center
+         * is given by the Morton key of its tile coordinates. size = 0 for a special block and offset
+         * then holds its special value. The index is sorted by (rad, key). */
+        struct _tileIndexEntry
+            {
+            uint64 rad;     // half-width of the block
+            uint64 key;     // Morton key of the block
+            uint64 offset;  // position of the serialized leaf in the file (or special value)
+            uint64 size;    // size of the serialized leaf (0 for a special block)
+
+            bool operator<(const _tileIndexEntry & E) const { return ((rad < E.rad) || ((rad == E.rad) && (key < E.key))); }
+            };
+
+
+        /* Footer of a file written by Grid_factor::saveIndexed() (the last bytes of the file) */
+        struct _tileIndexFooter
+            {
+            static const uint64 MAGIC = 0x3158444944495247ULL; // "GRIDIDX1"
+
+            uint64 headoffset;  // position of the archive containing the header of the grid
+            uint64 headsize;    // size of that archive
+            uint64 indexoffset; // position of the index (array of _tileIndexEntry)
+            uint64 nbentries;   // number of entries in the index
+            uint64 magic;       // MAGIC
+            };
+
+
+        /* index of the tile of half-width rad containing x (the tiles are centered on the multiples of 2rad+1) */
+        inline int64 _tileCoord(int64 x, int64 rad)
+            {
+            const int64 L = 2 * rad + 1;
+            x += rad;
+            return ((x >= 0) ? (x / L) : (-((-x + L - 1) / L)));
+            }
+
+
+        /* Morton key of the tile of half-width rad centered at center. Return false if one of the tile
+         * coordinates does not fit in the 64/D bits available (the key would not be unique) */
+        template<size_t D> inline bool _tileMortonKey(const iVec<D> & center, int64 rad, uint64 & key)
+            {
+            const size_t B = 64 / D;
+            key = 0;
+            for (size_t i = 0; i < D; ++i)
+                {
+                const int64 k = _tileCoord(center[i], rad);
+                if ((B < 64) && ((k < -(((int64)1) << (B - 1))) || (k >= (((int64)1) << (B - 1))))) return false;
+                const uint64 u = ((uint64)k) + (((uint64)1) << (B - 1));
+                for (size_t b = 0; b < B; ++b) { key |= ((u >> b) & 1) << (b*D + i); }
+                }
+            return true;
+            }
+
+
+        /* inverse of _tileMortonKey(): the center of the tile of half-width rad with a given key */
+        template<size_t D> inline iVec<D> _tileCenter(uint64 key, int64 rad)
+            {
+            const size_t B = 64 / D;
+            iVec<D> center;
+            for (size_t i = 0; i < D; ++i)
+                {
+                uint64 u = 0;
+                for (size_t b = 0; b < B; ++b) { u |= ((key >> (b*D + i)) & 1) << b; }
+                center[i] = ((int64)(u - (((uint64)1) << (B - 1)))) * (2 * rad + 1);
+                }
+            return center;
+            }
+
+
+        /* recursive part of _mortonRanges(): visit the cell with key prefix 'prefix' whose coordinates
+         * span [base, base + 2^b - 1] */
+        template<size_t D> void _mortonRangesRec(uint64 prefix, size_t b, uint64 * base, const uint64 * qmin, const uint64 * qmax, uint64 MAXU, std::vector<std::pair<uint64, uint64> > & ranges)
+            {
+            const uint64 ext = (b == 64) ? MAXU : ((((uint64)1) << b) - 1);
+            bool inside = true;
+            for (size_t i = 0; i < D; ++i)
+                {
+                if ((base[i] > qmax[i]) || (base[i] + ext < qmin[i])) return; // disjoint
+                if ((base[i] < qmin[i]) || (base[i] + ext > qmax[i])) inside = false;
+                }
+            if (inside)
+                {
+                const uint64 last = (b*D >= 64) ? ((uint64)-1) : (prefix | ((((uint64)1) << (b*D)) - 1));
+                if ((ranges.size() > 0) && (ranges.back().second + 1 == prefix)) { ranges.back().second = last; } else { ranges.push_back(std::pair<uint64, uint64>(prefix, last)); }
+                return;
+                }
+            MTOOLS_ASSERT(b > 0);
+            uint64 sub[D];
+            for (uint64 c = 0; c < (((uint64)1) << D); ++c)
+                {
+                for (size_t i = 0; i < D; ++i) { sub[i] = base[i] | (((c >> i) & 1) << (b - 1)); }
+                _mortonRangesRec<D>(prefix | (c << ((b - 1)*D)), b - 1, sub, qmin, qmax, MAXU, ranges);
+                }
+            }
+
+
+        /* Decompose the set of tiles of half-width rad intersecting the box into intervals of Morton
+         * keys. The cells of the Z-order curve fully inside the box give one interval each, the
+         * others are split until they reach the size of a tile. The intervals are sorted and disjoint. */
+        template<size_t D> inline void _mortonRanges(const iBox<D> & box, int64 rad, std::vector<std::pair<uint64, uint64> > & ranges)
+            {
+            ranges.clear();
+            if (box.isEmpty()) return;
+            const size_t B = 64 / D;
+            const uint64 MAXU = (B < 64) ? ((((uint64)1) << B) - 1) : ((uint64)-1);
+            uint64 qmin[D], qmax[D];
+            for (size_t i = 0; i < D; ++i)
+                {
+                int64 a = _tileCoord(box.min[i], rad), b = _tileCoord(box.max[i], rad);
+                if (B < 64)
+                    { // clip to the representable tiles
+                    const int64 h = (((int64)1) << (B - 1));
+                    if ((b < -h) || (a >= h)) return;
+                    a = std::max<int64>(a, -h); b = std::min<int64>(b, h - 1);
+                    }
+                qmin[i] = ((uint64)a) + (((uint64)1) << (B - 1));
+                qmax[i] = ((uint64)b) + (((uint64)1) << (B - 1));
+                }
+            uint64 base[D];
+            for (size_t i = 0; i < D; ++i) { base[i] = 0; }
+            _mortonRangesRec<D>(0, B, base, qmin, qmax, MAXU, ranges);
+            }
+
+
+        /* Journal of the leafs modified in a grid (cf. Grid_basic::journal()). record() is called by the
+         * write accessors with the position written; the center of the leaf containing it is appended
+         * to a bounded list, consecutive writes in the same leaf (by the same thread) being recorded
+         * only once. take() may be called by another thread (e.g. a drawer) while the grid is written. */
+        template<size_t D, size_t R> class _journal
+        {
+        public:
+
+            typedef iVec<D> Pos;
+
+            _journal() : _on(false), _epoch(_newEpoch()), _cap(0), _overflow(true), _hasLast(false) {}
+
+            /* enable / disable the journal. The first take() after enabling reports everything */
+            void enable(bool on, size_t capacity)
+                {
+                std::lock_guard<std::mutex> lock(_mut);
+                _cap = std::max<size_t>(capacity, 1);
+                _list.clear();
+                _overflow = true;
+                _hasLast = false;
+                _epoch = _newEpoch();
+                _on = on;
+                }
+
+            bool enabled() const { return _on.load(std::memory_order_relaxed); }
+
+            /* the position pos is about to be written */
+            inline void record(const Pos & pos) { if (_on.load(std::memory_order_relaxed)) { _record(pos); } }
+
+            /* the whole grid changed (reset, load, assignment...) */
+            void all()
+                {
+                if (!enabled()) return;
+                std::lock_guard<std::mutex> lock(_mut);
+                _list.clear();
+                _overflow = true;
+                }
+
+            /* return the boxes of the leafs modified since the last call, or false if too many
+             * changes occurred (or the journal is disabled) and everything should be considered
+             * modified. The last leaf recorded is reported again by the next call since a write
+             * through a reference may still be in progress when take() is called. */
+            bool take(std::vector<iBox<D> > & boxes)
+                {
+                boxes.clear();
+                std::lock_guard<std::mutex> lock(_mut);
+                if (!enabled()) return false;
+                const bool ok = !_overflow;
+                if (ok)
+                    { // sort the leafs in Z-order and remove the duplicates
+                    std::vector<std::pair<uint64, size_t> > ord(_list.size());
+                    for (size_t k = 0; k < _list.size(); k++) { ord[k] = std::pair<uint64, size_t>(_leafMortonKey<D, R>(_list[k]), k); }
+                    std::sort(ord.begin(), ord.end());
+                    boxes.reserve(ord.size());
+                    for (size_t k = 0; k < ord.size(); k++)
+                        {
+                        const Pos & c = _list[ord[k].second];
+                        if ((k > 0) && (ord[k].first == ord[k - 1].first) && (c == _list[ord[k - 1].second])) continue;
+                        iBox<D> B;
+                        for (size_t i = 0; i < D; i++) { B.min[i] = c[i] - (int64)R; B.max[i] = c[i] + (int64)R; }
+                        boxes.push_back(B);
+                        }
+                    }
+                _list.clear();
+                _overflow = false;
+                if (_hasLast) { _list.push_back(_last); _hasLast = false; }
+                _epoch = _newEpoch(); // forget the leafs remembered by the writing threads
+                return ok;
+                }
+
+        private:
+
+            _journal(const _journal &) = delete;
+            _journal & operator=(const _journal &) = delete;
+
+            /* epochs are unique among all journals so a thread never mistakes a leaf of another journal for one of this journal */
+            static uint64 _newEpoch() { static std::atomic<uint64> counter(0); return ++counter; }
+
+            void _record(const Pos & pos)
+                {
+                struct Last { uint64 epoch; Pos center; };
+                static thread_local Last last = { 0, Pos() };
+                Pos c;
+                const int64 L = (int64)(2 * R + 1);
+                for (size_t i = 0; i < D; ++i) { const int64 x = pos[i] + (int64)R; c[i] = ((x >= 0) ? (x / L) : (-((-x + L - 1) / L))) * L; }
+                if ((last.epoch == _epoch.load(std::memory_order_acquire)) && (last.center == c)) return; // same leaf as the previous write
+                std::lock_guard<std::mutex> lock(_mut);
+                if (!_overflow)
+                    {
+                    if (_list.size() >= _cap) { _overflow = true; _list.clear(); } else { _list.push_back(c); }
+                    }
+                _last = c;
+                _hasLast = true;
+                last.epoch = _epoch;
+                last.center = c;
+                }
+
+            std::atomic<bool>   _on;        // true if the journal is enabled
+            std::atomic<uint64> _epoch;     // changed by take(): the writers must record again
+            std::mutex          _mut;       // protects the members below
+            size_t              _cap;       // maximum number of leafs recorded
+            bool                _overflow;  // true if everything must be considered modified
+            std::vector<Pos>    _list;      // centers of the leafs recorded
+            bool                _hasLast;   // true if _last is valid
+            Pos                 _last;      // center of the last leaf recorded
+        };
+
+
 
     }
 }
@@ -0,0 +1,256 @@
+/** @file minmaxpyramid.hpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+
+#include "../misc/internal/mtools_export.hpp"
+#include "../misc/misc.hpp"
+#include "../misc/error.hpp"
+
+#include <vector>
+#include <limits>
+#include <cmath>
+
+
+namespace mtools
+{
+
+
+    /**
+     * Multi-resolution min/max envelope of a sequence of numbers.
+     *
+     * The pyramid does not own the sequence. It stores, for each block of BLOCK consecutive
+     * elements and then for each group of FANOUT blocks (recursively), the min, max, sum and
+     * number of elements (with the positions of the min and max). The min/max/sum of any range
+     * [a,b) is then obtained in O(BLOCK + FANOUT*log(n)) operations, whatever the length of the
+     * range. NaN values are ignored.
+     *
+     * The pyramid is built incrementally: update() only computes the blocks of the elements added
+     * since the previous call (and the last, previously incomplete, block). If elements already
+     * seen are modified, call clear() before the next update().
+     *
+     * @code{.cpp}
+     * std::vector<int> walk;
+     * MinMaxPyramid P;
+     * ... // fill the vector
+     * P.update(walk.data(), walk.size());
+     * auto E = P.query(walk.data(), 1000, 1000000000); // E.min, E.max, E.argmin... over [1000, 10^9)
+     * @endcode
+     **/
+    class MinMaxPyramid
+    {
+
+    public:
+
+        static const size_t BLOCK = 1024;   ///< number of elements summarized by a node of the first level
+        static const size_t FANOUT = 16;    ///< number of children of the nodes of the other levels
+
+
+        /** Summary of a range of elements. */
+        struct Node
+            {
+            double min;         ///< minimum value (+inf if count = 0)
+            double max;         ///< maximum value (-inf if count = 0)
+            double sum;         ///< sum of the values
+            uint64 argmin;      ///< position of the minimum
+            uint64 argmax;      ///< position of the maximum
+            uint64 count;       ///< number of (non NaN) elements
+
+            /** Constructor. Empty range. */
+            Node() : min(std::numeric_limits<double>::infinity()), max(-std::numeric_limits<double>::infinity()), sum(0.0), argmin(0), argmax(0), count(0) {}
+
+            /** Add an element. */
+            inline void add(double v, uint64 pos)
+                {
+                if (std::isnan(v)) return;
+                if (v < min) { min = v; argmin = pos; }
+                if (v > max) { max = v; argmax = pos; }
+                sum += v;
+                count++;
+                }
+
+            /** Merge with the summary of another range. */
+            inline void merge(const Node & N)
+                {
+                if (N.count == 0) return;
+                if (N.min < min) { min = N.min; argmin = N.argmin; }
+                if (N.max > max) { max = N.max; argmax = N.argmax; }
+                sum += N.sum;
+                count += N.count;
+                }
+
+            /** Average value (NaN if the range is empty). */
+            inline double mean() const { return (count > 0) ? (sum / count) : std::numeric_limits<double>::quiet_NaN(); }
+            };
+
+
+        /** Constructor. Empty pyramid. */
+        MinMaxPyramid() : _n(0) {}
+
+
+        /** Number of elements summarized. */
+        size_t size() const { return _n; }
+
+
+        /** Forget everything (the next update() rebuilds the whole pyramid). */
+        void clear() { _n = 0; _levels.clear(); }
+
+
+        /** Approximate memory used by the pyramid (in bytes). */
+        size_t memoryUsed() const
+            {
+            size_t m = sizeof(*this);
+            for (const auto & L : _levels) { m += L.capacity() * sizeof(Node); }
+            return m;
+            }
+
+
+        /**
+         * Update the pyramid for the sequence tab[0..len-1]. Only the elements from position size()
+         * on are read (from the start of the last block). If len < size(), the pyramid is rebuilt.
+         *
+         * @param   tab Pointer to the sequence (elements must be convertible to double).
+         * @param   len Length of the sequence.
+         **/
+        template<typename T> void update(const T * tab, size_t len)
+            {
+            if (len < _n) clear();
+            if (len == _n) return;
+            if (_levels.size() == 0) _levels.resize(1);
+            size_t first = _n / BLOCK; // first node to recompute
+            const size_t nb0 = (len + BLOCK - 1) / BLOCK;
+            _levels[0].resize(nb0);
+            for (size_t k = first; k < nb0; k++)
+                {
+                Node N;
+                const size_t e = std::min<size_t>(len, (k + 1)*BLOCK);
+                for (size_t i = k*BLOCK; i < e; i++) { N.add((double)tab[i], (uint64)i); }
+                _levels[0][k] = N;
+                }
+            for (size_t L = 0; _levels[L].size() > 1; L++)
+                {
+                if (L + 1 == _levels.size()) _levels.resize(L + 2);
+                const std::vector<Node> & C = _levels[L];
+                std::vector<Node> & P = _levels[L + 1];
+                first /= FANOUT;
+                const size_t nbp = (C.size() + FANOUT - 1) / FANOUT;
+                P.resize(nbp);
+                for (size_t k = first; k < nbp; k++)
+                    {
+                    Node N;
+                    const size_t e = std::min<size_t>(C.size(), (k + 1)*FANOUT);
+                    for (size_t i = k*FANOUT; i < e; i++) { N.merge(C[i]); }
+                    P[k] = N;
+                    }
+                }
+            _n = len;
+            }
+
+
+        /**
+         * Summary of the elements in [a,b). The range is truncated to [0,size()).
+         *
+         * @param   tab Pointer to the sequence (the same as for update(), used for the partial
+         *              blocks at both ends of the range).
+         * @param   a   First element.
+         * @param   b   Position after the last element.
+         **/
+        template<typename T> Node query(const T * tab, size_t a, size_t b) const
+            {
+            Node R;
+            if (b > _n) b = _n;
+            if (a >= b) return R;
+            size_t lo = (a + BLOCK - 1) / BLOCK, hi = b / BLOCK; // full blocks [lo,hi)
+            if (lo >= hi) { for (size_t i = a; i < b; i++) { R.add((double)tab[i], (uint64)i); } return R; }
+            for (size_t i = a; i < lo*BLOCK; i++) { R.add((double)tab[i], (uint64)i); }
+            for (size_t i = hi*BLOCK; i < b; i++) { R.add((double)tab[i], (uint64)i); }
+            for (size_t L = 0; lo < hi; L++)
+                {
+                const std::vector<Node> & C = _levels[L];
+                const size_t plo = (lo + FANOUT - 1) / FANOUT, phi = hi / FANOUT; // complete parents
+                if ((L + 1 == _levels.size()) || (plo >= phi))
+                    {
+                    for (size_t k = lo; k < hi; k++) { R.merge(C[k]); }
+                    break;
+                    }
+                for (size_t k = lo; k < plo*FANOUT; k++) { R.merge(C[k]); }
+                for (size_t k = phi*FANOUT; k < hi; k++) { R.merge(C[k]); }
+                lo = plo; hi = phi;
+                }
+            return R;
+            }
+
+
+        /**
+         * Downsample the elements in [a,b) with the Largest-Triangle-Three-Buckets method. The range
+         * is cut in nbbuckets buckets of equal length and one element is selected in each of them:
+         * the one making the largest triangle with the element selected in the previous bucket and
+         * the average point of the next bucket. The candidates of a bucket are its min and max so the
+         * cost depends only on the number of buckets.
+         *
+         * @param           tab         Pointer to the sequence.
+         * @param           a           First element.
+         * @param           b           Position after the last element.
+         * @param           nbbuckets   Number of buckets.
+         * @param [in,out]  res         Position of the element selected in each bucket (size() if the bucket is empty).
+         **/
+        template<typename T> void lttb(const T * tab, size_t a, size_t b, size_t nbbuckets, std::vector<size_t> & res) const
+            {
+            res.assign(nbbuckets, _n);
+            if (b > _n) b = _n;
+            if ((a >= b) || (nbbuckets == 0)) return;
+            std::vector<Node> buckets(nbbuckets);
+            const double w = ((double)(b - a)) / nbbuckets;
+            for (size_t k = 0; k < nbbuckets; k++) { buckets[k] = query(tab, a + (size_t)(k*w), (k + 1 == nbbuckets) ? b : (a + (size_t)((k + 1)*w))); }
+            double px = 0.0, py = 0.0;
+            bool hasprev = false;
+            for (size_t k = 0; k < nbbuckets; k++)
+                {
+                const Node & B = buckets[k];
+                if (B.count == 0) continue;
+                // average point of the next non empty bucket (or of the bucket itself for the last one)
+                size_t k2 = k + 1;
+                while ((k2 < nbbuckets) && (buckets[k2].count == 0)) k2++;
+                const Node & C = (k2 < nbbuckets) ? buckets[k2] : B;
+                const double cx = a + ((k2 < nbbuckets) ? (k2 + 0.5) : (k + 0.5))*w, cy = C.mean();
+                if (!hasprev) { px = (double)B.argmin; py = B.min; } // no previous point: use the min of the bucket
+                const double amin = std::abs((px - cx)*(B.min - py) - (px - (double)B.argmin)*(cy - py));
+                const double amax = std::abs((px - cx)*(B.max - py) - (px - (double)B.argmax)*(cy - py));
+                const size_t sel = (amax > amin) ? (size_t)B.argmax : (size_t)B.argmin;
+                res[k] = sel;
+                px = (double)sel; py = (double)tab[sel];
+                hasprev = true;
+                }
+            }
+
+
+    private:
+
+        size_t _n;                                  // number of elements summarized
+        std::vector< std::vector<Node> > _levels;   // _levels[0] : blocks of BLOCK elements, _levels[k+1] : groups of FANOUT nodes of _levels[k]
+
+    };
+
+
+}
+
+
+/* end of file */
@@ -0,0 +1,400 @@
+/** @file particlegrid2D.hpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+
+#include "../misc/internal/mtools_export.hpp"
+#include "../misc/misc.hpp"
+#include "../misc/error.hpp"
+#include "../maths/vec.hpp"
+#include "../maths/box.hpp"
+#include "grid_basic.hpp"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+
+namespace mtools
+{
+
+
+    /**
+     * Spatial index for particles in the plane (off-lattice models such as continuum DLA/eDLA).
+     *
+     * The plane is divided into square cells of side cellSize() centered on the points of
+     * cellSize()*Z^2. Each particle is a center (fVec2) together with a value of type T. A cell may
+     * contain any number of particles: the particles of a cell form a linked list stored in a
+     * common pool so the memory used is proportional to the number of particles. The cells are the
+     * elements of a Grid_basic object and are created only when a particle is inserted so the
+     * quadtree-like structure of the grid is used to find large empty regions.
+     *
+     * The queries are:
+     * - nearest() / distance() : exact nearest particle / distance to the set of centers.
+     * - emptyRadius()          : cheap lower bound on the distance to the set of centers which is
+     *                            large far away from the particles (it uses the largest empty box
+     *                            of the grid containing the point). This is what a walker uses to
+     *                            make big jumps.
+     * - forEachInBall() and forEachInCell() to visit the particles close to a point.
+     *
+     * Particles are never moved in memory: the methods which only read a cell (nbInCell(),
+     * forEachInCell(), position(), value()) can be called by another thread (e.g. for drawing)
+     * while particles are inserted, with the same guarantees as Grid_basic::peek(). The other
+     * queries are not thread-safe.
+     *
+     * @code
+     * ParticleGrid2D<int64> G;                             // unit cells
+     * G.insert(fVec2(0.0, 0.0), 1);                        // seed
+     * fVec2 pos = ...;                                     // a walker
+     * double e = G.emptyRadius(pos) - 2*RAD;               // it can jump that far without touching the cluster
+     * int64 k = G.nearest(pos);                            // index of the closest particle
+     * @endcode
+     *
+     * @tparam  T   Type of the value associated with each particle (must be copyable).
+     **/
+    template<typename T = int64> class ParticleGrid2D
+    {
+
+    public:
+
+
+        /**
+         * Constructor. An empty index.
+         *
+         * @param   cellSize    Side of the cells. The best choice is about the diameter of the
+         *                      particles (or the interaction distance) so that a cell contains only
+         *                      a few particles.
+         **/
+        ParticleGrid2D(double cellSize = 1.0) : _cs(cellSize), _ics(1.0 / cellSize), _blocks(nullptr), _nb(0), _maxnorm(0.0), _cellbox()
+            {
+            MTOOLS_INSURE(cellSize > 0.0);
+            _blocks = new _Particle*[_NBBLOCKS];
+            for (size_t i = 0; i < _NBBLOCKS; i++) { _blocks[i] = nullptr; }
+            }
+
+
+        /**
+         * Destructor.
+         **/
+        ~ParticleGrid2D()
+            {
+            for (size_t i = 0; i < _NBBLOCKS; i++) { delete [] _blocks[i]; }
+            delete [] _blocks;
+            }
+
+
+        /**
+         * Remove all the particles.
+         **/
+        void clear()
+            {
+            _grid.reset();
+            _nb = 0;
+            _maxnorm = 0.0;
+            _cellbox.clear();
+            }
+
+
+        /**
+         * Insert a particle.
+         *
+         * @param   pos     Position of its center.
+         * @param   value   The associated value.
+         *
+         * @return  The index of the particle (0 for the first one, then 1, 2...).
+         **/
+        int64 insert(const fVec2 & pos, const T & value = T())
+            {
+            const int64 k = _nb;
+            MTOOLS_INSURE(k < (int64)(_NBBLOCKS*_BLOCKSIZE));
+            _Particle * & B = _blocks[(size_t)(k / _BLOCKSIZE)];
+            if (B == nullptr) { B = new _Particle[_BLOCKSIZE]; }
+            _Particle & P = B[(size_t)(k % _BLOCKSIZE)];
+            const iVec2 c = cellOf(pos);
+            _Cell & C = _grid(c);
+            P.pos = pos;
+            P.value = value;
+            P.next = C.first;
+            C.first = k;    // publish the particle once it is complete
+            C.nb++;
+            _nb = k + 1;
+            const double n = pos.norm();
+            if (n > _maxnorm) { _maxnorm = n; }
+            _cellbox.swallowPoint(c);
+            return k;
+            }
+
+
+        /**
+         * Number of particles.
+         **/
+        inline int64 size() const { return _nb; }
+
+
+        /**
+         * Position of the center of a particle.
+         **/
+        inline const fVec2 & position(int64 index) const { return _get(index).pos; }
+
+
+        /**
+         * Value associated with a particle.
+         **/
+        inline const T & value(int64 index) const { return _get(index).value; }
+
+
+        /**
+         * Value associated with a particle.
+         **/
+        inline T & value(int64 index) { return _get(index).value; }
+
+
+        /**
+         * Largest distance between the origin and the center of a particle (0 if there are none).
+         **/
+        inline double maxNorm() const { return _maxnorm; }
+
+
+        /**
+         * The side of the cells.
+         **/
+        inline double cellSize() const { return _cs; }
+
+
+        /**
+         * The cell containing a given position.
+         **/
+        inline iVec2 cellOf(const fVec2 & pos) const { return iVec2((int64)std::floor(pos.X()*_ics + 0.5), (int64)std::floor(pos.Y()*_ics + 0.5)); }
+
+
+        /**
+         * The square covered by a cell.
+         **/
+        inline fBox2 cellBox(const iVec2 & cell) const { return fBox2((cell.X() - 0.5)*_cs, (cell.X() + 0.5)*_cs, (cell.Y() - 0.5)*_cs, (cell.Y() + 0.5)*_cs); }
+
+
+        /**
+         * Number of particles whose center is in a given cell.
+         **/
+        inline int64 nbInCell(const iVec2 & cell) const
+            {
+            const _Cell * C = _grid.peek(cell);
+            return ((C == nullptr) ? 0 : C->nb);
+            }
+
+
+        /**
+         * Call fun(index, pos, value) for each particle whose center is in a given cell. The
+         * particles are visited from the last inserted to the first one.
+         **/
+        template<typename FUN> void forEachInCell(const iVec2 & cell, FUN fun) const
+            {
+            const _Cell * C = _grid.peek(cell);
+            if (C == nullptr) return;
+            for (int64 k = C->first; k >= 0; )
+                {
+                const _Particle & P = _get(k);
+                fun(k, P.pos, P.value);
+                k = P.next;
+                }
+            }
+
+
+        /**
+         * Call fun(index, pos, value) for each particle whose center is at distance at most r from
+         * pos.
+         **/
+        template<typename FUN> void forEachInBall(const fVec2 & pos, double r, FUN fun) const
+            {
+            const iVec2 c0 = cellOf(fVec2(pos.X() - r, pos.Y() - r));
+            const iVec2 c1 = cellOf(fVec2(pos.X() + r, pos.Y() + r));
+            const double r2 = r*r;
+            for (int64 j = c0.Y(); j <= c1.Y(); j++)
+                {
+                for (int64 i = c0.X(); i <= c1.X(); i++)
+                    {
+                    forEachInCell(iVec2(i, j), [&](int64 k, const fVec2 & p, const T & v) { if (dist2(pos, p) <= r2) fun(k, p, v); });
+                    }
+                }
+            }
+
+
+        /**
+         * Find the particle whose center is the closest to a given position.
+         *
+         * The cells are visited ring by ring around the cell containing pos, starting outside of the
+         * largest empty box of the grid around it.
+         *
+         * @param   pos     The position.
+         * @param   maxDist Only look for particles at distance at most maxDist.
+         *
+         * @return  The index of the closest particle or -1 if there is no particle at distance at
+         *          most maxDist.
+         **/
+        int64 nearest(const fVec2 & pos, double maxDist = std::numeric_limits<double>::infinity()) const
+            {
+            double d2;
+            return _nearest(pos, maxDist, d2);
+            }
+
+
+        /**
+         * Distance between a position and the closest center of a particle.
+         *
+         * @param   pos     The position.
+         * @param   maxDist Only look for particles at distance at most maxDist.
+         *
+         * @return  The distance, or infinity if there is no particle at distance at most maxDist.
+         **/
+        double distance(const fVec2 & pos, double maxDist = std::numeric_limits<double>::infinity()) const
+            {
+            double d2;
+            if (_nearest(pos, maxDist, d2) < 0) return std::numeric_limits<double>::infinity();
+            return std::sqrt(d2);
+            }
+
+
+        /**
+         * Lower bound on the distance between a position and the closest center of a particle. It is
+         * much cheaper than distance():
+         *
+         * - if pos lies in an empty box of the grid (at least one cell away from its boundary), the
+         *   bound is the distance to the boundary of the box. The boxes are found hierarchically in
+         *   the tree of the grid so the bound is of the order of the distance to the particles.
+         * - otherwise, the bound is exact up to distance cellSize() (the particles of the 3x3 cells
+         *   around pos are examined).
+         *
+         * @param   pos The position.
+         *
+         * @return  A lower bound on distance(pos).
+         **/
+        double emptyRadius(const fVec2 & pos) const
+            {
+            const iVec2 c = cellOf(pos);
+            iBox2 R;
+            const _Cell * C = _grid.findFullBoxCentered(c, R);
+            if ((C == nullptr) && (R.boundaryDist(c) > 0))
+                {
+                const fBox2 fR((R.min[0] - 0.5)*_cs, (R.max[0] + 0.5)*_cs, (R.min[1] - 0.5)*_cs, (R.max[1] + 0.5)*_cs);
+                return fR.boundaryDist(pos);
+                }
+            double r = _cs + _distToCellBoundary(pos, c); r *= r;
+            for (int64 j = -1; j <= 1; j++)
+                {
+                for (int64 i = -1; i <= 1; i++)
+                    {
+                    forEachInCell(iVec2(c.X() + i, c.Y() + j), [&](int64, const fVec2 & p, const T &) { const double d = dist2(pos, p); if (d < r) { r = d; } });
+                    }
+                }
+            return std::sqrt(r);
+            }
+
+
+    private:
+
+
+        /* a particle */
+        struct _Particle
+            {
+            fVec2   pos;    // center
+            T       value;  // associated value
+            int64   next;   // next particle in the same cell (-1 for none)
+            };
+
+
+        /* a cell: the first particle of the list and the number of particles. */
+        struct _Cell
+            {
+            _Cell() : first(-1), nb(0) {}
+            int64 first;
+            int64 nb;
+            };
+
+
+        /* the particle with a given index */
+        inline _Particle & _get(int64 k) const { return _blocks[(size_t)(k / _BLOCKSIZE)][(size_t)(k % _BLOCKSIZE)]; }
+
+
+        /* distance between pos and the boundary of the cell c which contains it */
+        inline double _distToCellBoundary(const fVec2 & pos, const iVec2 & c) const
+            {
+            const double r1 = 0.5*_cs - std::abs(pos.X() - c.X()*_cs);
+            const double r2 = 0.5*_cs - std::abs(pos.Y() - c.Y()*_cs);
+            return std::max(0.0, std::min(r1, r2));
+            }
+
+
+        /* index of the closest particle at distance at most maxDist (or -1), set d2 to the squared distance */
+        int64 _nearest(const fVec2 & pos, double maxDist, double & d2) const
+            {
+            d2 = std::numeric_limits<double>::infinity();
+            if ((_nb == 0) || (!(maxDist >= 0.0))) return -1;
+            const iVec2 c = cellOf(pos);
+            const double d0 = _distToCellBoundary(pos, c);
+            int64 best = -1;
+            double best2 = ((maxDist == std::numeric_limits<double>::infinity()) ? maxDist : maxDist*maxDist);
+            auto test = [&](int64 k, const fVec2 & p, const T &) { const double d = dist2(pos, p); if (d <= best2) { best2 = d; best = k; } };
+            // the cells at distance < k from c are empty: those outside of the bounding box of the
+            // occupied cells and those inside the empty box of the grid around c.
+            const iBox2 & B = _cellbox;
+            int64 k = std::max<int64>(0, std::max(std::max(B.min[0] - c.X(), c.X() - B.max[0]), std::max(B.min[1] - c.Y(), c.Y() - B.max[1])));
+            iBox2 R;
+            if (_grid.findFullBoxCentered(c, R) == nullptr) { k = std::max<int64>(k, R.boundaryDist(c) + 1); }
+            // last ring which meets the bounding box
+            const int64 kmax = std::max(std::max(B.max[0] - c.X(), c.X() - B.min[0]), std::max(B.max[1] - c.Y(), c.Y() - B.min[1]));
+            for (; k <= kmax; k++)
+                { // the cells of ring k are at distance at least (k-1)*cs + d0 from pos.
+                const double lb = (k - 1)*_cs + d0;
+                if ((lb > 0) && (lb*lb > best2)) break;
+                if (k == 0) { forEachInCell(c, test); continue; }
+                const int64 x0 = std::max(c.X() - k, B.min[0]), x1 = std::min(c.X() + k, B.max[0]);
+                const int64 y0 = std::max(c.Y() - k + 1, B.min[1]), y1 = std::min(c.Y() + k - 1, B.max[1]);
+                if (c.Y() - k >= B.min[1]) { for (int64 i = x0; i <= x1; i++) forEachInCell(iVec2(i, c.Y() - k), test); }
+                if (c.Y() + k <= B.max[1]) { for (int64 i = x0; i <= x1; i++) forEachInCell(iVec2(i, c.Y() + k), test); }
+                if (c.X() - k >= B.min[0]) { for (int64 j = y0; j <= y1; j++) forEachInCell(iVec2(c.X() - k, j), test); }
+                if (c.X() + k <= B.max[0]) { for (int64 j = y0; j <= y1; j++) forEachInCell(iVec2(c.X() + k, j), test); }
+                }
+            if (best >= 0) d2 = best2;
+            return best;
+            }
+
+
+        ParticleGrid2D(const ParticleGrid2D &) = delete;
+        ParticleGrid2D & operator=(const ParticleGrid2D &) = delete;
+
+        static const size_t _BLOCKSIZE = 65536;     // number of particles in a block
+        static const size_t _NBBLOCKS = 65536;      // size of the table of blocks
+
+        double                      _cs;        // side of a cell
+        double                      _ics;       // 1/_cs
+        Grid_basic<2, _Cell, 2>     _grid;      // the cells
+        _Particle **                _blocks;    // blocks of particles (never moved)
+        int64                       _nb;        // number of particles
+        double                      _maxnorm;   // largest norm of a center
+        iBox2                       _cellbox;   // bounding box of the cells which contain a particle
+    };
+
+
+}
+
+
+/* end of file */
+
@@ -25,9 +25,12 @@
 #include "../misc/stringfct.hpp"
 #include "../misc/misc.hpp"
 #include "../misc/error.hpp"
+#include "../random/classiclaws.hpp"
+#include "../io/serialization.hpp"
 
 #include <string>
 #include <vector>
+#include <type_traits>
 
 
 namespace mtools
@@ -36,7 +39,13 @@ namespace mtools
 
     /**
      * A random urn container. Element can be added and removed from the urn. It is possible to pick
-     * an element at random via operator() by providing a uniform random number in [0,1[.
+     * an element at random via operator() by providing a uniform random number in [0,1[ or with
+     * pick(gen).
+     * 
+     * The elements are stored contiguously so removing an element moves the last element of the
+     * urn into its place: indices and references are not stable. Each element also has a Handle
+     * (returned by insertHandle() or handleOf()) which remains valid until the element is removed:
+     * the urn keeps a slot map (handle -> index) so that get(h) and remove(h) run in constant time.
      *
      * @tparam  T   Type of object that the urn contains.
      **/
@@ -44,10 +53,30 @@ namespace mtools
     {
     public:
 
+        /**
+         * Handle to an element of the urn. Remains valid until the element is removed (or the urn is
+         * cleared / loaded), whatever the other insertions and removals. Handles are saved with the
+         * urn.
+         **/
+        struct Handle
+            {
+            Handle() : _slot(NO_SLOT), _gen(0) {}
+
+            bool operator==(const Handle & h) const { return ((_slot == h._slot) && (_gen == h._gen)); }
+            bool operator!=(const Handle & h) const { return !(*this == h); }
+
+            private:
+                friend class RandomUrn<T>;
+                Handle(size_t slot, uint32 gen) : _slot(slot), _gen(gen) {}
+                size_t _slot;   // index of the slot
+                uint32 _gen;    // generation of the slot when the handle was created
+            };
+
+
         /**
          * Default constructor. An empty urn
          **/
-        RandomUrn() {}
+        RandomUrn() : _freeSlot(NO_SLOT) {}
 
 
         /**
@@ -56,7 +85,7 @@ namespace mtools
          * 
          * @param   filename    name of the file.
          **/
-        RandomUrn(const std::string & filename) { load(filename); }
+        RandomUrn(const std::string & filename) : _freeSlot(NO_SLOT) { load(filename); }
 
 
         /**
@@ -66,21 +95,21 @@ namespace mtools
          **/
         void load(const std::string & filename)
             {
-            _tab.clear();
+            clear();
             IFileArchive ar(filename);
             ar & (*this);
             }
 
 
         /**
-         * Saves the urn into a file. Throws if error.
-         * Use .z or .gz to save in compressed format.
+         * Saves the urn into a file (binary archive: the tables are written as raw blocks). Throws 
+         * if error. Use .z or .gz to save in compressed format.
          * 
          * @param   filename    name of the file.
          **/
-        void save(const std::string & filename)
+        void save(const std::string & filename) const
             {
-            OFileArchive ar(filename);
+            OBinaryFileArchive ar(filename);
             ar & (*this);
             }
 
@@ -128,6 +157,23 @@ namespace mtools
             }
 
 
+        /**
+         * Pick an element uniformly at random in the urn (the urn must not be empty). Use an exact
+         * integer sampler (Unif_bounded()) instead of a double in [0,1[.
+         * 
+         * @warning The reference is invalidated after a call to insert(), remove() or clear().
+         *
+         * @param [in,out]  gen The random number generator.
+         *
+         * @return  A reference to the element chosen.
+         **/
+        template<class random_t> inline T & pick(random_t & gen)
+            {
+            MTOOLS_ASSERT(_tab.size() > 0);
+            return _tab[(size_t)Unif_bounded((uint64)_tab.size(), gen)];
+            }
+
+
         /**
          * Inserts an element in the Urn.
          *
@@ -137,11 +183,25 @@ namespace mtools
          **/
         inline T & insert(const T & obj)
             {
-            _tab.emplace_back(obj);
+            _insert(obj);
             return _tab.back();
             }
 
 
+        /**
+         * Inserts an element in the Urn and return its handle.
+         *
+         * @param   obj The object to insert
+         *
+         * @return  The handle of the object.
+         **/
+        inline Handle insertHandle(const T & obj)
+            {
+            const size_t slot = _insert(obj);
+            return Handle(slot, _gen[slot]);
+            }
+
+
         /**
          * Removes an element from the urn.
          *
@@ -151,15 +211,95 @@ namespace mtools
             {
             auto index = (&obj) - _tab.data();
             MTOOLS_ASSERT(((index >= 0) && (index < (int64)_tab.size())));
-            if ((size_t)(index + 1) < _tab.size()) { _tab[index] = _tab.back(); }
-            _tab.pop_back();
+            _remove((size_t)index);
+            }
+
+
+        /**
+         * Removes an element from the urn given its handle.
+         *
+         * @param   h   The handle of the object to remove.
+         **/
+        inline void remove(Handle h)
+            {
+            MTOOLS_ASSERT(isValid(h));
+            _remove(_slots[h._slot]);
+            }
+
+
+        /**
+         * Query if a handle refers to an element of the urn.
+         **/
+        inline bool isValid(Handle h) const
+            {
+            return ((h._slot < _slots.size()) && (_gen[h._slot] == h._gen) && (_slots[h._slot] < _tab.size()) && (_owner[_slots[h._slot]] == h._slot));
+            }
+
+
+        /**
+         * Access an element given its handle.
+         **/
+        inline T & get(Handle h)
+            {
+            MTOOLS_ASSERT(isValid(h));
+            return _tab[_slots[h._slot]];
+            }
+
+
+        /**
+         * Access an element given its handle.
+         **/
+        inline const T & get(Handle h) const
+            {
+            MTOOLS_ASSERT(isValid(h));
+            return _tab[_slots[h._slot]];
             }
 
 
         /**
-         * Remove every elements in the urn, leaving it empty.
+         * Return the handle of the element at a given position (between 0 and size()-1).
          **/
-        void clear() { _tab.clear(); }
+        inline Handle handle(size_t pos) const
+            {
+            MTOOLS_ASSERT(pos < size());
+            const size_t slot = _owner[pos];
+            return Handle(slot, _gen[slot]);
+            }
+
+
+        /**
+         * Return the handle of an element of the urn given a reference to it (e.g. returned by
+         * pick() or insert()).
+         **/
+        inline Handle handleOf(const T & obj) const
+            {
+            auto index = (&obj) - _tab.data();
+            MTOOLS_ASSERT(((index >= 0) && (index < (int64)_tab.size())));
+            return handle((size_t)index);
+            }
+
+
+        /**
+         * Return the current position of an element given its handle.
+         **/
+        inline size_t index(Handle h) const
+            {
+            MTOOLS_ASSERT(isValid(h));
+            return _slots[h._slot];
+            }
+
+
+        /**
+         * Remove every elements in the urn, leaving it empty. All handles are invalidated.
+         **/
+        void clear() 
+            { 
+            _tab.clear(); 
+            _owner.clear();
+            _slots.clear();
+            _gen.clear();
+            _freeSlot = NO_SLOT;
+            }
 
 
         /**
@@ -179,7 +319,7 @@ namespace mtools
          * @return  The number of byte used by the urn (does not count memory dynamiccally allocate by T
          *          objects).
          **/
-        size_t memoryUsed() const { return MEM_FOR_OBJ(T, _tab.size()) + sizeof(*this); }
+        size_t memoryUsed() const { return MEM_FOR_OBJ(T, _tab.size()) + MEM_FOR_OBJ(size_t, _owner.size() + _slots.size()) + MEM_FOR_OBJ(uint32, _gen.size()) + sizeof(*this); }
 
         /**
         * Memory allocated by the urn.
@@ -187,24 +327,125 @@ namespace mtools
         * @return  The number of byte used by the urn (does not count memory dynamiccally allocate by T
         *          objects).
         **/
-        size_t memoryAllocated() const { return MEM_FOR_OBJ(T, _tab.capacity()) + sizeof(*this); }
+        size_t memoryAllocated() const { return MEM_FOR_OBJ(T, _tab.capacity()) + MEM_FOR_OBJ(size_t, _owner.capacity() + _slots.capacity()) + MEM_FOR_OBJ(uint32, _gen.capacity()) + sizeof(*this); }
 
 
         /**
-        * serialise/deserialize the urn. Works with boost and with the custom serialization classes
-        * OBaseArchive and IBaseArchive. the method performs both serialization and deserialization.
+        * serialise/deserialize the urn (the elements and their handles). Works with boost and with the
+        * custom serialization classes OBaseArchive and IBaseArchive. the method performs both
+        * serialization and deserialization.
+        *
+        * The urn is written after a format tag and a version number. Urns saved without them (elements
+        * only) can still be loaded: the elements are read and new handles are created for them.
         **/
         template<typename ARCHIVE> void serialize(ARCHIVE & ar, const int version = 0)
             {
-            ar & _tab;
+            _serialize(ar, std::integral_constant<bool, _isLoading<ARCHIVE>::value>());
             }
 
 
     private: 
-        std::vector<T> _tab;
+
+        static const size_t NO_SLOT = (size_t)(-1);
+        static const uint64 FORMAT_TAG = (uint64)(-1);    // written first: cannot be the size of the element vector of the old format
+        static const uint32 FORMAT_VERSION = 1;
+
+        /* whether ARCHIVE reads the urn: IBaseArchive or boost input archives (ARCHIVE::is_loading) */
+        template<typename ARCHIVE, typename = void> struct _isLoading : std::is_base_of<IBaseArchive, ARCHIVE> {};
+        template<typename ARCHIVE> struct _isLoading<ARCHIVE, typename std::conditional<true, void, typename ARCHIVE::is_loading>::type> : std::integral_constant<bool, ARCHIVE::is_loading::value> {};
+
+        /* save the urn */
+        template<typename ARCHIVE> void _serialize(ARCHIVE & ar, std::false_type)
+            {
+            uint64 tag = FORMAT_TAG;
+            uint32 ver = FORMAT_VERSION;
+            ar & tag;
+            ar & ver;
+            ar & _tab;
+            ar & _owner;
+            ar & _gen;
+            }
+
+        /* load the urn. The slot map and the free list are rebuilt from the saved handles */
+        template<typename ARCHIVE> void _serialize(ARCHIVE & ar, std::true_type)
+            {
+            clear();
+            uint64 tag;
+            ar & tag;
+            if (tag != FORMAT_TAG)
+                { // old format: tag is the number of elements, which follow. Each element gets a new slot.
+                _tab.resize((size_t)tag);
+                for (size_t i = 0; i < _tab.size(); i++) { ar & _tab[i]; }
+                _owner.resize(_tab.size());
+                for (size_t i = 0; i < _owner.size(); i++) { _owner[i] = i; }
+                _slots = _owner;
+                _gen.assign(_tab.size(), 0);
+                return;
+                }
+            uint32 ver;
+            ar & ver;
+            MTOOLS_INSURE(ver == FORMAT_VERSION);
+            ar & _tab;
+            ar & _owner;
+            ar & _gen;
+            MTOOLS_INSURE((_owner.size() == _tab.size()) && (_gen.size() >= _tab.size()));
+            _slots.assign(_gen.size(), NO_SLOT);
+            for (size_t i = 0; i < _owner.size(); i++) { MTOOLS_INSURE((_owner[i] < _slots.size()) && (_slots[_owner[i]] == NO_SLOT)); _slots[_owner[i]] = i; }
+            for (size_t s = _slots.size(); s > 0; s--) { if (_slots[s - 1] == NO_SLOT) { _slots[s - 1] = _freeSlot; _freeSlot = s - 1; } }
+            }
+
+        /* add an element at the end of _tab and give it a slot. Return the slot. */
+        inline size_t _insert(const T & obj)
+            {
+            size_t slot;
+            if (_freeSlot != NO_SLOT)
+                {
+                slot = _freeSlot;
+                _freeSlot = _slots[slot];
+                }
+            else
+                {
+                slot = _slots.size();
+                _slots.push_back(0);
+                _gen.push_back(0);
+                }
+            _slots[slot] = _tab.size();
+            _tab.emplace_back(obj);
+            _owner.push_back(slot);
+            return slot;
+            }
+
+        /* remove the element at a given index: the last element is moved into its place and the slot is freed */
+        inline void _remove(size_t index)
+            {
+            const size_t slot = _owner[index];
+            const size_t last = _tab.size() - 1;
+            if (index < last)
+                { 
+                _tab[index] = std::move(_tab[last]);
+                _owner[index] = _owner[last];
+                _slots[_owner[index]] = index;
+                }
+            _tab.pop_back();
+            _owner.pop_back();
+            _gen[slot]++;               // invalidate the handles to this slot
+            _slots[slot] = _freeSlot;   // and put it in the free list
+            _freeSlot = slot;
+            }
+
+        std::vector<T>      _tab;       // the elements
+        std::vector<size_t> _owner;     // slot of each element
+        std::vector<size_t> _slots;     // position of the element of each slot (or next free slot)
+        std::vector<uint32> _gen;       // generation of each slot
+        size_t              _freeSlot;  // first free slot (NO_SLOT if none)
     };
 
 
+    template<typename T> const size_t RandomUrn<T>::NO_SLOT;
+    template<typename T> const uint64 RandomUrn<T>::FORMAT_TAG;
+    template<typename T> const uint32 RandomUrn<T>::FORMAT_VERSION;
+
+
 }
 
 
@@ -25,18 +25,34 @@
 #include "../maths/vec.hpp"
 #include "../maths/box.hpp"
 #include "../misc/metaprog.hpp"
+#include "../misc/memory.hpp"
 #include "../io/serialization.hpp"
 #include "../graphics/rgbc.hpp"
 #include "../graphics/image.hpp"
+#include "../misc/internal/threadworker.hpp"
 
 
 #include <string>
 #include <vector>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+#include <fstream>
+#include <cstring>
+#include <type_traits>
+#include <queue>
+#include <limits>
+#include <cmath>
 
 
 namespace mtools
 {
 
+	template<class T, class TFloat> class FrozenTreeFigure;
+
+
 	/**
 	 * TreeFigure class. 
 	 * 
@@ -54,6 +70,11 @@ namespace mtools
 	 * This class if useful to store figure objects (such a line/rectangle/point...) cf the 
 	 * plot2DFigure class. 
 	 * 
+	 * Objects can also be moved or removed: insert() returns a Handle to the object which can then
+	 * be given to update() and remove(). The cost of these operations depends only on the object
+	 * moved so animated scenes (particles, evolving packings...) need not rebuild the tree at each
+	 * frame. Nodes that become empty are released lazily, by condense().
+	 * 
 	 * @tparam	T	   template parameter representing the type of objects contained in the container.
 	 * @tparam	N	   Max number of 'reducible' object per node (typically between 2 and 100). 
 	 * @tparam	TFloat Type use for floating point computation (default double).
@@ -88,6 +109,53 @@ namespace mtools
 			};
 
 
+		/**
+		* Handle to an object of the tree, returned by insert(). It stays valid, whatever the calls to
+		* insert() / update() / remove() for other objects, until the object is removed or the tree is 
+		* reset. 
+		**/
+		struct Handle
+			{
+			Handle() : _p(nullptr) {}
+
+			/** true if the handle refers to an object. */
+			bool isValid() const { return (_p != nullptr); }
+
+			bool operator==(const Handle & h) const { return (_p == h._p); }
+			bool operator!=(const Handle & h) const { return (_p != h._p); }
+
+			private:
+
+			friend class TreeFigure;
+			Handle(void * p) : _p(p) {}
+			void * _p;
+			};
+
+
+		/**
+		* Level of detail summary of a node (cf. computeLOD()).
+		* 
+		* The bounding box of the node is divided into LOD_SIZE x LOD_SIZE cells. Cell (i,j), at index 
+		* i + LOD_SIZE*j, covers [min[0] + i*w, min[0] + (i+1)*w] x [min[1] + j*h, min[1] + (j+1)*h] 
+		* where w and h are the width and height of the node box divided by LOD_SIZE. 
+		**/
+		struct LODRaster
+			{
+			static const int LOD_SIZE = 4;
+
+			float	coverage[LOD_SIZE*LOD_SIZE];	// fraction of the cell covered by the objects of the subtree (clamped to 1)
+			RGBc	color[LOD_SIZE*LOD_SIZE];		// area weighted average colour of these objects, opacity multiplied by the coverage
+
+			/** Return the box of cell (i,j) for a node with bounding box nodebox. */
+			static BBox cellBox(const BBox & nodebox, int i, int j)
+				{
+				const TFloat w = (nodebox.max[0] - nodebox.min[0]) / LOD_SIZE;
+				const TFloat h = (nodebox.max[1] - nodebox.min[1]) / LOD_SIZE;
+				return BBox(nodebox.min[0] + i*w, nodebox.min[0] + (i + 1)*w, nodebox.min[1] + j*h, nodebox.min[1] + (j + 1)*h);
+				}
+			};
+
+
 
 		/**************************************************************************************************
 		* Public Methods
@@ -97,7 +165,7 @@ namespace mtools
 		/**
 		* Default constructor, create an empty object.
 		**/
-		TreeFigure(bool callDtors = false) : _callDtors(callDtors), _rootNode(nullptr), _treeNodePool(), _listNodePool()
+		TreeFigure(bool callDtors = false) : _callDtors(callDtors), _looseUpdate(true), _rootNode(nullptr), _treeNodePool(), _listNodePool(), _lod(), _dirtyNodes()
 			{
 			_createRoot(); // create the root
 			}
@@ -115,7 +183,7 @@ namespace mtools
 		/**
 		* Move constructor.
 		**/
-		TreeFigure(const TreeFigure && TF) : _callDtors(TF._callDtors), _rootNode(TF._rootNode), _treeNodePool(std::forward<decltype(_treeNodePool)>(TF._sqrNodePool)), _listNodePool(std::forward<decltype(_listNodePool)>(TF._listNodePool))
+		TreeFigure(const TreeFigure && TF) : _callDtors(TF._callDtors), _looseUpdate(TF._looseUpdate), _rootNode(TF._rootNode), _treeNodePool(std::forward<decltype(_treeNodePool)>(TF._sqrNodePool)), _listNodePool(std::forward<decltype(_listNodePool)>(TF._listNodePool))
 			{
 			TF._rootNode = nullptr;
 			}
@@ -128,6 +196,7 @@ namespace mtools
 			{
 			_reset();
 			_callDtors = TF._callDtors;
+			_looseUpdate = TF._looseUpdate;
 			_rootNode = TF._rootNode;
 			_treeNodePool = std::forward<decltype(_treeNodePool)>(TF._treeNodePool);
 			_listNodePool = std::forward<decltype(_listNodePool)>(TF._listNodePool);
@@ -181,9 +250,9 @@ namespace mtools
 		* 
 		* A copy of object is made with the copy constructor.
 		**/
-		MTOOLS_FORCEINLINE void insert(const BBox & boundingbox, const T & object)
+		MTOOLS_FORCEINLINE Handle insert(const BBox & boundingbox, const T & object)
 			{
-			insert({ boundingbox , object });
+			return insert({ boundingbox , object });
 			}
 
 
@@ -191,34 +260,244 @@ namespace mtools
 		* Insert a bounded object.
 		* 
 		* A copy is made with the copy constructor.
+		* 
+		* @return	A handle to the object (for update() and remove()).
 		**/
-		void insert(const BoundedObject & boundedObject)
+		Handle insert(const BoundedObject & boundedObject)
 			{
 			MTOOLS_INSURE(!(boundedObject.boundingbox.isEmpty())); // bounding box should not be empty. 
+			if (!_lod.empty()) _lod.clear(); // LOD summaries are now obsolete
 			// create new roots until we contain the object's bounding box
 			while (!(_rootNode->_bbox.contain(boundedObject.boundingbox))) { _reRootUp(); }
+			_ListNode * LN = (_ListNode *)_listNodePool.malloc();
+			::new(LN) _ListNode(boundedObject);
 			// start from the root and go down
-			_TreeNode * node = _rootNode;
-			while (1)
+			_place(LN, _rootNode);
+			return Handle(LN);
+			}
+
+
+		/**
+		 * Remove an object from the tree. The handle (and its copies) become invalid. 
+		 * 
+		 * The object's destructor is called if the tree was created with callDtors = true. The nodes
+		 * emptied are not released immediately but by the next call to condense() (which is done
+		 * automatically from time to time).
+		 **/
+		void remove(Handle h)
+			{
+			MTOOLS_ASSERT(h.isValid());
+			if (!_lod.empty()) _lod.clear();
+			_ListNode * LN = (_ListNode *)h._p;
+			_TreeNode * node = LN->_owner;
+			_unlink(LN);
+			_markDirty(node);
+			if (_callDtors) _listNodePool.destroyAndFree(LN); else _listNodePool.free(LN);
+			if (_dirtyNodes.size() >= MAX_DIRTY_NODES) condense();
+			}
+
+
+		/**
+		 * Change the bounding box of an object.
+		 * 
+		 * If the new box is still contained in the box of the node holding the object and the loose
+		 * update mode is on (cf. looseUpdate()), the box is just modified in place: small moves do
+		 * not change the structure of the tree. Otherwise, the object goes up to the first ancestor
+		 * containing the new box and then down to its new node, as insert() does from the root. In
+		 * both cases, the cost is independent of the number of objects in the tree.
+		 *
+		 * @param	h	  	Handle to the object.
+		 * @param	newBox	The new bounding box (must not be empty).
+		 **/
+		void update(Handle h, const BBox & newBox)
+			{
+			MTOOLS_ASSERT(h.isValid());
+			MTOOLS_INSURE(!(newBox.isEmpty()));
+			if (!_lod.empty()) _lod.clear();
+			_ListNode * LN = (_ListNode *)h._p;
+			_TreeNode * node = LN->_owner;
+			if (node->_bbox.contain(newBox))
 				{
-				int i = _getIndex(boundedObject.boundingbox, node->_bbox);
-				if (i == 15)
-					{ // irreducible item, we just put it there (in front)
-					_addIrreducible(boundedObject, node);
-					// deal with overflowing nodes if needed.  
-					if ((node->_nb_reducible >0) &&(node->_nb_reducible + node->_nb_irreducible > N)) _overflow(node);
+				const bool irr = _isIrreducible(LN);
+				const int i = _getIndex(newBox, node->_bbox);
+				if (_looseUpdate)
+					{ // stay here, just move the object to the correct list if needed. 
+					LN->_bobj.boundingbox = newBox;
+					if (irr != (i == 15)) { _unlink(LN, irr); if (i == 15) _linkIrreducible(LN, node); else _linkReducible(LN, node); }
 					return;
 					}
-				if (node->_son[i] == nullptr)
-					{ // son not created. Put reducible object right here. 
-					_addReducible(boundedObject, node);
-					// and check for overflow
-					if (node->_nb_reducible + node->_nb_irreducible > N) _overflow(node);
+				if ((irr) ? (i == 15) : ((i != 15) && (node->_son[i] == nullptr)))
+					{ // the object would be placed here anyway
+					LN->_bobj.boundingbox = newBox;
 					return;
 					}
-				// go to the correct son and continue
-				node = node->_son[i]; 
 				}
+			_unlink(LN);
+			_markDirty(node);
+			LN->_bobj.boundingbox = newBox;
+			// go up until the box is contained and then down again. 
+			while ((node->_father != nullptr) && (!(node->_bbox.contain(newBox)))) { node = node->_father; }
+			while (!(_rootNode->_bbox.contain(newBox))) { _reRootUp(); }
+			if (!(node->_bbox.contain(newBox))) node = _rootNode;
+			_place(LN, node);
+			if (_dirtyNodes.size() >= MAX_DIRTY_NODES) condense();
+			}
+
+
+		/**
+		 * Change the bounding box and the object associated with a handle.
+		 **/
+		void update(Handle h, const BBox & newBox, const T & newObject)
+			{
+			object(h) = newObject;
+			update(h, newBox);
+			}
+
+
+		/**
+		 * Return the bounded object associated with a handle.
+		 **/
+		const BoundedObject & get(Handle h) const
+			{
+			MTOOLS_ASSERT(h.isValid());
+			return ((const _ListNode *)h._p)->_bobj;
+			}
+
+
+		/**
+		 * Return a reference to the object associated with a handle (use update() to change its
+		 * bounding box).
+		 **/
+		T & object(Handle h)
+			{
+			MTOOLS_ASSERT(h.isValid());
+			return ((_ListNode *)h._p)->_bobj.object;
+			}
+
+
+		/**
+		 * Set the loose update mode (on by default). When on, update() keeps an object in its node as
+		 * long as its new box fits inside the node box, even if it could now be stored deeper in the
+		 * tree. When off, update() always places the object at the node insert() would choose.
+		 **/
+		void looseUpdate(bool loose) { _looseUpdate = loose; }
+
+
+		/**
+		 * Query the loose update mode.
+		 **/
+		bool looseUpdate() const { return _looseUpdate; }
+
+
+		/**
+		 * Condense the nodes emptied by remove() and update(): leaf sons whose objects fit in their
+		 * father are merged into it and nodes left without objects and sons are released (going up
+		 * the tree as long as possible). Only the nodes modified since the last call are visited.
+		 * Called automatically by remove() and update() once MAX_DIRTY_NODES nodes are pending.
+		 **/
+		void condense()
+			{
+			if (_dirtyNodes.size() == 0) return;
+			// deepest nodes first so that the sons are visited before their father.
+			std::vector<std::pair<int, size_t> > tab; // (-depth, index in _dirtyNodes)
+			tab.reserve(_dirtyNodes.size());
+			for (size_t i = 0; i < _dirtyNodes.size(); i++)
+				{
+				int d = 0;
+				for (_TreeNode * f = _dirtyNodes[i]->_father; f != nullptr; f = f->_father) d++;
+				tab.push_back({ -d, i });
+				}
+			std::sort(tab.begin(), tab.end());
+			std::vector<_TreeNode *> nodes;
+			nodes.swap(_dirtyNodes);
+			for (auto & pr : tab)
+				{
+				_TreeNode * node = nodes[pr.second];
+				node->_dirty = false;
+				while (node != nullptr)
+					{
+					_absorbLeafSons(node);
+					_TreeNode * father = node->_father;
+					if ((father == nullptr) || (node->_nb_reducible + node->_nb_irreducible > 0) || (_hasSon(node))) break;
+					// empty leaf: release it and continue with the father (unless it is pending itself).
+					for (int j = 0; j < 15; j++) { if (father->_son[j] == node) { father->_son[j] = nullptr; break; } }
+					_treeNodePool.free(node);
+					node = ((father->_dirty) ? nullptr : father);
+					}
+				}
+			}
+
+
+		/** number of pending nodes which triggers an automatic call to condense() */
+		static const size_t MAX_DIRTY_NODES = 256;
+
+
+		/**
+		 * Insert many objects at once.
+		 * 
+		 * The objects are sorted along a Morton (Z-order) curve and then dispatched top-down in the
+		 * tree: at each node, the objects are split between the node and its sons by a counting sort
+		 * on the son index. Once the sets are small enough, the subtrees are built in parallel. The
+		 * list nodes are allocated in Morton order so objects that are close in space are also close
+		 * in memory.
+		 * 
+		 * The tree obtained satisfies the same invariants as one built by insert() so it can still be
+		 * modified afterwards (but the objects need not be placed at the exact same nodes). The object
+		 * may be non-empty in which case the new objects are added to the existing ones.
+		 *
+		 * @param [in,out]	objects  	The objects to insert (moved from). The vector is cleared. 
+		 * @param 		  	nbThreads	Number of threads to use (0 = number of hardware threads).
+		 * @param [in,out]	handles  	If not nullptr, receives the handles of the objects (in the 
+		 * 								order of the vector objects).
+		 **/
+		void bulkLoad(std::vector<BoundedObject> && objects, size_t nbThreads = 0, std::vector<Handle> * handles = nullptr)
+			{
+			const size_t n = objects.size();
+			if (n == 0) return;
+			if (nbThreads == 0) { nbThreads = (size_t)nbHardwareThreads(); }
+			_lod.clear();
+			// grow the root so that it contains every object
+			BBox U;
+			for (size_t i = 0; i < n; i++) { MTOOLS_INSURE(!(objects[i].boundingbox.isEmpty())); U.swallowBox(objects[i].boundingbox); }
+			while (!(_rootNode->_bbox.contain(U))) { _reRootUp(); }
+			// sort along the Morton curve of the root box
+			std::vector<std::pair<uint64, size_t> > keys(n);
+			_parallelFor(n, nbThreads, [&](size_t i) { keys[i] = std::pair<uint64, size_t>(_mortonKey(objects[i].boundingbox, _rootNode->_bbox), i); });
+			std::sort(keys.begin(), keys.end());
+			// allocate the list nodes in that order
+			std::vector<_ListNode *> tab(n);
+			for (size_t i = 0; i < n; i++) 
+				{ 
+				tab[i] = (_ListNode *)_listNodePool.malloc(); 
+				::new(tab[i]) _ListNode(std::move(objects[keys[i].second])); 
+				}
+			if (handles != nullptr)
+				{
+				handles->resize(n);
+				for (size_t i = 0; i < n; i++) { (*handles)[keys[i].second] = Handle(tab[i]); }
+				}
+			objects.clear();
+			keys.clear(); keys.shrink_to_fit();
+			// dispatch from the root, collecting the subtrees to build in parallel
+			const size_t tasksize = ((n / (8 * nbThreads)) > (size_t)(4 * N)) ? (n / (8 * nbThreads)) : (size_t)(4 * N);
+			std::vector<std::tuple<_TreeNode *, size_t, size_t> > tasks;
+			std::vector<_ListNode *> buf;
+			_bulkInsert(_rootNode, tab, 0, n, buf, ((nbThreads > 1) ? &tasks : nullptr), tasksize);
+			if (tasks.size() == 0) return;
+			const size_t oldTC = _treeNodePool.threadCaching();
+			if (oldTC == 0) { _treeNodePool.setThreadCaching(); }
+			std::atomic<size_t> next(0);
+			auto worker = [&]()
+				{
+				std::vector<_ListNode *> wbuf;
+				size_t k;
+				while ((k = next.fetch_add(1)) < tasks.size()) { _bulkInsert(std::get<0>(tasks[k]), tab, std::get<1>(tasks[k]), std::get<2>(tasks[k]), wbuf, nullptr, 0); }
+				};
+			std::vector<std::thread> threads;
+			for (size_t t = 1; t < nbThreads; t++) { threads.push_back(std::thread(worker)); }
+			worker();
+			for (auto & th : threads) { th.join(); }
+			if (oldTC == 0) { _treeNodePool.setThreadCaching(0); }
 			}
 
 
@@ -515,6 +794,338 @@ namespace mtools
 			}
 
 
+		/**
+		* Distance between a point and a bounding box (0 if the point is inside the box).
+		**/
+		static MTOOLS_FORCEINLINE TFloat boxDistance(const Vec<TFloat, 2> & P, const BBox & B)
+			{
+			const TFloat dx = (P.X() < B.min[0]) ? (B.min[0] - P.X()) : ((P.X() > B.max[0]) ? (P.X() - B.max[0]) : (TFloat)0);
+			const TFloat dy = (P.Y() < B.min[1]) ? (B.min[1] - P.Y()) : ((P.Y() > B.max[1]) ? (P.Y() - B.max[1]) : (TFloat)0);
+			return (TFloat)std::sqrt(dx*dx + dy*dy);
+			}
+
+
+		/**
+		* Iterate over the k objects nearest to a point, by increasing distance (best first search).
+		* The distance to an object is the distance from P to its bounding box.
+		* the function 'fun' must be callable in the form 'fun(boundedObject, dist)'.
+		*
+		* The nodes of the tree are explored by increasing distance to their bounding boxes so the
+		* cost is logarithmic in the number of objects for fixed k.
+		*
+		* @param	P	   	the point.
+		* @param	k	   	maximum number of objects to report.
+		* @param	fun	   	function called for each object found.
+		* @param	maxDist	only objects at distance at most maxDist are reported.
+		*
+		* @return	the number of objects reported (at most k).
+		**/
+		template<typename FUNCTION> size_t iterate_nearest(const Vec<TFloat, 2> & P, size_t k, FUNCTION fun, TFloat maxDist = std::numeric_limits<TFloat>::infinity()) const
+			{
+			return iterate_nearest(P, k, fun, [&](const BoundedObject & bo) -> TFloat { return boxDistance(P, bo.boundingbox); }, maxDist);
+			}
+
+
+		/**
+		* Same as above but with a user supplied distance: 'distfun(boundedObject)' must return the
+		* distance from P to the object and this distance must never be smaller than the distance from
+		* P to the bounding box of the object (which is the case for any reasonable distance to a
+		* figure contained in its box). Otherwise, the order of the results is not guaranteed.
+		**/
+		template<typename FUNCTION, typename DISTFUN> size_t iterate_nearest(const Vec<TFloat, 2> & P, size_t k, FUNCTION fun, DISTFUN distfun, TFloat maxDist = std::numeric_limits<TFloat>::infinity()) const
+			{
+			if ((k == 0) || (_rootNode == nullptr)) return 0;
+			std::priority_queue<_QueueEntry> Q;
+			Q.push({ boxDistance(P, _rootNode->_bbox), _rootNode, nullptr });
+			size_t nb = 0;
+			while ((!Q.empty()) && (nb < k))
+				{
+				const _QueueEntry E = Q.top(); Q.pop();
+				if (!(E.dist <= maxDist)) break;
+				if (E.obj != nullptr) { fun(E.obj->_bobj, E.dist); nb++; continue; }
+				const _TreeNode * node = E.node;
+				const _ListNode * LN = node->_first_irreducible;
+				for (int l = 0; l < 2; l++)
+					{
+					while (LN != nullptr)
+						{
+						const TFloat d = (TFloat)distfun(LN->_bobj);
+						if (d <= maxDist) Q.push({ d, nullptr, LN });
+						LN = LN->_next;
+						}
+					LN = node->_first_reducible;
+					}
+				for (int j = 0; j < 15; j++)
+					{
+					if (node->_son[j] != nullptr)
+						{
+						const TFloat d = boxDistance(P, node->_son[j]->_bbox);
+						if (d <= maxDist) Q.push({ d, node->_son[j], nullptr });
+						}
+					}
+				}
+			return nb;
+			}
+
+
+		/**
+		* Return the k objects nearest to P (at distance at most maxDist), by increasing distance.
+		**/
+		std::vector<BoundedObject> nearest(const Vec<TFloat, 2> & P, size_t k, TFloat maxDist = std::numeric_limits<TFloat>::infinity()) const
+			{
+			std::vector<BoundedObject> res;
+			iterate_nearest(P, k, [&](const BoundedObject & bo, TFloat) { res.push_back(bo); }, maxDist);
+			return res;
+			}
+
+
+		/**
+		* Return a pointer to the object nearest to P or nullptr if there is no object at distance at
+		* most maxDist. If dist is not null, it is set to the distance to the object.
+		**/
+		const BoundedObject * nearest(const Vec<TFloat, 2> & P, TFloat maxDist = std::numeric_limits<TFloat>::infinity(), TFloat * dist = nullptr) const
+			{
+			const BoundedObject * res = nullptr;
+			iterate_nearest(P, 1, [&](const BoundedObject & bo, TFloat d) { res = &bo; if (dist) *dist = d; }, maxDist);
+			return res;
+			}
+
+
+		/**
+		* Iterate over all the objects whose bounding box is at distance at most r from P (in no
+		* particular order). Subtrees farther than r are skipped.
+		* the function 'fun' must be callable in the form 'fun(boundedObject, dist)'.
+		**/
+		template<typename FUNCTION> size_t iterate_within(const Vec<TFloat, 2> & P, TFloat r, FUNCTION fun) const
+			{
+			if (_rootNode == nullptr) return 0;
+			std::vector<const _TreeNode *> stack;
+			if (boxDistance(P, _rootNode->_bbox) <= r) stack.push_back(_rootNode);
+			size_t nb = 0;
+			while (!stack.empty())
+				{
+				const _TreeNode * node = stack.back(); stack.pop_back();
+				const _ListNode * LN = node->_first_irreducible;
+				for (int l = 0; l < 2; l++)
+					{
+					while (LN != nullptr)
+						{
+						const TFloat d = boxDistance(P, LN->_bobj.boundingbox);
+						if (d <= r) { fun(LN->_bobj, d); nb++; }
+						LN = LN->_next;
+						}
+					LN = node->_first_reducible;
+					}
+				for (int j = 0; j < 15; j++)
+					{
+					if ((node->_son[j] != nullptr) && (boxDistance(P, node->_son[j]->_bbox) <= r)) stack.push_back(node->_son[j]);
+					}
+				}
+			return nb;
+			}
+
+
+		/**
+		* Batch version of iterate_intersect(): find the objects intersecting each box of a list.
+		* 
+		* The query boxes are sorted along a Morton curve and the tree is traversed only once: each
+		* node carries the list of the queries whose box intersects its bounding box, and each son
+		* receives the sub-list of those which intersect its own box. Below the first levels, the
+		* subtrees are distributed among nbThreads threads.
+		*
+		* the function 'fun' must be callable in the form 'fun(queryIndex, boundedObject)'. It is called
+		* once for each pair (query box, object) which intersect, in no particular order, and may be
+		* called simultaneously by several threads (when nbThreads > 1).
+		*
+		* @param	boxes	 	the query boxes.
+		* @param	fun		 	function called for each result.
+		* @param	nbThreads	number of threads to use (0 = number of hardware threads).
+		*
+		* @return	the total number of results.
+		**/
+		template<typename FUNCTION> size_t batch_intersect(const std::vector<BBox> & boxes, FUNCTION fun, size_t nbThreads = 0) const
+			{
+			return _batchQuery(boxes, nbThreads, [&](size_t, size_t q, const BoundedObject & bo) { fun(q, bo); });
+			}
+
+
+		/**
+		* Batch version of iterate_intersect() returning the results in flat arrays: the objects
+		* intersecting boxes[i] are results[offsets[i]], ..., results[offsets[i+1] - 1] (in no 
+		* particular order).
+		*
+		* @param		  	boxes	 	the query boxes.
+		* @param [in,out]	offsets  	receives the offsets of the results of each query (size boxes.size() + 1).
+		* @param [in,out]	results  	receives pointers to the objects found.
+		* @param		  	nbThreads	number of threads to use (0 = number of hardware threads).
+		*
+		* @return	the total number of results.
+		**/
+		size_t batch_intersect(const std::vector<BBox> & boxes, std::vector<size_t> & offsets, std::vector<const BoundedObject *> & results, size_t nbThreads = 0) const
+			{
+			if (nbThreads == 0) { nbThreads = (size_t)nbHardwareThreads(); }
+			std::vector<std::vector<std::pair<size_t, const BoundedObject *> > > parts(nbThreads); // results of each thread
+			const size_t nb = _batchQuery(boxes, nbThreads, [&](size_t t, size_t q, const BoundedObject & bo) { parts[t].push_back(std::pair<size_t, const BoundedObject *>(q, &bo)); });
+			// counting sort by query
+			offsets.assign(boxes.size() + 1, 0);
+			for (auto & P : parts) { for (auto & r : P) { offsets[r.first + 1]++; } }
+			for (size_t i = 0; i < boxes.size(); i++) { offsets[i + 1] += offsets[i]; }
+			results.resize(nb);
+			std::vector<size_t> pos(offsets.begin(), offsets.end() - 1);
+			for (auto & P : parts) { for (auto & r : P) { results[pos[r.first]++] = r.second; } }
+			return nb;
+			}
+
+
+		/**
+		* Compute the level of detail summaries of all the nodes of the tree (cf. LODRaster). 
+		* 
+		* The summary of a node describes all the objects of its subtree. It is computed bottom-up in
+		* time proportional to the number of objects plus the number of nodes. Summaries use about
+		* 128 bytes per node and are discarded as soon as a new object is inserted.
+		*
+		* @param	colorfun	Function returning the representative colour of an object, callable in the
+		* 						form 'RGBc colorfun(boundedObject)'.
+		**/
+		template<typename FUNCTION> void computeLOD(FUNCTION colorfun)
+			{
+			const int L = LODRaster::LOD_SIZE;
+			_lod.clear();
+			// list the nodes in breadth first order so that sons come after their father.
+			std::vector<_TreeNode *> nodes;
+			nodes.push_back(_rootNode);
+			for (size_t i = 0; i < nodes.size(); i++)
+				{
+				for (int j = 0; j < 15; j++) { if (nodes[i]->_son[j] != nullptr) nodes.push_back(nodes[i]->_son[j]); }
+				}
+			// accumulate from the leaves up. acc[node] holds (area, area*R, area*G, area*B, area*A) per cell. 
+			std::unordered_map<const _TreeNode *, std::vector<double> > acc;
+			for (size_t i = nodes.size(); i > 0; i--)
+				{
+				_TreeNode * node = nodes[i - 1];
+				std::vector<double> S(5 * L * L, 0.0);
+				const TFloat w = (node->_bbox.max[0] - node->_bbox.min[0]) / L;
+				const TFloat h = (node->_bbox.max[1] - node->_bbox.min[1]) / L;
+				for (int k = 0; k < 2; k++)
+					{
+					_ListNode * LN = ((k == 0) ? node->_first_irreducible : node->_first_reducible);
+					while (LN != nullptr)
+						{
+						const BBox & B = LN->_bobj.boundingbox;
+						const RGBc c = colorfun(LN->_bobj);
+						const int i0 = _cellIndex(B.min[0], node->_bbox.min[0], w), i1 = _cellIndex(B.max[0], node->_bbox.min[0], w);
+						const int j0 = _cellIndex(B.min[1], node->_bbox.min[1], h), j1 = _cellIndex(B.max[1], node->_bbox.min[1], h);
+						for (int cj = j0; cj <= j1; cj++) for (int ci = i0; ci <= i1; ci++)
+							{
+							const BBox C = LODRaster::cellBox(node->_bbox, ci, cj);
+							double a = (double)(std::min(B.max[0], C.max[0]) - std::max(B.min[0], C.min[0])) * (double)(std::min(B.max[1], C.max[1]) - std::max(B.min[1], C.min[1]));
+							if (a <= 0) { a = 0; }
+							if ((a == 0) && (ci == i0) && (cj == j0)) { a = (double)(w*h) / (L*L); } // degenerate object (point or segment): count it as a small area
+							double * s = S.data() + 5 * (ci + L*cj);
+							s[0] += a; s[1] += a * c.comp.R; s[2] += a * c.comp.G; s[3] += a * c.comp.B; s[4] += a * c.comp.A;
+							}
+						LN = LN->_next;
+						}
+					}
+				for (int j = 0; j < 15; j++)
+					{ // the cells of a son are nested in those of its father.
+					_TreeNode * son = node->_son[j];
+					if (son == nullptr) continue;
+					auto it = acc.find(son);
+					if (it == acc.end()) continue;
+					const TFloat sw = (son->_bbox.max[0] - son->_bbox.min[0]) / L;
+					const TFloat sh = (son->_bbox.max[1] - son->_bbox.min[1]) / L;
+					for (int cj = 0; cj < L; cj++) for (int ci = 0; ci < L; ci++)
+						{
+						const int pi = _cellIndex(son->_bbox.min[0] + (ci + (TFloat)0.5)*sw, node->_bbox.min[0], w);
+						const int pj = _cellIndex(son->_bbox.min[1] + (cj + (TFloat)0.5)*sh, node->_bbox.min[1], h);
+						const double * s = it->second.data() + 5 * (ci + L*cj);
+						double * d = S.data() + 5 * (pi + L*pj);
+						for (int m = 0; m < 5; m++) { d[m] += s[m]; }
+						}
+					acc.erase(it);
+					}
+				bool empty = true;
+				for (int m = 0; m < L*L; m++) { if (S[5 * m] > 0) { empty = false; break; } }
+				if (empty) continue;
+				LODRaster & R = _lod[node];
+				const double cellarea = (double)w * (double)h;
+				for (int m = 0; m < L*L; m++)
+					{
+					const double a = S[5 * m];
+					if (a <= 0) { R.coverage[m] = 0.0f; R.color[m] = RGBc::c_Transparent; continue; }
+					const double cov = std::min<double>(1.0, a / cellarea);
+					R.coverage[m] = (float)cov;
+					R.color[m] = RGBc((uint8)(S[5 * m + 1] / a * cov), (uint8)(S[5 * m + 2] / a * cov), (uint8)(S[5 * m + 3] / a * cov), (uint8)(S[5 * m + 4] / a * cov));
+					}
+				acc[node] = std::move(S);
+				}
+			}
+
+
+		/**
+		* Return true if the level of detail summaries are available (cf. computeLOD()).
+		**/
+		bool hasLOD() const { return (!_lod.empty()); }
+
+
+		/**
+		* Same as iterate_intersect() but using the level of detail summaries: the subtrees whose
+		* root node has a bounding box with width and height at most lodsize are not explored. Instead,
+		* funlod(nodebox, raster) is called with the LODRaster summarizing the objects of the subtree. 
+		* 
+		* If the summaries are not available, this is the same as iterate_intersect(). Objects are
+		* not guaranteed to be returned in the same order as iterate_intersect().
+		*
+		* @param	box	   	The region to explore.
+		* @param	lodsize	Max size of a node summarized by its LODRaster.
+		* @param	fun	   	Function callable in the form 'fun(boundedObject)'.
+		* @param	funlod 	Function callable in the form 'funlod(const BBox & nodebox, const LODRaster & raster)'.
+		*
+		* @return	The number of objects returned (objects summarized by funlod() are not counted).
+		**/
+		template<typename FUNCTION, typename FUNCTIONLOD> size_t iterate_intersect_lod(BBox box, TFloat lodsize, FUNCTION fun, FUNCTIONLOD funlod) const
+			{
+			if ((box.isEmpty()) || (intersectionRect(_rootNode->_bbox, box).isEmpty())) return 0; // nothing to find. 
+			std::vector<const _TreeNode *> stack1;
+			std::vector<const _TreeNode *> stack2;
+			std::vector<const _TreeNode *> * pcurrentStack = &stack1;
+			std::vector<const _TreeNode *> * pnextStack = &stack2;
+			pcurrentStack->push_back(_rootNode);
+			size_t nb = 0;
+			while (pcurrentStack->size() > 0)
+				{
+				pnextStack->clear();
+				for (size_t i = 0; i < pcurrentStack->size(); i++)
+					{
+					const _TreeNode * node = pcurrentStack->operator[](i);
+					for (int k = 0; k < 2; k++)
+						{
+						const _ListNode * LN = ((k == 0) ? node->_first_irreducible : node->_first_reducible);
+						while (LN != nullptr)
+							{
+							if (!(intersectionRect(LN->_bobj.boundingbox, box).isEmpty())) { fun(LN->_bobj); nb++; }
+							LN = LN->_next;
+							}
+						}
+					for (int j = 0; j < 15; j++)
+						{
+						const _TreeNode * son = node->_son[j];
+						if ((son == nullptr) || (intersectionRect(son->_bbox, box).isEmpty())) continue;
+						if ((son->_bbox.max[0] - son->_bbox.min[0] <= lodsize) && (son->_bbox.max[1] - son->_bbox.min[1] <= lodsize))
+							{
+							auto it = _lod.find(son);
+							if (it != _lod.end()) { funlod(son->_bbox, it->second); continue; }
+							}
+						pnextStack->push_back(son);
+						}
+					}
+				mtools::swap(pcurrentStack, pnextStack);
+				}
+			return nb;
+			}
+
+
 		/**
 		* Return the main bounding box that contains all items currently inserted.
 		**/
@@ -527,6 +1138,21 @@ namespace mtools
 		size_t size() const { return _listNodePool.size(); }
 
 
+		/**
+		* Enable or disable the thread caching mode of the memory pools used for the nodes of the tree
+		* (see CstSizeMemoryPool::setThreadCaching()). In this mode, nodes may be allocated and released
+		* simultaneously by several threads without a global lock.
+		*
+		* @param	batchSize	Number of chunks exchanged at once between a thread and the shared depot
+		*						(0 to disable the mode).
+		**/
+		void setThreadCaching(size_t batchSize = 64)
+			{
+			_treeNodePool.setThreadCaching(batchSize);
+			_listNodePool.setThreadCaching(batchSize);
+			}
+
+
 		/**
 		* Return the number of bytes malloced by this object.
 		**/
@@ -586,16 +1212,25 @@ namespace mtools
 		TreeFigure(const TreeFigure & TF) = delete;				// no copy
 		TreeFigure & operator=(const TreeFigure &) = delete;	//
 
+		template<class T2, class TFloat2> friend class FrozenTreeFigure;
+
+
+
+		struct _TreeNode;
 
 
 		/** structure for doubly chained list of bounded objects. */
 		struct _ListNode
 			{
 			/** ctor. */
-			_ListNode(const BoundedObject & bobj) : _prev(nullptr), _next(nullptr), _bobj(bobj) {}
+			_ListNode(const BoundedObject & bobj) : _prev(nullptr), _next(nullptr), _owner(nullptr), _bobj(bobj) {}
+
+			/** move ctor from a bounded object. */
+			_ListNode(BoundedObject && bobj) : _prev(nullptr), _next(nullptr), _owner(nullptr), _bobj(std::move(bobj)) {}
 
 			_ListNode *   _prev;	// next item in the list, nullptr if there are none. 
 			_ListNode *   _next;	// next item in the list, nullptr if there are none. 
+			_TreeNode *   _owner;	// the tree node whose lists contain this item.
 			BoundedObject _bobj;	// the bounded object.
 			};
 
@@ -604,7 +1239,7 @@ namespace mtools
 		struct _TreeNode
 			{
 			/** ctor. */
-			_TreeNode(const BBox & bbox) : _bbox(bbox), _first_reducible(nullptr), _last_reducible(nullptr), _first_irreducible(nullptr), _nb_reducible(0), _nb_irreducible(0), _son {nullptr} {}
+			_TreeNode(const BBox & bbox, _TreeNode * father = nullptr) : _bbox(bbox), _first_reducible(nullptr), _last_reducible(nullptr), _first_irreducible(nullptr), _nb_reducible(0), _nb_irreducible(0), _son {nullptr}, _father(father), _dirty(false) {}
 
 			BBox		_bbox;				// the node bounding box
 			_ListNode *	_first_reducible;	// pointeur to the first reducible item
@@ -613,12 +1248,25 @@ namespace mtools
 			size_t		_nb_reducible;		// number of reducible items
 			size_t		_nb_irreducible;	// number of irreducible items
 			_TreeNode *	_son[15];			// pointer to the sons
+			_TreeNode * _father;			// pointer to the father (nullptr for the root)
+			bool		_dirty;				// true if the node is in the list of nodes to condense
 			};
 
 
-
-		/** link a reducible node at the end */
-		inline void _linkReducible(_ListNode * LN, _TreeNode * node)
+		/** entry of the priority queue used by iterate_nearest(): a node or an object with its distance to the point. */
+		struct _QueueEntry
+			{
+			TFloat				dist;	// distance to the node bounding box or to the object
+			const _TreeNode *	node;	// the node (or nullptr)
+			const _ListNode *	obj;	// the object (or nullptr)
+
+			bool operator<(const _QueueEntry & E) const { return dist > E.dist; }	// reversed: the top of the queue is the closest
+			};
+
+
+
+		/** link a reducible node at the end */
+		inline void _linkReducible(_ListNode * LN, _TreeNode * node)
 			{
 			MTOOLS_ASSERT(LN != nullptr);
 			MTOOLS_ASSERT(node != nullptr);
@@ -633,6 +1281,7 @@ namespace mtools
 				}
 			LN->_prev = node->_last_reducible;
 			LN->_next = nullptr;
+			LN->_owner = node;
 			node->_last_reducible = LN;
 			node->_nb_reducible++;
 			}
@@ -672,6 +1321,7 @@ namespace mtools
 				}
 			LN->_next = node->_first_irreducible;
 			LN->_prev = nullptr;
+			LN->_owner = node;
 			node->_first_irreducible = LN;
 			node->_nb_irreducible++;
 			}
@@ -699,6 +1349,94 @@ namespace mtools
 			}
 
 
+		/** Return true if a list node is in the irreducible list of its owner (the objects are irreducible exactly when they do not fit in a son). */
+		inline bool _isIrreducible(const _ListNode * LN) const
+			{
+			return (_getIndex(LN->_bobj.boundingbox, LN->_owner->_bbox) == 15);
+			}
+
+
+		/** remove a list node from the list of its owner. irr tells which list holds it. */
+		inline void _unlink(_ListNode * LN, bool irr)
+			{
+			if (irr) unlinkIrreducible(LN, LN->_owner); else unlinkReducible(LN, LN->_owner);
+			}
+
+
+		/** remove a list node from the list of its owner. */
+		inline void _unlink(_ListNode * LN)
+			{
+			_unlink(LN, _isIrreducible(LN));
+			}
+
+
+		/** put a list node at the correct place in the subtree rooted at node (whose box must contain the object's box) */
+		void _place(_ListNode * LN, _TreeNode * node)
+			{
+			while (1)
+				{
+				int i = _getIndex(LN->_bobj.boundingbox, node->_bbox);
+				if (i == 15)
+					{ // irreducible item, we just put it there (in front)
+					_linkIrreducible(LN, node);
+					// deal with overflowing nodes if needed.  
+					if ((node->_nb_reducible >0) &&(node->_nb_reducible + node->_nb_irreducible > N)) _overflow(node);
+					return;
+					}
+				if (node->_son[i] == nullptr)
+					{ // son not created. Put reducible object right here. 
+					_linkReducible(LN, node);
+					// and check for overflow
+					if (node->_nb_reducible + node->_nb_irreducible > N) _overflow(node);
+					return;
+					}
+				// go to the correct son and continue
+				node = node->_son[i]; 
+				}
+			}
+
+
+		/** add a node to the list of nodes to condense */
+		inline void _markDirty(_TreeNode * node)
+			{
+			if (node->_dirty) return;
+			node->_dirty = true;
+			_dirtyNodes.push_back(node);
+			}
+
+
+		/** true if the node has at least one son */
+		static inline bool _hasSon(const _TreeNode * node)
+			{
+			for (int j = 0; j < 15; j++) { if (node->_son[j] != nullptr) return true; }
+			return false;
+			}
+
+
+		/** merge into node the sons without sons whose objects fit in node (their objects are moved to the lists of node). */
+		void _absorbLeafSons(_TreeNode * node)
+			{
+			for (int j = 0; j < 15; j++)
+				{
+				_TreeNode * son = node->_son[j];
+				if ((son == nullptr) || (son->_dirty) || (_hasSon(son))) continue; // pending sons are dealt with later. 
+				if (node->_nb_reducible + node->_nb_irreducible + son->_nb_reducible + son->_nb_irreducible > N) continue;
+				for (int k = 0; k < 2; k++)
+					{
+					_ListNode * LN = ((k == 0) ? son->_first_irreducible : son->_first_reducible);
+					while (LN != nullptr)
+						{
+						_ListNode * nLN = LN->_next;
+						if (_getIndex(LN->_bobj.boundingbox, node->_bbox) == 15) _linkIrreducible(LN, node); else _linkReducible(LN, node);
+						LN = nLN;
+						}
+					}
+				node->_son[j] = nullptr;
+				_treeNodePool.free(son);
+				}
+			}
+
+
 		/** deal with overflowing node. (Recursive version, to be improved). */
 		void _overflow(_TreeNode * node)
 			{
@@ -733,11 +1471,221 @@ namespace mtools
 			}
 
 
+		/**
+		 * Insert the list nodes tab[b..e[ (already allocated) in the subtree rooted at node (used by bulkLoad()).
+		 * 
+		 * If tasks is not null, the sub-ranges of size smaller than tasksize are not processed but
+		 * pushed into tasks instead. buf is a scratch buffer. 
+		 **/
+		void _bulkInsert(_TreeNode * node, std::vector<_ListNode *> & tab, size_t b, size_t e, std::vector<_ListNode *> & buf, std::vector<std::tuple<_TreeNode *, size_t, size_t> > * tasks, size_t tasksize)
+			{
+			if ((tasks != nullptr) && (e - b < tasksize)) { tasks->push_back(std::tuple<_TreeNode *, size_t, size_t>(node, b, e)); return; }
+			// irreducible items stay here, compute the son index of the others
+			int cnt[16] = { 0 };
+			std::vector<unsigned char> ind(e - b);
+			size_t m = b;
+			for (size_t i = b; i < e; i++)
+				{
+				const int k = _getIndex(tab[i]->_bobj.boundingbox, node->_bbox);
+				if (k == 15) { _linkIrreducible(tab[i], node); } else { ind[m - b] = (unsigned char)k; tab[m++] = tab[i]; cnt[k]++; }
+				}
+			if (m == b) return;
+			if (node->_nb_reducible + node->_nb_irreducible + (m - b) <= N)
+				{ // no overflow
+				for (size_t i = b; i < m; i++) { _linkReducible(tab[i], node); }
+				return;
+				}
+			if (node->_nb_reducible > 0)
+				{ // the node overflows, its previous reducible items must also be dispatched
+				std::vector<_ListNode *> tab2(tab.begin() + b, tab.begin() + m);
+				_ListNode * LN = node->_first_reducible;
+				while (LN != nullptr) { _ListNode * nLN = unlinkReducible(LN, node); tab2.push_back(LN); LN = nLN; }
+				_bulkInsert(node, tab2, 0, tab2.size(), buf, nullptr, 0);
+				return;
+				}
+			// keep some reducible items here (as _overflow() does) 
+			size_t keep = ((node->_nb_irreducible >= N) ? 0 : (N - node->_nb_irreducible));
+			if (keep > m - b) keep = m - b;
+			for (size_t i = b; i < b + keep; i++) { _linkReducible(tab[i], node); cnt[ind[i - b]]--; }
+			// counting sort of the remaining ones by son index
+			size_t pos[16]; size_t acc = b + keep;
+			for (int k = 0; k < 15; k++) { pos[k] = acc; acc += cnt[k]; }
+			buf.resize(m - b - keep);
+			for (size_t i = b + keep; i < m; i++) { buf[pos[ind[i - b]] - b - keep] = tab[i]; pos[ind[i - b]]++; }
+			std::copy(buf.begin(), buf.end(), tab.begin() + b + keep);
+			acc = b + keep;
+			for (int k = 0; k < 15; k++)
+				{
+				if (cnt[k] == 0) continue;
+				if (node->_son[k] == nullptr) { _createChildNode(node, k); }
+				_bulkInsert(node->_son[k], tab, acc, acc + cnt[k], buf, tasks, tasksize);
+				acc += cnt[k];
+				}
+			}
+
+
+		/** Morton key of the center of a box, relative to a reference box. */
+		static inline uint64 _mortonKey(const BBox & B, const BBox & ref)
+			{
+			uint64 x = (uint64)(((B.min[0] + B.max[0]) / 2 - ref.min[0]) / (ref.max[0] - ref.min[0]) * 4294967295.0);
+			uint64 y = (uint64)(((B.min[1] + B.max[1]) / 2 - ref.min[1]) / (ref.max[1] - ref.min[1]) * 4294967295.0);
+			auto spread = [](uint64 v) -> uint64
+				{
+				v &= 0xFFFFFFFFULL;
+				v = (v | (v << 16)) & 0x0000FFFF0000FFFFULL;
+				v = (v | (v << 8)) & 0x00FF00FF00FF00FFULL;
+				v = (v | (v << 4)) & 0x0F0F0F0F0F0F0F0FULL;
+				v = (v | (v << 2)) & 0x3333333333333333ULL;
+				v = (v | (v << 1)) & 0x5555555555555555ULL;
+				return v;
+				};
+			return spread(x) | (spread(y) << 1);
+			}
+
+
+		/** true if the (non-empty) boxes A and B intersect. */
+		static inline bool _touch(const BBox & A, const BBox & B)
+			{
+			return ((A.min[0] <= B.max[0]) && (B.min[0] <= A.max[0]) && (A.min[1] <= B.max[1]) && (B.min[1] <= A.max[1]));
+			}
+
+
+		/** 
+		 * Run the batch intersection queries. fun(t, q, bobj) is called with t the index of the 
+		 * thread in [0, nbThreads[. 
+		 **/
+		template<typename FUNCTION> size_t _batchQuery(const std::vector<BBox> & boxes, size_t nbThreads, FUNCTION fun) const
+			{
+			if (nbThreads == 0) { nbThreads = (size_t)nbHardwareThreads(); }
+			const BBox & R = _rootNode->_bbox;
+			// sort the queries which intersect the root along the Morton curve
+			std::vector<std::pair<uint64, size_t> > keys;
+			keys.reserve(boxes.size());
+			for (size_t i = 0; i < boxes.size(); i++)
+				{
+				if ((!boxes[i].isEmpty()) && (_touch(boxes[i], R))) keys.push_back(std::pair<uint64, size_t>(_mortonKey(intersectionRect(boxes[i], R), R), i));
+				}
+			if (keys.size() == 0) return 0;
+			std::sort(keys.begin(), keys.end());
+			std::vector<std::pair<const _TreeNode *, std::vector<size_t> > > frontier(1), next;
+			frontier[0].first = _rootNode;
+			frontier[0].second.reserve(keys.size());
+			for (auto & k : keys) { frontier[0].second.push_back(k.second); }
+			keys.clear(); keys.shrink_to_fit();
+			// expand the first levels in this thread until there are enough subtrees to share
+			size_t nb = 0;
+			if (nbThreads > 1)
+				{
+				auto fun0 = [&](size_t q, const BoundedObject & bo) { fun(0, q, bo); };
+				int depth = 0;
+				while ((frontier.size() > 0) && (frontier.size() < 8 * nbThreads) && (depth++ < 6))
+					{
+					next.clear();
+					for (auto & F : frontier)
+						{
+						nb += _batchNodeObjects(F.first, boxes.data(), F.second.data(), F.second.size(), fun0);
+						for (int j = 0; j < 15; j++)
+							{
+							const _TreeNode * son = F.first->_son[j];
+							if (son == nullptr) continue;
+							std::vector<size_t> q;
+							for (size_t i : F.second) { if (_touch(boxes[i], son->_bbox)) q.push_back(i); }
+							if (q.size() > 0) next.push_back(std::pair<const _TreeNode *, std::vector<size_t> >(son, std::move(q)));
+							}
+						}
+					mtools::swap(frontier, next);
+					}
+				}
+			// then process the subtrees of the frontier in parallel
+			std::atomic<size_t> nextTask(0), total(nb);
+			auto worker = [&](size_t t)
+				{
+				auto funt = [&](size_t q, const BoundedObject & bo) { fun(t, q, bo); };
+				std::vector<size_t> buf;
+				size_t k, wnb = 0;
+				while ((k = nextTask.fetch_add(1)) < frontier.size())
+					{
+					buf.assign(frontier[k].second.begin(), frontier[k].second.end());
+					wnb += _batchSubtree(frontier[k].first, boxes.data(), buf, 0, funt);
+					}
+				total += wnb;
+				};
+			std::vector<std::thread> threads;
+			const size_t nbt = (nbThreads < frontier.size()) ? nbThreads : frontier.size();
+			for (size_t t = 1; t < nbt; t++) { threads.push_back(std::thread(worker, t)); }
+			worker(0);
+			for (auto & th : threads) { th.join(); }
+			return total;
+			}
+
+
+		/** test the objects of a node against the queries q[0..nq-1] (which intersect the node box). */
+		template<typename FUNCTION> static size_t _batchNodeObjects(const _TreeNode * node, const BBox * boxes, const size_t * q, size_t nq, FUNCTION & fun)
+			{
+			size_t nb = 0;
+			const _ListNode * LN = node->_first_irreducible;
+			for (int l = 0; l < 2; l++)
+				{
+				while (LN != nullptr)
+					{
+					const BBox & B = LN->_bobj.boundingbox;
+					for (size_t i = 0; i < nq; i++) { if (_touch(boxes[q[i]], B)) { fun(q[i], LN->_bobj); nb++; } }
+					LN = LN->_next;
+					}
+				LN = node->_first_reducible;
+				}
+			return nb;
+			}
+
+
+		/** 
+		 * Answer the queries buf[a..] for the subtree rooted at node. The lists of queries of the 
+		 * sons are appended to buf (and removed afterwards) so no allocation occurs once buf is 
+		 * large enough.
+		 **/
+		template<typename FUNCTION> static size_t _batchSubtree(const _TreeNode * node, const BBox * boxes, std::vector<size_t> & buf, size_t a, FUNCTION & fun)
+			{
+			const size_t b = buf.size();
+			size_t nb = _batchNodeObjects(node, boxes, buf.data() + a, b - a, fun);
+			for (int j = 0; j < 15; j++)
+				{
+				const _TreeNode * son = node->_son[j];
+				if (son == nullptr) continue;
+				for (size_t i = a; i < b; i++) { const size_t q = buf[i]; if (_touch(boxes[q], son->_bbox)) buf.push_back(q); }
+				if (buf.size() > b) nb += _batchSubtree(son, boxes, buf, b, fun);
+				buf.resize(b);
+				}
+			return nb;
+			}
+
+
+		/** call fun(i) for i in [0,n[ using nbThreads threads. */
+		template<typename FUNCTION> static void _parallelFor(size_t n, size_t nbThreads, FUNCTION fun)
+			{
+			if ((nbThreads <= 1) || (n < 10000)) { for (size_t i = 0; i < n; i++) { fun(i); } return; }
+			auto worker = [&](size_t t) { const size_t a = (n * t) / nbThreads, b = (n * (t + 1)) / nbThreads; for (size_t i = a; i < b; i++) { fun(i); } };
+			std::vector<std::thread> threads;
+			for (size_t t = 1; t < nbThreads; t++) { threads.push_back(std::thread(worker, t)); }
+			worker(0);
+			for (auto & th : threads) { th.join(); }
+			}
+
+
+		/** index of the cell of size w starting at origin o containing x (clamped to [0, LOD_SIZE-1]). */
+		static inline int _cellIndex(TFloat x, TFloat o, TFloat w)
+			{
+			const int i = (int)((x - o) / w);
+			return ((i < 0) ? 0 : ((i >= LODRaster::LOD_SIZE) ? (LODRaster::LOD_SIZE - 1) : i));
+			}
+
+
 		/** Release all allocated memory and set pointers to nullptr. */
 		void _reset()
 			{
+			_lod.clear();
+			_dirtyNodes.clear();
 			_treeNodePool.freeAll();
-			if (_callDtors) _listNodePool.destroyAndFreeAll<_ListNode>(); else _listNodePool.freeAll();
+			if (_callDtors) _listNodePool.template destroyAndFreeAll<_ListNode>(); else _listNodePool.freeAll();
 			_rootNode = nullptr;
 			}
 
@@ -759,7 +1707,7 @@ namespace mtools
 			MTOOLS_ASSERT(node != nullptr);
 			MTOOLS_ASSERT(node->_son[index] == nullptr);
 			_TreeNode * nn = (_TreeNode *)_treeNodePool.malloc();
-			::new(nn) _TreeNode(_getSubBox(index, node->_bbox));
+			::new(nn) _TreeNode(_getSubBox(index, node->_bbox), node);
 			node->_son[index] = nn;
 			return;
 			}
@@ -771,6 +1719,7 @@ namespace mtools
 			_TreeNode * newrootnode = (_TreeNode *)_treeNodePool.malloc();
 			::new(newrootnode) _TreeNode({ 2 * _rootNode->_bbox.min[0], 2 * _rootNode->_bbox.max[0], 2 * _rootNode->_bbox.min[1], 2 * _rootNode->_bbox.max[1] });
 			newrootnode->_son[5] = _rootNode;
+			_rootNode->_father = newrootnode;
 			_rootNode = newrootnode;
 			}
 
@@ -941,12 +1890,429 @@ namespace mtools
 
 		bool _callDtors;														// true if we should call the destructor when object are deleted. 
 
+		bool _looseUpdate;														// true to keep moved objects in their node when possible (cf. update()) 
+
 		_TreeNode * _rootNode;													// root node the "tree"
 
 		mtools::CstSizeMemoryPool<sizeof(_TreeNode), 10000> _treeNodePool;		// memory pool for the tree nodes elements
 		mtools::CstSizeMemoryPool<sizeof(_ListNode), 100000> _listNodePool;	    // memory pool for listNode elements
 
+		std::unordered_map<const _TreeNode *, LODRaster> _lod;					// level of detail summaries (cf. computeLOD())
+
+		std::vector<_TreeNode *> _dirtyNodes;									// nodes modified by remove() / update() waiting for condense()
+
+
+	};
+
+
+	/**
+	 * FrozenTreeFigure class.
+	 * 
+	 * Read-only, compacted copy of a TreeFigure object. The nodes of the tree are stored in a single
+	 * array in breadth-first order, the sons of a node being contiguous, and the objects are stored
+	 * in a second array, the objects of a node being contiguous. Nodes refer to their sons and to
+	 * their objects by indices so the whole structure is pointer free. 
+	 * 
+	 * Queries return the same objects as the corresponding methods of the TreeFigure object it was
+	 * created from (larger objects are still returned before smaller ones) but run over contiguous
+	 * memory instead of chasing linked lists scattered in the memory pools. Useful for the viewing
+	 * phase, once all the objects have been inserted.
+	 * 
+	 * The arrays can be saved in a binary file with save() and memory mapped back with load(): the
+	 * file is not read when it is opened, its pages are loaded by the operating system when the
+	 * queries reach them. This requires T to be trivially copyable (and, of course, not to contain
+	 * pointers).
+	 * 
+	 * @tparam	T	   Type of objects contained in the container.
+	 * @tparam	TFloat Type use for floating point computation (default double).
+	 */
+	template<class T, class TFloat = double> class FrozenTreeFigure
+	{
+
+	public:
+
+		/**
+		* typedef. Represent a bounding box.
+		**/
+		using BBox = Box<TFloat, 2>;
+
+
+		/**
+		* An object together, with its bounding box
+		**/
+		struct BoundedObject
+			{
+			BoundedObject() : boundingbox(), object() {}
+			BoundedObject(const BBox & bbox, const T & obj) : boundingbox(bbox), object(obj) {}
+
+			BBox	boundingbox;
+			T		object;
+			};
+
+
+		/**
+		* Default constructor, create an empty object.
+		**/
+		FrozenTreeFigure() : _nodes(), _objects(), _file(), _pnodes(nullptr), _nbnodes(0), _pobjects(nullptr), _nbobjects(0) {}
+
+
+		/**
+		* Construct a frozen copy of a TreeFigure object. The TreeFigure object is not modified and
+		* can be deleted afterward.
+		**/
+		template<int N> FrozenTreeFigure(const TreeFigure<T, N, TFloat> & TF) : _nodes(), _objects(), _file(), _pnodes(nullptr), _nbnodes(0), _pobjects(nullptr), _nbobjects(0)
+			{
+			freeze(TF);
+			}
+
+
+		/**
+		* Move constructor.
+		**/
+		FrozenTreeFigure(FrozenTreeFigure && TF) : _nodes(), _objects(), _file(), _pnodes(nullptr), _nbnodes(0), _pobjects(nullptr), _nbobjects(0)
+			{
+			*this = std::move(TF);
+			}
+
+
+		/**
+		* Move assignment operator.
+		**/
+		FrozenTreeFigure & operator=(FrozenTreeFigure && TF)
+			{
+			if (this == &TF) return(*this);
+			_nodes = std::move(TF._nodes);
+			_objects = std::move(TF._objects);
+			_file = std::move(TF._file);
+			_pnodes = TF._pnodes; _nbnodes = TF._nbnodes;
+			_pobjects = TF._pobjects; _nbobjects = TF._nbobjects;
+			TF.reset();
+			return(*this);
+			}
+
+
+		/**
+		* Reset the object to its initial empty state.
+		**/
+		void reset()
+			{
+			_nodes.clear(); _nodes.shrink_to_fit();
+			_objects.clear(); _objects.shrink_to_fit();
+			_file.reset();
+			_pnodes = nullptr; _nbnodes = 0;
+			_pobjects = nullptr; _nbobjects = 0;
+			}
+
+
+		/**
+		* Replace the content of this object by a frozen copy of a TreeFigure object.
+		**/
+		template<int N> void freeze(const TreeFigure<T, N, TFloat> & TF)
+			{
+			typedef typename TreeFigure<T, N, TFloat>::_TreeNode  _SrcTreeNode;
+			typedef typename TreeFigure<T, N, TFloat>::_ListNode  _SrcListNode;
+			reset();
+			_objects.reserve(TF.size());
+			std::vector<const _SrcTreeNode *> src;	// src[i] is the node of TF that becomes _nodes[i] 
+			src.push_back(TF._rootNode);
+			for (size_t i = 0; i < src.size(); i++)
+				{ // breadth first, so the sons of a node are appended contiguously. 
+				const _SrcTreeNode * node = src[i];
+				_FlatNode FN;
+				FN.bbox = node->_bbox;
+				FN.firstObject = (uint64)_objects.size();
+				const _SrcListNode * LN = node->_first_irreducible;
+				while (LN != nullptr) { _objects.push_back(BoundedObject(LN->_bobj.boundingbox, LN->_bobj.object)); LN = LN->_next; }
+				LN = node->_first_reducible;
+				while (LN != nullptr) { _objects.push_back(BoundedObject(LN->_bobj.boundingbox, LN->_bobj.object)); LN = LN->_next; }
+				FN.nbObjects = (uint64)_objects.size() - FN.firstObject;
+				FN.firstSon = (uint64)src.size();
+				for (int j = 0; j < 15; j++) { if (node->_son[j] != nullptr) { src.push_back(node->_son[j]); } }
+				FN.nbSons = (uint64)src.size() - FN.firstSon;
+				_nodes.push_back(FN);
+				}
+			_nodes.shrink_to_fit();
+			MTOOLS_ASSERT(_objects.size() == TF.size());
+			_pnodes = _nodes.data(); _nbnodes = _nodes.size();
+			_pobjects = _objects.data(); _nbobjects = _objects.size();
+			}
+
+
+		/**
+		* Save the tree into a binary file that can be memory mapped with load(). 
+		* 
+		* The file contains a header followed by the raw arrays of nodes and objects so it can only be
+		* read back on a machine with the same endianness and the same type sizes (this is checked by
+		* load()).
+		*
+		* @param	filename	Name of the file (overwritten if it exists).
+		*
+		* @return	true if the file was written successfully.
+		**/
+		bool save(const std::string & filename) const
+			{
+			static_assert(std::is_trivially_copyable<T>::value, "FrozenTreeFigure::save() requires a trivially copyable type T.");
+			_FileHeader H;
+			_setHeader(H);
+			H.nbNodes = _nbnodes;
+			H.nbObjects = _nbobjects;
+			H.nodesOffset = _align(sizeof(_FileHeader));
+			H.objectsOffset = _align(H.nodesOffset + _nbnodes * sizeof(_FlatNode));
+			std::ofstream f(filename, std::ios::binary | std::ios::trunc);
+			if (!f.is_open()) return false;
+			const char zeros[_FILEALIGN] = { 0 };
+			f.write((const char *)&H, sizeof(H));
+			f.write(zeros, (std::streamsize)(H.nodesOffset - sizeof(H)));
+			if (_nbnodes > 0) f.write((const char *)_pnodes, (std::streamsize)(_nbnodes * sizeof(_FlatNode)));
+			f.write(zeros, (std::streamsize)(H.objectsOffset - H.nodesOffset - _nbnodes * sizeof(_FlatNode)));
+			if (_nbobjects > 0) f.write((const char *)_pobjects, (std::streamsize)(_nbobjects * sizeof(BoundedObject)));
+			return f.good();
+			}
+
+
+		/**
+		* Replace the content of this object by the tree saved in a file by save(). 
+		* 
+		* The file is memory mapped, not read: this method returns immediately whatever the size of the
+		* file and the pages of the file are loaded only when they are accessed by the queries. The file
+		* must not be modified while it is mapped.
+		*
+		* @param	filename	Name of the file.
+		*
+		* @return	true if the file was mapped successfully. On failure, the object is left empty.
+		**/
+		bool load(const std::string & filename)
+			{
+			static_assert(std::is_trivially_copyable<T>::value, "FrozenTreeFigure::load() requires a trivially copyable type T.");
+			reset();
+			std::unique_ptr<MappedFile> file(new MappedFile(filename));
+			if ((!file->isOpen()) || (file->size() < sizeof(_FileHeader))) return false;
+			const char * data = (const char *)file->data();
+			_FileHeader H, R;
+			std::memcpy(&H, data, sizeof(H));
+			_setHeader(R);
+			if ((H.magic != R.magic) || (H.version != R.version) || (H.sizeofT != R.sizeofT) || (H.sizeofTFloat != R.sizeofTFloat) || (H.sizeofNode != R.sizeofNode) || (H.sizeofObject != R.sizeofObject)) return false;
+			if ((H.nodesOffset % _FILEALIGN != 0) || (H.objectsOffset % _FILEALIGN != 0)) return false;
+			if ((H.nodesOffset + H.nbNodes * sizeof(_FlatNode) > file->size()) || (H.objectsOffset + H.nbObjects * sizeof(BoundedObject) > file->size())) return false;
+			_pnodes = (const _FlatNode *)(data + H.nodesOffset); _nbnodes = (size_t)H.nbNodes;
+			_pobjects = (const BoundedObject *)(data + H.objectsOffset); _nbobjects = (size_t)H.nbObjects;
+			_file = std::move(file);
+			return true;
+			}
+
+
+		/**
+		* Return true if the content of the object is memory mapped from a file (see load()).
+		**/
+		bool isMapped() const { return ((bool)_file); }
+
+
+		/**
+		* Iterate over all objects whose bounding box intersect 'box'.
+		* the function 'fun' must be callable in the form 'fun(boundedObject)'.
+		**/
+		template<typename FUNCTION> size_t iterate_intersect(const BBox & box, FUNCTION fun) const
+			{
+			return _iterate(box, fun,
+				[](const BBox & B, const BBox & box) -> bool { return _intersect(B, box); },
+				[](const BBox & B, const BBox & box) -> bool { return _intersect(B, box); });
+			}
+
+
+		/**
+		* Iterate over all objects whose bounding box is contained in 'box'.
+		* the function 'fun' must be callable in the form 'fun(boundedObject)'.
+		**/
+		template<typename FUNCTION> size_t iterate_contained_in(const BBox & box, FUNCTION fun) const
+			{
+			return _iterate(box, fun,
+				[](const BBox & B, const BBox & box) -> bool { return _contain(box, B); },
+				[](const BBox & B, const BBox & box) -> bool { return _intersect(B, box); });
+			}
+
+
+		/**
+		* Iterate over all objects whose bounding box contains 'box'.
+		* the function 'fun' must be callable in the form 'fun(boundedObject)'.
+		**/
+		template<typename FUNCTION> size_t iterate_contain(const BBox & box, FUNCTION fun) const
+			{
+			return _iterate(box, fun,
+				[](const BBox & B, const BBox & box) -> bool { return _contain(B, box); },
+				[](const BBox & B, const BBox & box) -> bool { return _contain(B, box); });
+			}
+
+
+		/**
+		* Iterate over all objects (in the order of the tree: larger objects first).
+		* the function 'fun' must be callable in the form 'fun(boundedObject)'.
+		**/
+		template<typename FUNCTION> size_t iterate_all(FUNCTION fun) const
+			{
+			for (size_t i = 0; i < _nbobjects; i++) { fun(_pobjects[i]); }
+			return _nbobjects;
+			}
+
+
+		/**
+		* Return the main bounding box that contains all items.
+		**/
+		BBox mainBoundingBox() const { return ((_nbnodes == 0) ? BBox() : _pnodes[0].bbox); }
+
+
+		/**
+		* Query the number of objects.
+		**/
+		size_t size() const { return _nbobjects; }
+
+
+		/**
+		* Query the number of nodes of the tree.
+		**/
+		size_t nbNodes() const { return _nbnodes; }
+
+
+		/**
+		* Return the number of bytes malloced by this object (the memory mapped file is not counted).
+		**/
+		size_t footprint() const { return (_nodes.capacity() * sizeof(_FlatNode) + _objects.capacity() * sizeof(BoundedObject)); }
+
+
+		/**
+		* Print information about this object into a string.
+		**/
+		std::string toString() const
+			{
+			std::string s = std::string("FrozenTreeFigure<") + typeid(T).name() + ", " + typeid(TFloat).name() + ">\n";
+			s += std::string(" - objects : ") + mtools::toString(size()) + "\n";
+			s += std::string(" - nodes : ") + mtools::toString(nbNodes()) + "\n";
+			s += std::string(" - memory used : ") + mtools::toStringMemSize(footprint()) + "\n";
+			if (isMapped()) { s += std::string(" - mapped from file : ") + _file->filename() + "\n"; }
+			s += std::string(" - main bounding box : ") + mtools::toString(mainBoundingBox()) + "\n";
+			return s + "---\n";
+			}
+
+
+
+	/**************************************************************************************************
+	* Private implementation.
+	**************************************************************************************************/
+
+	private:
+
+		FrozenTreeFigure(const FrozenTreeFigure &) = delete;				// no copy
+		FrozenTreeFigure & operator=(const FrozenTreeFigure &) = delete;	//
+
+
+		/** a node of the tree. */
+		struct _FlatNode
+			{
+			BBox	bbox;			// bounding box of the node
+			uint64	firstObject;	// index of the first object of the node in _objects
+			uint64	nbObjects;		// number of objects of the node
+			uint64	firstSon;		// index of the first son in _nodes
+			uint64	nbSons;			// number of sons (they are contiguous in _nodes)
+			};
+
+
+		static const uint64 _FILEMAGIC = 0x455254465A4E5246ULL;	// "FRNZFTRE" read as a little endian integer 
+		static const uint32 _FILEVERSION = 1;					// version of the file format
+		static const size_t _FILEALIGN = 64;					// alignment of the arrays inside the file
+
+
+		/** header of the files created by save() */
+		struct _FileHeader
+			{
+			uint64	magic;			// _FILEMAGIC (also detects endianness mismatch)
+			uint32	version;		// _FILEVERSION
+			uint32	sizeofT;		// sizeof(T)
+			uint32	sizeofTFloat;	// sizeof(TFloat)
+			uint32	sizeofNode;		// sizeof(_FlatNode)
+			uint32	sizeofObject;	// sizeof(BoundedObject)
+			uint32	reserved;		// 0
+			uint64	nbNodes;		// number of nodes
+			uint64	nbObjects;		// number of objects
+			uint64	nodesOffset;	// position of the array of nodes in the file
+			uint64	objectsOffset;	// position of the array of objects in the file
+			};
+
+
+		/** set the fields of a header that do not depend on the content */
+		static void _setHeader(_FileHeader & H)
+			{
+			std::memset(&H, 0, sizeof(H));
+			H.magic = _FILEMAGIC;
+			H.version = _FILEVERSION;
+			H.sizeofT = (uint32)sizeof(T);
+			H.sizeofTFloat = (uint32)sizeof(TFloat);
+			H.sizeofNode = (uint32)sizeof(_FlatNode);
+			H.sizeofObject = (uint32)sizeof(BoundedObject);
+			}
+
+
+		/** round up to a multiple of _FILEALIGN */
+		static inline uint64 _align(uint64 pos) { return ((pos + _FILEALIGN - 1) / _FILEALIGN) * _FILEALIGN; }
+
+
+		/** branchless test: the (non-empty) boxes A and B intersect */
+		static inline bool _intersect(const BBox & A, const BBox & B)
+			{
+			return ((A.min[0] <= B.max[0]) & (B.min[0] <= A.max[0]) & (A.min[1] <= B.max[1]) & (B.min[1] <= A.max[1]));
+			}
+
+
+		/** branchless test: box A contains box B */
+		static inline bool _contain(const BBox & A, const BBox & B)
+			{
+			return ((A.min[0] <= B.min[0]) & (B.max[0] <= A.max[0]) & (A.min[1] <= B.min[1]) & (B.max[1] <= A.max[1]));
+			}
+
+
+		/**
+		 * Breadth first traversal. Call fun on the objects obj such that objtest(obj.boundingbox, box)
+		 * is true, going down into the sons S such that nodetest(S.bbox, box) is true.
+		 **/
+		template<typename FUNCTION, typename OBJTEST, typename NODETEST> size_t _iterate(const BBox & box, FUNCTION & fun, OBJTEST objtest, NODETEST nodetest) const
+			{
+			if ((_nbnodes == 0) || (box.isEmpty()) || (!nodetest(_pnodes[0].bbox, box))) return 0; // nothing to find. 
+			std::vector<uint64> stack1;
+			std::vector<uint64> stack2;
+			std::vector<uint64> * pcurrentStack = &stack1;
+			std::vector<uint64> * pnextStack = &stack2;
+			pcurrentStack->push_back(0);
+			size_t nb = 0;
+			while (pcurrentStack->size() > 0)
+				{
+				pnextStack->clear();
+				for (size_t i = 0; i < pcurrentStack->size(); i++)
+					{
+					const _FlatNode & node = _pnodes[(size_t)pcurrentStack->operator[](i)];
+					const BoundedObject * obj = _pobjects + node.firstObject;
+					for (uint64 k = 0; k < node.nbObjects; k++)
+						{
+						if (objtest(obj[k].boundingbox, box)) { fun(obj[k]); nb++; }
+						}
+					const _FlatNode * son = _pnodes + node.firstSon;
+					for (uint64 k = 0; k < node.nbSons; k++)
+						{
+						if (nodetest(son[k].bbox, box)) { pnextStack->push_back(node.firstSon + k); }
+						}
+					}
+				mtools::swap(pcurrentStack, pnextStack);
+				}
+			return nb;
+			}
+
+
+		std::vector<_FlatNode>		_nodes;		// the nodes, in breadth first order (the root is _nodes[0])
+		std::vector<BoundedObject>	_objects;	// the objects, grouped by node
+
+		std::unique_ptr<MappedFile>	_file;	// the mapped file (if any)
 
+		const _FlatNode *		_pnodes;	// the nodes used by the queries (_nodes.data() or inside the mapped file)
+		size_t					_nbnodes;	// number of nodes
+		const BoundedObject *	_pobjects;	// the objects used by the queries (_objects.data() or inside the mapped file)
+		size_t					_nbobjects;	// number of objects
 	};
 
 
@@ -0,0 +1,495 @@
+/** @file weightedurn.hpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+
+#include "../misc/internal/mtools_export.hpp"
+#include "../misc/stringfct.hpp"
+#include "../misc/misc.hpp"
+#include "../misc/error.hpp"
+#include "../misc/memory.hpp"
+#include "../io/serialization.hpp"
+
+#include <string>
+#include <vector>
+#include <typeinfo>
+
+
+namespace mtools
+{
+
+
+    /**
+     * Alias table (Walker's alias method, with Vose's construction) for sampling an index in
+     * {0,...,n-1} according to a fixed set of non-negative weights.
+     *
+     * The construction takes O(n) time and each draw takes O(1) time: an index is picked via
+     * operator() by providing a uniform random number in [0,1[ (just like RandomUrn).
+     *
+     * Use WeightedUrn when the weights change over time.
+     **/
+    class AliasTable
+    {
+    public:
+
+        /**
+         * Default constructor. An empty table
+         **/
+        AliasTable() : _total(0.0) {}
+
+
+        /**
+         * Constructor from a vector of weights.
+         *
+         * @param   weights The weights (non-negative, not all zero).
+         **/
+        AliasTable(const std::vector<double> & weights) { set(weights); }
+
+
+        /**
+         * Construct the table for a set of weights. The previous content is discarded.
+         *
+         * @param   weights The weights (non-negative, not all zero).
+         **/
+        void set(const std::vector<double> & weights)
+            {
+            _weights = weights;
+            _build();
+            }
+
+
+        /**
+         * Number of indices in the table.
+         **/
+        inline size_t size() const { return _weights.size(); }
+
+
+        /**
+         * Return the weight associated with an index.
+         **/
+        inline double weight(size_t index) const
+            {
+            MTOOLS_ASSERT(index < size());
+            return _weights[index];
+            }
+
+
+        /**
+         * Return the sum of all the weights.
+         **/
+        inline double totalWeight() const { return _total; }
+
+
+        /**
+         * Return the index associated with a value in [0,1[. If v is uniform in [0,1[ then the index
+         * returned is i with probability weight(i)/totalWeight().
+         *
+         * @param   v   The double in [0,1[.
+         *
+         * @return  The corresponding index.
+         **/
+        inline size_t operator()(double v) const
+            {
+            MTOOLS_ASSERT(((v >= 0.0) && (v < 1.0)));
+            MTOOLS_ASSERT(size() > 0);
+            const double x = v*_prob.size();
+            size_t i = (size_t)x;
+            if (i >= _prob.size()) { i = _prob.size() - 1; }
+            return ((x - i) < _prob[i]) ? i : _alias[i];
+            }
+
+
+        /**
+         * Empty the table.
+         **/
+        void clear() { _weights.clear(); _prob.clear(); _alias.clear(); _total = 0.0; }
+
+
+        /**
+         * Print information about the table into a string.
+         *
+         * @return  A std::string that represents this object.
+         **/
+        std::string toString(bool debug = false) const
+            {
+            return std::string("AliasTable size: ") + mtools::toString(size()) + " total weight: " + mtools::toString(_total) + " (" + toStringMemSize(memoryUsed()) + ")" + (debug ? std::string("\n") + mtools::toString(_weights) : std::string(""));
+            }
+
+
+        /**
+         * Memory used by the table.
+         *
+         * @return  The number of byte used by the table.
+         **/
+        size_t memoryUsed() const { return MEM_FOR_OBJ(double, 2*_weights.size()) + MEM_FOR_OBJ(size_t, _alias.size()) + sizeof(*this); }
+
+
+        /**
+         * Serialize the object into an archive (only the weights are saved).
+         **/
+        void serialize(OBaseArchive & ar) const
+            {
+            ar << "AliasTable";
+            ar & _weights;
+            }
+
+
+        /**
+         * Deserialize the object from an archive.
+         **/
+        void deserialize(IBaseArchive & ar)
+            {
+            ar & _weights;
+            _build();
+            }
+
+
+    private:
+
+        /* Vose's construction of the alias table */
+        void _build()
+            {
+            const size_t n = _weights.size();
+            _total = 0.0;
+            for (size_t i = 0; i < n; i++) { MTOOLS_INSURE(_weights[i] >= 0.0); _total += _weights[i]; }
+            MTOOLS_INSURE((n == 0) || (_total > 0.0));
+            _prob.assign(n, 1.0);
+            _alias.resize(n);
+            for (size_t i = 0; i < n; i++) { _alias[i] = i; }
+            if (n == 0) return;
+            std::vector<double> p(n);
+            std::vector<size_t> small, large;
+            for (size_t i = 0; i < n; i++)
+                {
+                p[i] = _weights[i] * n / _total;
+                if (p[i] < 1.0) small.push_back(i); else large.push_back(i);
+                }
+            while ((small.size() > 0) && (large.size() > 0))
+                {
+                const size_t s = small.back(); small.pop_back();
+                const size_t l = large.back();
+                _prob[s] = p[s];
+                _alias[s] = l;
+                p[l] = (p[l] + p[s]) - 1.0;
+                if (p[l] < 1.0) { large.pop_back(); small.push_back(l); }
+                }
+            // the remaining entries have probability 1 (up to rounding errors)
+            for (size_t i : large) { _prob[i] = 1.0; }
+            for (size_t i : small) { _prob[i] = 1.0; }
+            }
+
+        std::vector<double> _weights;   // the weights
+        std::vector<double> _prob;      // probability of keeping index i
+        std::vector<size_t> _alias;     // alias of index i
+        double              _total;     // sum of the weights
+    };
+
+
+
+    /**
+     * A weighted random urn container. Elements can be added and removed from the urn and the weight
+     * of each element can be modified at any time. It is possible to pick an element at random,
+     * proportionally to its weight, via operator() by providing a uniform random number in [0,1[.
+     *
+     * The weights are stored in a sum-tree (complete binary tree whose nodes contain the sum of the
+     * weights of their children) so that insert(), remove(), setWeight() and drawing an element all
+     * take O(log n) time.
+     *
+     * Elements are identified by their index in the urn, between 0 and size()-1. Just as for
+     * RandomUrn, removing an element moves the last element of the urn into its place.
+     *
+     * @tparam  T   Type of object that the urn contains.
+     **/
+    template<typename T> class WeightedUrn
+    {
+    public:
+
+        /**
+         * Default constructor. An empty urn
+         **/
+        WeightedUrn() : _cap(1), _tree(2, 0.0) {}
+
+
+        /**
+         * Constructor. Load the urn from a file. Throws if error.
+         *
+         * @param   filename    name of the file.
+         **/
+        WeightedUrn(const std::string & filename) : _cap(1), _tree(2, 0.0) { load(filename); }
+
+
+        /**
+         * Loads from a file. The current content of the urn is discarded. Throws if eror.
+         *
+         * @param   filename    name o the file.
+         **/
+        void load(const std::string & filename)
+            {
+            clear();
+            IFileArchive ar(filename);
+            ar & (*this);
+            }
+
+
+        /**
+         * Saves the urn into a file. Throws if error.
+         * Use .z or .gz to save in compressed format.
+         *
+         * @param   filename    name of the file.
+         **/
+        void save(const std::string & filename) const
+            {
+            OFileArchive ar(filename);
+            ar & (*this);
+            }
+
+
+        /**
+         * Number of elements in the urn.
+         **/
+        inline size_t size() const { return _tab.size(); }
+
+
+        /**
+         * Return the sum of the weights of all the elements in the urn.
+         **/
+        inline double totalWeight() const { return _tree[1]; }
+
+
+        /**
+         * Access an element according to its index in the urn.
+         *
+         * @param   index   The position between 0 and size()-1.
+         *
+         * @return  A reference to the corresponding element.
+         **/
+        inline T & operator[](size_t index)
+            {
+            MTOOLS_ASSERT(index < size());
+            return _tab[index];
+            }
+
+
+        /**
+         * Return the weight of an element.
+         *
+         * @param   index   The position between 0 and size()-1.
+         **/
+        inline double weight(size_t index) const
+            {
+            MTOOLS_ASSERT(index < size());
+            return _tree[_cap + index];
+            }
+
+
+        /**
+         * Set the weight of an element.
+         *
+         * @param   index   The position between 0 and size()-1.
+         * @param   w       The new weight (non-negative).
+         **/
+        inline void setWeight(size_t index, double w)
+            {
+            MTOOLS_ASSERT(index < size());
+            MTOOLS_ASSERT(w >= 0.0);
+            size_t p = _cap + index;
+            _tree[p] = w;
+            for (p >>= 1; p > 0; p >>= 1) { _tree[p] = _tree[2 * p] + _tree[2 * p + 1]; }
+            }
+
+
+        /**
+         * Add a quantity to the weight of an element (e.g. for reinforcement).
+         *
+         * @param   index   The position between 0 and size()-1.
+         * @param   dw      The quantity to add (the resulting weight must be non-negative).
+         **/
+        inline void addWeight(size_t index, double dw) { setWeight(index, weight(index) + dw); }
+
+
+        /**
+         * Return the index of the element associated with a value in [0,1[. If v is uniform in [0,1[
+         * then the index returned is i with probability weight(i)/totalWeight().
+         *
+         * @param   v   The double in [0,1[.
+         *
+         * @return  The corresponding index.
+         **/
+        inline size_t indexOf(double v) const
+            {
+            MTOOLS_ASSERT(((v >= 0.0) && (v < 1.0)));
+            MTOOLS_ASSERT(totalWeight() > 0.0);
+            double x = v*_tree[1];
+            size_t p = 1;
+            while (p < _cap)
+                {
+                const double l = _tree[2 * p];
+                if ((x < l) || (_tree[2 * p + 1] <= 0.0)) { p = 2 * p; }
+                else { x -= l; p = 2 * p + 1; }
+                }
+            MTOOLS_ASSERT(p - _cap < size());
+            return p - _cap;
+            }
+
+
+        /**
+         * Access the element associated with a value in [0,1[. Useful for choosing an element at
+         * random (proportionally to its weight) given a uniform random number.
+         *
+         * @warning The reference is invalidated after a call to insert(), remove() or clear().
+         *
+         * @param   v   The double in [0,1[.
+         *
+         * @return  The corresponding element.
+         **/
+        inline T & operator()(double v) { return _tab[indexOf(v)]; }
+
+
+        /**
+         * Inserts an element in the Urn.
+         *
+         * @param   obj The object to insert.
+         * @param   w   Its weight (non-negative).
+         *
+         * @return  The index of the object inside the urn (i.e. size() - 1).
+         **/
+        inline size_t insert(const T & obj, double w)
+            {
+            if (_tab.size() == _cap) { _grow(); }
+            _tab.emplace_back(obj);
+            setWeight(_tab.size() - 1, w);
+            return _tab.size() - 1;
+            }
+
+
+        /**
+         * Removes an element from the urn. The last element of the urn is moved into its place.
+         *
+         * @param   index   The index of the element to remove.
+         **/
+        inline void remove(size_t index)
+            {
+            MTOOLS_ASSERT(index < size());
+            const size_t last = _tab.size() - 1;
+            if (index < last)
+                {
+                _tab[index] = _tab[last];
+                setWeight(index, weight(last));
+                }
+            setWeight(last, 0.0);
+            _tab.pop_back();
+            }
+
+
+        /**
+         * Remove every elements in the urn, leaving it empty.
+         **/
+        void clear()
+            {
+            _tab.clear();
+            _cap = 1;
+            _tree.assign(2, 0.0);
+            }
+
+
+        /**
+         * Print information about the urn into a string.
+         *
+         * @return  A std::string that represents this object.
+         **/
+        std::string toString(bool debug = false) const
+            {
+            return std::string("WeightedUrn<") + typeid(T).name() + "> size: " + mtools::toString(size()) + " total weight: " + mtools::toString(totalWeight()) + " (" + toStringMemSize(memoryUsed()) + " / " + toStringMemSize(memoryAllocated()) + ")" + (debug ? std::string("\n") + mtools::toString(_tab) : std::string(""));
+            }
+
+
+        /**
+         * Memory used by the urn.
+         *
+         * @return  The number of byte used by the urn (does not count memory dynamiccally allocate by T
+         *          objects).
+         **/
+        size_t memoryUsed() const { return MEM_FOR_OBJ(T, _tab.size()) + MEM_FOR_OBJ(double, _tree.size()) + sizeof(*this); }
+
+
+        /**
+         * Memory allocated by the urn.
+         *
+         * @return  The number of byte used by the urn (does not count memory dynamiccally allocate by T
+         *          objects).
+         **/
+        size_t memoryAllocated() const { return MEM_FOR_OBJ(T, _tab.capacity()) + MEM_FOR_OBJ(double, _tree.capacity()) + sizeof(*this); }
+
+
+        /**
+         * Serialize the urn into an archive (the elements followed by their weights).
+         **/
+        void serialize(OBaseArchive & ar) const
+            {
+            ar << "WeightedUrn";
+            ar & _tab;
+            ar.newline();
+            std::vector<double> w(_tree.begin() + _cap, _tree.begin() + _cap + _tab.size());
+            ar & w;
+            }
+
+
+        /**
+         * Deserialize the urn from an archive.
+         **/
+        void deserialize(IBaseArchive & ar)
+            {
+            clear();
+            std::vector<double> w;
+            ar & _tab;
+            ar & w;
+            MTOOLS_INSURE(w.size() == _tab.size());
+            while (_cap < _tab.size()) { _cap *= 2; }
+            _tree.assign(2 * _cap, 0.0);
+            for (size_t i = 0; i < w.size(); i++) { MTOOLS_INSURE(w[i] >= 0.0); _tree[_cap + i] = w[i]; }
+            for (size_t p = _cap - 1; p > 0; p--) { _tree[p] = _tree[2 * p] + _tree[2 * p + 1]; }
+            }
+
+
+    private:
+
+        /* double the capacity of the sum-tree */
+        void _grow()
+            {
+            const size_t ncap = 2 * _cap;
+            std::vector<double> ntree(2 * ncap, 0.0);
+            for (size_t i = 0; i < _tab.size(); i++) { ntree[ncap + i] = _tree[_cap + i]; }
+            for (size_t p = ncap - 1; p > 0; p--) { ntree[p] = ntree[2 * p] + ntree[2 * p + 1]; }
+            _tree.swap(ntree);
+            _cap = ncap;
+            }
+
+        std::vector<T>      _tab;   // the elements
+        size_t              _cap;   // number of leaves of the sum-tree (power of 2)
+        std::vector<double> _tree;  // the sum-tree: node p has children 2p and 2p+1, leaf i is at _cap + i
+    };
+
+
+}
+
+
+/* end of file */
+
@@ -25,6 +25,9 @@
 #if (MTOOLS_USE_OPENCL)
 
 #include "../misc/internal/mtools_export.hpp"
+#include "../random/gen_philox4x32.hpp"
+
+#include <string>
 
 // we want to use C++ exceptions
 #define __CL_ENABLE_EXCEPTIONS
@@ -95,6 +98,15 @@ namespace mtools
 		cl::Context			context;
 		cl::CommandQueue	queue;
 
+		/**
+		 * Directory of the on-disk cache of program binaries (empty to disable the cache). Set by the
+		 * constructor to openCL_defaultProgramCacheDir(). Programs built by createProgramFromFile()
+		 * and createProgramFromString() are stored there, keyed by the platform, the device, the
+		 * driver version, the compiler options and the source, and loaded back instead of being
+		 * compiled again. A missing, stale or invalid entry simply falls back to compiling the source.
+		 **/
+		std::string			programCacheDir;
+
 
 		/**
 		 * Constructor.
@@ -114,6 +126,12 @@ namespace mtools
 		int maxWorkGroupSize() const { return (int)device.getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE>(); }
 
 
+		/**
+		 * Query whether the device supports double precision.
+		 **/
+		bool supportsDouble() const;
+
+
 		/**
 		* Create an OpensCL programm file a source file.
 		*
@@ -179,6 +197,28 @@ namespace mtools
 	cl::Device openCL_selectDevice(const cl::Platform  & platform, bool selectdefault = true, bool output = true, bool showextensions = false);
 
 
+	/**
+	* Query whether an openCL device supports double precision (i.e. whether it reports the
+	* cl_khr_fp64 or cl_amd_fp64 extension).
+	*
+	* @param	device	The device.
+	*
+	* @return	true if kernels using double can be compiled for the device.
+	**/
+	bool openCL_supportsDouble(const cl::Device & device);
+
+
+	/**
+	* Default directory for the cache of openCL program binaries: the value of the environment
+	* variable MTOOLS_OPENCL_CACHE if it is set (an empty value disables the cache), otherwise
+	* "mtools_opencl" in %LOCALAPPDATA% (Windows) or in $HOME/.cache (other systems). The directory
+	* is created if needed.
+	*
+	* @return	The directory (empty if the cache is disabled or if no directory can be created).
+	**/
+	std::string openCL_defaultProgramCacheDir();
+
+
 	/**
 	* Create an openCL context.
 	*
@@ -201,6 +241,18 @@ namespace mtools
 	cl::CommandQueue openCL_createQueue(const cl::Device & device, const cl::Context & context, bool output = true);
 
 
+	/**
+	* OpenCL C source of the Philox4x32 counter-based generator, to prepend to the source of a
+	* program. In a kernel, mtools_philox_init(&g, seed, stream) followed by calls to
+	* mtools_philox_next(&g) returns the same sequence as Philox4x32(seed, stream) on the CPU
+	* (mtools_philox_at(seed, stream, index) is the equivalent of Philox4x32::at()). Using the
+	* global id of the work-item as stream gives each work-item its own stream without any setup.
+	*
+	* @return	The source code.
+	**/
+	inline const char * openCL_philoxSource() { return internals_random::philox4x32_openCLsource(); }
+
+
 	}
 
 
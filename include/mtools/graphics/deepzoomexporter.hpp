@@ -0,0 +1,284 @@
+/** @file deepzoomexporter.hpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include "../misc/internal/mtools_export.hpp"
+#include "../misc/misc.hpp"
+#include "../misc/error.hpp"
+#include "../misc/stringfct.hpp"
+#include "../maths/vec.hpp"
+#include "../maths/box.hpp"
+#include "../io/fileio.hpp"
+#include "rgbc.hpp"
+#include "image.hpp"
+#include "progressimg.hpp"
+#include "pixeldrawer.hpp"
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+
+
+namespace mtools
+{
+
+
+    /**
+    * Export a very large picture of a lattice object as a Deep Zoom image (the tiled multi-resolution
+    * pyramid format read by OpenSeadragon and most web viewers).
+    *
+    * The object is drawn tile by tile with a PixelDrawer so the picture can be much larger than the
+    * memory (gigapixels). save() creates:
+    *
+    * - "name.dzi"  : the xml descriptor.
+    * - "name_files/<level>/<col>_<row>.png" : the tiles. Level maxLevel() is the full resolution image
+    *   and each level below is half the size of the previous one, down to level 0 which is 1x1.
+    *
+    * Only the tiles of the full resolution level are computed from the object. The tiles of lower
+    * levels are obtained by downscaling (box average) their four children, which is exact and much
+    * cheaper than drawing the object again. The pyramid is built depth first so only a few tiles per
+    * thread are in memory at any time. Sub-trees are processed in parallel: each thread has its own
+    * PixelDrawer and encodes its own tiles.
+    *
+    * The object must be thread-safe (same requirement as for a PixelDrawer with several threads).
+    *
+    * @code
+    * DeepZoomExporter<MyLattice> E(&lattice, fBox2(-5000, 5000, -5000, 5000), 40000, 40000);
+    * E.save("lattice");   // lattice.dzi + lattice_files/
+    * @endcode
+    **/
+    template<typename ObjType> class DeepZoomExporter
+        {
+
+        public:
+
+            static const int DEFAULT_TILE_SIZE = 256;   ///< default size of the tiles
+
+
+            /**
+            * Constructor.
+            *
+            * @param [in,out]  obj         The object to draw (must stay alive until save() returns).
+            * @param           range       The range of the object to draw.
+            * @param           width       The width of the full resolution image.
+            * @param           height      The height of the full resolution image.
+            * @param           tileSize    The size of the (square) tiles.
+            * @param           bkColor     The background color, under the object.
+            **/
+            DeepZoomExporter(ObjType * obj, const fBox2 & range, int64 width, int64 height, int tileSize = DEFAULT_TILE_SIZE, RGBc bkColor = RGBc::c_White) :
+                _obj(obj), _range(range), _W(width), _H(height), _T(tileSize), _bkColor(bkColor), _maxLevel(0), _splitLevel(0),
+                _compression(6), _dir(), _top(), _topDone(false), _nbdone(0), _ok(true)
+                {
+                MTOOLS_INSURE(obj != nullptr);
+                MTOOLS_INSURE((width > 0) && (height > 0) && (tileSize >= 16));
+                MTOOLS_INSURE((range.lx() > 0) && (range.ly() > 0));
+                while ((((int64)1) << _maxLevel) < std::max<int64>(_W, _H)) { _maxLevel++; }
+                }
+
+
+            /**
+            * Index of the full resolution level (level 0 is the 1x1 image).
+            **/
+            int maxLevel() const { return _maxLevel; }
+
+
+            /**
+            * Size in pixels of the image at a given level.
+            **/
+            iVec2 levelSize(int level) const
+                {
+                const int sh = _maxLevel - level;
+                return iVec2(((_W - 1) >> sh) + 1, ((_H - 1) >> sh) + 1);
+                }
+
+
+            /**
+            * Number of tiles (horizontally and vertically) at a given level.
+            **/
+            iVec2 levelTiles(int level) const
+                {
+                const iVec2 S = levelSize(level);
+                return iVec2((S.X() + _T - 1) / _T, (S.Y() + _T - 1) / _T);
+                }
+
+
+            /**
+            * Total number of tiles in the pyramid.
+            **/
+            int64 nbTiles() const
+                {
+                int64 n = 0;
+                for (int l = 0; l <= _maxLevel; l++) { const iVec2 N = levelTiles(l); n += N.X()*N.Y(); }
+                return n;
+                }
+
+
+            /**
+            * Percentage of the tiles written by the current (or last) call to save(). Can be queried from
+            * another thread.
+            **/
+            int progress() const { return (int)((100 * (int64)_nbdone) / nbTiles()); }
+
+
+            /**
+            * Draw the object and write the pyramid. Blocks until all the tiles are written.
+            *
+            * @param   name        The base name of the output: creates name.dzi and the directory
+            *                      name_files/ (which may already exist, tiles are overwritten).
+            * @param   nbThreads   Number of threads (0 = number of hardware threads).
+            * @param   compression zlib compression level of the tiles, between 0 and 9.
+            *
+            * @return  true if all the files were written, false if an error occured.
+            **/
+            bool save(const std::string & name, int nbThreads = 0, int compression = 6)
+                {
+                if (nbThreads <= 0) nbThreads = (int)nbHardwareThreads();
+                _compression = (compression < 0) ? 0 : ((compression > 9) ? 9 : compression);
+                _nbdone = 0;
+                _ok = true;
+                _dir = name + "_files/";
+                if (!createDirectory(_dir)) return false;
+                for (int l = 0; l <= _maxLevel; l++) { if (!createDirectory(_dir + mtools::toString(l))) return false; }
+                // the sub-trees rooted at level _splitLevel are distributed among the threads
+                _splitLevel = 0;
+                while ((_splitLevel < _maxLevel) && (levelTiles(_splitLevel).X()*levelTiles(_splitLevel).Y() < 4 * (int64)nbThreads)) { _splitLevel++; }
+                const iVec2 N = levelTiles(_splitLevel);
+                _topDone = false;
+                _top.clear();
+                _top.resize((size_t)(N.X()*N.Y()));
+                std::atomic<int64> next(0);
+                std::vector<std::thread> threads;
+                for (int i = 0; i < nbThreads; i++)
+                    {
+                    threads.push_back(std::thread([&]()
+                        {
+                        PixelDrawer<ObjType> PD(_obj, 1);
+                        PD.panReuse(false);
+                        PD.enable(true);
+                        ProgressImg pim;
+                        int64 k;
+                        while ((k = next++) < (int64)_top.size()) { _top[(size_t)k] = _build(_splitLevel, k % N.X(), k / N.X(), &PD, &pim); }
+                        }));
+                    }
+                for (auto & th : threads) { th.join(); }
+                // the levels above are small: finish in this thread from the stored tiles
+                _topDone = true;
+                if (_splitLevel > 0) _build(0, 0, 0, nullptr, nullptr);
+                _top.clear();
+                const std::string dzi = std::string("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n")
+                    + "<Image xmlns=\"http://schemas.microsoft.com/deepzoom/2008\" Format=\"png\" Overlap=\"0\" TileSize=\"" + mtools::toString(_T) + "\">\n"
+                    + "  <Size Width=\"" + mtools::toString(_W) + "\" Height=\"" + mtools::toString(_H) + "\"/>\n"
+                    + "</Image>\n";
+                if (!saveStringToFile(name + ".dzi", dzi)) _ok = false;
+                return (bool)_ok;
+                }
+
+
+        private:
+
+
+            /* size of a tile (smaller on the right and bottom borders) */
+            iVec2 _tileDim(int level, int64 tx, int64 ty) const
+                {
+                const iVec2 S = levelSize(level);
+                return iVec2(std::min<int64>(_T, S.X() - tx*_T), std::min<int64>(_T, S.Y() - ty*_T));
+                }
+
+
+            /* create a tile (and its sub-tree), save it and return it */
+            Image _build(int level, int64 tx, int64 ty, PixelDrawer<ObjType> * PD, ProgressImg * pim)
+                {
+                if ((_topDone) && (level == _splitLevel)) return std::move(_top[(size_t)(tx + ty*levelTiles(level).X())]); // done by a worker
+                const iVec2 D = _tileDim(level, tx, ty);
+                Image im;
+                if (level == _maxLevel)
+                    {
+                    im = _render(tx, ty, D, PD, pim);
+                    }
+                else
+                    {
+                    const iVec2 C = _tileDim(level + 1, 2 * tx, 2 * ty);
+                    const iVec2 S = levelSize(level + 1);
+                    Image big(std::min<int64>(2 * _T, S.X() - 2 * tx*_T), std::min<int64>(2 * _T, S.Y() - 2 * ty*_T), _bkColor);
+                    for (int j = 0; j < 2; j++) for (int i = 0; i < 2; i++)
+                        {
+                        if (((2 * tx + i)*_T < S.X()) && ((2 * ty + j)*_T < S.Y()))
+                            {
+                            Image child = _build(level + 1, 2 * tx + i, 2 * ty + j, PD, pim);
+                            big.blit(child, i*C.X(), j*C.Y());
+                            }
+                        }
+                    im = big.get_rescale(10, D.X(), D.Y());
+                    }
+                if (!im.save_png((_dir + mtools::toString(level) + "/" + mtools::toString(tx) + "_" + mtools::toString(ty) + ".png").c_str(), _compression, false)) _ok = false;
+                _nbdone++;
+                return im;
+                }
+
+
+            /* draw a tile of the full resolution level */
+            Image _render(int64 tx, int64 ty, iVec2 D, PixelDrawer<ObjType> * PD, ProgressImg * pim)
+                {
+                const int64 x0 = tx*_T, y0 = ty*_T;
+                const int64 lx = std::max<int64>(D.X(), 3); // the drawer needs at least 3x3 pixels,
+                const int64 ly = std::max<int64>(D.Y(), 3); // thin border tiles are cropped afterward
+                const double px = _range.lx() / _W, py = _range.ly() / _H;
+                const fBox2 R(_range.min[0] + x0*px, _range.min[0] + (x0 + lx)*px, _range.max[1] - (y0 + ly)*py, _range.max[1] - y0*py);
+                pim->resize((size_t)lx, (size_t)ly);
+                PD->setParameters(R, pim);
+                PD->sync();
+                while (PD->progress() < 100) { std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
+                Image im(lx, ly, _bkColor);
+                pim->blit(im);
+                if ((lx == D.X()) && (ly == D.Y())) return im;
+                Image crop(D.X(), D.Y());
+                crop.blit(im, 0, 0, 0, 0, D.X(), D.Y());
+                return crop;
+                }
+
+
+            DeepZoomExporter(const DeepZoomExporter &) = delete;
+            DeepZoomExporter & operator=(const DeepZoomExporter &) = delete;
+
+            ObjType *           _obj;           // the object to draw
+            fBox2               _range;         // range of the full image
+            int64               _W, _H;         // size of the full image
+            int64               _T;             // tile size
+            RGBc                _bkColor;       // background color
+            int                 _maxLevel;      // full resolution level
+            int                 _splitLevel;    // level of the sub-trees given to the threads
+            int                 _compression;   // zlib level
+            std::string         _dir;           // output directory (with trailing '/')
+            std::vector<Image>  _top;           // tiles of level _splitLevel
+            bool                _topDone;       // true once the workers have filled _top
+            std::atomic<int64>  _nbdone;        // number of tiles written
+            std::atomic<bool>   _ok;            // false if a file could not be written
+        };
+
+
+}
+
+
+/* end of file */
+
@@ -40,6 +40,16 @@ namespace mtools
      * - The color of each element can be customized.
      *
      * Once every parameters of the image are set, it is created using the makeImage() method.
+     *
+     * Drawing the image is slow compared to blitting it. When used for the sprites of a
+     * LatticeDrawer, also implement getImageKey() with key() so that each distinct configuration
+     * is drawn only once and then reused from the drawer sprite cache:
+     *
+     * @code
+     * EdgeSiteImage makeES(iVec2 pos);  // configuration of a site
+     * uint64 getImageKey(iVec2 pos) { return makeES(pos).key(); }
+     * const Image * getImage(iVec2 pos, iVec2 size) { makeES(pos).makeImage(image, size); return &image; }
+     * @endcode
      **/
 	class EdgeSiteImage
 	{
@@ -292,6 +302,15 @@ namespace mtools
     Image & makeImage(Image & im, iVec2 size) const;
 
 
+    /**
+     * Compact key (64-bit hash) of the configuration: the edges, the site, all the colors and
+     * texts. Two objects with the same parameters have the same key (and produce the same image for
+     * a given size) while different configurations have, with overwhelming probability, different
+     * keys.
+     **/
+    uint64 key() const;
+
+
 	private:
 
     //
@@ -0,0 +1,219 @@
+/** @file escapetime.hpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include "../misc/internal/mtools_export.hpp"
+#include "../misc/misc.hpp"
+#include "../maths/vec.hpp"
+#include "rgbc.hpp"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+
+
+namespace mtools
+	{
+
+
+	/**
+	 * Escape-time engine for the Mandelbrot set z -> z^2 + c.
+	 *
+	 * The point pos of the plane corresponds to the parameter c = center + pos where the center is
+	 * given with arbitrary precision (as a decimal string). Since doubles are very precise close to 0,
+	 * the plane can be zoomed (with the usual range of Plot2DPlane) far beyond the 1e-13 limit of a
+	 * plain double iteration as long as the view stays around the origin, i.e. around the center.
+	 *
+	 * Two methods are used:
+	 * - double iteration of each point, for shallow zooms. Points are processed 4 at a time with
+	 *   AVX2 when the CPU supports it (selected at runtime, see kernelName()).
+	 * - perturbation for deep zooms: a reference orbit of the center is computed once with
+	 *   fixed-point arithmetic and each point only iterates its (double) difference with the
+	 *   reference. When the difference becomes larger than the orbit itself, or the reference
+	 *   escapes, the point is rebased on the start of the reference orbit so no glitch
+	 *   detection/second reference is needed.
+	 * In automatic mode, perturbation is used when the spacing between the points of a batch is too
+	 * small compared to |c| for the double iteration.
+	 *
+	 * The object implements getColorBatch() and getColor() so it can be plotted directly with
+	 * Plot2DPlane / PlaneDrawer. The methods computing colors are thread-safe.
+	 *
+	 * @code
+	 * MandelbrotEngine M(5000);
+	 * M.setCenter("-1.7497219297157246118", "0.00000000000000033");  // deep point
+	 * Plotter2D P;
+	 * auto L = makePlot2DPlane(M, 4, "Mandelbrot");
+	 * P[L];
+	 * P.range().setRange(fBox2(-1e-15, 1e-15, -1e-15, 1e-15));
+	 * P.plot();
+	 * @endcode
+	 *
+	 * Series approximation (skipping the first iterations of all the points at once) is not
+	 * implemented: the perturbation iterations are already cheap and the skip needs a validity check
+	 * which depends on the view.
+	 **/
+	class MandelbrotEngine
+		{
+
+		public:
+
+			static const int MODE_AUTO = 0;				///< choose between double iteration and perturbation for each batch
+			static const int MODE_DOUBLE = 1;			///< always iterate in double
+			static const int MODE_PERTURBATION = 2;		///< always use perturbation
+
+			static const int DEFAULT_MAX_ITER = 1000;	///< default maximum number of iterations
+
+
+			/**
+			 * Constructor. The center is initially 0.
+			 *
+			 * @param	maxIter	The maximum number of iterations.
+			 **/
+			MandelbrotEngine(int maxIter = DEFAULT_MAX_ITER);
+
+
+			/**
+			 * Set the center from doubles.
+			 **/
+			void setCenter(double re, double im);
+
+
+			/**
+			 * Set the center from decimal strings such as "-0.743643887037158704752191506114774" (an
+			 * exponent "e-5" is accepted). The precision of the reference orbit is deduced from the
+			 * number of digits (see precision()). Invalid strings are treated as 0.
+			 **/
+			void setCenter(const std::string & re, const std::string & im);
+
+
+			/**
+			 * The real part of the center, as given to setCenter().
+			 **/
+			std::string centerRe() const;
+
+
+			/**
+			 * The imaginary part of the center, as given to setCenter().
+			 **/
+			std::string centerIm() const;
+
+
+			/**
+			 * Set the maximum number of iterations.
+			 **/
+			void maxIter(int n);
+
+
+			/**
+			 * The maximum number of iterations.
+			 **/
+			int maxIter() const;
+
+
+			/**
+			 * Set the number of bits of the fractional part used for the reference orbit (0 =
+			 * automatic: 64 bits more than the number of digits of the center, at least 128).
+			 **/
+			void precision(int bits);
+
+
+			/**
+			 * The number of bits of the fractional part used for the reference orbit.
+			 **/
+			int precision() const;
+
+
+			/**
+			 * Set the method used: MODE_AUTO, MODE_DOUBLE or MODE_PERTURBATION.
+			 **/
+			void mode(int m);
+
+
+			/**
+			 * The method used.
+			 **/
+			int mode() const;
+
+
+			/**
+			 * Number of iterations of the reference orbit before it escapes (maxIter() if it does not).
+			 **/
+			int referenceLength() const;
+
+
+			/**
+			 * Compute the smooth escape time of n points: i + 1 - log2(log|z_i|) where i is the first
+			 * iteration with |z_i| > 256, or -1 if the point does not escape after maxIter()
+			 * iterations.
+			 *
+			 * @param	pos	   	the points (the parameter is center + pos[k]).
+			 * @param	n	   	number of points.
+			 * @param [out]	out	the n escape times.
+			 **/
+			void iterate(const fVec2 * pos, size_t n, double * out) const;
+
+
+			/**
+			 * Colors of n points (jet palette of the escape time, black inside). Used by PlaneDrawer.
+			 **/
+			void getColorBatch(const fVec2 * pos, size_t n, RGBc * out) const;
+
+
+			/**
+			 * Color of a point (required by GetColorPlaneSelector, getColorBatch() is faster).
+			 **/
+			RGBc getColor(fVec2 pos) const { RGBc c; getColorBatch(&pos, 1, &c); return c; }
+
+
+			/**
+			 * Name of the implementation of the double iteration kernel: "avx2" or "scalar".
+			 **/
+			static const char * kernelName();
+
+
+		private:
+
+			struct _Reference;
+
+			/* recompute the reference orbit */
+			void _update();
+
+			/* true if perturbation must be used for these points */
+			bool _usePerturbation(const fVec2 * pos, size_t n, const _Reference & R) const;
+
+			MandelbrotEngine(const MandelbrotEngine &) = delete;
+			MandelbrotEngine & operator=(const MandelbrotEngine &) = delete;
+
+			std::string						_re, _im;		// the center
+			int								_maxiter;		// maximum number of iterations
+			int								_precision;		// requested precision in bits (0 = auto)
+			int								_mode;			// method used
+			std::shared_ptr<const _Reference>	_ref;		// current reference orbit
+			mutable std::mutex				_mut;			// protect _ref
+		};
+
+
+	}
+
+
+/* end of file */
+
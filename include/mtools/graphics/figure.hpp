@@ -29,12 +29,74 @@
 #include "../containers/treefigure.hpp"
 
 #include <type_traits>
+#include <typeinfo>
+#include <typeindex>
+#include <memory>
+#include <deque>
+#include <vector>
 
 namespace mtools
 {
 
 
 
+	/**
+	 * Receives the vector primitives of the figures exported by FigureVectorExporter. 
+	 *
+	 * Coordinates are given in the output space: pixels of an lx x ly page, y axis pointing down.
+	 * The methods X(), Y(), DX() and DY() convert from the range R of the plane.
+	 **/
+	class FigureVectorWriter
+	{
+
+	public:
+
+		/** Constructor. R is the range of the plane mapped onto the page of size lx x ly. */
+		FigureVectorWriter(fBox2 R, int64 lx, int64 ly) : _R(R), _lx(lx), _ly(ly), _sx(lx / R.lx()), _sy(ly / R.ly()) {}
+
+		/** Virtual destructor */
+		virtual ~FigureVectorWriter() {}
+
+		/** 
+		 * Draw an ellipse with axes parallel to the axes. The interior is filled with color fill 
+		 * (unless transparent) and the outline of width strokeWidth with color stroke (unless 
+		 * strokeWidth = 0 or stroke is transparent). 
+		 **/
+		virtual void ellipse(double cx, double cy, double rx, double ry, RGBc fill, RGBc stroke, double strokeWidth) = 0;
+
+		/** Fill a rectangle. */
+		virtual void rect(double x, double y, double w, double h, RGBc fill) = 0;
+
+		/** The range of the plane. */
+		fBox2 range() const { return _R; }
+
+		/** Width of the page. */
+		int64 lx() const { return _lx; }
+
+		/** Height of the page. */
+		int64 ly() const { return _ly; }
+
+		/** Conversion of an x coordinate from the plane to the page. */
+		MTOOLS_FORCEINLINE double X(double x) const { return (x - _R.min[0]) * _sx; }
+
+		/** Conversion of a y coordinate from the plane to the page. */
+		MTOOLS_FORCEINLINE double Y(double y) const { return (_R.max[1] - y) * _sy; }
+
+		/** Conversion of a length along the x axis from the plane to the page. */
+		MTOOLS_FORCEINLINE double DX(double dx) const { return dx * _sx; }
+
+		/** Conversion of a length along the y axis from the plane to the page. */
+		MTOOLS_FORCEINLINE double DY(double dy) const { return dy * _sy; }
+
+	private:
+
+		fBox2	_R;			// range of the plane
+		int64	_lx, _ly;	// size of the page
+		double	_sx, _sy;	// scale factors
+	};
+
+
+
 	/**  
 	 * Interface class for figure objects. 
 	 *
@@ -69,6 +131,21 @@ namespace mtools
 		virtual fBox2 boundingBox() const = 0;
 
 
+		/**
+		* Return the colour that represents the figure when it is too small to be drawn (used by the
+		* level of detail summaries of Plot2DFigure). Default to opaque black.
+		*/
+		virtual RGBc lodColor() const { return RGBc::c_Black; }
+
+
+		/**
+		* Draw the figure with vector primitives (used by FigureVectorExporter). Return false if the
+		* figure has no vector representation, in which case the exporter fills its bounding box with
+		* lodColor(). Default to false.
+		*/
+		virtual bool drawVector(FigureVectorWriter & W) const { return false; }
+
+
 		/**
 		* Print info about the object into an std::string.
 		*/
@@ -186,6 +263,29 @@ namespace mtools
 			}
 
 
+		/**
+		* Draw the figure with vector primitives.
+		*/
+		virtual bool drawVector(FigureVectorWriter & W) const override
+			{
+			const double cx = W.X(center.X()), cy = W.Y(center.Y());
+			const double rx = W.DX(radius), ry = W.DY(radius);
+			if (thickness == 0.0)
+				{ // one pixel outline
+				W.ellipse(cx, cy, rx, ry, fillcolor, color, 1.0);
+				return true;
+				}
+			const bool relative = (thickness > 0);
+			const double thick = (relative ? thickness : -thickness);
+			double tx = (relative ? W.DX(thick) : thick), ty = (relative ? W.DY(thick) : thick);
+			if (tx > rx) tx = rx;
+			if (ty > ry) ty = ry;
+			if ((fillcolor.comp.A != 0) && (rx > tx) && (ry > ty)) W.ellipse(cx, cy, rx - tx, ry - ty, fillcolor, RGBc::c_Transparent, 0.0);
+			W.ellipse(cx, cy, rx - tx / 2, ry - ty / 2, RGBc::c_Transparent, color, (tx + ty) / 2);	// the band between radius - thickness and radius
+			return true;
+			}
+
+
 		/**
 		* Return the object's bounding box.
 		*
@@ -197,6 +297,15 @@ namespace mtools
 			}
 
 
+		/**
+		* Return the colour that represents the figure when it is too small to be drawn.
+		*/
+		virtual RGBc lodColor() const override
+			{
+			return ((fillcolor.comp.A == 0) ? color : fillcolor);
+			}
+
+
 		/**
 		* Print info about the object into an std::string.
 		*/
@@ -278,9 +387,91 @@ namespace mtools
 
 
 
+	namespace internals_figure
+	{
+
+		/**
+		 * Base class for the storage of all the figures of a given class inside a layer of a 
+		 * FigureCanvas object.
+		 **/
+		class FigureBucketBase
+			{
+
+			public:
+
+			/** Virtual destructor */
+			virtual ~FigureBucketBase() {}
+
+			/** Number of figures in the bucket. */
+			virtual size_t size() const = 0;
+
+			/** Draw all the figures of the bucket that intersect R, in the order they were inserted. */
+			virtual void draw(Image & im, fBox2 & R, bool highQuality) = 0;
+
+			/** Destroy all the figures of the bucket. */
+			virtual void clear() = 0;
+			};
+
+
+		/**
+		 * Storage for all the figures of class FIGURECLASS inside a layer of a FigureCanvas object.
+		 * 
+		 * Figures are stored by value in a deque (so their address never changes and can be given to
+		 * the TreeFigure object of the layer) and their bounding boxes are stored contiguously in a
+		 * separate array. draw() calls FIGURECLASS::draw() directly: there is no virtual call per figure
+		 * and the compiler may inline the drawing code in the loop.
+		 **/
+		template<typename FIGURECLASS> class FigureBucket : public FigureBucketBase
+			{
+
+			public:
+
+			/** Add a copy of a figure to the bucket and return a pointer to it. */
+			FIGURECLASS * push(const FIGURECLASS & figure)
+				{
+				_figs.push_back(figure);
+				_boxes.push_back(figure.boundingBox());
+				return &(_figs.back());
+				}
+
+			virtual size_t size() const override { return _figs.size(); }
+
+			virtual void draw(Image & im, fBox2 & R, bool highQuality) override
+				{
+				const size_t l = _figs.size();
+				for (size_t i = 0; i < l; i++)
+					{
+					const fBox2 & B = _boxes[i];
+					if ((B.max[0] < R.min[0]) || (B.min[0] > R.max[0]) || (B.max[1] < R.min[1]) || (B.min[1] > R.max[1])) continue;
+					_figs[i].FIGURECLASS::draw(im, R, highQuality); // non virtual call
+					}
+				}
+
+			virtual void clear() override
+				{
+				_figs.clear();
+				_boxes.clear();
+				}
+
+			private:
+
+			std::deque<FIGURECLASS>	_figs;	// the figures
+			std::vector<fBox2>		_boxes;	// their bounding boxes
+			};
+
+	}
+
+
+
 	/**
 	 * Class that holds figure objects
 	 * 
+	 * Figures are stored by type: each layer has one bucket per figure class holding all the figures
+	 * of this class contiguously. The figures of a layer are also indexed in a TreeFigure object
+	 * (cf. getTreeLayer()) for fast spatial queries. When most of the figures must be drawn (e.g. 
+	 * when rendering the whole canvas), drawLayer() iterates directly over the buckets, which avoids
+	 * the virtual call and the pointer indirection per figure. 
+	 * 
 	 * NOT THREADSAFE : do not insert objects while accessing (ie drawing) the canvas. 
 	 */
 	class FigureCanvas
@@ -293,10 +484,10 @@ namespace mtools
 		/**
 		 * Constructor: create an empty canvas with a given number of layers. 
 		 **/
-		FigureCanvas(size_t nbLayers = 1) : _nbLayers(nbLayers)
+		FigureCanvas(size_t nbLayers = 1) : _nbLayers(nbLayers), _buckets(nbLayers), _lastType(nbLayers, nullptr), _lastBucket(nbLayers, nullptr)
 			{
 			MTOOLS_INSURE(nbLayers > 0);
-			_figLayers = new TreeFigure<FigureInterface*>(nbLayers);
+			_figLayers = new TreeFigure<FigureInterface*>[nbLayers];
 			}
 
 
@@ -306,7 +497,7 @@ namespace mtools
 		~FigureCanvas()
 			{
 			clear();
-			delete _figLayers;
+			delete [] _figLayers;
 			}
 
 
@@ -315,9 +506,10 @@ namespace mtools
 		 */
 		template<typename FIGURECLASS> MTOOLS_FORCEINLINE void operator()(const FIGURECLASS & figure, size_t layer = 0)
 			{
+			static_assert(std::is_base_of<FigureInterface, FIGURECLASS>::value, "FigureCanvas: the figure class must derive from FigureInterface");
 			MTOOLS_ASSERT(layer < _nbLayers);
-			FigureInterface * pf = _copyInPool(figure);			// save a copy of the object in the memory pool
-			_figLayers[layer].insert(pf->boundingBox(), pf);	// add to the corresponding layer. 
+			FigureInterface * pf = _getBucket<FIGURECLASS>(layer)->push(figure);	// save a copy of the object in the bucket of its class
+			_figLayers[layer].insert(pf->boundingBox(), pf);					// add to the corresponding layer. 
 			return;
 			}
 
@@ -333,7 +525,11 @@ namespace mtools
 		 **/
 		void clear()
 			{
-			// TODO
+			for (size_t i = 0; i < _nbLayers; i++) 
+				{ 
+				_figLayers[i].reset(); 
+				for (auto & b : _buckets[i]) { b.second->clear(); }
+				}
 			}
 
 
@@ -342,8 +538,28 @@ namespace mtools
 		 */
 		MTOOLS_FORCEINLINE size_t size() const
 			{
-			// TODO
-			return 0;  
+			size_t nb = 0;
+			for (size_t i = 0; i < _nbLayers; i++) { nb += _figLayers[i].size(); }
+			return nb;  
+			}
+
+
+		/**
+		 * Draw all the figures of a layer that intersect the range R onto an image.
+		 * 
+		 * The figures are drawn class by class (in the order of insertion within each class) using
+		 * the typed buckets: the layer is scanned linearly, without using the TreeFigure object, which
+		 * is faster when a large fraction of the figures is visible. 
+		 *
+		 * @param [in,out]	im		   	the image to draw onto.
+		 * @param 		  	R		   	the range.
+		 * @param 		  	layer	   	the layer to draw.
+		 * @param 		  	highQuality	true for high quality drawing.
+		 **/
+		void drawLayer(Image & im, fBox2 R, size_t layer = 0, bool highQuality = true)
+			{
+			MTOOLS_ASSERT(layer < _nbLayers);
+			for (auto & b : _buckets[layer]) { b.second->draw(im, R, highQuality); }
 			}
 
 
@@ -355,6 +571,29 @@ namespace mtools
 			}
 
 
+		/**
+		 * Find the figure whose bounding box is nearest to a given position (for picking).
+		 *
+		 * @param 		  	pos	   	The position.
+		 * @param 		  	maxDist	Only figures whose bounding box is at distance at most maxDist are
+		 * 							considered.
+		 * @param [in,out]	layer  	If not null, set to the layer of the figure found.
+		 *
+		 * @return	the figure or nullptr if there is none within distance maxDist.
+		 **/
+		FigureInterface * nearestFigure(fVec2 pos, double maxDist = std::numeric_limits<double>::infinity(), size_t * layer = nullptr) const
+			{
+			FigureInterface * res = nullptr;
+			for (size_t l = 0; l < _nbLayers; l++)
+				{
+				double d;
+				auto bo = _figLayers[l].nearest(pos, maxDist, &d);
+				if (bo != nullptr) { res = bo->object; maxDist = d; if (layer) *layer = l; }
+				}
+			return res;
+			}
+
+
 	private: 
 
 
@@ -363,32 +602,34 @@ namespace mtools
 		FigureCanvas & operator=(const FigureCanvas &) = delete;
 
 
-
-		/******************** MEMORY POOL **********************/
+		typedef std::vector<std::pair<std::type_index, std::unique_ptr<internals_figure::FigureBucketBase> > > _BucketList;
 
 
-		/* Make a copy of the figure object inside the memory pool */
-		template<typename FIGURECLASS> MTOOLS_FORCEINLINE
-		//typename std::enable_if<std::is_base_of<FigureInterface, typename FIGURECLASS>, FigureInterface*>::type
-		FigureInterface *
-		_copyInPool(const FIGURECLASS & figure)
+		/* Return the bucket for a figure class in a given layer (create it if needed). */
+		template<typename FIGURECLASS> MTOOLS_FORCEINLINE internals_figure::FigureBucket<FIGURECLASS> * _getBucket(size_t layer)
 			{
-			void * p = _allocate(sizeof(FIGURECLASS));	// allocate memory in the memory pool for the figure object
-			new (p) FIGURECLASS(figure);				// placement new : copy constructor. 
-			return ((FigureInterface *)p);				// cast to base class. 
-			}
-
-
-		/* allocate size bytes in the memory pool. */
-		MTOOLS_FORCEINLINE void * _allocate(size_t size)
-			{ 
-			return malloc(size); // TODO : use better memory pool. 
+			const std::type_info * ti = &typeid(FIGURECLASS);
+			if (_lastType[layer] != ti)
+				{ // not the same class as the previous insertion in this layer
+				internals_figure::FigureBucketBase * pb = nullptr;
+				for (auto & b : _buckets[layer]) { if (b.first == std::type_index(*ti)) { pb = b.second.get(); break; } }
+				if (pb == nullptr)
+					{
+					pb = new internals_figure::FigureBucket<FIGURECLASS>();
+					_buckets[layer].push_back(std::make_pair(std::type_index(*ti), std::unique_ptr<internals_figure::FigureBucketBase>(pb)));
+					}
+				_lastType[layer] = ti;
+				_lastBucket[layer] = pb;
+				}
+			return static_cast<internals_figure::FigureBucket<FIGURECLASS> *>(_lastBucket[layer]);
 			}
 
 
-		const size_t					_nbLayers;	// number of layers
-		TreeFigure<FigureInterface*> *	_figLayers;	// tree figure object for each layer. 
-
+		const size_t										_nbLayers;		// number of layers
+		TreeFigure<FigureInterface*> *						_figLayers;		// tree figure object for each layer. 
+		std::vector<_BucketList>							_buckets;		// typed buckets holding the figures of each layer
+		std::vector<const std::type_info *>					_lastType;		// class of the last figure inserted in each layer
+		std::vector<internals_figure::FigureBucketBase *>	_lastBucket;	// corresponding bucket
 
 	};
 
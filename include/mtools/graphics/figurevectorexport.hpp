@@ -0,0 +1,179 @@
+/** @file figurevectorexport.hpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include "../misc/internal/mtools_export.hpp"
+#include "../misc/misc.hpp"
+#include "../misc/error.hpp"
+#include "figure.hpp"
+
+#include <string>
+#include <vector>
+
+
+namespace mtools
+{
+
+
+	namespace internals_figure
+	{
+		class VectorBackend;
+	}
+
+
+	/**
+	 * Export of figures (typically the content of a FigureCanvas) into a SVG or PDF file.
+	 *
+	 * The figures are written to the file as they are added so the memory used does not depend on
+	 * their number and the export time is linear. Each figure draws itself with the vector
+	 * primitives of FigureVectorWriter (cf. FigureInterface::drawVector()).
+	 *
+	 * When mergeSmall is set, figures whose bounding box is smaller than a pixel of the output
+	 * page are not written individually: their color (FigureInterface::lodColor()) is accumulated
+	 * in a lx x ly grid of cells which is written, at the end of each layer, as horizontal runs of
+	 * identical cells. Millions of tiny figures thus produce a file of size proportional to the
+	 * page instead of the number of figures.
+	 *
+	 * Two backends are available:
+	 *
+	 * - BACKEND_NATIVE : SVG and PDF are written directly (the PDF content stream is deflated on
+	 *                    the fly). Always available. Bounded memory.
+	 * - BACKEND_CAIRO  : uses the cairo SVG / PDF surfaces (when mtools is built with cairo,
+	 *                    otherwise the native backend is used). Cairo records the whole page
+	 *                    before writing it so the memory grows with the number of primitives.
+	 *
+	 * @code
+	 * FigureVectorExporter::save(canvas, "packing.pdf", fBox2(-1, 1, -1, 1), 2000, 2000);
+	 * @endcode
+	 **/
+	class FigureVectorExporter
+	{
+
+	public:
+
+		static const int FORMAT_AUTO = 0;		///< deduce the format from the extension of the file name (.svg or .pdf)
+		static const int FORMAT_SVG = 1;		///< SVG
+		static const int FORMAT_PDF = 2;		///< PDF
+
+		static const int BACKEND_NATIVE = 0;	///< mtools' own streaming writers
+		static const int BACKEND_CAIRO = 1;		///< cairo (if available)
+
+
+		/**
+		 * Constructor. Create the file and write its header.
+		 *
+		 * @param	filename  	The file name.
+		 * @param	R		  	The range of the plane exported.
+		 * @param	lx		  	width of the page (in pixels, i.e. 1/72 inch for PDF).
+		 * @param	ly		  	height of the page.
+		 * @param	format	  	FORMAT_AUTO, FORMAT_SVG or FORMAT_PDF.
+		 * @param	mergeSmall	true to merge the figures smaller than a pixel.
+		 * @param	backend   	BACKEND_NATIVE or BACKEND_CAIRO.
+		 **/
+		FigureVectorExporter(const std::string & filename, fBox2 R, int64 lx, int64 ly, int format = FORMAT_AUTO, bool mergeSmall = true, int backend = BACKEND_NATIVE);
+
+
+		/**
+		 * Destructor. Calls close().
+		 **/
+		~FigureVectorExporter();
+
+
+		/**
+		 * Write a figure (nothing is done if it does not intersect the range).
+		 **/
+		void add(const FigureInterface & fig);
+
+
+		/**
+		 * Write all the figures of a layer of a canvas which intersect the range, then the merged
+		 * small figures of the layer.
+		 **/
+		void addLayer(const FigureCanvas & canvas, size_t layer);
+
+
+		/**
+		 * Write all the layers of a canvas, in order.
+		 **/
+		void addCanvas(const FigureCanvas & canvas);
+
+
+		/**
+		 * Write the small figures merged so far (called automatically by addLayer() and close()).
+		 **/
+		void flushSmall();
+
+
+		/**
+		 * Finish the file and close it. Called automatically by the destructor.
+		 *
+		 * @return	true if the file was written successfully.
+		 **/
+		bool close();
+
+
+		/** true if no error occurred so far. */
+		bool ok() const;
+
+
+		/** Number of figures written individually. */
+		size_t nbWritten() const { return _nbWritten; }
+
+
+		/** Number of figures merged because they were smaller than a pixel. */
+		size_t nbMerged() const { return _nbMerged; }
+
+
+		/**
+		 * Export all the layers of a canvas into a file.
+		 *
+		 * @return	true if the file was written successfully.
+		 **/
+		static bool save(const FigureCanvas & canvas, const std::string & filename, fBox2 R, int64 lx, int64 ly, int format = FORMAT_AUTO, bool mergeSmall = true, int backend = BACKEND_NATIVE)
+			{
+			FigureVectorExporter E(filename, R, lx, ly, format, mergeSmall, backend);
+			E.addCanvas(canvas);
+			return E.close();
+			}
+
+
+	private:
+
+		FigureVectorExporter(const FigureVectorExporter &) = delete;
+		FigureVectorExporter & operator=(const FigureVectorExporter &) = delete;
+
+		internals_figure::VectorBackend * _writer;	// the backend (nullptr once closed)
+		fBox2					_R;				// range
+		int64					_lx, _ly;		// size of the page
+		bool					_merge;			// merge the small figures
+		std::vector<RGBc>		_cells;			// colors of the merged small figures (allocated on first use)
+		bool					_dirtyCells;	// true if some cells are not transparent
+		size_t					_nbWritten;		// number of figures written
+		size_t					_nbMerged;		// number of figures merged
+		bool					_ok;			// status of the last close()
+	};
+
+
+}
+
+
+/* end of file */
+
@@ -29,6 +29,11 @@
 #include "rgbc.hpp"
 #include "../io/serialization.hpp"
 
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+
 
 namespace mtools
 	{
@@ -93,6 +98,10 @@ namespace mtools
 	*
 	*  Support the .bff font format of 'Codehead's bitmap font generator'. c.f.
 	*  http://www.codehead.co.uk/cbfg/.
+	*
+	*  All the glyphs of the font are packed in a single image (the atlas). Texts drawn with
+	*  drawText() are composited once (for a given color) into a single sprite which is kept in a
+	*  cache so that drawing the same text again only requires one blend() operation.
 	**/
 	class Font
 		{
@@ -100,7 +109,7 @@ namespace mtools
 		public:
 
 			/** Default constructor. Empty font */
-			Font() : _fontsize(0), _tab() {}
+			Font() : _fontsize(0), _tab(), _atlas(), _runpixels(0) {}
 
 
 			/**
@@ -119,9 +128,10 @@ namespace mtools
 			*
 			* @param [in,out]	ar	The archive.
 			**/
-			Font(IBaseArchive & ar) : _fontsize(0), _tab()
+			Font(IBaseArchive & ar) : _fontsize(0), _tab(), _atlas(), _runpixels(0)
 				{
 				serialize(ar);
+				_buildAtlas();
 				}
 
 
@@ -131,7 +141,7 @@ namespace mtools
 			* @param	ft			the font to copy.
 			* @param	fontsize	the font size.
 			**/
-			Font(const Font & ft, int fontsize) : _fontsize(0), _tab()
+			Font(const Font & ft, int fontsize) : _fontsize(0), _tab(), _atlas(), _runpixels(0)
 				{
 				createFrom(ft, fontsize);
 				}
@@ -140,17 +150,19 @@ namespace mtools
 			/**
 			* Move constructor.
 			**/
-			Font(Font && ft) : _fontsize(ft._fontsize), _tab(std::move(ft._tab))
+			Font(Font && ft) : _fontsize(ft._fontsize), _tab(std::move(ft._tab)), _atlas(std::move(ft._atlas)), _runpixels(0)
 				{
 				ft._fontsize = 0;
 				ft._tab.clear();
+				ft._atlas.empty();
+				ft._clearRuns();
 				}
 
 
 			/**
 			* Copy constructor (shallow !)
 			**/
-			Font(const Font & ft) : _fontsize(ft._fontsize), _tab(ft._tab)
+			Font(const Font & ft) : _fontsize(ft._fontsize), _tab(ft._tab), _atlas(ft._atlas), _runpixels(0)
 				{
 				}
 
@@ -163,10 +175,14 @@ namespace mtools
 				if (this != &ft)
 					{
 					_tab.clear();
+					_clearRuns();
 					_fontsize = ft._fontsize;
 					_tab = std::move(ft._tab);
+					_atlas = std::move(ft._atlas);
 					ft._fontsize = 0;
 					ft._tab.clear();
+					ft._atlas.empty();
+					ft._clearRuns();
 					}
 				return(*this);
 				}
@@ -179,8 +195,10 @@ namespace mtools
 				{
 				if (this != &ft)
 					{
+					_clearRuns();
 					_fontsize = ft._fontsize;
 					_tab = ft._tab;
+					_atlas = ft._atlas;
 					}
 				return(*this);
 				}
@@ -218,6 +236,13 @@ namespace mtools
 			const Glyph glyph(char c) const { return ((_fontsize) ? (_tab[c]) : (Glyph())); }
 
 
+			/**
+			* Return the atlas of the font i.e. the image containing all the glyphs (the glyph images
+			* are shallow sub-images of the atlas).
+			**/
+			const Image & atlas() const { return _atlas; }
+
+
 			/**
 			* Return the size of the bounding box when drawing text txt with this font.
 			**/
@@ -309,7 +334,36 @@ namespace mtools
 			friend class FontFamily;
 
 			/** Empty the font (only for friend class) **/
-			void empty() { _fontsize = 0; _tab.clear(); }
+			void empty() { _fontsize = 0; _tab.clear(); _atlas.empty(); _clearRuns(); }
+
+
+			static const size_t MAX_RUN_LENGTH = 256;		// longer texts are not cached, their glyphs are drawn one by one
+			static const size_t MAX_RUNS = 4096;			// maximum number of texts in the cache
+			static const int64 MAX_RUN_PIXELS = 1 << 24;	// maximum number of pixels in the cache
+
+
+			/* text run: the glyphs of a text composited in a single sprite */
+			struct _TextRun
+				{
+				iVec2 dim;		// dimension of the text box
+				iVec2 off;		// position of the sprite relative to the upper left corner of the text box
+				Image sprite;	// the composited glyphs, with the color already applied
+				};
+
+			/* return the text run associated with txt and color (from the cache if possible) */
+			std::shared_ptr<const _TextRun> _textRun(const std::string & txt, RGBc color) const;
+
+			/* composite the glyphs of txt into a single sprite with a given color */
+			void _makeTextRun(const std::string & txt, RGBc color, _TextRun & run) const;
+
+			/* draw the glyphs of txt one by one, pos is the upper left corner of the text box */
+			void _drawGlyphs(Image & im, iVec2 pos, const std::string & txt, RGBc color) const;
+
+			/* empty the text run cache */
+			void _clearRuns() const;
+
+			/* pack all the glyphs into the atlas and replace them by shallow sub-images of it */
+			void _buildAtlas();
 
 			/* trim the glyph image and set glyph.offx and glyph.offy values */
 			void _trim(int c);
@@ -330,6 +384,11 @@ namespace mtools
 
 			int64 _fontsize;			// size of the font
 			std::vector<Glyph> _tab;	// vector containing the glyphs. 
+			Image _atlas;				// image containing all the glyphs
+
+			mutable std::mutex _runmut;		// mutex for the text run cache (fonts are shared between threads)
+			mutable std::unordered_map<std::string, std::shared_ptr<const _TextRun> > _runs;	// text run cache (key = color + text)
+			mutable int64 _runpixels;		// number of pixels in the cache
 
 		};
 
@@ -360,11 +419,33 @@ namespace mtools
 			FontFamily(IBaseArchive & ar) { _empty(); deserialize(ar); }
 
 
+			/**
+			 * Lazy constructor. The native fonts are read from the archive (created with serialize())
+			 * only when a font of this size, or a size rescaled from it, is first requested. Since the
+			 * fonts are stored by increasing size, requesting a small font does not decode the large
+			 * ones. The archive is released once all the fonts are read.
+			 *
+			 * @param	ar			 	The archive.
+			 * @param	nativeSizes	The sizes of the fonts stored in the archive.
+			 **/
+			FontFamily(std::unique_ptr<IBaseArchive> ar, const std::set<int> & nativeSizes)
+				{
+				_empty();
+				std::lock_guard<std::mutex> lock(_mut); // mutex lock for concurrent access. 
+				size_t l; (*ar) & l;
+				MTOOLS_INSURE(l == nativeSizes.size());
+				_nativeset = nativeSizes;
+				_lazyleft = l;
+				if (l > 0) _lazyar = std::move(ar);
+				}
+
+
 			/**
 			 * Serialization of the object.
 			 **/
 			void serialize(OBaseArchive & ar) const
 				{
+				_loadAll();
 				ar & _nativeset.size();
 				for (auto it = _nativeset.begin(); it != _nativeset.end(); it++)
 					{
@@ -387,6 +468,8 @@ namespace mtools
 					int fs; ar & fs;
 					_nativeset.insert(fs);
 					ar & _fonts[fs];
+					_fonts[fs]._buildAtlas();
+					_ready[fs].store(true, std::memory_order_release);
 					}
 				}
 
@@ -401,8 +484,10 @@ namespace mtools
 				std::lock_guard<std::mutex> lock(_mut); // mutex lock for concurrent access. 
 				const int size = font.fontsize();
 				if ((size <= 0)||(size >= MAX_FONT_SIZE)) return; 
+				if ((_lazyar) && (_nativeset.size() > 0)) _loadNative(*(_nativeset.rbegin())); // read the remaining native fonts first
 				_fonts[size] = font;
 				_nativeset.insert(size);
+				_ready[size].store(true, std::memory_order_release);
 				}
 
 
@@ -433,7 +518,7 @@ namespace mtools
 			inline const Font & operator()(int fontsize, int  method = MTOOLS_NATIVE_FONT_BELOW)
 				{
 				int fs = nearestSize(fontsize, method);
-				if (_fonts[fontsize].isEmpty()) { _constructFont(fs); }
+				if (!_ready[fs].load(std::memory_order_acquire)) { _constructFont(fs); }
 				return _fonts[fs];
 				}
 
@@ -468,10 +553,19 @@ namespace mtools
 			/* construct the font using the smallest larger font */ 
 			void _constructFont(int fontsize);
 
+			/* read the native fonts from the lazy archive until the font with size fontsize is read (called with _mut locked) */
+			void _loadNative(int fontsize) const;
+
+			/* read all the remaining native fonts from the lazy archive */
+			void _loadAll() const;
+
 
 			std::set<int>		_nativeset;				// set that keep tracks of native fonts
-			std::vector<Font>	_fonts;					// vector of fonts. 
-			std::mutex			_mut;					// mutex for mutlithread access to global font objects. 
+			mutable std::vector<Font>	_fonts;			// vector of fonts (native fonts are filled lazily). 
+			mutable std::unique_ptr<std::atomic<bool>[]> _ready;	// _ready[fs] is true once _fonts[fs] is constructed
+			mutable std::unique_ptr<IBaseArchive> _lazyar;	// archive of the native fonts not read yet (or nullptr)
+			mutable size_t		_lazyleft;				// number of native fonts left in _lazyar
+			mutable std::mutex	_mut;					// mutex for mutlithread access to global font objects. 
 		};
 
 
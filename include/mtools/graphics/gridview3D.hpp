@@ -0,0 +1,343 @@
+/** @file gridview3D.hpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include "../misc/internal/mtools_export.hpp"
+#include "../misc/misc.hpp"
+#include "../misc/error.hpp"
+#include "../misc/internal/threadworker.hpp"
+#include "../maths/vec.hpp"
+#include "../maths/box.hpp"
+#include "rgbc.hpp"
+#include "palette.hpp"
+
+#include <vector>
+#include <thread>
+#include <limits>
+#include <cmath>
+#include <algorithm>
+
+
+namespace mtools
+{
+
+    template<typename GRID, typename FUN> class GridView3D;
+
+
+    /**
+     * Factory function for a GridView3D.
+     *
+     * @param   grid    The 3D grid (a Grid_factor<3, ...>).
+     * @param   fun     The function double fun(const T &) giving the value of a site.
+     * @param   pal     The palette used to color the values.
+     **/
+    template<typename GRID, typename FUN> GridView3D<GRID, FUN> makeGridView3D(const GRID & grid, FUN fun, const Palette & pal = Palette::jet(256))
+        {
+        return GridView3D<GRID, FUN>(grid, fun, pal);
+        }
+
+
+    /**
+     * 2D view of a 3D grid (Grid_factor<3, T, ...>) to be drawn with a LatticeDrawer / Plot2DLattice.
+     *
+     * Each site is given a value by the function fun(const T &) (returning a double, NaN for
+     * 'nothing here'). The view is either:
+     *
+     * - VIEW_SLICE : the values on the plane {x[axis] = pos}.
+     * - VIEW_MAX / VIEW_MIN / VIEW_SUM : the max / min / sum of the values along the axis (NaN
+     *   values are skipped).
+     *
+     * The two remaining coordinates (in increasing order) are the coordinates of the 2D view. The
+     * view is computed by update() which visits the blocks of the grid (Grid_factor::leafs()) in bulk,
+     * a uniform special sub-box being processed at once whatever its size, and stores the result for
+     * each column in a dense 2D array covering the bounding box of the leafs (or a given region). The
+     * array is kept between frames so getColor() is a single lookup. Columns without value are
+     * transparent. The values are colored with the palette over [vmin, vmax] (by default the range of
+     * the values of the view).
+     *
+     * update() must be called again when the grid changes (while the plot is suspended since the
+     * grid must not be modified during the update and the array is rebuilt).
+     *
+     * @code{.cpp}
+     * Grid_factor<3, int> G;
+     * ... // simulation
+     * auto V = makeGridView3D(G, [](const int & v) { return (v == 0) ? std::numeric_limits<double>::quiet_NaN() : (double)v; });
+     * V.projection(2, V.VIEW_SUM);          // thickness of the cluster along z
+     * auto P = makePlot2DLattice(V, "cluster");
+     * Plotter2D plotter; plotter[P];
+     * plotter.plot();
+     * V.slice(2, 10);                      // plane z = 10
+     * @endcode
+     **/
+    template<typename GRID, typename FUN> class GridView3D
+        {
+
+        public:
+
+            static const int VIEW_SLICE = 0;    ///< slice perpendicular to the axis
+            static const int VIEW_MAX = 1;      ///< maximum along the axis
+            static const int VIEW_MIN = 2;      ///< minimum along the axis
+            static const int VIEW_SUM = 3;      ///< sum along the axis
+
+
+            /**
+             * Constructor. The view is the projection along the z axis with VIEW_MAX. The cache is
+             * computed.
+             *
+             * @param   grid    The 3D grid.
+             * @param   fun     The function double fun(const T &) giving the value of a site.
+             * @param   pal     The palette.
+             **/
+            GridView3D(const GRID & grid, FUN fun, const Palette & pal = Palette::jet(256)) : _grid(&grid), _fun(fun), _pal(pal), _type(VIEW_MAX), _axis(2), _pos(0), _fixedRange(false), _vmin(0), _vmax(0), _amin(0), _amax(0), _dom(0, -1, 0, -1)
+                {
+                update();
+                }
+
+
+            /**
+             * Display the slice {x[axis] = pos}. The cache is recomputed.
+             **/
+            void slice(int axis, int64 pos, size_t nbThreads = 0)
+                {
+                MTOOLS_INSURE((axis >= 0) && (axis < 3));
+                _type = VIEW_SLICE; _axis = axis; _pos = pos;
+                update(nbThreads);
+                }
+
+
+            /**
+             * Display the projection along an axis. The cache is recomputed.
+             *
+             * @param   axis    The axis (0, 1 or 2).
+             * @param   type    VIEW_MAX, VIEW_MIN or VIEW_SUM.
+             **/
+            void projection(int axis, int type = VIEW_MAX, size_t nbThreads = 0)
+                {
+                MTOOLS_INSURE((axis >= 0) && (axis < 3));
+                MTOOLS_INSURE((type == VIEW_MAX) || (type == VIEW_MIN) || (type == VIEW_SUM));
+                _type = type; _axis = axis;
+                update(nbThreads);
+                }
+
+
+            /** The type of view: VIEW_SLICE, VIEW_MAX, VIEW_MIN or VIEW_SUM. */
+            int viewType() const { return _type; }
+
+
+            /** The axis of the slice / projection. */
+            int axis() const { return _axis; }
+
+
+            /** The position of the slice. */
+            int64 slicePos() const { return _pos; }
+
+
+            /**
+             * Set the range of values mapped to the palette.
+             **/
+            void colorRange(double vmin, double vmax) { _fixedRange = true; _vmin = vmin; _vmax = vmax; }
+
+
+            /**
+             * Use the range of the values of the view (default).
+             **/
+            void autoColorRange() { _fixedRange = false; _vmin = _amin; _vmax = _amax; }
+
+
+            /**
+             * Change the palette.
+             **/
+            void palette(const Palette & pal) { _pal = pal; }
+
+
+            /**
+             * Region covered by the cache (in the coordinates of the view).
+             **/
+            iBox2 domain() const { return _dom; }
+
+
+            /**
+             * Recompute the cache over the bounding box of the leafs of the grid (projected on the plane
+             * of the view). The grid must not be modified during the call.
+             *
+             * @param   nbThreads   Number of threads (0 = number of hardware threads).
+             **/
+            void update(size_t nbThreads = 0)
+                {
+                const std::vector<LeafSpan> vec = _grid->leafs();
+                iBox2 R(0, -1, 0, -1);
+                for (const LeafSpan & L : vec)
+                    {
+                    if (L.special) continue;
+                    const iBox2 B = _proj(L.box);
+                    R = (R.isEmpty()) ? B : iBox2(std::min(R.min[0], B.min[0]), std::max(R.max[0], B.max[0]), std::min(R.min[1], B.min[1]), std::max(R.max[1], B.max[1]));
+                    }
+                _update(vec, R, nbThreads);
+                }
+
+
+            /**
+             * Recompute the cache over a given region of the plane of the view.
+             **/
+            void update(const iBox2 & region, size_t nbThreads = 0)
+                {
+                _update(_grid->leafs(), region, nbThreads);
+                }
+
+
+            /**
+             * Value of the view at a given position (NaN if none).
+             **/
+            inline double value(iVec2 pos) const
+                {
+                if (!_dom.isInside(pos)) return std::numeric_limits<double>::quiet_NaN();
+                return _val[(size_t)((pos.Y() - _dom.min[1])*(_dom.max[0] - _dom.min[0] + 1) + (pos.X() - _dom.min[0]))];
+                }
+
+
+            /**
+             * Color of a site (LatticeDrawer interface).
+             **/
+            inline RGBc getColor(iVec2 pos) const
+                {
+                const double v = value(pos);
+                if (std::isnan(v)) return RGBc::c_Transparent;
+                return _pal(v, _vmin, _vmax);
+                }
+
+
+        private:
+
+            typedef typename GRID::LeafSpan LeafSpan;
+
+
+            /* project a 3D box on the plane of the view */
+            inline iBox2 _proj(const iBox<3> & B) const
+                {
+                const int a = (_axis == 0) ? 1 : 0, b = (_axis == 2) ? 1 : 2;
+                return iBox2(B.min[a], B.max[a], B.min[b], B.max[b]);
+                }
+
+
+            /* combine a new value into a cell */
+            inline void _combine(double & cell, double x) const
+                {
+                if (std::isnan(x)) return;
+                if (std::isnan(cell)) { cell = x; return; }
+                switch (_type)
+                    {
+                    case VIEW_MAX: { if (x > cell) cell = x; return; }
+                    case VIEW_MIN: { if (x < cell) cell = x; return; }
+                    case VIEW_SUM: { cell += x; return; }
+                    default: { cell = x; return; }
+                    }
+                }
+
+
+            /* recompute the cache over region R */
+            void _update(const std::vector<LeafSpan> & vec, iBox2 R, size_t nbThreads)
+                {
+                _dom = R;
+                _val.clear();
+                _amin = _amax = 0;
+                if (R.isEmpty()) { if (!_fixedRange) { _vmin = _vmax = 0; } return; }
+                const int64 lx = R.max[0] - R.min[0] + 1, ly = R.max[1] - R.min[1] + 1;
+                _val.assign((size_t)(lx*ly), std::numeric_limits<double>::quiet_NaN());
+                if (nbThreads == 0) { nbThreads = (size_t)nbHardwareThreads(); }
+                if ((int64)nbThreads > ly) { nbThreads = (size_t)ly; }
+                // thread t processes the rows [y0, y1] of the view so there is no need for locking
+                auto work = [&](size_t t)
+                    {
+                    const int64 y0 = R.min[1] + (ly*(int64)t) / (int64)nbThreads;
+                    const int64 y1 = R.min[1] + (ly*(int64)(t + 1)) / (int64)nbThreads - 1;
+                    for (const LeafSpan & L : vec) { _processBlock(L, R, y0, y1, lx); }
+                    };
+                std::vector<std::thread> threads;
+                for (size_t t = 1; t < nbThreads; t++) { threads.push_back(std::thread(work, t)); }
+                work(0);
+                for (auto & th : threads) { th.join(); }
+                bool first = true;
+                for (const double v : _val)
+                    {
+                    if (std::isnan(v)) continue;
+                    if (first) { _amin = _amax = v; first = false; }
+                    else { if (v < _amin) _amin = v; if (v > _amax) _amax = v; }
+                    }
+                if (!_fixedRange) { _vmin = _amin; _vmax = _amax; }
+                }
+
+
+            /* add the contribution of a block to the rows [y0,y1] of the view */
+            void _processBlock(const LeafSpan & L, const iBox2 & R, int64 y0, int64 y1, int64 lx)
+                {
+                if ((_type == VIEW_SLICE) && ((_pos < L.box.min[_axis]) || (_pos > L.box.max[_axis]))) return;
+                const iBox2 P = _proj(L.box);
+                const int64 ax = std::max(P.min[0], R.min[0]), bx = std::min(P.max[0], R.max[0]);
+                const int64 ay = std::max(P.min[1], y0), by = std::min(P.max[1], y1);
+                if ((ax > bx) || (ay > by)) return;
+                const int a = (_axis == 0) ? 1 : 0, b = (_axis == 2) ? 1 : 2;
+                if (L.special)
+                    { // uniform block: a single value for all the columns
+                    double x = (double)_fun(*L.data);
+                    if ((_type == VIEW_SUM) && (!std::isnan(x))) { x *= (double)(L.box.max[_axis] - L.box.min[_axis] + 1); }
+                    for (int64 j = ay; j <= by; j++)
+                        {
+                        double * row = _val.data() + (size_t)((j - R.min[1])*lx - R.min[0]);
+                        for (int64 i = ax; i <= bx; i++) { _combine(row[i], x); }
+                        }
+                    return;
+                    }
+                const int64 z0 = (_type == VIEW_SLICE) ? _pos : L.box.min[_axis];
+                const int64 z1 = (_type == VIEW_SLICE) ? _pos : L.box.max[_axis];
+                iVec<3> pos;
+                for (int64 j = ay; j <= by; j++)
+                    {
+                    pos[b] = j;
+                    double * row = _val.data() + (size_t)((j - R.min[1])*lx - R.min[0]);
+                    for (int64 z = z0; z <= z1; z++)
+                        {
+                        pos[_axis] = z;
+                        for (int64 i = ax; i <= bx; i++) { pos[a] = i; _combine(row[i], (double)_fun(L(pos))); }
+                        }
+                    }
+                }
+
+
+            const GRID *        _grid;          // the grid
+            FUN                 _fun;           // value of a site
+            Palette             _pal;           // the palette
+            int                 _type;          // type of view
+            int                 _axis;          // axis of the slice / projection
+            int64               _pos;           // position of the slice
+            bool                _fixedRange;    // true if the color range is set by the user
+            double              _vmin, _vmax;   // range of values mapped to the palette
+            double              _amin, _amax;   // range of the values of the view
+            iBox2               _dom;           // region covered by the cache
+            std::vector<double> _val;           // value of each column of the region (row by row)
+
+        };
+
+
+}
+
+
+/* end of file */
+
@@ -25,7 +25,11 @@
 #include "../misc/error.hpp"
 #include "../maths/vec.hpp"
 #include "../maths/box.hpp"
+#include "../maths/vecarray.hpp"
+#include "../maths/bezier.hpp"
 #include "rgbc.hpp"
+#include "internal/blendkernels.hpp"
+#include "internal/scanlinerasterizer.hpp"
 #include "../io/serialization.hpp"
 #include "../random/gen_fastRNG.hpp"
 #include "../random/classiclaws.hpp"
@@ -35,6 +39,13 @@
 #endif
 
 #include "../io/console.hpp"
+#include "../misc/internal/threadworker.hpp"
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <cstring>
+#include <cctype>
 
 
 // use libpng
@@ -118,6 +129,9 @@ namespace mtools
 	 *  ************************************* SSE optimizations ************************************
 	 * used if  MTOOLS_USE_SSE is non zero. 
 	 * 
+	 * Independently of MTOOLS_USE_SSE, blending, filling and clearing regions use the vectorized
+	 * kernels of internal/blendkernels.hpp (AVX2/SSE2/NEON selected at runtime, scalar fallback).
+	 * 
 	 **/
 	class Image
 		{
@@ -128,6 +142,10 @@ namespace mtools
 			static const bool DEFAULT_BLEND			= true;			///< default mode is to use blending.
 			static const bool DEFAULT_GRID_ALIGN    = true;			///< default mode is to align to grid for faster drawing.
 
+			static const int GAUSSIAN_CONVOLUTION	= 0;			///< gaussian blur by convolution with a truncated gaussian kernel.
+			static const int GAUSSIAN_BOX			= 1;			///< gaussian blur approximated by three box blurs.
+			static const int GAUSSIAN_IIR			= 2;			///< gaussian blur approximated by a recursive (IIR) filter.
+
 
 			/******************************************************************************************************************************************************
 			*******************************************************************************************************************************************************
@@ -144,7 +162,7 @@ namespace mtools
 			 */
 			inline Image() :	_lx(0), _ly(0), _stride(0),
 								_deletepointer(nullptr), _data(nullptr),
-								_pcairo_surface(nullptr), _pcairo_context(nullptr)
+								_pcairo_surface(nullptr), _pcairo_context(nullptr), _pmipmaps(nullptr)
 				{}
 
 
@@ -171,7 +189,7 @@ namespace mtools
 			 */
 			inline Image(int64 lx, int64 ly, int64 padding = 0) :   _lx(lx), _ly(ly), _stride(lx + ((padding < 0) ? 0 : padding)),
 																                _deletepointer(nullptr), _data(nullptr), 
-																				_pcairo_surface(nullptr), _pcairo_context(nullptr)
+																				_pcairo_surface(nullptr), _pcairo_context(nullptr), _pmipmaps(nullptr)
 				{
 				if ((_lx <= 0) || (_ly <= 0)) { empty(); return; }
 				_allocate(_ly, _stride, nullptr);
@@ -238,7 +256,7 @@ namespace mtools
 			 **/
 			inline Image(RGBc * data, int64 lx, int64 ly, bool shallow, int64 padding = 0) : _lx(lx), _ly(ly), _stride(lx + padding),
 																				      _deletepointer(nullptr), _data(nullptr), 
-																		              _pcairo_surface(nullptr), _pcairo_context(nullptr)
+																		              _pcairo_surface(nullptr), _pcairo_context(nullptr), _pmipmaps(nullptr)
 				{
 				MTOOLS_INSURE(data != nullptr);
 				MTOOLS_INSURE(_lx > 0);
@@ -287,7 +305,7 @@ namespace mtools
 			 **/
 			inline Image(Image && source) : _lx(source._lx), _ly(source._ly), _stride(source._stride),
 									 _deletepointer(source._deletepointer), _data(source._data),
-									 _pcairo_surface(source._pcairo_surface), _pcairo_context(source._pcairo_context)				
+									 _pcairo_surface(source._pcairo_surface), _pcairo_context(source._pcairo_context), _pmipmaps(source._pmipmaps)
 				{
 				source._lx = 0;
 				source._ly = 0;
@@ -296,6 +314,7 @@ namespace mtools
 				source._data = nullptr;
 				source._pcairo_surface = nullptr;
 				source._pcairo_context = nullptr;
+				source._pmipmaps = nullptr;
 				}
 
 
@@ -341,7 +360,7 @@ namespace mtools
 			inline Image(const Image & source, int64 x0, int64 y0, int64 newlx, int64 newly, bool shallow, int64 padding = 0) :
 								_lx(newlx), _ly(newly), _stride(shallow ? source._stride : (newlx + ((padding >= 0) ? padding : 0))),
 								_deletepointer(nullptr), _data(nullptr),
-								_pcairo_surface(nullptr), _pcairo_context(nullptr)
+								_pcairo_surface(nullptr), _pcairo_context(nullptr), _pmipmaps(nullptr)
 				{
 				MTOOLS_INSURE((newlx >= 0) && (newly >= 0));
 				if((newlx*newly == 0) || (source._data == nullptr)) { empty(); return; }
@@ -417,6 +436,7 @@ namespace mtools
 					dest._deletepointer = _deletepointer;
 					dest._pcairo_surface = _pcairo_surface;
 					dest._pcairo_context = _pcairo_context;
+					dest._pmipmaps = _pmipmaps;
 					_lx = 0;
 					_ly = 0;
 					_stride = 0;
@@ -424,6 +444,7 @@ namespace mtools
 					_deletepointer = nullptr;
 					_pcairo_context = nullptr;
 					_pcairo_surface = nullptr;
+					_pmipmaps = nullptr;
 					}
 				return;
 				}
@@ -778,44 +799,49 @@ namespace mtools
 				empty(); 
 				if (im.is_empty()) return; 
 				resizeRaw(im.width(), im.height(),true,0);
-				RGBc * pdest = _data;
-				const size_t pad = (size_t)(_stride - _lx);
+				if ((im.spectrum() != 3) && (im.spectrum() != 4))
+					{
+					MTOOLS_DEBUG("Invalid CImg image");
+					clear(RGBc::c_White);
+					return;
+					}
 				const unsigned char * pR = im.data(0, 0, 0, 0);
 				const unsigned char * pG = im.data(0, 0, 0, 1);
 				const unsigned char * pB = im.data(0, 0, 0, 2);
-				if (im.spectrum() == 3)
+				const unsigned char * pA = (im.spectrum() == 4) ? im.data(0, 0, 0, 3) : nullptr;
+				for (int64 j = 0; j < _ly; j++)
 					{
-					for (int64 j = 0; j < _ly; j++)
-						{
-						for (int64 i = 0; i < _lx; i++) { *(pdest++) = RGBc(*(pR++), *(pG++), *(pB++), 255); }
-						pdest += pad;
-						}						
-					return;
+					const size_t off = (size_t)(j*_lx);
+					internals_graphics::planarToLine(_data + j*_stride, pR + off, pG + off, pB + off, ((pA == nullptr) ? nullptr : pA + off), (size_t)_lx);
+					if ((premult) && (pA != nullptr)) internals_graphics::premultiplyLine(_data + j*_stride, (size_t)_lx);
 					}
-				if (im.spectrum() == 4)
+				}
+
+
+			/**
+			 * Initialize this image from a buffer of interleaved 8-bit RGB or RGBA pixels (the usual
+			 * layout of framebuffers, video frames, stb_image...). Current image content is discarded.
+			 *
+			 * @param	src		   	pointer to the first pixel of the buffer.
+			 * @param	lx		   	width of the image.
+			 * @param	ly		   	height of the image.
+			 * @param	nbchannels 	3 for RGB or 4 for RGBA.
+			 * @param	rowbytes   	(Optional) number of bytes between two lines of the buffer (0 =
+			 * 						lx*nbchannels).
+			 * @param	premult	   	(Optional) True to perform alpha pre-multiplication during conversion.
+			 **/
+			void fromInterleaved(const unsigned char * src, int64 lx, int64 ly, int nbchannels, int64 rowbytes = 0, bool premult = true)
+				{
+				MTOOLS_INSURE((nbchannels == 3) || (nbchannels == 4));
+				empty();
+				if ((lx <= 0) || (ly <= 0)) return;
+				if (rowbytes <= 0) rowbytes = lx*nbchannels;
+				resizeRaw(lx, ly, true, 0);
+				for (int64 j = 0; j < _ly; j++)
 					{
-					const unsigned char * pA = im.data(0, 0, 0, 3);
-					if (premult)
-						{
-						for (int64 j = 0; j < _ly; j++)
-							{
-							for (int64 i = 0; i < _lx; i++) { RGBc cc = RGBc(*(pR++), *(pG++), *(pB++), *(pA++)); cc.premultiply();  *(pdest++) = cc; }
-							pdest += pad;
-							}
-						}
-					else
-						{
-						for (int64 j = 0; j < _ly; j++)
-							{
-							for (int64 i = 0; i < _lx; i++) { *(pdest++) = RGBc(*(pR++), *(pG++), *(pB++), *(pA++)); }
-							pdest += pad;
-							}
-						}
-					return;
+					internals_graphics::interleavedToLine(_data + j*_stride, src + j*rowbytes, (size_t)_lx, nbchannels);
+					if ((premult) && (nbchannels == 4)) internals_graphics::premultiplyLine(_data + j*_stride, (size_t)_lx);
 					}
-				MTOOLS_DEBUG("Invalid CImg image");
-				clear(RGBc::c_White);
-				return;
 				}
 
 
@@ -1241,6 +1267,85 @@ namespace mtools
 			*******************************************************************************************************************************************************/
 
 
+			/**
+			 * Set the number of threads used by the rescaling methods (rescale(), get_rescale() and
+			 * blit_rescaled()). The destination rectangle is split into horizontal bands which are
+			 * computed in parallel when the image is large enough. The result does not depend on the
+			 * number of threads (except for the stochastic downscaling used with low quality).
+			 *
+			 * @param	nbthreads	number of threads: 0 (default) to use all the hardware threads and 1 to
+			 * 						disable multithreading.
+			 **/
+			static void setRescaleThreads(int nbthreads)
+				{
+				_rescaleThreadsRef() = ((nbthreads < 0) ? 0 : nbthreads);
+				}
+
+
+			/**
+			 * Return the number of threads used by the rescaling methods.
+			 **/
+			static int rescaleThreads()
+				{
+				const int nb = _rescaleThreadsRef();
+				return ((nb <= 0) ? nbHardwareThreads() : nb);
+				}
+
+
+			/**
+			 * Build the mipmap pyramid of this image: level k is a copy of the image downscaled by a factor
+			 * 2^k (with box average). When the image is used as the source of a downscaling operation
+			 * (rescale(), get_rescale(), blit_rescaled()), the rescaling starts from the smallest level
+			 * which is still larger than the destination instead of the full resolution image. This speeds
+			 * up repeated zooms out on the same image.
+			 *
+			 * The pyramid is a cache: it is NOT updated when the image is modified. Call buildMipmaps()
+			 * again (or clearMipmaps()) after modifying the image. The pyramid is discarded when the image
+			 * is emptied or reassigned and it is not shared with copies of the image.
+			 *
+			 * @param	minsize	The width and height of the smallest level are at least minsize.
+			 **/
+			void buildMipmaps(int64 minsize = 16)
+				{
+				clearMipmaps();
+				if (isEmpty()) return;
+				if (minsize < 1) minsize = 1;
+				std::vector<Image> * levels = new std::vector<Image>();
+				int64 nlx = _lx / 2, nly = _ly / 2;
+				while ((nlx >= minsize) && (nly >= minsize))
+					{
+					levels->emplace_back(nlx, nly);
+					const Image & prev = ((levels->size() == 1) ? (*this) : ((*levels)[levels->size() - 2]));
+					levels->back().blit_rescaled(10, prev, 0, 0, nlx, nly);
+					nlx /= 2; nly /= 2;
+					}
+				if (levels->size() == 0) { delete levels; return; }
+				_pmipmaps = levels;
+				}
+
+
+			/**
+			 * Discard the mipmap pyramid of this image (if any).
+			 **/
+			void clearMipmaps()
+				{
+				delete _pmipmaps;
+				_pmipmaps = nullptr;
+				}
+
+
+			/**
+			 * Query if the image has a mipmap pyramid.
+			 *
+			 * @return	the number of levels of the pyramid (not counting the image itself), 0 if there is no
+			 * 			pyramid.
+			 **/
+			int nbMipmaps() const
+				{
+				return ((_pmipmaps == nullptr) ? 0 : (int)_pmipmaps->size());
+				}
+
+
 			/**
 			 * Rescale this image to a given size.
 			 * 
@@ -1602,14 +1707,25 @@ namespace mtools
 					}
 				if ((dest_sx <= sprite_sx) && (dest_sy <= sprite_sy))
 					{ // downscaling
+					if (sprite._pmipmaps != nullptr)
+						{ // use the smallest level of the pyramid still larger than the destination
+						int64 L = (int64)sprite._pmipmaps->size();
+						while (L > 0)
+							{
+							const int64 mx = (sprite_x >> L), my = (sprite_y >> L);
+							const int64 msx = ((sprite_x + sprite_sx) >> L) - mx, msy = ((sprite_y + sprite_sy) >> L) - my;
+							if ((msx >= dest_sx) && (msy >= dest_sy)) { return blit_rescaled(quality, (*sprite._pmipmaps)[(size_t)(L - 1)], dest_x, dest_y, dest_sx, dest_sy, mx, my, msx, msy); }
+							L--;
+							}
+						}
 					if ((dest_sx == 1) || (dest_sy == 1))
 						{ // box average does not work for flat images. use _nearest neighbour. (TODO, improve that). 
-						_nearest_neighbour_scaling(_data + (dest_y*_stride) + dest_x, _stride, dest_sx, dest_sy, sprite._data + (sprite_y*sprite._stride) + sprite_x, sprite._stride, sprite_sx, sprite_sy);
+						_nearest_neighbour_scaling_mt(_data + (dest_y*_stride) + dest_x, _stride, dest_sx, dest_sy, sprite._data + (sprite_y*sprite._stride) + sprite_x, sprite._stride, sprite_sx, sprite_sy);
 						return MAX_QUALITY; // cannot do any better. 
 						}
 					if (!quality)
 						{ // quality = 0, we use fastest method : nearest neighbour.
-						_nearest_neighbour_scaling(_data + (dest_y*_stride) + dest_x, _stride, dest_sx, dest_sy, sprite._data + (sprite_y*sprite._stride) + sprite_x, sprite._stride, sprite_sx, sprite_sy);
+						_nearest_neighbour_scaling_mt(_data + (dest_y*_stride) + dest_x, _stride, dest_sx, dest_sy, sprite._data + (sprite_y*sprite._stride) + sprite_x, sprite._stride, sprite_sx, sprite_sy);
 						return 0; // worst quality. 
 						}
 					// use box average downscaling					
@@ -1627,27 +1743,27 @@ namespace mtools
 					uint64 stepy = (1ULL << (2*(MAX_QUALITY - quality)));
 					int quality_y = quality;
 					while (dst_sy*stepy > src_sy) { stepy >>= 2; quality_y++; }
-					_boxaverage_downscaling(dest_data, dest_stride, dst_sx, dst_sy, src_data, src_stride, src_sx, src_sy, stepx, stepy);
+					_boxaverage_downscaling_mt(dest_data, dest_stride, dst_sx, dst_sy, src_data, src_stride, src_sx, src_sy, stepx, stepy);
 					return (int)std::min<uint64>(quality_x,quality_y); 
 					}
 				if ((dest_sx >= sprite_sx) && (dest_sy >= sprite_sy))
 					{ // upscaling, quality > 0
 					if ((sprite_sx == 1) || (sprite_sy == 1))
 						{ // use _nearest neighbour. (TODO, improve that). 
-						_nearest_neighbour_scaling(_data + (dest_y*_stride) + dest_x, _stride, dest_sx, dest_sy, sprite._data + (sprite_y*sprite._stride) + sprite_x, sprite._stride, sprite_sx, sprite_sy);
+						_nearest_neighbour_scaling_mt(_data + (dest_y*_stride) + dest_x, _stride, dest_sx, dest_sy, sprite._data + (sprite_y*sprite._stride) + sprite_x, sprite._stride, sprite_sx, sprite_sy);
 						return MAX_QUALITY; // cannot do any better. 
 						}
 					if (!quality)
 						{ // quality = 0, use fastest method. 
-						_nearest_neighbour_scaling(_data + (dest_y*_stride) + dest_x, _stride, dest_sx, dest_sy, sprite._data + (sprite_y*sprite._stride) + sprite_x, sprite._stride, sprite_sx, sprite_sy);
+						_nearest_neighbour_scaling_mt(_data + (dest_y*_stride) + dest_x, _stride, dest_sx, dest_sy, sprite._data + (sprite_y*sprite._stride) + sprite_x, sprite._stride, sprite_sx, sprite_sy);
 						return 0;
 						}
 					// use linear interpolation
-					_linear_upscaling(_data + (dest_y*_stride) + dest_x, _stride, dest_sx, dest_sy, sprite._data + (sprite_y*sprite._stride) + sprite_x, sprite._stride, sprite_sx, sprite_sy);
+					_linear_upscaling_mt(_data + (dest_y*_stride) + dest_x, _stride, dest_sx, dest_sy, sprite._data + (sprite_y*sprite._stride) + sprite_x, sprite._stride, sprite_sx, sprite_sy);
 					return MAX_QUALITY;
 					}
 				// mix up/down scaling -> use nearest neighbour
-				_nearest_neighbour_scaling(_data + (dest_y*_stride) + dest_x, _stride, dest_sx, dest_sy, sprite._data + (sprite_y*sprite._stride) + sprite_x, sprite._stride, sprite_sx, sprite_sy);
+				_nearest_neighbour_scaling_mt(_data + (dest_y*_stride) + dest_x, _stride, dest_sx, dest_sy, sprite._data + (sprite_y*sprite._stride) + sprite_x, sprite._stride, sprite_sx, sprite_sy);
 				return MAX_QUALITY;
 				}
 
@@ -1973,16 +2089,9 @@ namespace mtools
 					if ((blending) && (!color.isOpaque())) _lineBresenham<true, true, false, false,false,false>(P1, P2, color, draw_P2, 0, 0); else _lineBresenham<false, true, false, false, false, false>(P1, P2, color, draw_P2, 0, 0);
 					return;
 					}
-				_correctPenOpacity(color, penwidth);
-				if (antialiased)
-					{
-					const int64 of = 10 + 2 * penwidth;
-					if (!_csLineClip(P1, P2, iBox2(-of, _lx - 1 + of, -of, _ly - 1 + of))) return; // choose box bigger to diminish clipping error. 
-					if (blending) _lineBresenhamAA<true, true, true>(P1, P2, color, draw_P2, penwidth); else _lineBresenhamAA<false, true, true>(P1, P2, color, draw_P2, penwidth);
-					return;
-					}
-				if ((blending) && (!color.isOpaque())) _lineBresenham<true,true, false, true, false, false>(P1, P2, color, draw_P2, penwidth, 0); else _lineBresenham<false,true, false, true, false, false>(P1, P2, color, draw_P2, penwidth, 0);
-				return;
+				// large pen: rasterize the region swept by the pen
+				const iVec2 tab[2] = { P1, P2 };
+				_draw_thick_polyline(2, tab, false, color, blending, antialiased, penwidth + 0.5);
 				}
 
 
@@ -2065,32 +2174,12 @@ namespace mtools
 						}
 					return;
 					}
-				// penwidth >= 1
-				_correctPenOpacity(color, penwidth);
+				// penwidth >= 1: flatten the curve and rasterize the region swept by the pen
 				mbr.enlarge(penwidth);
 				if (intersectionRect(mbr, B).isEmpty()) return;  // nothing to draw
-				// always check range since cost is negligible compared to using a large pen. 
-				if (antialiasing)
-					{
-					if (wc == 1)
-						{
-						if (blending)  _plotQuadBezier<true, true, true, true>(P1.X(), P1.Y(), PC.X(), PC.Y(), P2.X(), P2.Y(), color, draw_P2, penwidth); else _plotQuadBezier<false, true, true, true>(P1.X(), P1.Y(), PC.X(), PC.Y(), P2.X(), P2.Y(), color, draw_P2, penwidth);
-						}
-					else
-						{
-						if (blending)  _plotQuadRationalBezier<true, true, true, true>(P1.X(), P1.Y(), PC.X(), PC.Y(), P2.X(), P2.Y(), wc, color, draw_P2, penwidth); else _plotQuadRationalBezier<false, true, true, true>(P1.X(), P1.Y(), PC.X(), PC.Y(), P2.X(), P2.Y(), wc, color, draw_P2, penwidth);
-						}
-					return;
-					}
-				if (wc == 1)
-					{
-					if ((blending) && (!color.isOpaque()))  _plotQuadBezier<true, true, false, true>(P1.X(), P1.Y(), PC.X(), PC.Y(), P2.X(), P2.Y(), color, draw_P2, penwidth); else _plotQuadBezier<false, true, false, true>(P1.X(), P1.Y(), PC.X(), PC.Y(), P2.X(), P2.Y(), color, draw_P2, penwidth);
-					}
-				else
-					{
-					if ((blending) && (!color.isOpaque()))  _plotQuadRationalBezier<true, true, false, true>(P1.X(), P1.Y(), PC.X(), PC.Y(), P2.X(), P2.Y(), wc, color, draw_P2, penwidth); else _plotQuadRationalBezier<false, true, false, true>(P1.X(), P1.Y(), PC.X(), PC.Y(), P2.X(), P2.Y(), wc, color, draw_P2, penwidth);
-					}
-				return;
+				std::vector<fVec2> tab;
+				_flattenQuadBezier(P1, P2, PC, wc, tab);
+				_draw_thick_polyline(tab.size(), tab.data(), false, color, blending, antialiasing, penwidth + 0.5);
 				}
 
 
@@ -2133,17 +2222,12 @@ namespace mtools
 					if ((blending) && (!color.isOpaque()))  _plotCubicBezier<true, false, false, false>(P1.X(), P1.Y(), PA.X(), PA.Y(), PB.X(), PB.Y(), P2.X(), P2.Y(), color, draw_P2, penwidth); else _plotCubicBezier<false, false, false, false>(P1.X(), P1.Y(), PA.X(), PA.Y(), PB.X(), PB.Y(), P2.X(), P2.Y(), color, draw_P2, penwidth);
 					return;
 					}
-				// use large pen
-				_correctPenOpacity(color, penwidth);
+				// use large pen: flatten the curve and rasterize the region swept by the pen
 				mbr.enlarge(penwidth);
 				if (intersectionRect(mbr, B).isEmpty()) return;  // nothing to draw
-				//always check bounds
-				if (antialiasing) 
-					{
-					if (blending) _plotCubicBezier<true, true, true, true>(P1.X(), P1.Y(), PA.X(), PA.Y(), PB.X(), PB.Y(), P2.X(), P2.Y(), color, draw_P2, penwidth); else _plotCubicBezier<false, true, true, true>(P1.X(), P1.Y(), PA.X(), PA.Y(), PB.X(), PB.Y(), P2.X(), P2.Y(), color, draw_P2, penwidth);
-					return;
-					}
-				if ((blending) && (!color.isOpaque())) _plotCubicBezier<true, true, false, true>(P1.X(), P1.Y(), PA.X(), PA.Y(), PB.X(), PB.Y(), P2.X(), P2.Y(), color, draw_P2, penwidth); else _plotCubicBezier<false, true, false, true>(P1.X(), P1.Y(), PA.X(), PA.Y(), PB.X(), PB.Y(), P2.X(), P2.Y(), color, draw_P2, penwidth);
+				std::vector<fVec2> tab;
+				_flattenCubicBezier(P1, P2, PA, PB, tab);
+				_draw_thick_polyline(tab.size(), tab.data(), false, color, blending, antialiasing, penwidth + 0.5);
 				}
 			
 
@@ -2560,6 +2644,11 @@ namespace mtools
 				{
 				if (isEmpty()) return;
 				if ((color.isOpaque())&&(!antialiased)) blending = false;
+				if ((penwidth > 0) && (nbvertices > 1))
+					{ // large pen: all the sides are rasterized together so the corners are drawn only once
+					_draw_thick_polyline(nbvertices, tabPoints, true, color, blending, antialiased, penwidth + 0.5);
+					return;
+					}
 				switch (nbvertices)
 					{
 					case 0: { return; }
@@ -2615,6 +2704,56 @@ namespace mtools
 				}
 
 
+			/**
+			 * Draw an open polyline. Consecutive points should be distinct.
+			 *
+			 * @param	nbpoints			Number of points.
+			 * @param	tabPoints			the list of points.
+			 * @param	color				The color tu use.
+			 * @param	draw_last_point		true to draw the last point.
+			 * @param	blending			true to use blending.
+			 * @param	antialiased			true to draw antialiased lines.
+			 * @param	penwidth			The pen width (0 = unit width)
+			 **/
+			inline void draw_polyline(size_t nbpoints, const iVec2 * tabPoints, RGBc color, bool draw_last_point, bool blending, bool antialiased, int32 penwidth = 0)
+				{
+				if ((isEmpty()) || (nbpoints == 0)) return;
+				if ((color.isOpaque()) && (!antialiased)) blending = false;
+				if (nbpoints == 1)
+					{
+					if (draw_last_point) draw_dot(*tabPoints, color, blending, penwidth);
+					return;
+					}
+				if (penwidth > 0)
+					{ // large pen: all the segments are rasterized together so the joints are drawn only once
+					_draw_thick_polyline(nbpoints, tabPoints, false, color, blending, antialiased, penwidth + 0.5);
+					return;
+					}
+				if (antialiased)
+					{
+					if (blending) _draw_polyline_thin<true, true>(nbpoints, tabPoints, color, draw_last_point); else _draw_polyline_thin<false, true>(nbpoints, tabPoints, color, draw_last_point);
+					return;
+					}
+				if (blending) _draw_polyline_thin<true, false>(nbpoints, tabPoints, color, draw_last_point); else _draw_polyline_thin<false, false>(nbpoints, tabPoints, color, draw_last_point);
+				}
+
+
+			/**
+			 * Draw an open polyline. Consecutive points should be distinct.
+			 *
+			 * @param	tabPoints			std vector of points.
+			 * @param	color				The color tu use.
+			 * @param	draw_last_point		true to draw the last point.
+			 * @param	blending			true to use blending.
+			 * @param	antialiased			true to draw antialiased lines.
+			 * @param	penwidth			The pen width (0 = unit width)
+			 **/
+			MTOOLS_FORCEINLINE void draw_polyline(const std::vector<iVec2> & tabPoints, RGBc color, bool draw_last_point, bool blending, bool antialiased, int32 penwidth = 0)
+				{
+				draw_polyline(tabPoints.size(), tabPoints.data(), color, draw_last_point, blending, antialiased, penwidth);
+				}
+
+
 			/**
 			* Fill the interior of a convex polygon. The boundary lines are not drawn.
 			*
@@ -2632,27 +2771,16 @@ namespace mtools
 					fill_triangle(tabPoints[0], tabPoints[1], tabPoints[2], fillcolor, blending);
 					return;
 					}
-				//Compute the barycenter
-				double X = 0, Y = 0;
-				for (size_t i = 0; i < nbvertices; i++) { X += tabPoints[i].X(); Y += tabPoints[i].Y(); }
-				iVec2 G((int64)(X / nbvertices), (int64)(Y / nbvertices));
-				for (size_t i = 0; i < nbvertices; i++)
-					{
-					fill_triangle(tabPoints[i], tabPoints[(i + 1) % nbvertices], G, fillcolor, blending);
-					}
-				if (blending)
-					{
-					_lineBresenham_avoid<true, true, false, false, false>(tabPoints[0], G, tabPoints[nbvertices - 1], tabPoints[1], fillcolor, 0,0);
-					for (size_t i = 1; i < nbvertices; i++)
-						{
-						_lineBresenham_avoid_both_sides<true, true, false, false, false>(tabPoints[i], G, tabPoints[i - 1], tabPoints[(i + 1) % nbvertices], tabPoints[0], tabPoints[i - 1], fillcolor,0);
-						}
-					return;
-					}
-				for (size_t i = 0; i < nbvertices; i++)
-					{
-					draw_line(G, tabPoints[i], fillcolor, false);
-					}
+				iBox2 mbr(tabPoints[0]);
+				for (size_t i = 1; i < nbvertices; i++) { mbr.swallowPoint(tabPoints[i]); }
+				const iBox2 B = intersectionRect(mbr, imageBox());
+				if (B.isEmpty()) return; // nothing to draw.
+				// sample the centers of the pixels, excluding those on the boundary.
+				auto & S = _scanlineRasterizer();
+				S.reset(B, false, true);
+				S.addPolygon(nbvertices, tabPoints);
+				S.begin();
+				if (blending) _draw_scanline<true>(S, fillcolor); else _draw_scanline<false>(S, fillcolor);
 				}
 
 
@@ -2670,6 +2798,51 @@ namespace mtools
 				}	
 
 
+			/**
+			 * Fill a (real-valued) polygon. The polygon may be non-convex or self-intersecting (non-zero
+			 * winding rule). The edges are not drawn.
+			 *
+			 * With antialiasing, the opacity of each pixel is multiplied by the exact fraction of its area
+			 * covered by the polygon (the pixel (i,j) being the square [i-1/2,i+1/2]x[j-1/2,j+1/2]).
+			 * Otherwise, the pixels whose center is inside the polygon are filled.
+			 *
+			 * @param	nbvertices 	Number of vertices in the polygon.
+			 * @param	tabPoints  	the list of points in clockwise or counterclockwise order.
+			 * @param	fillcolor  	The color to use.
+			 * @param	aa		   	(Optional) true to use antialiasing.
+			 * @param	blend	   	(Optional) true to use blending.
+			 **/
+			inline void fill_polygon(size_t nbvertices, const fVec2 * tabPoints, RGBc fillcolor, bool aa = DEFAULT_AA, bool blend = DEFAULT_BLEND)
+				{
+				if (isEmpty() || nbvertices < 3) return;
+				fBox2 mbr(tabPoints[0]);
+				for (size_t i = 1; i < nbvertices; i++) { mbr.swallowPoint(tabPoints[i]); }
+				const iBox2 B = intersectionRect(imageBox(), iBox2((int64)std::max<double>(-1.0, floor(mbr.min[0])), (int64)std::min<double>((double)_lx, ceil(mbr.max[0])),
+																	(int64)std::max<double>(-1.0, floor(mbr.min[1])), (int64)std::min<double>((double)_ly, ceil(mbr.max[1]))));
+				if (B.isEmpty()) return; // nothing to draw.
+				auto & S = _scanlineRasterizer();
+				S.reset(B, aa);
+				S.addPolygon(nbvertices, tabPoints);
+				S.begin();
+				if ((blend) && ((aa) || (!fillcolor.isOpaque()))) _draw_scanline<true>(S, fillcolor); else _draw_scanline<false>(S, fillcolor);
+				}
+
+
+			/**
+			 * Fill a (real-valued) polygon. The polygon may be non-convex or self-intersecting (non-zero
+			 * winding rule). The edges are not drawn.
+			 *
+			 * @param	tabPoints  	std vector of polygon vertice in clockwise or counterclockwise order.
+			 * @param	fillcolor  	The color to use.
+			 * @param	aa		   	(Optional) true to use antialiasing.
+			 * @param	blend	   	(Optional) true to use blending.
+			 **/
+			MTOOLS_FORCEINLINE void fill_polygon(const std::vector<fVec2> & tabPoints, RGBc fillcolor, bool aa = DEFAULT_AA, bool blend = DEFAULT_BLEND)
+				{
+				fill_polygon(tabPoints.size(), tabPoints.data(), fillcolor, aa, blend);
+				}
+
+
 			/**
 			* Draw an (integer-valued) circle
 			*
@@ -2847,6 +3020,36 @@ namespace mtools
 				}
 
 
+			/**
+			 * Draw a batch of (real-valued) filled discs, in the order given.
+			 *
+			 * Same result as calling draw_filled_circle(centers[i], radii[i], colors[i], colors[i], aa, blend)
+			 * for i = 0,...,n-1 but much faster for a large number of circles: the discs are binned by
+			 * bands of lines and the bands are filled in parallel (see setRescaleThreads()), one span per
+			 * disc and per line.
+			 *
+			 * @param	centers	array with the centers of the discs.
+			 * @param	radii  	array with the radii of the discs.
+			 * @param	colors 	array with the colors of the discs.
+			 * @param	n	   	number of discs.
+			 * @param	aa	   	(Optional) true to use antialiasing.
+			 * @param	blend  	(Optional) true to use blending.
+			 **/
+			void draw_circles(const fVec2 * centers, const double * radii, const RGBc * colors, size_t n, bool aa = DEFAULT_AA, bool blend = DEFAULT_BLEND)
+				{
+				_draw_circles(n, [=](size_t i) { return _CircleItem{ centers[i].X(), centers[i].Y(), radii[i], colors[i] }; }, aa, blend);
+				}
+
+
+			/**
+			 * Draw a batch of (real-valued) filled discs with the same color. See draw_circles() above.
+			 **/
+			void draw_circles(const fVec2 * centers, const double * radii, RGBc color, size_t n, bool aa = DEFAULT_AA, bool blend = DEFAULT_BLEND)
+				{
+				_draw_circles(n, [=](size_t i) { return _CircleItem{ centers[i].X(), centers[i].Y(), radii[i], color }; }, aa, blend);
+				}
+
+
 			/**
 			* Draw a thick (real-valued) circle
 			*
@@ -3275,6 +3478,120 @@ namespace mtools
 			}
 
 
+			/**
+			 * Flood fill: fill the connected region of pixels containing P whose color is close to the
+			 * color of P.
+			 *
+			 * A pixel belongs to the region if each of its four (premultiplied) channels differs from
+			 * the corresponding channel of the color of P by at most tolerance. The region is filled span
+			 * by span (scanline algorithm) so each pixel is visited a bounded number of times.
+			 *
+			 * When multithread is set and the image is large, the image is split into horizontal bands
+			 * which are labelled in parallel (runs of matching pixels joined with a union-find) and the
+			 * labels are merged across the band borders before the region is filled. This visits every
+			 * pixel of the image once, so it pays off only when the region is a large part of an image
+			 * with millions of pixels.
+			 *
+			 * @param	P		   	the starting point (nothing is done if it is outside of the image).
+			 * @param	fillcolor  	the color to use.
+			 * @param	tolerance  	maximum difference per channel (0 = exact color match).
+			 * @param	blend	   	true to blend fillcolor over the region and false to copy it.
+			 * @param	connect8   	true to use 8-connectivity (diagonal neighbours) and false for
+			 * 						4-connectivity.
+			 * @param	multithread	true to use the parallel algorithm on large images (with
+			 * 						rescaleThreads() threads).
+			 *
+			 * @return	the number of pixels filled.
+			 **/
+			int64 floodFill(iVec2 P, RGBc fillcolor, int32 tolerance = 0, bool blend = false, bool connect8 = false, bool multithread = true);
+
+
+			/**
+			 * Flood fill: fill the connected region of pixels containing (x,y) whose color is close to
+			 * the color of (x,y). See floodFill(iVec2, RGBc, int32, bool, bool, bool).
+			 **/
+			MTOOLS_FORCEINLINE int64 floodFill(int64 x, int64 y, RGBc fillcolor, int32 tolerance = 0, bool blend = false, bool connect8 = false, bool multithread = true)
+				{
+				return floodFill({ x, y }, fillcolor, tolerance, blend, connect8, multithread);
+				}
+
+
+
+			/******************************************************************************************************************************************************
+			*******************************************************************************************************************************************************
+			*																				   																      *
+			*                                                                      FILTERS                                                                        *
+			*																																					  *
+			*******************************************************************************************************************************************************
+			*******************************************************************************************************************************************************/
+
+
+			/**
+			 * Convolve the image with a separable kernel: each pixel is replaced by sum_{i,j}
+			 * kernelx[i] * kernely[j] * P(x + i - rx, y + j - ry) where rx and ry are the half sizes of
+			 * the kernels. The pixels outside the image are replaced by the nearest pixel of the border.
+			 *
+			 * The four channels are computed together (in a SIMD register when available), with a single
+			 * rounding at the end. The image is split into tiles processed in parallel (with
+			 * rescaleThreads() threads). The cost is proportional to (kernelx.size() + kernely.size())
+			 * per pixel.
+			 *
+			 * @param	kernelx	the horizontal kernel (its size should be odd so that it is centered).
+			 * @param	kernely	the vertical kernel (its size should be odd so that it is centered).
+			 **/
+			void convolve(const std::vector<float> & kernelx, const std::vector<float> & kernely);
+
+
+			/**
+			 * Box blur: each pixel is replaced by the average of the pixels in the (2rx+1)x(2ry+1) box
+			 * centered on it (the pixels outside the image are replaced by the nearest pixel of the
+			 * border). The averages are computed with running sums so the cost per pixel does not depend
+			 * on the radius. The rows, then the columns, are processed in parallel (with rescaleThreads()
+			 * threads).
+			 *
+			 * @param	rx	  	horizontal radius (0 for no horizontal blur).
+			 * @param	ry	  	vertical radius (0 for no vertical blur).
+			 * @param	passes	number of times the blur is applied (3 passes are very close to a gaussian
+			 * 					blur).
+			 **/
+			void boxBlur(int64 rx, int64 ry, int passes = 1);
+
+
+			/**
+			 * Gaussian blur with standard deviations sigmax and sigmay.
+			 *
+			 * - GAUSSIAN_CONVOLUTION : exact (convolution with a kernel truncated at 3 sigma), cost
+			 *                          proportional to sigma.
+			 * - GAUSSIAN_BOX         : three box blurs with radii chosen to match the variance, cost
+			 *                          independent of sigma.
+			 * - GAUSSIAN_IIR         : recursive filter of Young and van Vliet (forward and backward in
+			 *                          each direction), cost independent of sigma. Best for large sigma
+			 *                          (sigma >= 1).
+			 *
+			 * @param	sigmax	standard deviation in the x direction (0 for no horizontal blur).
+			 * @param	sigmay	standard deviation in the y direction (0 for no vertical blur).
+			 * @param	method	one of GAUSSIAN_CONVOLUTION, GAUSSIAN_BOX, GAUSSIAN_IIR.
+			 **/
+			void gaussianBlur(double sigmax, double sigmay, int method = GAUSSIAN_BOX);
+
+
+			/**
+			 * Gaussian blur with standard deviation sigma in both directions. See gaussianBlur(double,
+			 * double, int).
+			 **/
+			MTOOLS_FORCEINLINE void gaussianBlur(double sigma, int method = GAUSSIAN_BOX)
+				{
+				gaussianBlur(sigma, sigma, method);
+				}
+
+
+			/**
+			 * Return a normalized gaussian kernel with standard deviation sigma, truncated at nbsigma
+			 * standard deviations (size 2*ceil(nbsigma*sigma) + 1). To use with convolve().
+			 **/
+			static std::vector<float> gaussianKernel(double sigma, double nbsigma = 3.0);
+
+
 
 			/******************************************************************************************************************************************************
 			*******************************************************************************************************************************************************
@@ -3663,6 +3980,33 @@ namespace mtools
 				}
 
 
+			/**
+			 * Set the maximum amount of memory kept by the pool of image buffers.
+			 *
+			 * Pixel buffers of at least 64KB are recycled: when an image releases its buffer, the buffer
+			 * is kept in a pool (sorted in size classes spaced by a factor 5/4) and reused by the next
+			 * image of a similar size instead of being returned to the system. Thus, the temporary images
+			 * created at each redraw (rescaling, cropping...) do not allocate memory nor page fault
+			 * once the steady state is reached. The pool is shared by all threads.
+			 *
+			 * @param	maxbytes	maximum total size of the buffers kept in the pool (0 to disable the
+			 * 						pool and release all the cached buffers). Default 256MB.
+			 **/
+			static void setBufferPoolSize(size_t maxbytes);
+
+
+			/**
+			 * Return the maximum amount of memory kept by the pool of image buffers.
+			 **/
+			static size_t bufferPoolSize();
+
+
+			/**
+			 * Return the total size of the buffers currently kept in the pool (i.e. not used by any image).
+			 **/
+			static size_t bufferPoolCached();
+
+
 			/**
 			* Make the image standalone by recreating the pixel buffer if need be. After this method, no
 			* other image share the same pixel buffer with this one.
@@ -3749,8 +4093,8 @@ namespace mtools
 
 
 			/**
-			 * Saves the image into a file. uses CImg's save method (hence support all formats supported by
-			 * CImg).
+			 * Saves the image into a file. PNG files are written with save_png(). Other formats use CImg's
+			 * save method (hence support all formats supported by CImg).
 			 *
 			 * @param	filename name of the file.
 			 * @param	number   number to apped to the file name (if positive)
@@ -3758,6 +4102,18 @@ namespace mtools
 			 */
 			void save(const char * filename, const int number = -1, const unsigned int digits = 6) const
 				{
+				if (_isPNGFilename(filename))
+					{
+					std::string name(filename);
+					if (number >= 0)
+						{ // same naming scheme as CImg: "name_000012.png"
+						std::string num = mtools::toString(number);
+						if (num.size() < digits) num = std::string(digits - num.size(), '0') + num;
+						name = name.substr(0, name.size() - 4) + "_" + num + name.substr(name.size() - 4);
+						}
+					save_png(name.c_str());
+					return;
+					}
 				cimg_library::CImg<unsigned char> im;
 				toCImg(im);
 				im.save(filename, number, digits);
@@ -3765,19 +4121,50 @@ namespace mtools
 
 
 			/**
-			 * Load the image from a file. Uses CImg's load method (hence support all formats supported by
-			 * CImg).
+			 * Load the image from a file. PNG files are read with load_png() (with CImg as fallback).
+			 * Other formats use CImg's load method (hence support all formats supported by CImg).
 			 *
 			 * @param	filename name of the file.
 			 */
 			void load(const char * filename)
 				{
+				if ((_isPNGFilename(filename)) && (load_png(filename))) return;
 				cimg_library::CImg<unsigned char> im;
 				im.load(filename);
 				fromCImg(im);
 				}
 
 
+			/**
+			 * Saves the image in PNG format.
+			 *
+			 * The image is split into horizontal strips of a few MB which are filtered and deflated
+			 * independently, in parallel, and written as consecutive IDAT chunks of a single standard
+			 * zlib stream. The pixels are read directly from the image buffer. The alpha channel is
+			 * omitted if the image is fully opaque.
+			 *
+			 * @param	filename   	name of the file.
+			 * @param	compression	zlib compression level between 0 (no compression, fastest) and 9.
+			 * @param	multithread	true to compress the strips in parallel (with rescaleThreads() threads).
+			 *
+			 * @return	true if the operation succeeded and false if it failed.
+			 **/
+			bool save_png(const char * filename, int compression = 6, bool multithread = true) const;
+
+
+			/**
+			 * Load the image from a PNG file with libpng. The rows are decoded directly into the image
+			 * buffer (as BGRA) and premultiplied in place. Any PNG format is accepted (palette, gray,
+			 * 16 bits...).
+			 *
+			 * @param	filename	name of the file.
+			 *
+			 * @return	true if the operation succeeded and false if it failed (and in this case, the
+			 * 			image is left unchanged).
+			 **/
+			bool load_png(const char * filename);
+
+
 			/**
 			* Serializes the image into an OBaseArchive.
 			**/
@@ -3908,6 +4295,7 @@ namespace mtools
 			inline void empty()
 				{
 				_removecairo();
+				clearMipmaps();
 				_deallocate();
 				_lx = 0;
 				_ly = 0;
@@ -4040,28 +4428,16 @@ namespace mtools
 			/**
 			* Find the (closed) minimal bounding rectangle enclosing the image.
 			*
+			* The lines are scanned with the vectorized kernels of blendkernels.hpp and only the parts of
+			* the lines outside of the current box are visited.
+			*
 			* @param	bk_color	The 'background' color which is not part of the image.
 			*
 			* @return	the minimal bounding box.
 			**/
-			inline iBox2 minBoundingBox(RGBc bk_color)
+			inline iBox2 minBoundingBox(RGBc bk_color) const
 				{
-				int64 minx = _lx + 1, maxx = -1;
-				int64 miny = _ly + 1, maxy = -1;
-				for (int64 j = 0; j < _ly; j++)
-					{
-					for (int64 i = 0; i < _lx; i++)
-						{
-						if (operator()(i, j) != bk_color)
-							{
-							if (i < minx) minx = i;
-							if (i > maxx) maxx = i;
-							if (j < miny) miny = j;
-							if (j > maxy) maxy = j;
-							}
-						}
-					}
-				return iBox2(minx, maxx, miny, maxy);
+				return _minBoundingBox(bk_color.color, 0xFFFFFFFF);
 				}
 
 
@@ -4071,24 +4447,41 @@ namespace mtools
 			*
 			* @return	the minimal bounding box.
 			**/
-			inline iBox2 minBoundingBox()
+			inline iBox2 minBoundingBox() const
 				{
-				int64 minx = _lx + 1, maxx = -1;
-				int64 miny = _ly + 1, maxy = -1;
-				for (int64 j = 0; j < _ly; j++)
-					{
-					for (int64 i = 0; i < _lx; i++)
-						{
-						if (!(operator()(i, j).isTransparent()))
-							{
-							if (i < minx) minx = i;
-							if (i > maxx) maxx = i;
-							if (j < miny) miny = j;
-							if (j > maxy) maxy = j;
-							}
-						}
-					}
-				return iBox2(minx, maxx, miny, maxy);
+				return _minBoundingBox(0, 0xFF000000);
+				}
+
+
+			/**
+			* Query if all the pixels of the image are opaque (alpha channel equal to 255). The scan stops at
+			* the first pixel which is not. Return true for an empty image.
+			**/
+			inline bool isOpaque() const
+				{
+				return _allEqual(0xFF000000, 0xFF000000);
+				}
+
+
+			/**
+			* Query if all the pixels of the image are fully transparent (alpha channel equal to 0). The scan
+			* stops at the first pixel which is not. Return true for an empty image.
+			**/
+			inline bool isTransparent() const
+				{
+				return _allEqual(0, 0xFF000000);
+				}
+
+
+			/**
+			* Query if all the pixels of the image have the same given color. The scan stops at the first
+			* pixel which does not. Return true for an empty image.
+			*
+			* @param	color	The color.
+			**/
+			inline bool isUniform(RGBc color) const
+				{
+				return _allEqual(color.color, 0xFFFFFFFF);
 				}
 
 
@@ -4109,6 +4502,7 @@ namespace mtools
 					mtools::swap<uint32*>(_deletepointer, im._deletepointer);
 					mtools::swap<void*>(_pcairo_surface, im._pcairo_surface);
 					mtools::swap<void*>(_pcairo_context, im._pcairo_context);
+					mtools::swap<std::vector<Image>*>(_pmipmaps, im._pmipmaps);
 					}
 				}
 
@@ -4616,6 +5010,62 @@ namespace mtools
 				}
 
 
+			/**
+			* Draw an open polyline.
+			*
+			* Use absolute coordinate (canvas method). Consecutive points that fall on the same pixel
+			* are merged.
+			*
+			* @param	R					the absolute range represented in the image.
+			* @param	nbpoints			Number of points.
+			* @param	tabPoints			the list of points.
+			* @param	color				The color tu use.
+			* @param	draw_last_point		true to draw the last point.
+			* @param	blending			true to use blending.
+			* @param	antialiased			true to draw antialiased lines.
+			* @param	penwidth			The pen width (0 = unit width)
+			**/
+			void canvas_draw_polyline(const mtools::fBox2 & R, size_t nbpoints, const fVec2 * tabPoints, RGBc color, bool draw_last_point, bool blending, bool antialiased, int32 penwidth = 0)
+				{
+				if ((isEmpty()) || (nbpoints == 0)) return;
+				const auto dim = dimension();
+				std::vector<iVec2> tab;
+				tab.reserve(nbpoints);
+				tab.push_back(R.absToPixel(tabPoints[0], dim));
+				for (size_t i = 1; i < nbpoints; i++)
+					{
+					const iVec2 P = R.absToPixel(tabPoints[i], dim);
+					if (P != tab.back()) tab.push_back(P);
+					}
+				draw_polyline(tab, color, draw_last_point, blending, antialiased, penwidth);
+				}
+
+
+			/**
+			* Draw a Bezier curve by rasterizing its flattening with the line drawing methods. The
+			* flattening (within 1/4 pixel of the curve) is kept in the cache and reused as long as
+			* the zoom level stays in the same bucket (see BezierFlattening). This is the method to
+			* use for curves redrawn many times.
+			*
+			* Use absolute coordinate (canvas method).
+			*
+			* @param	R				the absolute range represented in the image.
+			* @param	curve			The curve.
+			* @param	cache			The flattening cache associated with the curve.
+			* @param	color			The color to use.
+			* @param	blending		true to use blending.
+			* @param	antialiased		true to use antialiasing.
+			* @param	penwidth		The pen width (0 = unit width)
+			**/
+			void canvas_draw_bezier(const mtools::fBox2 & R, const Bezier & curve, BezierFlattening & cache, RGBc color, bool blending, bool antialiased, int32 penwidth = 0)
+				{
+				if ((isEmpty()) || (R.isEmpty())) return;
+				const double pix = std::min<double>(R.lx() / _lx, R.ly() / _ly); // size of a pixel in absolute units
+				const std::vector<fVec2> & tab = cache.get(curve, 0.25*pix);
+				canvas_draw_polyline(R, tab.size(), tab.data(), color, true, blending, antialiased, penwidth);
+				}
+
+
 			/**
 			* Fill the interior of a convex polygon. The edge are not drawn.
 			*
@@ -4638,6 +5088,28 @@ namespace mtools
 				}
 
 
+			/**
+			* Fill a polygon (possibly non-convex or self-intersecting). The edge are not drawn.
+			*
+			* Use absolute coordinate (canvas method).
+			*
+			* @param	R				the absolute range represented in the image.
+			* @param	tabPoints  	std vector of polygon vertice in clockwise or counterclockwise order.
+			* @param	fillcolor  	The color to use.
+			* @param	aa		   	(Optional) true to use antialiasing.
+			* @param	blend	   	(Optional) true to use blending.
+			**/
+			MTOOLS_FORCEINLINE void canvas_fill_polygon(const mtools::fBox2 & R, const std::vector<fVec2> & tabPoints, RGBc fillcolor, bool aa = DEFAULT_AA, bool blend = DEFAULT_BLEND)
+				{
+				if (isEmpty()) return;
+				const fBox2 imBox(-0.5, lx() - 0.5, -0.5, ly() - 0.5);
+				const size_t N = tabPoints.size();
+				std::vector<fVec2> tab(N);
+				if (N > 0) boxTransform(tabPoints.data(), N, R, imBox, tab.data());
+				fill_polygon(tab, fillcolor, aa, blend);
+				}
+
+
 			/**
 			* Draw a circle.
 			*
@@ -4683,6 +5155,35 @@ namespace mtools
 			}
 
 
+			/**
+			 * Draw a batch of filled discs, in the order given. See draw_circles().
+			 *
+			 * If the range R does not have the same aspect ratio as the image, the discs become ellipses
+			 * and are drawn one by one with canvas_draw_filled_circle().
+			 *
+			 * @param	R	   	the absolute range represented in the image.
+			 * @param	centers	array with the centers of the discs.
+			 * @param	radii  	array with the radii of the discs.
+			 * @param	colors 	array with the colors of the discs.
+			 * @param	n	   	number of discs.
+			 * @param	aa	   	(Optional) true to use antialiasing.
+			 * @param	blend  	(Optional) true to use blending.
+			 **/
+			void canvas_draw_circles(const fBox2 & R, const fVec2 * centers, const double * radii, const RGBc * colors, size_t n, bool aa = DEFAULT_AA, bool blend = DEFAULT_BLEND)
+				{
+				_canvas_draw_circles(R, n, centers, radii, [=](size_t i) { return colors[i]; }, aa, blend);
+				}
+
+
+			/**
+			 * Draw a batch of filled discs with the same color. See canvas_draw_circles() above.
+			 **/
+			void canvas_draw_circles(const fBox2 & R, const fVec2 * centers, const double * radii, RGBc color, size_t n, bool aa = DEFAULT_AA, bool blend = DEFAULT_BLEND)
+				{
+				_canvas_draw_circles(R, n, centers, radii, [=](size_t) { return color; }, aa, blend);
+				}
+
+
 			/**
 			* Draw a thick circle.
 			*
@@ -5100,21 +5601,117 @@ namespace mtools
 			*******************************************************************************************************************************************************/
 
 
-			/* apply nearest neighour scaling. fast ! 
-			   work for downscaling and upscaling both. */
-			static void _nearest_neighbour_scaling(RGBc * dest, int64 dest_stride, int64 dest_lx, int64 dest_ly, RGBc * src, int64 src_stride, int64 src_lx, int64 src_ly)
+			/* true if the file name has the extension .png (any case) */
+			static bool _isPNGFilename(const char * filename)
+				{
+				const size_t l = strlen(filename);
+				if (l < 4) return false;
+				return ((filename[l - 4] == '.') && (tolower(filename[l - 3]) == 'p') && (tolower(filename[l - 2]) == 'n') && (tolower(filename[l - 1]) == 'g'));
+				}
+
+
+			/* true if (p.color & mask) == (value & mask) for all the pixels p of the image */
+			bool _allEqual(uint32 value, uint32 mask) const
+				{
+				for (int64 j = 0; j < _ly; j++)
+					{
+					if (internals_graphics::findFirstNotEqual(_data + j*_stride, (size_t)_lx, value, mask) != (size_t)_lx) return false;
+					}
+				return true;
+				}
+
+
+			/* minimal bounding box of the pixels p such that (p.color & mask) != (value & mask) */
+			iBox2 _minBoundingBox(uint32 value, uint32 mask) const
+				{
+				const size_t lx = (size_t)_lx;
+				int64 miny = 0;
+				while ((miny < _ly) && (internals_graphics::findFirstNotEqual(_data + miny*_stride, lx, value, mask) == lx)) { miny++; }
+				if (miny == _ly) return iBox2(_lx + 1, -1, _ly + 1, -1); // nothing found
+				int64 maxy = _ly - 1;
+				while (internals_graphics::findFirstNotEqual(_data + maxy*_stride, lx, value, mask) == lx) { maxy--; } // stops at miny
+				int64 minx = _lx, maxx = -1;
+				for (int64 j = miny; j <= maxy; j++)
+					{ // only scan the parts of the line outside of [minx, maxx]
+					const RGBc * p = _data + j*_stride;
+					if (minx > 0)
+						{
+						const size_t a = internals_graphics::findFirstNotEqual(p, (size_t)minx, value, mask);
+						if (a < (size_t)minx) minx = (int64)a;
+						}
+					if (maxx < _lx - 1)
+						{
+						const size_t l = (size_t)(_lx - 1 - maxx);
+						const size_t b = internals_graphics::findLastNotEqual(p + maxx + 1, l, value, mask);
+						if (b < l) maxx += 1 + (int64)b;
+						}
+					}
+				return iBox2(minx, maxx, miny, maxy);
+				}
+
+
+			/* reference to the number of threads used for rescaling (0 = number of hardware threads) */
+			static std::atomic<int> & _rescaleThreadsRef()
+				{
+				static std::atomic<int> nb(0);
+				return nb;
+				}
+
+
+			/* Split the lines [0, nblines[ into bands and call fun(jmin, jmax) for each band [jmin, jmax[. 
+			   The bands are processed in parallel if the amount of work (number of pixels visited) is large enough. */
+			template<typename FUN> static void _parallelLines(int64 nblines, int64 work, FUN fun)
+				{
+				const int64 MIN_WORK_PER_THREAD = 65536;
+				int64 nbth = std::min<int64>(std::min<int64>(rescaleThreads(), nblines), work / MIN_WORK_PER_THREAD);
+				if (nbth <= 1) { fun(0, nblines); return; }
+				std::vector<std::thread> threads;
+				threads.reserve((size_t)(nbth - 1));
+				for (int64 k = 1; k < nbth; k++) { threads.emplace_back(fun, (nblines*k) / nbth, (nblines*(k + 1)) / nbth); }
+				fun(0, nblines / nbth);
+				for (auto & th : threads) { th.join(); }
+				}
+
+
+			/* multithreaded version of _nearest_neighbour_scaling() */
+			static void _nearest_neighbour_scaling_mt(RGBc * dest, int64 dest_stride, int64 dest_lx, int64 dest_ly, RGBc * src, int64 src_stride, int64 src_lx, int64 src_ly)
+				{
+				_parallelLines(dest_ly, dest_lx*dest_ly, [=](int64 jmin, int64 jmax) { _nearest_neighbour_scaling(dest, dest_stride, dest_lx, dest_ly, src, src_stride, src_lx, src_ly, jmin, jmax); });
+				}
+
+
+			/* multithreaded version of _linear_upscaling() */
+			static void _linear_upscaling_mt(RGBc * dest_data, uint64 dest_stride, uint64 dest_sx, uint64 dest_sy, RGBc * src_data, uint64 src_stride, uint64 src_sx, uint64 src_sy)
+				{
+				_parallelLines((int64)dest_sy, (int64)(dest_sx*dest_sy), [=](int64 jmin, int64 jmax) { _linear_upscaling(dest_data, dest_stride, dest_sx, dest_sy, src_data, src_stride, src_sx, src_sy, (uint64)jmin, (uint64)jmax); });
+				}
+
+
+			/* multithreaded version of _boxaverage_downscaling() */
+			static void _boxaverage_downscaling_mt(RGBc * dest_data, uint64 dest_stride, uint64 dest_sx, uint64 dest_sy, RGBc * src_data, uint64 src_stride, uint64 src_lx, uint64 src_ly, uint64 src_stepx = 1, uint64 src_stepy = 1)
 				{
+				const int64 work = (int64)((src_lx / src_stepx)*(src_ly / src_stepy) + dest_sx*dest_sy);
+				_parallelLines((int64)dest_sy, work, [=](int64 jmin, int64 jmax) { _boxaverage_downscaling(dest_data, dest_stride, dest_sx, dest_sy, src_data, src_stride, src_lx, src_ly, src_stepx, src_stepy, (uint64)jmin, (uint64)jmax); });
+				}
 
-				if ((src_lx == dest_lx) && (src_ly == dest_ly)) { _blitRegion(dest, dest_stride, src, src_stride, src_lx, src_ly); return; }
+
+			/* apply nearest neighour scaling. fast ! 
+			   work for downscaling and upscaling both. 
+			   Only the lines [jmin, jmax[ of the destination are computed (jmax < 0 for all the lines). */
+			static void _nearest_neighbour_scaling(RGBc * dest, int64 dest_stride, int64 dest_lx, int64 dest_ly, RGBc * src, int64 src_stride, int64 src_lx, int64 src_ly, int64 jmin = 0, int64 jmax = -1)
+				{
+				if ((jmax < 0) || (jmax > dest_ly)) { jmax = dest_ly; }
+				if (jmin >= jmax) return;
+				if ((src_lx == dest_lx) && (src_ly == dest_ly)) { _blitRegion(dest + jmin*dest_stride, dest_stride, src + jmin*src_stride, src_stride, src_lx, jmax - jmin); return; }
 				MTOOLS_ASSERT((src_lx < 1000000) && (src_ly < 1000000)); // must be smaller than 2^20 to use fp arithmetic with FP_PRECISION = 43
 				const int64 FP_PRECISION = 43;
 				const double fbx = ((double)src_lx) / ((double)dest_lx);
 				const int64  ibx = (int64)(fbx * (((int64)1) << FP_PRECISION));
 				const double fby = ((double)src_ly) / ((double)dest_ly);
 				const int64  iby = (int64)(fby * (((int64)1) << FP_PRECISION));
-				int64 iay = (iby / 2);
-				int64 offdest = 0;
-				const int64 endj = dest_stride*dest_ly;
+				int64 iay = (iby / 2) + jmin*iby;
+				int64 offdest = jmin*dest_stride;
+				const int64 endj = dest_stride*jmax;
 				while (offdest < endj)
 					{
 					const int64 offsrc = src_stride*(iay >> FP_PRECISION);
@@ -5132,9 +5729,11 @@ namespace mtools
 
 
 
-			/* upscale image via linear interpolation. Work only for upscaling.  */ 
-			static void _linear_upscaling(RGBc * dest_data, uint64 dest_stride, uint64 dest_sx, uint64 dest_sy, RGBc * src_data, uint64 src_stride, uint64 src_sx, uint64 src_sy)
+			/* upscale image via linear interpolation. Work only for upscaling.  
+			   Only the lines [jmin, jmax[ of the destination are computed. */ 
+			static void _linear_upscaling(RGBc * dest_data, uint64 dest_stride, uint64 dest_sx, uint64 dest_sy, RGBc * src_data, uint64 src_stride, uint64 src_sx, uint64 src_sy, uint64 jmin = 0, uint64 jmax = (uint64)(-1))
 				{
+				if (jmax > dest_sy) { jmax = dest_sy; }
 				MTOOLS_ASSERT((src_sx < 1000000) && (src_sy < 1000000)); // must be smaller than 2^20
 				MTOOLS_ASSERT(dest_sx >= src_sx);
 				MTOOLS_ASSERT(dest_sy >= src_sy);
@@ -5148,8 +5747,14 @@ namespace mtools
 				const uint64 step_y = ((src_sy - 1)*unit) / (dest_sy - 1);
 				uint64 offy = 0;
 				uint64 js = 0;
-				for (uint64 jd = 0; jd < dest_sy; jd++)
+				for (uint64 jd = 0; jd < jmax; jd++)
 					{
+					if (jd < jmin)
+						{ // line not in range, just update the vertical position
+						offy += step_y;
+						if (offy > unit) { offy -= unit; js++; }
+						continue;
+						}
 					MTOOLS_ASSERT(js < src_sy - 1);
 					const uint64 c_offy = unit - offy;
 					uint64 offx = 0;
@@ -5191,8 +5796,9 @@ namespace mtools
 
 
 			/* Call the correct template version of _boxaverage_downscaling2() depending on the input parameters.
-			   this method choose the stepping nto the src image and the value of the BIT_FP template parameter. */
-			static void _boxaverage_downscaling(RGBc * dest_data, uint64 dest_stride, uint64 dest_sx, uint64 dest_sy, RGBc * src_data, uint64 src_stride, uint64 src_lx, uint64 src_ly, uint64 src_stepx = 1, uint64 src_stepy = 1)
+			   this method choose the stepping nto the src image and the value of the BIT_FP template parameter. 
+			   Only the lines [jmin, jmax[ of the destination are computed. */
+			static void _boxaverage_downscaling(RGBc * dest_data, uint64 dest_stride, uint64 dest_sx, uint64 dest_sy, RGBc * src_data, uint64 src_stride, uint64 src_lx, uint64 src_ly, uint64 src_stepx = 1, uint64 src_stepy = 1, uint64 jmin = 0, uint64 jmax = (uint64)(-1))
 				{
 				const uint64 src_sx = src_lx / src_stepx;	// for the _boxaverage method, it is the same as a destination
 				const uint64 src_sy = src_ly / src_stepy;	// image of size (src_lx/src_stepx , src_ly/src_stepy)
@@ -5202,16 +5808,16 @@ namespace mtools
 				if ((src_stepx == 1) && (src_stepy == 1))
 					{ //perfect downscaling
 					uint64 a = 16;
-					if (v <= a) { _boxaverage_downscaling2<10>(dest_data, dest_stride, dest_sx, dest_sy, src_data, src_stride, src_sx, src_sy); return; } a *= 4;  // at most 16 pixels per dest pixel
-					if (v <= a) { _boxaverage_downscaling2<9>(dest_data, dest_stride, dest_sx, dest_sy, src_data, src_stride, src_sx, src_sy); return; } a *= 4;   // at most 64 pixels per dest pixel
-					if (v <= a) { _boxaverage_downscaling2<8>(dest_data, dest_stride, dest_sx, dest_sy, src_data, src_stride, src_sx, src_sy); return; } a *= 4;   // at most 256 pixels per dest pixel
-					if (v <= a) { _boxaverage_downscaling2<7>(dest_data, dest_stride, dest_sx, dest_sy, src_data, src_stride, src_sx, src_sy); return; } a *= 4;   // at most 1024 pixels per dest pixel
-					if (v <= a) { _boxaverage_downscaling2<6>(dest_data, dest_stride, dest_sx, dest_sy, src_data, src_stride, src_sx, src_sy); return; } a *= 4;   // at most 4096 pixels per dest pixel 
-					if (v <= a) { _boxaverage_downscaling2<5>(dest_data, dest_stride, dest_sx, dest_sy, src_data, src_stride, src_sx, src_sy); return; } a *= 4;   // at most 16384 pixels per dest pixel
+					if (v <= a) { _boxaverage_downscaling2<10>(dest_data, dest_stride, dest_sx, dest_sy, src_data, src_stride, src_sx, src_sy, jmin, jmax); return; } a *= 4;  // at most 16 pixels per dest pixel
+					if (v <= a) { _boxaverage_downscaling2<9>(dest_data, dest_stride, dest_sx, dest_sy, src_data, src_stride, src_sx, src_sy, jmin, jmax); return; } a *= 4;   // at most 64 pixels per dest pixel
+					if (v <= a) { _boxaverage_downscaling2<8>(dest_data, dest_stride, dest_sx, dest_sy, src_data, src_stride, src_sx, src_sy, jmin, jmax); return; } a *= 4;   // at most 256 pixels per dest pixel
+					if (v <= a) { _boxaverage_downscaling2<7>(dest_data, dest_stride, dest_sx, dest_sy, src_data, src_stride, src_sx, src_sy, jmin, jmax); return; } a *= 4;   // at most 1024 pixels per dest pixel
+					if (v <= a) { _boxaverage_downscaling2<6>(dest_data, dest_stride, dest_sx, dest_sy, src_data, src_stride, src_sx, src_sy, jmin, jmax); return; } a *= 4;   // at most 4096 pixels per dest pixel 
+					if (v <= a) { _boxaverage_downscaling2<5>(dest_data, dest_stride, dest_sx, dest_sy, src_data, src_stride, src_sx, src_sy, jmin, jmax); return; } a *= 4;   // at most 16384 pixels per dest pixel
 					// scale factor too large. use stochastic anyway. 					
 					uint64 stepx = (bx/128) + 1;
 					uint64 stepy = (by/128) + 1;
-					_boxaverage_downscaling(dest_data, dest_stride, dest_sx, dest_sy, src_data, src_stride, src_lx, src_ly, stepx, stepy);
+					_boxaverage_downscaling(dest_data, dest_stride, dest_sx, dest_sy, src_data, src_stride, src_lx, src_ly, stepx, stepy, jmin, jmax);
 					return; 
 					}
 				else
@@ -5222,42 +5828,42 @@ namespace mtools
 					FastLaw lawy((uint32)src_stepy);
 					if (v <= a)
 						{ // at most 16 pixels per dest pixel
-						_boxaverage_downscaling2<10, true>( dest_data, dest_stride, dest_sx, dest_sy, src_data, src_stride, src_sx, src_sy,
+						_boxaverage_downscaling2<10, true>( dest_data, dest_stride, dest_sx, dest_sy, src_data, src_stride, src_sx, src_sy, jmin, jmax,
 					        [&](uint64 x, uint64 y) -> RGBc { uint32 g = gen(); return src_data[(y*src_stepy + lawy(g))*src_stride + x*src_stepx + lawx(g >> 16)].color; },
 					        [&](uint64 x, uint64 y, RGBc c) { dest_data[y*dest_stride + x] = c;  });
 						return;
 						} a *= 4;
 					if (v <= a)
 						{ // at most 64 pixels per dest pixel
-						_boxaverage_downscaling2<9, true>(dest_data, dest_stride, dest_sx, dest_sy, src_data, src_stride, src_sx, src_sy,
+						_boxaverage_downscaling2<9, true>(dest_data, dest_stride, dest_sx, dest_sy, src_data, src_stride, src_sx, src_sy, jmin, jmax,
 							[&](uint64 x, uint64 y) -> RGBc { uint32 g = gen(); return src_data[(y*src_stepy + lawy(g))*src_stride + x*src_stepx + lawx(g >> 16)].color; },
 							[&](uint64 x, uint64 y, RGBc c) { dest_data[y*dest_stride + x] = c;  });
 						return;
 						} a *= 4;
 					if (v <= a)
 						{ // at most 256 pixels per dest pixel
-						_boxaverage_downscaling2<8, true>(dest_data, dest_stride, dest_sx, dest_sy, src_data, src_stride, src_sx, src_sy,
+						_boxaverage_downscaling2<8, true>(dest_data, dest_stride, dest_sx, dest_sy, src_data, src_stride, src_sx, src_sy, jmin, jmax,
 							[&](uint64 x, uint64 y) -> RGBc { uint32 g = gen(); return src_data[(y*src_stepy + lawy(g))*src_stride + x*src_stepx + lawx(g >> 16)].color; },
 							[&](uint64 x, uint64 y, RGBc c) { dest_data[y*dest_stride + x] = c;  });
 						return;
 						} a *= 4;
 					if (v <= a)
 						{ // at most 1024 pixels per dest pixel
-						_boxaverage_downscaling2<7, true>(dest_data, dest_stride, dest_sx, dest_sy, src_data, src_stride, src_sx, src_sy,
+						_boxaverage_downscaling2<7, true>(dest_data, dest_stride, dest_sx, dest_sy, src_data, src_stride, src_sx, src_sy, jmin, jmax,
 							[&](uint64 x, uint64 y) -> RGBc { uint32 g = gen(); return src_data[(y*src_stepy + lawy(g))*src_stride + x*src_stepx + lawx(g >> 16)].color; },
 							[&](uint64 x, uint64 y, RGBc c) { dest_data[y*dest_stride + x] = c;  });
 						return;
 						} a *= 4;
 					if (v <= a)
 						{ // at most 4096 pixels per dest pixel
-						_boxaverage_downscaling2<6, true>(dest_data, dest_stride, dest_sx, dest_sy, src_data, src_stride, src_sx, src_sy,
+						_boxaverage_downscaling2<6, true>(dest_data, dest_stride, dest_sx, dest_sy, src_data, src_stride, src_sx, src_sy, jmin, jmax,
 							[&](uint64 x, uint64 y) -> RGBc { uint32 g = gen(); return src_data[(y*src_stepy + lawy(g))*src_stride + x*src_stepx + lawx(g >> 16)].color; },
 							[&](uint64 x, uint64 y, RGBc c) { dest_data[y*dest_stride + x] = c;  });
 						return;
 						} a *= 4;
 					if (v <= a)
 						{ // at most 16384 pixels per dest pixel
-						_boxaverage_downscaling2<5, true>(dest_data, dest_stride, dest_sx, dest_sy, src_data, src_stride, src_sx, src_sy,
+						_boxaverage_downscaling2<5, true>(dest_data, dest_stride, dest_sx, dest_sy, src_data, src_stride, src_sx, src_sy, jmin, jmax,
 							[&](uint64 x, uint64 y) -> RGBc { uint32 g = gen(); return src_data[(y*src_stepy + lawy(g))*src_stride + x*src_stepx + lawx(g >> 16)].color; },
 							[&](uint64 x, uint64 y, RGBc c) { dest_data[y*dest_stride + x] = c;  });
 						return;
@@ -5265,7 +5871,7 @@ namespace mtools
 					// downsampling ratio is still too big. increase the step even more.
 					uint64 spc_x = (bx/128) + 1; 
 					uint64 spc_y = (by/128) + 1;
-					_boxaverage_downscaling(dest_data, dest_stride, dest_sx, dest_sy, src_data, src_stride, src_lx, src_ly, src_stepx*spc_x, src_stepy*spc_y);
+					_boxaverage_downscaling(dest_data, dest_stride, dest_sx, dest_sy, src_data, src_stride, src_lx, src_ly, src_stepx*spc_x, src_stepy*spc_y, jmin, jmax);
 					return;
 					}
 				}
@@ -5277,7 +5883,7 @@ namespace mtools
 
 			/* call _boxaverage_downscaling_FP32 with the correct template parameters for BIT_FP and BIT_DIV */
 			template<uint64 BIT_FP_REDUCE, bool USE_FUNCION_CALL = false, typename READ_FUNCTOR = _dummy_read_functor, typename WRITE_FUNCTOR = _dummy_write_functor>
-			inline static void _boxaverage_downscaling2(RGBc * dest_data, uint64 dest_stride, uint64 dest_sx, uint64 dest_sy, RGBc * src_data, uint64 src_stride, uint64 src_sx, uint64 src_sy, READ_FUNCTOR funread = _dummy_read_functor(), WRITE_FUNCTOR funwrite = _dummy_write_functor())
+			inline static void _boxaverage_downscaling2(RGBc * dest_data, uint64 dest_stride, uint64 dest_sx, uint64 dest_sy, RGBc * src_data, uint64 src_stride, uint64 src_sx, uint64 src_sy, uint64 jmin, uint64 jmax, READ_FUNCTOR funread = _dummy_read_functor(), WRITE_FUNCTOR funwrite = _dummy_write_functor())
 				{
 				const uint64 bx = (src_sx / dest_sx); // lower bound on horizontal ratio 
 				const uint64 by = (src_sy / dest_sy); // lower bound on vertical ratio
@@ -5286,14 +5892,14 @@ namespace mtools
 				MTOOLS_ASSERT(bit_div >= 47);
 				switch (bit_div)
 					{
-					case 47: { _boxaverage_downscaling_FP32<40, BIT_FP_REDUCE, 48, USE_FUNCION_CALL>(dest_data, dest_stride, dest_sx, dest_sy, src_data, src_stride, src_sx, src_sy, funread, funwrite); return; }
-					case 48: { _boxaverage_downscaling_FP32<40, BIT_FP_REDUCE, 48, USE_FUNCION_CALL>(dest_data, dest_stride, dest_sx, dest_sy, src_data, src_stride, src_sx, src_sy, funread, funwrite); return; }
-					case 49: { _boxaverage_downscaling_FP32<40, BIT_FP_REDUCE, 49, USE_FUNCION_CALL>(dest_data, dest_stride, dest_sx, dest_sy, src_data, src_stride, src_sx, src_sy, funread, funwrite); return; }
-					case 50: { _boxaverage_downscaling_FP32<40, BIT_FP_REDUCE, 50, USE_FUNCION_CALL>(dest_data, dest_stride, dest_sx, dest_sy, src_data, src_stride, src_sx, src_sy, funread, funwrite); return; }
-					case 51: { _boxaverage_downscaling_FP32<40, BIT_FP_REDUCE, 51, USE_FUNCION_CALL>(dest_data, dest_stride, dest_sx, dest_sy, src_data, src_stride, src_sx, src_sy, funread, funwrite); return; }
-					case 52: { _boxaverage_downscaling_FP32<40, BIT_FP_REDUCE, 52, USE_FUNCION_CALL>(dest_data, dest_stride, dest_sx, dest_sy, src_data, src_stride, src_sx, src_sy, funread, funwrite); return; }
-					case 53: { _boxaverage_downscaling_FP32<40, BIT_FP_REDUCE, 53, USE_FUNCION_CALL>(dest_data, dest_stride, dest_sx, dest_sy, src_data, src_stride, src_sx, src_sy, funread, funwrite); return; }
-					default: { _boxaverage_downscaling_FP32<40, BIT_FP_REDUCE, 54, USE_FUNCION_CALL>(dest_data, dest_stride, dest_sx, dest_sy, src_data, src_stride, src_sx, src_sy, funread, funwrite); return; }
+					case 47: { _boxaverage_downscaling_FP32<40, BIT_FP_REDUCE, 48, USE_FUNCION_CALL>(dest_data, dest_stride, dest_sx, dest_sy, src_data, src_stride, src_sx, src_sy, jmin, jmax, funread, funwrite); return; }
+					case 48: { _boxaverage_downscaling_FP32<40, BIT_FP_REDUCE, 48, USE_FUNCION_CALL>(dest_data, dest_stride, dest_sx, dest_sy, src_data, src_stride, src_sx, src_sy, jmin, jmax, funread, funwrite); return; }
+					case 49: { _boxaverage_downscaling_FP32<40, BIT_FP_REDUCE, 49, USE_FUNCION_CALL>(dest_data, dest_stride, dest_sx, dest_sy, src_data, src_stride, src_sx, src_sy, jmin, jmax, funread, funwrite); return; }
+					case 50: { _boxaverage_downscaling_FP32<40, BIT_FP_REDUCE, 50, USE_FUNCION_CALL>(dest_data, dest_stride, dest_sx, dest_sy, src_data, src_stride, src_sx, src_sy, jmin, jmax, funread, funwrite); return; }
+					case 51: { _boxaverage_downscaling_FP32<40, BIT_FP_REDUCE, 51, USE_FUNCION_CALL>(dest_data, dest_stride, dest_sx, dest_sy, src_data, src_stride, src_sx, src_sy, jmin, jmax, funread, funwrite); return; }
+					case 52: { _boxaverage_downscaling_FP32<40, BIT_FP_REDUCE, 52, USE_FUNCION_CALL>(dest_data, dest_stride, dest_sx, dest_sy, src_data, src_stride, src_sx, src_sy, jmin, jmax, funread, funwrite); return; }
+					case 53: { _boxaverage_downscaling_FP32<40, BIT_FP_REDUCE, 53, USE_FUNCION_CALL>(dest_data, dest_stride, dest_sx, dest_sy, src_data, src_stride, src_sx, src_sy, jmin, jmax, funread, funwrite); return; }
+					default: { _boxaverage_downscaling_FP32<40, BIT_FP_REDUCE, 54, USE_FUNCION_CALL>(dest_data, dest_stride, dest_sx, dest_sy, src_data, src_stride, src_sx, src_sy, jmin, jmax, funread, funwrite); return; }
 					}
 				}
 
@@ -5312,8 +5918,10 @@ namespace mtools
 			   the parameters dest_data,dest_stride,src_data, src_stride are irrelevant...
 			*/
 			template<uint64 BIT_FP = 40, uint64 BIT_FP_REDUCE = 10, uint64 BIT_DIV = 50, bool USE_FUNCION_CALL = false, typename READ_FUNCTOR = _dummy_read_functor, typename WRITE_FUNCTOR = _dummy_write_functor> 
-			static void _boxaverage_downscaling_FP32(RGBc * dest_data, uint64 dest_stride, uint64 dest_sx, uint64 dest_sy, RGBc * src_data, uint64 src_stride, uint64 src_sx, uint64 src_sy, READ_FUNCTOR funread = _dummy_read_functor(), WRITE_FUNCTOR funwrite = _dummy_write_functor())
+			static void _boxaverage_downscaling_FP32(RGBc * dest_data, uint64 dest_stride, uint64 dest_sx, uint64 dest_sy, RGBc * src_data, uint64 src_stride, uint64 src_sx, uint64 src_sy, uint64 jmin, uint64 jmax, READ_FUNCTOR funread = _dummy_read_functor(), WRITE_FUNCTOR funwrite = _dummy_write_functor())
 				{
+					if (jmax > dest_sy) { jmax = dest_sy; }
+					if (jmin >= jmax) return;
 					size_t tmpsize = (size_t)(16 * (dest_sx + 1));
 					uint32 * tmp = (uint32*)malloc(tmpsize);
 					MTOOLS_ASSERT(tmp != nullptr);
@@ -5341,6 +5949,9 @@ namespace mtools
 						const uint64 ry = overflowy*(epsy - LY);
 						const uint32 p2y = (uint32)(ry >> (BIT_FP - BIT_FP_REDUCE));
 						const uint32 p1y = LL_RED - p2y;
+						const bool inrange = ((dj >= jmin) && (dj < jmax));	// true if the current destination line must be computed
+						const bool nextinrange = ((dj + 1 >= jmin) && (dj + 1 < jmax));	// same for the next line
+						if (inrange)
 						{
 						uint64 epsx = 0;
 						uint64 di = 0;
@@ -5389,7 +6000,7 @@ namespace mtools
 							epsx -= LX*overflowx;
 							}
 						}
-						if (overflowy)
+						if ((overflowy) && (inrange))
 							{
 							for (uint64 k = 0; k < dest_sx; k++)
 								{ // normalize
@@ -5408,7 +6019,9 @@ namespace mtools
 									}
 								}
 							memset(tmp, 0, (size_t)((dest_sx + 1) * 16)); // clear the temporary buffer							
-							// redo the line for the remainders
+							}
+						if ((overflowy) && (nextinrange))
+							{ // redo the line for the remainders
 							uint64 epsx = 0;
 							uint64 di = 0;
 							for (uint64 si = 0; si < src_sx; si++)
@@ -5459,8 +6072,9 @@ namespace mtools
 							}
 						dj += overflowy;
 						epsy -= LY*overflowy;
+						if (dj >= jmax) break; // done with the lines in range
 						}
-					if (dj < dest_sy)
+					if ((dj < dest_sy) && (dj < jmax))
 						{ // flush the last line
 						for (uint64 k = 0; k < dest_sx; k++)
 							{
@@ -5480,7 +6094,7 @@ namespace mtools
 							}
 						dj++;
 						}
-					MTOOLS_ASSERT(dj == dest_sy);
+					MTOOLS_ASSERT((dj == dest_sy) || (dj >= jmax));
 					free(tmp);
 					return;
 					#undef MTOOLS_ind_A_geq_B_U64
@@ -5544,15 +6158,17 @@ namespace mtools
 				}
 
 
-			/* blend a region, in increasing order */
+			/* blend a region, in increasing order. The fully transparent pixels (blending them does nothing) at both ends of the lines are skipped */
 			MTOOLS_FORCEINLINE static void _blendRegionUp(RGBc * pdest, int64 dest_stride, RGBc * psrc, int64 src_stride, int64 sx, int64 sy, float op)
 				{
 				uint32 uop = (uint32)(256 * op);
 				for (int64 j = 0; j < sy; j++)
 					{
-					for (int64 i = 0; i < sx; i++)
+					const size_t a = internals_graphics::findFirstNotEqual(psrc, (size_t)sx, 0, 0xFFFFFFFF);
+					if (a < (size_t)sx)
 						{
-						pdest[i].blend(psrc[i], uop);
+						const size_t b = internals_graphics::findLastNotEqual(psrc + a, (size_t)sx - a, 0, 0xFFFFFFFF);
+						internals_graphics::blendLine(pdest + a, psrc + a, b + 1, uop);
 						}
 					pdest += dest_stride;
 					psrc += src_stride;
@@ -5561,17 +6177,18 @@ namespace mtools
 				}
 
 
-			/* blend a region, in decreasing order */
+			/* blend a region, in decreasing order. The fully transparent pixels at both ends of the lines are skipped */
 			MTOOLS_FORCEINLINE static void _blendRegionDown(RGBc * pdest, int64 dest_stride, RGBc * psrc, int64 src_stride, int64 sx, int64 sy, float op)
 				{
 				uint32 uop = (uint32)(256 * op);
 				for (int64 j = sy - 1; j >= 0; j--)
 					{
-					RGBc * pdest2 = pdest + j*dest_stride;
-					RGBc * psrc2 = psrc + j*src_stride;
-					for (int64 i = sx - 1; i >= 0; i--)
+					RGBc * ps = psrc + j*src_stride;
+					const size_t a = internals_graphics::findFirstNotEqual(ps, (size_t)sx, 0, 0xFFFFFFFF);
+					if (a < (size_t)sx)
 						{
-						pdest2[i].blend(psrc2[i], uop);
+						const size_t b = internals_graphics::findLastNotEqual(ps + a, (size_t)sx - a, 0, 0xFFFFFFFF);
+						internals_graphics::blendLineReverse(pdest + j*dest_stride + a, ps + a, b + 1, uop);
 						}
 					}
 				return;
@@ -8147,11 +8764,7 @@ namespace mtools
 				{
 				for (int64 j = 0; j < sy; j++)
 					{
-					const int64 offdest = j*dest_stride;
-					for (int64 i = 0; i < sx; i++)
-						{
-						pdest[offdest + i] = color;
-						}
+					internals_graphics::fillLine(pdest + j*dest_stride, (size_t)sx, color);
 					}
 				}
 
@@ -8161,11 +8774,7 @@ namespace mtools
 				{
 				for (int64 j = 0; j < sy; j++)
 					{
-					const int64 offdest = j * dest_stride;
-					for (int64 i = 0; i < sx; i++)
-						{
-						pdest[offdest + i].blend(color);
-						}
+					internals_graphics::blendLineColor(pdest + j*dest_stride, (size_t)sx, color);
 					}
 				}
 
@@ -9001,6 +9610,331 @@ namespace mtools
 
 
 
+			/**
+			 * Return the rasterizer used by the scanline drawing methods (one per thread, so that its
+			 * buffers are reused between calls).
+			 */
+			static internals_graphics::ScanlineRasterizer & _scanlineRasterizer()
+				{
+				static thread_local internals_graphics::ScanlineRasterizer rast;
+				return rast;
+				}
+
+
+			/**
+			 * Draw the shape described by a rasterizer (after begin() was called). Each pixel is
+			 * written once, with the color opacity multiplied by its coverage.
+			 */
+			template<bool blend> void _draw_scanline(internals_graphics::ScanlineRasterizer & S, RGBc color)
+				{
+				while (S.nextRow())
+					{
+					RGBc * p = _data + S.row()*_stride;
+					const size_t nbs = S.nbSpans();
+					for (size_t i = 0; i < nbs; i++)
+						{
+						const auto & sp = S.span(i);
+						if (sp.constant)
+							{ // run of pixels with the same coverage
+							const uint32 op = (uint32)(sp.cov*256.0f + 0.5f);
+							const size_t len = (size_t)(sp.x1 - sp.x0 + 1);
+							if (op == 256) { if (blend) internals_graphics::blendLineColor(p + sp.x0, len, color); else internals_graphics::fillLine(p + sp.x0, len, color); continue; }
+							if (op == 0) continue;
+							if (blend) { for (int64 x = sp.x0; x <= sp.x1; x++) { p[x].blend(color, op); } }
+							else { internals_graphics::fillLine(p + sp.x0, len, color.getMultOpacityInt(op)); }
+							continue;
+							}
+						for (int64 x = sp.x0; x <= sp.x1; x++)
+							{
+							const uint32 op = (uint32)(S.coverage(x)*256.0f + 0.5f);
+							if (op == 0) continue;
+							if (blend) p[x].blend(color, op); else p[x] = color.getMultOpacityInt(op);
+							}
+						}
+					}
+				}
+
+
+			/* a disc to draw with _draw_circles() (image coordinates) */
+			struct _CircleItem
+				{
+				double	cx, cy, r;
+				RGBc	color;
+				};
+
+
+			/* draw the discs get(0),...,get(n-1) in this order. The discs are processed by chunks: each chunk
+			   is binned by bands of lines (counting sort, so the order is kept inside each band) and the
+			   bands are filled in parallel. */
+			template<typename GETCIRCLE> void _draw_circles(size_t n, GETCIRCLE get, bool aa, bool blend)
+				{
+				if (isEmpty() || (n == 0)) return;
+				const int64 BAND = 32;									// number of lines per band
+				const size_t CHUNK = ((size_t)1) << 22;					// number of discs per chunk
+				const int64 nbbands = (_ly + BAND - 1) / BAND;
+				const double m = (aa ? 0.5 : 0.0);						// antialiased discs extend by half a pixel
+				std::vector<_CircleItem> items;
+				std::vector<int64> rows;								// first/last band of each item
+				std::vector<uint32> bins;
+				std::vector<size_t> start((size_t)nbbands + 1);
+				for (size_t first = 0; first < n; first += CHUNK)
+					{
+					const size_t last = std::min<size_t>(n, first + CHUNK);
+					items.clear(); rows.clear();
+					std::fill(start.begin(), start.end(), 0);
+					int64 work = 0;
+					for (size_t i = first; i < last; i++)
+						{
+						const _CircleItem C = get(i);
+						if (!(C.r > 0)) continue; // also discard NaN
+						const double R = C.r + m;
+						if ((C.cx + R < 0) || (C.cx - R > _lx - 1) || (C.cy + R < 0) || (C.cy - R > _ly - 1)) continue;
+						const int64 j0 = std::max<int64>(0, (int64)ceil(C.cy - R)), j1 = std::min<int64>(_ly - 1, (int64)floor(C.cy + R));
+						if (j0 > j1) continue;
+						const int64 b0 = j0 / BAND, b1 = j1 / BAND;
+						for (int64 b = b0; b <= b1; b++) { start[(size_t)b + 1]++; }
+						work += (j1 - j0 + 1)*(int64)std::min<double>(2 * R + 2, (double)_lx);
+						items.push_back(C); rows.push_back(b0); rows.push_back(b1);
+						}
+					if (items.size() == 0) continue;
+					for (int64 b = 0; b < nbbands; b++) { start[(size_t)b + 1] += start[(size_t)b]; }
+					bins.resize(start[(size_t)nbbands]);
+					std::vector<size_t> pos(start.begin(), start.end() - 1);
+					for (size_t k = 0; k < items.size(); k++)
+						{
+						for (int64 b = rows[2 * k]; b <= rows[2 * k + 1]; b++) { bins[pos[(size_t)b]++] = (uint32)k; }
+						}
+					_parallelLines(nbbands, work, [&](int64 bmin, int64 bmax)
+						{
+						for (int64 b = bmin; b < bmax; b++)
+							{
+							const int64 jmin = b*BAND, jmax = std::min<int64>(_ly, jmin + BAND) - 1;
+							for (size_t k = start[(size_t)b]; k < start[(size_t)b + 1]; k++)
+								{
+								const _CircleItem & C = items[bins[k]];
+								if (aa)
+									{
+									if (blend) _draw_disc_AA<true>(C, jmin, jmax); else _draw_disc_AA<false>(C, jmin, jmax);
+									}
+								else
+									{
+									if (blend) _draw_disc<true>(C, jmin, jmax); else _draw_disc<false>(C, jmin, jmax);
+									}
+								}
+							}
+						});
+					}
+				}
+
+
+			/* draw the lines [jmin, jmax] of a filled disc: a pixel is drawn iff its center is inside the disc */
+			template<bool blend> inline void _draw_disc(const _CircleItem & C, int64 jmin, int64 jmax)
+				{
+				const double r2 = C.r*C.r;
+				jmin = std::max<int64>(jmin, (int64)ceil(C.cy - C.r));
+				jmax = std::min<int64>(jmax, (int64)floor(C.cy + C.r));
+				for (int64 j = jmin; j <= jmax; j++)
+					{
+					const double dy = j - C.cy, d2 = r2 - dy*dy;
+					if (d2 < 0) continue;
+					const double dx = sqrt(d2);
+					const int64 x0 = std::max<int64>(0, (int64)ceil(C.cx - dx)), x1 = std::min<int64>(_lx - 1, (int64)floor(C.cx + dx));
+					if (x0 > x1) continue;
+					if (blend) internals_graphics::blendLineColor(_data + j*_stride + x0, (size_t)(x1 - x0 + 1), C.color);
+					else internals_graphics::fillLine(_data + j*_stride + x0, (size_t)(x1 - x0 + 1), C.color);
+					}
+				}
+
+
+			/* draw the lines [jmin, jmax] of an antialiased filled disc. The coverage of a pixel is
+			   approximated by r + 1/2 - (distance from its center to the center of the disc) (clamped
+			   to [0,1]) and scaled by 2r for discs of radius smaller than 1/2. */
+			template<bool blend> inline void _draw_disc_AA(const _CircleItem & C, int64 jmin, int64 jmax)
+				{
+				const double ro = C.r + 0.5, ri = C.r - 0.5;
+				const double ro2 = ro*ro, ri2 = ((ri > 0) ? ri*ri : -1.0);
+				const double w = std::min<double>(1.0, 2 * C.r);
+				jmin = std::max<int64>(jmin, (int64)ceil(C.cy - ro));
+				jmax = std::min<int64>(jmax, (int64)floor(C.cy + ro));
+				for (int64 j = jmin; j <= jmax; j++)
+					{
+					const double dy = j - C.cy, dy2 = dy*dy, d2 = ro2 - dy2;
+					if (d2 < 0) continue;
+					const double dx = sqrt(d2);
+					const int64 x0 = std::max<int64>(0, (int64)ceil(C.cx - dx)), x1 = std::min<int64>(_lx - 1, (int64)floor(C.cx + dx));
+					if (x0 > x1) continue;
+					// inner part [a,b] is fully covered
+					int64 a = x1 + 1, b = x1;
+					if (ri2 - dy2 >= 0)
+						{
+						const double dxi = sqrt(ri2 - dy2);
+						a = std::max<int64>(x0, (int64)ceil(C.cx - dxi)); b = std::min<int64>(x1, (int64)floor(C.cx + dxi));
+						if (a > b) { a = x1 + 1; b = x1; }
+						}
+					RGBc * p = _data + j*_stride;
+					for (int64 x = x0; x <= x1; x++)
+						{
+						if (x == a)
+							{
+							if (blend) internals_graphics::blendLineColor(p + a, (size_t)(b - a + 1), C.color); else internals_graphics::fillLine(p + a, (size_t)(b - a + 1), C.color);
+							x = b;
+							continue;
+							}
+						const double dd = x - C.cx;
+						const double cov = std::min<double>(1.0, ro - sqrt(dd*dd + dy2))*w;
+						if (cov <= 0) continue;
+						const uint32 op = (uint32)(cov*256.0 + 0.5);
+						if (blend) p[x].blend(C.color, op); else p[x] = C.color.getMultOpacityInt(op);
+						}
+					}
+				}
+
+
+			/* canvas version of _draw_circles() */
+			template<typename GETCOLOR> void _canvas_draw_circles(const fBox2 & R, size_t n, const fVec2 * centers, const double * radii, GETCOLOR getcolor, bool aa, bool blend)
+				{
+				if (isEmpty() || (n == 0)) return;
+				const fBox2 imBox(-0.5, lx() - 0.5, -0.5, ly() - 0.5);
+				const double sx = boxTransform_dx(1.0, R, imBox), sy = boxTransform_dy(1.0, R, imBox);
+				if (std::abs<double>(sx - sy) > 1.0e-3*std::max<double>(sx, sy))
+					{ // discs are mapped to ellipses
+					for (size_t i = 0; i < n; i++) { const RGBc c = getcolor(i); canvas_draw_filled_circle(R, centers[i], radii[i], c, c, aa, blend); }
+					return;
+					}
+				_draw_circles(n, [&](size_t i) { const fVec2 P = boxTransform(centers[i], R, imBox); return _CircleItem{ P.X(), P.Y(), radii[i] * sx, getcolor(i) }; }, aa, blend);
+				}
+
+
+			/** Flatten a quadratic (rational) Bezier curve into a polyline (at most 1/4 pixel away from the curve). **/
+			static void _flattenQuadBezier(iVec2 P1, iVec2 P2, iVec2 PC, double wc, std::vector<fVec2> & tab)
+				{
+				// Wang's formula (with a crude correction for the weight)
+				const double M = fVec2((double)(P1.X() - 2 * PC.X() + P2.X()), (double)(P1.Y() - 2 * PC.Y() + P2.Y())).norm() * std::max<double>(1.0, wc);
+				const int64 n = std::max<int64>(2, std::min<int64>(10000, (int64)ceil(sqrt(M))));
+				tab.resize((size_t)(n + 1));
+				for (int64 i = 0; i <= n; i++)
+					{
+					const double t = ((double)i) / n, u = 1.0 - t;
+					const double a = u*u, b = 2 * wc*t*u, c = t*t, w = a + b + c;
+					tab[(size_t)i] = fVec2((a*P1.X() + b*PC.X() + c*P2.X()) / w, (a*P1.Y() + b*PC.Y() + c*P2.Y()) / w);
+					}
+				}
+
+
+			/** Flatten a cubic Bezier curve into a polyline (at most 1/4 pixel away from the curve). **/
+			static void _flattenCubicBezier(iVec2 P1, iVec2 P2, iVec2 PA, iVec2 PB, std::vector<fVec2> & tab)
+				{
+				// Wang's formula
+				const double M = std::max<double>(fVec2((double)(P1.X() - 2 * PA.X() + PB.X()), (double)(P1.Y() - 2 * PA.Y() + PB.Y())).norm(),
+												  fVec2((double)(PA.X() - 2 * PB.X() + P2.X()), (double)(PA.Y() - 2 * PB.Y() + P2.Y())).norm());
+				const int64 n = std::max<int64>(2, std::min<int64>(10000, (int64)ceil(sqrt(3 * M))));
+				tab.resize((size_t)(n + 1));
+				for (int64 i = 0; i <= n; i++)
+					{
+					const double t = ((double)i) / n, u = 1.0 - t;
+					const double a = u*u*u, b = 3 * u*u*t, c = 3 * u*t*t, d = t*t*t;
+					tab[(size_t)i] = fVec2(a*P1.X() + b*PA.X() + c*PB.X() + d*P2.X(), a*P1.Y() + b*PA.Y() + c*PB.Y() + d*P2.Y());
+					}
+				}
+
+
+			/**
+			 * Draw an open polyline with unit pen width. The vertices are classified once against the
+			 * image box: segments lying entirely inside are drawn without any range check and runs of
+			 * vertices outside of the image on the same side are collapsed into a single (invisible)
+			 * segment. Consecutive collinear segments pointing in the same direction are merged so each
+			 * maximal straight run is set up only once. Each joint pixel is drawn only once.
+			 */
+			template<bool blend, bool aa> void _draw_polyline_thin(size_t nbpoints, const iVec2 * tabPoints, RGBc color, bool draw_last_point)
+				{
+				const iBox2 outB = aa ? iBox2(-1, _lx, -1, _ly) : iBox2(0, _lx - 1, 0, _ly - 1);	// pixels drawn by a segment outside this box are off the image
+				const iBox2 inB = aa ? iBox2(1, _lx - 2, 1, _ly - 2) : outB;						// segments inside this box need no range check
+				const int64 lim = ((int64)1) << 31;												// bound for exact cross products
+				size_t k = 1;
+				iVec2 A = tabPoints[0];
+				while ((k < nbpoints) && (tabPoints[k] == A)) k++;
+				if (k == nbpoints)
+					{
+					if (draw_last_point) draw_dot(A, color, blend, 0);
+					return;
+					}
+				iVec2 prev = A;
+				iVec2 B = tabPoints[k++];
+				int cA = _csLineClipCode(A, outB), cB = _csLineClipCode(B, outB);
+				bool first = true;
+				while (1)
+					{
+					// extend the current segment [A,B] as far as possible
+					while (k < nbpoints)
+						{
+						const iVec2 & C = tabPoints[k];
+						if (C == B) { k++; continue; }
+						const int cC = _csLineClipCode(C, outB);
+						if ((cA & cB & cC) != 0) { B = C; cB = cC; k++; continue; } // A, B, C outside on the same side: the path stays invisible
+						const int64 ux = B.X() - A.X(), uy = B.Y() - A.Y(), vx = C.X() - B.X(), vy = C.Y() - B.Y();
+						if ((std::abs(ux) < lim) && (std::abs(uy) < lim) && (std::abs(vx) < lim) && (std::abs(vy) < lim) && (ux*vy == uy*vx) && (ux*vx + uy*vy > 0)) { B = C; cB = cC; k++; continue; } // collinear, same direction
+						break;
+						}
+					const bool last = (k == nbpoints);
+					if ((cA & cB) == 0)
+						{
+						const bool inside = ((_csLineClipCode(A, inB) | _csLineClipCode(B, inB)) == 0);
+						if (aa)
+							{
+							if (inside) { _lineBresenhamAA<blend, false, false>(A, B, color, last && draw_last_point, 0); }
+							else
+								{
+								const int64 of = 10;
+								iVec2 P1 = A, P2 = B;
+								if (_csLineClip(P1, P2, iBox2(-of, _lx - 1 + of, -of, _ly - 1 + of))) _lineBresenhamAA<blend, true, false>(P1, P2, color, last && draw_last_point, 0); // choose box bigger to diminish clipping error.
+								}
+							}
+						else if ((blend) && (!first))
+							{ // draw without overlapping the previous segment
+							const int64 stop = (last && (!draw_last_point)) ? 1 : 0;
+							if (inside) _lineBresenham_avoid<true, false, false, false, false>(A, B, prev, color, stop, 0); else _lineBresenham_avoid<true, true, false, false, false>(A, B, prev, color, stop, 0);
+							}
+						else
+							{
+							const bool drawB = (blend) ? ((!last) || draw_last_point) : (last && draw_last_point); // with blending, the joint is drawn by the first segment and avoided by the next one
+							if (inside) _lineBresenham<blend, false, false, false, false, false>(A, B, color, drawB, 0, 0); else _lineBresenham<blend, true, false, false, false, false>(A, B, color, drawB, 0, 0);
+							}
+						}
+					if (last) return;
+					prev = A; A = B; cA = cB;
+					B = tabPoints[k++]; cB = _csLineClipCode(B, outB);
+					first = false;
+					}
+				}
+
+
+			/**
+			 * Draw a polyline with a square pen of half side h using the scanline rasterizer. The
+			 * segments are rasterized together so the pixels where they overlap are drawn only once.
+			 */
+			template<typename VEC> void _draw_thick_polyline(size_t nbpoints, const VEC * tabPoints, bool closed, RGBc color, bool blending, bool antialiased, double h)
+				{
+				if ((isEmpty()) || (nbpoints == 0)) return;
+				fBox2 mbr(fVec2((double)tabPoints[0].X(), (double)tabPoints[0].Y()));
+				for (size_t i = 1; i < nbpoints; i++) { mbr.swallowPoint(fVec2((double)tabPoints[i].X(), (double)tabPoints[i].Y())); }
+				const iBox2 B = intersectionRect(imageBox(), iBox2((int64)std::max<double>(-1.0, floor(mbr.min[0] - h - 1)), (int64)std::min<double>((double)_lx, ceil(mbr.max[0] + h + 1)),
+																	(int64)std::max<double>(-1.0, floor(mbr.min[1] - h - 1)), (int64)std::min<double>((double)_ly, ceil(mbr.max[1] + h + 1))));
+				if (B.isEmpty()) return;
+				auto & S = _scanlineRasterizer();
+				S.reset(B, antialiased);
+				for (size_t i = 0; i + 1 < nbpoints; i++)
+					{
+					S.addThickSegment(fVec2((double)tabPoints[i].X(), (double)tabPoints[i].Y()), fVec2((double)tabPoints[i + 1].X(), (double)tabPoints[i + 1].Y()), h);
+					}
+				if ((closed) || (nbpoints == 1))
+					{
+					S.addThickSegment(fVec2((double)tabPoints[nbpoints - 1].X(), (double)tabPoints[nbpoints - 1].Y()), fVec2((double)tabPoints[0].X(), (double)tabPoints[0].Y()), h);
+					}
+				S.begin();
+				if ((blending) && ((antialiased) || (!color.isOpaque()))) _draw_scanline<true>(S, color); else _draw_scanline<false>(S, color);
+				}
+
+
 			/**
 			 * Draw a thick ellipse. 
 			 * Support real valued paramter and drawing only the part inside a box.
@@ -9312,10 +10246,10 @@ namespace mtools
 				if (_pcairo_surface != nullptr)	cairo_surface_flush((cairo_surface_t *)_pcairo_surface);
 				}
 
-			/* remove the cairo objects */
+			/* remove the cairo objects (a shallow view, e.g. a tile of a larger image, owns its own cairo objects which write through to the shared buffer) */
 			inline void _removecairo() const
 				{
-				if (_pcairo_context != nullptr) { cairo_destroy((cairo_t *)_pcairo_surface); _pcairo_context = nullptr; }
+				if (_pcairo_context != nullptr) { cairo_destroy((cairo_t *)_pcairo_context); _pcairo_context = nullptr; }
 				if (_pcairo_surface != nullptr) { cairo_surface_destroy((cairo_surface_t *)_pcairo_surface); _pcairo_surface = nullptr; }
 				}
 
@@ -9387,9 +10321,11 @@ namespace mtools
 			MTOOLS_FORCEINLINE void _allocate(int64 ly, int64 stride, RGBc * databuffer)
 				{
 				size_t memsize = 16 + (size_t)((databuffer == nullptr) ? (4*ly*stride) : 0); // 16 byte + the image buffer size if needed.
-				_deletepointer = (uint32*)malloc(memsize);
+				uint32 sizeclass = 0;
+				_deletepointer = (uint32*)((memsize >= BUFFERPOOL_MINSIZE) ? _poolAlloc(memsize, sizeclass) : malloc(memsize));
 				if (_deletepointer == nullptr) { MTOOLS_ERROR(std::string("malloc error: cannot allocate ") + mtools::toStringMemSize(memsize)); }
 				_deletepointer[0] = 1; // set reference count to 1
+				_deletepointer[1] = sizeclass; // size class in the buffer pool (0 = not from the pool)
 				((uint32**)_deletepointer)[1] = (databuffer == nullptr) ? _deletepointer : (uint32*)databuffer; // use to track the beginning of the buffer. 
 				_data = (databuffer == nullptr) ? ((RGBc*)(_deletepointer + 4)) : databuffer; // if allocated, buffer start 16 bytes (4 uint32) after the deletepointr.
 				}
@@ -9399,13 +10335,22 @@ namespace mtools
 				{
 				if ((_deletepointer != nullptr) && ((--(*_deletepointer)) == 0))
 					{ // deallocate 
-					free(_deletepointer);
+					if (_deletepointer[1] != 0) _poolFree(_deletepointer, _deletepointer[1]); else free(_deletepointer);
 					}
 				// not allowed to access the buffer anymore, so we null the adress.  
 				_deletepointer = nullptr;
 				_data = nullptr;
 				}
 
+			/* buffers smaller than this are not pooled */
+			static const size_t BUFFERPOOL_MINSIZE = 65536;
+
+			/* get a buffer of at least memsize bytes from the pool (or malloc it), set its size class (> 0) */
+			static void * _poolAlloc(size_t memsize, uint32 & sizeclass);
+
+			/* return a buffer obtained from _poolAlloc() to the pool */
+			static void _poolFree(void * p, uint32 sizeclass);
+
 			/* copy buffer pointer and increment the reference count */
 			MTOOLS_FORCEINLINE void _shallow_copy(uint32 * deletepointer, RGBc * data)
 				{
@@ -9430,6 +10375,7 @@ namespace mtools
 			RGBc *				_data;						// pointer to the image buffer
 			mutable void *		_pcairo_surface;			// pointer to the optional cairo surface
 			mutable void *		_pcairo_context;			// pointer to the optional cairo context
+			std::vector<Image> *	_pmipmaps;					// pointer to the optional mipmap pyramid (level 1, 2...)
 
 		};
 
@@ -0,0 +1,180 @@
+/** @file imagesequencewriter.hpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include "../misc/internal/mtools_export.hpp"
+#include "../misc/misc.hpp"
+#include "../misc/error.hpp"
+#include "../misc/internal/threadsafequeue.hpp"
+#include "../maths/vec.hpp"
+#include "image.hpp"
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <cstdio>
+
+
+namespace mtools
+	{
+
+
+	/**
+	 * Asynchronous writer for sequences of images (e.g. the frames of a simulation).
+	 *
+	 * push() makes a copy of the image, put it in a bounded queue and returns immediately (unless
+	 * the queue is full, in which case it waits for a slot). The frames are written by a pool of
+	 * background threads. Three output modes are available:
+	 *
+	 * - OUTPUT_PNG  : each frame is saved in its own PNG file with the same naming scheme as
+	 *                 Image::save(filename, number, digits) i.e. "name_000012.png". Frames are
+	 *                 encoded in parallel by the pool of threads with the chosen zlib compression
+	 *                 level (0 = none/fastest, 9 = smallest).
+	 * - OUTPUT_RAW  : the frames are appended, in order, to a single file as raw pixels
+	 *                 (ffmpeg: -f rawvideo -pix_fmt bgra -s LXxLY).
+	 * - OUTPUT_PIPE : same as OUTPUT_RAW but the bytes are written to the standard input of a
+	 *                 command started with popen(), e.g.
+	 *                 "ffmpeg -y -f rawvideo -pix_fmt bgra -s 800x600 -r 30 -i - out.mp4".
+	 *
+	 * In raw/pipe mode, a single thread writes the frames (the order must be kept) and the pixels
+	 * are written as stored in the image (premultiplied alpha, which is the same for opaque images).
+	 * All the frames must then have the same size.
+	 *
+	 * @code
+	 * ImageSequenceWriter W(ImageSequenceWriter::OUTPUT_PNG, "frame.png");
+	 * for (int i = 0; i < 1000; i++) { simulate(); draw(im); W.push(im); }  // frame_000000.png ...
+	 * @endcode
+	 **/
+	class ImageSequenceWriter
+		{
+
+		public:
+
+			static const int OUTPUT_PNG = 0;			///< one PNG file per frame
+			static const int OUTPUT_RAW = 1;			///< raw frames appended to a single file
+			static const int OUTPUT_PIPE = 2;			///< raw frames written to the input of a command
+
+			static const int DEFAULT_COMPRESSION = 3;	///< default zlib level for PNG (fast, and not much larger than 6).
+			static const int DEFAULT_QUEUE_SIZE = 8;	///< default number of frames waiting to be written.
+
+
+			/**
+			 * Constructor.
+			 *
+			 * @param	mode	   	OUTPUT_PNG, OUTPUT_RAW or OUTPUT_PIPE.
+			 * @param	target	   	The file name (OUTPUT_PNG / OUTPUT_RAW) or the command (OUTPUT_PIPE).
+			 * @param	compression	zlib compression level for PNG, between 0 and 9 (ignored otherwise).
+			 * @param	nbThreads  	Number of encoding threads for PNG (0 = number of hardware threads).
+			 * 						Always 1 for the other modes.
+			 * @param	queueSize  	Maximum number of frames waiting in the queue.
+			 * @param	digits	   	Number of digits of the frame number in the PNG file names.
+			 **/
+			ImageSequenceWriter(int mode, const std::string & target, int compression = DEFAULT_COMPRESSION, int nbThreads = 0, int queueSize = DEFAULT_QUEUE_SIZE, unsigned int digits = 6);
+
+
+			/**
+			 * Destructor. Waits until all the frames in the queue are written.
+			 **/
+			~ImageSequenceWriter();
+
+
+			/**
+			 * Add a frame. The image is copied so it can be modified as soon as the method returns.
+			 * Blocks only if the queue is full.
+			 *
+			 * @param	im	The image.
+			 *
+			 * @return	The number of the frame (starting from 0).
+			 **/
+			int64 push(const Image & im);
+
+
+			/**
+			 * Wait until all the frames pushed so far are written.
+			 **/
+			void flush();
+
+
+			/**
+			 * Number of frames pushed.
+			 **/
+			int64 nbFrames() const { return _nbpushed; }
+
+
+			/**
+			 * Number of frames written.
+			 **/
+			int64 nbWritten() const { return _nbdone - _nberrors; }
+
+
+			/**
+			 * Number of frames that could not be written (I/O or encoding error).
+			 **/
+			int64 nbErrors() const { return _nberrors; }
+
+
+			/**
+			 * The output mode.
+			 **/
+			int mode() const { return _mode; }
+
+
+		private:
+
+			struct _Frame
+				{
+				Image	im;		// standalone copy of the image
+				int64	nb;		// frame number
+				};
+
+			void _workerLoop();
+
+			bool _writePNG(const _Frame & F);
+
+			bool _writeRaw(const _Frame & F);
+
+			std::string _filename(int64 nb) const;
+
+
+			ImageSequenceWriter(const ImageSequenceWriter &) = delete;
+			ImageSequenceWriter & operator=(const ImageSequenceWriter &) = delete;
+
+			int							_mode;			// output mode
+			std::string					_target;		// file name or command
+			int							_compression;	// zlib level
+			unsigned int				_digits;		// digits of the frame number
+			FILE *						_out;			// output stream (raw/pipe mode)
+			iVec2						_rawdim;		// size of the frames in raw/pipe mode (set by the first frame)
+			std::atomic<int64>			_nbpushed;		// number of frames pushed
+			std::atomic<int64>			_nbdone;		// number of frames processed (written or failed)
+			std::atomic<int64>			_nberrors;		// number of frames that failed
+			std::atomic<bool>			_stop;			// true when the workers must quit once the queue is empty
+			MultiProducerMultiConsumerQueue<_Frame*> _queue;	// frames waiting to be written
+			std::vector<std::thread>	_threads;		// the workers
+		};
+
+
+	}
+
+
+/* end of file */
+
@@ -0,0 +1,183 @@
+/** @file imagestreamwriter.hpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include "../misc/internal/mtools_export.hpp"
+#include "../misc/misc.hpp"
+#include "../misc/error.hpp"
+#include "image.hpp"
+
+#include <string>
+#include <vector>
+#include <cstdio>
+
+
+namespace mtools
+	{
+
+
+	/**
+	 * Writer for images too large to fit in memory. The image is given from top to bottom as
+	 * horizontal bands (of any height) and is written to the file as they arrive, so the memory used
+	 * does not depend on the height of the image. Typically, the bands are rendered one after the
+	 * other by a LatticeDrawer, a FigureDrawerDispatcher... into a sub-image of width lx.
+	 *
+	 * Three formats are available:
+	 *
+	 * - FORMAT_BMP  : 24 bit uncompressed BMP (the alpha channel is dropped, the file must be smaller
+	 *                 than 4GB). Rows are stored top-down (negative height).
+	 * - FORMAT_PNG  : RGB or RGBA PNG. The rows are filtered and deflated by strips, several strips
+	 *                 being compressed in parallel (Image::rescaleThreads() threads).
+	 * - FORMAT_TIFF : tiled RGB or RGBA (associated alpha) TIFF, deflate compressed (or uncompressed
+	 *                 if the compression level is 0) with tiles of TIFF_TILE x TIFF_TILE pixels, also
+	 *                 compressed in parallel. A BigTIFF file is written when the uncompressed image is
+	 *                 larger than 2GB.
+	 *
+	 * The memory used is about lx * TIFF_TILE * 4 bytes for TIFF, a few strips of 4MB per thread
+	 * for PNG and a single row for BMP.
+	 *
+	 * @code
+	 * ImageStreamWriter W("poster.png", 200000, 200000);
+	 * Image band(200000, 256);
+	 * for (int64 y = 0; y < 200000; y += 256) { render(band, y); W.push(band); } // last band may be cut
+	 * W.close();
+	 * @endcode
+	 **/
+	class ImageStreamWriter
+		{
+
+		public:
+
+			static const int FORMAT_AUTO = 0;		///< deduce the format from the extension of the file name (.bmp, .png, .tif / .tiff)
+			static const int FORMAT_BMP = 1;		///< 24 bit BMP
+			static const int FORMAT_PNG = 2;		///< PNG
+			static const int FORMAT_TIFF = 3;		///< tiled TIFF
+
+			static const int TIFF_TILE = 256;		///< size of the TIFF tiles
+
+
+			/**
+			 * Constructor. Create the file and write its header.
+			 *
+			 * @param	filename   	The file name.
+			 * @param	lx		   	width of the image.
+			 * @param	ly		   	height of the image.
+			 * @param	alpha	   	true to keep the alpha channel (PNG and TIFF). Use false for opaque images:
+			 * 						the file is smaller.
+			 * @param	compression	zlib compression level between 0 and 9 (PNG and TIFF).
+			 * @param	format	   	FORMAT_AUTO, FORMAT_BMP, FORMAT_PNG or FORMAT_TIFF.
+			 **/
+			ImageStreamWriter(const std::string & filename, int64 lx, int64 ly, bool alpha = true, int compression = 6, int format = FORMAT_AUTO);
+
+
+			/**
+			 * Destructor. Calls close().
+			 **/
+			~ImageStreamWriter();
+
+
+			/**
+			 * Append the rows of a band below those already written. The band must have width lx. If it
+			 * contains more rows than the number of rows remaining, the extra rows are ignored.
+			 *
+			 * @param	band	The band.
+			 **/
+			void push(const Image & band) { push(band.data(), band.stride(), band.lx(), band.ly()); }
+
+
+			/**
+			 * Append nbrows rows below those already written.
+			 *
+			 * @param	rows  	pointer to the first pixel of the first row.
+			 * @param	stride	number of pixels between two rows.
+			 * @param	lx	  	width of the rows (must be equal to the width of the image).
+			 * @param	nbrows	number of rows.
+			 **/
+			void push(const RGBc * rows, int64 stride, int64 lx, int64 nbrows);
+
+
+			/**
+			 * Finish the file and close it. If not all the rows were pushed, the missing ones are
+			 * transparent (black in BMP). Called automatically by the destructor.
+			 *
+			 * @return	true if the file was written successfully.
+			 **/
+			bool close();
+
+
+			/** true if no error occurred so far. */
+			bool ok() const { return _ok; }
+
+
+			/** Number of rows pushed so far. */
+			int64 rows() const { return _y; }
+
+
+			/** Width of the image. */
+			int64 lx() const { return _lx; }
+
+
+			/** Height of the image. */
+			int64 ly() const { return _ly; }
+
+
+			/** The format of the file. */
+			int format() const { return _format; }
+
+
+		private:
+
+			ImageStreamWriter(const ImageStreamWriter &) = delete;
+			ImageStreamWriter & operator=(const ImageStreamWriter &) = delete;
+
+			/* write bytes at the end of the file */
+			void _write(const void * data, size_t len);
+
+			/* encode the rows buffered in _band */
+			void _flushPNG(bool last);
+			void _flushTIFF();
+
+			/* write the TIFF directory and update the header */
+			void _finishTIFF();
+
+			FILE *				_f;			// the file (nullptr once closed)
+			int					_format;	// format of the file
+			int64				_lx, _ly;	// size of the image
+			int64				_y;			// number of rows pushed
+			bool				_alpha;		// keep the alpha channel
+			int					_level;		// zlib compression level
+			bool				_ok;		// no error so far
+			uint64				_pos;		// current size of the file
+			Image				_band;		// rows waiting to be encoded (PNG: row 0 is the previous row)
+			int64				_nbrows;	// number of rows in _band
+			int64				_strip;		// PNG: number of rows per strip
+			uint32				_adler;		// PNG: adler32 checksum of the data so far
+			bool				_bigtiff;	// TIFF: BigTIFF file
+			std::vector<uint64>	_offsets;	// TIFF: offset of each tile
+			std::vector<uint64>	_counts;	// TIFF: size of each tile
+			std::vector<uint8>	_row;		// BMP: conversion buffer for a row
+		};
+
+
+	}
+
+
+/* end of file */
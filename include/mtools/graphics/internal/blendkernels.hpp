@@ -0,0 +1,223 @@
+/** @file blendkernels.hpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+
+#include "../../misc/internal/mtools_export.hpp"
+#include "../rgbc.hpp"
+
+
+namespace mtools
+{
+
+	namespace internals_graphics
+	{
+
+		/**
+		 * Vectorized kernels used by Image and ProgressImg for blending, filling, scanning and
+		 * converting lines of pixels.
+		 *
+		 * Each kernel processes a single line of contiguous pixels. The implementation is selected at
+		 * runtime the first time a kernel is called, depending on the CPU:
+		 *   - x86/x64 : AVX2 (8 pixels per instruction) if supported by the CPU and the OS,
+		 *               otherwise SSE2 (4 pixels per instruction).
+		 *   - ARM     : NEON (4 pixels per instruction) when the compiler targets it.
+		 *   - otherwise the scalar version, which simply calls RGBc::blend() on each pixel.
+		 *
+		 * All versions return exactly the same result as the scalar code (bit for bit).
+		 **/
+
+
+		/**
+		 * Blend a line of pixels: dst[i].blend(src[i], op) for i = 0..n-1 (in increasing order).
+		 * The lines may overlap if dst <= src.
+		 *
+		 * @param	dst	the destination line.
+		 * @param	src	the line to blend over the destination.
+		 * @param	n  	number of pixels.
+		 * @param	op 	the opacity in [0, 0x100].
+		 **/
+		MTOOLS_DLL void blendLine(RGBc * dst, const RGBc * src, size_t n, uint32 op);
+
+
+		/**
+		 * Blend a line of pixels: dst[i].blend(src[i], op) for i = n-1..0 (in decreasing order).
+		 * The lines may overlap if dst >= src.
+		 *
+		 * @param	dst	the destination line.
+		 * @param	src	the line to blend over the destination.
+		 * @param	n  	number of pixels.
+		 * @param	op 	the opacity in [0, 0x100].
+		 **/
+		MTOOLS_DLL void blendLineReverse(RGBc * dst, const RGBc * src, size_t n, uint32 op);
+
+
+		/**
+		 * Blend a single color over a line of pixels: dst[i].blend(color) for i = 0..n-1.
+		 *
+		 * @param	dst  	the destination line.
+		 * @param	n	 	number of pixels.
+		 * @param	color	the color to blend.
+		 **/
+		MTOOLS_DLL void blendLineColor(RGBc * dst, size_t n, RGBc color);
+
+
+		/**
+		 * Fill a line of pixels with a given color.
+		 *
+		 * @param	dst  	the destination line.
+		 * @param	n	 	number of pixels.
+		 * @param	color	the color to use.
+		 **/
+		MTOOLS_DLL void fillLine(RGBc * dst, size_t n, RGBc color);
+
+
+		/**
+		 * Blend a line of RGBc64 pixels with normalisation: dst[i].blend(src[i], norm[i] + 1, op) for
+		 * i = 0..n-1. This is the kernel used by ProgressImg::blit() in BLIT_CLASSIC mode.
+		 *
+		 * @param	dst 	the destination line.
+		 * @param	src 	the line to blend over the destination.
+		 * @param	norm	the normalisation minus 1 of each pixel of src.
+		 * @param	n   	number of pixels.
+		 * @param	op  	the opacity in [0, 0x100].
+		 **/
+		MTOOLS_DLL void blendLine64(RGBc * dst, const RGBc64 * src, const uint8 * norm, size_t n, uint32 op);
+
+
+		/**
+		 * Multiply the opacity of a line of pixels: dst[i].multOpacityInt(op) for i = 0..n-1.
+		 *
+		 * @param	dst	the line.
+		 * @param	n  	number of pixels.
+		 * @param	op 	the opacity in [0, 0x100].
+		 **/
+		MTOOLS_DLL void multOpacityLine(RGBc * dst, size_t n, uint32 op);
+
+
+		/**
+		 * Convert a line of non-premultiplied pixels to premultiplied alpha: dst[i].premultiply() for i
+		 * = 0..n-1.
+		 *
+		 * @param	dst	the line.
+		 * @param	n  	number of pixels.
+		 **/
+		MTOOLS_DLL void premultiplyLine(RGBc * dst, size_t n);
+
+
+		/**
+		 * Return the index of the first pixel of a line such that (src[i].color & mask) != (value &
+		 * mask), or n if there is none. The pixels are compared by blocks of 16 and the scan stops at
+		 * the first block containing a difference.
+		 *
+		 * @param	src  	the line.
+		 * @param	n	 	number of pixels.
+		 * @param	value	the value to compare against.
+		 * @param	mask 	the bits to compare (0xFFFFFFFF for the whole pixel, 0xFF000000 for the alpha
+		 * 					channel only).
+		 **/
+		MTOOLS_DLL size_t findFirstNotEqual(const RGBc * src, size_t n, uint32 value, uint32 mask);
+
+
+		/**
+		 * Return the index of the last pixel of a line such that (src[i].color & mask) != (value &
+		 * mask), or n if there is none. Same as findFirstNotEqual() but the line is scanned backward.
+		 *
+		 * @param	src  	the line.
+		 * @param	n	 	number of pixels.
+		 * @param	value	the value to compare against.
+		 * @param	mask 	the bits to compare.
+		 **/
+		MTOOLS_DLL size_t findLastNotEqual(const RGBc * src, size_t n, uint32 value, uint32 mask);
+
+
+		/**
+		 * Convert a line of pixels given by separate 8-bit color planes (e.g. the layout of a CImg
+		 * image) into RGBc: dst[i] = RGBc(R[i], G[i], B[i], A[i]). No premultiplication is performed
+		 * (use premultiplyLine() afterward if needed).
+		 *
+		 * @param	dst	the destination line.
+		 * @param	R  	the red plane.
+		 * @param	G  	the green plane.
+		 * @param	B  	the blue plane.
+		 * @param	A  	the alpha plane (nullptr for opaque pixels).
+		 * @param	n  	number of pixels.
+		 **/
+		MTOOLS_DLL void planarToLine(RGBc * dst, const uint8 * R, const uint8 * G, const uint8 * B, const uint8 * A, size_t n);
+
+
+		/**
+		 * Convert a line of interleaved 8-bit RGB or RGBA pixels (the usual framebuffer layout) into
+		 * RGBc. No premultiplication is performed.
+		 *
+		 * @param	dst		  	the destination line.
+		 * @param	src		  	the source pixels (nbchannels bytes per pixel).
+		 * @param	n		  	number of pixels.
+		 * @param	nbchannels	3 for RGB (opaque) or 4 for RGBA.
+		 **/
+		MTOOLS_DLL void interleavedToLine(RGBc * dst, const uint8 * src, size_t n, int nbchannels);
+
+
+		/**
+		 * Convert a line of premultiplied pixels to non-premultiplied alpha: dst[i].unpremultiply() for
+		 * i = 0..n-1 (scalar: one division per channel).
+		 *
+		 * @param	dst	the line.
+		 * @param	n  	number of pixels.
+		 **/
+		MTOOLS_DLL void unpremultiplyLine(RGBc * dst, size_t n);
+
+
+		/**
+		 * Convert a line of RGBc64 to RGBc with normalisation: dst[i] = RGBc(src[i], N). Divisions are
+		 * replaced by shifts when N is a power of 2.
+		 *
+		 * @param	dst	the destination line.
+		 * @param	src	the source line.
+		 * @param	n  	number of pixels.
+		 * @param	N  	the normalisation (N > 0).
+		 **/
+		MTOOLS_DLL void convertLine(RGBc * dst, const RGBc64 * src, size_t n, uint32 N);
+
+
+		/**
+		 * Convert a line of RGBc to RGBc64: dst[i] = src[i].
+		 *
+		 * @param	dst	the destination line.
+		 * @param	src	the source line.
+		 * @param	n  	number of pixels.
+		 **/
+		MTOOLS_DLL void convertLine(RGBc64 * dst, const RGBc * src, size_t n);
+
+
+		/**
+		 * Return the name of the implementation selected for the kernels: "avx2", "sse2", "neon" or
+		 * "scalar".
+		 **/
+		MTOOLS_DLL const char * blendKernelsName();
+
+	}
+
+}
+
+
+/* end of file */
+
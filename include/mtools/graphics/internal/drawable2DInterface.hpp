@@ -121,6 +121,16 @@ namespace internals_graphics
          **/
         virtual bool enableThreads() const {return false; }
 
+
+        /**
+         * Set the priority of the working threads w.r.t. the global ThreadScheduler. Plotter2D gives
+         * a higher priority to the object currently on top so that it is drawn first. The default
+         * implementation does nothing.
+         *
+         * @param   prio    The new priority (ThreadScheduler::PRIORITY_NORMAL or PRIORITY_HIGH).
+         **/
+        virtual void threadsPriority(int prio) { return; }
+
     };
 
 	
@@ -155,6 +165,8 @@ namespace internals_graphics
 
             bool enableThreads() const override { return _obj->workThread(); }
 
+            void threadsPriority(int prio) override { _obj->workThreadPriority(prio); }
+
         private:
 
             EncapsulateDrawable2DObject(const EncapsulateDrawable2DObject &) = delete;
@@ -191,6 +203,8 @@ namespace internals_graphics
         void enableThreads(bool status) override { _obj->workThread(status); }
 
         bool enableThreads() const override { return _obj->workThread(); }
+
+        void threadsPriority(int prio) override { _obj->workThreadPriority(prio); }
 		
 	private:
 
@@ -138,6 +138,78 @@ namespace internals_graphics
 
 
 
+    /**
+     * Global scheduler deciding for how long the worker thread of each AutoDrawable2DObject calls
+     * the work() method of its object before returning the execution slot to the ThreadScheduler.
+     *
+     * Time is divided in frames (frameMs() = 1000 / frameRate()). A worker never works more than a
+     * frame in a row so that the quality seen by the plotters is updated at the frame rate. The
+     * time of the frame is shared between the objects which are still refining their drawing
+     * (quality \< 100) in proportion to:
+     *
+     * - their priority: the object currently visible (ThreadScheduler::PRIORITY_HIGH) gets
+     *   HIGH_PRIORITY_FACTOR times more than the others.
+     * - the inverse of their estimated remaining time (100 - quality) x (cost of a quality point).
+     *   The cost is measured during the previous calls to work(). Objects close to completion are
+     *   thus finished first, which minimizes the total time for all the objects to converge, while
+     *   a costly object cannot starve the cheap ones.
+     *
+     * Each slice is at least MIN_SLICE_MS long so every object keeps progressing.
+     **/
+    class Drawable2DScheduler
+    {
+
+    public:
+
+        static const int DEFAULT_FRAMERATE = 25;        ///< default target frame rate
+        static const int MIN_SLICE_MS = 5;              ///< minimum duration of a call to work()
+        static const int HIGH_PRIORITY_FACTOR = 4;      ///< weight of the visible object w.r.t. the other ones
+
+
+        /**
+         * Set the target frame rate (number of frames per second between 1 and 100). Also used by
+         * Plotter2D to pace the updates of its window.
+         **/
+        static void frameRate(int fps);
+
+
+        /** Return the target frame rate. */
+        static int frameRate();
+
+
+        /** Return the duration of a frame in milliseconds. */
+        static int frameMs();
+
+
+        /** Register / unregister an object (called by AutoDrawable2DObject). */
+        static void add(const void * obj);
+        static void remove(const void * obj);
+
+
+        /**
+         * Return the time (in ms) the worker of an object should spend in its next call to work().
+         *
+         * @param   obj         The object.
+         * @param   priority    Its current priority w.r.t. the ThreadScheduler.
+         * @param   quality     Its current quality.
+         **/
+        static int slice(const void * obj, int priority, int quality);
+
+
+        /**
+         * Report the result of a call to work() to update the estimated cost of the object.
+         *
+         * @param   obj     The object.
+         * @param   q0      The quality before the call.
+         * @param   q1      The quality returned by the call.
+         * @param   ms      The duration of the call in milliseconds.
+         **/
+        static void report(const void * obj, int q0, int q1, double ms);
+
+    };
+
+
+
     /**
      * Class which automates the `work()` method of a `Drawable2DObject`. This class creates an
      * independent thread which keep the drawing of the underlying Drawable2DObject updated.
@@ -238,6 +310,21 @@ namespace internals_graphics
         bool workThread() const;
 
 
+        /**
+         * Set the priority of the working thread w.r.t. the global ThreadScheduler. The thread holds
+         * an execution slot while it calls the work() method of the underlying object.
+         *
+         * @param   prio    The new priority.
+         **/
+        void workThreadPriority(int prio);
+
+
+        /**
+         * Return the priority of the working thread.
+         **/
+        int workThreadPriority() const;
+
+
     private:
 
         AutoDrawable2DObject(const AutoDrawable2DObject &) = delete;                // no copy.
@@ -252,6 +339,7 @@ namespace internals_graphics
         mutable std::mutex _mut;
         std::atomic<bool> _mustexit;
         std::atomic<bool> _threadon;
+        std::atomic<int> _priority;
 
         Drawable2DObject * _obj; // the drawable object to manage
     };
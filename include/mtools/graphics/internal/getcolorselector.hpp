@@ -191,6 +191,63 @@ namespace mtools
 
 
 
+    /**
+    * GetColorBatch Plane method selector.
+    *
+    * Detect if a type contains a method getColorBatch() that computes the colors of several points at
+    * once. When present, the PlaneDrawer class uses it instead of the GetColorPlaneSelector method
+    * and queries a whole line of pixels (or all the samples of a pass inside a line) in a single call
+    * so that the color function can vectorize its computations.
+    *
+    * - const fVec2 * pos : array of the n points to compute.
+    *
+    * - size_t n : number of points.
+    *
+    * - RGBc * out : array of size n where the colors are written. The colors are always blended with the
+    *                values previously obtained (as for the RGBc return type of getColor()).
+    *
+    * - void* & data : reference to an opaque value that identify the thread drawing (same as for
+    *                  GetColorPlaneSelector).
+    *
+    * The signature below are recognized with the following order:
+    *
+    *  void getColorBatch(const fVec2 * pos, size_t n, RGBc * out, void* & data)
+    *  void getColorBatch(const fVec2 * pos, size_t n, RGBc * out)
+    *
+    * If none of them is found, call() falls back to querying each point with GetColorPlaneSelector
+    * (with an empty pixel box and nbiter = 1).
+    **/
+    template<typename T> class GetColorPlaneBatchSelector
+        {
+        static void * dumptr;
+
+        template<typename U> static decltype((*(U*)(0)).getColorBatch((const fVec2 *)nullptr, (size_t)0, (RGBc *)nullptr, dumptr), metaprog::yes()) vers1(int);
+        template<typename> static metaprog::no vers1(...);
+        static const bool version1 = std::is_same<decltype(vers1<T>(0)), metaprog::yes>::value;
+
+        template<typename U> static decltype((*(U*)(0)).getColorBatch((const fVec2 *)nullptr, (size_t)0, (RGBc *)nullptr), metaprog::yes()) vers2(int);
+        template<typename> static metaprog::no vers2(...);
+        static const bool version2 = std::is_same<decltype(vers2<T>(0)), metaprog::yes>::value;
+
+        static void call1(T & obj, const fVec2 * pos, size_t n, RGBc * out, void * &data, mtools::metaprog::dummy<true> D) { obj.getColorBatch(pos, n, out, data); }
+        static void call2(T & obj, const fVec2 * pos, size_t n, RGBc * out, void * &data, mtools::metaprog::dummy<true> D) { obj.getColorBatch(pos, n, out); }
+
+        static void call1(T & obj, const fVec2 * pos, size_t n, RGBc * out, void * &data, mtools::metaprog::dummy<false> D) { call2(obj, pos, n, out, data, mtools::metaprog::dummy<version2>()); }
+        static void call2(T & obj, const fVec2 * pos, size_t n, RGBc * out, void * &data, mtools::metaprog::dummy<false> D)
+            {
+            for (size_t k = 0; k < n; k++) { out[k] = GetColorPlaneSelector<T>::call(obj, pos[k], fBox2(), 1, data).first; }
+            }
+
+        public:
+
+            static const bool has_getColorBatch = version1 | version2;
+
+            static void call(T & obj, const fVec2 * pos, size_t n, RGBc * out, void * &data) { call1(obj, pos, n, out, data, mtools::metaprog::dummy<version1>()); }
+
+        };
+
+
+
         /**
         * GetImage method selector.
         *
@@ -381,6 +438,164 @@ namespace mtools
 
 
 
+        /**
+        * GetColorBatch method selector.
+        *
+        * Detect if a type contains a method getColorBatch() that computes the colors of several sites at
+        * once. When present, the PixelDrawer and LatticeDrawer classes use it instead of the
+        * GetColorSelector method for the lines of sites (or the sets of random samples) they query.
+        *
+        * - const iVec2 * pos : array of the n sites to compute.
+        *
+        * - size_t n : number of sites.
+        *
+        * - RGBc * out : array of size n where the colors are written.
+        *
+        * - void* & data : reference to an opaque value that identify the thread drawing (same as for
+        *                  GetColorSelector).
+        *
+        * The signature below are recognized with the following order:
+        *
+        *  void getColorBatch(const iVec2 * pos, size_t n, RGBc * out, void* & data)
+        *  void getColorBatch(const iVec2 * pos, size_t n, RGBc * out)
+        *
+        * If none of them is found, call() falls back to querying each site with GetColorSelector.
+        **/
+        template<typename T> class GetColorBatchSelector
+            {
+            static void * dumptr;
+
+            template<typename U> static decltype((*(U*)(0)).getColorBatch((const iVec2 *)nullptr, (size_t)0, (RGBc *)nullptr, dumptr), metaprog::yes()) vers1(int);
+            template<typename> static metaprog::no vers1(...);
+            static const bool version1 = std::is_same<decltype(vers1<T>(0)), metaprog::yes>::value;
+
+            template<typename U> static decltype((*(U*)(0)).getColorBatch((const iVec2 *)nullptr, (size_t)0, (RGBc *)nullptr), metaprog::yes()) vers2(int);
+            template<typename> static metaprog::no vers2(...);
+            static const bool version2 = std::is_same<decltype(vers2<T>(0)), metaprog::yes>::value;
+
+            static void call1(T & obj, const iVec2 * pos, size_t n, RGBc * out, void * &data, mtools::metaprog::dummy<true> D) { obj.getColorBatch(pos, n, out, data); }
+            static void call2(T & obj, const iVec2 * pos, size_t n, RGBc * out, void * &data, mtools::metaprog::dummy<true> D) { obj.getColorBatch(pos, n, out); }
+
+            static void call1(T & obj, const iVec2 * pos, size_t n, RGBc * out, void * &data, mtools::metaprog::dummy<false> D) { call2(obj, pos, n, out, data, mtools::metaprog::dummy<version2>()); }
+            static void call2(T & obj, const iVec2 * pos, size_t n, RGBc * out, void * &data, mtools::metaprog::dummy<false> D)
+                {
+                for (size_t k = 0; k < n; k++) { out[k] = GetColorSelector<T>::call(obj, pos[k], data); }
+                }
+
+            public:
+
+                static const bool has_getColorBatch = version1 | version2;
+
+                static void call(T & obj, const iVec2 * pos, size_t n, RGBc * out, void * &data) { call1(obj, pos, n, out, data, mtools::metaprog::dummy<version1>()); }
+
+            };
+
+
+
+        /**
+        * GetColorBox method selector.
+        *
+        * Detect if a type contains a method getColorBox() that returns the color of a site together with
+        * a box containing the site on which all the sites have the same color (for instance the box
+        * returned by Grid_factor::findFullBox()). When present, the LatticeDrawer class colors whole
+        * runs of pixels with a single query.
+        *
+        * - iVec2 pos : the site.
+        *
+        * - iBox2 & box : set to a (closed) box containing pos on which the color is constant. The
+        *                 singleton {pos} is always a valid answer.
+        *
+        * - void* & data : reference to an opaque value that identify the thread drawing (same as for
+        *                  GetColorSelector).
+        *
+        * The signature below are recognized with the following order:
+        *
+        *  RGBc getColorBox(iVec2 pos, iBox2 & box, void* & data)
+        *  RGBc getColorBox(iVec2 pos, iBox2 & box)
+        *
+        * If none of them is found, call() uses GetColorSelector and returns the singleton {pos}.
+        **/
+        template<typename T> class GetColorBoxSelector
+            {
+            static void * dumptr;
+            static iBox2 dumbox;
+
+            template<typename U> static decltype((*(U*)(0)).getColorBox(iVec2(), dumbox, dumptr), metaprog::yes()) vers1(int);
+            template<typename> static metaprog::no vers1(...);
+            static const bool version1 = std::is_same<decltype(vers1<T>(0)), metaprog::yes>::value;
+
+            template<typename U> static decltype((*(U*)(0)).getColorBox(iVec2(), dumbox), metaprog::yes()) vers2(int);
+            template<typename> static metaprog::no vers2(...);
+            static const bool version2 = std::is_same<decltype(vers2<T>(0)), metaprog::yes>::value;
+
+            static RGBc call1(T & obj, const iVec2 & pos, iBox2 & box, void * &data, mtools::metaprog::dummy<true> D) { return obj.getColorBox(pos, box, data); }
+            static RGBc call2(T & obj, const iVec2 & pos, iBox2 & box, void * &data, mtools::metaprog::dummy<true> D) { return obj.getColorBox(pos, box); }
+
+            static RGBc call1(T & obj, const iVec2 & pos, iBox2 & box, void * &data, mtools::metaprog::dummy<false> D) { return call2(obj, pos, box, data, mtools::metaprog::dummy<version2>()); }
+            static RGBc call2(T & obj, const iVec2 & pos, iBox2 & box, void * &data, mtools::metaprog::dummy<false> D)
+                {
+                box = iBox2(pos.X(), pos.X(), pos.Y(), pos.Y());
+                return GetColorSelector<T>::call(obj, pos, data);
+                }
+
+            public:
+
+                static const bool has_getColorBox = version1 | version2;
+
+                static RGBc call(T & obj, const iVec2 & pos, iBox2 & box, void * &data) { return call1(obj, pos, box, data, mtools::metaprog::dummy<version1>()); }
+
+            };
+
+
+
+        /**
+        * GetImageKey method selector.
+        *
+        * Detect if a type contains a method getImageKey() that returns a key identifying the image of a
+        * site: two sites with the same key must have the same image (for instance the key encodes the
+        * state of the site). When present, the LatticeDrawer class caches the images of the sites
+        * (already rescaled to the size of a site) by key and calls getImage() only for new keys.
+        *
+        * - iVec2 pos : the site.
+        *
+        * - void* & data : reference to an opaque value that identify the thread drawing (same as for
+        *                  GetColorSelector).
+        *
+        * The signature below are recognized with the following order:
+        *
+        *  uint64 getImageKey(iVec2 pos, void* & data)
+        *  uint64 getImageKey(iVec2 pos)
+        *
+        * If none of them is found, call() returns 0.
+        **/
+        template<typename T> class GetImageKeySelector
+            {
+            static void * dumptr;
+
+            template<typename U> static decltype((*(U*)(0)).getImageKey(iVec2(), dumptr), metaprog::yes()) vers1(int);
+            template<typename> static metaprog::no vers1(...);
+            static const bool version1 = std::is_same<decltype(vers1<T>(0)), metaprog::yes>::value;
+
+            template<typename U> static decltype((*(U*)(0)).getImageKey(iVec2()), metaprog::yes()) vers2(int);
+            template<typename> static metaprog::no vers2(...);
+            static const bool version2 = std::is_same<decltype(vers2<T>(0)), metaprog::yes>::value;
+
+            static uint64 call1(T & obj, const iVec2 & pos, void * &data, mtools::metaprog::dummy<true> D) { return (uint64)obj.getImageKey(pos, data); }
+            static uint64 call2(T & obj, const iVec2 & pos, void * &data, mtools::metaprog::dummy<true> D) { return (uint64)obj.getImageKey(pos); }
+
+            static uint64 call1(T & obj, const iVec2 & pos, void * &data, mtools::metaprog::dummy<false> D) { return call2(obj, pos, data, mtools::metaprog::dummy<version2>()); }
+            static uint64 call2(T & obj, const iVec2 & pos, void * &data, mtools::metaprog::dummy<false> D) { return 0; }
+
+            public:
+
+                static const bool has_getImageKey = version1 | version2;
+
+                static uint64 call(T & obj, const iVec2 & pos, void * &data) { return call1(obj, pos, data, mtools::metaprog::dummy<version1>()); }
+
+            };
+
+
+
     }
 
 /* end of file */
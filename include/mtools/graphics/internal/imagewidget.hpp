@@ -49,6 +49,8 @@ namespace mtools
 
             public:
 
+            static const int UPLOAD_TILE_SIZE = 64;     ///< size of the tiles compared when an Image is set
+
             /**
              * Constructor. Same as every FLTK widget. By default, no image is associated with the window
              * (so that it is drawn with its background color).
@@ -76,6 +78,10 @@ namespace mtools
             /**
              * Set the image to display. The image is cached into an offscreen buffer used when the window
              * must be redrawn. This method is threadsafe.
+             * 
+             * A copy of the last image set is kept: when the new image has the same size, it is compared
+             * with it by tiles of UPLOAD_TILE_SIZE x UPLOAD_TILE_SIZE pixels and only the tiles which
+             * changed are converted and sent to the offscreen buffer.
              *
              * @param   im  the new image to display, nullptr for no image at all.
              **/
@@ -126,6 +132,12 @@ namespace mtools
             /* callback called when copying the image into the offscreen buffer line by line */
             static void _drawLine_callback2(void * data, int x, int y, int w, uchar *buf);
 
+            /* callback called when copying a tile of the image into the offscreen buffer line by line */
+            static void _drawTile_callback(void * data, int x, int y, int w, uchar *buf);
+
+            /* a tile of an image */
+            struct _Tile { const Image * im; int x0, y0; };
+
             std::recursive_mutex _mutim;        // mutex for synchronization
 
             std::atomic<Fl_Offscreen>  _offbuf; // offscreen buffer
@@ -137,6 +149,9 @@ namespace mtools
             Image *       _saved_im;	// used for saving the image prior to the first drawing
             ProgressImg * _saved_im32;	// of the window in order to avoid a seg fault with X11
 
+            Image   _shadow;            // copy of the image in the offscreen buffer
+            bool    _shadowok;          // true if _shadow is the content of the offscreen buffer
+
         };
 
     }
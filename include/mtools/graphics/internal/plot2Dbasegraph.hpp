@@ -29,6 +29,7 @@
 #include <atomic>
 #include <limits>
 #include <cmath>
+#include <vector>
 
 
 namespace mtools
@@ -221,6 +222,17 @@ namespace mtools
         virtual double _function(double x) const = 0;
 
 
+        /**
+         * CAN BE OVERRIDEN : compute the extent of the graph over each of the nbcol screen columns
+         * [R.min[0] + i*w, R.min[0] + (i+1)*w[ (with w = R.lx()/nbcol). ymin[i] and ymax[i] are set to
+         * the min and max of the graph over column i (equal if the column is summarized by a single
+         * value, NaN if the graph is not defined there). When this method returns true, the line
+         * drawing uses these values instead of sampling _function() at the center of each column.
+         * The default implementation returns false.
+         **/
+        virtual bool _columns(const fBox2 & R, int nbcol, double * ymin, double * ymax) const { return false; }
+
+
         private:
 
 
@@ -271,6 +283,9 @@ namespace mtools
             /* make the drawing with linear interpolation */
             void _drawWithInterpolation(int depth, Image & im, const fBox2 & R, const RGBc coul, const float opacity, const int tickness);
 
+            /* make the drawing from the column extents returned by _columns() */
+            void _drawColumns(const std::vector<double> & ymin, const std::vector<double> & ymax, Image & im, const fBox2 & R, const RGBc coul, const float opacity, const int tickness);
+
             /* fill below or over */
              void _drawOverOrBelow(bool over, Image & im, const fBox2 & R, RGBc coul, const float opacity);
             
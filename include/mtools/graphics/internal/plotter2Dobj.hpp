@@ -32,6 +32,9 @@
 namespace mtools
 {
 
+    /* forward declaration */
+    class OffscreenPlotter2D;
+
 
     namespace internals_graphics
     {
@@ -282,6 +285,34 @@ namespace mtools
             virtual bool hasFavouriteRangeY();
 
 
+            /**
+             * Publish a bounding box for the object. Typically called by the simulation each time the
+             * object grows (e.g. with the range of a grid, which the grid maintains itself) so that the
+             * plotter never has to scan the object to find its extent. Cheap and thread-safe: can be
+             * called from any thread, at every step. An empty box removes the published range.
+             *
+             * The published box is returned by the default implementation of favouriteRangeX/Y() (and
+             * by Plot2DLattice when its domain is full) and is tracked by the follow mode of the plotter
+             * (see Plotter2D::follow()).
+             *
+             * @param   R   The bounding box of the object.
+             **/
+            void publishRange(fBox2 R);
+
+
+            /**
+             * Return the last box given to publishRange() (completely empty if none).
+             **/
+            fBox2 publishedRange() const;
+
+
+            /**
+             * Return the number of calls to publishRange() so far. Used by the plotter to detect that a
+             * new box was published.
+             **/
+            int64 publishedRangeVersion() const;
+
+
             /**
              * Request the plotter to refresh the drawing. Does nothing if not inserted. This method ask the
              * plotter to redraw the screen but it does not reset the drawing. To redraw this object from
@@ -452,6 +483,7 @@ namespace mtools
 
             friend class Plotter2DWindow;
             friend class Plot2DComposer;
+            friend class mtools::OffscreenPlotter2D;
 
             static const int _REQUEST_DETACH = 0;       ///< code when requesting to be detached
             static const int _REQUEST_REFRESH = 1;      ///< code when requesting a refresh of the picture
@@ -498,6 +530,37 @@ namespace mtools
             void _removed();
 
 
+            /**
+             * Same as _inserted() but for an owner without any window (e.g. OffscreenPlotter2D). May be
+             * called from any thread and the fltk thread is never used afterward: the callback is called
+             * directly from the thread that triggers it and the widgets of the option window are created
+             * but never shown.
+             *
+             * @param   cb                  the callback method to talk back to the owner.
+             * @param [in,out]  rm          the range manager associated with this object.
+             * @param [in,out]  data        The data that should be passed along when using the callback.
+             * @param [in,out]  data2       Additonnal data to be passed along when using the callback.
+             * @param   hintWidth           Width of the hint.
+             **/
+            void _insertedHeadless(pnot cb, RangeManager * rm, void * data, void * data2, int hintWidth);
+
+
+            /**
+             * Counterpart of _removed() for an object inserted with _insertedHeadless(). The owner must
+             * call it when it receives the 'detach' request.
+             **/
+            void _removedHeadless();
+
+
+            /**
+             * Set the priority of the working threads of the object w.r.t. the global ThreadScheduler.
+             * Called by the owner, does nothing if the object is not inserted.
+             *
+             * @param   prio    The new priority.
+             **/
+            void _threadsPriority(int prio);
+
+
             /**
              * The option window of the object. Return nullptr if not inserted.
              *
@@ -568,6 +631,10 @@ namespace mtools
             std::atomic<float> _opacity;                    // the opacity for drawing
             std::atomic<bool>  _drawOn;                     // is the object enabled.
             std::atomic<bool>  _suspended;                  // is the object suspended
+            std::atomic<bool>  _headless;                   // true if inserted in an owner without window (no widget, no fltk thread).
+            std::atomic<fBox2> _pubRange;                   // the last published range
+            std::atomic<int64> _pubVersion;                 // number of calls to publishRange()
+            int64 _pubSeen;                                 // version for which the range buttons were last updated
             std::string _name;                              // the object name
             int _progVal;                                   // the last value of the progress bar, -1 if thread stopped
             int _nbth;                                      // last number of thread queried.
@@ -33,6 +33,7 @@ namespace mtools
 {
     /* forward declaration */
     class Plot2DComposer;
+    class OffscreenPlotter2D;
 
     namespace internals_graphics
     {
@@ -56,6 +57,7 @@ namespace mtools
         {
             friend class View2DWidget;
             friend class Plot2DComposer;
+            friend class mtools::OffscreenPlotter2D;
 
             public:
 
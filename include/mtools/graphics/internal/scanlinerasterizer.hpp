@@ -0,0 +1,429 @@
+/** @file scanlinerasterizer.hpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+
+#include "../../misc/internal/mtools_export.hpp"
+#include "../../misc/misc.hpp"
+#include "../../misc/error.hpp"
+#include "../../maths/vec.hpp"
+#include "../../maths/box.hpp"
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+
+namespace mtools
+{
+
+	namespace internals_graphics
+	{
+
+		/**
+		 * Scanline rasterizer used by Image for filling polygons and thick curves.
+		 *
+		 * Edges are added in pixel coordinates (the center of pixel (i,j) is at (i,j)) and the image
+		 * is then swept row by row from top to bottom, with an active edge table. For each row, the
+		 * rasterizer computes the coverage of every pixel:
+		 *   - in antialiased mode, the exact area of the pixel covered by the shape (signed area
+		 *     accumulation, as in font engines) clamped to [0,1] (non-zero winding rule).
+		 *   - otherwise, 1 if the center of the pixel is inside the shape and 0 if not. In 'strict'
+		 *     mode, the pixels whose center lies on an edge are not filled.
+		 *
+		 * All the edges added are rasterized together: overlapping parts of the shape (e.g. the segments
+		 * of a thick polyline) are covered only once so each pixel is drawn exactly once.
+		 *
+		 * The object keeps its buffers between calls so it should be reused (Image uses a thread_local
+		 * instance).
+		 **/
+		class ScanlineRasterizer
+		{
+
+		public:
+
+			/** Default constructor. */
+			ScanlineRasterizer() : _W(0), _row(0), _rowmax(-1), _aa(true), _strict(false), _nextedge(0)
+				{
+				_clip.clear();
+				}
+
+
+			/**
+			 * Remove all the edges and set the clipping box. Only the pixels inside the box are
+			 * computed.
+			 *
+			 * @param	clip  	the clipping box (in pixels, inclusive).
+			 * @param	aa	  	true to compute the exact coverage and false to sample the centers of
+			 * 					the pixels.
+			 * @param	strict	(Only without aa) true to exclude the pixels whose center is on an edge.
+			 **/
+			void reset(const iBox2 & clip, bool aa, bool strict = false)
+				{
+				_clip = clip;
+				_aa = aa;
+				_strict = ((strict) && (!aa));
+				_edges.clear();
+				_hedges.clear();
+				_active.clear();
+				_nextedge = 0;
+				_row = 0;
+				_rowmax = -1;
+				_W = (_clip.isEmpty()) ? 0 : (_clip.max[0] - _clip.min[0] + 1);
+				_acc.assign((size_t)(_W + 3), 0.0f);
+				_cov.assign((size_t)(_W + 1), 0.0f);
+				_excl.assign((size_t)(_W + 1), 0);
+				_ymin = std::numeric_limits<double>::max();
+				_ymax = std::numeric_limits<double>::lowest();
+				}
+
+
+			/**
+			 * Add an edge of the shape, oriented from (x0,y0) to (x1,y1).
+			 *
+			 * @param	x0  	x-coordinate of the first endpoint.
+			 * @param	y0  	y-coordinate of the first endpoint.
+			 * @param	x1  	x-coordinate of the second endpoint.
+			 * @param	y1  	y-coordinate of the second endpoint.
+			 **/
+			void addEdge(double x0, double y0, double x1, double y1)
+				{
+				if (_W <= 0) return;
+				// move to the local frame where pixel i covers [i, i+1]
+				x0 += 0.5 - (double)_clip.min[0]; x1 += 0.5 - (double)_clip.min[0];
+				y0 += 0.5; y1 += 0.5;
+				if ((std::isnan(x0)) || (std::isnan(y0)) || (std::isnan(x1)) || (std::isnan(y1))) return;
+				if ((std::max(y0, y1) <= (double)_clip.min[1]) || (std::min(y0, y1) >= (double)(_clip.max[1] + 1))) return; // rows outside of the clipping box
+				if (y0 == y1)
+					{
+					if (_strict) { _hedges.push_back({ std::min(x0, x1), y0, std::max(x0, x1), y0, 0.0, 0.0f }); }
+					return;
+					}
+				// split the edge where it crosses the left and right sides of the clipping box: the
+				// parts outside are moved onto the sides, which does not change the coverage inside.
+				const double W = (double)_W;
+				double t[4]; int nt = 0;
+				t[nt++] = 0.0;
+				if (((x0 < 0) && (x1 > 0)) || ((x0 > 0) && (x1 < 0))) { t[nt++] = x0 / (x0 - x1); }
+				if (((x0 < W) && (x1 > W)) || ((x0 > W) && (x1 < W))) { t[nt++] = (x0 - W) / (x0 - x1); }
+				t[nt++] = 1.0;
+				if ((nt == 4) && (t[1] > t[2])) std::swap(t[1], t[2]);
+				for (int k = 0; k < nt - 1; k++)
+					{
+					const double ya = (k == 0) ? y0 : y0 + t[k] * (y1 - y0);
+					const double yb = (k == nt - 2) ? y1 : y0 + t[k + 1] * (y1 - y0);
+					const double xa = (k == 0) ? x0 : x0 + t[k] * (x1 - x0);
+					const double xb = (k == nt - 2) ? x1 : x0 + t[k + 1] * (x1 - x0);
+					_push(_clamp(xa, W), ya, _clamp(xb, W), yb);
+					}
+				}
+
+
+			/**
+			 * Add a closed polygon.
+			 *
+			 * @param	nbvertices	Number of vertices.
+			 * @param	tab		  	the vertices.
+			 **/
+			template<typename VEC> void addPolygon(size_t nbvertices, const VEC * tab)
+				{
+				if (nbvertices < 2) return;
+				for (size_t i = 0; i < nbvertices; i++)
+					{
+					const VEC & P = tab[i];
+					const VEC & Q = tab[(i + 1 == nbvertices) ? 0 : (i + 1)];
+					addEdge((double)P.X(), (double)P.Y(), (double)Q.X(), (double)Q.Y());
+					}
+				}
+
+
+			/**
+			 * Add a thick segment: the region swept by the square [-h,h]x[-h,h] when its center moves
+			 * from P1 to P2 (i.e. the union of the pen dots drawn along the segment).
+			 *
+			 * @param	P1	first endpoint.
+			 * @param	P2	second endpoint.
+			 * @param	h 	half side of the square.
+			 **/
+			void addThickSegment(fVec2 P1, fVec2 P2, double h)
+				{
+				typedef std::pair<double, double> _P;
+				_P pts[8] = { _P(P1.X() - h, P1.Y() - h), _P(P1.X() + h, P1.Y() - h), _P(P1.X() + h, P1.Y() + h), _P(P1.X() - h, P1.Y() + h),
+							  _P(P2.X() - h, P2.Y() - h), _P(P2.X() + h, P2.Y() - h), _P(P2.X() + h, P2.Y() + h), _P(P2.X() - h, P2.Y() + h) };
+				// convex hull (monotone chain) so that all the hexagons have the same orientation
+				std::sort(pts, pts + 8);
+				_P hull[16];
+				int k = 0;
+				for (int i = 0; i < 8; i++)
+					{
+					while ((k >= 2) && (_cross(hull[k - 2], hull[k - 1], pts[i]) <= 0)) k--;
+					hull[k++] = pts[i];
+					}
+				for (int i = 6, t = k + 1; i >= 0; i--)
+					{
+					while ((k >= t) && (_cross(hull[k - 2], hull[k - 1], pts[i]) <= 0)) k--;
+					hull[k++] = pts[i];
+					}
+				for (int i = 0; i < k - 1; i++) { addEdge(hull[i].first, hull[i].second, hull[i + 1].first, hull[i + 1].second); }
+				}
+
+
+			/**
+			 * Prepare the sweep. Must be called once after all the edges have been added and before
+			 * calling nextRow().
+			 **/
+			void begin()
+				{
+				std::sort(_edges.begin(), _edges.end(), [](const _Edge & A, const _Edge & B) { return A.y0 < B.y0; });
+				_nextedge = 0;
+				_active.clear();
+				if ((_W <= 0) || (_edges.empty())) { _row = 0; _rowmax = -1; return; }
+				_row = std::max<int64>(_clip.min[1], (int64)std::floor(_ymin)) - 1;
+				_rowmax = std::min<int64>(_clip.max[1], (int64)std::ceil(_ymax) - 1);
+				}
+
+
+			/**
+			 * A run of pixels of the current row.
+			 **/
+			struct Span
+				{
+				int64	x0, x1;		// pixels [x0, x1] (x-coordinates in the image)
+				bool	constant;	// true if the coverage is constant on the run
+				float	cov;		// the coverage when constant
+				};
+
+
+			/**
+			 * Compute the coverage of the next row.
+			 *
+			 * The row is described as a list of spans (sorted from left to right, the pixels not in a
+			 * span have zero coverage). The coverage is constant on the spans between edges and it is
+			 * given pixel by pixel (via coverage()) on the spans that contain an edge.
+			 *
+			 * @return	false when there is no more row to draw.
+			 **/
+			bool nextRow()
+				{
+				if (_row >= _rowmax) return false;
+				_row++;
+				const double ytop = (double)_row; // row covers [ytop, ytop + 1] in the local frame
+				// update the active edge table
+				const double ylim = _aa ? (ytop + 1.0) : (ytop + 0.5);
+				while ((_nextedge < _edges.size()) && (_edges[_nextedge].y0 <= ylim)) { _active.push_back(_nextedge++); }
+				size_t j = 0;
+				for (size_t i = 0; i < _active.size(); i++) { if (_edges[_active[i]].y1 > ytop) _active[j++] = _active[i]; }
+				_active.resize(j);
+				_cells.clear();
+				_spans.clear();
+				if (_aa) { for (size_t i : _active) { _accumulateAA(_edges[i], ytop); } }
+				else { for (size_t i : _active) { _accumulateCenter(_edges[i], ytop + 0.5); } }
+				if (_strict)
+					{
+					for (auto & e : _hedges)
+						{ // pixels on an horizontal edge are not filled
+						if (e.y0 != ytop + 0.5) continue;
+						const int64 ha = std::max<int64>(0, (int64)std::ceil(e.x0 - 0.5));
+						const int64 hb = std::min<int64>(_W - 1, (int64)std::floor(e.x1 - 0.5));
+						for (int64 k = ha; k <= hb; k++) { _excl[(size_t)k] = 1; }
+						if (ha <= hb) _cells.push_back({ ha, hb });
+						}
+					}
+				if (_cells.empty()) return true;
+				// merge the ranges of modified cells
+				std::sort(_cells.begin(), _cells.end(), [](const _Range & A, const _Range & B) { return A.a < B.a; });
+				size_t m = 0;
+				for (size_t i = 1; i < _cells.size(); i++)
+					{
+					if (_cells[i].a <= _cells[m].b + 1) { if (_cells[i].b > _cells[m].b) _cells[m].b = _cells[i].b; }
+					else { _cells[++m] = _cells[i]; }
+					}
+				_cells.resize(m + 1);
+				// prefix sums
+				float * acc = _acc.data();
+				float * cov = _cov.data();
+				float s = 0.0f;
+				int64 prev = 0;
+				for (auto & R : _cells)
+					{
+					const int64 a = R.a;
+					const int64 b = std::min<int64>(R.b, _W - 1);
+					if (a > prev)
+						{ // constant run between two ranges of cells
+						const float c = _clampcov(s);
+						if (c > 0.0f) _spans.push_back({ prev + _clip.min[0], a - 1 + _clip.min[0], true, c });
+						}
+					if (a > b) break;
+					for (int64 k = a; k <= b; k++) { s += acc[k]; acc[k] = 0.0f; cov[k] = _clampcov(s); }
+					if (_strict)
+						{
+						for (int64 k = a; k <= b; k++) { if (_excl[(size_t)k]) { cov[k] = 0.0f; _excl[(size_t)k] = 0; } }
+						}
+					_spans.push_back({ a + _clip.min[0], b + _clip.min[0], false, 0.0f });
+					prev = b + 1;
+					}
+				std::fill(acc + _W, acc + _W + 3, 0.0f); // cells on the right of the clipping box
+				return true;
+				}
+
+
+			/** The current row (y-coordinate in the image). */
+			MTOOLS_FORCEINLINE int64 row() const { return _row; }
+
+
+			/** Number of spans in the current row. */
+			MTOOLS_FORCEINLINE size_t nbSpans() const { return _spans.size(); }
+
+
+			/** Return a span of the current row. */
+			MTOOLS_FORCEINLINE const Span & span(size_t i) const { return _spans[i]; }
+
+
+			/** Coverage in [0,1] of pixel (x, row()). x must be inside a non-constant span. */
+			MTOOLS_FORCEINLINE float coverage(int64 x) const { return _cov[(size_t)(x - _clip.min[0])]; }
+
+
+		private:
+
+			struct _Range { int64 a, b; };
+
+			struct _Edge
+				{
+				double	x0, y0, x1, y1;	// endpoints in the local frame, y0 < y1
+				double	dxdy;			// slope
+				float	dir;			// +1 if the edge goes down and -1 if it goes up
+				};
+
+
+			static MTOOLS_FORCEINLINE double _clamp(double x, double W) { return (x < 0) ? 0 : ((x > W) ? W : x); }
+
+
+			static MTOOLS_FORCEINLINE double _cross(const std::pair<double, double> & O, const std::pair<double, double> & A, const std::pair<double, double> & B) { return (A.first - O.first)*(B.second - O.second) - (A.second - O.second)*(B.first - O.first); }
+
+
+			void _push(double xa, double ya, double xb, double yb)
+				{
+				if (ya == yb) return;
+				float dir = 1.0f;
+				if (ya > yb) { std::swap(xa, xb); std::swap(ya, yb); dir = -1.0f; }
+				_edges.push_back({ xa, ya, xb, yb, (xb - xa) / (yb - ya), dir });
+				if (ya < _ymin) _ymin = ya;
+				if (yb > _ymax) _ymax = yb;
+				}
+
+
+			static MTOOLS_FORCEINLINE float _clampcov(float v) { v = std::abs(v); return (v > 1.0f) ? 1.0f : v; }
+
+
+			MTOOLS_FORCEINLINE void _touch(int64 a, int64 b) { _cells.push_back({ a, b }); }
+
+
+			/* add the signed area contribution of the part of edge e inside the row [ytop, ytop+1] */
+			void _accumulateAA(const _Edge & e, double ytop)
+				{
+				const double ya = std::max(e.y0, ytop);
+				const double yb = std::min(e.y1, ytop + 1.0);
+				if (yb <= ya) return;
+				float * acc = _acc.data();
+				const float d = (float)(yb - ya) * e.dir;
+				const double xa = e.x0 + (ya - e.y0)*e.dxdy;
+				const double xb = e.x0 + (yb - e.y0)*e.dxdy;
+				const double x0 = std::min(xa, xb);
+				const double x1 = std::max(xa, xb);
+				const double x0floor = std::floor(x0);
+				const int64 x0i = (int64)x0floor;
+				const double x1ceil = std::ceil(x1);
+				const int64 x1i = (int64)x1ceil;
+				if (x1i <= x0i + 1)
+					{ // the edge stays inside a single pixel
+					const float xmf = (float)(0.5*(xa + xb) - x0floor);
+					acc[x0i] += d - d*xmf;
+					acc[x0i + 1] += d*xmf;
+					_touch(x0i, x0i + 1);
+					return;
+					}
+				const float s = (float)(1.0 / (x1 - x0));
+				const float x0f = (float)(x0 - x0floor);
+				const float a0 = 0.5f*s*(1.0f - x0f)*(1.0f - x0f);
+				const float x1f = (float)(x1 - x1ceil + 1.0);
+				const float am = 0.5f*s*x1f*x1f;
+				acc[x0i] += d*a0;
+				if (x1i == x0i + 2)
+					{
+					acc[x0i + 1] += d*(1.0f - a0 - am);
+					}
+				else
+					{
+					const float a1 = s*(1.5f - x0f);
+					acc[x0i + 1] += d*(a1 - a0);
+					const float ds = d*s;
+					for (int64 k = x0i + 2; k < x1i - 1; k++) { acc[k] += ds; }
+					const float a2 = a1 + (float)(x1i - x0i - 3)*s;
+					acc[x1i - 1] += d*(1.0f - a2 - am);
+					}
+				acc[x1i] += d*am;
+				_touch(x0i, x1i);
+				}
+
+
+			/* add the winding contribution of edge e at height yc (center of the row) */
+			void _accumulateCenter(const _Edge & e, double yc)
+				{
+				if ((yc < e.y0) || (yc >= e.y1)) return;
+				const double xc = e.x0 + (yc - e.y0)*e.dxdy - 0.5;
+				const double fx = std::floor(xc);
+				int64 k = (int64)fx + 1;	// first pixel whose center is strictly on the right of the edge
+				if (k < 0) k = 0; else if (k > _W) k = _W;
+				_acc[(size_t)k] += e.dir;
+				if ((_strict) && (fx == xc) && (k >= 1) && (k <= _W)) { _excl[(size_t)(k - 1)] = 1; }
+				_touch(((_strict) && (k >= 1)) ? (k - 1) : k, k);
+				}
+
+
+			iBox2				_clip;			// clipping box
+			int64				_W;				// width of the clipping box
+			int64				_row;			// current row
+			int64				_rowmax;		// last row
+			bool				_aa;			// antialiased mode
+			bool				_strict;		// exclude the boundary (non antialiased mode only)
+			double				_ymin, _ymax;	// vertical extent of the edges (local frame)
+
+			std::vector<_Edge>	_edges;			// edges sorted by y0
+			std::vector<_Edge>	_hedges;		// horizontal edges (strict mode only)
+			std::vector<size_t>	_active;		// active edge table
+			size_t				_nextedge;		// next edge to activate
+
+			std::vector<float>	_acc;			// accumulation buffer
+			std::vector<float>	_cov;			// coverage of the current row
+			std::vector<char>	_excl;			// excluded pixels of the current row (strict mode)
+			std::vector<_Range>	_cells;			// ranges of cells modified in the current row
+			std::vector<Span>	_spans;			// spans of the current row
+		};
+
+	}
+
+}
+
+
+/* end of file */
+
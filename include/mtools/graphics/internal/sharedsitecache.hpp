@@ -0,0 +1,264 @@
+/** @file sharedsitecache.hpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+
+#include "../../misc/misc.hpp"
+#include "../../maths/vec.hpp"
+#include "../../maths/box.hpp"
+#include "../rgbc.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+
+namespace mtools
+{
+
+
+namespace internals_graphics
+{
+
+
+    /**
+     * State shared by all the LatticeDrawers drawing the same object (e.g. an overview and a zoomed
+     * view of the same lattice in two Plotter2D windows).
+     *
+     * - A world-space cache of the colors of the sites. The plane is cut in tiles of TILE x TILE
+     *   sites which are stored in NB_SHARDS hash maps, each protected by its own mutex. The cache is
+     *   only used while at least two drawers are attached (shared() is true) so that a single view
+     *   does not pay for it.
+     *
+     * - A common budget of helper threads: while the object is shared, the threads used by the
+     *   drawers for parallel pixel drawing are taken from a single pool of (number of cores - 1)
+     *   threads instead of each drawer spawning its own.
+     *
+     * Instances are obtained with get() which returns the same instance for the same object (and
+     * type) as long as one drawer holds it.
+     **/
+    class SharedSiteCache
+    {
+
+    public:
+
+        static const int TILE_BITS = 6;                         ///< tiles of 64x64 sites
+        static const int64 TILE = ((int64)1) << TILE_BITS;      ///< size of a tile
+        static const size_t NB_SHARDS = 64;                     ///< number of independent hash maps
+        static const size_t DEFAULT_MAX_TILES = 2048;           ///< default maximum number of tiles kept (about 35MB)
+
+
+        /**
+         * Return the shared state associated with an object of type T (created if needed).
+         **/
+        template<typename T> static std::shared_ptr<SharedSiteCache> get(const T * obj)
+            {
+            static std::mutex mut;
+            static std::map<const T *, std::weak_ptr<SharedSiteCache> > registry;
+            std::lock_guard<std::mutex> lock(mut);
+            for (auto it = registry.begin(); it != registry.end();) { if (it->second.expired()) { it = registry.erase(it); } else { ++it; } } // remove dead entries
+            std::shared_ptr<SharedSiteCache> p = registry[obj].lock();
+            if (!p) { p = std::make_shared<SharedSiteCache>(); registry[obj] = p; }
+            return p;
+            }
+
+
+        /** Constructor. Use get() instead. */
+        SharedSiteCache() : _users(0), _gen(0), _maxTilesPerShard(DEFAULT_MAX_TILES / NB_SHARDS), _freeThreads(std::max<int>(0, (int)std::thread::hardware_concurrency() - 1))
+            {
+            }
+
+
+        /** Register / unregister a drawer. */
+        void attach() { ++_users; }
+        void detach() { --_users; }
+
+
+        /** True if several drawers are attached (the cache and the thread budget are in use). */
+        bool shared() const { return (_users > 1); }
+
+
+        /**
+         * Look for the color of a site.
+         *
+         * @param           pos The site.
+         * @param [out]     col its color (if found).
+         * @param [out]     gen the generation of the cache, to pass to insert().
+         *
+         * @return  true if the color was found.
+         **/
+        bool find(iVec2 pos, RGBc & col, uint64 & gen)
+            {
+            gen = _gen;
+            const int64 tx = _tileCoord(pos.X()), ty = _tileCoord(pos.Y());
+            const size_t off = (size_t)(((pos.Y() - ty*TILE) << TILE_BITS) + (pos.X() - tx*TILE));
+            Shard & S = _shards[_shardIndex(tx, ty)];
+            std::lock_guard<std::mutex> lock(S.mut);
+            auto it = S.tiles.find(iVec2(tx, ty));
+            if (it == S.tiles.end()) return false;
+            const Tile & T = *(it->second);
+            if (((T.valid[off >> 6] >> (off & 63)) & 1) == 0) return false;
+            col = T.col[off];
+            return true;
+            }
+
+
+        /**
+         * Store the color of a site. Ignored if the cache was cleared since gen was obtained from
+         * find() (the color may be outdated).
+         **/
+        void insert(iVec2 pos, RGBc col, uint64 gen)
+            {
+            const int64 tx = _tileCoord(pos.X()), ty = _tileCoord(pos.Y());
+            const size_t off = (size_t)(((pos.Y() - ty*TILE) << TILE_BITS) + (pos.X() - tx*TILE));
+            Shard & S = _shards[_shardIndex(tx, ty)];
+            std::lock_guard<std::mutex> lock(S.mut);
+            if (gen != _gen) return;
+            std::unique_ptr<Tile> & P = S.tiles[iVec2(tx, ty)];
+            if (!P)
+                {
+                if (S.tiles.size() > _maxTilesPerShard) { S.tiles.clear(); return; } // full: start over (the new entry is removed too)
+                P.reset(new Tile());
+                }
+            P->col[off] = col;
+            P->valid[off >> 6] |= (((uint64)1) << (off & 63));
+            }
+
+
+        /** The current generation of the cache (incremented by clear()). */
+        uint64 generation() const { return _gen; }
+
+
+        /**
+         * Empty the cache (the colors of the object changed).
+         **/
+        void clear()
+            {
+            for (size_t i = 0; i < NB_SHARDS; i++) { _shards[i].mut.lock(); }
+            ++_gen;
+            for (size_t i = 0; i < NB_SHARDS; i++) { _shards[i].tiles.clear(); _shards[i].mut.unlock(); }
+            }
+
+
+        /**
+         * Forget the colors of the sites in some boxes (only these sites changed).
+         **/
+        void invalidate(const std::vector<iBox2> & boxes)
+            {
+            for (size_t i = 0; i < NB_SHARDS; i++) { _shards[i].mut.lock(); }
+            ++_gen; // colors computed before the call must not be inserted
+            for (const iBox2 & B : boxes)
+                {
+                if (B.isEmpty()) continue;
+                for (int64 ty = _tileCoord(B.min[1]); ty <= _tileCoord(B.max[1]); ty++) for (int64 tx = _tileCoord(B.min[0]); tx <= _tileCoord(B.max[0]); tx++)
+                    {
+                    Shard & S = _shards[_shardIndex(tx, ty)];
+                    auto it = S.tiles.find(iVec2(tx, ty));
+                    if (it == S.tiles.end()) continue;
+                    Tile & T = *(it->second);
+                    const int64 x0 = std::max<int64>(B.min[0], tx*TILE), x1 = std::min<int64>(B.max[0], tx*TILE + TILE - 1);
+                    const int64 y0 = std::max<int64>(B.min[1], ty*TILE), y1 = std::min<int64>(B.max[1], ty*TILE + TILE - 1);
+                    for (int64 y = y0; y <= y1; y++) for (int64 x = x0; x <= x1; x++)
+                        {
+                        const size_t off = (size_t)(((y - ty*TILE) << TILE_BITS) + (x - tx*TILE));
+                        T.valid[off >> 6] &= ~(((uint64)1) << (off & 63));
+                        }
+                    }
+                }
+            for (size_t i = 0; i < NB_SHARDS; i++) { _shards[i].mut.unlock(); }
+            }
+
+
+        /**
+         * Set the maximum number of tiles kept in the cache (each tile uses about 17KB).
+         **/
+        void maxTiles(size_t nb) { _maxTilesPerShard = std::max<size_t>(1, nb / NB_SHARDS); }
+
+
+        /**
+         * Take at most nb helper threads from the common budget.
+         *
+         * @return  the number of threads granted (between 0 and nb).
+         **/
+        int acquireThreads(int nb)
+            {
+            int cur = _freeThreads;
+            while (true)
+                {
+                const int k = std::min<int>(nb, cur);
+                if (k <= 0) return 0;
+                if (_freeThreads.compare_exchange_weak(cur, cur - k)) return k;
+                }
+            }
+
+
+        /** Give back helper threads obtained with acquireThreads(). */
+        void releaseThreads(int nb) { _freeThreads += nb; }
+
+
+    private:
+
+        SharedSiteCache(const SharedSiteCache &) = delete;
+        SharedSiteCache & operator=(const SharedSiteCache &) = delete;
+
+        struct Tile
+            {
+            Tile() { memset(valid, 0, sizeof(valid)); }
+            RGBc    col[TILE*TILE];         // colors of the sites
+            uint64  valid[TILE*TILE / 64];  // bit set if the color is known
+            };
+
+        struct TileHash
+            {
+            size_t operator()(const iVec2 & V) const { return (size_t)((((uint64)V.X()) * 0x9E3779B97F4A7C15ULL) ^ ((uint64)V.Y())); }
+            };
+
+        struct Shard
+            {
+            std::mutex mut;
+            std::unordered_map<iVec2, std::unique_ptr<Tile>, TileHash> tiles;
+            };
+
+        static inline int64 _tileCoord(int64 x) { return ((x >= 0) ? (x / TILE) : (-((-x - 1) / TILE) - 1)); }
+
+        static inline size_t _shardIndex(int64 tx, int64 ty) { return (size_t)((((uint64)tx) * 31 + ((uint64)ty)) % NB_SHARDS); }
+
+        std::atomic<int>     _users;                // number of drawers attached
+        std::atomic<uint64>  _gen;                  // incremented by clear()
+        std::atomic<size_t>  _maxTilesPerShard;     // maximum number of tiles in a shard
+        std::atomic<int>     _freeThreads;          // helper threads available
+        Shard                _shards[NB_SHARDS];    // the tiles
+    };
+
+
+}
+
+}
+
+
+/* end of file */
+
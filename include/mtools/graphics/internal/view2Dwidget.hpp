@@ -194,6 +194,28 @@ namespace mtools
             virtual void resize(int X, int Y, int	W, int H);
 
 
+            /**
+            * Set a text displayed in the upper left corner of the view, over the image (one line per '\n').
+            * An empty string removes the overlay.
+            *
+            * @warning This method should be called exclusively from the fltk thread.
+            **/
+            void overlayText(const std::string & txt);
+
+
+            /**
+            * Time (in milliseconds) taken by the last complete redraw of the widget (blitting of the image
+            * by fltk).
+            **/
+            double lastDrawTime() const { return _drawTime; }
+
+
+            /**
+            * Time (in milliseconds) taken by the last call to improveImageFactor().
+            **/
+            double lastImproveTime() const { return _improveTime; }
+
+
    
    protected:
 
@@ -218,6 +240,9 @@ namespace mtools
 
         private:
 
+            /* implementation of improveImageFactor() */
+            void _improveImageFactor(const Image * im);
+
             /* swap the stocIm pointer */
             inline void swapStocIm() {auto tmp = _stocIm; _stocIm = _stocImAlt; _stocImAlt = tmp;}
 
@@ -255,6 +280,10 @@ namespace mtools
 
             FastRNG _g_fgen;			// fast RNG
 
+            std::string _overlay;					// overlay text
+            std::atomic<double> _drawTime;			// duration of the last complete redraw (ms)
+            std::atomic<double> _improveTime;		// duration of the last call to improveImageFactor (ms)
+
         };
 
 
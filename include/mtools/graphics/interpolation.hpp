@@ -25,6 +25,11 @@
 #include "../maths/box.hpp"
 #include "../misc/error.hpp"
 
+#include <map>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
 
 namespace mtools
 {
@@ -104,6 +109,166 @@ namespace mtools
     double monotoneCubicInterpolation(double x, const std::map<double, double> & map);
 
 
+    /**
+     * Interpolation of a function known at a set of points x_0 < x_1 < ... < x_{n-1}.
+     *
+     * The points are copied into flat arrays and the coefficients of the polynomial on each segment
+     * are computed once, so an evaluation costs a search of the segment and a cubic polynomial
+     * (instead of a walk in a std::map and the computation of the tangents for each call of
+     * linearInterpolation(x, map) ...). The interpolation matches the 4 points functions above,
+     * the first and last segments using the slope of the segment as outer tangent (as in
+     * Plot2DMap). The value is NaN outside of [x_0, x_{n-1}].
+     *
+     * Evaluations at increasing x (e.g. one per screen column) should use the hint version of
+     * operator() or eval() which continue the search from the previous segment.
+     *
+     * @code
+     * Interpolator I(map, Interpolator::MONOTONE_CUBIC);
+     * size_t hint = 0;
+     * for (double x = a; x < b; x += eps) { y = I(x, hint); ... }
+     * @endcode
+     **/
+    class Interpolator
+    {
+
+    public:
+
+        static const int STEP = 0;              ///< piecewise constant: value at the left end of the segment.
+        static const int LINEAR = 1;            ///< linear interpolation.
+        static const int CUBIC = 2;             ///< cubic Hermite interpolation (Catmull-Rom like tangents).
+        static const int MONOTONE_CUBIC = 3;    ///< monotone cubic interpolation (Fritsch-Carlson).
+
+
+        /** Default constructor. No points: evaluations return NaN. */
+        Interpolator() : _type(LINEAR) {}
+
+
+        /**
+         * Construct from a map x -> y.
+         **/
+        template<typename T1, typename T2, typename Compare, typename Alloc> Interpolator(const std::map<T1, T2, Compare, Alloc> & map, int type = LINEAR) : _type(LINEAR)
+            {
+            set(map.begin(), map.end(), type);
+            }
+
+
+        /**
+         * Construct from arrays of abscissas (strictly increasing) and values.
+         **/
+        Interpolator(const double * x, const double * y, size_t n, int type = LINEAR) : _type(LINEAR)
+            {
+            set(x, y, n, type);
+            }
+
+
+        /**
+         * Set the points from a map x -> y. The storage is reused.
+         **/
+        template<typename T1, typename T2, typename Compare, typename Alloc> void set(const std::map<T1, T2, Compare, Alloc> & map, int type = LINEAR)
+            {
+            set(map.begin(), map.end(), type);
+            }
+
+
+        /**
+         * Set the points from a range of pairs (x,y) sorted by increasing x (e.g. a part of a map).
+         **/
+        template<typename InputIt> void set(InputIt first, InputIt last, int type = LINEAR)
+            {
+            _x.clear(); _y.clear();
+            for (; first != last; ++first) { _x.push_back((double)first->first); _y.push_back((double)first->second); }
+            _type = type;
+            _compute();
+            }
+
+
+        /**
+         * Set the points from arrays of abscissas (strictly increasing) and values.
+         **/
+        void set(const double * x, const double * y, size_t n, int type = LINEAR)
+            {
+            _x.assign(x, x + n); _y.assign(y, y + n);
+            _type = type;
+            _compute();
+            }
+
+
+        /**
+         * Value at x.
+         **/
+        double operator()(double x) const
+            {
+            size_t hint = 0;
+            return operator()(x, hint);
+            }
+
+
+        /**
+         * Value at x. The search for the segment containing x starts at hint (and its neighbour)
+         * which is updated, so a sweep at increasing x costs O(1) per evaluation.
+         **/
+        double operator()(double x, size_t & hint) const
+            {
+            if ((_x.size() == 0) || (!(x >= _x.front())) || (!(x <= _x.back()))) return mtools::NaN;
+            if (_x.size() == 1) return _y[0];
+            hint = _segment(x, hint);
+            return _eval(hint, x);
+            }
+
+
+        /**
+         * Evaluate at n abscissas: y[i] = value at x[i]. Fastest when the x[i] are increasing.
+         **/
+        void eval(const double * x, double * y, size_t n) const;
+
+
+        /** Number of points. */
+        size_t size() const { return _x.size(); }
+
+
+        /** The interpolation type (STEP, LINEAR, CUBIC or MONOTONE_CUBIC). */
+        int type() const { return _type; }
+
+
+    private:
+
+        /* index i of the segment [x_i, x_{i+1}] containing x, starting the search at hint */
+        size_t _segment(double x, size_t hint) const
+            {
+            const size_t nseg = _x.size() - 1;
+            if ((hint < nseg) && (x >= _x[hint]))
+                {
+                if (x < _x[hint + 1]) return hint;
+                if ((hint + 1 < nseg) && (x < _x[hint + 2])) return hint + 1;
+                }
+            size_t i = (size_t)(std::upper_bound(_x.begin(), _x.end(), x) - _x.begin());
+            return ((i == 0) ? 0 : ((i > nseg) ? (nseg - 1) : (i - 1)));
+            }
+
+        /* value at x in segment i */
+        double _eval(size_t i, double x) const
+            {
+            if ((x == _x[i]) || (_type == STEP)) return _y[i];
+            if (x == _x[i + 1]) return _y[i + 1];
+            const double * c = _c.data() + 3 * i;
+            if (std::isnan(c[2])) return _evalSpecial(i, x);
+            const double dx = x - _x[i];
+            return _y[i] + dx*(c[0] + dx*(c[1] + dx*c[2]));
+            }
+
+        /* segment with non finite values: use the 4 points functions */
+        double _evalSpecial(size_t i, double x) const;
+
+        /* compute the coefficients */
+        void _compute();
+
+        int                 _type;  // interpolation type
+        std::vector<double> _x;     // abscissas
+        std::vector<double> _y;     // values
+        std::vector<double> _c;     // 3 coefficients per segment (degree 1,2,3 in x - x_i), NaN for a segment with non finite values
+    };
+
+
 
 
 
@@ -30,12 +30,18 @@
 #include "../misc/metaprog.hpp"
 #include "../random/gen_fastRNG.hpp"
 #include "internal/getcolorselector.hpp"
+#include "internal/sharedsitecache.hpp"
 
 #include <algorithm>
 #include <ctime>
+#include <chrono>
+#include <thread>
 #include <mutex>
 #include <atomic>
 #include <vector>
+#include <cstring>
+#include <unordered_map>
+#include <memory>
 
 
 namespace mtools
@@ -57,6 +63,13 @@ namespace mtools
  * 
  * - The template LatticeObj must implement a method `getColor()` which return the
  * color associated with a given site. The method should be made as fast as possible.
+ * If the object also implements `getColorBatch()` (see GetColorBatchSelector), the fast and
+ * stochastic pixel drawings query the sites a whole line at a time with it.
+ *
+ * If the object implements `getColorBox()` (see GetColorBoxSelector) which also returns a box of
+ * sites with the same color (e.g. with Grid_factor::findFullBox()), the fast and perfect pixel
+ * drawings use it instead: a single query colors all the pixels inside the box, and the boxes found
+ * on a line of pixels are reused for the next one.
  * 
  * - If TYPEIMAGE is selected, the plotter can request an image of the sites by calling the
  * object method `const Image * getImage(iVec pos,iVec size)` if it is present.
@@ -74,6 +87,24 @@ namespace mtools
  * - The `getImage` method must return a pointer to a Image object. It can be nullptr: in this
  * case, the drawer interpret this as the site being completely transparent.
  *
+ * - If the object also implements `uint64 getImageKey(iVec2 pos)` (see GetImageKeySelector) which
+ * returns the same key for sites with the same image (e.g. a hash of the state of the site), the
+ * sprites are cached by key, already rescaled to the size of a site. getImage() is then only
+ * called for keys not yet seen and redraws reduce to blits. Without it, the same cache keyed by
+ * the address of the returned image can be enabled with `spriteCache(true)` when the images
+ * returned by getImage() are never modified.
+ *
+ * - The pixel drawing can be shared between several threads with `nbThreads()`: each call to work()
+ * then splits the remaining part of the image into tiles processed in parallel. This requires the
+ * getColor() (and getColorBox() if present) method of the object to be callable concurrently.
+ *
+ * - Several drawers of the same object (e.g. an overview and a zoomed view in two Plotter2D
+ * windows) share a world-space cache of the colors of the sites returned by getColor() /
+ * getColorBatch() and a common budget of helper threads (see SharedSiteCache), so the views
+ * draw on common results and do not oversubscribe the CPU. A single drawer does not use the
+ * cache. resetDrawing() empties the cache of all the drawers of the object. Disable it with
+ * `shareCache(false)` if the colors depend on the drawer.
+ *
  *        
  * @tparam  LatticeObj  Type of the lattice object. Can be any class provided that satisfy the 
  * 						requierement of GetColorSelector and possible GetImageSelector.
@@ -92,15 +123,21 @@ public:
 
     static const bool HAS_GETCOLOR = mtools::GetColorSelector<LatticeObj>::has_getColor;
     static const bool HAS_GETIMAGE = mtools::GetImageSelector<LatticeObj>::has_getImage;
+    static const bool HAS_GETCOLORBATCH = mtools::GetColorBatchSelector<LatticeObj>::has_getColorBatch;
+    static const bool HAS_GETIMAGEKEY = mtools::GetImageKeySelector<LatticeObj>::has_getImageKey;
+    static const bool HAS_GETCOLORBOX = mtools::GetColorBoxSelector<LatticeObj>::has_getColorBox;
+
+    static const size_t MAX_CACHED_SPRITES = 4096;  ///< the sprite cache is emptied when it reaches this size
 
     /**
      * Constructor. Set the lattice object that will be drawn. 
      *
      * @param [in,out]  obj The object to draw, it must survive the drawer.
      **/
-    LatticeDrawer(LatticeObj * obj) : _g_requestAbort(0), _g_current_quality(0), _g_obj(obj), _g_drawingtype(TYPEPIXEL), _g_reqdrawtype(TYPEPIXEL), _g_imSize(201, 201), _g_r(-100.5, 100.5, -100.5, 100.5), _g_redraw_im(true), _g_redraw_pix(true), _g_removeColor(REMOVE_NOTHING), _g_opacify(1.0f)
+    LatticeDrawer(LatticeObj * obj) : _g_requestAbort(0), _g_current_quality(0), _g_obj(obj), _g_drawingtype(TYPEPIXEL), _g_reqdrawtype(TYPEPIXEL), _g_imSize(201, 201), _g_r(-100.5, 100.5, -100.5, 100.5), _g_redraw_im(true), _g_redraw_pix(true), _g_removeColor(REMOVE_NOTHING), _g_opacify(1.0f), _g_panReuse(true), _g_spriteCache(HAS_GETIMAGEKEY), _g_nbThreads(1), _g_shared(internals_graphics::SharedSiteCache::get<LatticeObj>(obj)), _g_shareCache(true), _sprites_sx(0), _sprites_sy(0), _boxP(0)
 		{
         static_assert((HAS_GETCOLOR || HAS_GETIMAGE), "No compatible getColor / getImage / operator() method found...");
+        _g_shared->attach();
         _initInt16Buf();
         domainFull();
         if (hasImage()) { setImageType(TYPEIMAGE); } // use images by default if available.
@@ -116,6 +153,7 @@ public:
             {
             std::lock_guard<std::timed_mutex> lg(_g_lock); // and wait until we aquire the lock 
             _removeInt16Buf(); // remove the int16 buffer
+            if (_g_shareCache) { _g_shared->detach(); }
             }
         }
 
@@ -200,6 +238,120 @@ public:
     void transparentColor(int type) { MTOOLS_ASSERT((type == REMOVE_BLACK)|| (type == REMOVE_WHITE)|| (type == REMOVE_NOTHING)); _g_removeColor = type; }
 
 
+    /**
+     * Query if a completed pixel-type drawing is reused when the range changes by a translation of
+     * an integer number of pixels (pan) or by a zoom in of an integer factor.
+     **/
+    bool panReuse() const { return _g_panReuse; }
+
+
+    /**
+     * Enable/disable the reuse of a completed pixel-type drawing (enabled by default).
+     *
+     * - On a pan by an integer number of pixels, the buffer is scrolled and only the exposed strips
+     *   are redrawn.
+     * - On a zoom in by an integer factor, the enlarged previous drawing replaces the fast drawing
+     *   phase and the drawer goes on directly with the next phases.
+     *
+     * @param   status  true to enable, false to always redraw from scratch.
+     **/
+    void panReuse(bool status) { _g_panReuse = status; }
+
+
+    /**
+     * Query the number of threads used for pixel-type drawings.
+     **/
+    int nbThreads() const { return _g_nbThreads; }
+
+
+    /**
+     * Set the number of threads used for pixel-type drawings (1 by default). With nb > 1, work()
+     * splits the image into tiles processed by nb threads (the calling thread being one of them),
+     * so the getColor() / getColorBox() methods of the object must be thread-safe. Calling this
+     * method interrupts any work() in progress but keeps the current drawing.
+     *
+     * @param   nb  The number of threads (0 = number of hardware threads).
+     **/
+    void nbThreads(int nb)
+        {
+        if (nb <= 0) nb = std::max<int>(1, (int)std::thread::hardware_concurrency());
+        ++_g_requestAbort; // request immediate stop of the work method if active.
+            {
+            std::lock_guard<std::timed_mutex> lg(_g_lock); // and wait until we aquire the lock 
+            --_g_requestAbort; // and then remove the stop request
+            _g_nbThreads = nb;
+            }
+        }
+
+
+    /**
+     * Query if the colors are shared with the other drawers of the same object.
+     **/
+    bool shareCache() const { return _g_shareCache; }
+
+
+    /**
+     * Enable / disable the sharing of the colors and of the helper threads with the other drawers
+     * of the same object (enabled by default). Calling this method interrupts any work() in
+     * progress but keeps the current drawing.
+     **/
+    void shareCache(bool status)
+        {
+        ++_g_requestAbort; // request immediate stop of the work method if active.
+            {
+            std::lock_guard<std::timed_mutex> lg(_g_lock); // and wait until we aquire the lock 
+            --_g_requestAbort; // and then remove the stop request
+            if (status == _g_shareCache) return;
+            if (status) { _g_shared->attach(); } else { _g_shared->detach(); }
+            _g_shareCache = status;
+            }
+        }
+
+
+    /**
+     * Query if the sprites returned by getImage() are cached (image-type drawing).
+     **/
+    bool spriteCache() const { return _g_spriteCache; }
+
+
+    /**
+     * Enable/disable the sprite cache (image-type drawing). Enabled by default when the object has a
+     * getImageKey() method. Otherwise the sprites are identified by their address, so enable it only
+     * if the images returned by getImage() are never modified (e.g. a fixed set of images, one per
+     * state of a site). Calling this method interrupts any work() in progress.
+     *
+     * @param   status  true to enable the cache.
+     **/
+    void spriteCache(bool status)
+        {
+        ++_g_requestAbort; // request immediate stop of the work method if active.
+            {
+            std::lock_guard<std::timed_mutex> lg(_g_lock); // and wait until we aquire the lock 
+            --_g_requestAbort; // and then remove the stop request
+            _g_spriteCache = status;
+            _sprites.clear();
+            _g_redraw_im = true;   // request redraw
+            }
+        }
+
+
+    /**
+     * Empty the sprite cache. Call it when the images associated with the keys (or the images
+     * returned by getImage() when there is no getImageKey() method) have changed. Calling this method
+     * interrupts any work() in progress.
+     **/
+    void clearSpriteCache()
+        {
+        ++_g_requestAbort; // request immediate stop of the work method if active.
+            {
+            std::lock_guard<std::timed_mutex> lg(_g_lock); // and wait until we aquire the lock 
+            --_g_requestAbort; // and then remove the stop request
+            _sprites.clear();
+            _g_redraw_im = true;   // request redraw
+            }
+        }
+
+
     /**
      * Get the definition domain of the lattice (does not interrupt any computation in progress).
      * By default this is everything.
@@ -319,6 +471,37 @@ public:
             --_g_requestAbort; // and then remove the stop request
             _g_redraw_im = true;
             _g_redraw_pix = true;
+            _g_shared->clear(); // the colors of the object may have changed
+            if (_g_drawingtype == TYPEPIXEL) { _workPixel(0); } else { _workImage(0); } // work for a zero length period to update the quality and sync things.
+            }
+        }
+
+
+    /**
+     * Redraw only some sites of the lattice: the colors of the sites in boxes changed but the rest
+     * of the drawing is still valid (e.g. the boxes returned by Grid_basic::takeChanges() while a
+     * simulation is running). The pixels covering these sites are redrawn (first quickly, then
+     * perfectly) and the rest of the current drawing is kept. Behaves as resetDrawing() if the
+     * current drawing is not a completed pixel drawing of the current range or if the sites cover
+     * a large part of the image. Calling this method interrupt any work() in progress. This method
+     * is fast, it does not draw anything.
+     **/
+    void redrawSites(const std::vector<iBox2> & boxes)
+        {
+        ++_g_requestAbort; // request immediate stop of the work method if active.
+            {
+            std::lock_guard<std::timed_mutex> lg(_g_lock); // and wait until we aquire the lock 
+            --_g_requestAbort; // and then remove the stop request
+            if (_redrawSites(boxes))
+                {
+                if ((_g_shareCache) && (_g_shared->shared())) { _g_shared->invalidate(boxes); } // only these colors may have changed
+                }
+            else
+                {
+                _g_redraw_im = true;
+                _g_redraw_pix = true;
+                _g_shared->clear();
+                }
             if (_g_drawingtype == TYPEPIXEL) { _workPixel(0); } else { _workImage(0); } // work for a zero length period to update the quality and sync things.
             }
         }
@@ -439,6 +622,11 @@ private:
     std::atomic<int>  _g_removeColor;       // one of REMOVE_NOTHING, REMOVE_WHITE, REMOVE_BLACK
     std::atomic<float> _g_opacify;          // opacification ratio for pixel drawing
     iBox2             _g_domR;              // definition domain of the object 
+    std::atomic<bool> _g_panReuse;          // true to reuse the previous pixel drawing on pan / integer zoom
+    std::atomic<bool> _g_spriteCache;       // true to cache the sprites returned by getImage()
+    std::atomic<int>  _g_nbThreads;         // number of threads used for pixel drawing
+    std::shared_ptr<internals_graphics::SharedSiteCache> _g_shared; // cache and thread budget shared with the other drawers of the object
+    bool              _g_shareCache;        // true if attached to _g_shared
 
 
 
@@ -461,7 +649,12 @@ private:
 fBox2           _pr;                    // the current range
 uint32 			_counter1,_counter2;	// counter for the number of pixel added in each cell: counter1 for cells < (_qi,_qj) and counter2 for cells >= (_qi,qj)
 uint32 			_qi,_qj;		        // position where we stopped previously
-int 			_phase;			        // the current phase of the drawing
+int 			_phase;			        // the current phase of the drawing (4 = redrawing the strips exposed by a pan)
+std::vector<iBox2> _strips;             // pixel boxes exposed by a pan (or covering the sites given to redrawSites()), to redraw
+std::vector<char> _stripMark;           // pixels to redraw (used by redrawSites())
+size_t          _stripIndex;            // current strip
+int             _stripPass;             // 0 = fast drawing of the strips, 1 = perfect drawing
+int64           _stripDone, _stripTotal;// number of pixels done / to do (for the quality)
 
 
 
@@ -474,6 +667,7 @@ void _qualityPixelDraw() const
         case 1: {_g_current_quality = _getLinePourcent(_counter2, _nbPointToDraw(_pr, _int16_buffer_dim), 1, 25); break; }
         case 2: {_g_current_quality = _getLinePourcent(_qj, (int)_int16_buffer_dim.Y(), 26, 99); break; }
         case 3: {_g_current_quality = 100; break; }
+        case 4: {_g_current_quality = (int)(26 + (73 * _stripDone) / ((_stripTotal > 0) ? _stripTotal : 1)); break; }
         default: MTOOLS_INSURE(false); // wtf are we doing here
         }
     return;
@@ -485,14 +679,307 @@ inline RGBc getColor(iVec2 pos)
     {
     if (!_g_domR.isInside(pos)) return RGBc::c_Transparent;
     void * data = nullptr;
+    if ((_g_shareCache) && (_g_shared->shared()))
+        { // other drawers of the object: use the common cache
+        RGBc coul;
+        uint64 gen;
+        if (_g_shared->find(pos, coul, gen)) return coul;
+        coul = mtools::GetColorSelector<LatticeObj>::call(*_g_obj, pos, data);
+        _g_shared->insert(pos, coul, gen);
+        return coul;
+        }
     return mtools::GetColorSelector<LatticeObj>::call(*_g_obj, pos, data);
     }
 
 
+/* compute the colors of the sites _bpos[0..n-1] into _bcol with getColorBatch(), transparent
+   white for the sites outside of the definition domain (which are not queried) */
+void _getColorBatch(size_t n)
+    {
+    _bcol.resize(n);
+    _bin.clear();
+    if ((_g_shareCache) && (_g_shared->shared()))
+        { // other drawers of the object: only query the sites not in the common cache
+        const uint64 gen0 = _g_shared->generation(); // generation before the queries
+        uint64 gen;
+        _bidx.clear();
+        for (size_t k = 0; k < n; k++)
+            {
+            _bcol[k] = RGBc::c_Transparent;
+            if ((_g_domR.isInside(_bpos[k])) && (!_g_shared->find(_bpos[k], _bcol[k], gen))) { _bin.push_back(_bpos[k]); _bidx.push_back(k); }
+            }
+        if (_bin.size() == 0) return;
+        _bout.resize(_bin.size());
+        void * data = nullptr;
+        mtools::GetColorBatchSelector<LatticeObj>::call(*_g_obj, _bin.data(), _bin.size(), _bout.data(), data);
+        for (size_t u = 0; u < _bin.size(); u++) { _bcol[_bidx[u]] = _bout[u]; _g_shared->insert(_bin[u], _bout[u], gen0); }
+        return;
+        }
+    for (size_t k = 0; k < n; k++) { if (_g_domR.isInside(_bpos[k])) _bin.push_back(_bpos[k]); }
+    _bout.resize(_bin.size());
+    void * data = nullptr;
+    mtools::GetColorBatchSelector<LatticeObj>::call(*_g_obj, _bin.data(), _bin.size(), _bout.data(), data);
+    size_t u = 0;
+    for (size_t k = 0; k < n; k++) { _bcol[k] = (_g_domR.isInside(_bpos[k])) ? _bout[u++] : RGBc::c_Transparent; }
+    }
+
+
+/* return the color of a site and a box containing it with the same color (singleton outside of the
+   definition domain) */
+inline RGBc _getColorBox(iVec2 pos, iBox2 & B)
+    {
+    if (!_g_domR.isInside(pos)) { B = iBox2(pos.X(), pos.X(), pos.Y(), pos.Y()); return RGBc::c_Transparent; }
+    void * data = nullptr;
+    const RGBc coul = mtools::GetColorBoxSelector<LatticeObj>::call(*_g_obj, pos, B, data);
+    B.intersectionBox(_g_domR);
+    if (!B.isInside(pos)) { B = iBox2(pos.X(), pos.X(), pos.Y(), pos.Y()); } // just to be on the safe side..
+    return coul;
+    }
+
+
+/* start a new line of pixels: the boxes of the current line become those of the previous line */
+inline void _newBoxRow() { _boxPrev.swap(_boxCur); _boxCur.clear(); _boxP = 0; }
+
+
+/* forget all the boxes (the drawing restarts) */
+inline void _clearBoxRows() { _boxPrev.clear(); _boxCur.clear(); _boxP = 0; }
+
+
+/* return true if all the sites of S have the same color (put in coul). Look first at the last box of
+   the current line, then at the boxes of the previous line and finally query the top left site of S */
+bool _colorBox(const iBox2 & S, RGBc & coul)
+    {
+    if ((_boxCur.size() > 0) && (_boxCur.back().first.contain(S))) { coul = _boxCur.back().second; return true; }
+    while ((_boxP < _boxPrev.size()) && (_boxPrev[_boxP].first.max[0] < S.min[0])) { _boxP++; }
+    if ((_boxP < _boxPrev.size()) && (_boxPrev[_boxP].first.contain(S)))
+        {
+        coul = _boxPrev[_boxP].second;
+        _boxCur.push_back(_boxPrev[_boxP]);
+        return true;
+        }
+    iBox2 B;
+    coul = _getColorBox({ S.min[0], S.max[1] }, B);
+    if (!B.contain(S)) return false;
+    _boxCur.push_back(std::pair<iBox2, RGBc>(B, coul));
+    return true;
+    }
+
+
+/* compute the perfect color of pixel (i,j) using getColorBox(): one query per run of sites with the
+   same color on a row of sites (or for a whole block of rows when the run covers the pixel width) */
+inline void _perfectPixelBox(int i, int j, const fBox2 & r, double px, double py)
+    {
+    fBox2 pixr(r.min[0] + i*px, r.min[0] + (i + 1)*px, r.max[1] - (j + 1)*py, r.max[1] - j*py);
+    iBox2 ipixr = pixr.integerEnclosingRect();
+    RGBc coul;
+    if (_colorBox(ipixr, coul)) { _setInt16Buf(i, j, coul); return; } // uniform pixel
+    _perfectPixelRuns(i, j, pixr, ipixr);
+    }
+
+
+/* compute the perfect color of pixel (i,j) with one getColorBox() query per run of sites with the
+   same color (does not use the boxes of the previous line) */
+inline void _perfectPixelRuns(int i, int j, const fBox2 & pixr, const iBox2 & ipixr)
+    {
+    double cr = 0.0, cg = 0.0, cb = 0.0, ca = 0.0, tot = 0.0;
+    for (int64 l = ipixr.min[1]; l <= ipixr.max[1];)
+        {
+        int64 lnext = l;
+        for (int64 k = ipixr.min[0]; k <= ipixr.max[0];)
+            {
+            iBox2 B;
+            const RGBc coul = _getColorBox({ k, l }, B);
+            const int64 k2 = std::min<int64>(B.max[0], ipixr.max[0]);
+            const int64 l2 = ((k == ipixr.min[0]) && (k2 == ipixr.max[0])) ? std::min<int64>(B.max[1], ipixr.max[1]) : l; // the box covers the width: take all its rows
+            const double ax = std::min<double>(pixr.max[0], k2 + 0.5) - std::max<double>(pixr.min[0], k - 0.5);
+            const double ay = std::min<double>(pixr.max[1], l2 + 0.5) - std::max<double>(pixr.min[1], l - 0.5);
+            const double a = ((ax > 0) && (ay > 0)) ? ax*ay : 0.0;
+            cr += (coul.comp.R*a); cg += (coul.comp.G*a); cb += (coul.comp.B*a); ca += (coul.comp.A*a);
+            tot += a;
+            lnext = l2;
+            k = k2 + 1;
+            }
+        l = lnext + 1;
+        }
+    _setInt16Buf(i, j, cr / tot, cg / tot, cb / tot, ca / tot);
+    }
+
+
+/* same as _drawPixel_fast() but with getColorBox(): a single query for each run of pixels inside a
+   box of sites with the same color (and no query at all if the box was found on the previous line) */
+void _drawPixel_fast_box(int maxtime_ms)
+    {
+    const fBox2 r = _pr;
+    const double px = ((double)r.lx()) / ((double)_int16_buffer_dim.X())  // size of a pixel
+               , py = ((double)r.ly()) / ((double)_int16_buffer_dim.Y());
+    _counter1 = 1;
+    const int lx = (int)_int16_buffer_dim.X();
+    if ((_qi == 0) && (_qj == 0)) { _clearBoxRows(); }
+    for (int j = _qj; j < _int16_buffer_dim.Y(); j++)
+        {
+        const int64 sy = (int64)floor(r.max[1] - (j + 0.5)*py + 0.5);
+        if (_qi == 0) { _newBoxRow(); }
+        int i = _qi; _qi = 0;
+        while (i < lx)
+            {
+            if (_isTime(maxtime_ms)) { _qi = i; _qj = j; return; }    // time's up : we quit
+            const int64 sx = (int64)floor(r.min[0] + (i + 0.5)*px + 0.5);
+            RGBc coul;
+            _colorBox(iBox2(sx, sx, sy, sy), coul); // always true for a single site
+            const int64 xmax = _boxCur.back().first.max[0];
+            do { _setInt16Buf(i, j, coul); i++; } while ((i < lx) && ((int64)floor(r.min[0] + (i + 0.5)*px + 0.5) <= xmax));
+            }
+        }
+    // we are done
+    _counter2 = _counter1; _qi = 0; _qj = 0;
+    if (_skipStochastic(r, _int16_buffer_dim)) { _phase = 2; } else { _phase = 1; } // go to next phase, skip stochastic if not needed.
+    return;
+    }
+
+
+/* same as _drawPixel_stochastic() but the pixels inside a box of uniform color are not sampled */
+void _drawPixel_stochastic_box(int maxtime_ms)
+    {
+    const fBox2 r = _pr;
+    const double px = ((double)r.lx()) / ((double)_int16_buffer_dim.X())  // size of a pixel
+               , py = ((double)r.ly()) / ((double)_int16_buffer_dim.Y());
+    const uint32 ndraw = _nbDrawPerTurn(r, _int16_buffer_dim);
+    const int lx = (int)_int16_buffer_dim.X();
+    while (_counter2 < _nbPointToDraw(r, _int16_buffer_dim))
+        {
+        if (_counter2 == _counter1) { ++_counter1; _clearBoxRows(); } // start of a loop: we increase counter1
+        for (int j = _qj; j < _int16_buffer_dim.Y(); j++)
+            {
+            if (_qi == 0) { _newBoxRow(); }
+            int i = _qi; _qi = 0;
+            for (; i < lx; i++)
+                {
+                if (_isTime(maxtime_ms)) { _qi = i; _qj = j; return; }    // time's up : we quit
+                const fBox2 pixr(r.min[0] + i*px, r.min[0] + (i + 1)*px, r.max[1] - (j + 1)*py, r.max[1] - j*py);
+                RGBc coul;
+                if (_colorBox(pixr.integerEnclosingRect(), coul)) { _addInt16Buf(i, j, coul.comp.R, coul.comp.G, coul.comp.B, coul.comp.A); continue; } // uniform pixel
+                uint32 R = 0, G = 0, B = 0, A = 0;
+                for (uint32 k = 0; k < ndraw; k++)
+                    {
+                    double x = r.min[0] + (i + _g_fgen.unif())*px, y = r.max[1] - (j + _g_fgen.unif())*py;   // pick a point at random inside the pixel
+                    coul = getColor({ (int64)floor(x + 0.5), (int64)floor(y + 0.5) });
+                    R += coul.comp.R; G += coul.comp.G; B += coul.comp.B; A += coul.comp.A;
+                    }
+                _addInt16Buf(i, j, R / ndraw, G / ndraw, B / ndraw, A / ndraw);
+                }
+            }
+        // we finished a loop
+        _counter2 = _counter1; _qi = 0; _qj = 0;
+        }
+    _phase = 2; // go to next phase
+    return;
+    }
+
+
+/* same as _drawPixel_perfect() but with getColorBox() */
+void _drawPixel_perfect_box(int maxtime_ms)
+    {
+    const fBox2 r = _pr;
+    const double px = ((double)r.lx()) / ((double)_int16_buffer_dim.X())  // size of a pixel
+               , py = ((double)r.ly()) / ((double)_int16_buffer_dim.Y());
+    _counter1 = 1; // counter1 must be 1
+    const int lx = (int)_int16_buffer_dim.X();
+    if ((_qi == 0) && (_qj == 0)) { _clearBoxRows(); }
+    for (int j = _qj; j < _int16_buffer_dim.Y(); j++)
+        {
+        if (_qi == 0) { _newBoxRow(); }
+        int i = _qi; _qi = 0;
+        for (; i < lx; i++)
+            {
+            if (_isTime(maxtime_ms)) { _qi = i; _qj = j; return; }    // time's up : we quit
+            _perfectPixelBox(i, j, r, px, py);
+            }
+        }
+    _qi = 0; _qj = 0; _counter2 = _counter1;
+    _phase = 3; // we are done, perfect drawing !
+    return;
+    }
+
+
+/* check the time at the end of a line (used by the batch versions which do not stop inside lines) */
+inline bool _isTimeLine(int maxtime_ms) { _tic = _maxtic; return _isTime(maxtime_ms); }
+
+
+/* same as _drawPixel_fast() but query the colors of each line at once with getColorBatch() */
+void _drawPixel_fast_batch(int maxtime_ms)
+    {
+    const fBox2 r = _pr;
+    const double px = ((double)r.lx()) / ((double)_int16_buffer_dim.X())  // size of a pixel
+               , py = ((double)r.ly()) / ((double)_int16_buffer_dim.Y());
+    _counter1 = 1;
+    const int lx = (int)_int16_buffer_dim.X();
+    _bpos.resize((size_t)lx);
+    for (int j = _qj; j < _int16_buffer_dim.Y(); j++)
+        {
+        if (_isTimeLine(maxtime_ms)) { _qi = 0; _qj = j; return; }    // time's up : we quit
+        const int64 sy = (int64)floor(r.max[1] - (j + 0.5)*py + 0.5);
+        for (int i = 0; i < lx; i++) { _bpos[(size_t)i] = { (int64)floor(r.min[0] + (i + 0.5)*px + 0.5), sy }; }
+        _getColorBatch((size_t)lx);
+        for (int i = 0; i < lx; i++) { _setInt16Buf(i, j, _bcol[(size_t)i]); }
+        }
+    // we are done
+    _counter2 = _counter1; _qi = 0; _qj = 0;
+    if (_skipStochastic(r, _int16_buffer_dim)) { _phase = 2; } else { _phase = 1; } // go to next phase, skip stochastic if not needed.
+    return;
+    }
+
+
+/* same as _drawPixel_stochastic() but query the samples of each line at once with getColorBatch() */
+void _drawPixel_stochastic_batch(int maxtime_ms)
+    {
+    const fBox2 r = _pr;
+    const double px = ((double)r.lx()) / ((double)_int16_buffer_dim.X())  // size of a pixel
+               , py = ((double)r.ly()) / ((double)_int16_buffer_dim.Y());
+    const uint32 ndraw = _nbDrawPerTurn(r, _int16_buffer_dim);
+    const int lx = (int)_int16_buffer_dim.X();
+    _bpos.resize((size_t)lx*ndraw);
+    while (_counter2 < _nbPointToDraw(r, _int16_buffer_dim))
+        {
+        if (_counter2 == _counter1) { ++_counter1; } // start of a loop: we increase counter1
+        for (int j = _qj; j < _int16_buffer_dim.Y(); j++)
+            {
+            if (_isTimeLine(maxtime_ms)) { _qi = 0; _qj = j; return; }    // time's up : we quit
+            size_t u = 0;
+            for (int i = 0; i < lx; i++)
+                {
+                for (uint32 k = 0; k < ndraw; k++)
+                    {
+                    double x = r.min[0] + (i + _g_fgen.unif())*px, y = r.max[1] - (j + _g_fgen.unif())*py;   // pick a point at random inside the pixel
+                    _bpos[u++] = { (int64)floor(x + 0.5), (int64)floor(y + 0.5) };
+                    }
+                }
+            _getColorBatch((size_t)lx*ndraw);
+            u = 0;
+            for (int i = 0; i < lx; i++)
+                {
+                uint32 R = 0, G = 0, B = 0, A = 0;
+                for (uint32 k = 0; k < ndraw; k++)
+                    {
+                    const RGBc coul = _bcol[u++];
+                    R += coul.comp.R; G += coul.comp.G; B += coul.comp.B; A += coul.comp.A;
+                    }
+                _addInt16Buf(i, j, R / ndraw, G / ndraw, B / ndraw, A / ndraw);
+                }
+            }
+        // we finished a loop
+        _counter2 = _counter1; _qi = 0; _qj = 0;
+        }
+    _phase = 2; // go to next phase
+    return;
+    }
+
+
 /* draw as much as possible of a fast drawing, return true if finished false otherwise
   if finished, then _qi,_qj are set to zero and counter1 = counter2 has the correct value */
 void _drawPixel_fast(int maxtime_ms)
 	{
+    if (HAS_GETCOLORBOX) { _drawPixel_fast_box(maxtime_ms); return; }
+    if (HAS_GETCOLORBATCH) { _drawPixel_fast_batch(maxtime_ms); return; }
     const fBox2 r = _pr;
     const double px = ((double)r.lx()) / ((double)_int16_buffer_dim.X())  // size of a pixel
                , py = ((double)r.ly()) / ((double)_int16_buffer_dim.Y()); 
@@ -526,6 +1013,8 @@ void _drawPixel_fast(int maxtime_ms)
   if finished, then _qi,_qj are set to zero and counter1 = counter2 has the correct value */
 void _drawPixel_stochastic(int maxtime_ms)
 	{
+    if (HAS_GETCOLORBOX) { _drawPixel_stochastic_box(maxtime_ms); return; }
+    if (HAS_GETCOLORBATCH) { _drawPixel_stochastic_batch(maxtime_ms); return; }
     const fBox2 r = _pr;
     const double px = ((double)r.lx()) / ((double)_int16_buffer_dim.X())  // size of a pixel
                , py = ((double)r.ly()) / ((double)_int16_buffer_dim.Y());
@@ -561,6 +1050,7 @@ void _drawPixel_stochastic(int maxtime_ms)
   if finished, then _qi,_qj are set to zero and counter1 = counter2 has the correct value */
 void _drawPixel_perfect(int maxtime_ms)
 	{
+    if (HAS_GETCOLORBOX) { _drawPixel_perfect_box(maxtime_ms); return; }
     const fBox2 r = _pr;
     const double px = ((double)r.lx()) / ((double)_int16_buffer_dim.X())  // size of a pixel
                , py = ((double)r.ly()) / ((double)_int16_buffer_dim.Y());
@@ -596,11 +1086,226 @@ void _drawPixel_perfect(int maxtime_ms)
 	}
 
 
+/* compute the perfect color of pixel (i,j) i.e. the average of the sites weighted by their area inside the pixel */
+inline void _perfectPixel(int i, int j, const fBox2 & r, double px, double py)
+    {
+    if (HAS_GETCOLORBOX) { _perfectPixelBox(i, j, r, px, py); return; }
+    fBox2 pixr(r.min[0] + i*px, r.min[0] + (i + 1)*px, r.max[1] - (j + 1)*py, r.max[1] - j*py);
+    iBox2 ipixr = pixr.integerEnclosingRect();
+    double cr = 0.0, cg = 0.0, cb = 0.0, ca = 0.0, tot = 0.0;
+    for (int64 k = ipixr.min[0]; k <= ipixr.max[0]; k++) for (int64 l = ipixr.min[1]; l <= ipixr.max[1]; l++)
+        {
+        double a = pixr.pointArea(fVec2((double)k, (double)l));
+        RGBc coul = getColor({ k, l });
+        cr += (coul.comp.R*a); cg += (coul.comp.G*a); cb += (coul.comp.B*a); ca += (coul.comp.A*a);
+        tot += a;
+        }
+    _setInt16Buf(i, j, cr / tot, cg / tot, cb / tot, ca / tot);
+    }
+
+
+/* redraw the strips exposed by a pan: first a fast drawing of all the strips then a perfect one.
+   The rest of the buffer is a completed drawing so the counters stay equal to 1 during the whole phase */
+void _drawPixel_strips(int maxtime_ms)
+    {
+    const fBox2 r = _pr;
+    const double px = ((double)r.lx()) / ((double)_int16_buffer_dim.X())  // size of a pixel
+               , py = ((double)r.ly()) / ((double)_int16_buffer_dim.Y());
+    while (_stripPass < 2)
+        {
+        while (_stripIndex < _strips.size())
+            {
+            const iBox2 B = _strips[_stripIndex];
+            for (int j = _qj; j <= B.max[1]; j++)
+                {
+                for (int i = _qi; i <= B.max[0]; i++)
+                    {
+                    if (_isTime(maxtime_ms)) { _qi = i; _qj = j; return; }    // time's up : we quit
+                    if (_stripPass == 0)
+                        {
+                        const iVec2 pos((int64)floor(r.min[0] + (i + 0.5)*px + 0.5), (int64)floor(r.max[1] - (j + 0.5)*py + 0.5));
+                        RGBc coul;
+                        if ((!HAS_GETCOLORBOX) || (!_colorBox(iBox2(pos.X(), pos.X(), pos.Y(), pos.Y()), coul))) { coul = getColor(pos); }
+                        _setInt16Buf(i, j, coul);
+                        }
+                    else
+                        {
+                        _perfectPixel(i, j, r, px, py);
+                        }
+                    _stripDone++;
+                    }
+                _qi = (int)B.min[0];
+                }
+            _stripIndex++;
+            if (_stripIndex < _strips.size()) { _qi = (int)_strips[_stripIndex].min[0]; _qj = (int)_strips[_stripIndex].min[1]; }
+            }
+        _stripPass++;
+        _stripIndex = 0;
+        if (_strips.size() > 0) { _qi = (int)_strips[0].min[0]; _qj = (int)_strips[0].min[1]; }
+        }
+    _strips.clear();
+    _qi = 0; _qj = 0;
+    _phase = 3; // done, the whole buffer is a perfect drawing again
+    }
+
+
+/* scroll the buffer: the new pixel (i,j) is the old pixel (i+dx, j+dy). The exposed part is cleared. */
+void _scrollInt16Buf(int64 dx, int64 dy)
+    {
+    const int64 lx = _int16_buffer_dim.X(), ly = _int16_buffer_dim.Y();
+    const int64 w = lx - std::abs(dx);                  // width of the part kept
+    const int64 isrc = (dx > 0) ? dx : 0, idst = (dx > 0) ? 0 : -dx;
+    for (int c = 0; c < 4; c++)
+        {
+        uint16 * plane = _int16_buffer + c*lx*ly;
+        if (dy >= 0)
+            {
+            for (int64 j = 0; j < ly - dy; j++) { memmove(plane + j*lx + idst, plane + (j + dy)*lx + isrc, (size_t)w*sizeof(uint16)); }
+            }
+        else
+            {
+            for (int64 j = ly - 1; j >= -dy; j--) { memmove(plane + j*lx + idst, plane + (j + dy)*lx + isrc, (size_t)w*sizeof(uint16)); }
+            }
+        }
+    for (const iBox2 & B : _strips)
+        {
+        for (int c = 0; c < 4; c++) for (int64 j = B.min[1]; j <= B.max[1]; j++)
+            {
+            memset(_int16_buffer + c*lx*ly + j*lx + B.min[0], 0, (size_t)(B.lx() + 1)*sizeof(uint16));
+            }
+        }
+    }
+
+
+/* compute the integer value of v if it is close enough to one, return false otherwise */
+inline static bool _closeToInteger(double v, int64 & iv)
+    {
+    iv = (int64)std::floor(v + 0.5);
+    return (std::abs(v - (double)iv) < 1.0e-3);
+    }
+
+
+/* try to reuse the previous (completed) drawing when the new range is a translation by an integer
+   number of pixels: the buffer is scrolled and only the exposed strips are redrawn. */
+bool _panPixel()
+    {
+    const int64 lx = _int16_buffer_dim.X(), ly = _int16_buffer_dim.Y();
+    const double px = _pr.lx() / lx, py = _pr.ly() / ly;
+    if ((std::abs(_g_r.lx() - _pr.lx()) > 1.0e-3*px) || (std::abs(_g_r.ly() - _pr.ly()) > 1.0e-3*py)) return false; // not the same scale
+    int64 dx, dy;
+    if ((!_closeToInteger((_g_r.min[0] - _pr.min[0]) / px, dx)) || (!_closeToInteger((_pr.max[1] - _g_r.max[1]) / py, dy))) return false;
+    if ((std::abs(dx) >= lx) || (std::abs(dy) >= ly)) return false; // nothing to keep
+    _strips.clear();
+    if (dy > 0) { _strips.push_back(iBox2(0, lx - 1, ly - dy, ly - 1)); }
+    else if (dy < 0) { _strips.push_back(iBox2(0, lx - 1, 0, -dy - 1)); }
+    const int64 j0 = (dy < 0) ? -dy : 0, j1 = (dy > 0) ? (ly - 1 - dy) : (ly - 1);
+    if (dx > 0) { _strips.push_back(iBox2(lx - dx, lx - 1, j0, j1)); }
+    else if (dx < 0) { _strips.push_back(iBox2(0, -dx - 1, j0, j1)); }
+    _scrollInt16Buf(dx, dy);
+    _clearBoxRows();
+    _pr = _g_r;
+    _counter1 = 1; _counter2 = 1;
+    _stripIndex = 0; _stripPass = 0; _stripDone = 0; _stripTotal = 0;
+    for (const iBox2 & B : _strips) { _stripTotal += 2 * (B.lx() + 1)*(B.ly() + 1); }
+    if (_strips.size() == 0) { _qi = 0; _qj = 0; _phase = 3; return true; }
+    _qi = (int)_strips[0].min[0]; _qj = (int)_strips[0].min[1];
+    _phase = 4;
+    return true;
+    }
+
+
+/* prepare the redrawing of the pixels covering the sites in boxes (together with the strips not yet
+   redrawn). Return false if the whole drawing must be redone instead. */
+bool _redrawSites(const std::vector<iBox2> & boxes)
+    {
+    if ((_g_drawingtype != TYPEPIXEL) || (_g_redraw_pix) || (_g_imSize != _int16_buffer_dim) || (_g_r != _pr) || ((_phase != 3) && (_phase != 4))) return false;
+    const int64 lx = _int16_buffer_dim.X(), ly = _int16_buffer_dim.Y();
+    const double px = _pr.lx() / lx, py = _pr.ly() / ly;
+    _stripMark.assign((size_t)(lx*ly), 0);
+    int64 nb = 0;
+    auto mark = [&](int64 i0, int64 i1, int64 j0, int64 j1)
+        {
+        i0 = std::max<int64>(i0, 0); i1 = std::min<int64>(i1, lx - 1);
+        j0 = std::max<int64>(j0, 0); j1 = std::min<int64>(j1, ly - 1);
+        for (int64 j = j0; j <= j1; j++) for (int64 i = i0; i <= i1; i++)
+            {
+            char & m = _stripMark[(size_t)(j*lx + i)];
+            if (m == 0) { m = 1; nb++; }
+            }
+        };
+    auto pixel = [](double v, int64 n) -> int64 { return (int64)std::floor(std::max<double>(-1.0, std::min<double>((double)n, v))); };
+    if (_phase == 4) { for (const iBox2 & B : _strips) { mark(B.min[0], B.max[0], B.min[1], B.max[1]); } }
+    for (const iBox2 & S : boxes)
+        { // pixels intersecting the squares [x-0.5,x+0.5]x[y-0.5,y+0.5] of the sites of S
+        if (S.isEmpty()) continue;
+        mark(pixel((S.min[0] - 0.5 - _pr.min[0]) / px, lx), pixel((S.max[0] + 0.5 - _pr.min[0]) / px, lx),
+             pixel((_pr.max[1] - S.max[1] - 0.5) / py, ly), pixel((_pr.max[1] - S.min[1] + 0.5) / py, ly));
+        if (2*nb > lx*ly) return false; // faster to redraw everything
+        }
+    _strips.clear();
+    for (int64 j = 0; j < ly; j++)
+        { // one strip per run of marked pixels
+        const char * row = _stripMark.data() + j*lx;
+        int64 i = 0;
+        while (i < lx)
+            {
+            if (row[i] == 0) { i++; continue; }
+            const int64 i0 = i;
+            while ((i < lx) && (row[i] != 0)) { i++; }
+            _strips.push_back(iBox2(i0, i - 1, j, j));
+            }
+        }
+    _clearBoxRows();
+    _counter1 = 1; _counter2 = 1;
+    _stripIndex = 0; _stripPass = 0; _stripDone = 0; _stripTotal = 2 * nb;
+    if (_strips.size() == 0) { _qi = 0; _qj = 0; _phase = 3; return true; }
+    _qi = (int)_strips[0].min[0]; _qj = (int)_strips[0].min[1];
+    _phase = 4;
+    return true;
+    }
+
+
+/* try to reuse the previous (completed) drawing when the new range is a zoom in by an integer factor
+   aligned on the previous pixels: the enlarged drawing is used as the fast drawing phase. */
+bool _zoomPixel()
+    {
+    const int64 lx = _int16_buffer_dim.X(), ly = _int16_buffer_dim.Y();
+    const double px = _pr.lx() / lx, py = _pr.ly() / ly;
+    int64 k, ky, ox, oy;
+    if ((!_closeToInteger(_pr.lx() / _g_r.lx(), k)) || (!_closeToInteger(_pr.ly() / _g_r.ly(), ky)) || (k != ky) || (k < 2)) return false;
+    if ((!_closeToInteger((_g_r.min[0] - _pr.min[0]) / px, ox)) || (!_closeToInteger((_pr.max[1] - _g_r.max[1]) / py, oy))) return false;
+    if ((ox < 0) || (oy < 0) || (ox + (lx - 1) / k >= lx) || (oy + (ly - 1) / k >= ly)) return false; // must be inside the previous drawing
+    uint16 * nbuf = new uint16[(size_t)(lx*ly * 4)];
+    for (int c = 0; c < 4; c++)
+        {
+        const uint16 * src = _int16_buffer + c*lx*ly;
+        uint16 * dst = nbuf + c*lx*ly;
+        for (int64 j = 0; j < ly; j++)
+            {
+            const uint16 * srow = src + (oy + j / k)*lx + ox;
+            for (int64 i = 0; i < lx; i++) { dst[j*lx + i] = srow[i / k]; }
+            }
+        }
+    delete[] _int16_buffer;
+    _int16_buffer = nbuf;
+    _clearBoxRows();
+    _pr = _g_r;
+    _qi = 0; _qj = 0;
+    _counter1 = 1; _counter2 = 1; // the enlarged drawing counts as the fast drawing
+    if (_skipStochastic(_pr, _int16_buffer_dim)) { _phase = 2; } else { _phase = 1; }
+    return true;
+    }
+
+
 /* the main method for drawing a pixel image */
 void _workPixel(int maxtime_ms)
     {
     _startTimer();
     if (_g_imSize != _int16_buffer_dim) { _g_redraw_pix = true; } //set redraw to true if the size of the image changed
+    if ((_g_r != _pr) && (!_g_redraw_pix))
+        { // the range changed: try to reuse the previous drawing if it is complete
+        if ((!_g_panReuse) || (_phase != 3) || ((!_panPixel()) && (!_zoomPixel()))) { _g_redraw_pix = true; }
+        }
     if (_g_r != _pr) _g_redraw_pix = true; // set redraw to true if the range changed
     if (_g_redraw_pix)
         { // we must completly redraw, initialize everything
@@ -615,6 +1320,7 @@ void _workPixel(int maxtime_ms)
         {
         while ((_phase != 3) && (!_isTime(maxtime_ms)))
             {
+            if ((_g_nbThreads > 1) && (_phase <= 2)) { _drawPixel_parallel(maxtime_ms); continue; } // share the work between several threads
             switch (_phase)
                 {
                 case 0: // fast drawing phase : start from _qi,qj and make the fastest drawing possible
@@ -632,6 +1338,11 @@ void _workPixel(int maxtime_ms)
                     _drawPixel_perfect(maxtime_ms);
                     break;
                     }
+                case 4: // redraw the strips exposed by a pan
+                    {
+                    _drawPixel_strips(maxtime_ms);
+                    break;
+                    }
                 default: MTOOLS_INSURE(false); // wtf are we doing here
                 }
             }
@@ -642,6 +1353,144 @@ void _workPixel(int maxtime_ms)
 
 
 
+// ****************************************************************
+// MULTI-THREADED PIXEL DRAWING
+// ****************************************************************
+
+std::vector<FastRNG> _tgen;     // random generators of the threads (stochastic phase)
+
+
+/* compute pixel (i,j) for the fast (phase 0), stochastic (phase 1) or perfect (phase 2) drawing.
+   Only write the buffer entries of the pixel so it can be called concurrently for distinct pixels.
+   (B, cB) is a box of sites with color cB found previously by the calling thread (empty at first) */
+inline void _tilePixel(int phase, int i, int j, const fBox2 & r, double px, double py, uint32 ndraw, FastRNG & gen, iBox2 & B, RGBc & cB)
+    {
+    if (phase == 0)
+        {
+        const iVec2 pos((int64)floor(r.min[0] + (i + 0.5)*px + 0.5), (int64)floor(r.max[1] - (j + 0.5)*py + 0.5));
+        if (!B.isInside(pos))
+            {
+            if (HAS_GETCOLORBOX) { cB = _getColorBox(pos, B); } else { cB = getColor(pos); B = iBox2(pos.X(), pos.X(), pos.Y(), pos.Y()); }
+            }
+        _setInt16Buf(i, j, cB);
+        return;
+        }
+    const fBox2 pixr(r.min[0] + i*px, r.min[0] + (i + 1)*px, r.max[1] - (j + 1)*py, r.max[1] - j*py);
+    const iBox2 ipixr = pixr.integerEnclosingRect();
+    if (HAS_GETCOLORBOX)
+        {
+        if (!B.contain(ipixr)) { cB = _getColorBox({ ipixr.min[0], ipixr.max[1] }, B); }
+        if (B.contain(ipixr))
+            { // uniform pixel
+            if (phase == 1) { _addInt16Buf(i, j, cB.comp.R, cB.comp.G, cB.comp.B, cB.comp.A); } else { _setInt16Buf(i, j, cB); }
+            return;
+            }
+        }
+    if (phase == 1)
+        {
+        uint32 R = 0, G = 0, Bl = 0, A = 0;
+        for (uint32 k = 0; k < ndraw; k++)
+            {
+            const double x = r.min[0] + (i + gen.unif())*px, y = r.max[1] - (j + gen.unif())*py;   // pick a point at random inside the pixel
+            const RGBc coul = getColor({ (int64)floor(x + 0.5), (int64)floor(y + 0.5) });
+            R += coul.comp.R; G += coul.comp.G; Bl += coul.comp.B; A += coul.comp.A;
+            }
+        _addInt16Buf(i, j, R / ndraw, G / ndraw, Bl / ndraw, A / ndraw);
+        return;
+        }
+    if (HAS_GETCOLORBOX) { _perfectPixelRuns(i, j, pixr, ipixr); } else { _perfectPixel(i, j, r, px, py); }
+    }
+
+
+/* draw the current phase (0, 1 or 2) from position (_qi,_qj) with _g_nbThreads threads. The pixels
+   are cut in tiles which are handed out in increasing order and every tile taken is completed: the
+   pixels done always form a prefix of the buffer so (_qi,_qj) keeps its meaning. The calling thread
+   also processes tiles and checks the time. Return true if the end of the buffer was reached. */
+bool _drawPixel_tiles(int phase, int maxtime_ms)
+    {
+    const fBox2 r = _pr;
+    const int64 lx = _int16_buffer_dim.X(), tot = lx*_int16_buffer_dim.Y();
+    const double px = ((double)r.lx()) / ((double)lx)  // size of a pixel
+               , py = ((double)r.ly()) / ((double)_int16_buffer_dim.Y());
+    const uint32 ndraw = _nbDrawPerTurn(r, _int16_buffer_dim);
+    const int64 start = _qi + _qj*lx;
+    const int64 cost = (phase == 0) ? 1 : ((phase == 1) ? (int64)ndraw : std::max<int64>(1, (int64)_sitePerPixel(r, _int16_buffer_dim))); // queries per pixel
+    const int64 tile = std::max<int64>(16, std::min<int64>(1024, 16384 / cost)); // number of pixels in a tile
+    const int64 nbtiles = (tot - start + tile - 1) / tile;
+    size_t nbth = (size_t)std::max<int>(1, _g_nbThreads);
+    const bool budget = ((_g_shareCache) && (_g_shared->shared())); // helper threads taken from the budget common to the drawers of the object
+    if (budget) { nbth = 1 + (size_t)_g_shared->acquireThreads((int)nbth - 1); }
+    while (_tgen.size() < nbth) { _tgen.push_back(FastRNG()); _tgen.back().discard(1000003ULL*_tgen.size()); } // distinct sequences for each thread
+    std::atomic<int64> next(0);
+    std::atomic<bool> stop(false);
+    auto work = [&](size_t t)
+        {
+        iBox2 B;
+        RGBc cB;
+        while ((!stop) && (_g_requestAbort == 0))
+            {
+            const int64 k = next.fetch_add(1);
+            if (k >= nbtiles) return;
+            const int64 a = start + k*tile, b = std::min<int64>(tot, a + tile);
+            for (int64 u = a; u < b; u++) { _tilePixel(phase, (int)(u % lx), (int)(u / lx), r, px, py, ndraw, _tgen[t], B, cB); }
+            if (t == 0)
+                { // the calling thread updates the quality and checks the time
+                _qj = (int)(std::min<int64>(tot, start + next*tile) / lx);
+                if (_isTimeLine(maxtime_ms)) { stop = true; }
+                }
+            }
+        };
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < nbth; t++) { threads.push_back(std::thread(work, t)); }
+    work(0);
+    stop = true;
+    for (auto & th : threads) { th.join(); }
+    if (budget) { _g_shared->releaseThreads((int)nbth - 1); }
+    const int64 pos = std::min<int64>(tot, start + std::min<int64>(nbtiles, next)*tile);
+    _qi = (int)(pos % lx); _qj = (int)(pos / lx);
+    return (pos == tot);
+    }
+
+
+/* multi-threaded version of _drawPixel_fast(), _drawPixel_stochastic() and _drawPixel_perfect() */
+void _drawPixel_parallel(int maxtime_ms)
+    {
+    _clearBoxRows(); // the boxes of the single threaded drawing are not used (nor kept up to date)
+    switch (_phase)
+        {
+        case 0:
+            {
+            _counter1 = 1;
+            if (!_drawPixel_tiles(0, maxtime_ms)) return;
+            _counter2 = _counter1; _qi = 0; _qj = 0;
+            if (_skipStochastic(_pr, _int16_buffer_dim)) { _phase = 2; } else { _phase = 1; } // go to next phase, skip stochastic if not needed.
+            return;
+            }
+        case 1:
+            {
+            while (_counter2 < _nbPointToDraw(_pr, _int16_buffer_dim))
+                {
+                if (_counter2 == _counter1) { ++_counter1; } // start of a loop: we increase counter1
+                if (!_drawPixel_tiles(1, maxtime_ms)) return;
+                _counter2 = _counter1; _qi = 0; _qj = 0; // we finished a loop
+                }
+            _phase = 2;
+            return;
+            }
+        case 2:
+            {
+            _counter1 = 1;
+            if (!_drawPixel_tiles(2, maxtime_ms)) return;
+            _qi = 0; _qj = 0; _counter2 = _counter1;
+            _phase = 3; // we are done, perfect drawing !
+            return;
+            }
+        default: MTOOLS_INSURE(false); // wtf are we doing here
+        }
+    }
+
+
+
 // *****************************
 // Dealing with the int16 buffer 
 // *****************************
@@ -842,6 +1691,8 @@ int					_exact_qi,_exact_qj;	// position we continue from for improving quality
 int					_exact_phase;			// 0 = remain undrawn sites, 1 = remain dirty site, 2 = finished
 uint32              _exact_Q0;              // number of images not drawn 
 uint32              _exact_Q23;             // number of images of good quality
+std::unordered_map<uint64, Image> _sprites; // sprite cache: key (or address) -> sprite rescaled to the site size (empty if none)
+int                 _sprites_sx, _sprites_sy; // site size of the cached sprites
 
 
 /* version when LatticeObj implement the getImage method */
@@ -864,6 +1715,44 @@ inline const Image * _getimage(int64 i, int64 j, int lx, int ly, mtools::metapro
 
 
 
+/* return the sprite of a site from the cache (adding it if needed) or nullptr if the site has no image */
+const Image * _cachedSprite(int64 i, int64 j)
+    {
+    if ((_sprites_sx != _exact_sx) || (_sprites_sy != _exact_sy) || (_sprites.size() >= MAX_CACHED_SPRITES))
+        { // new site size (or too many sprites): start again
+        _sprites.clear();
+        _sprites_sx = _exact_sx; _sprites_sy = _exact_sy;
+        }
+    const iVec2 pos(i, j);
+    if (!_g_domR.isInside(pos)) return nullptr;
+    const Image * spr = nullptr;
+    uint64 key;
+    if (HAS_GETIMAGEKEY)
+        {
+        void * data = nullptr;
+        key = mtools::GetImageKeySelector<LatticeObj>::call(*_g_obj, pos, data);
+        }
+    else
+        {
+        spr = _getimage(i, j, _exact_sx, _exact_sy, metaprog::dummy< HAS_GETIMAGE >());
+        if (spr == nullptr) return nullptr;
+        key = (uint64)((size_t)spr);
+        }
+    auto it = _sprites.find(key);
+    if (it == _sprites.end())
+        {
+        if (HAS_GETIMAGEKEY) { spr = _getimage(i, j, _exact_sx, _exact_sy, metaprog::dummy< HAS_GETIMAGE >()); }
+        Image im;
+        if ((spr != nullptr) && (!spr->isEmpty()))
+            {
+            im = ((spr->width() == _exact_sx) && (spr->height() == _exact_sy)) ? spr->get_standalone() : spr->get_rescale(10, _exact_sx, _exact_sy);
+            }
+        it = _sprites.emplace(key, std::move(im)).first;
+        }
+    return (it->second.isEmpty()) ? nullptr : &(it->second);
+    }
+
+
 /* improve the quality of the image */
 void _improveImage(int maxtime_ms)
 	{
@@ -882,7 +1771,18 @@ void _improveImage(int maxtime_ms)
 					{
 					if (fixstart) {i = _exact_qi; j= _exact_qj; fixstart = false;}
                     if (_isTime2(maxtime_ms)) { _exact_qi = i; _exact_qj = j; _qualityImageDraw();  return; }
-					if (_exact_qbuf(i,j) == 0) // site must be redrawn
+					if ((_exact_qbuf(i,j) == 0) && (_g_spriteCache)) // site must be redrawn, from the sprite cache
+						{
+                        --_exact_Q0; ++_exact_Q23;
+                        const Image * spr = _cachedSprite(_exact_r.min[0] + i, _exact_r.min[1] + j);
+                        if (spr == nullptr) { _exact_qbuf(i, j) = 3; }
+                        else
+                            {
+                            _exact_qbuf(i, j) = 2;
+                            _exact_im.blit(*spr, _exact_sx*i, _exact_sy*(_exact_qbuf.height() - 1 - j));
+                            }
+                        }
+					else if (_exact_qbuf(i,j) == 0) // site must be redrawn
 						{
                         --_exact_Q0;
                         const Image * spr = _getimage(_exact_r.min[0] + i, _exact_r.min[1] + j, _exact_sx, _exact_sy, metaprog::dummy< HAS_GETIMAGE >());
@@ -917,7 +1817,18 @@ void _improveImage(int maxtime_ms)
 					{
 					if (fixstart) {i = _exact_qi; j= _exact_qj; fixstart = false;}
                     if (_isTime2(maxtime_ms)) { _exact_qi = i; _exact_qj = j; _qualityImageDraw();  return; }
-					if (_exact_qbuf(i,j) == 1) // site must be redrawn
+					if ((_exact_qbuf(i,j) == 1) && (_g_spriteCache)) // site must be redrawn, from the sprite cache
+						{
+                        _exact_Q23++;
+                        const Image * spr = _cachedSprite(_exact_r.min[0] + i, _exact_r.min[1] + j);
+                        if (spr == nullptr) { _exact_qbuf(i, j) = 3; }
+                        else
+                            {
+                            _exact_qbuf(i, j) = 2;
+                            _exact_im.blit(*spr, _exact_sx*i, _exact_sy*(_exact_qbuf.height() - 1 - j));
+                            }
+                        }
+					else if (_exact_qbuf(i,j) == 1) // site must be redrawn
 						{
                         _exact_Q23++;
                         const Image * spr = _getimage(_exact_r.min[0] + i, _exact_r.min[1] + j, _exact_sx, _exact_sy, metaprog::dummy< HAS_GETIMAGE >());
@@ -1135,10 +2046,14 @@ inline void _drawOntoImage(Image & im, float op)
 static const int _maxtic = 100;	    // number of tic until we look for time
 static const int _maxtic2 = 10;   	// number of tic until we look for time
 int _tic;							// current tic
-clock_t _stime;						// start time
+std::chrono::steady_clock::time_point _stime;	// start time (wall clock: several threads may work at the same time)
 
 /* start the timer */
-inline void _startTimer() {_stime = clock(); _tic = _maxtic; }
+inline void _startTimer() {_stime = std::chrono::steady_clock::now(); _tic = _maxtic; }
+
+
+/* number of milliseconds elapsed since calling startTimer() */
+inline int64 _elapsedTime() const { return (int64)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - _stime).count(); }
 
 
 /* return true when time ms milliseconds has passed since calling startTimer() */
@@ -1148,7 +2063,7 @@ inline bool _isTime(uint32 ms)
     if (_g_requestAbort > 0) {return true; }
     if (_tic < _maxtic) return false;
     if (_g_drawingtype == TYPEPIXEL) { _qualityPixelDraw(); } else { _qualityImageDraw(); } // update the quality of the drawing
-	if (((clock() - _stime)*1000)/CLOCKS_PER_SEC > (clock_t)ms) {_tic = _maxtic; return true;}
+	if (_elapsedTime() > (int64)ms) {_tic = _maxtic; return true;}
 	_tic = 0;
 	return false;
 	}
@@ -1160,7 +2075,7 @@ inline bool _isTime2(uint32 ms)
     if (_g_requestAbort > 0) {return true; }
     if (_tic < _maxtic2) return false;
     if (_g_drawingtype == TYPEPIXEL) { _qualityPixelDraw(); } else { _qualityImageDraw(); } // update the quality of the drawing
-    if (((clock() - _stime) * 1000) / CLOCKS_PER_SEC > (clock_t)ms) { _tic = _maxtic; return true; }
+    if (_elapsedTime() > (int64)ms) { _tic = _maxtic; return true; }
     _tic = 0;
     return false;
     }
@@ -1210,6 +2125,16 @@ inline int _getLinePourcent(int qj,int maxqj,int minv,int maxv) const
 
 FastRNG _g_fgen; // fast RNG
 
+std::vector<iVec2> _bpos;   // buffer for the sites of a line (getColorBatch)
+std::vector<RGBc>  _bcol;   // buffer for their colors
+std::vector<iVec2> _bin;    // buffer for the sites inside the definition domain
+std::vector<RGBc>  _bout;   // buffer for the colors returned by getColorBatch()
+std::vector<size_t> _bidx;  // index in _bpos of the sites queried (shared cache)
+
+std::vector<std::pair<iBox2, RGBc> > _boxPrev;  // boxes of uniform color found on the previous line of pixels (getColorBox)
+std::vector<std::pair<iBox2, RGBc> > _boxCur;   // boxes found on the current line
+size_t _boxP;                                   // position in _boxPrev
+
 
 };
 
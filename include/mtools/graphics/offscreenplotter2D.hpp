@@ -0,0 +1,284 @@
+/** @file offscreenplotter2D.hpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include "../misc/internal/mtools_export.hpp"
+#include "../maths/vec.hpp"
+#include "../maths/box.hpp"
+#include "../misc/error.hpp"
+#include "image.hpp"
+#include "rgbc.hpp"
+#include "internal/rangemanager.hpp"
+#include "plot2Daxes.hpp"
+#include "plot2Dgrid.hpp"
+
+#include <vector>
+#include <mutex>
+
+
+namespace mtools
+{
+
+    /* forward declaration */
+    namespace internals_graphics
+    {
+        class Plotter2DObj;     // basic class of a plottable object
+    }
+
+
+    /**
+     * Offscreen plotter. Same as Plotter2D but without any window: the inserted objects are drawn
+     * into an Image on request. The fltk thread is never started so it can be used on machines
+     * without a display (e.g. cluster nodes) to produce pictures of a simulation.
+     *
+     * The object accepts the same Plotter2DObj as Plotter2D (axes, grid, lattice, plane, figures...).
+     * Their worker threads run in the background as usual and render() waits until the requested
+     * quality is reached before composing the image.
+     *
+     * @code
+     * OffscreenPlotter2D P(1000, 1000);        // 1000x1000 image with axes
+     * auto L = makePlot2DLattice(colorFct);
+     * P.add(L);
+     * P.range().setRange(fBox2(-100, 100, -100, 100));
+     * Image im;
+     * P.render(im);                            // wait for quality 100 and draw
+     * im.save("lattice.png");
+     * @endcode
+     *
+     * @warning The option methods of some objects which update their widgets (for instance
+     *          Plot2DAxes::numbers()) still go through the fltk thread. Set them before inserting the
+     *          object. The objects must not be modified while render() is running.
+     **/
+    class OffscreenPlotter2D
+    {
+
+    public:
+
+        static const int DEFAULT_W = 1000;      ///< default width of the image
+        static const int DEFAULT_H = 1000;      ///< default height of the image
+
+
+        /**
+         * Constructor. Create an initially empty offscreen plotter.
+         *
+         * @param   W       The width of the image.
+         * @param   H       The height of the image.
+         * @param   addAxes true to add a Plot2DAxes object on top.
+         * @param   addGrid true to add a Plot2DGrid object on top.
+         **/
+        OffscreenPlotter2D(int W = DEFAULT_W, int H = DEFAULT_H, bool addAxes = true, bool addGrid = false);
+
+
+        /**
+         * Destructor. If there are object inserted, they are removed (but not deleted).
+         **/
+        ~OffscreenPlotter2D();
+
+
+        /**
+         * Insert a Plotter2DObj into the plotter. The object in added at the top of the list of
+         * inserted object.
+         *
+         * @param [in,out]  obj pointer to the object.
+         **/
+        void add(internals_graphics::Plotter2DObj * obj);
+
+
+        /**
+         * Insert a Plotter2DObj into the plotter. The object in added at the top of the list of
+         * inserted object.
+         *
+         * @param [in,out]  obj The object to insert.
+         **/
+        void add(internals_graphics::Plotter2DObj & obj);
+
+
+        /**
+         * Insert an object into the plotter, same as `add()`.
+         *
+         * @param [in,out]  obj The object to insert.
+         *
+         * @return  The plotter itself for chaining.
+         **/
+        OffscreenPlotter2D & operator[](internals_graphics::Plotter2DObj & obj);
+
+
+        /**
+         * Remove an object from the plotter. Does nothing if the object is not inserted.
+         *
+         * @param [in,out]  obj pointer to the object.
+         **/
+        void remove(internals_graphics::Plotter2DObj * obj);
+
+
+        /**
+         * Remove an object from the plotter. Does nothing if the object is not inserted.
+         *
+         * @param [in,out]  obj The object to remove.
+         **/
+        void remove(internals_graphics::Plotter2DObj & obj);
+
+
+        /**
+         * Return the number of objects currently inserted in the plotter.
+         **/
+        int nbObject() const;
+
+
+        /**
+         * Get the object at a given position in the plotter (object 0 is on top and drawn last).
+         *
+         * @param   pos The position between 0 (top object) and nbObject()-1 (bottom object).
+         *
+         * @return  A pointer to the object, nullptr if out of bound.
+         **/
+        internals_graphics::Plotter2DObj * get(int pos) const;
+
+
+        /**
+         * Return the Plot2DAxes object created by the constructor or nullptr if there is none.
+         **/
+        Plot2DAxes * axesObject() const;
+
+
+        /**
+         * Return the Plot2DGrid object created by the constructor or nullptr if there is none.
+         **/
+        Plot2DGrid * gridObject() const;
+
+
+        /**
+         * Query if the background is a solid color (otherwise it is a checkerboard).
+         **/
+        bool useSolidBackground() const;
+
+
+        /**
+         * Set whether we use a solid color for the background (otherwise it is a checkerboard).
+         **/
+        void useSolidBackground(bool use);
+
+
+        /**
+         * Return the color used for the solid background.
+         **/
+        RGBc solidBackGroundColor() const;
+
+
+        /**
+         * Set the color used for the solid background (made opaque).
+         **/
+        void solidBackGroundColor(RGBc color);
+
+
+        /**
+         * The range manager of the plotter. Use it to set the range of the image.
+         **/
+        internals_graphics::RangeManager & range();
+
+
+        /**
+         * Size of the images produced by render().
+         **/
+        iVec2 imageSize() const;
+
+
+        /**
+         * Change the size of the images produced by render(). The range is adjusted accordingly (as for
+         * the window of a Plotter2D).
+         **/
+        void imageSize(int W, int H);
+
+
+        /**
+         * Set the range to fit the favourite X range of all the enabled objects.
+         **/
+        void autorangeX();
+
+
+        /**
+         * Set the range to fit the favourite Y range of all the enabled objects.
+         **/
+        void autorangeY();
+
+
+        /**
+         * Set the range to fit the favourite X and Y range of all the enabled objects.
+         **/
+        void autorangeXY();
+
+
+        /**
+         * Return the current quality of the drawing: the minimum of the quality of the enabled objects
+         * (100 if there are none).
+         **/
+        int quality() const;
+
+
+        /**
+         * Draw the objects into an image. The method blocks until the quality of the drawing reaches
+         * minQuality (or the timeout expires) and then draws the background and the enabled objects
+         * from bottom to top.
+         *
+         * @param [in,out]  im          The image to draw onto. It is resized to imageSize() if needed.
+         * @param           minQuality  The quality to wait for, between 0 and 100.
+         * @param           timeout     Maximum time to wait in milliseconds (negative for no limit).
+         *
+         * @return  The quality of the image drawn.
+         **/
+        int render(Image & im, int minQuality = 100, int timeout = -1);
+
+
+    private:
+
+        static void _objectCB_static(void * data, void * data2, void * obj, int code);
+        void _objectCB(internals_graphics::Plotter2DObj * obj, int code);
+
+        static bool _rangeCB_static(void * data, void * data2, bool changedRange, bool changedWinSize, bool changedFixAspectRatio);
+        bool _rangeCB();
+
+        int _findIndex(internals_graphics::Plotter2DObj * obj) const;
+        void _move(internals_graphics::Plotter2DObj * obj, int newpos);
+        void _updatePriorities();
+
+        fBox2 _autoRangeX(fBox2 CR, bool keepAR, internals_graphics::Plotter2DObj * obj);
+        fBox2 _autoRangeY(fBox2 CR, bool keepAR, internals_graphics::Plotter2DObj * obj);
+        void _useRange(internals_graphics::Plotter2DObj * obj, bool X, bool Y);
+
+
+        OffscreenPlotter2D(const OffscreenPlotter2D &) = delete;                // no copy
+        OffscreenPlotter2D & operator=(const OffscreenPlotter2D &) = delete;    //
+
+        mutable std::recursive_mutex _mut;                                  // protect the list of objects
+        internals_graphics::RangeManager * _RM;                             // the range manager
+        std::vector<internals_graphics::Plotter2DObj *> _vecPlot;           // the inserted objects, 0 is on top
+        Plot2DAxes * _axePlot;                                              // the axes plot created by the ctor
+        Plot2DGrid * _gridPlot;                                             // the grid plot created by the ctor
+        bool _usesolidBK;                                                   // use a solid background
+        RGBc _solidBKcolor;                                                 // color of the solid background
+    };
+
+
+}
+
+
+/* end of file */
+
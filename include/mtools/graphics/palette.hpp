@@ -0,0 +1,242 @@
+/** @file palette.hpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include "../misc/internal/mtools_export.hpp"
+#include "../misc/misc.hpp"
+#include "../misc/error.hpp"
+#include "rgbc.hpp"
+
+#include <vector>
+#include <cmath>
+
+
+namespace mtools
+{
+
+
+    /**
+    * A color palette stored as a lookup table.
+    *
+    * The colors are computed once (gradients are interpolated at construction) so that mapping a
+    * value to a color is a single table lookup. Two kinds of lookup are provided:
+    *
+    * - by integer state: state i is mapped to color i modulo size() (a mask when the size is a
+    *   power of 2). Typical use: the getColor() method of a lattice object.
+    * - by value in [0,1] (or in a range [a,b]): the value is mapped linearly to the table and
+    *   clamped at the boundaries. Typical use: escape times, densities...
+    *
+    * The batch versions map a whole span of values at once and are the ones to use in loops.
+    *
+    * @code
+    * static const Palette pal = Palette::jet(256);
+    * RGBc colorFct(iVec2 pos) { return pal(lattice(pos)); }      // state -> color
+    * pal.map(values, n, out, 0.0, maxValue);                      // batch, linear scale
+    * @endcode
+    **/
+    class Palette
+        {
+
+        public:
+
+            /**
+            * Default constructor: a palette with a single transparent color.
+            **/
+            Palette() : _tab(1, RGBc::c_Transparent), _mask(0) {}
+
+
+            /**
+            * Constructor from a list of colors (used as is, without interpolation).
+            **/
+            Palette(const std::vector<RGBc> & colors) : _tab(colors), _mask(0)
+                {
+                if (_tab.size() == 0) _tab.push_back(RGBc::c_Transparent);
+                _setMask();
+                }
+
+
+            /**
+            * Gradient palette of n colors interpolated linearly between the given stops (equally spaced,
+            * the first color is stops.front() and the last one is stops.back()).
+            **/
+            static Palette gradient(const std::vector<RGBc> & stops, size_t n = 256)
+                {
+                MTOOLS_INSURE((stops.size() > 0) && (n > 0));
+                std::vector<RGBc> tab(n);
+                for (size_t i = 0; i < n; i++)
+                    {
+                    const double x = (n == 1) ? 0.0 : ((double)i)*(stops.size() - 1) / (n - 1);
+                    size_t k = (size_t)x; if (k >= stops.size() - 1) { tab[i] = stops.back(); continue; }
+                    const double t = x - k;
+                    const RGBc & A = stops[k];
+                    const RGBc & B = stops[k + 1];
+                    RGBc c;
+                    c.comp.R = (uint8)std::lround(A.comp.R + t*((double)B.comp.R - A.comp.R)); // premultiplied colors:
+                    c.comp.G = (uint8)std::lround(A.comp.G + t*((double)B.comp.G - A.comp.G)); // interpolating each
+                    c.comp.B = (uint8)std::lround(A.comp.B + t*((double)B.comp.B - A.comp.B)); // channel keeps the
+                    c.comp.A = (uint8)std::lround(A.comp.A + t*((double)B.comp.A - A.comp.A)); // channels <= alpha.
+                    tab[i] = c;
+                    }
+                return Palette(tab);
+                }
+
+
+            /**
+            * The jet palette (same colors as RGBc::jetPalette()) sampled with n colors.
+            **/
+            static Palette jet(size_t n = 72)
+                {
+                MTOOLS_INSURE(n > 0);
+                std::vector<RGBc> tab(n);
+                for (size_t i = 0; i < n; i++) { tab[i] = RGBc::jetPalette((n == 1) ? 0.0 : ((double)i) / (n - 1)); }
+                return Palette(tab);
+                }
+
+
+            /**
+            * The jet palette in logarithmic scale (same colors as RGBc::jetPaletteLog()) sampled with n
+            * colors.
+            **/
+            static Palette jetLog(size_t n = 256, double exponent = 2)
+                {
+                MTOOLS_INSURE(n > 0);
+                std::vector<RGBc> tab(n);
+                for (size_t i = 0; i < n; i++) { tab[i] = RGBc::jetPaletteLog((n == 1) ? 0.0 : ((double)i) / (n - 1), exponent); }
+                return Palette(tab);
+                }
+
+
+            /**
+            * The first n colors of RGBc::getDistinctColor() (they repeat after 32).
+            **/
+            static Palette distinct(size_t n = 32)
+                {
+                MTOOLS_INSURE(n > 0);
+                std::vector<RGBc> tab(n);
+                for (size_t i = 0; i < n; i++) { tab[i] = RGBc::getDistinctColor(i); }
+                return Palette(tab);
+                }
+
+
+            /**
+            * Number of colors.
+            **/
+            size_t size() const { return _tab.size(); }
+
+
+            /**
+            * The table of colors.
+            **/
+            const RGBc * data() const { return _tab.data(); }
+
+
+            /**
+            * Change a color of the palette.
+            **/
+            void set(size_t i, RGBc color) { MTOOLS_ASSERT(i < _tab.size()); _tab[i] = color; }
+
+
+            /**
+            * Color of an integer state: color number state modulo size() (negative states wrap
+            * around).
+            **/
+            MTOOLS_FORCEINLINE RGBc operator()(int64 state) const
+                {
+                if (_mask != 0) return _tab[(size_t)(state & _mask)];
+                int64 k = state % (int64)_tab.size();
+                if (k < 0) k += (int64)_tab.size();
+                return _tab[(size_t)k];
+                }
+
+
+            /**
+            * Color of a value in [0,1] (clamped).
+            **/
+            MTOOLS_FORCEINLINE RGBc operator()(double v) const
+                {
+                const double x = v * (double)_tab.size();
+                if (!(x > 0.0)) return _tab.front(); // also NaN
+                if (x >= (double)_tab.size()) return _tab.back();
+                return _tab[(size_t)x];
+                }
+
+
+            /**
+            * Color of a value in the range [a,b] (clamped).
+            **/
+            MTOOLS_FORCEINLINE RGBc operator()(double v, double a, double b) const
+                {
+                return operator()((b == a) ? 0.5 : (v - a) / (b - a));
+                }
+
+
+            /**
+            * Map n integer states to colors (same as operator()(int64)).
+            **/
+            void map(const int64 * states, size_t n, RGBc * out) const
+                {
+                const RGBc * T = _tab.data();
+                if (_mask != 0)
+                    {
+                    const int64 m = _mask;
+                    for (size_t i = 0; i < n; i++) { out[i] = T[(size_t)(states[i] & m)]; }
+                    return;
+                    }
+                for (size_t i = 0; i < n; i++) { out[i] = operator()(states[i]); }
+                }
+
+
+            /**
+            * Map n values of the range [a,b] to colors (same as operator()(double, a, b)).
+            **/
+            void map(const double * values, size_t n, RGBc * out, double a = 0.0, double b = 1.0) const
+                {
+                const RGBc * T = _tab.data();
+                const double L = (double)_tab.size();
+                const double s = (b == a) ? 0.0 : L / (b - a);
+                const double o = (b == a) ? 0.5*L : -a*s;
+                const size_t last = _tab.size() - 1;
+                for (size_t i = 0; i < n; i++)
+                    {
+                    const double x = values[i] * s + o;
+                    out[i] = (!(x > 0.0)) ? T[0] : ((x >= L) ? T[last] : T[(size_t)x]);
+                    }
+                }
+
+
+        private:
+
+            /* set the mask when the size is a power of 2 */
+            void _setMask()
+                {
+                const size_t n = _tab.size();
+                _mask = (((n & (n - 1)) == 0) && (n > 1)) ? (int64)(n - 1) : 0;
+                }
+
+            std::vector<RGBc>   _tab;   // the colors
+            int64               _mask;  // size - 1 if the size is a power of 2 (> 1), 0 otherwise
+        };
+
+
+}
+
+
+/* end of file */
@@ -37,6 +37,7 @@
 #include <ctime>
 #include <mutex>
 #include <atomic>
+#include <vector>
 
 
 
@@ -52,6 +53,9 @@ namespace mtools
      * Template class that create a unique thread used to draw inside a progressImg. This class is
      * used by the PixelDrawer class which combine several threads together for faster drawing.
      *
+     * If the object also implements a getColorBatch() method (see GetColorBatchSelector), it is used
+     * to query the sites a whole line at a time in the fast, 1 to 1 and stochastic drawings.
+     *
      * @tparam  ObjType Type of object to draw. Must implement a color recognized by the
      *                  GetColorSelector() (cf file getcolorselector.hpp).
      **/
@@ -73,6 +77,7 @@ namespace mtools
                 _opaque(opaque),
                 _keepPrevious(false),
                 _validParam(false),
+                _idle(false),
                 _range(fBox2()),
                 _temp_range(fBox2()),
                 _im(nullptr),
@@ -82,7 +87,9 @@ namespace mtools
                 _dens(0.0),
                 _dlx(0.0), _dly(0.0),
                 _is1to1(false),
-                _range1to1(iBox2())
+                _range1to1(iBox2()),
+                _bpos(),
+                _bcol()
                 {
                 static_assert(mtools::GetColorSelector<ObjType>::has_getColor, "The object must be implement one of the getColor() method recognized by GetColorSelector.");
                 }
@@ -145,6 +152,19 @@ namespace mtools
                 }
 
 
+            /**
+            * Put the thread in the idle state: there is nothing to draw and the progress is set to 100.
+            * The idle state is left with the next call to setParameters().
+            *
+            * Returns immediately, use sync() to wait for the operation to complete.
+            **/
+            void setIdle()
+                {
+                sync();
+                signal(SIGNAL_IDLE);
+                }
+
+
 
         private:
 
@@ -174,6 +194,7 @@ namespace mtools
                     {
                     case SIGNAL_NEWPARAM: { return _setNewParam(); }
                     case SIGNAL_REDRAW: { return _setRedraw(); }
+                    case SIGNAL_IDLE: { _idle = true; setProgress(100); return THREAD_RESET_AND_WAIT; }
                     default: { MTOOLS_ERROR("wtf!"); return 0; }
                     }
                 }
@@ -189,6 +210,7 @@ namespace mtools
                 _im = _temp_im;
                 _subBox = _temp_subBox;
                 _keepPrevious = false;
+                _idle = false;
                 setProgress(0);
                 if ((_im == nullptr) || (_im->width() < MIN_IMAGE_SIZE) || (_im->height() < MIN_IMAGE_SIZE)) { _validParam = false; return THREAD_RESET_AND_WAIT; }   // make sure im is not nullptr and is big enough.
                 if (_subBox.isEmpty()) { _subBox = iBox2(0, _im->width() - 1, 0, _im->height() - 1); } // subbox = whole image if empty. 
@@ -199,6 +221,14 @@ namespace mtools
                 if ((rlx < RANGE_MIN_VALUE) || (rly < RANGE_MIN_VALUE)) { _validParam = false; return THREAD_RESET_AND_WAIT; } // prevent zooming in too far
                 if ((std::abs(_range.min[0]) > RANGE_MAX_VALUE) || (std::abs(_range.max[0]) > RANGE_MAX_VALUE) || (std::abs(_range.min[1]) > RANGE_MAX_VALUE) || (std::abs(_range.max[1]) > RANGE_MAX_VALUE)) { _validParam = false; return THREAD_RESET_AND_WAIT; } // prevent zooming out too far
                 _validParam = true;
+                if ((ThreadAffinity::policy() != ThreadAffinity::AFFINITY_NONE) && (ThreadAffinity::nbNodes() > 1))
+                    { // move the rows of our band to the node of the thread
+                    const ProgressImg & cim = *_im;
+                    const size_t off = (size_t)(_subBox.min[1] * cim.width());
+                    const size_t len = (size_t)((_subBox.ly() + 1) * cim.width());
+                    ThreadAffinity::bindLocal(cim.imData() + off, len * sizeof(RGBc64));
+                    ThreadAffinity::bindLocal(cim.normData() + off, len);
+                    }
                 const int64 ilx = _subBox.lx() + 1;
                 const int64 ily = _subBox.ly() + 1;
                 _dlx = rlx / ilx;
@@ -225,6 +255,7 @@ namespace mtools
             /* trigger a redraw */
             int _setRedraw()
                 {
+                if (_idle) { setProgress(100); return THREAD_RESET_AND_WAIT; }
                 if (!((bool)_validParam)) return THREAD_RESET_AND_WAIT;
                 if ((progress() >= 5) && ((bool)_keepPrevious))
                     {
@@ -398,6 +429,29 @@ namespace mtools
                         else
                             {
                             prevsy = sy;
+                            if (HAS_BATCH)
+                                { // query the distinct sites of the line at once
+                                _bpos.clear();
+                                int64 prevsx = (int64)r.min[0] - 3; // cannot match anything
+                                for (int64 i = 0; i < ilx; i++)
+                                    {
+                                    const int64 sx = (int64)floor(r.min[0] + (i + 0.5)*px + 0.5);
+                                    if (prevsx != sx) { _bpos.push_back({ sx, sy }); prevsx = sx; }
+                                    }
+                                _bcol.resize(_bpos.size());
+                                mtools::GetColorBatchSelector<ObjType>::call(*_obj, _bpos.data(), _bpos.size(), _bcol.data(), _opaque);
+                                size_t u = 0;
+                                for (int64 i = 0; i < ilx; i++)
+                                    {
+                                    const int64 sx = (int64)floor(r.min[0] + (i + 0.5)*px + 0.5);
+                                    if (_bpos[u].X() != sx) u++;
+                                    imData[off] = _bcol[u];
+                                    normData[off] = 0;
+                                    off++;
+                                    }
+                                off += pa;
+                                continue;
+                                }
                             RGBc64 coul(0);
                             int64 prevsx = (int64)r.min[0] - 3; // cannot match anything
                             for (int64 i = 0; i < ilx; i++)
@@ -425,6 +479,15 @@ namespace mtools
                         check();
                         const double y = r.min[1] + (j + 0.5)*py;
                         const int64 sy = (int64)floor(y + 0.5);
+                        if (HAS_BATCH)
+                            { // query the whole line at once
+                            _bpos.resize((size_t)ilx); _bcol.resize((size_t)ilx);
+                            for (int64 i = 0; i < ilx; i++) { _bpos[(size_t)i] = { (int64)floor(r.min[0] + (i + 0.5)*px + 0.5), sy }; }
+                            mtools::GetColorBatchSelector<ObjType>::call(*_obj, _bpos.data(), (size_t)ilx, _bcol.data(), _opaque);
+                            for (int64 i = 0; i < ilx; i++) { imData[off] = _bcol[(size_t)i]; normData[off] = 0; off++; }
+                            off += pa;
+                            continue;
+                            }
                         for (int64 i = 0; i < ilx; i++)
                             {
 							check();
@@ -453,6 +516,21 @@ namespace mtools
                 uint8 * normData = _im->normData();
                 size_t off = (size_t)(_subBox.min[0] + _im->width()*(_subBox.min[1])); // offset of the first point in the image
                 size_t pa = (size_t)(_im->width() - (_subBox.lx() + 1)); // padding needed to get to the next line
+                if (HAS_BATCH)
+                    { // query each line at once
+                    const size_t n = (size_t)(xmax - xmin + 1);
+                    _bpos.resize(n); _bcol.resize(n);
+                    for (int64 j = ymin; j <= ymax; j++)
+                        {
+                        check();
+                        for (size_t u = 0; u < n; u++) { _bpos[u] = { xmin + (int64)u, j }; }
+                        mtools::GetColorBatchSelector<ObjType>::call(*_obj, _bpos.data(), n, _bcol.data(), _opaque);
+                        for (size_t u = 0; u < n; u++) { imData[off] = _bcol[u]; normData[off] = 0; off++; }
+                        off += pa;
+                        }
+                    setProgress(100);
+                    return;
+                    }
                 if (pa != 0)
                     {
                     for (int64 j = ymin; j <= ymax; j++)
@@ -570,6 +648,45 @@ namespace mtools
                     fBox2 pixBox(r.min[0], r.min[0] + px, r.min[1], r.min[1] + py);
                     for (int64 jj = 0; jj < ily; jj++)
                         {
+                        if (HAS_BATCH)
+                            { // draw all the samples of the line, query them at once and then average them
+                            const size_t n = (size_t)(ilx*batchsize);
+                            _bpos.resize(n); _bcol.resize(n);
+                            size_t u = 0;
+                            for (int64 ii = 0; ii < ilx; ii++)
+                                {
+                                iBox2 siteBox((int64)std::floor(pixBox.min[0] + 0.5), (int64)std::ceil(pixBox.max[0] - 0.5), (int64)std::floor(pixBox.min[1] + 0.5), (int64)std::ceil(pixBox.max[1] - 0.5));
+                                randX.setParam((uint32)(siteBox.max[0] - siteBox.min[0] + 1));
+                                randY.setParam((uint32)(siteBox.max[1] - siteBox.min[1] + 1));
+                                for (int l = 0; l < batchsize; l++)
+                                    {
+                                    uint32 rr = _fastgen();
+                                    _bpos[u++] = { siteBox.min[0] + randX(rr), siteBox.min[1] + randY(rr >> 16) };
+                                    }
+                                pixBox.min[0] += px; pixBox.max[0] += px;
+                                }
+                            check();
+                            mtools::GetColorBatchSelector<ObjType>::call(*_obj, _bpos.data(), n, _bcol.data(), _opaque);
+                            u = 0;
+                            for (int64 ii = 0; ii < ilx; ii++)
+                                {
+                                int64 iR = 0, iG = 0, iB = 0, iA = 0;
+                                for (int l = 0; l < batchsize; l++)
+                                    {
+                                    const RGBc c = _bcol[u++];
+                                    iR += c.comp.R; iG += c.comp.G; iB += c.comp.B; iA += c.comp.A;
+                                    }
+                                imData[off].add(RGBc64((uint16)(iR >> bln), (uint16)(iG >> bln), (uint16)(iB >> bln), (uint16)(iA >> bln)));
+                                normData[off]++;
+                                off++;
+                                }
+                            off += pa;
+                            pixBox.min[1] += py;
+                            pixBox.max[1] += py;
+                            pixBox.min[0] = r.min[0];
+                            pixBox.max[0] = r.min[0] + px;
+                            continue;
+                            }
                         for (int64 ii = 0; ii < ilx; ii++)
                             {
 							if (!(ii & 127)) check();
@@ -964,12 +1081,14 @@ namespace mtools
 
             static const int SIGNAL_NEWPARAM = 4;
             static const int SIGNAL_REDRAW = 5;
+            static const int SIGNAL_IDLE = 6;
 
             ObjType * _obj;                         // the object to draw.
             void * _opaque;                         // opaque data passed to _obj;
 
             std::atomic<bool> _keepPrevious;        // do we keep something from the previous drawing
             std::atomic<bool> _validParam;          // indicate if the parameter are valid.
+            bool _idle;                             // true if there is nothing to draw
 
             fBox2 _range;                           // the range
             std::atomic<fBox2> _temp_range;         // and the temporary use to communicate with the thread.
@@ -985,6 +1104,10 @@ namespace mtools
 
             FastRNG _fastgen;                       // fast RNG
 
+            static const bool HAS_BATCH = mtools::GetColorBatchSelector<ObjType>::has_getColorBatch;  // true if the object has a getColorBatch() method
+            std::vector<iVec2> _bpos;               // buffer for the sites passed to getColorBatch()
+            std::vector<RGBc> _bcol;                // buffer for the colors returned by getColorBatch()
+
         };
 
 
@@ -994,6 +1117,12 @@ namespace mtools
     *
     * Uses several threads to draw from a getColor function into a progressImg.
     *
+    * When the range is translated by an integer number of pixels (a pan) while the scale, the image
+    * and the sub box are unchanged and the previous drawing is complete, the drawing is reused: the
+    * content of the image is shifted and the threads only draw the newly exposed strips. Any drawing
+    * still in progress is cancelled by the call to setParameters(). Use panReuse() to disable this
+    * behaviour.
+    *
     * @tparam  ObjType Type of object to draw. Must implement a color recognized by the
     *                  GetColorSelector().
     **/
@@ -1007,7 +1136,8 @@ namespace mtools
             *
             * @param [in,out]  obj The object to draw
             **/
-            PixelDrawer(ObjType * obj, int nbthread = 1) : _obj(obj), _vecThread()
+            PixelDrawer(ObjType * obj, int nbthread = 1) : _obj(obj), _vecThread(), _priority(ThreadScheduler::PRIORITY_NORMAL),
+                _panReuse(true), _stripLayout(false), _lastRange(), _lastIm(nullptr), _lastSubBox()
                 {
                 static_assert(mtools::GetColorSelector<ObjType>::has_getColor, "The object must be implement one of the getColor() method recognized by GetColorSelector.");
                 if (nbthread < 1) nbthread = 1;
@@ -1038,11 +1168,29 @@ namespace mtools
                 if (nb < 1) nb = 1;
                 if (nb == nbThreads()) return;
                 _deleteAllThread();
+                _lastIm = nullptr; // the new threads have no parameters
+                _stripLayout = false;
                 _vecThread.resize(nb);
-                for (int i = 0; i < nb; i++) { _vecThread[i] = new ThreadPixelDrawer<ObjType>(_obj); }
+                for (int i = 0; i < nb; i++) { _vecThread[i] = new ThreadPixelDrawer<ObjType>(_obj); _vecThread[i]->priority(_priority); _vecThread[i]->affinity(i); }
                 }
 
 
+            /**
+            * Set the priority of the threads w.r.t. the global ThreadScheduler (see ThreadWorker::priority()).
+            **/
+            void priority(int prio)
+                {
+                _priority = prio;
+                for (size_t i = 0; i < _vecThread.size(); i++) { _vecThread[i]->priority(prio); }
+                }
+
+
+            /**
+            * Return the priority of the threads.
+            **/
+            int priority() const { return _priority; }
+
+
             /**
             * Determines if the drawing parameters are valid.
             **/
@@ -1117,6 +1265,49 @@ namespace mtools
             void setParameters(const fBox2 & range, ProgressImg * im, iBox2 subBox = iBox2())
                 {
                 if (subBox.isEmpty()) { subBox = iBox2(0, im->width() - 1, 0, im->height() - 1); }
+                int64 dx, dy;
+                if (_isPan(range, im, subBox, dx, dy))
+                    {
+                    if ((dx == 0) && (dy == 0)) { _lastRange = range; return; } // same drawing, nothing to do
+                    if (_setStripLayout(range, im, subBox, dx, dy)) return;
+                    }
+                _setFullLayout(range, im, subBox);
+                }
+
+
+            /**
+            * Force a redraw.
+            *
+            * Returns immediately, use sync() to wait for the operation to complete.
+            **/
+            void redraw(bool keepPrevious)
+                {
+                if (_stripLayout) { _setFullLayout(_lastRange, _lastIm, _lastSubBox); return; } // the threads only cover part of the image
+                for (size_t i = 0; i < _vecThread.size(); i++) { (_vecThread[i])->redraw(keepPrevious); }
+                }
+
+
+            /**
+            * Enable/disable the reuse of the previous drawing when the range is translated by an integer
+            * number of pixels. Enabled by default.
+            **/
+            void panReuse(bool status) { _panReuse = status; }
+
+
+            /**
+            * Query if the previous drawing is reused for pans.
+            **/
+            bool panReuse() const { return _panReuse; }
+
+
+        private:
+
+
+            /* split the whole sub box between the threads (horizontal bands) */
+            void _setFullLayout(const fBox2 & range, ProgressImg * im, const iBox2 & subBox)
+                {
+                _stripLayout = false;
+                _lastIm = nullptr;
                 const size_t nt = _vecThread.size();
                 const int64 H = subBox.ly() + 1;
                 if ((nt == 0) || (H < (int64)(3 * nt))) return;
@@ -1135,21 +1326,106 @@ namespace mtools
                     cbox.min[1] += (h + 1); cbox.max[1] += (h + 1);
                     }
                 MTOOLS_INSURE(cbox.min[1] == 1 + subBox.max[1]);
+                _lastRange = range; _lastIm = im; _lastSubBox = subBox;
                 }
 
 
-            /**
-            * Force a redraw.
-            *
-            * Returns immediately, use sync() to wait for the operation to complete.
-            **/
-            void redraw(bool keepPrevious)
+            /* check if the new parameters are a translation of the previous (completed) drawing by (dx,dy) pixels */
+            bool _isPan(const fBox2 & range, ProgressImg * im, const iBox2 & subBox, int64 & dx, int64 & dy)
                 {
-                for (size_t i = 0; i < _vecThread.size(); i++) { (_vecThread[i])->redraw(keepPrevious); }
+                const double EPS_SCALE = 1.0e-9;    // relative tolerance on the scale
+                const double EPS_PIXEL = 1.0e-3;    // tolerance on the shift (in pixels)
+                if ((!_panReuse) || (im == nullptr) || (im != _lastIm) || (subBox != _lastSubBox)) return false;
+                if (progress() < 100) return false; // previous drawing not finished
+                const double rlx = range.lx(), rly = range.ly();
+                if ((std::abs(rlx - _lastRange.lx()) > EPS_SCALE*rlx) || (std::abs(rly - _lastRange.ly()) > EPS_SCALE*rly)) return false;
+                const double px = rlx / (subBox.lx() + 1);
+                const double py = rly / (subBox.ly() + 1);
+                const double fdx = (range.min[0] - _lastRange.min[0]) / px;
+                const double fdy = (range.min[1] - _lastRange.min[1]) / py;
+                if ((std::abs(fdx) > (double)subBox.lx()) || (std::abs(fdy) > (double)subBox.ly())) return false;
+                dx = (int64)std::floor(fdx + 0.5);
+                dy = (int64)std::floor(fdy + 0.5);
+                return ((std::abs(fdx - dx) < EPS_PIXEL) && (std::abs(fdy - dy) < EPS_PIXEL));
                 }
 
 
-        private:
+            /* split a box in k bands (along its longest side) and append them to list */
+            static void _splitBox(const iBox2 & B, size_t k, std::vector<iBox2> & list)
+                {
+                const bool vert = (B.lx() >= B.ly()); // cut along x
+                const int64 L = (vert ? B.lx() : B.ly()) + 1;
+                int64 pos = (vert ? B.min[0] : B.min[1]);
+                for (size_t i = 0; i < k; i++)
+                    {
+                    const int64 len = L / (int64)k + ((i < (size_t)(L % (int64)k)) ? 1 : 0);
+                    iBox2 C = B;
+                    if (vert) { C.min[0] = pos; C.max[0] = pos + len - 1; } else { C.min[1] = pos; C.max[1] = pos + len - 1; }
+                    list.push_back(C);
+                    pos += len;
+                    }
+                }
+
+
+            /* shift the previous drawing by (dx,dy) pixels and let the threads draw only the uncovered strips.
+               Return false (without doing anything) if the strips cannot be distributed between the threads. */
+            bool _setStripLayout(const fBox2 & range, ProgressImg * im, const iBox2 & subBox, int64 dx, int64 dy)
+                {
+                const int64 MIN_STRIP = 3; // min width of a strip handled by a thread (see ThreadPixelDrawer::_setNewParam())
+                const size_t nt = _vecThread.size();
+                const int64 W = subBox.lx() + 1;
+                const int64 H = subBox.ly() + 1;
+                if ((W < 4 * MIN_STRIP) || (H < 4 * MIN_STRIP)) return false;
+                // the uncovered strips (enlarged to the minimum size)
+                std::vector<iBox2> strips;
+                int64 ax = std::min<int64>(std::max<int64>(std::abs(dx), MIN_STRIP), W - MIN_STRIP);
+                int64 ay = std::min<int64>(std::max<int64>(std::abs(dy), MIN_STRIP), H - MIN_STRIP);
+                iBox2 rest = subBox; // part not covered by the vertical strip
+                if (dx != 0)
+                    {
+                    iBox2 B = subBox;
+                    if (dx > 0) { B.min[0] = subBox.max[0] - ax + 1; rest.max[0] = B.min[0] - 1; } else { B.max[0] = subBox.min[0] + ax - 1; rest.min[0] = B.max[0] + 1; }
+                    strips.push_back(B);
+                    }
+                if (dy != 0)
+                    {
+                    iBox2 B = rest;
+                    if (dy > 0) { B.min[1] = subBox.max[1] - ay + 1; } else { B.max[1] = subBox.min[1] + ay - 1; }
+                    strips.push_back(B);
+                    }
+                if (strips.size() > nt) return false;
+                // number of threads for each strip, proportional to its area
+                int64 area = 0;
+                for (size_t i = 0; i < strips.size(); i++) { area += (strips[i].lx() + 1)*(strips[i].ly() + 1); }
+                std::vector<iBox2> boxes;
+                size_t remaining = nt;
+                for (size_t i = 0; i < strips.size(); i++)
+                    {
+                    const int64 a = (strips[i].lx() + 1)*(strips[i].ly() + 1);
+                    const int64 L = std::max<int64>(strips[i].lx(), strips[i].ly()) + 1;
+                    size_t k = (size_t)((a * (int64)nt) / area);
+                    k = std::min<size_t>(k, (size_t)(L / MIN_STRIP));
+                    k = std::min<size_t>(k, remaining - (strips.size() - 1 - i)); // keep one thread for each of the next strips
+                    if (k < 1) k = 1;
+                    remaining -= k;
+                    _splitBox(strips[i], k, boxes);
+                    }
+                // stop all the threads, move the drawing and set the new parameters
+                const bool en = enable();
+                enable(false);
+                sync();
+                im->shift(dx, dy, subBox);
+                for (size_t i = 0; i < nt; i++)
+                    {
+                    if (i < boxes.size()) { _vecThread[i]->setParameters(_computeRange(range, subBox, boxes[i]), im, boxes[i]); }
+                    else { _vecThread[i]->setIdle(); }
+                    }
+                sync();
+                enable(en);
+                _stripLayout = true;
+                _lastRange = range; _lastIm = im; _lastSubBox = subBox;
+                return true;
+                }
 
 
             /* compute the range of a subbox */
@@ -1180,6 +1456,13 @@ namespace mtools
 
             ObjType * _obj;                                             // the object to draw.
             std::vector< ThreadPixelDrawer<ObjType>*  > _vecThread;     // vector of all the threads. 
+            int _priority;                                              // priority of the threads
+
+            bool _panReuse;                                             // true if the drawing is reused for pans
+            bool _stripLayout;                                          // true if the threads only draw part of the sub box
+            fBox2 _lastRange;                                           // parameters of the current drawing
+            ProgressImg * _lastIm;                                      // (_lastIm = nullptr if there is none)
+            iBox2 _lastSubBox;                                          //
 
 
         };
@@ -35,6 +35,7 @@
 #include <ctime>
 #include <mutex>
 #include <atomic>
+#include <vector>
 
 
 namespace mtools
@@ -48,6 +49,15 @@ namespace mtools
      * PlaneDrawer class which combined several instance of the class to optimized the drawing using
      * several threads.
      *
+     * By default, every pixel receives the same number of random samples. In adaptive sampling
+     * mode (see adaptiveSampling()), each pixel first receives a small number of samples and then
+     * the remaining samples are spent only on the pixels whose estimated error (standard error of
+     * the mean color) is still above a fixed tolerance. Flat regions thus converge after a few
+     * samples and the work is concentrated on the boundaries.
+     *
+     * If the object also implements a getColorBatch() method (see GetColorPlaneBatchSelector), the
+     * colors are queried a whole line at a time with it.
+     *
      * @tparam  ObjType Type of the object to draw. Must implement a method recognized by
      *                  GetColorPlaneSelector (cf file getcolorselector.hpp).
      **/
@@ -74,7 +84,12 @@ namespace mtools
                 _im(nullptr),
                 _temp_im(nullptr),
                 _subBox(iBox2()),
-                _temp_subBox(iBox2())
+                _temp_subBox(iBox2()),
+                _adaptive(false),
+                _sqr(),
+                _bpos(),
+                _bcol(),
+                _bidx()
                 {
                 static_assert(mtools::GetColorPlaneSelector<ObjType>::has_getColor, "The object must be implement one of the getColor() method recognized by GetColorPlaneSelector.");
                 }
@@ -133,6 +148,19 @@ namespace mtools
                 }
 
 
+            /**
+             * Enable/disable adaptive sampling. The new value is used for the next drawing (i.e. after
+             * the next call to setParameters() or redraw()).
+             **/
+            void adaptiveSampling(bool status) { _adaptive = status; }
+
+
+            /**
+             * Query if adaptive sampling is enabled.
+             **/
+            bool adaptiveSampling() const { return _adaptive; }
+
+
         private:
 
 
@@ -194,6 +222,7 @@ namespace mtools
                 MTOOLS_INSURE((bool)_validParam);
                 _drawFast();
                 setProgress(1);
+                if (_adaptive) { _drawAdaptive(); setProgress(100); return; }
                 for (int i = 0; i < 254;i++)
                     {
                     _drawStochastic();
@@ -219,6 +248,21 @@ namespace mtools
                 size_t off = (size_t)(_subBox.min[0] + _im->width()*(_subBox.min[1]));
                 const size_t pa = (size_t)(_im->width() - ilx);
                 fBox2 cbox(r.min[0], r.min[0] + px, r.min[1], r.min[1] + py);
+                if (HAS_BATCH)
+                    { // query a whole line at once
+                    _bpos.resize((size_t)ilx); _bcol.resize((size_t)ilx);
+                    for (int64 j = 0; j < ily; j++)
+                        {
+                        check();
+                        double x = r.min[0];
+                        for (int64 i = 0; i < ilx; i++) { _bpos[(size_t)i] = fVec2{ x + px2, cbox.min[1] + py2 }; x += px; }
+                        mtools::GetColorPlaneBatchSelector<ObjType>::call(*_obj, _bpos.data(), (size_t)ilx, _bcol.data(), _opaque);
+                        for (int64 i = 0; i < ilx; i++) { imData[off] = _bcol[(size_t)i]; normData[off] = 0; off++; }
+                        off += pa;
+                        cbox.min[1] += py;
+                        }
+                    return;
+                    }
                 for (int64 j = 0; j < ily; j++)
                     {
                     check();
@@ -252,6 +296,21 @@ namespace mtools
                 size_t off = (size_t)(_subBox.min[0] + _im->width()*(_subBox.min[1]));
                 const size_t pa = (size_t)(_im->width() - ilx);
                 fBox2 cbox(r.min[0], r.min[0] + px, r.min[1], r.min[1] + py);
+                if (HAS_BATCH)
+                    { // query a whole line at once
+                    _bpos.resize((size_t)ilx); _bcol.resize((size_t)ilx);
+                    for (int64 j = 0; j < ily; j++)
+                        {
+                        check();
+                        double x = r.min[0];
+                        for (int64 i = 0; i < ilx; i++) { _bpos[(size_t)i] = fVec2{ x + _fastgen.unif()*px, cbox.min[1] + _fastgen.unif()*py }; x += px; }
+                        mtools::GetColorPlaneBatchSelector<ObjType>::call(*_obj, _bpos.data(), (size_t)ilx, _bcol.data(), _opaque);
+                        for (int64 i = 0; i < ilx; i++) { imData[off].add(_bcol[(size_t)i]); normData[off]++; off++; }
+                        off += pa;
+                        cbox.min[1] += py;
+                        }
+                    return;
+                    }
                 for (int64 j = 0; j < ily; j++)
                     {
                     check();
@@ -281,6 +340,130 @@ namespace mtools
                 }
 
 
+            /* squared norm of a color */
+            static inline double _sqNorm(const RGBc64 & c)
+                {
+                return ((double)c.comp.R)*c.comp.R + ((double)c.comp.G)*c.comp.G + ((double)c.comp.B)*c.comp.B + ((double)c.comp.A)*c.comp.A;
+                }
+
+
+            /* squared standard error of the mean of n samples given their sum and the sum of their squared norms */
+            static inline double _stdErr2(const RGBc64 & sum, double sqr, int n)
+                {
+                const double var = (sqr - _sqNorm(sum) / n) / n;
+                return (var > 0) ? (var / n) : 0.0;
+                }
+
+
+            /* squared standard error of pixel (offset off in the image, index k in _sqr), 0 if the color is exact */
+            inline double _err2(const RGBc64 * imData, const uint8 * normData, size_t off, size_t k) const
+                {
+                return (_sqr[k] < 0) ? 0.0 : _stdErr2(imData[off], _sqr[k], normData[off] + 1);
+                }
+
+
+            /**
+             * Adaptive sampling. Called after _drawFast(). Each pixel first receives MIN_SAMPLES
+             * samples, then only the pixels whose standard error is above ERR_TOL get new samples, one
+             * per pass, until they converge or reach MAX_SAMPLES samples (the same number as in the
+             * non adaptive mode). A pixel is considered converged only when its neighbours are not too
+             * far from convergence. The sum of the squared norms of the samples of each pixel is kept in
+             * _sqr (-1 for pixels whose color is exact).
+             **/
+            void _drawAdaptive()
+                {
+                const int MIN_SAMPLES = 16;     // number of samples before estimating the error
+                const int MAX_SAMPLES = 256;    // max number of samples (normData cannot go above 255)
+                const double ERR_TOL = 1.0;     // target standard error of a pixel (in color units)
+                const double NEIGHBOUR_TOL = 8.0; // a pixel keeps sampling while the error of one of its neighbours is above this value
+                RGBc64 * imData = _im->imData();
+                uint8 * normData = _im->normData();
+                const fBox2 r = _range;
+                const int64 ilx = _subBox.lx() + 1;
+                const int64 ily = _subBox.ly() + 1;
+                const double px = r.lx() / ilx;
+                const double py = r.ly() / ily;
+                const size_t off0 = (size_t)(_subBox.min[0] + _im->width()*(_subBox.min[1]));
+                const size_t W = (size_t)_im->width();
+                const size_t pa = (size_t)(W - ilx);
+                const int64 tot = ilx*ily;
+                _sqr.resize((size_t)tot);
+                size_t off = off0, k = 0;
+                for (int64 j = 0; j < ily; j++)
+                    { // the sample of _drawFast()
+                    for (int64 i = 0; i < ilx; i++) { _sqr[k] = _sqNorm(imData[off]); off++; k++; }
+                    off += pa;
+                    }
+                int prog = 1;
+                for (int pass = 1; ; pass++)
+                    {
+                    int64 nbactive = 0;
+                    off = off0; k = 0;
+                    for (int64 j = 0; j < ily; j++)
+                        {
+                        check();
+                        const double y = r.min[1] + j*py;
+                        _bidx.clear(); _bpos.clear();
+                        for (int64 i = 0; i < ilx; i++)
+                            { // find the pixels of the line that need a new sample
+                            const int n = normData[off] + 1;
+                            bool active = ((_sqr[k] >= 0) && (n < MAX_SAMPLES));
+                            if ((active) && (n >= MIN_SAMPLES) && (_err2(imData, normData, off, k) <= ERR_TOL*ERR_TOL))
+                                { // converged unless one of its neighbour is far from converged (thin features may be missed by the first samples)
+                                active = ((i > 0) && (_err2(imData, normData, off - 1, k - 1) > NEIGHBOUR_TOL*NEIGHBOUR_TOL))
+                                      || ((i + 1 < ilx) && (_err2(imData, normData, off + 1, k + 1) > NEIGHBOUR_TOL*NEIGHBOUR_TOL))
+                                      || ((j > 0) && (_err2(imData, normData, off - W, k - (size_t)ilx) > NEIGHBOUR_TOL*NEIGHBOUR_TOL))
+                                      || ((j + 1 < ily) && (_err2(imData, normData, off + W, k + (size_t)ilx) > NEIGHBOUR_TOL*NEIGHBOUR_TOL));
+                                }
+                            if (active)
+                                {
+                                const double x = r.min[0] + i*px;
+                                _bidx.push_back(i);
+                                _bpos.push_back(fVec2{ x + _fastgen.unif()*px , y + _fastgen.unif()*py });
+                                }
+                            off++; k++;
+                            }
+                        const size_t nb = _bidx.size();
+                        nbactive += (int64)nb;
+                        off -= (size_t)ilx; k -= (size_t)ilx;
+                        if (HAS_BATCH)
+                            {
+                            _bcol.resize(nb);
+                            mtools::GetColorPlaneBatchSelector<ObjType>::call(*_obj, _bpos.data(), nb, _bcol.data(), _opaque);
+                            }
+                        for (size_t u = 0; u < nb; u++)
+                            { // and add the samples
+                            const int64 i = _bidx[u];
+                            const size_t o = off + (size_t)i, kk = k + (size_t)i;
+                            std::pair<RGBc, bool> P(RGBc::c_Transparent, false);
+                            if (HAS_BATCH) { P.first = _bcol[u]; }
+                            else
+                                {
+                                const double x = r.min[0] + i*px;
+                                P = mtools::GetColorPlaneSelector<ObjType>::call(*_obj, _bpos[u], fBox2(x, x + px, y, y + py), 1, _opaque);
+                                }
+                            if (P.second)
+                                {
+                                imData[o] = P.first;
+                                normData[o] = 0;
+                                _sqr[kk] = -1.0;
+                                }
+                            else
+                                {
+                                imData[o].add(P.first);
+                                normData[o]++;
+                                _sqr[kk] += _sqNorm(RGBc64(P.first));
+                                }
+                            }
+                        off += W; k += (size_t)ilx;
+                        }
+                    if (nbactive == 0) return;
+                    const int q = (pass < MIN_SAMPLES) ? (1 + (pass * 49) / MIN_SAMPLES) : (50 + (int)((49 * (tot - nbactive)) / tot));
+                    if (q > prog) { prog = q; setProgress(prog); }
+                    }
+                }
+
+
             // no copy
             ThreadPlaneDrawer(const ThreadPlaneDrawer &) = delete;
             ThreadPlaneDrawer & operator=(const ThreadPlaneDrawer &) = delete;
@@ -303,6 +486,14 @@ namespace mtools
 
             FastRNG _fastgen;                       // fast RNG
 
+            std::atomic<bool> _adaptive;            // true to use adaptive sampling
+            std::vector<double> _sqr;               // sum of the squared norms of the samples of each pixel (adaptive sampling)
+
+            static const bool HAS_BATCH = mtools::GetColorPlaneBatchSelector<ObjType>::has_getColorBatch;  // true if the object has a getColorBatch() method
+            std::vector<fVec2> _bpos;               // buffer for the positions passed to getColorBatch()
+            std::vector<RGBc> _bcol;                // buffer for the colors returned by getColorBatch()
+            std::vector<int64> _bidx;               // buffer for the indexes of the pixels sampled in a line (adaptive sampling)
+
         };
 
 
@@ -326,7 +517,7 @@ namespace mtools
             *
             * @param [in,out]  obj The object to draw
             **/
-            PlaneDrawer(ObjType * obj, int nbthread = 1) :  _obj(obj), _vecThread()
+            PlaneDrawer(ObjType * obj, int nbthread = 1) :  _obj(obj), _vecThread(), _priority(ThreadScheduler::PRIORITY_NORMAL), _adaptive(false)
                 {
                 static_assert(mtools::GetColorPlaneSelector<ObjType>::has_getColor, "The object must be implement one of the getColor() methods recognized by GetColorPlaneSelector.");
                 if (nbthread < 1) nbthread = 1;
@@ -358,10 +549,43 @@ namespace mtools
                 if (nb == nbThreads()) return;
                 _deleteAllThread();
                 _vecThread.resize(nb);
-                for (int i = 0; i < nb; i++) { _vecThread[i] = new ThreadPlaneDrawer<ObjType>(_obj); }
+                for (int i = 0; i < nb; i++) { _vecThread[i] = new ThreadPlaneDrawer<ObjType>(_obj); _vecThread[i]->priority(_priority); _vecThread[i]->adaptiveSampling(_adaptive); }
                 }
 
 
+            /**
+            * Set the priority of the threads w.r.t. the global ThreadScheduler (see ThreadWorker::priority()).
+            **/
+            void priority(int prio)
+                {
+                _priority = prio;
+                for (size_t i = 0; i < _vecThread.size(); i++) { _vecThread[i]->priority(prio); }
+                }
+
+
+            /**
+            * Return the priority of the threads.
+            **/
+            int priority() const { return _priority; }
+
+
+            /**
+            * Enable/disable adaptive sampling (see ThreadPlaneDrawer). Used for the next drawing, call
+            * redraw() to apply it immediately.
+            **/
+            void adaptiveSampling(bool status)
+                {
+                _adaptive = status;
+                for (size_t i = 0; i < _vecThread.size(); i++) { _vecThread[i]->adaptiveSampling(status); }
+                }
+
+
+            /**
+            * Query if adaptive sampling is enabled.
+            **/
+            bool adaptiveSampling() const { return _adaptive; }
+
+
             /**
             * Determines if the drawing parameters are valid.
             **/
@@ -499,6 +723,8 @@ namespace mtools
 
             ObjType * _obj;                                             // the object to draw.
             std::vector< ThreadPlaneDrawer<ObjType>*  > _vecThread;     // vector of all the threads. 
+            int _priority;                                              // priority of the threads
+            bool _adaptive;                                             // adaptive sampling
 
 
         };
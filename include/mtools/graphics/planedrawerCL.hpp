@@ -0,0 +1,157 @@
+/** @file planedrawerCL.hpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+#pragma once
+
+// check if OpenCL must be enabled
+#include "../mtools_config.hpp"
+
+
+#if (MTOOLS_USE_OPENCL)
+
+#include "../misc/internal/mtools_export.hpp"
+#include "../extensions/openCL.hpp"
+#include "rgbc.hpp"
+#include "../maths/vec.hpp"
+#include "planedrawer.hpp"
+#include "plot2Dplane.hpp"
+
+#include <string>
+#include <mutex>
+#include <memory>
+#include <vector>
+
+
+namespace mtools
+	{
+
+
+	/**
+	 * Color function of the plane evaluated on an openCL device.
+	 *
+	 * The object is constructed from the openCL source of a function with the signature
+	 *
+	 *     uchar4 getColor(double2 pos)
+	 *
+	 * which returns the color (x = red, y = green, z = blue, w = alpha) of the point pos. The source
+	 * is completed with a kernel that evaluates this function on a whole block of points. The object
+	 * implements the getColorBatch() method (see GetColorPlaneBatchSelector) so it can be drawn with
+	 * PlaneDrawer (see PlaneDrawerCL) and plotted with Plot2DPlane, next to CPU objects in the same
+	 * Plotter2D. Each line of pixels computed by a drawing thread is sent to the device at once.
+	 *
+	 * Example:
+	 *
+	 *     PlaneColorCL circle("uchar4 getColor(double2 pos) { return (dot(pos,pos) < 1.0) ? (uchar4)(255,0,0,255) : (uchar4)(255,255,255,255); }");
+	 *     Plotter2D P;
+	 *     auto plane = makePlot2DPlaneCL(circle, 4, "circle");
+	 *     P[plane];
+	 *     P.plot();
+	 *
+	 * The device must support double precision (cl_khr_fp64). The calls to getColorBatch() are
+	 * thread-safe but serialized: all threads share the same command queue.
+	 **/
+	class PlaneColorCL
+		{
+
+		public:
+
+			/**
+			 * Constructor. Select the default platform/device and build the program.
+			 *
+			 * @param	source		   	openCL source defining the function uchar4 getColor(double2 pos).
+			 * @param	compileroptions	options passed to the openCL compiler.
+			 * @param	output		   	true to output information to mtools::cout.
+			 **/
+			PlaneColorCL(const std::string & source, const std::string & compileroptions = "", bool output = false);
+
+
+			/** Destructor. */
+			~PlaneColorCL();
+
+
+			/**
+			 * Compute the colors of n points on the device.
+			 *
+			 * @param	pos			array of the n points.
+			 * @param	n			number of points.
+			 * @param [in,out]	out	array where the n colors are written.
+			 **/
+			void getColorBatch(const fVec2 * pos, size_t n, RGBc * out);
+
+
+			/**
+			 * Single point version (required by GetColorPlaneSelector). Use getColorBatch() with n = 1, this
+			 * is slow and only used as a fallback.
+			 **/
+			RGBc getColor(fVec2 pos) { RGBc c; getColorBatch(&pos, 1, &c); return c; }
+
+
+			/**
+			 * Return the openCL bundle used by the object.
+			 **/
+			OpenCLBundle & bundle() { return _clbundle; }
+
+
+		private:
+
+			PlaneColorCL(const PlaneColorCL &) = delete;               // no copy
+			PlaneColorCL & operator=(const PlaneColorCL &) = delete;   //
+
+			/* make sure the device buffers can hold n points */
+			void _reserve(size_t n);
+
+			OpenCLBundle					_clbundle;	// platform, device, context and queue
+			std::unique_ptr<cl::Program>	_prog;		// the program
+			std::unique_ptr<cl::Kernel>		_kernel;	// the evaluation kernel
+			std::unique_ptr<cl::Buffer>		_buff_pos;	// positions on the device
+			std::unique_ptr<cl::Buffer>		_buff_col;	// colors on the device
+			size_t							_capacity;	// size of the device buffers (in number of points)
+			std::vector<double>				_hpos;		// positions on the host (x0,y0,x1,y1...)
+			std::mutex						_mut;		// serialize the calls
+		};
+
+
+	/**
+	 * Plane drawer whose color function is evaluated on an openCL device.
+	 **/
+	typedef PlaneDrawer<PlaneColorCL> PlaneDrawerCL;
+
+
+	/**
+	 * Factory function for creating a Plot2DPlane associated with a PlaneColorCL object. The object
+	 * must survive the plot.
+	 *
+	 * @param [in,out]	obj	The openCL color function.
+	 * @param	nbthreads  	The number of threads (hence of blocks sent simultaneously to the device).
+	 * @param	name	   	The name of the plot.
+	 *
+	 * @return	A plottable object.
+	 **/
+	inline Plot2DPlane<PlaneColorCL> makePlot2DPlaneCL(PlaneColorCL & obj, int nbthreads = 2, std::string name = "Plane (openCL)")
+		{
+		return Plot2DPlane<PlaneColorCL>(obj, nbthreads, name);
+		}
+
+
+	}
+
+
+#endif
+
+/* end of file */
+
@@ -28,6 +28,7 @@
 #include "internal/rangemanager.hpp"
 #include "interpolation.hpp"
 #include "internal/plot2Dbasegraph.hpp"
+#include "../containers/minmaxpyramid.hpp"
 
 
 namespace mtools
@@ -136,7 +137,7 @@ namespace mtools
          * @param   maxDomain   The maximum of the definition domain.
          * @param   name        The name of the plot .
          **/
-        Plot2DArray(const T * tab, size_t len, double minDomain, double maxDomain, std::string name = "Array") : Plot2DBaseGraphWithInterpolation(minDomain, maxDomain, name), _tab(tab), _len(len)
+        Plot2DArray(const T * tab, size_t len, double minDomain, double maxDomain, std::string name = "Array") : Plot2DBaseGraphWithInterpolation(minDomain, maxDomain, name), _tab(tab), _len(len), _decimation(DECIMATION_NONE)
             {
             }
 
@@ -149,7 +150,7 @@ namespace mtools
          * @param   len     The length of the array.
          * @param   name    The name of the plot .
          **/
-        Plot2DArray(const T * tab, size_t len, std::string name = "Array") : Plot2DBaseGraphWithInterpolation(0.0,(double)len,name), _tab(tab), _len(len)
+        Plot2DArray(const T * tab, size_t len, std::string name = "Array") : Plot2DBaseGraphWithInterpolation(0.0,(double)len,name), _tab(tab), _len(len), _decimation(DECIMATION_NONE)
             {
             }
 
@@ -157,7 +158,7 @@ namespace mtools
         /**
          * Move Constructor.
          **/
-        Plot2DArray(Plot2DArray && obj) : Plot2DBaseGraphWithInterpolation(std::move(obj)), _tab(obj._tab), _len(obj._len)
+        Plot2DArray(Plot2DArray && obj) : Plot2DBaseGraphWithInterpolation(std::move(obj)), _tab(obj._tab), _len(obj._len), _decimation((int)obj._decimation), _pyramid(std::move(obj._pyramid))
             {
             }
 
@@ -171,8 +172,88 @@ namespace mtools
             }
 
 
+        static const int DECIMATION_NONE = 0;       ///< sample the array at the center of each screen column (default).
+        static const int DECIMATION_MINMAX = 1;     ///< draw the min/max envelope of the elements inside each screen column.
+        static const int DECIMATION_LTTB = 2;       ///< draw one element per screen column chosen with the Largest-Triangle-Three-Buckets method.
+
+
+        /**
+         * Set how the array is drawn when a screen column contains several elements (line drawing
+         * only). With DECIMATION_MINMAX or DECIMATION_LTTB, a min/max pyramid of the array is built
+         * (incrementally when the array grows) so that the cost of a drawing depends on the width of
+         * the screen and not on the size of the array.
+         *
+         * @param   type    One of DECIMATION_NONE, DECIMATION_MINMAX, DECIMATION_LTTB.
+         **/
+        void decimation(int type)
+            {
+            MTOOLS_ASSERT((type == DECIMATION_NONE) || (type == DECIMATION_MINMAX) || (type == DECIMATION_LTTB));
+            _decimation = type;
+            refresh();
+            }
+
+
+        /**
+         * Return the decimation method: DECIMATION_NONE, DECIMATION_MINMAX or DECIMATION_LTTB.
+         **/
+        int decimation() const { return _decimation; }
+
+
+        /**
+         * Discard the min/max pyramid. Must be called when elements of the array already drawn are
+         * modified (appending elements does not require it).
+         **/
+        void resetDecimation()
+            {
+            enable(false);
+            _pyramid.clear();
+            enable(true);
+            }
+
+
         protected:
 
+
+        /**
+         * Compute the min/max (or the LTTB representative) of the elements inside each column.
+         **/
+        virtual bool _columns(const fBox2 & R, int nbcol, double * ymin, double * ymax) const override
+            {
+            const int dec = _decimation;
+            if ((dec == DECIMATION_NONE) || (_tab == nullptr) || (_len == 0) || (nbcol <= 0)) return false;
+            const double e = (_maxDomain - _minDomain) / _len;
+            if (!((e >= DBL_MIN * 2) && (e <= DBL_MAX / 2.0))) return false;
+            const double w = R.lx() / nbcol;
+            if (w < 2 * e) return false; // less than 2 elements per column: use the usual drawing
+            _pyramid.update(_tab, _len);
+            // range of elements whose interval intersects [x1,x2[
+            auto first = [&](double x) -> size_t { const double v = floor((x - _minDomain) / e); return (v <= 0) ? 0 : ((v >= (double)_len) ? _len : (size_t)v); };
+            auto last = [&](double x) -> size_t { const double v = ceil((x - _minDomain) / e); return (v <= 0) ? 0 : ((v >= (double)_len) ? _len : (size_t)v); };
+            if (dec == DECIMATION_MINMAX)
+                {
+                for (int i = 0; i < nbcol; i++)
+                    {
+                    const MinMaxPyramid::Node N = _pyramid.query(_tab, first(R.min[0] + i*w), last(R.min[0] + (i + 1)*w));
+                    if (N.count == 0) { ymin[i] = ymax[i] = std::numeric_limits<double>::quiet_NaN(); } else { ymin[i] = N.min; ymax[i] = N.max; }
+                    }
+                return true;
+                }
+            // LTTB: the buckets are the columns intersecting the domain
+            const int i0 = std::max<int>(0, (int)floor((_minDomain - R.min[0]) / w));
+            const int i1 = std::min<int>(nbcol, (int)ceil((_maxDomain - R.min[0]) / w));
+            for (int i = 0; i < nbcol; i++) { ymin[i] = ymax[i] = std::numeric_limits<double>::quiet_NaN(); }
+            if (i0 >= i1) return true;
+            std::vector<size_t> sel;
+            _pyramid.lttb(_tab, first(R.min[0] + i0*w), last(R.min[0] + i1*w), (size_t)(i1 - i0), sel);
+            for (int i = i0; i < i1; i++)
+                {
+                const size_t k = sel[(size_t)(i - i0)];
+                if (k < _len) { ymin[i] = ymax[i] = (double)_tab[k]; }
+                }
+            return true;
+            }
+
+
         /**
          * Get the value of the function at x, return a quiet NAN if x is not in the definiton domain.
          **/
@@ -227,6 +308,11 @@ namespace mtools
         mutable const T * _tab; // need to be mutable because modified by Plot2DVector in const method _funcion
         mutable size_t _len;    // same here
 
+        private:
+
+        std::atomic<int> _decimation;       // the decimation method
+        mutable MinMaxPyramid _pyramid;     // min/max pyramid of the array (built when drawing)
+
         };
 
 
@@ -42,6 +42,10 @@ namespace mtools
      * Plot Object which encapsulate a CImg image. The image is either centered at
      * the origin or such that its bottom left corner is at the origin.
      * It is possible to change the image even while being displayed or to remove it by passing nullptr.
+     *
+     * The planar CImg data is converted once into an internal Image (with SIMD line kernels) each
+     * time the drawing is reset, so the drawing threads read interleaved RGBc pixels instead of
+     * gathering four planes per pixel. Call update() after modifying the CImg image in place.
      **/
     class  Plot2DCImg : public internals_graphics::Plotter2DObj, protected internals_graphics::Drawable2DInterface
     {
@@ -108,6 +112,13 @@ namespace mtools
 		cimg_library::CImg<unsigned char> * image() const;
 
 
+        /**
+         * Convert again the CImg image and redraw the plot. Call this method after modifying the
+         * content of the image.
+         **/
+		void update() { resetDrawing(); }
+
+
         /**
          * Sets the image position.
          *
@@ -136,22 +147,14 @@ namespace mtools
          **/
 		inline RGBc getColor(iVec2 pos)
             {
-            if (_im == nullptr) return RGBc::c_Transparent;
-			const int64 lx = _im->width();
-			const int64 ly = _im->height();
+            if (_conv.isEmpty()) return RGBc::c_Transparent;
+			const int64 lx = _conv.lx();
+			const int64 ly = _conv.ly();
 			int64 x = pos.X();
 			int64 y = pos.Y();
 			if (_typepos == TYPECENTER) { x += lx/2; y += ly/2; }
 			if ((x <0)||(y < 0)||(x >= lx)||(y >= ly)) return RGBc::c_Transparent;
-			y = ly - 1 - y;
-			const int64 lxy = lx*ly;
-			int64 off = x + lx*y;
-			const unsigned char * p = _im->data();
-			const char r = *(p + off);
-			const char g = *(p + off + lxy);
-			const char b = *(p + off + 2*lxy);
-			const char a = ((_im->spectrum() < 4) ? (const char)255 : (*(p + off + 3*lxy)));
-			return RGBc(r, g, b, a);
+			return _conv(x, ly - 1 - y);
             }
 
 
@@ -184,6 +187,8 @@ namespace mtools
 
 		virtual int nbThreads() const override;
 
+		virtual void threadsPriority(int prio) override;
+
 
 		/***************************************
 		* Override from the Drawable2DInterface.
@@ -197,6 +202,9 @@ namespace mtools
     private:
 
 
+		/* convert the CImg image into _conv (the drawing threads must be stopped) */
+		void _convert();
+
 		/* compute the range of the image */
 		fBox2 computeRange();
 
@@ -213,6 +221,7 @@ namespace mtools
 
         std::atomic<int>  _typepos;                      // position of the image wrt the origin
 		cimg_library::CImg<unsigned char> * _im;         // pointer to the source image
+		Image _conv;									 // the source image converted to RGBc (empty if none)
 
 		PixelDrawer<Plot2DCImg> * _PD;					 // the pixel drawer
 		ProgressImg * _proImg;							 // the progress image
@@ -0,0 +1,167 @@
+/** @file plot2Dextab.hpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include "../misc/internal/mtools_export.hpp"
+#include "internal/plot2Dbasegraph.hpp"
+#include "../containers/extab.hpp"
+
+#include <cmath>
+#include <limits>
+
+
+namespace mtools
+{
+
+    template<typename T> class Plot2DExTab;
+
+
+    /**
+     * Factory function for creating a plot of an ExTab object.
+     *
+     * @param   tab     The table to plot.
+     * @param   name    The name of the plot.
+     *
+     * @return  A Plot2DExTab object encapsulating the table.
+     **/
+    template<typename T>  Plot2DExTab<T>  makePlot2DExTab(const ExTab<T> & tab, std::string name = "ExTab")
+        {
+        return Plot2DExTab<T>(tab, name);
+        }
+
+
+    /**
+     * Plot object for an ExTab<T> (summary of a sequence too long to be stored).
+     *
+     * Entry i of the sequence is drawn on [i, i+1[ and the domain [0, NbEntries()] grows with the
+     * table. Each screen column shows the min/max envelope of the cells of the table it intersects
+     * and the graph itself follows the median estimate of the cells. The cost of a drawing depends
+     * only on the width of the screen and the number of cells of the table, not on the number of
+     * entries.
+     *
+     * The table may be filled with ExTab::Add() while it is displayed (its storage is never
+     * reallocated by Add()). Before calling other modifying methods (append(), Load(), Reset()...),
+     * disable the object with suspend() and re-enable it afterwards.
+     *
+     * @code{.cpp}
+     * ExTab<int64> tab(6000);
+     * auto PE = makePlot2DExTab(tab);
+     * Plotter2D P;
+     * P[PE];
+     * P.autoredraw(300);
+     * P.startPlot();
+     * int64 x = 0;
+     * while (P.shown()) { x += ((Unif(gen) < 0.5) ? -1 : 1); tab.Add(x); }
+     * @endcode
+     *
+     * @tparam  T   Type of the values of the table, must be convertible to double.
+     **/
+    template< typename T > class  Plot2DExTab : public internals_graphics::Plot2DBaseGraph
+        {
+
+        public:
+
+        /**
+         * Constructor.
+         *
+         * @param   tab     The table to plot.
+         * @param   name    The name of the plot.
+         **/
+        Plot2DExTab(const ExTab<T> & tab, std::string name = "ExTab") : Plot2DBaseGraph(0.0, (double)tab.NbEntries(), name), _tab(&tab)
+            {
+            }
+
+
+        /**
+         * Move Constructor.
+         **/
+        Plot2DExTab(Plot2DExTab && obj) : Plot2DBaseGraph(std::move(obj)), _tab(obj._tab)
+            {
+            }
+
+
+        /**
+         * Destructor. Remove the object if it is still inserted.
+         **/
+        virtual ~Plot2DExTab()
+            {
+            detach(); // detach from its owner if there is still one.
+            }
+
+
+        protected:
+
+
+        /**
+         * Min/max of the cells intersecting each column.
+         **/
+        virtual bool _columns(const fBox2 & R, int nbcol, double * ymin, double * ymax) const override
+            {
+            const uint64 n = _sync();
+            if ((n == 0) || (nbcol <= 0)) return false;
+            const double w = R.lx() / nbcol;
+            for (int i = 0; i < nbcol; i++)
+                {
+                ymin[i] = ymax[i] = std::numeric_limits<double>::quiet_NaN();
+                const double x1 = R.min[0] + i*w, x2 = x1 + w;
+                if ((x2 <= 0) || (x1 >= (double)n)) continue;
+                const uint64 a = (x1 <= 0) ? 0 : (uint64)floor(x1);
+                const double c = ceil(x2);
+                const uint64 b = std::max<uint64>(a + 1, (c >= (double)n) ? n : (uint64)c);
+                T mn, mx;
+                if (_tab->range(a, b, mn, mx)) { ymin[i] = (double)mn; ymax[i] = (double)mx; }
+                }
+            return true;
+            }
+
+
+        /**
+         * Median estimate of the cell containing entry floor(x).
+         **/
+        virtual double _function(double x) const override
+            {
+            const uint64 n = _sync();
+            if (!((x >= 0) && (x < (double)n))) return std::numeric_limits<double>::quiet_NaN();
+            return (double)_tab->medV((uint64)x);
+            }
+
+
+        private:
+
+        /* update the domain with the number of entries of the table */
+        uint64 _sync() const
+            {
+            const uint64 n = (uint64)_tab->NbEntries();
+            _minDomain = 0.0;
+            _maxDomain = (double)n;
+            return n;
+            }
+
+        const ExTab<T> * _tab;
+
+        };
+
+
+}
+
+
+/* end of file */
+
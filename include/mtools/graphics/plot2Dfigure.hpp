@@ -31,9 +31,12 @@
 #include "../io/internal/fltkSupervisor.hpp"
 #include "../misc/internal/forward_fltk.hpp"
 #include "../misc/internal/threadworker.hpp"
+#include "../misc/profiler.hpp"
 #include "../misc/internal/threadsafequeue.hpp"
 
 #include <atomic>
+#include <mutex>
+#include <vector>
 
 
 
@@ -46,7 +49,9 @@ namespace mtools
 	/**
 	* "Worker thread" that draws figures inside an Image object.
 	*
-	* Each thread has its own queue which is polled to query figures to draw.
+	* All the workers pop the figures to draw from the same queue, filled by the dispatcher, so a
+	* worker that is done with cheap figures simply takes the next ones. An idle worker sleeps on
+	* the queue instead of spinning.
 	* Instances of this class are created and managed by the FigureDrawerDispatcher class.
 	*/
 	class FigureDrawerWorker : public ThreadWorker
@@ -55,7 +60,7 @@ namespace mtools
 	public:
 
 		/** Constructor. Initially disabled, and not not active: nothing is drawn. */
-		FigureDrawerWorker() : ThreadWorker(), _queue(QUEUE_SIZE), _nb_drawn(0), _im(nullptr), _R(fBox2()), _hq(true)
+		FigureDrawerWorker() : ThreadWorker(), _queue(nullptr), _nb_drawn(0), _im(nullptr), _R(fBox2()), _hq(true)
 		{
 		}
 
@@ -70,10 +75,10 @@ namespace mtools
 
 
 		/** Set the parameters. requestStop() must have been called previously ! */
-		void set(Image* im, fBox2 R, bool hq)
+		void set(Image* im, fBox2 R, bool hq, MultiProducerMultiConsumerQueue<FigureInterface*> * queue)
 		{
 			sync();
-			_queue.clear();
+			_queue = queue;
 			_nb_drawn = 0;
 			_im = im;
 			_R = R;
@@ -95,18 +100,10 @@ namespace mtools
 		}
 
 
-		/** push a new figure in the queue */
-		MTOOLS_FORCEINLINE bool pushfigure(FigureInterface* fig)
+		/* number of figures drawn since the work started */
+		MTOOLS_FORCEINLINE size_t nbDrawn() const
 		{
-			return _queue.push(fig);
-		}
-
-
-		/* current progress w.r.t. the queue size, between 0 and 45 (queue empty) */
-		MTOOLS_FORCEINLINE int current_prog() const
-		{
-			if (_nb_drawn == 0) return 0;
-			return (int)((45 * _nb_drawn) / (_nb_drawn + _queue.size()));
+			return _nb_drawn;
 		}
 
 	protected:
@@ -121,12 +118,16 @@ namespace mtools
 			fBox2 R = _R;
 			Image * im = _im;
 			MTOOLS_INSURE(im != nullptr);
+			MTOOLS_INSURE(_queue != nullptr);
 			_nb_drawn = 0;
 			while (1)
 			{
 				FigureInterface * obj;
-				while (!_queue.pop(obj)) { check(); std::this_thread::yield(); }
-				obj->draw(*im, R, hq);
+				while (!_queue->pop_wait(obj)) { check(); }
+				{
+					MTOOLS_PROF_SCOPE("FigureDrawerWorker::draw");
+					obj->draw(*im, R, hq);
+				}
 				_nb_drawn++;
 				check();
 			}
@@ -159,11 +160,10 @@ namespace mtools
 
 	private:
 
-		static const size_t QUEUE_SIZE = 16 * 1024 * 1024;	// max queue size. 					
 		static const int64 CODE_STOP_AND_WAIT = 0;
 		static const int64 CODE_RESTART = 1;
 
-		SingleProducerSingleConsumerQueue<FigureInterface*> _queue;	// the queue containing the figures to draw
+		MultiProducerMultiConsumerQueue<FigureInterface*> * _queue;	// the (shared) queue containing the figures to draw
 		std::atomic<size_t> _nb_drawn;								// number of figure drawn since the work started 
 		std::atomic<Image*> _im;									// the image to draw onto
 		std::atomic<fBox2>  _R;										// range to use
@@ -173,9 +173,157 @@ namespace mtools
 
 
 
+	/**
+	* "Worker thread" that draws the figures of a TreeFigure object tile by tile (tiling mode of
+	* FigureDrawerDispatcher).
+	*
+	* The image is divided into square tiles. The workers share a counter giving the next tile to
+	* draw: for each tile, a worker queries the TreeFigure object for the figures that intersect the
+	* tile and draws them into a shallow sub-image restricted to the tile. Tiles are disjoint so the
+	* workers never write the same pixel and the result does not depend on the number of threads.
+	* Instances of this class are created and managed by the FigureDrawerDispatcher class.
+	*/
+	template<int N> class FigureTileWorker : public ThreadWorker
+	{
+
+	public:
+
+		/** Constructor. Initially disabled, and not not active: nothing is drawn. */
+		FigureTileWorker() : ThreadWorker(), _figTree(nullptr), _im(nullptr), _R(fBox2()), _hq(true), _tileSize(64), _nextTile(nullptr), _doneTiles(nullptr)
+		{
+		}
+
+
+		/** dtor. */
+		virtual ~FigureTileWorker()
+		{
+			requestStop();
+			sync();
+			_im = nullptr;
+		}
+
+
+		/** Set the parameters. requestStop() must have been called previously ! */
+		void set(TreeFigure<FigureInterface*, N> * figtree, Image* im, fBox2 R, bool hq, int64 tileSize, std::atomic<size_t> * nextTile, std::atomic<size_t> * doneTiles)
+		{
+			sync();
+			_figTree = figtree;
+			_im = im;
+			_R = R;
+			_hq = hq;
+			_tileSize = tileSize;
+			_nextTile = nextTile;
+			_doneTiles = doneTiles;
+		}
+
+
+		/** Request stop for any work in progress. Use sync() to wait for completion. */
+		MTOOLS_FORCEINLINE void requestStop()
+		{
+			signal(CODE_STOP_AND_WAIT);
+		}
+
+
+		/* (re)start work. Return without waiting for sync(). */
+		MTOOLS_FORCEINLINE void restart()
+		{
+			signal(CODE_RESTART);
+		}
+
+
+		/** Number of tiles of an image of size lx x ly. */
+		static size_t nbTiles(int64 lx, int64 ly, int64 tileSize)
+		{
+			return (size_t)(((lx + tileSize - 1) / tileSize) * ((ly + tileSize - 1) / tileSize));
+		}
+
+
+	protected:
+
+
+		/**
+		* Work method: draw tiles until there are none left.
+		**/
+		virtual void work() override
+		{
+			Image * im = _im;
+			MTOOLS_INSURE(im != nullptr);
+			MTOOLS_INSURE(_figTree != nullptr);
+			const fBox2 R = _R;
+			const bool hq = _hq;
+			const int64 ts = _tileSize;
+			const int64 LX = im->lx(), LY = im->ly();
+			if ((LX <= 0) || (LY <= 0)) return;
+			const int64 ntx = (LX + ts - 1) / ts;
+			const size_t nbt = nbTiles(LX, LY, ts);
+			const double px = (R.max[0] - R.min[0]) / LX; // size of a pixel
+			const double py = (R.max[1] - R.min[1]) / LY;
+			size_t k;
+			while ((k = _nextTile->fetch_add(1)) < nbt)
+			{
+				const int64 x0 = ((int64)k % ntx) * ts, y0 = ((int64)k / ntx) * ts;
+				const int64 tx = std::min<int64>(ts, LX - x0), ty = std::min<int64>(ts, LY - y0);
+				Image sub(*im, x0, y0, tx, ty, true);	// shallow: shares the pixels of the tile
+				// range such that the pixels of sub are exactly those of the tile in im (pixel y is counted from the top)
+				fBox2 Rt(R.min[0] + x0 * px, R.min[0] + (x0 + tx) * px, R.min[1] + (LY - y0 - ty) * py, R.min[1] + (LY - y0) * py);
+				_figTree->iterate_intersect(zoomOut(Rt), [&](const typename TreeFigure<FigureInterface*, N>::BoundedObject & bo) -> void
+				{
+					check();
+					bo.object->draw(sub, Rt, hq);
+				});
+				(*_doneTiles)++;
+				check();
+			}
+		}
+
+
+		/**
+		* Process incomming messages
+		**/
+		virtual int message(int64 code)
+		{
+			switch (code)
+			{
+			case CODE_RESTART:
+			{ // start drawing operations
+				return THREAD_RESET;
+			}
+			case CODE_STOP_AND_WAIT:
+			{ // stop all drawing operation and wait until new messages arrive
+				return THREAD_RESET_AND_WAIT;
+			}
+			default:
+			{
+				MTOOLS_ERROR("should not be possible...");
+			}
+			}
+			return THREAD_RESET_AND_WAIT;
+		}
+
+
+	private:
+
+		static const int64 CODE_STOP_AND_WAIT = 0;
+		static const int64 CODE_RESTART = 1;
+
+		TreeFigure<FigureInterface*, N> *	_figTree;	// the figures to draw
+		std::atomic<Image*>		_im;					// the image to draw onto
+		std::atomic<fBox2>		_R;						// range to use
+		std::atomic<bool>		_hq;					// true for high quality drawing
+		std::atomic<int64>		_tileSize;				// size of the tiles in pixels
+		std::atomic<size_t> *	_nextTile;				// shared counter: next tile to draw
+		std::atomic<size_t> *	_doneTiles;				// shared counter: number of tiles completed
+
+	};
+
+
+
 	/**
 	* Class that manage a TreeFigure object and draws it onto an Image using
 	* one or more FigureDrawerWorker instances.
+	* 
+	* In tiling mode (cf. setTiling()), FigureTileWorker instances are used instead: each one draws
+	* whole tiles of the image, which is race free and deterministic.
 	*/
 	template<int N> class FigureDrawerDispatcher : protected ThreadWorker
 	{
@@ -183,7 +331,7 @@ namespace mtools
 	public:
 
 		/** Constructor. Set the object in an empty state that does nothing. */
-		FigureDrawerDispatcher() : _figTree(nullptr), _workers(nullptr), _images(), _nb(0), _phase(0), _R(fBox2())
+		FigureDrawerDispatcher() : _figTree(nullptr), _workers(nullptr), _tileWorkers(nullptr), _images(), _queue(QUEUE_SIZE), _nb(0), _phase(0), _R(fBox2()), _lodPixels(0), _tileSize(0), _nextTile(0), _doneTiles(0), _nbTiles(0)
 		{
 		}
 
@@ -192,6 +340,8 @@ namespace mtools
 		{
 			delete[] _workers;
 			_workers = nullptr;
+			delete[] _tileWorkers;
+			_tileWorkers = nullptr;
 		}
 
 
@@ -206,7 +356,10 @@ namespace mtools
 			stopAll();						// interrupt any work in progress
 			_figTree = figtree;				// save the tree figure object
 			delete[] _workers;				// delete previous threads (if any)
+			delete[] _tileWorkers;			//
 			_workers = new FigureDrawerWorker[images.size()]; // create the worker threads
+			_tileWorkers = new FigureTileWorker<N>[images.size()]; //
+			for (size_t i = 0; i < images.size(); i++) { _workers[i].priority(priority()); _tileWorkers[i].priority(priority()); }
 			_images = images;				// save the images. 
 			_phase = 0;						// nothing done...
 			_nb = 0;						// yet...
@@ -224,6 +377,59 @@ namespace mtools
 		}
 
 
+		/**
+		* Enable/disable the level of detail mode. When enabled, the subtrees of the TreeFigure object
+		* whose node covers at most lodPixels x lodPixels pixels are not sent to the worker threads:
+		* their LOD summary (cf. TreeFigure::computeLOD()) is drawn instead.
+		*
+		* The summaries are computed, using FigureInterface::lodColor(), if they are not yet available.
+		* Stop the drawing (call restart() afterward).
+		*
+		* @param	lodPixels	size (in pixels) below which nodes are summarized (0 to disable).
+		**/
+		void setLOD(int lodPixels)
+		{
+			stopAll();
+			_lodPixels = (lodPixels < 0) ? 0 : lodPixels;
+			if ((_lodPixels > 0) && (_figTree != nullptr) && (!_figTree->hasLOD()))
+			{
+				_figTree->computeLOD([](const typename TreeFigure<FigureInterface*, N>::BoundedObject & bo) -> RGBc { return bo.object->lodColor(); });
+			}
+		}
+
+
+		/** Return the current LOD threshold in pixels (0 = LOD disabled). */
+		int getLOD() const
+		{
+			return _lodPixels;
+		}
+
+
+		/**
+		* Enable/disable the tiling mode. In this mode, the image is divided into tiles of 
+		* tileSize x tileSize pixels drawn independently by the worker threads (each tile is drawn
+		* by a single thread with the figures returned by TreeFigure::iterate_intersect() for the 
+		* tile). The LOD mode is not used in tiling mode.
+		*
+		* Tiling requires all worker threads to draw on the same image (it is ignored otherwise).
+		* Stop the drawing (call restart() afterward).
+		*
+		* @param	tileSize	size of the tiles in pixels (0 to disable tiling).
+		**/
+		void setTiling(int64 tileSize)
+		{
+			stopAll();
+			_tileSize = (tileSize < 0) ? 0 : tileSize;
+		}
+
+
+		/** Return the size of the tiles (0 if tiling is disabled). */
+		int64 getTiling() const
+		{
+			return _tileSize;
+		}
+
+
 		/** restart the drawing */
 		void restart(fBox2 R, bool hq)
 		{
@@ -231,7 +437,18 @@ namespace mtools
 			_nb = 0;
 			_phase = 0;
 			_R = R;
-			for (size_t i = 0; i < _images.size(); i++) { _workers[i].set(_images[i], R, hq); } // set parameters for worker threads
+			if (_tiling())
+			{
+				_nextTile = 0;
+				_doneTiles = 0;
+				_nbTiles = FigureTileWorker<N>::nbTiles(_images[0]->lx(), _images[0]->ly(), _tileSize);
+				_phase = 2;
+				for (size_t i = 0; i < _images.size(); i++) { _tileWorkers[i].set(_figTree, _images[0], R, hq, _tileSize, &_nextTile, &_doneTiles); }
+				for (size_t i = 0; i < _images.size(); i++) { _tileWorkers[i].restart(); }
+				return;
+			}
+			_queue.clear();
+			for (size_t i = 0; i < _images.size(); i++) { _workers[i].set(_images[i], R, hq, &_queue); } // set parameters for worker threads
 			signal(CODE_RESTART); // start the dispatcher thread
 			for (size_t i = 0; i < _images.size(); i++) { _workers[i].restart(); } // start the worker threads. 
 		}
@@ -249,7 +466,7 @@ namespace mtools
 		void requestStopAll()
 		{
 			signal(CODE_STOP_AND_WAIT); //request stop the dispatcher thread
-			for (size_t i = 0; i < _images.size(); i++) { _workers[i].requestStop(); } // stop the worker threads
+			for (size_t i = 0; i < _images.size(); i++) { _workers[i].requestStop(); _tileWorkers[i].requestStop(); } // stop the worker threads
 		}
 
 
@@ -257,7 +474,7 @@ namespace mtools
 		void syncAll()
 		{
 			sync();
-			for (size_t i = 0; i < _images.size(); i++) { _workers[i].sync(); } // stop the worker threads
+			for (size_t i = 0; i < _images.size(); i++) { _workers[i].sync(); _tileWorkers[i].sync(); } // stop the worker threads
 		}
 
 
@@ -273,9 +490,17 @@ namespace mtools
 		{
 			if (enable() == status) return;
 			enable(status);
-			for (size_t i = 0; i < _images.size(); i++) { _workers[i].enable(status); }
+			for (size_t i = 0; i < _images.size(); i++) { _workers[i].enable(status); _tileWorkers[i].enable(status); }
 			sync();
-			for (size_t i = 0; i < _images.size(); i++) { _workers[i].sync(); }
+			for (size_t i = 0; i < _images.size(); i++) { _workers[i].sync(); _tileWorkers[i].sync(); }
+		}
+
+
+		/** Set the priority of all the threads w.r.t. the global ThreadScheduler */
+		void priorityAllThreads(int prio)
+		{
+			priority(prio);
+			for (size_t i = 0; i < _images.size(); i++) { _workers[i].priority(prio); _tileWorkers[i].priority(prio); }
 		}
 
 
@@ -290,6 +515,11 @@ namespace mtools
 		/** Return the quality of the image currently drawn. 100 = finshed drawing. */
 		int quality() const
 		{
+			if (_phase == 2)
+			{ // tiling mode
+				if (_nbTiles == 0) return 100;
+				return (int)((100 * _doneTiles) / _nbTiles);
+			}
 			if (_phase == 0)
 			{
 				int64 u = _nb;
@@ -300,10 +530,10 @@ namespace mtools
 			else
 			{
 				const size_t Nth = _images.size();
-				int tot = 0;
-				for (size_t i = 0; i < Nth; i++) { tot += _workers[i].current_prog(); }
-				tot /= ((int)Nth);
-				return 55 + tot;
+				size_t drawn = 0;
+				for (size_t i = 0; i < Nth; i++) { drawn += _workers[i].nbDrawn(); }
+				if (drawn == 0) return 55;
+				return 55 + (int)((45 * drawn) / (drawn + _queue.size())); // 45 when the queue is empty
 			}
 		}
 
@@ -317,21 +547,34 @@ namespace mtools
 		virtual void work() override
 		{
 			_phase = 0; // iterating
-			const int64 Nth = _images.size();	// number of worker threads.
-			int64 th = 0;						// index of the thread to use. 
-												// iterate over the figures to draw
 			fBox2 oR = zoomOut((fBox2)_R);
-			_figTree->iterate_intersect(oR,
-				[&](mtools::TreeFigure<FigureInterface *, N, double>::BoundedObject & bo) -> void
+			auto pushfun = [&](const typename mtools::TreeFigure<FigureInterface *, N, double>::BoundedObject & bo) -> void
 			{
-				do
-				{
-					check(); // check if we should interrupt 
-					th++;
-					if (th >= Nth) th = 0;
-				} while (!_workers[th].pushfigure(bo.object));
+				check(); // check if we should interrupt 
+				while (!_queue.push_wait(bo.object)) { check(); } // wait for the workers if the queue is full
 				_nb++;
-			});
+			};
+			if ((_lodPixels > 0) && (_figTree->hasLOD()) && (_images[0]->lx() > 0) && (_images[0]->ly() > 0))
+			{ // small subtrees are drawn directly from their summary
+				const fBox2 R = _R;
+				Image * im = _images[0];
+				const double lodsize = _lodPixels * std::max<double>(R.lx() / (double)im->lx(), R.ly() / (double)im->ly());
+				const int L = TreeFigure<FigureInterface*, N>::LODRaster::LOD_SIZE;
+				_figTree->iterate_intersect_lod(oR, lodsize, pushfun,
+					[&](const fBox2 & nodebox, const typename TreeFigure<FigureInterface*, N>::LODRaster & raster) -> void
+				{
+					check();
+					for (int j = 0; j < L; j++) for (int i = 0; i < L; i++)
+					{
+						if (raster.coverage[i + L*j] > 0) im->canvas_draw_box(R, TreeFigure<FigureInterface*, N>::LODRaster::cellBox(nodebox, i, j), raster.color[i + L*j], true);
+					}
+					_nb++;
+				});
+			}
+			else
+			{
+				_figTree->iterate_intersect(oR, pushfun);
+			}
 			_phase = 1; // finished iterating.
 		}
 
@@ -362,15 +605,32 @@ namespace mtools
 
 	private:
 
+		static const size_t QUEUE_SIZE = 1024 * 1024;	// max queue size. 					
 		static const int64 CODE_STOP_AND_WAIT = 0;
 		static const int64 CODE_RESTART = 1;
 
 		TreeFigure<FigureInterface*, N> *   _figTree;	// container for all figure objects.
 		FigureDrawerWorker *  _workers;					// vector containing the worker threads.
 		std::vector<Image *> _images;					// vector containing the images to draw onto
+		FigureTileWorker<N> * _tileWorkers;				// vector containing the worker threads for the tiling mode.
+		MultiProducerMultiConsumerQueue<FigureInterface*> _queue;	// queue shared by the worker threads
 		std::atomic<int64>	_nb;						// number of figure processed
 		std::atomic<int>	_phase;						// drawing phase
 		std::atomic<fBox2>	_R;							// range
+		std::atomic<int>	_lodPixels;					// LOD threshold in pixels (0 = disabled)
+		std::atomic<int64>	_tileSize;					// size of the tiles (0 = no tiling)
+		std::atomic<size_t>	_nextTile;					// next tile to draw (tiling mode)
+		std::atomic<size_t>	_doneTiles;					// number of tiles drawn (tiling mode)
+		std::atomic<size_t>	_nbTiles;					// total number of tiles (tiling mode)
+
+
+		/* true if the tiling mode is active */
+		bool _tiling() const
+		{
+			if ((_tileSize <= 0) || (_images.size() == 0) || (_images[0]->lx() <= 0) || (_images[0]->ly() <= 0)) return false;
+			for (size_t i = 1; i < _images.size(); i++) { if (_images[i] != _images[0]) return false; }
+			return true;
+		}
 
 	};
 
@@ -391,27 +651,115 @@ namespace mtools
 		/**
 		* Constructor.
 		**/
-		Plot2DFigure(TreeFigure<FigureInterface*, N> * figtree, int nbthread = 2, std::string name = "Figure") : internals_graphics::Plotter2DObj(name), _figDrawer(nullptr), _im(), _R(), _hq(true)
+		Plot2DFigure(TreeFigure<FigureInterface*, N> * figtree, int nbthread = 2, std::string name = "Figure") : internals_graphics::Plotter2DObj(name), _figDrawer(nullptr), _figTree(figtree), _im(), _R(), _hq(true)
 		{
 			_figDrawer = new FigureDrawerDispatcher<N>;
 			_figDrawer->set(figtree, nbthread - 1, &_im);
+			if (nbthread > 2) _figDrawer->setTiling(DEFAULT_TILE_SIZE);
 		}
 
 
 		/**
 		* Constructor. Reference verison
 		**/
-		Plot2DFigure(TreeFigure<FigureInterface*, N> & figtree, int nbthread = 2, std::string name = "Figure") : internals_graphics::Plotter2DObj(name), _figDrawer(nullptr), _im(), _R(), _hq(true)
+		Plot2DFigure(TreeFigure<FigureInterface*, N> & figtree, int nbthread = 2, std::string name = "Figure") : internals_graphics::Plotter2DObj(name), _figDrawer(nullptr), _figTree(&figtree), _im(), _R(), _hq(true)
 		{
 			_figDrawer = new FigureDrawerDispatcher<N>;
 			_figDrawer->set(&figtree, nbthread - 1, &_im);
+			if (nbthread > 2) _figDrawer->setTiling(DEFAULT_TILE_SIZE);
+		}
+
+
+		/**
+		* Enable/disable the level of detail mode: when zoomed out, groups of figures covering at most
+		* lodPixels x lodPixels pixels are drawn as a coarse raster of their coverage and average colour
+		* instead of being drawn one by one (cf. FigureDrawerDispatcher::setLOD()).
+		*
+		* The LOD mode is not used in tiling mode so enabling it also disables tiling.
+		*
+		* @param	lodPixels	size (in pixels) below which figures are summarized (0 to disable).
+		**/
+		void setLOD(int lodPixels = 4)
+		{
+			if (lodPixels > 0) _figDrawer->setTiling(0);
+			_figDrawer->setLOD(lodPixels);
+			if ((_im.lx() > 0) && (_im.ly() > 0)) resetDrawing();
+		}
+
+
+		/**
+		* Enable/disable the tiling mode: the image is divided into tiles of tileSize x tileSize pixels
+		* drawn independently by the worker threads (cf. FigureDrawerDispatcher::setTiling()).
+		*
+		* Tiling is enabled by default when there is more than one worker thread: the threads never
+		* write the same pixel so the (costly) high quality drawing scales with the number of cores
+		* and the result does not depend on the number of threads.
+		*
+		* @param	tileSize	size of the tiles in pixels (0 to disable).
+		**/
+		void setTiling(int64 tileSize = DEFAULT_TILE_SIZE)
+		{
+			_figDrawer->setTiling(tileSize);
+			if ((_im.lx() > 0) && (_im.ly() > 0)) resetDrawing();
+		}
+
+
+		/**
+		* Enable/disable high quality drawing (enabled by default).
+		**/
+		void highQuality(bool status)
+		{
+			if (_hq == status) return;
+			_hq = status;
+			if ((_im.lx() > 0) && (_im.ly() > 0)) resetDrawing();
+		}
+
+
+		/**
+		* Query if high quality drawing is enabled.
+		**/
+		bool highQuality() const
+		{
+			return _hq;
+		}
+
+
+		/**
+		* Append a figure while the plot is displayed. May be called by any thread (e.g. a simulation
+		* emitting figures continuously) without stopping the drawing in progress.
+		*
+		* The new figures are drawn on top of the current image the next time the plot is displayed
+		* (as a delta, without restarting the dispatcher). They are inserted in the TreeFigure object
+		* only when a full redraw is needed anyway (range or size change, resetDrawing()...) since
+		* the tree cannot be modified while the worker threads are reading it.
+		*
+		* The figure is not copied: it must remain valid as long as the tree contains it (as for any
+		* object inserted directly in the TreeFigure object).
+		*
+		* @param [in]	fig	The figure to append.
+		**/
+		void append(FigureInterface * fig)
+		{
+			MTOOLS_ASSERT(fig != nullptr);
+			std::lock_guard<std::mutex> lock(_streamMut);
+			_streamPending.push_back(fig);
+		}
+
+
+		/**
+		* Number of figures appended that are not yet inserted in the TreeFigure object.
+		**/
+		size_t appendedPending() const
+		{
+			std::lock_guard<std::mutex> lock(_streamMut);
+			return _streamPending.size() + _streamDrawn.size();
 		}
 
 
 		/**
 		* Move constructor.
 		**/
-		Plot2DFigure(Plot2DFigure && o) : internals_graphics::Plotter2DObj(std::move(o)), _figDrawer(o._figDrawer), _im(std::move(o._im)), _R(o._R), _hq(O._hq)
+		Plot2DFigure(Plot2DFigure && o) : internals_graphics::Plotter2DObj(std::move(o)), _figDrawer(o._figDrawer), _figTree(o._figTree), _im(std::move(o._im)), _R(o._R), _hq(o._hq), _streamPending(std::move(o._streamPending)), _streamDrawn(std::move(o._streamDrawn))
 		{
 			o._figDrawer = nullptr;
 		}
@@ -435,6 +783,7 @@ namespace mtools
 		virtual void setParam(mtools::fBox2 range, mtools::iVec2 imageSize) override
 		{
 			_figDrawer->stopAll();
+			_mergeStream();
 			_im.resizeRaw(imageSize);
 			_im.clear(RGBc::c_Transparent);
 			_R = range;
@@ -445,6 +794,7 @@ namespace mtools
 		virtual void resetDrawing() override
 		{
 			_figDrawer->stopAll();
+			_mergeStream();
 			_im.clear(RGBc::c_Transparent);
 			_figDrawer->restart(_R, _hq);
 		}
@@ -452,7 +802,8 @@ namespace mtools
 
 		virtual int drawOnto(Image & im, float opacity = 1.0) override
 		{
-			auto q = _figDrawer->quality();
+			_drawStream();
+			auto q = quality();
 			im.blend(_im, { 0,0 }, opacity);
 			return q;
 		}
@@ -460,7 +811,13 @@ namespace mtools
 
 		virtual int quality() const override
 		{
-			return _figDrawer->quality();
+			int q = _figDrawer->quality();
+			if (q >= 100)
+			{ // not finished if there are appended figures not drawn yet
+				std::lock_guard<std::mutex> lock(_streamMut);
+				if (_streamPending.size() > 0) q = 99;
+			}
+			return q;
 		}
 
 
@@ -482,6 +839,12 @@ namespace mtools
 		}
 
 
+		virtual void threadsPriority(int prio) override
+		{
+			_figDrawer->priorityAllThreads(prio);
+		}
+
+
 		/**
 		* Override of the removed method, nothing to do...
 		**/
@@ -503,11 +866,55 @@ namespace mtools
 	private:
 
 
+		static const int64 DEFAULT_TILE_SIZE = 64;	// size of the tiles when tiling is enabled by default
+
+		/* draw the figures appended since the last call on top of the image */
+		void _drawStream()
+		{
+			std::vector<FigureInterface *> figs;
+			{
+				std::lock_guard<std::mutex> lock(_streamMut);
+				if (_streamPending.size() == 0) return;
+				figs.swap(_streamPending);
+			}
+			if ((_im.lx() > 0) && (_im.ly() > 0))
+			{
+				const fBox2 oR = zoomOut(_R);
+				for (auto f : figs)
+				{
+					if (intersectionRect(f->boundingBox(), oR).isEmpty()) continue;
+					fBox2 R = _R;
+					f->draw(_im, R, _hq);
+				}
+			}
+			std::lock_guard<std::mutex> lock(_streamMut);
+			_streamDrawn.insert(_streamDrawn.end(), figs.begin(), figs.end());
+		}
+
+
+		/* insert the appended figures in the tree. The drawing threads must be stopped. */
+		void _mergeStream()
+		{
+			std::lock_guard<std::mutex> lock(_streamMut);
+			if ((_streamDrawn.size() == 0) && (_streamPending.size() == 0)) return;
+			for (auto f : _streamDrawn) { _figTree->insert(f->boundingBox(), f); }
+			for (auto f : _streamPending) { _figTree->insert(f->boundingBox(), f); }
+			_streamDrawn.clear();
+			_streamPending.clear();
+			if (_figDrawer->getLOD() > 0) _figDrawer->setLOD(_figDrawer->getLOD());	// recompute the LOD summaries discarded by the insertions
+		}
+
+
 		FigureDrawerDispatcher<N> * _figDrawer;  // figure drawer dispatcher object. 
+		TreeFigure<FigureInterface*, N> * _figTree; // the figures
 		Image						_im;		 // image to draw onto
 		fBox2						_R;			 // range to draw
 		bool						_hq;		 // use high quality.
 
+		mutable std::mutex				_streamMut;		// protects the two vectors below
+		std::vector<FigureInterface *>	_streamPending;	// figures appended, not drawn yet
+		std::vector<FigureInterface *>	_streamDrawn;	// figures appended, drawn on the image but not yet in the tree
+
 	};
 
 
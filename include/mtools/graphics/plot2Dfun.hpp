@@ -26,6 +26,12 @@
 
 #include <string>
 #include <limits>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <unordered_map>
+#include <cmath>
+#include <cfloat>
 
 namespace mtools
 {
@@ -129,7 +135,7 @@ namespace mtools
          * @param   maxDomain   The maximum of the definition domain.
          * @param   name        The name of the plot.
          **/
-        Plot2DFun(F & fun, double minDomain, double maxDomain, std::string name = "Function") : Plot2DBaseGraph(minDomain, maxDomain, name), _fun(fun)
+        Plot2DFun(F & fun, double minDomain, double maxDomain, std::string name = "Function") : Plot2DBaseGraph(minDomain, maxDomain, name), _fun(fun), _adaptive(false), _adaptiveDepth(DEFAULT_ADAPTIVE_DEPTH), _nbThreads(1), _cacheSize(0)
             {
             }
 
@@ -141,7 +147,7 @@ namespace mtools
          *                      type must be convertible to double.
          * @param   name        The name of the plot.
          **/
-        Plot2DFun(F & fun, std::string name = "Function") : Plot2DBaseGraph(name), _fun(fun)
+        Plot2DFun(F & fun, std::string name = "Function") : Plot2DBaseGraph(name), _fun(fun), _adaptive(false), _adaptiveDepth(DEFAULT_ADAPTIVE_DEPTH), _nbThreads(1), _cacheSize(0)
             {
             }
 
@@ -149,7 +155,7 @@ namespace mtools
         /**
          * Move Constructor.
          **/
-        Plot2DFun(Plot2DFun && obj) : Plot2DBaseGraph(std::move(obj)), _fun(obj._fun)
+        Plot2DFun(Plot2DFun && obj) : Plot2DBaseGraph(std::move(obj)), _fun(obj._fun), _adaptive((bool)obj._adaptive), _adaptiveDepth((int)obj._adaptiveDepth), _nbThreads((int)obj._nbThreads), _cacheSize((size_t)obj._cacheSize), _cache(std::move(obj._cache))
             {
             }
 
@@ -164,8 +170,162 @@ namespace mtools
             }
 
 
+        static const int DEFAULT_ADAPTIVE_DEPTH = 8;   ///< default maximal number of subdivisions of a screen column with adaptive sampling.
+
+
+        /**
+         * Enable/disable adaptive sampling (line drawing only). The function is first evaluated once
+         * per screen column. Then, wherever the graph bends by more than half a pixel or becomes
+         * undefined (curvature, discontinuity, boundary of the domain), the interval between two
+         * columns is recursively halved (at most depth times) and the column is drawn as the
+         * vertical span of all the values found inside it. Disabled by default.
+         *
+         * @param   status  true to enable adaptive sampling.
+         * @param   depth   maximal number of subdivisions (between 1 and 30).
+         **/
+        void adaptiveSampling(bool status, int depth = DEFAULT_ADAPTIVE_DEPTH)
+            {
+            if (depth < 1) depth = 1; else if (depth > 30) depth = 30;
+            _adaptiveDepth = depth;
+            _adaptive = status;
+            refresh();
+            }
+
+
+        /**
+         * Query whether adaptive sampling is enabled.
+         **/
+        bool adaptiveSampling() const { return _adaptive; }
+
+
+        /**
+         * Set the maximal number of values of the function kept in memory (0 by default = no cache).
+         * The function is evaluated at points of a dyadic grid whose step depends on the zoom level
+         * so that the values are reused when the plot is moved or zoomed by a factor 2. The cache
+         * is emptied when it is full. Use it only if the function always returns the same value for
+         * the same argument (otherwise call clearCache() whenever the function changes).
+         *
+         * @param   maxentries  The maximal number of cached values (0 to disable the cache).
+         **/
+        void cacheSize(size_t maxentries)
+            {
+            enable(false);
+            _cacheSize = maxentries;
+            if (maxentries == 0) { _cache.clear(); _cache.rehash(0); }
+            enable(true);
+            refresh();
+            }
+
+
+        /**
+         * Return the maximal number of values kept in the cache (0 if the cache is disabled).
+         **/
+        size_t cacheSize() const { return _cacheSize; }
+
+
+        /**
+         * Discard all the cached values of the function.
+         **/
+        void clearCache()
+            {
+            enable(false);
+            _cache.clear();
+            enable(true);
+            refresh();
+            }
+
+
+        /**
+         * Set the number of threads evaluating the function during the line drawing (1 by default).
+         * With nb > 1, the function must be thread-safe.
+         *
+         * @param   nb  The number of threads (0 = number of hardware threads).
+         **/
+        void nbThreads(int nb)
+            {
+            if (nb <= 0) nb = std::max<int>(1, (int)std::thread::hardware_concurrency());
+            _nbThreads = nb;
+            refresh();
+            }
+
+
+        /**
+         * Return the number of threads evaluating the function.
+         **/
+        int nbThreads() const { return _nbThreads; }
+
+
         protected:
 
+
+        /**
+         * Override : sample the function with the cache, the adaptive refinement and the threads
+         * selected (return false when none of them is enabled).
+         **/
+        virtual bool _columns(const fBox2 & R, int nbcol, double * ymin, double * ymax) const override
+            {
+            const bool adaptive = _adaptive;
+            const int depth = _adaptiveDepth;
+            const int nbth = _nbThreads;
+            const size_t cachesize = _cacheSize;
+            if (((!adaptive) && (nbth <= 1) && (cachesize == 0)) || (nbcol <= 0)) return false;
+            const double w = R.lx() / nbcol;
+            if (!((w >= DBL_MIN * 4) && (w <= DBL_MAX / 4.0))) return false;
+            // one point per column, on the dyadic grid of step g in ]w/2,w] when the cache is enabled
+            std::vector<double> xs((size_t)nbcol), ys((size_t)nbcol);
+            const double g = std::ldexp(1.0, std::ilogb(w));
+            for (int i = 0; i < nbcol; i++)
+                {
+                const double x = R.min[0] + (i + 0.5)*w;
+                xs[i] = (cachesize > 0) ? (std::floor(x / g + 0.5)*g) : x;
+                }
+            if (_cache.size() > cachesize) { _cache.clear(); }
+            std::vector<size_t> missing;
+            for (int i = 0; i < nbcol; i++)
+                {
+                auto it = _cache.find(xs[i]);
+                if (it != _cache.end()) { ys[i] = it->second; } else { missing.push_back((size_t)i); }
+                }
+            _parallelFor(nbth, missing.size(), [&](size_t a, size_t b, size_t th) { for (size_t k = a; k < b; k++) { ys[missing[k]] = _function(xs[missing[k]]); } });
+            if (cachesize > 0) { for (size_t k : missing) { _cache[xs[k]] = ys[k]; } }
+            for (int i = 0; i < nbcol; i++) { ymin[i] = ymax[i] = ys[i]; }
+            if ((!adaptive) || (nbcol < 2)) return true;
+            // intervals [xs[i], xs[i+1]] to refine: where the second difference exceeds a pixel or where the function becomes undefined
+            const double pix = R.ly() / ((_imageSize.Y() > 0) ? _imageSize.Y() : nbcol);
+            if (!(pix > 0.0)) return true;
+            std::vector<size_t> todo;
+            for (int i = 0; i + 1 < nbcol; i++)
+                {
+                const bool n1 = std::isnan(ys[i]), n2 = std::isnan(ys[i + 1]);
+                if (n1 && n2) continue;
+                if (n1 != n2) { todo.push_back((size_t)i); continue; }
+                bool bend = false;
+                if ((i > 0) && (!std::isnan(ys[i - 1])) && (std::abs(ys[i - 1] - 2 * ys[i] + ys[i + 1]) > pix)) bend = true;
+                if ((i + 2 < nbcol) && (!std::isnan(ys[i + 2])) && (std::abs(ys[i] - 2 * ys[i + 1] + ys[i + 2]) > pix)) bend = true;
+                if (bend) todo.push_back((size_t)i);
+                }
+            if (todo.size() == 0) return true;
+            const size_t nbt = std::max<size_t>(1, std::min<size_t>((size_t)nbth, todo.size()));
+            std::vector< std::vector< std::pair<double, double> > > found(nbt); // new points found by each thread
+            _parallelFor((int)nbt, todo.size(), [&](size_t a, size_t b, size_t th) {
+                for (size_t k = a; k < b; k++) { const size_t i = todo[k]; _refine(xs[i], ys[i], xs[i + 1], ys[i + 1], depth, pix / 2, found[th]); }
+                });
+            for (auto & V : found)
+                {
+                for (auto & P : V)
+                    {
+                    if (cachesize > 0) { _cache[P.first] = P.second; }
+                    if (std::isnan(P.second)) continue;
+                    double c = std::floor((P.first - R.min[0]) / w);
+                    const int i = (c <= 0) ? 0 : ((c >= nbcol - 1) ? (nbcol - 1) : (int)c);
+                    if (std::isnan(ymin[i])) { ymin[i] = ymax[i] = P.second; }
+                    else { if (P.second < ymin[i]) ymin[i] = P.second; if (P.second > ymax[i]) ymax[i] = P.second; }
+                    }
+                }
+            return true;
+            }
+
+
         /**
          * Override : return the value of the function at x or a quiet NAN if fun(x) is not defined.
          **/
@@ -180,8 +340,53 @@ namespace mtools
 
         private:
 
+
+        /* Run fun(a, b, th) over [0, n) split in nbth chunks, the calling thread taking the first one. */
+        template<typename FUN> static void _parallelFor(int nbth, size_t n, FUN fun)
+            {
+            if (n == 0) return;
+            const size_t nb = std::max<size_t>(1, std::min<size_t>((size_t)std::max<int>(1, nbth), n));
+            if (nb == 1) { fun(0, n, 0); return; }
+            std::vector<std::thread> threads;
+            for (size_t t = 1; t < nb; t++) { threads.push_back(std::thread([&fun, t, n, nb]() { fun((n*t) / nb, (n*(t + 1)) / nb, t); })); }
+            fun(0, n / nb, 0);
+            for (auto & th : threads) { th.join(); }
+            }
+
+
+        /* Halve [xa,xb] recursively while the midpoint deviates from the chord by more than tol (or
+           the function becomes undefined) and store the new points in res. The cache is only read. */
+        void _refine(double xa, double ya, double xb, double yb, int depth, double tol, std::vector< std::pair<double, double> > & res) const
+            {
+            const double xm = (xa + xb) / 2;
+            if ((xm <= xa) || (xm >= xb)) return;
+            auto it = _cache.find(xm);
+            const double ym = (it != _cache.end()) ? it->second : _function(xm);
+            res.push_back(std::pair<double, double>(xm, ym));
+            if (depth <= 1) return;
+            const bool na = std::isnan(ya), nm = std::isnan(ym), nb = std::isnan(yb);
+            if (na || nm || nb)
+                { // only look for the boundaries of the definition domain
+                if (na != nm) _refine(xa, ya, xm, ym, depth - 1, tol, res);
+                if (nm != nb) _refine(xm, ym, xb, yb, depth - 1, tol, res);
+                return;
+                }
+            if (std::abs(ym - (ya + yb) / 2) > tol)
+                {
+                _refine(xa, ya, xm, ym, depth - 1, tol, res);
+                _refine(xm, ym, xb, yb, depth - 1, tol, res);
+                }
+            }
+
+
              F & _fun;
 
+             std::atomic<bool>   _adaptive;         // true for adaptive sampling
+             std::atomic<int>    _adaptiveDepth;    // maximal number of subdivisions
+             std::atomic<int>    _nbThreads;        // number of threads evaluating the function
+             std::atomic<size_t> _cacheSize;        // maximal number of cached values (0 = no cache)
+             mutable std::unordered_map<double, double> _cache;    // cached values of the function
+
         };
 
 
@@ -41,6 +41,19 @@ namespace mtools
 	 * Plot Object which encapsulate a Image object. The image is either centered at the origin or
 	 * such that its bottom left corner is at the origin. It is possible to change the image while
 	 * being displayed or to remove it by passing nullptr.
+	 *
+	 * The image is never copied: the drawing threads read its pixels directly. To display a
+	 * framebuffer owned by a simulation without any copy, wrap it in a shallow Image and call
+	 * update() whenever it changes:
+	 *
+	 * @code
+	 * std::vector<RGBc> fb(lx*ly);
+	 * Image im(fb.data(), lx, ly, true);	// shallow view, fb must outlive the plot
+	 * Plot2DImage P(im);
+	 * plotter[P];
+	 * // in the simulation: write into fb then
+	 * P.update();
+	 * @endcode
 	 **/
 	class  Plot2DImage : public internals_graphics::Plotter2DObj, protected internals_graphics::Drawable2DInterface
 		{
@@ -108,6 +121,13 @@ namespace mtools
 			Image * image() const;
 
 
+			/**
+			 * Redraw the plot. Call this method after modifying the content of the image (e.g. the
+			 * framebuffer it shares). May be called from any thread.
+			 **/
+			void update() { internals_graphics::Plotter2DObj::resetDrawing(true); }
+
+
 			/**
 			* Sets the image position.
 			*
@@ -175,6 +195,8 @@ namespace mtools
 
 			virtual int nbThreads() const override;
 
+			virtual void threadsPriority(int prio) override;
+
 
 			/***************************************
 			* Override from the Drawable2DInterface.
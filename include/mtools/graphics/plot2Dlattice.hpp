@@ -244,6 +244,20 @@ namespace mtools
                 }
 
 
+            /**
+             * Redraw only the sites in boxes, the rest of the drawing being kept (see
+             * LatticeDrawer::redrawSites()). Use this instead of resetDrawing() to display a running
+             * simulation, with the boxes returned by Grid_basic::takeChanges().
+             *
+             * @param   boxes   The sites whose colors changed.
+             **/
+            void redrawSites(const std::vector<iBox2> & boxes)
+                {
+                _LD->redrawSites(boxes);
+                refresh();
+                }
+
+
             /**
              * Query the definition domain.
              *
@@ -323,7 +337,7 @@ namespace mtools
 
             virtual fBox2 favouriteRangeX(fBox2 R) override
                 {
-                if ((_LD->isDomainEmpty() || _LD->isDomainFull())) return fBox2(); // no favourite range
+                if ((_LD->isDomainEmpty() || _LD->isDomainFull())) return Plot2DLatticeBase::favouriteRangeX(R); // the published range, if any
                 iBox2 D = _LD->domain();
                 return fBox2((double)D.min[0] - 0.5, (double)D.max[0] + 0.5, (double)D.min[1] - 0.5, (double)D.max[1] + 0.5);
                 }
@@ -331,7 +345,7 @@ namespace mtools
 
             virtual fBox2 favouriteRangeY(fBox2 R) override
                 {
-                if ((_LD->isDomainEmpty() || _LD->isDomainFull())) return fBox2(); // no favourite range
+                if ((_LD->isDomainEmpty() || _LD->isDomainFull())) return Plot2DLatticeBase::favouriteRangeY(R); // the published range, if any
                 iBox2 D = _LD->domain();
                 return fBox2((double)D.min[0] - 0.5, (double)D.max[0] + 0.5, (double)D.min[1] - 0.5, (double)D.max[1] + 0.5);
                 }
@@ -339,13 +353,15 @@ namespace mtools
 
             virtual bool hasFavouriteRangeX() override
                 {
-                return(!(_LD->isDomainEmpty() || _LD->isDomainFull())); // there is a favourite range if the domain is neither empy nor full
+                if (_LD->isDomainEmpty() || _LD->isDomainFull()) return Plot2DLatticeBase::hasFavouriteRangeX(); // use the published range, if any
+                return true; // the domain is neither empty nor full
                 }
 
 
             virtual bool hasFavouriteRangeY() override
                 {
-                return(!(_LD->isDomainEmpty() || _LD->isDomainFull())); // there is a favourite range if the domain is neither empy nor full
+                if (_LD->isDomainEmpty() || _LD->isDomainFull()) return Plot2DLatticeBase::hasFavouriteRangeY(); // use the published range, if any
+                return true; // the domain is neither empty nor full
                 }
 
 
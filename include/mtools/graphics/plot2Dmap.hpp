@@ -196,9 +196,38 @@ namespace mtools
 				}
 
 
+			/**
+			* Values at the center of each column, computed with an Interpolator built from the part
+			* of the map covering the range (plus two points on each side for the tangents).
+			**/
+			virtual bool _columns(const fBox2 & R, int nbcol, double * ymin, double * ymax) const override
+				{
+				if (_pmap->size() == 0) { return false; }
+				_minDomain = (_pmap->begin())->first;
+				_maxDomain = (_pmap->rbegin())->first;
+				const double a = std::max<double>(R.min[0], _minDomain), b = std::min<double>(R.max[0], _maxDomain); // in the range of T1
+				auto first = (a <= b) ? _pmap->lower_bound((T1)a) : _pmap->end();
+				for (int k = 0; (k < 2) && (first != _pmap->begin()); k++) { first--; }
+				auto last = (a <= b) ? _pmap->upper_bound((T1)b) : _pmap->end();
+				for (int k = 0; (k < 2) && (last != _pmap->end()); k++) { last++; }
+				_interp.set(first, last, interpolationMethod());
+				const double eps = R.lx() / nbcol;
+				double x = R.min[0] + (eps / 2.0);
+				size_t hint = 0;
+				for (int i = 0; i < nbcol; i++)
+					{
+					ymin[i] = ((x < _minDomain) || (x > _maxDomain)) ? std::numeric_limits<double>::quiet_NaN() : _interp(x, hint);
+					ymax[i] = ymin[i];
+					x += eps;
+					}
+				return true;
+				}
+
+
 		protected:
 
 			mutable std::map<T1, T2, Compare, Alloc> * _pmap;
+			mutable Interpolator _interp;	// interpolation of the visible part of the map
 
 		};
 
@@ -177,6 +177,8 @@ namespace mtools
 
 			virtual int nbThreads() const override { return _LD->nbThreads(); }
 
+			virtual void threadsPriority(int prio) override { _LD->priority(prio); }
+
 
 			/**
 			* Override of the removed method, nothing to do...
@@ -132,6 +132,24 @@ namespace mtools
                 delete _LD;     // remove the plane drawer
                 delete _proImg; // and the progress image
                 }
+
+
+            /**
+             * Enable/disable adaptive sampling: the samples are concentrated on the pixels where the
+             * color varies the most (see ThreadPlaneDrawer). Disabled by default.
+             **/
+            void adaptiveSampling(bool status)
+                {
+                _LD->adaptiveSampling(status);
+                _LD->redraw();
+                _LD->sync();
+                }
+
+
+            /**
+             * Query if adaptive sampling is enabled.
+             **/
+            bool adaptiveSampling() const { return _LD->adaptiveSampling(); }
   
 
         protected:
@@ -201,6 +219,12 @@ namespace mtools
             virtual int nbThreads() const override { return _LD->nbThreads(); }
 
 
+            /**
+            *Override from the Drawable2DInterface.
+            **/
+            virtual void threadsPriority(int prio) override { _LD->priority(prio); }
+
+
             /**
             * Override from the Plot2DObj base class method. 
             **/
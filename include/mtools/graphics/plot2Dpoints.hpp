@@ -0,0 +1,146 @@
+/** @file plot2Dpoints.hpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include "../misc/internal/mtools_export.hpp"
+#include "pointsplatter.hpp"
+#include "plot2Dplane.hpp"
+
+
+namespace mtools
+{
+
+
+	/**
+	 * Plot object displaying the density of a cloud of points accumulated in a PointSplatter.
+	 *
+	 * The simulation threads feed the splatter directly (PointSplatter::add() is lock free) and call
+	 * update() from time to time to merge the per-thread buffers, tone map the density and redraw
+	 * the plot. The favourite range of the object is the domain of the splatter.
+	 *
+	 * @code
+	 * PointSplatter S(fBox2(-100, 100, -100, 100), 2048, 2048);
+	 * Plot2DPoints P(S, PointSplatter::TONEMAP_EQUALIZE);
+	 * plotter[P];
+	 * plotter.plot();
+	 * // in the simulation
+	 * S.add(x, y); ...
+	 * P.update();
+	 * @endcode
+	 **/
+	class Plot2DPoints : public Plot2DPlane<PointSplatter>
+	{
+
+	public:
+
+		/**
+		 * Constructor. The splatter must survive the plot.
+		 *
+		 * @param [in,out]	splatter	The splatter.
+		 * @param 		  	mode		tone mapping (PointSplatter::TONEMAP_LINEAR, TONEMAP_LOG or TONEMAP_EQUALIZE).
+		 * @param 		  	palette 	the palette.
+		 * @param 		  	nbthread	The number of threads to use for drawing.
+		 * @param 		  	name		The name of the plot.
+		 **/
+		Plot2DPoints(PointSplatter & splatter, int mode = PointSplatter::TONEMAP_LOG, const Palette & palette = Palette::jet(256), int nbthread = 1, std::string name = "Points") :
+			Plot2DPlane<PointSplatter>(splatter, nbthread, name), _splatter(&splatter), _mode(mode), _palette(palette)
+			{
+			_splatter->update(_mode, _palette);
+			}
+
+
+		/**
+		 * Move constructor.
+		 **/
+		Plot2DPoints(Plot2DPoints && o) : Plot2DPlane<PointSplatter>(std::move(o)), _splatter(o._splatter), _mode(o._mode), _palette(o._palette)
+			{
+			}
+
+
+		/**
+		 * Destructor.
+		 **/
+		virtual ~Plot2DPoints() {}
+
+
+		/**
+		 * Merge the buffers of the splatter, tone map the density and redraw the plot. May be called
+		 * by any thread, while the other threads keep adding points.
+		 **/
+		void update()
+			{
+			_splatter->update(_mode, _palette);
+			internals_graphics::Plotter2DObj::resetDrawing(true);
+			}
+
+
+		/**
+		 * Change the tone mapping (and update the plot).
+		 **/
+		void toneMapping(int mode, const Palette & palette)
+			{
+			_mode = mode;
+			_palette = palette;
+			update();
+			}
+
+
+		/**
+		 * Change the tone mapping mode (and update the plot).
+		 **/
+		void toneMapping(int mode) { toneMapping(mode, _palette); }
+
+
+		/**
+		 * The current tone mapping mode.
+		 **/
+		int toneMapping() const { return _mode; }
+
+
+		/**
+		 * The splatter.
+		 **/
+		PointSplatter & splatter() const { return *_splatter; }
+
+
+	protected:
+
+		virtual fBox2 favouriteRangeX(fBox2 R) override { return _splatter->domain(); }
+
+		virtual fBox2 favouriteRangeY(fBox2 R) override { return _splatter->domain(); }
+
+		virtual bool hasFavouriteRangeX() override { return true; }
+
+		virtual bool hasFavouriteRangeY() override { return true; }
+
+
+	private:
+
+		PointSplatter *	_splatter;	// the splatter
+		int				_mode;		// tone mapping mode
+		Palette			_palette;	// tone mapping palette
+	};
+
+
+}
+
+
+/* end of file */
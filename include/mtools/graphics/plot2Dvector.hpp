@@ -230,7 +230,27 @@ namespace mtools
          **/
         virtual double _function(double x) const override
             {
-            this->_tab = _vec->data(); // update the pointer in case it changed
+            _sync();
+            return Plot2DArray<T>::_function(x); // call the base method
+            }
+
+
+        /**
+         * Compute the extent of the vector in each screen column (see Plot2DArray::decimation()).
+         **/
+        virtual bool _columns(const fBox2 & R, int nbcol, double * ymin, double * ymax) const override
+            {
+            _sync();
+            return Plot2DArray<T>::_columns(R, nbcol, ymin, ymax); // call the base method
+            }
+
+
+        private:
+
+        /* update the pointer and the size in case the vector changed */
+        void _sync() const
+            {
+            this->_tab = _vec->data();
             if (this->_len != _vec->size())
                 {
                 if (!_fd)
@@ -239,12 +259,8 @@ namespace mtools
                     }
                 this->_len = _vec->size(); // save the new size
                 }
-            return Plot2DArray<T>::_function(x); // call the base method
             }
 
-
-        private:
-
         bool _fd;
         const std::vector<T, Alloc> * _vec;
         double _e;
@@ -269,7 +269,8 @@ class Plotter2D
 
     /**
      * Return the delta in quality needed to trigger an update of the window. 
-     * (default = DEFAULT_SENSIBILITY).
+     * (default = DEFAULT_SENSIBILITY). The updates are paced by the target frame rate of the
+     * Drawable2DScheduler: at most one per frame (fewer if compositing the image is slow).
      *
      * @return  The delta in image quality needed to trigger a redraw (between 1 and 99).
      **/
@@ -389,6 +390,59 @@ class Plotter2D
     void autorangeXY(bool keepAspectRatio);
 
 
+    /**
+     * Follow mode: the range is updated automatically (as with autorangeX(), autorangeY() or
+     * autorangeXY()) each time an enabled object publishes a new bounding box with
+     * publishRange(). The check is done by the refresh timer of the plotter and costs nothing as
+     * long as no new box is published.
+     *
+     * @code
+     * auto L = makePlot2DLattice(obj);
+     * P[L]; P.follow(true, true); P.startPlot();
+     * while (1) { grow(); iBox2 B; G.getPosRange(B); L.publishRange(fBox2(B)); }  // O(1) per step
+     * @endcode
+     *
+     * @param   followX True to follow the objects horizontally.
+     * @param   followY True to follow the objects vertically.
+     **/
+    void follow(bool followX, bool followY);
+
+
+    /**
+     * Show or hide the timing overlay in the lower left corner of the view (can also be toggled
+     * with the 'm' key). For each enabled object: its quality, the time (since its drawing was last
+     * reset) at which it reached 50% and 100% quality, the percentage of time its workers were
+     * busy, the pixel throughput and the time of its last drawOnto(). The last line gives the time
+     * taken by the compositing of the main image, by the merging into the view and by the fltk
+     * blit. The values are sampled by the refresh timer (every 100ms).
+     **/
+    void showMetrics(bool status);
+
+
+    /**
+     * Query if the timing overlay is shown.
+     **/
+    bool showMetrics() const;
+
+
+    /**
+     * Return the timing metrics (same values as the overlay, with the times to reach 25/50/75/100%
+     * quality, -1 if not reached yet). Can be called from any thread.
+     *
+     * @param   json    true for a JSON object, false for CSV (one line per object with a header,
+     *                  followed by the lines "(compositing)", "(improve)" and "(blit)").
+     **/
+    std::string metrics(bool json = false);
+
+
+    /**
+     * Save the timing metrics in a file: JSON if the file name ends with ".json", CSV otherwise.
+     *
+     * @return  true if the file was written.
+     **/
+    bool saveMetrics(const std::string & filename);
+
+
     /**
      * Query the view zoom factor: this is the ratio of the view size w.r.t to the size of the image
      * really drawn (i.e. the size of the image that is saved in memory /on file). By default, the
@@ -0,0 +1,258 @@
+/** @file pointsplatter.hpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include "../misc/internal/mtools_export.hpp"
+#include "../misc/misc.hpp"
+#include "../misc/error.hpp"
+#include "../maths/vec.hpp"
+#include "../maths/box.hpp"
+#include "rgbc.hpp"
+#include "palette.hpp"
+#include "image.hpp"
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+
+
+namespace mtools
+{
+
+
+	/**
+	 * Density of a cloud of points, accumulated on a grid of lx x ly bins covering a domain of the
+	 * plane, and turned into colors by tone mapping.
+	 *
+	 * Meant to visualize billions of positions (walks, particles...) fed directly by the
+	 * simulation: add() may be called simultaneously by any number of threads without locking. Each
+	 * thread accumulates into its own float buffer (created the first time the thread calls add()),
+	 * so there is no contention and no saturation.
+	 *
+	 * merge() sums the buffers of all the threads into the density and toneMap() converts the
+	 * density into colors, either into an Image or into an internal snapshot read by getColor().
+	 * Both may be called while other threads keep adding points (the sum then contains some of the
+	 * points being added). update() does both. The empty bins are transparent.
+	 *
+	 * @code
+	 * PointSplatter S(fBox2(-100, 100, -100, 100), 2048, 2048);
+	 * // in the simulation threads
+	 * S.add(walk.X(), walk.Y());
+	 * // display
+	 * Plot2DPoints P(S);  // or S.update(); S.toneMap(im);
+	 * @endcode
+	 **/
+	class PointSplatter
+	{
+
+	public:
+
+		static const int TONEMAP_LINEAR = 0;	///< color proportional to the density.
+		static const int TONEMAP_LOG = 1;		///< color proportional to log(1 + density).
+		static const int TONEMAP_EQUALIZE = 2;	///< histogram equalization: color given by the rank of the density among the non-empty bins.
+
+
+		/**
+		 * Constructor.
+		 *
+		 * @param	domain	The region of the plane covered by the bins (points outside are ignored).
+		 * @param	lx	  	Number of bins in the x direction.
+		 * @param	ly	  	Number of bins in the y direction.
+		 **/
+		PointSplatter(const fBox2 & domain, int64 lx, int64 ly);
+
+
+		/** Destructor. */
+		~PointSplatter();
+
+
+		/**
+		 * Add a point with weight w in the bin containing (x,y). Lock free: may be called by several
+		 * threads simultaneously.
+		 **/
+		MTOOLS_FORCEINLINE void add(double x, double y, float w = 1.0f)
+			{
+			const double fx = (x - _domain.min[0])*_sx, fy = (y - _domain.min[1])*_sy;
+			if ((!(fx >= 0.0)) || (!(fy >= 0.0)) || (fx >= (double)_lx) || (fy >= (double)_ly)) return;
+			std::atomic<float> & b = _threadBuffer()[((int64)fy)*_lx + (int64)fx];
+			b.store(b.load(std::memory_order_relaxed) + w, std::memory_order_relaxed); // only the owner thread writes
+			}
+
+
+		/**
+		 * Add a point with weight w in the bin containing pos. Lock free.
+		 **/
+		MTOOLS_FORCEINLINE void add(fVec2 pos, float w = 1.0f) { add(pos.X(), pos.Y(), w); }
+
+
+		/**
+		 * Add n points with weight 1. Lock free.
+		 **/
+		void add(const fVec2 * pos, size_t n);
+
+
+		/**
+		 * Add a point with weight w spread over the four nearest bins (bilinear weights). Gives
+		 * smoother images when the points are not much more numerous than the bins. Lock free.
+		 **/
+		void addSmooth(double x, double y, float w = 1.0f);
+
+
+		/**
+		 * Sum the buffers of all the threads into the density. The buffers are not modified so merge()
+		 * may be called at any time.
+		 **/
+		void merge();
+
+
+		/**
+		 * Convert the density (as of the last merge()) into colors and store them in the snapshot read
+		 * by getColor(). Non empty bins are mapped to palette(t) with t in ]0,1] given by the tone
+		 * mapping. Empty bins are transparent.
+		 *
+		 * @param	mode   	TONEMAP_LINEAR, TONEMAP_LOG or TONEMAP_EQUALIZE.
+		 * @param	palette	the palette.
+		 **/
+		void toneMap(int mode = TONEMAP_LOG, const Palette & palette = Palette::jet(256));
+
+
+		/**
+		 * Convert the density (as of the last merge()) into an image of size lx x ly (the y axis
+		 * pointing up, as in the plane). The image is resized if needed.
+		 *
+		 * @param [in,out]	im	   	The image.
+		 * @param 		  	mode   	TONEMAP_LINEAR, TONEMAP_LOG or TONEMAP_EQUALIZE.
+		 * @param 		  	palette	the palette.
+		 **/
+		void toneMap(Image & im, int mode = TONEMAP_LOG, const Palette & palette = Palette::jet(256)) const;
+
+
+		/**
+		 * merge() then toneMap() into the snapshot.
+		 **/
+		void update(int mode = TONEMAP_LOG, const Palette & palette = Palette::jet(256))
+			{
+			merge();
+			toneMap(mode, palette);
+			}
+
+
+		/**
+		 * Color of the snapshot at a position of the plane (transparent outside of the domain). This
+		 * is the getColor() method used by Plot2DPoints (through Plot2DPlane).
+		 **/
+		MTOOLS_FORCEINLINE RGBc getColor(fVec2 pos) const
+			{
+			const double fx = (pos.X() - _domain.min[0])*_sx, fy = (pos.Y() - _domain.min[1])*_sy;
+			if ((!(fx >= 0.0)) || (!(fy >= 0.0)) || (fx >= (double)_lx) || (fy >= (double)_ly)) return RGBc::c_Transparent;
+			RGBc c;
+			c.color = _snapshot[((int64)fy)*_lx + (int64)fx].load(std::memory_order_relaxed);
+			return c;
+			}
+
+
+		/**
+		 * Density of bin (i,j) as of the last merge() (j = 0 is the bottom line).
+		 **/
+		float density(int64 i, int64 j) const { MTOOLS_ASSERT((i >= 0) && (j >= 0) && (i < _lx) && (j < _ly)); return _density[(size_t)(j*_lx + i)]; }
+
+
+		/** Largest density as of the last merge(). */
+		float maxDensity() const { return _max; }
+
+
+		/** Total weight as of the last merge(). */
+		double totalWeight() const { return _total; }
+
+
+		/**
+		 * Reset the density and the buffers of all the threads. No other thread may call add() at
+		 * the same time.
+		 **/
+		void clear();
+
+
+		/** The domain covered by the bins. */
+		fBox2 domain() const { return _domain; }
+
+
+		/** Number of bins in the x direction. */
+		int64 lx() const { return _lx; }
+
+
+		/** Number of bins in the y direction. */
+		int64 ly() const { return _ly; }
+
+
+		/** Number of threads which have added points (i.e. number of buffers). */
+		size_t nbBuffers() const { std::lock_guard<std::mutex> lock(_mut); return _buffers.size(); }
+
+
+	private:
+
+		PointSplatter(const PointSplatter &) = delete;
+		PointSplatter & operator=(const PointSplatter &) = delete;
+
+		/* buffer of a thread */
+		struct _Buffer
+			{
+			std::unique_ptr<std::atomic<float>[]>	data;	// one float per bin
+			std::thread::id							owner;	// the thread
+			};
+
+		/* return the buffer of the calling thread (fast path through a small thread local table) */
+		MTOOLS_FORCEINLINE std::atomic<float> * _threadBuffer()
+			{
+			struct _slot { uint64 id; std::atomic<float> * p; };
+			static thread_local _slot slots[4] = { { 0, nullptr },{ 0, nullptr },{ 0, nullptr },{ 0, nullptr } };
+			static thread_local size_t next = 0;
+			for (size_t i = 0; i < 4; i++) { if (slots[i].id == _id) return slots[i].p; }
+			std::atomic<float> * p = _findOrCreateBuffer();
+			slots[next].id = _id; slots[next].p = p; next = (next + 1) & 3;
+			return p;
+			}
+
+
+		/* find or create the buffer of the calling thread */
+		std::atomic<float> * _findOrCreateBuffer();
+
+		/* compute the tone mapped color of each bin */
+		void _toneMap(RGBc * out, int64 stride, bool flip, int mode, const Palette & palette) const;
+
+		fBox2					_domain;	// region covered by the bins
+		int64					_lx, _ly;	// number of bins
+		double					_sx, _sy;	// number of bins per unit length
+		uint64					_id;		// unique id (tags the thread local table)
+		mutable std::mutex		_mut;		// protects _buffers
+		std::vector<_Buffer *>	_buffers;	// buffers of the threads
+		std::vector<float>		_density;	// merged density
+		float					_max;		// largest density
+		double					_total;		// total weight
+		std::unique_ptr<std::atomic<uint32>[]> _snapshot;	// tone mapped colors read by getColor()
+	};
+
+
+}
+
+
+/* end of file */
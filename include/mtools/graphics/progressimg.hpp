@@ -27,6 +27,8 @@
 #include "rgbc.hpp"
 #include "image.hpp"
 
+#include <cstdlib>
+
 
 namespace mtools
     {
@@ -37,6 +39,11 @@ namespace mtools
      * 
      * Simple class which encapsulate a RGBc64 image together with a uint8 buffer that specifies the
      * normalisation for each pixel.
+     *
+     * The buffers are zero-filled by the allocator (transparent black, normalisation 1) so the pages
+     * of a large image that are never drawn on are not committed by the OS. clear() with a
+     * transparent black color does not touch a buffer that was never written to. Use toImage() to
+     * convert the image in a single pass (normalisation done on the fly, the buffer is unchanged).
      **/
     class ProgressImg
         {
@@ -46,34 +53,34 @@ namespace mtools
             /**
             * Construct an empty image
             **/
-            ProgressImg() : _width(0), _height(0), _imData(nullptr), _normData(nullptr) {}
+            ProgressImg() : _width(0), _height(0), _imData(nullptr), _normData(nullptr), _untouched(false) {}
 
 
             /**
             * Construct an image with a given size.
             **/
-            ProgressImg(size_t LX, size_t LY) : _width(0), _height(0), _imData(nullptr), _normData(nullptr) { resize(LX, LY); }
+            ProgressImg(size_t LX, size_t LY) : _width(0), _height(0), _imData(nullptr), _normData(nullptr), _untouched(false) { resize(LX, LY); }
 
 
             /** Destructor. */
             ~ProgressImg()
                 {
-                delete[] _normData; 
-                delete[] _imData;
+                _free();
                 }
 
 
             /**
              * Copy constructor. Make a deep copy
              **/
-            ProgressImg(const ProgressImg & im) : _width(0), _height(0), _imData(nullptr), _normData(nullptr)
+            ProgressImg(const ProgressImg & im) : _width(0), _height(0), _imData(nullptr), _normData(nullptr), _untouched(false)
                 {
                 resize(im.width(), im.height());
                 const size_t l = _width*_height;
-                if (l > 0)
+                if ((l > 0) && (!im._untouched))
                     {
                     memcpy(_imData, im._imData, l*sizeof(RGBc64));
                     memcpy(_normData, im._normData, l);
+                    _untouched = false;
                     }
                 }
 
@@ -81,7 +88,7 @@ namespace mtools
             /**
             * Move constructor.
             **/
-            ProgressImg(ProgressImg && im) : _width(im._width), _height(im._height), _imData(im._imData), _normData(im._normData)
+            ProgressImg(ProgressImg && im) : _width(im._width), _height(im._height), _imData(im._imData), _normData(im._normData), _untouched(im._untouched)
                 {
                 im._width = 0;
                 im._height = 0;
@@ -100,8 +107,10 @@ namespace mtools
                 const size_t l = _width*_height;
                 if (l > 0)
                     {
+                    if ((im._untouched) && (_untouched)) return *this; // both are zero
                     memcpy(_imData, im._imData, l*sizeof(RGBc64));
                     memcpy(_normData, im._normData, l);
+                    _untouched = im._untouched;
                     }
                 return *this;
                 }
@@ -118,6 +127,7 @@ namespace mtools
                 _height = im._height;
                 _imData = im._imData;
                 _normData = im._normData;
+                _untouched = im._untouched;
                 im._width = 0; 
                 im._height = 0;
                 im._imData = nullptr;
@@ -134,16 +144,18 @@ namespace mtools
                 {
                 if ((newLX <= 0) || (newLY <= 0))
                     {
-                    delete[] _normData; _normData = nullptr;
-                    delete[] _imData; _imData = nullptr;
+                    _free();
                     _width = 0; _height = 0;
                     return;
                     }
                 if ((!trytokeepbuffer)||((newLX*newLY) > (_width*_height)))
                     {
                     size_t l = newLX*newLY;
-                    delete[] _normData; _normData = new uint8[l];
-                    delete[] _imData; _imData = new RGBc64[l];
+                    _free();
+                    _normData = (uint8*)std::calloc(l, 1);
+                    _imData = (RGBc64*)std::calloc(l, sizeof(RGBc64));
+                    if ((_normData == nullptr) || (_imData == nullptr)) { MTOOLS_ERROR("ProgressImg::resize() : out of memory."); }
+                    _untouched = true;
                     }
                 _width = newLX;
                 _height = newLY;
@@ -157,6 +169,8 @@ namespace mtools
             void clear(RGBc color)
                 {
                 if (_imData == nullptr) return;
+                if ((_untouched) && (color.color == 0)) return; // already zero
+                _untouched = false;
                 const size_t l = _width*_height;
                 memset(_normData, 0, l);
                 if ((color.comp.R == color.comp.G) && (color.comp.R == color.comp.B) && (color.comp.R == color.comp.A))
@@ -202,7 +216,7 @@ namespace mtools
             /**
             * Return a pointer to the color buffer.
             **/
-            inline RGBc64 * imData() { return _imData; }
+            inline RGBc64 * imData() { _untouched = false; return _imData; }
 
 			/**
 			* Return a pointer to the color buffer.
@@ -213,7 +227,7 @@ namespace mtools
 			/**
 			* Return a pointer a position in the color buffer
 			**/
-			inline RGBc64 * imData(int64 x, int64 y) { return _imData + x + y*_width; }
+			inline RGBc64 * imData(int64 x, int64 y) { _untouched = false; return _imData + x + y*_width; }
 
 			/**
 			* Return a pointer a position in the color buffer
@@ -223,7 +237,7 @@ namespace mtools
 			/**
             * Return a pointer to the normalization buffer.
             **/
-            inline uint8 * normData() { return _normData; }
+            inline uint8 * normData() { _untouched = false; return _normData; }
 
 			/**
 			* Return a pointer to the normalization buffer.
@@ -234,7 +248,7 @@ namespace mtools
 			/**
 			* Return a pointer to a position in the normalization buffer.
 			**/
-			inline uint8 * normData(int64 x,int64 y) { return _normData + x + y*_width; }
+			inline uint8 * normData(int64 x,int64 y) { _untouched = false; return _normData + x + y*_width; }
 
 			/**
 			* Return a pointer to a position in the normalization buffer.
@@ -253,15 +267,16 @@ namespace mtools
                 {
                 if (subBox.min[0] < 0) { subBox.min[0] = 0; }
                 if (subBox.min[1] < 0) { subBox.min[1] = 0; }
-                if (subBox.max[0] > (int64)(_width - 1)) { subBox.min[0] = (int64)(_width - 1); }
-                if (subBox.max[1] > (int64)(_height - 1)) { subBox.min[1] = (int64)(_height - 1); }
-                if (subBox.isEmpty()) return;
+                if (subBox.max[0] > (int64)(_width - 1)) { subBox.max[0] = (int64)(_width - 1); }
+                if (subBox.max[1] > (int64)(_height - 1)) { subBox.max[1] = (int64)(_height - 1); }
+                if ((subBox.isEmpty()) || (_untouched)) return;
                 size_t off = (size_t)(subBox.min[0] + _width*subBox.min[1]);
+                const int64 lx = subBox.lx();
                 const int64 ly = subBox.ly();
-                const size_t pa = (size_t)(_width - (subBox.lx() + 1));
+                const size_t pa = (size_t)(_width - (lx + 1));
                 for (int64 y = 0; y <= ly; y++)
                     {
-                    for (int64 x = 0; x <= ly; x++)
+                    for (int64 x = 0; x <= lx; x++)
                         {
                         _imData[off].normalize(_normData[off] + 1);
                         _normData[off] = 0;
@@ -272,9 +287,41 @@ namespace mtools
                 }
 
 
+            /**
+             * Move the content of a portion of the image: after the call, the pixel at position (x,y)
+             * has the value of the pixel previously at position (x+dx, y+dy). Pixels whose source lies
+             * outside of the sub box are left unchanged. Used by PixelDrawer to reuse a drawing when the
+             * range is translated by an integer number of pixels.
+             *
+             * @param   dx      The horizontal shift.
+             * @param   dy      The vertical shift.
+             * @param   subBox  The portion of the image to shift (border inclusive). If empty, use the
+             *                  whole image.
+             **/
+            void shift(int64 dx, int64 dy, iBox2 subBox = iBox2())
+                {
+                if (isEmpty()) return;
+                if (subBox.isEmpty()) { subBox = iBox2(0, _width - 1, 0, _height - 1); }
+                const int64 W = subBox.lx() + 1;
+                const int64 H = subBox.ly() + 1;
+                if ((std::abs(dx) >= W) || (std::abs(dy) >= H) || ((dx == 0) && (dy == 0))) return;
+                const int64 n = W - std::abs(dx);                        // number of pixels moved in each line
+                const int64 xd = subBox.min[0] + ((dx < 0) ? (-dx) : 0); // first destination column
+                const int64 xs = xd + dx;                                // first source column
+                for (int64 k = 0; k < H - std::abs(dy); k++)
+                    { // iterate in the direction that does not overwrite the lines still to be copied
+                    const int64 yd = subBox.min[1] + ((dy >= 0) ? k : (H - 1 - k));
+                    const int64 ys = yd + dy;
+                    memmove(imData(xd, yd), imData(xs, ys), (size_t)n * sizeof(RGBc64));
+                    memmove(normData(xd, yd), normData(xs, ys), (size_t)n);
+                    }
+                }
+
+
             /** Normalises the whole image. */
             void normalize()
                 {
+                if (_untouched) return;
                 const size_t l = _width*_height;
                 for (size_t i = 0; i<l; i++) { _imData[i].normalize(_normData[i] + 1); _normData[i] = 0; }
                 }
@@ -304,9 +351,60 @@ namespace mtools
 				}
 
 
+			/**
+			 * Copy the normalised ProgressImg into an Image (no blending: the pixels of im are
+			 * overwritten, including the alpha channel). The normalisation is done on the fly, the
+			 * ProgressImg is not modified. Faster than normalize() followed by a copy and allows to
+			 * export an image without modifying the accumulated values.
+			 *
+			 * @param [in,out]	im	   	The destination image, resized to the size of this if needed.
+			 * @param 		  	reverse	true to reverse the y axis.
+			 **/
+			void toImage(Image & im, bool reverse = true) const
+				{
+				const int64 lx = (int64)width();
+				const int64 ly = (int64)height();
+				if ((im.lx() != lx) || (im.ly() != ly)) im.resizeRaw(lx, ly);
+				if (isEmpty()) return;
+				const int64 str = (reverse) ? (-im.stride()) : (im.stride());
+				const RGBc64 * psrc = _imData;
+				const uint8 *  qsrc = _normData;
+				RGBc *		   pdst = im.data() + ((reverse) ? (im.stride()*(ly - 1)) : 0);
+				for (int64 j = 0; j < ly; j++)
+					{
+					for (int64 i = 0; i < lx; i++)
+						{
+						const uint32 n = ((uint32)qsrc[i]) + 1;
+						const RGBc64 & c = psrc[i];
+						if (n == 1) { pdst[i] = RGBc((uint8)c.comp.R, (uint8)c.comp.G, (uint8)c.comp.B, (uint8)c.comp.A); }
+						else { pdst[i] = RGBc((uint8)(c.comp.R / n), (uint8)(c.comp.G / n), (uint8)(c.comp.B / n), (uint8)(c.comp.A / n)); }
+						}
+					psrc += lx;
+					qsrc += lx;
+					pdst += str;
+					}
+				}
+
+
+			/**
+			 * Number of bytes used by the buffers (allocated size, the OS may commit less for an image
+			 * which is only partially drawn).
+			 **/
+			size_t memoryUsed() const { return (_imData == nullptr) ? 0 : (_width*_height*(sizeof(RGBc64) + 1)); }
+
+
         private:
 
 
+			/* release the buffers */
+			void _free()
+				{
+				std::free(_normData); _normData = nullptr;
+				std::free(_imData); _imData = nullptr;
+				_untouched = false;
+				}
+
+
 			/* blitting procedure, traditionnal blending version */
 			void blit_classic(Image & im, float op, bool reverse)
 				{
@@ -320,10 +418,9 @@ namespace mtools
 				RGBc *	 pdst = im.data() + ((reverse) ? (im.stride()*(ly - 1)) : 0);
 				for (int64 j = 0; j < ly; j++)
 					{
-					for (int64 i = 0; i < lx; i++)
-						{
-						pdst[i].blend(*(psrc++), (uint32)(*(qsrc++)) + 1, op32);
-						}
+					internals_graphics::blendLine64(pdst, psrc, qsrc, (size_t)lx, op32);
+					psrc += lx;
+					qsrc += lx;
 					pdst += str;
 					}
 				}
@@ -381,6 +478,7 @@ namespace mtools
                 size_t          _height;        // height of the image
                 RGBc64 *        _imData;        // image buffer
                 uint8 *         _normData;      // normalization buffer (_normData[i] = 0 means already normalized). 
+                bool            _untouched;     // true if the buffers are still zero since their allocation
 
         };
 
@@ -0,0 +1,381 @@
+/** @file campaign.hpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "../misc/internal/mtools_export.hpp"
+#include "../misc/misc.hpp"
+#include "../misc/error.hpp"
+#include "../misc/stringfct.hpp"
+#include "../misc/internal/threadworker.hpp"
+#include "fileio.hpp"
+#include "serialization.hpp"
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <memory>
+#include <exception>
+#include <cstdio>
+#include <cstdlib>
+
+
+namespace mtools
+    {
+
+
+    /**
+     * Run a parameter sweep: nbReps independent jobs (one per seed) for each parameter of a list,
+     * with the results of the jobs of a same parameter merged into a single aggregate.
+     *
+     * - The jobs are run by a pool of threads inside the process: there is no process startup per
+     * job. When the campaign is split across several processes (array jobs of a cluster), each one
+     * selects a slot with setSlot() or slotFromEnvironment() and runs the jobs of this slot.
+     *
+     * - Each process keeps one aggregate per parameter, saved (atomically, together with the list of
+     * jobs it contains) in the file filename(p) at most every flushInterval seconds and when run()
+     * returns. When the campaign is restarted, the aggregates are reloaded and the jobs already
+     * merged are skipped: at most flushInterval seconds of work are lost when a process is killed.
+     *
+     * - collect() merges the aggregates of all the slots of a parameter: there is one file per
+     * (parameter, slot) instead of one file per job.
+     *
+     * The type RESULT must be copyable, serializable and have a method merge(const RESULT &) (e.g.
+     * IntegerEmpiricalDistribution). The results of the jobs are merged in any order.
+     *
+     * @code
+     * std::vector<double> P = { 0.50, 0.55, 0.60 };
+     * CampaignRunner<double, IntegerEmpiricalDistribution> C("results/perco", P, 10000);
+     * C.slotFromEnvironment();
+     * C.run([](const double & p, uint64 seed, IntegerEmpiricalDistribution & res) { MT2004_64 gen(seed); res.insert(clusterSize(p, gen)); });
+     * IntegerEmpiricalDistribution D = C.collect(1); // all the jobs of p = 0.55 done so far (any slot)
+     * @endcode
+     **/
+    template<typename PARAM, typename RESULT> class CampaignRunner
+        {
+
+        public:
+
+            /** Function running a job: fun(param, seed, result), the result is initially a copy of the prototype. */
+            typedef std::function<void(const PARAM &, uint64, RESULT &)> JobFun;
+
+
+            /**
+             * Constructor.
+             *
+             * @param   prefix      Prefix of the aggregate file names (may contain a directory).
+             * @param   params      The parameters.
+             * @param   nbReps      Number of jobs for each parameter.
+             * @param   proto       Prototype of a result (an empty aggregate).
+             * @param   seed        Seed of the campaign (the seeds of the jobs are derived from it).
+             **/
+            CampaignRunner(const std::string & prefix, const std::vector<PARAM> & params, uint64 nbReps, const RESULT & proto = RESULT(), uint64 seed = 0) :
+                _prefix(prefix), _params(params), _nbReps(nbReps), _proto(proto), _seed(seed), _slot(0), _nbSlots(1), _flushInterval(60.0), _loaded(false)
+                {
+                MTOOLS_INSURE(_params.size() > 0);
+                MTOOLS_INSURE(_nbReps > 0);
+                }
+
+
+            /**
+             * Select the jobs run by this process: the jobs whose index is equal to slot modulo
+             * nbSlots. Must be called before run().
+             **/
+            void setSlot(uint64 slot, uint64 nbSlots)
+                {
+                MTOOLS_INSURE((nbSlots > 0) && (slot < nbSlots));
+                MTOOLS_INSURE(!_loaded);
+                _slot = slot;
+                _nbSlots = nbSlots;
+                }
+
+
+            /**
+             * Select the slot from the environment of a SLURM array job (SLURM_ARRAY_TASK_ID,
+             * SLURM_ARRAY_TASK_MIN and SLURM_ARRAY_TASK_COUNT).
+             *
+             * @return  true if the variables were found, false if the process is not part of an array
+             *          job (then, the process runs all the jobs).
+             **/
+            bool slotFromEnvironment()
+                {
+                const char * id = std::getenv("SLURM_ARRAY_TASK_ID");
+                const char * nb = std::getenv("SLURM_ARRAY_TASK_COUNT");
+                const char * mn = std::getenv("SLURM_ARRAY_TASK_MIN");
+                if ((id == nullptr) || (nb == nullptr)) return false;
+                const int64 first = (mn != nullptr) ? std::atoll(mn) : 0;
+                setSlot((uint64)(std::atoll(id) - first), (uint64)std::atoll(nb));
+                return true;
+                }
+
+
+            /** Set the maximum time (in seconds) between two saves of an aggregate (0 = after every job). */
+            void flushInterval(double seconds) { _flushInterval = seconds; }
+
+
+            /** The parameters. */
+            const std::vector<PARAM> & params() const { return _params; }
+
+
+            /** Number of jobs per parameter. */
+            uint64 nbReps() const { return _nbReps; }
+
+
+            /** Seed of job 'rep' of parameter p. */
+            uint64 seed(size_t p, uint64 rep) const
+                {
+                uint64 h = _seed ^ (0x9E3779B97F4A7C15ULL * (rep + 1)) ^ (0xC2B2AE3D27D4EB4FULL * ((uint64)p + 1));
+                h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ULL;
+                h = (h ^ (h >> 27)) * 0x94D049BB133111EBULL;
+                return h ^ (h >> 31);
+                }
+
+
+            /** Name of the aggregate file of parameter p for the slot of this process. */
+            std::string filename(size_t p) const { return _filename(p, _slot); }
+
+
+            /**
+             * Run the jobs of this slot which are not done yet.
+             *
+             * @param   fun         The function running a job.
+             * @param   nbThreads   Number of threads (0 = number of hardware threads).
+             *
+             * @return  The number of jobs run. If a job throws, the other threads stop after their
+             *          current job, the aggregates are saved (without the failed job) and the
+             *          exception is rethrown.
+             **/
+            uint64 run(JobFun fun, int nbThreads = 0)
+                {
+                _load();
+                std::vector<uint64> todo;
+                const uint64 nbjobs = _nbReps * (uint64)_params.size();
+                for (uint64 k = _slot; k < nbjobs; k += _nbSlots)
+                    {
+                    const size_t p = (size_t)(k % _params.size());
+                    if (!_aggs[p]->done[(size_t)(k / _params.size())]) todo.push_back(k);
+                    }
+                if (nbThreads <= 0) nbThreads = (int)nbHardwareThreads();
+                if ((size_t)nbThreads > todo.size()) nbThreads = (int)std::max<size_t>(1, todo.size());
+                std::atomic<size_t> next(0);
+                std::atomic<uint64> nbrun(0);
+                std::atomic<bool> stop(false);
+                std::exception_ptr err;
+                std::mutex errmut;
+                auto work = [&]()
+                    {
+                    size_t i;
+                    while ((!stop) && ((i = next++) < todo.size()))
+                        {
+                        const size_t p = (size_t)(todo[i] % _params.size());
+                        const uint64 rep = todo[i] / _params.size();
+                        RESULT res(_proto);
+                        try
+                            {
+                            fun(_params[p], seed(p, rep), res);
+                            }
+                        catch (...)
+                            {
+                            std::lock_guard<std::mutex> lock(errmut);
+                            if (!err) err = std::current_exception();
+                            stop = true;
+                            break;
+                            }
+                        _Agg & A = *_aggs[p];
+                        std::lock_guard<std::mutex> lock(A.mut);
+                        A.res.merge(res);
+                        A.done[(size_t)rep] = 1;
+                        A.nbdone++;
+                        A.dirty = true;
+                        nbrun++;
+                        if (std::chrono::duration<double>(std::chrono::steady_clock::now() - A.lastflush).count() >= _flushInterval) _flush(p);
+                        }
+                    };
+                std::vector<std::thread> threads;
+                for (int t = 1; t < nbThreads; t++) { threads.push_back(std::thread(work)); }
+                work();
+                for (auto & th : threads) { th.join(); }
+                for (size_t p = 0; p < _params.size(); p++) { std::lock_guard<std::mutex> lock(_aggs[p]->mut); if (_aggs[p]->dirty) _flush(p); }
+                if (err) std::rethrow_exception(err);
+                return nbrun;
+                }
+
+
+            /** Number of jobs of parameter p merged in the aggregate of this slot. */
+            uint64 nbDone(size_t p)
+                {
+                _load();
+                return _aggs[p]->nbdone;
+                }
+
+
+            /** Query whether all the jobs of this slot are done. */
+            bool finished()
+                {
+                _load();
+                for (uint64 k = _slot; k < _nbReps * (uint64)_params.size(); k += _nbSlots) { if (!_aggs[(size_t)(k % _params.size())]->done[(size_t)(k / _params.size())]) return false; }
+                return true;
+                }
+
+
+            /** The aggregate of parameter p for the slot of this process (not thread safe while run() executes). */
+            const RESULT & result(size_t p)
+                {
+                _load();
+                return _aggs[p]->res;
+                }
+
+
+            /**
+             * Merge the aggregates of parameter p saved by all the slots (read from the files).
+             *
+             * @param   p               Index of the parameter.
+             * @param [in,out]  nbJobs  If not null, set to the number of jobs merged.
+             *
+             * @return  The merged result.
+             **/
+            RESULT collect(size_t p, uint64 * nbJobs = nullptr) const
+                {
+                MTOOLS_INSURE(p < _params.size());
+                std::string dir, base;
+                const size_t pos = _prefix.find_last_of("/\\");
+                if (pos == std::string::npos) { dir = "."; base = _prefix; } else { dir = _prefix.substr(0, pos); base = _prefix.substr(pos + 1); }
+                std::vector<std::string> files;
+                getFileList(dir, base + ".p" + mtools::toString(p) + ".s*.gz", true, files, false, true, false);
+                RESULT tot(_proto);
+                uint64 nb = 0;
+                for (auto & f : files)
+                    {
+                    _Agg A(_proto, _nbReps);
+                    if (!_read(dir + "/" + f, p, A)) { MTOOLS_DEBUG(std::string("CampaignRunner::collect(): skipping file [") + f + "]"); continue; }
+                    tot.merge(A.res);
+                    nb += A.nbdone;
+                    }
+                if (nbJobs != nullptr) *nbJobs = nb;
+                return tot;
+                }
+
+
+        private:
+
+            /* aggregate of a parameter */
+            struct _Agg
+                {
+                _Agg(const RESULT & proto, uint64 nbreps) : res(proto), done((size_t)nbreps, 0), nbdone(0), dirty(false), lastflush(std::chrono::steady_clock::now()) {}
+
+                RESULT                                  res;        // merged results
+                std::vector<uint8>                      done;       // done[rep] = 1 if the job is merged in res
+                uint64                                  nbdone;     // number of jobs merged
+                bool                                    dirty;      // true if modified since the last save
+                std::chrono::steady_clock::time_point   lastflush;  // time of the last save
+                std::mutex                              mut;
+                };
+
+
+            std::string _filename(size_t p, uint64 slot) const { return _prefix + ".p" + mtools::toString(p) + ".s" + mtools::toString(slot) + ".gz"; }
+
+
+            /* load the aggregates of this slot (once) */
+            void _load()
+                {
+                if (_loaded) return;
+                _aggs.clear();
+                for (size_t p = 0; p < _params.size(); p++)
+                    {
+                    _aggs.push_back(std::unique_ptr<_Agg>(new _Agg(_proto, _nbReps)));
+                    const std::string fn = filename(p);
+                    if ((doFileExist(fn)) && (!_read(fn, p, *_aggs.back()))) { MTOOLS_ERROR(std::string("CampaignRunner: cannot resume from [") + fn + "] (file corrupt or campaign parameters changed)"); }
+                    }
+                _loaded = true;
+                }
+
+
+            /* read an aggregate file, return false on error */
+            bool _read(const std::string & fn, size_t p, _Agg & A) const
+                {
+                try
+                    {
+                    IFileArchive ar(fn);
+                    uint64 fp, fnbreps, fslot, fnbslots;
+                    ar & fp & fnbreps & fslot & fnbslots;
+                    if ((fp != (uint64)p) || (fnbreps != _nbReps)) return false;
+                    ar & A.done;
+                    ar & A.res;
+                    if (A.done.size() != (size_t)_nbReps) return false;
+                    A.nbdone = 0;
+                    for (auto d : A.done) { if (d) A.nbdone++; }
+                    return true;
+                    }
+                catch (...) { return false; }
+                }
+
+
+            /* save the aggregate of parameter p (called with its mutex locked) */
+            void _flush(size_t p)
+                {
+                _Agg & A = *_aggs[p];
+                const std::string fn = filename(p);
+                const std::string tmp = fn + ".partial";
+                try
+                    {
+                    OFileArchive ar(tmp);
+                    ar << "CampaignRunner aggregate: parameter index, number of jobs per parameter, slot, number of slots, jobs done, result\n";
+                    ar & (uint64)p & _nbReps & _slot & _nbSlots;
+                    ar & A.done;
+                    ar & A.res;
+                    }
+                catch (...)
+                    {
+                    std::remove(tmp.c_str());
+                    MTOOLS_DEBUG(std::string("CampaignRunner: cannot write [") + tmp + "]");
+                    return;
+                    }
+#ifdef _WIN32
+                std::remove(fn.c_str()); // rename() does not overwrite on windows
+#endif
+                std::rename(tmp.c_str(), fn.c_str());
+                A.dirty = false;
+                A.lastflush = std::chrono::steady_clock::now();
+                }
+
+
+            std::string                             _prefix;        // prefix of the file names
+            std::vector<PARAM>                      _params;        // the parameters
+            uint64                                  _nbReps;        // number of jobs per parameter
+            RESULT                                  _proto;         // empty result
+            uint64                                  _seed;          // seed of the campaign
+            uint64                                  _slot;          // slot of this process
+            uint64                                  _nbSlots;       // number of slots
+            double                                  _flushInterval; // max time between two saves
+            bool                                    _loaded;        // true once the aggregates are loaded
+            std::vector< std::unique_ptr<_Agg> >    _aggs;          // the aggregates
+
+            CampaignRunner(const CampaignRunner &) = delete;
+            CampaignRunner & operator=(const CampaignRunner &) = delete;
+        };
+
+
+    }
+
+
+/* end of file */
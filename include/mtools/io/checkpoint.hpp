@@ -0,0 +1,177 @@
+/** @file checkpoint.hpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "../misc/internal/mtools_export.hpp"
+#include "../misc/misc.hpp"
+#include "serialization.hpp"
+
+#include <string>
+#include <deque>
+#include <functional>
+
+
+namespace mtools
+    {
+
+
+    /**
+     * Checkpoints of a long simulation written in the background.
+     *
+     * On POSIX systems, checkpoint() forks the process. The child gets a copy-on-write image of the
+     * whole address space: it serializes the objects with an OFileArchive and exits, while the
+     * parent returns immediately and keeps simulating. The only pause is the fork itself (copying
+     * the page tables, a few milliseconds per GB). The pages modified by the parent while the child
+     * is writing are duplicated by the system, so the memory used grows by at most the amount of
+     * memory written during the checkpoint. On other systems, the checkpoint is written in the
+     * calling thread.
+     *
+     * The checkpoints are named prefix.000001ext, prefix.000002ext... (the extension selects the
+     * compression, see OFileArchive). Each one is first written to prefix.partialext and renamed
+     * when complete, so a checkpoint file is always complete. Only the last 'keep' checkpoints are
+     * kept: the older ones are deleted.
+     *
+     * @code
+     * Checkpointer CP("run/eden", ".gz", 3);
+     * CP.onComplete([](const std::string & file, bool ok) { cout << file << (ok ? " saved\n" : " FAILED\n"); });
+     * while (1)
+     *     {
+     *     ... // simulate
+     *     if (time_for_checkpoint) CP.checkpoint(grid, urn, gen);  // returns at once
+     *     }
+     * CP.wait();
+     * @endcode
+     *
+     * The objects are serialized in the state they have when checkpoint() is called, as seen by the
+     * calling thread: other threads must not be modifying them at that time (only the calling
+     * thread exists in the child). The methods of the object must be called from a single thread.
+     **/
+    class Checkpointer
+        {
+
+        public:
+
+            /**
+             * Constructor.
+             *
+             * @param   prefix  Prefix of the checkpoint file names (may contain a directory).
+             * @param   ext     Extension of the checkpoint files (".gz", ".zst"... for a compressed archive).
+             * @param   keep    Number of checkpoints to keep (0 = keep all of them).
+             **/
+            Checkpointer(const std::string & prefix, const std::string & ext = ".gz", size_t keep = 2);
+
+
+            /** Destructor. Wait for the checkpoint in progress to complete. */
+            ~Checkpointer();
+
+
+            /**
+             * Set the function called when a checkpoint completes, with the name of the checkpoint file
+             * and whether it was successfully written. The function is called by the thread calling
+             * poll(), wait(), checkpoint() or checkpointWith().
+             **/
+            void onComplete(std::function<void(const std::string &, bool)> fun) { _onComplete = fun; }
+
+
+            /**
+             * Start a checkpoint: fun(OBaseArchive & ar) is called, in a child process, to serialize the
+             * objects into the archive. If a checkpoint is already in progress, nothing is done.
+             *
+             * @return  true if the checkpoint was started, false if a checkpoint is already in
+             *          progress (or the process could not be forked).
+             **/
+            bool checkpointWith(std::function<void(OBaseArchive &)> fun);
+
+
+            /**
+             * Start a checkpoint of the objects (each one is serialized with 'ar & obj', in this
+             * order, so they are read back with 'ar & obj' from an IFileArchive). If a checkpoint is
+             * already in progress, nothing is done.
+             *
+             * @return  true if the checkpoint was started and false otherwise.
+             **/
+            template<typename... OBJS> bool checkpoint(const OBJS & ... objs)
+                {
+                return checkpointWith([&](OBaseArchive & ar) { _serializeAll(ar, objs...); });
+                }
+
+
+            /**
+             * Check whether the checkpoint in progress has completed (without blocking). If so, the
+             * old checkpoints are deleted and the onComplete() function is called.
+             *
+             * @return  true if a checkpoint is still in progress.
+             **/
+            bool poll();
+
+
+            /**
+             * Wait until the checkpoint in progress completes.
+             *
+             * @return  true if the last checkpoint was successfully written.
+             **/
+            bool wait();
+
+
+            /** Query whether a checkpoint is in progress. */
+            bool running() const { return (_pid != 0); }
+
+
+            /** Name of the last checkpoint successfully written (empty if none). */
+            std::string lastCheckpoint() const { return (_files.size() == 0) ? std::string() : _files.back(); }
+
+
+            /** Number of checkpoints started. */
+            uint64 nbCheckpoints() const { return _nb; }
+
+
+            /** Name of the file of the n-th checkpoint. */
+            std::string filename(uint64 n) const;
+
+
+        private:
+
+            template<typename OBJ> static void _serializeAll(OBaseArchive & ar, const OBJ & obj) { ar & obj; }
+            template<typename OBJ, typename... OBJS> static void _serializeAll(OBaseArchive & ar, const OBJ & obj, const OBJS & ... objs) { ar & obj; _serializeAll(ar, objs...); }
+
+            /* write the archive into the temporary file, return true on success */
+            bool _write(std::function<void(OBaseArchive &)> & fun) const;
+
+            /* called in the parent process once the checkpoint is complete */
+            void _complete(bool ok);
+
+            std::string _prefix;                                    // prefix of the file names
+            std::string _ext;                                       // extension of the file names
+            size_t _keep;                                           // number of checkpoints to keep
+            uint64 _nb;                                             // number of checkpoints started
+            int64 _pid;                                             // pid of the child process (0 if none)
+            bool _lastok;                                           // status of the last checkpoint
+            std::deque<std::string> _files;                         // checkpoints written (oldest first)
+            std::function<void(const std::string &, bool)> _onComplete;
+
+            Checkpointer(const Checkpointer &) = delete;
+            Checkpointer & operator=(const Checkpointer &) = delete;
+        };
+
+
+    }
+
+
+/* end of file */
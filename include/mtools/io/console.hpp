@@ -96,6 +96,10 @@ namespace mtools
      *
      * - A global Console object mtools::cout is created at program startup (but is not displayed
      * unless it is accessed) and can be used as a replacement for std::cout and std::cin.
+     *
+     * - In headless mode (see isHeadless()), no window is created: the console reads from stdin and
+     * writes to stdout (and to the logfile), like the basic console used when MTOOLS_BASIC_CONSOLE is
+     * set.
      **/
     class Console
         {
@@ -261,6 +265,15 @@ namespace mtools
             void disableLogFile() { _enableLogging = false; }
 
 
+            /**
+             * Enable or disable the asynchronous output mode (off by default). In this mode, printing
+             * never blocks the calling thread: the log file is written by a background thread (see
+             * LogFile::setAsync()) and the console does not wait for the window to catch up when the
+             * text accumulates. Text is dropped instead when too much of it is waiting to be displayed.
+             **/
+            void setAsyncOutput(bool status) { _async = status; }
+
+
             /**
              * Enable output on the screen (on by default).
              **/
@@ -315,6 +328,7 @@ namespace mtools
             std::atomic<bool>   _enableLogging;
             std::atomic<bool>   _enableScreen;
             std::atomic<bool>   _showDefaultInputValue;
+            std::atomic<bool>   _async;
 
             std::string         _consoleName;
             mtools::LogFile *   _logfile;
@@ -355,6 +369,7 @@ namespace mtools
                 int getKey();
                 void enableLogFile() { _enableLogging = true; }
                 void disableLogFile() { _enableLogging = false; }
+                void setAsyncOutput(bool status) { _async = status; }   // only the log file is asynchronous
                 void enableScreenOutput() { _enableScreen = true; }
                 void disableScreenOutput() { _enableScreen = false; }
                 void clear() {}                             // for compatibility with Console, does nothing
@@ -372,6 +387,7 @@ namespace mtools
                 std::atomic<bool>   _enableLogging;
                 std::atomic<bool>   _enableScreen;
                 std::atomic<bool>   _showDefaultInputValue;
+                std::atomic<bool>   _async;
                 std::string         _consoleName;
                 mtools::LogFile *   _logfile;
             };
@@ -397,6 +413,7 @@ namespace mtools
                 void useDefaultInputValue(bool newstatus) { if (!_exist()) return; _get(0)->useDefaultInputValue(newstatus); }
                 void enableLogFile() { if (!_exist()) return; _get(0)->enableLogFile(); }
                 void disableLogFile() { if (!_exist()) return; _get(0)->disableLogFile(); }
+                void setAsyncOutput(bool status) { if (!_exist()) return; _get(0)->setAsyncOutput(status); }
                 void enableScreenOutput() { if (!_exist()) return; _get(0)->enableScreenOutput(); }
                 void disableScreenOutput() { if (!_exist()) return; _get(0)->disableScreenOutput(); }
                 void resize(int x, int y, int w, int h) { if (!_exist()) return; _get(0)->resize(x, y, w, h); }
@@ -435,6 +452,7 @@ namespace mtools
                 void useDefaultInputValue(bool newstatus) { if (!_exist()) return; _get(0)->useDefaultInputValue(newstatus); }
                 void enableLogFile() { if (!_exist()) return; _get(0)->enableLogFile(); }
                 void disableLogFile() { if (!_exist()) return; _get(0)->disableLogFile(); }
+                void setAsyncOutput(bool status) { if (!_exist()) return; _get(0)->setAsyncOutput(status); }
                 void enableScreenOutput() { if (!_exist()) return; _get(0)->enableScreenOutput(); }
                 void disableScreenOutput() { if (!_exist()) return; _get(0)->disableScreenOutput(); }
                 void resize(int x, int y, int w, int h) { if (!_exist()) return; _get(0)->resize(x, y, w, h); }
@@ -22,8 +22,14 @@
 
 #include "../misc/internal/mtools_export.hpp"
 
+#include "../misc/misc.hpp"
+#include "../misc/stringfct.hpp"
+#include "../misc/memory.hpp"
+
 #include <string>
 #include <vector>
+#include <functional>
+#include <cstdio>
 
 
 namespace mtools
@@ -37,6 +43,17 @@ namespace mtools
      **/
     bool doFileExist(std::string filename);
 
+
+    /**
+     * Create a directory. The parent directory must already exist.
+     *
+     * @param   path    The path of the directory to create.
+     *
+     * @return  true if the directory was created or already exist, false if an error occured.
+     **/
+    bool createDirectory(const std::string & path);
+
+
     /**
      * Loads a text file into a string.
      *
@@ -50,10 +67,142 @@ namespace mtools
      *                      |             |                                        |
      *
      * @return  The text file in the required format (or an empty string if error).
+     *
+     * @sa  MappedFile, FileLineReader for very large files.
      **/
     std::string loadStringFromFile(const std::string & filename, StringEncoding enc = enc_unknown);
 
 
+    /**
+     * Streaming reader for text files too large to be loaded in memory. The file is read by chunks
+     * and returned line by line (or record by record). The encoding of the file is detected once on
+     * the first chunk (UTF-8 BOM or valid UTF-8 sequence, ISO8859-1 otherwise) and each line is
+     * converted only if the requested encoding differs from the one of the file.
+     *
+     * @code
+     * FileLineReader R("dump.txt", enc_utf8);
+     * std::string line;
+     * while (R.getLine(line)) { ... }
+     * @endcode
+     **/
+    class FileLineReader
+        {
+
+        public:
+
+            /**
+             * Constructor. Open the file (check isOpen() for success).
+             *
+             * @param   filename    Name of the file.
+             * @param   enc         The encoding of the returned lines (enc_unknown = raw text).
+             * @param   chunkSize   Size of the chunks read from the file.
+             **/
+            FileLineReader(const std::string & filename, StringEncoding enc = enc_unknown, size_t chunkSize = 4194304);
+
+
+            /** Destructor. Close the file. */
+            ~FileLineReader();
+
+
+            /** Query if the file is open. */
+            bool isOpen() const { return (_f != nullptr); }
+
+
+            /** Encoding detected for the file (enc_utf8 or enc_iso8859). */
+            StringEncoding fileEncoding() const { return _fileenc; }
+
+
+            /**
+             * Read the next line. The end of line ("\n" or "\r\n") is removed.
+             *
+             * @param [out] line    the line.
+             *
+             * @return  false if there is no more line.
+             **/
+            bool getLine(std::string & line);
+
+
+            /**
+             * Read the next record ending with delim (the delimiter is removed).
+             *
+             * @param [out] rec the record.
+             * @param   delim   the delimiter.
+             *
+             * @return  false if there is no more record.
+             **/
+            bool getRecord(std::string & rec, char delim);
+
+
+            /**
+             * Read the next len raw bytes (for fixed size binary records). No conversion is done.
+             *
+             * @return  the number of bytes read (less than len at the end of the file).
+             **/
+            size_t read(void * buffer, size_t len);
+
+
+            /** Number of bytes consumed so far. */
+            uint64 position() const { return _consumed; }
+
+
+        private:
+
+            FileLineReader(const FileLineReader &) = delete;
+            FileLineReader & operator=(const FileLineReader &) = delete;
+
+            /* read the next chunk, return false at the end of the file */
+            bool _fill();
+
+            /* convert a record to the requested encoding */
+            void _convert(std::string & s) const;
+
+            FILE *              _f;         // the file
+            std::vector<char>   _buf;       // current chunk
+            size_t              _pos;       // position in the chunk
+            size_t              _len;       // number of bytes in the chunk
+            uint64              _consumed;  // number of bytes consumed
+            StringEncoding      _enc;       // requested encoding
+            StringEncoding      _fileenc;   // encoding of the file
+        };
+
+
+    /**
+     * List the files of a directory matching a mask (cf. getFileList()) and process them in
+     * parallel. Each file is memory mapped and fun(name, data, size) is called with its name
+     * relative to path and its content. fun must be thread-safe.
+     *
+     * @param   path            the directory.
+     * @param   mask            see matchFileMask().
+     * @param   case_sensitive  true to perform case sensitive comparison when matching the mask.
+     * @param   rec             true to look recursively inside sub-directories.
+     * @param   fun             the function called for each file.
+     * @param   nbThreads       number of threads (0 = number of cores).
+     *
+     * @return  the number of files processed or -1 if the directory could not be listed. Files
+     *          which cannot be opened are skipped.
+     **/
+    int64 processFiles(const std::string & path, const std::string & mask, bool case_sensitive, bool rec, std::function<void(const std::string & name, const char * data, size_t size)> fun, int nbThreads = 0);
+
+
+    /**
+     * Load all the files of a directory matching a mask, in parallel.
+     *
+     * @param   path                the directory.
+     * @param   mask                see matchFileMask().
+     * @param   case_sensitive      true to perform case sensitive comparison when matching the mask.
+     * @param   rec                 true to look recursively inside sub-directories.
+     * @param [in,out]  names       the names of the files (relative to path) are appended to it.
+     * @param [in,out]  contents    the contents of the files are appended to it (empty string for
+     *                              files which cannot be read).
+     * @param   enc                 The encoding format of the returned strings (cf.
+     *                              loadStringFromFile()).
+     * @param   nbThreads           number of threads (0 = number of cores).
+     *
+     * @return  true if it succeeds, false if the directory could not be listed.
+     **/
+    bool loadFilesFromDirectory(const std::string & path, const std::string & mask, bool case_sensitive, bool rec, std::vector<std::string> & names, std::vector<std::string> & contents, StringEncoding enc = enc_unknown, int nbThreads = 0);
+
+
     /**
      * Saves a string into a text file.
      *
@@ -26,6 +26,9 @@
 
 #include <thread>
 #include <condition_variable>
+#include <future>
+#include <type_traits>
+#include <utility>
 // If we are on OSX, we must swap threads as only the master thread is allowed to
 // allocate graphic resources
 #ifdef __APPLE__
@@ -93,6 +96,8 @@ namespace mtools
 
         bool runInFltk(IndirectCall * proxycall);
 
+        bool postInFltk(IndirectCall * proxycall, const void * key);
+
         bool newInFltk(IndirectCtor * proxy);
 
         bool deleteInFltk(IndirectDtor * proxy, bool deleteAlways);
@@ -157,6 +162,26 @@ namespace mtools
     bool fltkThreadStopped();
 
 
+    /**
+     * Enable or disable the headless mode. In headless mode, the fltk thread is never started: no
+     * window is created, Console objects print on stdout (and in their log file) while ProgressBar
+     * and WatchWindow objects do nothing. Windows already created are not affected so the mode
+     * should be chosen at the beginning of the program.
+     *
+     * @param   status  true to enable the headless mode and false to disable it.
+     **/
+    void setHeadless(bool status);
+
+
+    /**
+     * Query whether the headless mode is on. Unless chosen with setHeadless(), the mode is decided
+     * on the first call: it is on if the environment variable MTOOLS_HEADLESS is set to a non-zero
+     * value or (on unix systems other than OSX) if no display is available i.e. if neither DISPLAY
+     * nor WAYLAND_DISPLAY is set. Setting MTOOLS_HEADLESS=0 disables the display detection.
+     **/
+    bool isHeadless();
+
+
     /**
      * Create an object of type T with constructor argument args within the FLTK thread. The object
      * is constructed on the heap via new. Call the `deleteInFltkThread()` to delete the function.
@@ -207,6 +232,81 @@ namespace mtools
         }
 
 
+    /**
+     * Post a method/function call to be executed inside the FLTK thread and return immediately
+     * (fire and forget). The proxy object is copied so the temporary may be passed directly but the
+     * objects it refers to (the object of a member call and the parameters passed by reference)
+     * must stay alive until the call is made.
+     *
+     * All the calls pending are executed together, in the order they were posted, at the next
+     * iteration of the fltk loop. A synchronous call (runInFltkThread(), newInFltkThread(),
+     * deleteInFltkThread()) is always made after the calls posted before it.
+     *
+     * If key is not nullptr and a call posted with the same key is still pending, that call is
+     * replaced by the new one (which takes its place in the queue). Use for instance the address of
+     * a widget as key to coalesce its redraw requests:
+     *
+     * @code
+     * postInFltkThread(IndirectMemberProc<Fl_Widget>(*w, &Fl_Widget::redraw), w);
+     * @endcode
+     *
+     * @param [in,out]  proxycall   The proxy object containing the call to make.
+     * @param           key         The coalescing key (nullptr for no coalescing).
+     *
+     * @return  true if the call was queued and false if it was discarded because the fltk thread is
+     *          not available. When called from the fltk thread, the call is made at once.
+     **/
+    template<typename CALL> inline bool postInFltkThread(CALL && proxycall, const void * key = nullptr)
+        {
+        typedef typename std::decay<CALL>::type proxy_t;
+        static_assert(std::is_base_of<IndirectCall, proxy_t>::value, "postInFltkThread() expects an IndirectCall object");
+        return internals_fltkSupervisor::postInFltk(new proxy_t(std::forward<CALL>(proxycall)), key);
+        }
+
+
+    namespace internals_fltkSupervisor
+        {
+
+        /* IndirectCall wrapping a packaged task, used by asyncInFltkThread() */
+        template<typename R> class IndirectTask : public IndirectCall
+            {
+            public:
+                template<typename F> IndirectTask(F && fun) : _task(std::forward<F>(fun)) {}
+                virtual void call() override { _task(); }
+                std::future<R> future() { return _task.get_future(); }
+            private:
+                std::packaged_task<R()> _task;
+            };
+
+        }
+
+
+    /**
+     * Post a call to a function/functor (without argument) to be executed inside the FLTK thread
+     * and return immediately with a future for its result. Same ordering rules as
+     * postInFltkThread().
+     *
+     * @code
+     * std::future<int> v = asyncInFltkThread([slider]() { return (int)slider->value(); });
+     * ... // do something else
+     * int x = v.get();
+     * @endcode
+     *
+     * @param [in,out]  fun The function to call.
+     *
+     * @return  A future for the result of the call. If the fltk thread is not available, the call is
+     *          discarded and the future holds a std::future_error (broken promise).
+     **/
+    template<typename F> inline std::future<typename std::result_of<F()>::type> asyncInFltkThread(F && fun)
+        {
+        typedef typename std::result_of<F()>::type R;
+        internals_fltkSupervisor::IndirectTask<R> * task = new internals_fltkSupervisor::IndirectTask<R>(std::forward<F>(fun));
+        std::future<R> res = task->future();
+        internals_fltkSupervisor::postInFltk(task, nullptr); // the task is deleted if it cannot be posted
+        return res;
+        }
+
+
     /**
      * Registers a function that should be called when fltk exits().
      * 
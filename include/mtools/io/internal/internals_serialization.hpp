@@ -21,6 +21,8 @@
 #pragma once
 
 #include <utility>
+#include <algorithm>
+#include <cstring>
 #include <fstream>
 #include <type_traits>
 #include <wchar.h>
@@ -46,6 +48,14 @@ namespace internals_serialization
     {
 
 
+    /** magic number at the beginning of binary archives (the last byte is the format version) */
+    static const char BINARY_ARCHIVE_MAGIC[] = { '\x7f', 'm', 't', 'o', 'o', 'l', 's', 'B', 'A', '\x01' };
+    static const size_t BINARY_ARCHIVE_MAGIC_SIZE = sizeof(BINARY_ARCHIVE_MAGIC);
+
+    /** true if the host is little endian */
+    inline bool isLittleEndian() { const uint16 v = 1; unsigned char c; memcpy(&c, &v, 1); return (c == 1); }
+
+
     /**
      * OBaseArchive helper classes.
      *
@@ -26,16 +26,28 @@
 
 #include <fstream>
 #include <string>
+#include <atomic>
 
 
 namespace mtools
 {
 
+    namespace internals_logfile { class AsyncWriter; }
+
+
 
     /**
      * Log file class.
      *
      * Write something into a file using << operator.
+     *
+     * By default, each write goes synchronously to the file. In asynchronous mode (see setAsync()),
+     * operator<< only formats the string and copies it into a staging ring buffer owned by the
+     * calling thread; a single background thread drains the buffers of all the threads and writes
+     * them to the files in batches. A message that does not fit in the ring buffer of its thread is
+     * dropped (see nbDropped()) so logging never blocks the caller. Messages from a given thread are
+     * written in order but messages from different threads may be interleaved differently than they
+     * were issued.
      **/
     class LogFile
     {
@@ -72,12 +84,41 @@ namespace mtools
         template<class T> LogFile & operator<<(const T & v)
             {
             _openfile();
+            if (_async.load(std::memory_order_relaxed)) { _pushAsync(toString(v, _m_wenc)); return(*this); }
             (*_m_log) << toString(v, _m_wenc);
             (*_m_log).flush();
             return(*this);
             }
 
 
+        /**
+         * Enable or disable the asynchronous mode. When disabling it, the method returns once all the
+         * pending messages are written to the file.
+         *
+         * @param   status  true to enable the asynchronous mode and false to go back to synchronous
+         *                  writes.
+         **/
+        void setAsync(bool status);
+
+
+        /** Query if the asynchronous mode is enabled. */
+        bool isAsync() const { return _async; }
+
+
+        /**
+         * Wait until every message written (by any thread) before the call is in the file. Does
+         * nothing in synchronous mode.
+         **/
+        void flush();
+
+
+        /**
+         * Number of messages dropped in asynchronous mode because the staging buffer of the writing
+         * thread was full.
+         **/
+        uint64 nbDropped() const { return _dropped; }
+
+
         /**
          * Get the filename.
          * @return  the name of the log file.
@@ -89,6 +130,11 @@ namespace mtools
         /** open the file is not yet done and write the header if required */
         void _openfile();
 
+        /** push a message in the staging buffer of the calling thread (asynchronous mode) */
+        void _pushAsync(const std::string & s);
+
+        friend class internals_logfile::AsyncWriter;
+
 
         LogFile(const LogFile &) = delete;
         LogFile(LogFile &&) = delete;
@@ -101,6 +147,9 @@ namespace mtools
         std::ofstream * _m_log;             ///< the log file stream.
         bool  _append;                      ///< append to file flag
         bool  _header;                      ///< add an header
+        std::atomic<bool> _async;           ///< asynchronous mode flag
+        std::atomic<uint64> _dropped;       ///< number of messages dropped in asynchronous mode
+        uint64 _id;                         ///< identifier of the file for the asynchronous writer
     };
 
 
@@ -0,0 +1,212 @@
+/** @file metrics.hpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "../misc/internal/mtools_export.hpp"
+#include "../misc/misc.hpp"
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <type_traits>
+
+
+namespace mtools
+    {
+
+
+    /**
+     * Low overhead channel for publishing numeric counters of a running simulation.
+     *
+     * The simulation thread registers variables with add() and calls publish() in its main loop.
+     * Most calls to publish() only increment a counter: every 'tick' calls, the values of the
+     * registered variables are copied into a buffer protected by a seqlock. Readers (a watch window,
+     * a monitoring thread, the exporters below) take consistent snapshots of this buffer without ever
+     * blocking the writer, and all the formatting happens on the reader side.
+     *
+     * The channel can be spied in a watch window (the value displayed is toString(), computed in
+     * the fltk thread):
+     *
+     * @code
+     * MetricsChannel metrics(1000);
+     * metrics.add("steps", nbsteps);
+     * metrics.add("radius", radius);
+     * watch.spy<false>("metrics", metrics);
+     * metrics.serveHTTP(9100);     // Prometheus endpoint for headless runs
+     * while (1) { ... ; metrics.publish(); }
+     * @endcode
+     *
+     * add() and publish() must be called from the same (writer) thread. All the other methods are
+     * thread-safe.
+     **/
+    class MetricsChannel
+        {
+
+        public:
+
+            /**
+             * Constructor.
+             *
+             * @param   tick        publish() copies the values once every tick calls (0 = every call).
+             * @param   capacity    maximum number of metrics.
+             **/
+            MetricsChannel(size_t tick = 1000, size_t capacity = 64);
+
+
+            /** Destructor. Stop the exporters. */
+            ~MetricsChannel();
+
+
+            /**
+             * Register an arithmetic variable. The variable must outlive the channel (or the channel
+             * must not be published anymore). The metric is only visible after the next copy.
+             *
+             * @param   name    The name of the metric.
+             * @param   var     The variable.
+             *
+             * @return  The index of the metric.
+             **/
+            template<typename T> size_t add(const std::string & name, const T & var)
+                {
+                static_assert(std::is_arithmetic<T>::value, "MetricsChannel only accepts arithmetic types");
+                const int kind = (std::is_floating_point<T>::value ? KIND_DOUBLE : (std::is_signed<T>::value ? KIND_INT : KIND_UINT));
+                return _add(name, kind, [](const void * p) -> uint64 { return _encode(*((const T*)p)); }, &var);
+                }
+
+
+            /**
+             * Publish the values of the registered variables. Cheap: only copy the values once every
+             * tick calls.
+             **/
+            inline void publish()
+                {
+                if (_count < _tick) { _count++; return; }
+                publishNow();
+                }
+
+
+            /** Publish the values of the registered variables immediately. */
+            void publishNow();
+
+
+            /** Number of times the values were copied since the creation of the channel. */
+            uint64 nbPublished() const { return _nbpub.load(); }
+
+
+            /**
+             * Take a consistent snapshot of the values.
+             *
+             * @param [in,out]  names   The names of the metrics.
+             * @param [in,out]  values  The values of the metrics (as double).
+             **/
+            void snapshot(std::vector<std::string> & names, std::vector<double> & values) const;
+
+
+            /** Formatted snapshot: one line 'name = value' per metric. */
+            std::string toString() const;
+
+
+            /**
+             * Snapshot in the Prometheus text exposition format (every metric is a gauge, names are
+             * sanitized and prefixed with 'prefix').
+             **/
+            std::string toPrometheus(const std::string & prefix = "mtools_") const;
+
+
+            /**
+             * Start a thread serving the snapshots in the Prometheus text format over HTTP on
+             * localhost:port (every request gets the same answer, whatever the path).
+             *
+             * @return  true if the socket could be opened.
+             **/
+            bool serveHTTP(int port);
+
+
+            /**
+             * Start a thread sending a snapshot in UDP datagrams to host:port every interval
+             * milliseconds. Each line of a datagram has the form 'name:value|g' (statsd gauge).
+             *
+             * @return  true if the socket could be opened.
+             **/
+            bool sendUDP(const std::string & host, int port, int intervalms = 1000);
+
+
+            /** Stop the exporter threads. */
+            void stopExport();
+
+
+            static const int KIND_INT = 0;      // kinds of metrics
+            static const int KIND_UINT = 1;     //
+            static const int KIND_DOUBLE = 2;   //
+
+        private:
+
+            typedef uint64(*EncodeFun)(const void *);
+
+            struct Slot
+                {
+                std::string name;
+                int kind;
+                EncodeFun encode;
+                const void * var;
+                };
+
+            template<typename T> static uint64 _encode(const T & v, typename std::enable_if<std::is_floating_point<T>::value>::type * = nullptr) { double d = (double)v; uint64 r; std::memcpy(&r, &d, sizeof(r)); return r; }
+            template<typename T> static uint64 _encode(const T & v, typename std::enable_if<!std::is_floating_point<T>::value>::type * = nullptr) { return (uint64)((int64)v); }
+
+            size_t _add(const std::string & name, int kind, EncodeFun fun, const void * var);
+
+            void _read(std::vector<std::pair<std::string, int> > & names, std::vector<uint64> & raw) const;
+
+            void _httpLoop(intptr_t sock);
+            void _udpLoop(intptr_t sock, int intervalms);
+
+            size_t _tick;
+            size_t _count;
+            const size_t _capacity;
+
+            std::vector<Slot> _slots;                           // registered metrics (writer side)
+            size_t _nbpublished;                                // number of slots in the published buffer
+            std::unique_ptr<std::atomic<uint64>[]> _buf;        // published values
+            std::atomic<uint64> _seq;                           // seqlock sequence number (odd while writing)
+            std::atomic<uint64> _nbpub;                         // number of copies
+
+            mutable std::mutex _namesmut;                       // protect _names
+            std::vector<std::pair<std::string, int> > _names;   // names and kinds of the published slots
+
+            std::atomic<bool> _stop;
+            std::vector<std::thread> _threads;
+            std::vector<intptr_t> _sockets;
+
+            MetricsChannel(const MetricsChannel &) = delete;
+            MetricsChannel & operator=(const MetricsChannel &) = delete;
+        };
+
+
+    }
+
+
+/* end of file */
+
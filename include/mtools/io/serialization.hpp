@@ -27,8 +27,11 @@
 #include "../misc/error.hpp"
 #include "../misc/metaprog.hpp"
 #include "../misc/stringfct.hpp"
+#include "../misc/memory.hpp"
 #include "../io/fileio.hpp"
 
+#include <functional>
+
 
 /* include the helper class definiton */
 #include "internal/internals_serialization.hpp"
@@ -49,6 +52,7 @@ namespace mtools
 	* 
 	* This class should not be used directly. Use instead one of the derived class:
 	*	- OFileArchive  
+	*	- OBinaryFileArchive  
 	*	- OStringArchive  
 	*	- OCPPArchive
 	*
@@ -76,6 +80,14 @@ namespace mtools
 	*
 	* If there is an error while performing serialization, an exception is thrown.
 	*
+	* Binary mode (used by OBinaryFileArchive): fundamental types are written in little-endian
+	* form with their native size, array() of fundamental types and opaque() / opaqueArray() are
+	* copied as a single memory block, other tokens (strings, objects without serialize method...)
+	* are written in text form preceded by their length. Comments and formatting are ignored. The
+	* archive starts with a magic number which lets the IBaseArchive classes detect the format.
+	* Blocks written by array() and opaqueArray() are padded to be aligned (relative to the
+	* beginning of the archive) so that IMappedArchive can return them in place.
+	*
 	* @sa  class IBaseArchive
 	**/
 	class OBaseArchive
@@ -83,8 +95,12 @@ namespace mtools
 
 		public:
 
-			/** Default constructor. */
-			OBaseArchive() :  _startline(true), _comment(false), _indent(0), _nbitem(0), _writeBuffer()
+			/**
+			* Constructor.
+			*
+			* @param   binary  true to create a binary archive (see above), false for a text archive.
+			**/
+			OBaseArchive(bool binary = false) :  _startline(true), _comment(false), _binary(binary), _indent(0), _nbitem(0), _flushed(0), _writeBuffer()
 				{
 				const size_t BUFFER_SIZE = 512000;
 				_writeBuffer.reserve(BUFFER_SIZE);
@@ -128,6 +144,7 @@ namespace mtools
 				{
 				typedef mtools::remove_cv_t<T> cvT; // type T but without qualifiers
 				cvT * p = const_cast<cvT*>(&obj); // pointer to obj without qualifiers
+				if (_binary) { _binaryWrite(*p, std::integral_constant<bool, std::is_arithmetic<cvT>::value>()); _flush(); return(*this); }
 				_makeSpace(); if (_comment) { _writeBuffer.append("% "); _comment = false; } // exit comment mode if needed
 				internals_serialization::OArchiveHelper<cvT, OBaseArchive>::write(_nbitem, *this, (*p), _writeBuffer); // serialize the object into the archive using the helper class
 				_flush();
@@ -150,6 +167,7 @@ namespace mtools
 				{
 				typedef mtools::remove_cv_t<T> cvT; // type T but without qualifiers
 				cvT * p = const_cast<cvT*>(&obj); // pointer to obj without qualifiers
+				if (_binary) { _nbitem++; _writeBuffer.append((const char *)p, sizeof(obj)); _flush(); return(*this); }
 				_makeSpace(); if (_comment) { _writeBuffer.append("% "); _comment = false; } // exit comment mode if needed
 				if (sizeof(T) == 0) { _flush(); return(*this); }
 				_nbitem++;
@@ -173,8 +191,17 @@ namespace mtools
 				{
 				typedef mtools::remove_cv_t<T> cvT; // type T but without qualifiers
 				cvT * p = const_cast<cvT*>(pp); // pointer without qualifiers
-				MTOOLS_ASSERT(p != nullptr);
-				_makeSpace(); if (_comment) { _writeBuffer.append("% "); _comment = false; } // exit comment mode if needed
+				MTOOLS_ASSERT((p != nullptr) || (len == 0)); // empty std::vector have no storage
+				if ((_binary) && (std::is_arithmetic<cvT>::value))
+					{ // contiguous block of fundamental types
+					if (len == 0) return(*this);
+					_binaryAlign(std::alignment_of<cvT>::value);
+					_nbitem += len;
+					_appendLE(p, sizeof(cvT)*len, sizeof(cvT));
+					_flush();
+					return(*this);
+					}
+				if (!_binary) { _makeSpace(); if (_comment) { _writeBuffer.append("% "); _comment = false; } } // exit comment mode if needed
 				if (len == 0) { _flush(); return(*this); }
 				for (size_t i = 0; i < len; i++) { operator&(p[i]); } // serialize each element of the array.
 				return(*this);
@@ -197,7 +224,8 @@ namespace mtools
 				{
 				typedef mtools::remove_cv_t<T> cvT; // type T but without qualifiers
 				cvT * p = const_cast<cvT*>(pp); // pointer without qualifiers
-				MTOOLS_ASSERT(p != nullptr);
+				MTOOLS_ASSERT((p != nullptr) || (len == 0)); // empty std::vector have no storage
+				if (_binary) { if (len * sizeof(T) != 0) { _binaryAlign(std::alignment_of<cvT>::value); _nbitem++; _writeBuffer.append((const char *)p, sizeof(T)*len); } _flush(); return(*this); }
 				_makeSpace(); if (_comment) { _writeBuffer.append("% "); _comment = false; }
 				if (len * sizeof(T) == 0) { _flush(); return(*this); }
 				_nbitem++;
@@ -232,7 +260,7 @@ namespace mtools
 			**/
 			OBaseArchive & tab(size_t nb = 1)
 				{
-				if (nb > 0) { _writeBuffer.append(nb, '\t'); _flush(); }
+				if ((nb > 0) && (!_binary)) { _writeBuffer.append(nb, '\t'); _flush(); }
 				return(*this);
 				}
 
@@ -278,6 +306,12 @@ namespace mtools
 			uint64 nbItem() const { return _nbitem; }
 
 
+			/**
+			* Query if this is a binary archive.
+			**/
+			bool isBinary() const { return _binary; }
+
+
 		protected:
 
 			/** Return the current write buffer. */
@@ -290,6 +324,7 @@ namespace mtools
 			void header()
 				{
 				static const char * ARCHIVE_HEADER = "mtools::archive version 1.0\n";
+				if (_binary) { _writeBuffer.append(internals_serialization::BINARY_ARCHIVE_MAGIC, internals_serialization::BINARY_ARCHIVE_MAGIC_SIZE); _flush(); return; }
 				setIndent(0);
 				_insertComment(std::string(ARCHIVE_HEADER));
 				_flush();
@@ -301,6 +336,7 @@ namespace mtools
 				{
 				static const char * ARCHIVE_TRAILER1 = "\nnumber of items: ";
 				static const char * ARCHIVE_TRAILER2 = "\nend of archive\n";
+				if (_binary) return;
 				setIndent(0);
 				_insertComment(std::string(ARCHIVE_TRAILER1) + toString(_nbitem) + std::string(ARCHIVE_TRAILER2));
 				_flush();
@@ -328,14 +364,51 @@ namespace mtools
 			/* insert new lines */
 			void _newline(size_t nb = 1)
 				{
-				if (nb > 0) { _writeBuffer.append(nb, '\n'); _comment = false; _startline = true; _comment = false; }
+				if ((nb > 0) && (!_binary)) { _writeBuffer.append(nb, '\n'); _comment = false; _startline = true; _comment = false; }
+				}
+
+
+			/* binary mode: fundamental type */
+			template<typename T> inline void _binaryWrite(const T & obj, std::true_type)
+				{
+				_nbitem++;
+				_appendLE(&obj, sizeof(T), sizeof(T));
+				}
+
+
+			/* binary mode: other types. Leaf tokens are written in text form preceded by their length */
+			template<typename T> inline void _binaryWrite(const T & obj, std::false_type)
+				{
+				std::string tok; // compound objects call back operator&() and leave tok empty
+				internals_serialization::OArchiveHelper<T, OBaseArchive>::write(_nbitem, *this, obj, tok);
+				if (tok.size() == 0) return;
+				const uint64 l = (uint64)tok.size();
+				_appendLE(&l, sizeof(l), sizeof(l));
+				_writeBuffer += tok;
+				}
+
+
+			/* binary mode: pad with zeros until the position in the archive is a multiple of align */
+			inline void _binaryAlign(size_t align)
+				{
+				const size_t r = (size_t)((_flushed + _writeBuffer.size()) % align);
+				if (r != 0) { _writeBuffer.append(align - r, '\0'); }
+				}
+
+
+			/* append a block of values of size w in little endian form */
+			inline void _appendLE(const void * p, size_t len, size_t w)
+				{
+				if ((w == 1) || (internals_serialization::isLittleEndian())) { _writeBuffer.append((const char *)p, len); return; }
+				const char * q = (const char *)p;
+				for (size_t i = 0; i < len; i += w) { for (size_t j = w; j > 0; j--) { _writeBuffer.push_back(q[i + j - 1]); } }
 				}
 
 
 			/* add a comment string */
 			inline void _insertComment(std::string str)
 				{
-				if (str.length() == 0) return; // nothing to do
+				if ((str.length() == 0) || (_binary)) return; // nothing to do
 				replace(str, "%", "#"); // replace every % by #
 				while (1)
 					{
@@ -374,14 +447,18 @@ namespace mtools
 			/* write the buffer to the file (if needed or forced) */
 			inline void _flush()
 				{
+				const size_t l = _writeBuffer.size();
 				output(_writeBuffer);
+				if (_writeBuffer.size() < l) { _flushed += l - _writeBuffer.size(); }
 				}
 
 
 			bool _startline;                 // true if we are at the beginning of a new line
 			bool _comment;                   // true if we are in comment mode
+			bool _binary;                    // true for a binary archive
 			size_t _indent;                  // number of indentations at the beginning of each new line
 			uint64 _nbitem;                  // number of items in the archive
+			uint64 _flushed;                 // number of bytes already given to output()
 			std::string _writeBuffer;        // the write buffer
 
 		};
@@ -395,8 +472,13 @@ namespace mtools
 
 		public: 
 
-		/** Default constructor. */
-		OStringArchive() : OBaseArchive() { header(); }
+		/**
+		 * Constructor.
+		 *
+		 * @param	binary	true to create a binary archive (e.g. to send objects over the network),
+		 * 					false for a text archive.
+		 **/
+		OStringArchive(bool binary = false) : OBaseArchive(binary) { header(); }
 
 		/** Destructor. */
 		virtual ~OStringArchive() {}
@@ -457,21 +539,50 @@ namespace mtools
 
 
 
-	/** Class to serialize into a file (use compression depending on the file extension) */
+	/**
+	 * Class to serialize into a file (use compression depending on the file extension or on the
+	 * codec chosen).
+	 *
+	 * Available codecs:
+	 * - CODEC_NONE : no compression.
+	 * - CODEC_GZIP : zlib (extensions ".gz", ".gzip", ".z"), level 1 to 9, default 4.
+	 * - CODEC_ZSTD : zstd (extensions ".zst", ".zstd"), level 1 to 22, default 3. Can compress
+	 *                with several threads. Requires MTOOLS_USE_ZSTD.
+	 * - CODEC_LZ4  : lz4 frame format (extension ".lz4"), level 0 (fastest, default) to 12.
+	 *                Requires MTOOLS_USE_LZ4.
+	 *
+	 * zstd and lz4 are much faster than gzip for a similar (zstd) or slightly worse (lz4)
+	 * compression ratio. IFileArchive detects the codec used when reading the file back.
+	 **/
 	class OFileArchive : public OBaseArchive
 		{
 		public:
 
+			static const int CODEC_AUTO = -1;	///< codec determined by the extension of the file name
+			static const int CODEC_NONE = 0;	///< no compression
+			static const int CODEC_GZIP = 1;	///< gzip compression
+			static const int CODEC_ZSTD = 2;	///< zstd compression
+			static const int CODEC_LZ4 = 3;		///< lz4 compression
+
+
 			/**
 			* Constructor. Create a new archive. If a file with the same name already exist, it is
 			* truncated without warning.
 			*
-			* @param   filename    Filename of the archive. Compression is determined depending on the file
-			*                      extension : use a ".gz",".gzip" or ".z" extension to create a compressed
-			*                      archive (for example "distrib.ar.gz"), oitherwise, the archive is in plain
-			*                      text format.
+			* @param   filename    Filename of the archive. With CODEC_AUTO, compression is determined
+			*                      depending on the file extension : use a ".gz",".gzip" or ".z"
+			*                      extension to create a gzip compressed archive (for example
+			*                      "distrib.ar.gz"), ".zst" or ".lz4" for zstd or lz4, otherwise, the
+			*                      archive is in plain text format.
+			* @param   append      If true, the archive is appended at the end of the file instead of
+			*                      truncating it. Archives appended one after the other can be read
+			*                      back sequentially from a single IFileArchive object.
+			* @param   codec       The codec to use (CODEC_AUTO to choose it from the file extension).
+			* @param   level       The compression level (negative for the default level of the codec).
+			* @param   nbThreads   Number of compression threads (zstd only, 0 = number of hardware
+			*                      threads, 1 = compress in the calling thread).
 			**/
-			OFileArchive(const std::string & filename);
+			OFileArchive(const std::string & filename, bool append = false, int codec = CODEC_AUTO, int level = -1, int nbThreads = 1);
 
 			/**
 			* Destructor. Save and close the file containing the archive.
@@ -479,8 +590,23 @@ namespace mtools
 			virtual ~OFileArchive();
 
 
+			/**
+			* Return true if a codec is available (zstd and lz4 depend on the build options).
+			**/
+			static bool codecAvailable(int codec);
+
+
+			/**
+			* Return the codec associated with the extension of a file name.
+			**/
+			static int codecFromFilename(const std::string & filename);
+
+
 		protected:
 
+			/** Constructor used by OBinaryFileArchive. */
+			OFileArchive(const std::string & filename, bool append, bool binary, int codec, int level, int nbThreads);
+
 			virtual void output(std::string & str) override { _write(str, false);  }
 
 		private:
@@ -489,12 +615,139 @@ namespace mtools
 			void _closeFile();
 			void _write(std::string & str, bool force);
 
-			static const size_t GZIPBUFFERSIZE = 512000;
 			static const size_t WRITEBUFFERSIZE = 512000;
 
 			std::string _filename;           // name of the archive file
-			bool _compress;                  // true if we are using compression
-			void * _handle;                  // gzFile handle when using compression
+			int _codec;                      // the codec used
+			int _level;                      // compression level
+			int _nbThreads;                  // number of compression threads
+			bool _append;                    // true if we append to an existing file
+			void * _handle;                  // the output stream (internals_serialization::CodecWriter)
+		};
+
+
+
+	/**
+	 * Class to serialize into a binary file (use compression depending on the file extension).
+	 *
+	 * Same as OFileArchive but the archive is written in binary mode (cf. OBaseArchive): PODs and
+	 * contiguous arrays are copied directly instead of being formatted as text which makes
+	 * serialization of large numeric data much faster and the files smaller. The archive can be
+	 * read back with IBinaryFileArchive or IFileArchive (both detect the format).
+	 **/
+	class OBinaryFileArchive : public OFileArchive
+		{
+		public:
+
+			/**
+			* Constructor. Create a new archive. If a file with the same name already exist, it is
+			* truncated without warning.
+			*
+			* @param   filename    Filename of the archive. With CODEC_AUTO, use a ".gz",".gzip",
+			*                      ".z", ".zst" or ".lz4" extension to create a compressed archive.
+			* @param   codec       The codec to use (cf. OFileArchive).
+			* @param   level       The compression level (negative for the default level of the codec).
+			* @param   nbThreads   Number of compression threads (zstd only).
+			**/
+			OBinaryFileArchive(const std::string & filename, int codec = CODEC_AUTO, int level = -1, int nbThreads = 1) : OFileArchive(filename, false, true, codec, level, nbThreads) {}
+
+			/**
+			* Destructor. Save and close the file containing the archive.
+			**/
+			virtual ~OBinaryFileArchive() {}
+		};
+
+
+
+	/**
+	 * Class performing serialization into an std::string without header nor footer. Used to create
+	 * the independent pieces of an archive written by OParallelFileArchive.
+	 **/
+	class OChunkArchive : public OBaseArchive
+		{
+
+		public:
+
+			/** Default constructor. */
+			OChunkArchive() : OBaseArchive() { }
+
+			/** Destructor. */
+			virtual ~OChunkArchive() {}
+
+			/** Return the serialized string. */
+			std::string & get() { return getbuffer(); }
+
+			/** Write the archive header (first chunk only). */
+			void writeHeader() { header(); }
+
+			/** Write the archive footer with the total number of items (last chunk only). */
+			void writeFooter(uint64 nbitem) { newline(); (*this) << (std::string("\nnumber of items: ") + toString(nbitem) + std::string("\nend of archive\n")); }
+
+		protected:
+
+			virtual void output(std::string & str) override { }
+
+		};
+
+
+	/**
+	 * Class to serialize into a compressed file using several threads.
+	 *
+	 * The archive is made of chunks filled independently by a user supplied function. Chunks are
+	 * serialized and compressed in parallel and then written in order in the file as concatenated
+	 * gzip members. The resulting file is a regular gzip file: it can be read with IFileArchive
+	 * and the text obtained is the same as if the chunks were serialized one after the other
+	 * into an OFileArchive. Each gzip member also records its compressed and uncompressed size in
+	 * the header extra field so that IParallelFileArchive can decompress the file in parallel.
+	 *
+	 * The function used for filling the chunks is called concurrently from several threads, so it
+	 * must only access shared data in read-only mode.
+	 **/
+	class OParallelFileArchive
+		{
+		public:
+
+			/**
+			 * Constructor. Create a new archive. If a file with the same name already exist, it is
+			 * truncated without warning.
+			 *
+			 * @param	filename 	Filename of the archive (always compressed, whatever the extension).
+			 * @param	nbThreads	Number of threads to use (0 = number of hardware threads).
+			 * @param	level	 	zlib compression level (1 = fastest, 9 = best compression).
+			 **/
+			OParallelFileArchive(const std::string & filename, size_t nbThreads = 0, int level = 4);
+
+
+			/** Destructor. Write the footer and close the file. */
+			~OParallelFileArchive();
+
+
+			/**
+			 * Serialize chunks into the archive. fct(i, ar) is called for each i in [0, nbChunks - 1]
+			 * (concurrently, in arbitrary order) and must serialize the i-th chunk into ar. The chunks
+			 * are appended to the archive in increasing order of i. May be called several times.
+			 *
+			 * @param	nbChunks	Number of chunks.
+			 * @param	fct			The function that fills the chunks.
+			 **/
+			void write(size_t nbChunks, std::function<void(size_t, OBaseArchive &)> fct);
+
+
+			/** Return the number of items written so far. */
+			uint64 nbItem() const { return _nbitem; }
+
+		private:
+
+			OParallelFileArchive(const OParallelFileArchive &) = delete;
+			OParallelFileArchive & operator=(const OParallelFileArchive &) = delete;
+
+			void _writeChunk(OChunkArchive & ar);
+
+			std::string _filename;           // name of the archive file
+			void * _handle;                  // FILE handle
+			size_t _nbThreads;               // number of threads used for compression
+			int _level;                      // compression level
+			uint64 _nbitem;                  // number of items written
 		};
 
 
@@ -507,6 +760,7 @@ namespace mtools
 	*
 	* This class should not be used directly. Use instead one of the derived class:
 	*	- IFileArchive
+	*	- IMappedArchive
 	*	- IStringArchive
 	*	- ICPPArchive
 	*
@@ -528,6 +782,10 @@ namespace mtools
 	*
 	* If there is an error while deserialization, an exception (type const char *) is thrown.
 	*
+	* The format of the archive (text or binary) is detected when the first item is read: binary
+	* archives start with a magic number which must be contained in the first buffer returned by
+	* refill().
+	*
 	* @sa  class OBaseArchive
 	**/
 	class IBaseArchive
@@ -539,7 +797,7 @@ namespace mtools
 			/**
 			* Constructor.
 			**/
-			IBaseArchive() : _buffer(nullptr), _bufsize(0), _nbitem(0), _tempstr()
+			IBaseArchive() : _buffer(nullptr), _bufsize(0), _nbitem(0), _binpos(0), _format(FORMAT_UNKNOWN), _tempstr(), _bintok()
 				{
 				}
 
@@ -568,6 +826,7 @@ namespace mtools
 				{
 				typedef mtools::remove_cv_t<T> cvT; // type T but without qualifiers
 				cvT * p = const_cast<cvT*>(&obj); // pointer to obj without qualifiers
+				if ((_checkFormat()) && (std::is_arithmetic<cvT>::value)) { _nbitem++; _readLE(p, sizeof(cvT), sizeof(cvT)); return(*this); }
 				internals_serialization::IArchiveHelper<cvT, IBaseArchive>::read(_nbitem, *this, (*p)); // deserialize the object into the archive using the helper class
 				return(*this);
 				}
@@ -586,6 +845,7 @@ namespace mtools
 				{
 				typedef mtools::remove_cv_t<T> cvT; // type T but without qualifiers
 				cvT * p = const_cast<cvT*>(&obj); // pointer to obj without qualifiers
+				if (_checkFormat()) { _nbitem++; _readRaw(p, sizeof(obj)); return(*this); }
 				if (sizeof(T) == 0) return(*this);
 				_nbitem++;
 				if (readTokenFromArchive(p, sizeof(T)) != sizeof(obj)) { MTOOLS_THROW("IBaseArchive error (opaque)"); }
@@ -607,8 +867,9 @@ namespace mtools
 				{
 				typedef mtools::remove_cv_t<T> cvT; // type T but without qualifiers
 				cvT * p = const_cast<cvT*>(pp); // pointer without qualifiers
-				MTOOLS_ASSERT(p != nullptr);
+				MTOOLS_ASSERT((p != nullptr) || (len == 0)); // empty std::vector have no storage
 				if (len == 0) return(*this);
+				if ((_checkFormat()) && (std::is_arithmetic<cvT>::value)) { _skipPadding(std::alignment_of<cvT>::value); _nbitem += len; _readLE(p, sizeof(cvT)*len, sizeof(cvT)); return(*this); }
 				for (size_t i = 0; i < len; i++) { operator&(p[i]); } // unserialize each element of the array.
 				return(*this);
 				}
@@ -629,9 +890,10 @@ namespace mtools
 				{
 				typedef mtools::remove_cv_t<T> cvT; // type T but without qualifiers
 				cvT * p = const_cast<cvT*>(pp); // pointer without qualifiers
-				MTOOLS_ASSERT(p != nullptr);
+				MTOOLS_ASSERT((p != nullptr) || (len == 0)); // empty std::vector have no storage
 				if (len * sizeof(T) == 0) return(*this);
 				_nbitem++;
+				if (_checkFormat()) { _skipPadding(std::alignment_of<cvT>::value); _readRaw(p, sizeof(T)*len); return(*this); }
 				if (readTokenFromArchive(p, sizeof(T)*len) != (sizeof(T)*len)) { MTOOLS_THROW("IBaseArchive error (opaquearray)"); }
 				return(*this);
 				}
@@ -662,6 +924,34 @@ namespace mtools
 			uint64 nbItem() const { return _nbitem; }
 
 
+			/**
+			* Query if the archive is in binary format (the format is detected when the first item is
+			* read).
+			**/
+			bool isBinary() { return _checkFormat(); }
+
+
+			/**
+			* Query whether the end of the archive is reached i.e. if there is no more token to read
+			* (comments are skipped).
+			**/
+			bool atEnd()
+				{
+				if (_checkFormat())
+					{
+					if (_bufsize > 0) return false;
+					size_t l = 0;
+					return ((_refill(l) == nullptr) || (l == 0));
+					}
+				size_t nb = _bufsize;
+				bool found = findNextToken<IBaseArchive::_refillStatic>(_buffer, nb, this); // find the beginning of the next token
+				if (!found) { _bufsize = 0; return true; }
+				_buffer += nb;
+				_bufsize -= nb;
+				return false;
+				}
+
+
 		protected:
 
 			/**
@@ -675,6 +965,25 @@ namespace mtools
 				}
 
 
+			/**
+			* Binary archive only: skip the alignment padding and return a pointer to the next len bytes of
+			* the archive if they are contiguous in the current read buffer. In this case, the bytes are
+			* consumed and nbitems is added to the item count. Otherwise, return nullptr and nothing is
+			* consumed (except the padding).
+			**/
+			const void * binaryView(size_t len, size_t align, uint64 nbitems)
+				{
+				MTOOLS_ASSERT(_format == FORMAT_BINARY);
+				_skipPadding(align);
+				if (_bufsize == 0) { size_t l = 0; _refill(l); }
+				if ((_buffer == nullptr) || (_bufsize < len)) return nullptr;
+				const void * p = _buffer;
+				_buffer += len; _bufsize -= len; _binpos += len;
+				_nbitem += nbitems;
+				return p;
+				}
+
+
 		private:
 
 			/* no copy */
@@ -691,6 +1000,13 @@ namespace mtools
 			return the size of the token. */
 			size_t readTokenFromArchive(void * dest_buffer, size_t dest_len)
 				{
+				if (_checkFormat())
+					{
+					_readBinaryToken();
+					const char * src = _bintok.data();
+					size_t srclen = _bintok.size();
+					return readToken(dest_buffer, dest_len, src, srclen);
+					}
 				size_t nb = _bufsize;
 				bool found = findNextToken<IBaseArchive::_refillStatic>(_buffer, nb, this); // find the beginning of the next token
 				if (!found) { MTOOLS_THROW("IBaseArchive error, no more token"); } // no more token found
@@ -709,6 +1025,13 @@ namespace mtools
 			return the size of the token. */
 			size_t readTokenFromArchive(std::string & dest)
 				{
+				if (_checkFormat())
+					{
+					_readBinaryToken();
+					const char * src = _bintok.data();
+					size_t srclen = _bintok.size();
+					return readToken(dest, src, srclen);
+					}
 				size_t nb = _bufsize;
 				bool found = findNextToken<IBaseArchive::_refillStatic>(_buffer, nb, this); // find the beginning of the next token
 				if (!found) { MTOOLS_THROW("IBaseArchive error, no more token"); } // no more token found
@@ -738,10 +1061,87 @@ namespace mtools
 				return _buffer;
 				}
 
+
+			/* return true if the archive is binary. Detect the format on first call */
+			inline bool _checkFormat()
+				{
+				if (_format == FORMAT_UNKNOWN) { _detectFormat(); }
+				return (_format == FORMAT_BINARY);
+				}
+
+
+			/* look for the magic number at the beginning of the archive */
+			void _detectFormat()
+				{
+				if (_bufsize == 0) { size_t l = 0; _refill(l); }
+				const size_t M = internals_serialization::BINARY_ARCHIVE_MAGIC_SIZE;
+				if ((_buffer != nullptr) && (_bufsize >= M) && (memcmp(_buffer, internals_serialization::BINARY_ARCHIVE_MAGIC, M) == 0))
+					{
+					_buffer += M;
+					_bufsize -= M;
+					_binpos = M;
+					_format = FORMAT_BINARY;
+					return;
+					}
+				_format = FORMAT_TEXT;
+				}
+
+
+			/* binary mode: read len bytes. throws if the end of the archive is reached */
+			void _readRaw(void * dest, size_t len)
+				{
+				char * d = (char *)dest;
+				while (len > 0)
+					{
+					if (_bufsize == 0) { size_t l = 0; if ((_refill(l) == nullptr) || (l == 0)) { MTOOLS_THROW("IBaseArchive error, unexpected end of binary archive"); } }
+					const size_t k = (len < _bufsize) ? len : _bufsize;
+					memcpy(d, _buffer, k);
+					d += k; len -= k;
+					_buffer += k; _bufsize -= k; _binpos += k;
+					}
+				}
+
+
+			/* binary mode: skip the padding inserted by OBaseArchive::_binaryAlign() */
+			void _skipPadding(size_t align)
+				{
+				const size_t r = (size_t)(_binpos % align);
+				if (r != 0) { char pad[64]; _readRaw(pad, align - r); }
+				}
+
+
+			/* binary mode: read a block of values of size w in little endian form */
+			void _readLE(void * dest, size_t len, size_t w)
+				{
+				_readRaw(dest, len);
+				if ((w == 1) || (internals_serialization::isLittleEndian())) return;
+				char * q = (char *)dest;
+				for (size_t i = 0; i < len; i += w) { std::reverse(q + i, q + i + w); }
+				}
+
+
+			/* binary mode: read a text token preceded by its length into _bintok */
+			void _readBinaryToken()
+				{
+				uint64 l;
+				_readLE(&l, sizeof(l), sizeof(l));
+				if (l > ((uint64)1) << 40) { MTOOLS_THROW("IBaseArchive error, invalid token length"); }
+				_bintok.resize((size_t)l);
+				if (l > 0) { _readRaw(&_bintok[0], (size_t)l); }
+				}
+
+
+			static const int FORMAT_UNKNOWN = 0;
+			static const int FORMAT_TEXT = 1;
+			static const int FORMAT_BINARY = 2;
+
 			const char * _buffer;            // read buffer
 			size_t		 _bufsize;           // number of char in the read buffer
 			uint64		 _nbitem;            // number of item in the archive
+			uint64		 _binpos;            // binary mode: number of bytes read from the archive
+			int			 _format;            // format of the archive (text or binary), detected on first read.
 			std::string	 _tempstr;           // temporary string used for reconstructing objects (used by IArchiveHelper). 
+			std::string	 _bintok;            // binary mode: current text token.
 
 		};
 
@@ -797,7 +1197,11 @@ namespace mtools
 
 	
 
-	/** Class to deserialize an object of type const p_char[] created with OCPPArchive. */
+	/**
+	 * Class to deserialize an object of type const p_char[] created with OCPPArchive. The data is
+	 * decompressed chunk by chunk as it is read so reading the beginning of a large object is cheap
+	 * and the decompressed object is never held in memory as a whole.
+	 **/
 	class ICPPArchive : public IBaseArchive
 		{
 
@@ -805,31 +1209,34 @@ namespace mtools
 
 			ICPPArchive(const cp_char obj[] );
 
-			virtual ~ICPPArchive() {}
+			virtual ~ICPPArchive();
 
-			/* for debug purpose, return the buffer */
-			const std::string buffer() const { return _buf; }
+			/* for debug purpose, return the whole decompressed buffer */
+			const std::string buffer() const;
 
 		protected:
 
-			virtual const char * refill(size_t & len) override 
-				{
-				if (_firsttime) { _firsttime = false; len = _buf.size(); return _buf.data(); }
-				len = 0;
-				return nullptr;
-				}
+			virtual const char * refill(size_t & len) override;
 
 		private:
 
-			std::string _buf;
-			bool _firsttime;
+			static const size_t CHUNKSIZE = 262144;
+
+			const cp_char * _obj;		// the object
+			size_t _tabsize;			// number of lines of the object
+			size_t _k;					// next line to decompress
+			std::string _in;			// current line (decoded from hexadecimal)
+			std::vector<char> _out;		// decompressed chunk
+			void * _strm;				// zlib stream (nullptr once the end is reached)
 
+			ICPPArchive(const ICPPArchive &) = delete;
+			ICPPArchive & operator=(const ICPPArchive &) = delete;
 		};
 
 
 
 
-	/** Class to deserialize from a file create with OFileArchive. */
+	/** Class to deserialize from a file create with OFileArchive (the codec is detected automatically). */
 	class IFileArchive : public IBaseArchive
 		{
 
@@ -850,16 +1257,184 @@ namespace mtools
 			const char * _readfile(size_t & len);
 
 			static const size_t FILEBUFFERSIZE = 512000;
-			static const size_t GZIPBUFFERSIZE = 512000;
 
 			char * _filebuffer;             // read buffer
-			void * _handle;                 // gzfile handle
+			void * _handle;                 // the input stream (internals_serialization::CodecReader)
 			std::string _filename;          // name of the archive file
 
 		};
 
 
 
+	/**
+	 * Class to deserialize from a file created with OBinaryFileArchive. Text archives created with
+	 * OFileArchive can also be read (the format is detected automatically, as for IFileArchive).
+	 **/
+	class IBinaryFileArchive : public IFileArchive
+		{
+
+		public:
+
+			IBinaryFileArchive(const std::string & filename) : IFileArchive(filename) {}
+
+			virtual ~IBinaryFileArchive() {}
+
+		};
+
+
+
+	/**
+	 * Class to deserialize from an uncompressed archive file without copying it.
+	 *
+	 * The file is memory mapped and the whole mapping is given to the parser at once, so there is no
+	 * read buffer. For binary archives (created with an OBinaryFileArchive without compression),
+	 * arrayView() and opaqueArrayView() return pointers directly into the mapping: large tables can
+	 * then be used in place without any copy nor parsing. Views on text archives (or on big endian
+	 * hosts for arrayView()) fall back to deserializing into a buffer owned by the archive. In both
+	 * cases, the pointers remain valid until the archive is destroyed.
+	 *
+	 * Compressed archives cannot be mapped: the constructor throws in that case.
+	 *
+	 * @code
+	 * IMappedArchive ar("table.bin");
+	 * uint64 n; ar & n;
+	 * const double * tab = ar.arrayView<double>((size_t)n); // same data as ar.array(v, n)
+	 * @endcode
+	 **/
+	class IMappedArchive : public IBaseArchive
+		{
+
+		public:
+
+			/**
+			 * Constructor. Map the file.
+			 *
+			 * @param	filename	Filename of the archive (must not be compressed).
+			 **/
+			IMappedArchive(const std::string & filename) : IBaseArchive(), _map(filename), _firsttime(true), _owned()
+				{
+				if (!_map.isOpen()) { MTOOLS_THROW("IMappedArchive error (cannot map file)"); }
+				const unsigned char * p = (const unsigned char *)_map.data();
+				if ((_map.size() >= 2) && (p[0] == 0x1f) && (p[1] == 0x8b)) { MTOOLS_THROW("IMappedArchive error (compressed archive)"); }
+				}
+
+
+			virtual ~IMappedArchive()
+				{
+				for (auto p : _owned) { std::free(p); }
+				}
+
+
+			/**
+			 * Return a view on len objects of type T (fundamental type) serialized with array(). Same
+			 * as array() but the values are not copied.
+			 *
+			 * @param	len	number of objects in the array.
+			 *
+			 * @return	pointer to the objects, valid until the archive is destroyed (nullptr if len = 0).
+			 **/
+			template<typename T> const T * arrayView(size_t len)
+				{
+				static_assert(std::is_arithmetic<T>::value, "IMappedArchive::arrayView() requires a fundamental type");
+				if (len == 0) return nullptr;
+				if ((isBinary()) && ((sizeof(T) == 1) || (internals_serialization::isLittleEndian())))
+					{
+					const void * p = binaryView(sizeof(T)*len, std::alignment_of<T>::value, len);
+					if (p != nullptr) return (const T *)p;
+					}
+				T * q = (T *)_alloc(sizeof(T)*len);
+				array(q, len);
+				return q;
+				}
+
+
+			/**
+			 * Return a view on len objects of type T serialized with opaqueArray(). Same as
+			 * opaqueArray() but the memory is not copied.
+			 *
+			 * @param	len	number of objects in the array.
+			 *
+			 * @return	pointer to the objects, valid until the archive is destroyed (nullptr if len = 0).
+			 **/
+			template<typename T> const T * opaqueArrayView(size_t len)
+				{
+				if (len*sizeof(T) == 0) return nullptr;
+				if (isBinary())
+					{
+					const void * p = binaryView(sizeof(T)*len, std::alignment_of<T>::value, 1);
+					if (p != nullptr) return (const T *)p;
+					}
+				T * q = (T *)_alloc(sizeof(T)*len);
+				opaqueArray(q, len);
+				return q;
+				}
+
+
+		protected:
+
+			virtual const char * refill(size_t & len) override
+				{
+				if ((_firsttime) && (_map.size() > 0)) { _firsttime = false; len = _map.size(); return (const char *)_map.data(); }
+				len = 0;
+				return nullptr;
+				}
+
+		private:
+
+			IMappedArchive(const IMappedArchive &) = delete;
+			IMappedArchive & operator=(const IMappedArchive &) = delete;
+
+			void * _alloc(size_t size)
+				{
+				void * p = std::malloc(size);
+				if (p == nullptr) { MTOOLS_THROW("IMappedArchive error (malloc)"); }
+				_owned.push_back(p);
+				return p;
+				}
+
+			MappedFile						_map;		// the mapped file
+			bool							_firsttime;	// true until the mapping is given to the parser
+			std::vector<void *>				_owned;		// buffers allocated for views which could not be made in place
+		};
+
+
+
+	/**
+	 * Class to deserialize from a file created with OParallelFileArchive using several threads.
+	 *
+	 * The gzip members of the file are decompressed in parallel (ahead of the deserialization which
+	 * remains sequential). Any other file readable by IFileArchive can also be opened, in which
+	 * case decompression is simply performed sequentially.
+	 **/
+	class IParallelFileArchive : public IBaseArchive
+		{
+
+		public:
+
+			/**
+			 * Constructor.
+			 *
+			 * @param	filename 	Filename of the archive.
+			 * @param	nbThreads	Number of threads to use (0 = number of hardware threads).
+			 **/
+			IParallelFileArchive(const std::string & filename, size_t nbThreads = 0);
+
+			virtual ~IParallelFileArchive();
+
+		protected:
+
+			virtual const char * refill(size_t & len) override;
+
+		private:
+
+			IParallelFileArchive(const IParallelFileArchive &) = delete;
+			IParallelFileArchive & operator=(const IParallelFileArchive &) = delete;
+
+			void * _impl;                   // implementation details (opaque)
+		};
+
+
+
 
 
     }
@@ -21,9 +21,15 @@
 #pragma once
 
 #include "../misc/internal/mtools_export.hpp"
+#include "../misc/misc.hpp"
+#include "../misc/internal/threadsafequeue.hpp"
 
+#include <string>
 #include <vector>
 #include <memory>
+#include <thread>
+#include <atomic>
+#include <chrono>
 
 
 namespace mtools
@@ -31,10 +37,24 @@ namespace mtools
 
 
 	/**
-	* Simple class for performing serial communication
+	* Simple class for performing serial communication (Windows and POSIX systems).
 	*
 	* Whenever an error occurs, the connexion is closed and must be re-opened to continue.
 	* Use the static method getPortList() to list all available serial ports.
+	*
+	* Asynchronous acquisition: startAcquisition() launches a thread which reads the port
+	* continuously and stores the data, by chunks of at most CHUNK_SIZE bytes with the time at which
+	* they were received, in a lock-free single producer / single consumer ring. The consumer thread
+	* retrieves them in batch with readAvailable() or readChunk() whenever it wants, so no byte is lost
+	* while it is busy (e.g. plotting) as long as the ring is not full (see droppedBytes()).
+	*
+	* @code
+	* SerialPort port;
+	* port.open("COM3", 921600);
+	* port.startAcquisition();
+	* std::vector<char> data;
+	* while (port.status()) { port.readAvailable(data); ... process / plot data ... }
+	* @endcode
 	**/
 	class SerialPort
 		{
@@ -130,8 +150,106 @@ namespace mtools
 			static std::vector<std::string> getPortList();
 
 
+			static const size_t CHUNK_SIZE = 240;	///< maximum number of bytes in a chunk of the acquisition ring.
+
+
+			/** A chunk of data received during an asynchronous acquisition. */
+			struct Chunk
+				{
+				double	time;				///< reception time (in seconds since startAcquisition())
+				uint32	len;				///< number of bytes in data
+				char	data[CHUNK_SIZE];	///< the bytes received
+				};
+
+
+			/**
+			 * Start the asynchronous acquisition. A reader thread continuously moves the incoming data
+			 * into a ring buffer. While the acquisition is running, read() and available() use the ring
+			 * buffer (and must be called from a single consumer thread). write() can still be used.
+			 *
+			 * @param	ringSize		Capacity of the ring buffer, in chunks (of at most CHUNK_SIZE bytes).
+			 * @param	osBufferSize	Size requested for the receive buffer of the driver (Windows only).
+			 *
+			 * @return	true if the acquisition started, false if the port is not open or if the acquisition
+			 * 			is already running.
+			 **/
+			bool startAcquisition(size_t ringSize = 16384, size_t osBufferSize = 1048576);
+
+
+			/**
+			 * Stop the asynchronous acquisition. The data remaining in the ring buffer is discarded.
+			 * Called automatically by close().
+			 **/
+			void stopAcquisition();
+
+
+			/** Query if the asynchronous acquisition is running. */
+			bool acquiring() const { return _acqRunning; }
+
+
+			/**
+			 * Acquisition mode: copy the data available in the ring buffer. Returns immediately.
+			 *
+			 * @param [out]	buffer	buffer to receive the data.
+			 * @param	len		  	buffer size.
+			 * @param [out]	time  	if not nullptr, set to the reception time of the first byte copied
+			 * 						(unchanged if nothing is copied).
+			 *
+			 * @return	The number of bytes copied.
+			 **/
+			size_t readAvailable(char * buffer, size_t len, double * time = nullptr);
+
+
+			/**
+			 * Acquisition mode: append all the data available in the ring buffer at the end of a vector.
+			 * Returns immediately.
+			 *
+			 * @return	The number of bytes appended.
+			 **/
+			size_t readAvailable(std::vector<char> & out);
+
+
+			/**
+			 * Acquisition mode: retrieve the next chunk of data (with its reception time). Do not mix with
+			 * readAvailable() unless the last chunk was entirely consumed.
+			 *
+			 * @return	false if no chunk is available.
+			 **/
+			bool readChunk(Chunk & chunk);
+
+
+			/** Acquisition mode: number of bytes lost because the ring buffer was full. */
+			uint64 droppedBytes() const { return _acqDropped; }
+
+
 		private:
 
+			/* platform specific: read without closing the port on error (negative value if error) */
+			int _rawRead(char * buffer, size_t len);
+
+			/* platform specific: number of bytes in the RX buffer without closing the port on error */
+			int _rawAvailable();
+
+			/* platform specific: wait at most ms milliseconds for incoming data */
+			void _waitData(int ms);
+
+			/* platform specific: set the size of the RX buffer of the driver */
+			bool _setOSBuffer(size_t size);
+
+			/* body of the reader thread */
+			void _acquisitionLoop();
+
+			std::thread												_acqThread;				// the reader thread
+			std::unique_ptr<SingleProducerSingleConsumerQueue<Chunk> >	_acqRing;				// the ring buffer
+			std::atomic<bool>										_acqRunning{ false };	// true while the acquisition is running
+			std::atomic<bool>										_acqStop{ false };		// set to stop the reader thread
+			std::atomic<bool>										_acqError{ false };		// set by the reader thread when a read fails
+			std::atomic<uint64>										_acqBytes{ 0 };			// number of bytes in the ring
+			std::atomic<uint64>										_acqDropped{ 0 };		// number of bytes lost
+			std::chrono::steady_clock::time_point					_acqStart;				// start of the acquisition
+			Chunk													_acqCur;				// chunk being consumed
+			size_t													_acqCurPos{ 0 };		// position in _acqCur
+
 			
 			struct SerialPortHandle; // forward declaration
 
@@ -205,6 +205,12 @@ namespace mtools
          * 
          * a Global watch window named 'mtools::watch' is automatically created at startup (but is only
          * displayed when at least one variable is being watched).
+         *
+         * To watch counters updated in a tight loop, spy a MetricsChannel instead of the variables
+         * themselves: the loop then only pays for an occasional copy of the values and the formatting
+         * is done in the fltk thread.
+         *
+         * In headless mode (see isHeadless()), no window is created and the object does nothing.
          **/
         class WatchWindow
             {
@@ -279,7 +285,7 @@ namespace mtools
                  **/
                 template<bool allowWrite = true, typename T> void spy(const std::string & name, T & val)
                     {
-                    if (fltkThreadStopped()) return;
+                    if ((fltkThreadStopped()) || (isHeadless())) return;
                     createIfNeeded();
                     internals_watch::WatchObjVar<T, allowWrite> * p = new internals_watch::WatchObjVar<T, allowWrite>(name, val, DEFAULT_REFRESHRATE);
                     transmit(name,p);
@@ -298,7 +304,7 @@ namespace mtools
                 **/
                 template<bool allowWrite = true, typename T, typename OutFun> void spy(const std::string & name, T & val, OutFun & outfun)
                     {
-                    if (fltkThreadStopped()) return;
+                    if ((fltkThreadStopped()) || (isHeadless())) return;
                     createIfNeeded();
                     internals_watch::WatchObjVarOut<T, OutFun, allowWrite> * p = new internals_watch::WatchObjVarOut<T, OutFun, allowWrite>(name, val, outfun, DEFAULT_REFRESHRATE);
                     transmit(name, p);
@@ -321,7 +327,7 @@ namespace mtools
                 **/
                 template<bool allowWrite = true, typename T, typename OutFun, typename InFun> void spy(const std::string & name, T & val, OutFun & outfun, InFun & infun)
                     {
-                    if (fltkThreadStopped()) return;
+                    if ((fltkThreadStopped()) || (isHeadless())) return;
                     createIfNeeded();
                     internals_watch::WatchObjVarOutIn<T, OutFun, InFun, allowWrite> * p = new internals_watch::WatchObjVarOutIn<T, OutFun, InFun, allowWrite>(name, val, outfun, infun, DEFAULT_REFRESHRATE);
                     transmit(name, p);
@@ -27,8 +27,12 @@
 #include "../misc/stringfct.hpp"
 #include "vec.hpp"
 #include "box.hpp"
+#include "rootSolver.hpp"
 
 #include <algorithm>
+#include <vector>
+#include <tuple>
+#include <cmath>
 
 
 namespace mtools
@@ -109,6 +113,22 @@ namespace mtools
 		virtual std::pair<double, double> tangent_h() const = 0;
 
 
+		/**
+		* Compute the times of intersection of the curve with the four lines bounding the rectangle
+		* B, in the order X = B.min[0], X = B.max[0], Y = B.min[1], Y = B.max[1] (<0 for unused values).
+		* 
+		* The default implementation calls intersect_vline() and intersect_hline(). The curves
+		* override it to solve the four equations with a single call to the batch root solvers.
+		**/
+		virtual void intersect_boxlines(fBox2 B, double(&r)[4][3]) const
+			{
+			std::tie(r[0][0], r[0][1], r[0][2]) = intersect_vline(B.min[0]);
+			std::tie(r[1][0], r[1][1], r[1][2]) = intersect_vline(B.max[0]);
+			std::tie(r[2][0], r[2][1], r[2][2]) = intersect_hline(B.min[1]);
+			std::tie(r[3][0], r[3][1], r[3][2]) = intersect_hline(B.max[1]);
+			}
+
+
 		/**
 		* Compute all the intersection times between the cuve and the rectangle B. 
 		* the array res store the times of intersection (size at least 12)
@@ -117,27 +137,21 @@ namespace mtools
 		**/
 		int intersect_rect(fBox2 B, double(&res)[12]) const
 			{
+			double r[4][3];
+			intersect_boxlines(B, r);
 			int nb = 0;
-			std::tuple<double, double, double> r;
-			double & r1 = std::get<0>(r);
-			double & r2 = std::get<1>(r);
-			double & r3 = std::get<2>(r);
-			r = intersect_vline(B.min[0]);
-			if (r1 > 0) { double y = eval(r1).Y(); if ((y >= B.min[1]) && (y <= B.max[1])) { res[nb] = r1; nb++; } }
-			if (r2 > 0) { double y = eval(r2).Y(); if ((y >= B.min[1]) && (y <= B.max[1])) { res[nb] = r2; nb++; } }
-			if (r3 > 0) { double y = eval(r3).Y(); if ((y >= B.min[1]) && (y <= B.max[1])) { res[nb] = r3; nb++; } }
-			r = intersect_vline(B.max[0]);
-			if (r1 > 0) { double y = eval(r1).Y(); if ((y >= B.min[1]) && (y <= B.max[1])) { res[nb] = r1; nb++; } }
-			if (r2 > 0) { double y = eval(r2).Y(); if ((y >= B.min[1]) && (y <= B.max[1])) { res[nb] = r2; nb++; } }
-			if (r3 > 0) { double y = eval(r3).Y(); if ((y >= B.min[1]) && (y <= B.max[1])) { res[nb] = r3; nb++; } }
-			r = intersect_hline(B.min[1]);
-			if (r1 > 0) { double x = eval(r1).X(); if ((x >= B.min[0]) && (x <= B.max[0])) { res[nb] = r1; nb++; } }
-			if (r2 > 0) { double x = eval(r2).X(); if ((x >= B.min[0]) && (x <= B.max[0])) { res[nb] = r2; nb++; } }
-			if (r3 > 0) { double x = eval(r3).X(); if ((x >= B.min[0]) && (x <= B.max[0])) { res[nb] = r3; nb++; } }
-			r = intersect_hline(B.max[1]);
-			if (r1 > 0) { double x = eval(r1).X(); if ((x >= B.min[0]) && (x <= B.max[0])) { res[nb] = r1; nb++; } }
-			if (r2 > 0) { double x = eval(r2).X(); if ((x >= B.min[0]) && (x <= B.max[0])) { res[nb] = r2; nb++; } }
-			if (r3 > 0) { double x = eval(r3).X(); if ((x >= B.min[0]) && (x <= B.max[0])) { res[nb] = r3; nb++; } }
+			for (int l = 0; l < 4; l++)
+				{
+				for (int j = 0; j < 3; j++)
+					{
+					const double t = r[l][j];
+					if (t > 0)
+						{
+						if (l < 2) { double y = eval(t).Y(); if ((y >= B.min[1]) && (y <= B.max[1])) { res[nb] = t; nb++; } }
+						else { double x = eval(t).X(); if ((x >= B.min[0]) && (x <= B.max[0])) { res[nb] = t; nb++; } }
+						}
+					}
+				}
 			if (nb > 0) std::sort(res, res + nb);
 			return nb;
 			}
@@ -175,6 +189,58 @@ namespace mtools
 			}
 
 
+		/**
+		 * Flatten the curve into a polyline that stays within distance tol of the curve. The first
+		 * point of out is startPoint() and the last one is endPoint().
+		 * 
+		 * The default implementation subdivides the parameter interval adaptively (at least 4
+		 * segments, at most 2^16) until the middle of each piece is within tol of its chord.
+		 *
+		 * @param 		  	tol	The tolerance (must be positive).
+		 * @param [in,out]	out	vector to store the points of the polyline (previous content erased).
+		 **/
+		virtual void flatten(double tol, std::vector<fVec2> & out) const
+			{
+			out.clear();
+			const fVec2 S = startPoint();
+			out.push_back(S);
+			_flattenRec(0.0, S, 1.0, endPoint(), tol*tol, 0, out);
+			}
+
+
+	protected:
+
+		/** Uniform flattening with n segments. */
+		void _flattenUniform(int64 n, std::vector<fVec2> & out) const
+			{
+			n = std::max<int64>(1, std::min<int64>(65536, n));
+			out.resize((size_t)(n + 1));
+			out[0] = startPoint();
+			for (int64 i = 1; i < n; i++) { out[(size_t)i] = eval(((double)i) / n); }
+			out[(size_t)n] = endPoint();
+			}
+
+	private:
+
+		void _flattenRec(double t0, const fVec2 & A, double t1, const fVec2 & B, double tol2, int depth, std::vector<fVec2> & out) const
+			{
+			const double tm = 0.5*(t0 + t1);
+			const fVec2 M = eval(tm);
+			if ((depth >= 2) && ((depth >= 16) || (_dist2Segment(M, A, B) <= tol2))) { out.push_back(B); return; }
+			_flattenRec(t0, A, tm, M, tol2, depth + 1, out);
+			_flattenRec(tm, M, t1, B, tol2, depth + 1, out);
+			}
+
+		static double _dist2Segment(const fVec2 & M, const fVec2 & A, const fVec2 & B)
+			{
+			const double ux = B.X() - A.X(), uy = B.Y() - A.Y(), l2 = ux*ux + uy*uy;
+			double t = (l2 > 0) ? (((M.X() - A.X())*ux + (M.Y() - A.Y())*uy) / l2) : 0.0;
+			t = std::max<double>(0.0, std::min<double>(1.0, t));
+			const double dx = A.X() + t*ux - M.X(), dy = A.Y() + t*uy - M.Y();
+			return dx*dx + dy*dy;
+			}
+
+
 	};
 
 
@@ -257,6 +323,30 @@ namespace mtools
 			}
 
 
+		/**
+		* Return the times of intersection with the four lines bounding B (see Bezier::intersect_boxlines()).
+		**/
+		virtual void intersect_boxlines(fBox2 B, double(&r)[4][3]) const override
+			{
+			const double z[4] = { B.min[0], B.max[0], B.min[1], B.max[1] };
+			double a[4], b[4], c[4], r1[4] = { -1,-1,-1,-1 }, r2[4] = { -1,-1,-1,-1 };
+			for (int l = 0; l < 4; l++)
+				{
+				const int i = (l >> 1);
+				a[l] = P0[i] - 2 * P1[i] + P2[i];
+				b[l] = 2 * (P1[i] - P0[i]);
+				c[l] = P0[i] - z[l];
+				}
+			mtools::gsl_poly_solve_quadratic(a, b, c, 4, nullptr, r1, r2);
+			for (int l = 0; l < 4; l++)
+				{
+				r[l][0] = ((r1[l] >= 1) ? -1 : r1[l]);
+				r[l][1] = ((r2[l] >= 1) ? -1 : r2[l]);
+				r[l][2] = -1;
+				}
+			}
+
+
 		/**
 		* Return the point where the curve has an horizontal tangent.
 		* (return <0 if none).
@@ -283,6 +373,17 @@ namespace mtools
 			}
 
 
+		/**
+		 * Flatten the curve into a polyline within distance tol of the curve. Uniform subdivision with
+		 * the number of segments given by Wang's formula n = sqrt(|P0 - 2P1 + P2| / (4 tol)).
+		 **/
+		virtual void flatten(double tol, std::vector<fVec2> & out) const override
+			{
+			const double M = (P0 - 2.0 * P1 + P2).norm();
+			_flattenUniform((int64)ceil(sqrt(M / (4 * tol))), out);
+			}
+
+
 		/**
 		* Split the curve in two: 
 		* - first curve [0,T]  
@@ -438,6 +539,31 @@ namespace mtools
 			}
 
 
+		/**
+		* Return the times of intersection with the four lines bounding B (see Bezier::intersect_boxlines()).
+		**/
+		virtual void intersect_boxlines(fBox2 B, double(&r)[4][3]) const override
+			{
+			const double z[4] = { B.min[0], B.max[0], B.min[1], B.max[1] };
+			double a[4], b[4], c[4], r1[4] = { -1,-1,-1,-1 }, r2[4] = { -1,-1,-1,-1 };
+			for (int l = 0; l < 4; l++)
+				{
+				const int i = (l >> 1);
+				const double x0 = P0[i], x1 = P1[i], x2 = P2[i];
+				a[l] = x0 * w0 - 2 * x1*w1 + x2 * w2 - z[l] * (w0 - 2 * w1 + w2);
+				b[l] = -2 * x0*w0 + 2 * x1*w1 - z[l] * (-2 * w0 + 2 * w1);
+				c[l] = x0 * w0 - z[l] * w0;
+				}
+			mtools::gsl_poly_solve_quadratic(a, b, c, 4, nullptr, r1, r2);
+			for (int l = 0; l < 4; l++)
+				{
+				r[l][0] = ((r1[l] >= 1) ? -1 : r1[l]);
+				r[l][1] = ((r2[l] >= 1) ? -1 : r2[l]);
+				r[l][2] = -1;
+				}
+			}
+
+
 		/**
 		* Return the point where the curve has an horizontal tangent.
 		* (return <0 if none).
@@ -606,6 +732,31 @@ namespace mtools
 			}
 
 
+		/**
+		* Return the times of intersection with the four lines bounding B (see Bezier::intersect_boxlines()).
+		**/
+		virtual void intersect_boxlines(fBox2 B, double(&r)[4][3]) const override
+			{
+			const double z[4] = { B.min[0], B.max[0], B.min[1], B.max[1] };
+			double a[4], b[4], c[4], d[4], r1[4] = { -1,-1,-1,-1 }, r2[4] = { -1,-1,-1,-1 }, r3[4] = { -1,-1,-1,-1 };
+			for (int l = 0; l < 4; l++)
+				{
+				const int i = (l >> 1);
+				a[l] = P3[i] + 3 * (P1[i] - P2[i]) - P0[i];
+				b[l] = 3 * (P0[i] - 2 * P1[i] + P2[i]);
+				c[l] = 3 * (P1[i] - P0[i]);
+				d[l] = P0[i] - z[l];
+				}
+			mtools::gsl_poly_solve_cubic(a, b, c, d, 4, nullptr, r1, r2, r3);
+			for (int l = 0; l < 4; l++)
+				{
+				r[l][0] = ((r1[l] >= 1) ? -1 : r1[l]);
+				r[l][1] = ((r2[l] >= 1) ? -1 : r2[l]);
+				r[l][2] = ((r3[l] >= 1) ? -1 : r3[l]);
+				}
+			}
+
+
 		/**
 		* Return the point where the curve has an horizontal tangent.
 		* (return <0 if none).
@@ -634,6 +785,17 @@ namespace mtools
 			}
 
 
+		/**
+		 * Flatten the curve into a polyline within distance tol of the curve. Uniform subdivision with
+		 * the number of segments given by Wang's formula n = sqrt(3 max(|P0 - 2P1 + P2|, |P1 - 2P2 + P3|) / (4 tol)).
+		 **/
+		virtual void flatten(double tol, std::vector<fVec2> & out) const override
+			{
+			const double M = std::max<double>((P0 - 2.0 * P1 + P2).norm(), (P1 - 2.0 * P2 + P3).norm());
+			_flattenUniform((int64)ceil(sqrt(3 * M / (4 * tol))), out);
+			}
+
+
 		/**
 		* Split the curve in two: 
 		* - first curve [0,T]  
@@ -729,6 +891,69 @@ namespace mtools
 
 
 
+	/**
+	 * Cache for the flattening of a Bezier curve that is drawn repeatedly.
+	 * 
+	 * The tolerance is rounded down to a power of two (the 'zoom bucket'): the polyline is only
+	 * recomputed when the bucket changes or when another curve is passed. Call invalidate() after
+	 * modifying the curve in place.
+	 * 
+	 * @code
+	 * BezierCubic C(P0, P1, P2, P3);
+	 * BezierFlattening F;
+	 * im.canvas_draw_bezier(R, C, F, RGBc::c_Red, true, true); // the polyline is reused while the zoom stays in the same bucket
+	 * @endcode
+	 **/
+	class BezierFlattening
+		{
+
+		public:
+
+			/** Constructor. The cache is empty. */
+			BezierFlattening() : _curve(nullptr), _bucket(0), _valid(false) {}
+
+
+			/**
+			 * Return the polyline for a given curve at a tolerance at most tol (recomputed only if
+			 * needed). The reference is valid until the next call.
+			 **/
+			const std::vector<fVec2> & get(const Bezier & curve, double tol)
+				{
+				MTOOLS_ASSERT(tol > 0);
+				const int b = bucket(tol);
+				if ((!_valid) || (b != _bucket) || (&curve != _curve))
+					{
+					curve.flatten(ldexp(1.0, b - 1), _tab);
+					_curve = &curve;
+					_bucket = b;
+					_valid = true;
+					}
+				return _tab;
+				}
+
+
+			/** Discard the cached polyline. */
+			void invalidate() { _valid = false; }
+
+
+			/** Query if the cache currently holds a polyline. */
+			bool valid() const { return _valid; }
+
+
+			/** The zoom bucket of a tolerance: the integer b such that 2^(b-1) <= tol < 2^b. */
+			static int bucket(double tol) { int e; frexp(tol, &e); return e; }
+
+		private:
+
+			const Bezier * _curve;
+			int _bucket;
+			bool _valid;
+			std::vector<fVec2> _tab;
+		};
+
+
+
+
 
 
 
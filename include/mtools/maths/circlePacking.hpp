@@ -28,6 +28,7 @@
 #include "../misc/error.hpp"
 #include "../misc/timefct.hpp"
 #include "../io/logfile.hpp"
+#include "../io/serialization.hpp"
 #include "../io/console.hpp"
 #include "vec.hpp"
 #include "box.hpp"
@@ -38,9 +39,19 @@
 #include "../random/gen_fastRNG.hpp"
 #include "../random/classiclaws.hpp"
 
+#include "../misc/internal/threadworker.hpp"
 #include "../extensions/openCL.hpp" // openCL extension
 #include "internal/circlePacking.cl.hpp"	    // the openCL program source.
 
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <limits>
+#include <queue>
+#include <atomic>
+#include <unordered_map>
+
 
 
 
@@ -86,6 +97,23 @@ namespace mtools
 		{
 
 
+		static const char * const BINARY_MAGIC = "mtools_circlepacking";	// magic string of the binary format
+		static const uint32 BINARY_VERSION = 1;							// version of the binary format
+		static const size_t BINARY_BLOCK = 65536;						// number of values written/read at once
+
+
+		/* read and check the header of a binary circle packing file */
+		template<typename FPTYPE, typename ARCHIVE> void readBinaryHeader(ARCHIVE & ar, uint64 & nbvertices, uint64 & nbedges)
+			{
+			std::string magic; uint32 version, fpsize;
+			ar & magic & version & fpsize & nbvertices & nbedges;
+			if (magic != std::string(BINARY_MAGIC)) { MTOOLS_ERROR("Not a binary circle packing file."); }
+			MTOOLS_INSURE(version == BINARY_VERSION);
+			if (fpsize != (uint32)sizeof(FPTYPE)) { MTOOLS_ERROR("Binary circle packing saved with a different floating point type."); }
+			MTOOLS_INSURE((nbvertices > 0) && (nbvertices <= (uint64)std::numeric_limits<int32>::max()));
+			}
+
+
 		/** Compute the angle between the two circles of radius y and z that surround the circle of radius x **/
 		template<typename FPTYPE> FPTYPE angleEuclidian(const FPTYPE & rx, const  FPTYPE & ry, const  FPTYPE & rz)
 			{
@@ -166,6 +194,266 @@ namespace mtools
 			}
 
 
+		/** Compute the angle at the circle of s-radius x between the two circles of s-radii y and z (s = exp(-h), 0 for an horocycle) **/
+		template<typename FPTYPE> inline FPTYPE angleHyperbolic(const FPTYPE x, const FPTYPE y, const FPTYPE z)
+			{
+			const FPTYPE my = (y > 0) ? (1 - y) / (1 - x * y) : (FPTYPE)1;
+			const FPTYPE mz = (z > 0) ? (1 - z) / (1 - x * z) : (FPTYPE)1;
+			FPTYPE r = 1 - 2 * x * my * mz;
+			if (r < (FPTYPE)(-1.0)) r = (FPTYPE)(-1.0); else if (r > (FPTYPE)1.0) r = (FPTYPE)1.0;
+			return acos(r);
+			}
+
+
+		/* compute the sum of the angle around a given vertex (s-radii) */
+		template<typename FPTYPE, typename GRAPH> FPTYPE angleSumHyperbolic(const int index, const GRAPH & gr, const std::vector<FPTYPE> & rad)
+			{
+			FPTYPE theta = 0.0;
+			if (gr[index].size() < 2) return theta;
+			const FPTYPE v = rad[index];
+			auto it = gr[index].begin();
+			const FPTYPE firstR = rad[*it];
+			FPTYPE prevR = firstR;
+			it++;
+			FPTYPE C = 0.0;
+			for (; it != gr[index].end(); ++it) // use Kahan summation algorithm
+				{
+				FPTYPE nextR = rad[*it];
+				FPTYPE Y = angleHyperbolic(v, prevR, nextR) - C;
+				FPTYPE T = theta + Y;
+				C = (T - theta) - Y;
+				theta = T;
+				prevR = nextR;
+				}
+			theta += (angleHyperbolic(v, prevR, firstR) - C);
+			return theta;
+			}
+
+
+		/** Compute the L2 error for the hyperbolic angle sum for all vertices on the range [0,N-1] **/
+		template<typename FPTYPE, typename GRAPH> FPTYPE errorL2hyperbolic(const GRAPH & gr, const std::vector<FPTYPE> & rad, const int N)
+			{
+			const FPTYPE twopi = (2 * acos((FPTYPE)-1));
+			FPTYPE e = (FPTYPE)0;
+			FPTYPE C = (FPTYPE)0;
+			for (int i = 0; i < N; ++i) // use Kahan summation algorithm
+				{
+				if (gr[i].size() > 1)
+					{
+					const FPTYPE a = (angleSumHyperbolic(i, gr, rad) - twopi);
+					FPTYPE Y = (a*a) - C;
+					FPTYPE T = e + Y;
+					C = (T - e) - Y;
+					e = T;
+					}
+				}
+			return sqrt(e);
+			}
+
+
+		/** Compute the L1 error for the hyperbolic angle sum for all vertices on the range [0,N-1] **/
+		template<typename FPTYPE, typename GRAPH> FPTYPE errorL1hyperbolic(const GRAPH & gr, const std::vector<FPTYPE> & rad, const int N)
+			{
+			const FPTYPE twopi = 2 * acos((FPTYPE)-1);
+			FPTYPE e = (FPTYPE)0;
+			FPTYPE C = (FPTYPE)0;
+			for (int i = 0; i < N; ++i) // use Kahan summation algorithm
+				{
+				if (gr[i].size() > 1)
+					{
+					const FPTYPE a = (angleSumHyperbolic(i, gr, rad) - twopi);
+					FPTYPE Y = ((a > (FPTYPE)0) ? a : -a) - C;
+					FPTYPE T = e + Y;
+					C = (T - e) - Y;
+					e = T;
+					}
+				}
+			return e;
+			}
+
+
+		/** Same as angleSumEuclidian() but for a graph in CSR format **/
+		template<typename FPTYPE> FPTYPE angleSumEuclidianCSR(const int index, const CSRGraph & gr, const std::vector<FPTYPE> & rad)
+			{
+			FPTYPE theta = 0.0;
+			const auto nl = gr[index];
+			const int l = (int)nl.size();
+			if (l < 2) return theta;
+			const FPTYPE v = rad[index];
+			const FPTYPE firstR = rad[nl[0]];
+			FPTYPE prevR = firstR;
+			FPTYPE C = 0.0;
+			for (int k = 1; k < l; k++) // use Kahan summation algorithm
+				{
+				const FPTYPE nextR = rad[nl[k]];
+				FPTYPE Y = angleEuclidian(v, prevR, nextR) - C;
+				FPTYPE T = theta + Y;
+				C = (T - theta) - Y;
+				theta = T;
+				prevR = nextR;
+				}
+			theta += (angleEuclidian(v, prevR, firstR) - C);
+			return theta;
+			}
+
+
+		/**
+		 * Greedy colouring of the vertices [0,N-1] of a graph (the other vertices are ignored) such
+		 * that two adjacent vertices never have the same colour. The vertices are visited by decreasing
+		 * degree. On return, the vertices of colour c are classList[classOff[c]], ...,
+		 * classList[classOff[c+1]-1], sorted by increasing index.
+		 **/
+		inline void greedyColouring(const CSRGraph & gr, const int N, std::vector<int32> & classOff, std::vector<int32> & classList)
+			{
+			std::vector<int32> order(N), col(N, -1);
+			for (int i = 0; i < N; i++) { order[i] = i; }
+			std::stable_sort(order.begin(), order.end(), [&](int32 x, int32 y) { return gr.degree(x) > gr.degree(y); });
+			int32 nbcol = 0;
+			std::vector<int32> mark;	// mark[c] = i if colour c is used by a neighbour of the current vertex i
+			for (int u = 0; u < N; u++)
+				{
+				const int32 i = order[u];
+				for (const int j : gr[i])
+					{
+					if ((j < N) && (col[j] >= 0)) { mark[col[j]] = i; }
+					}
+				int32 c = 0;
+				while ((c < nbcol) && (mark[c] == i)) { c++; }
+				if (c == nbcol) { nbcol++; mark.push_back(-1); }
+				col[i] = c;
+				}
+			classOff.assign(nbcol + 1, 0);
+			for (int i = 0; i < N; i++) { classOff[col[i] + 1]++; }
+			for (int32 c = 0; c < nbcol; c++) { classOff[c + 1] += classOff[c]; }
+			classList.resize(N);
+			std::vector<int32> pos(classOff.begin(), classOff.end() - 1);
+			for (int i = 0; i < N; i++) { classList[pos[col[i]]++] = i; }
+			}
+
+
+		/** Simple reusable barrier for a fixed number of threads **/
+		class Barrier
+			{
+			public:
+
+			Barrier(int nb) : _nb(nb), _count(0), _gen(0) {}
+
+			/* wait until all the threads reach the barrier */
+			void wait()
+				{
+				std::unique_lock<std::mutex> lock(_mut);
+				const int64 g = _gen;
+				if (++_count == _nb) { _count = 0; _gen++; _cv.notify_all(); return; }
+				_cv.wait(lock, [&] { return (_gen != g); });
+				}
+
+			private:
+
+			std::mutex _mut;
+			std::condition_variable _cv;
+			const int _nb;
+			int _count;
+			int64 _gen;
+			};
+
+
+		/**
+		 * Coarsen a triangulation with boundary by collapsing a set of edges between interior vertices.
+		 *
+		 * An edge (u,v) is collapsed (v is merged into u) only if the result is still a triangulation:
+		 * u and v have exactly two common neighbours (the apex of the two adjacent faces) and these
+		 * two vertices have degree at least 4. Edges with an endpoint adjacent to the boundary are
+		 * not collapsed so that the neighbourhood of the boundary vertices is unchanged (their radii
+		 * are prescribed at the fine scale). After each collapse, the neighbourhoods of u and v are
+		 * locked so that the collapses performed during a same call do not interact. The orientation
+		 * of the neighbour lists is preserved.
+		 *
+		 * @param	gr		  	The triangulation. The interior vertices are 0,...,nb-1.
+		 * @param	nb		  	Number of interior vertices.
+		 * @param [out]	cgr	The coarse triangulation. Its interior vertices are 0,...,cnb-1.
+		 * @param [out]	cnb	Number of interior vertices of the coarse triangulation.
+		 * @param [out]	map	map[i] = index of the vertex of cgr containing vertex i of gr.
+		 *
+		 * @return	The number of edges collapsed.
+		 **/
+		inline int coarsenTriangulation(const std::vector<std::vector<int> > & gr, const int nb, std::vector<std::vector<int> > & cgr, int & cnb, std::vector<int> & map)
+			{
+			const int l = (int)gr.size();
+			std::vector<std::vector<int> > G = gr;
+			std::vector<int> rep(l);			// rep[i] = vertex i was merged into
+			std::vector<char> lock(l, 0);		// 1 = neighbourhood already modified
+			for (int i = 0; i < l; i++) { rep[i] = i; }
+			auto pos = [&](const std::vector<int> & L, int x) -> int { for (int k = 0; k < (int)L.size(); k++) { if (L[k] == x) return k; } return -1; };
+			int nbcoll = 0;
+			for (int u = 0; u < nb; u++)
+				{
+				if (lock[u]) continue;
+				const std::vector<int> & Lu = G[u];
+				const int du = (int)Lu.size();
+				for (int p = 0; p < du; p++)
+					{
+					const int v = Lu[p];
+					if ((v >= nb) || (lock[v])) continue;
+					const std::vector<int> & Lv = G[v];
+					const int dv = (int)Lv.size();
+					if (du + dv - 4 < 3) continue;
+					const int x1 = Lu[(p + 1) % du], xk = Lu[(p + du - 1) % du];	// apex of the two faces adjacent to (u,v)
+					const int q = pos(Lv, u);
+					if ((q < 0) || (Lv[(q + dv - 1) % dv] != x1) || (Lv[(q + 1) % dv] != xk)) continue; // not consistently oriented
+					if ((G[x1].size() < 4) || (G[xk].size() < 4)) continue;
+					bool nearbound = false;
+					for (int a : Lu) { if (a >= nb) nearbound = true; }
+					for (int a : Lv) { if (a >= nb) nearbound = true; }
+					if (nearbound) continue;
+					int nbcommon = 0;
+					for (int a : Lu) { if (pos(Lv, a) >= 0) nbcommon++; }
+					if (nbcommon != 2) continue;
+					// v is merged into u: new neighbourhood x1,...,xk,y2,...,y_{m-1} with y1 = xk and ym = x1
+					std::vector<int> L;
+					for (int k = 1; k < du; k++) { L.push_back(Lu[(p + k) % du]); }
+					for (int k = 2; k < dv - 1; k++) { L.push_back(Lv[(q + k) % dv]); }
+					for (int k = 2; k < dv - 1; k++) { auto & Ly = G[Lv[(q + k) % dv]]; Ly[pos(Ly, v)] = u; }
+					G[x1].erase(G[x1].begin() + pos(G[x1], v));
+					G[xk].erase(G[xk].begin() + pos(G[xk], v));
+					for (int a : L) { lock[a] = 1; }
+					for (int a : Lv) { lock[a] = 1; }
+					lock[u] = 1; lock[v] = 1;
+					G[v].clear();
+					G[u].swap(L);
+					rep[v] = u;
+					nbcoll++;
+					break;
+					}
+				}
+			// renumber the remaining vertices (keeping their order so that interior vertices come first)
+			std::vector<int> newindex(l, -1);
+			int n = 0;
+			cnb = 0;
+			for (int i = 0; i < l; i++) { if (rep[i] == i) { newindex[i] = n++; if (i < nb) cnb++; } }
+			cgr.assign(n, std::vector<int>());
+			for (int i = 0; i < l; i++)
+				{
+				if (rep[i] == i) { cgr[newindex[i]].reserve(G[i].size()); for (int a : G[i]) { cgr[newindex[i]].push_back(newindex[a]); } }
+				}
+			map.resize(l);
+			for (int i = 0; i < l; i++) { map[i] = newindex[rep[i]]; }
+			return nbcoll;
+			}
+
+
+		/**
+		 * Sort permutation for the vertices of a graph: by increasing key first and then according to
+		 * the reverse Cuthill-McKee ordering of the graph (to improve memory locality).
+		 **/
+		template<typename GRAPH, typename KEY> Permutation reorderPermutation(const GRAPH & graph, const std::vector<KEY> & key)
+			{
+			const Permutation P = reverseCuthillMcKeePermutation(graph);
+			std::vector<std::pair<KEY, int> > lab(key.size());
+			for (size_t i = 0; i < key.size(); i++) { lab[i] = std::pair<KEY, int>(key[i], P.inv(i)); }
+			return Permutation(lab);
+			}
+
+
 		/**
 		* Perform an exploration of the graph that can be used for the layout of the circles.
 		*
@@ -471,6 +759,229 @@ namespace mtools
 
 
 
+	/**
+	 * Saves a circle packing into a compact binary file.
+	 *
+	 * Much faster and smaller than the text .p format of saveCirclePacking() for large packings.
+	 * The file is an OBinaryFileArchive containing, after a small header (magic string, format
+	 * version, sizeof(FPTYPE), number of vertices and of oriented edges):
+	 * - the CSR adjacency: offsets (uint64, nbVertices + 1 values) then neighbours (int32),
+	 * - the boundary vector (int32),
+	 * - the radii (FPTYPE),
+	 * - the centers (FPTYPE, real and imaginary parts interleaved).
+	 *
+	 * The tables are written by blocks while traversing the graph so no copy of the packing is
+	 * made. Compression is chosen with the extension of the filename (".gz", ".zst", ".lz4", cf.
+	 * OFileArchive). Uncompressed files can be mapped in memory with CirclePackingMappedFile.
+	 *
+	 * @param	filename	name of the file.
+	 * @param	graph   	the graph.
+	 * @param	boundary	The boundary vector: any vertex boundary[v] > 0 belongs to the exterior face.
+	 * @param	circles 	The circles.
+	 * @param	codec   	The codec to use (OFileArchive::CODEC_AUTO to choose it from the extension).
+	 * @param	level   	The compression level (negative for the default level of the codec).
+	 **/
+	template<typename FPTYPE, typename GRAPH> void saveCirclePackingBinary(const std::string & filename, const GRAPH & graph, const std::vector<int> & boundary, const std::vector<Circle<FPTYPE> > & circles, int codec = OFileArchive::CODEC_AUTO, int level = -1)
+		{
+		const size_t l = graph.size();
+		MTOOLS_INSURE((l > 0) && (boundary.size() == l) && (circles.size() == l));
+		const size_t BLOCK = internals_circlepacking::BINARY_BLOCK;
+		uint64 nbedges = 0;
+		for (size_t i = 0; i < l; i++) { nbedges += (uint64)graph[i].size(); }
+		OBinaryFileArchive ar(filename, codec, level);
+		const std::string magic(internals_circlepacking::BINARY_MAGIC);
+		const uint32 version = internals_circlepacking::BINARY_VERSION;
+		const uint32 fpsize = (uint32)sizeof(FPTYPE);
+		const uint64 nbvertices = (uint64)l;
+		ar & magic & version & fpsize & nbvertices & nbedges;
+		std::vector<uint64> off; off.reserve(BLOCK + 1);
+		uint64 acc = 0;
+		off.push_back(acc);
+		for (size_t i = 0; i < l; i++)
+			{
+			acc += (uint64)graph[i].size(); off.push_back(acc);
+			if (off.size() >= BLOCK) { ar.array(off.data(), off.size()); off.clear(); }
+			}
+		ar.array(off.data(), off.size());
+		std::vector<int32> nei; nei.reserve(BLOCK);
+		for (size_t i = 0; i < l; i++)
+			{
+			for (auto it = graph[i].begin(); it != graph[i].end(); ++it) { nei.push_back((int32)(*it)); }
+			if (nei.size() >= BLOCK) { ar.array(nei.data(), nei.size()); nei.clear(); }
+			}
+		ar.array(nei.data(), nei.size());
+		ar.array(boundary.data(), l);
+		std::vector<FPTYPE> buf; buf.reserve(2*BLOCK);
+		for (size_t i = 0; i < l; i++)
+			{
+			buf.push_back(circles[i].radius);
+			if (buf.size() >= BLOCK) { ar.array(buf.data(), buf.size()); buf.clear(); }
+			}
+		ar.array(buf.data(), buf.size()); buf.clear();
+		for (size_t i = 0; i < l; i++)
+			{
+			buf.push_back(circles[i].center.real()); buf.push_back(circles[i].center.imag());
+			if (buf.size() >= 2*BLOCK) { ar.array(buf.data(), buf.size()); buf.clear(); }
+			}
+		ar.array(buf.data(), buf.size());
+		}
+
+
+	/**
+	 * Load a circle packing saved with saveCirclePackingBinary(). Compressed files are supported.
+	 *
+	 * @param	filename	name of the file.
+	 * @param	graph   	the graph (a vector of neighbour lists).
+	 * @param	boundary	The boundary vector.
+	 * @param	circles 	The circles.
+	 **/
+	template<typename FPTYPE, typename GRAPH> void loadCirclePackingBinary(const std::string & filename, GRAPH & graph, std::vector<int> & boundary, std::vector<Circle<FPTYPE> > & circles)
+		{
+		IBinaryFileArchive ar(filename);
+		uint64 nbvertices, nbedges;
+		internals_circlepacking::readBinaryHeader<FPTYPE>(ar, nbvertices, nbedges);
+		const size_t l = (size_t)nbvertices;
+		const size_t BLOCK = internals_circlepacking::BINARY_BLOCK;
+		std::vector<uint64> off(l + 1);
+		ar.array(off.data(), l + 1);
+		MTOOLS_INSURE((off[0] == 0) && (off[l] == nbedges));
+		graph.clear(); graph.resize(l);
+		std::vector<int32> nei;
+		size_t i = 0;
+		uint64 pos = 0;
+		while (pos < nbedges)
+			{
+			const size_t len = (size_t)std::min<uint64>(BLOCK, nbedges - pos);
+			nei.resize(len);
+			ar.array(nei.data(), len);
+			for (size_t k = 0; k < len; k++, pos++)
+				{
+				while (off[i + 1] <= pos) { i++; }
+				MTOOLS_INSURE((nei[k] >= 0) && ((uint64)nei[k] < nbvertices));
+				graph[i].push_back(nei[k]);
+				}
+			}
+		boundary.resize(l);
+		ar.array(boundary.data(), l);
+		circles.resize(l);
+		std::vector<FPTYPE> buf;
+		for (size_t a = 0; a < l; a += BLOCK)
+			{
+			const size_t len = std::min<size_t>(BLOCK, l - a);
+			buf.resize(len);
+			ar.array(buf.data(), len);
+			for (size_t k = 0; k < len; k++) { circles[a + k].radius = buf[k]; }
+			}
+		for (size_t a = 0; a < l; a += BLOCK)
+			{
+			const size_t len = std::min<size_t>(BLOCK, l - a);
+			buf.resize(2*len);
+			ar.array(buf.data(), 2*len);
+			for (size_t k = 0; k < len; k++) { circles[a + k].center = mtools::complex<FPTYPE>(buf[2*k], buf[2*k + 1]); }
+			}
+		}
+
+
+	/**
+	 * Read-only view on a circle packing file created by saveCirclePackingBinary().
+	 *
+	 * The file is memory mapped (with IMappedArchive) and the tables are used in place without any
+	 * copy nor parsing so even huge packings are 'loaded' instantly and the pages are only read
+	 * when accessed. The file must not be compressed and must have been saved with the same
+	 * FPTYPE. The object can be given directly to the drawCirclePacking_* functions.
+	 *
+	 * @code{.cpp}
+	 * CirclePackingMappedFile<double> CP("packing.cpb");
+	 * drawCirclePacking_Circles(img, R, CP, false, RGBc::c_Red);
+	 * @endcode
+	 **/
+	template<typename FPTYPE> class CirclePackingMappedFile
+		{
+
+		public:
+
+			/** Constructor. Map the file (throws if it cannot be mapped). */
+			CirclePackingMappedFile(const std::string & filename) : _ar(filename)
+				{
+				internals_circlepacking::readBinaryHeader<FPTYPE>(_ar, _nbv, _nbe);
+				const size_t l = (size_t)_nbv;
+				_off = _ar.template arrayView<uint64>(l + 1);
+				_nei = _ar.template arrayView<int32>((size_t)_nbe);
+				_bound = _ar.template arrayView<int32>(l);
+				_rad = _ar.template arrayView<FPTYPE>(l);
+				_cent = _ar.template arrayView<FPTYPE>(2*l);
+				MTOOLS_INSURE((_off[0] == 0) && (_off[l] == _nbe));
+				}
+
+			/** Number of vertices. */
+			size_t size() const { return (size_t)_nbv; }
+
+			/** Number of oriented edges (sum of the degrees). */
+			size_t nbEdges() const { return (size_t)_nbe; }
+
+			/** Degree of vertex i. */
+			size_t degree(size_t i) const { return (size_t)(_off[i + 1] - _off[i]); }
+
+			/** Pointer to the neighbours of vertex i (degree(i) values). */
+			const int32 * neighbours(size_t i) const { return _nei + _off[i]; }
+
+			/** Query if vertex i is on the boundary. */
+			bool isBoundary(size_t i) const { return (_bound[i] > 0); }
+
+			/** Radius of the circle around vertex i. */
+			FPTYPE radius(size_t i) const { return _rad[i]; }
+
+			/** Center of the circle around vertex i. */
+			mtools::complex<FPTYPE> center(size_t i) const { return mtools::complex<FPTYPE>(_cent[2*i], _cent[2*i + 1]); }
+
+			/** Circle around vertex i. */
+			Circle<FPTYPE> circle(size_t i) const { return Circle<FPTYPE>(center(i), radius(i)); }
+
+			/** CSR offsets (size() + 1 values). */
+			const uint64 * offsets() const { return _off; }
+
+			/** Boundary table (size() values). */
+			const int32 * boundary() const { return _bound; }
+
+			/** Radii table (size() values). */
+			const FPTYPE * radii() const { return _rad; }
+
+			/** Centers table (2*size() values, real and imaginary parts interleaved). */
+			const FPTYPE * centers() const { return _cent; }
+
+			/** Copy the graph into a vector of neighbour lists. */
+			std::vector<std::vector<int> > graph() const
+				{
+				std::vector<std::vector<int> > gr(size());
+				for (size_t i = 0; i < size(); i++) { gr[i].assign(neighbours(i), neighbours(i) + degree(i)); }
+				return gr;
+				}
+
+			/** Copy the circles into a vector. */
+			std::vector<Circle<FPTYPE> > circles() const
+				{
+				std::vector<Circle<FPTYPE> > C(size());
+				for (size_t i = 0; i < size(); i++) { C[i] = circle(i); }
+				return C;
+				}
+
+		private:
+
+			CirclePackingMappedFile(const CirclePackingMappedFile &) = delete;
+			CirclePackingMappedFile & operator=(const CirclePackingMappedFile &) = delete;
+
+			IMappedArchive	_ar;		// the mapped archive
+			uint64			_nbv;		// number of vertices
+			uint64			_nbe;		// number of oriented edges
+			const uint64 *	_off;		// CSR offsets
+			const int32 *	_nei;		// CSR neighbours
+			const int32 *	_bound;		// boundary
+			const FPTYPE *	_rad;		// radii
+			const FPTYPE *	_cent;		// centers (interleaved)
+		};
+
+
+
 
 	/**
 	 * Convert distance from the origin from euclidian to hyperbolic
@@ -542,80 +1053,314 @@ namespace mtools
 		}
 
 
-
-	/**
-	 * 
-	 *  ********************
-	 *  INCOMPLET : NE PLACE PAS TOUT LES RADII. (MANQUE CEUX QUI SONT SEPARE DU SITE CENTRAL PAR DES CERCLE FRONTIERE).
-	 *  ********************
-	 * 
-	 * Compute the layout for an hyperbolic packing label (i.e when the radius are given in term of the hyperbolic
-	 * metric instead of the euclidian one).
-	 *
-	 * @param	graph	   	The graph.
-	 * @param	boundary   	The boundary. Any vertex v with boundary[v] > 0 is on the exterior face.
-	 * @param	srad	   	The vector of hyperbolic radii given in s-radii format:  s = exp(-h) where h is the real 
-	 * 						hyperbolic radius. Thus, s = 0 for infinite radius and s = 1 for null radius
-	 * @param	strictMaths	true to raise an error if FPTYPE does not allows sufficient precision for layout. Otherwise, 
-	 * 						the algorithm does its best but circles may end up overlapping. 
-	 * @param	v0		   	Index of the start vertex to lay out at the origin of the disk or -1 to choose an arbirary one. 
-	 *
-	 * @return	The positions of the circles for the packing label. This yields a packing inside the unit disk. 
-	 */
-	template<typename FPTYPE, typename GRAPH> std::vector<Circle<FPTYPE> > computeCirclePackLayoutHyperbolic(const GRAPH & graph, const std::vector<int> & boundary, const std::vector<FPTYPE> & srad, bool strictMaths = false, int v0 = -1)
+	namespace internals_circlepacking
 		{
-		MTOOLS_INSURE(graph.size() == srad.size());
-		MTOOLS_INSURE(graph.size() == boundary.size());
-		if (v0 < 0) { for (size_t i = 0; i < boundary.size(); i++) { if (boundary[i] <= 0) { v0 = (int)i; break; } } }
-		MTOOLS_INSURE(boundary[v0] <= 0);
-		std::vector<Circle<FPTYPE> > circle(srad.size());		
-		circle[v0] = Circle<FPTYPE>(complex<FPTYPE>((FPTYPE)0, (FPTYPE)0), distStoR(srad[v0]));  // lay the circle at the origin		
-		int v1 = graph[v0].front();												//
-		circle[v1].radius = tangentCircleStoR(circle[v0].radius, srad[v1]);		// lay v1 on the right of v0.
-		circle[v1].center = circle[v0].radius + circle[v1].radius;				// 
 
-		auto laidvec = internals_circlepacking::layoutExplorer(graph, v0, v1, (boundary[v1] <= 0), [&](int ix, int iy, int iz)->bool
+
+		/**
+		 * Lay out the circle C(z) of radius rz tangent to C(x) and C(y), such that (x,y,z) is
+		 * positively oriented (euclidian case). Used by computeCirclePackLayout().
+		 **/
+		template<typename FPTYPE> Circle<FPTYPE> layoutCircleEuclidian(const Circle<FPTYPE> & Cx, const Circle<FPTYPE> & Cy, const FPTYPE rz, const bool strictMaths, const int ix, const int iy, const int iz)
+			{
+			const FPTYPE & rx = Cx.radius; if ((strictMaths) && ((rx == (FPTYPE)0.0) || (std::isnan(rx)))) { MTOOLS_ERROR(std::string("Precision error A. null radius (site ") + mtools::toString(ix) + ")"); }
+			const FPTYPE & ry = Cy.radius; if ((strictMaths) && ((ry == (FPTYPE)0.0) || (std::isnan(ry)))) { MTOOLS_ERROR(std::string("Precision error B. null radius (site ") + mtools::toString(iy) + ")"); }
+			if ((strictMaths) && ((rz == (FPTYPE)0.0) || (std::isnan(rz)))) { MTOOLS_ERROR(std::string("Precision error C. null radius (site ") + mtools::toString(iz) + ")"); }
+			const FPTYPE & alpha = angleEuclidian(rx, ry, rz);
+			if ((strictMaths) && (std::isnan(alpha))) { MTOOLS_ERROR(std::string("Precision error D. null alpha (site ") + mtools::toString(iz) + ")"); }
+			auto w = Cy.center - Cx.center;
+			w = w*complex<FPTYPE>(cos(alpha), sin(alpha));
+			const FPTYPE norm = std::abs(w);
+			if (norm != (FPTYPE)0.0) { w /= norm; w *= (rx + rz); } else { if (strictMaths) { MTOOLS_ERROR(std::string("Precision error E (site ") + mtools::toString(iz) + ")"); } }
+			const Circle<FPTYPE> Cz(Cx.center + w, rz);
+			if ((Cz.center == Cy.center) || (Cz.center == Cx.center)) { if (strictMaths) { MTOOLS_ERROR(std::string("Precision error F (site ") + mtools::toString(iz) + ")"); } }
+			return Cz;
+			}
+
+
+		/**
+		 * Lay out the circle C(z) with s-radius sz tangent to C(x) and C(y), such that (x,y,z) is
+		 * positively oriented (hyperbolic case, the circles are given by their euclidian
+		 * representation in the unit disk). Used by computeCirclePackLayoutHyperbolic().
+		 **/
+		template<typename FPTYPE> Circle<FPTYPE> layoutCircleHyperbolic(const Circle<FPTYPE> & Cx, const Circle<FPTYPE> & Cy, const FPTYPE sx, const FPTYPE sy, const FPTYPE sz, const bool strictMaths, const int ix, const int iy, const int iz)
 			{
-			auto hypcx = circle[ix].euclidianToHyperbolic().center; // hyperbolic center for C(x)
+			auto hypcx = Cx.euclidianToHyperbolic().center; // hyperbolic center for C(x)
 			mtools::Mobius<FPTYPE> M(hypcx); // Mobius transformation that centers the circle C(x) around 0 (M is an involution)
 
-			FPTYPE rx = distStoR(srad[ix]);					// radius of C(x) when it is centered on 0
+			FPTYPE rx = distStoR(sx);					// radius of C(x) when it is centered on 0
 			if ((strictMaths) && ((rx == (FPTYPE)0.0))) { MTOOLS_ERROR(std::string("Precision error A. null radius (site ") + mtools::toString(ix) + ")"); }
 			if ((strictMaths) && ((std::isnan(rx))))    { MTOOLS_ERROR(std::string("Precision error A. NaN (site ") + mtools::toString(ix) + ")"); }
-			FPTYPE ry = tangentCircleStoR(rx, srad[iy]);	// radius of C(y) when C(x) centered on 0
+			FPTYPE ry = tangentCircleStoR(rx, sy);	// radius of C(y) when C(x) centered on 0
 			if ((strictMaths) && ((ry == (FPTYPE)0.0))) { MTOOLS_ERROR(std::string("Precision error B. null radius (site ") + mtools::toString(iy) + ")"); }
 			if ((strictMaths) && ((std::isnan(ry))))    { MTOOLS_ERROR(std::string("Precision error B. NaN (site ") + mtools::toString(iy) + ")"); }
-			FPTYPE rz = tangentCircleStoR(rx, srad[iz]);	// radius of C(z) when C(x) centered on 0
+			FPTYPE rz = tangentCircleStoR(rx, sz);	// radius of C(z) when C(x) centered on 0
 			if ((strictMaths) && ((rz == (FPTYPE)0.0))) { MTOOLS_ERROR(std::string("Precision error C. null radius (site ") + mtools::toString(iz) + ")"); }
 			if ((strictMaths) && ((std::isnan(rz))))    { MTOOLS_ERROR(std::string("Precision error C. NaN (site ") + mtools::toString(iz) + ")"); }
 
-			const FPTYPE & alpha = internals_circlepacking::angleEuclidian(rx, ry, rz); // angle <y,x,z>
-			if ((strictMaths) && (isnan(alpha))) { MTOOLS_ERROR(std::string("Precision error D. null alpha (site ") + mtools::toString(iz) + ")"); }
+			const FPTYPE & alpha = angleEuclidian(rx, ry, rz); // angle <y,x,z>
+			if ((strictMaths) && (std::isnan(alpha))) { MTOOLS_ERROR(std::string("Precision error D. null alpha (site ") + mtools::toString(iz) + ")"); }
 
-			const Circle<FPTYPE> Cy = M*circle[iy];	// position of C(y) after the tranformation M (ie when C(x) is centered at 0)
+			const Circle<FPTYPE> Cyc = M*Cy;	// position of C(y) after the tranformation M (ie when C(x) is centered at 0)
 
-			auto w = (Cy.center)*complex<FPTYPE>(cos(alpha), sin(alpha)); // apply a rotation of angle alpha to the center of C(y)
+			auto w = (Cyc.center)*complex<FPTYPE>(cos(alpha), sin(alpha)); // apply a rotation of angle alpha to the center of C(y)
 			const FPTYPE norm = std::abs(w); // resize the lenght of the vector to be rx + rz.
 			if (norm > (FPTYPE)0.0) { w /= norm; w *= (rx + rz); } else { if (strictMaths) { MTOOLS_ERROR(std::string("Precision error E (site ") + mtools::toString(iz) + ")"); } }
 
 			const Circle<FPTYPE> Cz(w, rz); // position of C(z) when C(x) is centered.
-			circle[iz] = (M*Cz);			// move back to the correct position by applying the inverse tranformation.
+			return (M*Cz);			// move back to the correct position by applying the inverse tranformation.
+			}
 
-			return (boundary[iz] <= 0); // explore also around iz if it is an interior vertex
-			});
-		// done layout out circle adjacent to an interior circle but there may still be some other one to lay out
-		std::queue<int> queue;
-		for (int i = 0; i < laidvec.size(); i++) { if (laidvec[i] == 0) { queue.push(i); } } // push all vertices that are not yet lais. 
 
-		//
-		// TODO : THE FOLLOWING ASSUME THAT THE REMAINING CIRCLES TO LAY OUT ARE HOROCYCLES (IE WE ARE WORKING WITH
-		// A MAXIMAL HYPERBOLIC PACKING
-		// -> adapt to deal with the general case.
-		/*
-		while(queue.size() >0)
+		/**
+		 * Rigid motion (isometry) that maps the circles La and Lb onto Ga and Gb: a similarity of
+		 * ratio 1 in the euclidian case and an automorphism of the unit disk in the hyperbolic case.
+		 * The circles of a and b must have the same radii in both layouts, only their centers are
+		 * used.
+		 **/
+		template<typename FPTYPE> Mobius<FPTYPE> layoutMotion(const Circle<FPTYPE> & La, const Circle<FPTYPE> & Lb, const Circle<FPTYPE> & Ga, const Circle<FPTYPE> & Gb, const bool hyperbolic)
 			{
-			const int iz = queue.front(); queue.pop();
-			for (int k = 0; k < graph[iz].size(); k++)
+			if (!hyperbolic)
+				{
+				complex<FPTYPE> u = (Gb.center - Ga.center) / (Lb.center - La.center);
+				u /= std::abs(u);
+				return Mobius<FPTYPE>(u, Ga.center - u*La.center, complex<FPTYPE>((FPTYPE)0), complex<FPTYPE>((FPTYPE)1));
+				}
+			const Mobius<FPTYPE> M1(La.euclidianToHyperbolic().center);	// moves a to the origin in the local layout (involution)
+			const Mobius<FPTYPE> M2(Ga.euclidianToHyperbolic().center);	// moves a to the origin in the global layout (involution)
+			const complex<FPTYPE> w1 = (M1*Lb).center, w2 = (M2*Gb).center;
+			const complex<FPTYPE> rot = (w2 / std::abs(w2)) / (w1 / std::abs(w1));	// rotation around the origin that aligns b
+			return M2*Mobius<FPTYPE>(rot, complex<FPTYPE>((FPTYPE)0), complex<FPTYPE>((FPTYPE)0), complex<FPTYPE>((FPTYPE)1))*M1;
+			}
+
+
+		/**
+		 * Batched application of a Mobius transformation to the circles list[0..n-1]. In the euclidian
+		 * case the motions are similarities of ratio 1 and the radii rad[] are kept exactly.
+		 **/
+		template<typename FPTYPE> void applyMobius(const Mobius<FPTYPE> & M, std::vector<Circle<FPTYPE> > & circle, const int32 * list, const size_t n, const std::vector<FPTYPE> & rad, const bool hyperbolic)
+			{
+			if (hyperbolic)
+				{ // gather the circles by blocks and use the batch version of the transformation
+				const size_t BLOCK = 256;
+				Circle<FPTYPE> buf[BLOCK];
+				for (size_t i0 = 0; i0 < n; i0 += BLOCK)
+					{
+					const size_t len = std::min<size_t>(BLOCK, n - i0);
+					for (size_t i = 0; i < len; i++) { buf[i] = circle[list[i0 + i]]; }
+					M.apply(buf, buf, len);
+					for (size_t i = 0; i < len; i++) { circle[list[i0 + i]] = buf[i]; }
+					}
+				return;
+				}
+			for (size_t i = 0; i < n; i++) { const int v = list[i]; circle[v].center = M.a*circle[v].center + M.b; circle[v].radius = rad[v]; }
+			}
+
+
+		/**
+		 * Parallel layout of a packing label.
+		 *
+		 * The interior vertices reachable from v0 are split into connected regions of about
+		 * regionSize vertices (grown by BFS). Each region is laid out independently, by a thread,
+		 * from its own anchor (its first vertex at the origin, as done for v0 in the serial layout)
+		 * and with the same exploration as layoutExplorer() restricted to the region: the circles
+		 * of the region and of their neighbours are placed. The regions are then stitched together:
+		 * the first vertex of each region is adjacent to a vertex of a region created before so the
+		 * rigid motion of a region is obtained from the position of this edge in the (already moved)
+		 * parent region. Finally, the motions are applied in parallel.
+		 *
+		 * Since each circle is placed from its region anchor, the error accumulated along the
+		 * layout depends on the size of the regions (and the depth of the tree of regions) instead
+		 * of the size of the whole triangulation.
+		 **/
+		template<typename FPTYPE, typename GRAPH> std::vector<Circle<FPTYPE> > parallelLayout(const GRAPH & graph, const std::vector<int> & boundary, const std::vector<FPTYPE> & rad, const bool hyperbolic, const bool strictMaths, const int v0, int nbThreads, int regionSize)
+			{
+			const int l = (int)graph.size();
+			if (nbThreads <= 0) { nbThreads = (int)nbHardwareThreads(); }
+
+			// BFS from v0 on the interior vertices
+			std::vector<int> father(l, -2);
+			std::vector<int32> order; order.reserve(l);
+			father[v0] = -1; order.push_back(v0);
+			for (size_t h = 0; h < order.size(); h++)
+				{
+				const int v = order[h];
+				for (int w : graph[v]) { if ((boundary[w] <= 0) && (father[w] == -2)) { father[w] = v; order.push_back(w); } }
+				}
+			const int n = (int)order.size();
+			if (regionSize <= 0) { regionSize = std::max<int>(1024, n / (8 * nbThreads)); }
+
+			// split into connected regions, stored contiguously in regList
+			std::vector<int> region(l, -1);
+			std::vector<int32> regOff, regList; regList.reserve(n);
+			for (int h = 0; h < n; h++)
+				{
+				const int s = order[h];
+				if (region[s] >= 0) continue;
+				const int k = (int)regOff.size();
+				const size_t a = regList.size();
+				regOff.push_back((int32)a);
+				region[s] = k; regList.push_back(s);
+				for (size_t u = a; (u < regList.size()) && ((int)(regList.size() - a) < regionSize); u++)
+					{
+					for (int w : graph[regList[u]])
+						{
+						if ((father[w] != -2) && (region[w] < 0) && ((int)(regList.size() - a) < regionSize)) { region[w] = k; regList.push_back(w); }
+						}
+					}
+				}
+			const int nbreg = (int)regOff.size();
+			regOff.push_back((int32)regList.size());
+
+			// local layout of each region
+			std::vector<Circle<FPTYPE> > circle(l);
+			std::vector<std::unordered_map<int, Circle<FPTYPE> > > halo(nbreg);	// circles placed by a region which do not belong to it
+			std::vector<char> done(l, 0);
+			std::atomic<int> next(0);
+			auto worker = [&]()
+				{
+				std::vector<int32> st;
+				int k;
+				while ((k = next++) < nbreg)
+					{
+					auto & H = halo[k];
+					auto isdone = [&](int v) -> bool { return ((region[v] == k) ? (done[v] != 0) : (H.count(v) != 0)); };
+					auto get = [&](int v) -> const Circle<FPTYPE> & { return ((region[v] == k) ? circle[v] : H[v]); };
+					auto set = [&](int v, const Circle<FPTYPE> & C) { if (region[v] == k) { circle[v] = C; done[v] = 1; } else { H[v] = C; } };
+					const int s = regList[regOff[k]];
+					const int s1 = graph[s].front();
+					if (hyperbolic)
+						{
+						const FPTYPE r0 = distStoR(rad[s]), r1 = tangentCircleStoR(r0, rad[s1]);
+						set(s, Circle<FPTYPE>(complex<FPTYPE>((FPTYPE)0, (FPTYPE)0), r0));
+						set(s1, Circle<FPTYPE>(complex<FPTYPE>(r0 + r1, (FPTYPE)0), r1));
+						}
+					else
+						{
+						set(s, Circle<FPTYPE>(complex<FPTYPE>((FPTYPE)0, (FPTYPE)0), rad[s]));
+						set(s1, Circle<FPTYPE>(complex<FPTYPE>(rad[s] + rad[s1], (FPTYPE)0), rad[s1]));
+						}
+					st.clear();
+					st.push_back(s);
+					if (region[s1] == k) st.push_back(s1);
+					for (size_t h = 0; h < st.size(); h++)
+						{ // same exploration as layoutExplorer()
+						const int index = st[h];
+						auto it = graph[index].begin();
+						while (!isdone(*it)) { ++it; }
+						auto sit = it, pit = it; ++it;
+						if (it == graph[index].end()) { it = graph[index].begin(); }
+						while (it != sit)
+							{
+							if (!isdone(*it))
+								{
+								if (hyperbolic) { set(*it, layoutCircleHyperbolic(get(index), get(*pit), rad[index], rad[*pit], rad[*it], strictMaths, index, *pit, *it)); }
+								else { set(*it, layoutCircleEuclidian(get(index), get(*pit), rad[*it], strictMaths, index, *pit, *it)); }
+								if (region[*it] == k) st.push_back(*it);
+								}
+							pit = it;
+							++it;
+							if (it == graph[index].end()) { it = graph[index].begin(); }
+							}
+						}
+					}
+				};
+			{
+			std::vector<std::thread> threads;
+			for (int t = 1; t < nbThreads; t++) { threads.push_back(std::thread(worker)); }
+			worker();
+			for (auto & th : threads) { th.join(); }
+			}
+
+			// stitch the regions: region k is attached to the region of the BFS father of its first vertex
+			std::vector<Mobius<FPTYPE> > motion(nbreg);
+			for (int k = 1; k < nbreg; k++)
+				{
+				const int a = regList[regOff[k]];
+				const int b = father[a];
+				const int p = region[b];
+				MTOOLS_ASSERT(p < k);
+				const Circle<FPTYPE> Ga = motion[p] * halo[p][a], Gb = motion[p] * circle[b];
+				motion[k] = layoutMotion(circle[a], halo[k][b], Ga, Gb, hyperbolic);
+				}
+
+			// move the regions
+			std::vector<std::thread> threads;
+			for (int t = 0; t < nbThreads; t++)
+				{
+				threads.push_back(std::thread([&, t]() { for (int k = t + 1; k < nbreg; k += nbThreads) { applyMobius(motion[k], circle, regList.data() + regOff[k], (size_t)(regOff[k + 1] - regOff[k]), rad, hyperbolic); } }));
+				}
+			for (auto & th : threads) { th.join(); }
+
+			// the remaining circles (boundary vertices) are taken from the first region which placed them
+			for (int k = 0; k < nbreg; k++)
+				{
+				for (auto & E : halo[k])
+					{
+					const int v = E.first;
+					if ((region[v] >= 0) || (done[v])) continue;
+					done[v] = 1;
+					circle[v] = motion[k] * E.second;
+					if (!hyperbolic) circle[v].radius = rad[v];
+					}
+				}
+			return circle;
+			}
+
+
+		}
+
+
+
+	/**
+	 * 
+	 *  ********************
+	 *  INCOMPLET : NE PLACE PAS TOUT LES RADII. (MANQUE CEUX QUI SONT SEPARE DU SITE CENTRAL PAR DES CERCLE FRONTIERE).
+	 *  ********************
+	 * 
+	 * Compute the layout for an hyperbolic packing label (i.e when the radius are given in term of the hyperbolic
+	 * metric instead of the euclidian one).
+	 *
+	 * @param	graph	   	The graph.
+	 * @param	boundary   	The boundary. Any vertex v with boundary[v] > 0 is on the exterior face.
+	 * @param	srad	   	The vector of hyperbolic radii given in s-radii format:  s = exp(-h) where h is the real 
+	 * 						hyperbolic radius. Thus, s = 0 for infinite radius and s = 1 for null radius
+	 * @param	strictMaths	true to raise an error if FPTYPE does not allows sufficient precision for layout. Otherwise, 
+	 * 						the algorithm does its best but circles may end up overlapping. 
+	 * @param	v0		   	Index of the start vertex to lay out at the origin of the disk or -1 to choose an arbirary one. 
+	 *
+	 * @return	The positions of the circles for the packing label. This yields a packing inside the unit disk. 
+	 */
+	template<typename FPTYPE, typename GRAPH> std::vector<Circle<FPTYPE> > computeCirclePackLayoutHyperbolic(const GRAPH & graph, const std::vector<int> & boundary, const std::vector<FPTYPE> & srad, bool strictMaths = false, int v0 = -1)
+		{
+		MTOOLS_INSURE(graph.size() == srad.size());
+		MTOOLS_INSURE(graph.size() == boundary.size());
+		if (v0 < 0) { for (size_t i = 0; i < boundary.size(); i++) { if (boundary[i] <= 0) { v0 = (int)i; break; } } }
+		MTOOLS_INSURE(boundary[v0] <= 0);
+		std::vector<Circle<FPTYPE> > circle(srad.size());		
+		circle[v0] = Circle<FPTYPE>(complex<FPTYPE>((FPTYPE)0, (FPTYPE)0), distStoR(srad[v0]));  // lay the circle at the origin		
+		int v1 = graph[v0].front();												//
+		circle[v1].radius = tangentCircleStoR(circle[v0].radius, srad[v1]);		// lay v1 on the right of v0.
+		circle[v1].center = circle[v0].radius + circle[v1].radius;				// 
+
+		auto laidvec = internals_circlepacking::layoutExplorer(graph, v0, v1, (boundary[v1] <= 0), [&](int ix, int iy, int iz)->bool
+			{
+			circle[iz] = internals_circlepacking::layoutCircleHyperbolic(circle[ix], circle[iy], srad[ix], srad[iy], srad[iz], strictMaths, ix, iy, iz);
+			return (boundary[iz] <= 0); // explore also around iz if it is an interior vertex
+			});
+		// done layout out circle adjacent to an interior circle but there may still be some other one to lay out
+		std::queue<int> queue;
+		for (int i = 0; i < laidvec.size(); i++) { if (laidvec[i] == 0) { queue.push(i); } } // push all vertices that are not yet lais. 
+
+		//
+		// TODO : THE FOLLOWING ASSUME THAT THE REMAINING CIRCLES TO LAY OUT ARE HOROCYCLES (IE WE ARE WORKING WITH
+		// A MAXIMAL HYPERBOLIC PACKING
+		// -> adapt to deal with the general case.
+		/*
+		while(queue.size() >0)
+			{
+			const int iz = queue.front(); queue.pop();
+			for (int k = 0; k < graph[iz].size(); k++)
 				{
 				int ix = graph[iz][k];
 				if (laidvec[ix] > 0)
@@ -685,24 +1430,70 @@ namespace mtools
 
 		internals_circlepacking::layoutExplorer(graph, v0, v1, (boundary[v1] <= 0), [&](int ix, int iy, int iz)->bool
 			{
-			const FPTYPE & rx = rad[ix]; if ((strictMaths) && ((rx == (FPTYPE)0.0) || (isnan(rx)))) { MTOOLS_ERROR(std::string("Precision error A. null radius (site ") + mtools::toString(ix) + ")"); }
-			const FPTYPE & ry = rad[iy]; if ((strictMaths) && ((ry == (FPTYPE)0.0) || (isnan(ry)))) { MTOOLS_ERROR(std::string("Precision error B. null radius (site ") + mtools::toString(iy) + ")"); }
-			const FPTYPE & rz = rad[iz]; if ((strictMaths) && ((rz == (FPTYPE)0.0) || (isnan(rz)))) { MTOOLS_ERROR(std::string("Precision error C. null radius (site ") + mtools::toString(iz) + ")"); }
-			const FPTYPE & alpha = internals_circlepacking::angleEuclidian(rx, ry, rz);
-			if ((strictMaths) && (isnan(alpha))) { MTOOLS_ERROR(std::string("Precision error D. null alpha (site ") + mtools::toString(iz) + ")"); }
-			auto w = circle[iy].center - circle[ix].center;
-			w = w*complex<FPTYPE>(cos(alpha), sin(alpha));
-			const FPTYPE norm = std::abs(w);
-			if (norm != (FPTYPE)0.0) { w /= norm; w *= (rx + rz); } else { if (strictMaths) { MTOOLS_ERROR(std::string("Precision error E (site ") + mtools::toString(iz) + ")"); } }
-			circle[iz].center = circle[ix].center + w;
-			if ((circle[iz].center == circle[iy].center) || (circle[iz].center == circle[ix].center)) { if (strictMaths) { MTOOLS_ERROR(std::string("Precision error F (site ") + mtools::toString(iz) + ")"); } }
-			circle[iz].radius = rad[iz];
+			circle[iz] = internals_circlepacking::layoutCircleEuclidian(circle[ix], circle[iy], rad[iz], strictMaths, ix, iy, iz);
 			return (boundary[iz] <= 0);
 			});
 		return circle;
 		}
 
 
+	/**
+	 * Parallel version of computeCirclePackLayout().
+	 *
+	 * The interior vertices are split into connected regions which are laid out in parallel, each
+	 * one from its own anchor, and then stitched together with rigid motions (see
+	 * internals_circlepacking::parallelLayout()). The circles laid out are the same as with
+	 * computeCirclePackLayout() and the anchor v0 is placed in the same way. The positions differ
+	 * only by the rounding errors which are smaller since they accumulate inside each region only.
+	 *
+	 * @param	graph	   	The graph.
+	 * @param	boundary   	The boundary. Any vertex v with boundary[v] > 0 is on the exterior face.
+	 * @param	rad		   	The vector of radii.
+	 * @param	strictMaths	true to raise an error if FPTYPE does not allows sufficient precision for layout.
+	 * @param	v0		   	Index of the start vertex to lay out at the origin or -1 to choose an arbirary one.
+	 * @param	nbThreads  	Number of threads to use (0 = number of hardware threads).
+	 * @param	regionSize 	Number of vertices per region (0 = automatic).
+	 *
+	 * @return	The positions of the circles for the packing label.
+	 **/
+	template<typename FPTYPE, typename GRAPH> std::vector<Circle<FPTYPE> > computeCirclePackLayoutParallel(const GRAPH & graph, const std::vector<int> & boundary, const std::vector<FPTYPE> & rad, bool strictMaths = false, int v0 = -1, int nbThreads = 0, int regionSize = 0)
+		{
+		MTOOLS_INSURE(graph.size() == rad.size());
+		MTOOLS_INSURE(graph.size() == boundary.size());
+		if (v0 < 0) { for (size_t i = 0; i < boundary.size(); i++) { if (boundary[i] <= 0) { v0 = (int)i; break; } } }
+		MTOOLS_INSURE(boundary[v0] <= 0);
+		return internals_circlepacking::parallelLayout(graph, boundary, rad, false, strictMaths, v0, nbThreads, regionSize);
+		}
+
+
+	/**
+	 * Parallel version of computeCirclePackLayoutHyperbolic().
+	 *
+	 * Same as computeCirclePackLayoutParallel() but for an hyperbolic packing label: each region is
+	 * laid out with its anchor at the origin of the disk and the regions are stitched together
+	 * with automorphisms of the unit disk (Mobius transformations) which are then applied in
+	 * parallel.
+	 *
+	 * @param	graph	   	The graph.
+	 * @param	boundary   	The boundary. Any vertex v with boundary[v] > 0 is on the exterior face.
+	 * @param	srad	   	The vector of hyperbolic radii given in s-radii format:  s = exp(-h).
+	 * @param	strictMaths	true to raise an error if FPTYPE does not allows sufficient precision for layout.
+	 * @param	v0		   	Index of the start vertex to lay out at the origin of the disk or -1 to choose an arbirary one.
+	 * @param	nbThreads  	Number of threads to use (0 = number of hardware threads).
+	 * @param	regionSize 	Number of vertices per region (0 = automatic).
+	 *
+	 * @return	The positions of the circles for the packing label inside the unit disk.
+	 **/
+	template<typename FPTYPE, typename GRAPH> std::vector<Circle<FPTYPE> > computeCirclePackLayoutHyperbolicParallel(const GRAPH & graph, const std::vector<int> & boundary, const std::vector<FPTYPE> & srad, bool strictMaths = false, int v0 = -1, int nbThreads = 0, int regionSize = 0)
+		{
+		MTOOLS_INSURE(graph.size() == srad.size());
+		MTOOLS_INSURE(graph.size() == boundary.size());
+		if (v0 < 0) { for (size_t i = 0; i < boundary.size(); i++) { if (boundary[i] <= 0) { v0 = (int)i; break; } } }
+		MTOOLS_INSURE(boundary[v0] <= 0);
+		return internals_circlepacking::parallelLayout(graph, boundary, srad, true, strictMaths, v0, nbThreads, regionSize);
+		}
+
+
 
 	/**
 	* Draw the graph of the circle packing.
@@ -723,16 +1514,18 @@ namespace mtools
 		color.multOpacity(opacity);
 		MTOOLS_ASSERT(circles.size() == gr.size());
 		if ((lastIndex < 0) || (lastIndex > (int)(gr.size()))) lastIndex = (int)(gr.size());
+		if (filled)
+			{ // batched drawing
+			if (firstIndex >= lastIndex) return;
+			std::vector<fVec2> centers; centers.reserve(lastIndex - firstIndex);
+			std::vector<double> radii; radii.reserve(lastIndex - firstIndex);
+			for (int i = firstIndex; i < lastIndex; i++) { centers.push_back(fVec2((double)circles[i].center.real(), (double)circles[i].center.imag())); radii.push_back((double)circles[i].radius); }
+			img.canvas_draw_circles(R, centers.data(), radii.data(), color, centers.size(), true);
+			return;
+			}
 		for (int i = firstIndex; i < lastIndex; i++)
 			{
-			if (filled)
-				{
-				img.canvas_draw_filled_circle(R, circles[i].center, circles[i].radius, color, color,true);
-				}
-			else
-				{
-				img.canvas_draw_circle(R, circles[i].center, circles[i].radius, color, true, false);
-				}
+			img.canvas_draw_circle(R, circles[i].center, circles[i].radius, color, true, false);
 			}
 		}
 
@@ -793,6 +1586,62 @@ namespace mtools
 		}
 
 
+	/**
+	* Draw the circles of a packing mapped in memory (cf. drawCirclePacking_Circles() above).
+	**/
+	template<typename FPTYPE> void drawCirclePacking_Circles(Image & img, const mtools::Box<FPTYPE, 2> & R, const CirclePackingMappedFile<FPTYPE> & CP, bool filled, RGBc color, float opacity = 1.0f, int firstIndex = 0, int lastIndex = -1)
+		{
+		color.multOpacity(opacity);
+		if ((lastIndex < 0) || (lastIndex > (int)(CP.size()))) lastIndex = (int)(CP.size());
+		if (filled)
+			{ // batched drawing
+			if (firstIndex >= lastIndex) return;
+			std::vector<fVec2> centers; centers.reserve(lastIndex - firstIndex);
+			std::vector<double> radii; radii.reserve(lastIndex - firstIndex);
+			for (int i = firstIndex; i < lastIndex; i++) { const FPTYPE * c = CP.centers() + 2*(size_t)i; centers.push_back(fVec2((double)c[0], (double)c[1])); radii.push_back((double)CP.radius(i)); }
+			img.canvas_draw_circles(R, centers.data(), radii.data(), color, centers.size(), true);
+			return;
+			}
+		for (int i = firstIndex; i < lastIndex; i++)
+			{
+			img.canvas_draw_circle(R, CP.center(i), CP.radius(i), color, true, false);
+			}
+		}
+
+
+	/**
+	* Draw the graph of a packing mapped in memory (cf. drawCirclePacking_Graph() above).
+	**/
+	template<typename FPTYPE> void drawCirclePacking_Graph(Image & img, const mtools::Box<FPTYPE, 2> & R, const CirclePackingMappedFile<FPTYPE> & CP, RGBc color, float opacity = 1.0f, int firstIndex = 0, int lastIndex = -1)
+		{
+		color.multOpacity(opacity);
+		if ((lastIndex < 0) || (lastIndex > (int)(CP.size()))) lastIndex = (int)(CP.size());
+		for (int i = firstIndex; i < lastIndex; i++)
+			{
+			const int32 * nei = CP.neighbours(i);
+			const size_t d = CP.degree(i);
+			for (size_t k = 0; k < d; k++)
+				{
+				if ((nei[k] >= firstIndex) && (nei[k] < lastIndex)) { img.canvas_draw_line(R, CP.center(i), CP.center(nei[k]), color, true); }
+				}
+			}
+		}
+
+
+	/**
+	* Draw the labels of a packing mapped in memory (cf. drawCirclePacking_Labels() above).
+	**/
+	template<typename FPTYPE> void drawCirclePacking_Labels(Image & img, const mtools::Box<FPTYPE, 2> & R, const CirclePackingMappedFile<FPTYPE> & CP, int fontsize, RGBc color, float opacity = 1.0f, int firstIndex = 0, int lastIndex = -1)
+		{
+		color.multOpacity(opacity);
+		if ((lastIndex < 0) || (lastIndex > (int)(CP.size()))) lastIndex = (int)(CP.size());
+		for (int i = firstIndex; i < lastIndex; i++)
+			{
+			img.canvas_draw_text(R, CP.center(i), mtools::toString(i), mtools::MTOOLS_TEXT_CENTER, color, fontsize);
+			}
+		}
+
+
 
 
 		/**
@@ -815,6 +1664,9 @@ namespace mtools
 		 * NOTE: If openCL extension is active, the class CirclePackingLabelGPU may be used instead
 		 *       increase computation speed.
 		 *
+		 * NOTE: The method computeRadiiParallel() performs the same computation as computeRadii() using
+		 *       several threads (on the CPU).
+		 *
 		 * @tparam	FPTYPE	Floating type that should be used during calculation.
 		 **/
 		template<typename FPTYPE = double> class CirclePackingLabel
@@ -827,7 +1679,7 @@ namespace mtools
 			 *
 			 * @param	verbose	true to print info to mtools::cout during packing.
 			 */
-			CirclePackingLabel(bool verbose = false) : _verbose(verbose), _pi(acos((FPTYPE)(-1.0))) , _twopi(2*acos((FPTYPE)(-1.0)))
+			CirclePackingLabel(bool verbose = false) : _verbose(verbose), _reorder(false), _pi(acos((FPTYPE)(-1.0))) , _twopi(2*acos((FPTYPE)(-1.0)))
 				{
 				}
 
@@ -842,6 +1694,15 @@ namespace mtools
 			void verbose(bool verb) { _verbose = verb; }
 
 
+			/**
+			 * Decide whether the vertices should be renumbered (reverse Cuthill-McKee ordering) when the
+			 * triangulation is loaded with setTriangulation(). This improves memory locality, hence
+			 * speed, for large triangulations with a random numbering. The numbering used by setRadii()
+			 * and getRadii() is unchanged. Must be called before setTriangulation().
+			 **/
+			void reorderVertices(bool reorder) { _reorder = reorder; }
+
+
 			/** Clears the object to a blank initial state. */
 			void clear()
 				{
@@ -849,6 +1710,10 @@ namespace mtools
 				_perm.clear();
 				_nb = 0;
 				_rad.clear();
+				_csr.clear();
+				_classOff.clear();
+				_classList.clear();
+				_dirty.clear();
 				}
 
 
@@ -865,7 +1730,13 @@ namespace mtools
 				clear();
 				const size_t l = graph.size();
 				MTOOLS_INSURE(boundary.size() == l);
-				_perm.setSortPermutation(boundary);
+				if (_reorder)
+					{
+					std::vector<int> isbound(l);
+					for (size_t i = 0; i < l; i++) { isbound[i] = ((boundary[i] > 0) ? 1 : 0); }
+					_perm = internals_circlepacking::reorderPermutation(graph, isbound);
+					}
+				else { _perm.setSortPermutation(boundary); }
 				_gr = permuteGraph<std::vector<std::vector<int> > >(convertGraph<GRAPH, std::vector<std::vector<int> > >(graph), _perm);
 				_nb = l;
 				for (size_t i = 0; i < l; i++) 
@@ -877,6 +1748,74 @@ namespace mtools
 					}
 				MTOOLS_INSURE((_nb > 0)&&(_nb < l-2));
 				_rad.resize(l, (FPTYPE)1.0);
+				_dirty.resize(_nb);
+				for (size_t i = 0; i < _nb; i++) { _dirty[i] = (int32)i; }
+				}
+
+
+			/**
+			 * Loads a new version of a growing triangulation, keeping the current radii (warm start for
+			 * computeRadiiIncremental()).
+			 *
+			 * Vertex i of the new graph must be vertex i of the previous one for every i smaller than the
+			 * previous number of vertices: the triangulation grows by appending new vertices, as done by
+			 * CombinatorialMap::addTriangle(), addSplittingTriangle()... and hence by peelUIPT(). The
+			 * previous vertices keep their radius, each new interior vertex gets the geometric mean of
+			 * the radii of its neighbours already known and each new boundary vertex gets radius 1.0 (as
+			 * with setTriangulation(), use setRadii() to change it afterwards). The interior vertices which are new, whose
+			 * neighbourhood changed or which were on the boundary are marked as 'dirty': they are the
+			 * starting point of computeRadiiIncremental().
+			 *
+			 * If no triangulation is loaded, this is the same as setTriangulation().
+			 *
+			 * @param graph	   The new triangulation with boundary.
+			 * @param boundary  The boundary vector. Every index i for which boundary[i] > 0
+			 * 					is considered to be a boundary vertice.
+			 **/
+			template<typename GRAPH> void updateTriangulation(const GRAPH & graph, const std::vector<int> & boundary)
+				{
+				const size_t oldl = _gr.size();
+				if (oldl == 0) { setTriangulation(graph, boundary); return; }
+				const size_t l = graph.size();
+				MTOOLS_INSURE(l >= oldl);
+				// previous state in the original numbering
+				std::vector<FPTYPE> rad = getRadii();
+				rad.resize(l, (FPTYPE)0);
+				std::vector<char> changed(l, 1);
+				std::vector<int> oldn, newn;
+				for (size_t v = 0; v < oldl; v++)
+					{
+					const int iv = _perm.inv(v);
+					const bool wasbound = (iv >= (int)_nb);
+					if (wasbound != (boundary[v] > 0)) continue;
+					oldn.clear(); for (int a : _gr[iv]) { oldn.push_back(_perm[a]); }
+					newn.assign(graph[v].begin(), graph[v].end());
+					if (oldn.size() != newn.size()) continue;
+					std::sort(oldn.begin(), oldn.end());
+					std::sort(newn.begin(), newn.end());
+					if (oldn == newn) changed[v] = 0;
+					}
+				// radii of the new vertices: geometric mean of the known neighbours (BFS from the old vertices)
+				std::vector<int> queue;
+				std::vector<char> known(l, 0);
+				for (size_t v = 0; v < oldl; v++) { known[v] = 1; }
+				for (size_t v = oldl; v < l; v++) { for (int a : graph[v]) { if (a < (int)oldl) { queue.push_back((int)v); break; } } }
+				for (size_t h = 0; h < queue.size(); h++)
+					{
+					const int v = queue[h];
+					if (known[v]) continue;
+					FPTYPE lr = 0; int n = 0;
+					for (int a : graph[v]) { if (known[a]) { lr += log(rad[a]); n++; } }
+					rad[v] = ((n > 0) ? exp(lr / n) : (FPTYPE)1.0);
+					known[v] = 1;
+					for (int a : graph[v]) { if (!known[a]) queue.push_back(a); }
+					}
+				for (size_t v = oldl; v < l; v++) { if ((!known[v]) || (boundary[v] > 0)) rad[v] = (FPTYPE)1.0; } // new boundary vertices get radius 1.0 as in setTriangulation()
+				// load the new triangulation
+				setTriangulation(graph, boundary);
+				setRadii(rad);
+				_dirty.clear();
+				for (size_t i = 0; i < _nb; i++) { if (changed[_perm[i]]) _dirty.push_back((int32)i); }
 				}
 
 
@@ -1050,62 +1989,412 @@ namespace mtools
 				}
 
 
-				bool _verbose;	// do we print info on mtools::cout ?
-
-				const FPTYPE					_pi;		// pi
-				const FPTYPE					_twopi;		// pi
-
-				std::vector<std::vector<int> >	_gr;		// the graph
-				mtools::Permutation				_perm;		// the permutation applied to get all the boundary vertices at the end
-				std::vector<FPTYPE>				_rad;		// vertex raduises
-				size_t							_nb;		// number of internal vertices
-
-			};
-
-
-
-
-
-
-
-
-
-
-
-		/**
-		 * Class used to compute the radii associated with the hyperbolic circle packing
-		 * of a triangulation with a boundary.
-		 *
-		 * The algorithm is taken from Collins and Stephenson (2003).
-		 *
-		 * This class computes a 'packing label' in the hyperbolic case. The radii are
-		 * taken and coimputed is the so called s-format where 
-		 *                                  
-		 *                                    s = exp(-h)
-		 *                                    
-		 * and h is the true hyperbolic radii. Thus s = 0 means infinite radius and s = 1
-		 * means 0 radius. 
-		 *
-		 * @tparam	FPTYPE	Floating type that should be used during calculation.
-		 **/
-		template<typename FPTYPE = double> class CirclePackingLabelHyperbolic
-			{
-
-			public:
-
 			/**
-			 * Constructor.
+			 * Multithreaded version of computeRadii().
 			 *
-			 * @param	verbose	true to print info to mtools::cout during packing.
-			 */
-			CirclePackingLabelHyperbolic(bool verbose = false) : _verbose(verbose), _pi(acos((FPTYPE)(-1.0))) , _twopi(2*acos((FPTYPE)(-1.0)))
-				{
-				}
-
-
-			/* dtor, empty object */
-			~CirclePackingLabelHyperbolic() {}
-
+			 * The interior vertices are coloured such that two adjacent vertices never have the same
+			 * colour and each iteration updates the colour classes one after the other (Gauss-Seidel by
+			 * colour class, i.e. red-black ordering when two colours suffice). The vertices of a class do
+			 * not depend on each other, so each class is split between the threads. The graph is stored
+			 * in CSR format (flat neighbour array) for the computation and the colouring is computed once
+			 * per triangulation. The acceleration step is the same as in computeRadii().
+			 *
+			 * Since the updates are not performed in the same order as in computeRadii(), the number of
+			 * iterations and the radii (up to the precision eps) may differ slightly.
+			 *
+			 * @param	eps				the required precision, in L2 norm.
+			 * @param	delta			parameter that detemrine how super acceleration is performed (slower
+			 * 							value = more restrictive condition to perform acceleration).
+			 * @param	maxIteration	The maximum number of iteration before stopping. -1 = no limit.
+			 * @param	stepIter		number of iterations between printing infos (used only if verbose = true).
+			 * @param	nbThreads		number of threads to use (0 = number of hardware threads).
+			 *
+			 * @return	The number of iterations performed.
+			 **/
+			int64 computeRadiiParallel(const FPTYPE eps = 10e-9, const FPTYPE delta = 0.05, const int64 maxIteration = -1, const int64 stepIter = 1000, int nbThreads = 0)
+				{
+				auto totduration = chrono();
+				if (nbThreads <= 0) { nbThreads = nbHardwareThreads(); }
+				const int nb = (int)_nb;
+				if ((_csr.size() != _gr.size()) || (_classOff.size() == 0))
+					{ // build the CSR graph and the colouring
+					_csr = CSRGraph(_gr);
+					internals_circlepacking::greedyColouring(_csr, nb, _classOff, _classList);
+					}
+				const int nbcol = (int)_classOff.size() - 1;
+				FPTYPE minc = errorL2();
+				if (_verbose)
+					{
+					mtools::cout << "\n  --- Starting Packing Algorithm [CPU, " << nbThreads << " threads] ---\n\n";
+					mtools::cout << "initial L2 error  = " << minc << "\n";
+					mtools::cout << "L2 target         = " << eps << "\n";
+					mtools::cout << "max iterations    = " << maxIteration << "\n";
+					mtools::cout << "iter between info = " << stepIter << "\n";
+					mtools::cout << "colour classes    = " << nbcol << "\n\n";
+					}
+				FastRNG gen;					// use to randomize acceleration.
+				int64 iter = 0;
+				FPTYPE c = 1.0 + eps, c0;
+				FPTYPE lambda = -1.0, lambda0;
+				bool fl = false, fl0;
+				FPTYPE accel = 0.0;				// acceleration factor of the current iteration (0 = no acceleration)
+				bool stop = false;
+				std::vector<FPTYPE> _rad0 = _rad;
+				std::vector<FPTYPE> part_err(nbThreads), part_lstar(nbThreads);
+				internals_circlepacking::Barrier barrier(nbThreads);
+				auto duration = chrono();
+				auto worker = [&](const int t)
+					{
+					auto range = [&](int64 n, int64 & a, int64 & b) { a = (n*t) / nbThreads; b = (n*(t + 1)) / nbThreads; }; // part [a,b[ of [0,n[ for thread t
+					int64 va, vb;
+					range(nb, va, vb);
+					while (1)
+						{
+						for (int64 i = va; i < vb; i++) { _rad0[i] = _rad[i]; }
+						barrier.wait();
+						FPTYPE e2 = 0.0;
+						for (int col = 0; col < nbcol; col++)
+							{ // update the vertices of colour col
+							const int32 * L = _classList.data() + _classOff[col];
+							int64 a, b;
+							range(_classOff[col + 1] - _classOff[col], a, b);
+							for (int64 u = a; u < b; u++)
+								{
+								const int i = L[u];
+								const FPTYPE v = _rad[i];
+								const FPTYPE theta = internals_circlepacking::angleSumEuclidianCSR(i, _csr, _rad);
+								const FPTYPE k = (FPTYPE)_csr.degree(i);
+								const FPTYPE beta = sin(theta*0.5 / k);
+								const FPTYPE tildev = beta*v / (1.0 - beta);
+								const FPTYPE delt = sin(_pi / k);
+								_rad[i] = (1.0 - delt)*tildev / delt;
+								const FPTYPE e = theta - _twopi;
+								e2 += e*e;
+								}
+							barrier.wait();
+							}
+						FPTYPE ls = std::numeric_limits<FPTYPE>::max();
+						for (int64 i = va; i < vb; i++)
+							{
+							const FPTYPE d = _rad0[i] - _rad[i];
+							if (d > 0.0)
+								{
+								const FPTYPE d2 = (_rad[i] / d);
+								if (d2 < ls) { ls = d2; }
+								}
+							}
+						part_err[t] = e2;
+						part_lstar[t] = ls;
+						barrier.wait();
+						if (t == 0)
+							{ // sequential part, same as computeRadii()
+							iter++;
+							c0 = c;
+							lambda0 = lambda;
+							fl0 = fl;
+							c = 0.0;
+							for (int k = 0; k < nbThreads; k++) { c += part_err[k]; }
+							c = sqrt(c);
+							if (c < minc) { minc = c; }
+							lambda = c / c0;
+							fl = true;
+							accel = 0.0;
+							if ((fl0) && (lambda < 1.0))
+								{
+								if (std::abs(lambda - lambda0) < delta) { lambda = lambda / (1.0 - lambda); }
+								FPTYPE lstar = 3.0*lambda;
+								for (int k = 0; k < nbThreads; k++) { if (part_lstar[k] < lstar) { lstar = part_lstar[k]; } }
+								lambda = ((lambda < 0.5*lstar) ? lambda : 0.5*lstar);
+								if ((gen() & 1) && (c > eps)) { accel = lambda; fl = 0; } // do not accelerate if c < eps
+								}
+							if ((_verbose) && ((iter % stepIter == 0) || (c < eps) || (iter == maxIteration)))
+								{
+								mtools::cout << "iteration = " << iter << "\n";
+								mtools::cout << "L2 current error  = " << c << "\n";
+								mtools::cout << "L2 minimum error  = " << minc << "\n";
+								mtools::cout << "L2 target         = " << eps << "\n";
+								mtools::cout << ((iter % stepIter == 0) ? stepIter : iter % stepIter) << " interations performed in " << duration << "\n\n";
+								duration.reset();
+								}
+							stop = ((c <= eps) || (iter == maxIteration));
+							}
+						barrier.wait();
+						if (accel != 0.0) { for (int64 i = va; i < vb; i++) { _rad[i] += accel*(_rad[i] - _rad0[i]); } }
+						if (stop) return;
+						}
+					};
+				if ((maxIteration != 0) && (nb > 0))
+					{
+					std::vector<std::thread> threads;
+					for (int t = 1; t < nbThreads; t++) { threads.push_back(std::thread(worker, t)); }
+					worker(0);
+					for (auto & th : threads) { th.join(); }
+					}
+				if (_verbose)
+					{
+					cout << "\n\nFinal L2 error = " << errorL2() << "\n";
+					cout << "Final L1 error = " << errorL1() << "\n\n";
+					cout << "Total packing time : " << totduration << "\n\n";
+					if (iter == maxIteration) { mtools::cout << "  --- Packing stopped after " << iter << " iterations ---  \n\n"; }
+					else { mtools::cout << "  --- Packing complete ---  \n\n"; }
+					}
+				return iter;
+				}
+
+
+			/**
+			 * Coarse-to-fine version of computeRadii().
+			 *
+			 * A hierarchy of coarser triangulations is constructed by collapsing edges between interior
+			 * vertices (see internals_circlepacking::coarsenTriangulation()) until the number of interior
+			 * vertices drops below minSize. The radii are computed on the coarsest triangulation first.
+			 * They are then prolongated to the finer level (a vertex of the fine triangulation gets the
+			 * radius of the coarse vertex that contains it, divided by the square root of the local
+			 * number of fine vertices per coarse vertex, then the log-radii are smoothed with a few
+			 * averaging passes) and used as the starting point of computeRadii() on this level. The
+			 * coarse levels are only solved up to precision 0.01 since they only provide an initial
+			 * guess for the next level.
+			 *
+			 * This removes most of the large scale error before iterating on the finest level. However,
+			 * the asymptotic rate of convergence of computeRadii() is unchanged so the gain depends on
+			 * the triangulation and on the precision required.
+			 *
+			 * @param	eps				the required precision, in L2 norm.
+			 * @param	delta			parameter that detemrine how super acceleration is performed (slower
+			 * 							value = more restrictive condition to perform acceleration).
+			 * @param	maxIteration	The maximum number of iteration before stopping (for each level). -1 = no limit.
+			 * @param	stepIter		number of iterations between printing infos (used only if verbose = true).
+			 * @param	minSize			number of interior vertices below which the triangulation is not
+			 * 							coarsened anymore.
+			 *
+			 * @return	The number of iterations performed on the finest level.
+			 **/
+			int64 computeRadiiMultigrid(const FPTYPE eps = 10e-9, const FPTYPE delta = 0.05, const int64 maxIteration = -1, const int64 stepIter = 1000, const int minSize = 1000)
+				{
+				auto totduration = chrono();
+				// construct the hierarchy: level 0 is the triangulation itself
+				std::vector<std::vector<std::vector<int> > > graphs(1);
+				std::vector<int> nbs(1, (int)_nb);
+				std::vector<std::vector<int> > maps(1);	// maps[k] = map from level k-1 to level k
+				while (nbs.back() > minSize)
+					{
+					const std::vector<std::vector<int> > & G = (graphs.size() == 1) ? _gr : graphs.back();
+					std::vector<std::vector<int> > cgr;
+					std::vector<int> map;
+					int cnb;
+					internals_circlepacking::coarsenTriangulation(G, nbs.back(), cgr, cnb, map);
+					while (cnb > nbs.back() / 2)
+						{ // collapse more edges until the number of interior vertices is halved.
+						std::vector<std::vector<int> > cgr2;
+						std::vector<int> map2;
+						int cnb2;
+						if (internals_circlepacking::coarsenTriangulation(cgr, cnb, cgr2, cnb2, map2) * 100 < cnb) break;
+						for (auto & m : map) { m = map2[m]; }
+						cgr.swap(cgr2);
+						cnb = cnb2;
+						}
+					if (cnb * 10 > nbs.back() * 9) break; // not enough edges collapsed.
+					graphs.push_back(std::move(cgr));
+					nbs.push_back(cnb);
+					maps.push_back(std::move(map));
+					}
+				const int nblevels = (int)graphs.size();
+				if (_verbose)
+					{
+					mtools::cout << "\n  --- Multigrid hierarchy : " << nblevels << " levels ---\n";
+					for (int k = 0; k < nblevels; k++) { mtools::cout << "level " << k << " : " << nbs[k] << " interior vertices\n"; }
+					}
+				if (nblevels > 1)
+					{
+					// initial radii on each level: the value of the last fine vertex mapped to each coarse vertex
+					std::vector<std::vector<FPTYPE> > rads(nblevels);
+					rads[0] = _rad;
+					for (int k = 1; k < nblevels; k++)
+						{
+						rads[k].resize(graphs[k].size());
+						for (size_t i = 0; i < rads[k - 1].size(); i++) { rads[k][maps[k][i]] = rads[k - 1][i]; }
+						}
+					const FPTYPE coarseeps = ((eps > (FPTYPE)0.01) ? eps : (FPTYPE)0.01);
+					for (int k = nblevels - 1; k > 0; k--)
+						{
+						CirclePackingLabel<FPTYPE> P(false);
+						P._gr.swap(graphs[k]);
+						P._nb = nbs[k];
+						P._rad.swap(rads[k]);
+						const int64 it = P.computeRadii(coarseeps, delta, maxIteration, stepIter);
+						if (_verbose) { mtools::cout << "level " << k << " solved in " << it << " iterations (L2 error = " << P.errorL2() << ")\n"; }
+						// prolongate to level k-1
+						std::vector<int> clustersize(P._rad.size(), 0);
+						for (int c : maps[k]) { clustersize[c]++; }
+						std::vector<FPTYPE> & R = rads[k - 1];
+						std::vector<FPTYPE> scale(nbs[k]);
+						for (int c = 0; c < nbs[k]; c++)
+							{ // mean number of fine vertices per coarse vertex around c
+							FPTYPE d = (FPTYPE)clustersize[c];
+							for (int a : P._gr[c]) { d += (FPTYPE)clustersize[a]; }
+							scale[c] = 1 / sqrt(d / (FPTYPE)(P._gr[c].size() + 1));
+							}
+						for (int i = 0; i < nbs[k - 1]; i++) { const int c = maps[k][i]; R[i] = P._rad[c] * scale[c]; }
+						const std::vector<std::vector<int> > & F = (k == 1) ? _gr : graphs[k - 1];
+						for (int pass = 0; pass < 3; pass++)
+							{ // smooth the prolongated radii (geometric mean with the neighbours)
+							std::vector<FPTYPE> R2(R);
+							for (int i = 0; i < nbs[k - 1]; i++)
+								{
+								FPTYPE l = log(R[i]);
+								for (int a : F[i]) { l += log(R[a]); }
+								R2[i] = exp(l / (FPTYPE)(F[i].size() + 1));
+								}
+							R.swap(R2);
+							}
+						graphs[k].clear();
+						}
+					_rad.swap(rads[0]);
+					}
+				const int64 iter = computeRadii(eps, delta, maxIteration, stepIter);
+				if (_verbose) { cout << "Total multigrid packing time : " << totduration << "\n\n"; }
+				return iter;
+				}
+
+
+			/**
+			 * Incremental version of computeRadii(), to be used after updateTriangulation().
+			 *
+			 * 1) Local phase: the radii are updated only on an active set of interior vertices which
+			 *    starts from the 'dirty' vertices and their neighbours. During each sweep, a vertex whose
+			 *    angle sum error is larger than eps stays active and activates its interior neighbours,
+			 *    the other ones are dropped. This removes the large error located around the new part
+			 *    of the triangulation. The phase stops when the active set is empty or when it contains
+			 *    more than a quarter of the interior vertices.
+			 * 2) Global phase: if the L2 error is still larger than eps, computeRadii() is called
+			 *    starting from the current radii (warm start).
+			 *
+			 * For a triangulation which grows by a small amount between two calls (e.g. a few peeling
+			 * steps), the global phase starts close to the solution so it needs far fewer iterations
+			 * than a solve from scratch (about half of them for a 20000 vertices triangulation growing by
+			 * 10 vertices at a time with eps = 1.0e-6).
+			 *
+			 * @param	eps				the required precision, in L2 norm.
+			 * @param	delta			acceleration parameter of computeRadii() (used in the global phase).
+			 * @param	maxIteration	The maximum number of sweeps plus iterations of the global phase.
+			 * 							-1 = no limit.
+			 * @param	stepIter		number of iterations between printing infos (used only if verbose = true).
+			 *
+			 * @return	The number of sweeps plus the number of iterations of the global phase.
+			 **/
+			int64 computeRadiiIncremental(const FPTYPE eps = 10e-9, const FPTYPE delta = 0.05, const int64 maxIteration = -1, const int64 stepIter = 1000)
+				{
+				auto totduration = chrono();
+				const int nb = (int)_nb;
+				const FPTYPE tol = eps;
+				std::vector<int64> mark(nb, -1);	// mark[i] = last sweep in which i was activated
+				std::vector<int32> A, B;
+				for (int32 i : _dirty)
+					{
+					if (mark[i] < 0) { mark[i] = 0; A.push_back(i); }
+					for (int a : _gr[i]) { if ((a < nb) && (mark[a] < 0)) { mark[a] = 0; A.push_back(a); } }
+					}
+				int64 iter = 0, updates = 0;
+				while ((A.size() > 0) && (A.size() * 4 < (size_t)nb) && (iter != maxIteration))
+					{
+					iter++;
+					B.clear();
+					for (int32 i : A)
+						{
+						const FPTYPE v = _rad[i];
+						const FPTYPE theta = internals_circlepacking::angleSumEuclidian(i, _gr, _rad);
+						const FPTYPE k = (FPTYPE)_gr[i].size();
+						const FPTYPE beta = sin(theta*0.5 / k);
+						const FPTYPE tildev = beta*v / (1.0 - beta);
+						const FPTYPE del = sin(_pi / k);
+						_rad[i] = (1.0 - del)*tildev / del;
+						if (std::abs(theta - _twopi) > tol)
+							{
+							if (mark[i] != iter) { mark[i] = iter; B.push_back(i); }
+							for (int a : _gr[i]) { if ((a < nb) && (mark[a] != iter)) { mark[a] = iter; B.push_back(a); } }
+							}
+						}
+					updates += (int64)A.size();
+					A.swap(B);
+					}
+				_dirty.clear();
+				const FPTYPE c = errorL2();
+				if (_verbose)
+					{
+					mtools::cout << "\n  --- Incremental packing [CPU] ---\n\n";
+					mtools::cout << "sweeps            = " << iter << "\n";
+					mtools::cout << "vertex updates    = " << updates << " (" << ((double)updates) / std::max<int>(nb, 1) << " full iterations)\n";
+					mtools::cout << "L2 error          = " << c << "\n";
+					mtools::cout << "time              = " << totduration << "\n\n";
+					}
+				if ((c > eps) && (iter != maxIteration)) { iter += computeRadii(eps, delta, ((maxIteration < 0) ? -1 : (maxIteration - iter)), stepIter); }
+				return iter;
+				}
+
+
+				bool _verbose;	// do we print info on mtools::cout ?
+				bool _reorder;	// renumber the vertices in setTriangulation() ?
+
+				const FPTYPE					_pi;		// pi
+				const FPTYPE					_twopi;		// pi
+
+				std::vector<std::vector<int> >	_gr;		// the graph
+				mtools::Permutation				_perm;		// the permutation applied to get all the boundary vertices at the end
+				std::vector<FPTYPE>				_rad;		// vertex raduises
+				size_t							_nb;		// number of internal vertices
+
+				CSRGraph						_csr;		// the graph in CSR format (used by computeRadiiParallel)
+				std::vector<int32>				_classOff;	// colour classes of the internal vertices (used by computeRadiiParallel)
+				std::vector<int32>				_classList;	//
+
+				std::vector<int32>				_dirty;		// interior vertices modified by updateTriangulation() (used by computeRadiiIncremental)
+
+			};
+
+
+
+
+
+
+
+
+
+
+
+		/**
+		 * Class used to compute the radii associated with the hyperbolic circle packing
+		 * of a triangulation with a boundary.
+		 *
+		 * The algorithm is taken from Collins and Stephenson (2003).
+		 *
+		 * This class computes a 'packing label' in the hyperbolic case. The radii are
+		 * taken and coimputed is the so called s-format where 
+		 *                                  
+		 *                                    s = exp(-h)
+		 *                                    
+		 * and h is the true hyperbolic radii. Thus s = 0 means infinite radius and s = 1
+		 * means 0 radius. 
+		 *
+		 * @tparam	FPTYPE	Floating type that should be used during calculation.
+		 **/
+		template<typename FPTYPE = double> class CirclePackingLabelHyperbolic
+			{
+
+			public:
+
+			/**
+			 * Constructor.
+			 *
+			 * @param	verbose	true to print info to mtools::cout during packing.
+			 */
+			CirclePackingLabelHyperbolic(bool verbose = false) : _verbose(verbose), _reorder(false), _pi(acos((FPTYPE)(-1.0))) , _twopi(2*acos((FPTYPE)(-1.0)))
+				{
+				}
+
+
+			/* dtor, empty object */
+			~CirclePackingLabelHyperbolic() {}
+
 
 			/**
 			* Decide whether packing information should be printed to mtools::cout.
@@ -1113,6 +2402,15 @@ namespace mtools
 			void verbose(bool verb) { _verbose = verb; }
 
 
+			/**
+			 * Decide whether the vertices should be renumbered (reverse Cuthill-McKee ordering) when the
+			 * triangulation is loaded with setTriangulation(). This improves memory locality, hence
+			 * speed, for large triangulations with a random numbering. The numbering used by setRadii()
+			 * and getRadii() is unchanged. Must be called before setTriangulation().
+			 **/
+			void reorderVertices(bool reorder) { _reorder = reorder; }
+
+
 			/** Clears the object to a blank initial state. */
 			void clear()
 				{
@@ -1137,7 +2435,13 @@ namespace mtools
 				clear();
 				const size_t l = graph.size();
 				MTOOLS_INSURE(boundary.size() == l);
-				_perm.setSortPermutation(boundary);
+				if (_reorder)
+					{
+					std::vector<int> isbound(l);
+					for (size_t i = 0; i < l; i++) { isbound[i] = ((boundary[i] > 0) ? 1 : 0); }
+					_perm = internals_circlepacking::reorderPermutation(graph, isbound);
+					}
+				else { _perm.setSortPermutation(boundary); }
 				_gr = permuteGraph<std::vector<std::vector<int> > >(convertGraph<GRAPH, std::vector<std::vector<int> > >(graph), _perm);
 				_nb = l;
 				for (size_t i = 0; i < l; i++)
@@ -1188,29 +2492,15 @@ namespace mtools
 
 
 			/**
-			*
-			*                            TODO
-			*
-			* Compute the error in the circle radius in L2 norm.
+			* Compute the error in the angle sums in L2 norm.
 			*/
-			FPTYPE errorL2() const 
-				{ 
-				//   TODO, compute hyperbolic error
-				return 1;
-				}
+			FPTYPE errorL2() const { return internals_circlepacking::errorL2hyperbolic(_gr, _rad, (int)_nb); }
 
 
 			/**
-			*
-			*                            TODO 
-			*
-			* Compute the error in the circle radius in L1 norm.
+			* Compute the error in the angle sums in L1 norm.
 			*/
-			FPTYPE errorL1() const 
-				{ 
-				//   TODO, compute hyperbolic error
-				return 1;
-				}
+			FPTYPE errorL1() const { return internals_circlepacking::errorL1hyperbolic(_gr, _rad, (int)_nb); }
 
 
 			/**
@@ -1229,7 +2519,7 @@ namespace mtools
 				{
 				auto totduration = chrono();
 				FastRNG gen;					// use to randomize acceleration.
-				FPTYPE minc = errorL2();  // <- currently, this is wrong since errorL2 is not implemented.
+				FPTYPE minc = errorL2();
 				if (_verbose)
 					{ 
 					mtools::cout << "\n  --- Starting Packing Algorithm [CPU] ---\n\n"; 
@@ -1363,6 +2653,7 @@ namespace mtools
 
 
 				bool _verbose;	// do we print info on mtools::cout ?
+				bool _reorder;	// renumber the vertices in setTriangulation() ?
 
 				const FPTYPE					_pi;		// pi
 				const FPTYPE					_twopi;		// pi
@@ -1412,7 +2703,7 @@ namespace mtools
 			 *
 			 * @param	verbose	true print informations to mtools::cout.
 			 */
-			CirclePackingLabelGPU(bool verbose = false) : _verbose(verbose), _localsize(-1), _nbVertices(0), _clbundle(true, verbose, verbose)
+			CirclePackingLabelGPU(bool verbose = false) : _verbose(verbose), _reorder(false), _devbuffers(false), _localsize(-1), _nbVertices(0), _clbundle(true, verbose, verbose)
 				{
 				clear();
 				}
@@ -1430,6 +2721,15 @@ namespace mtools
 			void verbose(bool verb) { _verbose = verb; }
 
 
+			/**
+			 * Decide whether the vertices should be renumbered (reverse Cuthill-McKee ordering) when the
+			 * triangulation is loaded with setTriangulation(). This improves memory locality, hence
+			 * speed, for large triangulations with a random numbering. The numbering used by setRadii()
+			 * and getRadii() is unchanged. Must be called before setTriangulation().
+			 **/
+			void reorderVertices(bool reorder) { _reorder = reorder; }
+
+
 			/** Clears the object to a blank initial state. */
 			void clear()
 				{
@@ -1438,6 +2738,7 @@ namespace mtools
 				_nb = 0;
 				_nbdummy = 0;
 				_rad.clear();
+				_devbuffers = false;
 				}
 
 
@@ -1476,7 +2777,7 @@ namespace mtools
 					}
 				_nb += _nbdummy;
 				// done.
-				_perm.setSortPermutation(boundary);
+				if (_reorder) { _perm = internals_circlepacking::reorderPermutation(_gr, boundary); } else { _perm.setSortPermutation(boundary); }
 				_gr = permuteGraph<std::vector<std::vector<int> > >(_gr, _perm);
 				_rad.resize(_gr.size(), (FPTYPE)1.0);
 				}
@@ -1553,46 +2854,134 @@ namespace mtools
 			 **/
 			int64 computeRadii(const FPTYPE eps = 10e-9, const FPTYPE delta = 0.05, const int64 maxIteration = -1, const int64 stepIter = 1000)
 				{
-				auto totduration = chrono();
+				return _computeRadii(eps, delta, maxIteration, stepIter, false);
+				}
 
-				// recreate kernels if needed
-				_recreateKernels();
 
-				const int nbVerticesPow2 = pow2roundup(_nbVertices); // new power of 2
+			/**
+			 * Mixed precision version of computeRadii().
+			 *
+			 * The radii are first computed in single precision on the device until the error stops
+			 * decreasing (float precision is reached). The result is then refined in double precision:
+			 * on the device if it supports double precision and otherwise on the CPU with
+			 * CirclePackingLabel. Since most of the iterations are performed in float, this is faster
+			 * than computeRadii() on devices with slow (or without) double precision support.
+			 *
+			 * If FPTYPE = float, this method is the same as computeRadii().
+			 *
+			 * @param	eps				the required precision, in L2 norm.
+			 * @param	delta			parameter that determine how super acceleration is performed (slower
+			 * 							value = more restrictive condition to perform acceleration).
+			 * @param	maxIteration	The maximum number of iteration before stopping (for both phases). -1 = no limit.
+			 * @param	stepIter		number of iterations between each check of the current error
+			 * 							(and printing information if verbose = true)
+			 *
+			 * @return	The number of iterations performed (in both phases).
+			 **/
+			int64 computeRadiiMixed(const FPTYPE eps = 10e-12, const FPTYPE delta = 0.05, const int64 maxIteration = -1, const int64 stepIter = 1000)
+				{
+				if (std::is_same<FPTYPE, float>::value) { return computeRadii(eps, delta, maxIteration, stepIter); }
+				// phase 1: single precision on the device
+				int64 iter;
+				{
+				CirclePackingLabelGPU<float> F(false);
+				F.verbose(_verbose);
+				F._gr = _gr;
+				F._perm = _perm;
+				F._nb = _nb;
+				F._nbdummy = _nbdummy;
+				F._rad.resize(_rad.size());
+				for (size_t i = 0; i < _rad.size(); i++) { F._rad[i] = (float)_rad[i]; }
+				if (_verbose) { mtools::cout << "\n  --- Mixed precision packing: phase 1 [float] ---\n"; }
+				iter = F._computeRadii((float)eps, (float)delta, maxIteration, stepIter, true);
+				for (size_t i = 0; i < _nb; i++) { _rad[i] = (FPTYPE)F._rad[i]; }
+				}
+				if (iter == maxIteration) return iter;
+				const int64 maxit = ((maxIteration < 0) ? -1 : (maxIteration - iter));
+				// phase 2: double precision
+				if (_clbundle.supportsDouble())
+					{
+					if (_verbose) { mtools::cout << "\n  --- Mixed precision packing: phase 2 [double, openCL GPU] ---\n"; }
+					return iter + computeRadii(eps, delta, maxit, stepIter);
+					}
+				if (_verbose) { mtools::cout << "\n  --- Mixed precision packing: phase 2 [double, CPU] (the device does not support double precision) ---\n"; }
+				// remove the dummy vertices (they have no neighbours)
+				std::vector<int> newindex(_gr.size(), -1);
+				int n = 0;
+				for (size_t i = 0; i < _gr.size(); i++) { if (_gr[i].size() > 0) { newindex[i] = n++; } }
+				CirclePackingLabel<FPTYPE> P(_verbose);
+				P._gr.resize(n);
+				P._rad.resize(n);
+				P._nb = 0;
+				for (size_t i = 0; i < _gr.size(); i++)
+					{
+					const int j = newindex[i];
+					if (j < 0) continue;
+					for (int k : _gr[i]) { P._gr[j].push_back(newindex[k]); }
+					P._rad[j] = _rad[i];
+					if (i < _nb) { P._nb++; }
+					}
+				iter += P.computeRadii(eps, delta, maxit, stepIter);
+				for (size_t i = 0; i < _gr.size(); i++) { if (newindex[i] >= 0) { _rad[i] = P._rad[newindex[i]]; } }
+				return iter;
+				}
 
-				// create buffers and set their values
+
+			private:
+
+			template<typename T> friend class CirclePackingLabelGPU;
+
+
+			/* run the algorithm on the device. If stopOnPlateau is set, also stop when the error does not decrease anymore */
+			int64 _computeRadii(const FPTYPE eps, const FPTYPE delta, const int64 maxIteration, const int64 stepIter, const bool stopOnPlateau)
 				{
-				std::vector<FPTYPE> buff(nbVerticesPow2, (FPTYPE)0);
-				_buff_error1.reset(new cl::Buffer(_clbundle.context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, sizeof(FPTYPE)*nbVerticesPow2, buff.data()));
-				_buff_error2.reset(new cl::Buffer(_clbundle.context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, sizeof(FPTYPE)*nbVerticesPow2, buff.data()));
+				auto totduration = chrono();
 
-				for (size_t i = 0; i < nbVerticesPow2; i++) { buff[i] = (FPTYPE)1.0e10; }
-				_buff_lambdastar1.reset(new cl::Buffer(_clbundle.context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, sizeof(FPTYPE)*nbVerticesPow2, buff.data()));
-				_buff_lambdastar2.reset(new cl::Buffer(_clbundle.context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, sizeof(FPTYPE)*nbVerticesPow2, buff.data()));
+				// recreate kernels if needed
+				_recreateKernels();
 
-				_buff_radii1.reset(new cl::Buffer(_clbundle.context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, sizeof(FPTYPE)*_nbVertices, _rad.data()));
-				_buff_radii2.reset(new cl::Buffer(_clbundle.context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, sizeof(FPTYPE)*_nbVertices, _rad.data()));
+				const int nbVerticesPow2 = pow2roundup(_nbVertices); // new power of 2
 
-				std::vector<int32> degTab(_nbVertices);
-				std::vector<int32> neighbourTabOff(_nbVertices);
-				std::vector<int32> neighbourTabList; neighbourTabList.reserve(_nbVertices*3);
-				int offset = 0;
-				for (int i = 0; i < _nbVertices; i++) 
-					{ 
-					const int l = (int)(_gr[i].size());
-					degTab[i] = l;
-					neighbourTabOff[i] = offset;
-					for (int j = 0; j < l; j++) 
+				// create the device buffers (kept between calls as long as the triangulation does not change)
+				if (!_devbuffers)
+					{
+					std::vector<FPTYPE> buff(nbVerticesPow2, (FPTYPE)0);
+					_buff_error1.reset(new cl::Buffer(_clbundle.context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, sizeof(FPTYPE)*nbVerticesPow2, buff.data()));
+					_buff_error2.reset(new cl::Buffer(_clbundle.context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, sizeof(FPTYPE)*nbVerticesPow2, buff.data()));
+
+					for (size_t i = 0; i < nbVerticesPow2; i++) { buff[i] = (FPTYPE)1.0e10; }
+					_buff_lambdastar1.reset(new cl::Buffer(_clbundle.context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, sizeof(FPTYPE)*nbVerticesPow2, buff.data()));
+					_buff_lambdastar2.reset(new cl::Buffer(_clbundle.context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, sizeof(FPTYPE)*nbVerticesPow2, buff.data()));
+
+					_buff_radii1.reset(new cl::Buffer(_clbundle.context, CL_MEM_READ_WRITE, sizeof(FPTYPE)*_nbVertices));
+					_buff_radii2.reset(new cl::Buffer(_clbundle.context, CL_MEM_READ_WRITE, sizeof(FPTYPE)*_nbVertices));
+
+					std::vector<int32> degTab(_nbVertices);
+					std::vector<int32> neighbourTabOff(_nbVertices);
+					std::vector<int32> neighbourTabList; neighbourTabList.reserve(_nbVertices*3);
+					int offset = 0;
+					for (int i = 0; i < _nbVertices; i++) 
 						{ 
-						neighbourTabList.push_back((int32)_gr[i][j]); 
-						offset++;
+						const int l = (int)(_gr[i].size());
+						degTab[i] = l;
+						neighbourTabOff[i] = offset;
+						for (int j = 0; j < l; j++) 
+							{ 
+							neighbourTabList.push_back((int32)_gr[i][j]); 
+							offset++;
+							}
 						}
-					}
 
-				_buff_degree.reset(new cl::Buffer(_clbundle.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(int32)*_nbVertices, degTab.data()));
-				_buff_neighbourOff.reset(new cl::Buffer(_clbundle.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(int32)*_nbVertices, neighbourTabOff.data()));
-				_buff_neighbourList.reset(new cl::Buffer(_clbundle.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(int32)*offset, neighbourTabList.data()));
+					_buff_degree.reset(new cl::Buffer(_clbundle.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(int32)*_nbVertices, degTab.data()));
+					_buff_neighbourOff.reset(new cl::Buffer(_clbundle.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(int32)*_nbVertices, neighbourTabOff.data()));
+					_buff_neighbourList.reset(new cl::Buffer(_clbundle.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(int32)*offset, neighbourTabList.data()));
 
+					_buff_param.reset(new cl::Buffer(_clbundle.context, CL_MEM_READ_WRITE, sizeof(FPTYPE_VEC8)));
+					_buff_rng.reset(new cl::Buffer(_clbundle.context, CL_MEM_READ_WRITE, sizeof(UINT_VEC4)));
+					_devbuffers = true;
+					}
+
+				// upload the current radii and the parameters
 				FPTYPE_VEC8 paramTab;
 				FPTYPE ce = errorL2();
 				paramTab[0] = (FPTYPE)(ce);	   	   // error
@@ -1601,12 +2990,12 @@ namespace mtools
 				paramTab[3] = (FPTYPE)eps;         // target value
 				paramTab[4] = (FPTYPE)delta;	   // acceleration parameter
 				paramTab[5] = (FPTYPE)ce;		   // min error
-				_buff_param.reset(new cl::Buffer(_clbundle.context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, sizeof(paramTab), paramTab));
-
 				UINT_VEC4 rngTab;
 				rngTab[0] = 123456789; rngTab[1] = 362436069; rngTab[2] = 521288629; rngTab[3] = 0; // initial seed 
-				_buff_rng.reset(new cl::Buffer(_clbundle.context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, sizeof(rngTab), rngTab));
-				}
+				_clbundle.queue.enqueueWriteBuffer(*_buff_radii1, CL_FALSE, 0, sizeof(FPTYPE)*_nbVertices, _rad.data());
+				_clbundle.queue.enqueueWriteBuffer(*_buff_radii2, CL_FALSE, 0, sizeof(FPTYPE)*_nbVertices, _rad.data());
+				_clbundle.queue.enqueueWriteBuffer(*_buff_param, CL_FALSE, 0, sizeof(paramTab), paramTab);
+				_clbundle.queue.enqueueWriteBuffer(*_buff_rng, CL_TRUE, 0, sizeof(rngTab), rngTab); // blocking: waits for the previous writes too
 
 				// set kernels arguments
 				_kernel_updateRadius->setArg(0, *_buff_radii1);
@@ -1652,7 +3041,12 @@ namespace mtools
 				// make computation
 				int64 iter = 0;
 				bool done = false;
+				bool plateau = false;
+				FPTYPE lastmin = errorL2();
 				auto duration = chrono();
+				FPTYPE_VEC8 param[2];	// the parameters are read in turn in each slot
+				cl::Event readev[2];	// completion of the reads
+				int64 nbreads = 0;
 				while((!done)&&(iter != maxIteration))
 					{
 					iter++;
@@ -1677,36 +3071,51 @@ namespace mtools
 					_clbundle.queue.enqueueNDRangeKernel(*_kernel_accelerate, 0, _nb, cl::NullRange);
 
 					if (iter % stepIter == 0)
-						{
-						FPTYPE_VEC8 param;
-						_clbundle.queue.finish();
-						_clbundle.queue.enqueueReadBuffer(*_buff_param, CL_TRUE, 0, sizeof(param), &param);
-						if (param[0] < eps) { done = true; }												
-						if (_verbose)
+						{ // non-blocking read of the parameters: the result of the previous read is examined
+						  // while the device already works on the next stepIter iterations.
+						const int cur = (int)(nbreads & 1);
+						_clbundle.queue.enqueueReadBuffer(*_buff_param, CL_FALSE, 0, sizeof(FPTYPE_VEC8), param[cur], nullptr, &readev[cur]);
+						_clbundle.queue.flush();
+						nbreads++;
+						if (nbreads >= 2)
 							{
-							mtools::cout << "iteration = " << iter << "\n";
-							mtools::cout << "L2 current error  = " << param[0] << "\n";
-							mtools::cout << "L2 minimum error  = " << param[5] << "\n";
-							mtools::cout << "L2 target         = " << param[3] << "\n";
-							mtools::cout << stepIter << " interations performed in " << duration << "\n\n";
-							duration.reset();
-							}													
+							const FPTYPE * P = param[1 - cur];
+							readev[1 - cur].wait();
+							if (P[0] < eps) { done = true; }
+							if ((stopOnPlateau) && (!done))
+								{ // stop if the minimum error decreased by less than 10% since the last check
+								if (P[5] > (FPTYPE)0.9*lastmin) { done = true; plateau = true; }
+								lastmin = P[5];
+								}
+							if (_verbose)
+								{
+								mtools::cout << "iteration = " << (iter - stepIter) << "\n";
+								mtools::cout << "L2 current error  = " << P[0] << "\n";
+								mtools::cout << "L2 minimum error  = " << P[5] << "\n";
+								mtools::cout << "L2 target         = " << P[3] << "\n";
+								mtools::cout << stepIter << " interations performed in " << duration << "\n\n";
+								duration.reset();
+								}
+							}
 						}
 					}
-				// done, read back the result 
-				_clbundle.queue.finish();
+				// done, read back the result (in order queue: the pending reads complete first)
 				_clbundle.queue.enqueueReadBuffer(*_buff_radii1, CL_TRUE, 0, _nbVertices * sizeof(FPTYPE), _rad.data());
 				if (_verbose)
 					{
-					if (done) 
+					if ((done) && (!plateau))
 						{ 
 						cout << "Total packing time : " << totduration << "\n\n";
 						mtools::cout << "  --- Packing complete ---\n\n"; 
 						}
+					else if (plateau)
+						{
+						cout << "\nFinal L2 error = " << errorL2() << "\n";
+						cout << "Total packing time : " << totduration << "\n\n";
+						mtools::cout << "  --- Packing stopped after " << iter << " iterations (precision limit reached) ---  \n\n";
+						}
 					else
 						{
-						FPTYPE_VEC8 param;
-						_clbundle.queue.enqueueReadBuffer(*_buff_param, CL_TRUE, 0, sizeof(param), &param);
 						cout << "\nFinal L2 error = " << errorL2() << "\n";
 						cout << "Final L1 error = " << errorL1() << "\n\n";
 						cout << "Total packing time : " << totduration << "\n\n";
@@ -1746,11 +3155,13 @@ namespace mtools
 				/* create the openCL kernels if needed */
 				void _recreateKernels()
 					{
+					if ((std::is_same<FPTYPE, double>::value) && (!_clbundle.supportsDouble())) { MTOOLS_ERROR("The openCL device does not support double precision. Use CirclePackingLabelGPU<float> or computeRadiiMixed()."); }
 					const int maxgpsize = _clbundle.maxWorkGroupSize();
 					const int nbvert = (int)_gr.size();
 					if ((maxgpsize == _localsize) && (nbvert == _nbVertices)) { return; }
 					_localsize = maxgpsize;
 					_nbVertices = nbvert;
+					_devbuffers = false;
 
 					// compiler options
 					std::string options;
@@ -1777,6 +3188,8 @@ namespace mtools
 
 
 				bool _verbose;		// do we print info on mtools::cout ?
+				bool _reorder;		// renumber the vertices in setTriangulation() ?
+				bool _devbuffers;	// are the device buffers created for the current triangulation ?
 
 				// define in compiler options
 				int _localsize;
@@ -1815,6 +3228,414 @@ namespace mtools
 
 			};
 
+
+
+		/**
+		 * Same as CirclePackingLabelHyperbolic but use GPU acceleration.
+		 * This class is defined only if the openCL extension is activated.
+		 *
+		 * The s-radii are updated in parallel on the device (Jacobi iterations) with the formula of
+		 * Collins and Stephenson (2003). As for the CPU version, no acceleration is performed.
+		 *
+		 * @tparam	FPTYPE	floating type used for calculations. Must be either double or float.
+		 **/
+		template<typename FPTYPE = double> class CirclePackingLabelHyperbolicGPU
+			{
+
+			using UINT_VEC4   = uint32[4];
+			using FPTYPE_VEC8 = FPTYPE[8];
+
+			static_assert(std::is_same<FPTYPE, double>::value || std::is_same<FPTYPE, float>::value, "mtools::CirclePackingLabelHyperbolicGPU<FPTYPE> can only be instantiated with FPTYPE= double or float.");
+
+			public:
+
+			/**
+			 * Constructor.
+			 *
+			 * @param	verbose	true print informations to mtools::cout.
+			 */
+			CirclePackingLabelHyperbolicGPU(bool verbose = false) : _verbose(verbose), _reorder(false), _localsize(-1), _nbVertices(0), _clbundle(true, verbose, verbose)
+				{
+				clear();
+				}
+
+
+			/* dtor, empty object */
+			~CirclePackingLabelHyperbolicGPU()
+				{
+				}
+
+
+			/**
+			* Decide whether packing information should be printed to mtools::cout.
+			**/
+			void verbose(bool verb) { _verbose = verb; }
+
+
+			/**
+			 * Decide whether the vertices should be renumbered (reverse Cuthill-McKee ordering) when the
+			 * triangulation is loaded with setTriangulation(). The numbering used by setRadii() and
+			 * getRadii() is unchanged. Must be called before setTriangulation().
+			 **/
+			void reorderVertices(bool reorder) { _reorder = reorder; }
+
+
+			/** Clears the object to a blank initial state. */
+			void clear()
+				{
+				_gr.clear();
+				_perm.clear();
+				_nb = 0;
+				_nbdummy = 0;
+				_rad.clear();
+				}
+
+
+			/**
+			* Loads a triangulation and define the boundary vertices.
+			* All inside s-radii are set to 0.5 and all boundary s-radii are set to 0.0 (maximal packing
+			* in the disk with infinite radius for boundary circles.
+			*
+			* @param graph	   The triangulation with boundary.
+			* @param boundary  The boundary vector. Every index i for which boundary[i] > 0
+			* 					is considered to be a boundary vertice.
+			*/
+			template<typename GRAPH> void setTriangulation(const GRAPH & graph, std::vector<int> boundary)
+				{
+				const size_t l = graph.size();
+				MTOOLS_INSURE(l > 4);
+				MTOOLS_INSURE(boundary.size() == l);
+				clear();
+				_nb = 0;
+				for (size_t i = 0; i < l; i++)
+					{
+					if (boundary[i] <= 0.0) { boundary[i] = -(int)graph[i].size() - 2; _nb++; }
+					}
+				MTOOLS_INSURE((_nb > 0) && (_nb < l - 2));
+				_gr = convertGraph<GRAPH, std::vector<std::vector<int> > >(graph);
+				// add dummy vertice so that the number of inner vertices is a multiple of groupsize
+				const int wg = _clbundle.maxWorkGroupSize();
+				const int r = ((int)_nb) % wg;
+				_nbdummy = ((r == 0) ? 0 : (wg - r));
+				_gr.resize(l + _nbdummy);
+				boundary.resize(l + _nbdummy);
+				for (size_t i = l; i < l + _nbdummy; i++)
+					{
+					boundary[i] = -1; // not a boundary site.
+					_gr[i].clear(); // not a real site (degree = 0)
+					}
+				_nb += _nbdummy;
+				// done.
+				if (_reorder) { _perm = internals_circlepacking::reorderPermutation(_gr, boundary); } else { _perm.setSortPermutation(boundary); }
+				_gr = permuteGraph<std::vector<std::vector<int> > >(_gr, _perm);
+				_rad.resize(_gr.size(), (FPTYPE)0);
+				for (size_t i = 0; i < _nb; i++) { _rad[i] = (FPTYPE)0.5; }
+				}
+
+
+			/**
+			* Sets the s-radii of the circle around each vertices.
+			* The s-radii associated with the boundary vertices are not modified during
+			* the circle packing algorithm and serve as Dirichlet condition.
+			*
+			* @param	rad	The s-radii. Any values < 0.0 or > 1.0 is clipped.
+			**/
+			void setRadii(std::vector<FPTYPE> rad)
+				{
+				const size_t l = _gr.size();
+				MTOOLS_INSURE(rad.size() == l - _nbdummy);
+				rad.resize(l, (FPTYPE)0.5);
+				_rad = _perm.getPermute(rad);
+				for (size_t i = 0; i < l; i++) { if (_rad[i] < (FPTYPE)0.0) _rad[i] = 0.0; else if (_rad[i] > (FPTYPE)1.0) _rad[i] = 1.0; }
+				}
+
+
+			/**
+			* Sets all s-radii to r.
+			**/
+			void setRadii(FPTYPE r = 0.5)
+				{
+				MTOOLS_INSURE((r >= (FPTYPE)0.0)&&(r <= (FPTYPE)1.0));
+				const size_t l = _gr.size();
+				_rad.resize(l);
+				for (size_t i = 0; i < l; i++) { _rad[i] = r; }
+				}
+
+
+			/**
+			* Return the list of s-radii.
+			*/
+			std::vector<FPTYPE> getRadii() const
+				{
+				std::vector<FPTYPE> r = _perm.getAntiPermute(_rad);
+				r.resize(r.size() - _nbdummy);
+				return r;
+				}
+
+
+			/**
+			* Compute the error in the angle sums in L2 norm.
+			*/
+			FPTYPE errorL2() const { return internals_circlepacking::errorL2hyperbolic(_gr, _rad, (int)_nb); }
+
+
+			/**
+			* Compute the error in the angle sums in L1 norm.
+			*/
+			FPTYPE errorL1() const { return internals_circlepacking::errorL1hyperbolic(_gr, _rad, (int)_nb); }
+
+
+			/**
+			 * Run the algorithm for computing the value of the s-radii.
+			 *
+			 * @param	eps				the required precision, in L2 norm.
+			 * @param	delta			not used (no acceleration), kept for compatibility with
+			 * 							CirclePackingLabelGPU.
+			 * @param	maxIteration	The maximum number of iteration before stopping. -1 = no limit.
+			 * @param	stepIter		number of iterations between each check of the current error
+			 * 							(and printing information if verbose = true)
+			 *
+			 * @return	The number of iterations performed.
+			 **/
+			int64 computeRadii(const FPTYPE eps = 10e-9, const FPTYPE delta = 0.05, const int64 maxIteration = -1, const int64 stepIter = 1000)
+				{
+				auto totduration = chrono();
+
+				// recreate kernels if needed
+				_recreateKernels();
+
+				const int nbVerticesPow2 = pow2roundup(_nbVertices); // new power of 2
+
+				// create buffers and set their values
+				{
+				std::vector<FPTYPE> buff(nbVerticesPow2, (FPTYPE)0);
+				_buff_error1.reset(new cl::Buffer(_clbundle.context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, sizeof(FPTYPE)*nbVerticesPow2, buff.data()));
+				_buff_error2.reset(new cl::Buffer(_clbundle.context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, sizeof(FPTYPE)*nbVerticesPow2, buff.data()));
+
+				for (size_t i = 0; i < nbVerticesPow2; i++) { buff[i] = (FPTYPE)1.0e10; }
+				_buff_lambdastar1.reset(new cl::Buffer(_clbundle.context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, sizeof(FPTYPE)*nbVerticesPow2, buff.data()));
+				_buff_lambdastar2.reset(new cl::Buffer(_clbundle.context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, sizeof(FPTYPE)*nbVerticesPow2, buff.data()));
+
+				_buff_radii1.reset(new cl::Buffer(_clbundle.context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, sizeof(FPTYPE)*_nbVertices, _rad.data()));
+				_buff_radii2.reset(new cl::Buffer(_clbundle.context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, sizeof(FPTYPE)*_nbVertices, _rad.data()));
+
+				std::vector<int32> degTab(_nbVertices);
+				std::vector<int32> neighbourTabOff(_nbVertices);
+				std::vector<int32> neighbourTabList; neighbourTabList.reserve(_nbVertices*3);
+				int offset = 0;
+				for (int i = 0; i < _nbVertices; i++)
+					{
+					const int l = (int)(_gr[i].size());
+					degTab[i] = l;
+					neighbourTabOff[i] = offset;
+					for (int j = 0; j < l; j++)
+						{
+						neighbourTabList.push_back((int32)_gr[i][j]);
+						offset++;
+						}
+					}
+
+				_buff_degree.reset(new cl::Buffer(_clbundle.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(int32)*_nbVertices, degTab.data()));
+				_buff_neighbourOff.reset(new cl::Buffer(_clbundle.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(int32)*_nbVertices, neighbourTabOff.data()));
+				_buff_neighbourList.reset(new cl::Buffer(_clbundle.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(int32)*offset, neighbourTabList.data()));
+
+				FPTYPE_VEC8 paramTab;
+				FPTYPE ce = errorL2();
+				paramTab[0] = (FPTYPE)(ce);	   	   // error
+				paramTab[1] = (FPTYPE)1.0;		   // lambda
+				paramTab[2] = (FPTYPE)1.0;		   // flag acceleration
+				paramTab[3] = (FPTYPE)eps;         // target value
+				paramTab[4] = (FPTYPE)delta;	   // acceleration parameter
+				paramTab[5] = (FPTYPE)ce;		   // min error
+				_buff_param.reset(new cl::Buffer(_clbundle.context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, sizeof(paramTab), paramTab));
+
+				UINT_VEC4 rngTab;
+				rngTab[0] = 123456789; rngTab[1] = 362436069; rngTab[2] = 521288629; rngTab[3] = 0; // initial seed
+				_buff_rng.reset(new cl::Buffer(_clbundle.context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, sizeof(rngTab), rngTab));
+				}
+
+				// set kernels arguments
+				_kernel_updateRadius1->setArg(0, *_buff_radii1);
+				_kernel_updateRadius1->setArg(1, *_buff_radii2);
+				_kernel_updateRadius1->setArg(2, *_buff_degree);
+				_kernel_updateRadius1->setArg(3, *_buff_neighbourOff);
+				_kernel_updateRadius1->setArg(4, *_buff_neighbourList);
+				_kernel_updateRadius1->setArg(5, *_buff_error1);
+				_kernel_updateRadius1->setArg(6, *_buff_lambdastar1);
+
+				_kernel_updateRadius2->setArg(0, *_buff_radii2);
+				_kernel_updateRadius2->setArg(1, *_buff_radii1);
+				_kernel_updateRadius2->setArg(2, *_buff_degree);
+				_kernel_updateRadius2->setArg(3, *_buff_neighbourOff);
+				_kernel_updateRadius2->setArg(4, *_buff_neighbourList);
+				_kernel_updateRadius2->setArg(5, *_buff_error1);
+				_kernel_updateRadius2->setArg(6, *_buff_lambdastar1);
+
+				_kernel_reduction1->setArg(0, *_buff_error1);
+				_kernel_reduction1->setArg(1, *_buff_error2);
+				_kernel_reduction1->setArg(2, *_buff_lambdastar1);
+				_kernel_reduction1->setArg(3, *_buff_lambdastar2);
+
+				_kernel_reduction2->setArg(0, *_buff_error2);
+				_kernel_reduction2->setArg(1, *_buff_error1);
+				_kernel_reduction2->setArg(2, *_buff_lambdastar2);
+				_kernel_reduction2->setArg(3, *_buff_lambdastar1);
+
+				_kernel_reduction_finale1->setArg(0, *_buff_error1);
+				_kernel_reduction_finale1->setArg(1, *_buff_lambdastar1);
+				_kernel_reduction_finale1->setArg(2, *_buff_param);
+				_kernel_reduction_finale1->setArg(3, *_buff_rng);
+
+				_kernel_reduction_finale2->setArg(0, *_buff_error2);
+				_kernel_reduction_finale2->setArg(1, *_buff_lambdastar2);
+				_kernel_reduction_finale2->setArg(2, *_buff_param);
+				_kernel_reduction_finale2->setArg(3, *_buff_rng);
+
+				if (_verbose)
+					{
+					mtools::cout << "\n  --- Starting Hyperbolic Packing Algorithm [openCL GPU] ---\n\n";
+					mtools::cout << "initial L2 error  = " << errorL2() << "\n";
+					mtools::cout << "L2 target         = " << eps << "\n";
+					mtools::cout << "max iterations    = " << maxIteration << "\n";
+					mtools::cout << "iter between info = " << stepIter << "\n\n";
+					}
+				// make computation
+				int64 iter = 0;
+				bool done = false;
+				auto duration = chrono();
+				while ((!done) && (iter != maxIteration))
+					{
+					// update the s-radii, alternate between radii1 -> radii2 and radii2 -> radii1
+					_clbundle.queue.enqueueNDRangeKernel(((iter % 2 == 0) ? *_kernel_updateRadius1 : *_kernel_updateRadius2), 0, _nb, cl::NullRange);
+					iter++;
+
+					// compute the total error
+					int globalsize = nbVerticesPow2;
+					int flip = 1;
+					while (globalsize > _localsize)
+						{
+						_clbundle.queue.enqueueNDRangeKernel(((flip == 1) ? *_kernel_reduction1 : *_kernel_reduction2), 0, globalsize, _localsize);
+						flip = 1 - flip;
+						globalsize /= _localsize;
+						}
+
+					// complete the reduction
+					_clbundle.queue.enqueueNDRangeKernel(((flip == 1) ? *_kernel_reduction_finale1 : *_kernel_reduction_finale2), 0, globalsize, globalsize);
+
+					if (iter % stepIter == 0)
+						{
+						FPTYPE_VEC8 param;
+						_clbundle.queue.finish();
+						_clbundle.queue.enqueueReadBuffer(*_buff_param, CL_TRUE, 0, sizeof(param), &param);
+						if (param[0] < eps) { done = true; }
+						if (_verbose)
+							{
+							mtools::cout << "iteration = " << iter << "\n";
+							mtools::cout << "L2 current error  = " << param[0] << "\n";
+							mtools::cout << "L2 minimum error  = " << param[5] << "\n";
+							mtools::cout << "L2 target         = " << param[3] << "\n";
+							mtools::cout << stepIter << " interations performed in " << duration << "\n\n";
+							duration.reset();
+							}
+						}
+					}
+				// done, read back the result (the last update wrote into radii2 if iter is odd)
+				_clbundle.queue.finish();
+				_clbundle.queue.enqueueReadBuffer(((iter % 2 == 1) ? *_buff_radii2 : *_buff_radii1), CL_TRUE, 0, _nbVertices * sizeof(FPTYPE), _rad.data());
+				if (_verbose)
+					{
+					if (done)
+						{
+						cout << "Total packing time : " << totduration << "\n\n";
+						mtools::cout << "  --- Packing complete ---\n\n";
+						}
+					else
+						{
+						cout << "\nFinal L2 error = " << errorL2() << "\n";
+						cout << "Final L1 error = " << errorL1() << "\n\n";
+						cout << "Total packing time : " << totduration << "\n\n";
+						mtools::cout << "  --- Packing stopped after " << iter << " iterations ---  \n\n";
+						}
+					}
+				return iter;
+				}
+
+
+			private:
+
+
+				/* create the openCL kernels if needed */
+				void _recreateKernels()
+					{
+					if ((std::is_same<FPTYPE, double>::value) && (!_clbundle.supportsDouble())) { MTOOLS_ERROR("The openCL device does not support double precision. Use CirclePackingLabelHyperbolicGPU<float>."); }
+					const int maxgpsize = _clbundle.maxWorkGroupSize();
+					const int nbvert = (int)_gr.size();
+					if ((maxgpsize == _localsize) && (nbvert == _nbVertices)) { return; }
+					_localsize = maxgpsize;
+					_nbVertices = nbvert;
+
+					// compiler options
+					std::string options;
+					options += std::string(" -DFPTYPE=") + typeid(FPTYPE).name();
+					options += std::string(" -DFPTYPE_VEC8=") + typeid(FPTYPE).name() + "8";
+					options += " -DNBVERTICES=" + toString(_nbVertices);
+					options += " -DMAXGROUPSIZE=" + toString(_localsize);
+
+					// build program
+					std::string log;
+					_prog.reset(new cl::Program(_clbundle.createProgramFromString(internals_circlepacking::circlePacking_openCLprogram, log, options, _verbose))); // create programm
+
+					// create kernels objects
+					_kernel_updateRadius1.reset(new cl::Kernel(_clbundle.createKernel(*_prog, "updateRadiusHyperbolic", _verbose)));	// create kernel rad1 -> rad2
+					_kernel_updateRadius2.reset(new cl::Kernel(_clbundle.createKernel(*_prog, "updateRadiusHyperbolic", _verbose)));	// create kernel rad2 -> rad1
+					_kernel_reduction1.reset(new cl::Kernel(_clbundle.createKernel(*_prog, "reduction", _verbose)));					// create kernel error1 -> error2
+					_kernel_reduction2.reset(new cl::Kernel(_clbundle.createKernel(*_prog, "reduction", _verbose)));					// create kernel error2 -> error1
+					_kernel_reduction_finale1.reset(new cl::Kernel(_clbundle.createKernel(*_prog, "reduction_finale", _verbose)));	// create kernel error1 -> param
+					_kernel_reduction_finale2.reset(new cl::Kernel(_clbundle.createKernel(*_prog, "reduction_finale", _verbose)));	// create kernel error2 -> param
+					return;
+					}
+
+
+				bool _verbose;		// do we print info on mtools::cout ?
+				bool _reorder;		// renumber the vertices in setTriangulation() ?
+
+				// define in compiler options
+				int _localsize;
+				int _nbVertices;
+
+				// openCL bundle
+				mtools::OpenCLBundle			_clbundle;
+
+				// kernels
+				std::unique_ptr<cl::Program> _prog;
+				std::unique_ptr<cl::Kernel>  _kernel_updateRadius1;
+				std::unique_ptr<cl::Kernel>  _kernel_updateRadius2;
+				std::unique_ptr<cl::Kernel>  _kernel_reduction1;
+				std::unique_ptr<cl::Kernel>  _kernel_reduction2;
+				std::unique_ptr<cl::Kernel>  _kernel_reduction_finale1;
+				std::unique_ptr<cl::Kernel>  _kernel_reduction_finale2;
+
+				// buffer
+				std::unique_ptr<cl::Buffer> _buff_error1;
+				std::unique_ptr<cl::Buffer> _buff_error2;
+				std::unique_ptr<cl::Buffer> _buff_lambdastar1;
+				std::unique_ptr<cl::Buffer> _buff_lambdastar2;
+				std::unique_ptr<cl::Buffer> _buff_radii1;
+				std::unique_ptr<cl::Buffer> _buff_radii2;
+				std::unique_ptr<cl::Buffer> _buff_degree;
+				std::unique_ptr<cl::Buffer> _buff_neighbourOff;
+				std::unique_ptr<cl::Buffer> _buff_neighbourList;
+				std::unique_ptr<cl::Buffer> _buff_param;
+				std::unique_ptr<cl::Buffer> _buff_rng;
+
+				std::vector<std::vector<int> >	_gr;		// the graph
+				mtools::Permutation				_perm;		// the permutation applied to get all the boundary vertices at the end
+				std::vector<FPTYPE>				_rad;		// vertex s-radii
+				size_t							_nb;		// number of internal vertices (including the dummy ones)
+				size_t							_nbdummy;   // number of 'dummy' vertices added so that _nb is a multiple of the work group size
+
+			};
+
 #endif
 
 
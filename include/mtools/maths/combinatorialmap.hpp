@@ -29,6 +29,13 @@
 #include "../random/classiclaws.hpp"
 #include "permutation.hpp"
 #include "dyckword.hpp"
+#include "../misc/internal/threadworker.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <memory>
 
 namespace mtools
 	{
@@ -73,7 +80,7 @@ namespace mtools
 		public:
 
 			/** Default constructor. create a map with a single edge */
-			CombinatorialMap()
+			CombinatorialMap() : _growth(false), _invok(false), _vdegok(false), _fsizeok(false)
 				{
 				_root = 0;
 				_alpha.resize(2);
@@ -87,7 +94,7 @@ namespace mtools
 
 
 			/** Create a n-gon (a cycle with n=edges i.e. 2n darts) */
-			CombinatorialMap(int n)
+			CombinatorialMap(int n) : _growth(false), _invok(false), _vdegok(false), _fsizeok(false)
 				{
 				makeNgon(n);
 				}
@@ -107,7 +114,7 @@ namespace mtools
 			* such that phi(i) = i+1. The numbering of the vertices also start from the
 			* root vertex (ie vertice(0) =0) and follow the contour of the tree.
 			**/
-			CombinatorialMap(const DyckWord & dw)
+			CombinatorialMap(const DyckWord & dw) : _growth(false), _invok(false), _vdegok(false), _fsizeok(false)
 				{
 				fromDyckWord(dw);
 				}
@@ -122,7 +129,7 @@ namespace mtools
 			* @param	root	  	The oriented root edge. If it does not belong to the graph, the dart edge
 			* 						is set to 0.
    		    **/
-			template<typename GRAPH> CombinatorialMap(const GRAPH & gr, std::pair<int, int> root = std::pair<int, int>(-1, -1))
+			template<typename GRAPH> CombinatorialMap(const GRAPH & gr, std::pair<int, int> root = std::pair<int, int>(-1, -1)) : _growth(false), _invok(false), _vdegok(false), _fsizeok(false)
 				{
 				fromGraph(gr,root);
 				}
@@ -193,11 +200,12 @@ namespace mtools
 			/**
 			* Inverse of permutation sigma. Give the previous dart when 
 			* rotating around a vertex in the positive orientation. 
-			* (slower that sigma).
+			* (slower that sigma unless the growth mode is on, see setGrowthMode()).
 			**/
 			inline int invsigma(int i) const
 				{
 				MTOOLS_ASSERT((i >= 0) && (i < nbDarts()));
+				if (_invok) return _invsigma[i];
 				int prev = i; 
 				while (_sigma[prev] != i) { prev = _sigma[prev]; }
 				return prev;
@@ -219,7 +227,7 @@ namespace mtools
 			/**
 			* Inverse of permutation phi. 
 			* Rotate around a face in the other direction 
-			* (slower than phi).
+			* (slower than phi unless the growth mode is on).
 			**/
 			inline int invphi(int i) const
 				{
@@ -228,6 +236,49 @@ namespace mtools
 				}
 
 
+			/**
+			 * Enable/disable the growth mode. This mode is intended for maps that are grown incrementally
+			 * with addTriangle(), addTriangles(), addSplittingTriangle(), collapseFaceOfSize2() or the
+			 * peeling algorithms (peelUIPT(), freeBoltzmannTriangulation()...).
+			 * 
+			 * When the growth mode is on, the object keeps a table for the inverse of sigma so that
+			 * invsigma() and invphi() run in constant time instead of time proportional to the degree of
+			 * the vertex. The table is constructed lazily (on the next incremental operation) and is
+			 * updated by the incremental operations whereas any other modification of the map simply
+			 * invalidates it. This costs an additional int per dart.
+			 *
+			 * @param	enable 	true to turn the growth mode on, false to turn it off (and release the
+			 * 					memory used by the table).
+			 * @param	nbdarts	if positive, memory is reserved for this number of darts (see reserveDarts()).
+			 **/
+			void setGrowthMode(bool enable, int nbdarts = 0)
+				{
+				_growth = enable;
+				if (!enable) { _invok = false; std::vector<int>().swap(_invsigma); }
+				if (nbdarts > 0) reserveDarts(nbdarts);
+				}
+
+
+			/**
+			 * Query whether the growth mode is on.
+			 **/
+			bool growthMode() const { return _growth; }
+
+
+			/**
+			 * Reserve memory for a given total number of darts so that growing the map up to this size
+			 * does not trigger any reallocation.
+			 **/
+			void reserveDarts(int nbdarts)
+				{
+				_alpha.reserve(nbdarts);
+				_sigma.reserve(nbdarts);
+				_vertices.reserve(nbdarts);
+				_faces.reserve(nbdarts);
+				if (_growth) _invsigma.reserve(nbdarts);
+				}
+
+
 			/**
 			* Number of vertices of the graph. 
 			**/
@@ -247,6 +298,8 @@ namespace mtools
 
 			/**
 			* Compute the degree of the vertex that is the start point of a given dart.
+			* Constant time when the degrees are cached (see computeInvariants()), otherwise
+			* proportional to the degree.
 			*
 			* @param	dartIndex	the dart index whose start vertex's degree is to be computed.
 			* 						(note that this is NOT the index of the vertex itself!).
@@ -256,6 +309,7 @@ namespace mtools
 			int vertexDegree(int dartIndex) const 
 				{
 				MTOOLS_ASSERT((dartIndex >= 0) && (dartIndex < nbDarts()));
+				if (_vdegok) return _vdeg[_vertices[dartIndex]];
 				int n = 1, j= sigma(dartIndex);
 				while (j != dartIndex) { j = sigma(j); n++; }
 				return n;
@@ -269,6 +323,13 @@ namespace mtools
 			std::vector<int> getVerticeVector() const { return _vertices; }
 
 
+			/**
+			* Return a vector of size nbVertices() with the degree of each vertex
+			* (indexed by the vertex index). Linear time. 
+			**/
+			std::vector<int> getVertexDegreeVector() const { return (_vdegok ? _vdeg : _countLabels(_vertices, _nbvertices)); }
+
+
 			/**
 			* Number of faces of the graph.
 			**/
@@ -287,6 +348,8 @@ namespace mtools
 
 			/**
 			* Compute the number of edge that compose the face to which a given dart belongs.
+			* Constant time when the face sizes are cached (see computeInvariants()), otherwise
+			* proportional to the size of the face.
 			*
 			* @param	dartIndex	the dart index whose associated face size is to be computed.
 			* 						(note that this is NOT the index of the face itself!).
@@ -296,6 +359,7 @@ namespace mtools
 			int faceSize(int dartIndex) const
 				{
 				MTOOLS_ASSERT((dartIndex >= 0) && (dartIndex < nbDarts()));
+				if (_fsizeok) return _fsize[_faces[dartIndex]];
 				int n = 1, j = phi(dartIndex);
 				while (j != dartIndex) { j = phi(j); n++; }
 				return n;
@@ -309,6 +373,37 @@ namespace mtools
 			std::vector<int> getFaceVector() const { return _faces; }
 
 
+			/**
+			* Return a vector of size nbFaces() with the number of edges of each face
+			* (indexed by the face index). Linear time.
+			**/
+			std::vector<int> getFaceSizeVector() const { return (_fsizeok ? _fsize : _countLabels(_faces, _nbfaces)); }
+
+
+			/**
+			 * Cache the degree of every vertex and the size of every face so that vertexDegree() and
+			 * faceSize() run in constant time. Linear time, the numbering of the vertices and faces is
+			 * unchanged.
+			 *
+			 * The cache is filled automatically each time the vertex or face sets are recomputed from
+			 * scratch (construction, triangulate(), collapsetoTypeIII()...) and is dropped by any
+			 * other modification of the map (the incremental operations such as addTriangle() or the
+			 * peeling algorithms). Call this method again after such modifications when many degree
+			 * queries follow.
+			 **/
+			void computeInvariants()
+				{
+				if (!_vdegok) { _vdeg = _countLabels(_vertices, _nbvertices); _vdegok = true; }
+				if (!_fsizeok) { _fsize = _countLabels(_faces, _nbfaces); _fsizeok = true; }
+				}
+
+
+			/**
+			 * Query whether the vertex degrees and face sizes are currently cached.
+			 **/
+			bool hasCachedInvariants() const { return (_vdegok && _fsizeok); }
+
+
 			/**
 			 * Query the genus of the combinatorial map (euler characteristic).
 			 * The return value is zero i.i.f. this combinatorial map corresponds
@@ -360,6 +455,8 @@ namespace mtools
 				cm._nbvertices = _nbfaces;
 				cm._faces = _vertices;
 				cm._nbfaces = _nbvertices;
+				cm._vdeg = _fsize; cm._vdegok = _fsizeok;	// face sizes become vertex degrees
+				cm._fsize = _vdeg; cm._fsizeok = _vdegok;
 				cm._root = _root;
 				return cm;
 				}
@@ -374,6 +471,8 @@ namespace mtools
 			 **/
 			void makeNgon(int n)
 				{
+				_invok = false;
+				_invalidateInvariants();
 				_root = 0;
 				_nbvertices = n;
 				_nbfaces = 2;				
@@ -408,6 +507,8 @@ namespace mtools
 			**/
 			void fromDyckWord(const DyckWord & dw)
 				{
+				_invok = false;
+				_invalidateInvariants();
 				const int n = dw.nbedges();
 				MTOOLS_ASSERT(n > 0);           // tree must have at least 1 edges
 				_sigma.reserve(2 * (n + 1));	// make it faster to add an edge later on. 
@@ -503,6 +604,8 @@ namespace mtools
 			 **/
 			template<typename GRAPH> std::map< std::pair<int, int>, int> fromGraph(const GRAPH & gr, std::pair<int,int> root = std::pair<int, int>(-1,-1))
 				{
+				_invok = false;
+				_invalidateInvariants();
 				MTOOLS_ASSERT(isGraphSimple(gr)); // make sure the graph is simple (unoriented without loop nor double edges). 
 				MTOOLS_ASSERT(!isGraphEmpty(gr)); // make sure the graph is not empty
 				const int nbv = (int)gr.size();
@@ -582,6 +685,7 @@ namespace mtools
 			 **/
 			int triangulate() 
 				{
+				_invalidateInvariants();
 				const int nbv = nbVertices();
 				const int l = nbDarts();
 				for (int i = 0; i < l; i++) 
@@ -609,6 +713,8 @@ namespace mtools
 			 **/
 			int triangulateFace(int dartIndex)
 				{
+				_invok = false;
+				_invalidateInvariants();
 				int d = _triangulateFace(dartIndex);
 				_computeFaceSet();
 				CHECKCONSISTENCY;
@@ -647,6 +753,8 @@ namespace mtools
 					}
 				cm._nbvertices = _nbvertices;
 				cm._nbfaces = _nbfaces;
+				cm._vdeg = _vdeg; cm._vdegok = _vdegok;
+				cm._fsize = _fsize; cm._fsizeok = _fsizeok;
 				cm._root = perm.inv(_root);
 				CHECKCONSISTENCY;
 				return cm;
@@ -669,6 +777,8 @@ namespace mtools
 			 **/
 			std::tuple<int,int,int> btreeToTriangulation()
 				{
+				_invok = false;
+				_invalidateInvariants();
 				CHECKCONSISTENCY;
 				// we need to make sure that the numbering of the edges follow the contour of the tree.
 				const int len = nbDarts();
@@ -688,12 +798,12 @@ namespace mtools
 				if (needreorder)
 					{
 					Permutation perm(ord);
-					auto _alpha2 = _alpha;
-					auto _sigma2 = _sigma;
+					perm.permute(_sigma); // in place
+					perm.permute(_alpha);
 					for (int i = 0; i < len; i++)
 						{
-						_sigma[i] = perm.inv(_sigma2[perm[i]]);
-						_alpha[i] = perm.inv(_alpha2[perm[i]]);
+						_sigma[i] = perm.inv(_sigma[i]);
+						_alpha[i] = perm.inv(_alpha[i]);
 						}
 					}				
 				// ok, now have a tree in canonical order, we can apply the algorithm.				
@@ -803,11 +913,44 @@ namespace mtools
 			void addTriangle(int dartIndex)
 				{
 				CHECKCONSISTENCY;
+				_invalidateInvariants();
+				_syncInverse();
 				_addTriangle(dartIndex);
 				CHECKCONSISTENCY;
 				}
 
 
+			/**
+			 * Add n triangles in a row on the same face. Equivalent to (but faster than) calling n times:
+			 * 
+			 *     addTriangle(dartIndex); dartIndex = invphi(dartIndex);
+			 *     
+			 * (this is what the peeling by layer does when it discovers n new vertices in a row). In
+			 * growth mode, invphi() is constant time so the whole operation runs in O(n).
+			 *
+			 * @param	dartIndex	The dart PRECEDING the one to which the first face should be added.
+			 * @param	n		 	number of triangles to add.
+			 *
+			 * @return	the final value of dartIndex (i.e. the dart preceding the next edge to peel).
+			 **/
+			int addTriangles(int dartIndex, int n)
+				{
+				CHECKCONSISTENCY;
+				if (n <= 0) return dartIndex;
+				_invalidateInvariants();
+				_syncInverse();
+				const int l = (int)_alpha.size();
+				if (l + 4 * n > (int)_alpha.capacity()) reserveDarts(std::max<int>(l + 4 * n, 2 * l));
+				for (int i = 0; i < n; i++)
+					{
+					_addTriangle(dartIndex);
+					dartIndex = invphi(dartIndex);
+					}
+				CHECKCONSISTENCY;
+				return dartIndex;
+				}
+
+
 			/**
 			 * Add a triangle inside a face, effectively splitting it into 3 faces, the center one being the
 			 * triangle. Just like addTriangle(), the base of the triangle is the NEXT edge after dartIndexBase 
@@ -828,6 +971,8 @@ namespace mtools
 			 * @param   collapsedoubleedge  true to collapse double edges created if dartIndexTarget is either
 			 * 								invphi(dartIndexBase) or phi(phi(dartIndexBase)). In this case,
 			 * 								the parralel edges that should be created are ignored.
+			 * @param	facesize			The size of the face being split, if known (otherwise set it to -1 and
+			 * 								it is computed when needed, in time proportional to the size).
 			 *
 			 * Returns the size (len) of the face that contain [dartIndexTarget].
 			 *         the size of the face that contain [dartIndexBase] is (initialFaceSize - len + 1).
@@ -835,10 +980,13 @@ namespace mtools
 			 *         -> if collapsedoubleedge = true, the method still return 2 when a face was not 
 			 *            created since it would have has size 2.
 			 */
-			int addSplittingTriangle(int dartIndexBase, int dartIndexTarget, bool collapsedoubleedge = true)
+			int addSplittingTriangle(int dartIndexBase, int dartIndexTarget, bool collapsedoubleedge = true, int facesize = -1)
 				{
 				CHECKCONSISTENCY;
-				int len = _addSplittingTriangle(dartIndexBase, dartIndexTarget, collapsedoubleedge);
+				MTOOLS_ASSERT((facesize < 0) || (facesize == faceSize(dartIndexBase)));
+				_invalidateInvariants();
+				_syncInverse();
+				int len = _addSplittingTriangle(dartIndexBase, dartIndexTarget, collapsedoubleedge, facesize);
 				CHECKCONSISTENCY;
 				return len;
 				}
@@ -863,6 +1011,8 @@ namespace mtools
 			void collapseFaceOfSize2(int dart)
 				{
 				CHECKCONSISTENCY;
+				_invalidateInvariants();
+				_syncInverse();
 				const int f1 = _collapseFaceOfSize2(dart);  // remove the face
 				const int f2 = _nbfaces - 1;
 				const int l = (int)_alpha.size();
@@ -905,6 +1055,8 @@ namespace mtools
 			void boltzmannPeelingAlgo(int predart, std::function< int(int,int)> fun, bool collapsedoubleedge = true)
 				{
 				CHECKCONSISTENCY;
+				_invalidateInvariants();
+				_syncInverse();
 				_boltzmannPeelingAlgo(predart, fun, faceSize(predart), collapsedoubleedge); // run the algorithm recursively
 				CHECKCONSISTENCY;
 				return;
@@ -925,6 +1077,8 @@ namespace mtools
 			 **/
 			Permutation collapsetoTypeIII()
 				{
+				_invok = false;
+				_invalidateInvariants();
 				CHECKCONSISTENCY;
 				return _collapsetoTypeIII();
 				}
@@ -965,6 +1119,8 @@ namespace mtools
 			**/
 			template<typename ARCHIVE> void serialize(ARCHIVE & ar, const int version = 0)
 				{
+				_invok = false;
+				_invalidateInvariants();
 				ar & _root;
 				ar & _nbvertices;
 				ar & _nbfaces;
@@ -1068,10 +1224,7 @@ namespace mtools
 			void _addTriangle(int dartIndex)
 				{
 				const int l = (int)_alpha.size();
-				_alpha.resize(l + 4);
-				_sigma.resize(l + 4);
-				_vertices.resize(l + 4);
-				_faces.resize(l + 4);
+				_resizeDarts(l + 4);
 
 				const int F = _faces[dartIndex];
 				const int a = _alpha[dartIndex];
@@ -1084,9 +1237,9 @@ namespace mtools
 				_alpha[l + 0] = l + 1;  _alpha[l + 1] = l + 0;
 				_alpha[l + 2] = l + 3;  _alpha[l + 3] = l + 2;
 
-				_sigma[a] = l + 0; _sigma[l + 0] = b;
-				_sigma[c] = l + 3; _sigma[l + 3] = d;
-				_sigma[l + 1] = l + 2; _sigma[l + 2] = l + 1;
+				_setsigma(a, l + 0); _setsigma(l + 0, b);
+				_setsigma(c, l + 3); _setsigma(l + 3, d);
+				_setsigma(l + 1, l + 2); _setsigma(l + 2, l + 1);
 
 				_vertices[l + 0] = v1;
 				_vertices[l + 3] = v2;
@@ -1104,7 +1257,7 @@ namespace mtools
 
 
 			/* Private method */
-			int _addSplittingTriangle(int dartIndexBase, int dartIndexTarget, bool collapsedoubleedge)
+			int _addSplittingTriangle(int dartIndexBase, int dartIndexTarget, bool collapsedoubleedge, int facesize = -1)
 				{
 				MTOOLS_ASSERT((dartIndexBase >= 0) && (dartIndexBase < (int)_alpha.size()));
 				MTOOLS_ASSERT((dartIndexTarget >= 0) && (dartIndexTarget < (int)_alpha.size()));
@@ -1124,10 +1277,7 @@ namespace mtools
 				if (ignore2)
 					{ // only 1 edge to add. 
 					const int l = (int)_alpha.size();
-					_alpha.resize(l + 2);
-					_sigma.resize(l + 2);
-					_vertices.resize(l + 2);
-					_faces.resize(l + 2);
+					_resizeDarts(l + 2);
 					const int F = _faces[dartIndexBase];
 					const int a = _alpha[dartIndexBase];
 					const int b = _sigma[a];
@@ -1139,8 +1289,8 @@ namespace mtools
 					//const int v2 = _vertices[c];
 					const int v3 = _vertices[e];
 					_alpha[l + 0] = l + 1;  _alpha[l + 1] = l + 0;
-					_sigma[a] = l + 0; _sigma[l + 0] = b;
-					_sigma[e] = l + 1; _sigma[l + 1] = f;
+					_setsigma(a, l + 0); _setsigma(l + 0, b);
+					_setsigma(e, l + 1); _setsigma(l + 1, f);
 					_vertices[l + 0] = v1;
 					_vertices[l + 1] = v3;
 					_faces[l + 0] = F;
@@ -1153,12 +1303,9 @@ namespace mtools
 
 				if (ignore1)
 					{ // only 1 edge to add
-					int len = faceSize(dartIndexBase); // compute size of face before changes
+					int len = ((facesize >= 0) ? facesize : faceSize(dartIndexBase)); // size of face before changes
 					const int l = (int)_alpha.size();
-					_alpha.resize(l + 2);
-					_sigma.resize(l + 2);
-					_vertices.resize(l + 2);
-					_faces.resize(l + 2);
+					_resizeDarts(l + 2);
 					const int F = _faces[dartIndexBase];
 					const int a = _alpha[dartIndexBase];
 					const int b = _sigma[a];
@@ -1170,8 +1317,8 @@ namespace mtools
 					const int v2 = _vertices[c];
 					const int v3 = _vertices[e];
 					_alpha[l + 0] = l + 1;  _alpha[l + 1] = l + 0;
-					_sigma[c] = l + 1; _sigma[l + 1] = d;
-					_sigma[e] = l + 0; _sigma[l + 0] = f;
+					_setsigma(c, l + 1); _setsigma(l + 1, d);
+					_setsigma(e, l + 0); _setsigma(l + 0, f);
 					_vertices[l + 0] = v3;
 					_vertices[l + 1] = v2;
 					_faces[l + 0] = F;
@@ -1184,10 +1331,7 @@ namespace mtools
 
 				// normale setting, rwo edges to add
 				const int l = (int)_alpha.size();
-				_alpha.resize(l + 4);
-				_sigma.resize(l + 4);
-				_vertices.resize(l + 4);
-				_faces.resize(l + 4);
+				_resizeDarts(l + 4);
 
 				const int F = _faces[dartIndexBase];
 				const int a = _alpha[dartIndexBase];
@@ -1205,9 +1349,9 @@ namespace mtools
 				_alpha[l + 0] = l + 1;  _alpha[l + 1] = l + 0;
 				_alpha[l + 2] = l + 3;  _alpha[l + 3] = l + 2;
 
-				_sigma[a] = l + 0; _sigma[l + 0] = b;
-				_sigma[c] = l + 3; _sigma[l + 3] = d;
-				_sigma[e] = l + 2; _sigma[l + 2] = l + 1; _sigma[l + 1] = f;
+				_setsigma(a, l + 0); _setsigma(l + 0, b);
+				_setsigma(c, l + 3); _setsigma(l + 3, d);
+				_setsigma(e, l + 2); _setsigma(l + 2, l + 1); _setsigma(l + 1, f);
 
 				_vertices[l + 0] = v1;
 				_vertices[l + 3] = v2;
@@ -1250,15 +1394,12 @@ namespace mtools
 				_swapdarts(dart2, b);
 				int c = phi(a);
 				int d = _alpha[c];
-				_sigma[invsigma(b)] = c;
-				_sigma[d] = _sigma[a];
+				_setsigma(invsigma(b), c);
+				_setsigma(d, _sigma[a]);
 				_faces[c] = _faces[b];
 				if (_root == a) { _root = d; }
 				else if (_root == b) { _root = c; }
-				_alpha.resize(l - 2);
-				_sigma.resize(l - 2);
-				_vertices.resize(l - 2);
-				_faces.resize(l - 2);
+				_resizeDarts(l - 2);
 				return F;
 				}
 
@@ -1267,118 +1408,200 @@ namespace mtools
 			void _boltzmannPeelingAlgo(int preDart, std::function<int(int &, int)> fun, int fsize, bool collapsedoubleedge)
 				{
 				MTOOLS_INSURE((preDart >= 0) && (preDart < (int)_alpha.size()));
-				std::queue<std::pair<int, int> > que;
-				que.push(std::pair<int, int>(preDart, fsize));
-				while (que.size() > 0)
+				std::vector<std::pair<int, int> > que; // FIFO queue (que[head] is the front) reusing the buffer of the previous call
+				que.swap(_peelque);
+				que.clear();
+				size_t head = 0;
+				que.push_back(std::pair<int, int>(preDart, fsize));
+				while (head < que.size())
 					{
 					int facesize, preedge;
-					std::tie(preedge,facesize) = que.front(); que.pop();
+					std::tie(preedge,facesize) = que[head++];
+					if ((head >= 4096) && (2 * head >= que.size())) { que.erase(que.begin(), que.begin() + head); head = 0; } // drop the consumed part
 					int res = fun(preedge, facesize); // query the peeling action, may change preedege
 					MTOOLS_INSURE((res >= -2)&&(res < ((int)_alpha.size())));
 					if (res == -1) 
 						{ // discover a new triangle
-						_addTriangle(preedge); que.push(std::pair<int, int>(preedge, facesize + 1)); 
+						_addTriangle(preedge); que.push_back(std::pair<int, int>(preedge, facesize + 1)); 
 						}
 					else
 						{ // split the n-gon
 						if (res >= 0)
 							{
-							int fs2 = _addSplittingTriangle(preedge, res, collapsedoubleedge);
+							int fs2 = _addSplittingTriangle(preedge, res, collapsedoubleedge, facesize);
 							int fs1 = facesize - fs2 + 1;
 							// push sub n-gons if needed
-							if ((fs1 > 2) || (!collapsedoubleedge)) { que.push(std::pair<int, int>(preedge, fs1)); }
-							if ((fs2 > 2) || (!collapsedoubleedge)) { que.push(std::pair<int, int>(res, fs2)); }
+							if ((fs1 > 2) || (!collapsedoubleedge)) { que.push_back(std::pair<int, int>(preedge, fs1)); }
+							if ((fs2 > 2) || (!collapsedoubleedge)) { que.push_back(std::pair<int, int>(res, fs2)); }
 							}
 						}
 					}
+				que.clear();
+				que.swap(_peelque); // keep the buffer for the next call
 				return;
 				}
 
 
-			/* move a dart from i to f, used by _swapdarts 
-			   leave the object in an inconsistent state */
-			void _movedart(int i, int f)
+			/* swap indexes i and j without modifiying the graph */
+			void _swapdarts(int i, int j)
 				{
-				int a = _alpha[i];
-				_alpha[f] = a;
-				_alpha[a] = f;
-				int n = _sigma[i];
-				int p = invsigma(i);
-				_sigma[f] = ((n == i) ? f : n);
-				_sigma[p] = f;
-				_faces[f] = _faces[i];
-				_vertices[f] = _vertices[i];
-				if (_root == i) { _root = f; }
+				if (i == j) return;
+				auto t = [&](int x) -> int { return ((x == i) ? j : ((x == j) ? i : x)); }; // the transposition (i j)
+				// new_sigma = t o sigma o t  (same for alpha and invsigma)
+				const int si = _sigma[i], sj = _sigma[j];
+				const int pi = invsigma(i), pj = invsigma(j);
+				const int ai = _alpha[i], aj = _alpha[j];
+				_sigma[t(pi)] = j; _sigma[t(pj)] = i;
+				_sigma[j] = t(si); _sigma[i] = t(sj);
+				if (_invok)
+					{
+					_invsigma[t(si)] = j; _invsigma[t(sj)] = i;
+					_invsigma[j] = t(pi); _invsigma[i] = t(pj);
+					}
+				_alpha[t(ai)] = j; _alpha[t(aj)] = i;
+				_alpha[j] = t(ai); _alpha[i] = t(aj);
+				std::swap(_vertices[i], _vertices[j]);
+				std::swap(_faces[i], _faces[j]);
+				_root = t(_root);
 				}
 
 
-			/* swap indexes i1 and i2 without modifiying the graph */
-			void _swapdarts(int i, int j)
+			/* set sigma[x] = y and keep the inverse table up to date */
+			inline void _setsigma(int x, int y)
+				{
+				_sigma[x] = y;
+				if (_invok) _invsigma[y] = x;
+				}
+
+
+			/* resize the dart arrays */
+			void _resizeDarts(int l)
 				{
-				/* TODO : implement without resize() */
-				if (i == j) return;
-				const int l = (int)_alpha.size();
-				_alpha.resize(l + 1);
-				_sigma.resize(l + 1);
-				_vertices.resize(l + 1);
-				_faces.resize(l + 1);
-				_movedart(i, l);
-				_movedart(j, i);
-				_movedart(l, j);
 				_alpha.resize(l);
 				_sigma.resize(l);
 				_vertices.resize(l);
 				_faces.resize(l);
+				if (_invok) _invsigma.resize(l);
 				}
-				
-				
-			/* Compute the vertex set from sigma and alpha */
+
+
+			/* (re)construct the inverse table if the growth mode is on and it is not up to date */
+			void _syncInverse()
+				{
+				if ((!_growth) || (_invok)) return;
+				const int l = (int)_sigma.size();
+				_invsigma.reserve(_sigma.capacity());
+				_invsigma.resize(l);
+				for (int i = 0; i < l; i++) { _invsigma[_sigma[i]] = i; }
+				_invok = true;
+				}
+
+
+			/* Compute the vertex set from sigma and alpha (and cache the degrees) */
 			void _computeVerticeSet()
 				{
-				const int l = (int)_alpha.size();
-				_vertices.clear();
-				_vertices.resize(l, -1);
-				_nbvertices = 0;
-				for (int i = 0; i < l; i++)
-					{
-					if (_vertices[i] < 0)
-						{
-						_vertices[i] = _nbvertices;
-						int j = sigma(i);
-						while (j != i)
-							{
-							MTOOLS_ASSERT(_vertices[j] < 0);
-							_vertices[j] = _nbvertices;
-							j = sigma(j);
-							}
-						_nbvertices++;
-						}
-					}
+				_nbvertices = _labelOrbits([&](int i) { return _sigma[i]; }, (int)_alpha.size(), _vertices, _vdeg);
+				_vdegok = true;
 				}
 
 
-			/* compute the faces set from sigma and alpha */
+			/* compute the faces set from sigma and alpha (and cache the face sizes) */
 			void _computeFaceSet()
 				{
-				const int l = (int)_alpha.size();;
-				_faces.clear();
-				_faces.resize(l, -1);
-				_nbfaces = 0;
-				for(int i = 0; i < l; i++)
+				_nbfaces = _labelOrbits([&](int i) { return _sigma[_alpha[i]]; }, (int)_alpha.size(), _faces, _fsize);
+				_fsizeok = true;
+				}
+
+
+			/* drop the cached vertex degrees and face sizes */
+			inline void _invalidateInvariants() { _vdegok = false; _fsizeok = false; }
+
+
+			/* number of darts with each label */
+			static std::vector<int> _countLabels(const std::vector<int> & lab, int nb)
+				{
+				std::vector<int> cnt(nb, 0);
+				for (int v : lab) { cnt[v]++; }
+				return cnt;
+				}
+
+
+			/**
+			 * Label the orbits of the permutation next on the darts 0..l-1 (sigma for the vertices, phi
+			 * for the faces). The orbits are numbered in the order of their smallest dart and their
+			 * lengths are stored in size. Return the number of orbits.
+			 *
+			 * Large maps are labelled in parallel: each thread walks the orbits met in its range of
+			 * darts and marks their darts with the smallest dart of the orbit (two threads may walk the
+			 * same orbit, which only wastes a little time), then the orbits are numbered with a prefix
+			 * sum so that the labelling is the same as with the sequential sweep.
+			 **/
+			template<typename NEXT> static int _labelOrbits(NEXT next, int l, std::vector<int> & lab, std::vector<int> & size)
+				{
+				const int nb = (l < PARALLEL_LABEL_MIN) ? 1 : std::min<int>(nbHardwareThreads(), l / (PARALLEL_LABEL_MIN / 4));
+				lab.clear();
+				lab.resize(l, -1);
+				size.clear();
+				if (nb <= 1)
 					{
-					if (_faces[i] < 0)
+					for (int i = 0; i < l; i++)
 						{
-						_faces[i] = _nbfaces;
-						int j = phi(i);
-						while (j != i)
+						if (lab[i] < 0)
 							{
-							MTOOLS_ASSERT(_faces[j] < 0);
-							_faces[j] = _nbfaces;
-							j = phi(j);
+							const int id = (int)size.size();
+							int n = 1;
+							lab[i] = id;
+							int j = next(i);
+							while (j != i)
+								{
+								MTOOLS_ASSERT(lab[j] < 0);
+								lab[j] = id;
+								j = next(j);
+								n++;
+								}
+							size.push_back(n);
 							}
-						_nbfaces++;
 						}
+					return (int)size.size();
 					}
+				std::unique_ptr<std::atomic<int>[]> mini(new std::atomic<int>[l]);	// smallest dart of the orbit
+				std::vector<int> len(l), ids(l), cnt(nb + 1, 0);
+				auto run = [&](std::function<void(int, int, int)> fun)
+					{
+					std::vector<std::thread> threads;
+					for (int t = 1; t < nb; t++) { threads.push_back(std::thread(fun, t, (int)(((int64)l*t) / nb), (int)(((int64)l*(t + 1)) / nb))); }
+					fun(0, 0, (int)(l / nb));
+					for (auto & th : threads) { th.join(); }
+					};
+				run([&](int, int a, int b) { for (int i = a; i < b; i++) { mini[i].store(-1, std::memory_order_relaxed); } });
+				run([&](int, int a, int b)
+					{
+					for (int i = a; i < b; i++)
+						{
+						if (mini[i].load(std::memory_order_relaxed) >= 0) continue;
+						int m = i, n = 1, j = next(i);
+						while (j != i) { if (j < m) m = j; j = next(j); n++; }
+						int expected = -1;
+						if (mini[m].compare_exchange_strong(expected, m, std::memory_order_relaxed)) { len[m] = n; } // this thread owns the orbit
+						j = next(m);
+						while (j != m) { mini[j].store(m, std::memory_order_relaxed); j = next(j); }
+						}
+					});
+				run([&](int t, int a, int b)
+					{
+					int c = 0;
+					for (int i = a; i < b; i++) { if (mini[i].load(std::memory_order_relaxed) == i) c++; }
+					cnt[t + 1] = c;
+					});
+				for (int t = 0; t < nb; t++) { cnt[t + 1] += cnt[t]; }
+				size.resize(cnt[nb]);
+				run([&](int t, int a, int b)
+					{
+					int id = cnt[t];
+					for (int i = a; i < b; i++) { if (mini[i].load(std::memory_order_relaxed) == i) { ids[i] = id; size[id] = len[i]; id++; } }
+					});
+				run([&](int, int a, int b) { for (int i = a; i < b; i++) { lab[i] = ids[mini[i].load(std::memory_order_relaxed)]; } });
+				return cnt[nb];
 				}
 
 
@@ -1518,16 +1741,16 @@ namespace mtools
 					}
 				// ok, we can now reorder and troncate 
 				Permutation perm(exploreddarts);
-				std::vector<int > sigma2(l);
-				std::vector<int > alpha2(l);
+				perm.permute(_sigma); // in place
+				perm.permute(_alpha);
 				for (int i = 0; i < l; i++)
 					{
-					sigma2[i] = perm.inv(_sigma[perm[i]]);
-					alpha2[i] = perm.inv(_alpha[perm[i]]);
+					_sigma[i] = perm.inv(_sigma[i]);
+					_alpha[i] = perm.inv(_alpha[i]);
 					}
 				_root = perm.inv(_root);
-				_alpha = alpha2; _alpha.resize(nbdarts);
-				_sigma = sigma2; _sigma.resize(nbdarts);
+				_alpha.resize(nbdarts);
+				_sigma.resize(nbdarts);
 				_computeFaceSet();
 				_computeVerticeSet();
 				CHECKCONSISTENCY;
@@ -1569,6 +1792,16 @@ namespace mtools
 			std::vector<int> _sigma;	// rotations around vertices
 			std::vector<int> _vertices;	// index of vertices associated with half edges
 			std::vector<int> _faces;	// index of faces associated with half edges
+			std::vector<int> _invsigma;	// inverse of sigma (only in growth mode, valid if _invok is set)
+			bool _growth;				// true if the growth mode is on
+			bool _invok;				// true if _invsigma is up to date
+			std::vector<int> _vdeg;		// degree of each vertex (valid if _vdegok is set)
+			std::vector<int> _fsize;	// size of each face (valid if _fsizeok is set)
+			bool _vdegok;				// true if _vdeg is up to date
+			bool _fsizeok;				// true if _fsize is up to date
+			std::vector<std::pair<int, int> > _peelque;	// buffer of the queue of the peeling algorithm
+
+			static const int PARALLEL_LABEL_MIN = 262144;	// minimum number of darts for labelling the orbits in parallel
 
 		};
 
@@ -32,9 +32,40 @@
 #include "../random/peelinglaw.hpp"
 #include "combinatorialmap.hpp"
 
+#include <deque>
+#include <queue>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+#include <thread>
+
 namespace mtools
 	{
 
+
+	namespace internals_randomtriangulation
+		{
+
+		/* Insert a Boltzmann triangulation inside a face using the peeling algorithm. 
+		   law(m) gives the peeling step for a face of size m+2 (cf freeBoltzmanTriangulationLaw()). */
+		template<typename LAW> void boltzmannTriangulation(CombinatorialMap & CM, int peeldart, bool avoiddoubleedges, LAW law)
+			{
+			CM.boltzmannPeelingAlgo(peeldart, [&](int peeledge, int facesize)-> int {
+				MTOOLS_ASSERT((facesize >= 2)); // face must have size at least 2
+				MTOOLS_ASSERT((facesize >= 3) || (!avoiddoubleedges)); // if we avoid double edges, then all faces must have size >= 3.
+				int m = facesize - 2;
+				int k = (int)law(m);
+				if (k == -1) return -1; // new vertex discovered.
+				if ((m == 0) && (k == 0)) return -2; // stop peeling this face of size 2
+				MTOOLS_ASSERT((k >= 1) && (k <= m));
+				for (int i = 0; i < k + 1; i++) { peeledge = CM.phi(peeledge); }
+				return peeledge;
+				}, true);
+			}
+
+		}
+
+
 	/**
 	 * Insert a Free Boltzmann Triangulation (of type II) inside a given face of a map using the
 	 * peeling algorithm.
@@ -55,17 +86,8 @@ namespace mtools
 	 */
 	template<typename random_t> void freeBoltzmannTriangulation(CombinatorialMap & CM, int peeldart, bool avoiddoubleedges, random_t & gen)
 		{
-		CM.boltzmannPeelingAlgo(peeldart, [&](int peeledge, int facesize)-> int {
-			MTOOLS_ASSERT((facesize >= 2)); // face must have size at least 2
-			MTOOLS_ASSERT((facesize >= 3)||(!avoiddoubleedges)); // if we avoid double edges, then all faces must have size >= 3.
-			int m = facesize - 2;
-			int k = (int)freeBoltzmanTriangulationLaw(m, gen);
-			if (k == -1) return -1; // new vertex discovered.
-			if ((m == 0) && (k == 0)) return -2; // stop peeling this face of size 2
-			MTOOLS_ASSERT((k >= 1)&&(k <= m));
-			for (int i = 0; i < k+1; i++) { peeledge = CM.phi(peeledge); }
-			return peeledge;
-			},true); 
+		freeBoltzmanTriangulationLawSampler FBT;
+		internals_randomtriangulation::boltzmannTriangulation(CM, peeldart, avoiddoubleedges, [&](int64 m) -> int64 { return FBT(m, gen); });
 		}
 
 
@@ -91,17 +113,8 @@ namespace mtools
 	*/
 	template<typename random_t> void generalBoltzmannTriangulation(CombinatorialMap & CM, int peeldart, double theta, bool avoiddoubleedges, random_t & gen)
 		{
-		CM.boltzmannPeelingAlgo(peeldart, [&](int peeledge, int facesize)-> int {
-			MTOOLS_ASSERT((facesize >= 2)); // face must have size at least 2
-			MTOOLS_ASSERT((facesize >= 3) || (!avoiddoubleedges)); // if we avoid double edges, then all faces must have size >= 3.
-			int m = facesize - 2;
-			int k = (int)generalBoltzmanTriangulationLaw(m, theta, gen);
-			if (k == -1) return -1; // new vertex discovered.
-			if ((m == 0) && (k == 0)) return -2; // stop peeling this face of size 2
-			MTOOLS_ASSERT((k >= 1) && (k <= m));
-			for (int i = 0; i < k + 1; i++) { peeledge = CM.phi(peeledge); }
-			return peeledge;
-			}, true);
+		generalBoltzmanTriangulationLawSampler GBT;
+		internals_randomtriangulation::boltzmannTriangulation(CM, peeldart, avoiddoubleedges, [&](int64 m) -> int64 { return GBT(m, theta, gen); });
 		}
 
 
@@ -122,13 +135,20 @@ namespace mtools
 	 * @param [in,out]	gen			the random number generator
 	 * 					
 	 * returns the next edge to peel (identifies the infinite face). 
+	 * 
+	 * For large number of steps, turn the growth mode of the map on beforehand (possibly reserving
+	 * memory for the expected final number of darts) with CM.setGrowthMode(): otherwise each step
+	 * costs a rotation around the vertex of the infinite face when calling invphi(). 
 	 */
 	template<typename random_t> int peelUIPT(CombinatorialMap & CM, int64 nbsteps, int predart, bool avoiddoubleddges, random_t & gen)
 		{
+		UIPTLawSampler UIPT;
+		freeBoltzmanTriangulationLawSampler FBT;
+		auto fbtlaw = [&](int64 m) -> int64 { return FBT(m, gen); };
 		int fsize = CM.faceSize(predart); 
 		for (int64 n = 0; n < nbsteps; n++)
 			{
-			int k = (int)UIPTLaw(fsize - 2, gen);
+			int k = (int)UIPT(fsize - 2, gen);
 			if (avoiddoubleddges) { if (fsize == 3) { k = -1; } else if (fsize - k == 2) { k--; } } // avoid problematic cases...
 			if (k == -1)
 				{
@@ -142,24 +162,24 @@ namespace mtools
 					{
 					int d = predart;
 					for (int i = 0; i < k + 1; i++) { d = CM.phi(d); }		
-					auto fs2 = CM.addSplittingTriangle(predart, d, avoiddoubleddges); 
+					auto fs2 = CM.addSplittingTriangle(predart, d, avoiddoubleddges, fsize); 
 					MTOOLS_INSURE(fs2 = k + 1);
-					if ((!avoiddoubleddges) || (fs2 > 2)) { freeBoltzmannTriangulation(CM, d, avoiddoubleddges, gen); }
+					if ((!avoiddoubleddges) || (fs2 > 2)) { internals_randomtriangulation::boltzmannTriangulation(CM, d, avoiddoubleddges, fbtlaw); }
 					predart = CM.invphi(predart);
 					}
 				else
 					{
 					int d = predart;
 					for (int i = 0; i < k; i++) { d = CM.invphi(d); }
-					auto fs2 = CM.addSplittingTriangle(predart, d, avoiddoubleddges);
+					auto fs2 = CM.addSplittingTriangle(predart, d, avoiddoubleddges, fsize);
 					int fs1 = fsize - fs2 + 1;
 					MTOOLS_INSURE(fs2 = k + 1);
-					if ((!avoiddoubleddges) || (fs1 > 2)) { freeBoltzmannTriangulation(CM, predart, avoiddoubleddges, gen); }
+					if ((!avoiddoubleddges) || (fs1 > 2)) { internals_randomtriangulation::boltzmannTriangulation(CM, predart, avoiddoubleddges, fbtlaw); }
 					predart = CM.invphi(d);
 					}
 				fsize -= k;
 				}
-			MTOOLS_INSURE(fsize == CM.faceSize(predart));
+			MTOOLS_ASSERT(fsize == CM.faceSize(predart)); // O(fsize), only checked in debug mode
 			}
 		return predart;
 		}
@@ -186,10 +206,13 @@ namespace mtools
 	*/
 	template<typename random_t> int peelHyperbolicIPT(CombinatorialMap & CM, int64 nbsteps, int predart, double theta, bool avoiddoubleddges, random_t & gen)
 		{
+		hyperbolicIPTLawSampler HIPT;
+		generalBoltzmanTriangulationLawSampler GBT;
+		auto gbtlaw = [&](int64 m) -> int64 { return GBT(m, theta, gen); };
 		int fsize = CM.faceSize(predart);
 		for (int64 n = 0; n < nbsteps; n++)
 			{
-			int k = (int)hyperbolicIPTLaw(fsize - 2, theta, gen);
+			int k = (int)HIPT(fsize - 2, theta, gen);
 			if (avoiddoubleddges) { if (fsize == 3) { k = -1;} else if (fsize - k == 2) { k--; } } // avoid problematic cases...
 			if (k == -1)
 				{
@@ -203,29 +226,583 @@ namespace mtools
 					{
 					int d = predart;
 					for (int i = 0; i < k + 1; i++) { d = CM.phi(d); }
-					auto fs2 = CM.addSplittingTriangle(predart, d, avoiddoubleddges);
+					auto fs2 = CM.addSplittingTriangle(predart, d, avoiddoubleddges, fsize);
 					MTOOLS_INSURE(fs2 = k + 1);
-					if ((!avoiddoubleddges) || (fs2 > 2)) { generalBoltzmannTriangulation(CM, d, theta, avoiddoubleddges, gen); }
+					if ((!avoiddoubleddges) || (fs2 > 2)) { internals_randomtriangulation::boltzmannTriangulation(CM, d, avoiddoubleddges, gbtlaw); }
 					predart = CM.invphi(predart);
 					}
 				else
 					{
 					int d = predart;
 					for (int i = 0; i < k; i++) { d = CM.invphi(d); }
-					auto fs2 = CM.addSplittingTriangle(predart, d, avoiddoubleddges);
+					auto fs2 = CM.addSplittingTriangle(predart, d, avoiddoubleddges, fsize);
 					int fs1 = fsize - fs2 + 1;
 					MTOOLS_INSURE(fs2 = k + 1);
-					if ((!avoiddoubleddges) || (fs1 > 2)) { generalBoltzmannTriangulation(CM, predart, theta, avoiddoubleddges, gen); }
+					if ((!avoiddoubleddges) || (fs1 > 2)) { internals_randomtriangulation::boltzmannTriangulation(CM, predart, avoiddoubleddges, gbtlaw); }
 					predart = CM.invphi(d);
 					}
 				fsize -= k;
 				}
-			MTOOLS_INSURE(fsize == CM.faceSize(predart));
+			MTOOLS_ASSERT(fsize == CM.faceSize(predart)); // O(fsize), only checked in debug mode
 			}
 		return predart;
 		}
 
 
+
+	/**
+	 * Streaming version of the peeling algorithms above: generate a random triangulation (free or
+	 * generalized Boltzmann triangulation, UIPT or hyperbolic IPT) without constructing the
+	 * CombinatorialMap. 
+	 * 
+	 * Only the active boundary is kept in memory, i.e. the faces that remain to be peeled (each one
+	 * as the cyclic list of its vertices) together with the current degree of the vertices lying on
+	 * them. Each time a triangle is discovered, it is sent to the face callback and each time a
+	 * vertex leaves the active boundary (hence its degree is final), it is sent to the vertex callback.
+	 * 
+	 * The random choices are made in exactly the same order as in freeBoltzmannTriangulation(),
+	 * generalBoltzmannTriangulation(), peelUIPT() and peelHyperbolicIPT() so, with the same
+	 * generator, the triangulation obtained is the same (up to the numbering of the vertices) as the
+	 * one constructed by these methods with avoiddoubleedges = true. 
+	 * 
+	 * Vertices are numbered consecutively starting from 0 (with int64 so there is no limit on the size
+	 * of the triangulation). The degree of a vertex is its number of incident darts (multiple edges
+	 * counted with multiplicity). The faces of size 2 that remain when avoiddoubleedges = false are not
+	 * reported. 
+	 * 
+	 * Example (degree distribution of the first 10^8 steps of the UIPT):
+	 * 
+	 *     std::vector<int64> hist(1000, 0);
+	 *     TriangulationStream TS([](int64 a, int64 b, int64 c) {}, 
+	 *                            [&](int64 v, int64 deg, bool onboundary) { if (!onboundary) hist[std::min<int64>(deg, 999)]++; });
+	 *     TS.peelUIPT(100000000, true, gen);
+	 *     TS.finish();
+	 **/
+	class TriangulationStream
+		{
+
+		public:
+
+			/** Type of the callback called for each triangle (a,b,c) discovered. **/
+			typedef std::function<void(int64, int64, int64)> FaceCallback;
+
+			/** Type of the callback called for each vertex (vertex, degree, onboundary) whose degree is final. **/
+			typedef std::function<void(int64, int64, bool)> VertexCallback;
+
+
+			/**
+			 * Constructor. 
+			 *
+			 * @param	facefun  	The callback for the faces (may be empty).
+			 * @param	vertexfun	The callback for the vertices (may be empty).
+			 **/
+			TriangulationStream(FaceCallback facefun, VertexCallback vertexfun) : _facefun(facefun), _vertexfun(vertexfun), _nbvertices(0), _nbfaces(0), _started(false)
+				{
+				}
+
+
+			/**
+			 * Constructor. The faces and vertices are written into an archive: a face (a,b,c) is written
+			 * as 'f' a b c and a vertex as 'v' vertex degree onboundary (one item per line).
+			 *
+			 * @param [in,out]	ar	The archive. It must outlive the object.
+			 **/
+			TriangulationStream(OBaseArchive & ar) : _nbvertices(0), _nbfaces(0), _started(false)
+				{
+				OBaseArchive * par = &ar;
+				_facefun = [par](int64 a, int64 b, int64 c) { (*par) & 'f' & a & b & c; par->newline(); };
+				_vertexfun = [par](int64 v, int64 deg, bool onboundary) { (*par) & 'v' & v & deg & onboundary; par->newline(); };
+				}
+
+
+			/** Number of vertices created so far. **/
+			int64 nbVertices() const { return _nbvertices; }
+
+
+			/** Number of triangles reported so far. **/
+			int64 nbFaces() const { return _nbfaces; }
+
+
+			/** Number of vertices currently on the active boundary (those kept in memory). **/
+			int64 nbActiveVertices() const { return (int64)_vinfo.size(); }
+
+
+			/** Size of the infinite face of the peeling (peelUIPT() and peelHyperbolicIPT()). **/
+			int64 boundarySize() const { return (int64)_infinite.size(); }
+
+
+			/**
+			 * Stream a free Boltzmann triangulation (of type II) with a boundary of a given size. New
+			 * vertices 0..boundarysize-1 are created for the boundary (in this order along the boundary)
+			 * and their degree only counts the edges of the boundary and of the triangulation.
+			 *
+			 * @param	boundarysize		Size of the boundary (at least 3 if avoiddoubleedges is set and 2
+			 * 								otherwise).
+			 * @param	avoiddoubleedges	true to collapse the faces of size 2 as in freeBoltzmannTriangulation().
+			 * @param [in,out]	gen			random number generator.
+			 **/
+			template<typename random_t> void freeBoltzmannTriangulation(int64 boundarysize, bool avoiddoubleedges, random_t & gen)
+				{
+				_fill(_newPolygon(boundarysize, avoiddoubleedges), avoiddoubleedges, [&](int64 m) -> int64 { return _fbtlaw(m, gen); });
+				}
+
+
+			/**
+			 * Stream a generalized Boltzmann triangulation (of type II) with a boundary of a given size.
+			 * Same as freeBoltzmannTriangulation() but with parameter theta in (0,1/6] (cf peelinglaw.hpp).
+			 **/
+			template<typename random_t> void generalBoltzmannTriangulation(int64 boundarysize, double theta, bool avoiddoubleedges, random_t & gen)
+				{
+				_fill(_newPolygon(boundarysize, avoiddoubleedges), avoiddoubleedges, [&](int64 m) -> int64 { return _gbtlaw(m, theta, gen); });
+				}
+
+
+			/**
+			 * Peel a given number of steps of the UIPT type II (peeling by layer, as in peelUIPT()). 
+			 * 
+			 * The first call starts from a single triangle (vertices 0,1,2) and the following calls
+			 * continue to peel the same infinite face. Call finish() at the end to report the vertices
+			 * remaining on the boundary.
+			 *
+			 * @param	nbsteps				The number of steps of peeling to perform.
+			 * @param	avoiddoubleedges	true to avoid double edges whenever possible.
+			 * @param [in,out]	gen			random number generator.
+			 **/
+			template<typename random_t> void peelUIPT(int64 nbsteps, bool avoiddoubleedges, random_t & gen)
+				{
+				_peelInfinite(nbsteps, avoiddoubleedges, gen, 
+					[&](int64 m) -> int64 { return _uiptlaw(m, gen); }, 
+					[&](int64 m) -> int64 { return _fbtlaw(m, gen); });
+				}
+
+
+			/**
+			 * Peel a given number of steps of the hyperbolic IPT type II with parameter theta in (0,1/6)
+			 * (peeling by layer, as in peelHyperbolicIPT()). Same as peelUIPT() otherwise.
+			 **/
+			template<typename random_t> void peelHyperbolicIPT(int64 nbsteps, double theta, bool avoiddoubleedges, random_t & gen)
+				{
+				_peelInfinite(nbsteps, avoiddoubleedges, gen,
+					[&](int64 m) -> int64 { return _hiptlaw(m, theta, gen); },
+					[&](int64 m) -> int64 { return _gbtlaw(m, theta, gen); });
+				}
+
+
+			/**
+			 * Report the vertices of the infinite face (with onboundary = true and their current degree)
+			 * and reset the peeling: the next call to peelUIPT() or peelHyperbolicIPT() starts a new
+			 * triangulation (the numbering of the vertices continues).
+			 **/
+			void finish()
+				{
+				for (auto v : _infinite) 
+					{ 
+					auto it = _vinfo.find(v);
+					if (it != _vinfo.end())
+						{
+						if (_vertexfun) _vertexfun(v, it->second.first, true);
+						_vinfo.erase(it);
+						}
+					}
+				_infinite.clear();
+				_started = false;
+				}
+
+
+			/**
+			 * Forget everything (without calling the callbacks) and restart the numbering of the
+			 * vertices from 0. The memory allocated is kept so that streaming many small triangulations
+			 * one after the other does not allocate anything once the buffers are large enough.
+			 **/
+			void reset()
+				{
+				_vinfo.clear();
+				_infinite.clear();
+				_started = false;
+				_nbvertices = 0;
+				_nbfaces = 0;
+				}
+
+
+		private:
+
+			/* polygons are stored in reverse order: for P of size n, the edge to peel goes from P[n-1] to P[n-2] 
+			   and the face is P[n-1] -> P[n-2] -> ... -> P[0] -> P[n-1] */
+
+			static const size_t MAX_SPARES = 64;	// maximum number of buffers kept for reuse
+
+			TriangulationStream(const TriangulationStream &) = delete;
+			TriangulationStream & operator=(const TriangulationStream &) = delete;
+
+
+			/* create a new vertex */
+			int64 _newVertex()
+				{
+				const int64 v = _nbvertices++;
+				_vinfo[v] = std::pair<int64, int64>(0, 0);
+				return v;
+				}
+
+
+			/* add an edge between u and v */
+			void _addEdge(int64 u, int64 v)
+				{
+				_vinfo[u].first++;
+				_vinfo[v].first++;
+				}
+
+
+			/* report a triangle */
+			void _face(int64 a, int64 b, int64 c)
+				{
+				_nbfaces++;
+				if (_facefun) _facefun(a, b, c);
+				}
+
+
+			/* one more occurence of v on the active boundary */
+			void _ref(int64 v) { _vinfo[v].second++; }
+
+
+			/* one less occurence of v on the active boundary */
+			void _unref(int64 v)
+				{
+				auto it = _vinfo.find(v);
+				MTOOLS_ASSERT(it != _vinfo.end());
+				if ((--(it->second.second)) == 0)
+					{
+					if (_vertexfun) _vertexfun(v, it->second.first, false);
+					_vinfo.erase(it);
+					}
+				}
+
+
+			/* remove a polygon from the active boundary */
+			template<typename CONT> void _discard(CONT & P)
+				{
+				for (auto v : P) { _unref(v); }
+				P.clear();
+				}
+
+
+			/* create a new polygon of a given size */
+			std::vector<int64> _newPolygon(int64 size, bool avoiddoubleedges)
+				{
+				MTOOLS_INSURE((size >= 3) || ((size == 2) && (!avoiddoubleedges)));
+				std::vector<int64> P = _spare();
+				P.resize((size_t)size);
+				for (int64 i = 0; i < size; i++) { P[(size_t)(size - 1 - i)] = _newVertex(); _ref(P[(size_t)(size - 1 - i)]); }
+				for (int64 i = 0; i < size; i++) { _addEdge(P[(size_t)i], P[(size_t)((i + 1) % size)]); }
+				return P;
+				}
+
+
+			/* peel a new vertex: the edge x -> y is replaced by x -> w -> y and the next edge to peel is x -> w */
+			template<typename CONT> void _insertVertex(CONT & P)
+				{
+				const int64 x = P.back(), y = P[P.size() - 2];
+				const int64 w = _newVertex();
+				_ref(w);
+				_addEdge(x, w); _addEdge(w, y);
+				_face(x, y, w);
+				P.back() = w;
+				P.push_back(x);
+				}
+
+
+			/* Split P with the triangle (x,y,z) where x = P[n-1], y = P[n-2] and z = P[n-1-t] with 2 <= t <= n-1.
+			   P is moved into P1 or P2 and the smaller part is copied, with:
+			     - P1 = the face x -> z -> P[n-2-t] -> ... -> P[0] of size n-t+1, next edge to peel x -> z.
+			     - P2 = the face z -> y -> ... -> P[n-t] of size t, next edge to peel z -> y.
+			   Faces of size 2 are discarded (and the corresponding edge is not created) if collapse is set. */
+			template<typename CONT> void _split(CONT & P, int64 t, bool collapse, CONT & P1, CONT & P2)
+				{
+				const int64 n = (int64)P.size();
+				MTOOLS_ASSERT((t >= 2) && (t <= n - 1));
+				const int64 x = P[(size_t)(n - 1)], y = P[(size_t)(n - 2)], z = P[(size_t)(n - 1 - t)];
+				_face(x, y, z);
+				_ref(z);
+				P1.clear(); P2.clear();
+				if (t <= n - t + 1)
+					{ // P2 is the smaller one
+					P2.insert(P2.end(), P.begin() + (size_t)(n - t), P.begin() + (size_t)(n - 1));
+					P2.push_back(z);
+					P.erase(P.begin() + (size_t)(n - t), P.begin() + (size_t)(n - 1));
+					P1.swap(P); // P gets the buffer of P1
+					}
+				else
+					{ // P1 is the smaller one
+					P1.insert(P1.end(), P.begin(), P.begin() + (size_t)(n - t));
+					P1.push_back(x);
+					P.erase(P.begin(), P.begin() + (size_t)(n - t));
+					P.back() = z;
+					P2.swap(P);
+					}
+				P.clear();
+				if ((collapse) && (P1.size() == 2)) { _discard(P1); } else { _addEdge(x, z); }
+				if ((collapse) && (P2.size() == 2)) { _discard(P2); } else { _addEdge(z, y); }
+				}
+
+
+			/* fill a polygon with a Boltzmann triangulation (same as CombinatorialMap::boltzmannPeelingAlgo) */
+			template<typename LAW> void _fill(std::vector<int64> && P, bool collapse, LAW law)
+				{
+				std::deque<std::vector<int64> > que; // reuse the queue of the previous call
+				que.swap(_que);
+				que.push_back(std::move(P));
+				while (que.size() > 0)
+					{
+					std::vector<int64> Q = std::move(que.front()); que.pop_front();
+					const int64 m = (int64)Q.size() - 2;
+					MTOOLS_ASSERT((m >= 1) || (!collapse));
+					const int64 k = law(m);
+					if (k == -1) { _insertVertex(Q); que.push_back(std::move(Q)); continue; } // new vertex discovered
+					if ((m == 0) && (k == 0)) { _discard(Q); _recycle(Q); continue; } // stop peeling this face of size 2
+					MTOOLS_ASSERT((k >= 1) && (k <= m));
+					std::vector<int64> Q1 = _spare(), Q2 = _spare();
+					_split(Q, k + 1, collapse, Q1, Q2);
+					_recycle(Q);
+					if (Q1.size() > 0) que.push_back(std::move(Q1)); else _recycle(Q1);
+					if (Q2.size() > 0) que.push_back(std::move(Q2)); else _recycle(Q2);
+					}
+				que.swap(_que);
+				}
+
+
+			/* return an empty vector, reusing the buffer of a discarded polygon if possible */
+			std::vector<int64> _spare()
+				{
+				if (_spares.size() == 0) return std::vector<int64>();
+				std::vector<int64> V = std::move(_spares.back());
+				_spares.pop_back();
+				return V;
+				}
+
+
+			/* keep the buffer of a polygon which is not used anymore */
+			void _recycle(std::vector<int64> & V)
+				{
+				if ((V.capacity() == 0) || (_spares.size() >= MAX_SPARES)) return;
+				V.clear();
+				_spares.push_back(std::move(V));
+				}
+
+
+			/* move the last edge of the infinite face (the one preceding the edge to peel) in first position */
+			void _rotateInfinite()
+				{
+				const int64 v = _infinite.front();
+				_infinite.pop_front();
+				_infinite.push_back(v);
+				}
+
+
+			/* peeling by layer of the infinite face (same as peelUIPT() and peelHyperbolicIPT()) */
+			template<typename random_t, typename PEELLAW, typename FILLLAW> void _peelInfinite(int64 nbsteps, bool avoiddoubleedges, random_t & gen, PEELLAW peellaw, FILLLAW filllaw)
+				{
+				if (!_started)
+					{ // start with a single triangle
+					std::vector<int64> T = _newPolygon(3, avoiddoubleedges);
+					_face(T[2], T[1], T[0]);
+					_infinite.assign(T.begin(), T.end());
+					_started = true;
+					}
+				std::deque<int64> P1, P2;
+				for (int64 n = 0; n < nbsteps; n++)
+					{
+					const int64 fsize = (int64)_infinite.size();
+					int64 k = peellaw(fsize - 2);
+					if (avoiddoubleedges) { if (fsize == 3) { k = -1; } else if (fsize - k == 2) { k--; } } // avoid problematic cases...
+					if (k == -1)
+						{
+						_insertVertex(_infinite);
+						_rotateInfinite();
+						}
+					else
+						{
+						if (Unif_1(gen)) // direction
+							{
+							_split(_infinite, k + 1, avoiddoubleedges, P1, P2);
+							_infinite = std::move(P1);
+							if (P2.size() > 0) { std::vector<int64> Q = _spare(); Q.assign(P2.begin(), P2.end()); _fill(std::move(Q), avoiddoubleedges, filllaw); }
+							}
+						else
+							{
+							_split(_infinite, fsize - k, avoiddoubleedges, P1, P2);
+							_infinite = std::move(P2);
+							if (P1.size() > 0) { std::vector<int64> Q = _spare(); Q.assign(P1.begin(), P1.end()); _fill(std::move(Q), avoiddoubleedges, filllaw); }
+							}
+						_rotateInfinite();
+						}
+					MTOOLS_ASSERT((int64)_infinite.size() == ((k == -1) ? (fsize + 1) : (fsize - k)));
+					}
+				}
+
+
+			FaceCallback	_facefun;		// callback for the faces
+			VertexCallback	_vertexfun;		// callback for the vertices
+			int64			_nbvertices;	// number of vertices created
+			int64			_nbfaces;		// number of faces reported
+			bool			_started;		// true if the infinite face is initialized
+			std::deque<int64> _infinite;	// the infinite face
+			std::unordered_map<int64, std::pair<int64, int64> > _vinfo; // (degree, number of occurences on the active boundary) of the active vertices
+			std::deque<std::vector<int64> > _que;		// queue of the faces to fill (kept between calls for its memory)
+			std::vector<std::vector<int64> > _spares;	// buffers of discarded polygons, reused for the new ones
+			UIPTLawSampler							_uiptlaw;	// tabulated peeling laws
+			hyperbolicIPTLawSampler					_hiptlaw;	//
+			freeBoltzmanTriangulationLawSampler		_fbtlaw;	//
+			generalBoltzmanTriangulationLawSampler	_gbtlaw;	//
+
+		};
+
+
+
+	/**
+	 * Sampler context for Monte Carlo estimates over many small Boltzmann triangulations.
+	 * 
+	 * Calling freeBoltzmannTriangulation() with a new CombinatorialMap for each sample reallocates
+	 * the permutations of the map, the queue of the peeling and re-tabulates the peeling laws every
+	 * time. This object keeps all of them between samples: each sample resets the map (or the stream)
+	 * instead of freeing it, so once the buffers are large enough a sample does not allocate memory.
+	 * 
+	 * With the same generator, the samples are the same as those obtained with the free functions
+	 * (with the map starting from a polygon created by CombinatorialMap(boundarysize), the
+	 * triangulation being inserted in the face of dart 0) and with TriangulationStream.
+	 * 
+	 * One sampler must be used by a single thread: use parallelSamples() to run independent samples
+	 * in several threads, each one with its own sampler and its own stream of random numbers.
+	 * 
+	 *     MT2004_64 gen(123);
+	 *     std::vector<double> mean(8, 0.0);
+	 *     BoltzmannTriangulationSampler::parallelSamples(1000000, gen, [&](BoltzmannTriangulationSampler & S, MT2004_64 & g, int64 n, size_t th) 
+	 *         { mean[th] += S.freeBoltzmannTriangulation(3, true, g).nbVertices(); }, 8);
+	 **/
+	class BoltzmannTriangulationSampler
+		{
+
+		public:
+
+			/**
+			 * Constructor.
+			 *
+			 * @param	facefun  	The face callback used by the streaming methods (may be empty).
+			 * @param	vertexfun	The vertex callback used by the streaming methods (may be empty).
+			 **/
+			BoltzmannTriangulationSampler(TriangulationStream::FaceCallback facefun = nullptr, TriangulationStream::VertexCallback vertexfun = nullptr) : _stream(facefun, vertexfun)
+				{
+				}
+
+
+			/**
+			 * Sample a free Boltzmann triangulation (of type II) with a boundary of a given size. The
+			 * previous sample is overwritten.
+			 *
+			 * @param	boundarysize		Size of the boundary (at least 3 if avoiddoubleedges is set).
+			 * @param	avoiddoubleedges	see freeBoltzmannTriangulation().
+			 * @param [in,out]	gen			random number generator.
+			 *
+			 * @return	The map (valid until the next sample).
+			 **/
+			template<typename random_t> CombinatorialMap & freeBoltzmannTriangulation(int boundarysize, bool avoiddoubleedges, random_t & gen)
+				{
+				_CM.makeNgon(boundarysize);
+				internals_randomtriangulation::boltzmannTriangulation(_CM, 0, avoiddoubleedges, [&](int64 m) -> int64 { return _fbtlaw(m, gen); });
+				return _CM;
+				}
+
+
+			/**
+			 * Sample a generalized Boltzmann triangulation (of type II) with parameter theta in (0,1/6]
+			 * and a boundary of a given size. The previous sample is overwritten.
+			 *
+			 * @return	The map (valid until the next sample).
+			 **/
+			template<typename random_t> CombinatorialMap & generalBoltzmannTriangulation(int boundarysize, double theta, bool avoiddoubleedges, random_t & gen)
+				{
+				_CM.makeNgon(boundarysize);
+				internals_randomtriangulation::boltzmannTriangulation(_CM, 0, avoiddoubleedges, [&](int64 m) -> int64 { return _gbtlaw(m, theta, gen); });
+				return _CM;
+				}
+
+
+			/**
+			 * Stream a free Boltzmann triangulation to the callbacks given in the constructor, see
+			 * TriangulationStream::freeBoltzmannTriangulation(). The stream is reset first so the
+			 * vertices of each sample are numbered from 0.
+			 **/
+			template<typename random_t> void streamFreeBoltzmannTriangulation(int64 boundarysize, bool avoiddoubleedges, random_t & gen)
+				{
+				_stream.reset();
+				_stream.freeBoltzmannTriangulation(boundarysize, avoiddoubleedges, gen);
+				}
+
+
+			/**
+			 * Stream a generalized Boltzmann triangulation to the callbacks given in the constructor,
+			 * see TriangulationStream::generalBoltzmannTriangulation(). The stream is reset first.
+			 **/
+			template<typename random_t> void streamGeneralBoltzmannTriangulation(int64 boundarysize, double theta, bool avoiddoubleedges, random_t & gen)
+				{
+				_stream.reset();
+				_stream.generalBoltzmannTriangulation(boundarysize, theta, avoiddoubleedges, gen);
+				}
+
+
+			/** The map containing the last sample. **/
+			CombinatorialMap & map() { return _CM; }
+
+
+			/** The stream used by the streaming methods (e.g. to query the number of vertices of the last sample). **/
+			TriangulationStream & stream() { return _stream; }
+
+
+			/**
+			 * Run independent samples in several threads.
+			 * 
+			 * Thread th (in [0, nbThreads-1]) owns its sampler and a copy of gen moved to the
+			 * independent stream th + 1 with split() (so random_t must be copyable and provide split(),
+			 * e.g. MT2004_64). It calls fun(BoltzmannTriangulationSampler & S, random_t & g, int64 n, size_t th)
+			 * for the samples n in [th*nbsamples/nbThreads, (th+1)*nbsamples/nbThreads[, fun drawing the
+			 * sample with S and g. The results only depend on gen and nbThreads. Reductions should be
+			 * accumulated in per-thread variables indexed by th.
+			 *
+			 * @param	nbsamples	Total number of samples.
+			 * @param	gen		 	The generator (not modified).
+			 * @param	fun		 	The function called for each sample.
+			 * @param	nbThreads	Number of threads (0 = number of hardware threads).
+			 * @param	facefun  	The face callback of the samplers (may be empty).
+			 * @param	vertexfun	The vertex callback of the samplers (may be empty).
+			 **/
+			template<typename random_t, typename FUN> static void parallelSamples(int64 nbsamples, const random_t & gen, FUN fun, size_t nbThreads = 0, TriangulationStream::FaceCallback facefun = nullptr, TriangulationStream::VertexCallback vertexfun = nullptr)
+				{
+				if (nbThreads == 0) { nbThreads = (size_t)std::max<int>(1, nbHardwareThreads()); }
+				auto work = [&](size_t th)
+					{
+					random_t g(gen);
+					g.split((uint64)(th + 1));
+					BoltzmannTriangulationSampler S(facefun, vertexfun);
+					const int64 n0 = (int64)((nbsamples * (int64)th) / (int64)nbThreads), n1 = (int64)((nbsamples * (int64)(th + 1)) / (int64)nbThreads);
+					for (int64 n = n0; n < n1; n++) { fun(S, g, n, th); }
+					};
+				std::vector<std::thread> threads;
+				for (size_t th = 1; th < nbThreads; th++) { threads.push_back(std::thread(work, th)); }
+				work(0);
+				for (auto & t : threads) { t.join(); }
+				}
+
+
+		private:
+
+			BoltzmannTriangulationSampler(const BoltzmannTriangulationSampler &) = delete;
+			BoltzmannTriangulationSampler & operator=(const BoltzmannTriangulationSampler &) = delete;
+
+			CombinatorialMap						_CM;		// the map reused by all the samples
+			TriangulationStream						_stream;	// the stream reused by all the samples
+			freeBoltzmanTriangulationLawSampler		_fbtlaw;	// tabulated peeling laws
+			generalBoltzmanTriangulationLawSampler	_gbtlaw;	//
+		};
+
+
 	}
 
 
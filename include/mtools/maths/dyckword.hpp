@@ -34,6 +34,33 @@ namespace mtools
 	{
 
 
+	namespace internals_dyckword
+		{
+
+		/* number of set bits in a word */
+		inline int popcount64(uint64 w)
+			{
+			w = w - ((w >> 1) & 0x5555555555555555ULL);
+			w = (w & 0x3333333333333333ULL) + ((w >> 2) & 0x3333333333333333ULL);
+			w = (w + (w >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+			return (int)((w * 0x0101010101010101ULL) >> 56);
+			}
+
+		/* position of the k-th set bit (k = 0 for the lowest) of a word with more than k set bits */
+		inline int selectBit64(uint64 w, int k)
+			{
+			int b = 0;
+			for (int s = 32; s >= 8; s >>= 1)
+				{
+				const int c = popcount64(w & ((1ULL << s) - 1));
+				if (k >= c) { k -= c; w >>= s; b += s; }
+				}
+			while (true) { if (w & 1) { if (k == 0) return b; k--; } w >>= 1; b++; }
+			}
+
+		}
+
+
 	/**
 	* Class representing a dyck word with a given weight for the ups.
 	*
@@ -45,6 +72,10 @@ namespace mtools
 	* When weight > 1, there are weight adlissible rooting of the word that
 	* satisfy the prefix condition.
 	*
+	* The word is stored bit-packed (1 bit per letter, 1 = up, 0 = down) and always rooted at 
+	* position 0 so that words with 10^9 letters fit in ~125MB. An index with the number of ups 
+	* before each block of 512 letters gives rank and select queries in (almost) constant time.
+	*
 	* NOTE: the case weight > 1 encode the set of tree considered by Poulalhon and Schaeffer                
 	*       for their bijection with simple planar triangulation. 
 	**/
@@ -56,27 +87,37 @@ namespace mtools
 			/** default ctor. Empty dyck word with 1 ups and weight 1.  
 			 *  The corresponding tree is reduced to a single edge.
 			 **/
-			DyckWord() : _weight(1), _nup(1), _root(0), _vec(3, 0)
+			DyckWord() : _weight(1), _nup(1), _len(3)
 				{
-				_vec[0] = 1;
+				_bits.assign(1, 1);
+				_buildIndex();
 				}
 
 
 			/** ctor. Construct a simple simple dyck word of a given lenght and weight.  
 			 * All the ups are first, followed by all the down.
 			 **/
-			DyckWord(int nup, int weight = 1) : _weight(weight), _nup(nup), _root(0)
+			DyckWord(int nup, int weight = 1) : _weight(weight), _nup(nup)
 				{
 				MTOOLS_ASSERT(weight > 0);
 				MTOOLS_ASSERT(nup >= 0);
-				_vec.resize((_weight == 1) ? (2 * _nup + 1) : ((1 + _weight)*_nup + (_weight - 1)));
-				for (int i = 0; i < _nup; i++) { _vec[i] = 1; }
+				const int64 len = (_weight == 1) ? (2 * (int64)_nup + 1) : ((1 + (int64)_weight)*_nup + (_weight - 1));
+				MTOOLS_INSURE(len < 2147483647);
+				_len = (int)len;
+				_bits.assign(_nbWords(), 0);
+				for (int i = 0; i < (_nup >> 6); i++) { _bits[i] = ~((uint64)0); }
+				if (_nup & 63) { _bits[_nup >> 6] = (((uint64)1) << (_nup & 63)) - 1; }
+				_buildIndex();
 				}
 
 
 			/**
 			 * Shuffles the world uniformly. 
 			 * 
+			 * Linear time: the positions of the ups are drawn with sequential sampling (the random 
+			 * numbers are fetched by blocks with fillUnif64()) and the word is then rerooted with the
+			 * cycle lemma.
+			 * 
 			 * If weight > 1, there are weight possible choices that make a legal word.
 			 *   
 			 * @param	upminimum	true to choose a rooting such that the word start with 
@@ -84,31 +125,30 @@ namespace mtools
 			 * 						among the weight possible ones (there is only one legal rooting
 			 * 						when weight = 1).  
 			 **/
-			template<typename random_t> void shuffle(random_t gen,bool upminimum = true)
+			template<typename random_t> void shuffle(random_t & gen, bool upminimum = true)
 				{
-				randomShuffle(_vec, gen); // shuffle the word.
-				reroot(); // find a minimum that always start with an up. 
-				if ((_weight == 1) || (upminimum)) return; // done
+				_randomWord(gen);	// uniform word with _nup ups
+				reroot();			// find a minimum that always start with an up. 
+				if ((_weight == 1) || (upminimum)) { _buildIndex(); return; } // done
 				// choose another rooting uniformly among all other.
-				const int l = (int)_vec.size();
-				int mx = -((int)(Unif(gen)*_weight)); // there are _weight choices
-				if (mx == 0) return;
-				int x = 0;
-				for (int i = 0; i < l; i++)
+				int mx = -((int)Unif_bounded((uint64)_weight, gen)); // there are _weight choices
+				if (mx == 0) { _buildIndex(); return; }
+				int64 x = 0;
+				for (int i = 0; i < _len; i++)
 					{
-					x += ((this->operator[](i) == 0) ? -1 : _weight);
-					if (x == mx) { _root = ((_root + i + 1) % l); return; }
+					x += ((_bit(i) == 0) ? -1 : _weight);
+					if (x == mx) { _rotate((i + 1) % _len); _buildIndex(); return; }
 					}
 				MTOOLS_ERROR("should not be possible...");
 				}
 
 
-			/** Access a Dyck word letter (circular). **/
-			const char & operator[](int i) const
+			/** Access a Dyck word letter (circular): 1 for an up and 0 for a down. **/
+			inline int operator[](int i) const
 				{
-				const int l = (int)_vec.size();
-				const int p = i + _root;
-				return _vec[(p%l) + ((p<0) ? l : 0)];
+				if ((unsigned int)i < (unsigned int)_len) return _bit(i);
+				const int p = i % _len;
+				return _bit(p + ((p < 0) ? _len : 0));
 				}
 
 
@@ -118,7 +158,7 @@ namespace mtools
 			* weight > 1: this is (1 + weight)*nup + (weight - 1) [the word is rooted at a bud 
 			*             so the word ends when the RW reaches -(weigth-1)]
 			**/
-			inline int length() const { return (int)_vec.size(); }
+			inline int length() const { return _len; }
 
 
 			/**
@@ -147,13 +187,92 @@ namespace mtools
 			inline int nups() const { return _nup; }
 
 
+			/**
+			 * Number of ups among the first i letters of the word (0 <= i <= length()).
+			 **/
+			inline int rankUp(int i) const
+				{
+				MTOOLS_ASSERT((i >= 0) && (i <= _len));
+				const int k = i >> 6;
+				int r = _rank[i >> 9];
+				for (int j = (k & ~7); j < k; j++) { r += internals_dyckword::popcount64(_bits[j]); }
+				if (i & 63) { r += internals_dyckword::popcount64(_bits[k] & ((((uint64)1) << (i & 63)) - 1)); }
+				return r;
+				}
+
+
+			/**
+			 * Number of downs among the first i letters of the word (0 <= i <= length()).
+			 **/
+			inline int rankDown(int i) const { return i - rankUp(i); }
+
+
+			/**
+			 * Height of the walk after the first i letters of the word (0 <= i <= length()): each up
+			 * counts for +weight and each down for -1.
+			 **/
+			inline int64 height(int i) const { const int64 r = rankUp(i); return r*_weight - (i - r); }
+
+
+			/**
+			 * Position of the k-th up of the word (k = 0 for the first one, k < nups()).
+			 **/
+			int selectUp(int k) const
+				{
+				MTOOLS_ASSERT((k >= 0) && (k < _nup));
+				int a = 0, b = (int)_rank.size() - 1; // last block with _rank[a] <= k
+				while (b - a > 1) { const int m = (a + b) >> 1; if (_rank[m] <= k) a = m; else b = m; }
+				k -= _rank[a];
+				int j = a << 3;
+				while (true)
+					{
+					const int c = internals_dyckword::popcount64(_bits[j]);
+					if (k < c) return (j << 6) + internals_dyckword::selectBit64(_bits[j], k);
+					k -= c; j++;
+					}
+				}
+
+
+			/**
+			 * Position of the k-th down of the word (k = 0 for the first one, k < length() - nups()).
+			 **/
+			int selectDown(int k) const
+				{
+				MTOOLS_ASSERT((k >= 0) && (k < _len - _nup));
+				int a = 0, b = (int)_rank.size() - 1; // last block with (512*a - _rank[a]) <= k
+				while (b - a > 1) { const int m = (a + b) >> 1; if ((int64)512 * m - _rank[m] <= k) a = m; else b = m; }
+				k -= (int)(512 * (int64)a - _rank[a]);
+				int j = a << 3;
+				while (true)
+					{
+					const uint64 w = ~_bits[j];
+					const int c = internals_dyckword::popcount64(w);
+					if (k < c) return (j << 6) + internals_dyckword::selectBit64(w, k);
+					k -= c; j++;
+					}
+				}
+
+
+			/**
+			 * Word w of the bit-packed representation: letters 64*w to 64*w + 63, the first one in the 
+			 * lowest bit (the bits after length() are zero). Useful for streaming through the word.
+			 **/
+			inline uint64 packedWord(int w) const { return _bits[w]; }
+
+
+			/**
+			 * Number of words of the bit-packed representation.
+			 **/
+			inline int nbPackedWords() const { return (int)_bits.size(); }
+
+
 			/**
 			* Print the word into a string
 			**/
 			std::string toString() const
 				{
 				std::string s("[");
-				for (int i = 0; i < (int)_vec.size(); i++) { s += ((this->operator[](i))*_weight + '0'); }
+				for (int i = 0; i < _len; i++) { s += (char)(_bit(i)*_weight + '0'); }
 				return s + "]";
 				}
 
@@ -166,37 +285,152 @@ namespace mtools
 				{
 				Archive & _weight;
 				Archive & _nup;
-				Archive & _root;
-				Archive & _vec;
+				Archive & _len;
+				Archive & _bits;
+				_buildIndex();
 				}
 
 
 		private:
 
 
+			/* letter at position 0 <= i < _len */
+			inline int _bit(int i) const { return (int)((_bits[i >> 6] >> (i & 63)) & 1); }
+
+
+			/* number of words needed for the letters */
+			inline size_t _nbWords() const { return ((size_t)_len + 63) >> 6; }
+
+
+			/* rebuild the rank index: number of ups before each block of 512 letters */
+			void _buildIndex()
+				{
+				const size_t nw = _bits.size();
+				_rank.assign(((nw + 7) >> 3) + 1, 0);
+				int r = 0;
+				for (size_t j = 0; j < nw; j++)
+					{
+					if ((j & 7) == 0) _rank[j >> 3] = r;
+					r += internals_dyckword::popcount64(_bits[j]);
+					}
+				_rank.back() = r;
+				MTOOLS_ASSERT(r == _nup);
+				}
+
+
+			/**
+			 * Draw a uniform word with _nup ups among _len letters by sequential sampling: the letter 
+			 * at position i is an up with probability (number of ups left) / (number of letters left).
+			 * Each test is exact (Lemire's method as in Unif_bounded()) and uses one 64 bits random
+			 * number, the numbers being generated by blocks.
+			 **/
+			template<typename random_t> void _randomWord(random_t & gen)
+				{
+				const int B = 1024;
+				uint64 buf[B];
+				_bits.assign(_nbWords(), 0);
+				int64 ups = _nup;
+				for (int i0 = 0; i0 < _len; i0 += B)
+					{
+					const int m = std::min<int>(B, _len - i0);
+					fillUnif64(gen, buf, (size_t)m);
+					for (int k = 0; k < m; k++)
+						{
+						const int i = i0 + k;
+						const uint64 n = (uint64)(_len - i);	// letters left
+						uint64 lo;
+						uint64 hi = internals_random::_mul128(buf[k], n, lo);
+						if (lo < n)
+							{
+							const uint64 t = (0 - n) % n;
+							while (lo < t) { hi = internals_random::_mul128(Unif_64(gen), n, lo); }
+							}
+						if ((int64)hi < ups) { _bits[i >> 6] |= (((uint64)1) << (i & 63)); ups--; }
+						}
+					}
+				MTOOLS_ASSERT(ups == 0);
+				}
+
+
+			/* rotate the word such that the letter at position r becomes the first one */
+			void _rotate(int r)
+				{
+				if (r == 0) return;
+				std::vector<uint64> nb(_bits.size(), 0);
+				const int nw = (int)nb.size();
+				for (int w = 0; w < nw; w++)
+					{
+					int p = r + (w << 6);
+					if (p >= _len) p -= _len;
+					const int e = std::min<int>(64, _len - (w << 6)); // letters in this word
+					if ((p & 63) == 0 && p + e <= _len)
+						{
+						nb[w] = _bits[p >> 6];
+						}
+					else if (p + e <= _len)
+						{
+						const int s = p & 63;
+						uint64 v = _bits[p >> 6] >> s;
+						if ((p >> 6) + 1 < nw) v |= (_bits[(p >> 6) + 1] << (64 - s));
+						nb[w] = v;
+						}
+					else
+						{ // wraps around
+						uint64 v = 0;
+						for (int k = 0; k < e; k++) { v |= ((uint64)_bit(p)) << k; if (++p == _len) p = 0; }
+						nb[w] = v;
+						}
+					if (e < 64) nb[w] &= ((((uint64)1) << e) - 1);
+					}
+				_bits.swap(nb);
+				}
+
+
+			/* scan the letters in [a,b) updating the height x and the first absolute minimum */
+			void _scanMin(int a, int b, int64 & x, int64 & min_x, int & min_index) const
+				{
+				// table for each byte: increment, minimum of the partial heights and first position of this minimum
+				int tdelta[256], tmin[256], targ[256];
+				for (int v = 0; v < 256; v++)
+					{
+					int h = 0; tmin[v] = 1 << 30; targ[v] = 0;
+					for (int k = 0; k < 8; k++) { h += (((v >> k) & 1) ? _weight : -1); if (h < tmin[v]) { tmin[v] = h; targ[v] = k; } }
+					tdelta[v] = h;
+					}
+				int i = a;
+				while ((i < b) && (i & 7)) { x += ((_bit(i) == 0) ? -1 : _weight); if (x < min_x) { min_x = x; min_index = i; } i++; }
+				for (; i + 8 <= b; i += 8)
+					{
+					const int v = (int)((_bits[i >> 6] >> (i & 63)) & 255);
+					if (x + tmin[v] < min_x) { min_x = x + tmin[v]; min_index = i + targ[v]; }
+					x += tdelta[v];
+					}
+				for (; i < b; i++) { x += ((_bit(i) == 0) ? -1 : _weight); if (x < min_x) { min_x = x; min_index = i; } }
+				}
+
+
 			/**
 			 * Reroots the word such that it satisfies the prefix condition but
 			 * also that it starts with an up. 
 			 **/
 			inline void reroot()
 				{
-				if (_nup == 0) { _root = 0; return; }
-				const int l = (int)_vec.size();
-				for (int i = 0; i < l; i++) { if (_vec[i] != 0) { _root = i; } } // choose root such that the word start with an up
-				int x = 0, min_x = 0, min_index = 0;
-				for (int i = 0; i < l; i++) // find the absolute minimum.
-					{
-					x += ((this->operator[](i) == 0) ? -1 : _weight);
-					if (x < min_x) { min_x = x; min_index = i; }
-					}
-				_root = ((_root + min_index + 1) % l); // reroot, if the min is in the interior of the interval, it must start again with an up...
+				if (_nup == 0) { return; }
+				int s = 0;	// choose root such that the word start with an up (the last up)
+				for (int w = (int)_bits.size() - 1; w >= 0; w--) { if (_bits[w] != 0) { uint64 v = _bits[w]; int b = 63; while (((v >> b) & 1) == 0) b--; s = (w << 6) + b; break; } }
+				int64 x = 0, min_x = 0;
+				int min_index = s;
+				_scanMin(s, _len, x, min_x, min_index);	// find the absolute minimum, going around the word from s.
+				_scanMin(0, s, x, min_x, min_index);
+				_rotate((min_index + 1) % _len); // reroot, if the min is in the interior of the interval, it must start again with an up...
 				}
 
 
-			int _weight;			// weight of the ups
-			int _nup;				// number of ups. 
-			int _root;				// position of the root
-			std::vector<char> _vec;	// the word itself
+			int _weight;				// weight of the ups
+			int _nup;					// number of ups. 
+			int _len;					// length of the word
+			std::vector<uint64> _bits;	// the word itself (1 bit per letter, 1 = up)
+			std::vector<int> _rank;		// number of ups before each block of 512 letters (and total number of ups at the end)
 
 		};
 
@@ -204,5 +438,4 @@ namespace mtools
 
 	}
 
-/* end of file */
-
+/* end of file */
\ No newline at end of file
@@ -30,6 +30,8 @@
 #include "permutation.hpp"
 #include "combinatorialmap.hpp"
 
+#include <algorithm>
+
 namespace mtools
 	{
 
@@ -41,6 +43,154 @@ namespace mtools
 	typedef Graph1 Graph; // default choice. 
 
 
+	/**
+	 * Graph stored in compressed sparse row (CSR) format: all the neighbour lists are stored one
+	 * after the other in a single array and the neighbours of vertex i are list[off[i]], ...,
+	 * list[off[i+1]-1]. This avoids one allocation per vertex and gives much better memory locality
+	 * than std::vector<std::vector<int> > for large graphs.
+	 *
+	 * The object behaves like the other graph types: gr.size() is the number of vertices and gr[i]
+	 * is a (lightweight) view of the neighbour list of vertex i with begin(), end(), size() and
+	 * operator[] so it can be used with all the generic algorithms of this file and with
+	 * CombinatorialMap. The neighbour lists cannot be resized, new vertices are added at the end
+	 * with push_back().
+	 **/
+	class CSRGraph
+		{
+
+		public:
+
+		/** View of the neighbour list of a vertex. */
+		template<typename T> class NeighbourList
+			{
+			public:
+
+			NeighbourList(T * b, T * e) : _b(b), _e(e) {}
+
+			T * begin() const { return _b; }
+			T * end() const { return _e; }
+			size_t size() const { return (size_t)(_e - _b); }
+			bool empty() const { return (_b == _e); }
+			T & operator[](size_t k) const { return _b[k]; }
+
+			private:
+			T * _b;
+			T * _e;
+			};
+
+
+		/** Empty graph. */
+		CSRGraph() : _off(1, 0) {}
+
+
+		/**
+		 * Construct from another graph (any type accepted by the generic algorithms, e.g.
+		 * std::vector<std::vector<int>>).
+		 **/
+		template<typename GRAPH> explicit CSRGraph(const GRAPH & gr) : _off(1, 0)
+			{
+			const size_t l = gr.size();
+			size_t n = 0;
+			for (size_t i = 0; i < l; i++) { n += gr[i].size(); }
+			_off.reserve(l + 1);
+			_list.reserve(n);
+			for (size_t i = 0; i < l; i++) { push_back(gr[i]); }
+			}
+
+
+		/**
+		 * Construct directly from a combinatorial map. Same result as CSRGraph(cm.toGraph()) but
+		 * without the intermediate graph.
+		 **/
+		explicit CSRGraph(const CombinatorialMap & cm) : _off(1, 0)
+			{
+			const int nbv = cm.nbVertices();
+			const int l = cm.nbDarts();
+			std::vector<int> start(nbv, -1);	// first dart of each vertex
+			for (int i = 0; i < l; i++) { const int v = cm.vertice(i); if (start[v] < 0) start[v] = i; }
+			_off.resize(nbv + 1);
+			_list.resize(l);
+			int k = 0;
+			for (int v = 0; v < nbv; v++)
+				{
+				_off[v] = k;
+				const int i = start[v];
+				if (i < 0) continue;
+				int j = i;
+				do { _list[k++] = cm.vertice(cm.alpha(j)); j = cm.sigma(j); } while (j != i);
+				}
+			_off[nbv] = k;
+			_list.resize(k);
+			}
+
+
+		/** Number of vertices. */
+		size_t size() const { return _off.size() - 1; }
+
+
+		/** Total number of (directed) edges, i.e. the sum of all the degrees. */
+		size_t nbEdges() const { return _list.size(); }
+
+
+		/** Degree of vertex i. */
+		int degree(size_t i) const { return _off[i + 1] - _off[i]; }
+
+
+		/** Neighbour list of vertex i. */
+		NeighbourList<int> operator[](size_t i) { return NeighbourList<int>(_list.data() + _off[i], _list.data() + _off[i + 1]); }
+
+
+		/** Neighbour list of vertex i. */
+		NeighbourList<const int> operator[](size_t i) const { return NeighbourList<const int>(_list.data() + _off[i], _list.data() + _off[i + 1]); }
+
+
+		/** Offsets of the neighbour lists (size() + 1 elements). */
+		const std::vector<int> & offsets() const { return _off; }
+
+
+		/** All the neighbour lists, one after the other (nbEdges() elements). */
+		const std::vector<int> & neighbours() const { return _list; }
+
+
+		/** Add a new vertex at the end with given (iterable) neighbour list. */
+		template<typename LIST> void push_back(const LIST & neighbourlist)
+			{
+			for (auto it = neighbourlist.begin(); it != neighbourlist.end(); ++it) { _list.push_back((int)(*it)); }
+			_off.push_back((int)_list.size());
+			}
+
+
+		/** Remove all vertices. */
+		void clear() { _off.assign(1, 0); _list.clear(); }
+
+
+		bool operator==(const CSRGraph & gr) const { return ((_off == gr._off) && (_list == gr._list)); }
+
+		bool operator!=(const CSRGraph & gr) const { return !(operator==(gr)); }
+
+
+		/** Serialization. */
+		template<typename ARCHIVE> void serialize(ARCHIVE & ar, const int version = 0)
+			{
+			ar & _off;
+			ar & _list;
+			}
+
+
+		private:
+
+		std::vector<int> _off;		// offset of the neighbour list of each vertex + total size at the end
+		std::vector<int> _list;		// the neighbour lists
+		};
+
+
+	/** Conversion of a combinatorial map to a graph in CSR format. */
+	template<> inline CSRGraph CombinatorialMap::toGraph<CSRGraph>() const
+		{
+		return CSRGraph(*this);
+		}
+
+
 	/**
 	 * Return true if j is a neighour of i. Search by iterating among the neighbour of i
 	 * which is linear in the degree of i. 
@@ -87,27 +237,89 @@ namespace mtools
 		}
 
 
+	/**
+	* Reorder the vertices of a graph in place according to a permutation: same result as
+	* graph = permuteGraph(graph, perm) but the adjacency lists are moved instead of copied so
+	* the memory used does not double (see Permutation::permute()).
+	*
+	* @tparam	GRAPH   	Type of the graph, typically std::vector< std::vector<int> >.
+	* @param [in,out]	graph	The graph to reorder.
+	* @param	perm    	The permutation to apply: perm[i] = k means that the vertex with index k
+	*                       must now become the vertex at index i in the new graph.
+	**/
+	template<typename GRAPH> void permuteGraphInPlace(GRAPH & graph, const Permutation  & perm)
+		{
+		const size_t l = graph.size();
+		MTOOLS_INSURE(perm.size() == l);
+		perm.computeInverse();
+		perm.permute(graph);	// permute the order of the vertices.
+		for (size_t i = 0; i < l; i++)
+			{
+			for (auto it = graph[i].begin(); it != graph[i].end(); it++) { (*it) = perm.inv(*it); }
+			}
+		}
 
 
 	/**
-	* Convert a graph from type A to type B.
+	* Specialization of permuteGraph() for CSRGraph.
 	**/
-	template<typename GRAPH_A, typename GRAPH_B> GRAPH_B convertGraph(const GRAPH_A & graph)
+	template<> inline CSRGraph permuteGraph<CSRGraph>(const CSRGraph & graph, const Permutation  & perm)
 		{
-		GRAPH_B res;
 		const size_t l = graph.size();
-		if (l == 0) return res;
-		res.resize(l);
+		MTOOLS_INSURE(perm.size() == l);
+		CSRGraph res;
+		std::vector<int> row;
 		for (size_t i = 0; i < l; i++)
 			{
-			auto & lv1 = graph[i];
-			auto & lv2 = res[i];
-			for (auto it = lv1.begin(); it != lv1.end(); ++it) { lv2.push_back(*it); }
+			auto nl = graph[perm[(int)i]];
+			row.resize(nl.size());
+			for (size_t k = 0; k < nl.size(); k++) { row[k] = perm.inv(nl[k]); }
+			res.push_back(row);
 			}
 		return res;
 		}
 
 
+	namespace internals_graph
+		{
+
+		/* generic conversion between graph types */
+		template<typename GRAPH_A, typename GRAPH_B> struct GraphConverter
+			{
+			static GRAPH_B convert(const GRAPH_A & graph)
+				{
+				GRAPH_B res;
+				const size_t l = graph.size();
+				if (l == 0) return res;
+				res.resize(l);
+				for (size_t i = 0; i < l; i++)
+					{
+					auto && lv1 = graph[i];
+					auto & lv2 = res[i];
+					for (auto it = lv1.begin(); it != lv1.end(); ++it) { lv2.push_back(*it); }
+					}
+				return res;
+				}
+			};
+
+		/* conversion to CSR format */
+		template<typename GRAPH_A> struct GraphConverter<GRAPH_A, CSRGraph>
+			{
+			static CSRGraph convert(const GRAPH_A & graph) { return CSRGraph(graph); }
+			};
+
+		}
+
+
+	/**
+	* Convert a graph from type A to type B.
+	**/
+	template<typename GRAPH_A, typename GRAPH_B> GRAPH_B convertGraph(const GRAPH_A & graph)
+		{
+		return internals_graph::GraphConverter<GRAPH_A, GRAPH_B>::convert(graph);
+		}
+
+
 	/**
 	 * Removes all the vertices (and edges pointing to them) from index newSize to the end. The
 	 * vertices strictly below startIndex are unaffected. This yields a  graph with a total number
@@ -130,6 +342,23 @@ namespace mtools
 		}
 
 
+	/**
+	* Specialization of resizeGraph() for CSRGraph.
+	**/
+	template<> inline CSRGraph resizeGraph<CSRGraph>(const CSRGraph & graph, size_t newSize)
+		{
+		CSRGraph gres;
+		std::vector<int> row;
+		for (size_t i = 0; i < newSize; i++)
+			{
+			row.clear();
+			for (auto it = graph[i].begin(); it != graph[i].end(); it++) { if ((size_t)(*it) < newSize) row.push_back(*it); }
+			gres.push_back(row);
+			}
+		return gres;
+		}
+
+
 
 	
 	namespace internals_graph
@@ -219,7 +448,7 @@ namespace mtools
 	template<typename GRAPH> int exploreNeighbour(const GRAPH & gr, int vertex, std::function<bool(int)> fun)
 		{
 		int nbv = 0;
-		for (const auto it = gr[vertex].begin(); it != gr[vertex].end(); ++it) { if (!fun(*it)) return nbv; }
+		for (auto it = gr[vertex].begin(); it != gr[vertex].end(); ++it) { nbv++; if (!fun(*it)) return nbv; }
 		return nbv;
 		}
 
@@ -348,6 +577,120 @@ namespace mtools
 		}
 
 
+	namespace internals_graph
+		{
+
+		/* breadth-first ordering of all the vertices of the graph, one connected component after the
+		   other. If cm is set, the neighbours are visited by increasing degree and each component is
+		   started from a pseudo-peripheral vertex of minimum degree (Cuthill-McKee ordering). */
+		template<typename GRAPH> std::vector<int> bfsOrder(const GRAPH & gr, int root, bool cm)
+			{
+			const int l = (int)gr.size();
+			std::vector<int> order;
+			order.reserve(l);
+			std::vector<char> visited(l, 0);
+			std::vector<int> dist(l, -1);
+			std::vector<int> nbs;
+			auto bfs = [&](int start, std::vector<int> & res) // bfs of the component of start, appended to res
+				{
+				const size_t first = res.size();
+				visited[start] = 1;
+				res.push_back(start);
+				for (size_t k = first; k < res.size(); k++)
+					{
+					const int v = res[k];
+					nbs.clear();
+					for (auto it = gr[v].begin(); it != gr[v].end(); ++it) { const int w = (int)(*it); if (!visited[w]) { visited[w] = 1; nbs.push_back(w); } }
+					if (cm) { std::stable_sort(nbs.begin(), nbs.end(), [&](int a, int b) { return gr[a].size() < gr[b].size(); }); }
+					res.insert(res.end(), nbs.begin(), nbs.end());
+					}
+				};
+			auto peripheral = [&](int start) -> int // find a pseudo-peripheral vertex in the component of start
+				{
+				std::vector<int> comp;
+				int v = start, ecc = -1;
+				for (int pass = 0; pass < 10; pass++)
+					{ // move to a vertex of minimal degree among the farthest ones while the eccentricity increases.
+					comp.clear();
+					bfs(v, comp);
+					for (int w : comp) { dist[w] = -1; }
+					dist[v] = 0;
+					int e = 0;
+					for (int w : comp) { for (auto it = gr[w].begin(); it != gr[w].end(); ++it) { const int u = (int)(*it); if (dist[u] < 0) { dist[u] = dist[w] + 1; if (dist[u] > e) e = dist[u]; } } }
+					for (int w : comp) { visited[w] = 0; }
+					if (e <= ecc) break;
+					ecc = e;
+					int best = -1;
+					for (int w : comp) { if ((dist[w] == e) && ((best < 0) || (gr[w].size() < gr[best].size()))) best = w; }
+					v = best;
+					}
+				return v;
+				};
+			if ((root >= 0) && (root < l)) { bfs((cm ? peripheral(root) : root), order); }
+			for (int i = 0; i < l; i++)
+				{
+				if (visited[i]) continue;
+				int s = i;
+				if (cm)
+					{ // start from a vertex of minimum degree in the component
+					std::vector<int> comp;
+					bfs(i, comp);
+					for (int w : comp) { visited[w] = 0; if (gr[w].size() < gr[s].size()) s = w; }
+					s = peripheral(s);
+					}
+				bfs(s, order);
+				}
+			return order;
+			}
+
+
+		/* the permutation that puts vertex order[i] at position i */
+		inline Permutation orderToPermutation(const std::vector<int> & order)
+			{
+			std::vector<int> rank(order.size());
+			for (int i = 0; i < (int)order.size(); i++) { rank[order[i]] = i; }
+			return Permutation(rank);
+			}
+
+		}
+
+
+	/**
+	 * Compute a breadth-first search ordering of the vertices of a graph. Vertices that are close in
+	 * the graph get close indices which improves memory locality when the graph is traversed.
+	 * Connected components not containing the root are visited afterward.
+	 *
+	 * @param	gr  	The graph.
+	 * @param	root	The vertex to start from.
+	 *
+	 * @return	The permutation to use with permuteGraph() (and getPermute() for labels attached to the
+	 * 			vertices, getAntiPermute() to map them back).
+	 **/
+	template<typename GRAPH> Permutation bfsPermutation(const GRAPH & gr, int root = 0)
+		{
+		return internals_graph::orderToPermutation(internals_graph::bfsOrder(gr, root, false));
+		}
+
+
+	/**
+	 * Compute the reverse Cuthill-McKee ordering of the vertices of a graph: breadth-first search
+	 * from a pseudo-peripheral vertex, visiting the neighbours by increasing degree, in reverse
+	 * order. This reduces the bandwidth of the adjacency matrix, i.e. the neighbours of each vertex
+	 * have close indices, which makes sweeps over the graph cache friendly.
+	 *
+	 * @param	gr	The graph.
+	 *
+	 * @return	The permutation to use with permuteGraph() (and getPermute() for labels attached to the
+	 * 			vertices, getAntiPermute() to map them back).
+	 **/
+	template<typename GRAPH> Permutation reverseCuthillMcKeePermutation(const GRAPH & gr)
+		{
+		std::vector<int> order = internals_graph::bfsOrder(gr, -1, true);
+		std::reverse(order.begin(), order.end());
+		return internals_graph::orderToPermutation(order);
+		}
+
+
 	/* forward declaration */
 	struct GraphInfo;
 	template<typename GRAPH>  GraphInfo graphInfo(const GRAPH & gr);
@@ -0,0 +1,437 @@
+/** @file graphAlgorithms.hpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include "../misc/internal/mtools_export.hpp"
+#include "../misc/misc.hpp"
+#include "../misc/error.hpp"
+#include "../misc/internal/threadworker.hpp"
+#include "combinatorialmap.hpp"
+#include "graph.hpp"
+
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <algorithm>
+
+
+namespace mtools
+	{
+
+	/*
+	 * Parallel algorithms for large graphs: breadth-first search (distances from one or several
+	 * sources, ball volumes) and connected components.
+	 *
+	 * All the functions accept any graph type of graph.hpp (std::vector<std::vector<int>>,
+	 * CSRGraph...) and also a CombinatorialMap directly: in that case, the neighbours of a vertex
+	 * are read on the darts around it (sigma orbit) without building the graph.
+	 *
+	 * The BFS is level synchronous and direction optimizing (Beamer, Asanovic, Patterson 2012):
+	 * small frontiers are expanded top-down (each vertex of the frontier claims its unvisited
+	 * neighbours) and large frontiers bottom-up (each unvisited vertex looks for a neighbour in the
+	 * frontier and stops at the first one found) which avoids examining most of the edges in the
+	 * middle levels of the search. The bottom-up steps require the graph to be undirected (which is
+	 * the case for the graphs obtained from combinatorial maps).
+	 */
+
+
+	namespace internals_graphalgo
+		{
+
+		static const int64 PARALLEL_MIN = 4096;		// minimum amount of work in a step for using several threads
+		static const int64 BFS_ALPHA = 14;			// switch to bottom-up when the frontier has more than 1/ALPHA of the remaining edges
+		static const int64 BFS_BETA = 24;			// switch back to top-down when the frontier has less than 1/BETA of the vertices
+
+
+		/* adjacency of a graph of graph.hpp */
+		template<typename GRAPH> struct GraphAdjacency
+			{
+			GraphAdjacency(const GRAPH & g) : gr(g) {}
+
+			int size() const { return (int)gr.size(); }
+
+			int degree(int v) const { return (int)gr[v].size(); }
+
+			/* call fun(w) for each neighbour w of v until it returns false */
+			template<typename FUN> void forEachNeighbour(int v, FUN & fun) const
+				{
+				for (auto it = gr[v].begin(); it != gr[v].end(); ++it) { if (!fun((int)(*it))) return; }
+				}
+
+			const GRAPH & gr;
+			};
+
+
+		/* adjacency of the vertices of a combinatorial map, read directly on the darts */
+		struct MapAdjacency
+			{
+			MapAdjacency(const CombinatorialMap & m) : cm(m), start(m.nbVertices(), -1), deg(m.nbVertices(), 0)
+				{
+				const int l = cm.nbDarts();
+				for (int i = 0; i < l; i++) { const int v = cm.vertice(i); if (start[v] < 0) start[v] = i; deg[v]++; }
+				}
+
+			int size() const { return (int)start.size(); }
+
+			int degree(int v) const { return deg[v]; }
+
+			/* call fun(w) for each neighbour w of v until it returns false */
+			template<typename FUN> void forEachNeighbour(int v, FUN & fun) const
+				{
+				const int i = start[v];
+				if (i < 0) return;
+				int j = i;
+				do { if (!fun(cm.vertice(cm.alpha(j)))) return; j = cm.sigma(j); } while (j != i);
+				}
+
+			const CombinatorialMap & cm;
+			std::vector<int> start;		// a dart around each vertex
+			std::vector<int> deg;		// degree of each vertex
+			};
+
+
+		template<typename GRAPH> inline GraphAdjacency<GRAPH> adjacency(const GRAPH & gr) { return GraphAdjacency<GRAPH>(gr); }
+
+		inline MapAdjacency adjacency(const CombinatorialMap & cm) { return MapAdjacency(cm); }
+
+
+		/* bitset whose bits can be set concurrently */
+		class AtomicBitset
+			{
+			public:
+
+			AtomicBitset(size_t n) : _nbw((n + 63) / 64), _w(new std::atomic<uint64>[(n + 63) / 64]) { clear(); }
+
+			void clear() { for (size_t k = 0; k < _nbw; k++) { _w[k].store(0, std::memory_order_relaxed); } }
+
+			bool test(size_t i) const { return ((_w[i >> 6].load(std::memory_order_relaxed) >> (i & 63)) & 1) != 0; }
+
+			/* set bit i, return true if it was not already set */
+			bool testAndSet(size_t i) { const uint64 m = ((uint64)1) << (i & 63); return ((_w[i >> 6].fetch_or(m, std::memory_order_relaxed) & m) == 0); }
+
+			/* same as testAndSet() when no other thread modifies the bitset (no atomic read-modify-write) */
+			bool setUnsync(size_t i) { const uint64 m = ((uint64)1) << (i & 63); _w[i >> 6].store(_w[i >> 6].load(std::memory_order_relaxed) | m, std::memory_order_relaxed); return true; }
+
+			void set(size_t i) { _w[i >> 6].fetch_or(((uint64)1) << (i & 63), std::memory_order_relaxed); }
+
+			uint64 word(size_t k) const { return _w[k].load(std::memory_order_relaxed); }
+
+			size_t nbWords() const { return _nbw; }
+
+			void swap(AtomicBitset & B) { std::swap(_nbw, B._nbw); std::swap(_w, B._w); }
+
+			private:
+
+			size_t _nbw;
+			std::unique_ptr<std::atomic<uint64>[]> _w;
+			};
+
+
+		/* index of the lowest set bit of a non zero word */
+		inline int lowestSetBit(uint64 w)
+			{
+			int b = 0;
+			while ((w & 0xFFFF) == 0) { w >>= 16; b += 16; }
+			while ((w & 1) == 0) { w >>= 1; b++; }
+			return b;
+			}
+
+
+		/* number of threads to use for a given amount of work */
+		inline int nbThreadsFor(int64 work, int nbth)
+			{
+			if (work < PARALLEL_MIN) return 1;
+			return (int)std::min<int64>((int64)nbth, work / (PARALLEL_MIN / 4));
+			}
+
+
+		/* call fun(th, a, b) on nb consecutive ranges [a,b) of [0,n) (with bounds multiple of 64 if aligned is set) */
+		template<typename FUN> void parallelRanges(int64 n, int nb, bool aligned, FUN fun)
+			{
+			auto bound = [&](int th) -> int64 { int64 x = (n*th) / nb; if ((aligned) && (th < nb)) x &= ~((int64)63); return x; };
+			if (nb <= 1) { fun(0, (int64)0, n); return; }
+			std::vector<std::thread> threads;
+			for (int t = 1; t < nb; t++) { threads.push_back(std::thread(fun, t, bound(t), bound(t + 1))); }
+			fun(0, (int64)0, bound(1));
+			for (auto & th : threads) { th.join(); }
+			}
+
+
+		/* direction optimizing BFS from a set of sources. Fills dist (if not null, must have size adj.size())
+		   with the distance to the sources (-1 if not reached) and return the number of vertices at each distance. */
+		template<typename ADJ> std::vector<int64> bfs(const ADJ & adj, const std::vector<int> & sources, int * dist, int nbThreads)
+			{
+			const int n = adj.size();
+			const int nbth = (nbThreads <= 0) ? std::max<int>(1, nbHardwareThreads()) : nbThreads;
+			std::vector<int64> profile;
+			if (dist != nullptr) { parallelRanges(n, nbThreadsFor(n, nbth), false, [&](int th, int64 a, int64 b) { for (int64 v = a; v < b; v++) dist[v] = -1; }); }
+			AtomicBitset visited(n), front(n), next(n);
+			std::vector<int> frontier;
+			for (int s : sources)
+				{
+				MTOOLS_INSURE((s >= 0) && (s < n));
+				if (visited.testAndSet(s)) { frontier.push_back(s); if (dist != nullptr) dist[s] = 0; }
+				}
+			if (frontier.size() == 0) return profile;
+			profile.push_back((int64)frontier.size());
+			std::vector<int64> degsum(nbth, 0);
+			parallelRanges(n, nbThreadsFor(n, nbth), false, [&](int th, int64 a, int64 b) { int64 s = 0; for (int64 v = a; v < b; v++) s += adj.degree((int)v); degsum[th] = s; });
+			int64 mu = 0;
+			for (int th = 0; th < nbth; th++) { mu += degsum[th]; }
+			int64 nf = (int64)frontier.size(), mf = 0;
+			for (int v : frontier) { mf += adj.degree(v); }
+			mu -= mf;
+			std::vector< std::vector<int> > local(nbth);
+			std::vector<int64> cnt(nbth);
+			bool bottomup = false;
+			int d = 0;
+			while (nf > 0)
+				{
+				if ((!bottomup) && (mf > mu / BFS_ALPHA))
+					{ // switch to bottom-up
+					bottomup = true;
+					front.clear();
+					for (int v : frontier) { front.set(v); }
+					}
+				else if ((bottomup) && (nf < n / BFS_BETA))
+					{ // switch back to top-down
+					bottomup = false;
+					frontier.clear();
+					for (size_t k = 0; k < front.nbWords(); k++) { uint64 w = front.word(k); while (w) { const int b = (int)lowestSetBit(w); frontier.push_back((int)(64 * k + b)); w &= (w - 1); } }
+					}
+				d++;
+				std::fill(degsum.begin(), degsum.end(), 0);
+				std::fill(cnt.begin(), cnt.end(), 0);
+				int nb;
+				if (!bottomup)
+					{ // top-down step: the vertices of the frontier claim their unvisited neighbours
+					nb = nbThreadsFor(mf, nbth);
+					const bool single = (nb <= 1);
+					parallelRanges((int64)frontier.size(), nb, false, [&](int th, int64 a, int64 b)
+						{
+						std::vector<int> & out = local[th];
+						out.clear();
+						int64 s = 0;
+						auto claim = [&](int w) -> bool
+							{
+							if ((!visited.test(w)) && ((single) ? visited.setUnsync(w) : visited.testAndSet(w))) { out.push_back(w); if (dist != nullptr) dist[w] = d; s += adj.degree(w); }
+							return true;
+							};
+						for (int64 k = a; k < b; k++) { adj.forEachNeighbour(frontier[k], claim); }
+						degsum[th] = s; cnt[th] = (int64)out.size();
+						});
+					frontier.clear();
+					for (int th = 0; th < nb; th++) { frontier.insert(frontier.end(), local[th].begin(), local[th].end()); }
+					}
+				else
+					{ // bottom-up step: the unvisited vertices look for a neighbour in the frontier
+					next.clear();
+					nb = nbThreadsFor(mu, nbth);
+					parallelRanges(n, nb, true, [&](int th, int64 a, int64 b)
+						{
+						int64 s = 0, c = 0;
+						bool found;
+						auto look = [&](int w) -> bool { if (front.test(w)) { found = true; return false; } return true; };
+						for (int64 v = a; v < b; v++)
+							{
+							if (visited.test(v)) continue;
+							found = false;
+							adj.forEachNeighbour((int)v, look);
+							if (found) { next.set(v); visited.set(v); if (dist != nullptr) dist[v] = d; c++; s += adj.degree((int)v); }
+							}
+						degsum[th] = s; cnt[th] = c;
+						});
+					front.swap(next);
+					}
+				nf = 0; mf = 0;
+				for (int th = 0; th < nb; th++) { nf += cnt[th]; mf += degsum[th]; }
+				mu -= mf;
+				if (nf > 0) profile.push_back(nf);
+				}
+			return profile;
+			}
+
+
+		/* root of x in the union-find forest, with path halving (lock free) */
+		inline int ufFind(std::atomic<int> * parent, int x)
+			{
+			while (true)
+				{
+				int p = parent[x].load(std::memory_order_relaxed);
+				if (p == x) return x;
+				const int gp = parent[p].load(std::memory_order_relaxed);
+				if (gp != p) { parent[x].compare_exchange_weak(p, gp, std::memory_order_relaxed); }
+				x = gp;
+				}
+			}
+
+
+		/* merge the trees of a and b, the root with larger index is linked under the other one (lock free) */
+		inline void ufUnite(std::atomic<int> * parent, int a, int b)
+			{
+			while (true)
+				{
+				a = ufFind(parent, a);
+				b = ufFind(parent, b);
+				if (a == b) return;
+				if (a < b) std::swap(a, b);
+				int expected = a;
+				if (parent[a].compare_exchange_strong(expected, b, std::memory_order_relaxed)) return;
+				}
+			}
+
+
+		/* connected components with a concurrent union-find */
+		template<typename ADJ> int components(const ADJ & adj, std::vector<int> & comp, int nbThreads)
+			{
+			const int n = adj.size();
+			const int nbth = (nbThreads <= 0) ? std::max<int>(1, nbHardwareThreads()) : nbThreads;
+			const int nb = nbThreadsFor(n, nbth);
+			std::unique_ptr<std::atomic<int>[]> parent(new std::atomic<int>[n > 0 ? n : 1]);
+			std::atomic<int> * P = parent.get();
+			parallelRanges(n, nb, false, [&](int th, int64 a, int64 b) { for (int64 v = a; v < b; v++) P[v].store((int)v, std::memory_order_relaxed); });
+			parallelRanges(n, nb, false, [&](int th, int64 a, int64 b)
+				{
+				for (int64 v = a; v < b; v++)
+					{
+					auto link = [&](int w) -> bool { if (w < (int)v) ufUnite(P, (int)v, w); return true; };
+					adj.forEachNeighbour((int)v, link);
+					}
+				});
+			comp.resize(n);
+			parallelRanges(n, nb, false, [&](int th, int64 a, int64 b) { for (int64 v = a; v < b; v++) comp[v] = ufFind(P, (int)v); });
+			// the root of a component is its smallest vertex: number the components in this order
+			int k = 0;
+			for (int v = 0; v < n; v++)
+				{
+				if (comp[v] == v) { P[v].store(k++, std::memory_order_relaxed); }
+				comp[v] = P[comp[v]].load(std::memory_order_relaxed);
+				}
+			return k;
+			}
+
+		}
+
+
+	/**
+	 * Compute the graph distance of every vertex to a given set of sources (multi-source BFS) using
+	 * several threads. The graph must be undirected.
+	 *
+	 * @param	gr		  	The graph (any type of graph.hpp or a CombinatorialMap).
+	 * @param	sources   	The source vertices.
+	 * @param	nbThreads 	Number of threads (0 = number of hardware threads).
+	 *
+	 * @return	The distance of each vertex to the closest source (-1 if it is not connected to any).
+	 **/
+	template<typename GRAPH> std::vector<int> parallelGraphDistances(const GRAPH & gr, const std::vector<int> & sources, int nbThreads = 0)
+		{
+		auto adj = internals_graphalgo::adjacency(gr);
+		std::vector<int> dist(adj.size());
+		internals_graphalgo::bfs(adj, sources, dist.data(), nbThreads);
+		return dist;
+		}
+
+
+	/**
+	 * Compute the graph distance of every vertex to a root vertex using several threads. Same
+	 * result as computeGraphDistances() for an undirected graph.
+	 *
+	 * @param	gr		  	The graph (any type of graph.hpp or a CombinatorialMap).
+	 * @param	rootVertex	The root vertex.
+	 * @param	nbThreads 	Number of threads (0 = number of hardware threads).
+	 *
+	 * @return	The distance of each vertex to the root (-1 if not in the same connected component).
+	 **/
+	template<typename GRAPH> std::vector<int> parallelGraphDistances(const GRAPH & gr, int rootVertex, int nbThreads = 0)
+		{
+		return parallelGraphDistances(gr, std::vector<int>(1, rootVertex), nbThreads);
+		}
+
+
+	/**
+	 * Compute the number of vertices at each distance from a set of sources (sizes of the spheres)
+	 * using several threads. The distances are not stored so the memory used is only a few bits per
+	 * vertex. The graph must be undirected.
+	 *
+	 * @param	gr		  	The graph (any type of graph.hpp or a CombinatorialMap).
+	 * @param	sources   	The source vertices.
+	 * @param	nbThreads 	Number of threads (0 = number of hardware threads).
+	 *
+	 * @return	res[r] = number of vertices at distance r from the sources. The size of the vector is the
+	 * 			eccentricity of the sources plus one.
+	 **/
+	template<typename GRAPH> std::vector<int64> graphSphereSizes(const GRAPH & gr, const std::vector<int> & sources, int nbThreads = 0)
+		{
+		return internals_graphalgo::bfs(internals_graphalgo::adjacency(gr), sources, nullptr, nbThreads);
+		}
+
+
+	/**
+	 * Same as above with a single source.
+	 **/
+	template<typename GRAPH> std::vector<int64> graphSphereSizes(const GRAPH & gr, int rootVertex, int nbThreads = 0)
+		{
+		return graphSphereSizes(gr, std::vector<int>(1, rootVertex), nbThreads);
+		}
+
+
+	/**
+	 * Compute the volume of the balls around a root vertex (ball growth profile) using several
+	 * threads. The graph must be undirected.
+	 *
+	 * @param	gr		  	The graph (any type of graph.hpp or a CombinatorialMap).
+	 * @param	rootVertex	The root vertex.
+	 * @param	nbThreads 	Number of threads (0 = number of hardware threads).
+	 *
+	 * @return	res[r] = number of vertices at distance at most r from the root. The last value is the
+	 * 			size of the connected component of the root.
+	 **/
+	template<typename GRAPH> std::vector<int64> graphBallVolumes(const GRAPH & gr, int rootVertex, int nbThreads = 0)
+		{
+		std::vector<int64> res = graphSphereSizes(gr, rootVertex, nbThreads);
+		for (size_t r = 1; r < res.size(); r++) { res[r] += res[r - 1]; }
+		return res;
+		}
+
+
+	/**
+	 * Compute the connected components of a graph using several threads (concurrent union-find).
+	 * For a directed graph, the edges are considered without their orientation (weakly connected
+	 * components).
+	 *
+	 * @param	gr		  	The graph (any type of graph.hpp or a CombinatorialMap).
+	 * @param [out]	comp	The component of each vertex. The components are numbered 0, 1, 2...
+	 * 						in the order of their smallest vertex.
+	 * @param	nbThreads 	Number of threads (0 = number of hardware threads).
+	 *
+	 * @return	The number of connected components.
+	 **/
+	template<typename GRAPH> int graphConnectedComponents(const GRAPH & gr, std::vector<int> & comp, int nbThreads = 0)
+		{
+		return internals_graphalgo::components(internals_graphalgo::adjacency(gr), comp, nbThreads);
+		}
+
+
+	}
+
+
+/* end of file */
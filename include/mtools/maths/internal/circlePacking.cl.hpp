@@ -31,11 +31,15 @@ namespace mtools
 
 
 		/* The openCL program for circle packing
-		   use by the CirclePackingLAbelGPU class from circlePacking.hpp
+		   used by the CirclePackingLabelGPU and CirclePackingLabelHyperbolicGPU classes from circlePacking.hpp
 		   Algorithm from Stephenson & Collins (2003) */
 		static const char * circlePacking_openCLprogram = R"CLsource(
 
-//#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+#if defined(cl_khr_fp64)
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+#elif defined(cl_amd_fp64)
+#pragma OPENCL EXTENSION cl_amd_fp64 : enable
+#endif
 
 //#define FPTYPE		  		// these defined are passed
 //#define FPTYPE_VEC8 			// via compiler's option
@@ -124,6 +128,72 @@ __kernel void updateRadius(__global FPTYPE g_radiiTab1[NBVERTICES],						// orig
 	g_lambdastar[index] = ((l <= 0.0) ? 1.0e10 : (u/l));	// save lambdastar
 	}
 
+
+/** Compute the angle at the circle of s-radius x between the two circles
+    of s-radii y and z (s = exp(-h), 0 for an horocycle) **/
+inline FPTYPE angleHyperbolic(FPTYPE x, FPTYPE y, FPTYPE z)
+	{
+	const FPTYPE my = (y > 0.0) ? ((1.0 - y)/(1.0 - x*y)) : 1.0;
+	const FPTYPE mz = (z > 0.0) ? ((1.0 - z)/(1.0 - x*z)) : 1.0;
+	const FPTYPE r = 1.0 - 2.0*x*my*mz;
+	return((r >= 1.0) ? 0.0 : ((r <= -1.0) ? (M_1PI) : (acos(r))));
+	}
+
+
+/** Update the s-radii (hyperbolic case), same arguments as updateRadius **/
+__kernel void updateRadiusHyperbolic(__global FPTYPE g_radiiTab1[NBVERTICES],			// original s-radii of each vertex
+									 __global FPTYPE g_radiiTab2[NBVERTICES],			// updated s-radii of each vertex
+									 __global const int g_degreeTab[NBVERTICES],		// degree of each vertex
+									 __global const int g_neighbourOffset[NBVERTICES],	// offset to the list of neighbours of each vertex
+									 __global const int * g_neighbourList,				// the list of neighbours
+									 __global FPTYPE g_error[NBVERTICES],				// error term
+									 __global FPTYPE g_lambdastar[NBVERTICES]			// not used (no acceleration)
+									)
+	{
+	const int index = get_global_id(0);				// global index
+	const int deg = g_degreeTab[index]; 			// degree of the site
+	if (deg == 0) return;							// dummy site, nothing to do
+
+	const FPTYPE v  = g_radiiTab1[index];			// s-radius
+	const int offset = g_neighbourOffset[index];	// offset for the list of neighbours
+
+	// compute the sum angle, use Kahan summation algorithm to reduce roundoff errors
+	FPTYPE theta = 0.0;
+	FPTYPE C = 0.0;
+	const FPTYPE firstR = g_radiiTab1[g_neighbourList[offset]];
+	FPTYPE prevR = firstR;
+	for(int k = 1; k < deg; k++) // add the angles due to the neighbours
+		{
+		FPTYPE nextR = g_radiiTab1[g_neighbourList[offset + k]];
+		FPTYPE Y = angleHyperbolic(v,prevR,nextR) - C;
+		FPTYPE T = theta + Y;
+		C = (T-theta) - Y;
+		theta = T;
+		prevR = nextR;
+		}
+	theta += (angleHyperbolic(v,prevR,firstR) - C); // close the flower
+
+	// compute the new s-radius (Collins and Stephenson 2003)
+	const FPTYPE ik    = 1.0/((FPTYPE)deg);
+	const FPTYPE del   = sinpi(ik);
+	const FPTYPE bet   = sin(theta*ik*0.5);
+	const FPTYPE sv    = sqrt(v);
+	FPTYPE u = (bet - sv)/(bet*v - sv);
+	if (u > 0.0)
+		{
+		const FPTYPE t1 = 1.0 - u;
+		const FPTYPE t2 = 2.0*del;
+		const FPTYPE t3 = t2/(sqrt(t1*t1 + t2*t2*u) + t1);
+		u = t3*t3;
+		}
+	else { u = del*del; }
+	g_radiiTab2[index] 	= u;						// save new s-radius
+
+	const FPTYPE e      = theta - M_2PI;			// error term
+	g_error[index]		= (e*e);					// save error
+	g_lambdastar[index] = 1.0e10;
+	}
+
 	
 	
 /** reduction kernel to sum up the errors and compute lambda star **/		
@@ -0,0 +1,89 @@
+/** @file mobius.cl.hpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+#if (MTOOLS_USE_OPENCL)
+
+
+namespace mtools
+	{
+
+	namespace internals_mobius
+		{
+
+
+		/* The openCL program used by the MobiusGPU class from mobius.hpp.
+		   Same computations as internals_mobius::applyPoints() and applyCircles() */
+		static const char * mobius_openCLprogram = R"CLsource(
+
+#if defined(cl_khr_fp64)
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+#elif defined(cl_amd_fp64)
+#pragma OPENCL EXTENSION cl_amd_fp64 : enable
+#endif
+
+//#define FPTYPE		  		// passed via compiler's option
+
+
+/** images of circles (center.re, center.im, radius) by z -> (az + b)/(cz + d) **/
+__kernel void mobiusCircles(__global const FPTYPE * src, __global FPTYPE * dst, const uint n,
+                            const FPTYPE ar, const FPTYPE ai, const FPTYPE br, const FPTYPE bi,
+                            const FPTYPE cr, const FPTYPE ci, const FPTYPE dr0, const FPTYPE di0,
+                            const FPTYPE accr, const FPTYPE acci, const FPTYPE normc, const FPTYPE det)
+	{
+	const uint i = get_global_id(0);
+	if (i >= n) return;
+	const FPTYPE x = src[3 * i], y = src[3 * i + 1], r = src[3 * i + 2], r2 = r*r;
+	const FPTYPE nr = ar*x - ai*y + br, ni = ar*y + ai*x + bi;
+	const FPTYPE dr = cr*x - ci*y + dr0, di = cr*y + ci*x + di0;
+	const FPTYPE inv = ((FPTYPE)1) / (dr*dr + di*di - r2*normc);
+	dst[3 * i] = (nr*dr + ni*di - r2*accr)*inv;
+	dst[3 * i + 1] = (ni*dr - nr*di - r2*acci)*inv;
+	dst[3 * i + 2] = r*det*fabs(inv);
+	}
+
+
+/** images of points (re, im) by z -> (az + b)/(cz + d) **/
+__kernel void mobiusPoints(__global const FPTYPE * src, __global FPTYPE * dst, const uint n,
+                           const FPTYPE ar, const FPTYPE ai, const FPTYPE br, const FPTYPE bi,
+                           const FPTYPE cr, const FPTYPE ci, const FPTYPE dr0, const FPTYPE di0)
+	{
+	const uint i = get_global_id(0);
+	if (i >= n) return;
+	const FPTYPE x = src[2 * i], y = src[2 * i + 1];
+	const FPTYPE nr = ar*x - ai*y + br, ni = ar*y + ai*x + bi;
+	const FPTYPE dr = cr*x - ci*y + dr0, di = cr*y + ci*x + di0;
+	const FPTYPE inv = ((FPTYPE)1) / (dr*dr + di*di);
+	dst[2 * i] = (nr*dr + ni*di)*inv;
+	dst[2 * i + 1] = (ni*dr - nr*di)*inv;
+	}
+
+)CLsource";
+
+
+		}
+
+	}
+
+
+#endif
+
+
+/* end of file */
@@ -25,12 +25,56 @@
 #include "../misc/stringfct.hpp" 
 #include "../misc/error.hpp"
 #include "circle.hpp"
+#include "../extensions/openCL.hpp" // openCL extension
+#include "internal/mobius.cl.hpp"	  // the openCL program source.
+
+#include <vector>
+#include <memory>
 
 
 namespace mtools
 	{
 
 
+	namespace internals_mobius
+		{
+
+		/* Batch kernels used by Mobius<T>::apply(). coef[] = { a.re, a.im, b.re, b.im, c.re, c.im, d.re, d.im } and, for
+		   circles, coef[8..11] = { (a.conj(c)).re, (a.conj(c)).im, |c|^2, |ad - bc| }. The input and output may overlap. */
+
+		template<typename T> void applyPoints(const T * coef, const std::complex<T> * z, std::complex<T> * out, size_t n)
+			{
+			for (size_t i = 0; i < n; i++)
+				{
+				const T x = z[i].real(), y = z[i].imag();
+				const T nr = coef[0] * x - coef[1] * y + coef[2], ni = coef[0] * y + coef[1] * x + coef[3];
+				const T dr = coef[4] * x - coef[5] * y + coef[6], di = coef[4] * y + coef[5] * x + coef[7];
+				const T inv = ((T)1) / (dr*dr + di*di);
+				out[i] = std::complex<T>((nr*dr + ni*di)*inv, (ni*dr - nr*di)*inv);
+				}
+			}
+
+		template<typename T> void applyCircles(const T * coef, const Circle<T> * C, Circle<T> * out, size_t n)
+			{
+			for (size_t i = 0; i < n; i++)
+				{
+				const T x = C[i].center.real(), y = C[i].center.imag(), r = C[i].radius, r2 = r*r;
+				const T nr = coef[0] * x - coef[1] * y + coef[2], ni = coef[0] * y + coef[1] * x + coef[3];
+				const T dr = coef[4] * x - coef[5] * y + coef[6], di = coef[4] * y + coef[5] * x + coef[7];
+				const T inv = ((T)1) / (dr*dr + di*di - r2*coef[10]);
+				out[i].center = std::complex<T>((nr*dr + ni*di - r2*coef[8])*inv, (ni*dr - nr*di - r2*coef[9])*inv);
+				out[i].radius = r*coef[11] * std::abs(inv);
+				}
+			}
+
+		/* SSE2 versions for double (src/mobius.cpp) */
+		MTOOLS_DLL void applyPoints(const double * coef, const std::complex<double> * z, std::complex<double> * out, size_t n);
+		MTOOLS_DLL void applyCircles(const double * coef, const Circle<double> * C, Circle<double> * out, size_t n);
+
+		}
+
+
+
 	/**
 	 * Class representing a Mobius transformation of the form  z -> (az + b)/(cz+d). 
 	 *
@@ -90,6 +134,47 @@ namespace mtools
 			}
 			
 
+		/**
+		 * Compute the images of the points z[0..n-1] and store them in out[0..n-1] (out may be equal
+		 * to z). Same as operator* but the coefficients are hoisted out of the loop and the complex
+		 * division is done by hand (for double, two points at a time with SSE2). The results may
+		 * differ from operator* in the last bits and the image of the pole is NaN instead of infinity.
+		 **/
+		void apply(const mtools::complex<T> * z, mtools::complex<T> * out, size_t n) const
+			{
+			T coef[8];
+			_coeffs(coef, false);
+			internals_mobius::applyPoints(coef, z, out, n);
+			}
+
+
+		/**
+		 * Compute the images of the circles C[0..n-1] and store them in out[0..n-1] (out may be
+		 * equal to C). Same as operator* on each circle, with the quantities that do not depend on
+		 * the circle computed once (and for double, two circles at a time with SSE2). This is what
+		 * should be used to move a whole (hyperbolic) packing, e.g. Mobius(z).apply(circles) brings
+		 * the point z of the unit disk to the origin.
+		 **/
+		void apply(const mtools::Circle<T> * C, mtools::Circle<T> * out, size_t n) const
+			{
+			T coef[12];
+			_coeffs(coef);
+			internals_mobius::applyCircles(coef, C, out, n);
+			}
+
+
+		/**
+		 * Apply the transformation to all the points of a vector (in place).
+		 **/
+		void apply(std::vector<mtools::complex<T> > & v) const { apply(v.data(), v.data(), v.size()); }
+
+
+		/**
+		 * Apply the transformation to all the circles of a vector (in place).
+		 **/
+		void apply(std::vector<mtools::Circle<T> > & v) const { apply(v.data(), v.data(), v.size()); }
+
+
 		/**
 		 * Return the invert transformation.
 		 */
@@ -138,9 +223,170 @@ namespace mtools
 		mtools::complex<T> c;   //
 		mtools::complex<T> d;   //
 
+
+		/**
+		 * Coefficients used by the batch kernels (see internals_mobius). coef must have size 8
+		 * (points) or 12 (circles).
+		 **/
+		void _coeffs(T * coef, bool circles = true) const
+			{
+			coef[0] = a.real(); coef[1] = a.imag(); coef[2] = b.real(); coef[3] = b.imag();
+			coef[4] = c.real(); coef[5] = c.imag(); coef[6] = d.real(); coef[7] = d.imag();
+			if (!circles) return;
+			const mtools::complex<T> acc = a*std::conj(c);
+			coef[8] = acc.real(); coef[9] = acc.imag(); coef[10] = std::norm(c); coef[11] = std::abs(a*d - b*c);
+			}
+
+		};
+
+
+
+#if (MTOOLS_USE_OPENCL)
+
+
+	/**
+	 * Application of Mobius transformations to a large set of circles (or points) on the GPU.
+	 * This class is defined only if the openCL extension is activated.
+	 *
+	 * The circles are uploaded once with setCircles() and stay on the device: apply() then computes
+	 * the images of the original circles by a transformation and getCircles() reads them back. This
+	 * makes it possible to re-center a hyperbolic packing interactively (apply(Mobius(z)) for each
+	 * new center z) without sending the packing to the device each time. The class is independent
+	 * of CirclePackingLabelGPU and can be used with the layout it produces.
+	 *
+	 * @tparam	FPTYPE	floating type used for calculations. Must be either double or float.
+	 **/
+	template<typename FPTYPE = double> class MobiusGPU
+		{
+
+		static_assert(std::is_same<FPTYPE, double>::value || std::is_same<FPTYPE, float>::value, "mtools::MobiusGPU<FPTYPE> can only be instantiated with FPTYPE= double or float.");
+		static_assert(sizeof(Circle<FPTYPE>) == 3 * sizeof(FPTYPE), "unexpected layout for mtools::Circle<FPTYPE>");
+
+		public:
+
+			/**
+			 * Constructor.
+			 *
+			 * @param	verbose	true print informations to mtools::cout.
+			 **/
+			MobiusGPU(bool verbose = false) : _verbose(verbose), _nb(0), _capacity(0), _clbundle(true, verbose, verbose)
+				{
+				if ((std::is_same<FPTYPE, double>::value) && (!_clbundle.supportsDouble())) { MTOOLS_ERROR("The openCL device does not support double precision. Use MobiusGPU<float>."); }
+				std::string options = std::string(" -DFPTYPE=") + typeid(FPTYPE).name();
+				std::string log;
+				_prog.reset(new cl::Program(_clbundle.createProgramFromString(internals_mobius::mobius_openCLprogram, log, options, _verbose)));
+				_kernel_circles.reset(new cl::Kernel(_clbundle.createKernel(*_prog, "mobiusCircles", _verbose)));
+				_kernel_points.reset(new cl::Kernel(_clbundle.createKernel(*_prog, "mobiusPoints", _verbose)));
+				}
+
+
+			/**
+			 * Upload the circles C[0..n-1] to the device. They are kept there until the next call.
+			 **/
+			void setCircles(const Circle<FPTYPE> * C, size_t n)
+				{
+				_reserve(n);
+				_nb = n;
+				if (n > 0) _clbundle.queue.enqueueWriteBuffer(*_buff_src, CL_TRUE, 0, sizeof(FPTYPE) * 3 * n, C);
+				}
+
+
+			/**
+			 * Upload the circles of a vector to the device.
+			 **/
+			void setCircles(const std::vector<Circle<FPTYPE> > & C) { setCircles(C.data(), C.size()); }
+
+
+			/**
+			 * Number of circles on the device.
+			 **/
+			size_t size() const { return _nb; }
+
+
+			/**
+			 * Compute, on the device, the images by M of the circles given by setCircles(). Returns
+			 * immediately (the computation is queued).
+			 **/
+			void apply(const Mobius<FPTYPE> & M)
+				{
+				if (_nb == 0) return;
+				FPTYPE coef[12];
+				M._coeffs(coef);
+				cl::Kernel & K = *_kernel_circles;
+				K.setArg(0, *_buff_src);
+				K.setArg(1, *_buff_dst);
+				K.setArg(2, (cl_uint)_nb);
+				for (int i = 0; i < 12; i++) K.setArg(3 + i, coef[i]);
+				_clbundle.queue.enqueueNDRangeKernel(K, cl::NullRange, cl::NDRange(_nb), cl::NullRange);
+				}
+
+
+			/**
+			 * Read the result of the last apply() into out[0..size()-1]. Blocks until it is available.
+			 **/
+			void getCircles(Circle<FPTYPE> * out)
+				{
+				if (_nb > 0) _clbundle.queue.enqueueReadBuffer(*_buff_dst, CL_TRUE, 0, sizeof(FPTYPE) * 3 * _nb, out);
+				}
+
+
+			/**
+			 * Read the result of the last apply() into a vector (resized to size()).
+			 **/
+			void getCircles(std::vector<Circle<FPTYPE> > & out) { out.resize(_nb); getCircles(out.data()); }
+
+
+			/**
+			 * Compute the images of the points z[0..n-1] on the device and store them in out[0..n-1].
+			 * Uses the device buffers, hence the circles previously given by setCircles() are lost.
+			 **/
+			void apply(const Mobius<FPTYPE> & M, const mtools::complex<FPTYPE> * z, mtools::complex<FPTYPE> * out, size_t n)
+				{
+				_nb = 0;
+				if (n == 0) return;
+				_reserve((2 * n + 2) / 3);
+				_clbundle.queue.enqueueWriteBuffer(*_buff_src, CL_FALSE, 0, sizeof(FPTYPE) * 2 * n, z);
+				FPTYPE coef[8];
+				M._coeffs(coef, false);
+				cl::Kernel & K = *_kernel_points;
+				K.setArg(0, *_buff_src);
+				K.setArg(1, *_buff_dst);
+				K.setArg(2, (cl_uint)n);
+				for (int i = 0; i < 8; i++) K.setArg(3 + i, coef[i]);
+				_clbundle.queue.enqueueNDRangeKernel(K, cl::NullRange, cl::NDRange(n), cl::NullRange);
+				_clbundle.queue.enqueueReadBuffer(*_buff_dst, CL_TRUE, 0, sizeof(FPTYPE) * 2 * n, out);
+				}
+
+
+		private:
+
+			MobiusGPU(const MobiusGPU &) = delete;
+			MobiusGPU & operator=(const MobiusGPU &) = delete;
+
+			/* make sure the device buffers can hold n circles */
+			void _reserve(size_t n)
+				{
+				if ((n <= _capacity) && (_buff_src)) return;
+				_capacity = std::max<size_t>(n, 1);
+				_buff_src.reset(new cl::Buffer(_clbundle.context, CL_MEM_READ_ONLY, sizeof(FPTYPE) * 3 * _capacity));
+				_buff_dst.reset(new cl::Buffer(_clbundle.context, CL_MEM_WRITE_ONLY, sizeof(FPTYPE) * 3 * _capacity));
+				}
+
+			bool						_verbose;		// print info on mtools::cout ?
+			size_t						_nb;			// number of circles on the device
+			size_t						_capacity;		// size of the device buffers (in circles)
+			mtools::OpenCLBundle		_clbundle;		// openCL bundle
+			std::unique_ptr<cl::Program> _prog;
+			std::unique_ptr<cl::Kernel>	_kernel_circles;
+			std::unique_ptr<cl::Kernel>	_kernel_points;
+			std::unique_ptr<cl::Buffer>	_buff_src;		// original circles / points
+			std::unique_ptr<cl::Buffer>	_buff_dst;		// images
 		};
 
 
+#endif
+
+
 
 	}
 
@@ -26,11 +26,80 @@
 #include "../misc/error.hpp"
 #include "vec.hpp"
 #include "box.hpp"
+#include "../random/classiclaws.hpp"
+#include "../random/gen_philox4x32.hpp"
+#include "../misc/internal/threadworker.hpp"
+
+#include <vector>
+#include <thread>
+#include <functional>
 
 namespace mtools
 	{
 
 
+	namespace internals_permutation
+		{
+
+		static const size_t PARALLEL_MIN = 1048576;		// minimum size for using several threads
+		static const size_t MERGESHUFFLE_BLOCK = 65536;	// size of the blocks shuffled independently by mergeShuffle()
+
+
+		/* run fun(a,b) on nb consecutive ranges covering [0,n) in parallel */
+		inline void parallelRanges(size_t n, int nb, std::function<void(size_t, size_t)> fun)
+			{
+			if (nb <= 1) { fun(0, n); return; }
+			std::vector<std::thread> threads;
+			for (int t = 1; t < nb; t++) { threads.push_back(std::thread(fun, (n*t) / nb, (n*(t + 1)) / nb)); }
+			fun(0, n / nb);
+			for (auto & th : threads) { th.join(); }
+			}
+
+
+		/* number of threads to use for n elements */
+		inline int nbThreadsFor(size_t n, int nbThreads)
+			{
+			if (nbThreads <= 0) nbThreads = nbHardwareThreads();
+			if (n < PARALLEL_MIN) return 1;
+			return (int)std::min<size_t>((size_t)nbThreads, n / (PARALLEL_MIN / 4));
+			}
+
+
+		/* view of the range [a, a+n) of a vector */
+		template<class Vector> struct SubVector
+			{
+			Vector & vec;
+			size_t a, n;
+			size_t size() const { return n; }
+			auto operator[](size_t i) -> decltype(vec[0]) { return vec[a + i]; }
+			};
+
+
+		/* merge the two uniformly shuffled ranges [a,m) and [m,e) into a uniformly shuffled range [a,e) */
+		template<class Vector> void mergeShuffled(Vector & vec, size_t a, size_t m, size_t e, Philox4x32 & gen)
+			{
+			size_t i = a, j = m;
+			uint64 bits = 0;
+			int nbits = 0;
+			while (true)
+				{
+				if (nbits == 0) { bits = gen(); nbits = 64; }
+				const bool c = ((bits & 1) != 0); bits >>= 1; nbits--;
+				if (c)
+					{
+					if (j == e) break;
+					std::swap(vec[i], vec[j]); j++;
+					}
+				else if (i == j) break;
+				i++;
+				}
+			for (; i < e; i++) { const size_t k = a + (size_t)Unif_bounded((uint64)(i - a + 1), gen); std::swap(vec[i], vec[k]); }
+			}
+
+		}
+
+
+
 
 	/**
 	* Query if a given vector encode a proper permutation of {0,...,vec.size()-1}.
@@ -49,34 +118,114 @@ namespace mtools
 
 
 	/**
-	* Perform a uniform shuffle of a vector.
+	* Perform a uniform shuffle of a vector (Fisher-Yates).
+	* 
+	* The indices are drawn by batches: as long as the product of the sizes of the ranges fits in 64
+	* bits, several indices are extracted from a single 64 bits random number with Lemire's
+	* multiply-shift method (up to 4 indices per number for vectors with less than 65536 elements).
+	* The shuffle remains exactly uniform.
 	*
 	* @tparam	random_t	Type of the random number generator
 	* @tparam	Vector  	Type of the vector. Must implement size() and operator[].
 	* 						For example: std::vector of std::deque
 	* @param [in,out]	gen	the rng
 	* @param [in,out]	vec	the vector
-	*
-	* @return	An uint32.
 	**/
 	template<class Vector, class random_t> inline void randomShuffle(Vector & vec, random_t & gen)
 		{
-		const size_t l = vec.size();
-		if (l < 2) return;
-		for (size_t i = l - 1; i > 0; --i)
+		size_t i = vec.size(); // the next index is drawn in [0,i-1]
+		while (i > 1)
 			{
-			size_t j = (size_t)(Unif(gen)*(i + 1));
-			typename std::remove_reference<decltype(vec[0])>::type temp(vec[i]);
-			vec[i] = vec[j];
-			vec[j] = temp;
+			// number of indices drawn with the next random number
+			uint64 prod = 1;
+			size_t k = 0;
+			while ((k < 4) && (i - k > 1) && (prod <= 18446744073709551615ULL / (i - k))) { prod *= (uint64)(i - k); k++; }
+			uint64 idx[4];
+			uint64 r = Unif_64(gen);
+			for (size_t j = 0; j < k; j++) { idx[j] = internals_random::_mul128(r, (uint64)(i - j), r); }
+			if (r < prod)
+				{ // reject the (rare) biased numbers
+				const uint64 t = (0 - prod) % prod;
+				while (r < t)
+					{
+					r = Unif_64(gen);
+					for (size_t j = 0; j < k; j++) { idx[j] = internals_random::_mul128(r, (uint64)(i - j), r); }
+					}
+				}
+			for (size_t j = 0; j < k; j++)
+				{
+				const size_t a = i - 1 - j, b = (size_t)idx[j];
+				typename std::remove_reference<decltype(vec[0])>::type temp(vec[a]);
+				vec[a] = vec[b];
+				vec[b] = temp;
+				}
+			i -= k;
 			}
 		}
 
 
 
 
+	/**
+	* Perform a uniform shuffle of a vector in parallel (MergeShuffle of Bacher, Bodini, Hollender
+	* and Lumbroso).
+	*
+	* The vector is cut into blocks of MERGESHUFFLE_BLOCK elements which are shuffled independently
+	* with randomShuffle() and the blocks are then merged two by two: a merge flips a coin for each
+	* element to decide from which half it comes and inserts the remaining elements of the longest
+	* half at uniform positions. The shuffle is exactly uniform. Each block and each merge uses its
+	* own stream of the counter-based generator Philox4x32 (with a key drawn from gen) so that the
+	* result does not depend on the number of threads.
+	*
+	* Vectors with less than 2*MERGESHUFFLE_BLOCK elements are simply shuffled with randomShuffle().
+	*
+	* @tparam	random_t	Type of the random number generator
+	* @tparam	Vector  	Type of the vector. Must implement size() and operator[].
+	* @param [in,out]	vec	the vector
+	* @param [in,out]	gen	the rng
+	* @param	nbThreads	number of threads (0 = number of hardware threads).
+	**/
+	template<class Vector, class random_t> inline void mergeShuffle(Vector & vec, random_t & gen, int nbThreads = 0)
+		{
+		const size_t B = internals_permutation::MERGESHUFFLE_BLOCK;
+		const size_t n = vec.size();
+		if (n < 2 * B) { randomShuffle(vec, gen); return; }
+		const uint64 key = Unif_64(gen);
+		const size_t nbb = (n + B - 1) / B; // number of blocks
+		const int nb = internals_permutation::nbThreadsFor(n, nbThreads);
+		internals_permutation::parallelRanges(nbb, nb, [&](size_t b0, size_t b1)
+			{
+			for (size_t b = b0; b < b1; b++)
+				{
+				Philox4x32 g(key, (uint64)b);
+				internals_permutation::SubVector<Vector> sub{ vec, b*B, std::min<size_t>(B, n - b*B) };
+				randomShuffle(sub, g);
+				}
+			});
+		uint64 level = 1;
+		for (size_t w = B; w < n; w *= 2, level++)
+			{
+			const size_t nbp = (n + 2 * w - 1) / (2 * w); // number of pairs
+			internals_permutation::parallelRanges(nbp, std::min<int>(nb, (int)nbp), [&](size_t p0, size_t p1)
+				{
+				for (size_t p = p0; p < p1; p++)
+					{
+					const size_t a = 2 * w*p, m = a + w, e = std::min<size_t>(a + 2 * w, n);
+					if (m >= e) continue;
+					Philox4x32 g(key, (level << 40) + (uint64)p);
+					internals_permutation::mergeShuffled(vec, a, m, e, g);
+					}
+				});
+			}
+		}
+
+
 	/**  
 	*  Class representing a permutation of {0,...,N-1} 
+	*  
+	*  The inverse permutation is computed lazily, on the first call to inv(), invert() or
+	*  getInverse(), and is dropped by any modification. Since inv() may then modify the object,
+	*  call computeInverse() first when a permutation is shared between threads.
 	**/
 	class Permutation
 		{
@@ -86,13 +235,13 @@ namespace mtools
 		/**
 		* Constructor. empty permutation. 
 		**/
-		Permutation() : _perm(), _invperm() {}
+		Permutation() : _perm(), _invperm(), _invok(true) {}
 
 
 		/**
 		 * Constructor. Identity permutation of a given size.
 		 **/
-		Permutation(size_t size) : _perm(), _invperm()	{ setIdentity(size); }
+		Permutation(size_t size) : _perm(), _invperm(), _invok(false)	{ setIdentity(size); }
 
 
 		/**
@@ -100,7 +249,7 @@ namespace mtools
 		 * (perm[i] = k means that the label initially at position i is now at position k
 		 *  after they are sorted increasingly).
 		 **/
-		template<typename T> Permutation(const std::vector<T> & labels) : _perm(), _invperm() { setSortPermutation(labels); }
+		template<typename T> Permutation(const std::vector<T> & labels) : _perm(), _invperm(), _invok(false) { setSortPermutation(labels); }
 
 
 		/**
@@ -108,8 +257,9 @@ namespace mtools
 		 **/
 		void setIdentity(size_t size)
 			{
-			_perm.resize(size); _invperm.resize(size);
-			for (int i = 0; i < (int)size; i++) { _perm[i] = i; _invperm[i] = i; }
+			_dropInverse();
+			_perm.resize(size);
+			for (int i = 0; i < (int)size; i++) { _perm[i] = i; }
 			}
 
 
@@ -121,7 +271,6 @@ namespace mtools
 			MTOOLS_INSURE((i < size) && (j < size));
 			setIdentity(size);
 			_perm[i] = (int)j; _perm[j] = (int)i;
-			_invperm[i] = (int)j; _invperm[j] = (int)i;
 			}
 
 
@@ -130,23 +279,21 @@ namespace mtools
 		**/
 		void setCycle(int k, size_t size)
 			{
-			_perm.resize(size); _invperm.resize(size);
+			_dropInverse();
+			_perm.resize(size);
 			int l = (int)size;
 			if (l == 0) return;
 			const int k1 = (((k % l) + l) % l); // makes sure k \in {0,size-1}
-			const int k2 = l - k1; 
-			for (size_t i = 0; i < size; i++)
-				{
-				_perm[i] = (i + k1) % l; _invperm[i] = (i + k2) % l;
-				}
+			for (size_t i = 0; i < size; i++) { _perm[i] = (i + k1) % l; }
 			}
 
 
 		/* Set the permutation as the involution perm[i] = size-1 - i */
 		void setMirror(size_t size)
 			{
-			_perm.resize(size); _invperm.resize(size);
-			for (int i = 0; i < (int)size; i++) { _perm[i] = (int)size - 1 - i; _invperm[i] = (int)size - 1 - i; }
+			_dropInverse();
+			_perm.resize(size);
+			for (int i = 0; i < (int)size; i++) { _perm[i] = (int)size - 1 - i; }
 			}
 
 
@@ -161,27 +308,35 @@ namespace mtools
 			setIdentity(l);
 			if (l == 0) return;
 			sort(_perm.begin(), _perm.end(), [&](const int & x, const int & y) { return labels[x] < labels[y]; });
-			_recomputeInvert();
 			}
 
 
 
 		/**
 		* Create a random permutation, uniform among all permutations of a given size.
+		* Large permutations are shuffled in parallel (see mergeShuffle()).
+		*
+		* @param	size	   	size of the permutation.
+		* @param [in,out]	gen	the rng
+		* @param	nbThreads  	number of threads (0 = number of hardware threads).
 		**/
-		template<class random_t> inline void setRandomPermutation(size_t size, random_t & gen)
+		template<class random_t> inline void setRandomPermutation(size_t size, random_t & gen, int nbThreads = 0)
 			{
-			setIdentity(size); shuffle(gen);
+			_dropInverse();
+			_perm.resize(size);
+			internals_permutation::parallelRanges(size, internals_permutation::nbThreadsFor(size, nbThreads), [&](size_t a, size_t b) { for (size_t i = a; i < b; i++) { _perm[i] = (int)i; } });
+			shuffle(gen, nbThreads);
 			}
 
 
 		/**
 		 * Shuffles the permutation, making it uniform among all permutation of this size. 
 		 * Same as setRandomPermutation() but without changing the current size. 
+		 * Large permutations are shuffled in parallel (see mergeShuffle()).
 		 **/
-		template<class random_t> inline void shuffle(random_t & gen)
+		template<class random_t> inline void shuffle(random_t & gen, int nbThreads = 0)
 			{
-			if (_perm.size() != 0) { mtools::randomShuffle(_perm,gen); _recomputeInvert(); }
+			if (_perm.size() != 0) { _dropInverse(); mtools::mergeShuffle(_perm, gen, nbThreads); }
 			}
 
 
@@ -190,7 +345,7 @@ namespace mtools
 		* Re-order a vector of labels according to the permutation.
 		* perm[i] = k means that label L(k) initially at position k must be put at pos i.
 		* 
-		* see getAntiPermute() for the opposite transformation.
+		* see getAntiPermute() for the opposite transformation and permute() for the in-place version.
 		**/
 		template<typename VECTOR> VECTOR getPermute(const VECTOR & labels) const
 			{
@@ -206,7 +361,7 @@ namespace mtools
 		* Re-order a vector of labels according to the permutation.
 		* perm[i] = k means that label L(i) initially at position i must be put at pos k.
 		*
-		* see getPermute() for the opposite transformation.
+		* see getPermute() for the opposite transformation and antiPermute() for the in-place version.
 		**/
 		template<typename VECTOR> VECTOR getAntiPermute(const VECTOR & labels) const
 			{
@@ -219,9 +374,65 @@ namespace mtools
 
 
 		/**
-		* Invert the permutation (very fast, just a swap). 
+		* Re-order a vector in place: same result as labels = getPermute(labels).
+		* 
+		* The elements are moved along the cycles of the permutation so the only additional memory is
+		* one bit per element (and one element). Works with any container with size() and operator[]
+		* (the elements must be movable).
 		**/
-		void invert() { _perm.swap(_invperm); }
+		template<typename VECTOR> void permute(VECTOR & labels) const
+			{
+			const size_t l = labels.size();
+			MTOOLS_INSURE(_perm.size() == l);
+			std::vector<bool> done(l, false);
+			for (size_t s = 0; s < l; s++)
+				{
+				if (done[s]) continue;
+				typename std::remove_reference<decltype(labels[0])>::type temp(std::move(labels[s]));
+				size_t j = s;
+				while (true)
+					{
+					done[j] = true;
+					const size_t k = (size_t)_perm[j];
+					if (k == s) { labels[j] = std::move(temp); break; }
+					labels[j] = std::move(labels[k]);
+					j = k;
+					}
+				}
+			}
+
+
+		/**
+		* Re-order a vector in place: same result as labels = getAntiPermute(labels).
+		* Uses one bit per element of additional memory (see permute()).
+		**/
+		template<typename VECTOR> void antiPermute(VECTOR & labels) const
+			{
+			const size_t l = labels.size();
+			MTOOLS_INSURE(_perm.size() == l);
+			std::vector<bool> done(l, false);
+			for (size_t s = 0; s < l; s++)
+				{
+				if (done[s]) continue;
+				done[s] = true;
+				size_t j = (size_t)_perm[s];
+				if (j == s) continue;
+				typename std::remove_reference<decltype(labels[0])>::type temp(std::move(labels[s]));
+				while (j != s)
+					{
+					std::swap(temp, labels[j]);
+					done[j] = true;
+					j = (size_t)_perm[j];
+					}
+				labels[s] = std::move(temp);
+				}
+			}
+
+
+		/**
+		* Invert the permutation (very fast once the inverse is computed, just a swap). 
+		**/
+		void invert() { computeInverse(); _perm.swap(_invperm); }
 
 
 		/**
@@ -230,6 +441,20 @@ namespace mtools
 		Permutation getInverse() const { Permutation P(*this); P.invert(); return P; }
 
 
+		/**
+		 * Compute the inverse permutation now (otherwise, it is computed on the first call to inv()).
+		 * Large permutations are inverted in parallel.
+		 **/
+		void computeInverse(int nbThreads = 0) const
+			{
+			if (_invok) return;
+			const size_t l = _perm.size();
+			_invperm.resize(l);
+			internals_permutation::parallelRanges(l, internals_permutation::nbThreadsFor(l, nbThreads), [&](size_t a, size_t b) { for (size_t i = a; i < b; i++) { _invperm[_perm[i]] = (int)i; } });
+			_invok = true;
+			}
+
+
 		/**
 		 * Convert the permutation to a vector
 		 **/
@@ -252,8 +477,9 @@ namespace mtools
 			const size_t l = _perm.size();
 			if (newsize >= (int)l) // increase size
 				{ 
-				_perm.resize(newsize); _invperm.resize(newsize);
-				for (size_t i = l; i < (size_t)newsize; i++) { _perm[i] = (int)i; _invperm[i] = (int)i; }
+				_perm.resize(newsize);
+				if (_invok) _invperm.resize(newsize);
+				for (size_t i = l; i < (size_t)newsize; i++) { _perm[i] = (int)i; if (_invok) _invperm[i] = (int)i; }
 				return;
 				}
 
@@ -261,14 +487,15 @@ namespace mtools
 				{
 				if (_perm[i] < newsize) { MTOOLS_ERROR(std::string("Subset is not stable: perm[") + mtools::toString(i) + "]=" + mtools::toString(_perm[i]) + " < newsize = " + mtools::toString(newsize)); }
 				}
-			_perm.resize(newsize); _invperm.resize(newsize);
+			_perm.resize(newsize);
+			if (_invok) _invperm.resize(newsize);
 			}
 
 
 		/**
 		* Clear the object, making it a empty permutation.
 		**/
-		void clear() { _perm.clear(); _invperm.clear(); }
+		void clear() { _perm.clear(); _invperm.clear(); _invok = true; }
 
 
 		/**
@@ -287,24 +514,40 @@ namespace mtools
 		int inv(size_t index) const 
 			{ 
 			MTOOLS_ASSERT((index >= 0) && (index < _perm.size())); 
+			if (!_invok) computeInverse();
 			return _invperm[index]; 
 			}
 
 
 		/**
 		 * Composition operator ie (P1*P2)[k] = P1[P2[k]]
+		 * Large permutations are composed in parallel. 
 		 **/
 		Permutation operator*(const Permutation & P2) const
 			{
 			MTOOLS_INSURE(_perm.size() == P2.size());
-			const int l = (int)_perm.size();
+			const size_t l = _perm.size();
 			Permutation R;
-			R._perm.resize(l); R._invperm.resize(l);
-			for (int i = 0;i < l;i++) { R._perm[i] = _perm[P2._perm[i]]; R._invperm[i] = P2._invperm[_invperm[i]]; }
+			R._invok = false;
+			R._perm.resize(l);
+			internals_permutation::parallelRanges(l, internals_permutation::nbThreadsFor(l, 0), [&](size_t a, size_t b) { for (size_t i = a; i < b; i++) { R._perm[i] = _perm[P2._perm[i]]; } });
 			return R;
 			}
 
 
+		/**
+		 * In-place composition: set this permutation to (*this)*P2 without allocating another
+		 * permutation (see permute()).
+		 **/
+		Permutation & operator*=(const Permutation & P2)
+			{
+			MTOOLS_INSURE(_perm.size() == P2.size());
+			_dropInverse();
+			P2.permute(_perm);
+			return *this;
+			}
+
+
 		/**
 		* serialise the permutation
 		**/
@@ -320,7 +563,7 @@ namespace mtools
 		template<typename U> void deserialize(U & Archive, const int version = 0)
 			{
 			Archive & _perm;
-			_recomputeInvert();
+			_dropInverse();
 			}
 
 
@@ -344,16 +587,16 @@ namespace mtools
 		private:
 
 
-		/* re-compute the inverse permutation */
-		void _recomputeInvert()
+		/* drop the inverse permutation (and release its memory) */
+		void _dropInverse()
 			{
-			const size_t l = _perm.size();
-			_invperm.resize(l);	
-			for (size_t i = 0; i < l; i++) { _invperm[_perm[i]] = (int)i; } 
+			_invok = false;
+			std::vector<int>().swap(_invperm);
 			}
-		
+
 		std::vector<int> _perm;
-		std::vector<int> _invperm;
+		mutable std::vector<int> _invperm;	// inverse permutation (valid if _invok is set)
+		mutable bool _invok;				// true if _invperm is up to date
 		};
 
 
@@ -361,4 +604,3 @@ namespace mtools
 	}
 
 /* end of file */
-
@@ -20,6 +20,8 @@
 
 #pragma once
 
+#include <cstddef>
+
 
 namespace mtools
 {
@@ -66,6 +68,45 @@ namespace mtools
 	int gsl_poly_solve_cubic(double k, double a, double b, double c, double *x0, double *x1, double *x2);
 
 
+	/**
+	 * Batch version of gsl_poly_solve_quadratic(): finds the real roots of the n polynomials
+	 * a[i].x^2 + b[i].x + c[i] = 0. The arrays are in SoA layout (one array per coefficient and
+	 * one per root). The results are exactly those of the scalar function (in particular x0[i],
+	 * x1[i] are untouched when the roots do not exist) but the polynomials are solved two at a
+	 * time with SSE2 when available.
+	 *
+	 * @param	a		  	coeffs. of x^2.
+	 * @param	b		  	coeffs. of x.
+	 * @param	c		  	coeffs. of 1.
+	 * @param	n		  	number of polynomials.
+	 * @param [in,out]	nb	number of real roots of each polynomial (may be nullptr).
+	 * @param [in,out]	x0	smallest real roots.
+	 * @param [in,out]	x1	largest real roots.
+	 **/
+	void gsl_poly_solve_quadratic(const double * a, const double * b, const double * c, size_t n, int * nb, double * x0, double * x1);
+
+
+	/**
+	 * Batch version of gsl_poly_solve_cubic(): finds the real roots of the n polynomials
+	 * k[i].x^3 + a[i].x^2 + b[i].x + c[i] = 0 (SoA layout). The results are exactly those of the
+	 * scalar function. The normalization and the discriminants are computed for blocks of
+	 * polynomials at once and the degenerate polynomials (k[i] = 0) are sent together to the batch
+	 * quadratic solver, only the final trigonometric / cube root step is done one polynomial at a
+	 * time.
+	 *
+	 * @param	k		  	coeffs. of x^3.
+	 * @param	a		  	coeffs. of x^2.
+	 * @param	b		  	coeffs. of x.
+	 * @param	c		  	coeffs. of 1.
+	 * @param	n		  	number of polynomials.
+	 * @param [in,out]	nb	number of real roots of each polynomial (may be nullptr).
+	 * @param [in,out]	x0	smallest real roots.
+	 * @param [in,out]	x1	second smallest real roots.
+	 * @param [in,out]	x2	largest real roots.
+	 **/
+	void gsl_poly_solve_cubic(const double * k, const double * a, const double * b, const double * c, size_t n, int * nb, double * x0, double * x1, double * x2);
+
+
 }
 
 
@@ -24,6 +24,8 @@
 #include "../misc/misc.hpp"
 #include "../misc/error.hpp"
 
+#include <cmath>
+
 namespace mtools
     {
 
@@ -52,52 +54,159 @@ namespace mtools
 		}
 
 
+    namespace internals_specialfunctions
+        {
+
+        /* arguments below this bound use the tables in factln() / gammln() */
+        static const int64 FACTLN_TABLE_SIZE = 16384;
+
+        /* above this bound, gammln() uses the Stirling series (exact to double precision there) */
+        static const double STIRLING_BOUND = 1024.0;
+
+
+        /* Lanczos approximation of log(gamma(x)) for x > 0 (numerical recipes) */
+        inline double _gammlnLanczos(const double xx)
+            {
+            static const double cof[14] = { 57.1562356658629235,-59.5979603554754912,14.1360979747417471,-0.491913816097620199,.339946499848118887e-4,.465236289270485756e-4,-.983744753048795646e-4,.158088703224912494e-3,-.210264441724104883e-3,.217439618115212643e-3,-.164318106536763890e-3,.844182239838527433e-4,-.261908384015814087e-4,.368991826595316234e-5 };
+            double x, tmp, y, ser;
+            y = x = xx;
+            tmp = x + 5.24218750000000000;
+            tmp = (x + 0.5)*log(tmp) - tmp;
+            ser = 0.999999999999997092;
+            for (int j = 0; j < 14; j++) ser += cof[j] / ++y;
+            return tmp + log(2.5066282746310005*ser / x);
+            }
+
+
+        /* Stirling series for log(gamma(x)), x >= STIRLING_BOUND */
+        inline double _gammlnStirling(const double x)
+            {
+            const double ix = 1.0 / x, ix2 = ix*ix;
+            return (x - 0.5)*log(x) - x + 0.91893853320467274178 + ix*(1.0 / 12.0 - ix2*(1.0 / 360.0 - ix2*(1.0 / 1260.0)));
+            }
+
+
+        /* table of n! for n in [0,170], computed at compile time */
+        struct FactrlTable
+            {
+            double a[171];
+            constexpr FactrlTable() : a()
+                {
+                a[0] = 1.0;
+                for (int i = 1; i < 171; i++) a[i] = i*a[i - 1];
+                }
+            };
+
+
+        /* table of log(n!) for n in [0, FACTLN_TABLE_SIZE[ (computed on first use, thread safe) */
+        struct FactlnTable
+            {
+            double a[FACTLN_TABLE_SIZE];
+            FactlnTable() { for (int64 i = 0; i < FACTLN_TABLE_SIZE; i++) a[i] = _gammlnLanczos(i + 1.0); }
+            };
+
+        inline const double * _factlnTable()
+            {
+            static const FactlnTable tab;
+            return tab.a;
+            }
+
+        }
+
+
     /**
      * Compute the logarithm of the gamma function.
-     * Taken from numerical recipes.
+     * Lanczos approximation taken from numerical recipes. Integer arguments are read from the
+     * table of factln() and large arguments use the Stirling series.
      **/
     inline double gammln(const double xx)
         {
-        int j;
-        double x, tmp, y, ser;
-        static const double cof[14] = { 57.1562356658629235,-59.5979603554754912,14.1360979747417471,-0.491913816097620199,.339946499848118887e-4,.465236289270485756e-4,-.983744753048795646e-4,.158088703224912494e-3,-.210264441724104883e-3,.217439618115212643e-3,-.164318106536763890e-3,.844182239838527433e-4,-.261908384015814087e-4,.368991826595316234e-5 };
+        using namespace internals_specialfunctions;
         MTOOLS_ASSERT(xx > 0);
-        y = x = xx;
-        tmp = x + 5.24218750000000000;
-        tmp = (x + 0.5)*log(tmp) - tmp;
-        ser = 0.999999999999997092;
-        for (j = 0;j < 14;j++) ser += cof[j] / ++y;
-        return tmp + log(2.5066282746310005*ser / x);
+        if (xx < (double)FACTLN_TABLE_SIZE)
+            {
+            const int64 n = (int64)xx;
+            if ((double)n == xx) return _factlnTable()[n - 1];
+            }
+        if (xx >= STIRLING_BOUND) return _gammlnStirling(xx);
+        return _gammlnLanczos(xx);
+        }
+
+
+    /**
+     * Compute log(gamma(x[i])) for i in [0,n[ (x[i] > 0). Same values as gammln() but the Lanczos
+     * series of several arguments are computed together (the loop is vectorized by the compiler).
+     **/
+    inline void gammln(const double * x, double * res, size_t n)
+        {
+        using namespace internals_specialfunctions;
+        static const double cof[14] = { 57.1562356658629235,-59.5979603554754912,14.1360979747417471,-0.491913816097620199,.339946499848118887e-4,.465236289270485756e-4,-.983744753048795646e-4,.158088703224912494e-3,-.210264441724104883e-3,.217439618115212643e-3,-.164318106536763890e-3,.844182239838527433e-4,-.261908384015814087e-4,.368991826595316234e-5 };
+        const size_t B = 8;
+        for (size_t i0 = 0; i0 < n; i0 += B)
+            {
+            const size_t nb = ((n - i0) < B) ? (n - i0) : B;
+            double ser[B], y[B];
+            for (size_t k = 0; k < B; k++) { ser[k] = 0.999999999999997092; y[k] = (k < nb) ? x[i0 + k] : 1.0; }
+            for (int j = 0; j < 14; j++)
+                {
+                for (size_t k = 0; k < B; k++) { y[k] += 1.0; ser[k] += cof[j] / y[k]; }
+                }
+            for (size_t k = 0; k < nb; k++)
+                {
+                const double xx = x[i0 + k];
+                MTOOLS_ASSERT(xx > 0);
+                if (xx < (double)FACTLN_TABLE_SIZE)
+                    {
+                    const int64 m = (int64)xx;
+                    if ((double)m == xx) { res[i0 + k] = _factlnTable()[m - 1]; continue; }
+                    }
+                if (xx >= STIRLING_BOUND) { res[i0 + k] = _gammlnStirling(xx); continue; }
+                const double tmp = xx + 5.24218750000000000;
+                res[i0 + k] = ((xx + 0.5)*log(tmp) - tmp) + log(2.5066282746310005*ser[k] / xx);
+                }
+            }
         }
 
 
     /**
      * Compute the factorial for n in [0,170]
      * Taken from numerical recipes, (well, this one I could have written myself :-))
+     * The table is computed at compile time.
      **/
     inline double factrl(int64 n)
         {
-        static double a[171];
-        static bool init = true;
-        if (init) { init = false; a[0] = 1.; for (int i = 1;i < 171;i++) a[i] = i*a[i - 1]; }
-        MTOOLS_ASSERT((n >= 0 || n <= 170));
-        return a[n];
+        static constexpr internals_specialfunctions::FactrlTable tab{};
+        MTOOLS_ASSERT((n >= 0) && (n <= 170));
+        return tab.a[n];
         }
 
 
     /**
      * Compute the logarithm of a factorial.
-     * Taken from numerical recipes.
+     * Taken from numerical recipes. Values for n < 16384 are tabulated (the table is built on
+     * the first call).
      **/
     inline double factln(int64 n)
         {
-        static const int64 NTOP = 2000;
-        static double a[NTOP];
-        static bool init = true;
-        if (init) { init = false; for (int64 i = 0;i < NTOP;i++) a[i] = gammln(i + 1.); }
+        using namespace internals_specialfunctions;
         MTOOLS_ASSERT(n >= 0);
-        if (n < NTOP) return a[n];
-        return gammln(n + 1.);
+        if (n < FACTLN_TABLE_SIZE) return _factlnTable()[n];
+        return _gammlnStirling(n + 1.0);
+        }
+
+
+    /**
+     * Compute log(n[i]!) for i in [0,len[.
+     **/
+    inline void factln(const int64 * n, double * res, size_t len)
+        {
+        using namespace internals_specialfunctions;
+        const double * tab = _factlnTable();
+        for (size_t i = 0; i < len; i++)
+            {
+            MTOOLS_ASSERT(n[i] >= 0);
+            res[i] = (n[i] < FACTLN_TABLE_SIZE) ? tab[n[i]] : _gammlnStirling(n[i] + 1.0);
+            }
         }
 
 
@@ -107,7 +216,7 @@ namespace mtools
      **/
     inline double bico(const int64 n, const int64 k)
         {
-        MTOOLS_ASSERT((n >= 0) || (k >= 0) || (k <= n));
+        MTOOLS_ASSERT((n >= 0) && (k >= 0) && (k <= n));
         if (n < 171) return floor(0.5 + factrl(n) / (factrl(k)*factrl(n - k)));
         return floor(0.5 + exp(factln(n) - factln(k) - factln(n - k)));
         }
@@ -24,11 +24,19 @@
 #include "../misc/misc.hpp"
 #include "vec.hpp"
 
+#include <cmath>
+#include <complex>
+#include <vector>
+#include <algorithm>
+
 
 namespace mtools
 {
 
 
+template<class T, size_t N> class LU;
+
+
 /**
  * A simple class representing a NxN matrix
  *
@@ -212,96 +220,31 @@ template<class T, size_t N> class SqrMatrix
 
 
      /**
-      * Compute the determinant of the matrix.
+      * Compute the determinant of the matrix (with an LU factorization, see class LU).
       *
       * @return the determinant.
       **/
      T det() const
 		{
-		T det = 1; // the determinant
-		SqrMatrix<T,N> A((*this)); // auxiliary matrix = this object
-		/* Elementary operations to reduce the matrix to an upper triangular matrix */
-		for(size_t k=0;k<N;k++)
-			{
-			if (A(k,k) == 0) // swap needed if the diagonal coefficient is zero
-				{
-				size_t l = k+1;
-				while(l<N)
-					{
-					if (A(l,k)!=0) 
-						{
-						A.exchangeLine(k,l);		// exchange the lines k and l
-						det = -det;					// invert the sign of the determinant
-						break;
-						} 
-					l++;
-					}
-				if (l==N) {return((T)0);}	// could not find a non-zero coefficient : the matrix is not invertible !
-				}
-			det *= A(k,k); // multiply the determinant by the diagonal coefficient
-			A.multLine(1/A(k,k),k); // the coefficient A(k,k) is now equal to 1. 
-			for(size_t l=k+1;l<N;l++) // set all the coeffcients below the diagonal to 0
-				{
-				A.multSubLine(A(l,k),l,k);  // L_l  <--  L_l - M_{l,k}L_k
-				}
-			}
-		return det;
+		return LU<T, N>(*this).det();
 		}
 
 
      /**
       * Invert the matrix and returns its determinant. 
-      *     - if the determinant is 0, then the object is left in an undetermined state !
+      *     - if the determinant is 0, then the object is left unchanged.
       *     - if the determinant is not zero, then the object now contain the inverse matrix
+      * 
+      * Use class LU instead when the matrix is only needed to solve linear systems.
       *
       * @return the determinant of the matrix.
       **/
 	 T invert()
 		{
-		T det = 1;		  // the determinant
-		SqrMatrix<T,N> M; // auxiliary matrix
-		M.setIdentity();  // starting with the identity matrix
- 		SqrMatrix<T,N> & A = (*this); // commodity reference
-		T v; // auxilary variable
-		/* Elementary operations to reduce the matrix to an upper triangular matrix with coefficients 1 on the diagonal */
-		for(size_t k=0;k<N;k++)
-			{
-			if (A(k,k) == 0) // swap needed if the diagonal coefficient is zero
-				{
-                size_t l = k+1;
-				while(l<N)
-					{
-					if (A(l,k)!=0) 
-						{
-						exchangeLine(k,l); M.exchangeLine(k,l);		// exchange the lines k and l
-						det = -det;									// invert the sign of the determinant
-						break;
-						} 
-					l++;
-					}
-				if (l==N) {return(0);}	// could not find a non-zero coefficient : the matrix is not invertible !
-				}
-			det *= A(k,k); // multiply the determinant by the diagonal coefficient
-			v = 1/A(k,k);
-			multLine(v,k); M.multLine(v,k); // the coefficient A(k,k) is now equal to 1. 
-			for(size_t l=k+1;l<N;l++) // set all the coeffcients below the diagonal to 0
-				{
-				v = A(l,k);
-				multSubLine(v,l,k); M.multSubLine(v,l,k);  // L_l  <--  L_l - M_{l,k}L_k
-				}
-			}
-		/* Elementary operations to reduce the upper diagonal matrix to the identity */
-		for(size_t k=0;k<(N-1);k++)
-			{
-			for(size_t l=0 ; l<(N-1-k); l++)
-				{
-				v = A(l,N-1-k);
-				multSubLine(v,l,N-1-k); M.multSubLine(v,l,N-1-k);  // L_l  <--  L_l - M_{l,N-1-k}L_k
-				}
-			}
-		/* we are done ! */
-		A = M;	// set the matrix to its inverse
-		return det; // and return the determinant
+		LU<T, N> lu(*this);
+		if (lu.isSingular()) return (T)0;
+		(*this) = lu.inverse();
+		return lu.det();
 		}
 
 
@@ -453,11 +396,13 @@ template<class T, size_t N> class SqrMatrix
  template<class T, size_t N> inline Vec<T,N> operator*(const SqrMatrix<T,N> & M, const Vec<T,N> & V)
 	 {
 	 Vec<T,N> W(0);
-	 for(size_t i=0;i<N;i++)
-		{
-        for(size_t j=0;j<N;j++)
+	 for(size_t j=0;j<N;j++)
+		{ // columns are contiguous: the inner loop can be vectorized
+		const T v = V[j];
+        const T * c = &(M(0,j));
+        for(size_t i=0;i<N;i++)
             {
-			W[i] += ((M(i,j))*(V[j]));
+			W[i] += (c[i]*v);
 			}
 		}
 	 return W;
@@ -497,14 +442,41 @@ template<class T, size_t N> class SqrMatrix
  template<class T, size_t N> inline SqrMatrix<T,N> operator*(const SqrMatrix<T,N> & M1, const SqrMatrix<T,N> & M2)
 	{	
 	 SqrMatrix<T,N> R(0);
-	 for(size_t j=0;j<N;j++)
+	 // column j of R is a combination of the (contiguous) columns of M1: the inner loop can be
+	 // vectorized and each column of M1 is loaded once for two columns of R. For large N, the rows
+	 // are processed by blocks so that the accumulators stay in the L1 cache. The terms are summed
+	 // in the same order as the naive triple loop.
+	 const size_t BI = ((N * sizeof(T) <= 2048) ? N : (2048 / sizeof(T)));
+	 T acc[2][BI]; // local accumulators (cannot alias the matrices), two columns of R at once
+	 for(size_t i0=0;i0<N;i0+=BI)
 		{
-		for(size_t i=0;i<N;i++)
+		const size_t m = std::min<size_t>(N - i0, BI);
+		size_t j = 0;
+		for(;j + 1<N;j+=2)
 			{
+			for(size_t i=0;i<m;i++) { acc[0][i] = R(i0+i,j); acc[1][i] = R(i0+i,j+1); }
 			for(size_t k=0;k<N;k++)
 				{
-				R(i,j) += (M1(i,k)*M2(k,j));
+				const T v0 = M2(k,j), v1 = M2(k,j+1);
+				const T * c = &(M1(i0,k));
+				for(size_t i=0;i<m;i++)
+					{
+					acc[0][i] += (c[i]*v0);
+					acc[1][i] += (c[i]*v1);
+					}
 				}
+			for(size_t i=0;i<m;i++) { R(i0+i,j) = acc[0][i]; R(i0+i,j+1) = acc[1][i]; }
+			}
+		for(;j<N;j++)
+			{
+			for(size_t i=0;i<m;i++) { acc[0][i] = R(i0+i,j); }
+			for(size_t k=0;k<N;k++)
+				{
+				const T v = M2(k,j);
+				const T * c = &(M1(i0,k));
+				for(size_t i=0;i<m;i++) { acc[0][i] += (c[i]*v); }
+				}
+			for(size_t i=0;i<m;i++) { R(i0+i,j) = acc[0][i]; }
 			}
 		}
 	return R;
@@ -555,6 +527,222 @@ template<class T, size_t N> inline SqrMatrix<T,N> operator-(const SqrMatrix<T,N>
 	}
 
 
+/**
+ * LU factorization (with partial pivoting) of a NxN matrix: P.A = L.U with P a permutation matrix,
+ * L lower triangular with unit diagonal and U upper triangular.
+ * 
+ * The factorization is computed once by the constructor and can then be reused to solve as many
+ * linear systems A.X = B as needed, which is much cheaper than inverting A or running a new
+ * elimination for each right hand side:
+ * 
+ * @code
+ * LU<double, 10> lu(A);
+ * for (...) { Vec<double, 10> X = lu.solve(B); ... }
+ * lu.solve(tabB, tabX, 1000); // batch version, faster for many right hand sides.
+ * @endcode
+ * 
+ * The pivot is the coefficient with the largest modulus (computed with abs(), found by argument
+ * dependent lookup for user defined types). The factors are stored in column major order, like
+ * SqrMatrix, so that the inner loops run over contiguous memory and can be vectorized.
+ *
+ * @tparam  T   Type of the coeffcient.
+ * @tparam  N   dimension of the matrix.
+ **/
+template<class T, size_t N> class LU
+	{
+
+	public:
+
+		/**
+		 * Constructor. Compute the factorization of A.
+		 **/
+		LU(const SqrMatrix<T, N> & A) : _sign(1), _singular(false)
+			{
+			for (size_t j = 0; j < N; j++) { for (size_t i = 0; i < N; i++) { _a[i + N * j] = A(i, j); } }
+			_factorize();
+			}
+
+
+		/**
+		 * Query if the matrix is singular (in which case the solve methods must not be used).
+		 **/
+		inline bool isSingular() const { return _singular; }
+
+
+		/**
+		 * Determinant of the matrix.
+		 **/
+		T det() const
+			{
+			if (_singular) return (T)0;
+			T d = (T)_sign;
+			for (size_t k = 0; k < N; k++) { d *= _a[k + N * k]; }
+			return d;
+			}
+
+
+		/**
+		 * Solve A.X = B.
+		 *
+		 * @param   B   The right hand side.
+		 *
+		 * @return  The solution X.
+		 **/
+		Vec<T, N> solve(const Vec<T, N> & B) const
+			{
+			MTOOLS_ASSERT(!_singular);
+			Vec<T, N> X;
+			for (size_t i = 0; i < N; i++) { X[i] = B[_perm[i]]; }
+			for (size_t k = 0; k < N; k++)
+				{ // forward substitution (L has unit diagonal)
+				const T x = X[k];
+				const T * c = _a + N * k;
+				for (size_t i = k + 1; i < N; i++) { X[i] -= c[i] * x; }
+				}
+			for (size_t k = N; k-- > 0;)
+				{ // backward substitution
+				const T * c = _a + N * k;
+				X[k] /= c[k];
+				const T x = X[k];
+				for (size_t i = 0; i < k; i++) { X[i] -= c[i] * x; }
+				}
+			return X;
+			}
+
+
+		/**
+		 * Solve A.X[r] = B[r] for r = 0..nb-1. The right hand sides are processed by blocks and the
+		 * inner loops run over the right hand sides of a block, so this is faster than calling
+		 * solve() nb times. X may be equal to B.
+		 *
+		 * @param   B       array of the right hand sides.
+		 * @param [out] X   array of the solutions.
+		 * @param   nb      number of systems.
+		 **/
+		void solve(const Vec<T, N> * B, Vec<T, N> * X, size_t nb) const
+			{
+			MTOOLS_ASSERT(!_singular);
+			const size_t BS = 32; // number of right hand sides per block
+			std::vector<T> buf(N * BS);
+			T * w = buf.data(); // w[i*BS + r] = coordinate i of the r-th rhs of the block
+			for (size_t r0 = 0; r0 < nb; r0 += BS)
+				{
+				const size_t m = std::min<size_t>(BS, nb - r0);
+				for (size_t i = 0; i < N; i++) { const size_t pi = _perm[i]; for (size_t r = 0; r < m; r++) { w[i * BS + r] = B[r0 + r][pi]; } }
+				for (size_t k = 0; k < N; k++)
+					{
+					const T * wk = w + k * BS;
+					for (size_t i = k + 1; i < N; i++)
+						{
+						const T l = _a[i + N * k];
+						T * wi = w + i * BS;
+						for (size_t r = 0; r < m; r++) { wi[r] -= l * wk[r]; }
+						}
+					}
+				for (size_t k = N; k-- > 0;)
+					{
+					T * wk = w + k * BS;
+					const T d = _a[k + N * k];
+					for (size_t r = 0; r < m; r++) { wk[r] /= d; }
+					for (size_t i = 0; i < k; i++)
+						{
+						const T u = _a[i + N * k];
+						T * wi = w + i * BS;
+						for (size_t r = 0; r < m; r++) { wi[r] -= u * wk[r]; }
+						}
+					}
+				for (size_t i = 0; i < N; i++) { for (size_t r = 0; r < m; r++) { X[r0 + r][i] = w[i * BS + r]; } }
+				}
+			}
+
+
+		/**
+		 * Solve A.X = B for a matrix B (each column of B is a right hand side).
+		 *
+		 * @param   B   The right hand sides.
+		 *
+		 * @return  The matrix X = A^{-1}.B.
+		 **/
+		SqrMatrix<T, N> solve(const SqrMatrix<T, N> & B) const
+			{
+			std::vector< Vec<T, N> > C(N);
+			for (size_t j = 0; j < N; j++) { for (size_t i = 0; i < N; i++) { C[j][i] = B(i, j); } }
+			solve(C.data(), C.data(), N);
+			SqrMatrix<T, N> X;
+			for (size_t j = 0; j < N; j++) { for (size_t i = 0; i < N; i++) { X(i, j) = C[j][i]; } }
+			return X;
+			}
+
+
+		/**
+		 * Inverse of the matrix.
+		 **/
+		SqrMatrix<T, N> inverse() const
+			{
+			SqrMatrix<T, N> I;
+			I.setIdentity();
+			return solve(I);
+			}
+
+
+		/**
+		 * Row permutation: row i of P.A is row perm(i) of A.
+		 **/
+		inline size_t perm(size_t i) const { MTOOLS_ASSERT(i < N); return _perm[i]; }
+
+
+		/**
+		 * Coefficient (i,j) of the packed factors: L below the diagonal (unit diagonal not stored)
+		 * and U on and above the diagonal.
+		 **/
+		inline const T & factor(size_t i, size_t j) const { MTOOLS_ASSERT((i < N) && (j < N)); return _a[i + N * j]; }
+
+
+	private:
+
+		/* magnitude used to choose the pivot */
+		static inline double _mag(const T & v) { using std::abs; return (double)abs(v); }
+
+
+		/* right looking elimination, column by column */
+		void _factorize()
+			{
+			for (size_t i = 0; i < N; i++) { _perm[i] = i; }
+			for (size_t k = 0; k < N; k++)
+				{
+				T * ck = _a + N * k;
+				size_t p = k;
+				double best = _mag(ck[k]);
+				for (size_t i = k + 1; i < N; i++) { const double m = _mag(ck[i]); if (m > best) { best = m; p = i; } }
+				if (ck[p] == (T)0) { _singular = true; continue; } // no pivot in this column
+				if (p != k)
+					{
+					for (size_t j = 0; j < N; j++) { std::swap(_a[k + N * j], _a[p + N * j]); }
+					std::swap(_perm[k], _perm[p]);
+					_sign = -_sign;
+					}
+				const T inv = ((T)1) / ck[k];
+				for (size_t i = k + 1; i < N; i++) { ck[i] *= inv; }
+				for (size_t j = k + 1; j < N; j++)
+					{ // update the trailing submatrix: contiguous inner loop
+					T * cj = _a + N * j;
+					const T f = cj[k];
+					if (f == (T)0) continue;
+					for (size_t i = k + 1; i < N; i++) { cj[i] -= ck[i] * f; }
+					}
+				}
+			}
+
+
+		T		_a[N*N];	// packed factors, column major
+		size_t	_perm[N];	// row permutation
+		int		_sign;		// sign of the permutation
+		bool	_singular;	// true if a zero pivot was found
+	};
+
+
+
+
 
 }
 
@@ -0,0 +1,582 @@
+/** @file vecarray.hpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include "../misc/internal/mtools_export.hpp"
+#include "../misc/error.hpp"
+#include "../misc/misc.hpp"
+#include "vec.hpp"
+#include "box.hpp"
+
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <type_traits>
+
+
+
+namespace mtools
+	{
+
+
+	namespace internals_vecarray
+		{
+
+		/**
+		 * Storage for K arrays of arithmetic values of the same length (structure of arrays). The
+		 * arrays are allocated in a single block and each one starts on a 64 bytes boundary so that
+		 * the loops over them can be vectorized with aligned loads.
+		 **/
+		template<typename T, size_t K> class SoAStorage
+			{
+
+			static_assert(std::is_arithmetic<T>::value, "SoAStorage: T must be an arithmetic type");
+
+			public:
+
+				static const size_t ALIGN = 64;	// alignment of the arrays (in bytes)
+
+
+				/** Query the number of elements. */
+				inline size_t size() const { return _size; }
+
+
+				/** Query the number of elements that can be stored without reallocation. */
+				inline size_t capacity() const { return _cap; }
+
+
+				/** Remove all the elements (the memory is kept). */
+				inline void clear() { _size = 0; }
+
+
+				/** Make sure that n elements can be stored without reallocation. */
+				void reserve(size_t n)
+					{
+					if (n <= _cap) return;
+					const size_t step = ALIGN / sizeof(T);
+					const size_t newcap = std::max<size_t>(((n + step - 1) / step) * step, 2 * _cap);
+					char * raw = new char[K * newcap * sizeof(T) + ALIGN];
+					T * data = (T *)(((uintptr_t)raw + ALIGN - 1) & ~((uintptr_t)(ALIGN - 1)));
+					for (size_t k = 0; k < K; k++) { if (_size > 0) std::memcpy(data + k * newcap, _data + k * _cap, _size * sizeof(T)); }
+					delete[] _raw;
+					_raw = raw; _data = data; _cap = newcap;
+					}
+
+
+				/** Change the number of elements. New elements are set to zero. */
+				void resize(size_t n)
+					{
+					reserve(n);
+					if (n > _size) { for (size_t k = 0; k < K; k++) { std::memset(_data + k * _cap + _size, 0, (n - _size) * sizeof(T)); } }
+					_size = n;
+					}
+
+			protected:
+
+				SoAStorage() : _raw(nullptr), _data(nullptr), _size(0), _cap(0) {}
+
+				SoAStorage(const SoAStorage & S) : _raw(nullptr), _data(nullptr), _size(0), _cap(0) { _copy(S); }
+
+				SoAStorage(SoAStorage && S) : _raw(S._raw), _data(S._data), _size(S._size), _cap(S._cap) { S._raw = nullptr; S._data = nullptr; S._size = 0; S._cap = 0; }
+
+				SoAStorage & operator=(const SoAStorage & S) { if (&S != this) { _size = 0; _copy(S); } return *this; }
+
+				SoAStorage & operator=(SoAStorage && S)
+					{
+					if (&S == this) return *this;
+					delete[] _raw;
+					_raw = S._raw; _data = S._data; _size = S._size; _cap = S._cap;
+					S._raw = nullptr; S._data = nullptr; S._size = 0; S._cap = 0;
+					return *this;
+					}
+
+				~SoAStorage() { delete[] _raw; }
+
+				/* k-th array */
+				inline T * _array(size_t k) { MTOOLS_ASSERT(k < K); return _data + k * _cap; }
+				inline const T * _array(size_t k) const { MTOOLS_ASSERT(k < K); return _data + k * _cap; }
+
+				/* make room for one more element and return its index */
+				inline size_t _grow() { if (_size == _cap) reserve(_size + 1); return _size++; }
+
+			private:
+
+				void _copy(const SoAStorage & S)
+					{
+					reserve(S._size);
+					for (size_t k = 0; k < K; k++) { if (S._size > 0) std::memcpy(_data + k * _cap, S._data + k * S._cap, S._size * sizeof(T)); }
+					_size = S._size;
+					}
+
+				char *	_raw;	// allocated block
+				T *		_data;	// aligned start of the first array
+				size_t	_size;	// number of elements
+				size_t	_cap;	// capacity of each array (multiple of ALIGN/sizeof(T))
+			};
+
+		}
+
+
+	/**
+	 * Array of vectors Vec<T,N> stored as a structure of arrays: the i-th coordinates of all the
+	 * vectors are contiguous (and aligned) in memory.
+	 *
+	 * Contrarily to a std::vector< Vec<T,N> >, the batch kernels below (dist2(), dotProduct(),
+	 * boxTransform(), boundingBox()...) process the elements with simple loops over each coordinate
+	 * array, which the compiler can vectorize. Useful for large sets of points (centers of circles,
+	 * particles positions...).
+	 *
+	 * @tparam	T	Type of the coordinates (arithmetic type).
+	 * @tparam	N	Dimension.
+	 **/
+	template<typename T, size_t N> class VecArray : public internals_vecarray::SoAStorage<T, N>
+		{
+
+			typedef internals_vecarray::SoAStorage<T, N> Base;
+
+		public:
+
+			/** Default constructor. Empty array. */
+			VecArray() : Base() {}
+
+
+			/** Constructor. Array of n zero vectors. */
+			explicit VecArray(size_t n) : Base() { this->resize(n); }
+
+
+			/** Constructor from a (usual) array of vectors. */
+			VecArray(const Vec<T, N> * tab, size_t n) : Base() { assign(tab, n); }
+
+
+			/** Constructor from a std::vector of vectors. */
+			VecArray(const std::vector< Vec<T, N> > & tab) : Base() { assign(tab.data(), tab.size()); }
+
+
+			/** Copy constructor. */
+			VecArray(const VecArray & A) = default;
+
+
+			/** Move constructor. */
+			VecArray(VecArray && A) = default;
+
+
+			/** Assignment operator. */
+			VecArray & operator=(const VecArray & A) = default;
+
+
+			/** Move assignment operator. */
+			VecArray & operator=(VecArray && A) = default;
+
+
+			/** Replace the content with the n vectors of tab. */
+			void assign(const Vec<T, N> * tab, size_t n)
+				{
+				this->clear();
+				this->resize(n);
+				for (size_t k = 0; k < N; k++) { T * c = coord(k); for (size_t i = 0; i < n; i++) { c[i] = tab[i][k]; } }
+				}
+
+
+			/** Copy the vectors into a (usual) array of size at least size(). */
+			void copyTo(Vec<T, N> * tab) const
+				{
+				const size_t n = this->size();
+				for (size_t k = 0; k < N; k++) { const T * c = coord(k); for (size_t i = 0; i < n; i++) { tab[i][k] = c[i]; } }
+				}
+
+
+			/** Add a vector at the end of the array. */
+			inline void push_back(const Vec<T, N> & V) { const size_t i = this->_grow(); for (size_t k = 0; k < N; k++) { coord(k)[i] = V[k]; } }
+
+
+			/** Return the i-th vector. */
+			inline Vec<T, N> get(size_t i) const { MTOOLS_ASSERT(i < this->size()); Vec<T, N> V; for (size_t k = 0; k < N; k++) { V[k] = coord(k)[i]; } return V; }
+
+
+			/** Return the i-th vector. */
+			inline Vec<T, N> operator[](size_t i) const { return get(i); }
+
+
+			/** Set the i-th vector. */
+			inline void set(size_t i, const Vec<T, N> & V) { MTOOLS_ASSERT(i < this->size()); for (size_t k = 0; k < N; k++) { coord(k)[i] = V[k]; } }
+
+
+			/** Array of the k-th coordinates of the vectors. */
+			inline T * coord(size_t k) { return this->_array(k); }
+			inline const T * coord(size_t k) const { return this->_array(k); }
+
+
+			/** Array of the first coordinates. */
+			inline T * X() { return coord(0); }
+			inline const T * X() const { return coord(0); }
+
+
+			/** Array of the second coordinates. */
+			inline T * Y() { static_assert(N >= 2, "VecArray::Y() requires N >= 2"); return coord(1); }
+			inline const T * Y() const { static_assert(N >= 2, "VecArray::Y() requires N >= 2"); return coord(1); }
+
+
+			/** Smallest box containing all the vectors (empty box if the array is empty). */
+			Box<T, N> boundingBox() const
+				{
+				Box<T, N> B;
+				const size_t n = this->size();
+				if (n == 0) return B;
+				for (size_t k = 0; k < N; k++)
+					{
+					const T * c = coord(k);
+					T a = c[0], b = c[0];
+					for (size_t i = 1; i < n; i++) { a = (c[i] < a) ? c[i] : a; b = (c[i] > b) ? c[i] : b; }
+					B.min[k] = a; B.max[k] = b;
+					}
+				return B;
+				}
+
+
+			/** Print information about the array into a string. */
+			std::string toString() const
+				{
+				std::string s = std::string("VecArray<") + typeid(T).name() + "," + mtools::toString(N) + "> size " + mtools::toString(this->size()) + "\n";
+				for (size_t i = 0; i < this->size(); i++) { s += mtools::toString(i) + "\t -> " + get(i).toString(false) + "\n"; }
+				return s;
+				}
+		};
+
+
+	/**
+	 * Array of boxes Box<T,N> stored as a structure of arrays: 2N aligned arrays holding the min and
+	 * max of each coordinate. Used with the batch kernels intersect(), contain() and containedIn()
+	 * which test many boxes against a given box at once (bounding boxes of figures...).
+	 *
+	 * @tparam	T	Type of the coordinates (arithmetic type).
+	 * @tparam	N	Dimension.
+	 **/
+	template<typename T, size_t N> class BoxArray : public internals_vecarray::SoAStorage<T, 2*N>
+		{
+
+			typedef internals_vecarray::SoAStorage<T, 2*N> Base;
+
+		public:
+
+			/** Default constructor. Empty array. */
+			BoxArray() : Base() {}
+
+
+			/** Constructor. Array of n boxes reduced to the origin. */
+			explicit BoxArray(size_t n) : Base() { this->resize(n); }
+
+
+			/** Constructor from a (usual) array of boxes. */
+			BoxArray(const Box<T, N> * tab, size_t n) : Base() { assign(tab, n); }
+
+
+			/** Constructor from a std::vector of boxes. */
+			BoxArray(const std::vector< Box<T, N> > & tab) : Base() { assign(tab.data(), tab.size()); }
+
+
+			/** Copy constructor. */
+			BoxArray(const BoxArray & A) = default;
+
+
+			/** Move constructor. */
+			BoxArray(BoxArray && A) = default;
+
+
+			/** Assignment operator. */
+			BoxArray & operator=(const BoxArray & A) = default;
+
+
+			/** Move assignment operator. */
+			BoxArray & operator=(BoxArray && A) = default;
+
+
+			/** Replace the content with the n boxes of tab. */
+			void assign(const Box<T, N> * tab, size_t n)
+				{
+				this->clear();
+				this->resize(n);
+				for (size_t k = 0; k < N; k++)
+					{
+					T * a = min(k); T * b = max(k);
+					for (size_t i = 0; i < n; i++) { a[i] = tab[i].min[k]; b[i] = tab[i].max[k]; }
+					}
+				}
+
+
+			/** Copy the boxes into a (usual) array of size at least size(). */
+			void copyTo(Box<T, N> * tab) const
+				{
+				const size_t n = this->size();
+				for (size_t k = 0; k < N; k++)
+					{
+					const T * a = min(k); const T * b = max(k);
+					for (size_t i = 0; i < n; i++) { tab[i].min[k] = a[i]; tab[i].max[k] = b[i]; }
+					}
+				}
+
+
+			/** Add a box at the end of the array. */
+			inline void push_back(const Box<T, N> & B) { const size_t i = this->_grow(); for (size_t k = 0; k < N; k++) { min(k)[i] = B.min[k]; max(k)[i] = B.max[k]; } }
+
+
+			/** Return the i-th box. */
+			inline Box<T, N> get(size_t i) const { MTOOLS_ASSERT(i < this->size()); Box<T, N> B; for (size_t k = 0; k < N; k++) { B.min[k] = min(k)[i]; B.max[k] = max(k)[i]; } return B; }
+
+
+			/** Return the i-th box. */
+			inline Box<T, N> operator[](size_t i) const { return get(i); }
+
+
+			/** Set the i-th box. */
+			inline void set(size_t i, const Box<T, N> & B) { MTOOLS_ASSERT(i < this->size()); for (size_t k = 0; k < N; k++) { min(k)[i] = B.min[k]; max(k)[i] = B.max[k]; } }
+
+
+			/** Array of the minimums of the k-th coordinates of the boxes. */
+			inline T * min(size_t k) { return this->_array(k); }
+			inline const T * min(size_t k) const { return this->_array(k); }
+
+
+			/** Array of the maximums of the k-th coordinates of the boxes. */
+			inline T * max(size_t k) { return this->_array(N + k); }
+			inline const T * max(size_t k) const { return this->_array(N + k); }
+
+
+			/** Print information about the array into a string. */
+			std::string toString() const
+				{
+				std::string s = std::string("BoxArray<") + typeid(T).name() + "," + mtools::toString(N) + "> size " + mtools::toString(this->size()) + "\n";
+				for (size_t i = 0; i < this->size(); i++) { s += mtools::toString(i) + "\t -> " + get(i).toString(false) + "\n"; }
+				return s;
+				}
+		};
+
+
+
+	/**
+	 * Batch version of dist2(): out[i] = dist2(A[i], P) for i < A.size().
+	 *
+	 * @param	A		 	The array of vectors.
+	 * @param	P		 	The point.
+	 * @param [out]	out	Buffer of size at least A.size().
+	 **/
+	template<typename T, size_t N> void dist2(const VecArray<T, N> & A, const Vec<T, N> & P, T * out)
+		{
+		const size_t n = A.size();
+		for (size_t k = 0; k < N; k++)
+			{
+			const T * c = A.coord(k);
+			const T p = P[k];
+			if (k == 0) { for (size_t i = 0; i < n; i++) { const T d = c[i] - p; out[i] = d * d; } }
+			else { for (size_t i = 0; i < n; i++) { const T d = c[i] - p; out[i] += d * d; } }
+			}
+		}
+
+
+	/**
+	 * Batch version of dotProduct(): out[i] = dotProduct(A[i], V) for i < A.size().
+	 *
+	 * @param	A		 	The array of vectors.
+	 * @param	V		 	The vector.
+	 * @param [out]	out	Buffer of size at least A.size().
+	 **/
+	template<typename T, size_t N> void dotProduct(const VecArray<T, N> & A, const Vec<T, N> & V, T * out)
+		{
+		const size_t n = A.size();
+		for (size_t k = 0; k < N; k++)
+			{
+			const T * c = A.coord(k);
+			const T v = V[k];
+			if (k == 0) { for (size_t i = 0; i < n; i++) { out[i] = c[i] * v; } }
+			else { for (size_t i = 0; i < n; i++) { out[i] += c[i] * v; } }
+			}
+		}
+
+
+	/**
+	 * Batch intersection test: out[i] = 1 if the (closed) boxes A[i] and B intersect and 0 otherwise.
+	 * The boxes must be non-empty.
+	 *
+	 * @param	A		 	The array of boxes.
+	 * @param	B		 	The box to test against.
+	 * @param [out]	out	Buffer of size at least A.size().
+	 *
+	 * @return	the number of boxes that intersect B.
+	 **/
+	template<typename T, size_t N> size_t intersect(const BoxArray<T, N> & A, const Box<T, N> & B, uint8 * out)
+		{
+		const size_t n = A.size();
+		std::memset(out, 1, n);
+		for (size_t k = 0; k < N; k++)
+			{
+			const T * a = A.min(k); const T * b = A.max(k);
+			const T bmin = B.min[k], bmax = B.max[k];
+			for (size_t i = 0; i < n; i++) { out[i] &= (uint8)((a[i] <= bmax) & (bmin <= b[i])); }
+			}
+		size_t nb = 0;
+		for (size_t i = 0; i < n; i++) { nb += out[i]; }
+		return nb;
+		}
+
+
+	/**
+	 * Batch inclusion test: out[i] = 1 if A[i] contains B and 0 otherwise.
+	 *
+	 * @param	A		 	The array of boxes.
+	 * @param	B		 	The box to test against.
+	 * @param [out]	out	Buffer of size at least A.size().
+	 *
+	 * @return	the number of boxes that contain B.
+	 **/
+	template<typename T, size_t N> size_t contain(const BoxArray<T, N> & A, const Box<T, N> & B, uint8 * out)
+		{
+		const size_t n = A.size();
+		std::memset(out, 1, n);
+		for (size_t k = 0; k < N; k++)
+			{
+			const T * a = A.min(k); const T * b = A.max(k);
+			const T bmin = B.min[k], bmax = B.max[k];
+			for (size_t i = 0; i < n; i++) { out[i] &= (uint8)((a[i] <= bmin) & (bmax <= b[i])); }
+			}
+		size_t nb = 0;
+		for (size_t i = 0; i < n; i++) { nb += out[i]; }
+		return nb;
+		}
+
+
+	/**
+	 * Batch inclusion test: out[i] = 1 if A[i] is contained in B and 0 otherwise.
+	 *
+	 * @param	A		 	The array of boxes.
+	 * @param	B		 	The box to test against.
+	 * @param [out]	out	Buffer of size at least A.size().
+	 *
+	 * @return	the number of boxes contained in B.
+	 **/
+	template<typename T, size_t N> size_t containedIn(const BoxArray<T, N> & A, const Box<T, N> & B, uint8 * out)
+		{
+		const size_t n = A.size();
+		std::memset(out, 1, n);
+		for (size_t k = 0; k < N; k++)
+			{
+			const T * a = A.min(k); const T * b = A.max(k);
+			const T bmin = B.min[k], bmax = B.max[k];
+			for (size_t i = 0; i < n; i++) { out[i] &= (uint8)((bmin <= a[i]) & (b[i] <= bmax)); }
+			}
+		size_t nb = 0;
+		for (size_t i = 0; i < n; i++) { nb += out[i]; }
+		return nb;
+		}
+
+
+	/**
+	 * Batch version of boxTransform() for points: map the points of src with the affine
+	 * transformation that maps src_box to dst_box. The coefficients of the transformation are
+	 * computed once. dst is resized to src.size() and may be the same object as src.
+	 *
+	 * template parameter selects whether the y-axis is reversed
+	 **/
+	template<bool reverse_y = true> void boxTransform(const VecArray<double, 2> & src, const fBox2 & src_box, const fBox2 & dst_box, VecArray<double, 2> & dst)
+		{
+		MTOOLS_ASSERT((dst_box.max[0] - dst_box.min[0]) > 0);
+		MTOOLS_ASSERT((src_box.max[0] - src_box.min[0]) > 0);
+		MTOOLS_ASSERT((dst_box.max[1] - dst_box.min[1]) > 0);
+		MTOOLS_ASSERT((src_box.max[1] - src_box.min[1]) > 0);
+		const double mx = (dst_box.max[0] - dst_box.min[0]) / (src_box.max[0] - src_box.min[0]);
+		const double my = (dst_box.max[1] - dst_box.min[1]) / (src_box.max[1] - src_box.min[1]);
+		const size_t n = src.size();
+		if (&dst != &src) dst.resize(n);
+		const double ax = dst_box.min[0], sx = src_box.min[0], sy = src_box.min[1];
+		const double ay = (reverse_y ? dst_box.max[1] : dst_box.min[1]);
+		const double my2 = (reverse_y ? -my : my);
+		const double * x = src.X(); const double * y = src.Y();
+		double * X = dst.X(); double * Y = dst.Y();
+		for (size_t i = 0; i < n; i++) { X[i] = ax + mx * (x[i] - sx); }
+		for (size_t i = 0; i < n; i++) { Y[i] = ay + my2 * (y[i] - sy); }
+		}
+
+
+	/**
+	 * Batch version of boxTransform() for a (usual) array of points. The coefficients of the
+	 * transformation are computed once. dst may be equal to src.
+	 *
+	 * template parameter selects whether the y-axis is reversed
+	 **/
+	template<bool reverse_y = true> void boxTransform(const fVec2 * src, size_t n, const fBox2 & src_box, const fBox2 & dst_box, fVec2 * dst)
+		{
+		MTOOLS_ASSERT((dst_box.max[0] - dst_box.min[0]) > 0);
+		MTOOLS_ASSERT((src_box.max[0] - src_box.min[0]) > 0);
+		MTOOLS_ASSERT((dst_box.max[1] - dst_box.min[1]) > 0);
+		MTOOLS_ASSERT((src_box.max[1] - src_box.min[1]) > 0);
+		const double mx = (dst_box.max[0] - dst_box.min[0]) / (src_box.max[0] - src_box.min[0]);
+		const double my = (dst_box.max[1] - dst_box.min[1]) / (src_box.max[1] - src_box.min[1]);
+		const double ax = dst_box.min[0], sx = src_box.min[0], sy = src_box.min[1];
+		const double ay = (reverse_y ? dst_box.max[1] : dst_box.min[1]);
+		const double my2 = (reverse_y ? -my : my);
+		for (size_t i = 0; i < n; i++)
+			{
+			const double x = src[i].X(), y = src[i].Y();
+			dst[i].X() = ax + mx * (x - sx);
+			dst[i].Y() = ay + my2 * (y - sy);
+			}
+		}
+
+
+	/**
+	 * Batch version of boxTransform() for boxes. The coefficients of the transformation are
+	 * computed once. dst is resized to src.size() and may be the same object as src.
+	 *
+	 * template parameter selects whether the y-axis is reversed
+	 **/
+	template<bool reverse_y = true> void boxTransform(const BoxArray<double, 2> & src, const fBox2 & src_box, const fBox2 & dst_box, BoxArray<double, 2> & dst)
+		{
+		MTOOLS_ASSERT((dst_box.max[0] - dst_box.min[0]) > 0);
+		MTOOLS_ASSERT((src_box.max[0] - src_box.min[0]) > 0);
+		MTOOLS_ASSERT((dst_box.max[1] - dst_box.min[1]) > 0);
+		MTOOLS_ASSERT((src_box.max[1] - src_box.min[1]) > 0);
+		const double mx = (dst_box.max[0] - dst_box.min[0]) / (src_box.max[0] - src_box.min[0]);
+		const double my = (dst_box.max[1] - dst_box.min[1]) / (src_box.max[1] - src_box.min[1]);
+		const size_t n = src.size();
+		if (&dst != &src) dst.resize(n);
+		const double ax = dst_box.min[0], sx = src_box.min[0], sy = src_box.min[1];
+		const double * x0 = src.min(0); const double * x1 = src.max(0);
+		double * X0 = dst.min(0); double * X1 = dst.max(0);
+		for (size_t i = 0; i < n; i++) { X0[i] = ax + mx * (x0[i] - sx); X1[i] = ax + mx * (x1[i] - sx); }
+		const double * y0 = src.min(1); const double * y1 = src.max(1);
+		double * Y0 = dst.min(1); double * Y1 = dst.max(1);
+		if (reverse_y)
+			{ // the min and max are swapped
+			const double ay = dst_box.max[1];
+			for (size_t i = 0; i < n; i++) { const double a = y0[i], b = y1[i]; Y0[i] = ay - my * (b - sy); Y1[i] = ay - my * (a - sy); }
+			}
+		else
+			{
+			const double ay = dst_box.min[1];
+			for (size_t i = 0; i < n; i++) { Y0[i] = ay + my * (y0[i] - sy); Y1[i] = ay + my * (y1[i] - sy); }
+			}
+		}
+
+
+	}
+
+
+/* end of file */
+
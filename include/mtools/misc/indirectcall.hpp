@@ -54,6 +54,7 @@ namespace mtools
     class IndirectCall
     {
         public:
+        virtual ~IndirectCall() {}                      ///< virtual dtor so that a proxy may be deleted via a base class pointer
         virtual void call() { MTOOLS_INSURE(false); }; ///< make the registered call (may be invoqued more than once)
     };
 
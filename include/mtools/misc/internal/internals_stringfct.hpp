@@ -35,6 +35,12 @@
 #include <locale>
 #include <sstream>
 #include <cfloat>
+#include <cstdio>
+#include <clocale>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <limits>
 #include <algorithm>
 #include <iomanip>
 #include <utility>
@@ -60,6 +66,190 @@ namespace mtools
     {
 
 
+        /* arithmetic types handled by the buffer versions of toString() (the wide character types are printed as strings) */
+        template<typename T> struct isBufferPrintable
+            {
+            static const bool value = std::is_arithmetic<T>::value && (!std::is_same<T, wchar_t>::value) && (!std::is_same<T, char16_t>::value) && (!std::is_same<T, char32_t>::value);
+            };
+
+
+        /* arithmetic types handled by the allocation-free fromString() (the character types and bool are read as characters/words) */
+        template<typename T> struct isBufferParsable
+            {
+            static const bool value = isBufferPrintable<T>::value && (!std::is_same<T, bool>::value) && (!std::is_same<T, char>::value) && (!std::is_same<T, signed char>::value) && (!std::is_same<T, unsigned char>::value);
+            };
+
+
+        /* the pairs of digits "00" to "99" */
+        static const char digitPairs[201] = "00010203040506070809101112131415161718192021222324252627282930313233343536373839404142434445464748495051525354555657585960616263646566676869707172737475767778798081828384858687888990919293949596979899";
+
+
+        /* write the decimal representation of v just before end and return a pointer to the first digit */
+        inline char * formatUInt(uint64 v, char * end)
+            {
+            while (v >= 100)
+                {
+                const size_t k = (size_t)(v % 100) * 2; v /= 100;
+                end -= 2; end[0] = digitPairs[k]; end[1] = digitPairs[k + 1];
+                }
+            if (v >= 10) { const size_t k = (size_t)v * 2; end -= 2; end[0] = digitPairs[k]; end[1] = digitPairs[k + 1]; }
+            else { *(--end) = (char)('0' + v); }
+            return end;
+            }
+
+
+        /* integer types */
+        template<typename T> inline size_t toChars(const T & val, char * buf)
+            {
+            char tmp[24];
+            char * const end = tmp + sizeof(tmp);
+            char * p;
+            if ((std::is_signed<T>::value) && (val < (T)0)) { p = formatUInt((uint64)0 - (uint64)((int64)val), end); *(--p) = '-'; }
+            else { p = formatUInt((uint64)val, end); }
+            const size_t len = (size_t)(end - p);
+            std::memcpy(buf, p, len); buf[len] = 0;
+            return len;
+            }
+
+        inline size_t toChars(const bool & val, char * buf) { if (val) { std::memcpy(buf, "true", 5); return 4; } std::memcpy(buf, "false", 6); return 5; }
+
+        inline size_t toChars(const char & val, char * buf) { buf[0] = val; buf[1] = 0; return 1; }
+
+        /* The decimal point of the C locale (LC_NUMERIC) used by snprintf() and strtod(), nullptr if it
+         * is '.'. The streams use the classic locale so they (and the archives) always use '.' */
+        inline const char * localeDecimalPoint()
+            {
+            const char * dp = std::localeconv()->decimal_point;
+            return (((dp == nullptr) || (dp[0] == 0) || ((dp[0] == '.') && (dp[1] == 0))) ? nullptr : dp);
+            }
+
+
+        /* replace the decimal point of the C locale by '.' in the null terminated string buf of length len. Return the new length */
+        inline size_t classicDecimalPoint(char * buf, size_t len)
+            {
+            const char * dp = localeDecimalPoint();
+            if (dp == nullptr) return len;
+            char * p = std::strstr(buf, dp);
+            if (p == nullptr) return len;
+            const size_t l = std::strlen(dp);
+            *p = '.';
+            std::memmove(p + 1, p + l, len - (size_t)(p - buf) - l + 1);
+            return len - l + 1;
+            }
+
+
+        /* floating point types: same output as an ostream with default flags ("%g") */
+        inline size_t toChars(const float & val, char * buf) { return classicDecimalPoint(buf, (size_t)std::snprintf(buf, TOSTRING_BUFSIZE, "%g", (double)val)); }
+
+        inline size_t toChars(const double & val, char * buf) { return classicDecimalPoint(buf, (size_t)std::snprintf(buf, TOSTRING_BUFSIZE, "%g", val)); }
+
+        inline size_t toChars(const long double & val, char * buf) { return classicDecimalPoint(buf, (size_t)std::snprintf(buf, TOSTRING_BUFSIZE, "%Lg", val)); }
+
+
+        /* Find the number at the beginning of [s, s + len) the way an istream does it: skip the spaces,
+         * then optional sign, digits and, for floating point, fraction and exponent. Return the position
+         * of the first char of the number in start and the position after the number, 0 if there is no
+         * valid number. */
+        inline size_t scanNumber(const char * s, size_t len, bool fp, size_t & start)
+            {
+            size_t i = 0;
+            while ((i < len) && ((s[i] == ' ') || ((s[i] >= '\t') && (s[i] <= '\r')))) i++;
+            start = i;
+            if ((i < len) && ((s[i] == '+') || (s[i] == '-'))) i++;
+            size_t nd = 0;
+            while ((i < len) && (s[i] >= '0') && (s[i] <= '9')) { i++; nd++; }
+            if (!fp) return ((nd == 0) ? 0 : i);
+            if ((i < len) && (s[i] == '.')) { i++; while ((i < len) && (s[i] >= '0') && (s[i] <= '9')) { i++; nd++; } }
+            if (nd == 0) return 0;
+            if ((i < len) && ((s[i] == 'e') || (s[i] == 'E')))
+                {
+                i++;
+                if ((i < len) && ((s[i] == '+') || (s[i] == '-'))) i++;
+                size_t ne = 0;
+                while ((i < len) && (s[i] >= '0') && (s[i] <= '9')) { i++; ne++; }
+                if (ne == 0) return 0; // an istream also fails on a truncated exponent
+                }
+            return i;
+            }
+
+
+        /* integer types: fail (return 0) if the value does not fit in T */
+        template<typename T> inline size_t parseNumber(const char * s, size_t len, T & val, mtools::metaprog::dummy<false> D)
+            {
+            size_t start;
+            const size_t stop = scanNumber(s, len, false, start);
+            if (stop == 0) return 0;
+            const bool neg = (s[start] == '-');
+            size_t i = start + (((s[start] == '-') || (s[start] == '+')) ? 1 : 0);
+            uint64 v = 0;
+            for (; i < stop; i++)
+                {
+                const uint64 d = (uint64)(s[i] - '0');
+                if (v > (std::numeric_limits<uint64>::max() - d) / 10) return 0;
+                v = v * 10 + d;
+                }
+            if (std::is_signed<T>::value)
+                {
+                const uint64 lim = (uint64)std::numeric_limits<T>::max() + (neg ? 1 : 0);
+                if (v > lim) return 0;
+                val = (T)(neg ? (int64)((uint64)0 - v) : (int64)v);
+                }
+            else
+                {
+                if (v > (uint64)std::numeric_limits<T>::max()) return 0;
+                val = (T)(neg ? ((uint64)0 - v) : v); // an istream accepts a minus sign for unsigned types
+                }
+            return stop;
+            }
+
+
+        inline void strToFP(const char * s, char ** e, float & val) { val = std::strtof(s, e); }
+        inline void strToFP(const char * s, char ** e, double & val) { val = std::strtod(s, e); }
+        inline void strToFP(const char * s, char ** e, long double & val) { val = std::strtold(s, e); }
+
+
+        /* floating point types: fail (return 0) on overflow */
+        template<typename T> inline size_t parseNumber(const char * s, size_t len, T & val, mtools::metaprog::dummy<true> D)
+            {
+            size_t start;
+            const size_t stop = scanNumber(s, len, true, start);
+            if (stop == 0) return 0;
+            size_t n = stop - start;
+            char tmp[128];
+            std::string str;
+            const char * p = tmp;
+            const char * dp = localeDecimalPoint();
+            if ((n < sizeof(tmp)) && (dp == nullptr)) { std::memcpy(tmp, s + start, n); tmp[n] = 0; }
+            else
+                { // very long number, or strtod() expects another decimal point
+                str.assign(s + start, n);
+                const size_t k = ((dp == nullptr) ? std::string::npos : str.find('.'));
+                if (k != std::string::npos) { str.replace(k, 1, dp); n = str.size(); }
+                p = str.c_str();
+                }
+            char * e;
+            T v;
+            strToFP(p, &e, v);
+            if ((e != p + n) || (std::isinf(v))) return 0;
+            val = v;
+            return stop;
+            }
+
+
+        /* fromString() for the integer and floating point types */
+        template<typename T> inline size_t fromStringImpl(const char * s, size_t len, T & val, mtools::metaprog::dummy<true> D) { return parseNumber(s, len, val, mtools::metaprog::dummy<std::is_floating_point<T>::value>()); }
+
+        /* fromString() for the other types: use an istream */
+        template<typename T> inline size_t fromStringImpl(const char * s, size_t len, T & val, mtools::metaprog::dummy<false> D)
+            {
+            std::istringstream iss(std::string(s, len) + " ");
+            iss >> val;
+            std::streampos r = iss.tellg();
+            if (r < 0) return 0;
+            return(static_cast<size_t>(r));
+            }
+
+
         /* class for conversion to a string, specialization for basic types, partial specialization for arrays and containers */
         template<typename T> class StringConverter
         {
@@ -139,91 +329,91 @@ namespace mtools
         {
             typedef signed char T;
             public:
-            static inline std::string print(const T & val, StringEncoding output_enc) { return std::to_string(val); }
+            static inline std::string print(const T & val, StringEncoding output_enc) { char buf[TOSTRING_BUFSIZE]; return std::string(buf, toChars(val, buf)); }
         };
 
         template<> class StringConverter<short>
         {
             typedef short T;
             public:
-            static inline std::string print(const T & val, StringEncoding output_enc) { return std::to_string(val); }
+            static inline std::string print(const T & val, StringEncoding output_enc) { char buf[TOSTRING_BUFSIZE]; return std::string(buf, toChars(val, buf)); }
         };
 
         template<> class StringConverter<int>
         {
             typedef int T;
             public:
-            static inline std::string print(const T & val, StringEncoding output_enc) { return std::to_string(val); }
+            static inline std::string print(const T & val, StringEncoding output_enc) { char buf[TOSTRING_BUFSIZE]; return std::string(buf, toChars(val, buf)); }
         };
 
         template<> class StringConverter<long>
         {
             typedef long T;
             public:
-            static inline std::string print(const T & val, StringEncoding output_enc) { return std::to_string(val); }
+            static inline std::string print(const T & val, StringEncoding output_enc) { char buf[TOSTRING_BUFSIZE]; return std::string(buf, toChars(val, buf)); }
         };
 
         template<> class StringConverter<long long>
         {
             typedef long long T;
             public:
-            static inline std::string print(const T & val, StringEncoding output_enc) { return std::to_string(val); }
+            static inline std::string print(const T & val, StringEncoding output_enc) { char buf[TOSTRING_BUFSIZE]; return std::string(buf, toChars(val, buf)); }
         };
 
         template<> class StringConverter<unsigned char>
         {
             typedef unsigned char T;
             public:
-            static inline std::string print(const T & val, StringEncoding output_enc) { return std::to_string(val); }
+            static inline std::string print(const T & val, StringEncoding output_enc) { char buf[TOSTRING_BUFSIZE]; return std::string(buf, toChars(val, buf)); }
         };
 
         template<> class StringConverter<unsigned short>
         {
             typedef unsigned short T;
             public:
-            static inline std::string print(const T & val, StringEncoding output_enc) { return std::to_string(val); }
+            static inline std::string print(const T & val, StringEncoding output_enc) { char buf[TOSTRING_BUFSIZE]; return std::string(buf, toChars(val, buf)); }
         };
 
         template<> class StringConverter<unsigned int>
         {
             typedef unsigned int T;
             public:
-            static inline std::string print(const T & val, StringEncoding output_enc) { return std::to_string(val); }
+            static inline std::string print(const T & val, StringEncoding output_enc) { char buf[TOSTRING_BUFSIZE]; return std::string(buf, toChars(val, buf)); }
         };
 
         template<> class StringConverter<unsigned long>
         {
             typedef unsigned long T;
             public:
-            static inline std::string print(const T & val, StringEncoding output_enc) { return std::to_string(val); }
+            static inline std::string print(const T & val, StringEncoding output_enc) { char buf[TOSTRING_BUFSIZE]; return std::string(buf, toChars(val, buf)); }
         };
 
         template<> class StringConverter<unsigned long long>
         {
             typedef unsigned long long T;
             public:
-            static inline std::string print(const T & val, StringEncoding output_enc) { return std::to_string(val); }
+            static inline std::string print(const T & val, StringEncoding output_enc) { char buf[TOSTRING_BUFSIZE]; return std::string(buf, toChars(val, buf)); }
         };
 
         template<> class StringConverter<float>
         {
             typedef float T;
             public:
-            static inline std::string print(const T & val, StringEncoding output_enc) { std::stringstream stream; stream << val; return std::string(stream.str()); }
+            static inline std::string print(const T & val, StringEncoding output_enc) { char buf[TOSTRING_BUFSIZE]; return std::string(buf, toChars(val, buf)); }
         };
 
         template<> class StringConverter<double>
         {
             typedef double T;
             public:
-            static inline std::string print(const T & val, StringEncoding output_enc) { std::stringstream stream; stream << val; return std::string(stream.str()); }
+            static inline std::string print(const T & val, StringEncoding output_enc) { char buf[TOSTRING_BUFSIZE]; return std::string(buf, toChars(val, buf)); }
         };
 
         template<> class StringConverter<long double>
         {
             typedef long double T;
             public:
-            static inline std::string print(const T & val, StringEncoding output_enc) { std::stringstream stream; stream << val; return std::string(stream.str()); }
+            static inline std::string print(const T & val, StringEncoding output_enc) { char buf[TOSTRING_BUFSIZE]; return std::string(buf, toChars(val, buf)); }
         };
 
         template<> class StringConverter<char>
@@ -28,6 +28,8 @@
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <chrono>
+#include <vector>
 
 namespace mtools
 {
@@ -106,6 +108,195 @@ template<typename T> class SingleProducerSingleConsumerQueue
 
 
 
+
+/**
+ * Bounded lock-free FIFO queue for any number of producer and consumer threads.
+ * 
+ * The queue is a circular buffer of cells each carrying a sequence number (D. Vyukov's algorithm):
+ * push() and pop() only use a compare-and-swap on the position counter and never take a lock. 
+ * 
+ * push_wait() and pop_wait() are blocking versions: a thread that finds the queue full (resp.
+ * empty) first spins for a short time, then sleeps on a condition variable until another thread
+ * pops (resp. pushes) an element or until a timeout expires. Threads that do not wait never touch
+ * the mutex, except to wake up a sleeping thread.
+ **/
+template<typename T> class MultiProducerMultiConsumerQueue
+	{
+
+	public:
+
+	/** Constructor. The buffer size is rounded up to a power of 2. */
+	MultiProducerMultiConsumerQueue(size_t buffer_size) : _mask(0), _cells(), _writepos(0), _readpos(0), _nbwaiting(0)
+		{
+		MTOOLS_INSURE(buffer_size > 0);
+		size_t n = 2;
+		while (n < buffer_size) n *= 2;
+		_mask = n - 1;
+		_cells = std::vector<_Cell>(n);
+		for (size_t i = 0; i < n; i++) { _cells[i].seq.store(i, std::memory_order_relaxed); }
+		}
+
+
+	/**
+	 * push an element in the queue, return false if the queue is full.
+	 **/
+	MTOOLS_FORCEINLINE bool push(const T & obj)
+		{
+		size_t pos = _writepos.load(std::memory_order_relaxed);
+		while (1)
+			{
+			_Cell & cell = _cells[pos & _mask];
+			const size_t seq = cell.seq.load(std::memory_order_acquire);
+			const intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+			if (dif == 0)
+				{
+				if (_writepos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) 
+					{
+					cell.data = obj;
+					cell.seq.store(pos + 1, std::memory_order_release);
+					_wakeUp();
+					return true;
+					}
+				}
+			else if (dif < 0) { return false; } // full
+			else { pos = _writepos.load(std::memory_order_relaxed); }
+			}
+		}
+
+
+	/**
+	 * pop an element from the queue, return false if none available.
+	 **/
+	MTOOLS_FORCEINLINE bool pop(T & obj)
+		{
+		size_t pos = _readpos.load(std::memory_order_relaxed);
+		while (1)
+			{
+			_Cell & cell = _cells[pos & _mask];
+			const size_t seq = cell.seq.load(std::memory_order_acquire);
+			const intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+			if (dif == 0)
+				{
+				if (_readpos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					{
+					obj = cell.data;
+					cell.seq.store(pos + _mask + 1, std::memory_order_release);
+					_wakeUp();
+					return true;
+					}
+				}
+			else if (dif < 0) { return false; } // empty
+			else { pos = _readpos.load(std::memory_order_relaxed); }
+			}
+		}
+
+
+	/**
+	 * push an element in the queue, waiting at most maxwait milliseconds for a slot to become free.
+	 * Return false if the queue is still full after the timeout.
+	 **/
+	bool push_wait(const T & obj, int64 maxwait = 1)
+		{
+		return _wait([&]() -> bool { return push(obj); }, [&]() -> bool { return (size() < capacity()); }, maxwait);
+		}
+
+
+	/**
+	 * pop an element from the queue, waiting at most maxwait milliseconds for one to become 
+	 * available. Return false if the queue is still empty after the timeout.
+	 **/
+	bool pop_wait(T & obj, int64 maxwait = 1)
+		{
+		return _wait([&]() -> bool { return pop(obj); }, [&]() -> bool { return (size() > 0); }, maxwait);
+		}
+
+
+	/** Return the (approximate) number of elements in the queue */
+	MTOOLS_FORCEINLINE size_t size() const
+		{
+		const size_t w = _writepos.load(std::memory_order_relaxed);
+		const size_t r = _readpos.load(std::memory_order_relaxed);
+		return ((w > r) ? (w - r) : 0);
+		}
+
+
+	/** Return the capacity of the queue. */
+	MTOOLS_FORCEINLINE size_t capacity() const { return _mask + 1; }
+
+
+	/** Clear the queue (this method is not threadsafe) */
+	void clear()
+		{
+		T obj;
+		while (pop(obj)) {}
+		}
+
+
+	private:
+
+		MultiProducerMultiConsumerQueue(const MultiProducerMultiConsumerQueue &) = delete;
+		MultiProducerMultiConsumerQueue & operator=(const MultiProducerMultiConsumerQueue &) = delete;
+
+		static const int SPIN_COUNT = 64;	// number of attempts before sleeping
+
+		struct _Cell
+			{
+			_Cell() : seq(0), data() {}
+			_Cell(const _Cell & c) : seq(c.seq.load()), data(c.data) {}
+			_Cell & operator=(const _Cell & c) { seq.store(c.seq.load()); data = c.data; return *this; }
+
+			std::atomic<size_t>	seq;	// sequence number of the cell
+			T					data;	// the element
+			};
+
+
+		/* wake up the sleeping threads (if any) */
+		MTOOLS_FORCEINLINE void _wakeUp()
+			{
+			std::atomic_thread_fence(std::memory_order_seq_cst); // pairs with the fence in _wait()
+			if (_nbwaiting.load(std::memory_order_relaxed) == 0) return;
+			std::lock_guard<std::mutex> lock(_mut);
+			_cv.notify_all();
+			}
+
+
+		/* try op() with spinning, then sleeping, backoff. ready() tells if op() may succeed. */
+		template<typename OP, typename READY> bool _wait(OP op, READY ready, int64 maxwait)
+			{
+			for (int i = 0; i < SPIN_COUNT; i++) 
+				{ 
+				if (op()) return true; 
+				if (i >= SPIN_COUNT / 2) std::this_thread::yield();
+				}
+			const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(maxwait);
+			_nbwaiting++;
+			std::atomic_thread_fence(std::memory_order_seq_cst); // from now on, every successful push/pop notifies us
+			bool ok = false;
+			while (1)
+				{
+				if (op()) { ok = true; break; }
+				if (std::chrono::steady_clock::now() >= deadline) break;
+				std::unique_lock<std::mutex> lock(_mut);
+				if (ready()) continue;	// the state changed before we got the lock
+				_cv.wait_until(lock, deadline);
+				}
+			_nbwaiting--;
+			return ok;
+			}
+
+
+		size_t							_mask;		// buffer size - 1
+		std::vector<_Cell>				_cells;		// buffer
+		alignas(64) std::atomic<size_t>	_writepos;	// position to write
+		alignas(64) std::atomic<size_t>	_readpos;	// position to read
+		alignas(64) std::atomic<int>	_nbwaiting;	// number of sleeping threads
+		std::mutex						_mut;		// mutex/condition used by the sleeping threads
+		std::condition_variable			_cv;		//
+
+	};
+
+
+
 }
 
 /* end of file */
\ No newline at end of file
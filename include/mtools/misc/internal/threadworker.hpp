@@ -20,14 +20,18 @@
 
 #pragma once
 
+#include "mtools_export.hpp"
 #include "../misc.hpp"
 #include "../error.hpp"
+#include "../profiler.hpp"
 
 #include <ctime>
 #include <atomic>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <chrono>
+#include <vector>
 
 namespace mtools
 {
@@ -45,6 +49,208 @@ namespace mtools
         }
 
 
+    namespace internals_threadscheduler { struct SchedulerState; }
+
+
+    /**
+     * Global scheduler shared by all the ThreadWorker objects (and by the worker threads of
+     * AutoDrawable2DObject).
+     *
+     * Each drawer owns its threads but a thread must hold an execution slot while it performs work.
+     * There are maxRunning() slots for the whole program (by default, the number of hardware
+     * threads) so the core count is respected globally instead of per object, even when many
+     * drawers are active simultaneously. Threads waiting for a message do not hold a slot.
+     *
+     * Slots are granted to the waiting thread with the highest priority (then in FIFO order). A
+     * running worker gives back its slot at its next call to check() when a thread with a higher
+     * priority is waiting, or when a thread with the same priority is waiting and the worker has
+     * held the slot for more than TIMESLICE_MS milliseconds.
+     **/
+    class ThreadScheduler
+        {
+
+        public:
+
+            /* default priority of a thread */
+            static const int PRIORITY_NORMAL = 0;
+
+            /* priority used for the currently visible object */
+            static const int PRIORITY_HIGH = 1;
+
+            /* time slice between threads with the same priority */
+            static const int TIMESLICE_MS = 50;
+
+
+            /**
+             * Set the number of threads that may work simultaneously. Use 0 to restore the default value
+             * (number of hardware threads).
+             **/
+            MTOOLS_DLL static void setMaxRunning(int nb);
+
+
+            /* Return the number of threads that may work simultaneously */
+            MTOOLS_DLL static int maxRunning();
+
+
+            /* Return the number of threads currently holding a slot */
+            MTOOLS_DLL static int running();
+
+
+            /* Return the number of threads currently waiting for a slot */
+            MTOOLS_DLL static int waiting();
+
+
+            /**
+             * Acquire an execution slot. Blocks until a slot is granted or until abort(data) returns
+             * true. Only the thread first in line is woken up when a slot is released so whoever makes
+             * the predicate true must call wakeUp(data) afterward to interrupt the wait at once
+             * (otherwise, the predicate is only checked every millisecond).
+             *
+             * @param   priority    The priority of the calling thread.
+             * @param   abort       Optional predicate used to stop waiting (may be nullptr).
+             * @param   data        Opaque data passed to abort.
+             *
+             * @return  true if the slot was granted and false if the wait was aborted.
+             **/
+            MTOOLS_DLL static bool acquire(int priority, bool (*abort)(void *) = nullptr, void * data = nullptr);
+
+
+            /* Release an execution slot previously acquired */
+            MTOOLS_DLL static void release();
+
+
+            /* Wake up the threads waiting in acquire() with this data so that they check their abort predicate again */
+            MTOOLS_DLL static void wakeUp(const void * data);
+
+
+            /**
+             * Query if a thread holding a slot with a given priority should give it back now. This
+             * method is fast.
+             *
+             * @param   priority    The priority of the calling thread.
+             * @param   since       The time at which the slot was acquired.
+             **/
+            static inline bool mustYield(int priority, std::chrono::steady_clock::time_point since)
+                {
+                const int w = _topWaiting.load(std::memory_order_relaxed);
+                if (w < priority) return false;
+                if (w > priority) return true;
+                return ((std::chrono::steady_clock::now() - since) > std::chrono::milliseconds(TIMESLICE_MS));
+                }
+
+
+        private:
+
+            friend struct internals_threadscheduler::SchedulerState;
+
+            static const int NO_WAITING = -2147483647 - 1;
+
+            MTOOLS_DLL static std::atomic<int> _topWaiting;  // highest priority among the waiting threads (NO_WAITING if none)
+
+        };
+
+
+
+    /**
+     * Placement of the worker threads on the cpus and NUMA nodes of the machine.
+     *
+     * The policy applies to the threads of ThreadWorker objects (and to any thread calling
+     * pinCurrentThread()). Each thread has an index (its rank in its pool, see
+     * ThreadWorker::affinity()) and the policy maps the index to a cpu:
+     *
+     * - AFFINITY_NONE    : the threads are not pinned (default).
+     * - AFFINITY_COMPACT : consecutive indexes on consecutive cpus, filling a node before the next one.
+     * - AFFINITY_SCATTER : consecutive indexes on different nodes (round robin over the nodes).
+     * - AFFINITY_NODE    : all the threads on the cpus of a single node.
+     *
+     * Memory is allocated by the OS on the node of the thread which first writes to it. The buffers
+     * of ProgressImg are not touched at allocation so each drawer thread gets its band on its own
+     * node, and a pinned simulation thread gets the pools of the grids it fills. bindLocal() moves
+     * an already touched buffer to the node of the calling thread.
+     *
+     * The topology is read from /sys on Linux. On other systems, there is a single node and
+     * pinning does nothing.
+     **/
+    class ThreadAffinity
+        {
+
+        public:
+
+            static const int AFFINITY_NONE = 0;
+            static const int AFFINITY_COMPACT = 1;
+            static const int AFFINITY_SCATTER = 2;
+            static const int AFFINITY_NODE = 3;
+
+
+            /**
+             * Set the policy. The threads of the existing ThreadWorker objects are moved the next time
+             * they process a message.
+             *
+             * @param   policy  One of AFFINITY_NONE, AFFINITY_COMPACT, AFFINITY_SCATTER, AFFINITY_NODE.
+             * @param   node    The node used with AFFINITY_NODE.
+             **/
+            MTOOLS_DLL static void setPolicy(int policy, int node = 0);
+
+
+            /* Return the current policy */
+            MTOOLS_DLL static int policy();
+
+
+            /* Return a counter incremented each time the policy changes */
+            static inline int epoch() { return _epoch.load(std::memory_order_relaxed); }
+
+
+            /* Return the number of NUMA nodes (1 if unknown) */
+            MTOOLS_DLL static int nbNodes();
+
+
+            /* Return the cpus of a node (restricted to those the process may use) */
+            MTOOLS_DLL static std::vector<int> nodeCpus(int node);
+
+
+            /* Return the node of a cpu (0 if unknown) */
+            MTOOLS_DLL static int cpuNode(int cpu);
+
+
+            /* Return the cpu assigned to a thread index by the current policy (-1 for no pinning) */
+            MTOOLS_DLL static int cpuForIndex(int index);
+
+
+            /**
+             * Pin the calling thread to the cpu assigned to index by the current policy (or let it run
+             * on any cpu if the policy is AFFINITY_NONE).
+             *
+             * @return  true on success.
+             **/
+            MTOOLS_DLL static bool pinCurrentThread(int index);
+
+
+            /* Return the node on which the calling thread currently runs (0 if unknown) */
+            MTOOLS_DLL static int currentNode();
+
+
+            /**
+             * Ask the OS to place (and move if needed) the pages of a buffer on the node of the calling
+             * thread. Only the pages entirely inside the buffer are concerned. Does nothing if there is
+             * a single node.
+             *
+             * @return  true on success.
+             **/
+            MTOOLS_DLL static bool bindLocal(const void * p, size_t len);
+
+
+            /* Return a new index, used by default for the ThreadWorker threads */
+            MTOOLS_DLL static int nextIndex();
+
+
+        private:
+
+            MTOOLS_DLL static std::atomic<int> _epoch;
+
+        };
+
+
+
     /**
     * Class used for creating a simple worker thread.
     *
@@ -64,6 +270,11 @@ namespace mtools
 	*                                 virtual method. When, active, the thread performs the work() method. When inactive
 	*                                 it waits until being active again before continuing/starting the work method.  
 	*                                 Once work() is finished, this flag is set to inactive.
+	*
+	* The thread holds an execution slot from the global ThreadScheduler while it runs work() and
+	* gives it back while waiting. Use priority() to favor some workers over others.
+	*
+	* The thread is placed according to the ThreadAffinity policy, using its affinity() index.
     */
     class ThreadWorker
         {
@@ -79,7 +290,13 @@ namespace mtools
                 _thread_status(false),
                 _work_status(false),
                 _msg(MSG_NONE),
-                _code(0)
+                _code(0),
+                _priority(ThreadScheduler::PRIORITY_NORMAL),
+                _inAcquire(false),
+                _affinityIndex(ThreadAffinity::nextIndex()),
+                _affinityEpoch(-1),
+                _affinityApplied(-1),
+                _hasSlot(false)
                 {
                 _th = new std::thread(&ThreadWorker::_threadProc, this);
                 sync();
@@ -102,6 +319,28 @@ namespace mtools
             inline int progress() const { return _progress; }
 
 
+            /**
+            * Set the priority of the thread w.r.t. the global ThreadScheduler. Threads with higher
+            * priority get the execution slots first. Takes effect immediately.
+            **/
+            inline void priority(int prio) { _priority = prio; }
+
+
+            /** Return the priority of the thread. */
+            inline int priority() const { return _priority; }
+
+
+            /**
+            * Set the index of the thread w.r.t. the ThreadAffinity policy (typically, its rank in its
+            * pool). The thread is moved the next time it processes a message.
+            **/
+            inline void affinity(int index) { _affinityIndex = index; }
+
+
+            /** Return the index of the thread w.r.t. the ThreadAffinity policy. */
+            inline int affinity() const { return _affinityIndex; }
+
+
             /**
             * Enables/Disable the thread. A disable thread can still process signals but cannot perform any
             * work.
@@ -134,12 +373,21 @@ namespace mtools
             inline bool ready() const { return(((int)_msg) == MSG_NONE); }
 
 
-            /** Wait for the completion of any pending command. */
+            /**
+            * Wait for the completion of any pending command. Spins for a short while (the worker usually
+            * answers within a few microseconds) before blocking until notified by the thread.
+            **/
             void sync()
                 {
+                static const int spin = ((nbHardwareThreads() > 1) ? SYNC_SPIN : 0); // spinning is useless on a single core
+                for (int i = 0; i < spin; i++)
+                    {
+                    if (((int)_msg) == MSG_NONE) return;
+                    std::this_thread::yield();
+                    }
                 if (((int)_msg) == MSG_NONE) return;
                 std::unique_lock<std::mutex> lock(_mut_wait);
-                while (((int)_msg) != MSG_NONE) { _cv_wait.wait_for(lock,std::chrono::milliseconds(1)); }
+                while (((int)_msg) != MSG_NONE) { _cv_wait.wait_for(lock, std::chrono::milliseconds(1)); } // notified by _threadReady(), the timeout is only a safety net
                 }
 
 
@@ -178,7 +426,15 @@ namespace mtools
              * !!! This method is fast. It must be called regularly inside work() to keep the thread
              * responsive !!!
              **/
-            MTOOLS_FORCEINLINE void check() { if (((int)_msg) == MSG_NONE) { return; } _processInside(); }
+            MTOOLS_FORCEINLINE void check()
+                {
+                if (((int)_msg) == MSG_NONE)
+                    {
+                    if (ThreadScheduler::mustYield(_priority, _slotTime)) _yieldSlot();
+                    return;
+                    }
+                _processInside();
+                }
 
 
             /**
@@ -227,6 +483,14 @@ namespace mtools
             std::mutex _mut_wait;                   // associated condition variable.
             std::thread * _th;                      // the thread object.
 
+            std::atomic<int>    _priority;          // priority w.r.t. the ThreadScheduler
+            std::atomic<bool>   _inAcquire;         // true while the thread waits in ThreadScheduler::acquire()
+            std::atomic<int>    _affinityIndex;     // index of the thread w.r.t. the ThreadAffinity policy
+            int                 _affinityEpoch;     // policy epoch and index used for the current placement (thread side)
+            int                 _affinityApplied;   //
+            bool                _hasSlot;           // true if the thread currently holds an execution slot
+            std::chrono::steady_clock::time_point _slotTime; // time when the slot was acquired
+
 
             static const int PROGRESS_NONE = 0;
 
@@ -238,6 +502,8 @@ namespace mtools
 
             static const int64 CODE_NONE = 0;
 
+            static const int SYNC_SPIN = 64;        // number of yields in sync() before blocking
+
 
             /* send a signal to the thread */
             void _signal(int msg, int64 code = CODE_NONE)
@@ -247,6 +513,8 @@ namespace mtools
                 _code = code;
                 _msg = msg;
                 _cv_wakeup.notify_one();
+                lock.unlock();
+                if (_inAcquire) ThreadScheduler::wakeUp(this); // the thread is waiting for a slot: make it look at the message
                 }
 
 
@@ -255,7 +523,7 @@ namespace mtools
                 {
                 if (((int)_msg) != MSG_NONE) return;
                 std::unique_lock<std::mutex> lock(_mut_wakeup);
-                while (((int)_msg) == MSG_NONE) { _cv_wakeup.wait_for(lock, std::chrono::milliseconds(10)); }
+                while (((int)_msg) == MSG_NONE) { _cv_wakeup.wait_for(lock, std::chrono::milliseconds(10)); } // notified by _signal()
                 }
 
 
@@ -266,7 +534,54 @@ namespace mtools
                 std::unique_lock<std::mutex> lock(_mut_wait);
                 _msg = MSG_NONE;
                 _code = CODE_NONE;
-                _cv_wait.notify_one();
+                _cv_wait.notify_all(); // sync() may be called from several threads
+                }
+
+
+            /* abort predicate for ThreadScheduler::acquire(): stop waiting when there is a message */
+            static bool _pendingMessage(void * data) { return (((int)(((ThreadWorker *)data)->_msg)) != MSG_NONE); }
+
+
+            /* acquire an execution slot. Return false (without a slot) if a message arrived in the meantime */
+            bool _acquireSlot()
+                {
+                if (_hasSlot) return true;
+                _inAcquire = true; // set before the predicate is first checked (see _signal())
+                const bool ok = ThreadScheduler::acquire(_priority, &_pendingMessage, this);
+                _inAcquire = false;
+                if (!ok) return false;
+                _hasSlot = true;
+                _slotTime = std::chrono::steady_clock::now();
+                return true;
+                }
+
+
+            /* release the execution slot if we hold one */
+            void _releaseSlot()
+                {
+                if (!_hasSlot) return;
+                _hasSlot = false;
+                ThreadScheduler::release();
+                }
+
+
+            /* give the slot to a waiting thread and wait for our turn. Called from within check() */
+            void _yieldSlot()
+                {
+                _releaseSlot();
+                if (!_acquireSlot()) _processInside();
+                }
+
+
+            /* move the thread if the placement policy or its index changed */
+            void _applyAffinity()
+                {
+                const int e = ThreadAffinity::epoch();
+                const int i = _affinityIndex;
+                if ((e == _affinityEpoch) && (i == _affinityApplied)) return;
+                if ((_affinityEpoch < 0) && (ThreadAffinity::policy() == ThreadAffinity::AFFINITY_NONE)) { _affinityEpoch = e; _affinityApplied = i; return; } // nothing to undo
+                ThreadAffinity::pinCurrentThread(i);
+                _affinityEpoch = e; _affinityApplied = i;
                 }
 
 
@@ -275,7 +590,9 @@ namespace mtools
                 {
 
             wait_label:
+                _releaseSlot();
                 _threadSleep();
+                _applyAffinity();
                 switch ((int)_msg)
                     {
                     case MSG_ENABLE: { _thread_status = true; break; }
@@ -300,6 +617,7 @@ namespace mtools
 
             work_label:
                 if ((!((bool)_thread_status)) || (!((bool)_work_status))) goto wait_label;
+                if (!_acquireSlot()) goto wait_label; // a message arrived while waiting for a slot
                 try
                     {
                     work();
@@ -308,11 +626,11 @@ namespace mtools
                     }
                 catch (int r)
                     {
-                    if ((int)_msg == MSG_QUIT) { _threadReady(); return; }
+                    if ((int)_msg == MSG_QUIT) { _releaseSlot(); _threadReady(); return; }
                     switch (r)
                         {
                         case THREAD_RESET: { _work_status = true; _threadReady(); goto work_label; }
-                        case THREAD_RESET_AND_WAIT: { _work_status = false; _threadReady(); goto wait_label; }
+                        case THREAD_RESET_AND_WAIT: { _work_status = false; _releaseSlot(); _threadReady(); goto wait_label; }
                         default: { MTOOLS_ERROR("wtf?"); }
                         }
                     }
@@ -322,6 +640,7 @@ namespace mtools
             /* process a message inside check() */
             void _processInside()
                 {
+                MTOOLS_PROF_SCOPE("ThreadWorker::processInside");
                 while (1)
                     {
                     switch ((int)_msg)
@@ -329,7 +648,7 @@ namespace mtools
                         case MSG_ENABLE:
                             {
                             _thread_status = true;
-                            if ((bool)_work_status) { _threadReady(); return; }
+                            if ((bool)_work_status) { _threadReady(); if (_acquireSlot()) return; continue; }
                             break;
                             }
                         case MSG_DISABLE: { _thread_status = false; break; }
@@ -342,7 +661,7 @@ namespace mtools
                                 case THREAD_CONTINUE:
                                     {
                                     _work_status = true;
-                                    if ((bool)_thread_status) { _threadReady(); return; }
+                                    if ((bool)_thread_status) { _threadReady(); if (_acquireSlot()) return; continue; }
                                     break;
                                     }
                                 case THREAD_WAIT: { _work_status = false; break; }
@@ -354,6 +673,7 @@ namespace mtools
                             }
                         default: { MTOOLS_ERROR("wtf?"); }
                         }
+                    _releaseSlot(); // do not hold the slot while waiting
                     _threadReady();
                     _threadSleep();
                     }
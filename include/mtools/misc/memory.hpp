@@ -23,6 +23,7 @@
 #include "../misc/internal/mtools_export.hpp"
 #include "error.hpp"
 #include "metaprog.hpp"
+#include "misc.hpp"
 
 #include <cstddef>
 #include <cstdlib>
@@ -30,6 +31,10 @@
 #include <utility>
 #include <string>
 #include <type_traits>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <atomic>
 
 
 namespace mtools
@@ -63,6 +68,258 @@ namespace mtools
 
 
 
+	namespace internals_memory
+	{
+
+		/**
+		* A growable file used as backing store for memory pools.
+		*
+		* Each call to allocate() extends the file and maps the new region in memory (shared mapping)
+		* so that the operating system may page it out to the file when memory is scarce and reload it
+		* transparently when it is accessed again.
+		*
+		* When maxResident is non-zero, the regions are written back to the file and dropped from
+		* physical memory (oldest regions first) when new regions are created, so that at most
+		* maxResident bytes of the most recent regions remain resident. Each region is retired only
+		* once: older regions are reloaded on demand by page faults and are not dropped again.
+		*
+		* On platforms without memory mapped files, the memory is simply obtained from std::malloc().
+		**/
+		class MappedFileStore
+		{
+
+		public:
+
+			/**
+			* Constructor. Create (or truncate) the backing file.
+			*
+			* @param	filename	Name of the backing file. The file is deleted when the object is destroyed.
+			* @param	maxResident	Maximum number of bytes kept resident (0 = no limit, let the OS decide).
+			**/
+			MappedFileStore(const std::string & filename, size_t maxResident = 0);
+
+
+			/** Destructor. Unmap all the regions and delete the backing file. */
+			~MappedFileStore();
+
+
+			/**
+			* Extend the file and map a new region of (at least) size bytes.
+			* Throws std::bad_alloc on failure.
+			*
+			* @param	size	The size of the region.
+			*
+			* @return	a pointer to the new region (page aligned).
+			**/
+			void * allocate(size_t size);
+
+
+			/** Unmap all the regions and truncate the backing file. */
+			void releaseAll();
+
+
+			/** Write back and drop from physical memory the regions which are not among the most recent
+			*   maxResident bytes and were not dropped yet. Does nothing if maxResident = 0. */
+			void trim();
+
+
+			/** Name of the backing file. */
+			std::string filename() const { return _filename; }
+
+
+		private:
+
+			MappedFileStore(const MappedFileStore &) = delete;
+			MappedFileStore & operator=(const MappedFileStore &) = delete;
+
+			struct _region { void * p; size_t len; size_t off; };
+
+			std::string				_filename;		// name of the backing file
+			int						_fd;			// file descriptor
+			size_t					_filesize;		// current size of the file
+			size_t					_maxResident;	// max number of bytes kept resident
+			std::vector<_region>	_regions;		// mapped regions, in order of creation
+			size_t					_dropped;		// the regions [0, _dropped) were already written back and dropped
+			size_t					_resident;		// total size of the regions not dropped yet
+		};
+
+
+		/**
+		* An arena backed by huge pages used as backing store for memory pools.
+		*
+		* A large range of address space is reserved at construction (without using any memory) and
+		* the regions returned by allocate() are carved contiguously from it. The memory is committed
+		* lazily, one huge page at a time, as the regions are handed out, so consecutive regions share
+		* their pages and the TLB covers the whole pool with few entries. When the reserved range is
+		* exhausted, a new one is reserved.
+		*
+		* Explicit huge pages (MAP_HUGETLB, which require pages reserved by the system administrator)
+		* are tried first. If none are available, the memory is committed with regular pages and
+		* marked for transparent huge pages (MADV_HUGEPAGE).
+		*
+		* releaseAll() returns all the committed memory to the operating system but keeps the first
+		* reserved range.
+		*
+		* On platforms without mmap(), the memory is simply obtained from std::malloc().
+		**/
+		class HugePageStore
+		{
+
+		public:
+
+			/**
+			* Constructor. Reserve the address space.
+			*
+			* @param	pageSize	Size of a huge page (typically 2MB or 1GB). Rounded up to a power of two
+			*						multiple of the system page size.
+			* @param	reserve		Size of the address space reserved at once (rounded up to a multiple of
+			*						pageSize).
+			**/
+			HugePageStore(size_t pageSize = MEM_MB(2), size_t reserve = MEM_GB(((size_t)64)));
+
+
+			/** Destructor. Unmap everything. */
+			~HugePageStore();
+
+
+			/**
+			* Return a new region of size bytes (aligned on 64 bytes). Throws std::bad_alloc on failure.
+			**/
+			void * allocate(size_t size);
+
+
+			/** Return all the committed memory to the operating system. */
+			void releaseAll();
+
+
+			/** Size of a huge page. */
+			size_t pageSize() const { return _pageSize; }
+
+
+			/** Number of bytes currently committed. */
+			size_t committed() const { return _committed; }
+
+
+			/** Return true if the memory is committed with explicit huge pages (MAP_HUGETLB). */
+			bool explicitHugePages() const { return (_hugetlb == 1); }
+
+
+		private:
+
+			HugePageStore(const HugePageStore &) = delete;
+			HugePageStore & operator=(const HugePageStore &) = delete;
+
+			struct _range { char * base; size_t len; size_t used; size_t com; };
+
+			/* reserve a new range of at least len bytes */
+			void _reserve(size_t len);
+
+			/* commit len bytes at p (multiple of the page size) */
+			void _commit(char * p, size_t len);
+
+			size_t					_pageSize;		// size of a huge page
+			size_t					_reserveSize;	// size of a reserved range
+			size_t					_committed;		// total number of bytes committed
+			int						_hugetlb;		// -1 = not tried yet, 0 = unavailable, 1 = in use
+			std::vector<_range>		_ranges;		// reserved ranges (the last one is the current one)
+			std::vector<void*>		_blocks;		// blocks obtained from malloc() (platforms without mmap)
+		};
+
+
+		/** Return a new unique identifier (used to tag the thread caches of the memory pools). */
+		inline uint64 newPoolID()
+			{
+			static std::atomic<uint64> id(0);
+			return ++id;
+			}
+
+	}
+
+
+	/**
+	* A file mapped read-only in memory.
+	*
+	* The content of the file is not copied: the pages are loaded on demand by the operating system
+	* when they are accessed, so opening even a huge file is immediate, only the parts actually read
+	* use physical memory and several threads may read the view concurrently.
+	*
+	* On platforms without memory mapped files, the whole file is read into a buffer obtained
+	* from std::malloc().
+	*
+	* @code
+	* MappedFile F("trajectory.dat");
+	* if (F.isOpen()) { process(F.data(), F.size()); }
+	* @endcode
+	**/
+	class MappedFile
+	{
+
+	public:
+
+		/** Default constructor. No file mapped. */
+		MappedFile();
+
+
+		/**
+		* Constructor. Map the file. If the file cannot be opened, isOpen() returns false.
+		*
+		* @param	filename	Name of the file.
+		**/
+		MappedFile(const std::string & filename);
+
+
+		/** Destructor. Unmap the file. */
+		~MappedFile();
+
+
+		/**
+		* Map a file. The previous file (if any) is unmapped first.
+		*
+		* @param	filename	Name of the file.
+		*
+		* @return	true if it succeeds, false if it fails.
+		**/
+		bool open(const std::string & filename);
+
+
+		/** Unmap the file. */
+		void close();
+
+
+		/** Return true if a file is mapped (an empty file counts as mapped, with data() == nullptr). */
+		bool isOpen() const { return _open; }
+
+
+		/** Pointer to the beginning of the file (nullptr if no file is mapped or if the file is empty). */
+		const char * data() const { return _p; }
+
+
+		/** Size of the file in bytes. */
+		size_t size() const { return _size; }
+
+
+		/** Name of the file. */
+		std::string filename() const { return _filename; }
+
+
+		/** The content of the file as a string (copy). */
+		std::string str() const { return ((_p == nullptr) ? std::string() : std::string(_p, _size)); }
+
+
+	private:
+
+		MappedFile(const MappedFile &) = delete;
+		MappedFile & operator=(const MappedFile &) = delete;
+
+		std::string		_filename;	// name of the file
+		const char *	_p;			// beginning of the mapping
+		size_t			_size;		// size of the file
+		bool			_open;		// true if a file is mapped
+		void *			_handle;	// windows: handle of the file mapping
+	};
+
+
+
 	/**
 	* A simple (but fast) memory pool.
 	*
@@ -70,6 +327,11 @@ namespace mtools
 	*
 	* There is no 'wasted' memory provided that UNITALLOCSIZE > sizeof(T*).
 	*
+	* The pool is not threadsafe by default. Calling setThreadCaching() switches it to a thread
+	* caching mode where malloc() and free() may be called simultaneously by several threads: each
+	* thread keeps its own list of free chunks and exchanges them by batches with a shared depot so
+	* that the lock is only taken once per batch.
+	*
 	* @tparam  UNITALLOCSIZE   Size in byte of each unit chunk of memory to allocate.
 	* @tparam  POOLSIZE        Number of chunks in each pool. When a pool is full, a new one is
 	*                          created (default: each pool uses 50MB).
@@ -80,12 +342,15 @@ namespace mtools
 	public:
 
 		/** Default constructor. */
-		CstSizeMemoryPool() : _m_allocatedobj(0), _m_totmem(0), _m_firstfree(nullptr), _m_currentpool(nullptr), _m_firstpool(nullptr), _m_index(POOLSIZE) { }
+		CstSizeMemoryPool() : _m_allocatedobj(0), _m_totmem(0), _m_firstfree(nullptr), _m_currentpool(nullptr), _m_firstpool(nullptr), _m_index(POOLSIZE), _m_store(nullptr), _m_huge(nullptr), _m_tc(nullptr) { }
 
 
 		/** Move constructor **/
-		CstSizeMemoryPool(CstSizeMemoryPool && csmp) : _m_allocatedobj(csmp._m_allocatedobj), _m_totmem(csmp._m_totmem), _m_firstfree(csmp._m_firstfree), _m_currentpool(csmp._m_currentpool), _m_firstpool(csmp._m_firstpool), _m_index(csmp._m_index)
+		CstSizeMemoryPool(CstSizeMemoryPool && csmp) : _m_allocatedobj(csmp._m_allocatedobj), _m_totmem(csmp._m_totmem), _m_firstfree(csmp._m_firstfree), _m_currentpool(csmp._m_currentpool), _m_firstpool(csmp._m_firstpool), _m_index(csmp._m_index), _m_store(csmp._m_store), _m_huge(csmp._m_huge), _m_tc(csmp._m_tc)
 			{
+			csmp._m_store = nullptr;
+			csmp._m_huge = nullptr;
+			csmp._m_tc = nullptr;
 			csmp._m_allocatedobj = 0;
 			csmp._m_totmem = 0;
 			csmp._m_firstfree = nullptr;
@@ -99,14 +364,26 @@ namespace mtools
 		~CstSizeMemoryPool() 
 			{
 			freeAll(true);
+			delete _m_store;
+			delete _m_huge;
+			_deleteThreadCaches();
 			}
 
 
 		/** Move assignement operator. Discard current content without calling dtors. */
 		CstSizeMemoryPool & operator=(CstSizeMemoryPool && csmp) 			
 			{
-			if (&csmp == this) return;
+			if (&csmp == this) return *this;
 			freeAll(true);	// release memory without calling dtors
+			delete _m_store;
+			delete _m_huge;
+			_deleteThreadCaches();
+			_m_store = csmp._m_store;
+			csmp._m_store = nullptr;
+			_m_huge = csmp._m_huge;
+			csmp._m_huge = nullptr;
+			_m_tc = csmp._m_tc;
+			csmp._m_tc = nullptr;
 			_m_allocatedobj = csmp._m_allocatedobj;
 			_m_totmem = csmp._m_totmem;
 			_m_firstfree = csmp._m_firstfree;
@@ -119,6 +396,7 @@ namespace mtools
 			csmp._m_currentpool = nullptr;
 			csmp._m_firstpool = nullptr;
 			csmp._m_index = POOLSIZE;
+			return *this;
 			}
 
 
@@ -129,17 +407,8 @@ namespace mtools
 		**/
 		inline void * malloc()
 			{
-			++_m_allocatedobj;
-			if (_m_firstfree != nullptr)
-				{
-				_pfakeT p = _m_firstfree;
-				_m_firstfree = _getnextfake(_m_firstfree);
-				return p;
-				}
-			if (_m_index == POOLSIZE) { _nextPool(); }
-			auto r = _m_currentpool->tab + _m_index;
-			_m_index++;
-			return r;
+			if (_m_tc != nullptr) { return _tcMalloc(); }
+			return _rawMalloc();
 			}
 
 
@@ -182,11 +451,8 @@ namespace mtools
 		**/
 		inline void free(void * p)
 			{
-			MTOOLS_ASSERT(_m_firstpool != nullptr);
-			MTOOLS_ASSERT(_m_allocatedobj > 0);
-			--_m_allocatedobj;
-			_getnextfake((_pfakeT)p) = _m_firstfree;
-			_m_firstfree = (_pfakeT)p;
+			if (_m_tc != nullptr) { _tcFree(p); return; }
+			_rawFree(p);
 			}
 
 
@@ -204,12 +470,17 @@ namespace mtools
 
 		/**
 		* Free all allocated memory.
+		* 
+		* In thread caching mode, the lists of all the threads are also emptied: this is safe as long
+		* as no other thread is using the pool during the call (e.g. at the end of an epoch, once all
+		* the worker threads are done).
 		*
 		* @param   releaseMemoryToOS   true to release malloced memory to the operating system (default
 		*                              false).
 		**/
 		inline void freeAll(bool releaseMemoryToOS = false)
 			{
+			if (_m_tc != nullptr) { _clearThreadCaches(); }
 			if (_m_firstpool == nullptr) return;
 			_m_firstfree = nullptr;
 			_m_currentpool = _m_firstpool;
@@ -217,8 +488,11 @@ namespace mtools
 			_m_index = 0;
 			if (releaseMemoryToOS)
 				{
-				while (_m_firstpool != nullptr) { _pool * p = _m_firstpool; _m_firstpool = _m_firstpool->next; std::free(p); }
+				if (_m_store != nullptr) { _m_store->releaseAll(); } 
+				else if (_m_huge != nullptr) { _m_huge->releaseAll(); }
+				else { while (_m_firstpool != nullptr) { _pool * p = _m_firstpool; _m_firstpool = _m_firstpool->next; std::free(p); } }
 				_m_firstpool = nullptr;
+				_m_currentpool = nullptr;
 				_m_index = POOLSIZE;
 				_m_totmem = 0;
 				}
@@ -237,6 +511,7 @@ namespace mtools
 		**/
 		template<typename T> size_t destroyAndFreeAll(bool releaseMemoryToOS = false)
 			{
+			_flushThreadCaches();
 			if (_m_firstpool == nullptr) return 0;
 			// we call the dtor for all the sites with lower bit set since they cannot be free sites (memory adresses are aligned mod 2)
 			_pool * p = _m_firstpool;
@@ -295,6 +570,7 @@ namespace mtools
 		 */
 		template<typename FUNCTION> size_t iterateOver(FUNCTION fun)
 			{
+			_flushThreadCaches();
 			if (_m_firstpool == nullptr) return 0;
 			// we call fun with all object whose lowest bit is set since they cannot represent free site (memory adresses are aligned mod 2)
 			_pool * p = _m_firstpool;
@@ -351,7 +627,17 @@ namespace mtools
 		*
 		* @return  the number of object currently allocated. 
 		**/
-		inline size_t size() const { return _m_allocatedobj; }
+		inline size_t size() const 
+			{ 
+			if (_m_tc != nullptr)
+				{
+				std::lock_guard<std::mutex> lock(_m_tc->mut);
+				int64 n = _m_tc->base;
+				for (auto c : _m_tc->caches) { n += c->nalloc; }
+				return (size_t)n;
+				}
+			return _m_allocatedobj; 
+			}
 
 
 		/**
@@ -359,7 +645,7 @@ namespace mtools
 		*
 		* @return  the number of bytes currently allocated.
 		**/
-		inline size_t used() const { return(UNITALLOCSIZE*_m_allocatedobj); }
+		inline size_t used() const { return(UNITALLOCSIZE*size()); }
 
 
 		/**
@@ -379,13 +665,108 @@ namespace mtools
 		std::string toString() const
 			{
 			std::string s = std::string("CstSizeMemoryPool<") + mtools::toString(UNITALLOCSIZE) + ", " + mtools::toString(POOLSIZE) + ">\n";
-			s += std::string(" - number of chunks : ") + mtools::toString(_m_allocatedobj) + " (in " + mtools::toString(footprint() / sizeof(_pool)) + " pools)\n";
+			s += std::string(" - number of chunks : ") + mtools::toString(size()) + " (in " + mtools::toString(footprint() / sizeof(_pool)) + " pools)\n";
+			if (_m_huge != nullptr) { s += std::string(" - huge pages : ") + toStringMemSize(_m_huge->pageSize()) + (_m_huge->explicitHugePages() ? " (explicit)" : " (transparent)") + "\n"; }
+			if (_m_tc != nullptr) { s += std::string(" - thread caching : batches of ") + mtools::toString(_m_tc->batch) + " chunks, " + mtools::toString(_m_tc->caches.size()) + " threads\n"; }
 			s += std::string(" - memory allocated : ") + toStringMemSize(used()) + "\n";
 			s += std::string(" - memory footprint : ") + toStringMemSize(footprint()) + "\n";
 			return s;
 			}
 
 
+		/**
+		* Use a memory mapped file as backing store for the pools (instead of std::malloc). The
+		* operating system may then page out unused parts of the pool to the file and reload them
+		* transparently when they are accessed. This permits to allocate more memory than is
+		* physically available.
+		*
+		* All the memory currently allocated is first released (without calling dtors).
+		*
+		* @param	filename	Name of the backing file (deleted when the pool is destroyed). Set an
+		*						empty string to go back to regular memory allocation.
+		* @param	maxResident	Maximum number of bytes of the pool kept in physical memory (0 = no
+		*						limit). When a new pool is created, older pools are written back to file
+		*						and dropped from memory. They are reloaded on demand.
+		**/
+		void setBackingFile(const std::string & filename, size_t maxResident = 0)
+			{
+			freeAll(true);
+			delete _m_store;
+			_m_store = nullptr;
+			delete _m_huge;
+			_m_huge = nullptr;
+			if (filename.size() > 0) { _m_store = new internals_memory::MappedFileStore(filename, maxResident); }
+			}
+
+
+		/**
+		* Back the pools with huge pages (instead of std::malloc) to reduce the TLB misses when
+		* accessing chunks scattered over a large pool. The address space is reserved up front and
+		* the memory is committed lazily as the pools are created. Calling freeAll(true) returns the
+		* memory to the operating system. See internals_memory::HugePageStore.
+		*
+		* All the memory currently allocated is first released (without calling dtors). This
+		* replaces the backing file set by setBackingFile(), if any.
+		*
+		* @param	pageSize	Size of the huge pages (e.g. MEM_MB(2) or MEM_GB(1)). Set 0 to go back to
+		*						regular memory allocation.
+		* @param	reserve		Size of the address space reserved at once.
+		**/
+		void setHugePages(size_t pageSize = MEM_MB(2), size_t reserve = MEM_GB(((size_t)64)))
+			{
+			freeAll(true);
+			delete _m_store;
+			_m_store = nullptr;
+			delete _m_huge;
+			_m_huge = nullptr;
+			if (pageSize > 0) { _m_huge = new internals_memory::HugePageStore(pageSize, reserve); }
+			}
+
+
+		/**
+		* Return the size of the huge pages backing the pools (0 if huge pages are not used).
+		**/
+		size_t hugePages() const { return ((_m_huge == nullptr) ? 0 : _m_huge->pageSize()); }
+
+
+		/**
+		* Enable or disable the thread caching mode.
+		* 
+		* In thread caching mode, malloc() and free() may be called simultaneously by several
+		* threads (a chunk may be freed by another thread than the one which allocated it). Each
+		* thread keeps a list of free chunks. When the list is empty, a batch of batchSize chunks is
+		* taken from a shared depot (or carved from the pools) and when a thread holds too many free
+		* chunks, a batch is returned to the depot. The shared lock is only taken once per batch.
+		* 
+		* All other methods (freeAll(), destroyAndFreeAll(), iterateOver()...) must still be called
+		* while no other thread is using the pool. The allocated chunks are kept when switching mode.
+		*
+		* @param	batchSize	Number of chunks exchanged with the depot at once (0 to disable the
+		*						thread caching mode).
+		**/
+		void setThreadCaching(size_t batchSize = 64)
+			{
+			if (_m_tc != nullptr)
+				{
+				_flushThreadCaches();
+				_deleteThreadCaches();
+				}
+			if (batchSize > 0)
+				{
+				_m_tc = new _tcState();
+				_m_tc->batch = batchSize;
+				_m_tc->id = internals_memory::newPoolID();
+				_m_tc->base = (int64)_m_allocatedobj;
+				}
+			}
+
+
+		/**
+		* Return the batch size of the thread caching mode (0 if the mode is disabled).
+		**/
+		size_t threadCaching() const { return ((_m_tc == nullptr) ? 0 : _m_tc->batch); }
+
+
 		/**
 		* Query if a pointer belong to the memory pool.
 		*
@@ -413,12 +794,183 @@ namespace mtools
 	private:
 
 
+		typedef typename std::aligned_storage<((UNITALLOCSIZE > sizeof(int*)) ? UNITALLOCSIZE : sizeof(int*))>::type _fakeT; // placeholder 
+		typedef _fakeT * _pfakeT; // pointer of placeholder
+
+		/* free list of a thread */
+		struct _tcCache
+			{
+			_pfakeT			head;		// first free chunk
+			size_t			count;		// number of free chunks in the list
+			int64			nalloc;		// number of chunks allocated minus number of chunks freed by the thread
+			std::thread::id	owner;		// the thread
+			};
+
+
+		/* shared state of the thread caching mode */
+		struct _tcState
+			{
+			std::mutex								mut;		// protects everything below and the pools
+			size_t									batch;		// size of a batch
+			uint64									id;			// unique id of the pool
+			int64									base;		// number of chunks allocated when the mode was enabled
+			std::vector<_tcCache *>					caches;		// the lists of all the threads
+			std::vector<std::pair<_pfakeT, size_t> >	depot;		// batches of free chunks
+			};
+
+
+		/* Allocate a chunk (not threadsafe) */
+		inline void * _rawMalloc()
+			{
+			++_m_allocatedobj;
+			if (_m_firstfree != nullptr)
+				{
+				_pfakeT p = _m_firstfree;
+				_m_firstfree = _getnextfake(_m_firstfree);
+				return p;
+				}
+			if (_m_index == POOLSIZE) { _nextPool(); }
+			auto r = _m_currentpool->tab + _m_index;
+			_m_index++;
+			return r;
+			}
+
+
+		/* Free a chunk (not threadsafe) */
+		inline void _rawFree(void * p)
+			{
+			MTOOLS_ASSERT(_m_firstpool != nullptr);
+			MTOOLS_ASSERT(_m_allocatedobj > 0);
+			--_m_allocatedobj;
+			_getnextfake((_pfakeT)p) = _m_firstfree;
+			_m_firstfree = (_pfakeT)p;
+			}
+
+
+		/* return the free list of the calling thread (fast path through a small thread local table) */
+		inline _tcCache * _threadCache()
+			{
+			struct _slot { uint64 id; _tcCache * c; };
+			static thread_local _slot slots[4] = { { 0, nullptr },{ 0, nullptr },{ 0, nullptr },{ 0, nullptr } };
+			static thread_local size_t next = 0;
+			const uint64 id = _m_tc->id;
+			for (size_t i = 0; i < 4; i++) { if (slots[i].id == id) return slots[i].c; }
+			_tcCache * c = nullptr;
+				{
+				std::lock_guard<std::mutex> lock(_m_tc->mut);
+				const std::thread::id tid = std::this_thread::get_id();
+				for (auto q : _m_tc->caches) { if (q->owner == tid) { c = q; break; } }
+				if (c == nullptr)
+					{
+					c = new _tcCache{ nullptr, 0, 0, tid };
+					_m_tc->caches.push_back(c);
+					}
+				}
+			slots[next].id = id; slots[next].c = c; next = (next + 1) & 3;
+			return c;
+			}
+
+
+		/* malloc() in thread caching mode */
+		inline void * _tcMalloc()
+			{
+			_tcCache * c = _threadCache();
+			if (c->head == nullptr)
+				{ // get a batch
+				std::lock_guard<std::mutex> lock(_m_tc->mut);
+				if (_m_tc->depot.size() > 0)
+					{
+					c->head = _m_tc->depot.back().first;
+					c->count = _m_tc->depot.back().second;
+					_m_tc->depot.pop_back();
+					}
+				else
+					{
+					for (size_t i = 0; i < _m_tc->batch; i++) { _pfakeT f = (_pfakeT)_rawMalloc(); _getnextfake(f) = c->head; c->head = f; }
+					c->count = _m_tc->batch;
+					}
+				}
+			_pfakeT p = c->head;
+			c->head = _getnextfake(p);
+			c->count--;
+			c->nalloc++;
+			return p;
+			}
+
+
+		/* free() in thread caching mode */
+		inline void _tcFree(void * p)
+			{
+			_tcCache * c = _threadCache();
+			_getnextfake((_pfakeT)p) = c->head;
+			c->head = (_pfakeT)p;
+			c->count++;
+			c->nalloc--;
+			if (c->count >= 2 * _m_tc->batch)
+				{ // return a batch to the depot
+				_pfakeT first = c->head, last = c->head;
+				for (size_t i = 1; i < _m_tc->batch; i++) { last = _getnextfake(last); }
+				c->head = _getnextfake(last);
+				_getnextfake(last) = nullptr;
+				c->count -= _m_tc->batch;
+				std::lock_guard<std::mutex> lock(_m_tc->mut);
+				_m_tc->depot.push_back(std::pair<_pfakeT, size_t>(first, _m_tc->batch));
+				}
+			}
+
+
+		/* return all the chunks held by the threads and the depot to the pool (not threadsafe) */
+		void _flushThreadCaches()
+			{
+			if (_m_tc == nullptr) return;
+			for (auto c : _m_tc->caches)
+				{
+				while (c->head != nullptr) { _pfakeT f = c->head; c->head = _getnextfake(f); _rawFree(f); }
+				c->count = 0;
+				}
+			for (auto & d : _m_tc->depot)
+				{
+				_pfakeT f = d.first;
+				while (f != nullptr) { _pfakeT g = _getnextfake(f); _rawFree(f); f = g; }
+				}
+			_m_tc->depot.clear();
+			}
+
+
+		/* empty all the lists (the memory is released by freeAll()) */
+		void _clearThreadCaches()
+			{
+			for (auto c : _m_tc->caches) { c->head = nullptr; c->count = 0; c->nalloc = 0; }
+			_m_tc->depot.clear();
+			_m_tc->base = 0;
+			}
+
+
+		/* delete the state of the thread caching mode */
+		void _deleteThreadCaches()
+			{
+			if (_m_tc == nullptr) return;
+			for (auto c : _m_tc->caches) { delete c; }
+			delete _m_tc;
+			_m_tc = nullptr;
+			}
+
+
+		/* allocate the memory for a new pool */
+		void * _newPool()
+			{
+			if (_m_store != nullptr) { return _m_store->allocate(sizeof(_pool)); }
+			if (_m_huge != nullptr) { return _m_huge->allocate(sizeof(_pool)); }
+			return std::malloc(sizeof(_pool));
+			}
+
+
 		/** get/create the next memory pool */
 		void _nextPool()
 			{
 			if (_m_currentpool == nullptr)
 				{
-				_m_currentpool = (_pool*)std::malloc(sizeof(_pool));
+				_m_currentpool = (_pool*)_newPool();
 				if (_m_currentpool == nullptr) { MTOOLS_DEBUG("SingleObjectAllocator, bad_alloc"); throw std::bad_alloc(); }
 				MTOOLS_ASSERT(((size_t)_m_currentpool) % 2 == 0); // alignement is at least mod 2
 				_m_totmem += sizeof(_pool);
@@ -429,7 +981,7 @@ namespace mtools
 				{
 				if (_m_currentpool->next == nullptr)
 					{
-					_m_currentpool->next = (_pool*)std::malloc(sizeof(_pool));
+					_m_currentpool->next = (_pool*)_newPool();
 					if (_m_currentpool == nullptr) { MTOOLS_DEBUG("SingleObjectAllocator, bad_alloc"); throw std::bad_alloc(); }
 					MTOOLS_ASSERT(((size_t)_m_currentpool->next) % 2 == 0); // alignement is at least mod 2
 					_m_totmem += sizeof(_pool);
@@ -445,8 +997,6 @@ namespace mtools
 		CstSizeMemoryPool & operator=(const CstSizeMemoryPool &) = delete;      //
 
 
-		typedef typename std::aligned_storage<((UNITALLOCSIZE > sizeof(int*)) ? UNITALLOCSIZE : sizeof(int*))>::type _fakeT; // placeholder 
-		typedef _fakeT * _pfakeT; // pointer of placeholder
 
 		struct _pool // memory pool
 			{
@@ -462,6 +1012,10 @@ namespace mtools
 		_pool *     _m_firstpool;       // pointer to the first tpool
 		size_t      _m_index;           // index of the first free element in the current pool
 
+		internals_memory::MappedFileStore * _m_store;	// backing file store (nullptr when using std::malloc)
+		internals_memory::HugePageStore * _m_huge;		// huge page store (nullptr when using std::malloc)
+		_tcState *  _m_tc;              // state of the thread caching mode (nullptr when disabled)
+
 		_pfakeT & _getnextfake(_pfakeT f) { return (*((_pfakeT *)f)); } // get the fake T written a the adress of the fake T !
 
 		size_t & _getnextfakevalue(_pfakeT f) { return(*((size_t *)f)); } // get the fake T written a the adress of the fake T casted as a size_t !
@@ -701,6 +1255,12 @@ namespace mtools
 		inline size_t used() const { return (_memPool->used()); }
 
 
+		/**
+		 * Return the number of objects currently allocated.
+		 **/
+		inline size_t size() const { return (_memPool->size()); }
+
+
 		/**
 		* Return the total memory size malloced by the memory pool. This quantity never decrease
 		* since memory is not release until destruction of the allocator.
@@ -726,6 +1286,50 @@ namespace mtools
 
 
 
+		/**
+		* Use a memory mapped file as backing store for the memory pool of the allocator. All the
+		* memory currently allocated is released (without calling dtors). This affects all the
+		* allocators sharing the same memory pool. See CstSizeMemoryPool::setBackingFile().
+		*
+		* @param	filename	Name of the backing file (empty to go back to regular allocation).
+		* @param	maxResident	Maximum number of bytes kept in physical memory (0 = no limit).
+		**/
+		void setBackingFile(const std::string & filename, size_t maxResident = 0)
+		{
+			if (_count == nullptr) return; // empty object, do nothing
+			_memPool->setBackingFile(filename, maxResident);
+		}
+
+
+		/**
+		* Back the memory pool of the allocator with huge pages. All the memory currently allocated is
+		* released (without calling dtors). This affects all the allocators sharing the same memory
+		* pool. See CstSizeMemoryPool::setHugePages().
+		*
+		* @param	pageSize	Size of the huge pages (0 to go back to regular allocation).
+		* @param	reserve		Size of the address space reserved at once.
+		**/
+		void setHugePages(size_t pageSize = MEM_MB(2), size_t reserve = MEM_GB(((size_t)64)))
+		{
+			if (_count == nullptr) return; // empty object, do nothing
+			_memPool->setHugePages(pageSize, reserve);
+		}
+
+
+		/**
+		* Enable or disable the thread caching mode of the memory pool of the allocator so that
+		* allocate() and deallocate() may be called simultaneously by several threads. This affects
+		* all the allocators sharing the same memory pool. See CstSizeMemoryPool::setThreadCaching().
+		*
+		* @param	batchSize	Number of chunks exchanged with the shared depot at once (0 to disable).
+		**/
+		void setThreadCaching(size_t batchSize = 64)
+		{
+			if (_count == nullptr) return; // empty object, do nothing
+			_memPool->setThreadCaching(batchSize);
+		}
+
+
 		/**
 		* Query if a pointer belong to the memory pool of the allocator.
 		*
@@ -0,0 +1,159 @@
+/** @file profiler.hpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "../mtools_config.hpp"
+#include "internal/mtools_export.hpp"
+
+#include <string>
+#include <chrono>
+#include <atomic>
+#include <cstdint>
+
+
+/**
+ * Lightweight instrumentation of hot paths.
+ *
+ * - MTOOLS_PROF_SCOPE("name") times the enclosing scope (a zone).
+ * - MTOOLS_PROF_COUNT("name", n) adds n to a counter.
+ *
+ * The name must be a string literal (it is stored as a pointer). Each thread records its zones in
+ * its own ring buffer (the last profiler::RING_SIZE zones are kept) and aggregates the number of
+ * calls and the total time of each zone and the value of each counter, so there is no contention
+ * between threads.
+ *
+ * The macros expand to nothing unless the library is configured with the cmake option USE_PROFILING
+ * (which sets MTOOLS_USE_PROFILING in mtools_config.hpp). When compiled in, recording can still be
+ * switched off at runtime with profiler::enable(false).
+ *
+ * @code
+ * void step() { MTOOLS_PROF_SCOPE("simulation::step"); ... }
+ * ...
+ * mtools::cout << mtools::profiler::summary();
+ * mtools::profiler::saveChromeTrace("trace.json"); // open with chrome://tracing or ui.perfetto.dev
+ * @endcode
+ **/
+#if (MTOOLS_USE_PROFILING)
+	#define MTOOLS_PROF_CAT2(a, b) a ## b
+	#define MTOOLS_PROF_CAT(a, b) MTOOLS_PROF_CAT2(a, b)
+	#define MTOOLS_PROF_SCOPE(name) mtools::internals_profiler::Scope MTOOLS_PROF_CAT(_mtools_prof_scope_, __LINE__)(name)
+	#define MTOOLS_PROF_COUNT(name, n) mtools::internals_profiler::count(name, (int64_t)(n))
+#else
+	#define MTOOLS_PROF_SCOPE(name) do {} while(0)
+	#define MTOOLS_PROF_COUNT(name, n) do {} while(0)
+#endif
+
+
+namespace mtools
+{
+
+	class LogFile;
+
+
+	namespace profiler
+		{
+
+		/** Number of zones kept in the ring buffer of each thread. */
+		static const size_t RING_SIZE = 65536;
+
+
+		/**
+		 * Enable or disable the recording at runtime (enabled by default). Has no effect when profiling is
+		 * compiled out.
+		 **/
+		void enable(bool status);
+
+
+		/** Query if the recording is enabled. Always false when profiling is compiled out. */
+		bool enabled();
+
+
+		/**
+		 * Clear the ring buffers, zone statistics and counters of all the threads. Should be called while
+		 * the instrumented code is not running.
+		 **/
+		void reset();
+
+
+		/**
+		 * Table with, for each zone, the number of calls, the total and mean duration and, for each
+		 * counter, its value. Threads are listed separately and summed in the 'all' lines.
+		 **/
+		std::string summary();
+
+
+		/** Write summary() in a log file. */
+		void dump(LogFile & log);
+
+
+		/**
+		 * Save the zones of the ring buffers in the Chrome trace event format (JSON). The counters are
+		 * saved as counter events at the end of the trace.
+		 *
+		 * @return  true if the file was written.
+		 **/
+		bool saveChromeTrace(const std::string & filename);
+
+		}
+
+
+	namespace internals_profiler
+		{
+
+		extern std::atomic<bool> active;	// recording enabled
+
+
+		/* time in nanoseconds */
+		inline uint64_t now() { return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count(); }
+
+
+		/* record a zone for the calling thread */
+		void zone(const char * name, uint64_t start, uint64_t stop);
+
+
+		/* add to a counter of the calling thread */
+		void count(const char * name, int64_t n);
+
+
+		/* RAII zone */
+		class Scope
+			{
+			public:
+
+				inline Scope(const char * name) : _name(name), _start(active.load(std::memory_order_relaxed) ? now() : 0) {}
+
+				inline ~Scope() { if (_start != 0) zone(_name, _start, now()); }
+
+			private:
+
+				Scope(const Scope &) = delete;
+				Scope & operator=(const Scope &) = delete;
+
+				const char * _name;
+				uint64_t _start;
+			};
+
+		}
+
+}
+
+
+/* end of file */
+
@@ -32,6 +32,13 @@ namespace mtools
      * Enum for diferent character encodings.
      **/
     enum StringEncoding { enc_utf8, enc_iso8859, enc_unknown };
+
+
+    /**
+     * Size of a buffer large enough for the buffer version of toString() with any arithmetic type
+     * (including the terminating 0).
+     **/
+    static const size_t TOSTRING_BUFSIZE = 32;
 }
 
 #include "internal/internals_stringfct.hpp"
@@ -758,7 +765,10 @@ namespace mtools
         if (nb < 1024*1024) { unit = "TB"; } else { nb /= 1024;
         if (nb < 1024*1024) { unit = "PB"; } else { nb /= 1024; }}}}}}
         res = ((nb % 1024) * 100) / 1024;
-        return toString(nb / 1024) + ((res == 0) ? std::string("") : (std::string(".") + toString(res))) + unit;
+        char buf[2*TOSTRING_BUFSIZE + 8];
+        size_t l = internals_stringfct::toChars(nb / 1024, buf);
+        if (res != 0) { buf[l++] = '.'; l += internals_stringfct::toChars(res, buf + l); }
+        return std::string(buf, l) + unit;
         }
 
 
@@ -799,6 +809,25 @@ namespace mtools
     template<typename T> inline std::string toString(const T & val, StringEncoding output_enc) { return internals_stringfct::StringConverter<T>::print(val, output_enc); }
 
 
+    /**
+     * Convert an arithmetic value into a string written in a buffer provided by the caller. No memory
+     * allocation and no stream: this is the fast path used by toString() for arithmetic types, which
+     * produces the same output (integers in decimal, floating point values with "%g", bool as
+     * "true"/"false", char as a character).
+     *
+     * @code
+     * char buf[TOSTRING_BUFSIZE];
+     * size_t len = toString(x, buf);
+     * @endcode
+     *
+     * @param   val         The value to print.
+     * @param [out] buf     The buffer, of size at least TOSTRING_BUFSIZE. The result is null terminated.
+     *
+     * @return  The length of the string (without the terminating 0).
+     **/
+    template<typename T> inline typename std::enable_if<internals_stringfct::isBufferPrintable<T>::value, size_t>::type toString(const T & val, char * buf) { return internals_stringfct::toChars(val, buf); }
+
+
     /**
      * Convert an object into a wstring. See `toString() for details`
      *
@@ -962,11 +991,25 @@ namespace mtools
      **/
     template<class T> inline size_t fromString(const std::string & s, T & val)
         {
-        std::istringstream iss(s + " ");
-        iss >> val;
-        std::streampos r = iss.tellg();
-        if (r < 0) return 0;
-        return(static_cast<size_t>(r));
+        return internals_stringfct::fromStringImpl(s.c_str(), s.length(), val, metaprog::dummy<internals_stringfct::isBufferParsable<T>::value>());
+        }
+
+
+    /**
+     * Conversion of a buffer into an arithmetic type (integer or floating point, but not bool or a
+     * character type). No memory allocation: the number is parsed in place with the same rules as
+     * an istream (leading spaces are skipped, the conversion fails if the value does not fit in T).
+     * This is the path used by fromString(const std::string &, T &) for these types.
+     *
+     * @param   s       The buffer to read (need not be null terminated).
+     * @param   len     The length of the buffer.
+     * @param [out] val The variable to store the converted value (unchanged if the conversion fails).
+     *
+     * @return  the number of chars read in the buffer during the conversion (0 if it fails).
+     **/
+    template<class T> inline typename std::enable_if<internals_stringfct::isBufferParsable<T>::value, size_t>::type fromString(const char * s, size_t len, T & val)
+        {
+        return internals_stringfct::parseNumber(s, len, val, metaprog::dummy<std::is_floating_point<T>::value>());
         }
 
 
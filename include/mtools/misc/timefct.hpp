@@ -24,6 +24,7 @@
 
 #include <chrono>
 #include <string>
+#include <atomic>
 
 namespace mtools
 {
@@ -32,8 +33,7 @@ namespace mtools
     namespace internals_timefct
         {
             class ProgressWidget;
-            ProgressWidget * makeProgressWidget(bool, const std::string &);
-            void setProgressWidgetValue(ProgressWidget *, double);
+            ProgressWidget * makeProgressWidget(bool, const std::string &, const std::atomic<int64> *, int64, int64);
             void deleteProgressWidget(ProgressWidget *);
             void hideProgressWidget(ProgressWidget *);
             void showProgressWidget(ProgressWidget *);
@@ -123,6 +123,11 @@ namespace mtools
 
     /**
      * Class creating a windows that shows a progress bar with an indication of the remaining time.
+     * The window is not created in headless mode (see isHeadless()) and the object does nothing.
+     *
+     * The counter is an atomic polled by the window 20 times per second so update() and step() only
+     * cost a relaxed atomic store (resp. a relaxed fetch_add) and may be called in a hot loop and
+     * from several threads.
      *
      * @tparam  T   (scalar) type of the progress counter.
      **/
@@ -141,7 +146,7 @@ namespace mtools
              **/
             ProgressBar(T minval, T maxval, const std::string & name = "Progress",  bool showRemainingTime = true) : _minval(minval), _maxval(maxval), _val(minval)
                 {
-                _PW = internals_timefct::makeProgressWidget(showRemainingTime,name);
+                _PW = internals_timefct::makeProgressWidget(showRemainingTime, name, &_val, _minval, _maxval);
                 }
 
 
@@ -156,7 +161,7 @@ namespace mtools
              **/
             ProgressBar(T maxval, const std::string & name = "Progress", bool showRemainingTime = true) : _minval(0), _maxval(maxval), _val(0)
                 {
-                _PW = internals_timefct::makeProgressWidget(showRemainingTime, name);
+                _PW = internals_timefct::makeProgressWidget(showRemainingTime, name, &_val, _minval, _maxval);
                 }
 
 
@@ -175,7 +180,7 @@ namespace mtools
              *
              * @param   val The new value.
              **/
-            inline void update(T val) { if (((T)_val) != val) { _val = val; internals_timefct::setProgressWidgetValue(_PW, _rescale(val)); } }
+            inline void update(T val) { _val.store((int64)val, std::memory_order_relaxed); }
 
 
             /**
@@ -183,7 +188,7 @@ namespace mtools
              *
              * @param   st  The step to add.
              **/
-            inline void step(T st)  { if (st != 0) { _val += st; internals_timefct::setProgressWidgetValue(_PW, _rescale(_val)); } }
+            inline void step(T st)  { _val.fetch_add((int64)st, std::memory_order_relaxed); }
 
 
             /**
@@ -193,15 +198,13 @@ namespace mtools
 
         private:
 
-            inline double _rescale(T v) { return(((double)(v - _minval)) / ((double)(_maxval - _minval))); }
-
             ProgressBar(const ProgressBar &) = delete;              // no copy
             ProgressBar & operator=(const ProgressBar &) = delete;  // 
 
             internals_timefct::ProgressWidget * _PW;
             int64 _minval;
             int64 _maxval;
-            int64 _val;
+            std::atomic<int64> _val;    // polled by the widget
 
         };
 
@@ -30,6 +30,9 @@
 #include "io/serialization.hpp"
 #include "io/commandarg.hpp"
 #include "io/watch.hpp"
+#include "io/metrics.hpp"
+#include "io/checkpoint.hpp"
+#include "io/campaign.hpp"
 #include "io/serialport.hpp"
 
 
@@ -37,6 +40,7 @@
 #include "maths/rootSolver.hpp"
 #include "maths/vec.hpp"
 #include "maths/box.hpp"
+#include "maths/vecarray.hpp"
 #include "maths/sqrmatrix.hpp"
 #include "maths/circle.hpp"
 #include "maths/mobius.hpp"
@@ -46,6 +50,7 @@
 #include "maths/combinatorialmap.hpp"
 #include "maths/combinatorialmap_random_triangulation.hpp"
 #include "maths/graph.hpp"
+#include "maths/graphAlgorithms.hpp"
 #include "maths/circlePacking.hpp"
 
 
@@ -58,6 +63,7 @@
 #include "misc/metaprog.hpp"
 #include "misc/misc.hpp"
 #include "misc/timefct.hpp"
+#include "misc/profiler.hpp"
 
 
 // random
@@ -65,8 +71,15 @@
 #include "random/gen_mt2004_64.hpp"
 #include "random/gen_xorgen4096_64.hpp"
 #include "random/gen_fastRNG.hpp"
+#include "random/gen_philox4x32.hpp"
+#include "random/gen_buffered.hpp"
 #include "random/classiclaws.hpp"
 #include "random/SRW.hpp"
+#include "random/walkOnSpheres.hpp"
+#include "random/aggregation.hpp"
+#include "random/hammersleySweep.hpp"
+#include "random/reinforcedWalk.hpp"
+#include "random/parallelEden.hpp"
 #include "random/peelinglaw.hpp"
 #include "random/krikunlaw.hpp"
 
@@ -77,6 +90,9 @@
 
 // graphics
 #include "graphics/image.hpp"
+#include "graphics/imagesequencewriter.hpp"
+#include "graphics/imagestreamwriter.hpp"
+#include "graphics/escapetime.hpp"
 #include "graphics/font.hpp"
 #include "graphics/progressimg.hpp"
 #include "graphics/simpleBMP.hpp"
@@ -85,30 +101,46 @@
 #include "graphics/planedrawer.hpp"
 #include "graphics/pixeldrawer.hpp"
 #include "graphics/sitedrawer.hpp"
+#include "graphics/deepzoomexporter.hpp"
 #include "graphics/latticedrawer.hpp" // deprecated.
 #include "graphics/rgbc.hpp"
+#include "graphics/palette.hpp"
 #include "graphics/plotter2D.hpp"
+#include "graphics/offscreenplotter2D.hpp"
 #include "graphics/plot2Daxes.hpp"
 #include "graphics/plot2Dgrid.hpp"
 #include "graphics/plot2Dfun.hpp"
 #include "graphics/plot2Darray.hpp"
 #include "graphics/plot2Dvector.hpp"
+#include "graphics/plot2Dextab.hpp"
 #include "graphics/plot2Dmap.hpp"
 #include "graphics/plot2Dplane.hpp"
+#include "graphics/planedrawerCL.hpp" // only if openCL is enabled.
 #include "graphics/plot2Dpixel.hpp"
 #include "graphics/plot2Dlattice.hpp"
+#include "graphics/gridview3D.hpp"
 #include "graphics/plot2Dimage.hpp"
+#include "graphics/pointsplatter.hpp"
+#include "graphics/plot2Dpoints.hpp"
 #include "graphics/plot2Dcimg.hpp"
 #include "graphics/plot2Dbasic.hpp"
 #include "graphics/figure.hpp"
 #include "graphics/plot2Dfigure.hpp"
+#include "graphics/figurevectorexport.hpp"
 
 
 // containers
 #include "containers/grid_basic.hpp"
 #include "containers/grid_factor.hpp"
+#include "containers/grid_packed.hpp"
+#include "containers/grid_distributed.hpp"
+#include "containers/collectivemerge.hpp"
+#include "containers/particlegrid2D.hpp"
 #include "containers/bitgraphZ2.hpp"
 #include "containers/randomurn.hpp"
+#include "containers/minmaxpyramid.hpp"
+#include "containers/disjointSets.hpp"
+#include "containers/weightedurn.hpp"
 #include "containers/RWtreegraph.hpp"
 #include "containers/empiricalDistribution.hpp"
 #include "containers/extab.hpp"
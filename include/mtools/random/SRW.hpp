@@ -23,10 +23,17 @@
 #include "../misc/misc.hpp"
 #include "../maths/vec.hpp"
 #include "../maths/box.hpp"
+#include "../containers/weightedurn.hpp"
 #include "internal/SRW_exitGridZ2_data.hpp"
 #include "classiclaws.hpp"
 
 #include <algorithm>
+#include <vector>
+#include <map>
+#include <iterator>
+#include <limits>
+#include <cmath>
+#include <mutex>
 
 namespace mtools
     {
@@ -45,48 +52,198 @@ namespace mtools
             }
 
 
+        namespace internals_random
+            {
+
+            /* log(n!) - log(sqrt(2 pi n) (n/e)^n) (Stirling's formula error term) */
+            inline double _stirlerr(double n)
+                {
+                if (n <= 15.0) return gammln(n + 1.0) - (n + 0.5)*log(n) + n - 0.918938533204672742;
+                const double nn = n*n;
+                return (0.083333333333333333333 - (0.00277777777777777777778 - (0.00079365079365079365079 - 0.000595238095238095238095 / nn) / nn) / nn) / n;
+                }
+
+            /* x log(x/np) + np - x computed without cancellation (Loader 2000) */
+            inline double _bd0(double x, double np)
+                {
+                if (fabs(x - np) < 0.1*(x + np))
+                    {
+                    const double v = (x - np) / (x + np);
+                    double s = (x - np)*v, ej = 2 * x*v;
+                    for (int j = 1; j < 1000; j++)
+                        {
+                        ej *= v*v;
+                        const double s1 = s + ej / (2 * j + 1);
+                        if (s1 == s) return s1;
+                        s = s1;
+                        }
+                    return s;
+                    }
+                return x*log(x / np) + np - x;
+                }
+
+            /**
+             * Logarithm of P(Bin(n,1/2) = k), accurate even for huge n (saddle point expansion of Loader
+             * (2000) instead of a difference of log-factorials).
+             **/
+            inline double logBinomialHalf(int64 n, int64 k)
+                {
+                MTOOLS_ASSERT((k >= 0) && (k <= n));
+                if ((k == 0) || (k == n)) return n*log(0.5);
+                const double dn = (double)n, dk = (double)k, dl = (double)(n - k);
+                return _stirlerr(dn) - _stirlerr(dk) - _stirlerr(dl) - _bd0(dk, dn / 2) - _bd0(dl, dn / 2) + 0.5*log(dn / (TWOPI*dk*dl));
+                }
+
+            }
+
+
         /**
-         * Make a given number of step for the simple random walk in Z 
+         * Make a given number of step for the simple random walk in Z. 
+         * 
+         * The endpoint is sampled directly (exactly) so the cost does not depend on n: the walk is
+         * coded from the bits of uniform integers for n <= 320 and a ratio of uniforms rejection
+         * method is used otherwise. Intermediate positions can be sampled afterwards with
+         * SRW_Z_bridge() (or use SRW_Z_Lazy).
          *
          * @param   n   number of step to make
          * @param   gen random generator
          *
          * @return  A rv distributed as 2 * Bin(n,1/2) - n.
          **/
-        template<class random_t> inline int SRW_Z(int n, random_t & gen)
+        template<class random_t> inline int64 SRW_Z(int64 n, random_t & gen)
             { 
-            MTOOLS_ASSERT(n > 0);
+            MTOOLS_ASSERT(n >= 0);
+            if (n <= 0) return 0;
             if (n <= 320)
                 { // code the walk from the bits of an uniform uint64.
-                int k = 0;
+                int64 k = 0;
                 do
                     {
-                    int m = ((n >= 64) ? 64 : n); n -= 64; k -= m;
+                    int64 m = ((n >= 64) ? 64 : n); n -= 64; k -= m;
                     uint64 u = Unif_64(gen);
-                    for (int j = 0; j < m; j++) { k += 2 * (u & 1); u >>= 1; }
+                    for (int64 j = 0; j < m; j++) { k += 2 * (u & 1); u >>= 1; }
                     }
                 while (n > 0);
                 return k;
                 }
-           static const double plog = log(0.5); 
-           int k;
+           const double sn = sqrt(n*0.25);
+           int64 k;
            for (;;)
                 {
                 double u = 0.645*Unif(gen);
                 double v = -0.63 + 1.25*Unif(gen);
                 double v2 = v*v;
                 if (v >= 0.) { if (v2 > 6.5*u*(0.645 - u)*(u + 0.2)) continue; } else { if (v2 > 8.4*u*(0.645 - u)*(u + 0.1)) continue; }
-                k = int(floor(sqrt(n*0.25)*(v / u) + n*0.5 + 0.5));
-                if ((k < 0) || (k > n)) continue;
+                const double fk = floor(sn*(v / u) + n*0.5 + 0.5);
+                if ((fk < 0) || (fk > (double)n)) continue;
+                k = (int64)fk;
                 double u2 = u*u;
                 if (v >= 0.) { if (v2 < 12.25*u2*(0.615 - u)*(0.92 - u)) break; } else { if (v2 < 7.84*u2*(0.615 - u)*(1.2 - u)) break; }
-                double b = sqrt(n*0.25)*exp( gammln(n + 1.) + n*plog - (gammln(k + 1.) + gammln(n - k + 1.)) );
+                double b = sn*exp(internals_random::logBinomialHalf(n, k));
                 if (u2 < b) break;
                 }
             return (2*k - n);
             }
 
 
+        /**
+         * Sample the position of a SRW bridge: given that the walk on Z moves by d in n steps, return
+         * its displacement after the first m steps. The law is exact: the number of up steps among the
+         * first m is hypergeometric (drawing m steps without replacement among the (n+d)/2 up steps
+         * and (n-d)/2 down steps), sampled in a time independent of n.
+         *
+         * @param   n           total number of steps.
+         * @param   d           displacement after n steps (|d| <= n and n+d even).
+         * @param   m           number of steps (0 <= m <= n).
+         * @param [in,out]  gen random generator.
+         *
+         * @return  The displacement after m steps.
+         **/
+        template<class random_t> inline int64 SRW_Z_bridge(int64 n, int64 d, int64 m, random_t & gen)
+            {
+            MTOOLS_ASSERT((n >= 0) && (m >= 0) && (m <= n) && (d <= n) && (-d <= n) && (((n + d) & 1) == 0));
+            if (m == 0) return 0;
+            if (m == n) return d;
+            const int64 up = (n + d) / 2;
+            if ((up == 0) || (up == n)) return (up == 0) ? -m : m;
+            HypergeometricLaw H(up, n - up, m);
+            return 2 * H(gen) - m;
+            }
+
+
+        /**
+         * Simple random walk on Z sampled lazily. The walk starts at 0 and position(t) returns its
+         * position at time t. Each new query is sampled conditionally on the positions already known
+         * (exact binomial jump after the last known time, exact bridge between two known times) so
+         * the walk is consistent and has the law of the SRW whatever the order of the queries, and
+         * the cost of a query does not depend on the time scale.
+         *
+         * This makes it possible to plot a walk with 10^12 steps: the values queried while drawing
+         * are only those needed at the current zoom level and the walk is refined where the user
+         * zooms in.
+         *
+         * @code{.cpp}
+         * MT2004_64 gen;
+         * SRW_Z_Lazy<MT2004_64> walk(gen);
+         * auto P = makePlot2DFun(walk, 0.0, 1.0e12, "walk");
+         * @endcode
+         **/
+        template<class random_t> class SRW_Z_Lazy
+            {
+
+            public:
+
+                /**
+                 * Constructor.
+                 *
+                 * @param [in,out]  gen The random generator (must outlive the object).
+                 **/
+                SRW_Z_Lazy(random_t & gen) : _gen(gen) { _pos[0] = 0; }
+
+
+                /**
+                 * Position of the walk at time t (t >= 0).
+                 **/
+                int64 position(int64 t)
+                    {
+                    MTOOLS_ASSERT(t >= 0);
+                    auto it = _pos.lower_bound(t);
+                    if ((it != _pos.end()) && (it->first == t)) return it->second;
+                    auto prev = std::prev(it);
+                    int64 x;
+                    if (it == _pos.end()) { x = prev->second + SRW_Z(t - prev->first, _gen); }
+                    else { x = prev->second + SRW_Z_bridge(it->first - prev->first, it->second - prev->second, t - prev->first, _gen); }
+                    _pos.emplace_hint(it, t, x);
+                    return x;
+                    }
+
+
+                /**
+                 * Position of the walk at time floor(t) (for plotting). Return NaN if t < 0.
+                 **/
+                double operator()(double t)
+                    {
+                    if (!(t >= 0.0) || (t >= 9.0e18)) return std::numeric_limits<double>::quiet_NaN();
+                    return (double)position((int64)t);
+                    }
+
+
+                /**
+                 * Number of times at which the position of the walk is known.
+                 **/
+                size_t size() const { return _pos.size(); }
+
+
+            private:
+
+                random_t & _gen;
+                std::map<int64, int64> _pos;   // known positions
+
+                SRW_Z_Lazy(const SRW_Z_Lazy &) = delete;
+                SRW_Z_Lazy & operator=(const SRW_Z_Lazy &) = delete;
+            };
+
+
         /**
          * Make a single step for the SRW on Z^2.
          *
@@ -124,42 +281,56 @@ namespace mtools
             }
 
 
-        /**
-         * Move the SRW while staying inside the rectangle R. Contrarily to SRW_ExitRect(), the position
-         * pos when the method returns need not be on the boundary of R. However, When the method
-         * returns, the distance to the (inner) boundary of the rectangle has been divided by at least
-         * the parameter 'ratio' compared to the initial distance from the boundary.
-         *
-         * @param [in,out]  pos The position of the walk.
-         * @param   R           The rectangle.
-         * @param   ratio       The ratio by which the distance to the (inner) boundary has to decrease
-         *                      before we stop (set to <=0 for infinite ratio = stop at the
-         *                      boundary). 8 is a good choice usually.
-         * @param [in,out]  gen The random number generator.
-         *
-         * @return  The new distance to the inner boundary.
-         **/
-        template<class random_t> int64 SRW_Z2_MoveInRect(iVec2 & pos, iBox2 R, uint64 ratio, random_t & gen)
+        namespace internals_random
             {
-            MTOOLS_ASSERT((!R.isEmpty()) && (R.isInside(pos)));
-            int64 min_d = ((ratio <= 0) ? 0 : R.boundaryDist(pos)/ratio);
-            int64 d;
-            while((d = R.boundaryDist(pos)) >  min_d)
-                { // keep looping while we are striclty inside the rectangle.
+
+            /* alias tables for the exit distributions _srwExitGridSmallR[d] (3 <= d < 128) and _srwExitGridLargeR[b] (1 <= b < 9) */
+            struct SRWExitAliasTables
+                {
+                SRWExitAliasTables()
+                    {
+                    for (int d = 3; d < 128; d++) { _set(smallR[d], _srwExitGridSmallR[d], d); }
+                    for (int b = 1; b < 9; b++) { _set(largeR[b], _srwExitGridLargeR[b], 128 * b); }
+                    }
+
+                static void _set(AliasTable & A, const double * cdf, int n)
+                    {
+                    std::vector<double> w(n);
+                    w[0] = cdf[0];
+                    for (int i = 1; i < n; i++) { w[i] = std::max<double>(0.0, cdf[i] - cdf[i - 1]); }
+                    A.set(w);
+                    }
+
+                AliasTable smallR[128];
+                AliasTable largeR[9];
+                };
+
+
+            /* the alias tables (constructed on first use) */
+            inline const SRWExitAliasTables & srwExitAliasTables() { static const SRWExitAliasTables T; return T; }
+
+
+            /**
+             * Perform one jump of SRW_Z2_MoveInRect() for a walk at distance d > 0 from the inner
+             * boundary, using the 64 random bits u: the lowest bits select the direction and the
+             * highest 53 bits the offset (through the alias tables).
+             **/
+            inline void srwZ2Jump(iVec2 & pos, int64 d, uint64 u, const SRWExitAliasTables & T)
+                {
                 if (d == 1)
                     { // make one step
-                    switch (Unif_2(gen))
+                    switch (u & 3)
                         {
                         case  0: pos.X()++; break;
                         case  1: pos.X()--; break;
                         case  2: pos.Y()++; break;
                         case  3: pos.Y()--; break;
                         }
-                    continue;
+                    return;
                     }
                 if (d == 2)
                     { //  square of radius 2
-                    switch(Unif_4(gen))
+                    switch (u & 15)
                         {
                         case  0: 
                         case  1: pos.X() += 2; break;
@@ -178,52 +349,115 @@ namespace mtools
                         case 14: pos.Y() -= 2; pos.X()++; break;
                         case 15: pos.Y() -= 2; pos.X()--; break;
                         }
-                    continue;
+                    return;
                     }
-                if (d < 128)
-                    { // 2 < d < 128 : we use the exact CDF from the small grid array
-                    int64 off = sampleDiscreteRVfromCDF(internals_random::_srwExitGridSmallR[d], (size_t)(d-1), gen);
-                    switch (Unif_3(gen))
-                        {
-                        case  0: pos.X() += d; pos.Y() += off; break;
-                        case  1: pos.X() += d; pos.Y() -= off; break;
-                        case  2: pos.X() -= d; pos.Y() += off; break;
-                        case  3: pos.X() -= d; pos.Y() -= off; break;
-                        case  4: pos.Y() += d; pos.X() += off; break;
-                        case  5: pos.Y() += d; pos.X() -= off; break;
-                        case  6: pos.Y() -= d; pos.X() += off; break;
-                        case  7: pos.Y() -= d; pos.X() -= off; break;
-                        }
-                    continue;
-                    }
-                if (d < 1152)
-                    { // 128 <= d < 1152 : use the neareset 128 multiple and exact CDF from the large grid array
-                    int64 b = (d >> 7);  // divide by 128
-                    int64 l = (b << 7); // get the nearest lower multiple of 128
-                    int64 off = sampleDiscreteRVfromCDF(internals_random::_srwExitGridLargeR[b], (size_t)(l-1), gen);
-                    switch (Unif_3(gen))
-                        {
-                        case  0: pos.X() += l; pos.Y() += off; break;
-                        case  1: pos.X() += l; pos.Y() -= off; break;
-                        case  2: pos.X() -= l; pos.Y() += off; break;
-                        case  3: pos.X() -= l; pos.Y() -= off; break;
-                        case  4: pos.Y() += l; pos.X() += off; break;
-                        case  5: pos.Y() += l; pos.X() -= off; break;
-                        case  6: pos.Y() -= l; pos.X() += off; break;
-                        case  7: pos.Y() -= l; pos.X() -= off; break;
-                        }
-                    continue;
+                const double v = (u >> 11) * (1.0 / 9007199254740992.0);
+                if (d >= 1152)
+                    { // d >= 1152 We choose a point uniformly on the circle of radius d
+                    const double a = v*TWOPI;
+                    pos.X() += (int64)round(d*sin(a));
+                    pos.Y() += (int64)round(d*cos(a));
+                    return;
+                    }
+                // 2 < d < 128 : exact distribution from the small grid array
+                // 128 <= d < 1152 : use the nearest lower 128 multiple and the exact distribution from the large grid array
+                const int64 l = ((d < 128) ? d : ((d >> 7) << 7));
+                const int64 off = (int64)((d < 128) ? T.smallR[d](v) : T.largeR[d >> 7](v));
+                switch (u & 7)
+                    {
+                    case  0: pos.X() += l; pos.Y() += off; break;
+                    case  1: pos.X() += l; pos.Y() -= off; break;
+                    case  2: pos.X() -= l; pos.Y() += off; break;
+                    case  3: pos.X() -= l; pos.Y() -= off; break;
+                    case  4: pos.Y() += l; pos.X() += off; break;
+                    case  5: pos.Y() += l; pos.X() -= off; break;
+                    case  6: pos.Y() -= l; pos.X() += off; break;
+                    case  7: pos.Y() -= l; pos.X() -= off; break;
                     }
-                // d >= 1152 We choose a point uniformly on the circle of radius d
-                double a = Unif(gen)*TWOPI;
-                pos.X() += (int64)round(d*sin(a));
-                pos.Y() += (int64)round(d*cos(a));
+                }
+
+            }
+
+
+        /**
+         * Move the SRW while staying inside the rectangle R. Contrarily to SRW_ExitRect(), the position
+         * pos when the method returns need not be on the boundary of R. However, When the method
+         * returns, the distance to the (inner) boundary of the rectangle has been divided by at least
+         * the parameter 'ratio' compared to the initial distance from the boundary.
+         *
+         * Each jump uses a single 64 bits random number and the exit distributions are sampled in O(1)
+         * using alias tables built (once) from the precomputed exit tables.
+         *
+         * @param [in,out]  pos The position of the walk.
+         * @param   R           The rectangle.
+         * @param   ratio       The ratio by which the distance to the (inner) boundary has to decrease
+         *                      before we stop (set to <=0 for infinite ratio = stop at the
+         *                      boundary). 8 is a good choice usually.
+         * @param [in,out]  gen The random number generator.
+         *
+         * @return  The new distance to the inner boundary.
+         **/
+        template<class random_t> int64 SRW_Z2_MoveInRect(iVec2 & pos, iBox2 R, uint64 ratio, random_t & gen)
+            {
+            MTOOLS_ASSERT((!R.isEmpty()) && (R.isInside(pos)));
+            const internals_random::SRWExitAliasTables & T = internals_random::srwExitAliasTables();
+            int64 min_d = ((ratio <= 0) ? 0 : R.boundaryDist(pos)/ratio);
+            int64 d;
+            while((d = R.boundaryDist(pos)) >  min_d)
+                { // keep looping while we are striclty inside the rectangle.
+                internals_random::srwZ2Jump(pos, d, Unif_64(gen), T);
                 }
             MTOOLS_ASSERT(d >= 0);
             return d;
             }
 
 
+        /**
+         * Batch version of SRW_Z2_MoveInRect() for n independent walks inside the same rectangle R.
+         * Each walk is moved until its distance to the (inner) boundary of R has been divided by at
+         * least 'ratio'. All the walks still moving advance by one jump in each round and the random
+         * numbers for a whole round are fetched at once with fillUnif64().
+         *
+         * @param [in,out]  pos Array with the positions of the n walks.
+         * @param   n           The number of walks.
+         * @param   R           The rectangle.
+         * @param   ratio       The ratio by which the distance to the (inner) boundary has to decrease
+         *                      before we stop (set to <=0 for infinite ratio = stop at the boundary).
+         * @param [in,out]  gen The random number generator.
+         **/
+        template<class random_t> void SRW_Z2_MoveInRect(iVec2 * pos, size_t n, iBox2 R, uint64 ratio, random_t & gen)
+            {
+            MTOOLS_ASSERT(!R.isEmpty());
+            const internals_random::SRWExitAliasTables & T = internals_random::srwExitAliasTables();
+            std::vector<size_t> active;     // indices of the walks still moving
+            std::vector<int64>  dist(n);    // current distance to the boundary of each walk
+            std::vector<int64>  min_d(n);   // stopping distance of each walk
+            std::vector<uint64> u;          // random numbers for the current round
+            active.reserve(n);
+            for (size_t i = 0; i < n; i++)
+                {
+                MTOOLS_ASSERT(R.isInside(pos[i]));
+                dist[i] = R.boundaryDist(pos[i]);
+                min_d[i] = ((ratio <= 0) ? 0 : dist[i] / ratio);
+                if (dist[i] > min_d[i]) active.push_back(i);
+                }
+            while (active.size() > 0)
+                {
+                u.resize(active.size());
+                fillUnif64(gen, u.data(), u.size());
+                size_t m = 0;
+                for (size_t k = 0; k < active.size(); k++)
+                    {
+                    const size_t i = active[k];
+                    internals_random::srwZ2Jump(pos[i], dist[i], u[k], T);
+                    dist[i] = R.boundaryDist(pos[i]);
+                    if (dist[i] > min_d[i]) { active[m++] = i; }
+                    }
+                active.resize(m);
+                }
+            }
+
+
         /**
          * Move the SRW starting from pos until it reaches the INNER boudary of the rectangle R.
          * 
@@ -242,6 +476,253 @@ namespace mtools
             }
 
 
+        /**
+         * Batch version of SRW_Z2_ExitRect(): move n independent walks inside R until each one
+         * reaches the INNER boundary of R.
+         *
+         * @param [in,out]  pos Array with the positions of the n walks.
+         * @param   n           The number of walks.
+         * @param   R           The rectangle
+         * @param [in,out]  gen The random number generator
+         **/
+        template<class random_t> inline void SRW_Z2_ExitRect(iVec2 * pos, size_t n, iBox2 R, random_t & gen)
+            {
+            SRW_Z2_MoveInRect(pos, n, R, -1, gen); // set ratio to infinity
+            return;
+            }
+
+
+        namespace internals_random
+            {
+
+            /**
+             * Exact exit distribution of the SRW on Z^3 started at the center of the cube [-r,r]^3.
+             * 
+             * Sets w[a*r + b] (0 <= a,b < r) to the probability of exiting the cube at one of the
+             * points (r, +/-a, +/-b) (summed over the signs). Computed from the spectral decomposition
+             * of the Green function of the walk killed outside the cube: the exit probability at
+             * (r,y,z) is G(0,(r-1,y,z))/6 and the sums over the 3 modes are done one after the other in
+             * O(r^3) operations.
+             **/
+            inline void srwZ3ExitDistribution(int r, std::vector<double> & w)
+                {
+                MTOOLS_ASSERT(r >= 1);
+                const int M = 2 * r;    // coordinate j = x + r along an axis is in [1, M-1]
+                const int K = r;        // only the odd modes k = 2i + 1 do not vanish at the center
+                std::vector<double> sn((size_t)K*M), cs(K), sg(K);
+                for (int i = 0; i < K; i++)
+                    {
+                    const double t = PI*(2 * i + 1) / M;
+                    cs[i] = cos(t);
+                    sg[i] = ((i & 1) ? -1.0 : 1.0); // sin(pi k / 2)
+                    for (int j = 0; j < M; j++) { sn[(size_t)i*M + j] = sin(t*j); }
+                    }
+                std::vector<double> A((size_t)K*K), B((size_t)K*K);
+                for (int i2 = 0; i2 < K; i2++) for (int i3 = 0; i3 < K; i3++)
+                    { // sum over the first mode, first coordinate j1 = M - 1
+                    double s = 0.0;
+                    for (int i1 = 0; i1 < K; i1++) { s += sg[i1] * sn[(size_t)i1*M + M - 1] / (1.0 - (cs[i1] + cs[i2] + cs[i3]) / 3.0); }
+                    A[(size_t)i2*K + i3] = s;
+                    }
+                for (int i3 = 0; i3 < K; i3++) for (int a = 0; a < r; a++)
+                    { // sum over the second mode, second coordinate j2 = r + a
+                    double s = 0.0;
+                    for (int i2 = 0; i2 < K; i2++) { s += sg[i2] * sn[(size_t)i2*M + r + a] * A[(size_t)i2*K + i3]; }
+                    B[(size_t)i3*K + a] = s;
+                    }
+                const double f = (8.0 / ((double)M*M*M)) / 6.0;
+                w.assign((size_t)r*r, 0.0);
+                for (int a = 0; a < r; a++) for (int b = 0; b < r; b++)
+                    { // sum over the third mode, third coordinate j3 = r + b
+                    double s = 0.0;
+                    for (int i3 = 0; i3 < K; i3++) { s += sg[i3] * sn[(size_t)i3*M + r + b] * B[(size_t)i3*K + a]; }
+                    w[(size_t)a*r + b] = std::max<double>(0.0, s*f*((a > 0) ? 2 : 1)*((b > 0) ? 2 : 1));
+                    }
+                }
+
+
+            /* alias tables for the exit distributions of the cubes in Z^3 of radius r in [1,63] and in
+               largeR[] (each one computed on first use, thread-safe) */
+            struct SRWExitAliasTablesZ3
+                {
+                static const int NB_SMALL = 64;
+                static const int NB_LARGE = 7;
+
+                /* the large radii, all used for d >= 64 */
+                static int largeR(int i) { static const int L[NB_LARGE] = { 64, 96, 128, 192, 256, 384, 512 }; return L[i]; }
+
+                /* the table for index i (radius i if i < NB_SMALL and largeR(i - NB_SMALL) otherwise) */
+                const AliasTable & get(int i) const
+                    {
+                    MTOOLS_ASSERT((i >= 1) && (i < NB_SMALL + NB_LARGE));
+                    std::call_once(_flag[i], [&]() { _set(_tab[i], (i < NB_SMALL) ? i : largeR(i - NB_SMALL)); });
+                    return _tab[i];
+                    }
+
+                /* index 3*r*r entries: axis*r*r + a*r + b */
+                static void _set(AliasTable & T, int r)
+                    {
+                    std::vector<double> w;
+                    srwZ3ExitDistribution(r, w);
+                    double tot = 0.0;
+                    for (double x : w) { tot += x; }
+                    MTOOLS_INSURE(fabs(6 * tot - 1.0) < 1.0e-9); // the 6 faces
+                    const size_t n = w.size();
+                    w.resize(3 * n);
+                    std::copy(w.begin(), w.begin() + n, w.begin() + n);
+                    std::copy(w.begin(), w.begin() + n, w.begin() + 2 * n);
+                    T.set(w);
+                    }
+
+                mutable AliasTable _tab[NB_SMALL + NB_LARGE];
+                mutable std::once_flag _flag[NB_SMALL + NB_LARGE];
+                };
+
+
+            /* the alias tables (each one constructed on first use) */
+            inline const SRWExitAliasTablesZ3 & srwExitAliasTablesZ3() { static const SRWExitAliasTablesZ3 T; return T; }
+
+
+            /**
+             * Perform one jump of SRW_Z3_MoveInBox() for a walk at distance d > 0 from the inner
+             * boundary, using the 64 random bits u: the lowest 3 bits select the signs and the highest
+             * 53 bits the face and the offset (through the alias tables). The walk jumps to the exit
+             * point of the cube of radius d centered at pos if d < 64 and of the largest cube of radius
+             * largeR() <= d otherwise (so the law is always exact).
+             **/
+            inline void srwZ3Jump(iVec3 & pos, int64 d, uint64 u, const SRWExitAliasTablesZ3 & T)
+                {
+                int64 r = d; int ind = (int)d;
+                if (d >= SRWExitAliasTablesZ3::NB_SMALL)
+                    {
+                    int i = SRWExitAliasTablesZ3::NB_LARGE - 1;
+                    while (SRWExitAliasTablesZ3::largeR(i) > d) { i--; }
+                    r = SRWExitAliasTablesZ3::largeR(i); ind = SRWExitAliasTablesZ3::NB_SMALL + i;
+                    }
+                const size_t k = T.get(ind)((u >> 11) * (1.0 / 9007199254740992.0));
+                const int64 rr = r*r;
+                const int ax = (int)(k / rr);
+                const int64 a = (int64)(k % rr) / r, b = (int64)(k % rr) % r;
+                pos[ax] += ((u & 1) ? r : -r);
+                pos[(ax + 1) % 3] += ((u & 2) ? a : -a);
+                pos[(ax + 2) % 3] += ((u & 4) ? b : -b);
+                }
+
+            }
+
+
+        /**
+         * Move the SRW on Z^3 while staying inside the box R. Same as SRW_Z2_MoveInRect() but in
+         * dimension 3: when the method returns, the distance to the (inner) boundary of the box has
+         * been divided by at least the parameter 'ratio' compared to the initial distance from the
+         * boundary.
+         *
+         * Each jump uses a single 64 bits random number and moves the walk to its (exact) exit point
+         * from the cube centered at pos whose radius is the distance d to the boundary if d < 64 and
+         * the largest radius in {64, 96, 128, 192, 256, 384, 512} not larger than d otherwise. The
+         * exit distributions are computed and put in alias tables the first time
+         * a given radius is needed (O(r^3) operations, a couple of seconds for r = 512). Use
+         * Grid_factor::findFullBoxCentered() to find a large box around pos inside an empty region.
+         *
+         * @param [in,out]  pos The position of the walk.
+         * @param   R           The box.
+         * @param   ratio       The ratio by which the distance to the (inner) boundary has to decrease
+         *                      before we stop (set to <=0 for infinite ratio = stop at the
+         *                      boundary).
+         * @param [in,out]  gen The random number generator.
+         *
+         * @return  The new distance to the inner boundary.
+         **/
+        template<class random_t> int64 SRW_Z3_MoveInBox(iVec3 & pos, iBox3 R, uint64 ratio, random_t & gen)
+            {
+            MTOOLS_ASSERT((!R.isEmpty()) && (R.isInside(pos)));
+            const internals_random::SRWExitAliasTablesZ3 & T = internals_random::srwExitAliasTablesZ3();
+            int64 min_d = ((ratio <= 0) ? 0 : R.boundaryDist(pos) / ratio);
+            int64 d;
+            while ((d = R.boundaryDist(pos)) > min_d)
+                { // keep looping while we are striclty inside the box.
+                internals_random::srwZ3Jump(pos, d, Unif_64(gen), T);
+                }
+            MTOOLS_ASSERT(d >= 0);
+            return d;
+            }
+
+
+        /**
+         * Batch version of SRW_Z3_MoveInBox() for n independent walks inside the same box R. All the
+         * walks still moving advance by one jump in each round and the random numbers for a whole
+         * round are fetched at once with fillUnif64().
+         *
+         * @param [in,out]  pos Array with the positions of the n walks.
+         * @param   n           The number of walks.
+         * @param   R           The box.
+         * @param   ratio       The ratio by which the distance to the (inner) boundary has to decrease
+         *                      before we stop (set to <=0 for infinite ratio = stop at the boundary).
+         * @param [in,out]  gen The random number generator.
+         **/
+        template<class random_t> void SRW_Z3_MoveInBox(iVec3 * pos, size_t n, iBox3 R, uint64 ratio, random_t & gen)
+            {
+            MTOOLS_ASSERT(!R.isEmpty());
+            const internals_random::SRWExitAliasTablesZ3 & T = internals_random::srwExitAliasTablesZ3();
+            std::vector<size_t> active;     // indices of the walks still moving
+            std::vector<int64>  dist(n);    // current distance to the boundary of each walk
+            std::vector<int64>  min_d(n);   // stopping distance of each walk
+            std::vector<uint64> u;          // random numbers for the current round
+            active.reserve(n);
+            for (size_t i = 0; i < n; i++)
+                {
+                MTOOLS_ASSERT(R.isInside(pos[i]));
+                dist[i] = R.boundaryDist(pos[i]);
+                min_d[i] = ((ratio <= 0) ? 0 : dist[i] / ratio);
+                if (dist[i] > min_d[i]) active.push_back(i);
+                }
+            while (active.size() > 0)
+                {
+                u.resize(active.size());
+                fillUnif64(gen, u.data(), u.size());
+                size_t m = 0;
+                for (size_t k = 0; k < active.size(); k++)
+                    {
+                    const size_t i = active[k];
+                    internals_random::srwZ3Jump(pos[i], dist[i], u[k], T);
+                    dist[i] = R.boundaryDist(pos[i]);
+                    if (dist[i] > min_d[i]) { active[m++] = i; }
+                    }
+                active.resize(m);
+                }
+            }
+
+
+        /**
+         * Move the SRW on Z^3 starting from pos until it reaches the INNER boundary of the box R.
+         *
+         * @param [in,out]  pos The position of the walk
+         * @param   R           The box
+         * @param [in,out]  gen The random number generator
+         **/
+        template<class random_t> inline void SRW_Z3_ExitBox(iVec3 & pos, iBox3 R, random_t & gen)
+            {
+            SRW_Z3_MoveInBox(pos, R, -1, gen); // set ratio to infinity
+            return;
+            }
+
+
+        /**
+         * Batch version of SRW_Z3_ExitBox(): move n independent walks inside R until each one
+         * reaches the INNER boundary of R.
+         *
+         * @param [in,out]  pos Array with the positions of the n walks.
+         * @param   n           The number of walks.
+         * @param   R           The box
+         * @param [in,out]  gen The random number generator
+         **/
+        template<class random_t> inline void SRW_Z3_ExitBox(iVec3 * pos, size_t n, iBox3 R, random_t & gen)
+            {
+            SRW_Z3_MoveInBox(pos, n, R, -1, gen); // set ratio to infinity
+            return;
+            }
+
+
 
     }
 
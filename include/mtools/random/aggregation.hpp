@@ -0,0 +1,294 @@
+/** @file aggregation.hpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "../misc/internal/mtools_export.hpp"
+#include "../misc/misc.hpp"
+#include "../misc/error.hpp"
+#include "../misc/internal/threadworker.hpp"
+#include "../maths/vec.hpp"
+#include "../maths/box.hpp"
+#include "../containers/grid_factor.hpp"
+#include "gen_mt2004_64.hpp"
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <unordered_set>
+#include <type_traits>
+#include <utility>
+
+
+namespace mtools
+{
+
+
+    /**
+     * Read-only view of the cluster given to the walkers of a ParallelAggregation object.
+     *
+     * A walker must access the cluster only through this object: every query is recorded so that
+     * the engine can decide afterwards whether the walk would have been the same on the updated
+     * cluster.
+     **/
+    template<typename GRID_t> class AggregationView
+    {
+
+        template<typename GRID2_t, typename random_t> friend class ParallelAggregation;
+
+    public:
+
+        /**
+         * Type of the objects stored in the grid.
+         **/
+        typedef typename std::decay<decltype(std::declval<const GRID_t &>().get(std::declval<iVec2>()))>::type value_type;
+
+
+        /**
+         * Default constructor. The view is attached to a grid by the ParallelAggregation object.
+         **/
+        AggregationView() : _G(nullptr), _hint(nullptr), _index(0) {}
+
+
+        /**
+         * Return the value at a given site (the default value if the site was not yet created, just
+         * as Grid_factor::get() would).
+         **/
+        inline value_type get(const iVec2 & pos)
+            {
+            iBox2 B;
+            const value_type * p = _G->findFullBox(pos, B, _hint);
+            _gets.push_back(pos);
+            if (p == nullptr) return value_type();
+            return (*p);
+            }
+
+
+        /**
+         * Same as Grid_factor::findFullBox(): return a box containing pos on which the grid is
+         * constant, and a pointer to the common value (nullptr if the sites are not yet created).
+         * The leaf index of the grid is not used.
+         **/
+        inline const value_type * findFullBox(const iVec2 & pos, iBox2 & outBox)
+            {
+            const value_type * p = _G->findFullBox(pos, outBox, _hint);
+            _boxes.push_back(_boxQuery{ pos, outBox, ((p == nullptr) ? 0 : (int64)(*p)), (p != nullptr) });
+            return p;
+            }
+
+
+        /**
+         * Index of the walker currently using the view (walkers are numbered from 0 in the order of
+         * sequential execution).
+         **/
+        inline uint64 index() const { return _index; }
+
+
+    private:
+
+        struct _boxQuery
+            {
+            iVec2   pos;    // position queried
+            iBox2   box;    // box returned
+            int64   val;    // value returned
+            bool    def;    // false if nullptr was returned
+            };
+
+        /* start recording a new walk */
+        void _start(const GRID_t * G, uint64 index)
+            {
+            _G = G; _hint = nullptr; _index = index;
+            _gets.clear(); _boxes.clear();
+            }
+
+        const GRID_t *          _G;         // the grid
+        void *                  _hint;      // cursor in the grid owned by this view
+        uint64                  _index;     // index of the walker
+        std::vector<iVec2>      _gets;      // sites read with get()
+        std::vector<_boxQuery>  _boxes;     // findFullBox() queries
+    };
+
+
+
+    /**
+     * Parallel aggregation engine for 2D models (iDLA, lattice eDLA...) built on a Grid_factor.
+     *
+     * Walkers are numbered 0,1,2,... Walker i runs on the cluster made by the sites added by
+     * walkers 0,...,i-1 using its own random generator (seeded from the seed of the engine and i)
+     * and returns the site it adds to the cluster. The result is therefore identical to that of the
+     * sequential loop:
+     *
+     *     for (i = 0; i < nb; i++) { G.set(walker(view, gen_i), val); }
+     *
+     * whatever the number of threads.
+     *
+     * Walkers are processed by batches. Within a batch, the walkers run concurrently on the
+     * cluster as it was at the beginning of the batch. They are then committed in order: a walker
+     * whose queries all give the same answer on the current cluster is committed as is, otherwise it
+     * is run again (sequentially) on the current cluster. As long as most walkers do not interact,
+     * only a small fraction of them is run again.
+     *
+     * A walker is a functor with signature `iVec2 walker(AggregationView<GRID_t> & view, random_t & gen)`.
+     * It must access the cluster only through the view and must not use any other mutable state.
+     *
+     * @tparam  GRID_t      Type of the grid: a Grid_factor with D = 2.
+     * @tparam  random_t    Type of the random generators (must be constructible from a uint64 seed).
+     **/
+    template<typename GRID_t, typename random_t = MT2004_64> class ParallelAggregation
+    {
+
+    public:
+
+        /**
+         * Type of the objects stored in the grid.
+         **/
+        typedef typename AggregationView<GRID_t>::value_type value_type;
+
+
+        /**
+         * Constructor.
+         *
+         * @param [in,out]  G           The grid containing the cluster.
+         * @param           val         The value set at the sites added to the cluster.
+         * @param           seed        The seed used to construct the random generators of the walkers.
+         * @param           nbThreads   Number of threads (0 = number of hardware threads).
+         * @param           batchSize   Number of walkers per batch (0 = 32 per thread).
+         **/
+        ParallelAggregation(GRID_t & G, const value_type & val, uint64 seed, size_t nbThreads = 0, size_t batchSize = 0) :
+            _G(G), _val(val), _seed(seed), _nbThreads(nbThreads), _batchSize(batchSize), _nbWalkers(0), _nbRerun(0)
+            {
+            if (_nbThreads == 0) { _nbThreads = (size_t)nbHardwareThreads(); }
+            if (_batchSize == 0) { _batchSize = 32 * _nbThreads; }
+            }
+
+
+        /**
+         * Run nb walkers (the numbering of the walkers continues from the previous calls).
+         **/
+        template<typename WALKER> void run(size_t nb, WALKER walker)
+            {
+            std::vector<AggregationView<GRID_t> > views(_batchSize);
+            std::vector<iVec2> res(_batchSize);
+            while (nb > 0)
+                {
+                const size_t n = ((nb < _batchSize) ? nb : _batchSize);
+                // speculative phase: run the walkers concurrently on the current cluster
+                std::atomic<size_t> next(0);
+                auto worker = [&]()
+                    {
+                    size_t k;
+                    while ((k = next.fetch_add(1)) < n)
+                        {
+                        views[k]._start(&_G, _nbWalkers + k);
+                        random_t gen(_walkerSeed(_nbWalkers + k));
+                        res[k] = walker(views[k], gen);
+                        }
+                    };
+                const size_t nbth = ((_nbThreads < n) ? _nbThreads : n);
+                std::vector<std::thread> threads;
+                for (size_t t = 1; t < nbth; t++) { threads.push_back(std::thread(worker)); }
+                worker();
+                for (auto & th : threads) { th.join(); }
+                // commit phase: in order, re-running the walkers that observed a modified part of the cluster
+                _added.clear();
+                for (size_t k = 0; k < n; k++)
+                    {
+                    if ((k > 0) && (!_isValid(views[k])))
+                        {
+                        _nbRerun++;
+                        views[k]._start(&_G, _nbWalkers + k);
+                        random_t gen(_walkerSeed(_nbWalkers + k));
+                        res[k] = walker(views[k], gen);
+                        }
+                    _G.set(res[k], _val);
+                    _added.insert(_key(res[k]));
+                    }
+                _nbWalkers += n;
+                nb -= n;
+                }
+            }
+
+
+        /**
+         * Total number of walkers run so far.
+         **/
+        uint64 nbWalkers() const { return _nbWalkers; }
+
+
+        /**
+         * Number of walkers that had to be run again because the cluster changed under them.
+         **/
+        uint64 nbRerun() const { return _nbRerun; }
+
+
+    private:
+
+        /* hash for the set of sites added during the current batch */
+        struct _keyHash { size_t operator()(const std::pair<int64, int64> & p) const { return (size_t)(((uint64)p.first) * 0x9E3779B97F4A7C15ULL ^ ((uint64)p.second)); } };
+
+        static inline std::pair<int64, int64> _key(const iVec2 & pos) { return std::pair<int64, int64>(pos.X(), pos.Y()); }
+
+
+        /* seed for the generator of walker i (splitmix64 finalizer) */
+        inline uint64 _walkerSeed(uint64 i) const
+            {
+            uint64 z = _seed + (i + 1) * 0x9E3779B97F4A7C15ULL;
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            return z ^ (z >> 31);
+            }
+
+
+        /* check if all the queries of a walk give the same answer on the current cluster */
+        bool _isValid(const AggregationView<GRID_t> & V) const
+            {
+            // values only change at the sites added since the beginning of the batch
+            for (auto & p : V._gets) { if (_added.count(_key(p)) != 0) return false; }
+            // boxes also depend on the factorization of the tree: ask again
+            void * hint = nullptr;
+            for (auto & q : V._boxes)
+                {
+                iBox2 B;
+                const value_type * p = _G.findFullBox(q.pos, B, hint);
+                if ((p != nullptr) != q.def) return false;
+                if ((p != nullptr) && ((int64)(*p) != q.val)) return false;
+                if (B != q.box) return false;
+                }
+            return true;
+            }
+
+
+        GRID_t &        _G;             // the grid
+        value_type      _val;           // value of the sites added
+        uint64          _seed;          // seed of the engine
+        size_t          _nbThreads;     // number of threads
+        size_t          _batchSize;     // number of walkers per batch
+        uint64          _nbWalkers;     // number of walkers already committed
+        uint64          _nbRerun;       // number of walkers run twice
+
+        std::unordered_set<std::pair<int64, int64>, _keyHash> _added; // sites added during the current batch
+    };
+
+
+
+}
+
+
+/* end of file */
+
@@ -24,13 +24,48 @@
 #include "../misc/misc.hpp" 
 #include "../misc/error.hpp"
 #include "../maths/specialFunctions.hpp"
+#include "gen_buffered.hpp"
 
 #include <cmath>
 #include <random>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+
+#if defined (_MSC_VER) && defined (_M_X64)
+#include <intrin.h>
+#endif
 
 namespace mtools
 {
 
+
+    namespace internals_random
+    {
+
+        /* full 64x64 -> 128 bits product: return the high part and store the low part in lo */
+        inline uint64 _mul128(uint64 a, uint64 b, uint64 & lo)
+            {
+#if defined (__SIZEOF_INT128__)
+            const unsigned __int128 m = ((unsigned __int128)a) * b;
+            lo = (uint64)m;
+            return (uint64)(m >> 64);
+#elif defined (_MSC_VER) && defined (_M_X64)
+            uint64 hi;
+            lo = _umul128(a, b, &hi);
+            return hi;
+#else
+            const uint64 a0 = a & 4294967295ULL, a1 = a >> 32, b0 = b & 4294967295ULL, b1 = b >> 32;
+            const uint64 p00 = a0*b0, p01 = a0*b1, p10 = a1*b0, p11 = a1*b1;
+            const uint64 mid = (p00 >> 32) + (p01 & 4294967295ULL) + (p10 & 4294967295ULL);
+            lo = (mid << 32) | (p00 & 4294967295ULL);
+            return p11 + (p01 >> 32) + (p10 >> 32) + (mid >> 32);
+#endif
+            }
+
+    }
+
    
     /**
     * Construct a uniform unsigned integer value in the range [0,2^64-1] .
@@ -85,6 +120,41 @@ namespace mtools
     template<class random_t> inline uint32 Unif_1(random_t & gen) { return (Unif_32(gen) & 1); }
 
 
+    /**
+     * Fill an array with uniform 64 bits integers. Same as calling Unif_64() n times but the
+     * numbers are fetched from the generator by blocks with fillRandom().
+     *
+     * @param [in,out]  gen The random number generator
+     * @param [in,out]  out pointer to the array to fill.
+     * @param           n   number of random numbers to generate.
+     **/
+    template<class random_t> inline void fillUnif64(random_t & gen, uint64 * out, size_t n)
+        {
+        typedef typename random_t::result_type result_type;
+        const size_t B = 256;
+        result_type buf[2 * B];
+        const bool is64 = ((random_t::min() == 0) && (random_t::max() == 18446744073709551615ULL));
+        const bool is32 = ((random_t::min() == 0) && (random_t::max() == 4294967295UL));
+        if ((!is64) && (!is32)) { for (size_t k = 0; k < n; k++) { out[k] = Unif_64(gen); } return; }
+        while (n > 0)
+            {
+            const size_t m = (n < B) ? n : B;
+            if (is64)
+                {
+                fillRandom(gen, buf, m);
+                for (size_t k = 0; k < m; k++) { out[k] = (uint64)buf[k]; }
+                }
+            else
+                {
+                fillRandom(gen, buf, 2 * m);
+                for (size_t k = 0; k < m; k++) { out[k] = (uint64)buf[2 * k] + (((uint64)buf[2 * k + 1]) << 32); }
+                }
+            out += m;
+            n -= m;
+            }
+        }
+
+
     /**
      * Construct a real-valued uniform number in [0,1[.
      *
@@ -128,15 +198,48 @@ namespace mtools
 
 
     /**
-     * Construct a uniform integer valued random variable in the range [A,B].
+     * Construct a uniform integer in the range [0,n-1] (exactly uniform, without going through a
+     * double). Use Lemire's multiply-shift method: the high 64 bits of Unif_64()*n are returned
+     * unless the low 64 bits fall in the small biased zone, in which case a new number is drawn
+     * (this happens with probability less than n/2^64). The costly modulo is only computed in
+     * that case.
+     *
+     * @param   n           The size of the range (must be positive).
+     * @param [in,out]  gen The random number generator
+     *
+     * @return  A 64bit integer uniformely distributed in [0,n-1]
+     **/
+    template<class random_t> inline uint64 Unif_bounded(uint64 n, random_t & gen)
+        {
+        MTOOLS_ASSERT(n > 0);
+        uint64 lo;
+        uint64 hi = internals_random::_mul128(Unif_64<random_t>(gen), n, lo);
+        if (lo < n)
+            {
+            const uint64 t = (0 - n) % n; // 2^64 mod n
+            while (lo < t) { hi = internals_random::_mul128(Unif_64<random_t>(gen), n, lo); }
+            }
+        return hi;
+        }
+
+
+    /**
+     * Construct a uniform integer valued random variable in the range [A,B]. The distribution is
+     * exactly uniform, even for huge ranges (uses Unif_bounded()).
      *
      * @param   A           The minimal value
-     * @param   B           The maximal value
+     * @param   B           The maximal value (must be at least A).
      * @param [in,out]  gen The random number generator
      *
      * @return  A 64bit integer uniformely distributed in [A,B]
      **/
-    template<class random_t> inline int64 Unif_int(int64 A, int64 B, random_t & gen) { return((int64)((Unif<random_t>(gen))*(B - A + 1)) + A); }
+    template<class random_t> inline int64 Unif_int(int64 A, int64 B, random_t & gen)
+        {
+        MTOOLS_ASSERT(A <= B);
+        const uint64 n = (uint64)B - (uint64)A + 1;
+        if (n == 0) return (int64)Unif_64<random_t>(gen); // the whole range of int64
+        return (int64)((uint64)A + Unif_bounded<random_t>(n, gen));
+        }
 
 
     /**
@@ -169,6 +272,9 @@ namespace mtools
     * @param   N   the support of the RV X is [0,N] ie tab is at least N elements long.
     *
     * @return  A random position in [0,N] chosing according to the CDF.
+    *
+    * This performs a binary search at each call: use a DiscreteSampler object to sample many times
+    * from the same array.
     **/
     template<class random_t> inline int64 sampleDiscreteRVfromCDF(const double * tab, size_t N, random_t & gen)
         {
@@ -188,17 +294,16 @@ namespace mtools
 
 
     /**
-    * Sample a discrete random variable X taking value in Z from its cumulatice distribution
-    * function.
+    * Invert the cumulative distribution function of a discrete random variable X taking value in Z
+    * i.e. return the smallest value j such that cdf(j) > a. 
     *
-    * @param   cdf         CDF functor such that cdf(i) = P(S <= i) for any int64
-    * @param [in,out]  gen the random number generator.
+    * @param   cdf CDF functor such that cdf(i) = P(S <= i) for any int64
+    * @param   a   the value to invert, in [0,1[.
     *
     * @return  a value in [-4611686018427387904, 4611686018427387904] (truncate the rv if out of these bounds).
     **/
-    template<class random_t, class CDF> inline int64 sampleDiscreteRVfromCDF(CDF cdf, random_t & gen)
+    template<class CDF> inline int64 invertDiscreteCDF(CDF & cdf, double a)
         {
-        double a = Unif(gen); // uniform value in [0,1[
         int64 i, j;
         if (cdf(0) <= a)
             { // value is strictly positive
@@ -233,11 +338,242 @@ namespace mtools
         }
 
 
+    /**
+    * Sample a discrete random variable X taking value in Z from its cumulatice distribution
+    * function.
+    *
+    * @param   cdf         CDF functor such that cdf(i) = P(S <= i) for any int64
+    * @param [in,out]  gen the random number generator.
+    *
+    * @return  a value in [-4611686018427387904, 4611686018427387904] (truncate the rv if out of these bounds).
+    **/
+    template<class random_t, class CDF> inline int64 sampleDiscreteRVfromCDF(CDF cdf, random_t & gen)
+        {
+        double a = Unif(gen); // uniform value in [0,1[
+        return invertDiscreteCDF(cdf, a);
+        }
+
+
+    /**
+    * Sample a discrete random variable X taking value in Z from a tabulated version of its
+    * cumulative distribution function.
+    *
+    * The values cdf(kmin), cdf(kmin+1), ... are computed lazily and stored in a table (whose size
+    * doubles each time a larger value is needed, up to maxsize entries) together with a guide table so
+    * that a draw inside the table takes O(1) expected time without evaluating the CDF. Values beyond
+    * the table are obtained by inverting the CDF functor directly.
+    *
+    * The inversion is the same as with sampleDiscreteRVfromCDF(): given the same generator, the
+    * object returns the same sequence of values (as long as the CDF is non-decreasing).
+    *
+    * @tparam  CDF CDF functor such that cdf(i) = P(S <= i) for any int64.
+    **/
+    template<class CDF> class TabulatedDiscreteLaw
+    {
+
+    public:
+
+        /**
+        * Constructor.
+        *
+        * @param   cdf     the CDF functor.
+        * @param   kmin    lower bound on the support of the law: cdf(kmin - 1) = 0.
+        * @param   kmax    upper bound on the support of the law (if any) i.e. cdf(kmax) = 1.
+        * @param   maxsize maximum size of the table.
+        **/
+        TabulatedDiscreteLaw(CDF cdf, int64 kmin, int64 kmax = 4611686018427387904, size_t maxsize = 256) : _cdf(cdf), _kmin(kmin), _kmax(kmax), _maxsize(maxsize), _complete(false)
+            {
+            MTOOLS_INSURE(kmin <= kmax);
+            MTOOLS_INSURE(maxsize >= 1);
+            _extend();
+            }
+
+
+        /** Sample the random variable. **/
+        template<class random_t> inline int64 operator()(random_t & gen) { return invert(Unif(gen)); }
+
+
+        /** Return the smallest value j such that cdf(j) > a (for a in [0,1[). **/
+        inline int64 invert(double a)
+            {
+            while (1)
+                {
+                if (a < _tab.back())
+                    {
+                    size_t i = _guide[(size_t)(a*_guide.size())];
+                    while (_tab[i] <= a) { i++; }
+                    return _kmin + (int64)i;
+                    }
+                if (_complete) { return ((_kmin + (int64)_tab.size() - 1 >= _kmax) ? _kmax : invertDiscreteCDF(_cdf, a)); }
+                _extend();
+                }
+            }
+
+
+        /** Current size of the table. **/
+        size_t size() const { return _tab.size(); }
+
+
+    private:
+
+        /* double the size of the table and recompute the guide table */
+        void _extend()
+            {
+            size_t n = std::min<size_t>(_maxsize, std::max<size_t>(16, 2 * _tab.size()));
+            if ((int64)n - 1 >= _kmax - _kmin) { n = (size_t)(_kmax - _kmin + 1); }
+            for (size_t i = _tab.size(); i < n; i++) { _tab.push_back(_cdf(_kmin + (int64)i)); }
+            _complete = ((n == _maxsize) || (_kmin + (int64)n - 1 >= _kmax));
+            const size_t l = _tab.size();
+            _guide.resize(l);
+            size_t i = 0;
+            for (size_t j = 0; j < l; j++)
+                { // _guide[j] = smallest index i such that _tab[i] > j/l
+                while ((i < l - 1) && (_tab[i] <= ((double)j) / l)) { i++; }
+                _guide[j] = (uint32)i;
+                }
+            }
+
+        CDF                     _cdf;       // the cdf functor
+        int64                   _kmin;      // value associated with _tab[0]
+        int64                   _kmax;      // upper bound of the support
+        size_t                  _maxsize;   // maximum size of the table
+        bool                    _complete;  // true if the table cannot grow anymore
+        std::vector<double>     _tab;       // _tab[i] = cdf(_kmin + i)
+        std::vector<uint32>     _guide;     // guide table
+
+    };
+
+
+
+    /**
+    * Sampler for a discrete random variable given by a tabulated CDF, in O(1) expected time.
+    *
+    * The CDF is given on a range [kmin, kmin + N - 1] (either by an array or by a functor which is
+    * evaluated once for each value of the range) and a guide table (Chen and Asau) is built once:
+    * guide[j] is the first index whose CDF is larger than j/N so that the inversion of a uniform a
+    * starts at guide[floor(a*N)] and only scans a few entries. Values of a larger than the last
+    * entry of the table are sent to a tail handler (for example an asymptotic formula or a direct
+    * inversion of the CDF).
+    *
+    * The sampler returns the same value as a plain inversion of the CDF (e.g.
+    * sampleDiscreteRVfromCDF()) for the same uniform so, given the same generator, the same sequence
+    * is obtained. The object is not modified after construction and can be shared between threads.
+    **/
+    class DiscreteSampler
+    {
+
+    public:
+
+        /**
+        * Constructor from an array, with the same convention as sampleDiscreteRVfromCDF(tab, N, gen).
+        *
+        * @param   tab     The CDF array: tab[i] = P(X <= kmin + i) for 0 <= i < N.
+        * @param   N       Number of entries of the array.
+        * @param   kmin    value associated with tab[0].
+        * @param   tail    tail handler called with the uniform a when a >= tab[N-1]. If empty, the
+        *                  value kmin + N is returned, as sampleDiscreteRVfromCDF() does.
+        **/
+        DiscreteSampler(const double * tab, size_t N, int64 kmin = 0, std::function<int64(double)> tail = nullptr) : _kmin(kmin), _tail(tail), _tab(tab, tab + N)
+            {
+            MTOOLS_INSURE(N >= 1);
+            _buildGuide();
+            }
+
+
+        /**
+        * Constructor from a CDF functor, tabulated on the range [kmin, kmax].
+        *
+        * @param   cdf     CDF functor such that cdf(i) = P(X <= i) for any int64.
+        * @param   kmin    first value of the table (the support must be contained in [kmin, +inf)).
+        * @param   kmax    last value of the table.
+        * @param   tail    tail handler called with the uniform a when a >= cdf(kmax). If empty, the
+        *                  CDF functor is inverted directly (see invertDiscreteCDF()).
+        **/
+        template<class CDF, typename = typename std::enable_if<!std::is_arithmetic<typename std::remove_pointer<CDF>::type>::value>::type> DiscreteSampler(CDF cdf, int64 kmin, int64 kmax, std::function<int64(double)> tail = nullptr) : _kmin(kmin), _tail(tail)
+            {
+            MTOOLS_INSURE(kmin <= kmax);
+            _tab.resize((size_t)(kmax - kmin + 1));
+            for (size_t i = 0; i < _tab.size(); i++) { _tab[i] = cdf(kmin + (int64)i); }
+            if (!_tail) { _tail = [cdf](double a) mutable { return invertDiscreteCDF(cdf, a); }; }
+            _buildGuide();
+            }
+
+
+        /** Sample the random variable. **/
+        template<class random_t> inline int64 operator()(random_t & gen) const { return invert(Unif(gen)); }
+
+
+        /** Return the smallest value j such that P(X <= j) > a (for a in [0,1[). **/
+        inline int64 invert(double a) const
+            {
+            if (a >= _tab.back()) { return (_tail ? _tail(a) : _kmin + (int64)_tab.size()); }
+            size_t i = _guide[(size_t)(a*_guide.size())];
+            while (_tab[i] <= a) { i++; }
+            return _kmin + (int64)i;
+            }
+
+
+        /** Number of entries of the table. **/
+        size_t size() const { return _tab.size(); }
+
+
+    private:
+
+        /* compute the guide table */
+        void _buildGuide()
+            {
+            const size_t l = _tab.size();
+            _guide.resize(l);
+            size_t i = 0;
+            for (size_t j = 0; j < l; j++)
+                { // _guide[j] = smallest index i such that _tab[i] > j/l
+                while ((i < l - 1) && (_tab[i] <= ((double)j) / l)) { i++; }
+                _guide[j] = (uint32)i;
+                }
+            }
+
+        int64                           _kmin;  // value associated with _tab[0]
+        std::function<int64(double)>    _tail;  // tail handler
+        std::vector<double>             _tab;   // the CDF
+        std::vector<uint32>             _guide; // guide table
+
+    };
+
+
+
+    namespace internals_random
+    {
+
+        /**
+         * Number of samples generated at once by the fill() methods of the laws. The uniforms of a
+         * block are drawn first so the transformation loop has no call to the generator and can be
+         * vectorized by the compiler when vector math functions are available (e.g. glibc's libmvec
+         * with -O3 -ffast-math). The values then only match those of operator() up to rounding.
+         **/
+        static const size_t FILL_BLOCK = 256;
+
+
+        /**
+         * Fill u[0..n-1] with uniforms in [0,1[: the same values as n successive calls to Unif(gen)
+         * but the random numbers are fetched by blocks with fillUnif64() and converted in a
+         * vectorizable loop. buf must have room for n elements.
+         **/
+        template<class random_t> inline void unifBlock(random_t & gen, uint64 * buf, double * u, size_t n)
+            {
+            fillUnif64(gen, buf, n);
+            for (size_t k = 0; k < n; k++) { u[k] = ((double)(buf[k] >> 11)) * (1.0 / 9007199254740992.0); }
+            }
+
+    }
+
 
     /**
     * create a Binomial randon variable.
-    * Taken from numerical recipes 
-    * 
+    *
+    * - n <= 64 : bit-parallel method (taken from numerical recipes).
+    * - n*p < 30 : inversion of the cdf (taken from numerical recipes).
+    * - otherwise : BTPE algorithm of Kachitvichyanukul and Schmeiser (1988) whose constants are
+    *   computed once in setParam(). The expected cost of a draw is bounded independently of n.
     **/
     class BinomialLaw
         {
@@ -279,9 +615,18 @@ namespace mtools
                 swch = 1;
                 }
             else 
-                {
-                np = n*p; glnp = gammln(n + 1.); plog = log(p); pclog = log(1. - p); sq = sqrt(np*(1. - p));
-                if (n < 1024) for (j = 0;j <= n;j++) logfact[j] = gammln(j + 1.);
+                { // BTPE setup
+                const double q = 1.0 - p;
+                const double fm = n*p + p;
+                bm = floor(fm);
+                nrq = n*p*q;
+                p1 = floor(2.195*sqrt(nrq) - 4.6*q) + 0.5;
+                xm = bm + 0.5; xl = xm - p1; xr = xm + p1;
+                c = 0.134 + 20.5 / (15.3 + bm);
+                double a = (fm - xl) / (fm - xl*p); laml = a*(1.0 + a / 2.0);
+                a = (xr - fm) / (xr*q); lamr = a*(1.0 + a / 2.0);
+                p2 = p1*(1.0 + 2.0*c); p3 = p2 + c / laml; p4 = p3 + c / lamr;
+                rs = p / q; ra = rs*(n + 1);
                 swch = 2;
                 }
             }
@@ -297,7 +642,7 @@ namespace mtools
             template<class random_t> int operator()(random_t & gen)
             {
             int j, k, kl, km;
-            double y, u, v, u2, v2, b;
+            double y;
             if (swch == 0) 
                 {
                 unfin = uo;
@@ -323,37 +668,231 @@ namespace mtools
                     }
                 }
             else {
-                for (;;) 
-                    {
-                    u = 0.645*Unif(gen);
-                    v = -0.63 + 1.25*Unif(gen);
-                    v2 = v*v;
-                    if (v >= 0.) { if (v2 > 6.5*u*(0.645 - u)*(u + 0.2)) continue; } else { if (v2 > 8.4*u*(0.645 - u)*(u + 0.1)) continue; }
-                    k = int(floor(sq*(v / u) + np + 0.5));
-                    if ((k < 0) || (k > n)) continue;
-                    u2 = u*u;
-                    if (v >= 0.) { if (v2 < 12.25*u2*(0.615 - u)*(0.92 - u)) break; } else { if (v2 < 7.84*u2*(0.615 - u)*(1.2 - u)) break; }
-                    b = sq*exp(glnp + k*plog + (n - k)*pclog - (n < 1024 ? logfact[k] + logfact[n - k] : gammln(k + 1.) + gammln(n - k + 1.)));
-                    if (u2 < b) break;
-                    }
+                k = _btpe(gen);
                 }
             if (p != pp) k = n - k;
             return k;
             }
 
 
+            /**
+             * Fill an array with independent samples (same values as calling operator() n times). In
+             * the inversion regime (n*p < 30), the uniforms are drawn by blocks before the lookups.
+             *
+             * @param [in,out]  gen The random generator.
+             * @param [in,out]  out pointer to the array to fill.
+             * @param           nb  number of samples.
+             **/
+            template<class random_t> void fill(random_t & gen, int * out, size_t nb)
+                {
+                if (swch != 1) { for (size_t k = 0; k < nb; k++) { out[k] = operator()(gen); } return; }
+                const size_t B = internals_random::FILL_BLOCK;
+                uint64 buf[B];
+                double u[B];
+                while (nb > 0)
+                    {
+                    const size_t m = (nb < B) ? nb : B;
+                    internals_random::unifBlock(gen, buf, u, m);
+                    for (size_t i = 0; i < m; i++)
+                        {
+                        int kl = -1, k = 64;
+                        while (k - kl > 1) { const int km = (kl + k) / 2; if (u[i] < cdf[km]) k = km; else kl = km; }
+                        out[i] = (p != pp) ? (n - k) : k;
+                        }
+                    out += m;
+                    nb -= m;
+                    }
+                }
+
+
         private:
 
-            double pp, p, pb, np, glnp, plog, pclog, sq;
+            /* BTPE algorithm (for n*p >= 30 and p <= 1/2) */
+            template<class random_t> int _btpe(random_t & gen) const
+                {
+                double y;
+                while (1)
+                    {
+                    const double u = Unif(gen)*p4;
+                    double v = Unif(gen);
+                    if (u <= p1)
+                        { // triangular region: immediate acceptance
+                        return (int)floor(xm - p1*v + u);
+                        }
+                    if (u <= p2)
+                        { // parallelograms
+                        const double x = xl + (u - p1) / c;
+                        v = v*c + 1.0 - fabs(bm - x + 0.5) / p1;
+                        if (v > 1.0) continue;
+                        y = floor(x);
+                        }
+                    else if (u <= p3)
+                        { // left exponential tail
+                        y = floor(xl + log(v) / laml);
+                        if ((y < 0) || (v == 0.0)) continue;
+                        v = v*(u - p2)*laml;
+                        }
+                    else
+                        { // right exponential tail
+                        y = floor(xr - log(v) / lamr);
+                        if ((y > n) || (v == 0.0)) continue;
+                        v = v*(u - p3)*lamr;
+                        }
+                    const double k = fabs(y - bm);
+                    if ((k <= 20) || (k >= nrq / 2.0 - 1))
+                        { // explicit evaluation of f(y)/f(m) by recursion
+                        double F = 1.0;
+                        if (bm < y) { for (double i = bm + 1; i <= y; i++) F *= (ra / i - rs); }
+                        else if (bm > y) { for (double i = y + 1; i <= bm; i++) F /= (ra / i - rs); }
+                        if (v > F) continue;
+                        return (int)y;
+                        }
+                    // squeeze using upper and lower bounds on log(f(y))
+                    const double rho = (k / nrq)*((k*(k / 3.0 + 0.625) + 0.16666666666666666) / nrq + 0.5);
+                    const double t = -k*k / (2 * nrq);
+                    const double A = log(v);
+                    if (A < (t - rho)) return (int)y;
+                    if (A > (t + rho)) continue;
+                    // final acceptance/rejection test using Stirling's formula
+                    const double x1 = y + 1, f1 = bm + 1, z = n + 1 - bm, w = n - y + 1;
+                    const double x2 = x1*x1, f2 = f1*f1, z2 = z*z, w2 = w*w;
+                    if (A > (xm*log(f1 / x1) + (n - bm + 0.5)*log(z / w) + (y - bm)*log(w*p / (x1*(1.0 - p)))
+                             + (13680. - (462. - (132. - (99. - 140. / f2) / f2) / f2) / f2) / f1 / 166320.
+                             + (13680. - (462. - (132. - (99. - 140. / z2) / z2) / z2) / z2) / z / 166320.
+                             + (13680. - (462. - (132. - (99. - 140. / x2) / x2) / x2) / x2) / x1 / 166320.
+                             + (13680. - (462. - (132. - (99. - 140. / w2) / w2) / w2) / w2) / w / 166320.)) continue;
+                    return (int)y;
+                    }
+                }
+
+            double pp, p, pb;
             int n, swch;
             uint64 uz, uo, unfin, diff, rltp;
             int pbits[5];
             double cdf[64];
-            double logfact[1024];
+            double bm, nrq, p1, p2, p3, p4, xm, xl, xr, c, laml, lamr, rs, ra;   // BTPE constants
 
      };
 
 
+    namespace internals_random
+    {
+
+        /**
+         * Tables for the ziggurat method of Marsaglia and Tsang (2000) with 256 layers of equal area
+         * v under an (unnormalized) decreasing density f on [0,infty). With x[0] = v/f(r) > x[1] = r
+         * > x[2] > ... > x[256] = 0, layer i is the box [0, x[i]] x [f(x[i]), f(x[i+1])] ; layer 0
+         * also contains the tail [r, infty).
+         **/
+        struct ZigguratTables
+            {
+
+            /* construct the tables for the normal density exp(-x^2/2) or for the exponential density exp(-x) */
+            ZigguratTables(bool normal)
+                {
+                r = (normal ? 3.6541528853610088 : 7.69711747013104972);
+                const double v = (normal ? 4.92867323399e-3 : 3.9496598225815571993e-3);
+                double x[257];
+                x[0] = v / _f(normal, r);
+                x[1] = r;
+                for (int i = 1; i < 255; i++)
+                    {
+                    const double y = v / x[i] + _f(normal, x[i]);
+                    x[i + 1] = (y >= 1.0) ? 0.0 : (normal ? sqrt(-2.0*log(y)) : -log(y));
+                    }
+                x[256] = 0.0;
+                for (int i = 0; i < 256; i++)
+                    {
+                    w[i] = x[i] / 9007199254740992.0;
+                    k[i] = (uint64)((x[i + 1] / x[i]) * 9007199254740992.0);
+                    }
+                for (int i = 0; i < 257; i++) { f[i] = _f(normal, x[i]); }
+                }
+
+            static double _f(bool normal, double x) { return (normal ? exp(-0.5*x*x) : exp(-x)); }
+
+            double  r;          // start of the tail
+            double  w[256];     // w[i] = x[i] / 2^53
+            uint64  k[256];     // k[i] = 2^53 * x[i+1] / x[i] (threshold for the fast path)
+            double  f[257];     // f[i] = f(x[i])
+            };
+
+
+        /* the tables for the normal law (computed once) */
+        inline const ZigguratTables & zigguratNormalTables() { static const ZigguratTables T(true); return T; }
+
+
+        /* the tables for the exponential law (computed once) */
+        inline const ZigguratTables & zigguratExponentialTables() { static const ZigguratTables T(false); return T; }
+
+
+        /**
+         * Standard normal r.v. with the ziggurat method. The first attempt uses the 64 random bits u
+         * (8 bits for the layer, 1 for the sign and 53 for the abscissa). The generator is only used
+         * when this attempt fails (probability ~ 1.2%).
+         **/
+        template<class random_t> inline double zigguratNormal(const ZigguratTables & T, uint64 u, random_t & gen)
+            {
+            while (1)
+                {
+                const int i = (int)(u & 255);
+                const bool neg = (((u >> 8) & 1) != 0);
+                const uint64 j = (u >> 11);
+                double x = j*T.w[i];
+                if (j < T.k[i]) return (neg ? -x : x); // fast path
+                if (i == 0)
+                    { // tail
+                    double a, b;
+                    do { a = -log(Unif_01open(gen)) / T.r; b = -log(Unif_01open(gen)); } while (b + b < a*a);
+                    x = T.r + a;
+                    return (neg ? -x : x);
+                    }
+                if (T.f[i] + Unif(gen)*(T.f[i + 1] - T.f[i]) < exp(-0.5*x*x)) return (neg ? -x : x); // wedge
+                u = Unif_64(gen);
+                }
+            }
+
+
+        /**
+         * Exponential r.v. with parameter 1 with the ziggurat method. Same conventions as
+         * zigguratNormal() (the sign bit is unused). The first attempt fails with probability ~ 1.1%.
+         **/
+        template<class random_t> inline double zigguratExponential(const ZigguratTables & T, uint64 u, random_t & gen)
+            {
+            while (1)
+                {
+                const int i = (int)(u & 255);
+                const uint64 j = (u >> 11);
+                const double x = j*T.w[i];
+                if (j < T.k[i]) return x; // fast path
+                if (i == 0) return T.r - log(Unif_01open(gen)); // tail (memoryless)
+                if (T.f[i] + Unif(gen)*(T.f[i + 1] - T.f[i]) < exp(-x)) return x; // wedge
+                u = Unif_64(gen);
+                }
+            }
+
+
+        /**
+         * Fill an array with samples obtained by fun(u, gen) where u are 64 random bits. The random
+         * bits are fetched by blocks with fillUnif64().
+         **/
+        template<class random_t, typename FUN> inline void zigguratFill(random_t & gen, double * out, size_t n, FUN fun)
+            {
+            const size_t B = 256;
+            uint64 buf[B];
+            while (n > 0)
+                {
+                const size_t m = (n < B) ? n : B;
+                fillUnif64(gen, buf, m);
+                for (size_t k = 0; k < m; k++) { out[k] = fun(buf[k], gen); }
+                out += m;
+                n -= m;
+                }
+            }
+
+    }
+
+
     /**
      * Create an exponential distribution (by inverting the CDF). 
      * 
@@ -362,6 +901,10 @@ namespace mtools
      * The density of X is P(X in dx) = lambda*exp(-lambda*x)dx on [0,infty).
      * 
      * The expectation of X is thus E[X] = 1/lambda.
+     *
+     * If the flag ziggurat is set in the constructor, the ziggurat method is used instead: it
+     * requires a single 64 bits random number and no call to log() for ~99% of the samples (but the
+     * sequence obtained differs from the one obtained by inversion).
     **/
     class ExponentialLaw
     {
@@ -372,7 +915,7 @@ namespace mtools
          *
          * @param   lambda  Parameter of the exponential law (inverse of its expectation).
         **/
-        ExponentialLaw(double lambda = 1.0) : l(lambda) { MTOOLS_ASSERT(lambda > 0.0); }
+        ExponentialLaw(double lambda = 1.0, bool ziggurat = false) : l(lambda), _zig(ziggurat ? &internals_random::zigguratExponentialTables() : nullptr) { MTOOLS_ASSERT(lambda > 0.0); }
 
 
         /**
@@ -390,11 +933,52 @@ namespace mtools
          *
          * @return  the random variable.
         **/
-		template<class random_t> double operator()(random_t & gen) const { return(-log(1- Unif(gen))/l); }
+		template<class random_t> double operator()(random_t & gen) const
+            {
+            if (_zig != nullptr) return internals_random::zigguratExponential(*_zig, Unif_64(gen), gen)/l;
+            return(-log(1- Unif(gen))/l);
+            }
+
+
+        /**
+         * Fill an array with independent samples. The random numbers are fetched from the generator
+         * by blocks (see fillRandom()). Without the ziggurat method, the values are the same as
+         * calling operator() n times.
+         *
+         * @param [in,out]  gen The random generator.
+         * @param [in,out]  out pointer to the array to fill.
+         * @param           n   number of samples.
+         **/
+        template<class random_t> void fill(random_t & gen, double * out, size_t n) const
+            {
+            if (_zig == nullptr)
+                { // inversion: same values as operator(), uniforms drawn by blocks
+                const size_t B = internals_random::FILL_BLOCK;
+                uint64 buf[B];
+                double u[B];
+                while (n > 0)
+                    {
+                    const size_t m = (n < B) ? n : B;
+                    internals_random::unifBlock(gen, buf, u, m);
+                    for (size_t k = 0; k < m; k++) { out[k] = -log(1 - u[k]) / l; }
+                    out += m;
+                    n -= m;
+                    }
+                return;
+                }
+            const internals_random::ZigguratTables & T = *_zig;
+            const double il = 1.0 / l;
+            internals_random::zigguratFill(gen, out, n, [&T, il](uint64 u, random_t & g) { return internals_random::zigguratExponential(T, u, g)*il; });
+            }
+
+
+        /* return true if the ziggurat method is used */
+        bool ziggurat() const { return (_zig != nullptr); }
 
 
     private:
         double l;
+        const internals_random::ZigguratTables * _zig;
     };
 
 
@@ -442,6 +1026,31 @@ namespace mtools
                 }
 
 
+            /**
+             * Fill an array with independent samples (same values as calling operator() n times). For
+             * alpha < 0.6, the uniforms are drawn by blocks and inverted in a vectorizable loop.
+             *
+             * @param [in,out]  gen The random generator.
+             * @param [in,out]  out pointer to the array to fill.
+             * @param           n   number of samples.
+             **/
+            template<class random_t> void fill(random_t & gen, int64 * out, size_t n) const
+                {
+                if (a >= 0.6) { for (size_t k = 0; k < n; k++) { out[k] = operator()(gen); } return; }
+                const size_t B = internals_random::FILL_BLOCK;
+                uint64 buf[B];
+                double u[B];
+                while (n > 0)
+                    {
+                    const size_t m = (n < B) ? n : B;
+                    internals_random::unifBlock(gen, buf, u, m);
+                    for (size_t k = 0; k < m; k++) { out[k] = 1 + (int64)floor(-log(1 - u[k]) / l); }
+                    out += m;
+                    n -= m;
+                    }
+                }
+
+
         private:
             double a,l;
         };
@@ -457,7 +1066,10 @@ namespace mtools
      * 
      * The expectation of X is thus E[X] = m and variance = sigma2.
      * 
-     * Use numerical recipes rejection method instead of the classic Box-Muller algorithm.
+     * Use numerical recipes rejection method instead of the classic Box-Muller algorithm. If the
+     * flag ziggurat is set in the constructor, the ziggurat method is used instead: it requires a
+     * single 64 bits random number and no call to log() or sqrt() for ~99% of the samples (but the
+     * sequence obtained differs from the one obtained with the rejection method).
      **/
     class NormalLaw
     {
@@ -469,7 +1081,7 @@ namespace mtools
          * @param   m       mean of the r.v.
          * @param   sigma2  variance of the r.v.
         **/
-        NormalLaw(double m = 0.0, double sigma2 = 1.0) { setParam(m, sigma2); }
+        NormalLaw(double m = 0.0, double sigma2 = 1.0, bool ziggurat = false) : _zig(ziggurat ? &internals_random::zigguratNormalTables() : nullptr) { setParam(m, sigma2); }
 
 
         /**
@@ -490,6 +1102,7 @@ namespace mtools
         **/
 		template<class random_t> inline double operator()(random_t & gen) const 
             {
+            if (_zig != nullptr) return mu + sig*internals_random::zigguratNormal(*_zig, Unif_64(gen), gen);
             double u, v, x, y, q;
             do {
                 u = Unif(gen); v = 1.7156*(Unif(gen) - 0.5);
@@ -501,8 +1114,31 @@ namespace mtools
             }
 
 
+        /**
+         * Fill an array with independent samples. With the ziggurat method, the random numbers are
+         * fetched from the generator by blocks (see fillRandom()). The rejection method consumes a
+         * random number of uniforms per sample so it simply calls operator() n times.
+         *
+         * @param [in,out]  gen the random number generator.
+         * @param [in,out]  out pointer to the array to fill.
+         * @param           n   number of samples.
+         **/
+        template<class random_t> void fill(random_t & gen, double * out, size_t n) const
+            {
+            if (_zig == nullptr) { for (size_t k = 0; k < n; k++) { out[k] = operator()(gen); } return; }
+            const internals_random::ZigguratTables & T = *_zig;
+            const double m = mu, s = sig;
+            internals_random::zigguratFill(gen, out, n, [&T, m, s](uint64 u, random_t & g) { return m + s*internals_random::zigguratNormal(T, u, g); });
+            }
+
+
+        /* return true if the ziggurat method is used */
+        bool ziggurat() const { return (_zig != nullptr); }
+
+
     private:
         double mu, sig;
+        const internals_random::ZigguratTables * _zig;
     };
 
 
@@ -579,6 +1215,37 @@ namespace mtools
             }
 
 
+        /**
+         * Fill an array with independent samples (same values as calling operator() n times). The
+         * uniforms are drawn by blocks and the Chambers-Mallows-Stuck transform is applied in a
+         * separate loop without calls to the generator.
+         *
+         * @param [in,out]  gen the random number generator.
+         * @param [in,out]  out pointer to the array to fill.
+         * @param           n   number of samples.
+         **/
+        template<class random_t> void fill(random_t & gen, double * out, size_t n) const
+            {
+            const size_t B = internals_random::FILL_BLOCK;
+            uint64 buf[2*B];
+            double u[2*B];
+            while (n > 0)
+                {
+                const size_t m = (n < B) ? n : B;
+                internals_random::unifBlock(gen, buf, u, 2*m);
+                for (size_t k = 0; k < m; k++)
+                    {
+                    const double U = PI*(u[2*k] - 0.5);
+                    const double W = -log(1 - u[2*k + 1]);
+                    const double X = S*(sin(p_alpha*(U + xi)) / pow(cos(U), ialpha))*pow(cos(U - p_alpha*(U + xi)) / W, talpha);
+                    out[k] = p_C*X + p_m;
+                    }
+                out += m;
+                n -= m;
+                }
+            }
+
+
     private:
 
         double p_alpha,p_beta,p_C,p_m;
@@ -649,6 +1316,36 @@ namespace mtools
             }
 
 
+        /**
+         * Fill an array with independent samples (same values as calling operator() n times). The
+         * uniforms are drawn by blocks and transformed in a separate loop.
+         *
+         * @param [in,out]  gen the random number generator.
+         * @param [in,out]  out pointer to the array to fill.
+         * @param           n   number of samples.
+         **/
+        template<class random_t> void fill(random_t & gen, double * out, size_t n) const
+            {
+            const size_t B = internals_random::FILL_BLOCK;
+            uint64 buf[2*B];
+            double u[2*B];
+            while (n > 0)
+                {
+                const size_t m = (n < B) ? n : B;
+                internals_random::unifBlock(gen, buf, u, 2*m);
+                for (size_t k = 0; k < m; k++)
+                    {
+                    const double U = PI*(u[2*k] - 0.5);
+                    const double W = -log(1 - u[2*k + 1]);
+                    const double X = (2/PI)*((PI/2 + p_beta*U)*tan(U) - p_beta*log(((PI/2)*W*cos(U)) / (PI/2 + p_beta*U)));
+                    out[k] = p_C*X + mm;
+                    }
+                out += m;
+                n -= m;
+                }
+            }
+
+
     private:
 
         double p_beta,p_C,p_m,mm;
@@ -718,6 +1415,12 @@ namespace mtools
                 }
 
 
+            /**
+             * Fill an array with independent samples (same as calling operator() n times).
+             **/
+            template<class random_t> void fill(random_t & gen, double * out, size_t n) { for (size_t k = 0; k < n; k++) { out[k] = operator()(gen); } }
+
+
         private:
 
             NormalLaw normale;
@@ -769,6 +1472,12 @@ namespace mtools
             template<class random_t> inline double operator()(random_t & gen) { double x = G1(gen); double y = G2(gen); return x / (x + y); }
 
 
+            /**
+             * Fill an array with independent samples (same as calling operator() n times).
+             **/
+            template<class random_t> void fill(random_t & gen, double * out, size_t n) { for (size_t k = 0; k < n; k++) { out[k] = operator()(gen); } }
+
+
         private:
 
             GammaLaw G1, G2;
@@ -780,7 +1489,10 @@ namespace mtools
     /**
     * create a Poisson random variable.
     *
-    * Taken from numerical recipes
+    * - lambda < 10 : multiplication of uniforms (expected cost lambda + 1).
+    * - otherwise : PTRS transformed rejection method of Hoermann (1993) whose constants are
+    *   computed once in setParam(). The expected cost of a draw is bounded independently of
+    *   lambda.
     **/
     class PoissonLaw
         {
@@ -792,7 +1504,7 @@ namespace mtools
              *
              * @param   lambdaa parameter lambda.
              **/
-            PoissonLaw(double lambdaa) : lambold(-1.), logfact(1024, -1.) { setParam(lambdaa); }
+            PoissonLaw(double lambdaa) { setParam(lambdaa); }
 
 
             /**
@@ -800,7 +1512,18 @@ namespace mtools
              *
              * @param   lambdaa parameter lambda.
              **/
-            void setParam(double lambdaa) { lambda = lambdaa; }
+            void setParam(double lambdaa)
+                {
+                MTOOLS_ASSERT(lambdaa >= 0.0);
+                lambda = lambdaa;
+                lamexp = loglam = a = b = loginvalpha = vr = 0.0; // only the constants of the method used are set below
+                if (lambda < 10.0) { lamexp = exp(-lambda); return; }
+                loglam = log(lambda);
+                b = 0.931 + 2.53*sqrt(lambda);
+                a = -0.059 + 0.02483*b;
+                loginvalpha = log(1.1239 + 1.1328 / (b - 3.4));
+                vr = 0.9277 - 3.6224 / (b - 2);
+                }
 
 
             /**
@@ -810,53 +1533,135 @@ namespace mtools
             *
             * @return  the random variable
             **/
-            template<class random_t> double operator()(random_t & gen)
+            template<class random_t> double operator()(random_t & gen) const
                 {
-                double u, u2, v, v2=0;
-				double p, t, lfac;
-                int k;
-                if (lambda < 5.) 
+                if (lambda < 10.0)
                     {
-                    if (lambda != lambold) lamexp = exp(-lambda);
-                    k = -1; t = 1.;
+                    int64 k = -1; double t = 1.;
                     do { ++k; t *= Unif(gen); } while (t > lamexp);
+                    return (double)k;
                     }
-                else 
+                while (1)
                     {
-                    if (lambda != lambold) { sqlam = sqrt(lambda); loglam = log(lambda); }
-                    for (;;) 
-                        {
-                        u = 0.64*Unif(gen); v = -0.68 + 1.28*Unif(gen);
-                        if (lambda > 13.5) 
-                            {
-                            v2 = v*v;
-                            if (v >= 0.) { if (v2 > 6.5*u*(0.64 - u)*(u + 0.2)) continue; } else { if (v2 > 9.6*u*(0.66 - u)*(u + 0.07)) continue; }
-                            }
-                        k = int(floor(sqlam*(v / u) + lambda + 0.5));
-                        if (k < 0) continue;
-                        u2 = u*u;
-                        if (lambda > 13.5) 
-                            {
-                            if (v >= 0.) { if (v2 < 15.2*u2*(0.61 - u)*(0.8 - u)) break; } else { if (v2 < 6.76*u2*(0.62 - u)*(1.4 - u)) break; }
-                            }
-                        if (k < 1024) 
-                            {
-                            if (logfact[k] < 0.) logfact[k] = gammln(k + 1.);
-                            lfac = logfact[k];
-                            }
-                        else lfac = gammln(k + 1.);
-                        p = sqlam*exp(-lambda + k*loglam - lfac);
-                        if (u2 < p) break;
-                        }
+                    const double U = Unif(gen) - 0.5;
+                    const double V = Unif(gen);
+                    const double us = 0.5 - fabs(U);
+                    const double k = floor((2 * a / us + b)*U + lambda + 0.43);
+                    if ((us >= 0.07) && (V <= vr)) return k; // immediate acceptance
+                    if ((k < 0) || ((us < 0.013) && (V > us))) continue;
+                    if ((log(V) + loginvalpha - log(a / (us*us) + b)) <= (-lambda + k*loglam - factln((int64)k))) return k;
                     }
-                lambold = lambda;
-                return k;
                 }
 
+
+            /**
+             * Fill an array with independent samples (same as calling operator() n times).
+             **/
+            template<class random_t> void fill(random_t & gen, double * out, size_t n) const { for (size_t k = 0; k < n; k++) { out[k] = operator()(gen); } }
+
+        private:
+
+            double lambda, lamexp, loglam, a, b, loginvalpha, vr;
+
+        };
+
+
+
+    /**
+    * create an Hypergeometric random variable: the number of white balls obtained when drawing
+    * (without replacement) nsample balls from an urn containing ngood white balls and nbad black
+    * balls.
+    *
+    * - nsample < 10 : sequential draws.
+    * - otherwise : HRUA ratio of uniforms method of Stadlober (1989) whose constants are computed
+    *   once in setParam(). The expected cost of a draw is bounded independently of the parameters.
+    **/
+    class HypergeometricLaw
+        {
+
+        public:
+
+            /**
+             * Constructor. Set the parameters.
+             *
+             * @param   ngood   number of white balls.
+             * @param   nbad    number of black balls.
+             * @param   nsample number of balls drawn (at most ngood + nbad).
+             **/
+            HypergeometricLaw(int64 ngood, int64 nbad, int64 nsample) { setParam(ngood, nbad, nsample); }
+
+
+            /**
+             * Set the parameters.
+             *
+             * @param   ngood   number of white balls.
+             * @param   nbad    number of black balls.
+             * @param   nsample number of balls drawn (at most ngood + nbad).
+             **/
+            void setParam(int64 ngood, int64 nbad, int64 nsample)
+                {
+                MTOOLS_INSURE((ngood >= 0) && (nbad >= 0) && (nsample >= 0) && (nsample <= ngood + nbad));
+                good = ngood; bad = nbad; sample = nsample;
+                if (sample < 10) return;
+                const int64 popsize = good + bad;
+                mingoodbad = std::min<int64>(good, bad);
+                maxgoodbad = std::max<int64>(good, bad);
+                m = std::min<int64>(sample, popsize - sample);
+                const double d4 = ((double)mingoodbad) / popsize;
+                const double d5 = 1.0 - d4;
+                d6 = m*d4 + 0.5;
+                const double d7 = sqrt((double)(popsize - m)*sample*d4*d5 / (popsize - 1) + 0.5);
+                d8 = 1.7155277699214135*d7 + 0.8989161620588988;
+                const int64 d9 = (int64)floor((double)(m + 1)*(mingoodbad + 1) / (popsize + 2));
+                d10 = factln(d9) + factln(mingoodbad - d9) + factln(m - d9) + factln(maxgoodbad - m + d9);
+                d11 = std::min<double>(std::min<int64>(m, mingoodbad) + 1.0, floor(d6 + 16 * d7));
+                }
+
+
+            /**
+            * Generate an Hypergeometric random variable.
+            *
+            * @param [in,out]  gen The random number generator.
+            *
+            * @return  the random variable
+            **/
+            template<class random_t> int64 operator()(random_t & gen) const
+                {
+                if (sample < 10)
+                    { // sequential draws
+                    int64 w = 0, g = good, t = good + bad;
+                    for (int64 i = 0; i < sample; i++) { if (Unif(gen)*t < g) { w++; g--; } t--; }
+                    return w;
+                    }
+                int64 Z;
+                while (1)
+                    {
+                    const double X = Unif(gen);
+                    const double Y = Unif(gen);
+                    const double W = d6 + d8*(Y - 0.5) / X;
+                    if ((W < 0.0) || (W >= d11)) continue;
+                    Z = (int64)floor(W);
+                    const double T = d10 - (factln(Z) + factln(mingoodbad - Z) + factln(m - Z) + factln(maxgoodbad - m + Z));
+                    if ((X*(4.0 - X) - 3.0) <= T) break;
+                    if (X*(X - T) >= 1) continue;
+                    if (X > 0.0) { if (2.0*log(X) <= T) break; }
+                    }
+                if (good > bad) Z = m - Z;
+                if (m < sample) Z = good - Z;
+                return Z;
+                }
+
+
+
+            /**
+             * Fill an array with independent samples (same as calling operator() n times).
+             **/
+            template<class random_t> void fill(random_t & gen, int64 * out, size_t n) const { for (size_t k = 0; k < n; k++) { out[k] = operator()(gen); } }
+
         private:
 
-            double lambda, sqlam, loglam, lamexp, lambold;
-            std::vector<double> logfact;
+            int64 good, bad, sample, mingoodbad, maxgoodbad, m;
+            double d6, d8, d10, d11;
 
         };
 
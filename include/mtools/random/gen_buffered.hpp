@@ -0,0 +1,204 @@
+/** @file gen_buffered.hpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "../misc/internal/mtools_export.hpp"
+#include "../misc/misc.hpp"
+#include "../misc/error.hpp"
+#include "../io/serialization.hpp"
+
+#include <cstddef>
+
+
+namespace mtools
+{
+
+
+    namespace internals_random
+    {
+
+        /* use the fill() method of the generator when it exists */
+        template<class random_t> inline auto _fillRandom(random_t & gen, typename random_t::result_type * out, size_t n, int) -> decltype(gen.fill(out, n), void())
+            {
+            gen.fill(out, n);
+            }
+
+        /* otherwise, call operator() repeatedly */
+        template<class random_t> inline void _fillRandom(random_t & gen, typename random_t::result_type * out, size_t n, long)
+            {
+            for (size_t k = 0; k < n; k++) { out[k] = gen(); }
+            }
+
+    }
+
+
+    /**
+     * Fill an array with random numbers from a generator. Use the bulk method gen.fill() when the
+     * generator provides one (MT2004_64, MT2002_32, XorGen4096_64, FastRNG) and call gen() repeatedly
+     * otherwise. In both cases, the sequence obtained is the same as with n calls to gen().
+     *
+     * @param [in,out]  gen The random number generator.
+     * @param [in,out]  out pointer to the array to fill.
+     * @param           n   number of random numbers to generate.
+     **/
+    template<class random_t> inline void fillRandom(random_t & gen, typename random_t::result_type * out, size_t n)
+        {
+        internals_random::_fillRandom(gen, out, n, 0);
+        }
+
+
+    /**
+     * Buffered adapter around a random number generator.
+     *
+     * The adapter prefetches blocks of BUFSIZE numbers from the underlying generator with
+     * fillRandom() and then serves them one by one. It is itself a random number generator (same
+     * result_type, min() and max() as random_t) so it can be used everywhere a generator is expected,
+     * in particular with Unif(), NormalLaw, ExponentialLaw... For example:
+     *
+     *     MT2004_64 gen;
+     *     BufferedGen<MT2004_64> bgen(gen);
+     *     NormalLaw N(0, 1);
+     *     double x = N(bgen);
+     *
+     * The sequence of numbers returned by the adapter is exactly the sequence returned by the
+     * underlying generator. However, since the numbers are prefetched, the underlying generator is
+     * ahead of the adapter: one should not use it directly while the adapter is in use (or call
+     * flush() first, which discards the prefetched numbers).
+     *
+     * @tparam  random_t    Type of the underlying random number generator.
+     * @tparam  BUFSIZE     Number of random numbers prefetched at once.
+     **/
+    template<class random_t, size_t BUFSIZE = 1024> class BufferedGen
+    {
+
+        static_assert(BUFSIZE > 0, "the buffer size must be positive");
+
+    public:
+
+        /* type of integer returned by the generator */
+        typedef typename random_t::result_type result_type;
+
+
+        /* min value */
+        static constexpr result_type min() { return random_t::min(); }
+
+
+        /* max value */
+        static constexpr result_type max() { return random_t::max(); }
+
+
+        /**
+         * Constructor. The underlying generator must outlive the adapter.
+         *
+         * @param [in,out]  gen The underlying random number generator.
+         **/
+        BufferedGen(random_t & gen) : _gen(gen), _pos(BUFSIZE) {}
+
+
+        /* return a random number */
+        inline result_type operator()()
+            {
+            if (_pos == BUFSIZE) _refill();
+            return _buf[_pos++];
+            }
+
+
+        /* discard results */
+        void discard(unsigned long long z) { for (unsigned long long i = 0; i < z; i++) operator()(); }
+
+
+        /**
+         * Fill an array with random numbers. Same as calling operator() n times. Large requests are
+         * forwarded directly to the underlying generator once the buffer is empty.
+         *
+         * @param [in,out]  out pointer to the array to fill.
+         * @param           n   number of random numbers to generate.
+         **/
+        void fill(result_type * out, size_t n)
+            {
+            while ((n > 0) && (_pos < BUFSIZE)) { *(out++) = _buf[_pos++]; n--; }
+            if (n >= BUFSIZE) { fillRandom(_gen, out, n); return; }
+            for (size_t k = 0; k < n; k++) { out[k] = operator()(); }
+            }
+
+
+        /**
+         * Discard the prefetched numbers. After this call, the next number returned by the adapter is
+         * the next number returned by the underlying generator.
+         **/
+        void flush() { _pos = BUFSIZE; }
+
+
+        /* number of prefetched numbers still available in the buffer */
+        size_t available() const { return (BUFSIZE - _pos); }
+
+
+        /* return a reference to the underlying generator */
+        random_t & gen() { return _gen; }
+
+
+        /**
+         * Serialize the prefetched numbers. The underlying generator is not saved: serialize it
+         * separately (it is ahead of the adapter by available() numbers).
+         **/
+        void serialize(OBaseArchive & ar) const
+            {
+            ar << "BufferedGen";
+            ar & ((uint64)available());
+            ar.opaqueArray(_buf + _pos, available());
+            }
+
+
+        /**
+         * Restore the prefetched numbers saved with serialize().
+         **/
+        void deserialize(IBaseArchive & ar)
+            {
+            uint64 n; ar & n;
+            if (n > BUFSIZE) { MTOOLS_THROW("BufferedGen::deserialize() : buffer too large"); }
+            _pos = BUFSIZE - (size_t)n;
+            ar.opaqueArray(_buf + _pos, (size_t)n);
+            }
+
+
+    private:
+
+        BufferedGen(const BufferedGen &) = delete;                 // no copy
+        BufferedGen & operator=(const BufferedGen &) = delete;     //
+
+        /* prefetch a new block */
+        void _refill()
+            {
+            fillRandom(_gen, _buf, BUFSIZE);
+            _pos = 0;
+            }
+
+        random_t &      _gen;           // the underlying generator
+        size_t          _pos;           // position of the next number in the buffer
+        result_type     _buf[BUFSIZE];  // the prefetched numbers
+
+    };
+
+
+}
+
+
+/* end of file */
+
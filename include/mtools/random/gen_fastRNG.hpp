@@ -21,6 +21,7 @@
 
 #include "../misc/internal/mtools_export.hpp"
 #include "../misc/misc.hpp" 
+#include "internal/genstate.hpp"
 
 namespace mtools
     {
@@ -64,6 +65,46 @@ namespace mtools
             void discard(unsigned long long z) { for (unsigned long long i = 0; i < z; i++) operator()(); }
 
 
+            /**
+             * Fill an array with random numbers. Same as calling operator() n times (the sequence
+             * obtained is identical) but the state is kept in registers during the loop.
+             *
+             * @param [in,out]  out pointer to the array to fill.
+             * @param           n   number of random numbers to generate.
+             **/
+            void fill(uint32 * out, size_t n)
+                {
+                uint32 x = _gen_x, y = _gen_y, z = _gen_z, t;
+                for (size_t k = 0; k < n; k++)
+                    {
+                    x ^= x << 16; x ^= x >> 5; x ^= x << 1;
+                    t = x; x = y; y = z; z = t ^ x ^ y;
+                    out[k] = z;
+                    }
+                _gen_x = x; _gen_y = y; _gen_z = z;
+                }
+
+
+            /* serialize the whole state of the generator (see MT2004_64::serialize()) */
+            void serialize(OBaseArchive & ar) const
+                {
+                internals_random::writeStateHeader(ar, "FastRNG", (uint64)3);
+                ar & _gen_x; ar & _gen_y; ar & _gen_z;
+                }
+
+
+            /* restore a state saved with serialize() */
+            void deserialize(IBaseArchive & ar)
+                {
+                internals_random::readStateHeader(ar, "FastRNG", (uint64)3);
+                ar & _gen_x; ar & _gen_y; ar & _gen_z;
+                }
+
+
+            /* hash of the state of the generator (for checking a restored state) */
+            uint64 stateHash() const { return internals_random::hashState(&_gen_z, 1, internals_random::hashState(&_gen_y, 1, internals_random::hashState(&_gen_x, 1, 0))); }
+
+
             /**
              * Change the seed. This does nothing here (kept for compatibility purposes).
              **/
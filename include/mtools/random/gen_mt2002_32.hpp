@@ -57,6 +57,9 @@
 #include "../misc/internal/mtools_export.hpp"
 #include "../misc/misc.hpp" 
 #include "../misc/timefct.hpp"
+#include "../misc/error.hpp"
+#include "internal/gf2poly.hpp"
+#include "internal/genstate.hpp"
 
 
 namespace mtools
@@ -91,6 +94,93 @@ namespace mtools
         void discard(unsigned long long z) { for(unsigned long long i = 0; i < z; i++) operator()(); }
 
 
+        /**
+         * Fill an array with random numbers. Same as calling operator() n times (the sequence obtained
+         * is identical) but faster: the whole state is regenerated at once and the tempering is applied
+         * on contiguous chunks. Both loops are branchless so the compiler can vectorize them.
+         *
+         * @param [in,out]  out pointer to the array to fill.
+         * @param           n   number of random numbers to generate.
+         **/
+        void fill(uint32 * out, size_t n)
+            {
+            while (n > 0)
+                {
+                if (mti >= N) twist();
+                size_t m = (size_t)(N - mti); if (m > n) m = n;
+                const uint32 * p = mt + mti;
+                for (size_t k = 0; k < m; k++) { out[k] = temper(p[k]); }
+                mti += (int)m; out += m; n -= m;
+                }
+            }
+
+
+        /* log2 of the length of the streams obtained with split() */
+        static const int SPLIT_LOG2 = 128;
+
+
+        /**
+         * Jump ahead: same as discard(n) (the numbers generated afterwards are identical) but the cost
+         * does not depend on n. The jump is computed with the characteristic polynomial of the generator
+         * (computed once with Berlekamp-Massey and cached): g(x) = x^n mod P(x) is evaluated on the
+         * state. Each jump costs a few milliseconds so small values of n are simply discarded.
+         *
+         * @param   n   number of random numbers to skip.
+         **/
+        void jump(uint64 n)
+            {
+            if (n <= JUMP_DISCARD) { discard(n); return; }
+            jumpPoly(internals_random::GF2Poly::powXmod(n, charPoly()));
+            }
+
+
+        /**
+         * Jump ahead of 2^k random numbers. Same as jump(2^k) but also works for k >= 64.
+         *
+         * @param   k   log2 of the number of random numbers to skip.
+         **/
+        void jumpPow2(unsigned int k)
+            {
+            if ((k < 64) && ((1ULL << k) <= JUMP_DISCARD)) { discard(1ULL << k); return; }
+            jumpPoly(internals_random::GF2Poly::powX2mod(k, charPoly()));
+            }
+
+
+        /**
+         * Move to independent stream number streamId: jump ahead of streamId * 2^SPLIT_LOG2 random
+         * numbers. See MT2004_64::split().
+         *
+         * @param   streamId    Identifier of the stream.
+         **/
+        void split(uint64 streamId)
+            {
+            if (streamId == 0) return;
+            jumpPoly(internals_random::GF2Poly::powmod(splitPoly(), streamId, charPoly()));
+            }
+
+
+        /* serialize the whole state of the generator (see MT2004_64::serialize()) */
+        void serialize(OBaseArchive & ar) const
+            {
+            internals_random::writeStateHeader(ar, "MT2002_32", (uint64)N);
+            ar & mti;
+            ar.opaqueArray(mt, N);
+            }
+
+
+        /* restore a state saved with serialize() */
+        void deserialize(IBaseArchive & ar)
+            {
+            internals_random::readStateHeader(ar, "MT2002_32", (uint64)N);
+            ar & mti;
+            ar.opaqueArray(mt, N);
+            }
+
+
+        /* hash of the state of the generator (for checking a restored state) */
+        uint64 stateHash() const { return internals_random::hashState(mt, N, (uint64)mti); }
+
+
         /* change the seed */
         void seed(result_type s) { mti = N + 1; init_genrand(s); }
 
@@ -154,28 +244,30 @@ namespace mtools
             mt[0] = 0x80000000UL;
             }
 
-        inline uint32 randproc(void)
+        /* generates N words at one time (mag01[y&1] is computed with a mask instead of a lookup so the loops vectorize) */
+        inline void twist()
             {
+            int kk;
             uint32 y;
-            const static uint32 mag01[2]={0x0UL, MATRIX_A};
-            if (mti >= N)
+            for (kk=0;kk<N-M;kk++)
+                {
+                y = (mt[kk]&UPPER_MASK)|(mt[kk+1]&LOWER_MASK);
+                mt[kk] = mt[kk+M] ^ (y >> 1) ^ ((0UL - (y & 0x1UL)) & MATRIX_A);
+                }
+            for (;kk<N-1;kk++)
                 {
-                int kk;
-                for (kk=0;kk<N-M;kk++)
-                    {
-                    y = (mt[kk]&UPPER_MASK)|(mt[kk+1]&LOWER_MASK);
-                    mt[kk] = mt[kk+M] ^ (y >> 1) ^ mag01[y & 0x1UL];
-                    }
-                for (;kk<N-1;kk++)
-                    {
-                    y = (mt[kk]&UPPER_MASK)|(mt[kk+1]&LOWER_MASK);
-                    mt[kk] = mt[kk+(M-N)] ^ (y >> 1) ^ mag01[y & 0x1UL];
-                    }
-                y = (mt[N-1]&UPPER_MASK)|(mt[0]&LOWER_MASK);
-                mt[N-1] = mt[M-1] ^ (y >> 1) ^ mag01[y & 0x1UL];
-                mti = 0;
+                y = (mt[kk]&UPPER_MASK)|(mt[kk+1]&LOWER_MASK);
+                mt[kk] = mt[kk+(M-N)] ^ (y >> 1) ^ ((0UL - (y & 0x1UL)) & MATRIX_A);
                 }
-            y = mt[mti++];
+            y = (mt[N-1]&UPPER_MASK)|(mt[0]&LOWER_MASK);
+            mt[N-1] = mt[M-1] ^ (y >> 1) ^ ((0UL - (y & 0x1UL)) & MATRIX_A);
+            mti = 0;
+            }
+
+
+        /* tempering */
+        static inline uint32 temper(uint32 y)
+            {
             y ^= (y >> 11);
             y ^= (y << 7) & 0x9d2c5680UL;
             y ^= (y << 15) & 0xefc60000UL;
@@ -183,6 +275,58 @@ namespace mtools
             return y;
             }
 
+
+        /* generates a random number on [0, 2^32-1]-interval */
+        inline uint32 randproc(void)
+            {
+            if (mti >= N) twist();
+            return temper(mt[mti++]);
+            }
+
+
+        /* one step of the generator in canonical form (for internals_random::applyJumpPoly()) */
+        struct LinearStep
+            {
+            inline void operator()(uint32 * b, int & p) const
+                {
+                const int p1 = (p + 1 == N) ? 0 : (p + 1);
+                const int pm = (p + M >= N) ? (p + M - N) : (p + M);
+                const uint32 y = (b[p] & UPPER_MASK) | (b[p1] & LOWER_MASK);
+                b[p] = b[pm] ^ (y >> 1) ^ ((0UL - (y & 0x1UL)) & MATRIX_A);
+                p = p1;
+                }
+            };
+
+
+        /* characteristic polynomial of the generator (computed on first use) */
+        static const internals_random::GF2Poly & charPoly()
+            {
+            static const internals_random::GF2Poly P = []()
+                {
+                MT2002_32 g(5489UL);
+                internals_random::GF2Poly Q = internals_random::charPolyLFSR<uint32, N>(g.mt, DIM, LinearStep());
+                MTOOLS_INSURE(Q.degree() == DIM);
+                return Q;
+                }();
+            return P;
+            }
+
+
+        /* x^(2^SPLIT_LOG2) mod P (computed on first use) */
+        static const internals_random::GF2Poly & splitPoly()
+            {
+            static const internals_random::GF2Poly S = internals_random::GF2Poly::powX2mod(SPLIT_LOG2, charPoly());
+            return S;
+            }
+
+
+        /* apply a jump polynomial (same method as MT2004_64::jumpPoly(): mti is unchanged) */
+        void jumpPoly(const internals_random::GF2Poly & g)
+            {
+            MTOOLS_ASSERT(mti > 0);
+            internals_random::applyJumpPoly<uint32, N>(mt, g, LinearStep());
+            }
+
     
 
     /* some constants */
@@ -191,6 +335,8 @@ namespace mtools
     static const uint32 MATRIX_A = 0x9908b0dfUL;
     static const uint32 UPPER_MASK = 0x80000000UL;
     static const uint32 LOWER_MASK = 0x7fffffffUL;
+    static const int DIM = 19937;               // dimension of the state space
+    static const uint64 JUMP_DISCARD = 65536;   // smaller jumps are done with discard()
 
     /* state of the generator */
     uint32 mt[N]; /* the array for the state vector  */
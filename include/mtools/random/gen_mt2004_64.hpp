@@ -56,6 +56,9 @@
 #include "../misc/internal/mtools_export.hpp"
 #include "../misc/misc.hpp"
 #include "../misc/timefct.hpp"
+#include "../misc/error.hpp"
+#include "internal/gf2poly.hpp"
+#include "internal/genstate.hpp"
 
 
 namespace mtools
@@ -93,6 +96,108 @@ namespace mtools
         void discard(unsigned long long z) { for (unsigned long long i = 0; i < z; i++) operator()(); }
 
 
+        /**
+         * Fill an array with random numbers. Same as calling operator() n times (the sequence obtained
+         * is identical) but faster: the whole state is regenerated at once and the tempering is applied
+         * on contiguous chunks. Both loops are branchless so the compiler can vectorize them.
+         *
+         * @param [in,out]  out pointer to the array to fill.
+         * @param           n   number of random numbers to generate.
+         **/
+        void fill(uint64 * out, size_t n)
+            {
+            while (n > 0)
+                {
+                if (mti >= NN) twist();
+                size_t m = (size_t)(NN - mti); if (m > n) m = n;
+                const uint64 * p = mt + mti;
+                for (size_t k = 0; k < m; k++) { out[k] = temper64(p[k]); }
+                mti += (int)m; out += m; n -= m;
+                }
+            }
+
+
+        /* log2 of the length of the streams obtained with split() */
+        static const int SPLIT_LOG2 = 128;
+
+
+        /**
+         * Jump ahead: same as discard(n) (the numbers generated afterwards are identical) but the cost does not
+         * depend on n. The jump is computed with the characteristic polynomial of the generator
+         * (computed once with Berlekamp-Massey and cached): g(x) = x^n mod P(x) is evaluated on the
+         * state. Each jump costs a few milliseconds so small values of n are simply discarded.
+         *
+         * @param   n   number of random numbers to skip.
+         **/
+        void jump(uint64 n)
+            {
+            if (n <= JUMP_DISCARD) { discard(n); return; }
+            jumpPoly(internals_random::GF2Poly::powXmod(n, charPoly()));
+            }
+
+
+        /**
+         * Jump ahead of 2^k random numbers. Same as jump(2^k) but also works for k >= 64.
+         *
+         * @param   k   log2 of the number of random numbers to skip.
+         **/
+        void jumpPow2(unsigned int k)
+            {
+            if ((k < 64) && ((1ULL << k) <= JUMP_DISCARD)) { discard(1ULL << k); return; }
+            jumpPoly(internals_random::GF2Poly::powX2mod(k, charPoly()));
+            }
+
+
+        /**
+         * Move to independent stream number streamId: jump ahead of streamId * 2^SPLIT_LOG2 random
+         * numbers. Starting from generators with the same state, the streams obtained for different
+         * ids (one per thread or MPI rank) do not overlap as long as each stream uses less than
+         * 2^SPLIT_LOG2 numbers. The result only depends on the initial state and on streamId so the
+         * parallel simulations are reproducible. For example:
+         *
+         *     MT2004_64 gen(seed);     // same seed for all workers
+         *     gen.split(rank);         // now a non-overlapping stream for each worker
+         *
+         * @param   streamId    Identifier of the stream.
+         **/
+        void split(uint64 streamId)
+            {
+            if (streamId == 0) return;
+            jumpPoly(internals_random::GF2Poly::powmod(splitPoly(), streamId, charPoly()));
+            }
+
+
+        /**
+         * Serialize the full state of the generator (as an opaque array). Restoring it with
+         * deserialize() gives back exactly the same sequence of random numbers, so a simulation saved
+         * together with its generator resumes bit-exactly.
+         **/
+        void serialize(OBaseArchive & ar) const
+            {
+            internals_random::writeStateHeader(ar, "MT2004_64", (uint64)NN);
+            ar & mti;
+            ar.opaqueArray(mt, NN);
+            }
+
+
+        /**
+         * Deserialize the state of the generator from an archive created with serialize().
+         **/
+        void deserialize(IBaseArchive & ar)
+            {
+            internals_random::readStateHeader(ar, "MT2004_64", (uint64)NN);
+            ar & mti;
+            ar.opaqueArray(mt, NN);
+            }
+
+
+        /**
+         * Hash of the state of the generator. Two generators with the same hash produce (with
+         * overwhelming probability) the same sequence: use it to check a restored state.
+         **/
+        uint64 stateHash() const { return internals_random::hashState(mt, NN, (uint64)mti); }
+
+
         /* change the seed */
         void seed(result_type s) { mti = NN + 1; init_genrand64(s); }
 
@@ -155,21 +260,22 @@ namespace mtools
     }
 
 
-    /* generates a random number on [0, 2^64-1]-interval */
-    inline uint64 randproc64(void)
+    /* generates NN words at one time (mag01[x&1] is computed with a mask instead of a lookup so the loops vectorize) */
+    inline void twist()
     {
         int i;
         uint64 x;
-        const static uint64 mag01[2]={0ULL, MATRIX_A};
-        if (mti >= NN)
-            {
-            for (i=0;i<NN-MM;i++) {x = (mt[i]&UM)|(mt[i+1]&LM); mt[i] = mt[i+MM] ^ (x>>1) ^ mag01[(int)(x&1ULL)];}
-            for (;i<NN-1;i++) { x = (mt[i]&UM)|(mt[i+1]&LM); mt[i] = mt[i+(MM-NN)] ^ (x>>1) ^ mag01[(int)(x&1ULL)];}
-            x = (mt[NN-1]&UM)|(mt[0]&LM);
-            mt[NN-1] = mt[MM-1] ^ (x>>1) ^ mag01[(int)(x&1ULL)];
-            mti = 0;
-            }
-        x = mt[mti++];
+        for (i=0;i<NN-MM;i++) {x = (mt[i]&UM)|(mt[i+1]&LM); mt[i] = mt[i+MM] ^ (x>>1) ^ ((0ULL - (x&1ULL)) & MATRIX_A);}
+        for (;i<NN-1;i++) { x = (mt[i]&UM)|(mt[i+1]&LM); mt[i] = mt[i+(MM-NN)] ^ (x>>1) ^ ((0ULL - (x&1ULL)) & MATRIX_A);}
+        x = (mt[NN-1]&UM)|(mt[0]&LM);
+        mt[NN-1] = mt[MM-1] ^ (x>>1) ^ ((0ULL - (x&1ULL)) & MATRIX_A);
+        mti = 0;
+    }
+
+
+    /* tempering */
+    static inline uint64 temper64(uint64 x)
+    {
         x ^= (x >> 29) & 0x5555555555555555ULL;
         x ^= (x << 17) & 0x71D67FFFEDA60000ULL;
         x ^= (x << 37) & 0xFFF7EEE000000000ULL;
@@ -178,12 +284,68 @@ namespace mtools
     }
 
 
+    /* generates a random number on [0, 2^64-1]-interval */
+    inline uint64 randproc64(void)
+    {
+        if (mti >= NN) twist();
+        return temper64(mt[mti++]);
+    }
+
+
+    /* one step of the generator in canonical form (for internals_random::applyJumpPoly()) */
+    struct LinearStep
+        {
+        inline void operator()(uint64 * b, int & p) const
+            {
+            const int p1 = (p + 1 == NN) ? 0 : (p + 1);
+            const int pm = (p + MM >= NN) ? (p + MM - NN) : (p + MM);
+            const uint64 x = (b[p] & UM) | (b[p1] & LM);
+            b[p] = b[pm] ^ (x >> 1) ^ ((0ULL - (x & 1ULL)) & MATRIX_A);
+            p = p1;
+            }
+        };
+
+
+    /* characteristic polynomial of the generator (computed on first use) */
+    static const internals_random::GF2Poly & charPoly()
+        {
+        static const internals_random::GF2Poly P = []()
+            {
+            MT2004_64 g(5489ULL);
+            internals_random::GF2Poly Q = internals_random::charPolyLFSR<uint64, NN>(g.mt, DIM, LinearStep());
+            MTOOLS_INSURE(Q.degree() == DIM);
+            return Q;
+            }();
+        return P;
+        }
+
+
+    /* x^(2^SPLIT_LOG2) mod P (computed on first use) */
+    static const internals_random::GF2Poly & splitPoly()
+        {
+        static const internals_random::GF2Poly S = internals_random::GF2Poly::powX2mod(SPLIT_LOG2, charPoly());
+        return S;
+        }
+
+
+    /* apply a jump polynomial. The array mt is the canonical state (the last NN words generated) so
+       the jump keeps mti unchanged. Only the 31 lowest bits of mt[0] may differ from the exact
+       jump but they are never used since mti > 0 at this point. */
+    void jumpPoly(const internals_random::GF2Poly & g)
+        {
+        MTOOLS_ASSERT(mti > 0);
+        internals_random::applyJumpPoly<uint64, NN>(mt, g, LinearStep());
+        }
+
+
     /* some constants */
     static const int NN = 312;
     static const int MM = 156;
     static const uint64 MATRIX_A = 0xB5026F5AA96619E9ULL;
     static const uint64 UM = 0xFFFFFFFF80000000ULL;
     static const uint64 LM = 0x7FFFFFFFULL;
+    static const int DIM = 19937;           // dimension of the state space
+    static const uint64 JUMP_DISCARD = 65536; // smaller jumps are done with discard()
 
     /* state of the generator */
     uint64 mt[NN];
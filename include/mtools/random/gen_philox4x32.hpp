@@ -0,0 +1,325 @@
+/** @file gen_philox4x32.hpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+//
+// Philox4x32-10 from Salmon, Moraes, Dror, Shaw (2011) "Parallel random
+// numbers: as easy as 1, 2, 3".
+
+#pragma once
+
+#include "../misc/internal/mtools_export.hpp"
+#include "../misc/misc.hpp"
+#include "../misc/timefct.hpp"
+#include "internal/genstate.hpp"
+
+
+namespace mtools
+{
+
+
+    namespace internals_random
+    {
+
+        /* Philox4x32-10 bijection: encrypt the 128 bits counter ctr with the 64 bits key (k0,k1) */
+        inline void philox4x32_10(const uint32 ctr[4], uint32 k0, uint32 k1, uint32 out[4])
+            {
+            uint32 c0 = ctr[0], c1 = ctr[1], c2 = ctr[2], c3 = ctr[3];
+            for (int r = 0; r < 10; r++)
+                {
+                const uint64 p0 = ((uint64)0xD2511F53) * c0;
+                const uint64 p1 = ((uint64)0xCD9E8D57) * c2;
+                const uint32 n0 = ((uint32)(p1 >> 32)) ^ c1 ^ k0;
+                const uint32 n2 = ((uint32)(p0 >> 32)) ^ c3 ^ k1;
+                c0 = n0; c1 = (uint32)p1; c2 = n2; c3 = (uint32)p0;
+                k0 += 0x9E3779B9; k1 += 0xBB67AE85;
+                }
+            out[0] = c0; out[1] = c1; out[2] = c2; out[3] = c3;
+            }
+
+
+        /**
+         * OpenCL C implementation of Philox4x32 (identical to the Philox4x32 class). To use it in
+         * a kernel, prepend the returned string to the program source:
+         *
+         *     __kernel void sample(__global ulong * out, ulong seed)
+         *         {
+         *         mtools_philox gen;
+         *         mtools_philox_init(&gen, seed, get_global_id(0));   // stream = id of the work-item
+         *         out[get_global_id(0)] = mtools_philox_next(&gen);   // same as Philox4x32(seed, id)()
+         *         }
+         **/
+        inline const char * philox4x32_openCLsource()
+            {
+            return R"CLsource(
+
+/* Philox4x32-10 bijection: encrypt the 128 bits counter (c0,c1,c2,c3) with the key (k0,k1) */
+inline uint4 mtools_philox4x32_10(uint4 c, uint k0, uint k1)
+    {
+    for (int r = 0; r < 10; r++)
+        {
+        const uint hi0 = mul_hi((uint)0xD2511F53, c.x), lo0 = ((uint)0xD2511F53) * c.x;
+        const uint hi1 = mul_hi((uint)0xCD9E8D57, c.z), lo1 = ((uint)0xCD9E8D57) * c.z;
+        c = (uint4)(hi1 ^ c.y ^ k0, lo1, hi0 ^ c.w ^ k1, lo0);
+        k0 += 0x9E3779B9; k1 += 0xBB67AE85;
+        }
+    return c;
+    }
+
+
+/* state of a generator (private memory) */
+typedef struct
+    {
+    ulong seed;         // the key
+    ulong stream;       // upper half of the counter
+    ulong index;        // number of values already returned
+    uint4 buf;          // current block
+    } mtools_philox;
+
+
+/* initialize a generator: stream number 'stream' of the generator with key 'seed' */
+inline void mtools_philox_init(mtools_philox * g, ulong seed, ulong stream)
+    {
+    g->seed = seed; g->stream = stream; g->index = 0;
+    }
+
+
+/* block number b of a stream */
+inline uint4 mtools_philox_block(ulong seed, ulong stream, ulong b)
+    {
+    return mtools_philox4x32_10((uint4)((uint)b, (uint)(b >> 32), (uint)stream, (uint)(stream >> 32)), (uint)seed, (uint)(seed >> 32));
+    }
+
+
+/* value number 'index' of a stream (without any state) */
+inline ulong mtools_philox_at(ulong seed, ulong stream, ulong index)
+    {
+    const uint4 v = mtools_philox_block(seed, stream, index >> 1);
+    return ((index & 1) == 0) ? (((ulong)v.x) | (((ulong)v.y) << 32)) : (((ulong)v.z) | (((ulong)v.w) << 32));
+    }
+
+
+/* next 64 bits random number */
+inline ulong mtools_philox_next(mtools_philox * g)
+    {
+    if ((g->index & 1) == 0) { g->buf = mtools_philox_block(g->seed, g->stream, g->index >> 1); }
+    const ulong r = ((g->index & 1) == 0) ? (((ulong)g->buf.x) | (((ulong)g->buf.y) << 32)) : (((ulong)g->buf.z) | (((ulong)g->buf.w) << 32));
+    g->index++;
+    return r;
+    }
+
+
+/* skip n values */
+inline void mtools_philox_jump(mtools_philox * g, ulong n)
+    {
+    g->index += n;
+    if ((g->index & 1) != 0) { g->buf = mtools_philox_block(g->seed, g->stream, g->index >> 1); }
+    }
+
+
+/* uniform float in [0,1[ */
+inline float mtools_philox_unif_float(mtools_philox * g)
+    {
+    return ((float)(mtools_philox_next(g) >> 40)) * (1.0f / 16777216.0f);
+    }
+
+)CLsource";
+            }
+
+    }
+
+
+    /**
+     * Counter-based generator Philox4x32-10 (Salmon et al. 2011), returning 64 bits integers.
+     *
+     * The value number i of a stream is obtained by encrypting the 128 bits counter (i/2, stream)
+     * with the seed as key, so the generator has no state to set up: creating a generator, jumping
+     * ahead (jump()) or selecting a stream (stream()) all take constant time, and at() computes
+     * any value directly. This makes it convenient for parallel code: each thread (or each site of
+     * a lattice, each GPU work-item...) uses the stream given by its id, without contention and
+     * with a result that does not depend on the scheduling.
+     *
+     * The same generator is available in OpenCL kernels via the source philox4x32_openCLsource()
+     * (see openCL_philoxSource() in extensions/openCL.hpp): mtools_philox_next() after
+     * mtools_philox_init(&g, seed, stream) returns the same sequence as Philox4x32(seed, stream).
+     *
+     * @code{.cpp}
+     * Philox4x32 gen(seed, threadId);      // independent stream for each thread
+     * double x = Unif(gen);
+     * @endcode
+     **/
+    class Philox4x32
+    {
+
+    public:
+
+        /* type of integer returned by the generator */
+        typedef uint64 result_type;
+
+
+        /* min value */
+        static constexpr result_type min() { return 0; }
+
+
+        /* max value */
+        static constexpr result_type max() { return 18446744073709551615ULL; }
+
+
+        /* return a random number */
+        inline uint64 operator()()
+            {
+            if ((_index & 1) == 0) { _block(_index >> 1); _index++; return _buf[0]; }
+            _index++;
+            return _buf[1];
+            }
+
+
+        /**
+         * Fill an array with random numbers. Same as calling operator() n times (the sequence
+         * obtained is identical).
+         *
+         * @param [in,out]  out pointer to the array to fill.
+         * @param           n   number of random numbers to generate.
+         **/
+        void fill(uint64 * out, size_t n)
+            {
+            if (n == 0) return;
+            if (_index & 1) { *(out++) = operator()(); n--; }
+            uint32 ctr[4] = { 0, 0, (uint32)_stream, (uint32)(_stream >> 32) }, v[4];
+            uint64 b = _index >> 1;
+            for (; n >= 2; n -= 2, b++)
+                {
+                ctr[0] = (uint32)b; ctr[1] = (uint32)(b >> 32);
+                internals_random::philox4x32_10(ctr, (uint32)_seed, (uint32)(_seed >> 32), v);
+                *(out++) = ((uint64)v[0]) | (((uint64)v[1]) << 32);
+                *(out++) = ((uint64)v[2]) | (((uint64)v[3]) << 32);
+                }
+            _index = b << 1;
+            if (n == 1) { *out = operator()(); }
+            }
+
+
+        /* discard results (constant time) */
+        void discard(unsigned long long z) { jump((uint64)z); }
+
+
+        /**
+         * Jump ahead: same as discard(n), in constant time.
+         *
+         * @param   n   number of random numbers to skip.
+         **/
+        void jump(uint64 n)
+            {
+            _index += n;
+            if (_index & 1) { _block(_index >> 1); }
+            }
+
+
+        /**
+         * Select a stream. The generator restarts at the beginning of the stream. Streams with
+         * different ids are independent (for the same seed).
+         *
+         * @param   streamId    Identifier of the stream.
+         **/
+        void stream(uint64 streamId) { _stream = streamId; _index = 0; }
+
+
+        /* return the current stream */
+        uint64 stream() const { return _stream; }
+
+
+        /* return the number of random numbers already generated in the current stream */
+        uint64 index() const { return _index; }
+
+
+        /**
+         * Return the value number index of stream streamId for the seed s, without constructing a
+         * generator. Same as the result of the (index+1)-th call to Philox4x32(s, streamId)().
+         **/
+        static uint64 at(uint64 s, uint64 streamId, uint64 index)
+            {
+            const uint32 ctr[4] = { (uint32)(index >> 1), (uint32)(index >> 33), (uint32)streamId, (uint32)(streamId >> 32) };
+            uint32 v[4];
+            internals_random::philox4x32_10(ctr, (uint32)s, (uint32)(s >> 32), v);
+            return ((index & 1) == 0) ? (((uint64)v[0]) | (((uint64)v[1]) << 32)) : (((uint64)v[2]) | (((uint64)v[3]) << 32));
+            }
+
+
+        /* serialize the whole state of the generator (see MT2004_64::serialize()) */
+        void serialize(OBaseArchive & ar) const
+            {
+            internals_random::writeStateHeader(ar, "Philox4x32", (uint64)5);
+            ar & _seed; ar & _stream; ar & _index;
+            ar.opaqueArray(_buf, 2);
+            }
+
+
+        /* restore a state saved with serialize() */
+        void deserialize(IBaseArchive & ar)
+            {
+            internals_random::readStateHeader(ar, "Philox4x32", (uint64)5);
+            ar & _seed; ar & _stream; ar & _index;
+            ar.opaqueArray(_buf, 2);
+            }
+
+
+        /* hash of the state of the generator (for checking a restored state) */
+        uint64 stateHash() const { return internals_random::hashState(_buf, 2, internals_random::hashState(&_index, 1, internals_random::hashState(&_stream, 1, _seed))); }
+
+
+        /* change the seed (the stream is kept and the generator restarts at its beginning) */
+        void seed(result_type s) { _seed = s; _index = 0; }
+
+
+        /**
+        * Default constructor. Init with a unique random seed.
+        **/
+        Philox4x32() : _seed((uint64)(randomID())), _stream(0), _index(0), _buf() {}
+
+
+        /**
+        * Constructor with a given seed and stream.
+        **/
+        Philox4x32(result_type s, uint64 streamId = 0) : _seed(s), _stream(streamId), _index(0), _buf() {}
+
+
+    private:
+
+
+        /* compute block b in _buf */
+        inline void _block(uint64 b)
+            {
+            const uint32 ctr[4] = { (uint32)b, (uint32)(b >> 32), (uint32)_stream, (uint32)(_stream >> 32) };
+            uint32 v[4];
+            internals_random::philox4x32_10(ctr, (uint32)_seed, (uint32)(_seed >> 32), v);
+            _buf[0] = ((uint64)v[0]) | (((uint64)v[1]) << 32);
+            _buf[1] = ((uint64)v[2]) | (((uint64)v[3]) << 32);
+            }
+
+
+        uint64 _seed;       // key
+        uint64 _stream;     // upper half of the counter
+        uint64 _index;      // number of values already returned (the block of _index/2 is in _buf when _index is odd)
+        uint64 _buf[2];     // current block
+
+    };
+
+
+}
+
+
+/* end of file */
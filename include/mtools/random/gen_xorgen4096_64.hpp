@@ -23,6 +23,9 @@
 #include "../misc/internal/mtools_export.hpp"
 #include "../misc/misc.hpp"
 #include "../misc/timefct.hpp"
+#include "../misc/error.hpp"
+#include "internal/gf2poly.hpp"
+#include "internal/genstate.hpp"
 
 
 namespace mtools
@@ -61,6 +64,100 @@ namespace mtools
         void discard(unsigned long long z) { for (unsigned long long i = 0; i < z; i++) operator()(); }
 
 
+        /**
+         * Fill an array with random numbers. Same as calling operator() n times (the sequence obtained
+         * is identical) but faster since the state indices are kept in registers during the loop.
+         *
+         * @param [in,out]  out pointer to the array to fill.
+         * @param           n   number of random numbers to generate.
+         **/
+        void fill(uint64 * out, size_t n)
+            {
+            int j = i;
+            uint64 ww = w;
+            const uint64 we = weyl;
+            for (size_t k = 0; k < n; k++)
+                {
+                uint64 t = x[j = (j + 1)&(r - 1)];
+                uint64 v = x[(j + (r - s))&(r - 1)];
+                t ^= t << a;  t ^= t >> b;
+                v ^= v << c;  v ^= v >> d;
+                x[j] = (v ^= t);
+                ww += we;
+                out[k] = (v + (ww ^ (ww >> ws)));
+                }
+            i = j;
+            w = ww;
+            }
+
+
+        /* log2 of the length of the streams obtained with split() */
+        static const int SPLIT_LOG2 = 128;
+
+
+        /**
+         * Jump ahead: same as discard(n) (the numbers generated afterwards are identical) but the cost
+         * does not depend on n. The jump is computed with the characteristic polynomial of the generator
+         * (computed once with Berlekamp-Massey and cached): g(x) = x^n mod P(x) is evaluated on the
+         * xorshift state and the Weyl sequence is advanced by n steps. Each jump costs a few milliseconds so small values of n are simply discarded.
+         *
+         * @param   n   number of random numbers to skip.
+         **/
+        void jump(uint64 n)
+            {
+            if (n <= JUMP_DISCARD) { discard(n); return; }
+            jumpPoly(internals_random::GF2Poly::powXmod(n, charPoly()), n);
+            }
+
+
+        /**
+         * Jump ahead of 2^k random numbers. Same as jump(2^k) but also works for k >= 64.
+         *
+         * @param   k   log2 of the number of random numbers to skip.
+         **/
+        void jumpPow2(unsigned int k)
+            {
+            if ((k < 64) && ((1ULL << k) <= JUMP_DISCARD)) { discard(1ULL << k); return; }
+            jumpPoly(internals_random::GF2Poly::powX2mod(k, charPoly()), (k < 64) ? (1ULL << k) : 0);
+            }
+
+
+        /**
+         * Move to independent stream number streamId: jump ahead of streamId * 2^SPLIT_LOG2 random
+         * numbers. See MT2004_64::split(). The Weyl sequence is unchanged
+         * since 2^SPLIT_LOG2 = 0 modulo 2^64.
+         *
+         * @param   streamId    Identifier of the stream.
+         **/
+        void split(uint64 streamId)
+            {
+            if (streamId == 0) return;
+            jumpPoly(internals_random::GF2Poly::powmod(splitPoly(), streamId, charPoly()), 0);
+            }
+
+
+        /* serialize the whole state of the generator (see MT2004_64::serialize()) */
+        void serialize(OBaseArchive & ar) const
+            {
+            internals_random::writeStateHeader(ar, "XorGen4096_64", (uint64)r);
+            ar & i; ar & w; ar & weyl; ar & zero;
+            ar.opaqueArray(x, r);
+            }
+
+
+        /* restore a state saved with serialize() */
+        void deserialize(IBaseArchive & ar)
+            {
+            internals_random::readStateHeader(ar, "XorGen4096_64", (uint64)r);
+            ar & i; ar & w; ar & weyl; ar & zero;
+            ar.opaqueArray(x, r);
+            }
+
+
+        /* hash of the state of the generator (for checking a restored state) */
+        uint64 stateHash() const { return internals_random::hashState(x, r, internals_random::hashState(&w, 1, internals_random::hashState(&weyl, 1, (uint64)i))); }
+
+
         /* change the seed */
         void seed(result_type s) { zero = 0; i = -1; init_gen(s); }
 
@@ -107,6 +204,56 @@ namespace mtools
         }
 
 
+    /* one step of the xorshift part in canonical form (for internals_random::applyJumpPoly()) */
+    struct LinearStep
+        {
+        inline void operator()(uint64 * bu, int & p) const
+            {
+            uint64 t = bu[p];
+            uint64 v = bu[(p + (r - s))&(r - 1)];
+            t ^= t << a;  t ^= t >> b;
+            v ^= v << c;  v ^= v >> d;
+            bu[p] = (v ^ t);
+            p = (p + 1)&(r - 1);
+            }
+        };
+
+
+    /* characteristic polynomial of the xorshift part (computed on first use) */
+    static const internals_random::GF2Poly & charPoly()
+        {
+        static const internals_random::GF2Poly P = []()
+            {
+            uint64 st[r];
+            XorGen4096_64 g(5489ULL);
+            for (int k = 0; k < r; k++) { st[k] = g.x[k]; }
+            internals_random::GF2Poly Q = internals_random::charPolyLFSR<uint64, r>(st, DIM, LinearStep());
+            MTOOLS_INSURE(Q.degree() == DIM);
+            return Q;
+            }();
+        return P;
+        }
+
+
+    /* x^(2^SPLIT_LOG2) mod P (computed on first use) */
+    static const internals_random::GF2Poly & splitPoly()
+        {
+        static const internals_random::GF2Poly S = internals_random::GF2Poly::powX2mod(SPLIT_LOG2, charPoly());
+        return S;
+        }
+
+
+    /* apply a jump polynomial to the xorshift part and advance the Weyl sequence of nw steps (mod 2^64) */
+    void jumpPoly(const internals_random::GF2Poly & g, uint64 nw)
+        {
+        uint64 st[r]; // canonical state: st[k] = x[i+1+k]
+        for (int k = 0; k < r; k++) { st[k] = x[(i + 1 + k)&(r - 1)]; }
+        internals_random::applyJumpPoly<uint64, r>(st, g, LinearStep());
+        for (int k = 0; k < r; k++) { x[(i + 1 + k)&(r - 1)] = st[k]; }
+        w += nw*weyl;
+        }
+
+
     static const uint64 wlen = 64;
     static const int r = 64;
     static const int64 s = 53;
@@ -115,6 +262,8 @@ namespace mtools
     static const int c = 27;
     static const int d = 29;
     static const int ws = 27;
+    static const int DIM = 4096;                // dimension of the state space of the xorshift part
+    static const uint64 JUMP_DISCARD = 16384;   // smaller jumps are done with discard()
 
 
     /* state of the generator */
@@ -0,0 +1,284 @@
+/** @file hammersleySweep.hpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "../misc/internal/mtools_export.hpp"
+#include "../misc/misc.hpp"
+#include "../misc/stringfct.hpp"
+#include "../misc/error.hpp"
+#include "classiclaws.hpp"
+
+#include <map>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <utility>
+
+
+namespace mtools
+{
+
+
+    /**
+     * Event emitted by a HammersleySweep object each time a point of the process is reached by
+     * the sweep line.
+     **/
+    struct HammersleyEvent
+        {
+        static const uint64 NO_FATHER = 18446744073709551615ULL;   ///< value of father for a root
+
+        uint64 id;              ///< index of the point (sources first, then in increasing time)
+        double x;               ///< position of the point
+        double t;               ///< time of the point
+        int lives;              ///< number of lives (sons) of the point
+        uint64 father;          ///< index of the father (NO_FATHER if the point is a new root)
+        double fatherx;         ///< position of the father
+        double fathert;         ///< time of the father
+        int fatherremaining;    ///< lives of the father remaining after this point (0 = the father leaves the front)
+
+        /** Query whether the point is a new root (no leaf on its left). */
+        bool isRoot() const { return (father == NO_FATHER); }
+        };
+
+
+    /**
+     * Sweep-line engine for the Hammersley tree (genealogy of a Poisson point process where each
+     * point gets a number of lives).
+     *
+     * The points of a Poisson process of intensity 1 on [0,X]x[0,+inf) are visited in increasing
+     * time. Each point becomes the son of the closest leaf on its left (which then loses a life
+     * and leaves the front when it has no life remaining) and is inserted in the front with its own
+     * lives. A point without any leaf on its left is a new root.
+     *
+     * - The front (leaves with remaining lives) is kept in a balanced tree ordered by position so
+     *   each point costs O(log(front size)).
+     * - The points are generated by horizontal strips: the number of points of a strip is drawn
+     *   with PoissonLaw, then the points are drawn uniformly in the strip and sorted by time.
+     * - Nothing is kept once a point has been processed: it is only given to the visitor. The
+     *   memory used is that of the front and of one strip, whatever the number of points, so
+     *   domains with billions of points can be simulated (the visitor computes whatever statistic
+     *   is needed, or writes the points to a file).
+     *
+     * Sources (points on the line t=0) are added with addSource() and extra points (e.g. sinks on
+     * the right of the domain) with addPoint(). run() can be called several times to extend the
+     * simulation to larger times.
+     *
+     * @code{.cpp}
+     * MT2004_64 gen;
+     * HammersleySweep<MT2004_64> S(X, gen);
+     * S.addSources(sourcerate, [&](double x, double t) { return 1; });
+     * uint64 nbroots = 0;
+     * S.run(T, [&](double x, double t) { return 1; }, [&](const HammersleyEvent & E) { if (E.isRoot()) nbroots++; });
+     * @endcode
+     *
+     * @tparam  random_t    Type of the random number generator.
+     **/
+    template<class random_t> class HammersleySweep
+    {
+
+    public:
+
+        /** A leaf in the front. */
+        struct Leaf
+            {
+            uint64 id;          ///< index of the point
+            double t;           ///< time of the point
+            int remaining;      ///< number of lives remaining
+            };
+
+
+        /**
+         * Constructor.
+         *
+         * @param           X           Width of the domain [0,X].
+         * @param [in,out]  gen         The random number generator (must outlive the object).
+         * @param           stripHeight Height of the strips (0 = automatic: about STRIP_POINTS
+         *                              points per strip).
+         **/
+        HammersleySweep(double X, random_t & gen, double stripHeight = 0.0) : _X(X), _gen(gen), _h(stripHeight), _t(0.0), _nbpoints(0), _nbroots(0), _maxfront(0)
+            {
+            MTOOLS_INSURE(X > 0.0);
+            if (_h <= 0.0) _h = ((double)STRIP_POINTS) / X;
+            }
+
+
+        static const size_t STRIP_POINTS = 65536;  ///< average number of points per strip for the default strip height
+
+
+        /**
+         * Add a source: a root on the line t=0, with a given number of lives. Must be called before
+         * the first call to run().
+         *
+         * @return  The index of the source.
+         **/
+        uint64 addSource(double x, int lives)
+            {
+            MTOOLS_INSURE(_t == 0.0);
+            const uint64 id = _nbpoints++;
+            _nbroots++;
+            if (lives > 0) { _front[x] = Leaf{ id, 0.0, lives }; _updateMax(); }
+            return id;
+            }
+
+
+        /**
+         * Add a Poisson process of sources with a given rate on [0,X]x{0}.
+         *
+         * @param   rate    The intensity of the sources.
+         * @param   life    The number of lives of the points: int life(double x, double t).
+         *
+         * @return  The number of sources added.
+         **/
+        template<typename LIFEFUN> uint64 addSources(double rate, LIFEFUN life)
+            {
+            if (rate <= 0.0) return 0;
+            const int64 N = (int64)PoissonLaw(rate*_X)(_gen);
+            for (int64 k = 0; k < N; k++) { const double x = Unif(_gen)*_X; addSource(x, life(x, 0.0)); }
+            return (uint64)N;
+            }
+
+
+        /**
+         * Add a point, apart from the Poisson process, with a given number of lives (e.g. a sink at
+         * position x > X). The point is processed, in time order with the other points, by the
+         * call to run() which reaches time t.
+         **/
+        void addPoint(double x, double t, int lives)
+            {
+            MTOOLS_INSURE(t >= _t);
+            _extra.insert(std::make_pair(t, std::make_pair(x, lives)));
+            }
+
+
+        /**
+         * Run the sweep until time T.
+         *
+         * @param   T       The time to reach (nothing happens if T is not larger than time()).
+         * @param   life    The number of lives of the points: int life(double x, double t).
+         * @param   visitor Called for each point, in increasing time: void visitor(const HammersleyEvent &).
+         **/
+        template<typename LIFEFUN, typename VISITOR> void run(double T, LIFEFUN life, VISITOR visitor)
+            {
+            while (_t < T)
+                {
+                const double t0 = _t, t1 = std::min<double>(_t + _h, T);
+                const int64 N = (int64)PoissonLaw((t1 - t0)*_X)(_gen);
+                _strip.resize((size_t)N);
+                for (int64 k = 0; k < N; k++) { _strip[(size_t)k].first = t0 + Unif(_gen)*(t1 - t0); _strip[(size_t)k].second = Unif(_gen)*_X; }
+                std::sort(_strip.begin(), _strip.end());
+                auto ite = _extra.begin();
+                for (size_t k = 0; k < _strip.size(); k++)
+                    {
+                    const double t = _strip[k].first, x = _strip[k].second;
+                    while ((ite != _extra.end()) && (ite->first <= t)) { _process(ite->second.first, ite->first, ite->second.second, visitor); ite = _extra.erase(ite); }
+                    _process(x, t, life(x, t), visitor);
+                    }
+                while ((ite != _extra.end()) && (ite->first <= t1)) { _process(ite->second.first, ite->first, ite->second.second, visitor); ite = _extra.erase(ite); }
+                _t = t1;
+                }
+            }
+
+
+        /** Current time of the sweep line. */
+        double time() const { return _t; }
+
+
+        /** Width of the domain. */
+        double width() const { return _X; }
+
+
+        /** Number of points processed so far (including the sources). */
+        uint64 nbPoints() const { return _nbpoints; }
+
+
+        /** Number of roots so far (including the sources). */
+        uint64 nbRoots() const { return _nbroots; }
+
+
+        /** Current number of leaves in the front. */
+        size_t frontSize() const { return _front.size(); }
+
+
+        /** Largest size of the front so far. */
+        size_t maxFrontSize() const { return _maxfront; }
+
+
+        /** The front: leaves with remaining lives, ordered by position. */
+        const std::map<double, Leaf> & front() const { return _front; }
+
+
+        /** Print information about the sweep into a string. */
+        std::string toString() const
+            {
+            return std::string("HammersleySweep [0,") + mtools::toString(_X) + "] time: " + mtools::toString(_t) + " points: " + mtools::toString(_nbpoints) + " roots: " + mtools::toString(_nbroots) + " front: " + mtools::toString(_front.size()) + " (max " + mtools::toString(_maxfront) + ")";
+            }
+
+
+    private:
+
+
+        /* process the point (x,t) */
+        template<typename VISITOR> inline void _process(double x, double t, int lives, VISITOR & visitor)
+            {
+            HammersleyEvent E;
+            E.id = _nbpoints++; E.x = x; E.t = t; E.lives = lives;
+            auto it = _front.lower_bound(x);
+            if (it == _front.begin())
+                { // no leaf on the left: new root
+                E.father = HammersleyEvent::NO_FATHER; E.fatherx = 0.0; E.fathert = 0.0; E.fatherremaining = 0;
+                _nbroots++;
+                }
+            else
+                {
+                --it;
+                Leaf & F = it->second;
+                F.remaining--;
+                E.father = F.id; E.fatherx = it->first; E.fathert = F.t; E.fatherremaining = F.remaining;
+                if (F.remaining <= 0) { it = _front.erase(it); } else { ++it; }
+                }
+            if (lives > 0) { _front.emplace_hint(it, x, Leaf{ E.id, t, lives }); _updateMax(); }
+            visitor((const HammersleyEvent &)E);
+            }
+
+
+        /* update the largest size of the front */
+        inline void _updateMax() { if (_front.size() > _maxfront) _maxfront = _front.size(); }
+
+
+        double _X;                                                      // width of the domain
+        random_t & _gen;                                                // random generator
+        double _h;                                                      // height of the strips
+        double _t;                                                      // current time
+        uint64 _nbpoints;                                               // number of points processed
+        uint64 _nbroots;                                                // number of roots
+        size_t _maxfront;                                               // largest size of the front
+        std::map<double, Leaf> _front;                                  // leaves ordered by position
+        std::vector<std::pair<double, double> > _strip;                 // points (t,x) of the current strip
+        std::multimap<double, std::pair<double, int> > _extra;        // extra points t -> (x, lives)
+
+        HammersleySweep(const HammersleySweep &) = delete;
+        HammersleySweep & operator=(const HammersleySweep &) = delete;
+    };
+
+
+}
+
+
+/* end of file */
@@ -0,0 +1,74 @@
+/** @file genstate.hpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "../../misc/internal/mtools_export.hpp"
+#include "../../misc/misc.hpp"
+#include "../../misc/error.hpp"
+#include "../../io/serialization.hpp"
+
+#include <string>
+
+
+namespace mtools
+{
+
+    namespace internals_random
+    {
+
+        /* hash of the n words of the state of a generator, starting from h (splitmix64 finalizer
+         * applied after each word) */
+        template<typename U> inline uint64 hashState(const U * p, size_t n, uint64 h)
+            {
+            for (size_t k = 0; k < n; k++)
+                {
+                uint64 z = (h ^ ((uint64)p[k])) + 0x9E3779B97F4A7C15ULL;
+                z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+                z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+                h = z ^ (z >> 31);
+                }
+            return h;
+            }
+
+
+        /* write the header of the state of a generator: its name and the number of words of its state */
+        inline void writeStateHeader(OBaseArchive & ar, const char * name, uint64 n)
+            {
+            ar << name;
+            ar & std::string(name);
+            ar & n;
+            }
+
+
+        /* read and check the header written by writeStateHeader() */
+        inline void readStateHeader(IBaseArchive & ar, const char * name, uint64 n)
+            {
+            std::string s; ar & s;
+            if (s != std::string(name)) { MTOOLS_THROW(std::string("wrong generator: expected ") + name + " but found " + s); }
+            uint64 m; ar & m;
+            if (m != n) { MTOOLS_THROW(std::string("wrong state size for ") + name); }
+            }
+
+    }
+
+}
+
+
+/* end of file */
@@ -0,0 +1,167 @@
+/** @file gf2poly.hpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "../../misc/internal/mtools_export.hpp"
+#include "../../misc/misc.hpp"
+
+#include <vector>
+
+
+namespace mtools
+{
+
+    namespace internals_random
+    {
+
+
+        /**
+         * Polynomial over GF(2), used for computing the jump-ahead of F2-linear random number
+         * generators (Mersenne twisters, xorgens).
+         *
+         * The jump-ahead of n steps of a generator whose (one step) transition matrix T has
+         * characteristic polynomial P is obtained by computing g(x) = x^n mod P(x) and then applying
+         * g(T) to the state.
+         **/
+        class GF2Poly
+        {
+
+        public:
+
+            /* the null polynomial */
+            GF2Poly() {}
+
+
+            /* return the degree of the polynomial (-1 for the null polynomial) */
+            MTOOLS_DLL int64 degree() const;
+
+
+            /* return the coefficient of x^i */
+            inline bool coeff(size_t i) const { return ((i >> 6) < _w.size()) ? (((_w[i >> 6] >> (i & 63)) & 1) != 0) : false; }
+
+
+            /* set the coefficient of x^i to 1 */
+            MTOOLS_DLL void setCoeff(size_t i);
+
+
+            /* the polynomial x^n */
+            MTOOLS_DLL static GF2Poly monomial(size_t n);
+
+
+            /**
+             * Compute the minimal polynomial of a sequence of bits using the Berlekamp-Massey algorithm.
+             * In order to obtain a polynomial of degree d, the sequence must contain at least 2d bits.
+             *
+             * @param   seq The sequence of bits (one bit per element).
+             *
+             * @return  The minimal polynomial of the (linear recurring) sequence.
+             **/
+            MTOOLS_DLL static GF2Poly minimalPolynomial(const std::vector<uint8> & seq);
+
+
+            /* return (a * b) mod P */
+            MTOOLS_DLL static GF2Poly mulmod(const GF2Poly & a, const GF2Poly & b, const GF2Poly & P);
+
+
+            /* return x^(2^k) mod P, i.e. square x k times */
+            MTOOLS_DLL static GF2Poly powX2mod(size_t k, const GF2Poly & P);
+
+
+            /* return g^n mod P */
+            MTOOLS_DLL static GF2Poly powmod(const GF2Poly & g, uint64 n, const GF2Poly & P);
+
+
+            /* return x^n mod P */
+            MTOOLS_DLL static GF2Poly powXmod(uint64 n, const GF2Poly & P);
+
+
+        private:
+
+            /* remove the leading zero words */
+            void _normalize();
+
+            /* reduce this polynomial modulo P */
+            void _mod(const GF2Poly & P);
+
+            std::vector<uint64> _w;  // coefficients, bit i of _w[j] is the coeff. of x^(64j+i)
+
+        };
+
+
+        /**
+         * Apply g(T) to the state of an F2-linear generator, where T is its one step transition.
+         *
+         * The state must be given in canonical form s[0..N-1] where one step of the generator is the
+         * linear map: s[k] <- s[k+1] for k < N-1 and s[N-1] <- f(s). The step is performed on a
+         * circular buffer: step(buf, p) must compute the new word f from the canonical state
+         * buf[p], buf[p+1], ..., buf[p-1] (indices mod N), store it in buf[p] and increment p (mod N).
+         *
+         * @param [in,out]  s       The state in canonical form. Replaced by g(T).s
+         * @param           g       The jump polynomial.
+         * @param           step    The step functor.
+         **/
+        template<typename WORD, int N, typename STEP> void applyJumpPoly(WORD * s, const GF2Poly & g, STEP step)
+            {
+            WORD buf[N], acc[N];
+            for (int k = 0; k < N; k++) { buf[k] = s[k]; acc[k] = 0; }
+            int p = 0;
+            const int64 deg = g.degree();
+            for (int64 i = 0; i <= deg; i++)
+                {
+                if (g.coeff((size_t)i))
+                    {
+                    for (int k = 0; k < N - p; k++) { acc[k] ^= buf[p + k]; }
+                    for (int k = N - p; k < N; k++) { acc[k] ^= buf[p + k - N]; }
+                    }
+                step(buf, p);
+                }
+            for (int k = 0; k < N; k++) { s[k] = acc[k]; }
+            }
+
+
+        /**
+         * Compute the characteristic polynomial of an F2-linear generator from the sequence of bits
+         * produced by its step (same conventions as applyJumpPoly()). The bit used is the highest bit
+         * of each new word.
+         *
+         * @param [in,out]  s       A (non-zero) state in canonical form, modified by the method.
+         * @param           dim     The dimension of the state space (degree of the polynomial).
+         * @param           step    The step functor.
+         **/
+        template<typename WORD, int N, typename STEP> GF2Poly charPolyLFSR(WORD * s, size_t dim, STEP step)
+            {
+            std::vector<uint8> seq(2 * dim);
+            int p = 0;
+            for (size_t i = 0; i < 2 * dim; i++)
+                {
+                step(s, p);
+                seq[i] = (uint8)((s[(p + N - 1) % N] >> (8 * sizeof(WORD) - 1)) & 1);
+                }
+            return GF2Poly::minimalPolynomial(seq);
+            }
+
+
+    }
+
+}
+
+
+/* end of file */
+
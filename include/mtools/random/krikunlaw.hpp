@@ -34,6 +34,7 @@
 
 #include "../misc/internal/mtools_export.hpp"
 #include "../misc/misc.hpp" 
+#include "classiclaws.hpp"
 
 #include <cmath>
 
@@ -786,22 +787,18 @@ inline double CDF_Krikun(unsigned int p)
 
 
 /**
- * convert a double in [0,1) into an integer according to the krikun distribution conditionned on being non zero                                                  *
+ * convert a double in [0,1) into an integer according to the krikun distribution conditionned on being non zero
+ * (guide table on KRIKUNLAW_TAB and asymptotic formula for the tail).                                                  *
 **/
 inline unsigned int KrikunLaw_posi(double a)
     {
-    if (a >= KRIKUNLAW_TAB[5000])
+    static const DiscreteSampler sampler(KRIKUNLAW_TAB, 5001, 0, [](double b) -> int64
         {
-        double v = 1.1965351714172/(1-a);
+        double v = 1.1965351714172/(1-b);
         v = pow(v,2.0/3.0);
-        return(((unsigned int)v)+1);
-        }
-    unsigned int p = 1;
-    while(1)
-        {
-        if (a < KRIKUNLAW_TAB[p]) {return(p);}
-        p++;
-        }
+        return(((int64)v)+1);
+        });
+    return (unsigned int)sampler.invert(a);
     }
 
 
@@ -0,0 +1,303 @@
+/** @file parallelEden.hpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "../misc/internal/mtools_export.hpp"
+#include "../misc/misc.hpp"
+#include "../misc/stringfct.hpp"
+#include "../misc/error.hpp"
+#include "../maths/vec.hpp"
+#include "../maths/box.hpp"
+#include "../graphics/rgbc.hpp"
+#include "../containers/grid_basic.hpp"
+#include "gen_philox4x32.hpp"
+
+#include <vector>
+#include <map>
+#include <thread>
+#include <limits>
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+
+namespace mtools
+{
+
+
+    /**
+     * Eden model on Z^2 (first passage percolation with i.i.d. exponential weights on the edges)
+     * grown in parallel.
+     *
+     * A site enters the cluster at rate equal to its number of neighbours in the cluster, which is
+     * the same as first passage percolation from the origin with Exp(1) edge passage times: the
+     * cluster at time t is the set of sites at passage time <= t. Each edge gets its passage time
+     * from the counter-based generator Philox4x32 (the value depends only on the seed and on the
+     * position of the edge) so the law is exact and the cluster does not depend on the number of
+     * threads nor on the order in which the sites are processed.
+     *
+     * The boundary is kept in buckets of width delta according to the tentative passage times
+     * (delta-stepping). The sites of the lowest bucket do not depend on each other: they are
+     * processed together, the threads computing the passage times to their neighbours in parallel
+     * (reading the grid only) and the improved tentative times being then merged in the grid and in
+     * the buckets. A bucket is processed again until no site improves inside it, after which all
+     * its sites belong to the cluster.
+     *
+     * @code{.cpp}
+     * ParallelEden E(seed);
+     * E.growUntilSize(100000000);      // at least 10^8 sites
+     * auto L = makePlot2DLattice(E);   // color of the sites from E.getColor()
+     * @endcode
+     **/
+    class ParallelEden
+    {
+
+    public:
+
+        static constexpr double DEFAULT_DELTA = 0.25;   ///< default width of the buckets
+        static const size_t PARALLEL_MIN = 4096;        ///< minimum number of sites in a pass for using several threads
+
+
+        /** Information stored at each site. */
+        struct Site
+            {
+            Site() : T(std::numeric_limits<double>::infinity()) {}
+
+            double T;   ///< passage time (tentative for the sites outside the cluster, +inf if not yet reached)
+            };
+
+
+        /**
+         * Constructor. The cluster contains only the origin.
+         *
+         * @param   seed        The seed of the edge passage times.
+         * @param   nbThreads   Number of threads (0 = number of hardware threads).
+         * @param   delta       Width of the buckets.
+         **/
+        ParallelEden(uint64 seed = 0, int nbThreads = 0, double delta = DEFAULT_DELTA) : _G(false) { reset(seed, nbThreads, delta); }
+
+
+        /**
+         * Restart with the cluster reduced to the origin.
+         *
+         * @param   seed        The seed of the edge passage times.
+         * @param   nbThreads   Number of threads (0 = number of hardware threads).
+         * @param   delta       Width of the buckets.
+         **/
+        void reset(uint64 seed, int nbThreads = 0, double delta = DEFAULT_DELTA)
+            {
+            MTOOLS_INSURE(delta > 0.0);
+            _seed = seed;
+            _delta = delta;
+            _nbth = (nbThreads <= 0) ? std::max<int>(1, (int)std::thread::hardware_concurrency()) : nbThreads;
+            _G.reset();
+            _C.reset();
+            _buckets.clear();
+            _cand.assign((size_t)_nbth, std::vector<Entry>());
+            _R.clear();
+            _size = 0;
+            _time = 0.0;
+            _G.get(iVec2(0, 0), _C).T = 0.0;
+            _buckets[0].push_back(Entry{ iVec2(0, 0), 0.0 });
+            }
+
+
+        /**
+         * Grow the cluster until every site with passage time smaller than t belongs to it. The
+         * cluster is then exactly the Eden cluster at time time() >= t (time() is a multiple of
+         * delta).
+         **/
+        void growUntilTime(double t)
+            {
+            while ((_time < t) && (_buckets.size() > 0)) { _processBucket(); }
+            }
+
+
+        /**
+         * Grow the cluster until it has at least N sites. The last bucket is completed, so the size
+         * may exceed N by (a fraction of) the number of sites of a bucket.
+         **/
+        void growUntilSize(int64 N)
+            {
+            while ((_size < N) && (_buckets.size() > 0)) { _processBucket(); }
+            }
+
+
+        /** Number of sites in the cluster. */
+        int64 size() const { return _size; }
+
+
+        /** Current time: the cluster is the set of sites with passage time smaller than time(). */
+        double time() const { return _time; }
+
+
+        /** Smallest rectangle containing the cluster. */
+        iBox2 range() const { return _R; }
+
+
+        /** Number of boundary entries waiting in the buckets. */
+        size_t boundarySize() const { size_t n = 0; for (auto & B : _buckets) { n += B.second.size(); } return n; }
+
+
+        /** Passage time of a site (+inf if it was not yet reached). */
+        double passageTime(const iVec2 & p) const { const Site * S = _G.peek(p); return ((S == nullptr) ? std::numeric_limits<double>::infinity() : S->T); }
+
+
+        /** Query whether a site belongs to the cluster. */
+        bool inCluster(const iVec2 & p) const { return (passageTime(p) < _time); }
+
+
+        /** The underlying grid. */
+        const Grid_basic<2, Site> & grid() const { return _G; }
+
+
+        /**
+         * Passage time of the edge between p and p + (1,0) (dir = 0) or p + (0,1) (dir = 1): an
+         * Exp(1) random variable which depends only on the seed and on the edge.
+         **/
+        double edgeWeight(const iVec2 & p, int dir) const
+            {
+            const uint64 stream = (((uint64)(uint32)p.X()) << 32) | ((uint64)(uint32)p.Y());
+            const uint64 u = Philox4x32::at(_seed, stream, (uint64)dir);
+            return -std::log1p(-((double)(u >> 11)) * (1.0 / 9007199254740992.0));
+            }
+
+
+        /** Color of a site for drawing (passage time, sites outside the cluster are transparent). */
+        inline RGBc getColor(iVec2 p) const
+            {
+            const Site * S = _G.peek(p);
+            if ((S == nullptr) || (!(S->T < _time))) return RGBc::c_Transparent;
+            return RGBc::jetPalette(S->T, 0.0, _time);
+            }
+
+
+        /** Print information about the cluster into a string. */
+        std::string toString() const
+            {
+            std::string s = "Parallel Eden model\n";
+            s += "  -> cluster size  = " + mtools::toString(_size) + "\n";
+            s += "  -> time          = " + mtools::toString(_time) + "\n";
+            s += "  -> range         = " + mtools::toString(_R) + "\n";
+            s += "  -> boundary      = " + mtools::toString(boundarySize()) + "\n";
+            s += "  -> threads       = " + mtools::toString(_nbth) + "\n";
+            return s;
+            }
+
+
+    private:
+
+
+        /* a site with its tentative time when it was inserted */
+        struct Entry
+            {
+            iVec2 pos;
+            double T;
+            };
+
+
+        /* process the lowest bucket until it is settled */
+        void _processBucket()
+            {
+            auto itb = _buckets.begin();
+            const int64 ib = itb->first;
+            std::vector<Entry> cur, done;
+            while ((itb != _buckets.end()) && (itb->first == ib))
+                {
+                cur.swap(itb->second);
+                _buckets.erase(itb);
+                _relax(cur);
+                done.insert(done.end(), cur.begin(), cur.end());
+                cur.clear();
+                itb = _buckets.begin(); // new entries may have been added to the same bucket
+                }
+            for (const Entry & E : done)
+                { // each site appears once with its final time
+                if (_G.peek(E.pos, _C)->T == E.T) { _size++; _R.swallowPoint(E.pos); }
+                }
+            _time = (ib + 1)*_delta;
+            }
+
+
+        /* relax the edges out of the sites of a pass: compute in parallel, merge sequentially */
+        void _relax(const std::vector<Entry> & cur)
+            {
+            const size_t n = cur.size();
+            const size_t nb = (n < PARALLEL_MIN) ? 1 : std::min<size_t>((size_t)_nbth, n / (PARALLEL_MIN / 4));
+            auto work = [&](size_t th)
+                {
+                std::vector<Entry> & out = _cand[th];
+                out.clear();
+                typename Grid_basic<2, Site>::Cursor C;
+                const size_t a = (n*th) / nb, b = (n*(th + 1)) / nb;
+                for (size_t k = a; k < b; k++)
+                    {
+                    const Entry & E = cur[k];
+                    if (_G.peek(E.pos, C)->T != E.T) continue; // stale entry
+                    const iVec2 & p = E.pos;
+                    const iVec2 nei[4] = { iVec2(p.X() + 1, p.Y()), iVec2(p.X() - 1, p.Y()), iVec2(p.X(), p.Y() + 1), iVec2(p.X(), p.Y() - 1) };
+                    const double w[4] = { edgeWeight(p, 0), edgeWeight(nei[1], 0), edgeWeight(p, 1), edgeWeight(nei[3], 1) };
+                    for (int i = 0; i < 4; i++)
+                        {
+                        const double t = E.T + w[i];
+                        const Site * S = _G.peek(nei[i], C);
+                        if ((S == nullptr) || (t < S->T)) out.push_back(Entry{ nei[i], t });
+                        }
+                    }
+                };
+            if (nb <= 1) { work(0); }
+            else
+                {
+                std::vector<std::thread> threads;
+                for (size_t t = 1; t < nb; t++) { threads.push_back(std::thread(work, t)); }
+                work(0);
+                for (auto & th : threads) { th.join(); }
+                }
+            for (size_t th = 0; th < nb; th++)
+                {
+                for (const Entry & E : _cand[th])
+                    {
+                    Site & S = _G.get(E.pos, _C);
+                    if (E.T < S.T) { S.T = E.T; _buckets[(int64)std::floor(E.T / _delta)].push_back(E); }
+                    }
+                }
+            }
+
+
+        uint64 _seed;                                       // seed of the edge weights
+        double _delta;                                      // width of the buckets
+        int _nbth;                                          // number of threads
+        Grid_basic<2, Site> _G;                             // passage times
+        mutable typename Grid_basic<2, Site>::Cursor _C;   // cursor of the main thread
+        std::map<int64, std::vector<Entry> > _buckets;      // boundary sites by bucket of tentative time
+        std::vector< std::vector<Entry> > _cand;            // candidates found by each thread
+        iBox2 _R;                                           // rectangle containing the cluster
+        int64 _size;                                        // number of sites in the cluster
+        double _time;                                       // all the sites with passage time < _time are in the cluster
+
+        ParallelEden(const ParallelEden &) = delete;
+        ParallelEden & operator=(const ParallelEden &) = delete;
+    };
+
+
+}
+
+
+/* end of file */
@@ -28,11 +28,50 @@
 
 #include <cmath>
 #include <random>
+#include <map>
+#include <utility>
 
 namespace mtools
 	{
 
 
+	namespace internals_random
+		{
+
+		/* Cache of tabulated laws indexed by their parameters. The cache is simply emptied 
+		   when it contains too many tables. */
+		template<typename KEY, typename CDF> class TabulatedLawCache
+			{
+			public:
+
+				TabulatedLawCache(size_t maxtables, size_t tablesize) : _maxtables(maxtables), _tablesize(tablesize) {}
+
+				/* return the table associated with key, create it with TabulatedDiscreteLaw<CDF>(cdf, kmin, kmax) if needed */
+				inline TabulatedDiscreteLaw<CDF> & get(const KEY & key, const CDF & cdf, int64 kmin, int64 kmax = 4611686018427387904)
+					{
+					auto it = _map.find(key);
+					if (it != _map.end()) return it->second;
+					if (_map.size() >= _maxtables) { _map.clear(); }
+					return _map.insert(std::pair<KEY, TabulatedDiscreteLaw<CDF> >(key, TabulatedDiscreteLaw<CDF>(cdf, kmin, kmax, _tablesize))).first->second;
+					}
+
+				/* number of tables in the cache */
+				size_t size() const { return _map.size(); }
+
+				/* empty the cache */
+				void clear() { _map.clear(); }
+
+			private:
+
+				size_t _maxtables;
+				size_t _tablesize;
+				std::map<KEY, TabulatedDiscreteLaw<CDF> > _map;
+			};
+
+		}
+
+
+
 	/*******************************************************************************************************************
 	* 
 	*                                     UI(H)PT : UNIFORM INFINITE (HALF)-PLANAR TRIANGULATION
@@ -92,11 +131,14 @@ namespace mtools
 	* Sample a random variable according to the law of the walk associated with the peeling process
 	* of the Infinite Uniform Half plane Triangulation.
 	*
+	* The CDF is tabulated once on [-1,4095] (see DiscreteSampler) and inverted directly beyond.
+	*
 	* @param [in,out]  gen the random number generator
 	**/
 	template<class random_t> inline int64 UIHPTLaw(random_t & gen)
 		{
-		return sampleDiscreteRVfromCDF(UIHPT_CDF, gen);
+		static const DiscreteSampler sampler(UIHPT_CDF, -1, 4095);
+		return sampler(gen);
 		}
 
 
@@ -156,6 +198,35 @@ namespace mtools
 		}
 
 
+	/**
+	* Same as UIPTLaw() but with tabulated CDFs, computed once for every value of m encountered and
+	* kept in a cache. This is much faster when many samples are needed (e.g. for the peeling process).
+	* Given the same generator, the sequence returned is the same as with UIPTLaw().
+	**/
+	class UIPTLawSampler
+		{
+		public:
+
+			/**
+			* Constructor.
+			*
+			* @param   maxtables   maximum number of tables kept in the cache.
+			* @param   tablesize   maximum size of each table (larger values are sampled directly from the CDF).
+			**/
+			UIPTLawSampler(size_t maxtables = 4096, size_t tablesize = 256) : _cache(maxtables, tablesize) {}
+
+			/** Same as UIPTLaw(m, gen). **/
+			template<class random_t> inline int64 operator()(int64 m, random_t & gen)
+				{
+				return _cache.get(m, UIPT_CDF_obj(m), -1, m)(gen);
+				}
+
+		private:
+
+			internals_random::TabulatedLawCache<int64, UIPT_CDF_obj> _cache;
+		};
+
+
 	/**
 	* Cumulative distribution of the random variables associated with the peeling of a
 	* free Boltzmann Triangulation of type II.
@@ -232,6 +303,37 @@ namespace mtools
 		}
 
 
+	/**
+	* Same as freeBoltzmanTriangulationLaw() but with tabulated CDFs, computed once for every value of m
+	* encountered and kept in a cache. Given the same generator, the sequence returned is the same as
+	* with freeBoltzmanTriangulationLaw().
+	**/
+	class freeBoltzmanTriangulationLawSampler
+		{
+		public:
+
+			/**
+			* Constructor.
+			*
+			* @param   maxtables   maximum number of tables kept in the cache.
+			* @param   tablesize   maximum size of each table (larger values are sampled directly from the CDF).
+			**/
+			freeBoltzmanTriangulationLawSampler(size_t maxtables = 4096, size_t tablesize = 256) : _cache(maxtables, tablesize) {}
+
+			/** Same as freeBoltzmanTriangulationLaw(m, gen). **/
+			template<class random_t> inline int64 operator()(int64 m, random_t & gen)
+				{
+				int64 v = _cache.get(m, freeBoltzmanTriangulation_CDF_obj(m), -1, m)(gen);
+				if ((m > 0) && (v > 0) && (Unif_1(gen))) { v = m + 1 - v; } // re-symmetrize, as in freeBoltzmanTriangulationLaw()
+				return v;
+				}
+
+		private:
+
+			internals_random::TabulatedLawCache<int64, freeBoltzmanTriangulation_CDF_obj> _cache;
+		};
+
+
 
 
 
@@ -345,6 +447,47 @@ namespace mtools
 		}
 
 
+	/**
+	* Same as hyperbolicIPTLaw() but with a tabulated CDF for the steps of the walk, computed once for
+	* every value of theta encountered and kept in a cache. Given the same generator, the sequence
+	* returned is the same as with hyperbolicIPTLaw().
+	**/
+	class hyperbolicIPTLawSampler
+		{
+		public:
+
+			/**
+			* Constructor.
+			*
+			* @param   maxtables   maximum number of tables kept in the cache.
+			* @param   tablesize   maximum size of each table (larger values are sampled directly from the CDF).
+			**/
+			hyperbolicIPTLawSampler(size_t maxtables = 16, size_t tablesize = 1024) : _cache(maxtables, tablesize) {}
+
+			/** Same as hyperbolicIPTLaw(m, theta, gen). **/
+			template<class random_t> inline int64 operator()(int64 m, double theta, random_t & gen)
+				{
+				auto & O = _cache.get(theta, hyperbolicIHPT_CDF_obj(theta), -1);
+				const int NBSTEP = 10;
+				while (1)
+					{
+					int64 x0 = O(gen);
+					int64 pos = m - x0;
+					for (int i = 0; i < NBSTEP; i++)
+						{
+						if (pos < 0) { break; }
+						pos -= O(gen);
+						}
+					if (pos >= 0) { return x0; }
+					}
+				}
+
+		private:
+
+			internals_random::TabulatedLawCache<double, hyperbolicIHPT_CDF_obj> _cache;
+		};
+
+
 
 	/**
 	* Cumulative distribution of the peeling of a general Boltzmann triangulation of type II.
@@ -467,6 +610,37 @@ namespace mtools
 		return v;
 		}
 
+
+	/**
+	* Same as generalBoltzmanTriangulationLaw() but with tabulated CDFs, computed once for every pair
+	* (m, theta) encountered and kept in a cache. Given the same generator, the sequence returned is
+	* the same as with generalBoltzmanTriangulationLaw().
+	**/
+	class generalBoltzmanTriangulationLawSampler
+		{
+		public:
+
+			/**
+			* Constructor.
+			*
+			* @param   maxtables   maximum number of tables kept in the cache.
+			* @param   tablesize   maximum size of each table (larger values are sampled directly from the CDF).
+			**/
+			generalBoltzmanTriangulationLawSampler(size_t maxtables = 4096, size_t tablesize = 256) : _cache(maxtables, tablesize) {}
+
+			/** Same as generalBoltzmanTriangulationLaw(m, theta, gen). **/
+			template<class random_t> inline int64 operator()(int64 m, double theta, random_t & gen)
+				{
+				int64 v = _cache.get(std::pair<int64, double>(m, theta), generalBoltzmanTriangulation_CDF_obj(m, theta), -1, m)(gen);
+				if ((m > 0) && (v > 0) && (Unif_1(gen))) { v = m + 1 - v; } // re-symmetrize, as in generalBoltzmanTriangulationLaw()
+				return v;
+				}
+
+		private:
+
+			internals_random::TabulatedLawCache<std::pair<int64, double>, generalBoltzmanTriangulation_CDF_obj> _cache;
+		};
+
 	}
 
 
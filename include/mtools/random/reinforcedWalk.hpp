@@ -0,0 +1,341 @@
+/** @file reinforcedWalk.hpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "../misc/internal/mtools_export.hpp"
+#include "../misc/misc.hpp"
+#include "../misc/stringfct.hpp"
+#include "../misc/error.hpp"
+#include "../maths/vec.hpp"
+#include "../maths/box.hpp"
+#include "../graphics/rgbc.hpp"
+#include "../containers/grid_basic.hpp"
+#include "classiclaws.hpp"
+#include "SRW.hpp"
+#include "gen_mt2004_64.hpp"
+
+#include <string>
+
+
+namespace mtools
+{
+
+
+    /**
+     * Edge reinforced random walk on Z^2.
+     *
+     * Every edge starts with weight 1 and the walk jumps to a neighbour with probability
+     * proportional to the weight of the edge leading to it. Two models are available:
+     *
+     * - LINEAR : linearly reinforced walk (LERRW). The weight of an edge is 1 + delta x (number of
+     *   crossings).
+     * - ONCE : once reinforced walk (OERRW). The weight of an edge becomes delta after its first
+     *   crossing and does not change anymore.
+     *
+     * Each site of the grid holds the cumulative weights of its 4 edges (left, right, down, up) and
+     * its local time, so a step reads a single site and samples the move with one uniform and at
+     * most two comparisons. The weight of an edge is stored at both its endpoints.
+     *
+     * For the ONCE model, the weights are stable in the region where all the edges were already
+     * crossed, where the walk is a simple random walk. The grid is cut in BLOCK x BLOCK blocks and
+     * the number of 'full' sites (all 4 edges crossed) of each block is maintained. In
+     * walkUntilRange(), when the walk has spent some time inside full sites, the largest square of
+     * full blocks around it is found and the walk jumps to the boundary of the square at once with
+     * SRW_Z2_ExitRect(). Since a full block remains full forever, the last square is kept and
+     * reused as long as the walk is inside. The number of steps and the local times are not
+     * updated during these jumps.
+     *
+     * @code{.cpp}
+     * ReinforcedWalkZ2<> W(2.0, W.ONCE);
+     * W.walkUntilRange(1000000);           // until one million distinct sites are visited
+     * auto L = makePlot2DLattice(W);       // color of the sites from W.getColor()
+     * @endcode
+     *
+     * @tparam  random_t    Type of the random number generator.
+     **/
+    template<class random_t = MT2004_64> class ReinforcedWalkZ2
+    {
+
+    public:
+
+        static const int LINEAR = 0;    ///< linearly reinforced walk
+        static const int ONCE = 1;      ///< once reinforced walk
+
+        static const int64 BLOCK = 16;                  ///< size of the blocks used to find full squares (ONCE model)
+        static const int64 MAX_BLOCK_RADIUS = 64;       ///< largest radius (in blocks) of a full square
+        static const int64 JUMP_DELAY = 32;             ///< number of steps on full sites before looking for a full square
+
+
+        /** Information stored at each site (cumulative weights of the edges and local time). */
+        struct Site
+            {
+            Site() : V(0), mask(0) { cum[0] = 1.0; cum[1] = 2.0; cum[2] = 3.0; cum[3] = 4.0; }
+
+            double cum[4];      ///< cumulative weights of the edges left, right, down, up (cum[3] is the total weight)
+            uint64 V;           ///< local time (number of visits)
+            uint32 mask;        ///< bit k is set when edge k was crossed
+
+            /** Weight of edge k (0 = left, 1 = right, 2 = down, 3 = up). */
+            inline double weight(int k) const { return ((k == 0) ? cum[0] : (cum[k] - cum[k - 1])); }
+            };
+
+
+        /**
+         * Constructor.
+         *
+         * @param   delta   The reinforcement parameter.
+         * @param   model   The model (LINEAR or ONCE).
+         * @param   seed    Seed of the random number generator (0 for a random seed).
+         **/
+        ReinforcedWalkZ2(double delta = 1.0, int model = LINEAR, uint64 seed = 0) : _G(false), _blocks(false) { if (seed != 0) _gen.seed(seed); reset(delta, model); }
+
+
+        /**
+         * Reset the walk at the origin with every edge of weight 1.
+         *
+         * @param   delta   The reinforcement parameter.
+         * @param   model   The model (LINEAR or ONCE).
+         **/
+        void reset(double delta, int model)
+            {
+            MTOOLS_INSURE((model == LINEAR) || (model == ONCE));
+            MTOOLS_INSURE(delta > 0.0);
+            _delta = delta;
+            _model = model;
+            _G.reset();
+            _blocks.reset();
+            _C.reset();
+            _pos = iVec2(0, 0);
+            _R.clear();
+            _R.swallowPoint(_pos);
+            _range = 1;
+            _nbsteps = 0;
+            _nbjumps = 0;
+            _maxV = 1;
+            _sincefull = 0;
+            _full.clear();
+            _S = &_G.get(_pos, _C);
+            _S->V = 1;
+            }
+
+
+        /**
+         * Make nb steps of the walk (without any aggregation).
+         **/
+        void walk(uint64 nb)
+            {
+            for (uint64 i = 0; i < nb; i++) { _step(); }
+            }
+
+
+        /**
+         * Walk until the number of distinct sites visited reaches nb. For the ONCE model, the walk
+         * jumps across the squares of full blocks (see the class description).
+         **/
+        void walkUntilRange(int64 nb)
+            {
+            while (_range < nb)
+                {
+                if ((_model == ONCE) && (_S->mask == 15))
+                    {
+                    if ((++_sincefull >= JUMP_DELAY) && (_jump())) continue;
+                    }
+                else { _sincefull = 0; }
+                _step();
+                }
+            }
+
+
+        /** The current position of the walk. */
+        iVec2 pos() const { return _pos; }
+
+
+        /** Number of distinct sites visited. */
+        int64 range() const { return _range; }
+
+
+        /** Smallest rectangle containing the trace of the walk. */
+        iBox2 rangeRect() const { return _R; }
+
+
+        /** Number of single steps performed. */
+        uint64 nbSteps() const { return _nbsteps; }
+
+
+        /** Number of jumps across full squares (ONCE model). */
+        uint64 nbJumps() const { return _nbjumps; }
+
+
+        /** Largest local time. */
+        uint64 maxLocalTime() const { return _maxV; }
+
+
+        /** Reinforcement parameter. */
+        double delta() const { return _delta; }
+
+
+        /** The model (LINEAR or ONCE). */
+        int model() const { return _model; }
+
+
+        /** Information at a site (nullptr if the site was never created). */
+        const Site * peek(const iVec2 & p) const { return _G.peek(p); }
+
+
+        /** The underlying grid. */
+        const Grid_basic<2, Site> & grid() const { return _G; }
+
+
+        /** Color of a site for drawing (local time on a logarithmic scale). */
+        inline RGBc getColor(iVec2 p) const
+            {
+            const Site * S = _G.peek(p);
+            if ((S == nullptr) || (S->mask == 0)) return RGBc::c_Transparent;
+            if (_model == ONCE) return ((S->mask == 15) ? RGBc::c_Red : RGBc::c_Orange);
+            return RGBc::jetPaletteLog((double)S->V, 0, (double)_maxV, 1.2);
+            }
+
+
+        /** Print information about the walk into a string. */
+        std::string toString() const
+            {
+            std::string s = std::string((_model == ONCE) ? "Once" : "Linearly") + " edge reinforced random walk on Z^2\n";
+            s += "  -> reinf. param. delta    = " + mtools::toString(_delta) + "\n";
+            s += "  -> nb of visited sites    = " + mtools::toString(_range) + "\n";
+            s += "  -> nb of steps / jumps    = " + mtools::toString(_nbsteps) + " / " + mtools::toString(_nbjumps) + "\n";
+            s += "  -> max local time         = " + mtools::toString(_maxV) + "\n";
+            s += "  -> current position       = " + mtools::toString(_pos) + "\n";
+            s += "  -> range of the trace     = " + mtools::toString(_R) + "\n";
+            return s;
+            }
+
+
+    private:
+
+
+        /* reinforce edge k of site S at position p */
+        inline void _reinforce(Site & S, int k, const iVec2 & p)
+            {
+            if (_model == LINEAR)
+                {
+                for (int i = k; i < 4; i++) { S.cum[i] += _delta; }
+                S.mask |= (1u << k);
+                return;
+                }
+            if (S.mask & (1u << k)) return;
+            const double a = _delta - 1.0;
+            for (int i = k; i < 4; i++) { S.cum[i] += a; }
+            S.mask |= (1u << k);
+            if (S.mask == 15) { _blocks[_blockPos(p)]++; }
+            }
+
+
+        /* make one step */
+        inline void _step()
+            {
+            Site & S = *_S;
+            const double u = Unif(_gen) * S.cum[3];
+            const int k = (u < S.cum[1]) ? ((u < S.cum[0]) ? 0 : 1) : ((u < S.cum[2]) ? 2 : 3);
+            _reinforce(S, k, _pos);
+            switch (k)
+                {
+                case 0: _pos.X()--; break;
+                case 1: _pos.X()++; break;
+                case 2: _pos.Y()--; break;
+                case 3: _pos.Y()++; break;
+                }
+            _S = &_G.get(_pos, _C);
+            _reinforce(*_S, k ^ 1, _pos);
+            if (_S->V == 0) { _range++; _R.swallowPoint(_pos); }
+            if ((++(_S->V)) > _maxV) { _maxV = _S->V; }
+            _nbsteps++;
+            }
+
+
+        /* jump to the boundary of a square of full blocks around the walk, return false if there is none */
+        bool _jump()
+            {
+            if (_full.boundaryDist(_pos) < 2)
+                {
+                const iVec2 b = _blockPos(_pos);
+                if (!_blockFull(b)) { _sincefull = 0; return false; }
+                int64 r = 0;
+                while (r < MAX_BLOCK_RADIUS)
+                    { // check the ring at distance r+1
+                    const int64 q = r + 1;
+                    bool ok = true;
+                    for (int64 i = -q; (ok) && (i <= q); i++)
+                        {
+                        ok = _blockFull(iVec2(b.X() + i, b.Y() - q)) && _blockFull(iVec2(b.X() + i, b.Y() + q));
+                        if ((ok) && (i > -q) && (i < q)) { ok = _blockFull(iVec2(b.X() - q, b.Y() + i)) && _blockFull(iVec2(b.X() + q, b.Y() + i)); }
+                        }
+                    if (!ok) break;
+                    r = q;
+                    }
+                _full = iBox2((b.X() - r)*BLOCK, (b.X() + r + 1)*BLOCK - 1, (b.Y() - r)*BLOCK, (b.Y() + r + 1)*BLOCK - 1);
+                if (_full.boundaryDist(_pos) < 2) { _sincefull = 0; return false; }
+                }
+            SRW_Z2_ExitRect(_pos, _full, _gen);
+            _S = &_G.get(_pos, _C);
+            _nbjumps++;
+            return true;
+            }
+
+
+        /* position of the block containing p */
+        static inline iVec2 _blockPos(const iVec2 & p)
+            {
+            return iVec2((p.X() >= 0) ? (p.X() / BLOCK) : (-((-p.X() - 1) / BLOCK) - 1), (p.Y() >= 0) ? (p.Y() / BLOCK) : (-((-p.Y() - 1) / BLOCK) - 1));
+            }
+
+
+        /* query whether all the sites of a block are full */
+        inline bool _blockFull(const iVec2 & b) const
+            {
+            const uint32 * v = _blocks.peek(b);
+            return ((v != nullptr) && ((*v) == (uint32)(BLOCK*BLOCK)));
+            }
+
+
+        double _delta;                          // reinforcement parameter
+        int _model;                             // LINEAR or ONCE
+        Grid_basic<2, Site> _G;                 // the sites
+        Grid_basic<2, uint32> _blocks;          // number of full sites in each block (ONCE model)
+        typename Grid_basic<2, Site>::Cursor _C;// cursor for the accesses to _G
+        Site * _S;                              // site at the current position
+        iVec2 _pos;                             // current position
+        iBox2 _R;                               // rectangle containing the trace
+        int64 _range;                           // number of visited sites
+        uint64 _nbsteps;                        // number of single steps
+        uint64 _nbjumps;                        // number of jumps
+        uint64 _maxV;                           // largest local time
+        int64 _sincefull;                       // number of consecutive steps on full sites
+        iBox2 _full;                            // last square of full blocks
+        random_t _gen;                          // random number generator
+
+        ReinforcedWalkZ2(const ReinforcedWalkZ2 &) = delete;
+        ReinforcedWalkZ2 & operator=(const ReinforcedWalkZ2 &) = delete;
+    };
+
+
+}
+
+
+/* end of file */
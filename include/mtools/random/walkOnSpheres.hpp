@@ -0,0 +1,255 @@
+/** @file walkOnSpheres.hpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "../misc/internal/mtools_export.hpp"
+#include "../misc/misc.hpp"
+#include "../misc/error.hpp"
+#include "../maths/vec.hpp"
+#include "classiclaws.hpp"
+
+#include <cmath>
+#include <complex>
+#include <algorithm>
+
+
+namespace mtools
+{
+
+
+    namespace internals_random
+    {
+
+        /**
+         * Exit distribution of a planar Brownian motion started at the center of the square
+         * [-1,1]^2: the 4 sides are equally likely and, on a side, the absolute value t of the
+         * tangential coordinate has cdf G(t) = sum_{k odd} 8 sin(k pi t / 2) / (k pi cosh(k pi / 2))
+         * (Poisson kernel of the square computed by separation of variables). The cdf is tabulated
+         * and inverted by interpolation followed by Newton steps on the exact series so the result is
+         * accurate to the double precision.
+         **/
+        struct BMSquareExitTable
+        {
+            static const int NBTERMS = 16;  // k = 1, 3, ..., 31 (the next term is below 1e-21)
+            static const int N = 1024;      // number of intervals of the table
+
+            BMSquareExitTable()
+                {
+                for (int i = 0; i < NBTERMS; i++)
+                    {
+                    const double k = 2 * i + 1;
+                    _a[i] = 8.0 / (k*PI*std::cosh(k*PI / 2));
+                    _b[i] = 4.0 / std::cosh(k*PI / 2);
+                    }
+                double g;
+                for (int i = 0; i <= N; i++) { _G[i] = cdf((double)i / N, g); }
+                _G[N] = 1.0;
+                }
+
+            /* return G(t) and put the density G'(t) in g */
+            inline double cdf(double t, double & g) const
+                {
+                const double th = t*PI / 2;
+                const double s1 = std::sin(th), c1 = std::cos(th);
+                const double c2 = 2 * (1.0 - 2 * s1*s1);    // 2 cos(2 th) for the recurrences on the odd multiples of th
+                double sp = -s1, s = s1, cp = c1, c = c1;
+                double G = 0.0; g = 0.0;
+                for (int i = 0; i < NBTERMS; i++)
+                    {
+                    G += _a[i] * s; g += _b[i] * c;
+                    const double sn = c2*s - sp; sp = s; s = sn;
+                    const double cn = c2*c - cp; cp = c; c = cn;
+                    }
+                return G;
+                }
+
+            /* return t in [0,1] such that G(t) = v */
+            inline double inv(double v) const
+                {
+                const int i = std::max<int>(0, (int)(std::upper_bound(_G, _G + N + 1, v) - _G) - 1);
+                if (i >= N) return 1.0;
+                const double lo = (double)i / N, hi = (double)(i + 1) / N;
+                double t = lo + (v - _G[i]) / (_G[i + 1] - _G[i]) / N;
+                for (int it = 0; it < 3; it++)
+                    {
+                    double g;
+                    const double e = cdf(t, g) - v;
+                    if (!(g > 0.0)) break;
+                    const double nt = std::min<double>(hi, std::max<double>(lo, t - e / g));
+                    if (nt == t) break;
+                    t = nt;
+                    }
+                return t;
+                }
+
+            double _a[NBTERMS], _b[NBTERMS];
+            double _G[N + 1];
+        };
+
+
+        /* the table (constructed on first use) */
+        inline const BMSquareExitTable & bmSquareExitTable() { static const BMSquareExitTable T; return T; }
+
+    }
+
+
+    /**
+     * Move a planar Brownian motion started at pos to its exit point of the disc of radius r
+     * centered at pos (uniform on the circle).
+     *
+     * @param [in,out]  pos The position.
+     * @param   r           The radius of the disc.
+     * @param [in,out]  gen The random number generator.
+     **/
+    template<class random_t> inline void BM_exitDisc(fVec2 & pos, double r, random_t & gen)
+        {
+        const double a = Unif(gen)*TWOPI;
+        pos.X() += r*std::cos(a);
+        pos.Y() += r*std::sin(a);
+        }
+
+
+    /**
+     * Move a planar Brownian motion started at pos to its exit point of the square
+     * [pos.X()-r, pos.X()+r] x [pos.Y()-r, pos.Y()+r] (exact law, one 64 bits random number).
+     *
+     * @param [in,out]  pos The position.
+     * @param   r           Half the side of the square.
+     * @param [in,out]  gen The random number generator.
+     **/
+    template<class random_t> inline void BM_exitSquare(fVec2 & pos, double r, random_t & gen)
+        {
+        const uint64 u = Unif_64(gen);
+        const double t = r*internals_random::bmSquareExitTable().inv((u >> 11) * (1.0 / 9007199254740992.0));
+        const double off = ((u & 4) ? t : -t);
+        switch (u & 3)
+            {
+            case 0: pos.X() += r; pos.Y() += off; break;
+            case 1: pos.X() -= r; pos.Y() += off; break;
+            case 2: pos.Y() += r; pos.X() += off; break;
+            case 3: pos.Y() -= r; pos.X() += off; break;
+            }
+        }
+
+
+    /**
+     * Move a planar Brownian motion started at pos to the point where it first hits the circle of
+     * radius r centered at center. The law is exact whether pos is inside or outside the circle:
+     * inside, the harmonic measure seen from pos is the image of the uniform measure under the
+     * Moebius transform of the disc which maps the center to pos, and outside it is the harmonic
+     * measure seen from the inverse of pos with respect to the circle (the walk is recurrent so it
+     * hits the circle a.s.). This makes it possible to bring back a walker which went far away from
+     * a cluster in a single jump.
+     *
+     * @param [in,out]  pos     The position.
+     * @param   center          The center of the circle.
+     * @param   r               The radius of the circle.
+     * @param [in,out]  gen     The random number generator.
+     **/
+    template<class random_t> inline void BM_hitCircle(fVec2 & pos, const fVec2 & center, double r, random_t & gen)
+        {
+        MTOOLS_ASSERT(r > 0.0);
+        std::complex<double> a((pos.X() - center.X()) / r, (pos.Y() - center.Y()) / r);
+        const double n2 = std::norm(a);
+        if (n2 > 1.0) { a /= n2; } // inverse with respect to the unit circle
+        const double th = Unif(gen)*TWOPI;
+        const std::complex<double> w(std::cos(th), std::sin(th));
+        const std::complex<double> z = (w + a) / (1.0 + std::conj(a)*w);
+        pos.X() = center.X() + r*z.real();
+        pos.Y() = center.Y() + r*z.imag();
+        }
+
+
+    namespace internals_random
+    {
+
+        /* Common part of walkOnSpheres() and walkOnSquares() */
+        template<bool SQUARE, class DistOracle, class random_t> int64 walkOnShapes(fVec2 & pos, DistOracle & dist, double eps, double R, random_t & gen)
+            {
+            MTOOLS_ASSERT((eps > 0.0) && (R > 0.0));
+            int64 nb = 0;
+            for (;;)
+                {
+                if (pos.norm() > 2 * R) { BM_hitCircle(pos, fVec2(0.0, 0.0), R, gen); nb++; } // too far: come back in one jump
+                const double d = dist((const fVec2 &)pos);
+                if (d <= eps) return nb;
+                if (SQUARE) BM_exitSquare(pos, d, gen); else BM_exitDisc(pos, d, gen);
+                nb++;
+                }
+            }
+
+    }
+
+
+    /**
+     * Walk on spheres: move a planar Brownian motion started at pos until it comes within
+     * distance eps of an absorbing set A contained in the disc of radius R centered at the origin.
+     *
+     * The absorbing set is only known through the distance oracle dist: a callable object with
+     * signature 'double dist(const fVec2 & pos)' which returns a lower bound on the (euclidian)
+     * distance from pos to A. The walk jumps, in a single step, to the exit point of the disc of
+     * that radius centered at the current position (for instance dist(p) = G.emptyRadius(p) - 2*RAD
+     * for particles of radius RAD stored in a ParticleGrid2D G). When the walk goes further than 2R
+     * from the origin, it is brought back on the circle of radius R with BM_hitCircle() so a walker
+     * never wanders away. The exit points are exact so the only approximation is the final
+     * eps-shell. The number of jumps is of order log(1/eps) per visit near the set.
+     *
+     * @param [in,out]  pos     The starting position. When the method returns, a point at distance
+     *                          at most eps from A (according to the oracle).
+     * @param [in,out]  dist    The distance oracle.
+     * @param   eps             The absorbing distance (> 0).
+     * @param   R               Radius of a disc centered at the origin containing A (> 0).
+     * @param [in,out]  gen     The random number generator.
+     *
+     * @return  The number of jumps performed.
+     **/
+    template<class DistOracle, class random_t> inline int64 walkOnSpheres(fVec2 & pos, DistOracle && dist, double eps, double R, random_t & gen)
+        {
+        return internals_random::walkOnShapes<false>(pos, dist, eps, R, gen);
+        }
+
+
+    /**
+     * Walk on squares: same as walkOnSpheres() but the oracle returns a lower bound on the distance
+     * from pos to A for the infinity norm (i.e. the half side of a square centered at pos which
+     * does not meet A) and the walk jumps to the exit point of that square (exact law, see
+     * BM_exitSquare()). This is the natural choice when the oracle comes from empty boxes of a grid
+     * (see for instance Grid_basic::findFullBoxCentered()).
+     *
+     * @param [in,out]  pos     The starting position.
+     * @param [in,out]  dist    The oracle (half side of an empty square centered at pos).
+     * @param   eps             The absorbing distance (> 0).
+     * @param   R               Radius of a disc centered at the origin containing A (> 0).
+     * @param [in,out]  gen     The random number generator.
+     *
+     * @return  The number of jumps performed.
+     **/
+    template<class DistOracle, class random_t> inline int64 walkOnSquares(fVec2 & pos, DistOracle && dist, double eps, double R, random_t & gen)
+        {
+        return internals_random::walkOnShapes<true>(pos, dist, eps, R, gen);
+        }
+
+
+
+
+}
+
+
+/* end of file */
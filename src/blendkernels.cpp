@@ -0,0 +1,736 @@
+/** @file blendkernels.cpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "graphics/internal/blendkernels.hpp"
+
+#include <algorithm>
+
+
+/* SSE2 is always available on x64 (and on x86 when the compiler targets it) */
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+	#define MTOOLS_BLEND_SSE2 1
+	#include <emmintrin.h>
+	/* AVX2 kernels are compiled for a specific target and selected at runtime */
+	#if defined(_MSC_VER) || defined(__GNUC__) || defined(__clang__)
+		#define MTOOLS_BLEND_AVX2 1
+		#include <immintrin.h>
+		#if defined(_MSC_VER)
+			#include <intrin.h>
+			#define MTOOLS_TARGET_AVX2
+		#else
+			#define MTOOLS_TARGET_AVX2 __attribute__((target("avx2")))
+		#endif
+	#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	#define MTOOLS_BLEND_NEON 1
+	#include <arm_neon.h>
+#endif
+
+
+namespace mtools
+{
+
+	namespace internals_graphics
+	{
+
+
+		/******************************************************************************************
+		* SCALAR VERSION
+		*******************************************************************************************/
+
+		static void _blendLine_scalar(RGBc * dst, const RGBc * src, size_t n, uint32 op)
+			{
+			for (size_t i = 0; i < n; i++) { dst[i].blend(src[i], op); }
+			}
+
+		static void _blendLineReverse_scalar(RGBc * dst, const RGBc * src, size_t n, uint32 op)
+			{
+			for (size_t i = n; i > 0; i--) { dst[i - 1].blend(src[i - 1], op); }
+			}
+
+		static void _blendLineColor_scalar(RGBc * dst, size_t n, RGBc color)
+			{
+			for (size_t i = 0; i < n; i++) { dst[i].blend(color); }
+			}
+
+		static void _fillLine_scalar(RGBc * dst, size_t n, RGBc color)
+			{
+			for (size_t i = 0; i < n; i++) { dst[i] = color; }
+			}
+
+		static void _multOpacityLine_scalar(RGBc * dst, size_t n, uint32 op)
+			{
+			for (size_t i = 0; i < n; i++) { dst[i].multOpacityInt(op); }
+			}
+
+		static void _premultiplyLine_scalar(RGBc * dst, size_t n)
+			{
+			for (size_t i = 0; i < n; i++) { dst[i].premultiply(); }
+			}
+
+		static void _planarToLine_scalar(RGBc * dst, const uint8 * R, const uint8 * G, const uint8 * B, const uint8 * A, size_t n)
+			{
+			if (A == nullptr) { for (size_t i = 0; i < n; i++) { dst[i].color = ((uint32)B[i]) | (((uint32)G[i]) << 8) | (((uint32)R[i]) << 16) | 0xFF000000; } return; }
+			for (size_t i = 0; i < n; i++) { dst[i].color = ((uint32)B[i]) | (((uint32)G[i]) << 8) | (((uint32)R[i]) << 16) | (((uint32)A[i]) << 24); }
+			}
+
+		static void _interleavedToLine_scalar(RGBc * dst, const uint8 * src, size_t n, int nbchannels)
+			{
+			if (nbchannels == 3) { for (size_t i = 0; i < n; i++) { dst[i].color = ((uint32)src[3*i + 2]) | (((uint32)src[3*i + 1]) << 8) | (((uint32)src[3*i]) << 16) | 0xFF000000; } return; }
+			for (size_t i = 0; i < n; i++) { dst[i].color = ((uint32)src[4*i + 2]) | (((uint32)src[4*i + 1]) << 8) | (((uint32)src[4*i]) << 16) | (((uint32)src[4*i + 3]) << 24); }
+			}
+
+		static size_t _findFirstNotEqual_scalar(const RGBc * src, size_t n, uint32 value, uint32 mask)
+			{
+			value &= mask;
+			for (size_t i = 0; i < n; i++) { if ((src[i].color & mask) != value) return i; }
+			return n;
+			}
+
+		static size_t _findLastNotEqual_scalar(const RGBc * src, size_t n, uint32 value, uint32 mask)
+			{
+			value &= mask;
+			for (size_t i = n; i > 0; i--) { if ((src[i - 1].color & mask) != value) return i - 1; }
+			return n;
+			}
+
+
+		/******************************************************************************************
+		* SSE2 VERSION (4 pixels at a time)
+		*
+		* The pixels are expanded to 16 bits per channel so that the products (at most 256*255)
+		* do not overflow. The final addition is done on 32 bits words to match exactly the
+		* scalar code of RGBc::get_blend().
+		*******************************************************************************************/
+
+#if (MTOOLS_BLEND_SSE2)
+
+		/* blend 4 pixels of s over 4 pixels of d, vop contains the opacity in each 16 bits word */
+		static inline __m128i _blend_sse2(__m128i d, __m128i s, __m128i vop)
+			{
+			const __m128i zero = _mm_setzero_si128();
+			const __m128i c128 = _mm_set1_epi16(128);
+			const __m128i c256 = _mm_set1_epi16(256);
+			// premultiply s by the opacity
+			__m128i slo = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(s, zero), vop), 8);
+			__m128i shi = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(s, zero), vop), 8);
+			// broadcast the alpha channel and convert it to [0,0x100]
+			__m128i olo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(slo, 0xFF), 0xFF);
+			__m128i ohi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(shi, 0xFF), 0xFF);
+			olo = _mm_sub_epi16(c256, _mm_add_epi16(olo, _mm_srli_epi16(_mm_and_si128(olo, c128), 7)));
+			ohi = _mm_sub_epi16(c256, _mm_add_epi16(ohi, _mm_srli_epi16(_mm_and_si128(ohi, c128), 7)));
+			// multiply d by (1 - alpha) and add s
+			__m128i dlo = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), olo), 8);
+			__m128i dhi = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), ohi), 8);
+			return _mm_add_epi32(_mm_packus_epi16(dlo, dhi), _mm_packus_epi16(slo, shi));
+			}
+
+		/* blend constant premultiplied pixels sp with complementary opacity vo over 4 pixels of d */
+		static inline __m128i _blendConst_sse2(__m128i d, __m128i vo, __m128i sp)
+			{
+			const __m128i zero = _mm_setzero_si128();
+			__m128i dlo = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), vo), 8);
+			__m128i dhi = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), vo), 8);
+			return _mm_add_epi32(_mm_packus_epi16(dlo, dhi), sp);
+			}
+
+		static void _blendLine_sse2(RGBc * dst, const RGBc * src, size_t n, uint32 op)
+			{
+			const __m128i vop = _mm_set1_epi16((short)op);
+			size_t i = 0;
+			for (; i + 4 <= n; i += 4)
+				{
+				__m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+				__m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+				_mm_storeu_si128((__m128i*)(dst + i), _blend_sse2(d, s, vop));
+				}
+			_blendLine_scalar(dst + i, src + i, n - i, op);
+			}
+
+		static void _blendLineReverse_sse2(RGBc * dst, const RGBc * src, size_t n, uint32 op)
+			{
+			const __m128i vop = _mm_set1_epi16((short)op);
+			size_t i = n;
+			for (; i >= 4; i -= 4)
+				{
+				__m128i s = _mm_loadu_si128((const __m128i*)(src + i - 4));
+				__m128i d = _mm_loadu_si128((const __m128i*)(dst + i - 4));
+				_mm_storeu_si128((__m128i*)(dst + i - 4), _blend_sse2(d, s, vop));
+				}
+			_blendLineReverse_scalar(dst, src, i, op);
+			}
+
+		static void _blendLineColor_sse2(RGBc * dst, size_t n, RGBc color)
+			{
+			const __m128i vo = _mm_set1_epi16((short)(0x100 - convertAlpha_0xFF_to_0x100(color.comp.A)));
+			const __m128i sp = _mm_set1_epi32((int)color.color);
+			size_t i = 0;
+			for (; i + 4 <= n; i += 4)
+				{
+				__m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+				_mm_storeu_si128((__m128i*)(dst + i), _blendConst_sse2(d, vo, sp));
+				}
+			_blendLineColor_scalar(dst + i, n - i, color);
+			}
+
+		static void _fillLine_sse2(RGBc * dst, size_t n, RGBc color)
+			{
+			const __m128i c = _mm_set1_epi32((int)color.color);
+			size_t i = 0;
+			for (; i + 4 <= n; i += 4) { _mm_storeu_si128((__m128i*)(dst + i), c); }
+			_fillLine_scalar(dst + i, n - i, color);
+			}
+
+		/* (c * op) >> 8 on each channel: same as the SWAR code of RGBc::getMultOpacityInt() */
+		static void _multOpacityLine_sse2(RGBc * dst, size_t n, uint32 op)
+			{
+			const __m128i zero = _mm_setzero_si128();
+			const __m128i vop = _mm_set1_epi16((short)op);
+			size_t i = 0;
+			for (; i + 4 <= n; i += 4)
+				{
+				__m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+				__m128i lo = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), vop), 8);
+				__m128i hi = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), vop), 8);
+				_mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(lo, hi));
+				}
+			_multOpacityLine_scalar(dst + i, n - i, op);
+			}
+
+		/* c * A / 255 on the color channels of 2 pixels expanded to 16 bits. The alpha words are multiplied by
+		 * 255 so they are unchanged. The division uses x/255 = (x + 1 + (x >> 8)) >> 8, exact for x <= 255*255 */
+		static inline __m128i _premultiply_sse2(__m128i x)
+			{
+			const __m128i amask = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+			const __m128i c255 = _mm_set1_epi16(255);
+			const __m128i one = _mm_set1_epi16(1);
+			__m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, 0xFF), 0xFF);
+			a = _mm_or_si128(_mm_andnot_si128(amask, a), _mm_and_si128(amask, c255));
+			x = _mm_mullo_epi16(x, a);
+			return _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(x, one), _mm_srli_epi16(x, 8)), 8);
+			}
+
+		static void _premultiplyLine_sse2(RGBc * dst, size_t n)
+			{
+			const __m128i zero = _mm_setzero_si128();
+			size_t i = 0;
+			for (; i + 4 <= n; i += 4)
+				{
+				__m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+				__m128i lo = _premultiply_sse2(_mm_unpacklo_epi8(d, zero));
+				__m128i hi = _premultiply_sse2(_mm_unpackhi_epi8(d, zero));
+				_mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(lo, hi));
+				}
+			_premultiplyLine_scalar(dst + i, n - i);
+			}
+
+		/* interleave 16 pixels given by their planes (BGRA order in memory) */
+		static void _planarToLine_sse2(RGBc * dst, const uint8 * R, const uint8 * G, const uint8 * B, const uint8 * A, size_t n)
+			{
+			const __m128i ff = _mm_set1_epi8((char)0xFF);
+			size_t i = 0;
+			for (; i + 16 <= n; i += 16)
+				{
+				const __m128i r = _mm_loadu_si128((const __m128i*)(R + i));
+				const __m128i g = _mm_loadu_si128((const __m128i*)(G + i));
+				const __m128i b = _mm_loadu_si128((const __m128i*)(B + i));
+				const __m128i a = (A == nullptr) ? ff : _mm_loadu_si128((const __m128i*)(A + i));
+				const __m128i bglo = _mm_unpacklo_epi8(b, g), bghi = _mm_unpackhi_epi8(b, g);
+				const __m128i ralo = _mm_unpacklo_epi8(r, a), rahi = _mm_unpackhi_epi8(r, a);
+				_mm_storeu_si128((__m128i*)(dst + i), _mm_unpacklo_epi16(bglo, ralo));
+				_mm_storeu_si128((__m128i*)(dst + i + 4), _mm_unpackhi_epi16(bglo, ralo));
+				_mm_storeu_si128((__m128i*)(dst + i + 8), _mm_unpacklo_epi16(bghi, rahi));
+				_mm_storeu_si128((__m128i*)(dst + i + 12), _mm_unpackhi_epi16(bghi, rahi));
+				}
+			_planarToLine_scalar(dst + i, R + i, G + i, B + i, ((A == nullptr) ? nullptr : A + i), n - i);
+			}
+
+		/* RGBA -> BGRA: swap the first and third bytes of each pixel (RGB lines use the scalar code) */
+		static void _interleavedToLine_sse2(RGBc * dst, const uint8 * src, size_t n, int nbchannels)
+			{
+			size_t i = 0;
+			if (nbchannels == 4)
+				{
+				const __m128i mga = _mm_set1_epi32((int)0xFF00FF00), mrb = _mm_set1_epi32(0xFF);
+				for (; i + 4 <= n; i += 4)
+					{
+					const __m128i x = _mm_loadu_si128((const __m128i*)(src + 4*i));
+					const __m128i y = _mm_or_si128(_mm_and_si128(x, mga), _mm_or_si128(_mm_slli_epi32(_mm_and_si128(x, mrb), 16), _mm_and_si128(_mm_srli_epi32(x, 16), mrb)));
+					_mm_storeu_si128((__m128i*)(dst + i), y);
+					}
+				}
+			_interleavedToLine_scalar(dst + i, src + nbchannels*i, n - i, nbchannels);
+			}
+
+		/* true if the 16 pixels at p all satisfy (p[i] & mask) == value */
+		static inline bool _equal16_sse2(const RGBc * p, __m128i vv, __m128i vm)
+			{
+			__m128i a = _mm_cmpeq_epi32(_mm_and_si128(_mm_loadu_si128((const __m128i*)(p)), vm), vv);
+			__m128i b = _mm_cmpeq_epi32(_mm_and_si128(_mm_loadu_si128((const __m128i*)(p + 4)), vm), vv);
+			__m128i c = _mm_cmpeq_epi32(_mm_and_si128(_mm_loadu_si128((const __m128i*)(p + 8)), vm), vv);
+			__m128i d = _mm_cmpeq_epi32(_mm_and_si128(_mm_loadu_si128((const __m128i*)(p + 12)), vm), vv);
+			return (_mm_movemask_epi8(_mm_and_si128(_mm_and_si128(a, b), _mm_and_si128(c, d))) == 0xFFFF);
+			}
+
+		/* skip blocks of 16 equal pixels, the scalar code locates the difference inside the first block which is not */
+		static size_t _findFirstNotEqual_sse2(const RGBc * src, size_t n, uint32 value, uint32 mask)
+			{
+			const __m128i vv = _mm_set1_epi32((int)(value & mask)), vm = _mm_set1_epi32((int)mask);
+			size_t i = 0;
+			while ((i + 16 <= n) && (_equal16_sse2(src + i, vv, vm))) { i += 16; }
+			return i + _findFirstNotEqual_scalar(src + i, n - i, value, mask);
+			}
+
+		static size_t _findLastNotEqual_sse2(const RGBc * src, size_t n, uint32 value, uint32 mask)
+			{
+			const __m128i vv = _mm_set1_epi32((int)(value & mask)), vm = _mm_set1_epi32((int)mask);
+			size_t m = n;
+			while ((m >= 16) && (_equal16_sse2(src + m - 16, vv, vm))) { m -= 16; }
+			const size_t r = _findLastNotEqual_scalar(src, m, value, mask);
+			return (r == m) ? n : r;
+			}
+
+#endif
+
+
+		/******************************************************************************************
+		* AVX2 VERSION (8 pixels at a time)
+		*
+		* Same algorithm as the SSE2 version. Unpacking/packing operate within each 128 bits lane
+		* so the order of the pixels is preserved.
+		* The upper halves of the ymm registers are cleared before calling the (non VEX encoded)
+		* scalar code for the remaining pixels, otherwise all the subsequent SSE code of the
+		* program pays the AVX/SSE transition penalty.
+		*******************************************************************************************/
+
+#if (MTOOLS_BLEND_AVX2)
+
+		MTOOLS_TARGET_AVX2 static inline __m256i _blend_avx2(__m256i d, __m256i s, __m256i vop)
+			{
+			const __m256i zero = _mm256_setzero_si256();
+			const __m256i c128 = _mm256_set1_epi16(128);
+			const __m256i c256 = _mm256_set1_epi16(256);
+			__m256i slo = _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(s, zero), vop), 8);
+			__m256i shi = _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(s, zero), vop), 8);
+			__m256i olo = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(slo, 0xFF), 0xFF);
+			__m256i ohi = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(shi, 0xFF), 0xFF);
+			olo = _mm256_sub_epi16(c256, _mm256_add_epi16(olo, _mm256_srli_epi16(_mm256_and_si256(olo, c128), 7)));
+			ohi = _mm256_sub_epi16(c256, _mm256_add_epi16(ohi, _mm256_srli_epi16(_mm256_and_si256(ohi, c128), 7)));
+			__m256i dlo = _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(d, zero), olo), 8);
+			__m256i dhi = _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(d, zero), ohi), 8);
+			return _mm256_add_epi32(_mm256_packus_epi16(dlo, dhi), _mm256_packus_epi16(slo, shi));
+			}
+
+		MTOOLS_TARGET_AVX2 static inline __m256i _blendConst_avx2(__m256i d, __m256i vo, __m256i sp)
+			{
+			const __m256i zero = _mm256_setzero_si256();
+			__m256i dlo = _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(d, zero), vo), 8);
+			__m256i dhi = _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(d, zero), vo), 8);
+			return _mm256_add_epi32(_mm256_packus_epi16(dlo, dhi), sp);
+			}
+
+		MTOOLS_TARGET_AVX2 static void _blendLine_avx2(RGBc * dst, const RGBc * src, size_t n, uint32 op)
+			{
+			const __m256i vop = _mm256_set1_epi16((short)op);
+			size_t i = 0;
+			for (; i + 8 <= n; i += 8)
+				{
+				__m256i s = _mm256_loadu_si256((const __m256i*)(src + i));
+				__m256i d = _mm256_loadu_si256((const __m256i*)(dst + i));
+				_mm256_storeu_si256((__m256i*)(dst + i), _blend_avx2(d, s, vop));
+				}
+			_mm256_zeroupper();
+			_blendLine_scalar(dst + i, src + i, n - i, op);
+			}
+
+		MTOOLS_TARGET_AVX2 static void _blendLineReverse_avx2(RGBc * dst, const RGBc * src, size_t n, uint32 op)
+			{
+			const __m256i vop = _mm256_set1_epi16((short)op);
+			size_t i = n;
+			for (; i >= 8; i -= 8)
+				{
+				__m256i s = _mm256_loadu_si256((const __m256i*)(src + i - 8));
+				__m256i d = _mm256_loadu_si256((const __m256i*)(dst + i - 8));
+				_mm256_storeu_si256((__m256i*)(dst + i - 8), _blend_avx2(d, s, vop));
+				}
+			_mm256_zeroupper();
+			_blendLineReverse_scalar(dst, src, i, op);
+			}
+
+		MTOOLS_TARGET_AVX2 static void _blendLineColor_avx2(RGBc * dst, size_t n, RGBc color)
+			{
+			const __m256i vo = _mm256_set1_epi16((short)(0x100 - convertAlpha_0xFF_to_0x100(color.comp.A)));
+			const __m256i sp = _mm256_set1_epi32((int)color.color);
+			size_t i = 0;
+			for (; i + 8 <= n; i += 8)
+				{
+				__m256i d = _mm256_loadu_si256((const __m256i*)(dst + i));
+				_mm256_storeu_si256((__m256i*)(dst + i), _blendConst_avx2(d, vo, sp));
+				}
+			_mm256_zeroupper();
+			_blendLineColor_scalar(dst + i, n - i, color);
+			}
+
+		MTOOLS_TARGET_AVX2 static void _fillLine_avx2(RGBc * dst, size_t n, RGBc color)
+			{
+			const __m256i c = _mm256_set1_epi32((int)color.color);
+			size_t i = 0;
+			for (; i + 8 <= n; i += 8) { _mm256_storeu_si256((__m256i*)(dst + i), c); }
+			_mm256_zeroupper();
+			_fillLine_scalar(dst + i, n - i, color);
+			}
+
+		MTOOLS_TARGET_AVX2 static void _multOpacityLine_avx2(RGBc * dst, size_t n, uint32 op)
+			{
+			const __m256i zero = _mm256_setzero_si256();
+			const __m256i vop = _mm256_set1_epi16((short)op);
+			size_t i = 0;
+			for (; i + 8 <= n; i += 8)
+				{
+				__m256i d = _mm256_loadu_si256((const __m256i*)(dst + i));
+				__m256i lo = _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(d, zero), vop), 8);
+				__m256i hi = _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(d, zero), vop), 8);
+				_mm256_storeu_si256((__m256i*)(dst + i), _mm256_packus_epi16(lo, hi));
+				}
+			_mm256_zeroupper();
+			_multOpacityLine_scalar(dst + i, n - i, op);
+			}
+
+		MTOOLS_TARGET_AVX2 static inline __m256i _premultiply_avx2(__m256i x)
+			{
+			const __m256i amask = _mm256_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0);
+			const __m256i c255 = _mm256_set1_epi16(255);
+			const __m256i one = _mm256_set1_epi16(1);
+			__m256i a = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(x, 0xFF), 0xFF);
+			a = _mm256_or_si256(_mm256_andnot_si256(amask, a), _mm256_and_si256(amask, c255));
+			x = _mm256_mullo_epi16(x, a);
+			return _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(x, one), _mm256_srli_epi16(x, 8)), 8);
+			}
+
+		MTOOLS_TARGET_AVX2 static void _premultiplyLine_avx2(RGBc * dst, size_t n)
+			{
+			const __m256i zero = _mm256_setzero_si256();
+			size_t i = 0;
+			for (; i + 8 <= n; i += 8)
+				{
+				__m256i d = _mm256_loadu_si256((const __m256i*)(dst + i));
+				__m256i lo = _premultiply_avx2(_mm256_unpacklo_epi8(d, zero));
+				__m256i hi = _premultiply_avx2(_mm256_unpackhi_epi8(d, zero));
+				_mm256_storeu_si256((__m256i*)(dst + i), _mm256_packus_epi16(lo, hi));
+				}
+			_mm256_zeroupper();
+			_premultiplyLine_scalar(dst + i, n - i);
+			}
+
+		/* true if the 16 pixels at p all satisfy (p[i] & mask) == value */
+		MTOOLS_TARGET_AVX2 static inline bool _equal16_avx2(const RGBc * p, __m256i vv, __m256i vm)
+			{
+			__m256i a = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_loadu_si256((const __m256i*)(p)), vm), vv);
+			__m256i b = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_loadu_si256((const __m256i*)(p + 8)), vm), vv);
+			return (_mm256_movemask_epi8(_mm256_and_si256(a, b)) == -1);
+			}
+
+		MTOOLS_TARGET_AVX2 static size_t _findFirstNotEqual_avx2(const RGBc * src, size_t n, uint32 value, uint32 mask)
+			{
+			const __m256i vv = _mm256_set1_epi32((int)(value & mask)), vm = _mm256_set1_epi32((int)mask);
+			size_t i = 0;
+			while ((i + 16 <= n) && (_equal16_avx2(src + i, vv, vm))) { i += 16; }
+			_mm256_zeroupper();
+			return i + _findFirstNotEqual_scalar(src + i, n - i, value, mask);
+			}
+
+		MTOOLS_TARGET_AVX2 static size_t _findLastNotEqual_avx2(const RGBc * src, size_t n, uint32 value, uint32 mask)
+			{
+			const __m256i vv = _mm256_set1_epi32((int)(value & mask)), vm = _mm256_set1_epi32((int)mask);
+			size_t m = n;
+			while ((m >= 16) && (_equal16_avx2(src + m - 16, vv, vm))) { m -= 16; }
+			_mm256_zeroupper();
+			const size_t r = _findLastNotEqual_scalar(src, m, value, mask);
+			return (r == m) ? n : r;
+			}
+
+		/* return true if both the CPU and the OS support AVX2 */
+		static bool _cpuHasAVX2()
+			{
+			#if defined(_MSC_VER)
+			int info[4];
+			__cpuid(info, 0);
+			if (info[0] < 7) return false;
+			__cpuid(info, 1);
+			if (((info[2] & (1 << 27)) == 0) || ((info[2] & (1 << 28)) == 0)) return false; // OSXSAVE and AVX
+			if ((_xgetbv(0) & 6) != 6) return false; // the OS saves the YMM registers
+			__cpuidex(info, 7, 0);
+			return ((info[1] & (1 << 5)) != 0);
+			#else
+			__builtin_cpu_init();
+			return (__builtin_cpu_supports("avx2") != 0);
+			#endif
+			}
+
+#endif
+
+
+		/******************************************************************************************
+		* NEON VERSION (4 pixels at a time)
+		*******************************************************************************************/
+
+#if (MTOOLS_BLEND_NEON)
+
+		static inline uint8x16_t _blend_neon(uint8x16_t d, uint8x16_t s, uint16x8_t vop)
+			{
+			// premultiply s by the opacity
+			uint16x8_t slo = vshrq_n_u16(vmulq_u16(vmovl_u8(vget_low_u8(s)), vop), 8);
+			uint16x8_t shi = vshrq_n_u16(vmulq_u16(vmovl_u8(vget_high_u8(s)), vop), 8);
+			uint8x16_t sp = vcombine_u8(vmovn_u16(slo), vmovn_u16(shi));
+			// complementary opacity of each pixel, converted to [0,0x100] and broadcasted on 16 bits words
+			uint32x4_t a = vshrq_n_u32(vreinterpretq_u32_u8(sp), 24);
+			a = vaddq_u32(a, vshrq_n_u32(vandq_u32(a, vdupq_n_u32(128)), 7));
+			uint32x4_t o = vsubq_u32(vdupq_n_u32(256), a);
+			o = vorrq_u32(o, vshlq_n_u32(o, 16));
+			uint32x4x2_t oo = vzipq_u32(o, o);
+			// multiply d by (1 - alpha) and add s
+			uint16x8_t dlo = vshrq_n_u16(vmulq_u16(vmovl_u8(vget_low_u8(d)), vreinterpretq_u16_u32(oo.val[0])), 8);
+			uint16x8_t dhi = vshrq_n_u16(vmulq_u16(vmovl_u8(vget_high_u8(d)), vreinterpretq_u16_u32(oo.val[1])), 8);
+			uint8x16_t dp = vcombine_u8(vmovn_u16(dlo), vmovn_u16(dhi));
+			return vreinterpretq_u8_u32(vaddq_u32(vreinterpretq_u32_u8(dp), vreinterpretq_u32_u8(sp)));
+			}
+
+		static void _blendLine_neon(RGBc * dst, const RGBc * src, size_t n, uint32 op)
+			{
+			const uint16x8_t vop = vdupq_n_u16((uint16)op);
+			size_t i = 0;
+			for (; i + 4 <= n; i += 4)
+				{
+				uint8x16_t s = vld1q_u8((const uint8*)(src + i));
+				uint8x16_t d = vld1q_u8((const uint8*)(dst + i));
+				vst1q_u8((uint8*)(dst + i), _blend_neon(d, s, vop));
+				}
+			_blendLine_scalar(dst + i, src + i, n - i, op);
+			}
+
+		static void _blendLineReverse_neon(RGBc * dst, const RGBc * src, size_t n, uint32 op)
+			{
+			const uint16x8_t vop = vdupq_n_u16((uint16)op);
+			size_t i = n;
+			for (; i >= 4; i -= 4)
+				{
+				uint8x16_t s = vld1q_u8((const uint8*)(src + i - 4));
+				uint8x16_t d = vld1q_u8((const uint8*)(dst + i - 4));
+				vst1q_u8((uint8*)(dst + i - 4), _blend_neon(d, s, vop));
+				}
+			_blendLineReverse_scalar(dst, src, i, op);
+			}
+
+		static void _blendLineColor_neon(RGBc * dst, size_t n, RGBc color)
+			{
+			// the opacity is 0x100 so the premultiplication step does not modify the color
+			const uint16x8_t vop = vdupq_n_u16(0x100);
+			const uint8x16_t s = vreinterpretq_u8_u32(vdupq_n_u32(color.color));
+			size_t i = 0;
+			for (; i + 4 <= n; i += 4)
+				{
+				uint8x16_t d = vld1q_u8((const uint8*)(dst + i));
+				vst1q_u8((uint8*)(dst + i), _blend_neon(d, s, vop));
+				}
+			_blendLineColor_scalar(dst + i, n - i, color);
+			}
+
+		static void _fillLine_neon(RGBc * dst, size_t n, RGBc color)
+			{
+			const uint32x4_t c = vdupq_n_u32(color.color);
+			size_t i = 0;
+			for (; i + 4 <= n; i += 4) { vst1q_u32((uint32*)(dst + i), c); }
+			_fillLine_scalar(dst + i, n - i, color);
+			}
+
+#endif
+
+
+		/******************************************************************************************
+		* RUNTIME DISPATCH
+		*******************************************************************************************/
+
+		/* the set of kernels in use */
+		struct _BlendKernels
+			{
+			void(*blendLine)(RGBc *, const RGBc *, size_t, uint32);
+			void(*blendLineReverse)(RGBc *, const RGBc *, size_t, uint32);
+			void(*blendLineColor)(RGBc *, size_t, RGBc);
+			void(*fillLine)(RGBc *, size_t, RGBc);
+			void(*multOpacityLine)(RGBc *, size_t, uint32);
+			void(*premultiplyLine)(RGBc *, size_t);
+			size_t(*findFirstNotEqual)(const RGBc *, size_t, uint32, uint32);
+			size_t(*findLastNotEqual)(const RGBc *, size_t, uint32, uint32);
+			void(*planarToLine)(RGBc *, const uint8 *, const uint8 *, const uint8 *, const uint8 *, size_t);
+			void(*interleavedToLine)(RGBc *, const uint8 *, size_t, int);
+			const char * name;
+			};
+
+
+		/* select the best kernels for the current CPU */
+		static _BlendKernels _selectBlendKernels()
+			{
+			#if (MTOOLS_BLEND_AVX2)
+			if (_cpuHasAVX2()) { return _BlendKernels{ &_blendLine_avx2, &_blendLineReverse_avx2, &_blendLineColor_avx2, &_fillLine_avx2, &_multOpacityLine_avx2, &_premultiplyLine_avx2, &_findFirstNotEqual_avx2, &_findLastNotEqual_avx2, &_planarToLine_sse2, &_interleavedToLine_sse2, "avx2" }; }
+			#endif
+			#if (MTOOLS_BLEND_SSE2)
+			return _BlendKernels{ &_blendLine_sse2, &_blendLineReverse_sse2, &_blendLineColor_sse2, &_fillLine_sse2, &_multOpacityLine_sse2, &_premultiplyLine_sse2, &_findFirstNotEqual_sse2, &_findLastNotEqual_sse2, &_planarToLine_sse2, &_interleavedToLine_sse2, "sse2" };
+			#elif (MTOOLS_BLEND_NEON)
+			return _BlendKernels{ &_blendLine_neon, &_blendLineReverse_neon, &_blendLineColor_neon, &_fillLine_neon, &_multOpacityLine_scalar, &_premultiplyLine_scalar, &_findFirstNotEqual_scalar, &_findLastNotEqual_scalar, &_planarToLine_scalar, &_interleavedToLine_scalar, "neon" };
+			#else
+			return _BlendKernels{ &_blendLine_scalar, &_blendLineReverse_scalar, &_blendLineColor_scalar, &_fillLine_scalar, &_multOpacityLine_scalar, &_premultiplyLine_scalar, &_findFirstNotEqual_scalar, &_findLastNotEqual_scalar, &_planarToLine_scalar, &_interleavedToLine_scalar, "scalar" };
+			#endif
+			}
+
+
+		/* the kernels are selected once, the first time they are needed (thread safe) */
+		static const _BlendKernels & _blendKernels()
+			{
+			static const _BlendKernels kernels = _selectBlendKernels();
+			return kernels;
+			}
+
+
+		void blendLine(RGBc * dst, const RGBc * src, size_t n, uint32 op)
+			{
+			MTOOLS_ASSERT(op <= 256);
+			if (op == 0) return; // nothing to do
+			_blendKernels().blendLine(dst, src, n, op);
+			}
+
+
+		void blendLineReverse(RGBc * dst, const RGBc * src, size_t n, uint32 op)
+			{
+			MTOOLS_ASSERT(op <= 256);
+			if (op == 0) return; // nothing to do
+			_blendKernels().blendLineReverse(dst, src, n, op);
+			}
+
+
+		void blendLineColor(RGBc * dst, size_t n, RGBc color)
+			{
+			_blendKernels().blendLineColor(dst, n, color);
+			}
+
+
+		void fillLine(RGBc * dst, size_t n, RGBc color)
+			{
+			_blendKernels().fillLine(dst, n, color);
+			}
+
+
+		void blendLine64(RGBc * dst, const RGBc64 * src, const uint8 * norm, size_t n, uint32 op)
+			{
+			MTOOLS_ASSERT(op <= 256);
+			if (op == 0) return; // nothing to do
+			const _BlendKernels & K = _blendKernels();
+			const size_t BUFSIZE = 256;
+			RGBc buf[BUFSIZE];
+			while (n > 0)
+				{ // the normalisation (a division) is done in scalar mode by chunk, then the chunk is blended
+				const size_t m = std::min<size_t>(n, BUFSIZE);
+				for (size_t i = 0; i < m; i++) { buf[i] = RGBc(src[i], ((uint32)norm[i]) + 1); }
+				K.blendLine(dst, buf, m, op);
+				dst += m; src += m; norm += m; n -= m;
+				}
+			}
+
+
+		void multOpacityLine(RGBc * dst, size_t n, uint32 op)
+			{
+			MTOOLS_ASSERT(op <= 256);
+			if (op == 256) return; // nothing to do
+			_blendKernels().multOpacityLine(dst, n, op);
+			}
+
+
+		void premultiplyLine(RGBc * dst, size_t n)
+			{
+			_blendKernels().premultiplyLine(dst, n);
+			}
+
+
+		size_t findFirstNotEqual(const RGBc * src, size_t n, uint32 value, uint32 mask)
+			{
+			return _blendKernels().findFirstNotEqual(src, n, value, mask);
+			}
+
+
+		size_t findLastNotEqual(const RGBc * src, size_t n, uint32 value, uint32 mask)
+			{
+			return _blendKernels().findLastNotEqual(src, n, value, mask);
+			}
+
+
+		void planarToLine(RGBc * dst, const uint8 * R, const uint8 * G, const uint8 * B, const uint8 * A, size_t n)
+			{
+			_blendKernels().planarToLine(dst, R, G, B, A, n);
+			}
+
+
+		void interleavedToLine(RGBc * dst, const uint8 * src, size_t n, int nbchannels)
+			{
+			MTOOLS_ASSERT((nbchannels == 3) || (nbchannels == 4));
+			_blendKernels().interleavedToLine(dst, src, n, nbchannels);
+			}
+
+
+		void unpremultiplyLine(RGBc * dst, size_t n)
+			{
+			for (size_t i = 0; i < n; i++) { dst[i].unpremultiply(); }
+			}
+
+
+		void convertLine(RGBc * dst, const RGBc64 * src, size_t n, uint32 N)
+			{
+			MTOOLS_ASSERT(N > 0);
+			if ((N & (N - 1)) == 0)
+				{ // power of 2: shift
+				uint32 k = 0; while ((((uint32)1) << k) < N) { k++; }
+				for (size_t i = 0; i < n; i++)
+					{
+					const uint64 c = src[i].color;
+					dst[i].color = ((uint32)((c >> k) & 0xFF)) | (((uint32)((c >> (16 + k)) & 0xFF)) << 8) | (((uint32)((c >> (32 + k)) & 0xFF)) << 16) | (((uint32)((c >> (48 + k)) & 0xFF)) << 24);
+					}
+				return;
+				}
+			for (size_t i = 0; i < n; i++) { dst[i].fromRGBc64(src[i], N); }
+			}
+
+
+		void convertLine(RGBc64 * dst, const RGBc * src, size_t n)
+			{
+			for (size_t i = 0; i < n; i++) { dst[i] = src[i]; }
+			}
+
+
+		const char * blendKernelsName()
+			{
+			return _blendKernels().name;
+			}
+
+
+	}
+
+}
+
+
+/* end of file */
+
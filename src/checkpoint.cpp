@@ -0,0 +1,183 @@
+/** @file checkpoint.cpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "io/checkpoint.hpp"
+#include "misc/error.hpp"
+
+#include <cstdio>
+#include <cerrno>
+
+#ifndef _WIN32
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+namespace mtools
+    {
+
+
+    namespace internals_checkpoint
+        {
+
+        /* true if the file exists */
+        bool fileExists(const std::string & filename)
+            {
+            std::FILE * f = std::fopen(filename.c_str(), "rb");
+            if (f == nullptr) return false;
+            std::fclose(f);
+            return true;
+            }
+
+
+        /* flush the content of a file to the disk */
+        void syncFile(const std::string & filename)
+            {
+#ifndef _WIN32
+            const int fd = ::open(filename.c_str(), O_RDONLY);
+            if (fd < 0) return;
+            ::fsync(fd);
+            ::close(fd);
+#endif
+            }
+
+        }
+
+
+    Checkpointer::Checkpointer(const std::string & prefix, const std::string & ext, size_t keep) : _prefix(prefix), _ext(ext), _keep(keep), _nb(0), _pid(0), _lastok(false)
+        {
+        }
+
+
+    Checkpointer::~Checkpointer()
+        {
+        wait();
+        }
+
+
+    std::string Checkpointer::filename(uint64 n) const
+        {
+        char buf[32];
+        std::snprintf(buf, sizeof(buf), ".%06llu", (unsigned long long)n);
+        return _prefix + buf + _ext;
+        }
+
+
+    bool Checkpointer::checkpointWith(std::function<void(OBaseArchive &)> fun)
+        {
+        if (poll()) return false; // previous checkpoint still in progress
+        _nb++;
+#ifndef _WIN32
+        const pid_t pid = ::fork();
+        if (pid < 0)
+            {
+            MTOOLS_DEBUG("Checkpointer: fork() failed");
+            _nb--;
+            return false;
+            }
+        if (pid == 0)
+            { // child: write and leave without running any destructor or atexit handler
+            const bool ok = _write(fun);
+            ::_exit(ok ? 0 : 1);
+            }
+        _pid = (int64)pid;
+#else
+        _complete(_write(fun));
+#endif
+        return true;
+        }
+
+
+    bool Checkpointer::poll()
+        {
+#ifndef _WIN32
+        if (_pid == 0) return false;
+        int status = 0;
+        const pid_t r = ::waitpid((pid_t)_pid, &status, WNOHANG);
+        if (r == 0) return true;
+        if ((r < 0) && (errno == EINTR)) return true;
+        const bool ok = ((r == (pid_t)_pid) ? (WIFEXITED(status) && (WEXITSTATUS(status) == 0)) : internals_checkpoint::fileExists(filename(_nb))); // the child may have been reaped by someone else
+        _pid = 0;
+        _complete(ok);
+#endif
+        return false;
+        }
+
+
+    bool Checkpointer::wait()
+        {
+#ifndef _WIN32
+        if (_pid == 0) return _lastok;
+        int status = 0;
+        pid_t r;
+        while (((r = ::waitpid((pid_t)_pid, &status, 0)) < 0) && (errno == EINTR)) {}
+        const bool ok = ((r == (pid_t)_pid) ? (WIFEXITED(status) && (WEXITSTATUS(status) == 0)) : internals_checkpoint::fileExists(filename(_nb)));
+        _pid = 0;
+        _complete(ok);
+#endif
+        return _lastok;
+        }
+
+
+    bool Checkpointer::_write(std::function<void(OBaseArchive &)> & fun) const
+        {
+        const std::string tmp = _prefix + ".partial" + _ext;
+        try
+            {
+            OFileArchive ar(tmp);
+            fun(ar);
+            }
+        catch (...)
+            {
+            std::remove(tmp.c_str());
+            return false;
+            }
+        internals_checkpoint::syncFile(tmp);
+        const std::string dest = filename(_nb);
+#ifdef _WIN32
+        std::remove(dest.c_str()); // rename() does not overwrite on windows
+#endif
+        return (std::rename(tmp.c_str(), dest.c_str()) == 0);
+        }
+
+
+    void Checkpointer::_complete(bool ok)
+        {
+        _lastok = ok;
+        const std::string dest = filename(_nb);
+        if (ok)
+            {
+            _files.push_back(dest);
+            while ((_keep > 0) && (_files.size() > _keep)) { std::remove(_files.front().c_str()); _files.pop_front(); }
+            }
+        else
+            {
+            std::remove((_prefix + ".partial" + _ext).c_str());
+            }
+        if (_onComplete) { _onComplete(dest, ok); }
+        }
+
+
+    }
+
+
+/* end of file */
@@ -279,6 +279,48 @@ namespace mtools
         };
 
 
+        /* get a char from stdin without echo (if possible) */
+        int basicGetKey()
+            {
+            int ch = 0;
+            #if defined(MTOOLS_HASUNISTD)
+            struct termios oldt, newt;
+            tcgetattr(STDIN_FILENO, &oldt);
+            newt = oldt; newt.c_lflag &= ~(ICANON | ECHO);
+            tcsetattr(STDIN_FILENO, TCSANOW, &newt);
+            ch = getchar();
+            if (ch == 27) { ch = getchar() + 65536; }
+            tcsetattr(STDIN_FILENO, TCSANOW, &oldt);
+            #elif defined(MTOOLS_HASCONIO)
+            ch = _getch();
+            if ((ch == 0) || (ch == 0xE0)) { return(_getch() + 66536); }
+            #else
+            ch = std::getchar(); // fallback
+            #endif
+            if (ch == 10) { ch = 13; }  // map 10 and 13 to 13 (enter key)
+            if (ch == 127) { ch = 8; }  // map 8 and 127 to 8 (backspace key)
+            return ch;
+            }
+
+
+        /* get a text from stdin and remove it afterward */
+        std::string basicGetText(const std::string & initText)
+            {
+            std::string s(initText);
+            if (s.length() > 0) { std::cout << s; }
+            int ch;
+            do
+                {
+                ch = basicGetKey();
+                if ((ch >= 32) && (ch <= 126)) {s+=(char)ch; std::cout << (char)ch;}
+                if ((ch == 8) || (ch == 127)) {if (s.length()>0) {s.resize(s.length()-1); std::cout << "\b \b";}}
+                }
+            while ((ch != 10) && (ch != 13));
+            for(size_t i=0;i< s.length(); i++) {std::cout << "\b \b";}
+            return s;
+            }
+
+
 
     }
 
@@ -290,13 +332,13 @@ namespace mtools
 
 
 
-    Console::Console(const std::string & name, bool showAtCreation) :  _waiting_text(), _tl(0), _CW(nullptr),  _disabled(0), _enableLogging(true), _enableScreen(true), _showDefaultInputValue(false), _consoleName(name), _logfile(nullptr)
+    Console::Console(const std::string & name, bool showAtCreation) :  _waiting_text(), _tl(0), _CW(nullptr),  _disabled(0), _enableLogging(true), _enableScreen(true), _showDefaultInputValue(false), _async(false), _consoleName(name), _logfile(nullptr)
         {        
-        if (showAtCreation) { _logfile = new LogFile(_consoleName + ".txt"); _startProtect(); _endProtect(); }
+        if (showAtCreation) { _logfile = new LogFile(_consoleName + ".txt"); if (_startProtect()) _endProtect(); }
         }
 
 
-    Console::Console() : _waiting_text(), _tl(0), _CW(nullptr), _disabled(0) , _enableLogging(true), _enableScreen(true), _showDefaultInputValue(false)
+    Console::Console() : _waiting_text(), _tl(0), _CW(nullptr), _disabled(0) , _enableLogging(true), _enableScreen(true), _showDefaultInputValue(false), _async(false)
         {
         ++_consoleNumber;
         _consoleName = std::string("Console-") + toString(_consoleNumber);
@@ -312,7 +354,14 @@ namespace mtools
 
     void Console::_disableConsole()
         {
-        if (_CW == (internals_console::ConsoleWidget *)nullptr) { _disabled = 3;  return; }
+        if (_CW == (internals_console::ConsoleWidget *)nullptr)
+            { // no window (never shown or headless mode): just close the log file
+            _disabled = 3;
+            std::lock_guard<std::mutex> lock(_mustop);
+            delete _logfile;
+            _logfile = nullptr;
+            return;
+            }
         _disabled = 1;
         ((internals_console::ConsoleWidget *)_CW)->removeTimer(); // remove the timer
         _disabled = 2;
@@ -334,6 +383,7 @@ namespace mtools
 
     void Console::clear()
         {
+        if (isHeadless()) { return; } // no window
         if ((fltkThreadStopped()) || (!_startProtect())) { return; }
         if (_enableScreen)
             {
@@ -351,6 +401,7 @@ namespace mtools
 
     void Console::resize(int x, int y, int w, int h)
         {
+        if (isHeadless()) { return; } // no window
         if ((fltkThreadStopped()) || (!_startProtect())) { return; }
         mtools::IndirectMemberProc<internals_console::ConsoleWidget,int,int,int,int> proxy(*_CW, &internals_console::ConsoleWidget::chsize,x,y,w,h);
         mtools::runInFltkThread(proxy);
@@ -360,6 +411,7 @@ namespace mtools
 
     void Console::move(int x, int y)
         {
+        if (isHeadless()) { return; } // no window
         if ((fltkThreadStopped()) || (!_startProtect())) { return; }
         mtools::IndirectMemberProc<internals_console::ConsoleWidget,int,int> proxy(*_CW, &internals_console::ConsoleWidget::chpos,x,y);
         mtools::runInFltkThread(proxy);
@@ -369,30 +421,47 @@ namespace mtools
 
     void Console::_print(const std::string & s)
         {
+        if (isHeadless())
+            { // no window: print on stdout, same as ConsoleBasic
+            if ((_disabled > 0) || (s.length() == 0)) { return; }
+            std::lock_guard<std::mutex> lock(_mustop);
+            if (_disabled > 0) { return; }
+            if (_enableLogging)
+                {
+                if (_logfile == nullptr) _logfile = new LogFile(_consoleName + ".txt");
+                if (_logfile->isAsync() != _async) _logfile->setAsync(_async);
+                _logfile->operator<<(s);
+                }
+            if (_enableScreen) { std::cout << s; }
+            return;
+            }
         if ((fltkThreadStopped()) || (!_startProtect())) { return; }
         std::string us = mtools::toUtf8(s);
+        const bool async = _async;
         if (us.length() != 0)
             {
             if (_enableScreen)
                 {
                 std::lock_guard<std::mutex> lock(_mutext);
-                _waiting_text += us;
+                if ((!async) || (_waiting_text.size() < 1048576)) { _waiting_text += us; } // in async mode, drop the text if more than 1MB is waiting
                 _tl = _waiting_text.size();
                 }
             if (_enableLogging)
                 {
                 if (_logfile == nullptr) _logfile = new LogFile(_consoleName + ".txt");
+                if (_logfile->isAsync() != async) _logfile->setAsync(async);
                 _logfile->operator<<(us);
                 }
             }
         int i =  0;
-        while ((_tl > 16383) && (i < 20)) { i++;  std::this_thread::sleep_for(std::chrono::milliseconds(50)); } // more than 16KB of text to write, wait a little to let the thread catch up...
+        while ((!async) && (_tl > 16383) && (i < 20)) { i++;  std::this_thread::sleep_for(std::chrono::milliseconds(50)); } // more than 16KB of text to write, wait a little to let the thread catch up...
         _endProtect();
         }
 
     
     std::string Console::_getText(const std::string & initText)
         {
+        if (isHeadless()) { return internals_console::basicGetText(initText); }
         if ((fltkThreadStopped())||(!_startProtect())) { return std::string(""); }
         mtools::IndirectMemberProc<internals_console::ConsoleWidget, const std::string *> proxy1(*_CW, &internals_console::ConsoleWidget::startInput, &initText);
         mtools::runInFltkThread(proxy1);
@@ -435,6 +504,7 @@ namespace mtools
 
     int Console::getKey()
         {
+        if (isHeadless()) { return internals_console::basicGetKey(); }
         if ((fltkThreadStopped()) || (!_startProtect())) { return 0; }
         mtools::IndirectMemberProc<internals_console::ConsoleWidget> proxy1(*_CW, &internals_console::ConsoleWidget::startGetKey);
         mtools::runInFltkThread(proxy1);
@@ -457,6 +527,7 @@ namespace mtools
         _mustop.lock();
         if (_disabled > 0) { _mustop.unlock(); return false; }
         _makeWindow();
+        if (_CW == (internals_console::ConsoleWidget *)nullptr) { _mustop.unlock(); return false; } // fltk thread not available
         return true;
         }
 
@@ -489,7 +560,7 @@ namespace mtools
     namespace internals_console
     {
 
-    ConsoleBasic::ConsoleBasic(const std::string & name) : _enableLogging(true), _enableScreen(true), _showDefaultInputValue(false), _consoleName(name), _logfile(nullptr)
+    ConsoleBasic::ConsoleBasic(const std::string & name) : _enableLogging(true), _enableScreen(true), _showDefaultInputValue(false), _async(false), _consoleName(name), _logfile(nullptr)
         {
         }
 
@@ -520,41 +591,13 @@ namespace mtools
     /* get a char without echo (if possible) */ 
     int ConsoleBasic::getKey()
         {
-        int ch = 0;
-        #if defined(MTOOLS_HASUNISTD)
-        struct termios oldt, newt;
-        tcgetattr(STDIN_FILENO, &oldt);
-        newt = oldt; newt.c_lflag &= ~(ICANON | ECHO);
-        tcsetattr(STDIN_FILENO, TCSANOW, &newt);
-        ch = getchar();
-        if (ch == 27) { ch = getchar() + 65536; }
-        tcsetattr(STDIN_FILENO, TCSANOW, &oldt);
-        #elif defined(MTOOLS_HASCONIO)
-        ch = _getch();
-        if ((ch == 0) || (ch == 0xE0)) { return(_getch() + 66536); }
-        #else
-        ch = std::getchar(); // fallback
-        #endif
-        if (ch == 10) { ch = 13; }  // map 10 and 13 to 13 (enter key)
-        if (ch == 127) { ch = 8; }  // map 8 and 127 to 8 (backspace key)
-        return ch;
+        return basicGetKey();
         }
 
     /* get a text without and remove it afterward */
     std::string ConsoleBasic::_getText(const std::string & initText)
         {
-        std::string s(initText);
-        if (s.length() > 0) { std::cout << s; }
-        int ch;
-        do
-            {
-            ch = getKey();
-            if ((ch >= 32) && (ch <= 126)) {s+=(char)ch; std::cout << (char)ch;}
-            if ((ch == 8) || (ch == 127)) {if (s.length()>0) {s.resize(s.length()-1); std::cout << "\b \b";}}
-            }
-        while ((ch != 10) && (ch != 13));
-        for(size_t i=0;i< s.length(); i++) {std::cout << "\b \b";}
-        return s;
+        return basicGetText(initText);
         }
 
 
@@ -563,6 +606,7 @@ namespace mtools
         if (_enableLogging) 
             { 
             if (_logfile == nullptr) _logfile = new LogFile(_consoleName + ".txt");
+            if (_logfile->isAsync() != _async) _logfile->setAsync(_async);
             _logfile->operator<<(s); 
             }
         if (_enableScreen) { std::cout << s; }
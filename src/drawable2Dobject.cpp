@@ -19,6 +19,12 @@
 
 
 #include "graphics/internal/drawable2Dobject.hpp"
+#include "misc/internal/threadworker.hpp"
+
+#include <map>
+#include <mutex>
+#include <algorithm>
+#include <chrono>
 
 
 namespace mtools
@@ -28,8 +34,102 @@ namespace internals_graphics
 {
 
 
+    namespace internals_drawable2Dscheduler
+        {
+
+        /* what the scheduler knows about an object */
+        struct Entry
+            {
+            Entry() : cost(-1.0), quality(0), priority(ThreadScheduler::PRIORITY_NORMAL) {}
+            double cost;    // estimated time (ms) needed to gain a quality point (-1 = unknown yet)
+            int quality;    // last known quality
+            int priority;   // last known priority
+            };
+
+        /* state of the scheduler, created on first use */
+        struct SchedulerState
+            {
+            std::mutex mut;
+            std::map<const void *, Entry> objs;
+            std::atomic<int> fps;
+            SchedulerState() : fps(Drawable2DScheduler::DEFAULT_FRAMERATE) {}
+            };
+
+        static SchedulerState & state() { static SchedulerState S; return S; }
+
+        }
+
+
+    void Drawable2DScheduler::frameRate(int fps) { internals_drawable2Dscheduler::state().fps = std::min<int>(100, std::max<int>(1, fps)); }
+
+
+    int Drawable2DScheduler::frameRate() { return internals_drawable2Dscheduler::state().fps; }
+
+
+    int Drawable2DScheduler::frameMs() { return 1000 / frameRate(); }
+
+
+    void Drawable2DScheduler::add(const void * obj)
+        {
+        auto & S = internals_drawable2Dscheduler::state();
+        std::lock_guard<std::mutex> lock(S.mut);
+        S.objs[obj] = internals_drawable2Dscheduler::Entry();
+        }
+
+
+    void Drawable2DScheduler::remove(const void * obj)
+        {
+        auto & S = internals_drawable2Dscheduler::state();
+        std::lock_guard<std::mutex> lock(S.mut);
+        S.objs.erase(obj);
+        }
+
+
+    int Drawable2DScheduler::slice(const void * obj, int priority, int quality)
+        {
+        const int P = frameMs();
+        auto & S = internals_drawable2Dscheduler::state();
+        std::lock_guard<std::mutex> lock(S.mut);
+        auto it = S.objs.find(obj);
+        if (it == S.objs.end()) return P;
+        it->second.priority = priority;
+        it->second.quality = quality;
+        if (quality >= 100) return P; // nothing to do, work() returns at once
+        // mean cost of the objects already measured, used for those which are not
+        double tot = 0.0; int nbc = 0, nba = 0;
+        for (auto & E : S.objs) { if (E.second.quality < 100) { nba++; if (E.second.cost >= 0.0) { tot += E.second.cost; nbc++; } } }
+        const double defcost = (nbc > 0) ? (tot / nbc) : (P / 10.0);
+        // weight = priority / remaining time
+        auto weight = [&](const internals_drawable2Dscheduler::Entry & E)
+            {
+            const double c = (E.cost >= 0.0) ? E.cost : defcost;
+            const double rem = std::max<double>(1.0, (100 - E.quality) * c);
+            return ((E.priority >= ThreadScheduler::PRIORITY_HIGH) ? (double)HIGH_PRIORITY_FACTOR : 1.0) / rem;
+            };
+        double sumw = 0.0;
+        for (auto & E : S.objs) { if (E.second.quality < 100) { sumw += weight(E.second); } }
+        const int nbslots = std::max<int>(1, std::min<int>(nba, ThreadScheduler::maxRunning()));
+        const double share = weight(it->second) / sumw;
+        return std::min<int>(P, std::max<int>(MIN_SLICE_MS, (int)(share * nbslots * P)));
+        }
+
+
+    void Drawable2DScheduler::report(const void * obj, int q0, int q1, double ms)
+        {
+        auto & S = internals_drawable2Dscheduler::state();
+        std::lock_guard<std::mutex> lock(S.mut);
+        auto it = S.objs.find(obj);
+        if (it == S.objs.end()) return;
+        internals_drawable2Dscheduler::Entry & E = it->second;
+        E.quality = q1;
+        if ((q1 < q0) || (q1 >= 100)) return; // drawing reset meanwhile, or finished: nothing learned
+        const double c = ms / std::max<int>(1, q1 - q0); // no progress: a quality point costs more than ms
+        E.cost = (E.cost < 0.0) ? c : (0.7 * E.cost + 0.3 * c);
+        }
+
+
      
-    AutoDrawable2DObject::AutoDrawable2DObject(Drawable2DObject * obj, bool startThread) :  _mustexit(false), _threadon(false), _obj(obj)
+    AutoDrawable2DObject::AutoDrawable2DObject(Drawable2DObject * obj, bool startThread) :  _mustexit(false), _threadon(false), _priority(ThreadScheduler::PRIORITY_NORMAL), _obj(obj)
             {
             MTOOLS_ASSERT(obj != nullptr);
             if ((!_obj->needWork())||(!startThread)) return; // no work needed, return directly
@@ -93,16 +193,43 @@ namespace internals_graphics
             }
 
 
+        void AutoDrawable2DObject::workThreadPriority(int prio)
+            {
+            _priority = prio;
+            }
+
+
+        int AutoDrawable2DObject::workThreadPriority() const
+            {
+            return _priority;
+            }
+
+
+        /* abort predicate for ThreadScheduler::acquire() */
+        static bool _autoDrawableMustExit(void * data)
+            {
+            return ((std::atomic<bool> *)data)->load();
+            }
+
+
         /* the thread procedure doing the work */
         void AutoDrawable2DObject::_workerThread()
             {
             try
                 {
                 int nb = 0;
+                Drawable2DScheduler::add(this);
                 _threadon = true; // ok we are on...
                 while (!_mustexit) // loop until we are required to exit
                     {
-                    int q = _obj->work(500); // work for 1/3 of a second
+                    const int q0 = _obj->quality();
+                    const int ms = Drawable2DScheduler::slice(this, _priority, q0); // time allotted by the scheduler (at most a frame)
+                    if (!ThreadScheduler::acquire(_priority, &_autoDrawableMustExit, &_mustexit)) break; // wait for an execution slot
+                    const auto t0 = std::chrono::steady_clock::now();
+                    int q;
+                    try { q = _obj->work(ms); } catch (...) { ThreadScheduler::release(); throw; }
+                    ThreadScheduler::release();
+                    Drawable2DScheduler::report(this, q0, q, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count());
                     if (q == 100) {
                         std::this_thread::yield();
                         if (nb >= 100) { std::this_thread::sleep_for(std::chrono::milliseconds(1)); nb = 0; }
@@ -110,10 +237,12 @@ namespace internals_graphics
                         }
                     else { nb = 0; }
                     }
+                Drawable2DScheduler::remove(this);
                 _threadon = false; // ...and we are off
                 }
             catch (std::exception & exc)
                 {
+                Drawable2DScheduler::remove(this);
                 std::string msg = std::string("Exception caught in an autoDrawable2DObject : [") + exc.what() + "].";
                 MTOOLS_ERROR(msg.c_str());
                 }
@@ -137,6 +266,7 @@ namespace internals_graphics
             if (_threadon == true) // check if the thread is on
                 {
                 _mustexit = true;
+                ThreadScheduler::wakeUp(&_mustexit); // in case the thread is waiting for an execution slot
                 _obj->stopWork();
                 while (_threadon == true) { _obj->stopWork();  std::this_thread::yield(); }
                 }
@@ -143,6 +143,33 @@ namespace mtools
 
 
 
+	/* FNV-1a hash of a sequence of bytes */
+	static inline uint64 _fnvHash(uint64 h, const void * data, size_t len)
+		{
+		const unsigned char * p = (const unsigned char *)data;
+		for (size_t i = 0; i < len; i++) { h ^= p[i]; h *= 1099511628211ULL; }
+		return h;
+		}
+
+
+	uint64 EdgeSiteImage::key() const
+		{
+		const uint32 types = ((uint32)_up) | (((uint32)_down) << 3) | (((uint32)_left) << 6) | (((uint32)_right) << 9) | ((_site ? 1u : 0u) << 12);
+		const uint32 colors[11] = { _cbk.color, _csite.color, _cup.color, _cdown.color, _cleft.color, _cright.color, _ctext.color, _ctextup.color, _ctextdown.color, _ctextleft.color, _ctextright.color };
+		uint64 h = 14695981039346656037ULL;
+		h = _fnvHash(h, &types, sizeof(types));
+		h = _fnvHash(h, colors, sizeof(colors));
+		const std::string * txts[5] = { &_text, &_textup, &_textdown, &_textleft, &_textright };
+		for (int k = 0; k < 5; k++)
+			{
+			const uint64 l = (uint64)txts[k]->length(); // the length separates consecutive texts
+			h = _fnvHash(h, &l, sizeof(l));
+			h = _fnvHash(h, txts[k]->data(), txts[k]->length());
+			}
+		return h;
+		}
+
+
 	/* method for drawing an edge arrow according to specified model */
     void EdgeSiteImage::_drawArrow(RGBc coul, TypeEdge type, int direction, Image & im, double kx, double ky) const
 		{
@@ -0,0 +1,599 @@
+/** @file escapetime.cpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "graphics/escapetime.hpp"
+#include "misc/error.hpp"
+
+#include <cmath>
+#include <cctype>
+#include <cstdio>
+#include <algorithm>
+
+
+/* the AVX2 kernel is compiled for a specific target and selected at runtime (same as blendkernels.cpp) */
+#if (defined(__x86_64__) || defined(_M_X64)) && (defined(_MSC_VER) || defined(__GNUC__) || defined(__clang__))
+	#define MTOOLS_ESCAPE_AVX2 1
+	#include <immintrin.h>
+	#if defined(_MSC_VER)
+		#include <intrin.h>
+		#define MTOOLS_TARGET_AVX2
+	#else
+		#define MTOOLS_TARGET_AVX2 __attribute__((target("avx2")))
+	#endif
+#endif
+
+
+namespace mtools
+	{
+
+
+	namespace internals_escapetime
+		{
+
+		static const double BAILOUT2 = 65536.0;		// escape when |z|^2 > 256^2
+		static const size_t CHUNK = 256;			// number of points processed at once
+
+
+		/* smooth escape time when |z_{i+1}|^2 = r2 > BAILOUT2 */
+		inline double smoothIter(int i, double r2)
+			{
+			return i + 2 - std::log2(0.5*std::log(r2));
+			}
+
+
+		/******************************************************************************************
+		* FIXED POINT NUMBERS
+		*
+		* Sign and magnitude. The magnitude is stored in F+1 limbs of 32 bits (little endian): F limbs
+		* for the fractional part and one for the integer part. The orbit of the reference stays below
+		* 256 in absolute value (and its square below 2^32) so a single integer limb is enough.
+		*******************************************************************************************/
+
+		struct Fixed
+			{
+			bool				neg;
+			std::vector<uint32>	v;
+
+			explicit Fixed(size_t F = 0) : neg(false), v(F + 1, 0) {}
+
+			bool isZero() const { for (auto x : v) { if (x != 0) return false; } return true; }
+			};
+
+
+		/* compare magnitudes */
+		static int cmpMag(const Fixed & a, const Fixed & b)
+			{
+			for (size_t i = a.v.size(); i > 0; i--)
+				{
+				if (a.v[i - 1] != b.v[i - 1]) return (a.v[i - 1] < b.v[i - 1]) ? -1 : 1;
+				}
+			return 0;
+			}
+
+
+		/* r = |a| + |b| */
+		static void addMag(const Fixed & a, const Fixed & b, Fixed & r)
+			{
+			uint64 carry = 0;
+			for (size_t i = 0; i < a.v.size(); i++)
+				{
+				carry += (uint64)a.v[i] + (uint64)b.v[i];
+				r.v[i] = (uint32)carry;
+				carry >>= 32;
+				}
+			}
+
+
+		/* r = |a| - |b| with |a| >= |b| */
+		static void subMag(const Fixed & a, const Fixed & b, Fixed & r)
+			{
+			int64 borrow = 0;
+			for (size_t i = 0; i < a.v.size(); i++)
+				{
+				int64 d = (int64)a.v[i] - (int64)b.v[i] - borrow;
+				borrow = (d < 0) ? 1 : 0;
+				r.v[i] = (uint32)(d + (borrow << 32));
+				}
+			}
+
+
+		/* r = a + b (r may alias a or b) */
+		static void add(const Fixed & a, const Fixed & b, Fixed & r)
+			{
+			if (a.neg == b.neg) { addMag(a, b, r); r.neg = a.neg; return; }
+			if (cmpMag(a, b) >= 0) { const bool s = a.neg; subMag(a, b, r); r.neg = s; }
+			else { const bool s = b.neg; subMag(b, a, r); r.neg = s; }
+			if (r.isZero()) r.neg = false;
+			}
+
+
+		/* r = a - b (r may alias a or b) */
+		static void sub(const Fixed & a, const Fixed & b, Fixed & r)
+			{
+			Fixed c = b;
+			if (!c.isZero()) c.neg = !c.neg;
+			add(a, c, r);
+			}
+
+
+		/* r = a*b (truncated). r must not alias a or b. prod is a work buffer */
+		static void mul(const Fixed & a, const Fixed & b, Fixed & r, std::vector<uint64> & prod)
+			{
+			const size_t N = a.v.size(), F = N - 1;
+			prod.assign(2 * N + 1, 0);
+			for (size_t i = 0; i < N; i++)
+				{
+				const uint64 x = a.v[i];
+				if (x == 0) continue;
+				uint64 carry = 0;
+				for (size_t j = 0; j < N; j++)
+					{
+					const uint64 t = x * b.v[j] + (prod[i + j] & 0xFFFFFFFF) + carry;
+					prod[i + j] = t & 0xFFFFFFFF;
+					carry = t >> 32;
+					}
+				size_t k = i + N;
+				while (carry != 0) { const uint64 t = prod[k] + carry; prod[k] = t & 0xFFFFFFFF; carry = t >> 32; k++; }
+				}
+			for (size_t j = 0; j < N; j++) { r.v[j] = (uint32)prod[F + j]; }
+			r.neg = (a.neg != b.neg);
+			if (r.isZero()) r.neg = false;
+			}
+
+
+		/* a = 2a */
+		static void mul2(Fixed & a)
+			{
+			uint32 carry = 0;
+			for (size_t i = 0; i < a.v.size(); i++)
+				{
+				const uint32 x = a.v[i];
+				a.v[i] = (x << 1) | carry;
+				carry = x >> 31;
+				}
+			}
+
+
+		/* conversion to double (truncated to about 96 bits, more than enough) */
+		static double toDouble(const Fixed & a)
+			{
+			const int F = (int)a.v.size() - 1;
+			double r = (double)a.v[F];
+			for (int i = F - 1; (i >= 0) && (i >= F - 3); i--) { r += std::ldexp((double)a.v[i], 32 * (i - F)); }
+			return (a.neg ? -r : r);
+			}
+
+
+		/* split a decimal string "[+-]ddd.ddd[e[+-]nn]" in sign, integer and fractional digits.
+		 * Return false if the string is not valid */
+		static bool parseDecimal(const std::string & s, bool & neg, std::string & ipart, std::string & fpart)
+			{
+			size_t i = 0;
+			while ((i < s.size()) && (isspace((unsigned char)s[i]))) i++;
+			neg = false;
+			if ((i < s.size()) && ((s[i] == '-') || (s[i] == '+'))) { neg = (s[i] == '-'); i++; }
+			std::string digits;
+			long point = -1;
+			for (; i < s.size(); i++)
+				{
+				const char c = s[i];
+				if ((c >= '0') && (c <= '9')) { digits.push_back(c); }
+				else if ((c == '.') && (point < 0)) { point = (long)digits.size(); }
+				else break;
+				}
+			if (digits.size() == 0) return false;
+			if (point < 0) point = (long)digits.size();
+			if ((i < s.size()) && ((s[i] == 'e') || (s[i] == 'E')))
+				{
+				i++;
+				bool eneg = false;
+				if ((i < s.size()) && ((s[i] == '-') || (s[i] == '+'))) { eneg = (s[i] == '-'); i++; }
+				if ((i >= s.size()) || (s[i] < '0') || (s[i] > '9')) return false;
+				long e = 0;
+				for (; (i < s.size()) && (s[i] >= '0') && (s[i] <= '9'); i++) { if (e < 100000) e = 10 * e + (s[i] - '0'); }
+				point += (eneg ? -e : e);
+				}
+			while ((i < s.size()) && (isspace((unsigned char)s[i]))) i++;
+			if (i != s.size()) return false;
+			if (point < 0) { digits = std::string((size_t)(-point), '0') + digits; point = 0; }
+			if (point > (long)digits.size()) { digits += std::string((size_t)point - digits.size(), '0'); }
+			ipart = digits.substr(0, (size_t)point);
+			fpart = digits.substr((size_t)point);
+			while ((fpart.size() > 0) && (fpart.back() == '0')) fpart.pop_back();
+			return true;
+			}
+
+
+		/* number of significant fractional digits of a decimal string (0 if invalid) */
+		static size_t fracDigits(const std::string & s)
+			{
+			bool neg; std::string ip, fp;
+			if (!parseDecimal(s, neg, ip, fp)) return 0;
+			return fp.size();
+			}
+
+
+		/* conversion from a decimal string (0 if invalid or too large) */
+		static Fixed fromString(const std::string & s, size_t F)
+			{
+			bool neg; std::string ip, fp;
+			if (!parseDecimal(s, neg, ip, fp)) return Fixed(F);
+			uint64 I = 0;
+			for (char c : ip) { I = 10 * I + (uint64)(c - '0'); if (I >= 4294967296ULL) return Fixed(F); }
+			Fixed r(F);
+			for (size_t k = fp.size(); k > 0; k--)
+				{ // Horner: r = (r + d) / 10
+				r.v[F] += (uint32)(fp[k - 1] - '0');
+				uint64 rem = 0;
+				for (size_t i = F + 1; i > 0; i--)
+					{
+					const uint64 cur = (rem << 32) | r.v[i - 1];
+					r.v[i - 1] = (uint32)(cur / 10);
+					rem = cur % 10;
+					}
+				}
+			r.v[F] = (uint32)I;
+			r.neg = neg;
+			if (r.isZero()) r.neg = false;
+			return r;
+			}
+
+
+		/* decimal string of a double (round-trip exact) */
+		static std::string doubleToString(double x)
+			{
+			char buf[64];
+			snprintf(buf, sizeof(buf), "%.17g", x);
+			return std::string(buf);
+			}
+
+
+		/******************************************************************************************
+		* DOUBLE ITERATION KERNELS
+		*******************************************************************************************/
+
+		static void mandelDouble_scalar(const double * cx, const double * cy, size_t n, int maxIter, double * out)
+			{
+			for (size_t k = 0; k < n; k++)
+				{
+				double x = 0, y = 0, x2 = 0, y2 = 0;
+				out[k] = -1.0;
+				for (int i = 0; i < maxIter; i++)
+					{
+					y = (x + x)*y + cy[k];
+					x = (x2 - y2) + cx[k];
+					x2 = x*x;
+					y2 = y*y;
+					const double r2 = x2 + y2;
+					if (r2 > BAILOUT2) { out[k] = smoothIter(i, r2); break; }
+					}
+				}
+			}
+
+
+#if (MTOOLS_ESCAPE_AVX2)
+
+		/* 4 points at a time. Escaped lanes keep iterating (masked) until all the lanes are done */
+		MTOOLS_TARGET_AVX2 static void mandelDouble_avx2(const double * cx, const double * cy, size_t n, int maxIter, double * out)
+			{
+			const __m256d bail = _mm256_set1_pd(BAILOUT2);
+			size_t k = 0;
+			for (; k + 4 <= n; k += 4)
+				{
+				const __m256d Cx = _mm256_loadu_pd(cx + k);
+				const __m256d Cy = _mm256_loadu_pd(cy + k);
+				__m256d X = _mm256_setzero_pd(), Y = _mm256_setzero_pd(), X2 = _mm256_setzero_pd(), Y2 = _mm256_setzero_pd();
+				__m256d R2 = _mm256_setzero_pd(), It = _mm256_set1_pd(-1.0);
+				__m256d active = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+				for (int i = 0; i < maxIter; i++)
+					{
+					Y = _mm256_add_pd(_mm256_mul_pd(_mm256_add_pd(X, X), Y), Cy);
+					X = _mm256_add_pd(_mm256_sub_pd(X2, Y2), Cx);
+					X2 = _mm256_mul_pd(X, X);
+					Y2 = _mm256_mul_pd(Y, Y);
+					const __m256d r2 = _mm256_add_pd(X2, Y2);
+					const __m256d esc = _mm256_and_pd(_mm256_cmp_pd(r2, bail, _CMP_GT_OQ), active);
+					const int m = _mm256_movemask_pd(esc);
+					if (m != 0)
+						{
+						R2 = _mm256_blendv_pd(R2, r2, esc);
+						It = _mm256_blendv_pd(It, _mm256_set1_pd((double)i), esc);
+						active = _mm256_andnot_pd(esc, active);
+						if (_mm256_movemask_pd(active) == 0) break;
+						}
+					}
+				alignas(32) double it[4], r[4];
+				_mm256_store_pd(it, It);
+				_mm256_store_pd(r, R2);
+				for (int l = 0; l < 4; l++) { out[k + l] = (it[l] < 0) ? -1.0 : smoothIter((int)it[l], r[l]); }
+				}
+			_mm256_zeroupper();
+			mandelDouble_scalar(cx + k, cy + k, n - k, maxIter, out + k);
+			}
+
+
+		/* return true if both the CPU and the OS support AVX2 */
+		static bool cpuHasAVX2()
+			{
+			#if defined(_MSC_VER)
+			int info[4];
+			__cpuid(info, 0);
+			if (info[0] < 7) return false;
+			__cpuid(info, 1);
+			if (((info[2] & (1 << 27)) == 0) || ((info[2] & (1 << 28)) == 0)) return false; // OSXSAVE and AVX
+			if ((_xgetbv(0) & 6) != 6) return false; // the OS saves the YMM registers
+			__cpuidex(info, 7, 0);
+			return ((info[1] & (1 << 5)) != 0);
+			#else
+			__builtin_cpu_init();
+			return (__builtin_cpu_supports("avx2") != 0);
+			#endif
+			}
+
+#endif
+
+
+		typedef void(*MandelKernel)(const double *, const double *, size_t, int, double *);
+
+		struct DoubleKernel
+			{
+			MandelKernel	fun;
+			const char *	name;
+			};
+
+
+		/* the kernel is selected once, the first time it is needed (thread safe) */
+		static const DoubleKernel & doubleKernel()
+			{
+			#if (MTOOLS_ESCAPE_AVX2)
+			static const DoubleKernel K = (cpuHasAVX2() ? DoubleKernel{ &mandelDouble_avx2, "avx2" } : DoubleKernel{ &mandelDouble_scalar, "scalar" });
+			#else
+			static const DoubleKernel K = { &mandelDouble_scalar, "scalar" };
+			#endif
+			return K;
+			}
+
+
+		/******************************************************************************************
+		* PERTURBATION KERNEL
+		*
+		* The point c = C + dc follows z_i = Z_m + dz where Z is the reference orbit and
+		* dz -> 2 Z_m dz + dz^2 + dc. When |z| < |dz| (the orbit of the point comes close to 0 while
+		* the reference does not) or when the reference ends, the point is rebased: dz = z and m = 0
+		* (Z_0 = 0) which keeps dz small compared to Z and avoids the usual glitches.
+		*******************************************************************************************/
+
+		static void mandelPerturb(const double * refx, const double * refy, int reflen, const double * dcx, const double * dcy, size_t n, int maxIter, double * out)
+			{
+			for (size_t k = 0; k < n; k++)
+				{
+				double dx = 0, dy = 0;
+				int m = 0;
+				out[k] = -1.0;
+				for (int i = 0; i < maxIter; i++)
+					{
+					const double ax = 2 * refx[m] + dx, ay = 2 * refy[m] + dy;
+					const double ndx = (ax*dx - ay*dy) + dcx[k];
+					const double ndy = (ax*dy + ay*dx) + dcy[k];
+					dx = ndx; dy = ndy; m++;
+					const double zx = refx[m] + dx, zy = refy[m] + dy;
+					const double r2 = zx*zx + zy*zy;
+					if (r2 > BAILOUT2) { out[k] = smoothIter(i, r2); break; }
+					if ((r2 < dx*dx + dy*dy) || (m == reflen - 1)) { dx = zx; dy = zy; m = 0; }
+					}
+				}
+			}
+
+
+		}
+
+
+	using namespace internals_escapetime;
+
+
+	/* snapshot of the reference orbit (immutable once published) */
+	struct MandelbrotEngine::_Reference
+		{
+		double				cre, cim;		// center rounded to double
+		int					maxiter;		// number of iterations the reference was computed for
+		int					bits;			// precision used
+		std::vector<double>	x, y;			// Z_0 = 0, Z_1 = C, ... (rounded to double)
+		};
+
+
+	MandelbrotEngine::MandelbrotEngine(int maxIter) : _re("0"), _im("0"), _maxiter(std::max(1, maxIter)), _precision(0), _mode(MODE_AUTO), _ref(), _mut()
+		{
+		_update();
+		}
+
+
+	void MandelbrotEngine::setCenter(double re, double im)
+		{
+		setCenter(doubleToString(re), doubleToString(im));
+		}
+
+
+	void MandelbrotEngine::setCenter(const std::string & re, const std::string & im)
+		{
+		_re = re;
+		_im = im;
+		_update();
+		}
+
+
+	std::string MandelbrotEngine::centerRe() const { return _re; }
+
+	std::string MandelbrotEngine::centerIm() const { return _im; }
+
+
+	void MandelbrotEngine::maxIter(int n)
+		{
+		n = std::max(1, n);
+		if (n == _maxiter) return;
+		_maxiter = n;
+		_update();
+		}
+
+
+	int MandelbrotEngine::maxIter() const { return _maxiter; }
+
+
+	void MandelbrotEngine::precision(int bits)
+		{
+		_precision = std::max(0, bits);
+		_update();
+		}
+
+
+	int MandelbrotEngine::precision() const
+		{
+		std::lock_guard<std::mutex> lock(_mut);
+		return _ref->bits;
+		}
+
+
+	void MandelbrotEngine::mode(int m)
+		{
+		MTOOLS_INSURE((m == MODE_AUTO) || (m == MODE_DOUBLE) || (m == MODE_PERTURBATION));
+		_mode = m;
+		}
+
+
+	int MandelbrotEngine::mode() const { return _mode; }
+
+
+	int MandelbrotEngine::referenceLength() const
+		{
+		std::lock_guard<std::mutex> lock(_mut);
+		return (int)_ref->x.size() - 1;
+		}
+
+
+	const char * MandelbrotEngine::kernelName()
+		{
+		return doubleKernel().name;
+		}
+
+
+	void MandelbrotEngine::_update()
+		{
+		int bits = _precision;
+		if (bits <= 0)
+			{
+			const size_t d = std::max(fracDigits(_re), fracDigits(_im));
+			bits = std::max(128, (int)(d * 3.33) + 64);
+			}
+		const size_t F = (size_t)((bits + 31) / 32);
+		std::shared_ptr<_Reference> R = std::make_shared<_Reference>();
+		R->maxiter = _maxiter;
+		R->bits = (int)(32 * F);
+		const Fixed Cx = fromString(_re, F), Cy = fromString(_im, F);
+		R->cre = toDouble(Cx);
+		R->cim = toDouble(Cy);
+		R->x.reserve((size_t)_maxiter + 1);
+		R->y.reserve((size_t)_maxiter + 1);
+		R->x.push_back(0.0);
+		R->y.push_back(0.0);
+		Fixed X(F), Y(F), X2(F), Y2(F), XY(F);
+		std::vector<uint64> buf;
+		for (int i = 0; i < _maxiter; i++)
+			{
+			mul(X, X, X2, buf);
+			mul(Y, Y, Y2, buf);
+			mul(X, Y, XY, buf);
+			sub(X2, Y2, X);
+			add(X, Cx, X);
+			mul2(XY);
+			add(XY, Cy, Y);
+			const double x = toDouble(X), y = toDouble(Y);
+			R->x.push_back(x);
+			R->y.push_back(y);
+			if (x*x + y*y > BAILOUT2) break;
+			}
+		std::lock_guard<std::mutex> lock(_mut);
+		_ref = R;
+		}
+
+
+	bool MandelbrotEngine::_usePerturbation(const fVec2 * pos, size_t n, const _Reference & R) const
+		{
+		if (_mode != MODE_AUTO) return (_mode == MODE_PERTURBATION);
+		// the double iteration is fine as long as the points are separated by many ulps of |c|
+		double ext = 0, mag = 0;
+		for (size_t k = 0; k < n; k++)
+			{
+			ext = std::max(ext, std::max(std::fabs(pos[k].X() - pos[0].X()), std::fabs(pos[k].Y() - pos[0].Y())));
+			mag = std::max(mag, std::max(std::fabs(pos[k].X()), std::fabs(pos[k].Y())));
+			}
+		mag += std::max(std::fabs(R.cre), std::fabs(R.cim));
+		if (n == 1) return (mag*1e-9 > std::max(std::fabs(pos[0].X()), std::fabs(pos[0].Y())));
+		return (ext < 1e-12 * mag * (double)n);
+		}
+
+
+	void MandelbrotEngine::iterate(const fVec2 * pos, size_t n, double * out) const
+		{
+		if (n == 0) return;
+		std::shared_ptr<const _Reference> R;
+			{
+			std::lock_guard<std::mutex> lock(_mut);
+			R = _ref;
+			}
+		const bool perturb = _usePerturbation(pos, n, *R);
+		const int maxIter = R->maxiter;
+		double bx[CHUNK], by[CHUNK];
+		for (size_t s = 0; s < n; s += CHUNK)
+			{
+			const size_t m = std::min(CHUNK, n - s);
+			if (perturb)
+				{
+				for (size_t k = 0; k < m; k++) { bx[k] = pos[s + k].X(); by[k] = pos[s + k].Y(); }
+				mandelPerturb(R->x.data(), R->y.data(), (int)R->x.size(), bx, by, m, maxIter, out + s);
+				}
+			else
+				{
+				for (size_t k = 0; k < m; k++) { bx[k] = R->cre + pos[s + k].X(); by[k] = R->cim + pos[s + k].Y(); }
+				doubleKernel().fun(bx, by, m, maxIter, out + s);
+				}
+			}
+		}
+
+
+	void MandelbrotEngine::getColorBatch(const fVec2 * pos, size_t n, RGBc * out) const
+		{
+		double it[CHUNK];
+		const double M = (double)maxIter();
+		for (size_t s = 0; s < n; s += CHUNK)
+			{
+			const size_t m = std::min(CHUNK, n - s);
+			iterate(pos + s, m, it);
+			for (size_t k = 0; k < m; k++)
+				{
+				out[s + k] = (it[k] < 0) ? RGBc::c_Black : RGBc::jetPalette(std::min(1.0, std::max(0.0, it[k] / M)));
+				}
+			}
+		}
+
+
+	}
+
+
+/* end of file */
+
@@ -0,0 +1,474 @@
+/** @file figurevectorexport.cpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "graphics/figurevectorexport.hpp"
+#include "misc/stringfct.hpp"
+
+#include <zlib.h>
+#include <cstdio>
+#include <cstdarg>
+#include <cstring>
+#include <algorithm>
+
+#if (MTOOLS_USE_CAIRO)
+#include <cairo.h>
+#include <cairo-svg.h>
+#include <cairo-pdf.h>
+#endif
+
+
+namespace mtools
+{
+
+	namespace internals_figure
+	{
+
+		/* base class of the backends of FigureVectorExporter */
+		class VectorBackend : public FigureVectorWriter
+			{
+			public:
+				VectorBackend(fBox2 R, int64 lx, int64 ly) : FigureVectorWriter(R, lx, ly) {}
+				virtual ~VectorBackend() {}
+				virtual bool ok() const = 0;		// true if no error occurred so far
+				virtual bool finish() = 0;			// finish and close the file
+			};
+
+
+		/* non premultiplied version of a color */
+		static inline RGBc straightColor(RGBc c) { c.unpremultiply(); return c; }
+
+
+		/* SVG written directly */
+		class SVGBackend : public VectorBackend
+			{
+
+			public:
+
+				SVGBackend(const std::string & filename, fBox2 R, int64 lx, int64 ly) : VectorBackend(R, lx, ly), _ok(true)
+					{
+					_f = fopen(filename.c_str(), "wb");
+					if (_f == nullptr) { _ok = false; return; }
+					_print("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\" width=\"%lld\" height=\"%lld\" viewBox=\"0 0 %lld %lld\">\n", (long long)lx, (long long)ly, (long long)lx, (long long)ly);
+					}
+
+				virtual ~SVGBackend() { finish(); }
+
+				virtual void ellipse(double cx, double cy, double rx, double ry, RGBc fill, RGBc stroke, double strokeWidth) override
+					{
+					if ((fill.comp.A == 0) && ((stroke.comp.A == 0) || (strokeWidth <= 0.0))) return;
+					if (rx == ry) _print("<circle cx=\"%.2f\" cy=\"%.2f\" r=\"%.3f\"", cx, cy, rx); else _print("<ellipse cx=\"%.2f\" cy=\"%.2f\" rx=\"%.3f\" ry=\"%.3f\"", cx, cy, rx, ry);
+					_paint("fill", fill);
+					if ((stroke.comp.A != 0) && (strokeWidth > 0.0)) { _paint("stroke", stroke); _print(" stroke-width=\"%.3f\"", strokeWidth); }
+					_print("/>\n");
+					}
+
+				virtual void rect(double x, double y, double w, double h, RGBc fill) override
+					{
+					if (fill.comp.A == 0) return;
+					_print("<rect x=\"%.2f\" y=\"%.2f\" width=\"%.2f\" height=\"%.2f\"", x, y, w, h);
+					_paint("fill", fill);
+					_print("/>\n");
+					}
+
+				virtual bool ok() const override { return _ok; }
+
+				virtual bool finish() override
+					{
+					if (_f == nullptr) return _ok;
+					_print("</svg>\n");
+					if (fclose(_f) != 0) _ok = false;
+					_f = nullptr;
+					return _ok;
+					}
+
+			private:
+
+				/* write the attributes for a fill or stroke color */
+				void _paint(const char * what, RGBc c)
+					{
+					if (c.comp.A == 0) { _print(" %s=\"none\"", what); return; }
+					const RGBc s = straightColor(c);
+					_print(" %s=\"#%02x%02x%02x\"", what, (int)s.comp.R, (int)s.comp.G, (int)s.comp.B);
+					if (c.comp.A != 255) _print(" %s-opacity=\"%.3f\"", what, c.comp.A / 255.0);
+					}
+
+				void _print(const char * fmt, ...)
+					{
+					if (_f == nullptr) return;
+					va_list args;
+					va_start(args, fmt);
+					if (vfprintf(_f, fmt, args) < 0) _ok = false;
+					va_end(args);
+					}
+
+				FILE *	_f;		// the file
+				bool	_ok;	// no error so far
+			};
+
+
+		/* PDF written directly: a single page whose content stream is deflated on the fly */
+		class PDFBackend : public VectorBackend
+			{
+
+			public:
+
+				PDFBackend(const std::string & filename, fBox2 R, int64 lx, int64 ly) : VectorBackend(R, lx, ly), _ok(true), _pos(0), _streamStart(0), _streamLen(0), _fill(NO_COLOR), _stroke(NO_COLOR), _alpha(-1), _width(-1.0), _used(256, false)
+					{
+					std::memset(&_zs, 0, sizeof(_zs));
+					_f = fopen(filename.c_str(), "wb");
+					if (_f == nullptr) { _ok = false; return; }
+					if (deflateInit(&_zs, 6) != Z_OK) { _ok = false; fclose(_f); _f = nullptr; return; }
+					_raw("%%PDF-1.4\n%%\xE2\xE3\xCF\xD3\n");
+					_obj(1); _raw("<< /Type /Catalog /Pages 2 0 R >>\nendobj\n");
+					_obj(2); _raw("<< /Type /Pages /Kids [3 0 R] /Count 1 >>\nendobj\n");
+					_obj(3); _raw("<< /Type /Page /Parent 2 0 R /MediaBox [0 0 %lld %lld] /Resources 6 0 R /Contents 4 0 R >>\nendobj\n", (long long)lx, (long long)ly);
+					_obj(4); _raw("<< /Length 5 0 R /Filter /FlateDecode >>\nstream\n");
+					_streamStart = _pos;
+					_content("1 0 0 -1 0 %lld cm\n", (long long)ly); // y axis pointing down
+					}
+
+				virtual ~PDFBackend() { finish(); }
+
+				virtual void ellipse(double cx, double cy, double rx, double ry, RGBc fill, RGBc stroke, double strokeWidth) override
+					{
+					if (fill.comp.A != 0)
+						{
+						_setColor(fill, false);
+						_path(cx, cy, rx, ry);
+						_content("f\n");
+						}
+					if ((stroke.comp.A != 0) && (strokeWidth > 0.0))
+						{
+						_setColor(stroke, true);
+						if (strokeWidth != _width) { _width = strokeWidth; _content("%.3f w\n", strokeWidth); }
+						_path(cx, cy, rx, ry);
+						_content("S\n");
+						}
+					}
+
+				virtual void rect(double x, double y, double w, double h, RGBc fill) override
+					{
+					if (fill.comp.A == 0) return;
+					_setColor(fill, false);
+					_content("%.2f %.2f %.2f %.2f re f\n", x, y, w, h);
+					}
+
+				virtual bool ok() const override { return _ok; }
+
+				virtual bool finish() override
+					{
+					if (_f == nullptr) return _ok;
+					_flush(true);
+					deflateEnd(&_zs);
+					_streamLen = _pos - _streamStart;
+					_raw("\nendstream\nendobj\n");
+					_obj(5); _raw("%llu\nendobj\n", (unsigned long long)_streamLen);
+					_obj(6); _raw("<< /ExtGState <<");
+					for (int a = 0; a < 256; a++) { if (_used[a]) _raw(" /A%d << /ca %.4f /CA %.4f >>", a, a / 255.0, a / 255.0); }
+					_raw(" >> >>\nendobj\n");
+					const uint64 xref = _pos;
+					_raw("xref\n0 7\n0000000000 65535 f \n");
+					for (int i = 1; i <= 6; i++) { _raw("%010llu 00000 n \n", (unsigned long long)_offsets[i]); }
+					_raw("trailer\n<< /Size 7 /Root 1 0 R >>\nstartxref\n%llu\n%%%%EOF\n", (unsigned long long)xref);
+					if (fclose(_f) != 0) _ok = false;
+					_f = nullptr;
+					return _ok;
+					}
+
+			private:
+
+				static const size_t BUFFER_SIZE = 1 << 16;
+				static const uint64 NO_COLOR = (uint64)(-1);	// no color set yet
+
+				/* path of an ellipse made of 4 cubic Bezier curves */
+				void _path(double cx, double cy, double rx, double ry)
+					{
+					const double k = 0.5522847498;
+					const double kx = k * rx, ky = k * ry;
+					_content("%.2f %.2f m %.2f %.2f %.2f %.2f %.2f %.2f c %.2f %.2f %.2f %.2f %.2f %.2f c %.2f %.2f %.2f %.2f %.2f %.2f c %.2f %.2f %.2f %.2f %.2f %.2f c h\n",
+						cx + rx, cy,
+						cx + rx, cy + ky, cx + kx, cy + ry, cx, cy + ry,
+						cx - kx, cy + ry, cx - rx, cy + ky, cx - rx, cy,
+						cx - rx, cy - ky, cx - kx, cy - ry, cx, cy - ry,
+						cx + kx, cy - ry, cx + rx, cy - ky, cx + rx, cy);
+					}
+
+				/* set the fill or stroke color (and the opacity) if it changed */
+				void _setColor(RGBc c, bool stroke)
+					{
+					uint64 & cur = (stroke ? _stroke : _fill);
+					if ((uint64)c.color != cur)
+						{
+						cur = c.color;
+						const RGBc s = straightColor(c);
+						_content("%.3f %.3f %.3f %s\n", s.comp.R / 255.0, s.comp.G / 255.0, s.comp.B / 255.0, (stroke ? "RG" : "rg"));
+						}
+					const int a = c.comp.A;
+					if (a != _alpha) { _alpha = a; _used[a] = true; _content("/A%d gs\n", a); }
+					}
+
+				/* append to the content stream */
+				void _content(const char * fmt, ...)
+					{
+					if (_f == nullptr) return;
+					char tmp[1024];
+					va_list args;
+					va_start(args, fmt);
+					const int l = vsnprintf(tmp, sizeof(tmp), fmt, args);
+					va_end(args);
+					if (l > 0) _buf.append(tmp, ((size_t)l < sizeof(tmp)) ? (size_t)l : (sizeof(tmp) - 1));
+					if (_buf.size() >= BUFFER_SIZE) _flush(false);
+					}
+
+				/* deflate the buffered content and write it to the file */
+				void _flush(bool last)
+					{
+					unsigned char out[BUFFER_SIZE];
+					_zs.next_in = (Bytef *)_buf.data();
+					_zs.avail_in = (uInt)_buf.size();
+					int r;
+					do
+						{
+						_zs.next_out = out;
+						_zs.avail_out = (uInt)BUFFER_SIZE;
+						r = deflate(&_zs, (last ? Z_FINISH : Z_NO_FLUSH));
+						if (r == Z_STREAM_ERROR) { _ok = false; break; }
+						_write(out, BUFFER_SIZE - _zs.avail_out);
+						}
+					while ((_zs.avail_out == 0) || (last && (r != Z_STREAM_END)));
+					_buf.clear();
+					}
+
+				/* start object i */
+				void _obj(int i) { _offsets[i] = _pos; _raw("%d 0 obj\n", i); }
+
+				/* write (uncompressed) text to the file */
+				void _raw(const char * fmt, ...)
+					{
+					if (_f == nullptr) return;
+					va_list args;
+					va_start(args, fmt);
+					const int l = vfprintf(_f, fmt, args);
+					va_end(args);
+					if (l < 0) _ok = false; else _pos += (uint64)l;
+					}
+
+				void _write(const void * data, size_t len)
+					{
+					if ((_f == nullptr) || (len == 0)) return;
+					if (fwrite(data, 1, len, _f) != len) _ok = false;
+					_pos += len;
+					}
+
+				FILE *				_f;				// the file
+				bool				_ok;			// no error so far
+				uint64				_pos;			// current size of the file
+				uint64				_offsets[7];	// offsets of the objects
+				uint64				_streamStart;	// offset of the content stream
+				uint64				_streamLen;		// length of the content stream
+				z_stream			_zs;			// deflate state of the content stream
+				std::string			_buf;			// content not yet deflated
+				uint64				_fill, _stroke;	// current colors (NO_COLOR at the start)
+				int					_alpha;			// current opacity
+				double				_width;			// current line width
+				std::vector<bool>	_used;			// opacities used (graphic states to declare)
+			};
+
+
+#if (MTOOLS_USE_CAIRO)
+
+		/* SVG or PDF written by cairo */
+		class CairoBackend : public VectorBackend
+			{
+
+			public:
+
+				CairoBackend(const std::string & filename, bool svg, fBox2 R, int64 lx, int64 ly) : VectorBackend(R, lx, ly)
+					{
+					_s = (svg ? cairo_svg_surface_create(filename.c_str(), (double)lx, (double)ly) : cairo_pdf_surface_create(filename.c_str(), (double)lx, (double)ly));
+					_c = cairo_create(_s);
+					}
+
+				virtual ~CairoBackend() { finish(); }
+
+				virtual void ellipse(double cx, double cy, double rx, double ry, RGBc fill, RGBc stroke, double strokeWidth) override
+					{
+					if (_c == nullptr) return;
+					if ((rx <= 0.0) || (ry <= 0.0)) return;
+					cairo_save(_c);
+					cairo_translate(_c, cx, cy);
+					cairo_scale(_c, rx, ry);
+					cairo_arc(_c, 0.0, 0.0, 1.0, 0.0, 2 * M_PI);
+					cairo_restore(_c);
+					if (fill.comp.A != 0) { _source(fill); cairo_fill_preserve(_c); }
+					if ((stroke.comp.A != 0) && (strokeWidth > 0.0)) { _source(stroke); cairo_set_line_width(_c, strokeWidth); cairo_stroke_preserve(_c); }
+					cairo_new_path(_c);
+					}
+
+				virtual void rect(double x, double y, double w, double h, RGBc fill) override
+					{
+					if ((_c == nullptr) || (fill.comp.A == 0)) return;
+					_source(fill);
+					cairo_rectangle(_c, x, y, w, h);
+					cairo_fill(_c);
+					}
+
+				virtual bool ok() const override
+					{
+					if (_c == nullptr) return _status;
+					return ((cairo_status(_c) == CAIRO_STATUS_SUCCESS) && (cairo_surface_status(_s) == CAIRO_STATUS_SUCCESS));
+					}
+
+				virtual bool finish() override
+					{
+					if (_c == nullptr) return _status;
+					cairo_destroy(_c);
+					_c = nullptr;
+					cairo_surface_finish(_s);
+					_status = (cairo_surface_status(_s) == CAIRO_STATUS_SUCCESS);
+					cairo_surface_destroy(_s);
+					_s = nullptr;
+					return _status;
+					}
+
+			private:
+
+				void _source(RGBc c)
+					{
+					const RGBc s = straightColor(c);
+					cairo_set_source_rgba(_c, s.comp.R / 255.0, s.comp.G / 255.0, s.comp.B / 255.0, c.comp.A / 255.0);
+					}
+
+				cairo_surface_t *	_s;					// the surface
+				cairo_t *			_c;					// the context (nullptr once finished)
+				bool				_status = false;	// status after finish()
+			};
+
+#endif
+
+	}
+
+
+	FigureVectorExporter::FigureVectorExporter(const std::string & filename, fBox2 R, int64 lx, int64 ly, int format, bool mergeSmall, int backend) :
+		_writer(nullptr), _R(R), _lx(lx), _ly(ly), _merge(mergeSmall), _dirtyCells(false), _nbWritten(0), _nbMerged(0), _ok(false)
+		{
+		MTOOLS_INSURE((lx > 0) && (ly > 0));
+		MTOOLS_INSURE((!R.isEmpty()) && (R.lx() > 0) && (R.ly() > 0));
+		if (format == FORMAT_AUTO)
+			{
+			const std::string ext = toLowerCase(filename.substr((filename.size() >= 4) ? filename.size() - 4 : 0));
+			MTOOLS_INSURE((ext == ".svg") || (ext == ".pdf"));
+			format = ((ext == ".svg") ? FORMAT_SVG : FORMAT_PDF);
+			}
+		MTOOLS_INSURE((format == FORMAT_SVG) || (format == FORMAT_PDF));
+#if (MTOOLS_USE_CAIRO)
+		if (backend == BACKEND_CAIRO) { _writer = new internals_figure::CairoBackend(filename, (format == FORMAT_SVG), R, lx, ly); return; }
+#endif
+		if (format == FORMAT_SVG) _writer = new internals_figure::SVGBackend(filename, R, lx, ly); else _writer = new internals_figure::PDFBackend(filename, R, lx, ly);
+		}
+
+
+	FigureVectorExporter::~FigureVectorExporter()
+		{
+		close();
+		}
+
+
+	void FigureVectorExporter::add(const FigureInterface & fig)
+		{
+		if (_writer == nullptr) return;
+		const fBox2 B = fig.boundingBox();
+		if ((B.isEmpty()) || (intersectionRect(B, _R).isEmpty())) return;
+		if ((_merge) && (_writer->DX(B.lx()) < 1.0) && (_writer->DY(B.ly()) < 1.0))
+			{ // smaller than a pixel: accumulate in the cell containing its center
+			int64 i = (int64)_writer->X((B.min[0] + B.max[0]) / 2), j = (int64)_writer->Y((B.min[1] + B.max[1]) / 2);
+			i = (i < 0) ? 0 : ((i >= _lx) ? (_lx - 1) : i);
+			j = (j < 0) ? 0 : ((j >= _ly) ? (_ly - 1) : j);
+			if (_cells.size() == 0) _cells.assign((size_t)(_lx*_ly), RGBc::c_Transparent);
+			_cells[(size_t)(j*_lx + i)].blend(fig.lodColor());
+			_dirtyCells = true;
+			_nbMerged++;
+			return;
+			}
+		if (!fig.drawVector(*_writer))
+			{
+			_writer->rect(_writer->X(B.min[0]), _writer->Y(B.max[1]), _writer->DX(B.lx()), _writer->DY(B.ly()), fig.lodColor());
+			}
+		_nbWritten++;
+		}
+
+
+	void FigureVectorExporter::addLayer(const FigureCanvas & canvas, size_t layer)
+		{
+		MTOOLS_INSURE(layer < canvas.nbLayers());
+		canvas.getTreeLayer(layer)->iterate_intersect(_R, [&](const TreeFigure<FigureInterface*>::BoundedObject & bo) { add(*bo.object); });
+		flushSmall();
+		}
+
+
+	void FigureVectorExporter::addCanvas(const FigureCanvas & canvas)
+		{
+		for (size_t l = 0; l < canvas.nbLayers(); l++) { addLayer(canvas, l); }
+		}
+
+
+	void FigureVectorExporter::flushSmall()
+		{
+		if ((!_dirtyCells) || (_writer == nullptr)) return;
+		for (int64 j = 0; j < _ly; j++)
+			{
+			RGBc * row = _cells.data() + j*_lx;
+			int64 i = 0;
+			while (i < _lx)
+				{
+				const RGBc c = row[i];
+				int64 k = i + 1;
+				while ((k < _lx) && (row[k] == c)) k++;
+				if (c.comp.A != 0) _writer->rect((double)i, (double)j, (double)(k - i), 1.0, c);
+				i = k;
+				}
+			std::fill(row, row + _lx, RGBc::c_Transparent);
+			}
+		_dirtyCells = false;
+		}
+
+
+	bool FigureVectorExporter::close()
+		{
+		if (_writer == nullptr) return _ok;
+		flushSmall();
+		_ok = _writer->finish();
+		delete _writer;
+		_writer = nullptr;
+		return _ok;
+		}
+
+
+	bool FigureVectorExporter::ok() const
+		{
+		return ((_writer != nullptr) ? _writer->ok() : _ok);
+		}
+
+
+}
+
+
+/* end of file */
+
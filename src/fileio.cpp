@@ -27,10 +27,19 @@
 #pragma warning( disable : 4996 )
 #endif
 
+#if !defined (_MSC_VER)
+#include <sys/stat.h>
+#include <errno.h>
+#endif
+
 #include <FL/filename.H>
 #include <fstream>
 #include <streambuf>
 #include <iterator>
+#include <cstring>
+#include <algorithm>
+#include <thread>
+#include <atomic>
 
 
 namespace mtools
@@ -44,19 +53,194 @@ namespace mtools
         }
 
 
+    bool createDirectory(const std::string & path)
+        {
+        #if defined (_MSC_VER)
+        if (CreateDirectoryA(path.c_str(), NULL) != 0) return true;
+        return (GetLastError() == ERROR_ALREADY_EXISTS);
+        #else
+        if (mkdir(path.c_str(), 0755) == 0) return true;
+        struct stat st;
+        return ((errno == EEXIST) && (stat(path.c_str(), &st) == 0) && (S_ISDIR(st.st_mode)));
+        #endif
+        }
+
+
     std::string loadStringFromFile(const std::string & filename, StringEncoding enc)
         {
-        std::ifstream t(filename , std::ifstream::binary | std::ifstream::in);
-        if (t.fail()) { return ""; }
-        t.seekg(0, std::ios::end);
+        FILE * f = fopen(filename.c_str(), "rb");
+        if (f == nullptr) { return ""; }
         std::string s;
-        s.reserve(static_cast<size_t>(t.tellg()));
-        t.seekg(0, std::ios::beg);
-        s.assign((std::istreambuf_iterator<char>(t)), std::istreambuf_iterator<char>());
-        t.close();
-        if (enc == enc_utf8)    { return toUtf8(s); }
-        if (enc == enc_iso8859) { return toIso8859(s); }
-        return s;
+        #if defined (_MSC_VER)
+        if (_fseeki64(f, 0, SEEK_END) == 0)
+            {
+            const int64 l = (int64)_ftelli64(f);
+            if (l > 0) { s.resize((size_t)l); }
+            _fseeki64(f, 0, SEEK_SET);
+            }
+        #else
+        if (fseeko(f, 0, SEEK_END) == 0)
+            {
+            const int64 l = (int64)ftello(f);
+            if (l > 0) { s.resize((size_t)l); }
+            fseeko(f, 0, SEEK_SET);
+            }
+        #endif
+        if (s.size() > 0) { s.resize(fread(&s[0], 1, s.size(), f)); }
+        else
+            { // size unknown (pipe...): read by blocks
+            char buf[65536];
+            size_t n;
+            while ((n = fread(buf, 1, sizeof(buf), f)) > 0) { s.append(buf, n); }
+            }
+        fclose(f);
+        if (enc == enc_unknown) { return s; }
+        const bool utf8 = isValidUtf8(s); // detect once, no conversion if already in the right format
+        if (enc == enc_utf8) { return (utf8 ? s : toString(toWString(s, enc_iso8859), enc_utf8)); }
+        return (utf8 ? toString(toWString(s, enc_utf8), enc_iso8859) : s);
+        }
+
+
+    FileLineReader::FileLineReader(const std::string & filename, StringEncoding enc, size_t chunkSize) : _f(nullptr), _buf((chunkSize < 16) ? 16 : chunkSize), _pos(0), _len(0), _consumed(0), _enc(enc), _fileenc(enc_iso8859)
+        {
+        _f = fopen(filename.c_str(), "rb");
+        if (_f == nullptr) return;
+        _fill();
+        // detect the encoding on the first chunk (ignoring a truncated last character)
+        if ((_len >= 3) && ((unsigned char)_buf[0] == 0xEF) && ((unsigned char)_buf[1] == 0xBB) && ((unsigned char)_buf[2] == 0xBF)) { _fileenc = enc_utf8; }
+        else
+            {
+            size_t l = _len;
+            if (l == _buf.size())
+                {
+                size_t k = 0;
+                while ((k < 3) && (l > 0) && (((unsigned char)_buf[l - 1] & 0xC0) == 0x80)) { l--; k++; }
+                if ((l > 0) && ((unsigned char)_buf[l - 1] >= 0xC0)) { l--; }
+                }
+            _fileenc = (isValidUtf8(std::string(_buf.data(), l)) ? enc_utf8 : enc_iso8859);
+            }
+        }
+
+
+    FileLineReader::~FileLineReader()
+        {
+        if (_f != nullptr) { fclose(_f); }
+        }
+
+
+    bool FileLineReader::_fill()
+        {
+        if (_f == nullptr) return false;
+        _len = fread(_buf.data(), 1, _buf.size(), _f);
+        _pos = 0;
+        return (_len > 0);
+        }
+
+
+    void FileLineReader::_convert(std::string & s) const
+        {
+        if ((_enc == enc_unknown) || (_enc == _fileenc)) return;
+        s = toString(toWString(s, _fileenc), _enc);
+        }
+
+
+    bool FileLineReader::getRecord(std::string & rec, char delim)
+        {
+        rec.clear();
+        if ((_pos >= _len) && (!_fill())) return false;
+        while (true)
+            {
+            const char * p = (const char *)memchr(_buf.data() + _pos, delim, _len - _pos);
+            if (p != nullptr)
+                {
+                const size_t l = (size_t)(p - (_buf.data() + _pos));
+                rec.append(_buf.data() + _pos, l);
+                _pos += l + 1;
+                _consumed += l + 1;
+                break;
+                }
+            rec.append(_buf.data() + _pos, _len - _pos);
+            _consumed += _len - _pos;
+            if (!_fill()) break; // last record without delimiter
+            }
+        _convert(rec);
+        return true;
+        }
+
+
+    bool FileLineReader::getLine(std::string & line)
+        {
+        if (!getRecord(line, '\n')) return false;
+        if ((line.size() > 0) && (line.back() == '\r')) { line.pop_back(); }
+        return true;
+        }
+
+
+    size_t FileLineReader::read(void * buffer, size_t len)
+        {
+        size_t n = 0;
+        while (n < len)
+            {
+            if ((_pos >= _len) && (!_fill())) break;
+            const size_t l = std::min<size_t>(len - n, _len - _pos);
+            memcpy((char *)buffer + n, _buf.data() + _pos, l);
+            _pos += l;
+            n += l;
+            }
+        _consumed += n;
+        return n;
+        }
+
+
+    int64 processFiles(const std::string & path, const std::string & mask, bool case_sensitive, bool rec, std::function<void(const std::string & name, const char * data, size_t size)> fun, int nbThreads)
+        {
+        std::vector<std::string> tab;
+        if (!getFileList(path, mask, case_sensitive, tab, rec, true, false)) { return -1; }
+        const std::string dir = trailingSlash(path, true);
+        if (nbThreads <= 0) { nbThreads = std::max<int>(1, (int)std::thread::hardware_concurrency()); }
+        nbThreads = (int)std::min<size_t>((size_t)nbThreads, tab.size());
+        std::atomic<size_t> next(0);
+        std::atomic<int64> nb(0);
+        auto work = [&]()
+            {
+            size_t i;
+            while ((i = next++) < tab.size())
+                {
+                MappedFile F(dir + tab[i]);
+                if (!F.isOpen()) continue;
+                fun(tab[i], F.data(), F.size());
+                nb++;
+                }
+            };
+        std::vector<std::thread> threads;
+        for (int k = 1; k < nbThreads; k++) { threads.push_back(std::thread(work)); }
+        work();
+        for (auto & th : threads) { th.join(); }
+        return nb;
+        }
+
+
+    bool loadFilesFromDirectory(const std::string & path, const std::string & mask, bool case_sensitive, bool rec, std::vector<std::string> & names, std::vector<std::string> & contents, StringEncoding enc, int nbThreads)
+        {
+        std::vector<std::string> tab;
+        if (!getFileList(path, mask, case_sensitive, tab, rec, true, false)) { return false; }
+        const std::string dir = trailingSlash(path, true);
+        const size_t start = contents.size();
+        contents.resize(start + tab.size());
+        if (nbThreads <= 0) { nbThreads = std::max<int>(1, (int)std::thread::hardware_concurrency()); }
+        nbThreads = (int)std::min<size_t>((size_t)nbThreads, tab.size());
+        std::atomic<size_t> next(0);
+        auto work = [&]()
+            {
+            size_t i;
+            while ((i = next++) < tab.size()) { contents[start + i] = loadStringFromFile(dir + tab[i], enc); }
+            };
+        std::vector<std::thread> threads;
+        for (int k = 1; k < nbThreads; k++) { threads.push_back(std::thread(work)); }
+        work();
+        for (auto & th : threads) { th.join(); }
+        names.insert(names.end(), tab.begin(), tab.end());
+        return true;
         }
 
 
@@ -26,6 +26,9 @@
 #include <FL/Fl.H>
 
 #include <mutex>
+#include <vector>
+#include <unordered_map>
+#include <cstdlib>
 
 namespace mtools
     {
@@ -189,6 +192,47 @@ namespace mtools
 
               
 
+                /**
+                 * Post a call to the fltk thread and return without waiting. The supervisor takes
+                 * ownership of the proxy object and deletes it after the call. If key is not nullptr and
+                 * a call with the same key is still pending, it is replaced by the new one.
+                 *
+                 * @param [in,out]  proxycall   the method to call (allocated with new).
+                 * @param           key         the coalescing key (nullptr for none).
+                 *
+                 * @return  true if the call was queued and false if the thread is not available.
+                 **/
+                bool postInFltk(IndirectCall * proxycall, const void * key)
+                    {
+                    if (isFltkThread()) { proxycall->call(); delete proxycall; return true; }
+                    if (status() != THREAD_ON)
+                        { // do not lock _muthread when the thread is on: it is held during synchronous calls
+                        std::lock_guard<std::recursive_mutex> lock(_muthread);
+                        _startThread(); // try to start the thread if not up
+                        if (status() != THREAD_ON) { MTOOLS_DEBUG(std::string("Cannot post the method: thread has status ") + mtools::toString(status())); delete proxycall; return false; }
+                        }
+                    bool wake = false;
+                        {
+                        std::lock_guard<std::mutex> lock(_asyncmut);
+                        if (key != nullptr)
+                            {
+                            auto it = _asyncKeys.find(key);
+                            if (it != _asyncKeys.end())
+                                { // coalesce with the pending call
+                                delete _asyncQueue[it->second].second;
+                                _asyncQueue[it->second].second = proxycall;
+                                return true;
+                                }
+                            _asyncKeys[key] = _asyncQueue.size();
+                            }
+                        _asyncQueue.push_back(std::pair<const void *, IndirectCall *>(key, proxycall));
+                        if (!_asyncAwake) { _asyncAwake = true; wake = true; }
+                        }
+                    if (wake) { if (Fl::awake(&FltkSupervisor::_processAsyncCB, nullptr) != 0) Fl::awake(); } // if the awake ring is full, the loop processes the batch anyway
+                    return true;
+                    }
+
+
                 /**
                  * Creates an object in the fltk thread.
                  *
@@ -386,6 +430,7 @@ namespace mtools
                             {
                             Fl::wait(1.0);
                             _processMsg();
+                            _processAsync();
                             if (status() != THREAD_STOPPING)
                                 {
                                 if (status() == THREAD_NOT_STARTED)
@@ -395,6 +440,7 @@ namespace mtools
                                     }
                                 }
                             }
+                        _discardAsync();
                         MTOOLS_DEBUG(std::string(" **** fltk exit callback (") + mtools::toString(_exitCbList.size()) + ") ****.");
                         int icb = 0;
                         for (auto it = _exitCbList.begin(); it != _exitCbList.end(); ++it)
@@ -422,7 +468,7 @@ namespace mtools
             private:
 
                 /** Private Constructor. */
-                FltkSupervisor() : _status(THREAD_NOT_STARTED), _forcedExit(false), _exitCode(0), _th((std::thread *)nullptr) {}
+                FltkSupervisor() : _status(THREAD_NOT_STARTED), _forcedExit(false), _exitCode(0), _th((std::thread *)nullptr), _asyncAwake(false) {}
 
                 /* no copy */
                 FltkSupervisor(const FltkSupervisor &) = delete;
@@ -434,6 +480,7 @@ namespace mtools
                     if (isFltkThread()) { MTOOLS_DEBUG("Calling FltkSupervisor::startThread() from the fltk thread itself : do nothing !"); return; }
                     std::lock_guard<std::recursive_mutex> lock(_muthread); // only one operation at a time, status() is atomic
                     if (status() == THREAD_ON) return;
+                    if (isHeadless()) { MTOOLS_DEBUG("Calling FltkSupervisor::startThread() in headless mode. Do nothing."); return; }
 
             #ifdef MTOOLS_SWAP_THREADS_FLAG
                     if (status() == THREAD_NOT_STARTED) { MTOOLS_DEBUG("Calling FltkSupervisor::startThread() before barrier()  when MTOOLS_SWAP_THREADS_FLAG is set. Do nothing."); return; }
@@ -484,9 +531,37 @@ namespace mtools
                 /* static msg callback */
                 static void _processMsgCB(void * p) { getInst().first->_processMsg(); }
 
+                /* static async msg callback */
+                static void _processAsyncCB(void * p) { getInst().first->_processAsync(); }
+
+                /* execute, as a single batch, all the calls posted so far */
+                void _processAsync()
+                    {
+                    std::vector<std::pair<const void *, IndirectCall *> > batch;
+                        {
+                        std::lock_guard<std::mutex> lock(_asyncmut);
+                        if (_asyncQueue.size() == 0) { _asyncAwake = false; return; }
+                        batch.swap(_asyncQueue);
+                        _asyncKeys.clear();
+                        _asyncAwake = false;
+                        }
+                    for (auto & c : batch) { c.second->call(); delete c.second; }
+                    }
+
+                /* delete the pending posted calls without executing them (when the loop ends) */
+                void _discardAsync()
+                    {
+                    std::lock_guard<std::mutex> lock(_asyncmut);
+                    if (_asyncQueue.size() != 0) { MTOOLS_DEBUG(std::string("Discarding ") + mtools::toString(_asyncQueue.size()) + " posted calls."); }
+                    for (auto & c : _asyncQueue) { delete c.second; }
+                    _asyncQueue.clear();
+                    _asyncKeys.clear();
+                    }
+
                 /* process up to MAX_PROCESS_MSG pending messages */
                 void _processMsg()
                     {
+                    _processAsync(); // calls posted before a synchronous one are executed first
                     int c = 0;
                     while (c++ < MAX_PROCESS_MSG)
                         {
@@ -519,11 +594,18 @@ namespace mtools
 
                 std::list<std::pair<cbFltkExit, void*> > _exitCbList; // list of exit callbacks
 
+                std::mutex _asyncmut;                                               // mutex protecting the posted calls
+                std::vector<std::pair<const void *, IndirectCall *> > _asyncQueue;  // posted calls (with their coalescing key) in order
+                std::unordered_map<const void *, size_t> _asyncKeys;               // position in the queue of the pending calls with a key
+                bool _asyncAwake;                                                   // true if the fltk thread was awaken for the pending calls
+
             };
 
 
         bool runInFltk(IndirectCall * proxycall) { return internals_fltkSupervisor::FltkSupervisor::getInst().first->runInFltk(proxycall); }
 
+        bool postInFltk(IndirectCall * proxycall, const void * key) { return internals_fltkSupervisor::FltkSupervisor::getInst().first->postInFltk(proxycall, key); }
+
         bool newInFltk(IndirectCtor * proxy) { return internals_fltkSupervisor::FltkSupervisor::getInst().first->newInFltk(proxy); }
 
         bool deleteInFltk(IndirectDtor * proxy, bool deleteAlways) { return internals_fltkSupervisor::FltkSupervisor::getInst().first->deleteInFltk(proxy, deleteAlways); }
@@ -532,6 +614,39 @@ namespace mtools
 
         bool instInit() { return internals_fltkSupervisor::FltkSupervisor::getInst(true).second; }
 
+
+        /* headless flag: -1 = not yet decided, 0 = off, 1 = on */
+        std::atomic<int> & headlessFlag()
+            {
+            static std::atomic<int> flag(-1); // local static : no initialization order problem
+            return flag;
+            }
+
+
+        /* default headless mode, from the environment */
+        int defaultHeadless()
+            {
+            const char * s = std::getenv("MTOOLS_HEADLESS");
+            if ((s != nullptr) && (s[0] != 0)) { return (((s[0] == '0') && (s[1] == 0)) ? 0 : 1); }
+        #if !defined(_WIN32) && !defined(__APPLE__)
+            const char * d = std::getenv("DISPLAY");
+            const char * w = std::getenv("WAYLAND_DISPLAY");
+            if (((d == nullptr) || (d[0] == 0)) && ((w == nullptr) || (w[0] == 0))) { MTOOLS_DEBUG("No display found: headless mode."); return 1; }
+        #endif
+            return 0;
+            }
+
+        }
+
+
+    void setHeadless(bool status) { internals_fltkSupervisor::headlessFlag() = (status ? 1 : 0); }
+
+    bool isHeadless()
+        {
+        std::atomic<int> & flag = internals_fltkSupervisor::headlessFlag();
+        int h = flag;
+        if (h < 0) { flag.compare_exchange_strong(h, internals_fltkSupervisor::defaultHeadless()); h = flag; }
+        return (h == 1);
         }
 
 
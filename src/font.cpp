@@ -68,12 +68,15 @@ namespace mtools
 			_tab[c].glyph = im.sub_image(i*cell_lx, j*cell_ly, cell_lx, cell_ly);
 			_trim(c);
 			}
+		_buildAtlas();
 		}
 
 
 	void Font::createFrom(const Font & ft, int fontsize)
 		{
 		_tab.clear();
+		_atlas.empty();
+		_clearRuns();
 		_fontsize = (fontsize <= 0) ? 0 : fontsize;
 		if ((_fontsize <= 0) || (ft._fontsize <= 0)) return;
 		double scale = ((double)_fontsize) / ((double)ft._fontsize);
@@ -92,15 +95,27 @@ namespace mtools
 				_trim(c);
 				}
 			}
+		_buildAtlas();
 		}
 
 
 	void Font::drawText(Image & im, const iVec2 & pos, const std::string & txt, int txt_pos, RGBc color) const
 		{
 		if ((!_fontsize) || (txt.size() == 0)) return;
-		auto npos = _upperleft(pos, txt, txt_pos);
-		int64 x = npos.X();
-		int64 y = npos.Y();
+		if (txt.size() > MAX_RUN_LENGTH)
+			{
+			_drawGlyphs(im, _upperleft(pos, txt, txt_pos), txt, color);
+			return;
+			}
+		auto run = _textRun(txt, color);
+		im.blend(run->sprite, _upperleft(pos, run->dim, txt_pos) + run->off);
+		}
+
+
+	void Font::_drawGlyphs(Image & im, iVec2 pos, const std::string & txt, RGBc color) const
+		{
+		int64 x = pos.X();
+		int64 y = pos.Y();
 		int64 x0 = x;
 		for (size_t i = 0; i < txt.size(); i++)
 			{
@@ -113,7 +128,136 @@ namespace mtools
 				x += _tab[c].width;
 				}
 			}
-		return;
+		}
+
+
+	std::shared_ptr<const Font::_TextRun> Font::_textRun(const std::string & txt, RGBc color) const
+		{
+		std::string key((const char *)&color.color, sizeof(color.color));
+		key += txt;
+			{
+			std::lock_guard<std::mutex> lock(_runmut);
+			auto it = _runs.find(key);
+			if (it != _runs.end()) return it->second;
+			}
+		// not in the cache: composite the run outside of the lock
+		auto run = std::make_shared<_TextRun>();
+		_makeTextRun(txt, color, *run);
+		const int64 pix = run->sprite.lx()*run->sprite.ly() + 1;
+		std::lock_guard<std::mutex> lock(_runmut);
+		if ((_runs.size() >= MAX_RUNS) || (_runpixels + pix > MAX_RUN_PIXELS)) { _runs.clear(); _runpixels = 0; }
+		if (_runs.emplace(std::move(key), run).second) { _runpixels += pix; }
+		return run;
+		}
+
+
+	void Font::_makeTextRun(const std::string & txt, RGBc color, _TextRun & run) const
+		{
+		run.dim = _textDimension(txt);
+		// bounding box of the glyphs
+		iBox2 B;
+		int64 x = 0, y = 0;
+		for (size_t i = 0; i < txt.size(); i++)
+			{
+			const char c = txt[i];
+			if (c == '\n') { x = 0; y += _fontsize; }
+			else if (c == '\t') { x += 4 * _tab[' '].width; }
+			else if (c >= 32)
+				{
+				const Image & G = _tab[c].glyph;
+				if (!G.isEmpty()) { B.swallowBox(iBox2(x + _tab[c].offx, x + _tab[c].offx + G.lx() - 1, y + _tab[c].offy, y + _tab[c].offy + G.ly() - 1)); }
+				x += _tab[c].width;
+				}
+			}
+		run.off = iVec2(0, 0);
+		run.sprite.empty();
+		if (B.isEmpty()) return;
+		run.off = iVec2(B.min[0], B.min[1]);
+		run.sprite.resizeRaw(B.max[0] - B.min[0] + 1, B.max[1] - B.min[1] + 1);
+		run.sprite.clear(RGBc(0, 0, 0, 0));
+		// union of the glyphs (same result as masking them one after the other)
+		x = -B.min[0]; y = -B.min[1];
+		const int64 x0 = x;
+		for (size_t i = 0; i < txt.size(); i++)
+			{
+			const char c = txt[i];
+			if (c == '\n') { x = x0; y += _fontsize; }
+			else if (c == '\t') { x += 4 * _tab[' '].width; }
+			else if (c >= 32)
+				{
+				const Image & G = _tab[c].glyph;
+				const int64 gx = x + _tab[c].offx, gy = y + _tab[c].offy;
+				for (int64 j = 0; j < G.ly(); j++)
+					{
+					for (int64 i2 = 0; i2 < G.lx(); i2++)
+						{
+						const uint32 a = G(i2, j).comp.A;
+						if (a == 0) continue;
+						RGBc & D = run.sprite(gx + i2, gy + j);
+						const uint32 b = D.comp.A;
+						D.comp.A = (uint8)(a + b - (a*b + 127) / 255);
+						}
+					}
+				x += _tab[c].width;
+				}
+			}
+		// apply the color
+		const int64 lx = run.sprite.lx(), ly = run.sprite.ly();
+		for (int64 j = 0; j < ly; j++)
+			{
+			for (int64 i = 0; i < lx; i++)
+				{
+				RGBc & D = run.sprite(i, j);
+				D = color.getMultOpacityInt(D.opacityInt());
+				}
+			}
+		}
+
+
+	void Font::_clearRuns() const
+		{
+		std::lock_guard<std::mutex> lock(_runmut);
+		_runs.clear();
+		_runpixels = 0;
+		}
+
+
+	void Font::_buildAtlas()
+		{
+		_atlas.empty();
+		if ((_fontsize <= 0) || (_tab.size() == 0)) return;
+		std::vector<int> ord;
+		int64 area = 0, maxw = 0;
+		for (int c = 0; c < (int)_tab.size(); c++)
+			{
+			const Image & G = _tab[c].glyph;
+			if (G.isEmpty()) continue;
+			ord.push_back(c);
+			area += G.lx()*G.ly();
+			maxw = std::max<int64>(maxw, G.lx());
+			}
+		if (ord.size() == 0) return;
+		// shelf packing by decreasing height
+		std::sort(ord.begin(), ord.end(), [&](int a, int b) { return (_tab[a].glyph.ly() > _tab[b].glyph.ly()); });
+		const int64 W = std::max<int64>(maxw, (int64)ceil(sqrt((double)area)*1.2));
+		std::vector<iVec2> pos(_tab.size());
+		int64 x = 0, y = 0, h = 0;
+		for (int c : ord)
+			{
+			const Image & G = _tab[c].glyph;
+			if (x + G.lx() > W) { x = 0; y += h; h = 0; }
+			pos[c] = iVec2(x, y);
+			x += G.lx();
+			h = std::max<int64>(h, G.ly());
+			}
+		Image atlas(W, y + h, RGBc(0, 0, 0, 0));
+		for (int c : ord)
+			{
+			Image & G = _tab[c].glyph;
+			atlas.blit(G, pos[c].X(), pos[c].Y());
+			G = atlas.sub_image(pos[c].X(), pos[c].Y(), G.lx(), G.ly());
+			}
+		_atlas = atlas;
 		}
 
 
@@ -207,6 +351,10 @@ namespace mtools
 		_nativeset.clear();
 		_fonts.clear();
 		_fonts.resize(MAX_FONT_SIZE + 1);
+		_ready.reset(new std::atomic<bool>[MAX_FONT_SIZE + 1]);
+		for (int i = 0; i <= MAX_FONT_SIZE; i++) { _ready[i].store(false, std::memory_order_relaxed); }
+		_lazyar.reset();
+		_lazyleft = 0;
 		}
 
 
@@ -214,14 +362,35 @@ namespace mtools
 		{
 		if (fontsize == 0) return;
 		std::lock_guard<std::mutex> lock(_mut); // mutex lock for concurrent access. 
-		if (!(_fonts[fontsize].isEmpty())) return; // already created, nothing to do.
+		if (_ready[fontsize].load(std::memory_order_relaxed)) return; // already created, nothing to do.
+		if (_nativeset.count(fontsize)) { _loadNative(fontsize); return; }
+		if (_nativeset.size() == 0) return;
 		auto it = _nativeset.lower_bound(fontsize);
-		if (it == _nativeset.end())
-			{ // past the largest one. 
-			_fonts[fontsize].createFrom(_fonts[*(_nativeset.rbegin())], fontsize);
-			return;
+		const int src = (it == _nativeset.end()) ? *(_nativeset.rbegin()) : *it; // past the largest one: use the largest. 
+		_loadNative(src);
+		_fonts[fontsize].createFrom(_fonts[src], fontsize);
+		_ready[fontsize].store(true, std::memory_order_release);
+		}
+
+
+	void FontFamily::_loadNative(int fontsize) const
+		{
+		while ((_lazyar) && (!_ready[fontsize].load(std::memory_order_relaxed)))
+			{
+			int fs; (*_lazyar) & fs;
+			if ((fs <= 0) || (fs > MAX_FONT_SIZE) || (_nativeset.count(fs) == 0)) { MTOOLS_ERROR("FontFamily: unexpected font size in the archive"); }
+			(*_lazyar) & _fonts[fs];
+			_fonts[fs]._buildAtlas();
+			_ready[fs].store(true, std::memory_order_release);
+			if (--_lazyleft == 0) { _lazyar.reset(); } // all fonts read: release the archive
 			}
-		_fonts[fontsize].createFrom(_fonts[*it], fontsize);
+		}
+
+
+	void FontFamily::_loadAll() const
+		{
+		std::lock_guard<std::mutex> lock(_mut); // mutex lock for concurrent access. 
+		if ((_lazyar) && (_nativeset.size() > 0)) _loadNative(*(_nativeset.rbegin()));
 		}
 
 
@@ -232,19 +401,26 @@ namespace mtools
 		/* the buffer containing the global font data */
 		extern const cp_char OPEN_SANS_FONT_DATA[9680];
 
+		/* sizes of the native fonts stored in OPEN_SANS_FONT_DATA (in the order they are stored) */
+		static const int OPEN_SANS_NATIVE_SIZES[] = { 8, 9, 10, 11, 12, 13, 14, 16, 18, 20, 22, 24, 26, 28, 32, 36, 40, 48, 64, 72, 128, 256 };
+
 		/* pointer to the global font family object */
-		FontFamily * _gfont = nullptr;
+		std::atomic<FontFamily *> _gfont(nullptr);
 
-		/* make sure _gfont is created */ 
-		inline void _creategFont()
+		/* return the global font family, created on first use (its fonts are decoded when first requested) */
+		inline FontFamily * _getgFont()
 			{
+			FontFamily * p = _gfont.load(std::memory_order_acquire);
+			if (p != nullptr) return p;
 			static std::mutex mut;
-			if (internals_font::_gfont == nullptr)
+			std::lock_guard<std::mutex> lock(mut); // mutex lock for concurrent access. 
+			p = _gfont.load(std::memory_order_relaxed);
+			if (p == nullptr)
 				{
-				std::lock_guard<std::mutex> lock(mut); // mutex lock for concurrent access. 
-				ICPPArchive ar(internals_font::OPEN_SANS_FONT_DATA);
-				if (internals_font::_gfont == nullptr) internals_font::_gfont = new FontFamily(ar);
+				p = new FontFamily(std::unique_ptr<IBaseArchive>(new ICPPArchive(OPEN_SANS_FONT_DATA)), std::set<int>(std::begin(OPEN_SANS_NATIVE_SIZES), std::end(OPEN_SANS_NATIVE_SIZES)));
+				_gfont.store(p, std::memory_order_release);
 				}
+			return p;
 			}
 
 		}
@@ -252,26 +428,25 @@ namespace mtools
 
 	const Font & gFont(int fontsize, int  method)
 		{
-		internals_font::_creategFont();
-		return internals_font::_gfont->operator()(fontsize,method);
+		return internals_font::_getgFont()->operator()(fontsize,method);
 		}
 
 
 
 	int gFontFindSize(const std::string & text, mtools::iVec2 boxsize, int  method, int minheight, int maxheight)
 		{
-		internals_font::_creategFont();
+		FontFamily * gfont = internals_font::_getgFont();
 		if (minheight < 0) minheight = 0;
 		if (maxheight > FontFamily::MAX_FONT_SIZE) maxheight = FontFamily::MAX_FONT_SIZE;		
 		if (minheight > maxheight) return 0;
 		if (minheight == maxheight) return maxheight;
 
-		if ((text.length() == 0) || ((boxsize.X()<0) && (boxsize.Y()<0)))  return internals_font::_gfont->nearestSize(maxheight, method);
+		if ((text.length() == 0) || ((boxsize.X()<0) && (boxsize.Y()<0)))  return gfont->nearestSize(maxheight, method);
 		if ((boxsize.Y() >= 0) && (boxsize.Y()<maxheight)) { maxheight = (int)boxsize.Y(); }
 		mtools::iVec2 TS = gFont(maxheight, method).textDimension(text);
-		if (((boxsize.X() < 0) || (TS.X() <= boxsize.X())) && ((boxsize.Y()<0) || (TS.Y() <= boxsize.Y()))) return internals_font::_gfont->nearestSize(maxheight, method);
+		if (((boxsize.X() < 0) || (TS.X() <= boxsize.X())) && ((boxsize.Y()<0) || (TS.Y() <= boxsize.Y()))) return gfont->nearestSize(maxheight, method);
 		TS = gFont(minheight, method).textDimension(text);
-		if  (((boxsize.X() >= 0) && (TS.X() > boxsize.X())) || ((boxsize.Y() >= 0) && (TS.Y() > boxsize.Y()))) return internals_font::_gfont->nearestSize(minheight, method);
+		if  (((boxsize.X() >= 0) && (TS.X() > boxsize.X())) || ((boxsize.Y() >= 0) && (TS.Y() > boxsize.Y()))) return gfont->nearestSize(minheight, method);
 		while (maxheight - minheight >1) 
 			{
 			unsigned int f = (maxheight + minheight) / 2;
@@ -279,7 +454,7 @@ namespace mtools
 			if (((boxsize.X()<0) || (TS.X() <= boxsize.X())) && ((boxsize.Y()<0) || (TS.Y() <= boxsize.Y()))) { minheight = f; }
 			else { maxheight = f; }
 			}
-		return internals_font::_gfont->nearestSize(minheight, method);
+		return gfont->nearestSize(minheight, method);
 		}
 
 
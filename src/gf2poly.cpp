@@ -0,0 +1,231 @@
+/** @file gf2poly.cpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "random/internal/gf2poly.hpp"
+#include "misc/error.hpp"
+
+#include <algorithm>
+
+
+namespace mtools
+{
+
+    namespace internals_random
+    {
+
+
+        /* compute the 64 shifted copies of a polynomial: tab[s] = a << s (with nbw + 1 words each) */
+        static void _shiftedCopies(const std::vector<uint64> & a, std::vector<uint64> & tab)
+            {
+            const size_t nbw = a.size() + 1;
+            tab.assign(64 * nbw, 0);
+            for (size_t s = 0; s < 64; s++)
+                {
+                uint64 * t = tab.data() + s*nbw;
+                for (size_t j = 0; j < a.size(); j++)
+                    {
+                    t[j] ^= (a[j] << s);
+                    if (s > 0) { t[j + 1] ^= (a[j] >> (64 - s)); }
+                    }
+                }
+            }
+
+
+        int64 GF2Poly::degree() const
+            {
+            for (size_t j = _w.size(); j > 0; j--)
+                {
+                const uint64 v = _w[j - 1];
+                if (v != 0) { return (int64)(64 * (j - 1)) + (int64)highestBit(v) - 1; }
+                }
+            return -1;
+            }
+
+
+        void GF2Poly::setCoeff(size_t i)
+            {
+            if ((i >> 6) >= _w.size()) { _w.resize((i >> 6) + 1, 0); }
+            _w[i >> 6] |= (((uint64)1) << (i & 63));
+            }
+
+
+        GF2Poly GF2Poly::monomial(size_t n)
+            {
+            GF2Poly R;
+            R.setCoeff(n);
+            return R;
+            }
+
+
+        void GF2Poly::_normalize()
+            {
+            while ((_w.size() > 0) && (_w.back() == 0)) { _w.pop_back(); }
+            }
+
+
+        void GF2Poly::_mod(const GF2Poly & P)
+            {
+            const int64 d = P.degree();
+            MTOOLS_INSURE(d >= 0);
+            int64 deg = degree();
+            if (deg < d) { _normalize(); return; }
+            std::vector<uint64> tab;
+            _shiftedCopies(P._w, tab);
+            const size_t nbw = P._w.size() + 1;
+            for (int64 i = deg; i >= d; i--)
+                { // eliminate the coefficient of x^i
+                if (((_w[(size_t)(i >> 6)] >> (i & 63)) & 1) == 0) continue;
+                const size_t sh = (size_t)(i - d);
+                const uint64 * t = tab.data() + (sh & 63)*nbw;
+                const size_t off = (sh >> 6);
+                const size_t m = std::min<size_t>(nbw, _w.size() - off);
+                for (size_t j = 0; j < m; j++) { _w[off + j] ^= t[j]; }
+                }
+            _normalize();
+            }
+
+
+        GF2Poly GF2Poly::minimalPolynomial(const std::vector<uint8> & seq)
+            {
+            const size_t N = seq.size();
+            // sequence stored in reverse order: bit j of srev is seq[N-1-j]
+            const size_t nbw = (N + 63) / 64 + 2;
+            std::vector<uint64> srev(nbw, 0);
+            for (size_t j = 0; j < N; j++) { if (seq[N - 1 - j] & 1) { srev[j >> 6] |= (((uint64)1) << (j & 63)); } }
+            std::vector<uint64> C(nbw, 0), B(nbw, 0), T;
+            C[0] = 1; B[0] = 1;
+            size_t L = 0;
+            size_t m = 0;   // shift to apply to B
+            for (size_t n = 0; n < N; n++)
+                {
+                m++;
+                // discrepancy: sum_{i=0..L} C_i seq[n-i] with seq[n-i] = bit (N-1-n+i) of srev
+                const size_t o = N - 1 - n;
+                const size_t ow = (o >> 6), ob = (o & 63);
+                uint64 d = 0;
+                const size_t nw = (L >> 6) + 1;
+                for (size_t k = 0; k < nw; k++)
+                    {
+                    uint64 v = (srev[ow + k] >> ob);
+                    if ((ob != 0) && (ow + k + 1 < nbw)) { v |= (srev[ow + k + 1] << (64 - ob)); }
+                    d ^= (v & C[k]);
+                    }
+                d ^= (d >> 32); d ^= (d >> 16); d ^= (d >> 8); d ^= (d >> 4); d ^= (d >> 2); d ^= (d >> 1);
+                if (d & 1)
+                    {
+                    const bool upd = (2 * L <= n);
+                    if (upd) { T = C; }
+                    // C = C + x^m B
+                    const size_t mw = (m >> 6), mb = (m & 63);
+                    for (size_t k = 0; k + mw < nbw; k++)
+                        {
+                        C[k + mw] ^= (B[k] << mb);
+                        if ((mb != 0) && (k + mw + 1 < nbw)) { C[k + mw + 1] ^= (B[k] >> (64 - mb)); }
+                        }
+                    if (upd) { L = n + 1 - L; B.swap(T); m = 0; }
+                    }
+                }
+            // C(x) = 1 + c_1 x + ... + c_L x^L is the connection polynomial, the minimal polynomial is its reciprocal
+            GF2Poly R;
+            for (size_t i = 0; i <= L; i++) { if ((C[i >> 6] >> (i & 63)) & 1) R.setCoeff(L - i); }
+            return R;
+            }
+
+
+        GF2Poly GF2Poly::mulmod(const GF2Poly & a, const GF2Poly & b, const GF2Poly & P)
+            {
+            GF2Poly R;
+            if ((a._w.size() == 0) || (b._w.size() == 0)) return R;
+            std::vector<uint64> tab;
+            _shiftedCopies(b._w, tab);
+            const size_t nbw = b._w.size() + 1;
+            R._w.assign(a._w.size() + nbw, 0);
+            for (size_t j = 0; j < a._w.size(); j++)
+                {
+                uint64 v = a._w[j];
+                while (v != 0)
+                    {
+                    const size_t s = (size_t)(highestBit(v & (~v + 1)) - 1); // index of the lowest set bit
+                    v &= (v - 1);
+                    const uint64 * t = tab.data() + s*nbw;
+                    for (size_t k = 0; k < nbw; k++) { R._w[j + k] ^= t[k]; }
+                    }
+                }
+            R._mod(P);
+            return R;
+            }
+
+
+        GF2Poly GF2Poly::powX2mod(size_t k, const GF2Poly & P)
+            {
+            GF2Poly R = monomial(1);
+            R._mod(P);
+            for (size_t i = 0; i < k; i++)
+                { // squaring in GF(2)[x] spreads the bits
+                GF2Poly S;
+                S._w.assign(2 * R._w.size(), 0);
+                for (size_t j = 0; j < R._w.size(); j++)
+                    {
+                    const uint64 v = R._w[j];
+                    uint64 lo = 0, hi = 0;
+                    for (int b = 0; b < 32; b++)
+                        {
+                        lo |= ((v >> b) & 1) << (2 * b);
+                        hi |= ((v >> (b + 32)) & 1) << (2 * b);
+                        }
+                    S._w[2 * j] = lo;
+                    S._w[2 * j + 1] = hi;
+                    }
+                S._mod(P);
+                R._w.swap(S._w);
+                }
+            return R;
+            }
+
+
+        GF2Poly GF2Poly::powmod(const GF2Poly & g, uint64 n, const GF2Poly & P)
+            {
+            GF2Poly R = monomial(0);
+            R._mod(P);
+            GF2Poly A = g;
+            A._mod(P);
+            while (n != 0)
+                {
+                if (n & 1) { R = mulmod(R, A, P); }
+                n >>= 1;
+                if (n != 0) { A = mulmod(A, A, P); }
+                }
+            return R;
+            }
+
+
+        GF2Poly GF2Poly::powXmod(uint64 n, const GF2Poly & P)
+            {
+            return powmod(monomial(1), n, P);
+            }
+
+
+    }
+
+}
+
+
+/* end of file */
+
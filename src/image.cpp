@@ -18,8 +18,17 @@
 // along with mtools  If not, see <http://www.gnu.org/licenses/>.
 
 #include "graphics/image.hpp"
+#include "graphics/imagestreamwriter.hpp"
 #include "graphics/font.hpp"
 
+#include <png.h>
+#include <zlib.h>
+#include <cstdio>
+#include <algorithm>
+#include <unordered_map>
+#include <mutex>
+#include <thread>
+
 
 namespace mtools
 	{
@@ -125,6 +134,936 @@ namespace mtools
 
 
 
+
+	namespace internals_graphics
+		{
+
+		/* number of bytes of uncompressed data per strip in Image::save_png() */
+		static const int64 PNG_STRIP_BYTES = 4 << 20;
+
+
+		/* convert a row of the image to RGB or RGBA bytes (removing premultiplication) */
+		static void _pngConvertRow(uint8 * out, const RGBc * src, int64 lx, bool alpha)
+			{
+			if (alpha)
+				{
+				for (int64 i = 0; i < lx; i++)
+					{
+					RGBc col = src[i]; col.unpremultiply();
+					out[0] = col.comp.R; out[1] = col.comp.G; out[2] = col.comp.B; out[3] = col.comp.A;
+					out += 4;
+					}
+				}
+			else
+				{
+				for (int64 i = 0; i < lx; i++)
+					{
+					out[0] = src[i].comp.R; out[1] = src[i].comp.G; out[2] = src[i].comp.B;
+					out += 3;
+					}
+				}
+			}
+
+
+		/* Paeth predictor of the PNG specification */
+		static inline uint8 _pngPaeth(int a, int b, int c)
+			{
+			const int p = a + b - c;
+			const int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+			if ((pa <= pb) && (pa <= pc)) return (uint8)a;
+			return (uint8)((pb <= pc) ? b : c);
+			}
+
+
+		/* apply PNG filter 'type' to the row cur (previous row prev) and return the sum of the absolute
+		   values of the filtered bytes (the heuristic used by libpng to choose the filter). out[0] is set to type */
+		static uint64 _pngFilterRow(int type, uint8 * out, const uint8 * cur, const uint8 * prev, size_t len, size_t bpp)
+			{
+			out[0] = (uint8)type;
+			uint8 * f = out + 1;
+			switch (type)
+				{
+				case 0: { for (size_t i = 0; i < len; i++) f[i] = cur[i]; break; }
+				case 1: { for (size_t i = 0; i < len; i++) f[i] = (uint8)(cur[i] - ((i >= bpp) ? cur[i - bpp] : 0)); break; }
+				case 2: { for (size_t i = 0; i < len; i++) f[i] = (uint8)(cur[i] - prev[i]); break; }
+				case 3: { for (size_t i = 0; i < len; i++) f[i] = (uint8)(cur[i] - ((((i >= bpp) ? cur[i - bpp] : 0) + prev[i]) >> 1)); break; }
+				default: { for (size_t i = 0; i < len; i++) f[i] = (uint8)(cur[i] - ((i >= bpp) ? _pngPaeth(cur[i - bpp], prev[i], prev[i - bpp]) : prev[i])); break; }
+				}
+			uint64 cost = 0;
+			for (size_t i = 0; i < len; i++) { cost += ((f[i] < 128) ? f[i] : 256 - f[i]); }
+			return cost;
+			}
+
+
+		/* Filter and deflate the lines [jmin, jmax[ of the image as raw deflate data (no zlib header). The
+		   stream is byte aligned at the end (Z_SYNC_FLUSH) so that the strips can be concatenated, and
+		   finished if jmax == ly. Also compute the adler32 checksum of the uncompressed data. */
+		static bool _pngCompressStrip(const RGBc * data, int64 stride, int64 lx, int64 ly, bool alpha, int level, int64 jmin, int64 jmax, std::vector<uint8> & out, uLong & adler)
+			{
+			const size_t bpp = (alpha ? 4 : 3);
+			const size_t len = bpp * (size_t)lx;
+			std::vector<uint8> prev(len, 0), cur(len), row(len + 1), best(len + 1);
+			if (jmin > 0) _pngConvertRow(prev.data(), data + (jmin - 1)*stride, lx, alpha);
+			z_stream zs;
+			memset(&zs, 0, sizeof(zs));
+			if (deflateInit2(&zs, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) return false;
+			out.resize((size_t)deflateBound(&zs, (uLong)((len + 1)*(jmax - jmin))) + 64);
+			zs.next_out = out.data();
+			zs.avail_out = (uInt)out.size();
+			adler = adler32(0, Z_NULL, 0);
+			bool ok = true;
+			for (int64 j = jmin; (ok) && (j < jmax); j++)
+				{
+				_pngConvertRow(cur.data(), data + j*stride, lx, alpha);
+				uint8 * filtered = row.data();
+				if (level == 0) { _pngFilterRow(0, row.data(), cur.data(), prev.data(), len, bpp); }
+				else
+					{ // adaptive filtering
+					uint64 mincost = _pngFilterRow(0, best.data(), cur.data(), prev.data(), len, bpp);
+					filtered = best.data();
+					for (int type = 1; type <= 4; type++)
+						{
+						const uint64 cost = _pngFilterRow(type, row.data(), cur.data(), prev.data(), len, bpp);
+						if (cost < mincost) { mincost = cost; std::swap(row, best); filtered = best.data(); }
+						}
+					}
+				adler = adler32(adler, filtered, (uInt)(len + 1));
+				zs.next_in = filtered;
+				zs.avail_in = (uInt)(len + 1);
+				ok = (deflate(&zs, Z_NO_FLUSH) == Z_OK) && (zs.avail_in == 0);
+				std::swap(prev, cur);
+				}
+			if (ok)
+				{
+				const int ret = deflate(&zs, ((jmax == ly) ? Z_FINISH : Z_SYNC_FLUSH));
+				ok = (jmax == ly) ? (ret == Z_STREAM_END) : (ret == Z_OK);
+				}
+			out.resize(out.size() - zs.avail_out);
+			deflateEnd(&zs);
+			return ok;
+			}
+
+
+		/* write a 32 bit big endian integer */
+		static inline void _pngBE32(uint8 * p, uint32 v)
+			{
+			p[0] = (uint8)(v >> 24); p[1] = (uint8)(v >> 16); p[2] = (uint8)(v >> 8); p[3] = (uint8)v;
+			}
+
+
+		/* write a PNG chunk */
+		static bool _pngWriteChunk(FILE * f, const char * type, const uint8 * data, size_t len)
+			{
+			uint8 head[8];
+			_pngBE32(head, (uint32)len);
+			memcpy(head + 4, type, 4);
+			uLong crc = crc32(0, Z_NULL, 0);
+			crc = crc32(crc, head + 4, 4);
+			if (len > 0) crc = crc32(crc, data, (uInt)len);
+			uint8 tail[4];
+			_pngBE32(tail, (uint32)crc);
+			if (fwrite(head, 1, 8, f) != 8) return false;
+			if ((len > 0) && (fwrite(data, 1, len, f) != len)) return false;
+			return (fwrite(tail, 1, 4, f) == 4);
+			}
+
+		}
+
+
+	bool Image::save_png(const char * filename, int compression, bool multithread) const
+		{
+		using namespace internals_graphics;
+		if (isEmpty()) return false;
+		if (compression < 0) compression = 0; else if (compression > 9) compression = 9;
+		const bool alpha = !isOpaque();
+		FILE * f = fopen(filename, "wb");
+		if (f == nullptr) return false;
+		const int64 rowlen = (alpha ? 4 : 3)*_lx + 1;
+		const int64 strip = std::max<int64>(1, PNG_STRIP_BYTES / rowlen);	// lines per strip
+		const int64 nbstrips = (_ly + strip - 1) / strip;
+		const int64 batch = (multithread ? 2 * (int64)rescaleThreads() : 1);	// strips compressed at the same time
+		static const uint8 signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+		bool ok = (fwrite(signature, 1, 8, f) == 8);
+		uint8 ihdr[13];
+		_pngBE32(ihdr, (uint32)_lx);
+		_pngBE32(ihdr + 4, (uint32)_ly);
+		ihdr[8] = 8;						// bit depth
+		ihdr[9] = (alpha ? 6 : 2);			// RGBA or RGB
+		ihdr[10] = 0; ihdr[11] = 0; ihdr[12] = 0;	// deflate, adaptive filtering, no interlace
+		ok = ok && _pngWriteChunk(f, "IHDR", ihdr, 13);
+		const uint8 zhead[2] = { 0x78, (uint8)((compression < 2) ? 0x01 : ((compression < 6) ? 0x5E : ((compression == 6) ? 0x9C : 0xDA))) };
+		ok = ok && _pngWriteChunk(f, "IDAT", zhead, 2);
+		uLong adler = adler32(0, Z_NULL, 0);
+		std::vector< std::vector<uint8> > outs((size_t)batch);
+		std::vector<uLong> adlers((size_t)batch);
+		std::vector<char> oks((size_t)batch);
+		for (int64 s0 = 0; (ok) && (s0 < nbstrips); s0 += batch)
+			{
+			const int64 n = std::min<int64>(batch, nbstrips - s0);
+			auto fun = [&](int64 kmin, int64 kmax)
+				{
+				for (int64 k = kmin; k < kmax; k++)
+					{
+					const int64 jmin = (s0 + k)*strip, jmax = std::min<int64>(_ly, jmin + strip);
+					oks[(size_t)k] = _pngCompressStrip(_data, _stride, _lx, _ly, alpha, compression, jmin, jmax, outs[(size_t)k], adlers[(size_t)k]);
+					}
+				};
+			if (n > 1) { _parallelLines(n, n*strip*_lx, fun); } else { fun(0, n); }
+			for (int64 k = 0; (ok) && (k < n); k++)
+				{
+				const int64 jmin = (s0 + k)*strip, jmax = std::min<int64>(_ly, jmin + strip);
+				ok = (oks[(size_t)k] != 0) && _pngWriteChunk(f, "IDAT", outs[(size_t)k].data(), outs[(size_t)k].size());
+				adler = adler32_combine(adler, adlers[(size_t)k], (z_off_t)((jmax - jmin)*rowlen));
+				}
+			}
+		uint8 ztail[4];
+		_pngBE32(ztail, (uint32)adler);
+		ok = ok && _pngWriteChunk(f, "IDAT", ztail, 4);
+		ok = ok && _pngWriteChunk(f, "IEND", nullptr, 0);
+		ok = ok && (ferror(f) == 0);
+		if (fclose(f) != 0) ok = false;
+		return ok;
+		}
+
+
+	bool Image::load_png(const char * filename)
+		{
+		FILE * f = fopen(filename, "rb");
+		if (f == nullptr) return false;
+		png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+		png_infop info = (png != nullptr) ? png_create_info_struct(png) : nullptr;
+		if (info == nullptr) { png_destroy_read_struct(&png, nullptr, nullptr); fclose(f); return false; }
+		Image im;
+		if (setjmp(png_jmpbuf(png))) { png_destroy_read_struct(&png, &info, nullptr); fclose(f); return false; }
+		png_init_io(png, f);
+		png_read_info(png, info);
+		const int64 lx = (int64)png_get_image_width(png, info);
+		const int64 ly = (int64)png_get_image_height(png, info);
+		const int type = png_get_color_type(png, info);
+		// convert everything to 8 bit BGRA
+		if (png_get_bit_depth(png, info) == 16) png_set_strip_16(png);
+		if (type == PNG_COLOR_TYPE_PALETTE) png_set_palette_to_rgb(png);
+		if ((type == PNG_COLOR_TYPE_GRAY) || (type == PNG_COLOR_TYPE_GRAY_ALPHA)) { png_set_expand_gray_1_2_4_to_8(png); png_set_gray_to_rgb(png); }
+		if (png_get_valid(png, info, PNG_INFO_tRNS)) png_set_tRNS_to_alpha(png);
+		png_set_filler(png, 0xFF, PNG_FILLER_AFTER);
+		png_set_bgr(png);
+		const int passes = png_set_interlace_handling(png);
+		png_read_update_info(png, info);
+		if ((lx <= 0) || (ly <= 0) || (png_get_rowbytes(png, info) != (size_t)(4 * lx))) { png_destroy_read_struct(&png, &info, nullptr); fclose(f); return false; }
+		im.resizeRaw(lx, ly);
+		for (int p = 0; p < passes; p++)
+			{
+			for (int64 j = 0; j < ly; j++) { png_read_row(png, (png_bytep)(im._data + j*im._stride), nullptr); }
+			}
+		png_read_end(png, nullptr);
+		png_destroy_read_struct(&png, &info, nullptr);
+		fclose(f);
+		for (int64 j = 0; j < ly; j++)
+			{ // premultiply in place
+			RGBc * p = im._data + j*im._stride;
+			for (int64 i = 0; i < lx; i++) { if (p[i].comp.A != 255) p[i].premultiply(); }
+			}
+		*this = std::move(im);
+		return true;
+		}
+
+
+
+	namespace internals_graphics
+		{
+
+		/* call fun(kmin, kmax) on [0, n[ split between Image::rescaleThreads() threads */
+		template<typename FUN> static void _streamParallel(int64 n, FUN fun)
+			{
+			const int64 nbth = std::min<int64>(Image::rescaleThreads(), n);
+			if (nbth <= 1) { fun(0, n); return; }
+			std::vector<std::thread> threads;
+			threads.reserve((size_t)(nbth - 1));
+			for (int64 k = 1; k < nbth; k++) { threads.emplace_back(fun, (n*k) / nbth, (n*(k + 1)) / nbth); }
+			fun(0, n / nbth);
+			for (auto & th : threads) { th.join(); }
+			}
+
+
+		/* append a little endian integer of nbbytes bytes */
+		static inline void _tiffLE(std::vector<uint8> & buf, uint64 v, int nbbytes)
+			{
+			for (int i = 0; i < nbbytes; i++) { buf.push_back((uint8)(v >> (8 * i))); }
+			}
+
+
+		/* true if filename ends with ext (case insensitive) */
+		static bool _hasExtension(const std::string & filename, const char * ext)
+			{
+			const size_t l = strlen(ext);
+			if (filename.size() < l) return false;
+			for (size_t i = 0; i < l; i++) { if (tolower(filename[filename.size() - l + i]) != ext[i]) return false; }
+			return true;
+			}
+
+		}
+
+
+	ImageStreamWriter::ImageStreamWriter(const std::string & filename, int64 lx, int64 ly, bool alpha, int compression, int format) :
+		_f(nullptr), _format(format), _lx(lx), _ly(ly), _y(0), _alpha(alpha), _level(compression), _ok(true), _pos(0), _nbrows(0), _strip(0), _adler(1), _bigtiff(false)
+		{
+		using namespace internals_graphics;
+		MTOOLS_INSURE((lx > 0) && (ly > 0) && (lx <= 0x7FFFFFFF) && (ly <= 0x7FFFFFFF));
+		if (_level < 0) _level = 0; else if (_level > 9) _level = 9;
+		if (_format == FORMAT_AUTO)
+			{
+			if (_hasExtension(filename, ".bmp")) _format = FORMAT_BMP;
+			else if (_hasExtension(filename, ".png")) _format = FORMAT_PNG;
+			else if ((_hasExtension(filename, ".tif")) || (_hasExtension(filename, ".tiff"))) _format = FORMAT_TIFF;
+			}
+		MTOOLS_INSURE((_format == FORMAT_BMP) || (_format == FORMAT_PNG) || (_format == FORMAT_TIFF));
+		if (_format == FORMAT_BMP) { _alpha = false; }
+		_f = fopen(filename.c_str(), "wb");
+		if (_f == nullptr) { _ok = false; return; }
+		std::vector<uint8> head;
+		switch (_format)
+			{
+			case FORMAT_BMP:
+				{
+				const uint64 rowbytes = (uint64)((3 * _lx + 3) & (~((int64)3)));
+				MTOOLS_INSURE(rowbytes*(uint64)_ly + 54 <= 0xFFFFFFFFULL); // BMP files are limited to 4GB
+				const uint64 size = rowbytes*(uint64)_ly;
+				head.push_back('B'); head.push_back('M');
+				_tiffLE(head, size + 54, 4); _tiffLE(head, 0, 4); _tiffLE(head, 54, 4);
+				_tiffLE(head, 40, 4); _tiffLE(head, (uint64)_lx, 4); _tiffLE(head, (uint64)(uint32)(-(int32)_ly), 4); // negative height: top-down rows
+				_tiffLE(head, 1, 2); _tiffLE(head, 24, 2); _tiffLE(head, 0, 4); _tiffLE(head, size, 4);
+				_tiffLE(head, 10000, 4); _tiffLE(head, 10000, 4); _tiffLE(head, 0, 4); _tiffLE(head, 0, 4);
+				_row.assign((size_t)rowbytes, 0);
+				break;
+				}
+			case FORMAT_PNG:
+				{
+				static const uint8 signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+				_write(signature, 8);
+				uint8 ihdr[13];
+				_pngBE32(ihdr, (uint32)_lx);
+				_pngBE32(ihdr + 4, (uint32)_ly);
+				ihdr[8] = 8;
+				ihdr[9] = (_alpha ? 6 : 2);
+				ihdr[10] = 0; ihdr[11] = 0; ihdr[12] = 0;
+				_ok = _ok && _pngWriteChunk(_f, "IHDR", ihdr, 13);
+				const uint8 zhead[2] = { 0x78, (uint8)((_level < 2) ? 0x01 : ((_level < 6) ? 0x5E : ((_level == 6) ? 0x9C : 0xDA))) };
+				_ok = _ok && _pngWriteChunk(_f, "IDAT", zhead, 2);
+				_adler = (uint32)adler32(0, Z_NULL, 0);
+				const int64 rowlen = (_alpha ? 4 : 3)*_lx + 1;
+				_strip = std::max<int64>(1, PNG_STRIP_BYTES / rowlen);
+				_band.resizeRaw(_lx, 1 + _strip*Image::rescaleThreads());	// row 0 is the last row of the previous batch
+				break;
+				}
+			case FORMAT_TIFF:
+				{
+				_bigtiff = ((uint64)_lx*(uint64)_ly*(_alpha ? 4 : 3) > (((uint64)1) << 31));
+				head.push_back('I'); head.push_back('I');
+				if (_bigtiff) { _tiffLE(head, 43, 2); _tiffLE(head, 8, 2); _tiffLE(head, 0, 2); _tiffLE(head, 0, 8); }
+				else { _tiffLE(head, 42, 2); _tiffLE(head, 0, 4); }	// the offset of the directory is set by close()
+				const int64 ntx = (_lx + TIFF_TILE - 1) / TIFF_TILE;
+				_band.resizeRaw(ntx*TIFF_TILE, TIFF_TILE);
+				_band.clear(RGBc::c_Transparent);
+				break;
+				}
+			}
+		if (head.size() > 0) _write(head.data(), head.size());
+		}
+
+
+	ImageStreamWriter::~ImageStreamWriter()
+		{
+		close();
+		}
+
+
+	void ImageStreamWriter::push(const RGBc * rows, int64 stride, int64 lx, int64 nbrows)
+		{
+		MTOOLS_INSURE(lx == _lx);
+		if (_f == nullptr) return;
+		nbrows = std::min<int64>(nbrows, _ly - _y);
+		for (int64 k = 0; k < nbrows; k++)
+			{
+			const RGBc * src = rows + k*stride;
+			_y++;
+			switch (_format)
+				{
+				case FORMAT_BMP:
+					{
+					uint8 * p = _row.data();
+					for (int64 i = 0; i < _lx; i++) { p[0] = src[i].comp.B; p[1] = src[i].comp.G; p[2] = src[i].comp.R; p += 3; }
+					_write(_row.data(), _row.size());
+					break;
+					}
+				case FORMAT_PNG:
+					{
+					_nbrows++;
+					memcpy(_band.data() + _nbrows*_band.stride(), src, (size_t)_lx * sizeof(RGBc));
+					if ((_nbrows == _band.ly() - 1) || (_y == _ly)) _flushPNG(_y == _ly);
+					break;
+					}
+				case FORMAT_TIFF:
+					{
+					memcpy(_band.data() + _nbrows*_band.stride(), src, (size_t)_lx * sizeof(RGBc));
+					_nbrows++;
+					if ((_nbrows == TIFF_TILE) || (_y == _ly)) _flushTIFF();
+					break;
+					}
+				}
+			}
+		}
+
+
+	bool ImageStreamWriter::close()
+		{
+		using namespace internals_graphics;
+		if (_f == nullptr) return _ok;
+		if (_y < _ly)
+			{ // missing rows are transparent
+			std::vector<RGBc> empty_row((size_t)_lx, RGBc::c_Transparent);
+			push(empty_row.data(), 0, _lx, _ly - _y);
+			}
+		if (_format == FORMAT_PNG)
+			{
+			uint8 ztail[4];
+			_pngBE32(ztail, _adler);
+			_ok = _ok && _pngWriteChunk(_f, "IDAT", ztail, 4);
+			_ok = _ok && _pngWriteChunk(_f, "IEND", nullptr, 0);
+			}
+		if (_format == FORMAT_TIFF) _finishTIFF();
+		_ok = _ok && (ferror(_f) == 0);
+		if (fclose(_f) != 0) _ok = false;
+		_f = nullptr;
+		_band.empty();
+		_offsets.clear(); _offsets.shrink_to_fit();
+		_counts.clear(); _counts.shrink_to_fit();
+		return _ok;
+		}
+
+
+	void ImageStreamWriter::_write(const void * data, size_t len)
+		{
+		if ((!_ok) || (len == 0)) return;
+		if (fwrite(data, 1, len, _f) != len) { _ok = false; return; }
+		_pos += len;
+		}
+
+
+	void ImageStreamWriter::_flushPNG(bool last)
+		{
+		using namespace internals_graphics;
+		// rows 1.._nbrows of _band are new, row 0 is the previous one (used for filtering) except for the first batch.
+		const bool first = (_y == _nbrows);
+		const RGBc * base = _band.data() + (first ? _band.stride() : 0);
+		const int64 off = (first ? 0 : 1);
+		const int64 n = (_nbrows + _strip - 1) / _strip;
+		std::vector< std::vector<uint8> > outs((size_t)n);
+		std::vector<uLong> adlers((size_t)n);
+		std::vector<char> oks((size_t)n);
+		_streamParallel(n, [&](int64 kmin, int64 kmax)
+			{
+			for (int64 k = kmin; k < kmax; k++)
+				{
+				const int64 jmin = off + k*_strip, jmax = std::min<int64>(off + _nbrows, jmin + _strip);
+				const int64 lyp = ((last) && (k == n - 1)) ? jmax : (jmax + 1);	// the stream is finished only after the last row
+				oks[(size_t)k] = _pngCompressStrip(base, _band.stride(), _lx, lyp, _alpha, _level, jmin, jmax, outs[(size_t)k], adlers[(size_t)k]);
+				}
+			});
+		const int64 rowlen = (_alpha ? 4 : 3)*_lx + 1;
+		uLong adler = _adler;
+		for (int64 k = 0; (_ok) && (k < n); k++)
+			{
+			const int64 jmin = off + k*_strip, jmax = std::min<int64>(off + _nbrows, jmin + _strip);
+			_ok = (oks[(size_t)k] != 0) && _pngWriteChunk(_f, "IDAT", outs[(size_t)k].data(), outs[(size_t)k].size());
+			adler = adler32_combine(adler, adlers[(size_t)k], (z_off_t)((jmax - jmin)*rowlen));
+			}
+		_adler = (uint32)adler;
+		memcpy(_band.data(), _band.data() + _nbrows*_band.stride(), (size_t)_lx * sizeof(RGBc));
+		_nbrows = 0;
+		}
+
+
+	void ImageStreamWriter::_flushTIFF()
+		{
+		using namespace internals_graphics;
+		const int64 T = TIFF_TILE;
+		const int64 ntx = _band.lx() / T;
+		const size_t spp = (_alpha ? 4 : 3);
+		const size_t tilebytes = (size_t)(T*T)*spp;
+		std::vector< std::vector<uint8> > outs((size_t)ntx);
+		std::vector<char> oks((size_t)ntx);
+		_streamParallel(ntx, [&](int64 kmin, int64 kmax)
+			{
+			std::vector<uint8> raw(tilebytes);
+			for (int64 k = kmin; k < kmax; k++)
+				{
+				uint8 * p = raw.data();
+				for (int64 j = 0; j < T; j++)
+					{
+					const RGBc * src = _band.data() + j*_band.stride() + k*T;
+					if (_alpha) { for (int64 i = 0; i < T; i++) { p[0] = src[i].comp.R; p[1] = src[i].comp.G; p[2] = src[i].comp.B; p[3] = src[i].comp.A; p += 4; } }
+					else { for (int64 i = 0; i < T; i++) { p[0] = src[i].comp.R; p[1] = src[i].comp.G; p[2] = src[i].comp.B; p += 3; } }
+					}
+				if (_level == 0) { outs[(size_t)k] = raw; oks[(size_t)k] = 1; continue; }
+				uLongf len = compressBound((uLong)tilebytes);
+				outs[(size_t)k].resize((size_t)len);
+				oks[(size_t)k] = (compress2(outs[(size_t)k].data(), &len, raw.data(), (uLong)tilebytes, _level) == Z_OK);
+				outs[(size_t)k].resize((size_t)len);
+				}
+			});
+		for (int64 k = 0; (_ok) && (k < ntx); k++)
+			{
+			if (oks[(size_t)k] == 0) { _ok = false; break; }
+			_offsets.push_back(_pos);
+			_counts.push_back((uint64)outs[(size_t)k].size());
+			_write(outs[(size_t)k].data(), outs[(size_t)k].size());
+			}
+		_band.clear(RGBc::c_Transparent);
+		_nbrows = 0;
+		}
+
+
+	void ImageStreamWriter::_finishTIFF()
+		{
+		using namespace internals_graphics;
+		if (!_ok) return;
+		if (_pos & 1) { const uint8 z = 0; _write(&z, 1); } // word alignment
+		const size_t inl = (_bigtiff ? 8 : 4);		// bytes of a value stored in the directory entry
+		const int offsize = (_bigtiff ? 8 : 4);		// bytes of an offset
+		const uint16 SHORT = 3, LONG = 4, LONG8 = 16;
+		struct Entry { uint16 tag; uint16 type; uint64 count; std::vector<uint8> data; };
+		std::vector<Entry> entries;
+		auto add = [&](uint16 tag, uint16 type, const std::vector<uint64> & values)
+			{
+			Entry e; e.tag = tag; e.type = type; e.count = values.size();
+			const int s = ((type == SHORT) ? 2 : ((type == LONG) ? 4 : 8));
+			for (auto v : values) _tiffLE(e.data, v, s);
+			entries.push_back(std::move(e));
+			};
+		const uint64 spp = (_alpha ? 4 : 3);
+		add(256, LONG, { (uint64)_lx });								// ImageWidth
+		add(257, LONG, { (uint64)_ly });								// ImageLength
+		add(258, SHORT, std::vector<uint64>((size_t)spp, 8));			// BitsPerSample
+		add(259, SHORT, { (uint64)((_level == 0) ? 1 : 8) });			// Compression: none or deflate
+		add(262, SHORT, { 2 });										// PhotometricInterpretation: RGB
+		add(277, SHORT, { spp });										// SamplesPerPixel
+		add(284, SHORT, { 1 });										// PlanarConfiguration: interleaved
+		add(322, LONG, { (uint64)TIFF_TILE });							// TileWidth
+		add(323, LONG, { (uint64)TIFF_TILE });							// TileLength
+		add(324, (_bigtiff ? LONG8 : LONG), _offsets);					// TileOffsets
+		add(325, (_bigtiff ? LONG8 : LONG), _counts);					// TileByteCounts
+		if (_alpha) add(338, SHORT, { 1 });							// ExtraSamples: associated (premultiplied) alpha
+		// values too large for the entries are written first
+		std::vector<uint8> blob;
+		std::vector<uint64> valpos(entries.size(), 0);
+		for (size_t i = 0; i < entries.size(); i++)
+			{
+			if (entries[i].data.size() <= inl) continue;
+			valpos[i] = _pos + blob.size();
+			blob.insert(blob.end(), entries[i].data.begin(), entries[i].data.end());
+			if (blob.size() & 1) blob.push_back(0);
+			}
+		const uint64 ifdpos = _pos + blob.size();
+		std::vector<uint8> ifd;
+		_tiffLE(ifd, entries.size(), (_bigtiff ? 8 : 2));
+		for (size_t i = 0; i < entries.size(); i++)
+			{
+			_tiffLE(ifd, entries[i].tag, 2);
+			_tiffLE(ifd, entries[i].type, 2);
+			_tiffLE(ifd, entries[i].count, offsize);
+			if (entries[i].data.size() <= inl)
+				{
+				std::vector<uint8> v = entries[i].data; v.resize(inl, 0);
+				ifd.insert(ifd.end(), v.begin(), v.end());
+				}
+			else { _tiffLE(ifd, valpos[i], offsize); }
+			}
+		_tiffLE(ifd, 0, offsize); // no other directory
+		_write(blob.data(), blob.size());
+		_write(ifd.data(), ifd.size());
+		if (!_ok) return;
+		std::vector<uint8> p;
+		_tiffLE(p, ifdpos, offsize);
+		if ((fseek(_f, (_bigtiff ? 8 : 4), SEEK_SET) != 0) || (fwrite(p.data(), 1, p.size(), _f) != p.size())) { _ok = false; }
+		}
+
+
+	namespace internals_graphics
+		{
+
+		/* minimum number of pixels for the parallel flood fill */
+		static const int64 FLOOD_MIN_PARALLEL = 1 << 21;
+
+		/* minimum number of lines per band in the parallel flood fill */
+		static const int64 FLOOD_MIN_BAND_LINES = 64;
+
+
+		/* test whether a pixel belongs to the region */
+		static inline bool _floodMatch(RGBc c, RGBc ref, int32 tol)
+			{
+			if (tol == 0) return (c.color == ref.color);
+			return ((std::abs((int32)c.comp.R - (int32)ref.comp.R) <= tol) && (std::abs((int32)c.comp.G - (int32)ref.comp.G) <= tol)
+				&& (std::abs((int32)c.comp.B - (int32)ref.comp.B) <= tol) && (std::abs((int32)c.comp.A - (int32)ref.comp.A) <= tol));
+			}
+
+
+		/* fill a span of pixels */
+		static inline void _floodSpan(RGBc * p, int64 x0, int64 x1, RGBc col, bool blend)
+			{
+			if (blend) { for (int64 i = x0; i <= x1; i++) { p[i].blend(col); } }
+			else { for (int64 i = x0; i <= x1; i++) { p[i] = col; } }
+			}
+
+
+		/* scanline flood fill from (x,y), single threaded. Only the pixels of the region (and their
+		   neighbours) are visited. A bitmask records the pixels already filled. */
+		static int64 _floodFillSeq(RGBc * data, int64 stride, int64 lx, int64 ly, int64 x, int64 y, RGBc col, int32 tol, bool blend, bool c8)
+			{
+			const RGBc ref = data[y*stride + x];
+			std::vector<uint64> vis((size_t)((lx*ly + 63) / 64), 0);
+			auto inside = [&](int64 i, int64 j) -> bool
+				{
+				const uint64 k = (uint64)(j*lx + i);
+				if ((vis[(size_t)(k >> 6)] >> (k & 63)) & 1) return false;
+				return _floodMatch(data[j*stride + i], ref, tol);
+				};
+			std::vector<std::pair<int64, int64> > stack;
+			stack.push_back({ x, y });
+			int64 nb = 0;
+			while (stack.size() > 0)
+				{
+				const int64 sx = stack.back().first, sy = stack.back().second;
+				stack.pop_back();
+				if (!inside(sx, sy)) continue;
+				int64 x0 = sx; while ((x0 > 0) && (inside(x0 - 1, sy))) { x0--; }
+				int64 x1 = sx; while ((x1 < lx - 1) && (inside(x1 + 1, sy))) { x1++; }
+				for (int64 i = x0; i <= x1; i++) { const uint64 k = (uint64)(sy*lx + i); vis[(size_t)(k >> 6)] |= (((uint64)1) << (k & 63)); }
+				_floodSpan(data + sy*stride, x0, x1, col, blend);
+				nb += x1 - x0 + 1;
+				const int64 a = (c8 ? std::max<int64>(0, x0 - 1) : x0);
+				const int64 b = (c8 ? std::min<int64>(lx - 1, x1 + 1) : x1);
+				for (int64 yy = sy - 1; yy <= sy + 1; yy += 2)
+					{ // push one seed per run of the lines above and below
+					if ((yy < 0) || (yy >= ly)) continue;
+					bool run = false;
+					for (int64 i = a; i <= b; i++)
+						{
+						if (inside(i, yy)) { if (!run) { stack.push_back({ i, yy }); run = true; } }
+						else run = false;
+						}
+					}
+				}
+			return nb;
+			}
+
+
+		/* run of matching pixels in a band of the parallel flood fill */
+		struct _FloodSpan
+			{
+			int64 x0, x1;	// first and last pixel
+			int64 parent;	// union-find link (index in the band)
+			};
+
+
+		/* a band of lines of the parallel flood fill */
+		struct _FloodBand
+			{
+			int64 jmin, jmax;					// lines [jmin, jmax[
+			std::vector<_FloodSpan> spans;		// runs of matching pixels, line by line
+			std::vector<int64> rowstart;		// index of the first span of each line (+ end marker)
+
+			int64 find(int64 i)
+				{
+				while (spans[(size_t)i].parent != i) { spans[(size_t)i].parent = spans[(size_t)spans[(size_t)i].parent].parent; i = spans[(size_t)i].parent; }
+				return i;
+				}
+
+			void unite(int64 a, int64 b)
+				{
+				a = find(a); b = find(b);
+				if (a < b) spans[(size_t)b].parent = a; else if (b < a) spans[(size_t)a].parent = b;
+				}
+			};
+
+
+		/* test whether two spans on consecutive lines are connected */
+		static inline bool _floodTouch(const _FloodSpan & a, const _FloodSpan & b, bool c8)
+			{
+			const int64 e = (c8 ? 1 : 0);
+			return ((a.x0 <= b.x1 + e) && (b.x0 <= a.x1 + e));
+			}
+
+
+		/* call fun(i, k) for each pair of connected spans i in [ia, ie[ and k in [ka, ke[ (consecutive lines) */
+		template<typename FUN> static inline void _floodOverlaps(const std::vector<_FloodSpan> & A, int64 ia, int64 ie, const std::vector<_FloodSpan> & B, int64 ka, int64 ke, bool c8, FUN fun)
+			{
+			while ((ia < ie) && (ka < ke))
+				{
+				if (_floodTouch(A[(size_t)ia], B[(size_t)ka], c8)) { fun(ia, ka); }
+				if (A[(size_t)ia].x1 < B[(size_t)ka].x1) ia++; else ka++;
+				}
+			}
+
+
+		/* label the runs of matching pixels of a band and join the connected ones */
+		static void _floodLabelBand(const RGBc * data, int64 stride, int64 lx, RGBc ref, int32 tol, bool c8, _FloodBand & band)
+			{
+			band.rowstart.reserve((size_t)(band.jmax - band.jmin + 1));
+			for (int64 j = band.jmin; j < band.jmax; j++)
+				{
+				const int64 start = (int64)band.spans.size();
+				band.rowstart.push_back(start);
+				const RGBc * p = data + j*stride;
+				int64 i = 0;
+				while (i < lx)
+					{
+					if (!_floodMatch(p[i], ref, tol)) { i++; continue; }
+					const int64 x0 = i;
+					while ((i < lx) && (_floodMatch(p[i], ref, tol))) { i++; }
+					band.spans.push_back({ x0, i - 1, (int64)band.spans.size() });
+					}
+				if (j > band.jmin)
+					{
+					const int64 pstart = band.rowstart[band.rowstart.size() - 2];
+					_floodOverlaps(band.spans, pstart, start, band.spans, start, (int64)band.spans.size(), c8, [&](int64 a, int64 b) { band.unite(a, b); });
+					}
+				}
+			band.rowstart.push_back((int64)band.spans.size());
+			for (int64 i = 0; i < (int64)band.spans.size(); i++) { band.spans[(size_t)i].parent = band.find(i); }
+			}
+
+		}
+
+
+	int64 Image::floodFill(iVec2 P, RGBc fillcolor, int32 tolerance, bool blend, bool connect8, bool multithread)
+		{
+		using namespace internals_graphics;
+		if ((isEmpty()) || (P.X() < 0) || (P.Y() < 0) || (P.X() >= _lx) || (P.Y() >= _ly)) return 0;
+		if (tolerance < 0) tolerance = 0;
+		if ((blend) && (fillcolor.isOpaque())) blend = false;
+		const int64 nbbands = std::min<int64>((int64)rescaleThreads(), _ly / FLOOD_MIN_BAND_LINES);
+		if ((!multithread) || (nbbands <= 1) || (_lx*_ly < FLOOD_MIN_PARALLEL))
+			{
+			return _floodFillSeq(_data, _stride, _lx, _ly, P.X(), P.Y(), fillcolor, tolerance, blend, connect8);
+			}
+		const RGBc ref = _data[P.Y()*_stride + P.X()];
+		std::vector<_FloodBand> bands((size_t)nbbands);
+		for (int64 b = 0; b < nbbands; b++) { bands[(size_t)b].jmin = (_ly*b) / nbbands; bands[(size_t)b].jmax = (_ly*(b + 1)) / nbbands; }
+		// 1. label each band in parallel
+		_parallelLines(nbbands, _lx*_ly, [&](int64 bmin, int64 bmax) { for (int64 b = bmin; b < bmax; b++) { _floodLabelBand(_data, _stride, _lx, ref, tolerance, connect8, bands[(size_t)b]); } });
+		// 2. union-find over the components of the bands touching a border
+		std::vector<std::unordered_map<int64, int64> > gid((size_t)nbbands);	// local root -> global id
+		std::vector<int64> gpar;
+		auto gfind = [&](int64 i) -> int64 { while (gpar[(size_t)i] != i) { gpar[(size_t)i] = gpar[(size_t)gpar[(size_t)i]]; i = gpar[(size_t)i]; } return i; };
+		auto getgid = [&](int64 b, int64 s) -> int64
+			{
+			const int64 r = bands[(size_t)b].spans[(size_t)s].parent;
+			auto it = gid[(size_t)b].find(r);
+			if (it != gid[(size_t)b].end()) return it->second;
+			const int64 g = (int64)gpar.size();
+			gpar.push_back(g);
+			gid[(size_t)b][r] = g;
+			return g;
+			};
+		for (int64 b = 0; b + 1 < nbbands; b++)
+			{
+			_FloodBand & A = bands[(size_t)b];
+			_FloodBand & B = bands[(size_t)b + 1];
+			const int64 na = (int64)A.rowstart.size();
+			_floodOverlaps(A.spans, A.rowstart[(size_t)na - 2], A.rowstart[(size_t)na - 1], B.spans, B.rowstart[0], B.rowstart[1], connect8, [&](int64 s, int64 t)
+				{
+				const int64 ga = gfind(getgid(b, s)), gb = gfind(getgid(b + 1, t));
+				if (ga < gb) gpar[(size_t)gb] = ga; else if (gb < ga) gpar[(size_t)ga] = gb;
+				});
+			}
+		// 3. find the component of P and the local roots belonging to it in each band
+		int64 sb = 0;
+		while (bands[(size_t)sb].jmax <= P.Y()) { sb++; }
+		const _FloodBand & SB = bands[(size_t)sb];
+		int64 sroot = -1;
+		const int64 sl = P.Y() - SB.jmin;
+		for (int64 i = SB.rowstart[(size_t)sl]; i < SB.rowstart[(size_t)sl + 1]; i++)
+			{
+			if ((SB.spans[(size_t)i].x0 <= P.X()) && (P.X() <= SB.spans[(size_t)i].x1)) { sroot = SB.spans[(size_t)i].parent; break; }
+			}
+		MTOOLS_ASSERT(sroot >= 0);
+		std::vector<std::vector<int64> > sel((size_t)nbbands);
+		auto it = gid[(size_t)sb].find(sroot);
+		if (it == gid[(size_t)sb].end())
+			{ // the region does not cross a band border
+			sel[(size_t)sb].push_back(sroot);
+			}
+		else
+			{
+			const int64 G = gfind(it->second);
+			for (int64 b = 0; b < nbbands; b++)
+				{
+				for (auto & e : gid[(size_t)b]) { if (gfind(e.second) == G) sel[(size_t)b].push_back(e.first); }
+				std::sort(sel[(size_t)b].begin(), sel[(size_t)b].end());
+				}
+			}
+		// 4. fill the selected spans in parallel
+		std::vector<int64> counts((size_t)nbbands, 0);
+		_parallelLines(nbbands, _lx*_ly, [&](int64 bmin, int64 bmax)
+			{
+			for (int64 b = bmin; b < bmax; b++)
+				{
+				const _FloodBand & B = bands[(size_t)b];
+				const std::vector<int64> & S = sel[(size_t)b];
+				if (S.size() == 0) continue;
+				for (int64 j = B.jmin; j < B.jmax; j++)
+					{
+					RGBc * p = _data + j*_stride;
+					const int64 l = j - B.jmin;
+					for (int64 i = B.rowstart[(size_t)l]; i < B.rowstart[(size_t)l + 1]; i++)
+						{
+						const _FloodSpan & sp = B.spans[(size_t)i];
+						if (std::binary_search(S.begin(), S.end(), sp.parent)) { _floodSpan(p, sp.x0, sp.x1, fillcolor, blend); counts[(size_t)b] += sp.x1 - sp.x0 + 1; }
+						}
+					}
+				}
+			});
+		int64 nb = 0;
+		for (auto c : counts) { nb += c; }
+		return nb;
+		}
+
+
+
+	namespace internals_graphics
+		{
+
+		/* buffers larger than 2^BUFFERPOOL_MAXLOG2 bytes are not pooled */
+		static const int BUFFERPOOL_MAXLOG2 = 40;
+
+		/* number of size classes (4 per power of 2 above 2^15 = BUFFERPOOL_MINSIZE/2) */
+		static const int BUFFERPOOL_NBCLASSES = 4 * (BUFFERPOOL_MAXLOG2 - 15) + 1;
+
+		/* default maximum amount of memory kept by the pool */
+		static const size_t BUFFERPOOL_DEFAULT_SIZE = ((size_t)256) << 20;
+
+		/* the pool of image buffers */
+		struct ImageBufferPool
+			{
+			std::mutex					mut;							// protects everything below
+			std::vector<void *>			freelist[BUFFERPOOL_NBCLASSES];	// free buffers, by size class
+			size_t						cached = 0;						// total size of the free buffers
+			size_t						maxsize = BUFFERPOOL_DEFAULT_SIZE;	// maximum value for cached
+			};
+
+		/* the global pool (never destroyed so images may be released during static destruction) */
+		static ImageBufferPool & imageBufferPool()
+			{
+			static ImageBufferPool * pool = new ImageBufferPool();
+			return *pool;
+			}
+
+		/* size class of a buffer of memsize > 2^15 bytes (0 if too large to be pooled) and the size of the buffers in this class.
+		   the classes sizes are 2^e * k / 4 for k = 5, 6, 7, 8 */
+		static uint32 bufferPoolClass(size_t memsize, size_t & classsize)
+			{
+			int e = 15;
+			while ((e < BUFFERPOOL_MAXLOG2) && ((((size_t)1) << (e + 1)) < memsize)) e++;
+			if (e >= BUFFERPOOL_MAXLOG2) { classsize = memsize; return 0; }
+			for (int k = 5; k <= 8; k++)
+				{
+				classsize = ((((size_t)1) << e) / 4) * k;
+				if (classsize >= memsize) return (uint32)(4 * (e - 15) + (k - 4));
+				}
+			MTOOLS_ERROR("should not be possible...");
+			return 0;
+			}
+
+		/* size of the buffers of a given class */
+		static size_t bufferPoolClassSize(uint32 sizeclass)
+			{
+			const int e = 15 + (int)((sizeclass - 1) / 4);
+			const int k = 5 + (int)((sizeclass - 1) % 4);
+			return ((((size_t)1) << e) / 4) * k;
+			}
+
+		/* free cached buffers until the pool holds at most maxsize bytes (largest buffers first). The mutex must be locked. */
+		static void bufferPoolTrim(ImageBufferPool & pool, size_t maxsize)
+			{
+			for (int c = BUFFERPOOL_NBCLASSES - 1; (c > 0) && (pool.cached > maxsize); c--)
+				{
+				auto & L = pool.freelist[c];
+				while ((L.size() > 0) && (pool.cached > maxsize))
+					{
+					free(L.back());
+					L.pop_back();
+					pool.cached -= bufferPoolClassSize((uint32)c);
+					}
+				}
+			}
+
+		}
+
+
+	void * Image::_poolAlloc(size_t memsize, uint32 & sizeclass)
+		{
+		size_t classsize;
+		sizeclass = internals_graphics::bufferPoolClass(memsize, classsize);
+		if (sizeclass != 0)
+			{
+			auto & pool = internals_graphics::imageBufferPool();
+			std::lock_guard<std::mutex> lock(pool.mut);
+			auto & L = pool.freelist[sizeclass];
+			if (L.size() > 0)
+				{
+				void * p = L.back();
+				L.pop_back();
+				pool.cached -= classsize;
+				return p;
+				}
+			}
+		return malloc(classsize);
+		}
+
+
+	void Image::_poolFree(void * p, uint32 sizeclass)
+		{
+		const size_t classsize = internals_graphics::bufferPoolClassSize(sizeclass);
+		auto & pool = internals_graphics::imageBufferPool();
+			{
+			std::lock_guard<std::mutex> lock(pool.mut);
+			if (pool.cached + classsize <= pool.maxsize)
+				{
+				pool.freelist[sizeclass].push_back(p);
+				pool.cached += classsize;
+				return;
+				}
+			}
+		free(p);
+		}
+
+
+	void Image::setBufferPoolSize(size_t maxbytes)
+		{
+		auto & pool = internals_graphics::imageBufferPool();
+		std::lock_guard<std::mutex> lock(pool.mut);
+		pool.maxsize = maxbytes;
+		internals_graphics::bufferPoolTrim(pool, maxbytes);
+		if (maxbytes == 0) { for (auto & L : pool.freelist) { std::vector<void *>().swap(L); } }
+		}
+
+
+	size_t Image::bufferPoolSize()
+		{
+		auto & pool = internals_graphics::imageBufferPool();
+		std::lock_guard<std::mutex> lock(pool.mut);
+		return pool.maxsize;
+		}
+
+
+	size_t Image::bufferPoolCached()
+		{
+		auto & pool = internals_graphics::imageBufferPool();
+		std::lock_guard<std::mutex> lock(pool.mut);
+		return pool.cached;
+		}
+
+
 	}
 
 
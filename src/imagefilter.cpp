@@ -0,0 +1,414 @@
+/** @file imagefilter.cpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "graphics/image.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+
+/* SSE2 is always available on x64 (and on x86 when the compiler targets it) */
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+	#define MTOOLS_FILTER_SSE2 1
+	#include <emmintrin.h>
+#endif
+
+
+namespace mtools
+{
+
+	namespace internals_graphics
+	{
+
+		/* width of the tiles of convolve() */
+		static const int64 FILTER_TILE_LX = 256;
+
+		/* minimum height of the tiles of convolve() */
+		static const int64 FILTER_TILE_LY = 64;
+
+		/* width of the column strips for the vertical passes of boxBlur() and gaussianBlur() */
+		static const int64 FILTER_STRIP_LX = 64;
+
+		/* width of the column strips for the vertical pass of the IIR gaussian blur */
+		static const int64 FILTER_IIR_STRIP_LX = 16;
+
+
+		/* the four channels of a pixel as floats (in a SIMD register when available) */
+		struct _F4
+			{
+
+#if (MTOOLS_FILTER_SSE2)
+
+			__m128 v;
+
+			static MTOOLS_FORCEINLINE _F4 zero() { _F4 r; r.v = _mm_setzero_ps(); return r; }
+
+			static MTOOLS_FORCEINLINE _F4 load(RGBc c)
+				{
+				const __m128i z = _mm_setzero_si128();
+				__m128i x = _mm_cvtsi32_si128((int)c.color);
+				x = _mm_unpacklo_epi16(_mm_unpacklo_epi8(x, z), z);
+				_F4 r; r.v = _mm_cvtepi32_ps(x); return r;
+				}
+
+			MTOOLS_FORCEINLINE RGBc store() const
+				{ // round, saturate to [0,255] and make sure the color is premultiplied (R,G,B <= A)
+				__m128i x = _mm_cvtps_epi32(v);
+				x = _mm_packs_epi32(x, x);
+				x = _mm_packus_epi16(x, x);
+				const uint32 c = (uint32)_mm_cvtsi128_si32(x);
+				const uint32 a = c >> 24;
+				return RGBc((uint8)std::min<uint32>((c >> 16) & 255, a), (uint8)std::min<uint32>((c >> 8) & 255, a), (uint8)std::min<uint32>(c & 255, a), (uint8)a);
+				}
+
+			MTOOLS_FORCEINLINE _F4 operator+(const _F4 & o) const { _F4 r; r.v = _mm_add_ps(v, o.v); return r; }
+			MTOOLS_FORCEINLINE _F4 operator-(const _F4 & o) const { _F4 r; r.v = _mm_sub_ps(v, o.v); return r; }
+			MTOOLS_FORCEINLINE _F4 operator*(float f) const { _F4 r; r.v = _mm_mul_ps(v, _mm_set1_ps(f)); return r; }
+			MTOOLS_FORCEINLINE _F4 & operator+=(const _F4 & o) { v = _mm_add_ps(v, o.v); return *this; }
+
+#else
+
+			float v[4];
+
+			static MTOOLS_FORCEINLINE _F4 zero() { _F4 r; for (int k = 0; k < 4; k++) r.v[k] = 0.0f; return r; }
+
+			static MTOOLS_FORCEINLINE _F4 load(RGBc c)
+				{
+				_F4 r; for (int k = 0; k < 4; k++) r.v[k] = (float)((c.color >> (8 * k)) & 255); return r;
+				}
+
+			MTOOLS_FORCEINLINE RGBc store() const
+				{ // round, saturate to [0,255] and make sure the color is premultiplied (R,G,B <= A)
+				uint32 c[4];
+				for (int k = 0; k < 4; k++) { const float f = std::floor(v[k] + 0.5f); c[k] = (f <= 0.0f) ? 0 : ((f >= 255.0f) ? 255 : (uint32)f); }
+				return RGBc((uint8)std::min<uint32>(c[2], c[3]), (uint8)std::min<uint32>(c[1], c[3]), (uint8)std::min<uint32>(c[0], c[3]), (uint8)c[3]);
+				}
+
+			MTOOLS_FORCEINLINE _F4 operator+(const _F4 & o) const { _F4 r; for (int k = 0; k < 4; k++) r.v[k] = v[k] + o.v[k]; return r; }
+			MTOOLS_FORCEINLINE _F4 operator-(const _F4 & o) const { _F4 r; for (int k = 0; k < 4; k++) r.v[k] = v[k] - o.v[k]; return r; }
+			MTOOLS_FORCEINLINE _F4 operator*(float f) const { _F4 r; for (int k = 0; k < 4; k++) r.v[k] = v[k] * f; return r; }
+			MTOOLS_FORCEINLINE _F4 & operator+=(const _F4 & o) { for (int k = 0; k < 4; k++) v[k] += o.v[k]; return *this; }
+
+#endif
+			};
+
+
+		/* clamp an index to [0, l-1] */
+		static MTOOLS_FORCEINLINE int64 _fclamp(int64 i, int64 l) { return ((i < 0) ? 0 : ((i >= l) ? (l - 1) : i)); }
+
+
+		/* convolve the tile [x0,x1[ x [y0,y1[ of src into dst. line and hbuf are work buffers. */
+		static void _convolveTile(const RGBc * src, int64 stride, int64 lx, int64 ly, RGBc * dst, int64 x0, int64 x1, int64 y0, int64 y1,
+		                          const std::vector<float> & kx, const std::vector<float> & ky, std::vector<_F4> & line, std::vector<_F4> & hbuf)
+			{
+			const int64 nkx = (int64)kx.size(), nky = (int64)ky.size();
+			const int64 rx = nkx / 2, ry = nky / 2;
+			const int64 w = x1 - x0;
+			const int64 nrows = (y1 - y0) + nky - 1;
+			line.resize((size_t)(w + nkx - 1));
+			hbuf.resize((size_t)(nrows*w));
+			// horizontal pass on all the lines needed by the tile
+			for (int64 r = 0; r < nrows; r++)
+				{
+				const RGBc * p = src + _fclamp(y0 - ry + r, ly)*stride;
+				for (int64 k = 0; k < w + nkx - 1; k++) { line[(size_t)k] = _F4::load(p[_fclamp(x0 - rx + k, lx)]); }
+				_F4 * h = hbuf.data() + r*w;
+				for (int64 i = 0; i < w; i++)
+					{
+					_F4 acc = _F4::zero();
+					const _F4 * q = line.data() + i;
+					for (int64 k = 0; k < nkx; k++) { acc += q[k] * kx[(size_t)k]; }
+					h[i] = acc;
+					}
+				}
+			// vertical pass
+			for (int64 y = y0; y < y1; y++)
+				{
+				RGBc * d = dst + y*lx;
+				const _F4 * h = hbuf.data() + (y - y0)*w;
+				for (int64 i = 0; i < w; i++)
+					{
+					_F4 acc = _F4::zero();
+					const _F4 * q = h + i;
+					for (int64 k = 0; k < nky; k++) { acc += q[k*w] * ky[(size_t)k]; }
+					d[x0 + i] = acc.store();
+					}
+				}
+			}
+
+
+		/* horizontal box blur of the lines [jmin, jmax[ */
+		static void _boxBlurRows(RGBc * data, int64 stride, int64 lx, int64 rx, int64 jmin, int64 jmax)
+			{
+			const float inv = 1.0f / (float)(2 * rx + 1);
+			std::vector<RGBc> row((size_t)lx);
+			for (int64 j = jmin; j < jmax; j++)
+				{
+				RGBc * p = data + j*stride;
+				std::memcpy(row.data(), p, (size_t)lx*sizeof(RGBc));
+				_F4 sum = _F4::zero(); // the sums are integers < 2^24 so they are exact in float
+				for (int64 k = -rx; k <= rx; k++) { sum += _F4::load(row[(size_t)_fclamp(k, lx)]); }
+				for (int64 i = 0; i < lx; i++)
+					{
+					p[i] = (sum * inv).store();
+					sum += _F4::load(row[(size_t)_fclamp(i + rx + 1, lx)]) - _F4::load(row[(size_t)_fclamp(i - rx, lx)]);
+					}
+				}
+			}
+
+
+		/* vertical box blur of the columns [x0, x1[ */
+		static void _boxBlurColumns(RGBc * data, int64 stride, int64 ly, int64 ry, int64 x0, int64 x1)
+			{
+			const float inv = 1.0f / (float)(2 * ry + 1);
+			const int64 w = x1 - x0;
+			const int64 R = ry + 1;
+			std::vector<_F4> sums((size_t)w, _F4::zero());
+			std::vector<RGBc> first((size_t)w);	// original first line
+			std::vector<RGBc> ring((size_t)(R*w));	// original lines y-ry..y
+			std::memcpy(first.data(), data + x0, (size_t)w*sizeof(RGBc));
+			for (int64 k = -ry; k <= ry; k++)
+				{
+				const RGBc * p = data + _fclamp(k, ly)*stride + x0;
+				for (int64 i = 0; i < w; i++) { sums[(size_t)i] += _F4::load(p[i]); }
+				}
+			for (int64 y = 0; y < ly; y++)
+				{
+				RGBc * p = data + y*stride + x0;
+				RGBc * keep = ring.data() + (y % R)*w;
+				std::memcpy(keep, p, (size_t)w*sizeof(RGBc));
+				for (int64 i = 0; i < w; i++) { p[i] = (sums[(size_t)i] * inv).store(); }
+				if (y == ly - 1) break;
+				const RGBc * add = data + _fclamp(y + ry + 1, ly)*stride + x0;
+				const RGBc * sub = ((y - ry < 0) ? first.data() : (ring.data() + ((y - ry) % R)*w));
+				for (int64 i = 0; i < w; i++) { sums[(size_t)i] += _F4::load(add[i]) - _F4::load(sub[i]); }
+				}
+			}
+
+
+		/* coefficients of the recursive gaussian filter of Young and van Vliet */
+		struct _IIRCoeffs
+			{
+			float B, b1, b2, b3;
+
+			_IIRCoeffs(double sigma)
+				{
+				const double q = (sigma >= 2.5) ? (0.98711*sigma - 0.96330) : (3.97156 - 4.14554*std::sqrt(1.0 - 0.26891*sigma));
+				const double q2 = q*q, q3 = q2*q;
+				const double b0 = 1.57825 + 2.44413*q + 1.4281*q2 + 0.422205*q3;
+				b1 = (float)((2.44413*q + 2.85619*q2 + 1.26661*q3) / b0);
+				b2 = (float)(-(1.4281*q2 + 1.26661*q3) / b0);
+				b3 = (float)((0.422205*q3) / b0);
+				B = 1.0f - (b1 + b2 + b3);
+				}
+			};
+
+
+		/* recursive gaussian filter on a line of n values (forward then backward, in place) */
+		static void _iirLine(_F4 * v, int64 n, const _IIRCoeffs & C)
+			{
+			_F4 w1 = v[0], w2 = v[0], w3 = v[0]; // steady state for a constant line
+			for (int64 i = 0; i < n; i++)
+				{
+				const _F4 w = v[i] * C.B + w1 * C.b1 + w2 * C.b2 + w3 * C.b3;
+				w3 = w2; w2 = w1; w1 = w; v[i] = w;
+				}
+			w1 = v[n - 1]; w2 = v[n - 1]; w3 = v[n - 1];
+			for (int64 i = n - 1; i >= 0; i--)
+				{
+				const _F4 w = v[i] * C.B + w1 * C.b1 + w2 * C.b2 + w3 * C.b3;
+				w3 = w2; w2 = w1; w1 = w; v[i] = w;
+				}
+			}
+
+
+		/* horizontal recursive gaussian filter of the lines [jmin, jmax[ */
+		static void _iirRows(RGBc * data, int64 stride, int64 lx, const _IIRCoeffs & C, int64 jmin, int64 jmax)
+			{
+			std::vector<_F4> v((size_t)lx);
+			for (int64 j = jmin; j < jmax; j++)
+				{
+				RGBc * p = data + j*stride;
+				for (int64 i = 0; i < lx; i++) { v[(size_t)i] = _F4::load(p[i]); }
+				_iirLine(v.data(), lx, C);
+				for (int64 i = 0; i < lx; i++) { p[i] = v[(size_t)i].store(); }
+				}
+			}
+
+
+		/* vertical recursive gaussian filter of the columns [x0, x1[ (processed together, line by line) */
+		static void _iirColumns(RGBc * data, int64 stride, int64 ly, const _IIRCoeffs & C, int64 x0, int64 x1)
+			{
+			const int64 w = x1 - x0;
+			std::vector<_F4> v((size_t)(w*ly));
+			std::vector<_F4> s((size_t)(3 * w));
+			_F4 * w1 = s.data(); _F4 * w2 = w1 + w; _F4 * w3 = w2 + w;
+			for (int64 i = 0; i < w; i++) { w1[i] = w2[i] = w3[i] = _F4::load(data[x0 + i]); }
+			for (int64 y = 0; y < ly; y++)
+				{
+				const RGBc * p = data + y*stride + x0;
+				_F4 * q = v.data() + y*w;
+				for (int64 i = 0; i < w; i++)
+					{
+					const _F4 r = _F4::load(p[i]) * C.B + w1[i] * C.b1 + w2[i] * C.b2 + w3[i] * C.b3;
+					w3[i] = w2[i]; w2[i] = w1[i]; w1[i] = r; q[i] = r;
+					}
+				}
+			const _F4 * last = v.data() + (ly - 1)*w;
+			for (int64 i = 0; i < w; i++) { w1[i] = w2[i] = w3[i] = last[i]; }
+			for (int64 y = ly - 1; y >= 0; y--)
+				{
+				RGBc * p = data + y*stride + x0;
+				const _F4 * q = v.data() + y*w;
+				for (int64 i = 0; i < w; i++)
+					{
+					const _F4 r = q[i] * C.B + w1[i] * C.b1 + w2[i] * C.b2 + w3[i] * C.b3;
+					w3[i] = w2[i]; w2[i] = w1[i]; w1[i] = r;
+					p[i] = r.store();
+					}
+				}
+			}
+
+
+		/* radii of the n box blurs approximating a gaussian blur with standard deviation sigma */
+		static std::vector<int64> _boxesForGauss(double sigma, int n)
+			{
+			std::vector<int64> radii((size_t)n, 0);
+			if (sigma <= 0.0) return radii;
+			const double wideal = std::sqrt(12.0*sigma*sigma / n + 1.0);
+			int64 wl = (int64)std::floor(wideal);
+			if (wl % 2 == 0) wl--;
+			const int64 wu = wl + 2;
+			const double mideal = (12.0*sigma*sigma - n*wl*wl - 4.0*n*wl - 3.0*n) / (-4.0*wl - 4.0);
+			const int64 m = (int64)std::floor(mideal + 0.5);
+			for (int k = 0; k < n; k++) { radii[(size_t)k] = (((k < m) ? wl : wu) - 1) / 2; }
+			return radii;
+			}
+
+	}
+
+
+	void Image::convolve(const std::vector<float> & kernelx, const std::vector<float> & kernely)
+		{
+		using namespace internals_graphics;
+		if ((isEmpty()) || (kernelx.size() == 0) || (kernely.size() == 0)) return;
+		const int64 th = std::max<int64>(FILTER_TILE_LY, 2 * (int64)kernely.size());
+		const int64 ntx = (_lx + FILTER_TILE_LX - 1) / FILTER_TILE_LX;
+		const int64 nty = (_ly + th - 1) / th;
+		std::vector<RGBc> out((size_t)(_lx*_ly));
+		const int64 work = _lx*_ly*(int64)(kernelx.size() + kernely.size());
+		_parallelLines(ntx*nty, work, [&](int64 tmin, int64 tmax)
+			{
+			std::vector<_F4> line, hbuf;
+			for (int64 t = tmin; t < tmax; t++)
+				{
+				const int64 x0 = (t % ntx)*FILTER_TILE_LX, y0 = (t / ntx)*th;
+				_convolveTile(_data, _stride, _lx, _ly, out.data(), x0, std::min<int64>(_lx, x0 + FILTER_TILE_LX), y0, std::min<int64>(_ly, y0 + th), kernelx, kernely, line, hbuf);
+				}
+			});
+		_parallelLines(_ly, _lx*_ly, [&](int64 jmin, int64 jmax)
+			{
+			for (int64 j = jmin; j < jmax; j++) { std::memcpy(_data + j*_stride, out.data() + j*_lx, (size_t)_lx*sizeof(RGBc)); }
+			});
+		}
+
+
+	void Image::boxBlur(int64 rx, int64 ry, int passes)
+		{
+		using namespace internals_graphics;
+		if (isEmpty()) return;
+		rx = std::max<int64>(0, std::min<int64>(rx, _lx));
+		ry = std::max<int64>(0, std::min<int64>(ry, _ly));
+		const int64 nbstrips = (_lx + FILTER_STRIP_LX - 1) / FILTER_STRIP_LX;
+		for (int k = 0; k < passes; k++)
+			{
+			if (rx > 0) { _parallelLines(_ly, _lx*_ly, [&](int64 jmin, int64 jmax) { _boxBlurRows(_data, _stride, _lx, rx, jmin, jmax); }); }
+			if (ry > 0)
+				{
+				_parallelLines(nbstrips, _lx*_ly, [&](int64 smin, int64 smax)
+					{
+					for (int64 s = smin; s < smax; s++) { _boxBlurColumns(_data, _stride, _ly, ry, s*FILTER_STRIP_LX, std::min<int64>(_lx, (s + 1)*FILTER_STRIP_LX)); }
+					});
+				}
+			}
+		}
+
+
+	void Image::gaussianBlur(double sigmax, double sigmay, int method)
+		{
+		using namespace internals_graphics;
+		if (isEmpty()) return;
+		if (sigmax < 0.0) sigmax = 0.0;
+		if (sigmay < 0.0) sigmay = 0.0;
+		if ((sigmax == 0.0) && (sigmay == 0.0)) return;
+		if ((method == GAUSSIAN_IIR) && (((sigmax > 0.0) && (sigmax < 0.5)) || ((sigmay > 0.0) && (sigmay < 0.5)))) { method = GAUSSIAN_CONVOLUTION; } // the recursive filter is only valid for sigma >= 0.5
+		switch (method)
+			{
+			case GAUSSIAN_BOX:
+				{
+				const std::vector<int64> bx = _boxesForGauss(sigmax, 3), by = _boxesForGauss(sigmay, 3);
+				for (int k = 0; k < 3; k++) { boxBlur(bx[(size_t)k], by[(size_t)k], 1); }
+				return;
+				}
+			case GAUSSIAN_IIR:
+				{
+				if (sigmax > 0.0)
+					{
+					const _IIRCoeffs C(sigmax);
+					_parallelLines(_ly, _lx*_ly, [&](int64 jmin, int64 jmax) { _iirRows(_data, _stride, _lx, C, jmin, jmax); });
+					}
+				if (sigmay > 0.0)
+					{
+					const _IIRCoeffs C(sigmay);
+					const int64 nbstrips = (_lx + FILTER_IIR_STRIP_LX - 1) / FILTER_IIR_STRIP_LX;
+					_parallelLines(nbstrips, _lx*_ly, [&](int64 smin, int64 smax)
+						{
+						for (int64 s = smin; s < smax; s++) { _iirColumns(_data, _stride, _ly, C, s*FILTER_IIR_STRIP_LX, std::min<int64>(_lx, (s + 1)*FILTER_IIR_STRIP_LX)); }
+						});
+					}
+				return;
+				}
+			default:
+				{
+				convolve(gaussianKernel(sigmax), gaussianKernel(sigmay));
+				return;
+				}
+			}
+		}
+
+
+	std::vector<float> Image::gaussianKernel(double sigma, double nbsigma)
+		{
+		if (sigma <= 0.0) return std::vector<float>(1, 1.0f);
+		const int64 r = (int64)std::ceil(nbsigma*sigma);
+		std::vector<double> w((size_t)(2 * r + 1));
+		double tot = 0.0;
+		for (int64 i = -r; i <= r; i++) { w[(size_t)(i + r)] = std::exp(-(double)(i*i) / (2.0*sigma*sigma)); tot += w[(size_t)(i + r)]; }
+		std::vector<float> k(w.size());
+		for (size_t i = 0; i < w.size(); i++) { k[i] = (float)(w[i] / tot); }
+		return k;
+		}
+
+
+}
+
+
+/* end of file */
@@ -0,0 +1,147 @@
+/** @file imagesequencewriter.cpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "graphics/imagesequencewriter.hpp"
+#include "misc/error.hpp"
+
+#include <chrono>
+#include <cstdio>
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#define MTOOLS_POPEN_MODE "wb"
+#else
+#define MTOOLS_POPEN_MODE "w"
+#endif
+
+
+namespace mtools
+	{
+
+
+	ImageSequenceWriter::ImageSequenceWriter(int mode, const std::string & target, int compression, int nbThreads, int queueSize, unsigned int digits) :
+		_mode(mode), _target(target), _compression(compression), _digits(digits), _out(nullptr), _rawdim(0, 0),
+		_nbpushed(0), _nbdone(0), _nberrors(0), _stop(false), _queue((size_t)((queueSize > 0) ? queueSize : 1)), _threads()
+		{
+		MTOOLS_INSURE((mode == OUTPUT_PNG) || (mode == OUTPUT_RAW) || (mode == OUTPUT_PIPE));
+		if (_compression < 0) _compression = 0; else if (_compression > 9) _compression = 9;
+		if (mode == OUTPUT_PNG)
+			{
+			if (nbThreads <= 0) nbThreads = (int)nbHardwareThreads();
+			}
+		else
+			{
+			_out = (mode == OUTPUT_RAW) ? fopen(target.c_str(), "wb") : popen(target.c_str(), MTOOLS_POPEN_MODE);
+			if (_out == nullptr) { MTOOLS_ERROR(std::string("ImageSequenceWriter : cannot open [") + target + "]"); }
+			nbThreads = 1; // frames must be written in order
+			}
+		for (int i = 0; i < nbThreads; i++) { _threads.push_back(std::thread(&ImageSequenceWriter::_workerLoop, this)); }
+		}
+
+
+	ImageSequenceWriter::~ImageSequenceWriter()
+		{
+		flush();
+		_stop = true;
+		for (auto & th : _threads) { th.join(); }
+		if (_out != nullptr)
+			{
+			if (_mode == OUTPUT_RAW) fclose(_out); else pclose(_out);
+			}
+		}
+
+
+	int64 ImageSequenceWriter::push(const Image & im)
+		{
+		_Frame * F = new _Frame;
+		F->im = im.get_standalone(); // the caller may draw on im as soon as we return
+		F->nb = _nbpushed++;
+		while (!_queue.push_wait(F, 100)) {}
+		return F->nb;
+		}
+
+
+	void ImageSequenceWriter::flush()
+		{
+		while (_nbdone < _nbpushed) { std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
+		}
+
+
+	void ImageSequenceWriter::_workerLoop()
+		{
+		while (1)
+			{
+			_Frame * F = nullptr;
+			if (!_queue.pop_wait(F, 50))
+				{
+				if (_stop) return; // the queue is empty once _stop is set (cf. dtor)
+				continue;
+				}
+			const bool ok = ((_mode == OUTPUT_PNG) ? _writePNG(*F) : _writeRaw(*F));
+			delete F;
+			if (!ok) _nberrors++;
+			_nbdone++;
+			}
+		}
+
+
+	/* same naming scheme as cimg::number_filename() used by Image::save() */
+	std::string ImageSequenceWriter::_filename(int64 nb) const
+		{
+		std::string num = toString(nb);
+		if (num.size() < _digits) num = std::string(_digits - num.size(), '0') + num;
+		const size_t slash = _target.find_last_of("/\\");
+		const size_t dot = _target.find_last_of('.');
+		if ((dot == std::string::npos) || ((slash != std::string::npos) && (dot < slash))) return _target + "_" + num;
+		return _target.substr(0, dot) + "_" + num + _target.substr(dot);
+		}
+
+
+	bool ImageSequenceWriter::_writeRaw(const _Frame & F)
+		{
+		const Image & im = F.im;
+		if (im.isEmpty()) return false;
+		if (_rawdim == iVec2(0, 0)) { _rawdim = im.dimension(); }
+		if (im.dimension() != _rawdim)
+			{
+			MTOOLS_DEBUG("ImageSequenceWriter : frame with a different size, skipped.");
+			return false;
+			}
+		const size_t lx = (size_t)im.lx();
+		for (int64 j = 0; j < im.ly(); j++)
+			{
+			if (fwrite(im.data() + j*im.stride(), 4, lx, _out) != lx) return false;
+			}
+		return true;
+		}
+
+
+	bool ImageSequenceWriter::_writePNG(const _Frame & F)
+		{
+		return F.im.save_png(_filename(F.nb).c_str(), _compression, false); // frames are already encoded in parallel
+		}
+
+
+	}
+
+
+/* end of file */
+
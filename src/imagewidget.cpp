@@ -20,6 +20,9 @@
 
 #include "graphics/internal/imagewidget.hpp"
 
+#include <cstring>
+#include <algorithm>
+
 
 namespace mtools
 {
@@ -31,7 +34,8 @@ namespace mtools
         ImageWidget::ImageWidget(int X, int Y, int W, int H, const char *l) : 
 			Fl_Window(X, Y, W, H, l), _offbuf((Fl_Offscreen)0), 
 			_ox(0), _oy(0), 
-			_initdraw(false), _saved_im(nullptr), _saved_im32(nullptr)
+			_initdraw(false), _saved_im(nullptr), _saved_im32(nullptr),
+			_shadow(), _shadowok(false)
         {
         }
 
@@ -53,6 +57,7 @@ namespace mtools
                 if (_offbuf != ((Fl_Offscreen)0)) { fl_delete_offscreen((Fl_Offscreen)(_offbuf)); }
                 _offbuf = (Fl_Offscreen)0;
                 _ox = 0; _oy = 0;
+                _shadowok = false;
                 redraw();  
                 return;
                 }
@@ -71,14 +76,45 @@ namespace mtools
                 _offbuf = fl_create_offscreen(nox, noy);
                 _ox = nox; _oy = noy;
                 MTOOLS_ASSERT(_offbuf != ((Fl_Offscreen)0));
+                _shadowok = false;
                 }
             fl_begin_offscreen((Fl_Offscreen)(_offbuf));
-            fl_draw_image(_drawLine_callback, (void*)im, 0, 0, (int)_ox, (int)_oy, 3);
+            if (!_shadowok)
+                { // whole image
+                fl_draw_image(_drawLine_callback, (void*)im, 0, 0, (int)_ox, (int)_oy, 3);
+                _shadow.resizeRaw(nox, noy);
+                _shadow.blit(*im, 0, 0);
+                _shadowok = true;
+                }
+            else
+                { // only the tiles which changed
+                for (int ty = 0; ty < noy; ty += UPLOAD_TILE_SIZE)
+                    {
+                    const int h = std::min<int>(UPLOAD_TILE_SIZE, noy - ty);
+                    for (int tx = 0; tx < nox; tx += UPLOAD_TILE_SIZE)
+                        {
+                        const int w = std::min<int>(UPLOAD_TILE_SIZE, nox - tx);
+                        bool diff = false;
+                        for (int j = ty; (j < ty + h) && (!diff); j++) { diff = (memcmp(im->offset(tx, j), _shadow.offset(tx, j), w*sizeof(RGBc)) != 0); }
+                        if (!diff) continue;
+                        _Tile T = { im, tx, ty };
+                        fl_draw_image(_drawTile_callback, (void*)&T, tx, ty, w, h, 3);
+                        _shadow.blit(*im, tx, ty, tx, ty, w, h);
+                        }
+                    }
+                }
             fl_end_offscreen();
             return;
         }
 
 
+        void ImageWidget::_drawTile_callback(void * data, int x, int y, int w, uchar *buf)
+            { // x, y are relative to the tile
+            const _Tile * T = (const _Tile *)data;
+            _drawLine_callback((void*)T->im, T->x0 + x, T->y0 + y, w, buf);
+            }
+
+
         void ImageWidget::_drawLine_callback(void * data, int x, int y, int w, uchar *buf)
             {
             const Image * im = (const Image *)data;
@@ -104,9 +140,11 @@ namespace mtools
                 if (_offbuf != ((Fl_Offscreen)0)) { fl_delete_offscreen((Fl_Offscreen)(_offbuf)); }
                 _offbuf = (Fl_Offscreen)0;
                 _ox = 0; _oy = 0;
+                _shadowok = false;
                 redraw();
                 return;
                 }
+            _shadowok = false; // the offscreen buffer will not match the shadow image anymore
             if (!_initdraw) // prevent FLTK bug on linux
                 {
                 delete _saved_im; _saved_im = nullptr;
@@ -81,6 +81,30 @@ namespace mtools
             return x*x*(x - 1);
             }
 
+        /* tangents m1, m2 at the ends of the middle segment from the slopes D0, D1, D2 of the 3 segments */
+        inline void _hermiteTangents(const bool monotone, const double D0, const double D1, const double D2, double & m1, double & m2)
+            {
+            m1 = (D0 + D1) / 2;
+            m2 = (D1 + D2) / 2;
+            if (!monotone) return;
+            if ((D0 == 0.0) || (D1 == 0.0)) { m1 = 0.0; } 
+            else
+                {
+                double a1 = (D1 != 0) ? (m1 / D1) : -1.0;
+                if (a1 <= 0.0) { m1 = 0.0; } else { if (a1 > 3.0) { m1 = 3.0 * D1; } }
+                double b0 = (D0 != 0) ? (m1 / D0) : -1.0;
+                if (b0 <= 0.0) { m1 = 0.0; } else { if (b0 > 3.0) { m1 = 3.0 * D0; } }
+                }
+            if ((D1 == 0.0) || (D2 == 0.0)) { m2 = 0.0; }
+            else
+                {
+                double a2 = (D2 != 0) ? (m2 / D2) : -1.0;
+                if (a2 <= 0.0) { m2 = 0.0; } else { if (a2 > 3.0) { m2 = 3.0 * D2; } }
+                double b1 = (D1 != 0) ? (m2 / D1) : -1.0;
+                if (b1 <= 0.0) { m2 = 0.0; } else { if (b1 > 3.0) { m2 = 3.0 * D1; } }
+                }
+            }
+
         inline double _cubicInterpolation(const double x, const fVec2 P1, const fVec2 P2, const double m1, const double m2)
            {
             const double h = P2.X() - P1.X();
@@ -103,9 +127,8 @@ namespace mtools
         const double D0 = (std::isnan(P0.Y())) ? D1 : (P1.Y() - P0.Y()) / (P1.X() - P0.X());
         const double D2 = (std::isnan(P3.Y())) ? D1 : (P3.Y() - P2.Y()) / (P3.X() - P2.X());
 
-        const double m1 = (D0 + D1) / 2;
-        const double m2 = (D1 + D2) / 2;
-
+        double m1, m2;
+        internals_graphics::_hermiteTangents(false, D0, D1, D2, m1, m2);
         return internals_graphics::_cubicInterpolation(x, P1, P2, m1, m2);
         }
 
@@ -139,27 +162,8 @@ namespace mtools
         const double D0 = (std::isnan(P0.Y())) ? D1 : (P1.Y() - P0.Y()) / (P1.X() - P0.X());
         const double D2 = (std::isnan(P3.Y())) ? D1 : (P3.Y() - P2.Y()) / (P3.X() - P2.X());
 
-        double m1 = (D0 + D1) / 2;
-        double m2 = (D1 + D2) / 2;
-
-        if ((D0 == 0.0) || (D1 == 0.0)) { m1 = 0.0; } 
-        else
-            {
-            double a1 = (D1 != 0) ? (m1 / D1) : -1.0;
-            if (a1 <= 0.0) { m1 = 0.0; } else { if (a1 > 3.0) { m1 = 3.0 * D1; } }
-            double b0 = (D0 != 0) ? (m1 / D0) : -1.0;
-            if (b0 <= 0.0) { m1 = 0.0; } else { if (b0 > 3.0) { m1 = 3.0 * D0; } }
-            }
-
-        if ((D1 == 0.0) || (D2 == 0.0)) { m2 = 0.0; }
-        else
-            {
-            double a2 = (D2 != 0) ? (m2 / D2) : -1.0;
-            if (a2 <= 0.0) { m2 = 0.0; } else { if (a2 > 3.0) { m2 = 3.0 * D2; } }
-            double b1 = (D1 != 0) ? (m2 / D1) : -1.0;
-            if (b1 <= 0.0) { m2 = 0.0; } else { if (b1 > 3.0) { m2 = 3.0 * D1; } }
-            }
-
+        double m1, m2;
+        internals_graphics::_hermiteTangents(true, D0, D1, D2, m1, m2);
         return internals_graphics::_cubicInterpolation(x, P1, P2, m1, m2);
     }
 
@@ -183,6 +187,53 @@ namespace mtools
 
 
 
+    void Interpolator::eval(const double * x, double * y, size_t n) const
+        {
+        size_t hint = 0;
+        for (size_t k = 0; k < n; k++) { y[k] = operator()(x[k], hint); }
+        }
+
+
+    double Interpolator::_evalSpecial(size_t i, double x) const
+        {
+        const fVec2 P1(_x[i], _y[i]), P2(_x[i + 1], _y[i + 1]);
+        if (_type == LINEAR) return linearInterpolation(x, P1, P2);
+        const fVec2 P0 = (i > 0) ? fVec2(_x[i - 1], _y[i - 1]) : fVec2(_x[i] - 1.0, mtools::NaN);
+        const fVec2 P3 = (i + 2 < _x.size()) ? fVec2(_x[i + 2], _y[i + 2]) : fVec2(_x[i + 1] + 1.0, mtools::NaN);
+        if (_type == CUBIC) return cubicInterpolation(x, P0, P1, P2, P3);
+        return monotoneCubicInterpolation(x, P0, P1, P2, P3);
+        }
+
+
+    void Interpolator::_compute()
+        {
+        MTOOLS_INSURE((_type >= STEP) && (_type <= MONOTONE_CUBIC));
+        MTOOLS_INSURE(_x.size() == _y.size());
+        const size_t n = _x.size();
+        _c.assign((n > 1) ? (3 * (n - 1)) : 0, 0.0);
+        if ((n < 2) || (_type == STEP)) return;
+        for (size_t i = 0; i + 1 < n; i++) { MTOOLS_ASSERT(_x[i] < _x[i + 1]); }
+        for (size_t i = 0; i + 1 < n; i++)
+            {
+            double * c = _c.data() + 3 * i;
+            const double h = _x[i + 1] - _x[i];
+            const double D1 = (_y[i + 1] - _y[i]) / h;
+            double m1 = D1, m2 = D1;
+            if (_type == LINEAR) { c[0] = D1; c[1] = 0.0; c[2] = 0.0; }
+            else
+                {
+                const double D0 = (i > 0) ? ((_y[i] - _y[i - 1]) / (_x[i] - _x[i - 1])) : D1;
+                const double D2 = (i + 2 < n) ? ((_y[i + 2] - _y[i + 1]) / (_x[i + 2] - _x[i + 1])) : D1;
+                internals_graphics::_hermiteTangents(_type == MONOTONE_CUBIC, D0, D1, D2, m1, m2);
+                c[0] = m1;
+                c[1] = (3 * D1 - 2 * m1 - m2) / h;
+                c[2] = (m1 + m2 - 2 * D1) / (h*h);
+                }
+            if ((!std::isfinite(_y[i])) || (!std::isfinite(c[0])) || (!std::isfinite(c[1])) || (!std::isfinite(c[2]))) { c[2] = mtools::NaN; } // use the 4 points functions
+            }
+        }
+
+
 }
 
 /* end of file */
@@ -21,6 +21,14 @@
 #include "io/logfile.hpp"
 #include "misc/stringfct.hpp"
 
+#include <vector>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
+#include <cstring>
+#include <ctime>
 
 
 
@@ -33,14 +41,240 @@ namespace mtools
 {
 
 
-        LogFile::LogFile(const std::string & fname, bool append, bool writeheader, bool delayfilecreation, StringEncoding wenc) : _m_filename(fname), _m_wenc(wenc), _m_log(nullptr), _append(append), _header(writeheader)
+        namespace internals_logfile
+            {
+
+            static std::atomic<bool> writerGone(false);   // set when the writer is destroyed (exit)
+
+
+            /* single producer (the owning thread) / single consumer (the writer thread) ring buffer of
+             * messages. A message is [uint32 length][uint32 padding][uint64 id][bytes] */
+            struct Ring
+                {
+                static const size_t SIZE = (1 << 20);   // 1MB per thread
+                static const size_t HEAD = 16;
+
+                Ring() : buf(SIZE), head(0), tail(0), dead(false) {}
+
+                void copyIn(size_t pos, const char * p, size_t len)
+                    {
+                    pos &= (SIZE - 1);
+                    const size_t a = ((pos + len <= SIZE) ? len : (SIZE - pos));
+                    std::memcpy(buf.data() + pos, p, a);
+                    if (a < len) std::memcpy(buf.data(), p + a, len - a);
+                    }
+
+                void copyOut(size_t pos, char * p, size_t len) const
+                    {
+                    pos &= (SIZE - 1);
+                    const size_t a = ((pos + len <= SIZE) ? len : (SIZE - pos));
+                    std::memcpy(p, buf.data() + pos, a);
+                    if (a < len) std::memcpy(p + a, buf.data(), len - a);
+                    }
+
+                /* push a message, return false if it does not fit. Set half to true if the ring
+                 * becomes half full */
+                bool push(uint64 id, const std::string & s, bool & half)
+                    {
+                    const size_t need = HEAD + s.size();
+                    const size_t h = head.load(std::memory_order_relaxed);
+                    const size_t t = tail.load(std::memory_order_acquire);
+                    if (SIZE - (h - t) < need) return false;
+                    half = ((h - t < SIZE / 2) && (h - t + need >= SIZE / 2));
+                    char hd[HEAD];
+                    const uint32 len = (uint32)s.size();
+                    std::memset(hd, 0, HEAD);
+                    std::memcpy(hd, &len, sizeof(len));
+                    std::memcpy(hd + 8, &id, sizeof(id));
+                    copyIn(h, hd, HEAD);
+                    copyIn(h + HEAD, s.data(), s.size());
+                    head.store(h + need, std::memory_order_release);
+                    return true;
+                    }
+
+                std::vector<char> buf;
+                std::atomic<size_t> head;       // written by the producer
+                std::atomic<size_t> tail;       // written by the consumer
+                std::atomic<bool> dead;         // set when the owning thread exits
+                };
+
+
+            /* background thread writing the messages of the log files in asynchronous mode */
+            class AsyncWriter
+                {
+
+                public:
+
+                    static AsyncWriter & get() { static AsyncWriter W; return W; }
+
+                    void add(LogFile * lf)
+                        {
+                        std::lock_guard<std::mutex> lock(_mut);
+                        lf->_id = ++_lastid;
+                        _files[lf->_id] = lf;
+                        if (!_th.joinable()) { _th = std::thread(&AsyncWriter::_run, this); }
+                        }
+
+                    void remove(LogFile * lf)
+                        {
+                        flush();
+                        std::lock_guard<std::mutex> lock(_mut);
+                        _files.erase(lf->_id);
+                        }
+
+                    /* wait until all the messages pushed before the call are written */
+                    void flush()
+                        {
+                        std::unique_lock<std::mutex> lock(_mut);
+                        if (!_th.joinable()) return;
+                        const uint64 target = ++_reqgen;
+                        _cv.notify_all();
+                        _cvdone.wait(lock, [&] { return ((_donegen >= target) || (_stop)); });
+                        }
+
+                    /* push a message for the file id from the calling thread */
+                    bool push(uint64 id, const std::string & s)
+                        {
+                        bool half = false;
+                        if (!ring()->push(id, s, half)) return false;
+                        if (half) _cv.notify_one(); // wake up the writer early
+                        return true;
+                        }
+
+                    Ring * ring()
+                        {
+                        struct Holder
+                            {
+                            Ring * r = nullptr;
+                            ~Holder() { if (r) r->dead = true; }
+                            };
+                        static thread_local Holder H;
+                        if (H.r == nullptr)
+                            {
+                            H.r = new Ring();
+                            std::lock_guard<std::mutex> lock(_mut);
+                            _rings.push_back(H.r);
+                            }
+                        return H.r;
+                        }
+
+                    ~AsyncWriter()
+                        {
+                        {
+                        std::lock_guard<std::mutex> lock(_mut);
+                        _stop = true;
+                        _cv.notify_all();
+                        }
+                        if (_th.joinable()) _th.join();
+                        writerGone = true;
+                        }
+
+                private:
+
+                    AsyncWriter() : _lastid(0), _reqgen(0), _donegen(0), _stop(false) {}
+
+                    /* drain all the rings and write the messages in batches */
+                    void _pass()
+                        {
+                        std::map<uint64, std::string> out;
+                        uint64 lastid = 0;
+                        std::string * S = nullptr;
+                        for (size_t k = 0; k < _rings.size(); k++)
+                            {
+                            Ring * R = _rings[k];
+                            const bool dead = R->dead.load();
+                            size_t t = R->tail.load(std::memory_order_relaxed);
+                            const size_t h = R->head.load(std::memory_order_acquire);
+                            while (t < h)
+                                {
+                                char hd[Ring::HEAD];
+                                R->copyOut(t, hd, Ring::HEAD);
+                                uint32 len; uint64 id;
+                                std::memcpy(&len, hd, sizeof(len));
+                                std::memcpy(&id, hd + 8, sizeof(id));
+                                if ((S == nullptr) || (id != lastid)) { S = &out[id]; lastid = id; }
+                                const size_t off = S->size();
+                                S->resize(off + len);
+                                R->copyOut(t + Ring::HEAD, &((*S)[off]), len);
+                                t += Ring::HEAD + len;
+                                }
+                            R->tail.store(t, std::memory_order_release);
+                            if (dead) { delete R; _rings[k] = _rings.back(); _rings.pop_back(); k--; } // thread exited and ring empty
+                            }
+                        for (auto & m : out)
+                            { // files removed meanwhile are ignored
+                            auto it = _files.find(m.first);
+                            if ((it == _files.end()) || (it->second->_m_log == nullptr)) continue;
+                            std::ofstream & f = *(it->second->_m_log);
+                            f.write(m.second.data(), m.second.size());
+                            f.flush();
+                            }
+                        }
+
+                    void _run()
+                        {
+                        std::unique_lock<std::mutex> lock(_mut);
+                        while (1)
+                            {
+                            const uint64 gen = _reqgen; // the pass below contains every message pushed before this request
+                            _pass();
+                            _donegen = gen;
+                            _cvdone.notify_all();
+                            if (_stop) return;
+                            if (_reqgen > _donegen) continue;
+                            _cv.wait_for(lock, std::chrono::milliseconds(20));
+                            }
+                        }
+
+                    std::mutex _mut;
+                    std::condition_variable _cv;
+                    std::condition_variable _cvdone;
+                    std::thread _th;
+                    std::vector<Ring *> _rings;
+                    std::map<uint64, LogFile *> _files;
+                    uint64 _lastid;
+                    uint64 _reqgen, _donegen;
+                    bool _stop;
+                };
+
+            }
+
+
+        LogFile::LogFile(const std::string & fname, bool append, bool writeheader, bool delayfilecreation, StringEncoding wenc) : _m_filename(fname), _m_wenc(wenc), _m_log(nullptr), _append(append), _header(writeheader), _async(false), _dropped(0), _id(0)
             {
             if (!delayfilecreation) { _openfile(); }
             return;
             }
 
 
-        LogFile::~LogFile() { delete _m_log; }
+        LogFile::~LogFile() 
+            { 
+            setAsync(false);
+            delete _m_log; 
+            }
+
+
+        void LogFile::setAsync(bool status)
+            {
+            if (status == _async) return;
+            if (internals_logfile::writerGone) { _async = false; return; }
+            if (status) { internals_logfile::AsyncWriter::get().add(this); _async = true; }
+            else { _async = false; internals_logfile::AsyncWriter::get().remove(this); }
+            }
+
+
+        void LogFile::flush()
+            {
+            if ((!_async) || (internals_logfile::writerGone)) return;
+            internals_logfile::AsyncWriter::get().flush();
+            }
+
+
+        void LogFile::_pushAsync(const std::string & s)
+            {
+            if (internals_logfile::writerGone) { (*_m_log) << s; (*_m_log).flush(); return; } // exiting: write directly
+            if (!internals_logfile::AsyncWriter::get().push(_id, s)) { _dropped++; }
+            }
 
 
         void LogFile::_openfile()
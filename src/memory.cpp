@@ -0,0 +1,348 @@
+/** @file memory.cpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "misc/stringfct.hpp"
+#include "misc/memory.hpp"
+
+#include <new>
+#include <cstdio>
+
+#if defined(__linux__) || defined(__APPLE__) || defined(__unix__)
+#define MTOOLS_HAS_MMAP 1
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#else
+#define MTOOLS_HAS_MMAP 0
+#endif
+
+#if defined (_MSC_VER)
+#include <windows.h>
+#endif
+
+
+namespace mtools
+{
+
+	namespace internals_memory
+	{
+
+
+		MappedFileStore::MappedFileStore(const std::string & filename, size_t maxResident) : _filename(filename), _fd(-1), _filesize(0), _maxResident(maxResident), _dropped(0), _resident(0)
+			{
+			#if (MTOOLS_HAS_MMAP)
+			_fd = ::open(_filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+			if (_fd < 0) { MTOOLS_ERROR(std::string("MappedFileStore: cannot create backing file [") + _filename + "]"); }
+			#else
+			MTOOLS_DEBUG("MappedFileStore: memory mapped files not supported on this platform, using std::malloc() instead.");
+			#endif
+			}
+
+
+		MappedFileStore::~MappedFileStore()
+			{
+			releaseAll();
+			#if (MTOOLS_HAS_MMAP)
+			if (_fd >= 0) { ::close(_fd); std::remove(_filename.c_str()); }
+			#endif
+			}
+
+
+		void * MappedFileStore::allocate(size_t size)
+			{
+			#if (MTOOLS_HAS_MMAP)
+			const size_t ps = (size_t)::sysconf(_SC_PAGESIZE);
+			const size_t len = ((size + ps - 1) / ps)*ps;
+			if (::ftruncate(_fd, (off_t)(_filesize + len)) != 0) { MTOOLS_DEBUG("MappedFileStore: cannot extend the backing file"); throw std::bad_alloc(); }
+			void * p = ::mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, (off_t)_filesize);
+			if (p == MAP_FAILED) { MTOOLS_DEBUG("MappedFileStore: mmap() failed"); throw std::bad_alloc(); }
+			_regions.push_back({ p, len, _filesize });
+			_filesize += len;
+			_resident += len;
+			trim();
+			return p;
+			#else
+			void * p = std::malloc(size);
+			if (p == nullptr) { throw std::bad_alloc(); }
+			_regions.push_back({ p, size, 0 });
+			return p;
+			#endif
+			}
+
+
+		void MappedFileStore::releaseAll()
+			{
+			#if (MTOOLS_HAS_MMAP)
+			for (auto & r : _regions) { ::munmap(r.p, r.len); }
+			if (_fd >= 0) { if (::ftruncate(_fd, 0) != 0) { MTOOLS_DEBUG("MappedFileStore: cannot truncate the backing file"); } }
+			#else
+			for (auto & r : _regions) { std::free(r.p); }
+			#endif
+			_regions.clear();
+			_filesize = 0;
+			_dropped = 0;
+			_resident = 0;
+			}
+
+
+		void MappedFileStore::trim()
+			{
+			#if (MTOOLS_HAS_MMAP)
+			if (_maxResident == 0) return;
+			while ((_resident > _maxResident) && (_dropped + 1 < _regions.size())) // the most recent region is always kept
+				{ // write back and drop the oldest region still resident. It is reloaded by page fault when accessed again.
+				_region & r = _regions[_dropped];
+				::msync(r.p, r.len, MS_SYNC);
+				::madvise(r.p, r.len, MADV_DONTNEED);
+				#if defined(__linux__)
+				::posix_fadvise(_fd, (off_t)r.off, (off_t)r.len, POSIX_FADV_DONTNEED);
+				#endif
+				_resident -= r.len;
+				_dropped++;
+				}
+			#endif
+			}
+
+
+		HugePageStore::HugePageStore(size_t pageSize, size_t reserve) : _pageSize(4096), _reserveSize(0), _committed(0), _hugetlb(-1)
+			{
+			#if (MTOOLS_HAS_MMAP)
+			_pageSize = (size_t)::sysconf(_SC_PAGESIZE);
+			#endif
+			while (_pageSize < pageSize) { _pageSize *= 2; }
+			_reserveSize = ((reserve + _pageSize - 1) / _pageSize)*_pageSize;
+			if (_reserveSize == 0) _reserveSize = _pageSize;
+			}
+
+
+		HugePageStore::~HugePageStore()
+			{
+			releaseAll();
+			#if (MTOOLS_HAS_MMAP)
+			for (auto & r : _ranges) { ::munmap(r.base, r.len); }
+			#endif
+			_ranges.clear();
+			}
+
+
+		void * HugePageStore::allocate(size_t size)
+			{
+			size = ((size + 63) / 64) * 64;
+			#if (MTOOLS_HAS_MMAP)
+			if ((_ranges.size() == 0) || (_ranges.back().used + size > _ranges.back().len)) { _reserve(size); }
+			_range & r = _ranges.back();
+			char * p = r.base + r.used;
+			r.used += size;
+			if (r.used > r.com)
+				{ // commit the pages needed
+				const size_t com = ((r.used + _pageSize - 1) / _pageSize)*_pageSize;
+				_commit(r.base + r.com, com - r.com);
+				_committed += com - r.com;
+				r.com = com;
+				}
+			return p;
+			#else
+			void * p = std::malloc(size);
+			if (p == nullptr) { throw std::bad_alloc(); }
+			_blocks.push_back(p);
+			_committed += size;
+			return p;
+			#endif
+			}
+
+
+		void HugePageStore::releaseAll()
+			{
+			#if (MTOOLS_HAS_MMAP)
+			for (size_t i = 0; i < _ranges.size(); i++)
+				{
+				_range & r = _ranges[i];
+				if (i > 0) { ::munmap(r.base, r.len); continue; }
+				if (r.com > 0)
+					{ // replace the committed part by a fresh reservation: the pages are returned to the OS
+					void * q = ::mmap(r.base, r.com, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+					if (q == MAP_FAILED) { MTOOLS_DEBUG("HugePageStore: cannot release the memory"); }
+					}
+				r.used = 0;
+				r.com = 0;
+				}
+			if (_ranges.size() > 1) { _ranges.resize(1); }
+			#else
+			for (auto p : _blocks) { std::free(p); }
+			_blocks.clear();
+			#endif
+			_committed = 0;
+			}
+
+
+		void HugePageStore::_reserve(size_t len)
+			{
+			#if (MTOOLS_HAS_MMAP)
+			size_t rlen = _reserveSize;
+			if (rlen < len) { rlen = ((len + _pageSize - 1) / _pageSize)*_pageSize; }
+			void * q = MAP_FAILED;
+			while (1)
+				{ // reserve a little more than needed so the range can be aligned on a huge page
+				q = ::mmap(nullptr, rlen + _pageSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+				if (q != MAP_FAILED) break;
+				if ((rlen / 2 < len) || (rlen / 2 < _pageSize)) { MTOOLS_DEBUG("HugePageStore: cannot reserve the address space"); throw std::bad_alloc(); }
+				rlen = ((rlen / 2 + _pageSize - 1) / _pageSize)*_pageSize; // address space may be scarce (32 bits): try smaller
+				}
+			const uintptr_t a = (uintptr_t)q;
+			const uintptr_t b = ((a + _pageSize - 1) / _pageSize)*_pageSize;
+			if (b > a) { ::munmap(q, b - a); }
+			if (b + rlen < a + rlen + _pageSize) { ::munmap((void*)(b + rlen), (a + rlen + _pageSize) - (b + rlen)); }
+			_ranges.push_back({ (char*)b, rlen, 0, 0 });
+			#else
+			(void)len;
+			#endif
+			}
+
+
+		void HugePageStore::_commit(char * p, size_t len)
+			{
+			#if (MTOOLS_HAS_MMAP)
+			void * q = MAP_FAILED;
+			#if defined(__linux__) && defined(MAP_HUGETLB)
+			if ((_hugetlb != 0) && (_pageSize > (size_t)::sysconf(_SC_PAGESIZE)))
+				{ // try explicit huge pages
+				int lg = 0;
+				while ((((size_t)1) << lg) < _pageSize) { lg++; }
+				q = ::mmap(p, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_HUGETLB | (lg << 26), -1, 0); // 26 = MAP_HUGE_SHIFT: select the page size
+				_hugetlb = (q == MAP_FAILED) ? 0 : 1;
+				}
+			#endif
+			if (q == MAP_FAILED)
+				{ // regular pages, marked for transparent huge pages
+				q = ::mmap(p, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+				if (q == MAP_FAILED) { MTOOLS_DEBUG("HugePageStore: mmap() failed"); throw std::bad_alloc(); }
+				#if defined(MADV_HUGEPAGE)
+				::madvise(p, len, MADV_HUGEPAGE);
+				#endif
+				}
+			#else
+			(void)p; (void)len;
+			#endif
+			}
+
+	}
+
+
+	MappedFile::MappedFile() : _filename(), _p(nullptr), _size(0), _open(false), _handle(nullptr)
+		{
+		}
+
+
+	MappedFile::MappedFile(const std::string & filename) : _filename(), _p(nullptr), _size(0), _open(false), _handle(nullptr)
+		{
+		open(filename);
+		}
+
+
+	MappedFile::~MappedFile()
+		{
+		close();
+		}
+
+
+	bool MappedFile::open(const std::string & filename)
+		{
+		close();
+		#if defined (_MSC_VER)
+		HANDLE hf = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (hf == INVALID_HANDLE_VALUE) return false;
+		LARGE_INTEGER sz;
+		if (!GetFileSizeEx(hf, &sz)) { CloseHandle(hf); return false; }
+		if (sz.QuadPart > 0)
+			{
+			HANDLE hm = CreateFileMappingA(hf, NULL, PAGE_READONLY, 0, 0, NULL);
+			CloseHandle(hf); // the mapping keeps the file open
+			if (hm == NULL) return false;
+			_p = (const char *)MapViewOfFile(hm, FILE_MAP_READ, 0, 0, 0);
+			if (_p == nullptr) { MTOOLS_DEBUG(std::string("MappedFile: MapViewOfFile() failed for [") + filename + "]"); CloseHandle(hm); return false; }
+			_handle = (void*)hm;
+			_size = (size_t)sz.QuadPart;
+			}
+		else { CloseHandle(hf); }
+		#elif (MTOOLS_HAS_MMAP)
+		int fd = ::open(filename.c_str(), O_RDONLY);
+		if (fd < 0) return false;
+		struct stat st;
+		if ((::fstat(fd, &st) != 0) || (!S_ISREG(st.st_mode))) { ::close(fd); return false; }
+		if (st.st_size > 0)
+			{
+			void * p = ::mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+			::close(fd); // the mapping keeps a reference to the file
+			if (p == MAP_FAILED) { MTOOLS_DEBUG(std::string("MappedFile: mmap() failed for [") + filename + "]"); return false; }
+			_p = (const char *)p;
+			_size = (size_t)st.st_size;
+			}
+		else { ::close(fd); }
+		#else
+		std::FILE * f = std::fopen(filename.c_str(), "rb");
+		if (f == nullptr) return false;
+		std::fseek(f, 0, SEEK_END);
+		long len = std::ftell(f);
+		std::fseek(f, 0, SEEK_SET);
+		if (len < 0) { std::fclose(f); return false; }
+		if (len > 0)
+			{
+			void * p = std::malloc((size_t)len);
+			if ((p == nullptr) || (std::fread(p, 1, (size_t)len, f) != (size_t)len)) { std::free(p); std::fclose(f); return false; }
+			_p = (const char *)p;
+			_size = (size_t)len;
+			}
+		std::fclose(f);
+		#endif
+		_filename = filename;
+		_open = true;
+		return true;
+		}
+
+
+	void MappedFile::close()
+		{
+		if (_p != nullptr)
+			{
+			#if defined (_MSC_VER)
+			UnmapViewOfFile((LPCVOID)_p);
+			#elif (MTOOLS_HAS_MMAP)
+			::munmap((void*)_p, _size);
+			#else
+			std::free((void*)_p);
+			#endif
+			}
+		#if defined (_MSC_VER)
+		if (_handle != nullptr) { CloseHandle((HANDLE)_handle); }
+		#endif
+		_filename.clear();
+		_p = nullptr;
+		_size = 0;
+		_open = false;
+		_handle = nullptr;
+		}
+
+
+}
+
+
+/* end of file */
@@ -0,0 +1,297 @@
+/** @file metrics.cpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "io/metrics.hpp"
+#include "misc/stringfct.hpp"
+#include "misc/error.hpp"
+
+#include <chrono>
+#include <cstdio>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef int socklen_t;
+#define MTOOLS_CLOSESOCKET closesocket
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <unistd.h>
+#define MTOOLS_CLOSESOCKET close
+#endif
+
+
+namespace mtools
+    {
+
+
+    namespace internals_metrics
+        {
+
+        /* initialize the socket library (windows only) */
+        bool socketInit()
+            {
+#ifdef _WIN32
+            static bool ok = []() { WSADATA w; return (WSAStartup(MAKEWORD(2, 2), &w) == 0); }();
+            return ok;
+#else
+            return true;
+#endif
+            }
+
+
+        /* value of a slot as a string */
+        std::string valueStr(uint64 v, int kind)
+            {
+            char buf[64];
+            if (kind == MetricsChannel::KIND_DOUBLE) { double d; std::memcpy(&d, &v, sizeof(d)); std::snprintf(buf, sizeof(buf), "%.17g", d); }
+            else if (kind == MetricsChannel::KIND_UINT) { std::snprintf(buf, sizeof(buf), "%llu", (unsigned long long)v); }
+            else { std::snprintf(buf, sizeof(buf), "%lld", (long long)((int64)v)); }
+            return std::string(buf);
+            }
+
+
+        /* value of a slot as a double */
+        double valueDouble(uint64 v, int kind)
+            {
+            if (kind == MetricsChannel::KIND_DOUBLE) { double d; std::memcpy(&d, &v, sizeof(d)); return d; }
+            if (kind == MetricsChannel::KIND_UINT) return (double)v;
+            return (double)((int64)v);
+            }
+
+
+        /* replace the characters not allowed in a metric name by '_' */
+        std::string sanitize(const std::string & name)
+            {
+            std::string r(name);
+            for (size_t i = 0; i < r.size(); i++)
+                {
+                const char c = r[i];
+                if (!(((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z')) || ((c >= '0') && (c <= '9') && (i > 0)) || (c == '_') || (c == ':'))) r[i] = '_';
+                }
+            return r;
+            }
+
+        }
+
+
+    MetricsChannel::MetricsChannel(size_t tick, size_t capacity) : _tick(tick), _count(0), _capacity(capacity), _nbpublished(0), _buf(new std::atomic<uint64>[capacity]), _seq(0), _nbpub(0), _stop(false)
+        {
+        for (size_t i = 0; i < _capacity; i++) { _buf[i] = 0; }
+        }
+
+
+    MetricsChannel::~MetricsChannel()
+        {
+        stopExport();
+        }
+
+
+    size_t MetricsChannel::_add(const std::string & name, int kind, EncodeFun fun, const void * var)
+        {
+        MTOOLS_INSURE(_slots.size() < _capacity);
+        _slots.push_back({ name, kind, fun, var });
+        return _slots.size() - 1;
+        }
+
+
+    void MetricsChannel::publishNow()
+        {
+        _count = 0;
+        if (_nbpublished != _slots.size())
+            { // new metrics were added: update the list of names (rare)
+            std::lock_guard<std::mutex> lock(_namesmut);
+            for (size_t i = _nbpublished; i < _slots.size(); i++) { _names.push_back(std::pair<std::string, int>(_slots[i].name, _slots[i].kind)); }
+            _nbpublished = _slots.size();
+            }
+        const uint64 s = _seq.load(std::memory_order_relaxed);
+        _seq.store(s + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t i = 0; i < _nbpublished; i++) { _buf[i].store(_slots[i].encode(_slots[i].var), std::memory_order_relaxed); }
+        _seq.store(s + 2, std::memory_order_release);
+        _nbpub.fetch_add(1, std::memory_order_relaxed);
+        }
+
+
+    void MetricsChannel::_read(std::vector<std::pair<std::string, int> > & names, std::vector<uint64> & raw) const
+        {
+        std::lock_guard<std::mutex> lock(_namesmut);
+        const size_t n = _names.size();
+        raw.resize(n);
+        while (1)
+            {
+            const uint64 s1 = _seq.load(std::memory_order_acquire);
+            if (s1 & 1) { std::this_thread::yield(); continue; } // the writer is copying
+            for (size_t i = 0; i < n; i++) { raw[i] = _buf[i].load(std::memory_order_relaxed); }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (_seq.load(std::memory_order_relaxed) == s1) break;
+            }
+        names = _names;
+        }
+
+
+    void MetricsChannel::snapshot(std::vector<std::string> & names, std::vector<double> & values) const
+        {
+        std::vector<std::pair<std::string, int> > nk;
+        std::vector<uint64> raw;
+        _read(nk, raw);
+        names.resize(raw.size());
+        values.resize(raw.size());
+        for (size_t i = 0; i < raw.size(); i++) { names[i] = nk[i].first; values[i] = internals_metrics::valueDouble(raw[i], nk[i].second); }
+        }
+
+
+    std::string MetricsChannel::toString() const
+        {
+        std::vector<std::pair<std::string, int> > nk;
+        std::vector<uint64> raw;
+        _read(nk, raw);
+        std::string s;
+        for (size_t i = 0; i < raw.size(); i++) { s += nk[i].first + " = " + internals_metrics::valueStr(raw[i], nk[i].second) + "\n"; }
+        return s;
+        }
+
+
+    std::string MetricsChannel::toPrometheus(const std::string & prefix) const
+        {
+        std::vector<std::pair<std::string, int> > nk;
+        std::vector<uint64> raw;
+        _read(nk, raw);
+        std::string s;
+        for (size_t i = 0; i < raw.size(); i++)
+            {
+            const std::string n = internals_metrics::sanitize(prefix + nk[i].first);
+            s += "# TYPE " + n + " gauge\n" + n + " " + internals_metrics::valueStr(raw[i], nk[i].second) + "\n";
+            }
+        return s;
+        }
+
+
+    bool MetricsChannel::serveHTTP(int port)
+        {
+        if (!internals_metrics::socketInit()) return false;
+        auto sock = ::socket(AF_INET, SOCK_STREAM, 0);
+        if ((intptr_t)sock < 0) return false;
+        int yes = 1;
+        ::setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (const char *)&yes, sizeof(yes));
+        sockaddr_in addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons((unsigned short)port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if ((::bind(sock, (sockaddr *)&addr, sizeof(addr)) != 0) || (::listen(sock, 4) != 0)) { MTOOLS_CLOSESOCKET(sock); return false; }
+        _stop = false;
+        _sockets.push_back((intptr_t)sock);
+        _threads.push_back(std::thread(&MetricsChannel::_httpLoop, this, (intptr_t)sock));
+        return true;
+        }
+
+
+    void MetricsChannel::_httpLoop(intptr_t sock)
+        {
+        while (!_stop)
+            {
+            fd_set set;
+            FD_ZERO(&set);
+            FD_SET(sock, &set);
+            timeval tv; tv.tv_sec = 0; tv.tv_usec = 200000; // wake up regularly to check _stop
+            if (::select((int)sock + 1, &set, nullptr, nullptr, &tv) <= 0) continue;
+            auto c = ::accept(sock, nullptr, nullptr);
+            if ((intptr_t)c < 0) continue;
+            char req[1024];
+            ::recv(c, req, sizeof(req), 0); // the request itself is ignored
+            const std::string body = toPrometheus();
+            const std::string rep = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " + mtools::toString(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+            size_t off = 0;
+            while (off < rep.size()) { const auto k = ::send(c, rep.data() + off, (int)(rep.size() - off), 0); if (k <= 0) break; off += (size_t)k; }
+            MTOOLS_CLOSESOCKET(c);
+            }
+        }
+
+
+    bool MetricsChannel::sendUDP(const std::string & host, int port, int intervalms)
+        {
+        if (!internals_metrics::socketInit()) return false;
+        addrinfo hints, * res = nullptr;
+        std::memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_DGRAM;
+        if ((::getaddrinfo(host.c_str(), mtools::toString(port).c_str(), &hints, &res) != 0) || (res == nullptr)) return false;
+        auto sock = ::socket(AF_INET, SOCK_DGRAM, 0);
+        if (((intptr_t)sock < 0) || (::connect(sock, res->ai_addr, (socklen_t)res->ai_addrlen) != 0))
+            {
+            if ((intptr_t)sock >= 0) MTOOLS_CLOSESOCKET(sock);
+            ::freeaddrinfo(res);
+            return false;
+            }
+        ::freeaddrinfo(res);
+        _stop = false;
+        _sockets.push_back((intptr_t)sock);
+        _threads.push_back(std::thread(&MetricsChannel::_udpLoop, this, (intptr_t)sock, intervalms));
+        return true;
+        }
+
+
+    void MetricsChannel::_udpLoop(intptr_t sock, int intervalms)
+        {
+        const int step = 50;
+        int elapsed = intervalms;
+        while (!_stop)
+            {
+            if (elapsed >= intervalms)
+                {
+                elapsed = 0;
+                std::vector<std::pair<std::string, int> > nk;
+                std::vector<uint64> raw;
+                _read(nk, raw);
+                std::string msg;
+                for (size_t i = 0; i < raw.size(); i++)
+                    {
+                    const std::string line = internals_metrics::sanitize(nk[i].first) + ":" + internals_metrics::valueStr(raw[i], nk[i].second) + "|g\n";
+                    if (msg.size() + line.size() > 1400) { ::send(sock, msg.data(), (int)msg.size(), 0); msg.clear(); } // keep datagrams below the usual MTU
+                    msg += line;
+                    }
+                if (msg.size() > 0) ::send(sock, msg.data(), (int)msg.size(), 0);
+                }
+            std::this_thread::sleep_for(std::chrono::milliseconds(step));
+            elapsed += step;
+            }
+        }
+
+
+    void MetricsChannel::stopExport()
+        {
+        _stop = true;
+        for (auto & th : _threads) { if (th.joinable()) th.join(); }
+        for (auto s : _sockets) { MTOOLS_CLOSESOCKET(s); }
+        _threads.clear();
+        _sockets.clear();
+        }
+
+
+    }
+
+
+/* end of file */
+
@@ -0,0 +1,120 @@
+/** @file mobius.cpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+#include "maths/mobius.hpp"
+
+
+/* SSE2 is always available on x64 (and on x86 when the compiler targets it) */
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+	#define MTOOLS_MOBIUS_SSE2 1
+	#include <emmintrin.h>
+#endif
+
+
+namespace mtools
+{
+
+	namespace internals_mobius
+	{
+
+		static_assert(sizeof(std::complex<double>) == 2 * sizeof(double), "unexpected layout for std::complex<double>");
+		static_assert(sizeof(Circle<double>) == 3 * sizeof(double), "unexpected layout for mtools::Circle<double>");
+
+
+#if (MTOOLS_MOBIUS_SSE2)
+
+		/* numerator and denominator of the image of (x,y) for two points at once */
+		static MTOOLS_FORCEINLINE void _numden(const __m128d * K, __m128d x, __m128d y, __m128d & nr, __m128d & ni, __m128d & dr, __m128d & di)
+			{
+			nr = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(K[0], x), _mm_mul_pd(K[1], y)), K[2]);
+			ni = _mm_add_pd(_mm_add_pd(_mm_mul_pd(K[0], y), _mm_mul_pd(K[1], x)), K[3]);
+			dr = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(K[4], x), _mm_mul_pd(K[5], y)), K[6]);
+			di = _mm_add_pd(_mm_add_pd(_mm_mul_pd(K[4], y), _mm_mul_pd(K[5], x)), K[7]);
+			}
+
+#endif
+
+
+		void applyPoints(const double * coef, const std::complex<double> * z, std::complex<double> * out, size_t n)
+			{
+			size_t i = 0;
+#if (MTOOLS_MOBIUS_SSE2)
+			__m128d K[8];
+			for (int k = 0; k < 8; k++) K[k] = _mm_set1_pd(coef[k]);
+			const __m128d one = _mm_set1_pd(1.0);
+			const double * src = reinterpret_cast<const double *>(z);
+			double * dst = reinterpret_cast<double *>(out);
+			for (; i + 2 <= n; i += 2)
+				{
+				const __m128d z0 = _mm_loadu_pd(src + 2 * i), z1 = _mm_loadu_pd(src + 2 * i + 2);
+				const __m128d x = _mm_unpacklo_pd(z0, z1), y = _mm_unpackhi_pd(z0, z1);
+				__m128d nr, ni, dr, di;
+				_numden(K, x, y, nr, ni, dr, di);
+				const __m128d inv = _mm_div_pd(one, _mm_add_pd(_mm_mul_pd(dr, dr), _mm_mul_pd(di, di)));
+				const __m128d re = _mm_mul_pd(_mm_add_pd(_mm_mul_pd(nr, dr), _mm_mul_pd(ni, di)), inv);
+				const __m128d im = _mm_mul_pd(_mm_sub_pd(_mm_mul_pd(ni, dr), _mm_mul_pd(nr, di)), inv);
+				_mm_storeu_pd(dst + 2 * i, _mm_unpacklo_pd(re, im));
+				_mm_storeu_pd(dst + 2 * i + 2, _mm_unpackhi_pd(re, im));
+				}
+#endif
+			applyPoints<double>(coef, z + i, out + i, n - i);
+			}
+
+
+		void applyCircles(const double * coef, const Circle<double> * C, Circle<double> * out, size_t n)
+			{
+			size_t i = 0;
+#if (MTOOLS_MOBIUS_SSE2)
+			__m128d K[12];
+			for (int k = 0; k < 12; k++) K[k] = _mm_set1_pd(coef[k]);
+			const __m128d one = _mm_set1_pd(1.0);
+			const __m128d absmask = _mm_castsi128_pd(_mm_set1_epi64x(0x7FFFFFFFFFFFFFFFLL));
+			const double * src = reinterpret_cast<const double *>(C);
+			double * dst = reinterpret_cast<double *>(out);
+			for (; i + 2 <= n; i += 2)
+				{
+				const double * p = src + 3 * i;
+				const __m128d c0 = _mm_loadu_pd(p), c1 = _mm_loadu_pd(p + 3);
+				const __m128d x = _mm_unpacklo_pd(c0, c1), y = _mm_unpackhi_pd(c0, c1);
+				const __m128d r = _mm_unpacklo_pd(_mm_load_sd(p + 2), _mm_load_sd(p + 5));
+				const __m128d r2 = _mm_mul_pd(r, r);
+				__m128d nr, ni, dr, di;
+				_numden(K, x, y, nr, ni, dr, di);
+				const __m128d inv = _mm_div_pd(one, _mm_sub_pd(_mm_add_pd(_mm_mul_pd(dr, dr), _mm_mul_pd(di, di)), _mm_mul_pd(r2, K[10])));
+				const __m128d re = _mm_mul_pd(_mm_sub_pd(_mm_add_pd(_mm_mul_pd(nr, dr), _mm_mul_pd(ni, di)), _mm_mul_pd(r2, K[8])), inv);
+				const __m128d im = _mm_mul_pd(_mm_sub_pd(_mm_sub_pd(_mm_mul_pd(ni, dr), _mm_mul_pd(nr, di)), _mm_mul_pd(r2, K[9])), inv);
+				const __m128d rad = _mm_mul_pd(_mm_mul_pd(r, K[11]), _mm_and_pd(inv, absmask));
+				double * q = dst + 3 * i;
+				_mm_storeu_pd(q, _mm_unpacklo_pd(re, im));
+				_mm_store_sd(q + 2, rad);
+				_mm_storeu_pd(q + 3, _mm_unpackhi_pd(re, im));
+				_mm_storeh_pd(q + 5, rad);
+				}
+#endif
+			applyCircles<double>(coef, C + i, out + i, n - i);
+			}
+
+	}
+
+}
+
+
+/* end of file */
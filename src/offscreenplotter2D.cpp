@@ -0,0 +1,349 @@
+/** @file offscreenplotter2D.cpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "graphics/offscreenplotter2D.hpp"
+#include "graphics/internal/plotter2Dobj.hpp"
+#include "misc/error.hpp"
+#include "misc/internal/threadworker.hpp"
+
+#include <thread>
+#include <chrono>
+
+
+namespace mtools
+{
+
+    using internals_graphics::Plotter2DObj;
+
+
+    /* width hint given to the objects for their (never shown) option window */
+    #define OFFSCREENPLOTTER2D_OBJWIDTH 300
+
+    /* time between two quality queries in render() */
+    #define OFFSCREENPLOTTER2D_WAITTIME 1
+
+
+    OffscreenPlotter2D::OffscreenPlotter2D(int W, int H, bool addAxes, bool addGrid) : _RM(nullptr), _axePlot(nullptr), _gridPlot(nullptr), _usesolidBK(true), _solidBKcolor(RGBc::c_White)
+        {
+        MTOOLS_INSURE((W > 0) && (H > 0));
+        _RM = new internals_graphics::RangeManager(iVec2(W, H));
+        _RM->setNotificationCallback(_rangeCB_static, this, nullptr);
+        if (addGrid) { _gridPlot = new Plot2DGrid(); add(_gridPlot); }
+        if (addAxes) { _axePlot = new Plot2DAxes(); add(_axePlot); }
+        }
+
+
+    OffscreenPlotter2D::~OffscreenPlotter2D()
+        {
+        std::lock_guard<std::recursive_mutex> lock(_mut);
+        while (_vecPlot.size() > 0) { remove(_vecPlot.front()); }
+        delete _axePlot;
+        delete _gridPlot;
+        _RM->setNotificationCallback(nullptr, nullptr, nullptr);
+        delete _RM;
+        }
+
+
+    void OffscreenPlotter2D::add(Plotter2DObj * obj)
+        {
+        if (obj == nullptr)
+            {
+            MTOOLS_DEBUG("OffscreenPlotter2D::add with a nullptr pointer!");
+            return;
+            }
+        std::lock_guard<std::recursive_mutex> lock(_mut);
+        if (_findIndex(obj) >= 0)
+            {
+            MTOOLS_DEBUG("OffscreenPlotter2D::add, object already inserted!");
+            return;
+            }
+        _vecPlot.insert(_vecPlot.begin(), obj); // new object on top
+        obj->_insertedHeadless(_objectCB_static, _RM, this, obj, OFFSCREENPLOTTER2D_OBJWIDTH);
+        _updatePriorities();
+        }
+
+
+    void OffscreenPlotter2D::add(Plotter2DObj & obj) { add(&obj); }
+
+
+    OffscreenPlotter2D & OffscreenPlotter2D::operator[](Plotter2DObj & obj) { add(obj); return(*this); }
+
+
+    void OffscreenPlotter2D::remove(Plotter2DObj * obj)
+        {
+        std::lock_guard<std::recursive_mutex> lock(_mut);
+        const int i = _findIndex(obj);
+        if (i < 0)
+            {
+            MTOOLS_DEBUG("OffscreenPlotter2D::remove(), object not found.");
+            return;
+            }
+        _vecPlot.erase(_vecPlot.begin() + i);
+        obj->_removedHeadless();
+        _updatePriorities();
+        }
+
+
+    void OffscreenPlotter2D::remove(Plotter2DObj & obj) { remove(&obj); }
+
+
+    int OffscreenPlotter2D::nbObject() const
+        {
+        std::lock_guard<std::recursive_mutex> lock(_mut);
+        return (int)_vecPlot.size();
+        }
+
+
+    Plotter2DObj * OffscreenPlotter2D::get(int pos) const
+        {
+        std::lock_guard<std::recursive_mutex> lock(_mut);
+        if ((pos < 0) || (pos >= (int)_vecPlot.size())) return nullptr;
+        return _vecPlot[pos];
+        }
+
+
+    Plot2DAxes * OffscreenPlotter2D::axesObject() const { return _axePlot; }
+
+
+    Plot2DGrid * OffscreenPlotter2D::gridObject() const { return _gridPlot; }
+
+
+    bool OffscreenPlotter2D::useSolidBackground() const { return _usesolidBK; }
+
+
+    void OffscreenPlotter2D::useSolidBackground(bool use) { _usesolidBK = use; }
+
+
+    RGBc OffscreenPlotter2D::solidBackGroundColor() const { return _solidBKcolor; }
+
+
+    void OffscreenPlotter2D::solidBackGroundColor(RGBc color) { _solidBKcolor = color.getOpaque(); }
+
+
+    internals_graphics::RangeManager & OffscreenPlotter2D::range() { return *_RM; }
+
+
+    iVec2 OffscreenPlotter2D::imageSize() const { return _RM->getWinSize(); }
+
+
+    void OffscreenPlotter2D::imageSize(int W, int H)
+        {
+        MTOOLS_INSURE((W > 0) && (H > 0));
+        _RM->winSize(iVec2(W, H));
+        }
+
+
+    void OffscreenPlotter2D::autorangeX() { _useRange(nullptr, true, false); }
+
+
+    void OffscreenPlotter2D::autorangeY() { _useRange(nullptr, false, true); }
+
+
+    void OffscreenPlotter2D::autorangeXY() { _useRange(nullptr, true, true); }
+
+
+    int OffscreenPlotter2D::quality() const
+        {
+        std::lock_guard<std::recursive_mutex> lock(_mut);
+        int q = 100;
+        for (size_t i = 0; i < _vecPlot.size(); i++)
+            {
+            if (_vecPlot[i]->enable())
+                {
+                const int r = _vecPlot[i]->quality();
+                if (r < q) { q = r; }
+                }
+            }
+        return q;
+        }
+
+
+    int OffscreenPlotter2D::render(Image & im, int minQuality, int timeout)
+        {
+        if (minQuality > 100) minQuality = 100;
+        const auto start = std::chrono::steady_clock::now();
+        while (quality() < minQuality)
+            { // let the worker threads do their job
+            if ((timeout >= 0) && (std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count() >= timeout)) break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(OFFSCREENPLOTTER2D_WAITTIME));
+            }
+        std::lock_guard<std::recursive_mutex> lock(_mut);
+        const iVec2 dim = _RM->getWinSize();
+        if ((im.lx() != dim.X()) || (im.ly() != dim.Y())) { im.resizeRaw(dim); }
+        if (_usesolidBK) { im.clear(_solidBKcolor); } else { im.checkerboard(); }
+        int q = 100;
+        for (int i = (int)_vecPlot.size(); i > 0; i--)
+            { // same as Plotter2DWindow::updateView(): from bottom to top
+            if (_vecPlot[i - 1]->enable())
+                {
+                int r = 0;
+                if (_vecPlot[i - 1]->quality() > 0) { r = _vecPlot[i - 1]->drawOnto(im); }
+                if (r < q) { q = r; }
+                }
+            }
+        return q;
+        }
+
+
+    /* called by the objects, from any thread */
+    void OffscreenPlotter2D::_objectCB_static(void * data, void * data2, void * obj, int code) { MTOOLS_ASSERT(data != nullptr); ((OffscreenPlotter2D *)data)->_objectCB((Plotter2DObj *)obj, code); }
+    void OffscreenPlotter2D::_objectCB(Plotter2DObj * obj, int code)
+        {
+        switch (code)
+            {
+            case Plotter2DObj::_REQUEST_DETACH: { remove(obj); return; }
+            case Plotter2DObj::_REQUEST_UP: { std::lock_guard<std::recursive_mutex> lock(_mut); _move(obj, _findIndex(obj) - 1); return; }
+            case Plotter2DObj::_REQUEST_DOWN: { std::lock_guard<std::recursive_mutex> lock(_mut); _move(obj, _findIndex(obj) + 1); return; }
+            case Plotter2DObj::_REQUEST_TOP: { _move(obj, 0); return; }
+            case Plotter2DObj::_REQUEST_BOTTOM: { _move(obj, nbObject() - 1); return; }
+            case Plotter2DObj::_REQUEST_USERANGEX: { _useRange(obj, true, false); return; }
+            case Plotter2DObj::_REQUEST_USERANGEY: { _useRange(obj, false, true); return; }
+            case Plotter2DObj::_REQUEST_USERANGEXY: { _useRange(obj, true, true); return; }
+            default: { return; } // refresh, focus... : nothing to do, the image is only drawn on request.
+            }
+        }
+
+
+    /* called by the range manager (inside its lock) when the range/image size changes */
+    bool OffscreenPlotter2D::_rangeCB_static(void * data, void * data2, bool changedRange, bool changedWinSize, bool changedFixAspectRatio) { MTOOLS_ASSERT(data != nullptr); return ((OffscreenPlotter2D *)data)->_rangeCB(); }
+    bool OffscreenPlotter2D::_rangeCB()
+        {
+        std::lock_guard<std::recursive_mutex> lock(_mut);
+        const fBox2 R = _RM->getRange();
+        const iVec2 winSize = _RM->getWinSize();
+        for (size_t i = 0; i < _vecPlot.size(); i++) { _vecPlot[i]->setParam(R, winSize); }
+        return true;
+        }
+
+
+    int OffscreenPlotter2D::_findIndex(Plotter2DObj * obj) const
+        {
+        for (int i = 0; i < (int)_vecPlot.size(); i++) { if (_vecPlot[i] == obj) return i; }
+        return -1;
+        }
+
+
+    void OffscreenPlotter2D::_move(Plotter2DObj * obj, int newpos)
+        {
+        std::lock_guard<std::recursive_mutex> lock(_mut);
+        const int i = _findIndex(obj);
+        if ((i < 0) || (newpos < 0) || (newpos >= (int)_vecPlot.size()) || (newpos == i)) return;
+        _vecPlot.erase(_vecPlot.begin() + i);
+        _vecPlot.insert(_vecPlot.begin() + newpos, obj);
+        _updatePriorities();
+        }
+
+
+    /* same as Plotter2DWindow::updatePriorities(): the topmost enabled object gets the execution slots first */
+    void OffscreenPlotter2D::_updatePriorities()
+        {
+        bool found = false;
+        for (size_t i = 0; i < _vecPlot.size(); i++)
+            {
+            const bool top = ((!found) && (_vecPlot[i]->enable()));
+            if (top) found = true;
+            _vecPlot[i]->_threadsPriority(top ? ThreadScheduler::PRIORITY_HIGH : ThreadScheduler::PRIORITY_NORMAL);
+            }
+        }
+
+
+    /* favourite X range of obj (or of all enabled objects if obj is nullptr), see Plotter2DWindow::getAutoRangeX() */
+    fBox2 OffscreenPlotter2D::_autoRangeX(fBox2 CR, bool keepAR, Plotter2DObj * obj)
+        {
+        fBox2 NR;
+        for (size_t i = 0; i < _vecPlot.size(); i++)
+            {
+            if (((obj == nullptr) || (_vecPlot[i] == obj)) && (_vecPlot[i]->enable()) && (_vecPlot[i]->hasFavouriteRangeX()))
+                {
+                fBox2 R = _vecPlot[i]->favouriteRangeX(CR);
+                if (!R.isHorizontallyEmpty())
+                    {
+                    if (NR.isHorizontallyEmpty()) { NR = R; } else
+                        {
+                        if (R.min[0] < NR.min[0]) { NR.min[0] = R.min[0]; }
+                        if (NR.max[0] < R.max[0]) { NR.max[0] = R.max[0]; }
+                        }
+                    }
+                }
+            }
+        if (NR.isHorizontallyEmpty()) return fBox2();
+        if (!keepAR)
+            {
+            NR.min[1] = CR.min[1];
+            NR.max[1] = CR.max[1];
+            return NR;
+            }
+        double c = (CR.min[1] + CR.max[1]) / 2;
+        double r = CR.ly()*NR.lx() / (2 * CR.lx());
+        NR.min[1] = c - r;
+        NR.max[1] = c + r;
+        return NR;
+        }
+
+
+    /* favourite Y range of obj (or of all enabled objects if obj is nullptr), see Plotter2DWindow::getAutoRangeY() */
+    fBox2 OffscreenPlotter2D::_autoRangeY(fBox2 CR, bool keepAR, Plotter2DObj * obj)
+        {
+        fBox2 NR;
+        for (size_t i = 0; i < _vecPlot.size(); i++)
+            {
+            if (((obj == nullptr) || (_vecPlot[i] == obj)) && (_vecPlot[i]->enable()) && (_vecPlot[i]->hasFavouriteRangeY()))
+                {
+                fBox2 R = _vecPlot[i]->favouriteRangeY(CR);
+                if (!R.isVerticallyEmpty())
+                    {
+                    if (NR.isVerticallyEmpty()) { NR = R; } else
+                        {
+                        if (R.min[1] < NR.min[1]) { NR.min[1] = R.min[1]; }
+                        if (NR.max[1] < R.max[1]) { NR.max[1] = R.max[1]; }
+                        }
+                    }
+                }
+            }
+        if (NR.isVerticallyEmpty()) return fBox2();
+        NR.min[0] = CR.min[0];
+        NR.max[0] = CR.max[0];
+        if (!keepAR) { return NR; }
+        NR = NR.fixedRatioEnclosingRect(CR.lx() / CR.ly());
+        return NR;
+        }
+
+
+    void OffscreenPlotter2D::_useRange(Plotter2DObj * obj, bool X, bool Y)
+        {
+        fBox2 R = _RM->getRange();                  // current range
+        const bool keepAR = _RM->fixedAspectRatio();  // do we keep the aspect ratio
+            {
+            std::lock_guard<std::recursive_mutex> lock(_mut); // released before setRange() since the range manager callback also locks
+            if (X) { R = _autoRangeX(R, keepAR, obj); if (R.isEmpty()) return; }
+            if (Y) { R = _autoRangeY(R, keepAR, obj); if (R.isEmpty()) return; }
+            }
+        _RM->setRange(R);
+        }
+
+
+    #undef OFFSCREENPLOTTER2D_OBJWIDTH
+    #undef OFFSCREENPLOTTER2D_WAITTIME
+
+}
+
+
+/* end of file */
+
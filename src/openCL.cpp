@@ -26,6 +26,13 @@
 #include "io/console.hpp"
 #include "io/fileio.hpp"
 
+#include <fstream>
+#include <cstdlib>
+#include <cstdio>
+#include <chrono>
+#include <thread>
+#include <cstring>
+
 
 
 
@@ -33,6 +40,98 @@ namespace mtools
 	{
 
 
+	namespace internals_openCL
+		{
+
+		static const char CACHE_MAGIC[8] = { 'M','T','C','L','B','I','N','1' };
+
+
+		/* 64 bit FNV-1a hash */
+		inline uint64 fnv1a(const std::string & s, uint64 h = 14695981039346656037ULL)
+			{
+			for (size_t i = 0; i < s.size(); i++) { h ^= (uint64)((unsigned char)s[i]); h *= 1099511628211ULL; }
+			return h;
+			}
+
+
+		/* key identifying a program: everything that can change the binary produced by the compiler */
+		inline std::string programKey(const cl::Platform & platform, const cl::Device & device, const std::string & source, const std::string & options)
+			{
+			std::string key;
+			key += "platform: " + mtools::troncateAfterNullChar(platform.getInfo<CL_PLATFORM_NAME>()) + " / " + mtools::troncateAfterNullChar(platform.getInfo<CL_PLATFORM_VERSION>()) + "\n";
+			key += "device: " + mtools::troncateAfterNullChar(device.getInfo<CL_DEVICE_NAME>()) + " / " + mtools::troncateAfterNullChar(device.getInfo<CL_DEVICE_VENDOR>()) + " / " + mtools::troncateAfterNullChar(device.getInfo<CL_DEVICE_VERSION>()) + "\n";
+			key += "driver: " + mtools::troncateAfterNullChar(device.getInfo<CL_DRIVER_VERSION>()) + "\n";
+			key += "options: " + options + "\n";
+			key += "source: " + mtools::toString(fnv1a(source)) + " " + mtools::toString(source.size()) + "\n";
+			return key;
+			}
+
+
+		/* name of the cache file for a given key */
+		inline std::string cacheFile(const std::string & dir, const std::string & key)
+			{
+			const uint64 h = fnv1a(key);
+			char buf[32]; std::snprintf(buf, sizeof(buf), "%016llx.clbin", (unsigned long long)h);
+			return mtools::trailingSlash(dir, true) + buf;
+			}
+
+
+		/* try to create the program from the cache, return false if there is no valid entry */
+		inline bool loadCachedProgram(const OpenCLBundle & bundle, const std::string & key, const std::string & options, cl::Program & prog)
+			{
+			std::ifstream f(cacheFile(bundle.programCacheDir, key), std::ifstream::binary | std::ifstream::in);
+			if (f.fail()) return false;
+			char magic[8]; uint64 keylen = 0, binlen = 0;
+			f.read(magic, 8); f.read((char*)&keylen, sizeof(keylen));
+			if ((!f) || (std::memcmp(magic, CACHE_MAGIC, 8) != 0) || (keylen != (uint64)key.size())) return false;
+			std::string k((size_t)keylen, '\0'); f.read(&k[0], (std::streamsize)keylen);
+			f.read((char*)&binlen, sizeof(binlen));
+			if ((!f) || (k != key) || (binlen == 0)) return false;
+			std::string bin((size_t)binlen, '\0'); f.read(&bin[0], (std::streamsize)binlen);
+			if (!f) return false;
+			cl_device_id dev = bundle.device();
+			size_t len = bin.size();
+			const unsigned char * pbin = (const unsigned char *)bin.data();
+			cl_int status = CL_SUCCESS, err = CL_SUCCESS;
+			cl_program p = clCreateProgramWithBinary(bundle.context(), 1, &dev, &len, &pbin, &status, &err);
+			if ((err != CL_SUCCESS) || (status != CL_SUCCESS)) { if (p != nullptr) clReleaseProgram(p); return false; }
+			cl::Program P(p); // takes ownership
+			std::vector<cl::Device> listdevice; listdevice.push_back(bundle.device);
+			try { P.build(listdevice, options.c_str()); }
+			catch (const cl::Error &) { return false; }
+			prog = P;
+			return true;
+			}
+
+
+		/* save the binary of a program in the cache (failures are silently ignored) */
+		inline void saveCachedProgram(const OpenCLBundle & bundle, const std::string & key, const cl::Program & prog)
+			{
+			cl_uint nbdev = 0;
+			if ((clGetProgramInfo(prog(), CL_PROGRAM_NUM_DEVICES, sizeof(nbdev), &nbdev, nullptr) != CL_SUCCESS) || (nbdev != 1)) return;
+			size_t len = 0;
+			if ((clGetProgramInfo(prog(), CL_PROGRAM_BINARY_SIZES, sizeof(len), &len, nullptr) != CL_SUCCESS) || (len == 0)) return;
+			std::string bin(len, '\0');
+			unsigned char * pbin = (unsigned char *)&bin[0];
+			if (clGetProgramInfo(prog(), CL_PROGRAM_BINARIES, sizeof(pbin), &pbin, nullptr) != CL_SUCCESS) return;
+			const std::string filename = cacheFile(bundle.programCacheDir, key);
+			// write in a temporary file then rename it so that concurrent jobs never see a partial entry
+			const uint64 tag = fnv1a(mtools::toString(std::hash<std::thread::id>()(std::this_thread::get_id())), (uint64)std::chrono::high_resolution_clock::now().time_since_epoch().count());
+			const std::string tmpname = filename + "." + mtools::toString(tag) + ".tmp";
+				{
+				std::ofstream f(tmpname, std::ofstream::binary | std::ofstream::out | std::ofstream::trunc);
+				if (f.fail()) return;
+				const uint64 keylen = (uint64)key.size(), binlen = (uint64)bin.size();
+				f.write(CACHE_MAGIC, 8); f.write((const char*)&keylen, sizeof(keylen)); f.write(key.data(), (std::streamsize)keylen);
+				f.write((const char*)&binlen, sizeof(binlen)); f.write(bin.data(), (std::streamsize)binlen);
+				if (!f) { f.close(); std::remove(tmpname.c_str()); return; }
+				}
+			if (std::rename(tmpname.c_str(), filename.c_str()) != 0) { std::remove(tmpname.c_str()); }
+			}
+
+		}
+
+
 	cl::Platform openCL_selectPlatform(bool selectdefault, bool output, bool showextensions)
 		{
 		try
@@ -87,6 +186,7 @@ namespace mtools
 					mtools::cout << "(" << i << ")        name: [" << mtools::troncateAfterNullChar(deviceList[i].getInfo<CL_DEVICE_NAME>()) << "]\n";
 					mtools::cout << "       mem size: [" << deviceList[i].getInfo<CL_DEVICE_GLOBAL_MEM_SIZE>() / (1024 * 1024) << "Mo]\n";
 					mtools::cout << "      available: [" << (int)deviceList[i].getInfo<CL_DEVICE_AVAILABLE>() << "]\n";
+					mtools::cout << "    double prec: [" << (openCL_supportsDouble(deviceList[i]) ? "yes" : "no") << "]\n";
 					if (showextensions) { mtools::cout << "     extensions: [" << mtools::troncateAfterNullChar(deviceList[i].getInfo<CL_DEVICE_EXTENSIONS>()) << "]\n"; }
 					mtools::cout << "\n";
 					}
@@ -103,6 +203,42 @@ namespace mtools
 		}
 
 
+	bool openCL_supportsDouble(const cl::Device & device)
+		{
+		try {
+			const std::string ext = mtools::troncateAfterNullChar(device.getInfo<CL_DEVICE_EXTENSIONS>());
+			return ((ext.find("cl_khr_fp64") != std::string::npos) || (ext.find("cl_amd_fp64") != std::string::npos));
+			}
+		catch (const cl::Error & e) { MTOOLS_ERROR(std::string("OpenCL error :[") + e.what() + "]\n"); }
+		throw ""; // used to remove warning
+		}
+
+
+	std::string openCL_defaultProgramCacheDir()
+		{
+		const char * env = std::getenv("MTOOLS_OPENCL_CACHE");
+		if (env != nullptr)
+			{
+			const std::string dir(env);
+			if (dir.size() == 0) return std::string();
+			return (mtools::createDirectory(dir) ? dir : std::string());
+			}
+		#if defined (_MSC_VER)
+		const char * base = std::getenv("LOCALAPPDATA");
+		if (base == nullptr) return std::string();
+		std::string dir = mtools::trailingSlash(std::string(base), true);
+		#else
+		const char * base = std::getenv("HOME");
+		if (base == nullptr) return std::string();
+		std::string dir = mtools::trailingSlash(std::string(base), true) + ".cache";
+		if (!mtools::createDirectory(dir)) return std::string();
+		dir = mtools::trailingSlash(dir, true);
+		#endif
+		dir += "mtools_opencl";
+		return (mtools::createDirectory(dir) ? dir : std::string());
+		}
+
+
 	cl::Context openCL_createContext(const cl::Device & device, bool output)
 		{
 		try {
@@ -144,9 +280,15 @@ namespace mtools
 			device = openCL_selectDevice(platform, selectdefault, output, showextensions);
 			context = openCL_createContext(device, output);
 			queue = openCL_createQueue(device, context, output);
+			programCacheDir = openCL_defaultProgramCacheDir();
 			}
 		catch (const cl::Error & e) { MTOOLS_ERROR(std::string("OpenCL error :[") + e.what() + "]\n"); }
-		throw ""; // used to remove warning
+		}
+
+
+	bool OpenCLBundle::supportsDouble() const
+		{
+		return openCL_supportsDouble(device);
 		}
 
 
@@ -162,6 +304,17 @@ namespace mtools
 				}
 			std::string text = mtools::loadStringFromFile(filename);
 			if (text.length() == 0) { MTOOLS_ERROR(std::string("error loading file [") + filename + "]"); }
+			std::string key;
+			if (programCacheDir.size() > 0)
+				{
+				key = internals_openCL::programKey(platform, device, text, compileroptions);
+				cl::Program cprog;
+				if (internals_openCL::loadCachedProgram(*this, key, compileroptions, cprog))
+					{
+					if (output) { mtools::cout << "Program loaded from the binary cache.\n"; }
+					return cprog;
+					}
+				}
 			cl::Program prog(context, text);
 			std::vector<cl::Device> listdevice; listdevice.push_back(device);
 			try {
@@ -186,6 +339,7 @@ namespace mtools
 				mtools::cout << "Build successful.\n";
 				mtools::cout << "Compiler log:\n" << textlog << "\n";
 				}
+			if (key.size() > 0) { internals_openCL::saveCachedProgram(*this, key, prog); }
 			return prog;
 			}
 		catch (const cl::Error & e) { MTOOLS_ERROR(std::string("OpenCL error :[") + e.what() + "]\n"); }
@@ -204,6 +358,18 @@ namespace mtools
 				mtools::cout << "    with options : [" << compileroptions << "]\n";
 				}
 			if (source.length() == 0) { MTOOLS_ERROR("error empty source string"); }
+			std::string key;
+			if (programCacheDir.size() > 0)
+				{
+				key = internals_openCL::programKey(platform, device, source, compileroptions);
+				cl::Program cprog;
+				if (internals_openCL::loadCachedProgram(*this, key, compileroptions, cprog))
+					{
+					log.clear();
+					if (output) { mtools::cout << "Program loaded from the binary cache.\n"; }
+					return cprog;
+					}
+				}
 			cl::Program prog(context, source);
 			std::vector<cl::Device> listdevice; listdevice.push_back(device);
 			try {
@@ -223,6 +389,7 @@ namespace mtools
 				mtools::cout << "Build successful.\n";
 				mtools::cout << "Compiler log:\n" << log << "\n";
 				}
+			if (key.size() > 0) { internals_openCL::saveCachedProgram(*this, key, prog); }
 			return prog;
 			}
 		catch (const cl::Error & e) { MTOOLS_ERROR(std::string("OpenCL error :[") + e.what() + "]\n"); }
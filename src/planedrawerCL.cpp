@@ -0,0 +1,108 @@
+/** @file planedrawerCL.cpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+#include "graphics/planedrawerCL.hpp"
+
+// only if openCL is installed.
+#if (MTOOLS_USE_OPENCL)
+
+#include "misc/error.hpp"
+
+
+namespace mtools
+	{
+
+
+	namespace internals_planedrawercl
+		{
+
+		/* code added before the user source */
+		static const char * header_source = "#pragma OPENCL EXTENSION cl_khr_fp64 : enable\n";
+
+		/* evaluation kernel added after the user source: RGBc is stored as BGRA in memory */
+		static const char * kernel_source =
+			"\n__kernel void mtools_planeColorCL(__global const double2 * pos, __global uchar4 * col, const uint n)\n"
+			"	{\n"
+			"	const uint i = get_global_id(0);\n"
+			"	if (i < n) { col[i] = getColor(pos[i]).zyxw; }\n"
+			"	}\n";
+
+		/* granularity of the global size */
+		static const size_t BLOCK = 64;
+
+		}
+
+
+	PlaneColorCL::PlaneColorCL(const std::string & source, const std::string & compileroptions, bool output) : _clbundle(true, output), _capacity(0)
+		{
+		try
+			{
+			std::string log;
+			const std::string src = std::string(internals_planedrawercl::header_source) + source + internals_planedrawercl::kernel_source;
+			_prog.reset(new cl::Program(_clbundle.createProgramFromString(src, log, compileroptions, output)));
+			_kernel.reset(new cl::Kernel(_clbundle.createKernel(*_prog, "mtools_planeColorCL", output)));
+			}
+		catch (const cl::Error & e) { MTOOLS_ERROR(std::string("OpenCL error :[") + e.what() + "]\n"); }
+		}
+
+
+	PlaneColorCL::~PlaneColorCL()
+		{
+		}
+
+
+	void PlaneColorCL::_reserve(size_t n)
+		{
+		if (n <= _capacity) return;
+		size_t c = (_capacity == 0) ? internals_planedrawercl::BLOCK : _capacity;
+		while (c < n) { c *= 2; }
+		_buff_pos.reset(new cl::Buffer(_clbundle.context, CL_MEM_READ_ONLY, sizeof(double) * 2 * c));
+		_buff_col.reset(new cl::Buffer(_clbundle.context, CL_MEM_WRITE_ONLY, sizeof(RGBc) * c));
+		_capacity = c;
+		}
+
+
+	void PlaneColorCL::getColorBatch(const fVec2 * pos, size_t n, RGBc * out)
+		{
+		if (n == 0) return;
+		std::lock_guard<std::mutex> lock(_mut);
+		try
+			{
+			_reserve(n);
+			_hpos.resize(2 * n);
+			for (size_t k = 0; k < n; k++) { _hpos[2 * k] = pos[k].X(); _hpos[2 * k + 1] = pos[k].Y(); }
+			const size_t gs = ((n + internals_planedrawercl::BLOCK - 1) / internals_planedrawercl::BLOCK) * internals_planedrawercl::BLOCK;
+			_clbundle.queue.enqueueWriteBuffer(*_buff_pos, CL_FALSE, 0, sizeof(double) * 2 * n, _hpos.data());
+			_kernel->setArg(0, *_buff_pos);
+			_kernel->setArg(1, *_buff_col);
+			_kernel->setArg(2, (cl_uint)n);
+			_clbundle.queue.enqueueNDRangeKernel(*_kernel, 0, gs, cl::NullRange);
+			_clbundle.queue.enqueueReadBuffer(*_buff_col, CL_TRUE, 0, sizeof(RGBc) * n, out);
+			}
+		catch (const cl::Error & e) { MTOOLS_ERROR(std::string("OpenCL error :[") + e.what() + "]\n"); }
+		}
+
+
+	}
+
+
+#endif
+
+/* end of file */
+
@@ -609,6 +609,10 @@ namespace mtools
 
         void Plot2DBaseGraph::_drawWithInterpolation(int depth, Image & im, const fBox2 & R, const RGBc coul, const float opacity, const int tickness)
             {
+                {
+                std::vector<double> ymin((size_t)im.width()), ymax((size_t)im.width());
+                if ((im.width() > 0) && (_columns(R, (int)im.width(), ymin.data(), ymax.data()))) { _drawColumns(ymin, ymax, im, R, coul, opacity, tickness); return; }
+                }
                 double eps = R.lx() / im.width();
                 double x1 = R.min[0] + (eps / 2.0);
                 double y1 = _function(x1);
@@ -628,6 +632,32 @@ namespace mtools
             }
 
 
+        void Plot2DBaseGraph::_drawColumns(const std::vector<double> & ymin, const std::vector<double> & ymax, Image & im, const fBox2 & R, const RGBc coul, const float opacity, const int tickness)
+            {
+            const int ly = (int)im.height();
+            auto toj = [&](double y) -> int { return ((y >= R.min[1]) && (y <= R.max[1])) ? (ly - 1 - (int)floor((y - R.min[1]) / R.ly()*ly + 0.5)) : ((y >= R.max[1]) ? -1 - tickness : ly + tickness); };
+            const RGBc c = coul.getMultOpacity(opacity);
+            const int32 pen = (tickness <= 1) ? 0 : (tickness - 1);
+            bool prev = false;       // true if the previous column is defined
+            bool prevsingle = false; // true if it is summarized by a single value
+            int ptop = 0, pbot = 0;  // its extent on the screen
+            for (int i = 0; i < (int)im.width(); i++)
+                {
+                if ((std::isnan(ymin[i])) || (std::isnan(ymax[i]))) { prev = false; continue; }
+                int top = toj(ymax[i]), bot = toj(ymin[i]);
+                const bool single = (ymin[i] == ymax[i]);
+                if ((single) && (prev) && (prevsingle)) { _drawLine(i - 1, ptop, top, im, coul, opacity, tickness); } // connect the points as for the usual drawing
+                else
+                    {
+                    int t = top, b = bot;
+                    if (prev) { if (b < ptop) b = ptop; if (t > pbot) t = pbot; } // connect with the previous column
+                    im.draw_line(iVec2(i, t), iVec2(i, b), c, true, true, false, pen);
+                    }
+                prev = true; prevsingle = single; ptop = top; pbot = bot;
+                }
+            }
+
+
         void Plot2DBaseGraph::_drawOverOrBelow(bool over, Image & im, const fBox2 & R, RGBc coul, const float opacity)
             {
 			coul.multOpacity(opacity);
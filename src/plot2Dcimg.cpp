@@ -35,21 +35,23 @@ namespace mtools
 
 
 
-	Plot2DCImg::Plot2DCImg(cimg_library::CImg<unsigned char> * im, int nbthreads, std::string name) : internals_graphics::Plotter2DObj(name), _typepos(TYPEBOTTOMLEFT), _im(im), _PD(nullptr), _proImg(nullptr)
+	Plot2DCImg::Plot2DCImg(cimg_library::CImg<unsigned char> * im, int nbthreads, std::string name) : internals_graphics::Plotter2DObj(name), _typepos(TYPEBOTTOMLEFT), _im(im), _conv(), _PD(nullptr), _proImg(nullptr)
 		{
+		_convert();
 		_PD = new PixelDrawer<Plot2DCImg>(this, nbthreads);
 		_proImg = new ProgressImg();
 		}
 
 
-	Plot2DCImg::Plot2DCImg(cimg_library::CImg<unsigned char> & im, int nbthreads, std::string name) : internals_graphics::Plotter2DObj(name), _typepos(TYPEBOTTOMLEFT), _im(&im), _PD(nullptr), _proImg(nullptr)
+	Plot2DCImg::Plot2DCImg(cimg_library::CImg<unsigned char> & im, int nbthreads, std::string name) : internals_graphics::Plotter2DObj(name), _typepos(TYPEBOTTOMLEFT), _im(&im), _conv(), _PD(nullptr), _proImg(nullptr)
 		{
+		_convert();
 		_PD = new PixelDrawer<Plot2DCImg>(this, nbthreads);
 		_proImg = new ProgressImg();
 		}
 
 
-	Plot2DCImg::Plot2DCImg(Plot2DCImg && o) : internals_graphics::Plotter2DObj(std::move(o)), _typepos((int)o._typepos), _im(o._im), _PD((PixelDrawer<Plot2DCImg>*)o._PD), _proImg(o._proImg), _checkButtonCenter(nullptr), _checkButtonBottomLeft(nullptr)
+	Plot2DCImg::Plot2DCImg(Plot2DCImg && o) : internals_graphics::Plotter2DObj(std::move(o)), _typepos((int)o._typepos), _im(o._im), _conv(o._conv), _PD((PixelDrawer<Plot2DCImg>*)o._PD), _proImg(o._proImg), _checkButtonCenter(nullptr), _checkButtonBottomLeft(nullptr)
 		{
 		o._PD = nullptr;     // so that the plane drawer is not destroyed when the first object goes out of scope.
 		o._proImg = nullptr;
@@ -132,6 +134,11 @@ namespace mtools
 
 	void Plot2DCImg::resetDrawing()
 			{
+			const bool st = _PD->enable();
+			_PD->enable(false); // stop the threads while the image is converted
+			_PD->sync();
+			_convert();
+			_PD->enable(st);
 			_PD->redraw(false);
 			_PD->sync();
 			Plotter2DObj::refresh();
@@ -158,6 +165,9 @@ namespace mtools
 	int Plot2DCImg::nbThreads() const  { return _PD->nbThreads(); }
 
 
+	void Plot2DCImg::threadsPriority(int prio) { _PD->priority(prio); }
+
+
 	void Plot2DCImg::removed(Fl_Group * optionWin)
 			{
 			Fl::delete_widget(optionWin);
@@ -193,6 +203,13 @@ namespace mtools
 			}
 
 
+		void Plot2DCImg::_convert()
+			{
+			if ((_im == nullptr) || ((_im->spectrum() != 3) && (_im->spectrum() != 4))) { _conv.empty(); return; }
+			_conv.fromCImg(*_im);
+			}
+
+
 		fBox2 Plot2DCImg::computeRange()
 			{
 			if (_im == nullptr) return fBox2();
@@ -157,6 +157,9 @@ namespace mtools
 	int Plot2DImage::nbThreads() const { return _PD->nbThreads(); }
 
 
+	void Plot2DImage::threadsPriority(int prio) { _PD->priority(prio); }
+
+
 	void Plot2DImage::removed(Fl_Group * optionWin)
 		{
 		Fl::delete_widget(optionWin);
@@ -24,6 +24,8 @@
 #include "graphics/internal/view2Dwidget.hpp"
 #include "io/internal/fltkSupervisor.hpp"
 #include "misc/error.hpp"
+#include "misc/internal/threadworker.hpp"
+#include "graphics/internal/drawable2Dobject.hpp"
 #include "io/fileio.hpp"
 #include "graphics/internal/rgbc_flcolor.hpp"
 
@@ -44,6 +46,11 @@
 #include <FL/Fl_Color_Chooser.H> 
 #include <FL/Fl_File_Chooser.H> 
 
+#include <chrono>
+#include <mutex>
+#include <map>
+#include <cstdio>
+
 
 
 namespace mtools
@@ -88,6 +95,18 @@ namespace mtools
             static void static_updateViewTimer(void* p);
             void updateViewTimer();
 
+            /* follow mode: update the range if an object published a new range */
+            void followRange();
+
+            /* draw the object at index i of _vecPlot onto im and return its quality (0 if not drawn) */
+            int drawLayer(int i, Image & im);
+
+            /* timing metrics */
+            void metricsReset();
+            void metricsTick();
+            std::string metricsString(bool json);
+            std::string metricsOverlay();
+
 
             /* axe and grid object insertion */
             void _insertAxesObject(bool status);
@@ -269,6 +288,8 @@ namespace mtools
 
             Image * _mainImage;						 // the view image
             std::atomic<int>      _mainImageQuality; // the quality of this image.
+            Image _retainedImage;                    // background + the complete layers at the bottom of the stack
+            int   _retainedTop;                      // _retainedImage contains the objects with index >= _retainedTop in _vecPlot (-1 if invalid)
 
             std::atomic<RangeManager*> _RM;        // the associated range manager. Constructed in ctor and destroyed in dtor
 
@@ -282,6 +303,31 @@ namespace mtools
 
             std::atomic<unsigned int> _sensibility; // the delta in image quality needed to trigger a redraw
 
+            std::atomic<int> _follow;           // follow mode (bit 0 : horizontally, bit 1 : vertically)
+
+            std::atomic<uint64> _followVersion; // signature of the published ranges when the range was last updated
+
+            /* timing metrics of an object */
+            struct ObjMetrics
+                {
+                std::string name;                               // name of the object
+                std::chrono::steady_clock::time_point start;    // time of the last reset of the drawing
+                double tq[4];                                   // time (ms after start) when the quality reached 25/50/75/100 (-1 = not yet)
+                int quality;                                    // last quality
+                int64 ticks;                                    // number of timer ticks since start (while enabled)
+                int64 busy;                                     // number of those ticks where the object was still working
+                double drawMs;                                  // duration of the last drawOnto()
+                double drawTotMs;                               // total duration of drawOnto() since start
+                int64 nbDraw;                                   // number of drawOnto() since start
+                };
+
+            std::atomic<bool> _showMetrics;     // true to display the metrics overlay
+            std::mutex _metricsMut;             // protect the metrics (read from any thread)
+            std::map<Plotter2DObj *, ObjMetrics> _metrics;   // metrics of the objects
+            double _composeMs;                  // duration of the last compositing of the main image
+            std::chrono::steady_clock::time_point _lastViewUpdate; // time of the last update of the view triggered by a change of quality
+            int64 _nbFrames;                    // number of images composited since the last reset
+
             Fl_Double_Window * _w_mainWin;     // the main window.
             Fl_Group * _w_menuGroup;           // the option window
             Fl_Group * _w_viewGroup;           // the view group
@@ -342,6 +388,9 @@ namespace mtools
             /* reutrn if there is an object that is inserted and suspended at the smae time */
             bool isSuspendedInserted();
 
+            /* give the highest thread priority to the topmost enabled object */
+            void updatePriorities();
+
         };
 
 
@@ -389,6 +438,19 @@ namespace mtools
             return false;
             }
 
+        /* the topmost enabled object is the one we see: its threads get the execution slots first */
+        void Plotter2DWindow::updatePriorities()
+            {
+            bool found = false;
+            for (int i = 0; i < (int)_vecPlot.size(); i++)
+                {
+                const bool top = ((!found) && (_vecPlot[i]->enable()));
+                if (top) found = true;
+                _vecPlot[i]->_threadsPriority(top ? ThreadScheduler::PRIORITY_HIGH : ThreadScheduler::PRIORITY_NORMAL);
+                }
+            }
+
+
         /* add the object in the vector */
         void Plotter2DWindow::add(Plotter2DObj * obj)
             {
@@ -443,6 +505,10 @@ namespace mtools
                         i++;
                         }
                     _vecPlot.resize(_vecPlot.size() - 1); // diminish the vector size by one.
+                        {
+                        std::lock_guard<std::mutex> lock(_metricsMut);
+                        _metrics.erase(obj);
+                        }
                     _w_scrollWin->redraw(); // redraw the option window
                     updateView(); // redraw the view
                     return;
@@ -577,7 +643,7 @@ namespace mtools
 
 
         /* Constructor : Construct the plotter window but do not show it */
-        Plotter2DWindow::Plotter2DWindow(bool addAxes, bool addGrid, int X, int Y, int W, int H) : _mainImage(nullptr), _mainImageQuality(0), _RM(nullptr), _shown(false), _nbchannels(3), _usesolidBK(true), _solidBKcolor(RGBc::c_White), _refreshrate(0), _sensibility(Plotter2D::DEFAULT_SENSIBILITY), _axePlot(nullptr), _gridPlot(nullptr)
+        Plotter2DWindow::Plotter2DWindow(bool addAxes, bool addGrid, int X, int Y, int W, int H) : _mainImage(nullptr), _mainImageQuality(0), _retainedImage(), _retainedTop(-1), _RM(nullptr), _shown(false), _nbchannels(3), _usesolidBK(true), _solidBKcolor(RGBc::c_White), _refreshrate(0), _sensibility(Plotter2D::DEFAULT_SENSIBILITY), _follow(0), _followVersion(0), _showMetrics(false), _metricsMut(), _metrics(), _composeMs(0.0), _nbFrames(0), _axePlot(nullptr), _gridPlot(nullptr)
         {
             convertWindowCoord(W, H, X, Y);
 
@@ -819,7 +885,7 @@ namespace mtools
             setRatioTextLabel();                                     // update the "keep aspect ratio" text
 
             setRefreshRate(0);                                  // no refresh by default
-            Fl::add_timeout(0.1, static_updateViewTimer, this); // set the timer used for updating the view
+            Fl::add_timeout(Drawable2DScheduler::frameMs() / 1000.0, static_updateViewTimer, this); // set the timer used for updating the view
 
             setZoomFactor(1);  // set the view zoom factor to 1
             _w_zoomfactortext->copy_label((std::string("[") + toString(dim.X()) + "x" + toString(dim.Y()) + "]").c_str()); // update the View size text
@@ -895,10 +961,11 @@ namespace mtools
 			#define PLOTTER2D_WAITIME 1
 			#define PLOTTER2D_INITIAL_WAITIME 15
 
+			updatePriorities(); // the objects may have been reordered or enabled/disabled
 			std::this_thread::sleep_for(std::chrono::milliseconds(PLOTTER2D_INITIAL_WAITIME));	// always wait a little to give worker thread time to work. 
 
             int maxretry = (withreset ? PLOTTER2D_NBRETRY_WAIT : 0);
-            if (withreset) _PW->discardImage(); else { _mainImage->checkerboard(); }  // do it now while worker thread continu
+            if (withreset) { _PW->discardImage(); _retainedTop = -1; } else { _mainImage->checkerboard(); }  // do it now while worker thread continu
             if (isSuspendedInserted()) {maxretry /= 5;} // try less if there is a suspended object; 
 			int retry = 0;
 			_mainImageQuality = quality(); // query the current quality
@@ -920,17 +987,48 @@ namespace mtools
 				}
             if (_mainImageQuality > 0)
                 { // ok, there should be something to draw.. (we now interrupt every worker thread)
-                if (_usesolidBK) { _mainImage->clear(((RGBc)_solidBKcolor).getOpaque()); } else { _mainImage->checkerboard(); }// draw the background of the image
+                const auto tc0 = std::chrono::steady_clock::now();
+                // the objects at the bottom of the stack which are completely drawn do not change anymore (until the
+                // next reset) so their composition is retained and only the objects above are blended again.
+                const int n = (int)_vecPlot.size();
+                int k = n;
+                while ((k > 0) && ((!_vecPlot[k - 1]->enable()) || (_vecPlot[k - 1]->quality() == 100))) { k--; }
+                if ((_retainedTop >= 0) && ((k > _retainedTop) || (_retainedImage.dimension() != _mainImage->dimension()))) { _retainedTop = -1; }
                 int q = 100;
-                for (int i = (int)_vecPlot.size(); i > 0; i--)
+                if (k < n)
+                    {
+                    bool complete = true;
+                    if (_retainedTop < 0)
+                        {
+                        _retainedImage.resizeRaw(_mainImage->dimension());
+                        if (_usesolidBK) { _retainedImage.clear(((RGBc)_solidBKcolor).getOpaque()); } else { _retainedImage.checkerboard(); }
+                        _retainedTop = n;
+                        }
+                    for (int i = _retainedTop; i > k; i--)
+                        {
+                        if (_vecPlot[i - 1]->enable()) { const int r = drawLayer(i - 1, _retainedImage); if (r < 100) { complete = false; } if (r < q) { q = r; } }
+                        }
+                    _retainedTop = (complete ? k : -1); // an object was reset meanwhile: the retained image is redone next time
+                    _mainImage->blit(_retainedImage, 0, 0);
+                    }
+                else
+                    {
+                    _retainedTop = -1;
+                    if (_usesolidBK) { _mainImage->clear(((RGBc)_solidBKcolor).getOpaque()); } else { _mainImage->checkerboard(); }// draw the background of the image
+                    }
+                for (int i = k; i > 0; i--)
                     {
                     if (_vecPlot[i - 1]->enable())
                         {
-                        int r = 0;
-                        if (_vecPlot[i - 1]->quality() > 0) { r = _vecPlot[i - 1]->drawOnto(*_mainImage); }
+                        const int r = drawLayer(i - 1, *_mainImage);
                         if (r < q) { q = r; }
                         }
                     }
+                    {
+                    std::lock_guard<std::mutex> lock(_metricsMut);
+                    _composeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tc0).count();
+                    _nbFrames++;
+                    }
                 _mainImageQuality = q;
                 if (_mainImageQuality != 0) // make sure the quality is indeed not zero. 
                     {
@@ -949,30 +1047,189 @@ namespace mtools
 			}
 
 
+        /* draw an object and record the time taken */
+        int Plotter2DWindow::drawLayer(int i, Image & im)
+            {
+            if (_vecPlot[i]->quality() <= 0) return 0;
+            const auto t0 = std::chrono::steady_clock::now();
+            const int r = _vecPlot[i]->drawOnto(im);
+            const double dt = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+            std::lock_guard<std::mutex> lock(_metricsMut);
+            auto it = _metrics.find(_vecPlot[i]);
+            if (it != _metrics.end()) { it->second.drawMs = dt; it->second.drawTotMs += dt; it->second.nbDraw++; }
+            return r;
+            }
+
+
         /* timer used to redraw the view when the quality changes. This timer is always on : created a construction and stoped at destruction time
          * call updateView when the current quality is not zero and differs from the quality of the last image drawn */
         void Plotter2DWindow::static_updateViewTimer(void* p) { if (p == nullptr) { return; } ((Plotter2DWindow *)p)->updateViewTimer(); }
         void Plotter2DWindow::updateViewTimer()
             {
+            if (_follow != 0) followRange();
+            metricsTick();
+            const double frame = Drawable2DScheduler::frameMs() / 1000.0;
             int q = quality();
             if (q != 0)
                 {
                 if (q != (int)_mainImageQuality)
                     {
+                    // redraw at most once per frame, and less often if compositing the image takes more than a quarter of the frame
+                    const auto now = std::chrono::steady_clock::now();
+                    const bool due = (std::chrono::duration<double, std::milli>(now - _lastViewUpdate).count() >= std::max<double>(1000.0 * frame, 4.0 * _composeMs));
                     //if ((q == 100) || (q<_mainImageQuality) || (_mainImageQuality == 0) || (q >= _mainImageQuality + (int)_sensibility)) // redraw when quality is larger OR lower than previous one
-                    if ((q == 100) || (_mainImageQuality == 0) || (q >= _mainImageQuality + (int)_sensibility)) // redraw only when the quality is larger than previous one
+                    if ((q == 100) || (_mainImageQuality == 0) || ((due) && (q >= _mainImageQuality + (int)_sensibility))) // redraw only when the quality is larger than previous one
                         {
+                        _lastViewUpdate = now;
                         updateView(false);
-                        Fl::add_timeout(0.1, static_updateViewTimer, this);
+                        Fl::add_timeout(frame, static_updateViewTimer, this);
                         return;
                         }
                     }
                 if (_PW->zoomFactor() > 1) _PW->improveImageFactor(_mainImage);
                 }
-            Fl::add_timeout(0.1, static_updateViewTimer, this);
+            Fl::add_timeout(frame, static_updateViewTimer, this);
+            }
+
+
+
+        /* follow mode: update the range when the published ranges of the enabled objects changed.
+         * Only the version numbers are read so this is cheap when nothing changed */
+        void Plotter2DWindow::followRange()
+            {
+            uint64 v = 1;
+            for (int i = 0; i < (int)_vecPlot.size(); i++)
+                {
+                v = 31 * v + ((_vecPlot[i]->enable()) ? (uint64)(_vecPlot[i]->publishedRangeVersion() + 1) : 0);
+                }
+            if (v == _followVersion) return;
+            _followVersion = v;
+            switch ((int)_follow)
+                {
+                case 1: { useCommonRangeX(); break; }
+                case 2: { useCommonRangeY(); break; }
+                case 3: { useCommonRangeXY(); break; }
+                }
+            }
+
+
+        /* restart the timing of all the objects */
+        void Plotter2DWindow::metricsReset()
+            {
+            std::lock_guard<std::mutex> lock(_metricsMut);
+            for (auto & M : _metrics) { M.second.quality = -1; } // restart at the next tick
+            _nbFrames = 0;
+            }
+
+
+        /* called by the refresh timer: record the time at which each object reaches a given quality and update the overlay */
+        void Plotter2DWindow::metricsTick()
+            {
+            const auto now = std::chrono::steady_clock::now();
+                {
+                std::lock_guard<std::mutex> lock(_metricsMut);
+                for (int i = 0; i < (int)_vecPlot.size(); i++)
+                    {
+                    Plotter2DObj * obj = _vecPlot[i];
+                    if (!obj->enable()) continue;
+                    const int q = obj->quality();
+                    auto it = _metrics.find(obj);
+                    if (it == _metrics.end()) { it = _metrics.insert(std::make_pair(obj, ObjMetrics())).first; it->second.quality = -1; }
+                    ObjMetrics & M = it->second;
+                    if ((M.quality < 0) || (q < M.quality))
+                        { // new object or the drawing was reset
+                        M.name = obj->name();
+                        M.start = now;
+                        for (int k = 0; k < 4; k++) M.tq[k] = -1.0;
+                        M.ticks = 0; M.busy = 0;
+                        M.drawMs = 0.0; M.drawTotMs = 0.0; M.nbDraw = 0;
+                        }
+                    M.quality = q;
+                    const double t = std::chrono::duration<double, std::milli>(now - M.start).count();
+                    for (int k = 0; k < 4; k++) { if ((M.tq[k] < 0) && (q >= 25 * (k + 1))) M.tq[k] = t; }
+                    M.ticks++;
+                    if (q < 100) M.busy++;
+                    }
+                }
+            _PW->overlayText(_showMetrics ? metricsOverlay() : std::string());
             }
 
 
+        /* the overlay text */
+        std::string Plotter2DWindow::metricsOverlay()
+            {
+            const iVec2 S = ((RangeManager*)_RM)->getWinSize();
+            const auto now = std::chrono::steady_clock::now();
+            std::string txt = "object                q  t50(ms) t100(ms) busy Mpix/s draw(ms)\n";
+            char buf[256];
+            std::lock_guard<std::mutex> lock(_metricsMut);
+            for (int i = 0; i < (int)_vecPlot.size(); i++)
+                {
+                auto it = _metrics.find(_vecPlot[i]);
+                if ((!_vecPlot[i]->enable()) || (it == _metrics.end())) continue;
+                const ObjMetrics & M = it->second;
+                const double el = (M.tq[3] >= 0) ? M.tq[3] : std::chrono::duration<double, std::milli>(now - M.start).count();
+                const double mpix = (el > 0) ? ((double)S.X()*(double)S.Y()*M.quality / 100.0) / (el * 1000.0) : 0.0;
+                snprintf(buf, sizeof(buf), "%-20.20s %3d %8.0f %8.0f %3d%% %6.2f %8.2f\n", M.name.c_str(), M.quality, M.tq[1], M.tq[3],
+                    (int)((M.ticks > 0) ? (100 * M.busy) / M.ticks : 0), mpix, M.drawMs);
+                txt += buf;
+                }
+            snprintf(buf, sizeof(buf), "compositing %.2fms  improve %.2fms  blit %.2fms  frames %lld", _composeMs, _PW->lastImproveTime(), _PW->lastDrawTime(), (long long)_nbFrames);
+            txt += buf;
+            return txt;
+            }
+
+
+        /* metrics in CSV or JSON format */
+        std::string Plotter2DWindow::metricsString(bool json)
+            {
+            const iVec2 S = ((RangeManager*)_RM)->getWinSize();
+            const auto now = std::chrono::steady_clock::now();
+            std::lock_guard<std::mutex> lock(_metricsMut);
+            std::string res;
+            char buf[512];
+            if (json) res = "{\n  \"objects\": [";
+            else res = "name,quality,t25_ms,t50_ms,t75_ms,t100_ms,busy_pct,pixels_per_s,draw_ms,draw_avg_ms\n";
+            bool first = true;
+            for (auto & P : _metrics)
+                {
+                const ObjMetrics & M = P.second;
+                if (M.quality < 0) continue;
+                const double el = (M.tq[3] >= 0) ? M.tq[3] : std::chrono::duration<double, std::milli>(now - M.start).count();
+                const double pps = (el > 0) ? ((double)S.X()*(double)S.Y()*M.quality / 100.0) / (el / 1000.0) : 0.0;
+                const double busy = (M.ticks > 0) ? (100.0 * M.busy) / M.ticks : 0.0;
+                const double avg = (M.nbDraw > 0) ? M.drawTotMs / M.nbDraw : 0.0;
+                std::string name;
+                for (char c : M.name)
+                    {
+                    if (json) { if ((c == '"') || (c == '\\')) name += '\\'; name += c; }
+                    else { if (c == '"') name += '"'; name += c; }
+                    }
+                if (json)
+                    {
+                    snprintf(buf, sizeof(buf), "%s\n    { \"name\": \"%s\", \"quality\": %d, \"t25_ms\": %.3f, \"t50_ms\": %.3f, \"t75_ms\": %.3f, \"t100_ms\": %.3f, \"busy_pct\": %.1f, \"pixels_per_s\": %.0f, \"draw_ms\": %.3f, \"draw_avg_ms\": %.3f }",
+                        (first ? "" : ","), name.c_str(), M.quality, M.tq[0], M.tq[1], M.tq[2], M.tq[3], busy, pps, M.drawMs, avg);
+                    }
+                else
+                    {
+                    snprintf(buf, sizeof(buf), "\"%s\",%d,%.3f,%.3f,%.3f,%.3f,%.1f,%.0f,%.3f,%.3f\n", name.c_str(), M.quality, M.tq[0], M.tq[1], M.tq[2], M.tq[3], busy, pps, M.drawMs, avg);
+                    }
+                res += buf;
+                first = false;
+                }
+            if (json)
+                {
+                snprintf(buf, sizeof(buf), "\n  ],\n  \"width\": %lld, \"height\": %lld, \"frames\": %lld, \"composite_ms\": %.3f, \"improve_ms\": %.3f, \"blit_ms\": %.3f\n}\n",
+                    (long long)S.X(), (long long)S.Y(), (long long)_nbFrames, _composeMs, _PW->lastImproveTime(), _PW->lastDrawTime());
+                }
+            else
+                { // the view itself, in the draw_ms column
+                snprintf(buf, sizeof(buf), "\"(compositing)\",,,,,,,,%.3f,\n\"(improve)\",,,,,,,,%.3f,\n\"(blit)\",,,,,,,,%.3f,\n", _composeMs, _PW->lastImproveTime(), _PW->lastDrawTime());
+                }
+            res += buf;
+            return res;
+            }
+
 
         /* This method is called by the view when there is a key that was pressed */
         void Plotter2DWindow::view2DnotCB_static(void * data, int key) { MTOOLS_ASSERT(data != nullptr); ((Plotter2DWindow *)data)->view2DnotCB(key); }
@@ -983,6 +1240,12 @@ namespace mtools
                 saveImage();
                 return;
                 }
+            if ((key == 'm') || (key == 'M'))
+                { // toggle the metrics overlay
+                _showMetrics = !_showMetrics;
+                metricsTick();
+                return;
+                }
             if (key == FL_Home)
                 {
                 setZoomFactor(getZoomFactor() + 1);
@@ -1035,6 +1298,7 @@ namespace mtools
         void Plotter2DWindow::rangeManagerCB2(fBox2 R, iVec2 winSize,bool fixedAR, bool changedRange, bool changedWinSize, bool changedFixAspectRatio)
             {
             setImageSize((int)winSize.X(), (int)winSize.Y(), _nbchannels);    // resize the image if needed
+            if (changedRange || changedWinSize) metricsReset();     // every drawing restarts
             setRangeInput(R);                                       // update the range widgets
             setRatioTextLabel();                                    // and the aspect ratio text
             _w_fixedratio->value(fixedAR ? 1 : 0);                  // update the fixed apsect ratio checkbox
@@ -2034,6 +2298,29 @@ namespace mtools
         }
 
 
+    void Plotter2D::showMetrics(bool status) { _plotterWin->_showMetrics = status; }
+
+
+    bool Plotter2D::showMetrics() const { return _plotterWin->_showMetrics; }
+
+
+    std::string Plotter2D::metrics(bool json) { return _plotterWin->metricsString(json); }
+
+
+    bool Plotter2D::saveMetrics(const std::string & filename)
+        {
+        const bool json = (filename.size() >= 5) && (toLowerCase(filename.substr(filename.size() - 5)) == ".json");
+        return saveStringToFile(filename, metrics(json));
+        }
+
+
+    void Plotter2D::follow(bool followX, bool followY)
+        {
+        _plotterWin->_followVersion = 0; // force an update at the next tick
+        _plotterWin->_follow = (followX ? 1 : 0) | (followY ? 2 : 0);
+        }
+
+
     int Plotter2D::viewZoomFactor() const { return(_plotterWin->getZoomFactor()); }
 
 
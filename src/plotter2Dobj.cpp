@@ -58,6 +58,10 @@ namespace mtools
             _opacity(1.0),
             _drawOn(true),
             _suspended(false),
+            _headless(false),
+            _pubRange(fBox2()),
+            _pubVersion(0),
+            _pubSeen(0),
             _name(name),
             _nbth(-1),
             _optionWin(nullptr),
@@ -89,6 +93,10 @@ namespace mtools
             _opacity(1.0),
             _drawOn(true),
             _suspended(false),
+            _headless(false),
+            _pubRange((fBox2)obj._pubRange),
+            _pubVersion((int64)obj._pubVersion),
+            _pubSeen(0),
             _name(std::move(obj._name)),
             _nbth(-1),
             _optionWin(nullptr),
@@ -113,14 +121,14 @@ namespace mtools
 
         void Plotter2DObj::name(const std::string & newname)
             {
-            if (!isFltkThread()) // we need to run the method in FLTK
+            if ((!_headless) && (!isFltkThread())) // we need to run the method in FLTK
                 {
                 IndirectMemberProc<Plotter2DObj, const std::string & > proxy(*this, &Plotter2DObj::name, newname); // registers the call
                 runInFltkThread(proxy);
                 return;
                 }
             _name = newname;
-            if ((pnot)_ownercb == nullptr) return;
+            if (((pnot)_ownercb == nullptr) || (_headless)) return;
             _nameBox->copy_label(_name.c_str());
             _nameBox->redraw();
             }
@@ -134,7 +142,7 @@ namespace mtools
 
         void Plotter2DObj::opacity(float op)
             {
-            if (!isFltkThread()) // run the method in FLTK if not in it
+            if ((!_headless) && (!isFltkThread())) // run the method in FLTK if not in it
                 {
                 IndirectMemberProc<Plotter2DObj,float> proxy(*this, &Plotter2DObj::opacity, op); // registers the call
                 runInFltkThread(proxy);
@@ -142,7 +150,7 @@ namespace mtools
                 }
             if (op <= 0.0) op = 0.0; else if (op >= 1.0) op = 1.0;
             _opacity = op;
-            if ((pnot)_ownercb == nullptr) return;  // return if not inserted
+            if (((pnot)_ownercb == nullptr) || (_headless)) return;  // return if not inserted or no widget
             _opacitySlider->value(op);
             refresh();
             }
@@ -153,7 +161,7 @@ namespace mtools
 
         void Plotter2DObj::enable(bool status)
             {
-            if (!isFltkThread()) // run the method in FLTK if not in it
+            if ((!_headless) && (!isFltkThread())) // run the method in FLTK if not in it
               {
               IndirectMemberProc<Plotter2DObj, bool> proxy(*this, &Plotter2DObj::enable, status); // registers the call
               runInFltkThread(proxy);
@@ -163,6 +171,17 @@ namespace mtools
             _suspended = (_drawOn) ? false : true; // override the suspended flag
             if ((pnot)_ownercb == nullptr) return;  // return if not inserted
             MTOOLS_ASSERT(((Drawable2DInterface*)_di) != nullptr);
+            if (_headless)
+                { // no widget to update
+                if ((_drawOn) && (_missedSetParam))
+                    {
+                    ((Drawable2DInterface*)_di)->setParam(_crange, _cwinSize);
+                    _missedSetParam = false;
+                    }
+                ((Drawable2DInterface*)_di)->enableThreads(_drawOn);
+                refresh();
+                return;
+                }
             _onOffButton->value(_drawOn);
             if (_drawOn)
                 {
@@ -202,7 +221,7 @@ namespace mtools
 
         void Plotter2DObj::suspend(bool status)
             {
-            if (!isFltkThread()) // run the method in FLTK if not in it
+            if ((!_headless) && (!isFltkThread())) // run the method in FLTK if not in it
               {
               IndirectMemberProc<Plotter2DObj,bool> proxy(*this, &Plotter2DObj::suspend,status); // registers the call
               runInFltkThread(proxy);
@@ -285,20 +304,33 @@ namespace mtools
 
         fBox2 Plotter2DObj::favouriteRangeX(fBox2 R)
             {
-            return fBox2(); // completely empty rectangle.
+            return _pubRange; // completely empty rectangle if nothing was published.
             }
 
 
         fBox2 Plotter2DObj::favouriteRangeY(fBox2 R)
             {
-            return fBox2(); // completely empty rectangle.
+            return _pubRange; // completely empty rectangle if nothing was published.
             }
 
 
-        bool Plotter2DObj::hasFavouriteRangeX() { return false; }
+        bool Plotter2DObj::hasFavouriteRangeX() { return !(((fBox2)_pubRange).isHorizontallyEmpty()); }
 
 
-        bool Plotter2DObj::hasFavouriteRangeY() { return false; }
+        bool Plotter2DObj::hasFavouriteRangeY() { return !(((fBox2)_pubRange).isVerticallyEmpty()); }
+
+
+        void Plotter2DObj::publishRange(fBox2 R)
+            {
+            _pubRange = R;
+            _pubVersion++; // after the range so a reader seeing the new version also sees the new range
+            }
+
+
+        fBox2 Plotter2DObj::publishedRange() const { return _pubRange; }
+
+
+        int64 Plotter2DObj::publishedRangeVersion() const { return _pubVersion; }
 
 
         void Plotter2DObj::refresh()
@@ -319,6 +351,14 @@ namespace mtools
             }
 
 
+        void Plotter2DObj::_threadsPriority(int prio)
+            {
+            if ((pnot)_ownercb == nullptr) return;  // do nothing if not inserted
+            MTOOLS_ASSERT(((Drawable2DInterface*)_di) != nullptr);
+            ((Drawable2DInterface*)_di)->threadsPriority(prio);
+            }
+
+
         bool Plotter2DObj::needWork() const
             {
             if ((pnot)_ownercb == nullptr) return false;  // do nothing if not inserted
@@ -387,6 +427,7 @@ namespace mtools
 
         void Plotter2DObj::setNameWidgetColor()
             {
+            if (_headless) return; // no widget
             if (!isFltkThread()) // run the method in FLTK if not in it
                 {
                 IndirectMemberProc<Plotter2DObj> proxy(*this, &Plotter2DObj::setNameWidgetColor); // registers the call
@@ -589,6 +630,47 @@ namespace mtools
             }
 
 
+        /* called when we are inserted in an owner without window */
+        void Plotter2DObj::_insertedHeadless(pnot cb, RangeManager * rm, void * data, void * data2, int hintWidth)
+            {
+            if (((pnot)_ownercb) != nullptr) // we are already inserted, detach before going further
+               {
+               MTOOLS_DEBUG("Plotter2DObj::_insertedHeadless, already inserted, we detach before going any further");
+               MTOOLS_ASSERT(((pnot)_ownercb) != cb); // make sure it is a different owner.
+               detach(); // ok, we detach from the previous owner.
+               }
+            _headless = true; // set before the callback so that nothing is forwarded to fltk
+            _ownercb = cb;
+            _data = data;
+            _data2 = data2;
+            _rm = rm;
+            Fl_Group::current(0); // the option window is never shown but it must not be added to some other window.
+            _extOptionWin = nullptr;
+            _di = inserted(_optionWin, hintWidth); // get the drawable object (and the unused option window)
+            MTOOLS_ASSERT((Drawable2DInterface*)_di != nullptr); // the drawable object should exist.
+            setParam(rm->getRange(), rm->getWinSize()); // the owner may not call setParam before the next range change
+            enable(_drawOn);
+            return;
+            }
+
+
+        /* called by the owner without window when detached */
+        void Plotter2DObj::_removedHeadless()
+            {
+            MTOOLS_ASSERT(((pnot)_ownercb) != nullptr); // check that we are indeed inserted.
+            MTOOLS_ASSERT(_headless);
+            ((Drawable2DInterface*)_di)->enableThreads(false);
+            _di = nullptr;
+            removed(_optionWin); // call the virtual function that takes care of deleting _optionWin
+            _optionWin = nullptr;
+            _rm = nullptr;
+            _data = nullptr;
+            _data2 = nullptr;
+            _ownercb = nullptr;     // officially not inserted anymore
+            _headless = false;
+            }
+
+
         /* test whether the option win is inside the extOption Window.*/
         bool Plotter2DObj::_unrolled() const
             {
@@ -648,9 +730,9 @@ namespace mtools
         void Plotter2DObj::_makecallback(int code)
             {
             if (((pnot)_ownercb) == nullptr) return; // does nothing if not inserted.
-            if (isFltkThread())
+            if ((_headless) || (isFltkThread()))
                 {
-                ((pnot)_ownercb)(_data,_data2, this, code); // inside FLTK, we call directly
+                ((pnot)_ownercb)(_data,_data2, this, code); // inside FLTK (or no window), we call directly
                 }
             else
                 {
@@ -767,6 +849,14 @@ namespace mtools
                     _progBar->redraw();
                     }
                 }
+            const int64 pv = _pubVersion;
+            if ((pv != _pubSeen) && (_drawOn))
+                { // a new range was published: the range buttons may have to be activated
+                _pubSeen = pv;
+                if (!hasFavouriteRangeX()) { _useRangeX->deactivate(); } else { _useRangeX->activate(); }
+                if (!hasFavouriteRangeY()) { _useRangeY->deactivate(); } else { _useRangeY->activate(); }
+                if (!((hasFavouriteRangeX()) && (hasFavouriteRangeY()))) { _useRangeXY->deactivate(); } else { _useRangeXY->activate(); }
+                }
             Fl::repeat_timeout(0.1, _timerCB_static, this); // repeat the timer
             }
 
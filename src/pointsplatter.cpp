@@ -0,0 +1,196 @@
+/** @file pointsplatter.cpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "graphics/pointsplatter.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+
+namespace mtools
+{
+
+	namespace internals_graphics
+	{
+
+		/* unique id of a splatter (0 is never used so it marks the empty slots of the thread local tables) */
+		static uint64 newSplatterID()
+			{
+			static std::atomic<uint64> nextid(1);
+			return nextid++;
+			}
+
+	}
+
+
+	PointSplatter::PointSplatter(const fBox2 & domain, int64 lx, int64 ly) : _domain(domain), _lx(lx), _ly(ly), _id(internals_graphics::newSplatterID()), _max(0.0f), _total(0.0)
+		{
+		MTOOLS_INSURE((lx > 0) && (ly > 0));
+		MTOOLS_INSURE((!domain.isEmpty()) && (domain.lx() > 0) && (domain.ly() > 0));
+		_sx = ((double)_lx) / domain.lx();
+		_sy = ((double)_ly) / domain.ly();
+		const size_t N = (size_t)(_lx*_ly);
+		_density.assign(N, 0.0f);
+		_snapshot.reset(new std::atomic<uint32>[N]);
+		for (size_t i = 0; i < N; i++) { _snapshot[i].store(RGBc::c_Transparent.color, std::memory_order_relaxed); }
+		}
+
+
+	PointSplatter::~PointSplatter()
+		{
+		for (auto b : _buffers) delete b;
+		}
+
+
+	void PointSplatter::add(const fVec2 * pos, size_t n)
+		{
+		std::atomic<float> * buf = _threadBuffer();
+		for (size_t k = 0; k < n; k++)
+			{
+			const double fx = (pos[k].X() - _domain.min[0])*_sx, fy = (pos[k].Y() - _domain.min[1])*_sy;
+			if ((!(fx >= 0.0)) || (!(fy >= 0.0)) || (fx >= (double)_lx) || (fy >= (double)_ly)) continue;
+			std::atomic<float> & b = buf[((int64)fy)*_lx + (int64)fx];
+			b.store(b.load(std::memory_order_relaxed) + 1.0f, std::memory_order_relaxed);
+			}
+		}
+
+
+	void PointSplatter::addSmooth(double x, double y, float w)
+		{
+		// position relative to the centers of the bins
+		const double fx = (x - _domain.min[0])*_sx - 0.5, fy = (y - _domain.min[1])*_sy - 0.5;
+		if ((!(fx >= -1.0)) || (!(fy >= -1.0)) || (fx >= (double)_lx) || (fy >= (double)_ly)) return;
+		const int64 i = (int64)std::floor(fx), j = (int64)std::floor(fy);
+		const float ax = (float)(fx - i), ay = (float)(fy - j);
+		const float wb[4] = { (1.0f - ax)*(1.0f - ay)*w, ax*(1.0f - ay)*w, (1.0f - ax)*ay*w, ax*ay*w };
+		std::atomic<float> * buf = _threadBuffer();
+		for (int k = 0; k < 4; k++)
+			{
+			const int64 u = i + (k & 1), v = j + (k >> 1);
+			if ((u < 0) || (v < 0) || (u >= _lx) || (v >= _ly)) continue;
+			std::atomic<float> & b = buf[v*_lx + u];
+			b.store(b.load(std::memory_order_relaxed) + wb[k], std::memory_order_relaxed);
+			}
+		}
+
+
+	void PointSplatter::merge()
+		{
+		std::vector<std::atomic<float> *> bufs;
+			{
+			std::lock_guard<std::mutex> lock(_mut);
+			for (auto b : _buffers) bufs.push_back(b->data.get());
+			}
+		const size_t N = (size_t)(_lx*_ly);
+		std::fill(_density.begin(), _density.end(), 0.0f);
+		for (auto p : bufs)
+			{
+			float * d = _density.data();
+			for (size_t i = 0; i < N; i++) { d[i] += p[i].load(std::memory_order_relaxed); }
+			}
+		float m = 0.0f;
+		double tot = 0.0;
+		for (size_t i = 0; i < N; i++) { const float v = _density[i]; if (v > m) m = v; tot += v; }
+		_max = m;
+		_total = tot;
+		}
+
+
+	void PointSplatter::toneMap(int mode, const Palette & palette)
+		{
+		const size_t N = (size_t)(_lx*_ly);
+		std::vector<RGBc> tmp(N);
+		_toneMap(tmp.data(), _lx, false, mode, palette);
+		for (size_t i = 0; i < N; i++) { _snapshot[i].store(tmp[i].color, std::memory_order_relaxed); }
+		}
+
+
+	void PointSplatter::toneMap(Image & im, int mode, const Palette & palette) const
+		{
+		if ((im.lx() != _lx) || (im.ly() != _ly)) im.resizeRaw(_lx, _ly);
+		_toneMap(im.data(), im.stride(), true, mode, palette);
+		}
+
+
+	void PointSplatter::clear()
+		{
+		std::lock_guard<std::mutex> lock(_mut);
+		const size_t N = (size_t)(_lx*_ly);
+		for (auto b : _buffers)
+			{
+			for (size_t i = 0; i < N; i++) { b->data[i].store(0.0f, std::memory_order_relaxed); }
+			}
+		std::fill(_density.begin(), _density.end(), 0.0f);
+		_max = 0.0f;
+		_total = 0.0;
+		for (size_t i = 0; i < N; i++) { _snapshot[i].store(RGBc::c_Transparent.color, std::memory_order_relaxed); }
+		}
+
+
+	std::atomic<float> * PointSplatter::_findOrCreateBuffer()
+		{
+		std::lock_guard<std::mutex> lock(_mut);
+		const std::thread::id tid = std::this_thread::get_id();
+		for (auto b : _buffers) { if (b->owner == tid) return b->data.get(); }
+		const size_t N = (size_t)(_lx*_ly);
+		_Buffer * b = new _Buffer;
+		b->data.reset(new std::atomic<float>[N]);
+		for (size_t i = 0; i < N; i++) { b->data[i].store(0.0f, std::memory_order_relaxed); }
+		b->owner = tid;
+		_buffers.push_back(b);
+		return b->data.get();
+		}
+
+
+	void PointSplatter::_toneMap(RGBc * out, int64 stride, bool flip, int mode, const Palette & palette) const
+		{
+		MTOOLS_INSURE((mode == TONEMAP_LINEAR) || (mode == TONEMAP_LOG) || (mode == TONEMAP_EQUALIZE));
+		std::vector<float> sorted;
+		if (mode == TONEMAP_EQUALIZE)
+			{
+			for (auto v : _density) { if (v > 0.0f) sorted.push_back(v); }
+			std::sort(sorted.begin(), sorted.end());
+			}
+		const double lmax = std::log1p((double)_max);
+		for (int64 j = 0; j < _ly; j++)
+			{
+			const float * d = _density.data() + j*_lx;
+			RGBc * o = out + (flip ? (_ly - 1 - j) : j)*stride;
+			for (int64 i = 0; i < _lx; i++)
+				{
+				const float v = d[i];
+				if (!(v > 0.0f)) { o[i] = RGBc::c_Transparent; continue; }
+				double t;
+				switch (mode)
+					{
+					case TONEMAP_LINEAR: { t = v / _max; break; }
+					case TONEMAP_LOG: { t = std::log1p((double)v) / lmax; break; }
+					default: { t = ((double)(std::upper_bound(sorted.begin(), sorted.end(), v) - sorted.begin())) / ((double)sorted.size()); break; }
+					}
+				o[i] = palette(t);
+				}
+			}
+		}
+
+
+}
+
+
+/* end of file */
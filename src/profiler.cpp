@@ -0,0 +1,291 @@
+/** @file profiler.cpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "mtools_config.hpp"
+#include "misc/profiler.hpp"
+#include "io/logfile.hpp"
+
+#include <vector>
+#include <map>
+#include <mutex>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+
+namespace mtools
+{
+
+	namespace internals_profiler
+		{
+
+		std::atomic<bool> active(true);
+
+
+		/* size of the (open addressing) table of zones and counters of each thread */
+		static const size_t STAT_SIZE = 512;
+
+
+		struct Event
+			{
+			const char * name;
+			uint64_t start;
+			uint64_t dur;
+			};
+
+
+		struct Stat
+			{
+			const char * name;	// nullptr if the slot is free
+			bool iscounter;
+			uint64_t calls;
+			int64_t total;		// total time in ns for a zone, value for a counter
+			};
+
+
+		/* data of a thread, never freed so that it can still be read after the thread exits */
+		struct ThreadData
+			{
+			ThreadData(int i) : id(i), ring(profiler::RING_SIZE), pos(0), nb(0), stats(STAT_SIZE), lost(0) { lock.clear(); }
+
+			int id;
+			std::atomic_flag lock;		// held while the thread writes (and while the data is read)
+			std::vector<Event> ring;
+			size_t pos;					// next slot in the ring
+			uint64_t nb;				// total number of zones recorded
+			std::vector<Stat> stats;
+			uint64_t lost;				// number of records dropped because the stat table is full
+
+			void acquire() { while (lock.test_and_set(std::memory_order_acquire)) {} }
+			void release() { lock.clear(std::memory_order_release); }
+
+			Stat * find(const char * name, bool iscounter)
+				{
+				size_t h = (size_t)((((uintptr_t)name) >> 3) * 0x9E3779B97F4A7C15ULL) & (STAT_SIZE - 1);
+				for (size_t k = 0; k < STAT_SIZE; k++)
+					{
+					Stat & S = stats[(h + k) & (STAT_SIZE - 1)];
+					if ((S.name == name) && (S.iscounter == iscounter)) return &S;
+					if (S.name == nullptr) { S.name = name; S.iscounter = iscounter; S.calls = 0; S.total = 0; return &S; }
+					}
+				lost++;
+				return nullptr;
+				}
+
+			void clear()
+				{
+				pos = 0; nb = 0; lost = 0;
+				for (auto & S : stats) { S.name = nullptr; }
+				}
+			};
+
+
+		static std::mutex & registryMutex() { static std::mutex m; return m; }
+
+		static std::vector<ThreadData *> & registry() { static std::vector<ThreadData *> R; return R; }
+
+
+		static ThreadData * threadData()
+			{
+			static thread_local ThreadData * td = nullptr;
+			if (td == nullptr)
+				{
+				std::lock_guard<std::mutex> lock(registryMutex());
+				td = new ThreadData((int)registry().size());
+				registry().push_back(td);
+				}
+			return td;
+			}
+
+
+		void zone(const char * name, uint64_t start, uint64_t stop)
+			{
+			ThreadData * td = threadData();
+			const uint64_t dur = stop - start;
+			td->acquire();
+			td->ring[td->pos] = { name, start, dur };
+			td->pos = (td->pos + 1) & (profiler::RING_SIZE - 1);
+			td->nb++;
+			Stat * S = td->find(name, false);
+			if (S) { S->calls++; S->total += (int64_t)dur; }
+			td->release();
+			}
+
+
+		void count(const char * name, int64_t n)
+			{
+			if (!active.load(std::memory_order_relaxed)) return;
+			ThreadData * td = threadData();
+			td->acquire();
+			Stat * S = td->find(name, true);
+			if (S) { S->calls++; S->total += n; }
+			td->release();
+			}
+
+
+		/* format a duration given in ns */
+		static std::string durationStr(double ns)
+			{
+			char buf[64];
+			if (ns < 1.0e3) std::snprintf(buf, sizeof(buf), "%.0fns", ns);
+			else if (ns < 1.0e6) std::snprintf(buf, sizeof(buf), "%.2fus", ns / 1.0e3);
+			else if (ns < 1.0e9) std::snprintf(buf, sizeof(buf), "%.2fms", ns / 1.0e6);
+			else std::snprintf(buf, sizeof(buf), "%.3fs", ns / 1.0e9);
+			return std::string(buf);
+			}
+
+
+		static std::string jsonEscape(const char * s)
+			{
+			std::string r;
+			for (; *s != 0; s++) { if ((*s == '"') || (*s == '\\')) r += '\\'; r += *s; }
+			return r;
+			}
+
+		}
+
+
+	namespace profiler
+		{
+
+		using namespace internals_profiler;
+
+
+		void enable(bool status) { active = status; }
+
+
+		bool enabled() { return ((MTOOLS_USE_PROFILING) && (active.load())); }
+
+
+		void reset()
+			{
+			std::lock_guard<std::mutex> lock(registryMutex());
+			for (auto td : registry()) { td->acquire(); td->clear(); td->release(); }
+			}
+
+
+		std::string summary()
+			{
+			std::ostringstream os;
+			if (!(MTOOLS_USE_PROFILING)) { os << "profiler: compiled out (configure mtools with USE_PROFILING=ON)\n"; return os.str(); }
+			std::map<std::string, Stat> zones, counters;	// merged by name (the same literal may have several addresses)
+			char buf[512];
+			std::lock_guard<std::mutex> lock(registryMutex());
+			for (auto td : registry())
+				{
+				td->acquire();
+				std::vector<Stat> st;
+				for (auto & S : td->stats) { if (S.name != nullptr) st.push_back(S); }
+				const uint64_t lost = td->lost;
+				td->release();
+				if (st.size() == 0) continue;
+				os << "thread " << td->id << "\n";
+				for (auto & S : st)
+					{
+					if (S.iscounter)
+						{
+						std::snprintf(buf, sizeof(buf), "  %-48s %12llu adds  total %lld\n", S.name, (unsigned long long)S.calls, (long long)S.total);
+						Stat & M = counters[S.name]; M.calls += S.calls; M.total += S.total;
+						}
+					else
+						{
+						std::snprintf(buf, sizeof(buf), "  %-48s %12llu calls  total %10s  mean %10s\n", S.name, (unsigned long long)S.calls, durationStr((double)S.total).c_str(), durationStr(((double)S.total) / S.calls).c_str());
+						Stat & M = zones[S.name]; M.calls += S.calls; M.total += S.total;
+						}
+					os << buf;
+					}
+				if (lost > 0) os << "  (" << lost << " records dropped: too many distinct names)\n";
+				}
+			os << "all threads\n";
+			for (auto & Z : zones)
+				{
+				std::snprintf(buf, sizeof(buf), "  %-48s %12llu calls  total %10s  mean %10s\n", Z.first.c_str(), (unsigned long long)Z.second.calls, durationStr((double)Z.second.total).c_str(), durationStr(((double)Z.second.total) / Z.second.calls).c_str());
+				os << buf;
+				}
+			for (auto & C : counters)
+				{
+				std::snprintf(buf, sizeof(buf), "  %-48s %12llu adds  total %lld\n", C.first.c_str(), (unsigned long long)C.second.calls, (long long)C.second.total);
+				os << buf;
+				}
+			return os.str();
+			}
+
+
+		void dump(LogFile & log)
+			{
+			log << summary();
+			}
+
+
+		bool saveChromeTrace(const std::string & filename)
+			{
+			std::ofstream f(filename);
+			if (!f) return false;
+			f << "{\"traceEvents\":[";
+			bool first = true;
+			uint64_t t0 = 0, tmax = 0;
+			std::lock_guard<std::mutex> lock(registryMutex());
+			for (int pass = 0; pass < 2; pass++)
+				{ // first pass: find the origin of time, second pass: write the events
+				for (auto td : registry())
+					{
+					td->acquire();
+					const size_t n = (td->nb < profiler::RING_SIZE) ? (size_t)td->nb : profiler::RING_SIZE;
+					size_t i = (td->pos + profiler::RING_SIZE - n) & (profiler::RING_SIZE - 1);
+					for (size_t k = 0; k < n; k++, i = (i + 1) & (profiler::RING_SIZE - 1))
+						{
+						const Event & E = td->ring[i];
+						if (pass == 0)
+							{
+							if ((t0 == 0) || (E.start < t0)) t0 = E.start;
+							if (E.start + E.dur > tmax) tmax = E.start + E.dur;
+							continue;
+							}
+						char buf[128];
+						std::snprintf(buf, sizeof(buf), "\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d}", (E.start - t0) / 1000.0, E.dur / 1000.0, td->id);
+						f << (first ? "\n" : ",\n") << "{\"name\":\"" << jsonEscape(E.name) << "\",\"ph\":\"X\"," << buf;
+						first = false;
+						}
+					if (pass == 1)
+						{
+						for (auto & S : td->stats)
+							{
+							if ((S.name == nullptr) || (!S.iscounter)) continue;
+							char buf[128];
+							std::snprintf(buf, sizeof(buf), "\"ts\":%.3f,\"pid\":1,\"tid\":%d,\"args\":{\"value\":%lld}}", (tmax - t0) / 1000.0, td->id, (long long)S.total);
+							f << (first ? "\n" : ",\n") << "{\"name\":\"" << jsonEscape(S.name) << "\",\"ph\":\"C\"," << buf;
+							first = false;
+							}
+						}
+					td->release();
+					}
+				}
+			f << "\n],\"displayTimeUnit\":\"ns\"}\n";
+			return (bool)f;
+			}
+
+		}
+
+}
+
+
+/* end of file */
+
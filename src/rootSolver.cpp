@@ -25,6 +25,13 @@
 #include <math.h>
 
 
+/* SSE2 is always available on x64 (and on x86 when the compiler targets it) */
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+	#define MTOOLS_ROOTSOLVER_SSE2 1
+	#include <emmintrin.h>
+#endif
+
+
 namespace mtools
 {
 
@@ -74,30 +81,9 @@ int gsl_poly_solve_quadratic (double a, double b, double c, double *x0, double *
 
 
 
-int gsl_poly_solve_cubic(double k, double a, double b, double c, double *x0, double *x1, double *x2)
+/* end of gsl_poly_solve_cubic() once the polynomial is normalized (x^3 + a.x^2 + b.x + c) */
+static int _cubic_finish(double a, double R, double Q, double Q3, double R2, double CR2, double CQ3, double *x0, double *x1, double *x2)
 	{
-
-	if (k == 0)
-		{ // quadratic case 
-		return gsl_poly_solve_quadratic(a, b, c, x0, x1);
-		}
-	// normalize 
-	a /= k; 
-	b /= k;
-	c /= k;
-
-	double q = (a * a - 3 * b);
-	double r = (2 * a * a * a - 9 * a * b + 27 * c);
-
-	double Q = q / 9;
-	double R = r / 54;
-
-	double Q3 = Q * Q * Q;
-	double R2 = R * R;
-
-	double CR2 = 729 * r * r;
-	double CQ3 = 2916 * q * q * q;
-
 	if (R == 0 && Q == 0)
 		{
 		*x0 = -a / 3;
@@ -156,6 +142,136 @@ int gsl_poly_solve_cubic(double k, double a, double b, double c, double *x0, dou
 	}
 
 
+int gsl_poly_solve_cubic(double k, double a, double b, double c, double *x0, double *x1, double *x2)
+	{
+
+	if (k == 0)
+		{ // quadratic case 
+		return gsl_poly_solve_quadratic(a, b, c, x0, x1);
+		}
+	// normalize 
+	a /= k; 
+	b /= k;
+	c /= k;
+
+	double q = (a * a - 3 * b);
+	double r = (2 * a * a * a - 9 * a * b + 27 * c);
+
+	double Q = q / 9;
+	double R = r / 54;
+
+	double Q3 = Q * Q * Q;
+	double R2 = R * R;
+
+	double CR2 = 729 * r * r;
+	double CQ3 = 2916 * q * q * q;
+
+	return _cubic_finish(a, R, Q, Q3, R2, CR2, CQ3, x0, x1, x2);
+	}
+
+
+void gsl_poly_solve_quadratic(const double * a, const double * b, const double * c, size_t n, int * nb, double * x0, double * x1)
+	{
+	size_t i = 0;
+#if (MTOOLS_ROOTSOLVER_SSE2)
+	// same computations as the scalar version, all the branches are evaluated and the results selected with masks.
+	const __m128d zero = _mm_setzero_pd();
+	const __m128d one = _mm_set1_pd(1.0);
+	const __m128d four = _mm_set1_pd(4.0);
+	const __m128d mhalf = _mm_set1_pd(-0.5);
+	const __m128d signbit = _mm_set1_pd(-0.0);
+	for (; i + 2 <= n; i += 2)
+		{
+		const __m128d A = _mm_loadu_pd(a + i), B = _mm_loadu_pd(b + i), C = _mm_loadu_pd(c + i);
+		const __m128d lin = _mm_cmpeq_pd(A, zero);								// a == 0
+		const __m128d bz = _mm_cmpeq_pd(B, zero);								// b == 0
+		const __m128d disc = _mm_sub_pd(_mm_mul_pd(B, B), _mm_mul_pd(_mm_mul_pd(four, A), C));
+		const __m128d pos = _mm_andnot_pd(lin, _mm_cmpgt_pd(disc, zero));		// two distinct roots
+		const __m128d dbl = _mm_andnot_pd(lin, _mm_cmpeq_pd(disc, zero));		// double root
+		const __m128d one_root = _mm_andnot_pd(bz, lin);						// linear case
+		// b != 0 and disc > 0
+		const __m128d sgnb = _mm_or_pd(_mm_and_pd(_mm_cmpgt_pd(B, zero), one), _mm_andnot_pd(_mm_cmpgt_pd(B, zero), _mm_set1_pd(-1.0)));
+		const __m128d temp = _mm_mul_pd(mhalf, _mm_add_pd(B, _mm_mul_pd(sgnb, _mm_sqrt_pd(disc))));
+		const __m128d r1 = _mm_div_pd(temp, A), r2 = _mm_div_pd(C, temp);
+		__m128d lo = _mm_min_pd(r1, r2), hi = _mm_max_pd(r2, r1);
+		// b == 0 and disc > 0
+		const __m128d r = _mm_sqrt_pd(_mm_div_pd(_mm_xor_pd(C, signbit), A));
+		lo = _mm_or_pd(_mm_and_pd(bz, _mm_xor_pd(r, signbit)), _mm_andnot_pd(bz, lo));
+		hi = _mm_or_pd(_mm_and_pd(bz, r), _mm_andnot_pd(bz, hi));
+		// disc == 0
+		const __m128d d = _mm_div_pd(_mm_mul_pd(mhalf, B), A);
+		lo = _mm_or_pd(_mm_and_pd(dbl, d), _mm_andnot_pd(dbl, lo));
+		hi = _mm_or_pd(_mm_and_pd(dbl, d), _mm_andnot_pd(dbl, hi));
+		// linear case
+		lo = _mm_or_pd(_mm_and_pd(one_root, _mm_div_pd(_mm_xor_pd(C, signbit), B)), _mm_andnot_pd(one_root, lo));
+		// store (keeping the previous values where there is no root)
+		const __m128d two = _mm_or_pd(pos, dbl);
+		const __m128d w0 = _mm_or_pd(two, one_root);
+		_mm_storeu_pd(x0 + i, _mm_or_pd(_mm_and_pd(w0, lo), _mm_andnot_pd(w0, _mm_loadu_pd(x0 + i))));
+		_mm_storeu_pd(x1 + i, _mm_or_pd(_mm_and_pd(two, hi), _mm_andnot_pd(two, _mm_loadu_pd(x1 + i))));
+		if (nb != nullptr)
+			{
+			const int m2 = _mm_movemask_pd(two), m1 = _mm_movemask_pd(one_root);
+			nb[i] = ((m2 & 1) ? 2 : ((m1 & 1) ? 1 : 0));
+			nb[i + 1] = ((m2 & 2) ? 2 : ((m1 & 2) ? 1 : 0));
+			}
+		}
+#endif
+	for (; i < n; i++)
+		{
+		const int k = gsl_poly_solve_quadratic(a[i], b[i], c[i], x0 + i, x1 + i);
+		if (nb != nullptr) nb[i] = k;
+		}
+	}
+
+
+void gsl_poly_solve_cubic(const double * k, const double * a, const double * b, const double * c, size_t n, int * nb, double * x0, double * x1, double * x2)
+	{
+	const size_t BLOCK = 16;
+	double na[BLOCK], q[BLOCK], r[BLOCK];
+	size_t deg[BLOCK]; // indices of the degenerate polynomials
+	for (size_t i0 = 0; i0 < n; i0 += BLOCK)
+		{
+		const size_t len = ((n - i0) < BLOCK) ? (n - i0) : BLOCK;
+		// normalization (branchless, vectorized by the compiler). Degenerate lanes give garbage that is ignored.
+		for (size_t j = 0; j < len; j++)
+			{
+			const double kk = k[i0 + j];
+			const double aa = a[i0 + j] / kk, bb = b[i0 + j] / kk, cc = c[i0 + j] / kk;
+			na[j] = aa;
+			q[j] = (aa * aa - 3 * bb);
+			r[j] = (2 * aa * aa * aa - 9 * aa * bb + 27 * cc);
+			}
+		size_t nbdeg = 0;
+		for (size_t j = 0; j < len; j++)
+			{
+			const size_t i = i0 + j;
+			if (k[i] == 0) { deg[nbdeg++] = i; continue; }
+			const double Q = q[j] / 9, R = r[j] / 54;
+			const int res = _cubic_finish(na[j], R, Q, Q * Q * Q, R * R, 729 * r[j] * r[j], 2916 * q[j] * q[j] * q[j], x0 + i, x1 + i, x2 + i);
+			if (nb != nullptr) nb[i] = res;
+			}
+		if (nbdeg > 0)
+			{ // quadratic cases: gather, solve together and scatter
+			double qa[BLOCK], qb[BLOCK], qc[BLOCK], qx0[BLOCK], qx1[BLOCK];
+			int qnb[BLOCK];
+			for (size_t j = 0; j < nbdeg; j++)
+				{
+				const size_t i = deg[j];
+				qa[j] = a[i]; qb[j] = b[i]; qc[j] = c[i]; qx0[j] = x0[i]; qx1[j] = x1[i];
+				}
+			gsl_poly_solve_quadratic(qa, qb, qc, nbdeg, qnb, qx0, qx1);
+			for (size_t j = 0; j < nbdeg; j++)
+				{
+				const size_t i = deg[j];
+				x0[i] = qx0[j]; x1[i] = qx1[j];
+				if (nb != nullptr) nb[i] = qnb[j];
+				}
+			}
+		}
+	}
+
+
 
 }
 
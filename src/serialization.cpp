@@ -18,20 +18,540 @@
 // along with mtools  If not, see <http://www.gnu.org/licenses/>.
 
 
+#include "mtools_config.hpp"
 #include "io/serialization.hpp"
+#include "misc/internal/threadworker.hpp"
+#include "misc/profiler.hpp"
 
 #include <zlib.h>       // fltk zlib
 
+#if (MTOOLS_USE_ZSTD)
+#include <zstd.h>
+#endif
+
+#if (MTOOLS_USE_LZ4)
+#include <lz4frame.h>
+#endif
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <fstream>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+
 
 namespace mtools
 	{
 
 
 
-	OFileArchive::OFileArchive(const std::string & filename) : OBaseArchive(), _filename(filename), _compress(false), _handle(nullptr)
+	namespace internals_serialization
 		{
-		std::string ext = toLowerCase(extractExtension(filename));
-		if ((ext == std::string("gz")) || (ext == std::string("gzip")) || (ext == std::string("z"))) { _compress = true; }
+
+		/* gzip member header with an extra field 'M','T' containing the compressed and uncompressed sizes */
+		static const size_t GZMEMBER_HEADER_SIZE = 10 + 2 + 4 + 16;
+		static const size_t GZMEMBER_TRAILER_SIZE = 8;
+		static const size_t GZMEMBER_MAXBLOCK = ((size_t)1) << 30;	// max number of bytes given to zlib at once
+
+		static inline void _putLE(char * p, uint64 v, size_t nb) { for (size_t i = 0; i < nb; i++) { p[i] = (char)(v & 0xFF); v >>= 8; } }
+
+		static inline uint64 _getLE(const char * p, size_t nb) { uint64 v = 0; for (size_t i = nb; i > 0; i--) { v = (v << 8) | ((uint64)((unsigned char)p[i - 1])); } return v; }
+
+		/* crc32 of a (possibly large) buffer */
+		static uint32 _crc32(const char * buf, size_t len)
+			{
+			uLong crc = crc32(0L, Z_NULL, 0);
+			while (len > 0) { const size_t l = (len > GZMEMBER_MAXBLOCK) ? GZMEMBER_MAXBLOCK : len; crc = crc32(crc, (const Bytef *)buf, (uInt)l); buf += l; len -= l; }
+			return (uint32)crc;
+			}
+
+		/* compress a buffer into a complete gzip member */
+		static std::string _gzipMember(const std::string & raw, int level)
+			{
+			z_stream strm;
+			strm.zalloc = Z_NULL;
+			strm.zfree = Z_NULL;
+			strm.opaque = Z_NULL;
+			if (deflateInit2(&strm, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) { MTOOLS_THROW("OParallelFileArchive error (deflateInit)"); }
+			std::string res;
+			res.resize(GZMEMBER_HEADER_SIZE + (raw.size() + (raw.size() >> 8) + 1024) + GZMEMBER_TRAILER_SIZE);
+			size_t in = 0, out = GZMEMBER_HEADER_SIZE;
+			int ret;
+			do
+				{
+				if (res.size() - out - GZMEMBER_TRAILER_SIZE < 1024) { res.resize(res.size() * 2); }
+				const size_t lin = ((raw.size() - in) > GZMEMBER_MAXBLOCK) ? GZMEMBER_MAXBLOCK : (raw.size() - in);
+				const size_t avout = res.size() - out - GZMEMBER_TRAILER_SIZE;
+				const size_t lout = (avout > GZMEMBER_MAXBLOCK) ? GZMEMBER_MAXBLOCK : avout;
+				strm.next_in = (Bytef *)(raw.data() + in);
+				strm.avail_in = (uInt)lin;
+				strm.next_out = (Bytef *)(&res[out]);
+				strm.avail_out = (uInt)lout;
+				ret = deflate(&strm, ((in + lin == raw.size()) ? Z_FINISH : Z_NO_FLUSH));
+				if (ret == Z_STREAM_ERROR) { deflateEnd(&strm); MTOOLS_THROW("OParallelFileArchive error (deflate)"); }
+				in += lin - strm.avail_in;
+				out += lout - strm.avail_out;
+				}
+			while (ret != Z_STREAM_END);
+			deflateEnd(&strm);
+			const uint64 csize = out - GZMEMBER_HEADER_SIZE;
+			char * h = &res[0];
+			h[0] = (char)0x1f; h[1] = (char)0x8b; h[2] = 8; h[3] = 4;	// magic, deflate, FEXTRA
+			_putLE(h + 4, 0, 4);										// no time stamp
+			h[8] = 0; h[9] = (char)0xff;								// unknown OS
+			_putLE(h + 10, 20, 2);										// XLEN
+			h[12] = 'M'; h[13] = 'T'; _putLE(h + 14, 16, 2);			// subfield id and length
+			_putLE(h + 16, csize, 8);
+			_putLE(h + 24, (uint64)raw.size(), 8);
+			_putLE(&res[out], _crc32(raw.data(), raw.size()), 4);
+			_putLE(&res[out + 4], (uint64)(raw.size() & 0xFFFFFFFF), 4);
+			res.resize(out + GZMEMBER_TRAILER_SIZE);
+			return res;
+			}
+
+
+		/* implementation of IParallelFileArchive */
+		struct IParallelFileArchiveImpl
+			{
+			struct Member { uint64 offset; uint64 csize; uint64 rsize; };
+
+			std::string					_filename;
+			std::vector<Member>			_members;	// list of member (empty when falling back to sequential reading)
+			void *						_gzhandle;	// gzfile handle when reading sequentially
+			std::vector<char>			_gzbuffer;	// read buffer when reading sequentially
+			std::vector<std::string>	_slots;		// decompressed members
+			std::vector<char>			_ready;		// flag for each decompressed member
+			std::vector<std::thread *>	_threads;	// worker threads
+			std::mutex					_mut;
+			std::condition_variable		_cv;
+			size_t						_next;		// next member to decompress
+			size_t						_cur;		// next member to return
+			size_t						_window;	// max number of members decompressed ahead
+			bool						_abort;
+			std::exception_ptr			_err;
+
+			static const size_t GZIPBUFFERSIZE = 512000;
+
+			IParallelFileArchiveImpl(const std::string & filename, size_t nbThreads) : _filename(filename), _gzhandle(nullptr), _next(0), _cur(0), _abort(false)
+				{
+				if (nbThreads == 0) { nbThreads = (size_t)nbHardwareThreads(); }
+				_window = 4 * nbThreads;
+				if (!_scan())
+					{ // not created by OParallelFileArchive: read sequentially
+					_members.clear();
+					_gzhandle = gzopen(_filename.c_str(), "rb");
+					if (_gzhandle == nullptr) { MTOOLS_THROW("IParallelFileArchive error (openfile 1)"); }
+					if (gzbuffer((gzFile)_gzhandle, (unsigned int)GZIPBUFFERSIZE) != 0) { gzclose((gzFile)_gzhandle); MTOOLS_THROW("IParallelFileArchive error (openfile 2)"); }
+					_gzbuffer.resize(GZIPBUFFERSIZE);
+					return;
+					}
+				_slots.resize(_members.size());
+				_ready.resize(_members.size(), 0);
+				if (nbThreads > _members.size()) { nbThreads = _members.size(); }
+				for (size_t i = 0; i < nbThreads; i++) { _threads.push_back(new std::thread(&IParallelFileArchiveImpl::_work, this)); }
+				}
+
+			~IParallelFileArchiveImpl()
+				{
+				{
+				std::unique_lock<std::mutex> lock(_mut);
+				_abort = true;
+				}
+				_cv.notify_all();
+				for (auto th : _threads) { th->join(); delete th; }
+				if (_gzhandle != nullptr) { gzclose((gzFile)_gzhandle); }
+				}
+
+			/* read the list of members. return false if the file was not created by OParallelFileArchive */
+			bool _scan()
+				{
+				std::ifstream f(_filename, std::ios::binary);
+				if (!f.is_open()) { MTOOLS_THROW("IParallelFileArchive error (cannot open file)"); }
+				uint64 offset = 0;
+				while (1)
+					{
+					char h[GZMEMBER_HEADER_SIZE];
+					f.read(h, GZMEMBER_HEADER_SIZE);
+					if ((f.gcount() == 0) && (f.eof())) { return (_members.size() > 0); }
+					if ((size_t)f.gcount() != GZMEMBER_HEADER_SIZE) { return false; }
+					if ((h[0] != (char)0x1f) || (h[1] != (char)0x8b) || (h[2] != 8) || (h[3] != 4)) { return false; }
+					if ((_getLE(h + 10, 2) != 20) || (h[12] != 'M') || (h[13] != 'T') || (_getLE(h + 14, 2) != 16)) { return false; }
+					Member m;
+					m.offset = offset + GZMEMBER_HEADER_SIZE;
+					m.csize = _getLE(h + 16, 8);
+					m.rsize = _getLE(h + 24, 8);
+					_members.push_back(m);
+					offset = m.offset + m.csize + GZMEMBER_TRAILER_SIZE;
+					f.seekg((std::streamoff)offset, std::ios::beg);
+					if (!f.good()) { return false; }
+					}
+				}
+
+			/* decompress member i into res */
+			void _inflate(std::ifstream & f, size_t i, std::string & res)
+				{
+				const Member & m = _members[i];
+				std::string comp((size_t)(m.csize + GZMEMBER_TRAILER_SIZE), '\0');
+				f.seekg((std::streamoff)m.offset, std::ios::beg);
+				f.read(&comp[0], (std::streamsize)comp.size());
+				if ((uint64)f.gcount() != comp.size()) { MTOOLS_THROW("IParallelFileArchive error (truncated file)"); }
+				res.resize((size_t)m.rsize);
+				z_stream strm;
+				strm.zalloc = Z_NULL;
+				strm.zfree = Z_NULL;
+				strm.opaque = Z_NULL;
+				strm.avail_in = 0;
+				strm.next_in = Z_NULL;
+				if (inflateInit2(&strm, -15) != Z_OK) { MTOOLS_THROW("IParallelFileArchive error (inflateInit)"); }
+				size_t in = 0, out = 0;
+				int ret = Z_OK;
+				while (ret != Z_STREAM_END)
+					{
+					const size_t lin = ((m.csize - in) > GZMEMBER_MAXBLOCK) ? GZMEMBER_MAXBLOCK : (size_t)(m.csize - in);
+					const size_t lout = ((m.rsize - out) > GZMEMBER_MAXBLOCK) ? GZMEMBER_MAXBLOCK : (size_t)(m.rsize - out);
+					char dummy;
+					strm.next_in = (Bytef *)(comp.data() + in);
+					strm.avail_in = (uInt)lin;
+					strm.next_out = (Bytef *)((lout > 0) ? &res[out] : &dummy);
+					strm.avail_out = (uInt)((lout > 0) ? lout : 1);
+					ret = inflate(&strm, Z_NO_FLUSH);
+					if ((ret != Z_OK) && (ret != Z_STREAM_END)) { inflateEnd(&strm); MTOOLS_THROW("IParallelFileArchive error (inflate)"); }
+					if ((lout == 0) && (strm.avail_out == 0)) { inflateEnd(&strm); MTOOLS_THROW("IParallelFileArchive error (member too long)"); }
+					in += lin - strm.avail_in;
+					out += ((lout > 0) ? lout : 1) - strm.avail_out;
+					if ((lin == 0) && (ret != Z_STREAM_END)) { inflateEnd(&strm); MTOOLS_THROW("IParallelFileArchive error (truncated member)"); }
+					}
+				inflateEnd(&strm);
+				if ((out != m.rsize) || (_getLE(comp.data() + m.csize, 4) != _crc32(res.data(), res.size()))) { MTOOLS_THROW("IParallelFileArchive error (corrupted member)"); }
+				}
+
+			/* worker thread */
+			void _work()
+				{
+				try
+					{
+					std::ifstream f(_filename, std::ios::binary);
+					if (!f.is_open()) { MTOOLS_THROW("IParallelFileArchive error (cannot open file)"); }
+					while (1)
+						{
+						size_t i;
+						{
+						std::unique_lock<std::mutex> lock(_mut);
+						_cv.wait(lock, [&] { return ((_abort) || (_next >= _members.size()) || (_next < _cur + _window)); });
+						if ((_abort) || (_next >= _members.size())) return;
+						i = _next++;
+						}
+						std::string res;
+						_inflate(f, i, res);
+						{
+						std::unique_lock<std::mutex> lock(_mut);
+						_slots[i].swap(res);
+						_ready[i] = 1;
+						}
+						_cv.notify_all();
+						}
+					}
+				catch (...)
+					{
+					{
+					std::unique_lock<std::mutex> lock(_mut);
+					if (!_err) { _err = std::current_exception(); }
+					_abort = true;
+					}
+					_cv.notify_all();
+					}
+				}
+
+			/* return the next buffer */
+			const char * refill(size_t & len)
+				{
+				if (_gzhandle != nullptr)
+					{
+					int l = gzread((gzFile)_gzhandle, _gzbuffer.data(), (unsigned int)_gzbuffer.size());
+					if (l < 0) { MTOOLS_THROW("IParallelFileArchive error (gzread)"); }
+					len = (size_t)l;
+					return ((len == 0) ? nullptr : _gzbuffer.data());
+					}
+				std::unique_lock<std::mutex> lock(_mut);
+				while (1)
+					{
+					if ((_cur > 0) && (_cur <= _slots.size())) { std::string().swap(_slots[_cur - 1]); } // release the previous buffer
+					if (_cur >= _members.size()) { len = 0; return nullptr; }
+					_cv.wait(lock, [&] { return ((_ready[_cur] != 0) || (_abort)); });
+					if (_err) { std::rethrow_exception(_err); }
+					if (_ready[_cur] == 0) { MTOOLS_THROW("IParallelFileArchive error (aborted)"); }
+					const size_t i = _cur++;
+					_cv.notify_all(); // a new member can be decompressed
+					if (_slots[i].size() > 0) { len = _slots[i].size(); return _slots[i].data(); }
+					}
+				}
+
+			};
+
+
+		}
+
+
+	namespace internals_serialization
+		{
+
+		/* output stream used by OFileArchive */
+		class CodecWriter
+			{
+			public:
+				virtual ~CodecWriter() {}
+				virtual bool write(const char * buf, size_t len) = 0;	// return false on error
+				virtual bool close() = 0;								// flush and close the file. return false on error
+			};
+
+
+		/* input stream used by IFileArchive */
+		class CodecReader
+			{
+			public:
+				virtual ~CodecReader() {}
+				virtual int64 read(char * buf, size_t len) = 0;		// return the number of bytes read, 0 at end of file and -1 on error
+			};
+
+
+		static const size_t CODEC_BUFFERSIZE = 512000;
+
+
+		/* plain file */
+		class PlainWriter : public CodecWriter
+			{
+			public:
+				PlainWriter(FILE * f) : _f(f) {}
+				virtual ~PlainWriter() { if (_f != nullptr) fclose(_f); }
+				virtual bool write(const char * buf, size_t len) override { return (fwrite(buf, 1, len, _f) == len); }
+				virtual bool close() override { const bool ok = (fclose(_f) == 0); _f = nullptr; return ok; }
+			private:
+				FILE * _f;
+			};
+
+
+		/* gzip (zlib) */
+		class GzipWriter : public CodecWriter
+			{
+			public:
+				GzipWriter(gzFile f) : _f(f) {}
+				virtual ~GzipWriter() { if (_f != nullptr) gzclose(_f); }
+				virtual bool write(const char * buf, size_t len) override
+					{
+					while (len > 0)
+						{ // gzwrite takes an unsigned int
+						const size_t l = (len > GZMEMBER_MAXBLOCK) ? GZMEMBER_MAXBLOCK : len;
+						if ((size_t)gzwrite(_f, buf, (unsigned int)l) != l) return false;
+						buf += l; len -= l;
+						}
+					return true;
+					}
+				virtual bool close() override { const bool ok = (gzclose(_f) == Z_OK); _f = nullptr; return ok; }
+			private:
+				gzFile _f;
+			};
+
+
+		/* gzip reader, also reads plain files */
+		class GzipReader : public CodecReader
+			{
+			public:
+				GzipReader(gzFile f) : _f(f) {}
+				virtual ~GzipReader() { gzclose(_f); }
+				virtual int64 read(char * buf, size_t len) override { return (int64)gzread(_f, buf, (unsigned int)len); }
+			private:
+				gzFile _f;
+			};
+
+
+#if (MTOOLS_USE_ZSTD)
+
+		/* zstd, the frame is closed by close() */
+		class ZstdWriter : public CodecWriter
+			{
+			public:
+				ZstdWriter(FILE * f, int level, int nbThreads) : _f(f), _cctx(nullptr), _out(ZSTD_CStreamOutSize())
+					{
+					_cctx = ZSTD_createCCtx();
+					if (_cctx == nullptr) { fclose(_f); MTOOLS_THROW("OFileArchive error (zstd context)"); }
+					ZSTD_CCtx_setParameter(_cctx, ZSTD_c_compressionLevel, level);
+					if (nbThreads > 1) { ZSTD_CCtx_setParameter(_cctx, ZSTD_c_nbWorkers, nbThreads); } // ignored if libzstd was built without multithreading
+					}
+				virtual ~ZstdWriter() { ZSTD_freeCCtx(_cctx); if (_f != nullptr) fclose(_f); }
+				virtual bool write(const char * buf, size_t len) override
+					{
+					ZSTD_inBuffer in = { buf, len, 0 };
+					while (in.pos < in.size) { if (!_compress(in, ZSTD_e_continue)) return false; }
+					return true;
+					}
+				virtual bool close() override
+					{
+					ZSTD_inBuffer in = { nullptr, 0, 0 };
+					bool ok = true;
+					while (1)
+						{
+						size_t r;
+						if (!_compress(in, ZSTD_e_end, &r)) { ok = false; break; }
+						if (r == 0) break;
+						}
+					if (fclose(_f) != 0) ok = false;
+					_f = nullptr;
+					return ok;
+					}
+			private:
+				bool _compress(ZSTD_inBuffer & in, ZSTD_EndDirective mode, size_t * remaining = nullptr)
+					{
+					ZSTD_outBuffer out = { _out.data(), _out.size(), 0 };
+					const size_t r = ZSTD_compressStream2(_cctx, &out, &in, mode);
+					if (ZSTD_isError(r)) return false;
+					if (remaining != nullptr) *remaining = r;
+					return (fwrite(_out.data(), 1, out.pos, _f) == out.pos);
+					}
+				FILE * _f;
+				ZSTD_CCtx * _cctx;
+				std::vector<char> _out;
+			};
+
+
+		/* zstd reader (successive frames are decompressed one after the other) */
+		class ZstdReader : public CodecReader
+			{
+			public:
+				ZstdReader(FILE * f) : _f(f), _dctx(nullptr), _in(ZSTD_DStreamInSize()), _pos(0), _size(0)
+					{
+					_dctx = ZSTD_createDCtx();
+					if (_dctx == nullptr) { fclose(_f); MTOOLS_THROW("IFileArchive error (zstd context)"); }
+					}
+				virtual ~ZstdReader() { ZSTD_freeDCtx(_dctx); fclose(_f); }
+				virtual int64 read(char * buf, size_t len) override
+					{
+					ZSTD_outBuffer out = { buf, len, 0 };
+					while (out.pos == 0)
+						{
+						if (_pos == _size)
+							{
+							_size = fread(_in.data(), 1, _in.size(), _f);
+							_pos = 0;
+							if (_size == 0) return (ferror(_f) ? -1 : 0);
+							}
+						ZSTD_inBuffer in = { _in.data(), _size, _pos };
+						const size_t r = ZSTD_decompressStream(_dctx, &out, &in);
+						if (ZSTD_isError(r)) return -1;
+						_pos = in.pos;
+						}
+					return (int64)out.pos;
+					}
+			private:
+				FILE * _f;
+				ZSTD_DCtx * _dctx;
+				std::vector<char> _in;
+				size_t _pos, _size;
+			};
+
+#endif
+
+
+#if (MTOOLS_USE_LZ4)
+
+		/* lz4 frame, the frame is closed by close() */
+		class Lz4Writer : public CodecWriter
+			{
+			public:
+				Lz4Writer(FILE * f, int level) : _f(f), _cctx(nullptr), _out()
+					{
+					memset(&_prefs, 0, sizeof(_prefs));
+					_prefs.compressionLevel = level;
+					_prefs.frameInfo.blockSizeID = LZ4F_max4MB;
+					if (LZ4F_isError(LZ4F_createCompressionContext(&_cctx, LZ4F_VERSION))) { fclose(_f); MTOOLS_THROW("OFileArchive error (lz4 context)"); }
+					_out.resize(LZ4F_compressBound(CHUNK, &_prefs));
+					const size_t r = LZ4F_compressBegin(_cctx, _out.data(), _out.size(), &_prefs);
+					if ((LZ4F_isError(r)) || (fwrite(_out.data(), 1, r, _f) != r)) { LZ4F_freeCompressionContext(_cctx); fclose(_f); MTOOLS_THROW("OFileArchive error (lz4 header)"); }
+					}
+				virtual ~Lz4Writer() { LZ4F_freeCompressionContext(_cctx); if (_f != nullptr) fclose(_f); }
+				virtual bool write(const char * buf, size_t len) override
+					{
+					while (len > 0)
+						{
+						const size_t l = (len > CHUNK) ? CHUNK : len;
+						const size_t r = LZ4F_compressUpdate(_cctx, _out.data(), _out.size(), buf, l, nullptr);
+						if ((LZ4F_isError(r)) || (fwrite(_out.data(), 1, r, _f) != r)) return false;
+						buf += l; len -= l;
+						}
+					return true;
+					}
+				virtual bool close() override
+					{
+					const size_t r = LZ4F_compressEnd(_cctx, _out.data(), _out.size(), nullptr);
+					bool ok = ((!LZ4F_isError(r)) && (fwrite(_out.data(), 1, r, _f) == r));
+					if (fclose(_f) != 0) ok = false;
+					_f = nullptr;
+					return ok;
+					}
+			private:
+				static const size_t CHUNK = 1 << 20;
+				FILE * _f;
+				LZ4F_cctx * _cctx;
+				LZ4F_preferences_t _prefs;
+				std::vector<char> _out;
+			};
+
+
+		/* lz4 reader (successive frames are decompressed one after the other) */
+		class Lz4Reader : public CodecReader
+			{
+			public:
+				Lz4Reader(FILE * f) : _f(f), _dctx(nullptr), _in(CODEC_BUFFERSIZE), _pos(0), _size(0)
+					{
+					if (LZ4F_isError(LZ4F_createDecompressionContext(&_dctx, LZ4F_VERSION))) { fclose(_f); MTOOLS_THROW("IFileArchive error (lz4 context)"); }
+					}
+				virtual ~Lz4Reader() { LZ4F_freeDecompressionContext(_dctx); fclose(_f); }
+				virtual int64 read(char * buf, size_t len) override
+					{
+					size_t done = 0;
+					while (done == 0)
+						{
+						if (_pos == _size)
+							{
+							_size = fread(_in.data(), 1, _in.size(), _f);
+							_pos = 0;
+							if (_size == 0) return (ferror(_f) ? -1 : 0);
+							}
+						size_t lout = len;
+						size_t lin = _size - _pos;
+						const size_t r = LZ4F_decompress(_dctx, buf, &lout, _in.data() + _pos, &lin, nullptr);
+						if (LZ4F_isError(r)) return -1;
+						_pos += lin;
+						done = lout;
+						}
+					return (int64)done;
+					}
+			private:
+				FILE * _f;
+				LZ4F_dctx * _dctx;
+				std::vector<char> _in;
+				size_t _pos, _size;
+			};
+
+#endif
+
+		}
+
+
+
+	OFileArchive::OFileArchive(const std::string & filename, bool append, int codec, int level, int nbThreads) : OFileArchive(filename, append, false, codec, level, nbThreads)
+		{
+		}
+
+
+	OFileArchive::OFileArchive(const std::string & filename, bool append, bool binary, int codec, int level, int nbThreads) : OBaseArchive(binary), _filename(filename), _codec(codec), _level(level), _nbThreads(nbThreads), _append(append), _handle(nullptr)
+		{
+		if (_codec == CODEC_AUTO) { _codec = codecFromFilename(filename); }
+		if (!codecAvailable(_codec)) { MTOOLS_THROW("OFileArchive error (codec not available)"); }
+		if (_nbThreads <= 0) { _nbThreads = (int)nbHardwareThreads(); }
 		_openFile();
 		header();
 		}
@@ -44,25 +564,60 @@ namespace mtools
 		}
 
 
+	bool OFileArchive::codecAvailable(int codec)
+		{
+		switch (codec)
+			{
+			case CODEC_NONE: return true;
+			case CODEC_GZIP: return true;
+			#if (MTOOLS_USE_ZSTD)
+			case CODEC_ZSTD: return true;
+			#endif
+			#if (MTOOLS_USE_LZ4)
+			case CODEC_LZ4: return true;
+			#endif
+			}
+		return false;
+		}
+
+
+	int OFileArchive::codecFromFilename(const std::string & filename)
+		{
+		std::string ext = toLowerCase(extractExtension(filename));
+		if ((ext == std::string("gz")) || (ext == std::string("gzip")) || (ext == std::string("z"))) { return CODEC_GZIP; }
+		if ((ext == std::string("zst")) || (ext == std::string("zstd"))) { return CODEC_ZSTD; }
+		if (ext == std::string("lz4")) { return CODEC_LZ4; }
+		return CODEC_NONE;
+		}
+
 
 	void OFileArchive::_openFile()
 		{
-		if (_compress)
+		if (_codec == CODEC_GZIP)
 			{
-			_handle = gzopen(_filename.c_str(), "wb4");
-			if (_handle == nullptr) { MTOOLS_THROW("OFileArchive error (openfile 1)"); }
-			if (gzbuffer((gzFile)_handle, GZIPBUFFERSIZE) != 0) { MTOOLS_THROW("OFileArchive error (openfile 2)"); }
+			const int level = ((_level < 0) ? 4 : ((_level > 9) ? 9 : _level));
+			gzFile f = gzopen(_filename.c_str(), (std::string(_append ? "ab" : "wb") + toString(level)).c_str());
+			if (f == nullptr) { MTOOLS_THROW("OFileArchive error (openfile 1)"); }
+			if (gzbuffer(f, (unsigned int)internals_serialization::CODEC_BUFFERSIZE) != 0) { gzclose(f); MTOOLS_THROW("OFileArchive error (openfile 2)"); }
+			_handle = new internals_serialization::GzipWriter(f);
 			return;
 			}
 		#if defined (_MSC_VER) 
 		#pragma warning( push )				
 		#pragma warning( disable : 4996 )	
 		#endif
-		_handle = fopen(_filename.c_str(), "wb");
+		FILE * f = fopen(_filename.c_str(), (_append ? "ab" : "wb"));
 		#if defined (_MSC_VER) 
 		#pragma warning( pop )
 		#endif
-		if (_handle == nullptr) { MTOOLS_THROW("OFileArchive error (openfile 3)"); }
+		if (f == nullptr) { MTOOLS_THROW("OFileArchive error (openfile 3)"); }
+		#if (MTOOLS_USE_ZSTD)
+		if (_codec == CODEC_ZSTD) { _handle = new internals_serialization::ZstdWriter(f, ((_level < 0) ? 3 : _level), _nbThreads); return; }
+		#endif
+		#if (MTOOLS_USE_LZ4)
+		if (_codec == CODEC_LZ4) { _handle = new internals_serialization::Lz4Writer(f, ((_level < 0) ? 0 : _level)); return; }
+		#endif
+		_handle = new internals_serialization::PlainWriter(f);
 		return;
 		}
 
@@ -71,8 +626,11 @@ namespace mtools
 		{
 		newline();
 		_write(getbuffer(),true); // flush 
-		if (_compress) { if (gzclose((gzFile)_handle) != Z_OK) { MTOOLS_THROW("OFileArchive error (closefile 1)"); } return; }
-		if (fclose((FILE*)_handle) != 0) { MTOOLS_THROW("OFileArchive error (closefile 2)"); }
+		internals_serialization::CodecWriter * w = (internals_serialization::CodecWriter *)_handle;
+		const bool ok = w->close();
+		delete w;
+		_handle = nullptr;
+		if (!ok) { MTOOLS_THROW("OFileArchive error (closefile)"); }
 		return;
 		}
 
@@ -81,16 +639,137 @@ namespace mtools
 		{
 		if ((force) || (buffer.length() > WRITEBUFFERSIZE))
 			{ // ok we do flush
-			if (_compress)
+			MTOOLS_PROF_SCOPE("OFileArchive::flush");
+			MTOOLS_PROF_COUNT("OFileArchive::bytes flushed", buffer.length());
+			if (!((internals_serialization::CodecWriter *)_handle)->write(buffer.data(), buffer.length())) { MTOOLS_THROW("OFileArchive error (_flush)"); }
+			buffer.clear();
+			}
+		}
+
+
+
+	OParallelFileArchive::OParallelFileArchive(const std::string & filename, size_t nbThreads, int level) : _filename(filename), _handle(nullptr), _nbThreads(nbThreads), _level(level), _nbitem(0)
+		{
+		if (_nbThreads == 0) { _nbThreads = (size_t)nbHardwareThreads(); }
+		_handle = fopen(_filename.c_str(), "wb");
+		if (_handle == nullptr) { MTOOLS_THROW("OParallelFileArchive error (openfile)"); }
+		OChunkArchive ar;
+		ar.writeHeader();
+		_writeChunk(ar);
+		}
+
+
+	OParallelFileArchive::~OParallelFileArchive()
+		{
+		OChunkArchive ar;
+		ar.writeFooter(_nbitem);
+		_writeChunk(ar);
+		if (fclose((FILE*)_handle) != 0) { MTOOLS_ERROR("OParallelFileArchive error (closefile)"); }
+		}
+
+
+	void OParallelFileArchive::_writeChunk(OChunkArchive & ar)
+		{
+		ar.newline();
+		_nbitem += ar.nbItem();
+		std::string c = internals_serialization::_gzipMember(ar.get(), _level);
+		if (fwrite(c.data(), 1, c.size(), (FILE*)_handle) != c.size()) { MTOOLS_THROW("OParallelFileArchive error (write)"); }
+		}
+
+
+	void OParallelFileArchive::write(size_t nbChunks, std::function<void(size_t, OBaseArchive &)> fct)
+		{
+		if (nbChunks == 0) return;
+		std::vector<std::string> res(nbChunks);
+		std::vector<char> ready(nbChunks, 0);
+		std::mutex mut;
+		std::condition_variable cv;
+		size_t next = 0, written = 0;
+		const size_t window = 4 * _nbThreads;
+		bool abort = false;
+		std::exception_ptr err;
+		auto work = [&]()
+			{
+			try
 				{
-				if ((unsigned int)gzwrite((gzFile)_handle, buffer.c_str(), (unsigned int)buffer.length()) != buffer.length()) { MTOOLS_THROW("OFileArchive error (_flush 1)"); }
+				while (1)
+					{
+					size_t i;
+					{
+					std::unique_lock<std::mutex> lock(mut);
+					cv.wait(lock, [&] { return ((abort) || (next >= nbChunks) || (next < written + window)); });
+					if ((abort) || (next >= nbChunks)) return;
+					i = next++;
+					}
+					OChunkArchive ar;
+					fct(i, ar);
+					ar.newline();
+					std::string c = internals_serialization::_gzipMember(ar.get(), _level);
+					{
+					std::unique_lock<std::mutex> lock(mut);
+					res[i].swap(c);
+					ready[i] = 1;
+					_nbitem += ar.nbItem();
+					}
+					cv.notify_all();
+					}
 				}
-			else
+			catch (...)
+				{
 				{
-				if (fwrite(buffer.c_str(), 1, buffer.length(), (FILE*)_handle) != buffer.length()) { MTOOLS_THROW("OFileArchive error (_flush 2)"); }
+				std::unique_lock<std::mutex> lock(mut);
+				if (!err) { err = std::current_exception(); }
+				abort = true;
+				}
+				cv.notify_all();
+				}
+			};
+		const size_t nbth = (_nbThreads > nbChunks) ? nbChunks : _nbThreads;
+		std::vector<std::thread> threads;
+		for (size_t i = 0; i < nbth; i++) { threads.push_back(std::thread(work)); }
+		for (size_t w = 0; w < nbChunks; w++)
+			{ // write the chunks in order as soon as they are ready
+			std::string c;
+				{
+				std::unique_lock<std::mutex> lock(mut);
+				cv.wait(lock, [&] { return ((ready[w] != 0) || (abort)); });
+				if (abort) break;
+				c.swap(res[w]);
+				written = w + 1;
+				}
+			cv.notify_all();
+			if (fwrite(c.data(), 1, c.size(), (FILE*)_handle) != c.size())
+				{
+				{
+				std::unique_lock<std::mutex> lock(mut);
+				if (!err) { try { MTOOLS_THROW("OParallelFileArchive error (write)"); } catch (...) { err = std::current_exception(); } }
+				abort = true;
+				}
+				cv.notify_all();
+				break;
 				}
-			buffer.clear();
 			}
+		for (auto & th : threads) { th.join(); }
+		if (err) { std::rethrow_exception(err); }
+		}
+
+
+
+	IParallelFileArchive::IParallelFileArchive(const std::string & filename, size_t nbThreads) : IBaseArchive(), _impl(nullptr)
+		{
+		_impl = new internals_serialization::IParallelFileArchiveImpl(filename, nbThreads);
+		}
+
+
+	IParallelFileArchive::~IParallelFileArchive()
+		{
+		delete ((internals_serialization::IParallelFileArchiveImpl *)_impl);
+		}
+
+
+	const char * IParallelFileArchive::refill(size_t & len)
+		{
+		return ((internals_serialization::IParallelFileArchiveImpl *)_impl)->refill(len);
 		}
 
 
@@ -111,22 +790,58 @@ namespace mtools
 
 	void IFileArchive::_openfile()
 		{
-		_handle = gzopen(_filename.c_str(), "rb");
-		if (_handle == nullptr) { MTOOLS_THROW("IFileArchive::_openfile() error 1"); }
-		if (gzbuffer((gzFile)_handle, GZIPBUFFERSIZE) != 0) { MTOOLS_THROW("IFileArchive::_openfile() error 2"); }
+		unsigned char magic[4] = { 0, 0, 0, 0 };
+		#if defined (_MSC_VER) 
+		#pragma warning( push )				
+		#pragma warning( disable : 4996 )	
+		#endif
+		FILE * f = fopen(_filename.c_str(), "rb");
+		#if defined (_MSC_VER) 
+		#pragma warning( pop )
+		#endif
+		if (f == nullptr) { MTOOLS_THROW("IFileArchive::_openfile() error 1"); }
+		const size_t nm = fread(magic, 1, 4, f);
+		if ((nm == 4) && (magic[0] == 0x28) && (magic[1] == 0xB5) && (magic[2] == 0x2F) && (magic[3] == 0xFD))
+			{ // zstd frame
+			#if (MTOOLS_USE_ZSTD)
+			rewind(f);
+			_handle = new internals_serialization::ZstdReader(f);
+			return;
+			#else
+			fclose(f);
+			MTOOLS_THROW("IFileArchive::_openfile() error, zstd support not available");
+			#endif
+			}
+		if ((nm == 4) && (magic[0] == 0x04) && (magic[1] == 0x22) && (magic[2] == 0x4D) && (magic[3] == 0x18))
+			{ // lz4 frame
+			#if (MTOOLS_USE_LZ4)
+			rewind(f);
+			_handle = new internals_serialization::Lz4Reader(f);
+			return;
+			#else
+			fclose(f);
+			MTOOLS_THROW("IFileArchive::_openfile() error, lz4 support not available");
+			#endif
+			}
+		fclose(f);
+		gzFile g = gzopen(_filename.c_str(), "rb"); // gzip or plain file
+		if (g == nullptr) { MTOOLS_THROW("IFileArchive::_openfile() error 1"); }
+		if (gzbuffer(g, (unsigned int)internals_serialization::CODEC_BUFFERSIZE) != 0) { gzclose(g); MTOOLS_THROW("IFileArchive::_openfile() error 2"); }
+		_handle = new internals_serialization::GzipReader(g);
 		return;
 		}
 
 
 	void IFileArchive::_closefile()
 		{
-		if (gzclose((gzFile)_handle) != Z_OK) { MTOOLS_THROW("IFileArchive::_closeFile() error"); }
+		delete ((internals_serialization::CodecReader *)_handle); // no throw: called from the dtor, possibly during stack unwinding after a read error
+		_handle = nullptr;
 		return;
 		}
 
 	const char * IFileArchive::_readfile(size_t & len)
 		{
-		int l = gzread((gzFile)_handle, _filebuffer, FILEBUFFERSIZE);
+		const int64 l = ((internals_serialization::CodecReader *)_handle)->read(_filebuffer, FILEBUFFERSIZE);
 		if (l < 0) { MTOOLS_THROW("IFileArchive::_readfile() error"); } // something went wrong
 		len = (size_t)l; // number of char in the buffer
 		if (len == 0) return nullptr;
@@ -175,12 +890,65 @@ namespace mtools
 		}
 
 
-	ICPPArchive::ICPPArchive(const cp_char obj[]) : _buf(), _firsttime(true)
+	ICPPArchive::ICPPArchive(const cp_char obj[]) : _obj(obj), _tabsize(0), _k(0), _in(), _out(CHUNKSIZE), _strm(nullptr)
+		{
+		mtools::fromString(obj[0], _tabsize);
+		z_stream * strm = new z_stream;
+		strm->zalloc = Z_NULL;
+		strm->zfree = Z_NULL;
+		strm->opaque = Z_NULL;
+		strm->total_in = 0;
+		strm->avail_in = 0;
+		strm->next_in = Z_NULL;
+		strm->total_out = 0;
+		if (inflateInit(strm) != Z_OK) { delete strm; MTOOLS_ERROR("ICPPArchive: inflateInit() failed"); }
+		_strm = strm;
+		}
+
+
+	ICPPArchive::~ICPPArchive()
+		{
+		if (_strm != nullptr) { inflateEnd((z_stream*)_strm); delete (z_stream*)_strm; }
+		}
+
+
+	const char * ICPPArchive::refill(size_t & len)
+		{
+		len = 0;
+		if (_strm == nullptr) return nullptr;
+		z_stream * strm = (z_stream*)_strm;
+		strm->next_out = (Bytef *)_out.data();
+		strm->avail_out = (uInt)_out.size();
+		bool end = false;
+		while (strm->avail_out > 0)
+			{
+			if (strm->avail_in == 0)
+				{ // decode the next line
+				if (_k >= _tabsize) { end = true; break; }
+				const size_t l = (strlen(_obj[_k + 2]) >> 1);
+				_in.resize(l);
+				if (l > 0) stringToMemory(_obj[_k + 2], &(_in[0]));
+				strm->avail_in = (uInt)l;
+				strm->next_in = (Bytef *)_in.data();
+				_k++;
+				continue;
+				}
+			const int r = inflate(strm, Z_NO_FLUSH);
+			if (r == Z_STREAM_END) { end = true; break; }
+			if ((r != Z_OK) && (r != Z_BUF_ERROR)) { end = true; break; }
+			}
+		len = _out.size() - strm->avail_out;
+		if (end) { inflateEnd(strm); delete strm; _strm = nullptr; }
+		return (len > 0) ? _out.data() : nullptr;
+		}
+
+
+	const std::string ICPPArchive::buffer() const
 		{
-		size_t tabsize, src_len;
-		mtools::fromString(obj[0], tabsize);
-		mtools::fromString(obj[1], src_len);
-		_buf.resize(src_len,' ');
+		size_t tabsize = 0, src_len = 0; // fromString() leaves them untouched on failure
+		mtools::fromString(_obj[0], tabsize);
+		mtools::fromString(_obj[1], src_len);
+		std::string buf(src_len, ' ');
 		std::string tmp;
 		z_stream strm;
 		strm.zalloc = Z_NULL;
@@ -191,18 +959,19 @@ namespace mtools
 		strm.next_in = Z_NULL;
 		strm.total_out = 0;
 		strm.avail_out = (uInt)src_len;
-		strm.next_out = (Bytef *)&_buf[0];
+		strm.next_out = (Bytef *)&buf[0];
 		inflateInit(&strm);
 		for (size_t k = 0; k < tabsize; k++)
 			{
-			size_t l = (strlen(obj[k + 2]) >> 1);
+			size_t l = (strlen(_obj[k + 2]) >> 1);
 			tmp.resize(l);
-			stringToMemory(obj[k + 2], &(tmp[0]));
+			stringToMemory(_obj[k + 2], &(tmp[0]));
 			strm.avail_in = (uInt)l;
 			strm.next_in = (Bytef *)(&(tmp[0]));
 			inflate(&strm, Z_NO_FLUSH);
 			}
 		inflateEnd(&strm);
+		return buf;
 		}
 
 
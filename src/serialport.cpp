@@ -20,20 +20,26 @@
 
 #include "io/serialport.hpp"
 
+#include <algorithm>
+
 #ifdef _WIN32 
 #include <windows.h>
+#else
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#include <poll.h>
+#include <dirent.h>
+#include <sys/ioctl.h>
 #endif 
 
 
 namespace mtools
 	{
 
-	/******************************************************
-
-	TODO : Add Linux / OSX specific code. 
-
-	******************************************************/
-
+	const size_t SerialPort::CHUNK_SIZE;
 
 // WINDOWS SPECIFIC CODE
 #ifdef _WIN32 
@@ -110,6 +116,7 @@ namespace mtools
 
 	void SerialPort::close()
 		{
+		stopAcquisition();
 		if (_phandle->x  == INVALID_HANDLE_VALUE) return;
 		COMSTAT stat;
 		DWORD error;
@@ -127,35 +134,48 @@ namespace mtools
 		}
 
 
-	int SerialPort::read(char * buffer, size_t len)
+	int SerialPort::_rawRead(char * buffer, size_t len)
 		{
 		if (_phandle->x  == INVALID_HANDLE_VALUE) return -1;
 		COMSTAT stat;
 		DWORD error;
-		if (!ClearCommError(_phandle->x , &error, &stat)) { close(); return -2; }
-		if (error != 0) { close(); return -3; }
+		if (!ClearCommError(_phandle->x , &error, &stat)) { return -2; }
+		if (error != 0) { return -3; }
 		if (stat.cbInQue > 0)
 			{
 			if (len < (size_t)stat.cbInQue) { stat.cbInQue = (DWORD)len; }
 			DWORD nbread = 0;
-			if (!ReadFile(_phandle->x , (LPVOID)buffer, stat.cbInQue, &nbread, NULL)) { close(); return -4; }
+			if (!ReadFile(_phandle->x , (LPVOID)buffer, stat.cbInQue, &nbread, NULL)) { return -4; }
 			return((int)nbread);
 			}
 		return 0;
 		}
 
 
-	int SerialPort::available()
+	int SerialPort::_rawAvailable()
 		{
 		if (_phandle->x == INVALID_HANDLE_VALUE) return -1;
 		COMSTAT stat;
 		DWORD error;
-		if (!ClearCommError(_phandle->x, &error, &stat)) { close(); return -2; }
-		if (error != 0) { close(); return -3; }
+		if (!ClearCommError(_phandle->x, &error, &stat)) { return -2; }
+		if (error != 0) { return -3; }
 		return (int)stat.cbInQue;
 		}
 
 
+	void SerialPort::_waitData(int ms)
+		{
+		Sleep((ms < 1) ? 0 : 1);
+		}
+
+
+	bool SerialPort::_setOSBuffer(size_t size)
+		{
+		if (_phandle->x == INVALID_HANDLE_VALUE) return false;
+		return (SetupComm(_phandle->x, (DWORD)size, 4096) != 0);
+		}
+
+
 	int SerialPort::write(const char * buffer, size_t len)
 		{
 		if (!status()) return -1;
@@ -167,6 +187,7 @@ namespace mtools
 
 	bool SerialPort::status()
 		{
+		if (_acqError) { close(); return false; }
 		if (_phandle->x  == INVALID_HANDLE_VALUE) return false;
 		COMSTAT stat;
 		DWORD error;
@@ -194,9 +215,340 @@ namespace mtools
 		}
 
 
+// POSIX SPECIFIC CODE
+#else
+
+
+	struct SerialPort::SerialPortHandle
+		{
+		int fd;
+		};
+
+
+	/* termios constant for a baud rate, 0 if not supported */
+	static speed_t _serialSpeed(int baudRate)
+		{
+		switch (baudRate)
+			{
+			case 50: return B50;
+			case 75: return B75;
+			case 110: return B110;
+			case 134: return B134;
+			case 150: return B150;
+			case 200: return B200;
+			case 300: return B300;
+			case 600: return B600;
+			case 1200: return B1200;
+			case 1800: return B1800;
+			case 2400: return B2400;
+			case 4800: return B4800;
+			case 9600: return B9600;
+			case 19200: return B19200;
+			case 38400: return B38400;
+			case 57600: return B57600;
+			case 115200: return B115200;
+			case 230400: return B230400;
+#ifdef B460800
+			case 460800: return B460800;
+#endif
+#ifdef B500000
+			case 500000: return B500000;
+#endif
+#ifdef B576000
+			case 576000: return B576000;
+#endif
+#ifdef B921600
+			case 921600: return B921600;
+#endif
+#ifdef B1000000
+			case 1000000: return B1000000;
+#endif
+#ifdef B1500000
+			case 1500000: return B1500000;
+#endif
+#ifdef B2000000
+			case 2000000: return B2000000;
+#endif
+#ifdef B3000000
+			case 3000000: return B3000000;
+#endif
+#ifdef B4000000
+			case 4000000: return B4000000;
+#endif
+			}
+		return 0;
+		}
+
+
+	SerialPort::SerialPort() : _phandle(new SerialPortHandle)
+				{
+				_phandle->fd = -1;
+				}
+
+
+	SerialPort::~SerialPort()
+				{
+				close();
+				}
+
+
+	int SerialPort::open(std::string portName, int baudRate, bool parityCheck, int parity, int stopBits)
+		{
+		if (_phandle->fd >= 0) { return -1; }
+		if ((portName.size() == 0) || (portName[0] != '/')) { portName = std::string("/dev/") + portName; }
+		_phandle->fd = ::open(portName.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
+		if (_phandle->fd < 0) { return -2; }
+		struct termios tio;
+		if (tcgetattr(_phandle->fd, &tio) != 0) { close(); return -3; }
+		cfmakeraw(&tio);
+		const speed_t speed = _serialSpeed(baudRate);
+		if ((speed == 0) || (cfsetispeed(&tio, speed) != 0) || (cfsetospeed(&tio, speed) != 0)) { close(); return -4; }
+		tio.c_cflag |= (CLOCAL | CREAD);
+		tio.c_cflag &= ~CSIZE;
+		tio.c_cflag |= CS8;
+		tio.c_cflag &= ~(PARENB | PARODD);
+#ifdef CMSPAR
+		tio.c_cflag &= ~CMSPAR;
+#endif
+		switch (parity)
+			{
+			case SERIALPORT_PARITY_NONE: { break; }
+			case SERIALPORT_PARITY_ODD: { tio.c_cflag |= (PARENB | PARODD); break; }
+			case SERIALPORT_PARITY_EVEN: { tio.c_cflag |= PARENB; break; }
+#ifdef CMSPAR
+			case SERIALPORT_PARITY_MARK: { tio.c_cflag |= (PARENB | PARODD | CMSPAR); break; }
+			case SERIALPORT_PARITY_SPACE: { tio.c_cflag |= (PARENB | CMSPAR); break; }
+#endif
+			default: { close(); return -4; }
+			}
+		if (parityCheck) { tio.c_iflag |= INPCK; } else { tio.c_iflag &= ~INPCK; }
+		if (stopBits == SERIALPORT_STOPBITS_1) { tio.c_cflag &= ~CSTOPB; } else { tio.c_cflag |= CSTOPB; } // 1.5 stop bits is not available: use 2
+		tio.c_cc[VMIN] = 0;
+		tio.c_cc[VTIME] = 0;
+		if (tcsetattr(_phandle->fd, TCSANOW, &tio) != 0) { close(); return -5; }
+		if (tcflush(_phandle->fd, TCIOFLUSH) != 0) { close(); return -6; }
+		return 0;
+		}
+
+
+	void SerialPort::close()
+		{
+		stopAcquisition();
+		if (_phandle->fd < 0) return;
+		::close(_phandle->fd);
+		_phandle->fd = -1;
+		}
+
+
+	bool SerialPort::clear()
+		{
+		if (!status()) return false;
+		if (tcflush(_phandle->fd, TCIOFLUSH) != 0) { close(); return false; }
+		return true;
+		}
+
+
+	int SerialPort::_rawRead(char * buffer, size_t len)
+		{
+		if (_phandle->fd < 0) return -1;
+		const ssize_t n = ::read(_phandle->fd, buffer, len);
+		if (n >= 0) return (int)n;
+		if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)) return 0;
+		return -2;
+		}
+
+
+	int SerialPort::_rawAvailable()
+		{
+		if (_phandle->fd < 0) return -1;
+		int n = 0;
+		if (ioctl(_phandle->fd, FIONREAD, &n) != 0) { return -2; }
+		return n;
+		}
+
+
+	void SerialPort::_waitData(int ms)
+		{
+		if (_phandle->fd < 0) return;
+		struct pollfd p;
+		p.fd = _phandle->fd;
+		p.events = POLLIN;
+		p.revents = 0;
+		poll(&p, 1, ms);
+		}
+
+
+	bool SerialPort::_setOSBuffer(size_t size)
+		{
+		return (_phandle->fd >= 0); // the size of the driver buffer cannot be set portably
+		}
+
+
+	int SerialPort::write(const char * buffer, size_t len)
+		{
+		if (!status()) return -1;
+		size_t tot = 0;
+		while (tot < len)
+			{
+			const ssize_t n = ::write(_phandle->fd, buffer + tot, len - tot);
+			if (n > 0) { tot += (size_t)n; continue; }
+			if ((n < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)) { close(); return -2; }
+			struct pollfd p;
+			p.fd = _phandle->fd;
+			p.events = POLLOUT;
+			p.revents = 0;
+			if (poll(&p, 1, 1000) <= 0) break; // timeout
+			}
+		return (int)tot;
+		}
+
+
+	bool SerialPort::status()
+		{
+		if (_acqError) { close(); return false; }
+		return (_phandle->fd >= 0);
+		}
+
+
+	std::vector<std::string> SerialPort::getPortList()
+		{
+		static const char * prefix[] = { "ttyS", "ttyUSB", "ttyACM", "ttyAMA", "rfcomm", "tty.", "cu." };
+		std::vector<std::string> portList;
+		DIR * dir = opendir("/dev");
+		if (dir == nullptr) return portList;
+		struct dirent * e;
+		while ((e = readdir(dir)) != nullptr)
+			{
+			const std::string name(e->d_name);
+			for (const char * p : prefix) { if (name.find(p) == 0) { portList.push_back(std::string("/dev/") + name); break; } }
+			}
+		closedir(dir);
+		std::sort(portList.begin(), portList.end());
+		return portList;
+		}
+
+
 #endif // end of #ifdef _WIN32
 
 
+	/******************************************************
+	* Platform independent code
+	******************************************************/
+
+
+	int SerialPort::read(char * buffer, size_t len)
+		{
+		if (_acqRunning) { return (int)readAvailable(buffer, std::min<size_t>(len, 0x7FFFFFFF)); }
+		const int r = _rawRead(buffer, len);
+		if (r < 0) { close(); }
+		return r;
+		}
+
+
+	int SerialPort::available()
+		{
+		if (_acqRunning) { return (int)std::min<uint64>(_acqBytes, 0x7FFFFFFF); }
+		const int r = _rawAvailable();
+		if (r < 0) { close(); }
+		return r;
+		}
+
+
+	bool SerialPort::startAcquisition(size_t ringSize, size_t osBufferSize)
+		{
+		if ((_acqRunning) || (!status())) return false;
+		_setOSBuffer(osBufferSize);
+		_acqRing.reset(new SingleProducerSingleConsumerQueue<Chunk>((ringSize < 2) ? 2 : ringSize));
+		_acqStop = false;
+		_acqError = false;
+		_acqBytes = 0;
+		_acqDropped = 0;
+		_acqCur.len = 0;
+		_acqCurPos = 0;
+		_acqStart = std::chrono::steady_clock::now();
+		_acqRunning = true;
+		_acqThread = std::thread(&SerialPort::_acquisitionLoop, this);
+		return true;
+		}
+
+
+	void SerialPort::stopAcquisition()
+		{
+		if (!_acqRunning) return;
+		_acqStop = true;
+		if (_acqThread.joinable()) { _acqThread.join(); }
+		_acqRunning = false;
+		_acqRing.reset();
+		_acqBytes = 0;
+		_acqCur.len = 0;
+		_acqCurPos = 0;
+		}
+
+
+	size_t SerialPort::readAvailable(char * buffer, size_t len, double * time)
+		{
+		if (!_acqRunning) return 0;
+		size_t n = 0;
+		while (n < len)
+			{
+			if (_acqCurPos >= _acqCur.len)
+				{
+				if (!_acqRing->pop(_acqCur)) break;
+				_acqCurPos = 0;
+				}
+			if ((n == 0) && (time != nullptr)) { *time = _acqCur.time; }
+			const size_t l = std::min<size_t>(len - n, _acqCur.len - _acqCurPos);
+			memcpy(buffer + n, _acqCur.data + _acqCurPos, l);
+			_acqCurPos += l;
+			n += l;
+			}
+		_acqBytes -= n;
+		return n;
+		}
+
+
+	size_t SerialPort::readAvailable(std::vector<char> & out)
+		{
+		if (!_acqRunning) return 0;
+		const size_t start = out.size();
+		size_t n;
+		do
+			{
+			const size_t l = std::max<size_t>((size_t)_acqBytes, CHUNK_SIZE);
+			out.resize(out.size() + l);
+			n = readAvailable(out.data() + out.size() - l, l);
+			out.resize(out.size() - l + n);
+			}
+		while (n > 0);
+		return out.size() - start;
+		}
+
+
+	bool SerialPort::readChunk(Chunk & chunk)
+		{
+		if (!_acqRunning) return false;
+		if (!_acqRing->pop(chunk)) return false;
+		_acqBytes -= chunk.len;
+		return true;
+		}
+
+
+	void SerialPort::_acquisitionLoop()
+		{
+		Chunk c;
+		while (!_acqStop)
+			{
+			const int r = _rawRead(c.data, CHUNK_SIZE);
+			if (r < 0) { _acqError = true; return; }
+			if (r == 0) { _waitData(5); continue; }
+			c.len = (uint32)r;
+			c.time = std::chrono::duration<double>(std::chrono::steady_clock::now() - _acqStart).count();
+			_acqBytes += (uint64)r; // count first so the consumer never sees a negative value
+			if (!_acqRing->push(c)) { _acqBytes -= (uint64)r; _acqDropped += (uint64)r; }
+			}
+		}
+
+
 	}
 
 
@@ -20,6 +20,8 @@
 
 #include "misc/stringfct.hpp"
 
+#include <cstdio>
+
 
 namespace mtools
 {
@@ -135,35 +137,19 @@ namespace mtools
 
     size_t createTokenI(uint64 n, std::string & dest)
     {
-        size_t l = 0;
-        { const uint64 d = 10000000000000000000u; const uint64 r = (n / d); n = (n%d); if (r != 0) { dest.push_back('0' + (char)r); ++l; } }
-        { const uint64 d = 1000000000000000000u; const uint64 r = (n / d); n = (n%d); if ((l != 0) || (r != 0)) { dest.push_back('0' + (char)r); ++l; } }
-        { const uint64 d = 100000000000000000u; const uint64 r = (n / d); n = (n%d); if ((l != 0) || (r != 0)) { dest.push_back('0' + (char)r); ++l; } }
-        { const uint64 d = 10000000000000000u; const uint64 r = (n / d); n = (n%d); if ((l != 0) || (r != 0)) { dest.push_back('0' + (char)r); ++l; } }
-        { const uint64 d = 1000000000000000u; const uint64 r = (n / d); n = (n%d); if ((l != 0) || (r != 0)) { dest.push_back('0' + (char)r); ++l; } }
-        { const uint64 d = 100000000000000u; const uint64 r = (n / d); n = (n%d); if ((l != 0) || (r != 0)) { dest.push_back('0' + (char)r); ++l; } }
-        { const uint64 d = 10000000000000u; const uint64 r = (n / d); n = (n%d); if ((l != 0) || (r != 0)) { dest.push_back('0' + (char)r); ++l; } }
-        { const uint64 d = 1000000000000u; const uint64 r = (n / d); n = (n%d); if ((l != 0) || (r != 0)) { dest.push_back('0' + (char)r); ++l; } }
-        { const uint64 d = 100000000000u; const uint64 r = (n / d); n = (n%d); if ((l != 0) || (r != 0)) { dest.push_back('0' + (char)r); ++l; } }
-        { const uint64 d = 10000000000u; const uint64 r = (n / d); n = (n%d); if ((l != 0) || (r != 0)) { dest.push_back('0' + (char)r); ++l; } }
-        { const uint64 d = 1000000000u; const uint64 r = (n / d); n = (n%d); if ((l != 0) || (r != 0)) { dest.push_back('0' + (char)r); ++l; } }
-        { const uint64 d = 100000000u; const uint64 r = (n / d); n = (n%d); if ((l != 0) || (r != 0)) { dest.push_back('0' + (char)r); ++l; } }
-        { const uint64 d = 10000000u; const uint64 r = (n / d); n = (n%d); if ((l != 0) || (r != 0)) { dest.push_back('0' + (char)r); ++l; } }
-        { const uint64 d = 1000000u; const uint64 r = (n / d); n = (n%d); if ((l != 0) || (r != 0)) { dest.push_back('0' + (char)r); ++l; } }
-        { const uint64 d = 100000u; const uint64 r = (n / d); n = (n%d); if ((l != 0) || (r != 0)) { dest.push_back('0' + (char)r); ++l; } }
-        { const uint64 d = 10000u; const uint64 r = (n / d); n = (n%d); if ((l != 0) || (r != 0)) { dest.push_back('0' + (char)r); ++l; } }
-        { const uint64 d = 1000u; const uint64 r = (n / d); n = (n%d); if ((l != 0) || (r != 0)) { dest.push_back('0' + (char)r); ++l; } }
-        { const uint64 d = 100u; const uint64 r = (n / d); n = (n%d); if ((l != 0) || (r != 0)) { dest.push_back('0' + (char)r); ++l; } }
-        { const uint64 d = 10u; const uint64 r = (n / d); n = (n%d); if ((l != 0) || (r != 0)) { dest.push_back('0' + (char)r); ++l; } }
-        { dest.push_back('0' + (char)n); ++l; }
+        char buf[TOSTRING_BUFSIZE];
+        const size_t l = internals_stringfct::toChars(n, buf);
+        dest.append(buf, l);
         return l;
     }
 
 
     size_t createTokenI(int64 n, std::string & dest)
         {
-        if (n < 0) { dest.push_back('-'); return(createTokenI((uint64)(-n), dest) + 1); }
-        return(createTokenI((uint64)(n), dest));
+        char buf[TOSTRING_BUFSIZE];
+        const size_t l = internals_stringfct::toChars(n, buf);
+        dest.append(buf, l);
+        return l;
         }
 
 
@@ -215,14 +201,11 @@ namespace mtools
                 {
                 int64 n = (int64)floor(v);
                 float v2 = (float)n;
-                if (v == v2) { std::string s = std::to_string(n); dest += s; return s.length(); }
-                std::ostringstream os;
-                os << std::scientific;
-                os.precision(std::numeric_limits<float>::max_digits10);
-                os << v;
-                auto s = os.str();
-                dest += s;
-                return s.length();
+                if (v == v2) { return createTokenI(n, dest); }
+                char buf[64];
+                const size_t l = internals_stringfct::classicDecimalPoint(buf, (size_t)std::snprintf(buf, sizeof(buf), "%.*e", std::numeric_limits<float>::max_digits10, (double)v)); // same as an ostream with std::scientific (always with '.')
+                dest.append(buf, l);
+                return l;
                 }
             }
         MTOOLS_ERROR("wtf ?");
@@ -242,14 +225,11 @@ namespace mtools
                 {
                 int64 n = (int64)floor(v);
                 double v2 = (double)n;
-                if (v == v2) { std::string s = std::to_string(n); dest += s; return s.length(); }
-                std::ostringstream os;
-                os << std::scientific;
-                os.precision(std::numeric_limits<double>::max_digits10);
-                os << v;
-                auto s = os.str();
-                dest += s;
-                return s.length();
+                if (v == v2) { return createTokenI(n, dest); }
+                char buf[64];
+                const size_t l = internals_stringfct::classicDecimalPoint(buf, (size_t)std::snprintf(buf, sizeof(buf), "%.*e", std::numeric_limits<double>::max_digits10, v)); // same as an ostream with std::scientific (always with '.')
+                dest.append(buf, l);
+                return l;
                 }
             }
         MTOOLS_ERROR("wtf ?");
@@ -269,14 +249,11 @@ namespace mtools
                 {
                 int64 n = (int64)floor(v);
                 long double v2 = (long double)n;
-                if (v == v2) { std::string s = std::to_string(n); dest += s; return s.length(); }
-                std::ostringstream os;
-                os << std::scientific;
-                os.precision(std::numeric_limits<long double>::max_digits10);
-                os << v;
-                auto s = os.str();
-                dest += s;
-                return s.length();
+                if (v == v2) { return createTokenI(n, dest); }
+                char buf[64];
+                const size_t l = internals_stringfct::classicDecimalPoint(buf, (size_t)std::snprintf(buf, sizeof(buf), "%.*Le", std::numeric_limits<long double>::max_digits10, v)); // same as an ostream with std::scientific (always with '.')
+                dest.append(buf, l);
+                return l;
                 }
             }
         MTOOLS_ERROR("wtf ?");
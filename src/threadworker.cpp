@@ -0,0 +1,361 @@
+/** @file threadworker.cpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "misc/internal/threadworker.hpp"
+
+#include <map>
+#include <utility>
+#include <cstdio>
+#include <cstring>
+
+#if defined(__linux__)
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+
+namespace mtools
+{
+
+
+    namespace internals_threadscheduler
+    {
+
+        /* a thread waiting for a slot */
+        struct Waiter
+            {
+            std::condition_variable *   cv;     // signaled when the thread should look at the state again
+            const void *                data;   // the data passed to the abort predicate (identifies the thread for wakeUp())
+            };
+
+
+        /* state of the global scheduler */
+        struct SchedulerState
+            {
+            SchedulerState() : maxrun(nbHardwareThreads()), nbrun(0), ticket(0) {}
+
+            /* wake up the first thread in line if a slot is available */
+            void notifyFirst() { if ((queue.size() > 0) && (nbrun < maxrun)) queue.begin()->second.cv->notify_one(); }
+
+            /* update the priority of the first thread in line */
+            void updateTop() { ThreadScheduler::_topWaiting = (queue.size() == 0) ? ThreadScheduler::NO_WAITING : -(queue.begin()->first.first); }
+
+            std::mutex                                  mut;        // protects the fields below
+            int                                         maxrun;     // max number of simultaneous slots
+            int                                         nbrun;      // number of slots in use
+            uint64                                      ticket;     // next ticket number
+            std::map<std::pair<int, uint64>, Waiter>    queue;      // waiting threads: (-priority, ticket)
+            };
+
+
+        /* the unique instance (constructed on first use) */
+        static SchedulerState & state()
+            {
+            static SchedulerState S;
+            return S;
+            }
+
+    }
+
+
+    std::atomic<int> ThreadScheduler::_topWaiting(ThreadScheduler::NO_WAITING);
+
+
+    void ThreadScheduler::setMaxRunning(int nb)
+        {
+        auto & S = internals_threadscheduler::state();
+        std::unique_lock<std::mutex> lock(S.mut);
+        S.maxrun = (nb <= 0) ? nbHardwareThreads() : nb;
+        S.notifyFirst();
+        }
+
+
+    int ThreadScheduler::maxRunning()
+        {
+        auto & S = internals_threadscheduler::state();
+        std::unique_lock<std::mutex> lock(S.mut);
+        return S.maxrun;
+        }
+
+
+    int ThreadScheduler::running()
+        {
+        auto & S = internals_threadscheduler::state();
+        std::unique_lock<std::mutex> lock(S.mut);
+        return S.nbrun;
+        }
+
+
+    int ThreadScheduler::waiting()
+        {
+        auto & S = internals_threadscheduler::state();
+        std::unique_lock<std::mutex> lock(S.mut);
+        return (int)S.queue.size();
+        }
+
+
+    bool ThreadScheduler::acquire(int priority, bool(*abort)(void *), void * data)
+        {
+        auto & S = internals_threadscheduler::state();
+        std::unique_lock<std::mutex> lock(S.mut);
+        if ((S.queue.size() == 0) && (S.nbrun < S.maxrun)) { S.nbrun++; return true; } // fast path
+        std::condition_variable cv; // each thread waits on its own condition variable: only the one concerned is woken up
+        const std::pair<int, uint64> key(-priority, S.ticket++);
+        S.queue[key] = internals_threadscheduler::Waiter{ &cv, data };
+        S.updateTop();
+        while (1)
+            {
+            if ((S.nbrun < S.maxrun) && (S.queue.begin()->first == key))
+                { // our turn
+                S.queue.erase(key);
+                S.nbrun++;
+                S.updateTop();
+                S.notifyFirst(); // there may be other free slots
+                return true;
+                }
+            if ((abort != nullptr) && (abort(data)))
+                { // stop waiting
+                S.queue.erase(key);
+                S.updateTop();
+                S.notifyFirst(); // we may have been blocking the next thread in line
+                return false;
+                }
+            cv.wait_for(lock, std::chrono::milliseconds(1)); // woken up by release(), setMaxRunning(), wakeUp() or the previous thread in line (the timeout is only a safety net)
+            }
+        }
+
+
+    void ThreadScheduler::release()
+        {
+        auto & S = internals_threadscheduler::state();
+        std::unique_lock<std::mutex> lock(S.mut);
+        MTOOLS_ASSERT(S.nbrun > 0);
+        S.nbrun--;
+        S.notifyFirst();
+        }
+
+
+    namespace internals_threadaffinity
+    {
+
+        /* topology of the machine and current policy */
+        struct AffinityState
+            {
+            AffinityState() : policy(ThreadAffinity::AFFINITY_NONE), node(0), counter(0)
+                {
+#if defined(__linux__)
+                CPU_ZERO(&allowed);
+                const bool hasmask = (sched_getaffinity(0, sizeof(allowed), &allowed) == 0);
+                for (int n = 0; n < 1024; n++)
+                    {
+                    char name[64];
+                    std::snprintf(name, sizeof(name), "/sys/devices/system/node/node%d/cpulist", n);
+                    std::FILE * f = std::fopen(name, "r");
+                    if (f == nullptr) continue;
+                    char buf[4096];
+                    const size_t l = std::fread(buf, 1, sizeof(buf) - 1, f);
+                    std::fclose(f);
+                    buf[l] = 0;
+                    std::vector<int> cpus;
+                    char * q = buf;
+                    while (*q != 0)
+                        { // parse "0-7,16-23"
+                        char * e;
+                        const long a = std::strtol(q, &e, 10);
+                        if (e == q) break;
+                        long b = a;
+                        q = e;
+                        if (*q == '-') { q++; b = std::strtol(q, &e, 10); q = e; }
+                        for (long c = a; c <= b; c++) { if ((c < CPU_SETSIZE) && ((!hasmask) || (CPU_ISSET((int)c, &allowed)))) cpus.push_back((int)c); }
+                        if (*q == ',') q++; else break;
+                        }
+                    if (cpus.size() > 0) { nodes.push_back(cpus); nodeid.push_back(n); }
+                    }
+                if (!hasmask) { CPU_ZERO(&allowed); for (int c = 0; c < nbHardwareThreads(); c++) CPU_SET(c, &allowed); }
+                if (nodes.size() == 0)
+                    { // no information: a single node with all the allowed cpus
+                    std::vector<int> cpus;
+                    for (int c = 0; c < CPU_SETSIZE; c++) { if (CPU_ISSET(c, &allowed)) cpus.push_back(c); }
+                    nodes.push_back(cpus); nodeid.push_back(0);
+                    }
+#else
+                std::vector<int> cpus;
+                for (int c = 0; c < nbHardwareThreads(); c++) cpus.push_back(c);
+                nodes.push_back(cpus); nodeid.push_back(0);
+#endif
+                for (auto & v : nodes) { compact.insert(compact.end(), v.begin(), v.end()); }
+                }
+
+            std::mutex                          mut;        // protects policy and node
+            int                                 policy;     // current policy
+            int                                 node;       // node used by AFFINITY_NODE (position in nodes)
+            std::atomic<int>                    counter;    // counter for nextIndex()
+            std::vector<std::vector<int> >      nodes;      // cpus of each node
+            std::vector<int>                    nodeid;     // id of each node for the OS
+            std::vector<int>                    compact;    // all the cpus, node after node
+#if defined(__linux__)
+            cpu_set_t                           allowed;    // cpus the process may use
+#endif
+            };
+
+
+        /* the unique instance (constructed on first use) */
+        static AffinityState & state()
+            {
+            static AffinityState S;
+            return S;
+            }
+
+    }
+
+
+    std::atomic<int> ThreadAffinity::_epoch(0);
+
+
+    void ThreadAffinity::setPolicy(int policy, int node)
+        {
+        auto & S = internals_threadaffinity::state();
+        std::unique_lock<std::mutex> lock(S.mut);
+        S.policy = ((policy < AFFINITY_NONE) || (policy > AFFINITY_NODE)) ? AFFINITY_NONE : policy;
+        S.node = ((node < 0) || (node >= (int)S.nodes.size())) ? 0 : node;
+        _epoch++;
+        }
+
+
+    int ThreadAffinity::policy()
+        {
+        auto & S = internals_threadaffinity::state();
+        std::unique_lock<std::mutex> lock(S.mut);
+        return S.policy;
+        }
+
+
+    int ThreadAffinity::nbNodes()
+        {
+        return (int)internals_threadaffinity::state().nodes.size();
+        }
+
+
+    std::vector<int> ThreadAffinity::nodeCpus(int node)
+        {
+        auto & S = internals_threadaffinity::state();
+        if ((node < 0) || (node >= (int)S.nodes.size())) return std::vector<int>();
+        return S.nodes[node];
+        }
+
+
+    int ThreadAffinity::cpuNode(int cpu)
+        {
+        auto & S = internals_threadaffinity::state();
+        for (size_t n = 0; n < S.nodes.size(); n++) { for (int c : S.nodes[n]) { if (c == cpu) return (int)n; } }
+        return 0;
+        }
+
+
+    int ThreadAffinity::cpuForIndex(int index)
+        {
+        auto & S = internals_threadaffinity::state();
+        int pol, node;
+            {
+            std::unique_lock<std::mutex> lock(S.mut);
+            pol = S.policy; node = S.node;
+            }
+        if (index < 0) index = -index;
+        switch (pol)
+            {
+            case AFFINITY_COMPACT: { return S.compact[index % S.compact.size()]; }
+            case AFFINITY_SCATTER:
+                {
+                const auto & v = S.nodes[index % S.nodes.size()];
+                return v[(index / S.nodes.size()) % v.size()];
+                }
+            case AFFINITY_NODE: { const auto & v = S.nodes[node]; return v[index % v.size()]; }
+            default: { return -1; }
+            }
+        }
+
+
+    bool ThreadAffinity::pinCurrentThread(int index)
+        {
+#if defined(__linux__)
+        auto & S = internals_threadaffinity::state();
+        const int cpu = cpuForIndex(index);
+        cpu_set_t set;
+        if (cpu < 0) { set = S.allowed; } else { CPU_ZERO(&set); CPU_SET(cpu, &set); }
+        return (sched_setaffinity(0, sizeof(set), &set) == 0); // pid 0 = calling thread
+#else
+        return false;
+#endif
+        }
+
+
+    int ThreadAffinity::currentNode()
+        {
+#if defined(__linux__)
+        const int cpu = sched_getcpu();
+        if (cpu >= 0) return cpuNode(cpu);
+#endif
+        return 0;
+        }
+
+
+    bool ThreadAffinity::bindLocal(const void * p, size_t len)
+        {
+        auto & S = internals_threadaffinity::state();
+        if (S.nodes.size() < 2) return false;
+#if defined(__linux__) && defined(SYS_mbind)
+        const uintptr_t pagesize = (uintptr_t)sysconf(_SC_PAGESIZE);
+        const uintptr_t a = (((uintptr_t)p) + pagesize - 1) & ~(pagesize - 1);
+        const uintptr_t b = (((uintptr_t)p) + len) & ~(pagesize - 1);
+        if (b <= a) return false;
+        const int id = S.nodeid[currentNode()];
+        unsigned long mask[16];
+        if (id >= (int)(8 * sizeof(mask))) return false;
+        std::memset(mask, 0, sizeof(mask));
+        mask[id / (8 * sizeof(unsigned long))] |= (1UL << (id % (8 * sizeof(unsigned long))));
+        const int MPOL_PREFERRED_ = 1;  // constants from <numaif.h>, not included to avoid depending on libnuma
+        const unsigned MPOL_MF_MOVE_ = 2;
+        return (syscall(SYS_mbind, (void *)a, (unsigned long)(b - a), MPOL_PREFERRED_, mask, (unsigned long)(8 * sizeof(mask)), MPOL_MF_MOVE_) == 0);
+#else
+        return false;
+#endif
+        }
+
+
+    int ThreadAffinity::nextIndex()
+        {
+        return internals_threadaffinity::state().counter++;
+        }
+
+
+    void ThreadScheduler::wakeUp(const void * data)
+        {
+        auto & S = internals_threadscheduler::state();
+        std::unique_lock<std::mutex> lock(S.mut); // taken so that the notification cannot fall between the check of the predicate and the wait
+        for (auto & w : S.queue) { if (w.second.data == data) w.second.cv->notify_one(); }
+        }
+
+
+}
+
+
+/* end of file */
+
@@ -162,7 +162,7 @@ namespace mtools
 
 
             /* constructor of the widget */
-            ProgressWidget(bool sht,const char * tit) : Fl_Window(0,0,300,110), showtime(sht), newval(0), updatetime(0)
+            ProgressWidget(bool sht, const char * tit, const std::atomic<int64> * v, int64 minv, int64 maxv) : Fl_Window(0,0,300,110), showtime(sht), val(v), minval(minv), maxval(maxv), updatetime(0)
                 {
                 startTime = std::chrono::high_resolution_clock::now();
                 resize((Fl::w() - 300) / 2, (Fl::h() -110) / 2, 300, 110);
@@ -226,6 +226,7 @@ namespace mtools
             /* timer function */
             void window_timer()
                 {
+                const double newval = ((double)(val->load(std::memory_order_relaxed) - minval)) / ((double)(maxval - minval));
                 if (progBar->value() != (float)newval)
                     {
                     progBar->value((float)newval); progBar->redraw();
@@ -256,7 +257,6 @@ namespace mtools
 
             private:
 
-            friend void setProgressWidgetValue(ProgressWidget *, double);
             friend void deleteProgressWidget(ProgressWidget *);
 
             ProgressWidget(const ProgressWidget &) = delete;              // no copy
@@ -266,27 +266,25 @@ namespace mtools
             Fl_Progress *       progBar;    // the progress bar widget.
             Fl_Box *            textBar1;   // elapsed time widget
             Fl_Box *            textBar2;   // remaining time widget
-            std::atomic<double> newval;     // new value
+            const std::atomic<int64> * val; // counter of the ProgressBar (polled by the timer)
+            int64               minval;     // range of the counter
+            int64               maxval;     //
 
             std::chrono::high_resolution_clock::time_point startTime; // time when the progress bar was created.
             int updatetime; // when we should update remaining time
         };
 
 
-        ProgressWidget * makeProgressWidget(bool sh, const std::string & name)
+        ProgressWidget * makeProgressWidget(bool sh, const std::string & name, const std::atomic<int64> * val, int64 minval, int64 maxval)
             {
-             return newInFltkThread<ProgressWidget, bool&, const char *>(sh, name.c_str());
-            }
-
-
-        void setProgressWidgetValue(ProgressWidget * PW, double val)
-            {
-            PW->newval = val;
+            if (isHeadless()) return nullptr; // no window: the progress bar does nothing
+            return newInFltkThread<ProgressWidget, bool&, const char *, const std::atomic<int64> *, int64, int64>(sh, name.c_str(), (const std::atomic<int64> *)val, (int64)minval, (int64)maxval);
             }
 
 
         void deleteProgressWidget(ProgressWidget * PW)
             {
+            if (PW == nullptr) return;
             deleteInFltkThread<ProgressWidget>(PW);
             }
 
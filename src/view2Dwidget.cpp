@@ -22,6 +22,10 @@
 #include "misc/error.hpp"
 #include "random/gen_fastRNG.hpp"
 
+#include <chrono>
+#include <vector>
+#include <algorithm>
+
 
 
 namespace mtools
@@ -43,7 +47,10 @@ namespace mtools
             _RM(nullptr),
             _zoomFactor(1),
             _nbRounds(0),
-            _discardIm(true)
+            _discardIm(true),
+            _overlay(),
+            _drawTime(0.0),
+            _improveTime(0.0)
             {
             _stocIm = new ProgressImg(1, 1);
             _stocImAlt = new ProgressImg(1, 1);
@@ -140,6 +147,22 @@ namespace mtools
 
 
         void View2DWidget::improveImageFactor(const Image * im)
+            {
+            const auto t0 = std::chrono::steady_clock::now();
+            _improveImageFactor(im);
+            _improveTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+            }
+
+
+        void View2DWidget::overlayText(const std::string & txt)
+            {
+            if (txt == _overlay) return;
+            _overlay = txt;
+            redrawView();
+            }
+
+
+        void View2DWidget::_improveImageFactor(const Image * im)
             {
             if ((im == nullptr) || (im->isEmpty())) { setImage((const Image *)nullptr); _stocR.clear(); _nbRounds = 0; _discardIm = false; return; }
             _stocR = _RM->getRange(); // save the range for this image
@@ -507,7 +530,12 @@ namespace mtools
                         }
                     }
                 }
-            else { ImageWidget::draw(); } // redraw the whole thing otherwise
+            else
+                { // redraw the whole thing otherwise
+                const auto t0 = std::chrono::steady_clock::now();
+                ImageWidget::draw();
+                _drawTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+                }
             _zoom2 = { -1, -1 };
             _prevMouse = { -1, -1 };
             if (_RM == nullptr) { return; }
@@ -519,6 +547,26 @@ namespace mtools
                 fl_font(FL_HELVETICA, 12);
                 fl_draw((std::string("[") + toString(((int64)_zoomFactor)*w()) + " x " + toString(((int64)_zoomFactor)*h()) + "]").c_str(), w()-100, 20);
                 }
+            if (_overlay.size() > 0)
+                { // overlay text in the lower left corner
+                std::vector<std::string> lines;
+                size_t p = 0;
+                while (p <= _overlay.size())
+                    {
+                    size_t q = _overlay.find('\n', p); if (q == std::string::npos) q = _overlay.size();
+                    lines.push_back(_overlay.substr(p, q - p));
+                    p = q + 1;
+                    }
+                fl_font(FL_COURIER, 11);
+                int lw = 0;
+                for (auto & l : lines) { lw = std::max<int>(lw, (int)fl_width(l.c_str())); }
+                const int lh = 13;
+                const int y0 = h() - 5 - lh*(int)lines.size() - 6;
+                fl_color(FL_BLACK);
+                fl_rectf(5, y0, lw + 10, lh*(int)lines.size() + 6);
+                fl_color(FL_WHITE);
+                for (size_t i = 0; i < lines.size(); i++) { fl_draw(lines[i].c_str(), 10, y0 + 3 + lh*(int)(i + 1) - 3); }
+                }
             if (_isIn(_currentMouse))
                 {
                 if (_crossOn)
@@ -570,6 +570,7 @@ namespace mtools
         void WatchWindow::remove(const std::string & name)
             {
             createIfNeeded();
+            if (_fltkobj == nullptr) { return; }
             mtools::IndirectMemberProc<FltkWatchWin, const std::string &, bool> proxy((*_fltkobj), &FltkWatchWin::remove, name,true);
             mtools::runInFltkThread(proxy);
             _nb--;
@@ -590,8 +591,9 @@ namespace mtools
 
         void WatchWindow::refreshRate(const std::string & name, int newrate)
             {
-            if (fltkThreadStopped()) return;
+            if ((fltkThreadStopped()) || (isHeadless())) return;
             createIfNeeded();
+            if (_fltkobj == nullptr) { return; }
             mtools::IndirectMemberProc<FltkWatchWin, const std::string &, int> proxy((*_fltkobj), &FltkWatchWin::refreshRate, name, newrate);
             mtools::runInFltkThread(proxy);
             }
@@ -605,7 +607,7 @@ namespace mtools
 
         void WatchWindow::transmit(const std::string & name, internals_watch::WatchObj * p)
             {
-            if (fltkThreadStopped()) return;
+            if ((fltkThreadStopped()) || (_fltkobj == nullptr)) { delete p; return; } // no window to display the object
             _nb++;
             mtools::IndirectMemberProc<FltkWatchWin, const std::string &, WatchObj* > proxy((*_fltkobj), &FltkWatchWin::add, name, p);
             mtools::runInFltkThread(proxy);
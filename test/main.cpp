@@ -36,6 +36,34 @@ using namespace mtools;
 
 
 
+/* regression test for Grid_factor::loadBox(): a uniform cluster around the origin is saved as
+ * special sub-boxes which must replace the base node created when loading */
+bool testGridLoadBox()
+	{
+	Grid_factor<2, int, 3, 2> G(0, 2);
+	for (int64 x = -200; x <= 200; x++) for (int64 y = -200; y <= 200; y++) { G.set({ x, y }, 1); }
+	G.set({ 150, 150 }, 3);
+	if (!G.saveIndexed("testloadbox.grid")) { cout << "testGridLoadBox: saveIndexed() failed\n"; return false; }
+	bool ok = true;
+	const iBox2 boxes[2] = { iBox2(-3, 3, -3, 3), iBox2(-300, 300, -300, 300) };
+	for (const iBox2 & B : boxes)
+		{
+		Grid_factor<2, int, 3, 2> H;
+		if (!H.loadBox("testloadbox.grid", B)) { ok = false; break; }
+		const iBox2 C = intersectionRect(B, iBox2(-200, 200, -200, 200));
+		for (int64 x = C.min[0]; x <= C.max[0]; x++) for (int64 y = C.min[1]; y <= C.max[1]; y++)
+			{
+			const int * p = H.peek({ x, y });
+			if ((p == nullptr) || (*p != G.get({ x, y }))) { ok = false; }
+			}
+		}
+	std::remove("testloadbox.grid");
+	cout << "testGridLoadBox: " << (ok ? "ok" : "FAILED") << "\n";
+	return ok;
+	}
+
+
+
 void testplotfigure()
 	{
 	MT2004_64 gen;
@@ -662,6 +690,7 @@ int main(int argc, char *argv[])
 {
 	MTOOLS_SWAP_THREADS(argc, argv);         // required on OSX, does nothing on Linux/Windows
 
+	testGridLoadBox();
 	testplotfigure();
 	return 0;
 